@@ -576,7 +576,7 @@ static void publish_chanspy_message(struct ast_channel *spyer,
 	if (!message) {
 		return;
 	}
-	stasis_publish(ast_channel_topic(spyer), message);
+	ast_channel_publish_message(spyer, message);
 }
 
 static int attach_barge(struct ast_autochan *spyee_autochan,
@@ -873,6 +873,7 @@ static int common_exec(struct ast_channel *chan, struct ast_flags *flags,
 	int waitms;
 	int res;
 	int num_spyed_upon = 1;
+	int filter_prefix;
 	struct ast_channel_iterator *iter = NULL;
 
 	if (ast_test_flag(flags, OPTION_EXIT)) {
@@ -919,20 +920,24 @@ static int common_exec(struct ast_channel *chan, struct ast_flags *flags,
 		}
 
 		/* Set up the iterator we'll be using during this call */
-		if (!ast_strlen_zero(spec)) {
-			if (ast_test_flag(flags, OPTION_UNIQUEID)) {
-				struct ast_channel *unique_chan;
+		filter_prefix = 0;
+		if (!ast_strlen_zero(spec) && ast_test_flag(flags, OPTION_UNIQUEID)) {
+			struct ast_channel *unique_chan;
 
-				unique_chan = ast_channel_get_by_name(spec);
-				if (!unique_chan) {
-					res = -1;
-					goto exit;
-				}
-				iter = ast_channel_iterator_by_name_new(ast_channel_name(unique_chan), 0);
-				ast_channel_unref(unique_chan);
-			} else {
-				iter = ast_channel_iterator_by_name_new(spec, strlen(spec));
+			unique_chan = ast_channel_get_by_name(spec);
+			if (!unique_chan) {
+				res = -1;
+				goto exit;
 			}
+			iter = ast_channel_iterator_by_name_new(ast_channel_name(unique_chan), 0);
+			ast_channel_unref(unique_chan);
+		} else if (mygroup && !ast_test_flag(flags, OPTION_DAHDI_SCAN)
+			&& (!ast_strlen_zero(spec) || ast_strlen_zero(exten))) {
+			/* Only the channels in the groups, usually far fewer than match the prefix */
+			iter = ast_channel_iterator_by_spygroup_new(mygroup);
+			filter_prefix = !ast_strlen_zero(spec);
+		} else if (!ast_strlen_zero(spec)) {
+			iter = ast_channel_iterator_by_name_new(spec, strlen(spec));
 		} else if (!ast_strlen_zero(exten)) {
 			iter = ast_channel_iterator_by_exten_new(exten, context);
 		} else {
@@ -984,6 +989,10 @@ static int common_exec(struct ast_channel *chan, struct ast_flags *flags,
 				break;
 			}
 
+			if (filter_prefix && strncasecmp(ast_channel_name(autochan->chan), spec, strlen(spec))) {
+				continue;
+			}
+
 			if (ast_test_flag(flags, OPTION_BRIDGED) && !ast_channel_is_bridged(autochan->chan)) {
 				continue;
 			}
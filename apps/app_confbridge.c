@@ -71,6 +71,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/stasis_bridges.h"
 #include "asterisk/json.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/dial.h"
 
 /*** DOCUMENTATION
 	<application name="ConfBridge" language="en_US">
@@ -470,7 +471,7 @@ static void send_conf_stasis(struct confbridge_conference *conference, struct as
 	}
 
 	if (channel_topic) {
-		stasis_publish(ast_channel_topic(chan), msg);
+		ast_channel_publish_message(chan, msg);
 	} else {
 		stasis_publish(ast_bridge_topic(conference->bridge), msg);
 	}
@@ -724,6 +725,154 @@ static int conf_start_record(struct confbridge_conference *conference)
 	return 0;
 }
 
+/*! \brief How long to wait for the link to another node to answer, in milliseconds */
+#define CASCADE_DIAL_TIMEOUT 30000
+
+/*! \brief How long to wait before dialing a failed link again, in seconds */
+#define CASCADE_RETRY_INTERVAL 5
+
+/*!
+ * \internal
+ * \brief Dial the conference on another node
+ *
+ * \param conference The conference to link
+ *
+ * \return The answered channel, or NULL if it was not answered
+ */
+static struct ast_channel *conf_cascade_dial(struct confbridge_conference *conference)
+{
+	char *tech = ast_strdupa(conference->b_profile.cascade_to);
+	char *resource = strchr(tech, '/');
+	struct ast_channel *chan = NULL;
+	struct ast_dial *dial;
+
+	*resource++ = '\0';
+
+	dial = ast_dial_create();
+	if (!dial) {
+		return NULL;
+	}
+
+	if (!ast_dial_append(dial, tech, resource, NULL)) {
+		ast_dial_set_global_timeout(dial, CASCADE_DIAL_TIMEOUT);
+		if (ast_dial_run(dial, NULL, 0) == AST_DIAL_RESULT_ANSWERED) {
+			chan = ast_dial_answered_steal(dial);
+		}
+	}
+	ast_dial_destroy(dial);
+
+	return chan;
+}
+
+/*!
+ * \internal
+ * \brief Keep the conference linked to another node until it ends
+ *
+ * \param data The conference, whose reference this thread owns
+ */
+static void *conf_cascade_thread(void *data)
+{
+	struct confbridge_conference *conference = data;
+	int stopped = 0;
+
+	while (!stopped) {
+		struct ast_bridge_features features;
+		struct ast_channel *chan;
+		int wait;
+
+		chan = conf_cascade_dial(conference);
+
+		ao2_lock(conference);
+		stopped = conference->cascade_stopped;
+		if (!stopped && chan) {
+			conference->cascade_chan = ast_channel_ref(chan);
+		}
+		ao2_unlock(conference);
+
+		if (chan && !stopped) {
+			ast_debug(1, "Conference '%s' linked to '%s'\n", conference->name,
+				conference->b_profile.cascade_to);
+
+			/* The link carries the other node's talkers, so it must always be mixed */
+			if (!ast_bridge_features_init(&features)) {
+				ast_set_flag(&features.feature_flags,
+					AST_BRIDGE_CHANNEL_FLAG_IMMOVABLE | AST_BRIDGE_CHANNEL_FLAG_CASCADE);
+				ast_bridge_join(conference->bridge, chan, NULL, &features, NULL, 0);
+			}
+			ast_bridge_features_cleanup(&features);
+
+			ao2_lock(conference);
+			conference->cascade_chan = NULL;
+			stopped = conference->cascade_stopped;
+			ao2_unlock(conference);
+			ast_channel_unref(chan);
+		}
+		if (chan) {
+			ast_hangup(chan);
+		}
+
+		for (wait = 0; !stopped && wait < CASCADE_RETRY_INTERVAL; ++wait) {
+			sleep(1);
+			ao2_lock(conference);
+			stopped = conference->cascade_stopped;
+			ao2_unlock(conference);
+		}
+		if (!stopped) {
+			ast_log(LOG_NOTICE, "Dialing the link of conference '%s' to '%s' again\n",
+				conference->name, conference->b_profile.cascade_to);
+		}
+	}
+
+	ao2_ref(conference, -1);
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start linking the conference to another node
+ *
+ * \param conference The conference to link
+ *
+ * \note Must be called with the conference locked
+ *
+ * \retval 0 success
+ * \retval non-zero failure
+ */
+static int conf_start_cascade(struct confbridge_conference *conference)
+{
+	pthread_t thread;
+
+	if (!strchr(conference->b_profile.cascade_to, '/')) {
+		ast_log(LOG_WARNING, "Cannot link conference '%s', cascade_to '%s' is not Tech/resource\n",
+			conference->name, conference->b_profile.cascade_to);
+		return -1;
+	}
+
+	ao2_ref(conference, +1);
+	if (ast_pthread_create_detached(&thread, NULL, conf_cascade_thread, conference)) {
+		ao2_ref(conference, -1);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Stop linking the conference to another node
+ *
+ * \param conference The conference to unlink
+ *
+ * \note Must be called with the conference locked
+ */
+static void conf_stop_cascade(struct confbridge_conference *conference)
+{
+	conference->cascade_stopped = 1;
+	if (conference->cascade_chan) {
+		ast_softhangup(conference->cascade_chan, AST_SOFTHANGUP_EXPLICIT);
+	}
+}
+
 /* \brief Playback the given filename and monitor for any dtmf interrupts.
  *
  * This function is used to playback sound files on a given channel and optionally
@@ -1199,6 +1348,7 @@ void conf_ended(struct confbridge_conference *conference)
 	send_conf_end_event(conference);
 	ao2_lock(conference);
 	conf_stop_record(conference);
+	conf_stop_cascade(conference);
 	ao2_unlock(conference);
 }
 
@@ -1227,8 +1377,8 @@ static struct confbridge_conference *join_conference_bridge(const char *conferen
 		max_members_reached = conference->b_profile.max_members > conference->activeusers ? 0 : 1;
 	}
 
-	/* When finding a conference bridge that already exists make sure that it is not locked, and if so that we are not an admin */
-	if (conference && (max_members_reached || conference->locked) && !ast_test_flag(&user->u_profile, USER_OPT_ADMIN)) {
+	/* When finding a conference bridge that already exists make sure that it is not locked, and if so that we are not an admin or a link from another node */
+	if (conference && (max_members_reached || conference->locked) && !ast_test_flag(&user->u_profile, USER_OPT_ADMIN | USER_OPT_CASCADE)) {
 		ao2_unlock(conference_bridges);
 		ao2_ref(conference, -1);
 		ast_debug(1, "Conference '%s' is locked and caller is not an admin\n", conference_name);
@@ -1278,6 +1428,12 @@ static struct confbridge_conference *join_conference_bridge(const char *conferen
 		ast_bridge_set_internal_sample_rate(conference->bridge, conference->b_profile.internal_sample_rate);
 		/* Set the internal mixing interval on the bridge from the bridge profile */
 		ast_bridge_set_mixing_interval(conference->bridge, conference->b_profile.mix_interval);
+		/* Set the number of threads writing the mixed audio from the bridge profile */
+		ast_bridge_set_mixing_threads(conference->bridge, conference->b_profile.mixing_threads);
+		/* Set the limit on mixed talkers from the bridge profile */
+		ast_bridge_set_max_talkers(conference->bridge, conference->b_profile.max_talkers);
+		/* Set the quality of resampling participants from the bridge profile */
+		ast_bridge_set_resample_quality(conference->bridge, conference->b_profile.resample_quality);
 
 		if (ast_test_flag(&conference->b_profile, BRIDGE_OPT_VIDEO_SRC_FOLLOW_TALKER)) {
 			ast_bridge_set_talker_src_video_mode(conference->bridge);
@@ -1302,6 +1458,12 @@ static struct confbridge_conference *join_conference_bridge(const char *conferen
 			ao2_unlock(conference);
 		}
 
+		if (!ast_strlen_zero(conference->b_profile.cascade_to)) {
+			ao2_lock(conference);
+			conf_start_cascade(conference);
+			ao2_unlock(conference);
+		}
+
 		send_conf_start_event(conference);
 		ast_debug(1, "Created conference '%s' and linked to container.\n", conference_name);
 	}
@@ -1673,6 +1835,13 @@ static int confbridge_exec(struct ast_channel *chan, const char *data)
 		goto confbridge_cleanup;
 	}
 
+	/* A link from another node carries that node's mix and hears no prompts */
+	if (ast_test_flag(&user.u_profile, USER_OPT_CASCADE)) {
+		ast_set_flag(&user.u_profile, USER_OPT_QUIET);
+		ast_clear_flag(&user.u_profile, USER_OPT_ANNOUNCEUSERCOUNT | USER_OPT_ANNOUNCEUSERCOUNTALL);
+		ast_set_flag(&user.features.feature_flags, AST_BRIDGE_CHANNEL_FLAG_CASCADE);
+	}
+
 	quiet = ast_test_flag(&user.u_profile, USER_OPT_QUIET);
 
 	/* ask for a PIN immediately after finding user profile.  This has to be
@@ -1751,6 +1920,10 @@ static int confbridge_exec(struct ast_channel *chan, const char *data)
 		user.tech_args.drop_silence = 1;
 	}
 
+	if (ast_test_flag(&user.u_profile, USER_OPT_LISTEN_ONLY)) {
+		user.tech_args.listen_only = 1;
+	}
+
 	if (ast_test_flag(&user.u_profile, USER_OPT_JITTERBUFFER)) {
 		char *func_jb;
 		if ((func_jb = ast_module_helper("", "func_jitterbuffer", 0, 0, 0, 0))) {
@@ -2419,6 +2592,43 @@ static void handle_cli_confbridge_list_item(struct ast_cli_args *a, struct confb
 			ast_channel_caller(user->chan)->id.number.str, "<unknown>"));
 }
 
+/*!
+ * \internal
+ * \brief Show the sample rates the active users are mixed at
+ *
+ * \note Must be called with the conference locked
+ */
+static void handle_cli_confbridge_list_planes(struct ast_cli_args *a, struct confbridge_conference *conference)
+{
+	unsigned int rates[8] = { 0, };
+	unsigned int users[ARRAY_LEN(rates)] = { 0, };
+	struct confbridge_user *user;
+	unsigned int rate;
+	int idx;
+
+	/* The bridge writes to each user at the rate it mixes them at */
+	AST_LIST_TRAVERSE(&conference->active_list, user, list) {
+		ast_channel_lock(user->chan);
+		rate = ast_format_get_sample_rate(ast_channel_writeformat(user->chan));
+		ast_channel_unlock(user->chan);
+		for (idx = 0; idx < ARRAY_LEN(rates); ++idx) {
+			if (!rates[idx] || rates[idx] == rate) {
+				rates[idx] = rate;
+				users[idx]++;
+				break;
+			}
+		}
+	}
+	if (!rates[0]) {
+		return;
+	}
+
+	ast_cli(a->fd, "\nMixing Planes:\n");
+	for (idx = 0; idx < ARRAY_LEN(rates) && rates[idx]; ++idx) {
+		ast_cli(a->fd, "  %6u Hz %6u users\n", rates[idx], users[idx]);
+	}
+}
+
 static char *handle_cli_confbridge_list(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct confbridge_conference *conference;
@@ -2479,6 +2689,7 @@ static char *handle_cli_confbridge_list(struct ast_cli_entry *e, int cmd, struct
 		AST_LIST_TRAVERSE(&conference->waiting_list, user, list) {
 			handle_cli_confbridge_list_item(a, user, 1);
 		}
+		handle_cli_confbridge_list_planes(a, conference);
 		ao2_unlock(conference);
 		ao2_ref(conference, -1);
 		return CLI_SUCCESS;
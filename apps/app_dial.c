@@ -1179,6 +1179,7 @@ static struct ast_channel *wait_for_answer(struct ast_channel *in,
 			if (ast_test_flag64(o, DIAL_STILLGOING) && ast_channel_state(c) == AST_STATE_UP) {
 				if (!peer) {
 					ast_verb(3, "%s answered %s\n", ast_channel_name(c), ast_channel_name(in));
+					ast_channel_setup_stage_mark(in, AST_CHANNEL_SETUP_ANSWERED);
 					if (o->orig_chan_name
 						&& strcmp(o->orig_chan_name, ast_channel_name(c))) {
 						/*
@@ -1279,6 +1280,7 @@ static struct ast_channel *wait_for_answer(struct ast_channel *in,
 					/* This is our guy if someone answered. */
 					if (!peer) {
 						ast_verb(3, "%s answered %s\n", ast_channel_name(c), ast_channel_name(in));
+						ast_channel_setup_stage_mark(in, AST_CHANNEL_SETUP_ANSWERED);
 						if (o->orig_chan_name
 							&& strcmp(o->orig_chan_name, ast_channel_name(c))) {
 							/*
@@ -1373,6 +1375,7 @@ static struct ast_channel *wait_for_answer(struct ast_channel *in,
 					 * fine for ringing frames to get sent through.
 					 */
 					++num_ringing;
+					ast_channel_setup_stage_mark(in, AST_CHANNEL_SETUP_RINGING);
 					if (ignore_cc || cc_frame_received || num_ringing == numlines) {
 						ast_verb(3, "%s is ringing\n", ast_channel_name(c));
 						/* Setup early media if appropriate */
@@ -1388,6 +1391,7 @@ static struct ast_channel *wait_for_answer(struct ast_channel *in,
 					break;
 				case AST_CONTROL_PROGRESS:
 					ast_verb(3, "%s is making progress passing it to %s\n", ast_channel_name(c), ast_channel_name(in));
+					ast_channel_setup_stage_mark(in, AST_CHANNEL_SETUP_RINGING);
 					/* Setup early media if appropriate */
 					if (single && !caller_entertained
 						&& CAN_EARLY_BRIDGE(peerflags, in, c)) {
@@ -2337,6 +2341,8 @@ static int dial_exec_full(struct ast_channel *chan, const char *data, struct ast
 		ast_app_exec_sub(NULL, chan, opt_args[OPT_ARG_PREDIAL_CALLER], 0);
 	}
 
+	ast_channel_setup_stage_mark(chan, AST_CHANNEL_SETUP_DIAL);
+
 	/* loop through the list of dial destinations */
 	rest = args.peers;
 	while ((cur = strsep(&rest, "&")) ) {
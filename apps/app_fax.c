@@ -273,7 +273,7 @@ static void phase_e_handler(t30_state_t *f, void *user_data, int result)
 	if (!message) {
 		return;
 	}
-	stasis_publish(ast_channel_topic(s->chan), message);
+	ast_channel_publish_message(s->chan, message);
 }
 
 /* === Helper functions to configure fax === */
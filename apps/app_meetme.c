@@ -1392,7 +1392,7 @@ static void meetme_stasis_generate_msg(struct ast_conference *meetme_conference,
 		return;
 	}
 
-	stasis_publish(ast_channel_topic(chan), msg);
+	ast_channel_publish_message(chan, msg);
 }
 
 static int admin_exec(struct ast_channel *chan, const char *data);
@@ -59,6 +59,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/mixmonitor.h"
 #include "asterisk/format_cache.h"
 #include "asterisk/beep.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/taskprocessor.h"
 
 /*** DOCUMENTATION
 	<application name="MixMonitor" language="en_US">
@@ -267,6 +269,15 @@ ASTERISK_REGISTER_FILE()
 				<para>The piece of data to retrieve from the MixMonitor.</para>
 				<enumlist>
 					<enum name="filename" />
+					<enum name="backlog">
+						<para>The number of frames waiting to be written to the recording.</para>
+					</enum>
+					<enum name="backlog_max">
+						<para>The most frames that have been waiting to be written at once.</para>
+					</enum>
+					<enum name="dropped">
+						<para>The number of frames dropped because too many were waiting.</para>
+					</enum>
 				</enumlist>
 			</parameter>
 		</syntax>
@@ -282,6 +293,12 @@ static const char * const stop_app = "StopMixMonitor";
 
 static const char * const mixmonitor_spy_type = "MixMonitor";
 
+/*! \brief Threads writing the recordings, so a slow disk does not hold up the audiohooks */
+static struct ast_threadpool *writer_pool;
+
+/*! \brief Frames a recording may have waiting to be written before more are dropped */
+#define MAX_WRITE_BACKLOG 3000
+
 /*!
  * \internal
  * \brief This struct is a list item holds data needed to find a vm_recipient within voicemail
@@ -378,6 +395,12 @@ struct mixmonitor_ds {
 
 	struct ast_audiohook *audiohook;
 
+	/* Frames queued for the writer and not yet written */
+	unsigned int backlog;
+	unsigned int backlog_max;
+	unsigned int dropped;
+	ast_cond_t backlog_condition;
+
 	unsigned int samp_rate;
 	char *filename;
 	char *beep_id;
@@ -530,6 +553,7 @@ static void mixmonitor_free(struct mixmonitor *mixmonitor)
 		if (mixmonitor->mixmonitor_ds) {
 			ast_mutex_destroy(&mixmonitor->mixmonitor_ds->lock);
 			ast_cond_destroy(&mixmonitor->mixmonitor_ds->destruction_condition);
+			ast_cond_destroy(&mixmonitor->mixmonitor_ds->backlog_condition);
 			ast_free(mixmonitor->mixmonitor_ds);
 		}
 
@@ -619,6 +643,114 @@ static void mixmonitor_save_prep(struct mixmonitor *mixmonitor, char *filename,
 	}
 }
 
+/*!
+ * \internal
+ * \pre mixmonitor_ds must be locked before calling this function
+ */
+static void mixmonitor_write_frames(struct mixmonitor_ds *mixmonitor_ds, struct ast_frame *fr,
+	struct ast_frame *fr_read, struct ast_frame *fr_write)
+{
+	struct ast_frame *cur;
+
+	if (mixmonitor_ds->fs_read && fr_read) {
+		for (cur = fr_read; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			ast_writestream(mixmonitor_ds->fs_read, cur);
+		}
+	}
+
+	if (mixmonitor_ds->fs_write && fr_write) {
+		for (cur = fr_write; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			ast_writestream(mixmonitor_ds->fs_write, cur);
+		}
+	}
+
+	if (mixmonitor_ds->fs && fr) {
+		for (cur = fr; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			ast_writestream(mixmonitor_ds->fs, cur);
+		}
+	}
+}
+
+/*! \brief Frames read from the audiohook, waiting to be written */
+struct mixmonitor_write {
+	struct mixmonitor_ds *mixmonitor_ds;
+	struct ast_frame *fr;
+	struct ast_frame *fr_read;
+	struct ast_frame *fr_write;
+};
+
+static int mixmonitor_write_task(void *data)
+{
+	struct mixmonitor_write *write = data;
+	struct mixmonitor_ds *mixmonitor_ds = write->mixmonitor_ds;
+
+	ast_mutex_lock(&mixmonitor_ds->lock);
+	mixmonitor_write_frames(mixmonitor_ds, write->fr, write->fr_read, write->fr_write);
+	if (!--mixmonitor_ds->backlog) {
+		ast_cond_signal(&mixmonitor_ds->backlog_condition);
+	}
+	/* The datastore may be gone as soon as it is unlocked */
+	ast_mutex_unlock(&mixmonitor_ds->lock);
+
+	if (write->fr) {
+		ast_frame_free(write->fr, 0);
+	}
+	if (write->fr_read) {
+		ast_frame_free(write->fr_read, 0);
+	}
+	if (write->fr_write) {
+		ast_frame_free(write->fr_write, 0);
+	}
+	ast_free(write);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue frames to be written by the writer threads
+ *
+ * \retval 0 if the writer now owns the frames
+ * \retval -1 if they were not queued, and are still the caller's to free
+ */
+static int mixmonitor_queue_write(struct mixmonitor *mixmonitor, struct ast_taskprocessor *writer,
+	struct ast_frame *fr, struct ast_frame *fr_read, struct ast_frame *fr_write)
+{
+	struct mixmonitor_ds *mixmonitor_ds = mixmonitor->mixmonitor_ds;
+	struct mixmonitor_write *write;
+
+	if (!(write = ast_malloc(sizeof(*write)))) {
+		return -1;
+	}
+	write->mixmonitor_ds = mixmonitor_ds;
+	write->fr = fr;
+	write->fr_read = fr_read;
+	write->fr_write = fr_write;
+
+	ast_mutex_lock(&mixmonitor_ds->lock);
+	if (mixmonitor_ds->backlog >= MAX_WRITE_BACKLOG) {
+		if (!mixmonitor_ds->dropped++) {
+			ast_log(LOG_WARNING, "MixMonitor %s is too far behind writing its recording, dropping audio\n",
+				mixmonitor->name);
+		}
+		ast_mutex_unlock(&mixmonitor_ds->lock);
+		ast_free(write);
+		return -1;
+	}
+	mixmonitor_ds->backlog_max = MAX(mixmonitor_ds->backlog_max, ++mixmonitor_ds->backlog);
+	ast_mutex_unlock(&mixmonitor_ds->lock);
+
+	if (ast_taskprocessor_push(writer, mixmonitor_write_task, write)) {
+		ast_mutex_lock(&mixmonitor_ds->lock);
+		if (!--mixmonitor_ds->backlog) {
+			ast_cond_signal(&mixmonitor_ds->backlog_condition);
+		}
+		ast_mutex_unlock(&mixmonitor_ds->lock);
+		ast_free(write);
+		return -1;
+	}
+	return 0;
+}
+
 static void *mixmonitor_thread(void *obj)
 {
 	struct mixmonitor *mixmonitor = obj;
@@ -633,6 +765,8 @@ static void *mixmonitor_thread(void *obj)
 	unsigned int oflags;
 	int errflag = 0;
 	struct ast_format *format_slin;
+	struct ast_taskprocessor *writer = NULL;
+	char writer_name[64];
 
 	/* Keep callid association before any log messages */
 	if (mixmonitor->callid) {
@@ -641,6 +775,12 @@ static void *mixmonitor_thread(void *obj)
 
 	ast_verb(2, "Begin MixMonitor Recording %s\n", mixmonitor->name);
 
+	/* Without a writer the frames are written by this thread */
+	snprintf(writer_name, sizeof(writer_name), "mixmonitor/%p", mixmonitor->mixmonitor_ds);
+	if (writer_pool) {
+		writer = ast_threadpool_serializer(writer_name, writer_pool);
+	}
+
 	fs = &mixmonitor->mixmonitor_ds->fs;
 	fs_read = &mixmonitor->mixmonitor_ds->fs_read;
 	fs_write = &mixmonitor->mixmonitor_ds->fs_write;
@@ -678,33 +818,14 @@ static void *mixmonitor_thread(void *obj)
 		if (!ast_test_flag(mixmonitor, MUXFLAG_BRIDGED)
 			|| (mixmonitor->autochan->chan
 				&& ast_channel_is_bridged(mixmonitor->autochan->chan))) {
-			ast_mutex_lock(&mixmonitor->mixmonitor_ds->lock);
-
 			/* Write out the frame(s) */
-			if ((*fs_read) && (fr_read)) {
-				struct ast_frame *cur;
-
-				for (cur = fr_read; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
-					ast_writestream(*fs_read, cur);
-				}
-			}
-
-			if ((*fs_write) && (fr_write)) {
-				struct ast_frame *cur;
-
-				for (cur = fr_write; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
-					ast_writestream(*fs_write, cur);
-				}
-			}
-
-			if ((*fs) && (fr)) {
-				struct ast_frame *cur;
-
-				for (cur = fr; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
-					ast_writestream(*fs, cur);
-				}
+			if (writer && !mixmonitor_queue_write(mixmonitor, writer, fr, fr_read, fr_write)) {
+				fr = fr_read = fr_write = NULL;
+			} else if (!writer) {
+				ast_mutex_lock(&mixmonitor->mixmonitor_ds->lock);
+				mixmonitor_write_frames(mixmonitor->mixmonitor_ds, fr, fr_read, fr_write);
+				ast_mutex_unlock(&mixmonitor->mixmonitor_ds->lock);
 			}
-			ast_mutex_unlock(&mixmonitor->mixmonitor_ds->lock);
 		}
 		/* All done! free it. */
 		if (fr) {
@@ -734,14 +855,19 @@ static void *mixmonitor_thread(void *obj)
 
 	ast_autochan_destroy(mixmonitor->autochan);
 
-	/* Datastore cleanup.  close the filestream and wait for ds destruction */
+	/* Datastore cleanup.  finish writing, close the filestream and wait for ds destruction */
 	ast_mutex_lock(&mixmonitor->mixmonitor_ds->lock);
+	while (mixmonitor->mixmonitor_ds->backlog) {
+		ast_cond_wait(&mixmonitor->mixmonitor_ds->backlog_condition, &mixmonitor->mixmonitor_ds->lock);
+	}
 	mixmonitor_ds_close_fs(mixmonitor->mixmonitor_ds);
 	if (!mixmonitor->mixmonitor_ds->destruction_ok) {
 		ast_cond_wait(&mixmonitor->mixmonitor_ds->destruction_condition, &mixmonitor->mixmonitor_ds->lock);
 	}
 	ast_mutex_unlock(&mixmonitor->mixmonitor_ds->lock);
 
+	ast_taskprocessor_unreference(writer);
+
 	/* kill the audiohook */
 	destroy_monitor_audiohook(mixmonitor);
 
@@ -794,10 +920,12 @@ static int setup_mixmonitor_ds(struct mixmonitor *mixmonitor, struct ast_channel
 
 	ast_mutex_init(&mixmonitor_ds->lock);
 	ast_cond_init(&mixmonitor_ds->destruction_condition, NULL);
+	ast_cond_init(&mixmonitor_ds->backlog_condition, NULL);
 
 	if (!(datastore = ast_datastore_alloc(&mixmonitor_ds_info, *datastore_id))) {
 		ast_mutex_destroy(&mixmonitor_ds->lock);
 		ast_cond_destroy(&mixmonitor_ds->destruction_condition);
+		ast_cond_destroy(&mixmonitor_ds->backlog_condition);
 		ast_free(mixmonitor_ds);
 		return -1;
 	}
@@ -1468,6 +1596,12 @@ static int func_mixmonitor_read(struct ast_channel *chan, const char *cmd, char
 
 	if (!strcasecmp(args.key, "filename")) {
 		ast_copy_string(buf, ds_data->filename, len);
+	} else if (!strcasecmp(args.key, "backlog")) {
+		snprintf(buf, len, "%u", ds_data->backlog);
+	} else if (!strcasecmp(args.key, "backlog_max")) {
+		snprintf(buf, len, "%u", ds_data->backlog_max);
+	} else if (!strcasecmp(args.key, "dropped")) {
+		snprintf(buf, len, "%u", ds_data->dropped);
 	} else {
 		ast_log(LOG_WARNING, "Unrecognized %s option %s\n", cmd, args.key);
 		return -1;
@@ -1512,13 +1646,28 @@ static int unload_module(void)
 	res |= ast_custom_function_unregister(&mixmonitor_function);
 	res |= clear_mixmonitor_methods();
 
+	ast_threadpool_shutdown(writer_pool);
+	writer_pool = NULL;
+
 	return res;
 }
 
 static int load_module(void)
 {
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 60,
+		.auto_increment = 1,
+		.initial_size = 2,
+		.max_size = 32,
+	};
 	int res;
 
+	/* Recordings are written by their own threads if the pool cannot be made */
+	if (!(writer_pool = ast_threadpool_create("mixmonitor-writer", NULL, &options))) {
+		ast_log(LOG_WARNING, "Unable to create MixMonitor writer threads\n");
+	}
+
 	ast_cli_register_multiple(cli_mixmonitor, ARRAY_LEN(cli_mixmonitor));
 	res = ast_register_application_xml(app, mixmonitor_exec);
 	res |= ast_register_application_xml(stop_app, stop_mixmonitor_exec);
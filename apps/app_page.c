@@ -52,6 +52,7 @@ ASTERISK_REGISTER_FILE()
 		<syntax>
 			<parameter name="Technology/Resource" required="true" argsep="&amp;">
 				<argument name="Technology/Resource" required="true">
+					<para>May be empty when the <literal>m</literal> option is given.</para>
 					<para>Specification of the device(s) to dial. These must be in the format of
 					<literal>Technology/Resource</literal>, where <replaceable>Technology</replaceable>
 					represents a particular channel driver, and <replaceable>Resource</replaceable> represents a resource
@@ -110,6 +111,23 @@ ASTERISK_REGISTER_FILE()
 					<option name="n">
 						<para>Do not play announcement to caller (alters <literal>A(x)</literal> behavior)</para>
 					</option>
+					<option name="m">
+						<argument name="destination" required="true">
+							<para>A <literal>MulticastRTP</literal> resource:
+							<replaceable>type</replaceable>/<replaceable>address:port</replaceable>[/<replaceable>control address:port</replaceable>],
+							where <replaceable>type</replaceable> is <literal>basic</literal> or <literal>linksys</literal>.
+							Further addresses, separated by <literal>+</literal>, are sent the same packets,
+							for devices that only take unicast RTP.</para>
+						</argument>
+						<para>Page the devices listening on a multicast group with a single
+						stream. The page is encoded once and sent to the group, however many
+						devices listen to it, rather than each device being called and
+						mixed for separately. The devices must already be set up to listen
+						to the group, or be told to by the control packets of the
+						<literal>linksys</literal> type. Devices given as
+						<replaceable>Technology/Resource</replaceable> are still called, and
+						may be left out.</para>
+					</option>
 				</optionlist>
 			</parameter>
 			<parameter name="timeout">
@@ -141,13 +159,15 @@ enum page_opt_flags {
 	PAGE_NOCALLERANNOUNCE = (1 << 6),
 	PAGE_PREDIAL_CALLEE = (1 << 7),
 	PAGE_PREDIAL_CALLER = (1 << 8),
+	PAGE_MULTICAST = (1 << 9),
 };
 
 enum {
 	OPT_ARG_ANNOUNCE = 0,
 	OPT_ARG_PREDIAL_CALLEE = 1,
 	OPT_ARG_PREDIAL_CALLER = 2,
-	OPT_ARG_ARRAY_SIZE = 3,
+	OPT_ARG_MULTICAST = 3,
+	OPT_ARG_ARRAY_SIZE = 4,
 };
 
 AST_APP_OPTIONS(page_opts, {
@@ -160,6 +180,7 @@ AST_APP_OPTIONS(page_opts, {
 	AST_APP_OPTION('i', PAGE_IGNORE_FORWARDS),
 	AST_APP_OPTION_ARG('A', PAGE_ANNOUNCE, OPT_ARG_ANNOUNCE),
 	AST_APP_OPTION('n', PAGE_NOCALLERANNOUNCE),
+	AST_APP_OPTION_ARG('m', PAGE_MULTICAST, OPT_ARG_MULTICAST),
 });
 
 /* We use this structure as a way to pass this to all dialed channels */
@@ -247,6 +268,63 @@ static void page_state_callback(struct ast_dial *dial)
 	setup_profile_paged(chan, options);
 }
 
+/*!
+ * \internal
+ * \brief Call a device to join the page.
+ *
+ * \param chan The paging channel.
+ * \param tech The technology of the device.
+ * \param resource The resource of the device.
+ * \param confbridgeopts The application the device runs once answered.
+ * \param predial_callee The Gosub the device runs before it is called, if any.
+ * \param timeout Seconds to wait for the device to answer, 0 for no limit.
+ * \param options The page options.
+ *
+ * \return The dial, running asynchronously.
+ * \retval NULL on error.
+ */
+static struct ast_dial *page_dial(struct ast_channel *chan, const char *tech, const char *resource,
+	const char *confbridgeopts, const char *predial_callee, int timeout, struct page_options *options)
+{
+	struct ast_dial *dial;
+
+	/* Create a dialing structure */
+	if (!(dial = ast_dial_create())) {
+		ast_log(LOG_WARNING, "Failed to create dialing structure.\n");
+		return NULL;
+	}
+
+	/* Append technology and resource */
+	if (ast_dial_append(dial, tech, resource, NULL) == -1) {
+		ast_log(LOG_ERROR, "Failed to add %s to outbound dial\n", tech);
+		ast_dial_destroy(dial);
+		return NULL;
+	}
+
+	/* Set ANSWER_EXEC as global option */
+	ast_dial_option_global_enable(dial, AST_DIAL_OPTION_ANSWER_EXEC, (void *) confbridgeopts);
+
+	if (predial_callee) {
+		ast_dial_option_global_enable(dial, AST_DIAL_OPTION_PREDIAL, (void *) predial_callee);
+	}
+
+	if (timeout) {
+		ast_dial_set_global_timeout(dial, timeout * 1000);
+	}
+
+	if (ast_test_flag(&options->flags, PAGE_IGNORE_FORWARDS)) {
+		ast_dial_option_global_enable(dial, AST_DIAL_OPTION_DISABLE_CALL_FORWARDING, NULL);
+	}
+
+	ast_dial_set_state_callback(dial, &page_state_callback);
+	ast_dial_set_user_data(dial, options);
+
+	/* Run this dial in async mode */
+	ast_dial_run(dial, chan, 1);
+
+	return dial;
+}
+
 static int page_exec(struct ast_channel *chan, const char *data)
 {
 	char *tech;
@@ -301,9 +379,9 @@ static int page_exec(struct ast_channel *chan, const char *data)
 
 	snprintf(confbridgeopts, sizeof(confbridgeopts), "ConfBridge,%u", confid);
 
-	/* Count number of extensions in list by number of ampersands + 1 */
-	num_dials = 1;
-	tmp = args.devices;
+	/* Count number of extensions in list by number of ampersands + 1, and the multicast stream */
+	num_dials = 2;
+	tmp = S_OR(args.devices, "");
 	while (*tmp) {
 		if (*tmp == '&') {
 			num_dials++;
@@ -332,7 +410,7 @@ static int page_exec(struct ast_channel *chan, const char *data)
 	}
 
 	/* Go through parsing/calling each device */
-	while ((tech = strsep(&args.devices, "&"))) {
+	while (!ast_strlen_zero(args.devices) && (tech = strsep(&args.devices, "&"))) {
 		int state = 0;
 		struct ast_dial *dial = NULL;
 
@@ -359,42 +437,23 @@ static int page_exec(struct ast_channel *chan, const char *data)
 
 		*resource++ = '\0';
 
-		/* Create a dialing structure */
-		if (!(dial = ast_dial_create())) {
-			ast_log(LOG_WARNING, "Failed to create dialing structure.\n");
+		if (!(dial = page_dial(chan, tech, resource, confbridgeopts, predial_callee, timeout, &options))) {
 			continue;
 		}
 
-		/* Append technology and resource */
-		if (ast_dial_append(dial, tech, resource, NULL) == -1) {
-			ast_log(LOG_ERROR, "Failed to add %s to outbound dial\n", tech);
-			ast_dial_destroy(dial);
-			continue;
-		}
-
-		/* Set ANSWER_EXEC as global option */
-		ast_dial_option_global_enable(dial, AST_DIAL_OPTION_ANSWER_EXEC, confbridgeopts);
-
-		if (predial_callee) {
-			ast_dial_option_global_enable(dial, AST_DIAL_OPTION_PREDIAL, predial_callee);
-		}
+		/* Put in our dialing array */
+		dial_list[pos++] = dial;
+	}
 
-		if (timeout) {
-			ast_dial_set_global_timeout(dial, timeout * 1000);
-		}
+	/* One stream for every device listening to the multicast group */
+	if (ast_test_flag(&options.flags, PAGE_MULTICAST)
+		&& !ast_strlen_zero(options.opts[OPT_ARG_MULTICAST])) {
+		struct ast_dial *dial;
 
-		if (ast_test_flag(&options.flags, PAGE_IGNORE_FORWARDS)) {
-			ast_dial_option_global_enable(dial, AST_DIAL_OPTION_DISABLE_CALL_FORWARDING, NULL);
+		if ((dial = page_dial(chan, "MulticastRTP", options.opts[OPT_ARG_MULTICAST],
+			confbridgeopts, NULL, timeout, &options))) {
+			dial_list[pos++] = dial;
 		}
-
-		ast_dial_set_state_callback(dial, &page_state_callback);
-		ast_dial_set_user_data(dial, &options);
-
-		/* Run this dial in async mode */
-		ast_dial_run(dial, chan, 1);
-
-		/* Put in our dialing array */
-		dial_list[pos++] = dial;
 	}
 
 	ast_free(predial_callee);
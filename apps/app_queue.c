@@ -991,6 +991,23 @@ ASTERISK_REGISTER_FILE()
 		</description>
 	</manager>
 
+	<manager name="QueueInvalidate" language="en_US">
+		<synopsis>
+			Reload cached realtime queues.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Queue">
+				<para>The name of the queue to reload. If not given, every realtime queue is reloaded.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>With <literal>realtime_refresh</literal> set in <filename>queues.conf</filename>,
+			realtime queues and their members are cached. This makes the next use of the queue
+			load it and all of its members from realtime.</para>
+		</description>
+	</manager>
+
 	<managerEvent language="en_US" name="QueueMemberStatus">
 		<managerEventInstance class="EVENT_FLAG_AGENT">
 			<synopsis>Raised when a Queue member's status has changed.</synopsis>
@@ -1374,6 +1391,9 @@ static const struct autopause {
 
 #define MAX_QUEUE_BUCKETS 53
 
+/*! \brief Buckets of the index from devices to the queues with members watching them */
+#define MAX_QUEUE_DEVICE_BUCKETS 4093
+
 #define	RES_OKAY	0		/*!< Action completed */
 #define	RES_EXISTS	(-1)		/*!< Entry already exists */
 #define	RES_OUTOFMEMORY	(-2)		/*!< Out of memory */
@@ -1425,6 +1445,15 @@ static int negative_penalty_invalid = 0;
 /*! \brief queues.conf [general] option */
 static int log_membername_as_agent = 0;
 
+/*! \brief queues.conf [general] option, seconds realtime queues are cached for, 0 to load them on every use */
+static int realtime_refresh = 0;
+
+/*! \brief queues.conf [general] option, seconds between full loads of cached realtime queues */
+static int realtime_full_refresh = 3600;
+
+/*! \brief queues.conf [general] option, the queue_members field that says when a member last changed */
+static char realtime_updated_field[80];
+
 /*! \brief name of the ringinuse field in the realtime database */
 static char *realtime_ringinuse_field;
 
@@ -1677,6 +1706,12 @@ struct call_queue {
 	int memberdelay;                    /*!< Seconds to delay connecting member to caller */
 	int autofill;                       /*!< Ignore the head call status and ring an available agent */
 
+	/* Cached realtime queues */
+	time_t rt_loaded;                   /*!< When the queue was last loaded from realtime */
+	time_t rt_members_loaded;           /*!< When all of the realtime members were last loaded */
+	time_t rt_refreshed;                /*!< When the realtime members were last refreshed */
+	char rt_updated[80];                /*!< Greatest realtime_updated_field of the members loaded */
+
 	struct ao2_container *members;             /*!< Head of the list of members */
 	struct queue_ent *head;             /*!< Head of the list of callers */
 	AST_LIST_ENTRY(call_queue) list;    /*!< Next call queue */
@@ -1693,6 +1728,93 @@ static AST_LIST_HEAD_STATIC(rule_lists, rule_list);
 
 static struct ao2_container *queues;
 
+/*!
+ * \brief A queue that has, or had, a member whose state_interface is a device
+ *
+ * Device state changes only look at the queues indexed for the device.
+ * Entries are added whenever a member with the device joins a queue or
+ * changes to it, and removed when a state change finds no such member.
+ */
+struct queue_device {
+	const char *queue;	/*!< Name of the queue, stored after the device */
+	char device[0];		/*!< Device as device state messages name it */
+};
+
+/*! \brief Index of queue_device, by device */
+static struct ao2_container *queue_devices;
+
+static int queue_device_hash_fn(const void *obj, const int flags)
+{
+	const struct queue_device *qd = obj;
+
+	return ast_str_case_hash((flags & OBJ_KEY) ? obj : qd->device);
+}
+
+static int queue_device_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct queue_device *qd = obj;
+	struct queue_device *qd2 = arg;
+
+	if (flags & OBJ_KEY) {
+		/* Every queue of the device */
+		return strcasecmp(qd->device, arg) ? 0 : CMP_MATCH;
+	}
+	return strcasecmp(qd->device, qd2->device) || strcasecmp(qd->queue, qd2->queue) ? 0 : CMP_MATCH | CMP_STOP;
+}
+
+/*!
+ * \internal
+ * \brief Get the device whose state changes a member follows
+ *
+ * \param state_interface The state_interface of the member
+ * \param device Where to put the device
+ * \param size Size of \a device
+ */
+static void member_state_device(const char *state_interface, char *device, size_t size)
+{
+	char *slash_pos;
+
+	ast_copy_string(device, state_interface, size);
+
+	if ((slash_pos = strchr(device, '/'))) {
+		if (!strncasecmp(device, "Local/", 6) && (slash_pos = strchr(slash_pos + 1, '/'))) {
+			*slash_pos = '\0';
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Index a queue as having a member following the device state of an interface
+ *
+ * \param q The queue
+ * \param state_interface The state_interface of the member
+ */
+static void queue_device_add(struct call_queue *q, const char *state_interface)
+{
+	struct queue_device *qd;
+	char device[AST_CHANNEL_NAME];
+	size_t device_len;
+
+	member_state_device(state_interface, device, sizeof(device));
+	device_len = strlen(device) + 1;
+
+	qd = ao2_alloc_options(sizeof(*qd) + device_len + strlen(q->name) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!qd) {
+		return;
+	}
+	strcpy(qd->device, device); /* Safe */
+	qd->queue = strcpy(qd->device + device_len, q->name); /* Safe */
+
+	ao2_lock(queue_devices);
+	if (!ao2_find(queue_devices, qd, OBJ_POINTER | OBJ_NOLOCK | OBJ_NODATA)) {
+		ao2_link_flags(queue_devices, qd, OBJ_NOLOCK);
+	}
+	ao2_unlock(queue_devices);
+	ao2_ref(qd, -1);
+}
+
 static void update_realtime_members(struct call_queue *q);
 static struct member *interface_exists(struct call_queue *q, const char *interface);
 static int set_member_paused(const char *queuename, const char *interface, const char *reason, int paused);
@@ -2089,21 +2211,20 @@ STASIS_MESSAGE_TYPE_DEFN_LOCAL(queue_agent_ringnoanswer_type,
 	.to_ami = queue_agent_ringnoanswer_to_ami,
 	);
 
-static void queue_publish_multi_channel_snapshot_blob(struct stasis_topic *topic,
+static struct stasis_message *queue_multi_channel_snapshot_blob_create(
 		struct ast_channel_snapshot *caller_snapshot,
 		struct ast_channel_snapshot *agent_snapshot,
 		struct stasis_message_type *type, struct ast_json *blob)
 {
 	RAII_VAR(struct ast_multi_channel_blob *, payload, NULL, ao2_cleanup);
-	RAII_VAR(struct stasis_message *, msg, NULL, ao2_cleanup);
 
 	if (!type) {
-		return;
+		return NULL;
 	}
 
 	payload = ast_multi_channel_blob_create(blob);
 	if (!payload) {
-		return;
+		return NULL;
 	}
 
 	ast_multi_channel_blob_add_channel(payload, "caller", caller_snapshot);
@@ -2111,12 +2232,7 @@ static void queue_publish_multi_channel_snapshot_blob(struct stasis_topic *topic
 		ast_multi_channel_blob_add_channel(payload, "agent", agent_snapshot);
 	}
 
-	msg = stasis_message_create(type, payload);
-	if (!msg) {
-		return;
-	}
-
-	stasis_publish(topic, msg);
+	return stasis_message_create(type, payload);
 }
 
 static void queue_publish_multi_channel_blob(struct ast_channel *caller, struct ast_channel *agent,
@@ -2124,6 +2240,7 @@ static void queue_publish_multi_channel_blob(struct ast_channel *caller, struct
 {
 	RAII_VAR(struct ast_channel_snapshot *, caller_snapshot, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_channel_snapshot *, agent_snapshot, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, msg, NULL, ao2_cleanup);
 
 	ast_channel_lock(caller);
 	caller_snapshot = ast_channel_snapshot_create(caller);
@@ -2136,8 +2253,10 @@ static void queue_publish_multi_channel_blob(struct ast_channel *caller, struct
 		return;
 	}
 
-	queue_publish_multi_channel_snapshot_blob(ast_channel_topic(caller), caller_snapshot,
-			agent_snapshot, type, blob);
+	msg = queue_multi_channel_snapshot_blob_create(caller_snapshot, agent_snapshot, type, blob);
+	if (msg) {
+		ast_channel_publish_message(caller, msg);
+	}
 }
 
 /*!
@@ -2325,11 +2444,12 @@ static int is_member_available(struct call_queue *q, struct member *mem)
 /*! \brief set a member's status based on device state of that member's interface*/
 static void device_state_cb(void *unused, struct stasis_subscription *sub, struct stasis_message *msg)
 {
-	struct ao2_iterator miter, qiter;
+	struct ao2_iterator miter, *qditer;
 	struct ast_device_state_message *dev_state;
+	struct queue_device *qd;
 	struct member *m;
 	struct call_queue *q;
-	char interface[80], *slash_pos;
+	char interface[AST_CHANNEL_NAME];
 	int found = 0;			/* Found this member in any queue */
 	int found_member;		/* Found this member in this queue */
 	int avail = 0;			/* Found an available member in this queue */
@@ -2344,22 +2464,29 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		return;
 	}
 
-	qiter = ao2_iterator_init(queues, 0);
-	while ((q = ao2_t_iterator_next(&qiter, "Iterate over queues"))) {
+	/* Only the queues indexed for the device can have members following it */
+	qditer = ao2_find(queue_devices, dev_state->device, OBJ_KEY | OBJ_MULTIPLE);
+	while (qditer && (qd = ao2_iterator_next(qditer))) {
+		struct call_queue tmpq = {
+			.name = qd->queue,
+		};
+
+		if (!(q = ao2_t_find(queues, &tmpq, OBJ_POINTER, "Find queue of device"))) {
+			ao2_unlink(queue_devices, qd);
+			ao2_ref(qd, -1);
+			continue;
+		}
+
 		ao2_lock(q);
+		/* Members joining add themselves to the index with the members locked */
+		ao2_lock(q->members);
 
 		avail = 0;
 		found_member = 0;
 		miter = ao2_iterator_init(q->members, 0);
 		for (; (m = ao2_iterator_next(&miter)); ao2_ref(m, -1)) {
 			if (!found_member) {
-				ast_copy_string(interface, m->state_interface, sizeof(interface));
-
-				if ((slash_pos = strchr(interface, '/'))) {
-					if (!strncasecmp(interface, "Local/", 6) && (slash_pos = strchr(slash_pos + 1, '/'))) {
-						*slash_pos = '\0';
-					}
-				}
+				member_state_device(m->state_interface, interface, sizeof(interface));
 
 				if (!strcasecmp(interface, dev_state->device)) {
 					found_member = 1;
@@ -2385,14 +2512,21 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 			} else {
 				ast_devstate_changed(AST_DEVICE_INUSE, AST_DEVSTATE_CACHABLE, "Queue:%s_avail", q->name);
 			}
+		} else {
+			/* The members following the device have left the queue */
+			ao2_unlink(queue_devices, qd);
 		}
 
 		ao2_iterator_destroy(&miter);
 
+		ao2_unlock(q->members);
 		ao2_unlock(q);
-		queue_t_unref(q, "Done with iterator");
+		queue_t_unref(q, "Done with device's queue");
+		ao2_ref(qd, -1);
+	}
+	if (qditer) {
+		ao2_iterator_destroy(qditer);
 	}
-	ao2_iterator_destroy(&qiter);
 
 	if (found) {
 		ast_debug(1, "Device '%s' changed to state '%u' (%s)\n",
@@ -3120,6 +3254,7 @@ static void member_add_to_queue(struct call_queue *queue, struct member *mem)
 	ao2_lock(queue->members);
 	mem->queuepos = ao2_container_count(queue->members);
 	ao2_link(queue->members, mem);
+	queue_device_add(queue, mem->state_interface);
 	ast_devstate_changed(mem->paused ? QUEUE_PAUSED_DEVSTATE : QUEUE_UNPAUSED_DEVSTATE,
 		AST_DEVSTATE_CACHABLE, "Queue:%s_pause_%s", queue->name, mem->interface);
 	ao2_unlock(queue->members);
@@ -3206,6 +3341,7 @@ static void rt_handle_member_record(struct call_queue *q, char *interface, struc
 			}
 			if (strcasecmp(state_interface, m->state_interface)) {
 				ast_copy_string(m->state_interface, state_interface, sizeof(m->state_interface));
+				queue_device_add(q, m->state_interface);
 			}
 			m->penalty = penalty;
 			m->ringinuse = ringinuse;
@@ -3427,6 +3563,61 @@ static struct call_queue *find_queue_by_name_rt(const char *queuename, struct as
 /*!
  * note  */
 
+/*!
+ * \internal
+ * \brief Compare two values of realtime_updated_field
+ *
+ * Numbers compare as numbers, anything else (such as timestamps) as text.
+ */
+static int rt_updated_cmp(const char *a, const char *b)
+{
+	long long a_num, b_num;
+	char *a_end, *b_end;
+
+	a_num = strtoll(a, &a_end, 10);
+	b_num = strtoll(b, &b_end, 10);
+	if (*a && *b && !*a_end && !*b_end) {
+		return a_num < b_num ? -1 : a_num > b_num;
+	}
+	return strcmp(a, b);
+}
+
+/*!
+ * \internal
+ * \brief Note the greatest realtime_updated_field of loaded members
+ *
+ * \param q The queue, locked
+ * \param member_config The members loaded
+ */
+static void rt_note_updated(struct call_queue *q, struct ast_config *member_config)
+{
+	char *interface = NULL;
+	const char *updated;
+
+	if (ast_strlen_zero(realtime_updated_field)) {
+		return;
+	}
+
+	while ((interface = ast_category_browse(member_config, interface))) {
+		updated = ast_variable_retrieve(member_config, interface, realtime_updated_field);
+		if (!ast_strlen_zero(updated)
+			&& (ast_strlen_zero(q->rt_updated) || rt_updated_cmp(updated, q->rt_updated) > 0)) {
+			ast_copy_string(q->rt_updated, updated, sizeof(q->rt_updated));
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Whether a realtime queue loaded before is cached and need not be loaded again
+ */
+static int rt_queue_cached(struct call_queue *q)
+{
+	int lifetime = ast_strlen_zero(realtime_updated_field) ? realtime_refresh : realtime_full_refresh;
+
+	return realtime_refresh && q->rt_loaded && time(NULL) - q->rt_loaded < lifetime;
+}
+
 /*!
  * \internal
  * \brief Returns reference to the named queue. If the queue is realtime, it will load the queue as well.
@@ -3447,7 +3638,10 @@ static struct call_queue *find_load_queue_rt_friendly(const char *queuename)
 	/* Find the queue in the in-core list first. */
 	q = ao2_t_find(queues, &tmpq, OBJ_POINTER, "Look for queue in memory first");
 
-	if (!q || q->realtime) {
+	if (q && q->realtime && rt_queue_cached(q)) {
+		/* Only the members are refreshed, if it is time to */
+		update_realtime_members(q);
+	} else if (!q || q->realtime) {
 		/*! \note Load from realtime before taking the "queues" container lock, to avoid blocking all
 		   queue operations while waiting for the DB.
 
@@ -3471,6 +3665,13 @@ static struct call_queue *find_load_queue_rt_friendly(const char *queuename)
 		}
 
 		q = find_queue_by_name_rt(queuename, queue_vars, member_config);
+		if (q && q->realtime && member_config) {
+			ao2_lock(q);
+			q->rt_loaded = q->rt_members_loaded = q->rt_refreshed = time(NULL);
+			q->rt_updated[0] = '\0';
+			rt_note_updated(q, member_config);
+			ao2_unlock(q);
+		}
 		ast_config_destroy(member_config);
 		ast_variables_destroy(queue_vars);
 
@@ -3506,6 +3707,39 @@ static int update_realtime_member_field(struct member *mem, const char *queue_na
 }
 
 
+/*!
+ * \internal
+ * \brief Load the realtime members of a cached queue that changed since they were last loaded
+ *
+ * Members deleted from realtime are not noticed until the next full load.
+ */
+static void update_realtime_members_changed(struct call_queue *q)
+{
+	struct ast_config *member_config;
+	char *interface = NULL;
+	char updated[sizeof(q->rt_updated)];
+	char field[sizeof(realtime_updated_field) + 2];
+
+	ao2_lock(q);
+	ast_copy_string(updated, q->rt_updated, sizeof(updated));
+	ao2_unlock(q);
+
+	snprintf(field, sizeof(field), "%s >", realtime_updated_field);
+	member_config = ast_load_realtime_multientry("queue_members", "interface LIKE", "%", "queue_name", q->name,
+		field, updated, SENTINEL);
+
+	ao2_lock(q);
+	q->rt_refreshed = time(NULL);
+	if (member_config) {
+		while ((interface = ast_category_browse(member_config, interface))) {
+			rt_handle_member_record(q, interface, member_config);
+		}
+		rt_note_updated(q, member_config);
+	}
+	ao2_unlock(q);
+	ast_config_destroy(member_config);
+}
+
 static void update_realtime_members(struct call_queue *q)
 {
 	struct ast_config *member_config = NULL;
@@ -3513,6 +3747,20 @@ static void update_realtime_members(struct call_queue *q)
 	char *interface = NULL;
 	struct ao2_iterator mem_iter;
 
+	if (realtime_refresh && q->rt_loaded) {
+		time_t now = time(NULL);
+
+		if (now - q->rt_refreshed < realtime_refresh) {
+			/* Cached */
+			return;
+		}
+		if (!ast_strlen_zero(realtime_updated_field) && !ast_strlen_zero(q->rt_updated)
+			&& now - q->rt_members_loaded < realtime_full_refresh) {
+			update_realtime_members_changed(q);
+			return;
+		}
+	}
+
 	if (!(member_config = ast_load_realtime_multientry("queue_members", "interface LIKE", "%", "queue_name", q->name , SENTINEL))) {
 		/* This queue doesn't have realtime members. If the queue still has any realtime
 		 * members in memory, they need to be removed.
@@ -3561,6 +3809,9 @@ static void update_realtime_members(struct call_queue *q)
 		ao2_ref(m, -1);
 	}
 	ao2_iterator_destroy(&mem_iter);
+	q->rt_members_loaded = q->rt_refreshed = time(NULL);
+	q->rt_updated[0] = '\0';
+	rt_note_updated(q, member_config);
 	ao2_unlock(q);
 	ast_config_destroy(member_config);
 }
@@ -4343,20 +4594,70 @@ static int ring_entry(struct queue_ent *qe, struct callattempt *tmp, int *busies
 	return 1;
 }
 
-/*! \brief find the entry with the best metric, or NULL */
+/*!
+ * \brief Sort call attempts by metric, keeping the order of those with the same metric
+ *
+ * \param outgoing List of call attempts, linked by q_next
+ *
+ * \return The sorted list
+ */
+static struct callattempt *sort_by_metric(struct callattempt *outgoing)
+{
+	struct callattempt *left, *right, *slow, *fast;
+	struct callattempt *sorted = NULL, **tail = &sorted;
+
+	if (!outgoing || !outgoing->q_next) {
+		return outgoing;
+	}
+
+	/* Split the list in half */
+	slow = outgoing;
+	for (fast = outgoing->q_next; fast && fast->q_next; fast = fast->q_next->q_next) {
+		slow = slow->q_next;
+	}
+	right = slow->q_next;
+	slow->q_next = NULL;
+
+	left = sort_by_metric(outgoing);
+	right = sort_by_metric(right);
+
+	/* Merge, taking from the left half on ties so the sort is stable */
+	while (left && right) {
+		if (right->metric < left->metric) {
+			*tail = right;
+			right = right->q_next;
+		} else {
+			*tail = left;
+			left = left->q_next;
+		}
+		tail = &(*tail)->q_next;
+	}
+	*tail = left ? left : right;
+
+	return sorted;
+}
+
+/*!
+ * \brief Find the call attempt with the lowest metric not yet tried
+ *
+ * \param outgoing List of call attempts, sorted by sort_by_metric()
+ *
+ * The list is sorted once when it is built, so the best attempt is the first
+ * one still to be tried rather than needing every metric compared each time
+ * a member turns out to be busy.
+ */
 static struct callattempt *find_best(struct callattempt *outgoing)
 {
-	struct callattempt *best = NULL, *cur;
+	struct callattempt *cur;
 
 	for (cur = outgoing; cur; cur = cur->q_next) {
 		if (cur->stillgoing &&					/* Not already done */
-			!cur->chan &&					/* Isn't already going */
-			(!best || cur->metric < best->metric)) {		/* We haven't found one yet, or it's better */
-			best = cur;
+			!cur->chan) {					/* Isn't already going */
+			return cur;
 		}
 	}
 
-	return best;
+	return NULL;
 }
 
 /*!
@@ -4382,8 +4683,8 @@ static int ring_one(struct queue_ent *qe, struct callattempt *outgoing, int *bus
 		if (qe->parent->strategy == QUEUE_STRATEGY_RINGALL) {
 			struct callattempt *cur;
 			/* Ring everyone who shares this best metric (for ringall) */
-			for (cur = outgoing; cur; cur = cur->q_next) {
-				if (cur->stillgoing && !cur->chan && cur->metric <= best->metric) {
+			for (cur = best; cur && cur->metric <= best->metric; cur = cur->q_next) {
+				if (cur->stillgoing && !cur->chan) {
 					ast_debug(1, "(Parallel) Trying '%s' with metric %d\n", cur->interface, cur->metric);
 					ret |= ring_entry(qe, cur, busies);
 				}
@@ -5501,6 +5802,7 @@ static void send_agent_complete(const char *queuename, struct ast_channel_snapsh
 {
 	const char *reason = NULL;	/* silence dumb compilers */
 	RAII_VAR(struct ast_json *, blob, NULL, ast_json_unref);
+	RAII_VAR(struct stasis_message *, msg, NULL, ao2_cleanup);
 
 	switch (rsn) {
 	case CALLER:
@@ -5522,8 +5824,11 @@ static void send_agent_complete(const char *queuename, struct ast_channel_snapsh
 			     "TalkTime", (long)(time(NULL) - callstart),
 			     "Reason", reason);
 
-	queue_publish_multi_channel_snapshot_blob(ast_queue_topic(queuename), caller, peer,
+	msg = queue_multi_channel_snapshot_blob_create(caller, peer,
 			queue_agent_complete_type(), blob);
+	if (msg) {
+		stasis_publish(ast_queue_topic(queuename), msg);
+	}
 }
 
 static void queue_agent_cb(void *userdata, struct stasis_subscription *sub,
@@ -6497,6 +6802,7 @@ static int try_calling(struct queue_ent *qe, struct ast_flags opts, char **opt_a
 		}
 	}
 	ao2_iterator_destroy(&memi);
+	outgoing = sort_by_metric(outgoing);
 
 	if (qe->parent->timeoutpriority == TIMEOUT_PRIORITY_APP) {
 		/* Application arguments have higher timeout priority (behaviour for <=1.6) */
@@ -8739,6 +9045,24 @@ static void queue_set_global_params(struct ast_config *cfg)
 	if ((general_val = ast_variable_retrieve(cfg, "general", "log_membername_as_agent"))) {
 		log_membername_as_agent = ast_true(general_val);
 	}
+	realtime_refresh = 0;
+	if ((general_val = ast_variable_retrieve(cfg, "general", "realtime_refresh"))) {
+		if (sscanf(general_val, "%30d", &realtime_refresh) != 1 || realtime_refresh < 0) {
+			ast_log(LOG_WARNING, "Invalid realtime_refresh '%s', not caching realtime queues\n", general_val);
+			realtime_refresh = 0;
+		}
+	}
+	realtime_full_refresh = 3600;
+	if ((general_val = ast_variable_retrieve(cfg, "general", "realtime_full_refresh"))) {
+		if (sscanf(general_val, "%30d", &realtime_full_refresh) != 1 || realtime_full_refresh < 0) {
+			ast_log(LOG_WARNING, "Invalid realtime_full_refresh '%s', using 3600\n", general_val);
+			realtime_full_refresh = 3600;
+		}
+	}
+	realtime_updated_field[0] = '\0';
+	if ((general_val = ast_variable_retrieve(cfg, "general", "realtime_updated_field"))) {
+		ast_copy_string(realtime_updated_field, general_val, sizeof(realtime_updated_field));
+	}
 }
 
 /*! \brief reload information pertaining to a single member
@@ -8827,6 +9151,7 @@ static void reload_single_member(const char *memberdata, struct call_queue *q)
 			ao2_lock(q->members);
 			newm->queuepos = cur->queuepos;
 			ao2_link(q->members, newm);
+			queue_device_add(q, newm->state_interface);
 			ao2_unlink(q->members, cur);
 			ao2_unlock(q->members);
 		} else {
@@ -9861,6 +10186,36 @@ static int manager_queue_reload(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+static int manager_queue_invalidate(struct mansession *s, const struct message *m)
+{
+	const char *queuename = astman_get_header(m, "Queue");
+	struct ao2_iterator queue_iter;
+	struct call_queue *q;
+	int found = 0;
+
+	queue_iter = ao2_iterator_init(queues, 0);
+	while ((q = ao2_t_iterator_next(&queue_iter, "Iterate through queues"))) {
+		if (ast_strlen_zero(queuename) || !strcasecmp(q->name, queuename)) {
+			ao2_lock(q);
+			if (q->realtime) {
+				/* The next use loads the queue and all of its members */
+				q->rt_loaded = q->rt_members_loaded = q->rt_refreshed = 0;
+				found = 1;
+			}
+			ao2_unlock(q);
+		}
+		queue_t_unref(q, "Done with iterator");
+	}
+	ao2_iterator_destroy(&queue_iter);
+
+	if (!found && !ast_strlen_zero(queuename)) {
+		astman_send_error(s, m, "No such realtime queue");
+	} else {
+		astman_send_ack(s, m, "Realtime queues invalidated");
+	}
+	return 0;
+}
+
 static int manager_queue_reset(struct mansession *s, const struct message *m)
 {
 	const char *queuename = NULL;
@@ -10829,6 +11184,7 @@ static int unload_module(void)
 	ast_manager_unregister("QueuePenalty");
 	ast_manager_unregister("QueueReload");
 	ast_manager_unregister("QueueReset");
+	ast_manager_unregister("QueueInvalidate");
 	ast_manager_unregister("QueueMemberRingInUse");
 	ast_unregister_application(app_aqm);
 	ast_unregister_application(app_rqm);
@@ -10854,6 +11210,8 @@ static int unload_module(void)
 	ast_unload_realtime("queue_members");
 	ao2_cleanup(queues);
 	queues = NULL;
+	ao2_cleanup(queue_devices);
+	queue_devices = NULL;
 	return 0;
 }
 
@@ -10880,6 +11238,12 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	queue_devices = ao2_container_alloc(MAX_QUEUE_DEVICE_BUCKETS, queue_device_hash_fn, queue_device_cmp_fn);
+	if (!queue_devices) {
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	use_weight = 0;
 
 	if (reload_handler(0, &mask, NULL)) {
@@ -10937,6 +11301,7 @@ static int load_module(void)
 	err |= ast_manager_register_xml("QueueRule", 0, manager_queue_rule_show);
 	err |= ast_manager_register_xml("QueueReload", 0, manager_queue_reload);
 	err |= ast_manager_register_xml("QueueReset", 0, manager_queue_reset);
+	err |= ast_manager_register_xml("QueueInvalidate", 0, manager_queue_invalidate);
 	err |= ast_custom_function_register(&queuevar_function);
 	err |= ast_custom_function_register(&queueexists_function);
 	err |= ast_custom_function_register(&queuemembercount_function);
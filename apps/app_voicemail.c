@@ -985,6 +985,18 @@ static unsigned int poll_freq;
 /*! By default, poll every 30 seconds */
 #define DEFAULT_POLL_FREQ 30
 
+/*! Keep the message counts of mailboxes rather than counting them each time */
+static unsigned int count_cache;
+/*! Seconds a count not checked against its folder is kept for */
+static unsigned int count_cache_time;
+#if defined(ODBC_STORAGE) || defined(IMAP_STORAGE)
+/*! By default, only the file storage counts, which are checked, are kept */
+#define DEFAULT_COUNT_CACHE 0
+#else
+#define DEFAULT_COUNT_CACHE 1
+#endif
+#define DEFAULT_COUNT_CACHE_TIME 60
+
 AST_MUTEX_DEFINE_STATIC(poll_lock);
 static ast_cond_t poll_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t poll_thread = AST_PTHREADT_NULL;
@@ -1211,6 +1223,161 @@ static int inprocess_count(const char *context, const char *mailbox, int delta)
 	return 0;
 }
 
+/*!
+ * \brief The message counts of a mailbox, kept for MWI and VMCOUNT
+ *
+ * With file storage a count is kept along with the modification time of
+ * its folder, and is used only while the folder has not changed since.
+ * Other storage has no such check, so counts are kept for count_cache_time
+ * seconds and forgotten when the mailbox is changed here.
+ */
+struct vm_counts {
+	int count[ARRAY_LEN(mailbox_folders)];		/*!< Messages in each folder, -1 if not known */
+	time_t counted[ARRAY_LEN(mailbox_folders)];	/*!< When each folder was counted */
+	time_t mtime[ARRAY_LEN(mailbox_folders)];	/*!< The modification time of each folder, if checked */
+	char mailbox_id[0];				/*!< mailbox\@context */
+};
+
+static struct ao2_container *vm_counts_container;
+
+static int vm_counts_hash_fn(const void *obj, const int flags)
+{
+	const char *key = (flags & OBJ_KEY) ? obj : ((const struct vm_counts *) obj)->mailbox_id;
+
+	return ast_str_hash(key);
+}
+
+static int vm_counts_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct vm_counts *counts = obj;
+	const char *key = (flags & OBJ_KEY) ? arg : ((struct vm_counts *) arg)->mailbox_id;
+
+	return !strcmp(counts->mailbox_id, key) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+static int vm_counts_folder(const char *folder)
+{
+	size_t i;
+
+	if (!strcasecmp(folder, "INBOX")) {
+		return 0;
+	}
+	for (i = 1; i < ARRAY_LEN(mailbox_folders); i++) {
+		if (!strcasecmp(folder, mailbox_folders[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*!
+ * \internal
+ * \brief Get the kept message count of a mailbox folder
+ *
+ * \param context The context of the mailbox
+ * \param mailbox The mailbox
+ * \param folder The folder
+ * \param mtime The modification time of the folder now, or 0 if it cannot be checked
+ *
+ * \return The number of messages in the folder
+ * \retval -1 if it is not known and must be counted
+ */
+static int vm_counts_get(const char *context, const char *mailbox, const char *folder, time_t mtime)
+{
+	char mailbox_id[AST_MAX_EXTENSION + AST_MAX_CONTEXT + 2];
+	struct vm_counts *counts;
+	int idx = vm_counts_folder(folder);
+	int count = -1;
+
+	if (!count_cache || idx < 0 || !vm_counts_container) {
+		return -1;
+	}
+
+	snprintf(mailbox_id, sizeof(mailbox_id), "%s@%s", mailbox, context);
+	if (!(counts = ao2_find(vm_counts_container, mailbox_id, OBJ_KEY))) {
+		return -1;
+	}
+
+	ao2_lock(counts);
+	if (counts->count[idx] >= 0) {
+		if (counts->mtime[idx] ? counts->mtime[idx] == mtime
+			: time(NULL) - counts->counted[idx] < count_cache_time) {
+			count = counts->count[idx];
+		}
+	}
+	ao2_unlock(counts);
+	ao2_ref(counts, -1);
+
+	return count;
+}
+
+/*!
+ * \internal
+ * \brief Keep the message count of a mailbox folder
+ *
+ * \param context The context of the mailbox
+ * \param mailbox The mailbox
+ * \param folder The folder
+ * \param count The number of messages in the folder
+ * \param mtime The modification time of the folder before it was counted, or 0
+ * if it cannot be checked
+ *
+ * \note A folder changed in the last couple of seconds may change again without
+ * its modification time changing, so its count is not kept.
+ */
+static void vm_counts_set(const char *context, const char *mailbox, const char *folder, int count, time_t mtime)
+{
+	char mailbox_id[AST_MAX_EXTENSION + AST_MAX_CONTEXT + 2];
+	struct vm_counts *counts;
+	int idx = vm_counts_folder(folder);
+	time_t now = time(NULL);
+	int i;
+
+	if (!count_cache || idx < 0 || !vm_counts_container || (mtime && mtime >= now - 1)) {
+		return;
+	}
+
+	snprintf(mailbox_id, sizeof(mailbox_id), "%s@%s", mailbox, context);
+	ao2_lock(vm_counts_container);
+	if (!(counts = ao2_find(vm_counts_container, mailbox_id, OBJ_KEY | OBJ_NOLOCK))) {
+		if (!(counts = ao2_alloc(sizeof(*counts) + strlen(mailbox_id) + 1, NULL))) {
+			ao2_unlock(vm_counts_container);
+			return;
+		}
+		for (i = 0; i < ARRAY_LEN(counts->count); i++) {
+			counts->count[i] = -1;
+		}
+		strcpy(counts->mailbox_id, mailbox_id); /* SAFE */
+		ao2_link_flags(vm_counts_container, counts, OBJ_NOLOCK);
+	}
+	ao2_unlock(vm_counts_container);
+
+	ao2_lock(counts);
+	counts->count[idx] = count;
+	counts->counted[idx] = now;
+	counts->mtime[idx] = mtime;
+	ao2_unlock(counts);
+	ao2_ref(counts, -1);
+}
+
+/*!
+ * \internal
+ * \brief Forget the message counts of a mailbox that has changed
+ *
+ * \param mailbox_id The mailbox\@context, or NULL for every mailbox
+ */
+static void vm_counts_forget(const char *mailbox_id)
+{
+	if (!vm_counts_container) {
+		return;
+	}
+	if (!mailbox_id) {
+		ao2_callback(vm_counts_container, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+		return;
+	}
+	ao2_find(vm_counts_container, mailbox_id, OBJ_KEY | OBJ_UNLINK | OBJ_NODATA);
+}
+
 #if !(defined(ODBC_STORAGE) || defined(IMAP_STORAGE))
 static int __has_voicemail(const char *context, const char *mailbox, const char *folder, int shortcircuit);
 #endif
@@ -2455,6 +2622,11 @@ static int __messagecount(const char *context, const char *mailbox, const char *
 	if (ast_strlen_zero(mailbox))
 		return 0;
 
+	if ((ret = vm_counts_get(context, mailbox, folder, 0)) >= 0) {
+		return ret;
+	}
+	ret = 0;
+
 	/* We have to get the user before we can open the stream! */
 	vmu = find_user(&vmus, context, mailbox);
 	if (!vmu) {
@@ -2546,6 +2718,7 @@ static int __messagecount(const char *context, const char *mailbox, const char *
 		mail_free_searchpgm(&pgm);
 		ast_mutex_unlock(&vms_p->lock);
 		vms_p->updated = 0;
+		vm_counts_set(context, mailbox, folder, vms_p->vmArrayIndex, 0);
 		return vms_p->vmArrayIndex;
 	} else {
 		ast_mutex_lock(&vms_p->lock);
@@ -3787,8 +3960,8 @@ static int retrieve_file(char *dir, int msgnum)
 	int x = 0;
 	int res;
 	int fd = -1;
-	size_t fdlen = 0;
-	void *fdm = MAP_FAILED;
+	ssize_t fdlen = 0;
+	unsigned char *chunk = NULL;
 	SQLSMALLINT colcount = 0;
 	SQLHSTMT stmt;
 	char sql[PATH_MAX];
@@ -3880,38 +4053,35 @@ static int retrieve_file(char *dir, int msgnum)
 				goto yuck;
 			}
 			if (!strcasecmp(coltitle, "recording")) {
-				off_t offset;
-				res = SQLGetData(stmt, x + 1, SQL_BINARY, rowdata, 0, &colsize2);
-				fdlen = colsize2;
-				if (fd > -1) {
-					char tmp[1]="";
-					lseek(fd, fdlen - 1, SEEK_SET);
-					if (write(fd, tmp, 1) != 1) {
-						close(fd);
-						fd = -1;
-						continue;
+				/* Read out in small chunks, as they come; the driver need not know the length up front */
+				if (!chunk && !(chunk = ast_malloc(CHUNKSIZE))) {
+					SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+					ast_odbc_release_obj(obj);
+					goto yuck;
+				}
+				for (;;) {
+					res = SQLGetData(stmt, x + 1, SQL_BINARY, chunk, CHUNKSIZE, &colsize2);
+					if (res == SQL_NO_DATA || colsize2 == SQL_NULL_DATA) {
+						break;
 					}
-					/* Read out in small chunks */
-					for (offset = 0; offset < colsize2; offset += CHUNKSIZE) {
-						if ((fdm = mmap(NULL, CHUNKSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset)) == MAP_FAILED) {
-							ast_log(AST_LOG_WARNING, "Could not mmap the output file: %s (%d)\n", strerror(errno), errno);
-							SQLFreeHandle(SQL_HANDLE_STMT, stmt);
-							ast_odbc_release_obj(obj);
-							goto yuck;
-						} else {
-							res = SQLGetData(stmt, x + 1, SQL_BINARY, fdm, CHUNKSIZE, NULL);
-							munmap(fdm, CHUNKSIZE);
-							if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
-								ast_log(AST_LOG_WARNING, "SQL Get Data error!\n[%s]\n\n", sql);
-								unlink(full_fn);
-								SQLFreeHandle(SQL_HANDLE_STMT, stmt);
-								ast_odbc_release_obj(obj);
-								goto yuck;
-							}
-						}
+					if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
+						ast_log(AST_LOG_WARNING, "SQL Get Data error!\n[%s]\n\n", sql);
+						unlink(full_fn);
+						SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+						ast_odbc_release_obj(obj);
+						goto yuck;
+					}
+					/* Until the last chunk, the length is what is left rather than what was read */
+					fdlen = (colsize2 == SQL_NO_TOTAL || colsize2 > CHUNKSIZE) ? CHUNKSIZE : colsize2;
+					if (write(fd, chunk, fdlen) != fdlen) {
+						ast_log(AST_LOG_WARNING, "Failed to write '%s': %s\n", full_fn, strerror(errno));
+						unlink(full_fn);
+						SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+						ast_odbc_release_obj(obj);
+						goto yuck;
 					}
-					if (truncate(full_fn, fdlen) < 0) {
-						ast_log(LOG_WARNING, "Unable to truncate '%s': %s\n", full_fn, strerror(errno));
+					if (res == SQL_SUCCESS) {
+						break;
 					}
 				}
 			} else {
@@ -3940,6 +4110,7 @@ yuck:
 		fclose(f);
 	if (fd > -1)
 		close(fd);
+	ast_free(chunk);
 	return x - 1;
 }
 
@@ -4195,7 +4366,7 @@ struct insert_data {
 	char *sql;
 	const char *dir;
 	const char *msgnums;
-	void *data;
+	int fd;			/*!< The sound file, sent a chunk at a time as the statement runs */
 	SQLLEN datalen;
 	SQLLEN indlen;
 	const char *context;
@@ -4215,6 +4386,15 @@ static SQLHSTMT insert_data_cb(struct odbc_obj *obj, void *vdata)
 	struct insert_data *data = vdata;
 	int res;
 	SQLHSTMT stmt;
+	SQLPOINTER param;
+	unsigned char *chunk;
+	ssize_t len;
+
+	/* Sent from the start again if the statement is retried */
+	if (lseek(data->fd, 0, SEEK_SET) < 0) {
+		return NULL;
+	}
+	data->indlen = SQL_LEN_DATA_AT_EXEC(data->datalen);
 
 	res = SQLAllocHandle(SQL_HANDLE_STMT, obj->con, &stmt);
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
@@ -4225,7 +4405,7 @@ static SQLHSTMT insert_data_cb(struct odbc_obj *obj, void *vdata)
 
 	SQLBindParameter(stmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_CHAR, strlen(data->dir), 0, (void *) data->dir, 0, NULL);
 	SQLBindParameter(stmt, 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_CHAR, strlen(data->msgnums), 0, (void *) data->msgnums, 0, NULL);
-	SQLBindParameter(stmt, 3, SQL_PARAM_INPUT, SQL_C_BINARY, SQL_LONGVARBINARY, data->datalen, 0, (void *) data->data, data->datalen, &data->indlen);
+	SQLBindParameter(stmt, 3, SQL_PARAM_INPUT, SQL_C_BINARY, SQL_LONGVARBINARY, data->datalen, 0, (void *) data, 0, &data->indlen);
 	SQLBindParameter(stmt, 4, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_CHAR, strlen(data->context), 0, (void *) data->context, 0, NULL);
 	SQLBindParameter(stmt, 5, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_CHAR, strlen(data->macrocontext), 0, (void *) data->macrocontext, 0, NULL);
 	SQLBindParameter(stmt, 6, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_CHAR, strlen(data->callerid), 0, (void *) data->callerid, 0, NULL);
@@ -4239,6 +4419,28 @@ static SQLHSTMT insert_data_cb(struct odbc_obj *obj, void *vdata)
 		SQLBindParameter(stmt, 13, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_CHAR, strlen(data->category), 0, (void *) data->category, 0, NULL);
 	}
 	res = SQLExecDirect(stmt, (unsigned char *) data->sql, SQL_NTS);
+	if (res == SQL_NEED_DATA) {
+		/* The recording is the only parameter sent at execution */
+		if (!(chunk = ast_malloc(CHUNKSIZE))) {
+			SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+			return NULL;
+		}
+		while ((res = SQLParamData(stmt, &param)) == SQL_NEED_DATA) {
+			while ((len = read(data->fd, chunk, CHUNKSIZE)) > 0) {
+				res = SQLPutData(stmt, chunk, len);
+				if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
+					break;
+				}
+			}
+			if (len < 0) {
+				ast_log(AST_LOG_WARNING, "Failed to read sound file: %s\n", strerror(errno));
+				SQLCancel(stmt);
+				res = SQL_ERROR;
+				break;
+			}
+		}
+		ast_free(chunk);
+	}
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
 		ast_log(AST_LOG_WARNING, "SQL Direct Execute failed!\n");
 		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
@@ -4265,7 +4467,6 @@ static int store_file(const char *dir, const char *mailboxuser, const char *mail
 {
 	int res = 0;
 	int fd = -1;
-	void *fdm = MAP_FAILED;
 	off_t fdlen = -1;
 	SQLHSTMT stmt;
 	char sql[PATH_MAX];
@@ -4301,7 +4502,7 @@ static int store_file(const char *dir, const char *mailboxuser, const char *mail
 		snprintf(full_fn, sizeof(full_fn), "%s.txt", fn);
 		cfg = ast_config_load(full_fn, config_flags);
 		snprintf(full_fn, sizeof(full_fn), "%s.%s", fn, fmt);
-		fd = open(full_fn, O_RDWR);
+		fd = open(full_fn, O_RDONLY);
 		if (fd < 0) {
 			ast_log(AST_LOG_WARNING, "Open of sound file '%s' failed: %s\n", full_fn, strerror(errno));
 			res = -1;
@@ -4334,19 +4535,13 @@ static int store_file(const char *dir, const char *mailboxuser, const char *mail
 			}
 		}
 		fdlen = lseek(fd, 0, SEEK_END);
-		if (fdlen < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+		if (fdlen < 0) {
 			ast_log(AST_LOG_WARNING, "Failed to process sound file '%s': %s\n", full_fn, strerror(errno));
 			res = -1;
 			break;
 		}
-		fdm = mmap(NULL, fdlen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-		if (fdm == MAP_FAILED) {
-			ast_log(AST_LOG_WARNING, "Memory map failed for sound file '%s'!\n", full_fn);
-			res = -1;
-			break;
-		} 
-		idata.data = fdm;
-		idata.datalen = idata.indlen = fdlen;
+		idata.fd = fd;
+		idata.datalen = fdlen;
 
 		if (!ast_strlen_zero(idata.category)) 
 			snprintf(sql, sizeof(sql), "INSERT INTO %s (dir,msgnum,recording,context,macrocontext,callerid,origtime,duration,mailboxuser,mailboxcontext,flag,msg_id,category) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?)", odbc_table); 
@@ -4365,8 +4560,6 @@ static int store_file(const char *dir, const char *mailboxuser, const char *mail
 	}
 	if (valid_config(cfg))
 		ast_config_destroy(cfg);
-	if (fdm != MAP_FAILED)
-		munmap(fdm, fdlen);
 	if (fd > -1)
 		close(fd);
 	return res;
@@ -5610,6 +5803,7 @@ static int inboxcount2(const char *mailbox, int *urgentmsgs, int *newmsgs, int *
 {
 	int x = -1;
 	int res;
+	int cached;
 	SQLHSTMT stmt = NULL;
 	char sql[PATH_MAX];
 	char rowdata[20];
@@ -5658,6 +5852,23 @@ static int inboxcount2(const char *mailbox, int *urgentmsgs, int *newmsgs, int *
 	} else
 		context = "default";
 
+	/* Only query the counts that are not kept */
+	if (newmsgs && (cached = vm_counts_get(context, tmp, "INBOX", 0)) >= 0) {
+		*newmsgs = cached;
+		newmsgs = NULL;
+	}
+	if (oldmsgs && (cached = vm_counts_get(context, tmp, "Old", 0)) >= 0) {
+		*oldmsgs = cached;
+		oldmsgs = NULL;
+	}
+	if (urgentmsgs && (cached = vm_counts_get(context, tmp, "Urgent", 0)) >= 0) {
+		*urgentmsgs = cached;
+		urgentmsgs = NULL;
+	}
+	if (!newmsgs && !oldmsgs && !urgentmsgs) {
+		return 0;
+	}
+
 	if ((obj = ast_odbc_request_obj(odbc_database, 0))) {
 		do {
 			if (newmsgs) {
@@ -5678,6 +5889,7 @@ static int inboxcount2(const char *mailbox, int *urgentmsgs, int *newmsgs, int *
 				}
 				*newmsgs = atoi(rowdata);
 				SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+				vm_counts_set(context, tmp, "INBOX", *newmsgs, 0);
 			}
 
 			if (oldmsgs) {
@@ -5698,6 +5910,7 @@ static int inboxcount2(const char *mailbox, int *urgentmsgs, int *newmsgs, int *
 				}
 				SQLFreeHandle(SQL_HANDLE_STMT, stmt);
 				*oldmsgs = atoi(rowdata);
+				vm_counts_set(context, tmp, "Old", *oldmsgs, 0);
 			}
 
 			if (urgentmsgs) {
@@ -5717,6 +5930,7 @@ static int inboxcount2(const char *mailbox, int *urgentmsgs, int *newmsgs, int *
 					break;
 				}
 				*urgentmsgs = atoi(rowdata);
+				vm_counts_set(context, tmp, "Urgent", *urgentmsgs, 0);
 			}
 
 			x = 0;
@@ -5764,6 +5978,19 @@ static int messagecount(const char *mailbox_id, const char *folder)
 		folder = "INBOX";
 	}
 
+	if (!strcmp(folder, "INBOX")) {
+		int urgent = vm_counts_get(context, mailbox, "Urgent", 0);
+
+		if (urgent >= 0 && (nummsgs = vm_counts_get(context, mailbox, "INBOX", 0)) >= 0) {
+			return nummsgs + urgent;
+		}
+		nummsgs = 0;
+	} else if ((nummsgs = vm_counts_get(context, mailbox, folder, 0)) >= 0) {
+		return nummsgs;
+	} else {
+		nummsgs = 0;
+	}
+
 	obj = ast_odbc_request_obj(odbc_database, 0);
 	if (obj) {
 		if (!strcmp(folder, "INBOX")) {
@@ -5790,6 +6017,10 @@ static int messagecount(const char *mailbox_id, const char *folder)
 		}
 		nummsgs = atoi(rowdata);
 		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+		/* INBOX is counted along with Urgent, so cannot be kept alone */
+		if (strcmp(folder, "INBOX")) {
+			vm_counts_set(context, mailbox, folder, nummsgs, 0);
+		}
 	} else
 		ast_log(AST_LOG_WARNING, "Failed to obtain database object for '%s'!\n", odbc_database);
 
@@ -5922,6 +6153,7 @@ static int __has_voicemail(const char *context, const char *mailbox, const char
 	DIR *dir;
 	struct dirent *de;
 	char fn[256];
+	struct stat st;
 	int ret = 0;
 
 	/* If no mailbox, return immediately */
@@ -5935,6 +6167,15 @@ static int __has_voicemail(const char *context, const char *mailbox, const char
 
 	snprintf(fn, sizeof(fn), "%s%s/%s/%s", VM_SPOOL_DIR, context, mailbox, folder);
 
+	if (stat(fn, &st))
+		return 0;
+
+	/* Counted before and the folder has not changed since */
+	if ((ret = vm_counts_get(context, mailbox, folder, st.st_mtime)) >= 0) {
+		return shortcircuit ? !!ret : ret;
+	}
+	ret = 0;
+
 	if (!(dir = opendir(fn)))
 		return 0;
 
@@ -5951,6 +6192,11 @@ static int __has_voicemail(const char *context, const char *mailbox, const char
 
 	closedir(dir);
 
+	/* A short circuited count is only the count if nothing was found */
+	if (!shortcircuit || !ret) {
+		vm_counts_set(context, mailbox, folder, ret, st.st_mtime);
+	}
+
 	return ret;
 }
 
@@ -8004,6 +8250,7 @@ static int notify_new_message(struct ast_channel *chan, struct ast_vm_user *vmu,
 		DELETE(todir, msgnum, fn, vmu);
 
 	/* Leave voicemail for someone */
+	vm_counts_forget(ext_context);
 	if (ast_app_has_voicemail(ext_context, NULL)) 
 		ast_app_inboxcount2(ext_context, &urgentmsgs, &newmsgs, &oldmsgs);
 
@@ -11877,6 +12124,7 @@ out:
 	if (valid) {
 		int new = 0, old = 0, urgent = 0;
 		snprintf(ext_context, sizeof(ext_context), "%s@%s", vms.username, vmu->context);
+		vm_counts_forget(ext_context);
 		/* Urgent flag not passwd to externnotify here */
 		run_externnotify(vmu->context, vmu->mailbox, NULL);
 		ast_app_inboxcount2(ext_context, &urgent, &new, &old);
@@ -13065,6 +13313,7 @@ static int manager_voicemail_refresh(struct mansession *s, const struct message
 					strncmp(mailbox, mwi_sub->mailbox, at - mwi_sub->mailbox) == 0 &&
 					strcmp(context, at + 1) == 0)
 			) {
+				vm_counts_forget(mwi_sub->mailbox);
 				poll_subscribed_mailbox(mwi_sub);
 			}
 		}
@@ -13829,6 +14078,19 @@ static int actual_load_config(int reload, struct ast_config *cfg, struct ast_con
 		if ((val = ast_variable_retrieve(cfg, "general", "pollmailboxes")))
 			poll_mailboxes = ast_true(val);
 
+		count_cache = DEFAULT_COUNT_CACHE;
+		if ((val = ast_variable_retrieve(cfg, "general", "countcache")))
+			count_cache = ast_true(val);
+
+		count_cache_time = DEFAULT_COUNT_CACHE_TIME;
+		if ((val = ast_variable_retrieve(cfg, "general", "countcachetime"))) {
+			if (sscanf(val, "%30u", &count_cache_time) != 1) {
+				count_cache_time = DEFAULT_COUNT_CACHE_TIME;
+				ast_log(AST_LOG_ERROR, "'%s' is not a valid value for the countcachetime option!\n", val);
+			}
+		}
+		vm_counts_forget(NULL);
+
 		memset(fromstring, 0, sizeof(fromstring));
 		memset(pagerfromstring, 0, sizeof(pagerfromstring));
 		strcpy(charset, "ISO-8859-1");
@@ -14684,6 +14946,8 @@ static int unload_module(void)
 	ast_uninstall_vm_test_functions();
 #endif
 	ao2_ref(inprocess_container, -1);
+	ao2_cleanup(vm_counts_container);
+	vm_counts_container = NULL;
 
 	if (poll_thread != AST_PTHREADT_NULL)
 		stop_poll_thread();
@@ -14717,6 +14981,11 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	if (!(vm_counts_container = ao2_container_alloc(4093, vm_counts_hash_fn, vm_counts_cmp_fn))) {
+		ao2_ref(inprocess_container, -1);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	/* compute the location of the voicemail spool directory */
 	snprintf(VM_SPOOL_DIR, sizeof(VM_SPOOL_DIR), "%s/voicemail/", ast_config_AST_SPOOL_DIR);
 	
@@ -15654,6 +15923,7 @@ static void notify_new_state(struct ast_vm_user *vmu)
 	char ext_context[1024];
 
 	snprintf(ext_context, sizeof(ext_context), "%s@%s", vmu->mailbox, vmu->context);
+	vm_counts_forget(ext_context);
 	run_externnotify(vmu->context, vmu->mailbox, NULL);
 	ast_app_inboxcount2(ext_context, &urgent, &new, &old);
 	queue_mwi_event(NULL, ext_context, urgent, new, old);
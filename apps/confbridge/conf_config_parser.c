@@ -144,6 +144,17 @@ ASTERISK_REGISTER_FILE()
 					due to its performance enhancements.
 					</para></description>
 				</configOption>
+				<configOption name="listen_only">
+					<synopsis>Only let the user listen to the conference</synopsis>
+					<description><para>
+					The user hears the conference but is never heard.  Their audio is
+					dropped as it enters the bridge, without being decoded or examined
+					for talking, and they are sent the same encoded mix as every other
+					listener using the same format.  This makes each listener much cheaper
+					in very large conferences where few participants talk, such as
+					webinars.  Off by default.
+					</para></description>
+				</configOption>
 				<configOption name="dsp_silence_threshold">
 					<synopsis>The number of milliseconds of detected silence necessary to trigger silence detection</synopsis>
 					<description><para>
@@ -224,6 +235,18 @@ ASTERISK_REGISTER_FILE()
 						on the user before entering the ConfBridge application.
 					</para></description>
 				</configOption>
+				<configOption name="cascade">
+					<synopsis>Treat the caller as a link from a conference on another node</synopsis>
+					<description><para>
+						Set this on the user profile used by calls arriving from the
+						<literal>cascade_to</literal> option of a bridge profile on another
+						node.  The link hears no prompts, is let in to locked and full
+						conferences, and is always mixed even when <literal>max_talkers</literal>
+						limits the talkers.  Each node mixes its own participants, so the link
+						carries at most the loudest talkers of the other node, and neither node
+						hears its own audio back.
+					</para></description>
+				</configOption>
 				<configOption name="template">
 					<synopsis>When using the CONFBRIDGE dialplan function, use a user profile as a template for creating a new temporary profile</synopsis>
 				</configOption>
@@ -284,6 +307,50 @@ ASTERISK_REGISTER_FILE()
 						or 80.
 					</para></description>
 				</configOption>
+				<configOption name="mixing_threads" default="0">
+					<synopsis>Sets the number of threads writing mixed audio to the participants</synopsis>
+					<description><para>
+						Sets the number of threads that take each participant's own audio back
+						out of the mix, translate it and write it to them.  The mix itself is
+						still built once by the bridge's mixing thread, which is one of these
+						threads.  Very large conferences whose mixing thread cannot keep up
+						with the mixing interval may use several threads.  When set to 0 or 1,
+						the mixing thread does all of the work.  At most 16 threads are used.
+					</para></description>
+				</configOption>
+				<configOption name="max_talkers" default="0">
+					<synopsis>Limit the number of talkers mixed together</synopsis>
+					<description><para>
+						Only the loudest talkers, up to this number, are mixed into the audio
+						the conference hears.  Talkers are ranked by the energy of their audio
+						as measured for talk detection, and participants that are not talking
+						rank last.  This bounds the cost of mixing and keeps noise from many
+						unmuted lines out of the conference.  By default every participant
+						providing audio is mixed.
+					</para></description>
+				</configOption>
+				<configOption name="resample_quality" default="0">
+					<synopsis>Set the quality of resampling participants to and from the mix</synopsis>
+					<description><para>
+						Participants whose audio is at a different sample rate from the mix are
+						resampled every mixing interval.  This sets the quality of that
+						resampling from 1, the cheapest, to 10, the best.  Lower values cost
+						less CPU time in conferences with many participants at mixed sample
+						rates.  By default the resampler's own quality is used.
+					</para></description>
+				</configOption>
+				<configOption name="cascade_to">
+					<synopsis>Link the conference to the same conference on another node</synopsis>
+					<description><para>
+						When the conference is created it dials this channel, such as
+						<literal>IAX2/hub/townhall</literal>, and puts the answered channel in
+						the conference.  The far end should put the call in its conference with
+						a user profile that has <literal>cascade</literal> set.  One conference
+						may then span several nodes arranged as a tree, each mixing only its
+						own participants.  The link is dialed again if it hangs up while the
+						conference lasts.  By default the conference is not linked.
+					</para></description>
+				</configOption>
 				<configOption name="record_conference">
 					<synopsis>Record the conference starting with the first active user's entrance and ending with the last active user's exit</synopsis>
 					<description><para>
@@ -1458,6 +1525,12 @@ static char *handle_cli_confbridge_show_user_profile(struct ast_cli_entry *e, in
 	ast_cli(a->fd,"Announce User Count all: %s\n",
 		u_profile.flags & USER_OPT_ANNOUNCEUSERCOUNTALL ?
 		"enabled" : "disabled");
+	ast_cli(a->fd,"Listen Only:             %s\n",
+		u_profile.flags & USER_OPT_LISTEN_ONLY ?
+		"enabled" : "disabled");
+	ast_cli(a->fd,"Cascade Link:            %s\n",
+		u_profile.flags & USER_OPT_CASCADE ?
+		"enabled" : "disabled");
 		ast_cli(a->fd,"\n");
 
 	return CLI_SUCCESS;
@@ -1567,6 +1640,24 @@ static char *handle_cli_confbridge_show_bridge_profile(struct ast_cli_entry *e,
 		ast_cli(a->fd,"Mixing Interval:      Default 20ms\n");
 	}
 
+	ast_cli(a->fd,"Mixing Threads:       %u\n", MAX(b_profile.mixing_threads, 1));
+
+	if (b_profile.max_talkers) {
+		ast_cli(a->fd,"Max Talkers:          %u\n", b_profile.max_talkers);
+	} else {
+		ast_cli(a->fd,"Max Talkers:          No Limit\n");
+	}
+
+	if (b_profile.resample_quality) {
+		ast_cli(a->fd,"Resample Quality:     %u\n", b_profile.resample_quality);
+	} else {
+		ast_cli(a->fd,"Resample Quality:     Default\n");
+	}
+
+	ast_cli(a->fd,"Cascade To:           %s\n",
+		ast_strlen_zero(b_profile.cascade_to) ? "None" :
+		b_profile.cascade_to);
+
 	ast_cli(a->fd,"Record Conference:    %s\n",
 		b_profile.flags & BRIDGE_OPT_RECORD_CONFERENCE ?
 		"yes" : "no");
@@ -2140,11 +2231,13 @@ int conf_load_config(void)
 	aco_option_register(&cfg_info, "music_on_hold_class", ACO_EXACT, user_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct user_profile, moh_class));
 	aco_option_register(&cfg_info, "announcement", ACO_EXACT, user_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct user_profile, announcement));
 	aco_option_register(&cfg_info, "denoise", ACO_EXACT, user_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct user_profile, flags), USER_OPT_DENOISE);
+	aco_option_register(&cfg_info, "listen_only", ACO_EXACT, user_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct user_profile, flags), USER_OPT_LISTEN_ONLY);
 	aco_option_register(&cfg_info, "dsp_drop_silence", ACO_EXACT, user_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct user_profile, flags), USER_OPT_DROP_SILENCE);
 	aco_option_register(&cfg_info, "dsp_silence_threshold", ACO_EXACT, user_types, __stringify(DEFAULT_SILENCE_THRESHOLD), OPT_UINT_T, 0, FLDSET(struct user_profile, silence_threshold));
 	aco_option_register(&cfg_info, "dsp_talking_threshold", ACO_EXACT, user_types, __stringify(DEFAULT_TALKING_THRESHOLD), OPT_UINT_T, 0, FLDSET(struct user_profile, talking_threshold));
 	aco_option_register(&cfg_info, "jitterbuffer", ACO_EXACT, user_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct user_profile, flags), USER_OPT_JITTERBUFFER);
 	aco_option_register(&cfg_info, "timeout", ACO_EXACT, user_types, "0", OPT_UINT_T, 0, FLDSET(struct user_profile, timeout));
+	aco_option_register(&cfg_info, "cascade", ACO_EXACT, user_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct user_profile, flags), USER_OPT_CASCADE);
 	/* This option should only be used with the CONFBRIDGE dialplan function */
 	aco_option_register_custom(&cfg_info, "template", ACO_EXACT, user_types, NULL, user_template_handler, 0);
 
@@ -2155,6 +2248,10 @@ int conf_load_config(void)
 	/* "auto" will fail to parse as a uint, but we use PARSE_DEFAULT to set the value to 0 in that case, which is the value that auto resolves to */
 	aco_option_register(&cfg_info, "internal_sample_rate", ACO_EXACT, bridge_types, "0", OPT_UINT_T, PARSE_DEFAULT, FLDSET(struct bridge_profile, internal_sample_rate), 0);
 	aco_option_register_custom(&cfg_info, "mixing_interval", ACO_EXACT, bridge_types, "20", mix_interval_handler, 0);
+	aco_option_register(&cfg_info, "mixing_threads", ACO_EXACT, bridge_types, "0", OPT_UINT_T, 0, FLDSET(struct bridge_profile, mixing_threads));
+	aco_option_register(&cfg_info, "max_talkers", ACO_EXACT, bridge_types, "0", OPT_UINT_T, 0, FLDSET(struct bridge_profile, max_talkers));
+	aco_option_register(&cfg_info, "resample_quality", ACO_EXACT, bridge_types, "0", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct bridge_profile, resample_quality), 0, 10);
+	aco_option_register(&cfg_info, "cascade_to", ACO_EXACT, bridge_types, NULL, OPT_CHAR_ARRAY_T, 0, CHARFLDSET(struct bridge_profile, cascade_to));
 	aco_option_register(&cfg_info, "record_conference", ACO_EXACT, bridge_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_RECORD_CONFERENCE);
 	aco_option_register_custom(&cfg_info, "video_mode", ACO_EXACT, bridge_types, NULL, video_mode_handler, 0);
 	aco_option_register(&cfg_info, "record_file_append", ACO_EXACT, bridge_types, "yes", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_RECORD_FILE_APPEND);
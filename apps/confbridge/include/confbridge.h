@@ -62,6 +62,8 @@ enum user_profile_flags {
 	USER_OPT_ANNOUNCEUSERCOUNTALL = (1 << 14), /*!< Sets if the number of users should be announced to everyone. */
 	USER_OPT_JITTERBUFFER =  (1 << 15), /*!< Places a jitterbuffer on the user. */
 	USER_OPT_ANNOUNCE_JOIN_LEAVE_REVIEW = (1 << 16), /*!< modifies ANNOUNCE_JOIN_LEAVE - user reviews the recording before continuing */
+	USER_OPT_CASCADE =       (1 << 17), /*!< Set if the caller is a link carrying the mix of a conference on another node */
+	USER_OPT_LISTEN_ONLY =   (1 << 18), /*!< Set if the caller only listens, so their audio is never mixed */
 };
 
 enum bridge_profile_flags {
@@ -205,10 +207,14 @@ struct bridge_profile {
 	char rec_file[PATH_MAX];
 	char rec_options[128];
 	char rec_command[128];
+	char cascade_to[256];              /*!< Dial string of the conference on another node this one links to */
 	unsigned int flags;
 	unsigned int max_members;          /*!< The maximum number of participants allowed in the conference */
 	unsigned int internal_sample_rate; /*!< The internal sample rate of the bridge. 0 when set to auto adjust mode. */
 	unsigned int mix_interval;  /*!< The internal mixing interval used by the bridge. When set to 0 the bridgewill use a default interval. */
+	unsigned int mixing_threads; /*!< The number of threads writing mixed audio to the participants. 0 or 1 uses only the mixing thread. */
+	unsigned int max_talkers;    /*!< The number of loudest talkers mixed together. 0 mixes every talker. */
+	unsigned int resample_quality; /*!< The quality of resampling participants, 1 to 10. 0 uses the default. */
 	struct bridge_profile_sounds *sounds;
 };
 
@@ -225,6 +231,8 @@ struct confbridge_conference {
 	unsigned int muted:1;                                             /*!< Is this conference bridge muted? */
 	struct ast_channel *playback_chan;                                /*!< Channel used for playback into the conference bridge */
 	struct ast_channel *record_chan;                                  /*!< Channel used for recording the conference */
+	struct ast_channel *cascade_chan;                                 /*!< Channel linking the conference to another node */
+	unsigned int cascade_stopped:1;                                   /*!< Has the link to another node been stopped? */
 	struct ast_str *record_filename;                                  /*!< Recording filename. */
 	struct ast_str *orig_rec_file;                                    /*!< Previous b_profile.rec_file. */
 	ast_mutex_t playback_lock;                                        /*!< Lock used for playback channel */
@@ -418,6 +418,8 @@ static int native_rtp_bridge_framehook_attach(struct ast_bridge_channel *bridge_
 		.destroy_cb = __ao2_cleanup,
 		.consume_cb = native_rtp_framehook_consume,
 		.disable_inheritance = 1,
+		.frame_types = AST_FRAMEHOOK_BIT(AST_FRAME_CONTROL),
+		.events = AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_WRITE),
 	};
 
 	if (!data) {
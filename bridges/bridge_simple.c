@@ -63,7 +63,23 @@ static int simple_bridge_join(struct ast_bridge *bridge, struct ast_bridge_chann
 
 static int simple_bridge_write(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel, struct ast_frame *frame)
 {
-	return ast_bridge_queue_everyone_else(bridge, bridge_channel, frame);
+	struct ast_bridge_channel *other;
+
+	if (frame->frametype == AST_FRAME_NULL) {
+		/* "Accept" the frame and discard it. */
+		return 0;
+	}
+
+	/* Media goes straight to the other channel when its thread has nothing else to do. */
+	other = AST_LIST_FIRST(&bridge->channels);
+	if (other == bridge_channel) {
+		other = AST_LIST_LAST(&bridge->channels);
+	}
+	if (!other || other == bridge_channel) {
+		return -1;
+	}
+
+	return ast_bridge_channel_queue_frame_direct(other, frame);
 }
 
 static struct ast_bridge_technology simple_bridge = {
@@ -41,6 +41,7 @@ ASTERISK_REGISTER_FILE()
 #include <sys/time.h>
 #include <signal.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 
 #include "asterisk/module.h"
@@ -49,11 +50,15 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/bridge_technology.h"
 #include "asterisk/frame.h"
 #include "asterisk/options.h"
+#include "asterisk/probes.h"
 #include "asterisk/logger.h"
 #include "asterisk/slinfactory.h"
+#include "asterisk/slinear_mix.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/timing.h"
 #include "asterisk/translate.h"
+#include "asterisk/thread_affinity.h"
+#include "asterisk/cli.h"
 
 #define MAX_DATALEN 8096
 
@@ -79,6 +84,12 @@ ASTERISK_REGISTER_FILE()
 
 #define DEFAULT_ENERGY_HISTORY_LEN 150
 
+/*! \brief Maximum number of threads writing a bridge's mixed audio */
+#define SOFTMIX_MAX_MIXING_THREADS 16
+
+/*! \brief Maximum number of sample rates a bridge mixes at */
+#define SOFTMIX_MAX_PLANES 4
+
 struct video_follow_talker_data {
 	/*! audio energy history */
 	int energy_history[DEFAULT_ENERGY_HISTORY_LEN];
@@ -118,6 +129,25 @@ struct softmix_channel {
 	short our_buf[MAX_DATALEN];
 	/*! Data pertaining to talker mode for video conferencing */
 	struct video_follow_talker_data video_talker;
+	/*! NUMA node the channel joined the bridge from, -1 if not known */
+	int numa_node;
+	/*! Smoothed energy of the audio the channel is talking with, 0 when not talking */
+	int talker_energy;
+	/*! The talker energy when the channel's audio was read for the current mix */
+	int mix_energy;
+	/*! The plane the channel is mixed on */
+	struct softmix_plane *plane;
+};
+
+struct softmix_write_worker;
+struct softmix_plane;
+
+/*! \brief The write phase of a mixing interval, shared by the threads doing it */
+struct softmix_write_job {
+	/*! The channels to write to */
+	struct ast_bridge_channel **channels;
+	/*! Number of channels to write to */
+	unsigned int num_channels;
 };
 
 struct softmix_bridge_data {
@@ -138,10 +168,50 @@ struct softmix_bridge_data {
 	pthread_t thread;
 	unsigned int internal_rate;
 	unsigned int internal_mixing_interval;
+	/*! Number of channels in the bridge on each NUMA node */
+	unsigned int node_channels[AST_THREAD_AFFINITY_MAX_NODES];
 	/*! TRUE if the mixing thread should stop */
 	unsigned int stop:1;
+	/*! TRUE if the channels in the bridge moved between NUMA nodes */
+	unsigned int nodes_changed:1;
+	/*! Threads sharing the write phase with the mixing thread */
+	struct softmix_write_worker *workers;
+	/*! Number of write workers */
+	unsigned int num_workers;
+	/*! Lock for handing the write phase to the workers */
+	ast_mutex_t work_lock;
+	/*! Condition signalled when there is a write phase for the workers */
+	ast_cond_t work_cond;
+	/*! Condition signalled when the workers have finished a write phase */
+	ast_cond_t done_cond;
+	/*! Incremented for each write phase given to the workers */
+	unsigned int work_generation;
+	/*! Number of workers still writing the current write phase */
+	unsigned int work_pending;
+	/*! TRUE if the write workers should stop */
+	unsigned int workers_stop:1;
+	/*! The current write phase */
+	struct softmix_write_job job;
+	/*! Number of mixing intervals mixed */
+	unsigned int intervals;
+	/*! Number of mixing intervals whose mixing took longer than the interval */
+	unsigned int overruns;
+	/*! Longest time taken to mix an interval, in microseconds */
+	int64_t max_interval_us;
+	/*! The planes channels are mixed on, the first at the internal rate */
+	struct softmix_plane *planes[SOFTMIX_MAX_PLANES];
+	/*! Number of planes */
+	unsigned int num_planes;
+	/*! The rate of each plane as last mixed, for showing */
+	unsigned int plane_rates[SOFTMIX_MAX_PLANES];
+	/*! The number of channels on each plane as last mixed, for showing */
+	unsigned int plane_channels[SOFTMIX_MAX_PLANES];
+	AST_LIST_ENTRY(softmix_bridge_data) list;
 };
 
+/*! \brief The softmix bridges, for showing their mixing statistics */
+static AST_RWLIST_HEAD_STATIC(softmix_bridges, softmix_bridge_data);
+
 struct softmix_stats {
 	/*! Each index represents a sample rate used above the internal rate. */
 	unsigned int sample_rates[16];
@@ -161,6 +231,10 @@ struct softmix_mixing_array {
 	unsigned int max_num_entries;
 	unsigned int used_entries;
 	int16_t **buffers;
+	/*! The channels to write the mix to, with room for max_num_entries */
+	struct ast_bridge_channel **channels;
+	/*! The channel each buffer was read from */
+	struct softmix_channel **sources;
 };
 
 struct softmix_translate_helper_entry {
@@ -169,14 +243,72 @@ struct softmix_translate_helper_entry {
 	struct ast_format *dst_format; /*!< The destination format for this helper */
 	struct ast_trans_pvt *trans_pvt; /*!< the translator for this slot. */
 	struct ast_frame *out_frame; /*!< The output frame from the last translation */
+	struct ast_frame *shared_frame; /*!< The output frame shared by every listener of the full mix */
 	AST_LIST_ENTRY(softmix_translate_helper_entry) entry;
 };
 
+/*!
+ * \brief The encoded mixes of a bridge, shared by the threads writing them
+ *
+ * Entries are keyed by the format written to a channel, which carries its
+ * sample rate. The source sample rate and the mixing interval are the same
+ * for every entry and the entries are rebuilt when either changes. The full
+ * mix is the only mix heard by more than one channel, since a talker hears
+ * the mix without their own audio, so only the full mix is encoded here.
+ */
 struct softmix_translate_helper {
+	ast_mutex_t lock; /*!< the lock for the entries, which every write thread uses */
 	struct ast_format *slin_src; /*!< the source format expected for all the translators */
+	unsigned int resample_quality; /*!< the quality of resampling to each format, 0 for the default */
 	AST_LIST_HEAD_NOLOCK(, softmix_translate_helper_entry) entries;
 };
 
+/*!
+ * \brief The channels of a bridge mixed at one sample rate
+ *
+ * A channel whose native rate is below the bridge's internal rate is mixed
+ * on a plane at its own rate, so its audio is not resampled on the way in
+ * or out. The talkers of each plane are summed at its rate and only those
+ * sums are resampled to combine the planes, so the cost of resampling does
+ * not grow with the number of channels. A channel's own audio is never
+ * resampled on its own plane, so it is still taken back out exactly.
+ */
+struct softmix_plane {
+	/*! Sample rate of the plane */
+	unsigned int rate;
+	/*! Signed linear format at the plane's rate */
+	struct ast_format *slin;
+	/*! Samples in a mixing interval */
+	unsigned int samples;
+	/*! Bytes in a mixing interval */
+	unsigned int datalen;
+	/*! Number of channels on the plane */
+	unsigned int num_channels;
+	/*! Resamples the plane's talkers up to the internal rate */
+	struct ast_trans_pvt *up;
+	/*! Resamples the other planes' talkers down from the internal rate */
+	struct ast_trans_pvt *down;
+	/*! The encoded mixes shared by the plane's channels */
+	struct softmix_translate_helper trans_helper;
+	/*! The talkers on the plane */
+	int16_t talkers[MAX_DATALEN];
+	/*! The talkers of the other planes, at the internal rate or the plane's */
+	int16_t others[MAX_DATALEN];
+	/*! The full mix at the plane's rate */
+	int16_t buf[MAX_DATALEN];
+};
+
+/*! \brief A thread sharing the write phase with the mixing thread */
+struct softmix_write_worker {
+	/*! The bridge being written to */
+	struct softmix_bridge_data *softmix_data;
+	/*! Which share of the channels this worker writes to, from 1 */
+	unsigned int index;
+	/*! The last write phase this worker was given */
+	unsigned int generation;
+	pthread_t thread;
+};
+
 static struct softmix_translate_helper_entry *softmix_translate_helper_entry_alloc(struct ast_format *dst)
 {
 	struct softmix_translate_helper_entry *entry;
@@ -200,6 +332,9 @@ static void *softmix_translate_helper_free_entry(struct softmix_translate_helper
 	if (entry->out_frame) {
 		ast_frfree(entry->out_frame);
 	}
+	if (entry->shared_frame) {
+		ast_frfree(entry->shared_frame);
+	}
 	ast_free(entry);
 	return NULL;
 }
@@ -207,6 +342,7 @@ static void *softmix_translate_helper_free_entry(struct softmix_translate_helper
 static void softmix_translate_helper_init(struct softmix_translate_helper *trans_helper, unsigned int sample_rate)
 {
 	memset(trans_helper, 0, sizeof(*trans_helper));
+	ast_mutex_init(&trans_helper->lock);
 	trans_helper->slin_src = ast_format_cache_get_slin_by_rate(sample_rate);
 }
 
@@ -217,6 +353,7 @@ static void softmix_translate_helper_destroy(struct softmix_translate_helper *tr
 	while ((entry = AST_LIST_REMOVE_HEAD(&trans_helper->entries, entry))) {
 		softmix_translate_helper_free_entry(entry);
 	}
+	ast_mutex_destroy(&trans_helper->lock);
 }
 
 static void softmix_translate_helper_change_rate(struct softmix_translate_helper *trans_helper, unsigned int sample_rate)
@@ -230,12 +367,214 @@ static void softmix_translate_helper_change_rate(struct softmix_translate_helper
 			if (!(entry->trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src))) {
 				AST_LIST_REMOVE_CURRENT(entry);
 				entry = softmix_translate_helper_free_entry(entry);
+			} else if (trans_helper->resample_quality) {
+				ast_translator_set_quality(entry->trans_pvt, trans_helper->resample_quality);
 			}
 		}
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
 }
 
+/*!
+ * \internal
+ * \brief Set the rate and mixing interval of a plane
+ *
+ * \param plane The plane
+ * \param rate The sample rate
+ * \param interval The mixing interval in milliseconds
+ */
+static void softmix_plane_set_rate(struct softmix_plane *plane, unsigned int rate, unsigned int interval)
+{
+	plane->rate = rate;
+	plane->slin = ast_format_cache_get_slin_by_rate(rate);
+	plane->samples = SOFTMIX_SAMPLES(rate, interval);
+	plane->datalen = SOFTMIX_DATALEN(rate, interval);
+	if (plane->up) {
+		ast_translator_free_path(plane->up);
+		plane->up = NULL;
+	}
+	if (plane->down) {
+		ast_translator_free_path(plane->down);
+		plane->down = NULL;
+	}
+	softmix_translate_helper_change_rate(&plane->trans_helper, rate);
+}
+
+static void softmix_plane_destroy(struct softmix_plane *plane)
+{
+	if (plane->up) {
+		ast_translator_free_path(plane->up);
+	}
+	if (plane->down) {
+		ast_translator_free_path(plane->down);
+	}
+	softmix_translate_helper_destroy(&plane->trans_helper);
+	ast_free(plane);
+}
+
+static struct softmix_plane *softmix_plane_alloc(unsigned int rate, unsigned int interval)
+{
+	struct softmix_plane *plane;
+
+	plane = ast_calloc(1, sizeof(*plane));
+	if (!plane) {
+		return NULL;
+	}
+	softmix_translate_helper_init(&plane->trans_helper, rate);
+	softmix_plane_set_rate(plane, rate, interval);
+	return plane;
+}
+
+/*!
+ * \internal
+ * \brief Find the plane to mix a channel on, adding it if needed
+ *
+ * \param softmix_data The bridge
+ * \param native_rate The channel's native sample rate
+ * \param interval The mixing interval in milliseconds
+ *
+ * \note The bridge must be locked.
+ *
+ * \return The plane at the channel's rate, or at the internal rate if the
+ * channel's rate is not below it or no more planes can be added
+ */
+static struct softmix_plane *softmix_plane_get(struct softmix_bridge_data *softmix_data,
+	unsigned int native_rate, unsigned int interval)
+{
+	struct softmix_plane *plane;
+	unsigned int idx;
+
+	if (native_rate >= softmix_data->planes[0]->rate) {
+		return softmix_data->planes[0];
+	}
+	for (idx = 1; idx < softmix_data->num_planes; ++idx) {
+		if (softmix_data->planes[idx]->rate == native_rate) {
+			return softmix_data->planes[idx];
+		}
+	}
+	if (softmix_data->num_planes == SOFTMIX_MAX_PLANES
+		|| !(plane = softmix_plane_alloc(native_rate, interval))) {
+		return softmix_data->planes[0];
+	}
+
+	ast_debug(1, "Bridge %s: adding a mixing plane at %u\n",
+		softmix_data->bridge->uniqueid, native_rate);
+	softmix_data->planes[softmix_data->num_planes++] = plane;
+	return plane;
+}
+
+/*!
+ * \internal
+ * \brief Put every plane but the first aside for a new internal rate or interval
+ *
+ * \note Only called by the mixing thread, with the bridge locked. Every
+ * channel must be given a plane again afterwards.
+ */
+static void softmix_planes_reset(struct softmix_bridge_data *softmix_data)
+{
+	while (softmix_data->num_planes > 1) {
+		softmix_plane_destroy(softmix_data->planes[--softmix_data->num_planes]);
+	}
+	softmix_plane_set_rate(softmix_data->planes[0], softmix_data->internal_rate,
+		softmix_data->internal_mixing_interval);
+}
+
+/*!
+ * \internal
+ * \brief Put aside the planes no channel is mixed on
+ *
+ * \note Only called by the mixing thread, with the bridge locked.
+ */
+static void softmix_planes_prune(struct softmix_bridge_data *softmix_data)
+{
+	unsigned int idx = 1;
+
+	while (idx < softmix_data->num_planes) {
+		if (softmix_data->planes[idx]->num_channels) {
+			++idx;
+			continue;
+		}
+		ast_debug(1, "Bridge %s: removing the mixing plane at %u\n",
+			softmix_data->bridge->uniqueid, softmix_data->planes[idx]->rate);
+		softmix_plane_destroy(softmix_data->planes[idx]);
+		memmove(&softmix_data->planes[idx], &softmix_data->planes[idx + 1],
+			(--softmix_data->num_planes - idx) * sizeof(softmix_data->planes[0]));
+	}
+}
+
+/*!
+ * \internal
+ * \brief Resample a mixing interval of audio from one plane's rate to another's
+ *
+ * \param trans Where the resampler is kept, built when first needed
+ * \param quality The quality of resampling, 0 for the default
+ * \param from The plane whose rate the audio is at
+ * \param src The audio
+ * \param to The plane whose rate to resample to
+ * \param dst Where to put the resampled audio
+ */
+static void softmix_plane_resample(struct ast_trans_pvt **trans, unsigned int quality,
+	struct softmix_plane *from, int16_t *src, struct softmix_plane *to, int16_t *dst)
+{
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.subclass.format = from->slin,
+		.data.ptr = src,
+		.datalen = from->datalen,
+		.samples = from->samples,
+		.src = "softmix",
+	};
+	struct ast_frame *out;
+	unsigned int samples = 0;
+
+	if (!*trans && (*trans = ast_translator_build_path(to->slin, from->slin)) && quality) {
+		ast_translator_set_quality(*trans, quality);
+	}
+	if (*trans && (out = ast_translate(*trans, &frame, 0))) {
+		samples = MIN(out->samples, to->samples);
+		memcpy(dst, out->data.ptr, samples * sizeof(*dst));
+		ast_frfree(out);
+	}
+	/* The resampler gives fewer samples while it fills its filter */
+	memset(dst + samples, 0, (to->samples - samples) * sizeof(*dst));
+}
+
+/*!
+ * \internal
+ * \brief Build the full mix of every plane from the talkers of each
+ *
+ * The talkers of each lower plane are resampled up and added to the first
+ * plane's, which gives its full mix. Each lower plane is then given the
+ * full mix without its own talkers, resampled down, plus its own talkers.
+ *
+ * \param softmix_data The bridge
+ * \param quality The quality of resampling, 0 for the default
+ */
+static void softmix_planes_mix(struct softmix_bridge_data *softmix_data, unsigned int quality)
+{
+	struct softmix_plane *top = softmix_data->planes[0];
+	struct softmix_plane *plane;
+	unsigned int idx;
+
+	memcpy(top->buf, top->talkers, top->datalen);
+
+	for (idx = 1; idx < softmix_data->num_planes; ++idx) {
+		plane = softmix_data->planes[idx];
+		softmix_plane_resample(&plane->up, quality, plane, plane->talkers, top, plane->others);
+		ast_slinear_saturated_add_block(top->buf, plane->others, top->samples);
+	}
+
+	for (idx = 1; idx < softmix_data->num_planes; ++idx) {
+		plane = softmix_data->planes[idx];
+		/* The buffer holds the other planes' talkers at the internal rate until resampled */
+		memcpy(plane->buf, top->buf, top->datalen);
+		ast_slinear_saturated_subtract_block(plane->buf, plane->others, top->samples);
+		softmix_plane_resample(&plane->down, quality, top, plane->buf, plane, plane->others);
+		memcpy(plane->buf, plane->talkers, plane->datalen);
+		ast_slinear_saturated_add_block(plane->buf, plane->others, plane->samples);
+	}
+}
+
 /*!
  * \internal
  * \brief Get the next available audio on the softmix channel's read stream
@@ -260,33 +599,35 @@ static int16_t *softmix_process_read_audio(struct softmix_channel *sc, unsigned
  * \brief Process a softmix channel's write audio
  *
  * \details This function will remove the channel's talking from its own audio if present and
- * possibly even do the channel's write translation for it depending on how many other
- * channels use the same write format.
+ * possibly even share the write translation of the full mix with other channels using the same
+ * write format.
+ *
+ * \return The frame to queue to the channel
  */
-static void softmix_process_write_audio(struct softmix_translate_helper *trans_helper,
+static struct ast_frame *softmix_process_write_audio(struct softmix_translate_helper *trans_helper,
 	struct ast_format *raw_write_fmt,
 	struct softmix_channel *sc)
 {
 	struct softmix_translate_helper_entry *entry = NULL;
-	int i;
+	struct ast_frame *out = &sc->write_frame;
 
 	/* If we provided audio that was not determined to be silence,
 	 * then take it out while in slinear format. */
 	if (sc->have_audio && sc->talking) {
-		for (i = 0; i < sc->write_frame.samples; i++) {
-			ast_slinear_saturated_subtract(&sc->final_buf[i], &sc->our_buf[i]);
-		}
+		ast_slinear_saturated_subtract_block(sc->final_buf, sc->our_buf, sc->write_frame.samples);
 		/* check to see if any entries exist for the format. if not we'll want
 		   to remove it during cleanup */
+		ast_mutex_lock(&trans_helper->lock);
 		AST_LIST_TRAVERSE(&trans_helper->entries, entry, entry) {
 			if (ast_format_cmp(entry->dst_format, raw_write_fmt) == AST_FORMAT_CMP_EQUAL) {
 				++entry->num_times_requested;
 				break;
 			}
 		}
+		ast_mutex_unlock(&trans_helper->lock);
 		/* do not do any special write translate optimization if we had to make
 		 * a special mix for them to remove their own audio. */
-		return;
+		return out;
 	}
 
 	/* Attempt to optimize channels using the same translation path/codec. Build a list of entries
@@ -294,6 +635,7 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 	   type should be able to use the same out_frame. Since the optimization is only necessary for
 	   multiple channels (>=2) using the same codec make sure resources are allocated only when
 	   needed and released when not (see also softmix_translate_helper_cleanup */
+	ast_mutex_lock(&trans_helper->lock);
 	AST_LIST_TRAVERSE(&trans_helper->entries, entry, entry) {
 		if (ast_format_cmp(entry->dst_format, raw_write_fmt) == AST_FORMAT_CMP_EQUAL) {
 			entry->num_times_requested++;
@@ -302,15 +644,19 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 		}
 		if (!entry->trans_pvt && (entry->num_times_requested > 1)) {
 			entry->trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src);
+			if (entry->trans_pvt && trans_helper->resample_quality) {
+				ast_translator_set_quality(entry->trans_pvt, trans_helper->resample_quality);
+			}
 		}
 		if (entry->trans_pvt && !entry->out_frame) {
 			entry->out_frame = ast_translate(entry->trans_pvt, &sc->write_frame, 0);
+			/* The encoded mix is queued to every listener without copying it again */
+			if (entry->out_frame) {
+				entry->shared_frame = ast_frshare(entry->out_frame);
+			}
 		}
-		if (entry->out_frame && (entry->out_frame->datalen < MAX_DATALEN)) {
-			ao2_replace(sc->write_frame.subclass.format, entry->out_frame->subclass.format);
-			memcpy(sc->final_buf, entry->out_frame->data.ptr, entry->out_frame->datalen);
-			sc->write_frame.datalen = entry->out_frame->datalen;
-			sc->write_frame.samples = entry->out_frame->samples;
+		if (entry->shared_frame) {
+			out = entry->shared_frame;
 		}
 		break;
 	}
@@ -319,6 +665,39 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 	if (!entry && (entry = softmix_translate_helper_entry_alloc(raw_write_fmt))) {
 		AST_LIST_INSERT_HEAD(&trans_helper->entries, entry, entry);
 	}
+	ast_mutex_unlock(&trans_helper->lock);
+
+	return out;
+}
+
+/*!
+ * \internal
+ * \brief Get the mix already encoded in a format for another channel
+ *
+ * \param trans_helper The translation helper of the mixing interval
+ * \param raw_write_fmt The format the channel is written in
+ *
+ * \return The shared encoded frame, or NULL if the mix is not yet encoded in the format
+ */
+static struct ast_frame *softmix_translate_helper_shared(struct softmix_translate_helper *trans_helper,
+	struct ast_format *raw_write_fmt)
+{
+	struct softmix_translate_helper_entry *entry;
+	struct ast_frame *out = NULL;
+
+	ast_mutex_lock(&trans_helper->lock);
+	AST_LIST_TRAVERSE(&trans_helper->entries, entry, entry) {
+		if (ast_format_cmp(entry->dst_format, raw_write_fmt) == AST_FORMAT_CMP_EQUAL) {
+			if (entry->shared_frame) {
+				entry->num_times_requested++;
+				out = entry->shared_frame;
+			}
+			break;
+		}
+	}
+	ast_mutex_unlock(&trans_helper->lock);
+
+	return out;
 }
 
 static void softmix_translate_helper_cleanup(struct softmix_translate_helper *trans_helper)
@@ -337,6 +716,10 @@ static void softmix_translate_helper_cleanup(struct softmix_translate_helper *tr
 			ast_frfree(entry->out_frame);
 			entry->out_frame = NULL;
 		}
+		if (entry->shared_frame) {
+			ast_frfree(entry->shared_frame);
+			entry->shared_frame = NULL;
+		}
 
 		/* nothing is optimized for a single path reference, so there is
 		   no reason to continue to hold onto the codec */
@@ -353,10 +736,40 @@ static void softmix_translate_helper_cleanup(struct softmix_translate_helper *tr
 	AST_LIST_TRAVERSE_SAFE_END;
 }
 
+/*!
+ * \internal
+ * \brief Set the bridge's resample quality on a channel's translation paths
+ *
+ * \param bridge_channel Which channel's paths to set
+ */
+static void softmix_set_resample_quality(struct ast_bridge_channel *bridge_channel)
+{
+	unsigned int quality = bridge_channel->bridge->softmix.resample_quality;
+
+	if (!quality) {
+		return;
+	}
+
+	ast_channel_lock(bridge_channel->chan);
+	ast_translator_set_quality(ast_channel_readtrans(bridge_channel->chan), quality);
+	ast_translator_set_quality(ast_channel_writetrans(bridge_channel->chan), quality);
+	ast_channel_unlock(bridge_channel->chan);
+}
+
 static void set_softmix_bridge_data(int rate, int interval, struct ast_bridge_channel *bridge_channel, int reset)
 {
 	struct softmix_channel *sc = bridge_channel->tech_pvt;
+	struct softmix_bridge_data *softmix_data = bridge_channel->bridge->tech_pvt;
 	struct ast_format *slin_format;
+	unsigned int native_rate;
+
+	/* Mix the channel at its own rate if that is below the bridge's */
+	ast_channel_lock(bridge_channel->chan);
+	native_rate = MAX(SOFTMIX_MIN_SAMPLE_RATE,
+		ast_format_get_sample_rate(ast_channel_rawreadformat(bridge_channel->chan)));
+	ast_channel_unlock(bridge_channel->chan);
+	sc->plane = softmix_plane_get(softmix_data, MIN(native_rate, rate), interval);
+	rate = sc->plane->rate;
 
 	slin_format = ast_format_cache_get_slin_by_rate(rate);
 
@@ -390,10 +803,23 @@ static void set_softmix_bridge_data(int rate, int interval, struct ast_bridge_ch
 
 	/* set new read and write formats on channel. */
 	ast_channel_lock(bridge_channel->chan);
-	ast_set_read_format_path(bridge_channel->chan,
-		ast_channel_rawreadformat(bridge_channel->chan), slin_format);
+	if (bridge_channel->tech_args.listen_only) {
+		/* Audio from a listener is thrown away, so it is not decoded either */
+		ast_set_read_format(bridge_channel->chan, ast_channel_rawreadformat(bridge_channel->chan));
+	} else {
+		ast_set_read_format_path(bridge_channel->chan,
+			ast_channel_rawreadformat(bridge_channel->chan), slin_format);
+	}
 	ast_channel_unlock(bridge_channel->chan);
 	ast_set_write_format(bridge_channel->chan, slin_format);
+	softmix_set_resample_quality(bridge_channel);
+
+	/* A listener's audio is never examined, so it has no DSP */
+	if (bridge_channel->tech_args.listen_only) {
+		sc->dsp = NULL;
+		ast_mutex_unlock(&sc->lock);
+		return;
+	}
 
 	/* set up new DSP.  This is on the read side only right before the read frame enters the smoother.  */
 	sc->dsp = ast_dsp_new_with_rate(rate);
@@ -470,6 +896,13 @@ static int softmix_bridge_join(struct ast_bridge *bridge, struct ast_bridge_chan
 	/* Can't forget to record our pvt structure within the bridged channel structure */
 	bridge_channel->tech_pvt = sc;
 
+	sc->numa_node = -1;
+	if (ast_thread_affinity_mixing_follows_participants()
+		&& (sc->numa_node = ast_thread_affinity_current_node()) >= 0) {
+		softmix_data->node_channels[sc->numa_node]++;
+		softmix_data->nodes_changed = 1;
+	}
+
 	set_softmix_bridge_data(softmix_data->internal_rate,
 		softmix_data->internal_mixing_interval
 			? softmix_data->internal_mixing_interval
@@ -490,6 +923,13 @@ static void softmix_bridge_leave(struct ast_bridge *bridge, struct ast_bridge_ch
 	}
 	bridge_channel->tech_pvt = NULL;
 
+	if (sc->numa_node >= 0 && bridge->tech_pvt) {
+		struct softmix_bridge_data *softmix_data = bridge->tech_pvt;
+
+		softmix_data->node_channels[sc->numa_node]--;
+		softmix_data->nodes_changed = 1;
+	}
+
 	softmix_src_change(bridge_channel);
 
 	/* Drop mutex lock */
@@ -592,6 +1032,11 @@ static void softmix_bridge_write_voice(struct ast_bridge *bridge, struct ast_bri
 		DEFAULT_SOFTMIX_SILENCE_THRESHOLD;
 	char update_talking = -1;  /* if this is set to 0 or 1, tell the bridge that the channel has started or stopped talking. */
 
+	/* Nobody hears a listener, so its audio is dropped without being examined */
+	if (bridge_channel->tech_args.listen_only) {
+		return;
+	}
+
 	/* Write the frame into the conference */
 	ast_mutex_lock(&sc->lock);
 
@@ -613,6 +1058,10 @@ static void softmix_bridge_write_voice(struct ast_bridge *bridge, struct ast_bri
 			ast_format_get_name(sc->read_slin_format));
 		ast_set_read_format_path(bridge_channel->chan, frame->subclass.format,
 			sc->read_slin_format);
+		if (bridge->softmix.resample_quality) {
+			ast_translator_set_quality(ast_channel_readtrans(bridge_channel->chan),
+				bridge->softmix.resample_quality);
+		}
 		ast_channel_unlock(bridge_channel->chan);
 	}
 
@@ -634,13 +1083,17 @@ static void softmix_bridge_write_voice(struct ast_bridge *bridge, struct ast_bri
 	if (totalsilence < silence_threshold) {
 		if (!sc->talking) {
 			update_talking = 1;
+			sc->talker_energy = cur_energy;
 		}
 		sc->talking = 1; /* tell the write process we have audio to be mixed out */
+		/* Smooth the energy so the loudest talkers do not change on every frame */
+		sc->talker_energy += (cur_energy - sc->talker_energy) / 4;
 	} else {
 		if (sc->talking) {
 			update_talking = 0;
 		}
 		sc->talking = 0;
+		sc->talker_energy = 0;
 	}
 
 	/* Before adding audio in, make sure we haven't fallen behind. If audio has fallen
@@ -866,6 +1319,16 @@ static unsigned int analyse_softmix_stats(struct softmix_stats *stats, struct so
 	return 0;
 }
 
+static void softmix_mixing_array_destroy(struct softmix_mixing_array *mixing_array)
+{
+	ast_free(mixing_array->buffers);
+	mixing_array->buffers = NULL;
+	ast_free(mixing_array->channels);
+	mixing_array->channels = NULL;
+	ast_free(mixing_array->sources);
+	mixing_array->sources = NULL;
+}
+
 static int softmix_mixing_array_init(struct softmix_mixing_array *mixing_array, unsigned int starting_num_entries)
 {
 	memset(mixing_array, 0, sizeof(*mixing_array));
@@ -874,17 +1337,20 @@ static int softmix_mixing_array_init(struct softmix_mixing_array *mixing_array,
 		ast_log(LOG_NOTICE, "Failed to allocate softmix mixing structure.\n");
 		return -1;
 	}
+	if (!(mixing_array->channels = ast_calloc(mixing_array->max_num_entries, sizeof(struct ast_bridge_channel *)))
+		|| !(mixing_array->sources = ast_calloc(mixing_array->max_num_entries, sizeof(struct softmix_channel *)))) {
+		ast_log(LOG_NOTICE, "Failed to allocate softmix mixing structure.\n");
+		softmix_mixing_array_destroy(mixing_array);
+		return -1;
+	}
 	return 0;
 }
 
-static void softmix_mixing_array_destroy(struct softmix_mixing_array *mixing_array)
-{
-	ast_free(mixing_array->buffers);
-}
-
 static int softmix_mixing_array_grow(struct softmix_mixing_array *mixing_array, unsigned int num_entries)
 {
 	int16_t **tmp;
+	struct ast_bridge_channel **channels;
+	struct softmix_channel **sources;
 	/* give it some room to grow since memory is cheap but allocations can be expensive */
 	mixing_array->max_num_entries = num_entries;
 	if (!(tmp = ast_realloc(mixing_array->buffers, (mixing_array->max_num_entries * sizeof(int16_t *))))) {
@@ -892,9 +1358,254 @@ static int softmix_mixing_array_grow(struct softmix_mixing_array *mixing_array,
 		return -1;
 	}
 	mixing_array->buffers = tmp;
+	if (!(channels = ast_realloc(mixing_array->channels, (mixing_array->max_num_entries * sizeof(*channels))))) {
+		ast_log(LOG_NOTICE, "Failed to re-allocate softmix mixing structure.\n");
+		return -1;
+	}
+	mixing_array->channels = channels;
+	if (!(sources = ast_realloc(mixing_array->sources, (mixing_array->max_num_entries * sizeof(*sources))))) {
+		ast_log(LOG_NOTICE, "Failed to re-allocate softmix mixing structure.\n");
+		return -1;
+	}
+	mixing_array->sources = sources;
 	return 0;
 }
 
+/*! \brief Order mixing sources loudest first */
+static int softmix_source_cmp(const void *left, const void *right)
+{
+	const struct softmix_channel *sc_left = *(struct softmix_channel * const *) left;
+	const struct softmix_channel *sc_right = *(struct softmix_channel * const *) right;
+
+	return sc_right->mix_energy - sc_left->mix_energy;
+}
+
+/*!
+ * \internal
+ * \brief Keep only the loudest talkers in the mixing array
+ *
+ * \param mixing_array The buffers read for this interval
+ * \param max_talkers How many buffers to keep
+ *
+ * The channels whose audio is left out have it treated as if they had
+ * provided none, so it is not taken back out of the mix they hear.
+ */
+static void softmix_mixing_array_limit(struct softmix_mixing_array *mixing_array, unsigned int max_talkers)
+{
+	unsigned int idx;
+
+	qsort(mixing_array->sources, mixing_array->used_entries, sizeof(*mixing_array->sources), softmix_source_cmp);
+	for (idx = max_talkers; idx < mixing_array->used_entries; ++idx) {
+		mixing_array->sources[idx]->have_audio = 0;
+	}
+	mixing_array->used_entries = max_talkers;
+	for (idx = 0; idx < mixing_array->used_entries; ++idx) {
+		mixing_array->buffers[idx] = mixing_array->sources[idx]->our_buf;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Remove a channel's own audio from the mix and queue it to the channel
+ *
+ * \param job The write phase
+ * \param bridge_channel The channel to write to
+ */
+static void softmix_write_channel(struct softmix_write_job *job, struct ast_bridge_channel *bridge_channel)
+{
+	struct softmix_channel *sc = bridge_channel->tech_pvt;
+	struct softmix_plane *plane = sc->plane;
+	struct ast_frame *out;
+
+	/* A listener is sent the mix already encoded for another listener when there is one */
+	if (bridge_channel->tech_args.listen_only
+		&& (out = softmix_translate_helper_shared(&plane->trans_helper, ast_channel_rawwriteformat(bridge_channel->chan)))) {
+		ast_bridge_channel_queue_frame(bridge_channel, out);
+		return;
+	}
+
+	ast_mutex_lock(&sc->lock);
+
+	/* Make SLINEAR write frame from local buffer */
+	ao2_t_replace(sc->write_frame.subclass.format, plane->slin,
+		"Replace softmix channel slin format");
+	sc->write_frame.datalen = plane->datalen;
+	sc->write_frame.samples = plane->samples;
+	memcpy(sc->final_buf, plane->buf, plane->datalen);
+
+	/* process the softmix channel's new write audio */
+	out = softmix_process_write_audio(&plane->trans_helper, ast_channel_rawwriteformat(bridge_channel->chan), sc);
+
+	ast_mutex_unlock(&sc->lock);
+
+	/* A frame is now ready for the channel. */
+	ast_bridge_channel_queue_frame(bridge_channel, out);
+}
+
+/*!
+ * \internal
+ * \brief Write to one share of the channels of a write phase
+ *
+ * \param job The write phase
+ * \param share Which share to write to
+ * \param shares Number of threads sharing the write phase
+ */
+static void softmix_write_share(struct softmix_write_job *job, unsigned int share, unsigned int shares)
+{
+	unsigned int idx;
+
+	for (idx = share; idx < job->num_channels; idx += shares) {
+		softmix_write_channel(job, job->channels[idx]);
+	}
+}
+
+static void *softmix_write_worker_thread(void *data)
+{
+	struct softmix_write_worker *worker = data;
+	struct softmix_bridge_data *softmix_data = worker->softmix_data;
+
+	ast_thread_affinity_apply(AST_THREAD_CLASS_MIXING);
+
+	ast_mutex_lock(&softmix_data->work_lock);
+	for (;;) {
+		while (!softmix_data->workers_stop && worker->generation == softmix_data->work_generation) {
+			ast_cond_wait(&softmix_data->work_cond, &softmix_data->work_lock);
+		}
+		if (softmix_data->workers_stop) {
+			break;
+		}
+		worker->generation = softmix_data->work_generation;
+		ast_mutex_unlock(&softmix_data->work_lock);
+
+		softmix_write_share(&softmix_data->job, worker->index, softmix_data->num_workers + 1);
+
+		ast_mutex_lock(&softmix_data->work_lock);
+		if (!--softmix_data->work_pending) {
+			ast_cond_signal(&softmix_data->done_cond);
+		}
+	}
+	ast_mutex_unlock(&softmix_data->work_lock);
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Stop the write workers of a bridge
+ *
+ * \note Only called by the mixing thread, while the workers are idle.
+ */
+static void softmix_write_workers_stop(struct softmix_bridge_data *softmix_data)
+{
+	unsigned int idx;
+
+	if (!softmix_data->num_workers) {
+		return;
+	}
+
+	ast_mutex_lock(&softmix_data->work_lock);
+	softmix_data->workers_stop = 1;
+	ast_cond_broadcast(&softmix_data->work_cond);
+	ast_mutex_unlock(&softmix_data->work_lock);
+
+	for (idx = 0; idx < softmix_data->num_workers; ++idx) {
+		pthread_join(softmix_data->workers[idx].thread, NULL);
+	}
+	ast_free(softmix_data->workers);
+	softmix_data->workers = NULL;
+	softmix_data->num_workers = 0;
+	softmix_data->workers_stop = 0;
+}
+
+/*!
+ * \internal
+ * \brief Start the write workers of a bridge
+ *
+ * \param softmix_data The bridge
+ * \param num_workers Number of threads to start besides the mixing thread
+ *
+ * \note Only called by the mixing thread. If the threads cannot be
+ * started the mixing thread writes to every channel itself.
+ */
+static void softmix_write_workers_start(struct softmix_bridge_data *softmix_data, unsigned int num_workers)
+{
+	unsigned int idx;
+
+	if (!num_workers || !(softmix_data->workers = ast_calloc(num_workers, sizeof(*softmix_data->workers)))) {
+		return;
+	}
+
+	for (idx = 0; idx < num_workers; ++idx) {
+		struct softmix_write_worker *worker = &softmix_data->workers[idx];
+
+		worker->softmix_data = softmix_data;
+		worker->index = idx + 1;
+		worker->generation = softmix_data->work_generation;
+		if (ast_pthread_create(&worker->thread, NULL, softmix_write_worker_thread, worker)) {
+			ast_log(LOG_WARNING, "Bridge %s: Failed to start softmix write thread\n",
+				softmix_data->bridge->uniqueid);
+			break;
+		}
+		++softmix_data->num_workers;
+	}
+
+	if (!softmix_data->num_workers) {
+		ast_free(softmix_data->workers);
+		softmix_data->workers = NULL;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Start or stop write workers to match the bridge's setting
+ *
+ * \note The bridge must be locked.
+ */
+static void softmix_write_workers_update(struct softmix_bridge_data *softmix_data, unsigned int mixing_threads)
+{
+	unsigned int num_workers = MIN(MAX(mixing_threads, 1), SOFTMIX_MAX_MIXING_THREADS) - 1;
+
+	if (num_workers == softmix_data->num_workers) {
+		return;
+	}
+
+	ast_debug(1, "Bridge %s: using %u threads to write mixed audio\n",
+		softmix_data->bridge->uniqueid, num_workers + 1);
+	softmix_write_workers_stop(softmix_data);
+	softmix_write_workers_start(softmix_data, num_workers);
+}
+
+/*!
+ * \internal
+ * \brief Write the mix to every channel of a write phase, sharing it with the workers
+ *
+ * \param softmix_data The bridge
+ */
+static void softmix_write_all(struct softmix_bridge_data *softmix_data)
+{
+	unsigned int shares = softmix_data->num_workers + 1;
+
+	/* A single share has nothing to gain from waking the workers */
+	if (shares == 1 || softmix_data->job.num_channels < 2) {
+		softmix_write_share(&softmix_data->job, 0, 1);
+		return;
+	}
+
+	ast_mutex_lock(&softmix_data->work_lock);
+	softmix_data->work_pending = softmix_data->num_workers;
+	++softmix_data->work_generation;
+	ast_cond_broadcast(&softmix_data->work_cond);
+	ast_mutex_unlock(&softmix_data->work_lock);
+
+	softmix_write_share(&softmix_data->job, 0, shares);
+
+	ast_mutex_lock(&softmix_data->work_lock);
+	while (softmix_data->work_pending) {
+		ast_cond_wait(&softmix_data->done_cond, &softmix_data->work_lock);
+	}
+	ast_mutex_unlock(&softmix_data->work_lock);
+}
+
 /*!
  * \brief Mixing loop.
  *
@@ -907,18 +1618,17 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	struct softmix_mixing_array mixing_array;
 	struct softmix_bridge_data *softmix_data = bridge->tech_pvt;
 	struct ast_timer *timer;
-	struct softmix_translate_helper trans_helper;
-	int16_t buf[MAX_DATALEN];
+	struct softmix_plane *plane;
 	unsigned int stat_iteration_counter = 0; /* counts down, gather stats at zero and reset. */
 	int timingfd;
 	int update_all_rates = 0; /* set this when the internal sample rate has changed */
 	unsigned int idx;
-	unsigned int x;
 	int res = -1;
+	struct timeval start;
+	int64_t elapsed_us;
 
 	timer = softmix_data->timer;
 	timingfd = ast_timer_fd(timer);
-	softmix_translate_helper_init(&trans_helper, softmix_data->internal_rate);
 	ast_timer_set_rate(timer, (1000 / softmix_data->internal_mixing_interval));
 
 	/* Give the mixing array room to grow, memory is cheap but allocations are expensive. */
@@ -933,10 +1643,10 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	while (!softmix_data->stop && bridge->num_active) {
 		struct ast_bridge_channel *bridge_channel;
 		int timeout = -1;
-		struct ast_format *cur_slin = ast_format_cache_get_slin_by_rate(softmix_data->internal_rate);
-		unsigned int softmix_samples = SOFTMIX_SAMPLES(softmix_data->internal_rate, softmix_data->internal_mixing_interval);
 		unsigned int softmix_datalen = SOFTMIX_DATALEN(softmix_data->internal_rate, softmix_data->internal_mixing_interval);
 
+		start = ast_tvnow();
+
 		if (softmix_datalen > MAX_DATALEN) {
 			/* This should NEVER happen, but if it does we need to know about it. Almost
 			 * all the memcpys used during this process depend on this assumption.  Rather
@@ -964,9 +1674,20 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 			stats.locked_rate = bridge->softmix.internal_sample_rate;
 		}
 
-		/* If the sample rate has changed, update the translator helper */
+		/* Start or stop threads to write the mix if the bridge asks for a different number */
+		softmix_write_workers_update(softmix_data, bridge->softmix.mixing_threads);
+
+		/* If the sample rate has changed, every channel is given a plane again */
 		if (update_all_rates) {
-			softmix_translate_helper_change_rate(&trans_helper, softmix_data->internal_rate);
+			softmix_planes_reset(softmix_data);
+		}
+
+		for (idx = 0; idx < softmix_data->num_planes; ++idx) {
+			plane = softmix_data->planes[idx];
+			/* Resample the shared mixes at the quality the bridge asks for */
+			plane->trans_helper.resample_quality = bridge->softmix.resample_quality;
+			plane->num_channels = 0;
+			memset(plane->talkers, 0, plane->datalen);
 		}
 
 		/* Go through pulling audio from each factory that has it available */
@@ -977,69 +1698,87 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 			if (update_all_rates) {
 				set_softmix_bridge_data(softmix_data->internal_rate, softmix_data->internal_mixing_interval, bridge_channel, 1);
 			}
+			sc->plane->num_channels++;
 
 			/* If stat_iteration_counter is 0, then collect statistics during this mixing interation */
 			if (!stat_iteration_counter) {
 				gather_softmix_stats(&stats, softmix_data, bridge_channel);
 			}
 
-			/* if the channel is suspended, don't check for audio, but still gather stats */
-			if (bridge_channel->suspended) {
+			/* if the channel is suspended or only listens, don't check for audio, but still gather stats */
+			if (bridge_channel->suspended || bridge_channel->tech_args.listen_only) {
 				continue;
 			}
 
 			/* Try to get audio from the factory if available */
 			ast_mutex_lock(&sc->lock);
-			if ((mixing_array.buffers[mixing_array.used_entries] = softmix_process_read_audio(sc, softmix_samples))) {
+			if ((mixing_array.buffers[mixing_array.used_entries] = softmix_process_read_audio(sc, sc->plane->samples))) {
+				if (ast_test_flag(&bridge_channel->features->feature_flags, AST_BRIDGE_CHANNEL_FLAG_CASCADE)) {
+					/* A link to another bridge carries its talkers, so it is never dropped */
+					sc->mix_energy = INT_MAX;
+				} else {
+					sc->mix_energy = sc->talking ? sc->talker_energy : 0;
+				}
+				mixing_array.sources[mixing_array.used_entries] = sc;
 				mixing_array.used_entries++;
 			}
 			ast_mutex_unlock(&sc->lock);
 		}
 
-		/* mix it like crazy */
-		memset(buf, 0, softmix_datalen);
+		/* Only the loudest talkers are mixed if the bridge limits them */
+		if (bridge->softmix.max_talkers && mixing_array.used_entries > bridge->softmix.max_talkers) {
+			softmix_mixing_array_limit(&mixing_array, bridge->softmix.max_talkers);
+		}
+
+		/* mix it like crazy, each talker on its own plane */
 		for (idx = 0; idx < mixing_array.used_entries; ++idx) {
-			for (x = 0; x < softmix_samples; ++x) {
-				ast_slinear_saturated_add(buf + x, mixing_array.buffers[idx] + x);
-			}
+			plane = mixing_array.sources[idx]->plane;
+			ast_slinear_saturated_add_block(plane->talkers, mixing_array.buffers[idx], plane->samples);
 		}
+		/* then the planes together */
+		softmix_planes_mix(softmix_data, bridge->softmix.resample_quality);
 
 		/* Next step go through removing the channel's own audio and creating a good frame... */
+		softmix_data->job.channels = mixing_array.channels;
+		softmix_data->job.num_channels = 0;
 		AST_LIST_TRAVERSE(&bridge->channels, bridge_channel, entry) {
-			struct softmix_channel *sc = bridge_channel->tech_pvt;
-
-			if (bridge_channel->suspended) {
-				continue;
+			if (!bridge_channel->suspended) {
+				mixing_array.channels[softmix_data->job.num_channels++] = bridge_channel;
 			}
+		}
+		softmix_write_all(softmix_data);
 
-			ast_mutex_lock(&sc->lock);
-
-			/* Make SLINEAR write frame from local buffer */
-			ao2_t_replace(sc->write_frame.subclass.format, cur_slin,
-				"Replace softmix channel slin format");
-			sc->write_frame.datalen = softmix_datalen;
-			sc->write_frame.samples = softmix_samples;
-			memcpy(sc->final_buf, buf, softmix_datalen);
-
-			/* process the softmix channel's new write audio */
-			softmix_process_write_audio(&trans_helper, ast_channel_rawwriteformat(bridge_channel->chan), sc);
+		/* Count the intervals the mixing could not keep up with */
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+		++softmix_data->intervals;
+		if (elapsed_us > softmix_data->internal_mixing_interval * 1000) {
+			++softmix_data->overruns;
+		}
+		if (elapsed_us > softmix_data->max_interval_us) {
+			softmix_data->max_interval_us = elapsed_us;
+		}
+		AST_PROBE4(softmix__mix, bridge->uniqueid, bridge->num_channels,
+			mixing_array.used_entries, elapsed_us);
 
-			ast_mutex_unlock(&sc->lock);
+		for (idx = 0; idx < SOFTMIX_MAX_PLANES; ++idx) {
+			softmix_data->plane_rates[idx] = idx < softmix_data->num_planes ? softmix_data->planes[idx]->rate : 0;
+			softmix_data->plane_channels[idx] = idx < softmix_data->num_planes ? softmix_data->planes[idx]->num_channels : 0;
+		}
 
-			/* A frame is now ready for the channel. */
-			ast_bridge_channel_queue_frame(bridge_channel, &sc->write_frame);
+		/* cleanup any translation frame data from this mixing iteration. */
+		for (idx = 0; idx < softmix_data->num_planes; ++idx) {
+			softmix_translate_helper_cleanup(&softmix_data->planes[idx]->trans_helper);
 		}
 
 		update_all_rates = 0;
 		if (!stat_iteration_counter) {
 			update_all_rates = analyse_softmix_stats(&stats, softmix_data);
 			stat_iteration_counter = SOFTMIX_STAT_INTERVAL;
+			softmix_planes_prune(softmix_data);
 		}
 		stat_iteration_counter--;
 
 		ast_bridge_unlock(bridge);
-		/* cleanup any translation frame data from the previous mixing iteration. */
-		softmix_translate_helper_cleanup(&trans_helper);
 		/* Wait for the timing source to tell us to wake up and get things done */
 		ast_waitfor_n_fd(&timingfd, 1, &timeout, NULL);
 		if (ast_timer_ack(timer, 1) < 0) {
@@ -1062,11 +1801,36 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	res = 0;
 
 softmix_cleanup:
-	softmix_translate_helper_destroy(&trans_helper);
+	softmix_write_workers_stop(softmix_data);
 	softmix_mixing_array_destroy(&mixing_array);
 	return res;
 }
 
+/*!
+ * \internal
+ * \brief Move the mixing thread to the NUMA node most of the bridge's channels are on
+ *
+ * \note The bridge must be locked.
+ */
+static void softmix_follow_channels(struct softmix_bridge_data *softmix_data)
+{
+	int best = -1;
+	int node;
+
+	softmix_data->nodes_changed = 0;
+	for (node = 0; node < AST_THREAD_AFFINITY_MAX_NODES; ++node) {
+		if (softmix_data->node_channels[node]
+			&& (best < 0 || softmix_data->node_channels[node] > softmix_data->node_channels[best])) {
+			best = node;
+		}
+	}
+	if (best >= 0) {
+		ast_debug(1, "Bridge %s: placing mixing thread on NUMA node %d\n",
+			softmix_data->bridge->uniqueid, best);
+		ast_thread_affinity_apply_node(AST_THREAD_CLASS_MIXING, best);
+	}
+}
+
 /*!
  * \internal
  * \brief Mixing thread.
@@ -1081,6 +1845,8 @@ static void *softmix_mixing_thread(void *data)
 	struct softmix_bridge_data *softmix_data = data;
 	struct ast_bridge *bridge = softmix_data->bridge;
 
+	ast_thread_affinity_apply(AST_THREAD_CLASS_MIXING);
+
 	ast_bridge_lock(bridge);
 	if (bridge->callid) {
 		ast_callid_threadassoc_add(bridge->callid);
@@ -1089,6 +1855,10 @@ static void *softmix_mixing_thread(void *data)
 	ast_debug(1, "Bridge %s: starting mixing thread\n", bridge->uniqueid);
 
 	while (!softmix_data->stop) {
+		if (softmix_data->nodes_changed) {
+			softmix_follow_channels(softmix_data);
+		}
+
 		if (!bridge->num_active) {
 			/* Wait for something to happen to the bridge. */
 			ast_bridge_unlock(bridge);
@@ -1127,6 +1897,12 @@ static void softmix_bridge_data_destroy(struct softmix_bridge_data *softmix_data
 	}
 	ast_mutex_destroy(&softmix_data->lock);
 	ast_cond_destroy(&softmix_data->cond);
+	ast_mutex_destroy(&softmix_data->work_lock);
+	ast_cond_destroy(&softmix_data->work_cond);
+	ast_cond_destroy(&softmix_data->done_cond);
+	while (softmix_data->num_planes) {
+		softmix_plane_destroy(softmix_data->planes[--softmix_data->num_planes]);
+	}
 	ast_free(softmix_data);
 }
 
@@ -1142,6 +1918,9 @@ static int softmix_bridge_create(struct ast_bridge *bridge)
 	softmix_data->bridge = bridge;
 	ast_mutex_init(&softmix_data->lock);
 	ast_cond_init(&softmix_data->cond, NULL);
+	ast_mutex_init(&softmix_data->work_lock);
+	ast_cond_init(&softmix_data->work_cond, NULL);
+	ast_cond_init(&softmix_data->done_cond, NULL);
 	softmix_data->timer = ast_timer_open();
 	if (!softmix_data->timer) {
 		ast_log(AST_LOG_WARNING, "Failed to open timer for softmix bridge\n");
@@ -1151,6 +1930,13 @@ static int softmix_bridge_create(struct ast_bridge *bridge)
 	/* start at minimum rate, let it grow from there */
 	softmix_data->internal_rate = SOFTMIX_MIN_SAMPLE_RATE;
 	softmix_data->internal_mixing_interval = DEFAULT_SOFTMIX_INTERVAL;
+	softmix_data->planes[0] = softmix_plane_alloc(softmix_data->internal_rate,
+		softmix_data->internal_mixing_interval);
+	if (!softmix_data->planes[0]) {
+		softmix_bridge_data_destroy(softmix_data);
+		return -1;
+	}
+	softmix_data->num_planes = 1;
 
 	bridge->tech_pvt = softmix_data;
 
@@ -1163,6 +1949,10 @@ static int softmix_bridge_create(struct ast_bridge *bridge)
 		return -1;
 	}
 
+	AST_RWLIST_WRLOCK(&softmix_bridges);
+	AST_RWLIST_INSERT_TAIL(&softmix_bridges, softmix_data, list);
+	AST_RWLIST_UNLOCK(&softmix_bridges);
+
 	return 0;
 }
 
@@ -1200,6 +1990,10 @@ static void softmix_bridge_destroy(struct ast_bridge *bridge)
 		return;
 	}
 
+	AST_RWLIST_WRLOCK(&softmix_bridges);
+	AST_RWLIST_REMOVE(&softmix_bridges, softmix_data, list);
+	AST_RWLIST_UNLOCK(&softmix_bridges);
+
 	/* Stop the mixing thread. */
 	ast_mutex_lock(&softmix_data->lock);
 	softmix_data->stop = 1;
@@ -1216,6 +2010,57 @@ static void softmix_bridge_destroy(struct ast_bridge *bridge)
 	bridge->tech_pvt = NULL;
 }
 
+static char *handle_softmix_show_bridges(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT "%-36s %8s %7s %12s %10s %12s %s\n"
+#define FORMAT2 "%-36s %8u %7u %12u %10u %12" PRId64 " %s\n"
+	struct softmix_bridge_data *softmix_data;
+	struct ast_str *planes = ast_str_alloca(128);
+	unsigned int idx;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "softmix show bridges";
+		e->usage =
+			"Usage: softmix show bridges\n"
+			"       Show the mixing statistics of softmix bridges.  Overruns are\n"
+			"       mixing intervals that took longer than the interval to mix\n"
+			"       and write to every participant.  Planes are the sample\n"
+			"       rates participants are mixed at, each with the number of\n"
+			"       participants mixed at that rate.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, FORMAT, "Bridge-ID", "Channels", "Threads", "Intervals", "Overruns", "Max (us)", "Planes");
+	AST_RWLIST_RDLOCK(&softmix_bridges);
+	AST_RWLIST_TRAVERSE(&softmix_bridges, softmix_data, list) {
+		ast_str_reset(planes);
+		for (idx = 0; idx < SOFTMIX_MAX_PLANES && softmix_data->plane_rates[idx]; ++idx) {
+			ast_str_append(&planes, 0, "%s%u:%u", idx ? " " : "",
+				softmix_data->plane_rates[idx], softmix_data->plane_channels[idx]);
+		}
+		ast_cli(a->fd, FORMAT2, softmix_data->bridge->uniqueid,
+			softmix_data->bridge->num_channels, softmix_data->num_workers + 1,
+			softmix_data->intervals, softmix_data->overruns, softmix_data->max_interval_us,
+			ast_str_buffer(planes));
+	}
+	AST_RWLIST_UNLOCK(&softmix_bridges);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
+static struct ast_cli_entry softmix_cli[] = {
+	AST_CLI_DEFINE(handle_softmix_show_bridges, "Show the mixing statistics of softmix bridges"),
+};
+
 static struct ast_bridge_technology softmix_bridge = {
 	.name = "softmix",
 	.capabilities = AST_BRIDGE_CAPABILITY_MULTIMIX,
@@ -1231,6 +2076,7 @@ static struct ast_bridge_technology softmix_bridge = {
 
 static int unload_module(void)
 {
+	ast_cli_unregister_multiple(softmix_cli, ARRAY_LEN(softmix_cli));
 	ast_bridge_technology_unregister(&softmix_bridge);
 	return 0;
 }
@@ -1241,6 +2087,7 @@ static int load_module(void)
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
 	}
+	ast_cli_register_multiple(softmix_cli, ARRAY_LEN(softmix_cli));
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
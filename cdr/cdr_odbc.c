@@ -191,6 +191,59 @@ static int odbc_log(struct ast_cdr *cdr)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Insert a batch of records in a single transaction
+ *
+ * The batch is inserted on a connection of its own, so it is committed once
+ * rather than after every record. Should anything fail, the transaction is
+ * rolled back and the records are inserted one at a time.
+ */
+static int odbc_log_batch(struct ast_cdr **cdrs, size_t count)
+{
+	struct ast_flags flags = { RES_ODBC_INDEPENDENT_CONNECTION };
+	struct odbc_obj *obj = ast_odbc_request_obj2(dsn, flags);
+	SQLHSTMT stmt;
+	size_t i;
+	int failed = 0;
+
+	if (!obj) {
+		ast_log(LOG_ERROR, "Unable to retrieve database handle.  CDR failed.\n");
+		return -1;
+	}
+
+	if (SQLSetConnectAttr(obj->con, SQL_ATTR_AUTOCOMMIT, (void *) SQL_AUTOCOMMIT_OFF, 0) == SQL_ERROR) {
+		failed = 1;
+	}
+
+	for (i = 0; i < count && !failed; i++) {
+		/* No reconnecting, as that would lose the transaction */
+		stmt = execute_cb(obj, cdrs[i]);
+		if (!stmt) {
+			failed = 1;
+			break;
+		}
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+	}
+
+	if (!failed && SQLEndTran(SQL_HANDLE_DBC, obj->con, SQL_COMMIT) == SQL_ERROR) {
+		failed = 1;
+	}
+	if (failed) {
+		SQLEndTran(SQL_HANDLE_DBC, obj->con, SQL_ROLLBACK);
+	}
+	SQLSetConnectAttr(obj->con, SQL_ATTR_AUTOCOMMIT, (void *) SQL_AUTOCOMMIT_ON, 0);
+	ast_odbc_release_obj(obj);
+
+	if (failed) {
+		ast_log(LOG_WARNING, "cdr_odbc: Failed to insert a batch of %zu CDRs, inserting them one at a time\n", count);
+		for (i = 0; i < count; i++) {
+			odbc_log(cdrs[i]);
+		}
+	}
+	return 0;
+}
+
 static int odbc_load_module(int reload)
 {
 	int res = 0;
@@ -268,7 +321,7 @@ static int odbc_load_module(int reload)
 		}
 
 		if (!ast_test_flag(&config, CONFIG_REGISTERED)) {
-			res = ast_cdr_register(name, ast_module_info->description, odbc_log);
+			res = ast_cdr_register_batch(name, ast_module_info->description, odbc_log, odbc_log_batch);
 			if (res) {
 				ast_log(LOG_ERROR, "cdr_odbc: Unable to register ODBC CDR handling\n");
 			} else {
@@ -110,8 +110,7 @@ static AST_RWLIST_HEAD_STATIC(psql_columns, columns);
 						ast_free(sql);                                    \
 						ast_free(sql2);                                   \
 						AST_RWLIST_UNLOCK(&psql_columns);                 \
-						ast_mutex_unlock(&pgsql_lock);                    \
-						return -1;                                        \
+						return NULL;                                      \
 					}                                                     \
 				}                                                         \
 			} while (0)
@@ -124,8 +123,7 @@ static AST_RWLIST_HEAD_STATIC(psql_columns, columns);
 						ast_free(sql);                    \
 						ast_free(sql2);                   \
 						AST_RWLIST_UNLOCK(&psql_columns); \
-						ast_mutex_unlock(&pgsql_lock);    \
-						return -1;                        \
+						return NULL;                      \
 					}                                     \
 				}                                         \
 			} while (0)
@@ -213,13 +211,15 @@ static void pgsql_reconnect(void)
 	ast_free(conn_info);
 }
 
-static int pgsql_log(struct ast_cdr *cdr)
+/*!
+ * \internal
+ * \brief Connect to the database, if not connected
+ *
+ * \note Call with pgsql_lock held
+ */
+static void pgsql_connect(void)
 {
-	struct ast_tm tm;
 	char *pgerror;
-	PGresult *result;
-
-	ast_mutex_lock(&pgsql_lock);
 
 	if ((!connected) && pghostname && pgdbuser && pgpassword && pgdbname) {
 		pgsql_reconnect();
@@ -243,231 +243,369 @@ static int pgsql_log(struct ast_cdr *cdr)
 			conn = NULL;
 		}
 	}
+}
 
-	if (connected) {
-		struct columns *cur;
-		struct ast_str *sql = ast_str_create(maxsize), *sql2 = ast_str_create(maxsize2);
-		char buf[257], escapebuf[513], *value;
-		char *separator = "";
-
-		if (!sql || !sql2) {
-			ast_free(sql);
-			ast_free(sql2);
-			return -1;
-		}
+/*!
+ * \internal
+ * \brief Make sure the connection still works, reconnecting if it does not
+ *
+ * \note Call with pgsql_lock held
+ *
+ * \retval 0 if connected
+ * \retval -1 if not
+ */
+static int pgsql_check_connection(void)
+{
+	char *pgerror;
 
-		ast_str_set(&sql, 0, "INSERT INTO %s (", table);
-		ast_str_set(&sql2, 0, " VALUES (");
+	/* Test to be sure we're still connected... */
+	/* If we're connected, and connection is working, good. */
+	/* Otherwise, attempt reconnect.  If it fails... sorry... */
+	if (PQstatus(conn) == CONNECTION_OK) {
+		connected = 1;
+		return 0;
+	}
 
-		AST_RWLIST_RDLOCK(&psql_columns);
-		AST_RWLIST_TRAVERSE(&psql_columns, cur, list) {
-			/* For fields not set, simply skip them */
-			ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
-			if (strcmp(cur->name, "calldate") == 0 && !value) {
-				ast_cdr_format_var(cdr, "start", &value, buf, sizeof(buf), 0);
-			}
-			if (!value) {
-				if (cur->notnull && !cur->hasdefault) {
-					/* Field is NOT NULL (but no default), must include it anyway */
-					LENGTHEN_BUF1(strlen(cur->name) + 2);
-					ast_str_append(&sql, 0, "%s\"%s\"", separator, cur->name);
-					LENGTHEN_BUF2(3);
-					ast_str_append(&sql2, 0, "%s''", separator);
-					separator = ", ";
-				}
-				continue;
+	ast_log(LOG_ERROR, "Connection was lost... attempting to reconnect.\n");
+	PQreset(conn);
+	if (PQstatus(conn) == CONNECTION_OK) {
+		ast_log(LOG_ERROR, "Connection reestablished.\n");
+		connected = 1;
+		connect_time = time(NULL);
+		records = 0;
+		return 0;
+	}
+
+	pgerror = PQerrorMessage(conn);
+	ast_log(LOG_ERROR, "Unable to reconnect to database server %s. Calls will not be logged!\n", pghostname);
+	ast_log(LOG_ERROR, "Reason: %s\n", pgerror);
+	PQfinish(conn);
+	conn = NULL;
+	connected = 0;
+	return -1;
+}
+
+/*!
+ * \internal
+ * \brief Build the INSERT statement for a record
+ *
+ * \note Call with pgsql_lock held while connected, as values are escaped for
+ * the connection
+ *
+ * \return The statement, or NULL on error
+ */
+static struct ast_str *pgsql_build_insert(struct ast_cdr *cdr)
+{
+	struct ast_tm tm;
+	struct columns *cur;
+	struct ast_str *sql = ast_str_create(maxsize), *sql2 = ast_str_create(maxsize2);
+	char buf[257], escapebuf[513], *value;
+	char *separator = "";
+
+	if (!sql || !sql2) {
+		ast_free(sql);
+		ast_free(sql2);
+		return NULL;
+	}
+
+	ast_str_set(&sql, 0, "INSERT INTO %s (", table);
+	ast_str_set(&sql2, 0, " VALUES (");
+
+	AST_RWLIST_RDLOCK(&psql_columns);
+	AST_RWLIST_TRAVERSE(&psql_columns, cur, list) {
+		/* For fields not set, simply skip them */
+		ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
+		if (strcmp(cur->name, "calldate") == 0 && !value) {
+			ast_cdr_format_var(cdr, "start", &value, buf, sizeof(buf), 0);
+		}
+		if (!value) {
+			if (cur->notnull && !cur->hasdefault) {
+				/* Field is NOT NULL (but no default), must include it anyway */
+				LENGTHEN_BUF1(strlen(cur->name) + 2);
+				ast_str_append(&sql, 0, "%s\"%s\"", separator, cur->name);
+				LENGTHEN_BUF2(3);
+				ast_str_append(&sql2, 0, "%s''", separator);
+				separator = ", ";
 			}
+			continue;
+		}
 
-			LENGTHEN_BUF1(strlen(cur->name) + 2);
-			ast_str_append(&sql, 0, "%s\"%s\"", separator, cur->name);
+		LENGTHEN_BUF1(strlen(cur->name) + 2);
+		ast_str_append(&sql, 0, "%s\"%s\"", separator, cur->name);
 
-			if (strcmp(cur->name, "start") == 0 || strcmp(cur->name, "calldate") == 0) {
-				if (strncmp(cur->type, "int", 3) == 0) {
-					LENGTHEN_BUF2(13);
-					ast_str_append(&sql2, 0, "%s%ld", separator, (long) cdr->start.tv_sec);
-				} else if (strncmp(cur->type, "float", 5) == 0) {
-					LENGTHEN_BUF2(31);
-					ast_str_append(&sql2, 0, "%s%f", separator, (double)cdr->start.tv_sec + (double)cdr->start.tv_usec / 1000000.0);
-				} else {
-					/* char, hopefully */
-					LENGTHEN_BUF2(31);
-					ast_localtime(&cdr->start, &tm, tz);
-					ast_strftime(buf, sizeof(buf), DATE_FORMAT, &tm);
-					ast_str_append(&sql2, 0, "%s%s", separator, buf);
-				}
-			} else if (strcmp(cur->name, "answer") == 0) {
-				if (strncmp(cur->type, "int", 3) == 0) {
-					LENGTHEN_BUF2(13);
-					ast_str_append(&sql2, 0, "%s%ld", separator, (long) cdr->answer.tv_sec);
-				} else if (strncmp(cur->type, "float", 5) == 0) {
-					LENGTHEN_BUF2(31);
-					ast_str_append(&sql2, 0, "%s%f", separator, (double)cdr->answer.tv_sec + (double)cdr->answer.tv_usec / 1000000.0);
-				} else {
-					/* char, hopefully */
-					LENGTHEN_BUF2(31);
-					ast_localtime(&cdr->answer, &tm, tz);
-					ast_strftime(buf, sizeof(buf), DATE_FORMAT, &tm);
-					ast_str_append(&sql2, 0, "%s%s", separator, buf);
-				}
-			} else if (strcmp(cur->name, "end") == 0) {
-				if (strncmp(cur->type, "int", 3) == 0) {
-					LENGTHEN_BUF2(13);
-					ast_str_append(&sql2, 0, "%s%ld", separator, (long) cdr->end.tv_sec);
-				} else if (strncmp(cur->type, "float", 5) == 0) {
-					LENGTHEN_BUF2(31);
-					ast_str_append(&sql2, 0, "%s%f", separator, (double)cdr->end.tv_sec + (double)cdr->end.tv_usec / 1000000.0);
-				} else {
-					/* char, hopefully */
-					LENGTHEN_BUF2(31);
-					ast_localtime(&cdr->end, &tm, tz);
-					ast_strftime(buf, sizeof(buf), DATE_FORMAT, &tm);
-					ast_str_append(&sql2, 0, "%s%s", separator, buf);
-				}
-			} else if (strcmp(cur->name, "duration") == 0 || strcmp(cur->name, "billsec") == 0) {
-				if (cur->type[0] == 'i') {
-					/* Get integer, no need to escape anything */
-					ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
-					LENGTHEN_BUF2(13);
-					ast_str_append(&sql2, 0, "%s%s", separator, value);
-				} else if (strncmp(cur->type, "float", 5) == 0) {
-					struct timeval *when = cur->name[0] == 'd' ? &cdr->start : ast_tvzero(cdr->answer) ? &cdr->end : &cdr->answer;
-					LENGTHEN_BUF2(31);
-					ast_str_append(&sql2, 0, "%s%f", separator, (double) (ast_tvdiff_us(cdr->end, *when) / 1000000.0));
+		if (strcmp(cur->name, "start") == 0 || strcmp(cur->name, "calldate") == 0) {
+			if (strncmp(cur->type, "int", 3) == 0) {
+				LENGTHEN_BUF2(13);
+				ast_str_append(&sql2, 0, "%s%ld", separator, (long) cdr->start.tv_sec);
+			} else if (strncmp(cur->type, "float", 5) == 0) {
+				LENGTHEN_BUF2(31);
+				ast_str_append(&sql2, 0, "%s%f", separator, (double)cdr->start.tv_sec + (double)cdr->start.tv_usec / 1000000.0);
+			} else {
+				/* char, hopefully */
+				LENGTHEN_BUF2(31);
+				ast_localtime(&cdr->start, &tm, tz);
+				ast_strftime(buf, sizeof(buf), DATE_FORMAT, &tm);
+				ast_str_append(&sql2, 0, "%s%s", separator, buf);
+			}
+		} else if (strcmp(cur->name, "answer") == 0) {
+			if (strncmp(cur->type, "int", 3) == 0) {
+				LENGTHEN_BUF2(13);
+				ast_str_append(&sql2, 0, "%s%ld", separator, (long) cdr->answer.tv_sec);
+			} else if (strncmp(cur->type, "float", 5) == 0) {
+				LENGTHEN_BUF2(31);
+				ast_str_append(&sql2, 0, "%s%f", separator, (double)cdr->answer.tv_sec + (double)cdr->answer.tv_usec / 1000000.0);
+			} else {
+				/* char, hopefully */
+				LENGTHEN_BUF2(31);
+				ast_localtime(&cdr->answer, &tm, tz);
+				ast_strftime(buf, sizeof(buf), DATE_FORMAT, &tm);
+				ast_str_append(&sql2, 0, "%s%s", separator, buf);
+			}
+		} else if (strcmp(cur->name, "end") == 0) {
+			if (strncmp(cur->type, "int", 3) == 0) {
+				LENGTHEN_BUF2(13);
+				ast_str_append(&sql2, 0, "%s%ld", separator, (long) cdr->end.tv_sec);
+			} else if (strncmp(cur->type, "float", 5) == 0) {
+				LENGTHEN_BUF2(31);
+				ast_str_append(&sql2, 0, "%s%f", separator, (double)cdr->end.tv_sec + (double)cdr->end.tv_usec / 1000000.0);
+			} else {
+				/* char, hopefully */
+				LENGTHEN_BUF2(31);
+				ast_localtime(&cdr->end, &tm, tz);
+				ast_strftime(buf, sizeof(buf), DATE_FORMAT, &tm);
+				ast_str_append(&sql2, 0, "%s%s", separator, buf);
+			}
+		} else if (strcmp(cur->name, "duration") == 0 || strcmp(cur->name, "billsec") == 0) {
+			if (cur->type[0] == 'i') {
+				/* Get integer, no need to escape anything */
+				ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
+				LENGTHEN_BUF2(13);
+				ast_str_append(&sql2, 0, "%s%s", separator, value);
+			} else if (strncmp(cur->type, "float", 5) == 0) {
+				struct timeval *when = cur->name[0] == 'd' ? &cdr->start : ast_tvzero(cdr->answer) ? &cdr->end : &cdr->answer;
+				LENGTHEN_BUF2(31);
+				ast_str_append(&sql2, 0, "%s%f", separator, (double) (ast_tvdiff_us(cdr->end, *when) / 1000000.0));
+			} else {
+				/* Char field, probably */
+				struct timeval *when = cur->name[0] == 'd' ? &cdr->start : ast_tvzero(cdr->answer) ? &cdr->end : &cdr->answer;
+				LENGTHEN_BUF2(31);
+				ast_str_append(&sql2, 0, "%s'%f'", separator, (double) (ast_tvdiff_us(cdr->end, *when) / 1000000.0));
+			}
+		} else if (strcmp(cur->name, "disposition") == 0 || strcmp(cur->name, "amaflags") == 0) {
+			if (strncmp(cur->type, "int", 3) == 0) {
+				/* Integer, no need to escape anything */
+				ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 1);
+				LENGTHEN_BUF2(13);
+				ast_str_append(&sql2, 0, "%s%s", separator, value);
+			} else {
+				/* Although this is a char field, there are no special characters in the values for these fields */
+				ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
+				LENGTHEN_BUF2(31);
+				ast_str_append(&sql2, 0, "%s'%s'", separator, value);
+			}
+		} else {
+			/* Arbitrary field, could be anything */
+			ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
+			if (strncmp(cur->type, "int", 3) == 0) {
+				long long whatever;
+				if (value && sscanf(value, "%30lld", &whatever) == 1) {
+					LENGTHEN_BUF2(26);
+					ast_str_append(&sql2, 0, "%s%lld", separator, whatever);
 				} else {
-					/* Char field, probably */
-					struct timeval *when = cur->name[0] == 'd' ? &cdr->start : ast_tvzero(cdr->answer) ? &cdr->end : &cdr->answer;
-					LENGTHEN_BUF2(31);
-					ast_str_append(&sql2, 0, "%s'%f'", separator, (double) (ast_tvdiff_us(cdr->end, *when) / 1000000.0));
+					LENGTHEN_BUF2(2);
+					ast_str_append(&sql2, 0, "%s0", separator);
 				}
-			} else if (strcmp(cur->name, "disposition") == 0 || strcmp(cur->name, "amaflags") == 0) {
-				if (strncmp(cur->type, "int", 3) == 0) {
-					/* Integer, no need to escape anything */
-					ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 1);
-					LENGTHEN_BUF2(13);
-					ast_str_append(&sql2, 0, "%s%s", separator, value);
+			} else if (strncmp(cur->type, "float", 5) == 0) {
+				long double whatever;
+				if (value && sscanf(value, "%30Lf", &whatever) == 1) {
+					LENGTHEN_BUF2(51);
+					ast_str_append(&sql2, 0, "%s%30Lf", separator, whatever);
 				} else {
-					/* Although this is a char field, there are no special characters in the values for these fields */
-					ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
-					LENGTHEN_BUF2(31);
-					ast_str_append(&sql2, 0, "%s'%s'", separator, value);
+					LENGTHEN_BUF2(2);
+					ast_str_append(&sql2, 0, "%s0", separator);
 				}
+			/* XXX Might want to handle dates, times, and other misc fields here XXX */
 			} else {
-				/* Arbitrary field, could be anything */
-				ast_cdr_format_var(cdr, cur->name, &value, buf, sizeof(buf), 0);
-				if (strncmp(cur->type, "int", 3) == 0) {
-					long long whatever;
-					if (value && sscanf(value, "%30lld", &whatever) == 1) {
-						LENGTHEN_BUF2(26);
-						ast_str_append(&sql2, 0, "%s%lld", separator, whatever);
-					} else {
-						LENGTHEN_BUF2(2);
-						ast_str_append(&sql2, 0, "%s0", separator);
-					}
-				} else if (strncmp(cur->type, "float", 5) == 0) {
-					long double whatever;
-					if (value && sscanf(value, "%30Lf", &whatever) == 1) {
-						LENGTHEN_BUF2(51);
-						ast_str_append(&sql2, 0, "%s%30Lf", separator, whatever);
-					} else {
-						LENGTHEN_BUF2(2);
-						ast_str_append(&sql2, 0, "%s0", separator);
-					}
-				/* XXX Might want to handle dates, times, and other misc fields here XXX */
-				} else {
-					if (value)
-						PQescapeStringConn(conn, escapebuf, value, strlen(value), NULL);
-					else
-						escapebuf[0] = '\0';
-					LENGTHEN_BUF2(strlen(escapebuf) + 3);
-					ast_str_append(&sql2, 0, "%s'%s'", separator, escapebuf);
-				}
+				if (value)
+					PQescapeStringConn(conn, escapebuf, value, strlen(value), NULL);
+				else
+					escapebuf[0] = '\0';
+				LENGTHEN_BUF2(strlen(escapebuf) + 3);
+				ast_str_append(&sql2, 0, "%s'%s'", separator, escapebuf);
 			}
-			separator = ", ";
 		}
+		separator = ", ";
+	}
 
-		LENGTHEN_BUF1(ast_str_strlen(sql2) + 2);
-		AST_RWLIST_UNLOCK(&psql_columns);
-		ast_str_append(&sql, 0, ")%s)", ast_str_buffer(sql2));
+	LENGTHEN_BUF1(ast_str_strlen(sql2) + 2);
+	AST_RWLIST_UNLOCK(&psql_columns);
+	ast_str_append(&sql, 0, ")%s)", ast_str_buffer(sql2));
 
-		ast_debug(3, "Inserting a CDR record: [%s]\n", ast_str_buffer(sql));
+	/* Next time, just allocate buffers that are that big to start with. */
+	if (ast_str_strlen(sql) > maxsize) {
+		maxsize = ast_str_strlen(sql);
+	}
+	if (ast_str_strlen(sql2) > maxsize2) {
+		maxsize2 = ast_str_strlen(sql2);
+	}
+
+	ast_free(sql2);
+	return sql;
+}
 
-		/* Test to be sure we're still connected... */
-		/* If we're connected, and connection is working, good. */
-		/* Otherwise, attempt reconnect.  If it fails... sorry... */
+/*!
+ * \internal
+ * \brief Run INSERT statements, reconnecting and trying again once if they fail
+ *
+ * \note Call with pgsql_lock held while connected
+ *
+ * \param sql The statements
+ * \param count The number of records they insert
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int pgsql_exec_insert(const char *sql, int count)
+{
+	char *pgerror;
+	PGresult *result;
+
+	result = PQexec(conn, sql);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+		pgerror = PQresultErrorMessage(result);
+		ast_log(LOG_ERROR, "Failed to insert call detail record into database!\n");
+		ast_log(LOG_ERROR, "Reason: %s\n", pgerror);
+		ast_log(LOG_ERROR, "Connection may have been lost... attempting to reconnect.\n");
+		PQreset(conn);
 		if (PQstatus(conn) == CONNECTION_OK) {
+			ast_log(LOG_ERROR, "Connection reestablished.\n");
 			connected = 1;
-		} else {
-			ast_log(LOG_ERROR, "Connection was lost... attempting to reconnect.\n");
-			PQreset(conn);
-			if (PQstatus(conn) == CONNECTION_OK) {
-				ast_log(LOG_ERROR, "Connection reestablished.\n");
-				connected = 1;
-				connect_time = time(NULL);
-				records = 0;
-			} else {
-				pgerror = PQerrorMessage(conn);
-				ast_log(LOG_ERROR, "Unable to reconnect to database server %s. Calls will not be logged!\n", pghostname);
+			connect_time = time(NULL);
+			records = 0;
+			PQclear(result);
+			result = PQexec(conn, sql);
+			if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+				pgerror = PQresultErrorMessage(result);
+				ast_log(LOG_ERROR, "HARD ERROR!  Attempted reconnection failed.  DROPPING CALL RECORD!\n");
 				ast_log(LOG_ERROR, "Reason: %s\n", pgerror);
-				PQfinish(conn);
-				conn = NULL;
-				connected = 0;
-				ast_mutex_unlock(&pgsql_lock);
-				ast_free(sql);
-				ast_free(sql2);
-				return -1;
-			}
-		}
-		result = PQexec(conn, ast_str_buffer(sql));
-		if (PQresultStatus(result) != PGRES_COMMAND_OK) {
-			pgerror = PQresultErrorMessage(result);
-			ast_log(LOG_ERROR, "Failed to insert call detail record into database!\n");
-			ast_log(LOG_ERROR, "Reason: %s\n", pgerror);
-			ast_log(LOG_ERROR, "Connection may have been lost... attempting to reconnect.\n");
-			PQreset(conn);
-			if (PQstatus(conn) == CONNECTION_OK) {
-				ast_log(LOG_ERROR, "Connection reestablished.\n");
-				connected = 1;
-				connect_time = time(NULL);
-				records = 0;
+			}  else {
+				/* Second try worked out ok */
+				totalrecords += count;
+				records += count;
 				PQclear(result);
-				result = PQexec(conn, ast_str_buffer(sql));
-				if (PQresultStatus(result) != PGRES_COMMAND_OK) {
-					pgerror = PQresultErrorMessage(result);
-					ast_log(LOG_ERROR, "HARD ERROR!  Attempted reconnection failed.  DROPPING CALL RECORD!\n");
-					ast_log(LOG_ERROR, "Reason: %s\n", pgerror);
-				}  else {
-					/* Second try worked out ok */
-					totalrecords++;
-					records++;
-					ast_mutex_unlock(&pgsql_lock);
-					PQclear(result);
-					return 0;
-				}
+				return 0;
 			}
-			ast_mutex_unlock(&pgsql_lock);
-			PQclear(result);
-			ast_free(sql);
-			ast_free(sql2);
-			return -1;
-		} else {
-			totalrecords++;
-			records++;
 		}
 		PQclear(result);
+		return -1;
+	}
 
-		/* Next time, just allocate buffers that are that big to start with. */
-		if (ast_str_strlen(sql) > maxsize) {
-			maxsize = ast_str_strlen(sql);
+	totalrecords += count;
+	records += count;
+	PQclear(result);
+	return 0;
+}
+
+static int pgsql_log(struct ast_cdr *cdr)
+{
+	struct ast_str *sql;
+	int res = -1;
+
+	ast_mutex_lock(&pgsql_lock);
+
+	pgsql_connect();
+	if (!connected) {
+		ast_mutex_unlock(&pgsql_lock);
+		return 0;
+	}
+
+	sql = pgsql_build_insert(cdr);
+	if (sql) {
+		ast_debug(3, "Inserting a CDR record: [%s]\n", ast_str_buffer(sql));
+		if (!pgsql_check_connection()) {
+			res = pgsql_exec_insert(ast_str_buffer(sql), 1);
 		}
-		if (ast_str_strlen(sql2) > maxsize2) {
-			maxsize2 = ast_str_strlen(sql2);
+		ast_free(sql);
+	}
+
+	ast_mutex_unlock(&pgsql_lock);
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Insert a batch of records in one round trip
+ *
+ * The INSERT statements of the batch are sent in a single query, which the
+ * server runs as a single transaction. Should it fail, the records are
+ * inserted one at a time, so a bad record does not lose the whole batch.
+ */
+static int pgsql_log_batch(struct ast_cdr **cdrs, size_t count)
+{
+	struct ast_str **inserts;
+	struct ast_str *batch;
+	size_t built = 0;
+	size_t i;
+	int res = 0;
+
+	inserts = ast_calloc(count, sizeof(*inserts));
+	batch = ast_str_create(maxsize * count);
+	if (!inserts || !batch) {
+		ast_free(inserts);
+		ast_free(batch);
+		for (i = 0; i < count; i++) {
+			res |= pgsql_log(cdrs[i]);
 		}
+		return res;
+	}
 
-		ast_free(sql);
-		ast_free(sql2);
+	ast_mutex_lock(&pgsql_lock);
+
+	pgsql_connect();
+	if (!connected) {
+		ast_mutex_unlock(&pgsql_lock);
+		ast_free(inserts);
+		ast_free(batch);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		inserts[i] = pgsql_build_insert(cdrs[i]);
+		if (!inserts[i]) {
+			res = -1;
+			continue;
+		}
+		ast_str_append(&batch, 0, "%s;\n", ast_str_buffer(inserts[i]));
+		built++;
+	}
+
+	ast_debug(3, "Inserting a batch of %zu CDR records\n", built);
+	if (built && !pgsql_check_connection()) {
+		PGresult *result = PQexec(conn, ast_str_buffer(batch));
+
+		if (PQresultStatus(result) == PGRES_COMMAND_OK) {
+			totalrecords += built;
+			records += built;
+		} else {
+			ast_log(LOG_WARNING, "Failed to insert a batch of %zu call detail records, inserting them one at a time\n", built);
+			ast_log(LOG_WARNING, "Reason: %s\n", PQresultErrorMessage(result));
+			for (i = 0; i < count && connected; i++) {
+				if (inserts[i]) {
+					res |= pgsql_exec_insert(ast_str_buffer(inserts[i]), 1);
+				}
+			}
+		}
+		PQclear(result);
 	}
+
+	for (i = 0; i < count; i++) {
+		ast_free(inserts[i]);
+	}
+	ast_free(inserts);
+	ast_free(batch);
+
 	ast_mutex_unlock(&pgsql_lock);
-	return 0;
+	return res;
 }
 
 /* This function should be called without holding the pgsql_columns lock */
@@ -779,7 +917,7 @@ static int load_module(void)
 	if (config_module(0)) {
 		return AST_MODULE_LOAD_DECLINE;
 	}
-	return ast_cdr_register(name, ast_module_info->description, pgsql_log)
+	return ast_cdr_register_batch(name, ast_module_info->description, pgsql_log, pgsql_log_batch)
 		? AST_MODULE_LOAD_DECLINE : 0;
 }
 
@@ -64,6 +64,9 @@ ASTERISK_REGISTER_FILE()
 #endif
 #include <sys/stat.h>
 #include <math.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #include "sig_analog.h"
 /* Analog signaling is currently still present in chan_dahdi for use with
@@ -4090,10 +4093,27 @@ static int dahdi_open(char *fn)
 	return fd;
 }
 
+#ifdef HAVE_EPOLL
+/*! \brief Protects monitor_registered, changed by the monitor thread and as descriptors are closed */
+AST_MUTEX_DEFINE_STATIC(monitor_registered_lock);
+/*! \brief The events in the monitor thread's epoll set for each descriptor, indexed by descriptor */
+static short *monitor_registered;
+static int monitor_registered_len;
+#endif
+
 static void dahdi_close(int fd)
 {
-	if (fd > 0)
+	if (fd > 0) {
+#ifdef HAVE_EPOLL
+		/* Closing it takes it out of the epoll set, a descriptor opened with the same number must be added */
+		ast_mutex_lock(&monitor_registered_lock);
+		if (fd < monitor_registered_len) {
+			monitor_registered[fd] = 0;
+		}
+		ast_mutex_unlock(&monitor_registered_lock);
+#endif
 		close(fd);
+	}
 }
 
 static void dahdi_close_sub(struct dahdi_pvt *chan_pvt, int sub_num)
@@ -11327,22 +11347,234 @@ static struct dahdi_pvt *handle_init_event(struct dahdi_pvt *i, int event)
 	return NULL;
 }
 
-static void monitor_pfds_clean(void *arg) {
-	struct pollfd **pfds = arg;
-	ast_free(*pfds);
+/*! \brief Most ready descriptors the monitor thread takes from epoll at once */
+#define MONITOR_EPOLL_EVENTS 64
+
+/*!
+ * \brief The descriptors the monitor thread waits on
+ *
+ * With epoll the set persists from pass to pass. Each pass says which
+ * descriptors it wants to watch and only the ones that changed since the last
+ * pass are changed in the epoll set, so neither waiting nor finding what is
+ * ready depends on the number of idle channels.
+ */
+struct monitor_fds {
+#ifdef HAVE_EPOLL
+	int epfd;
+	/*! The events wanted this pass, indexed by descriptor */
+	short *wanted;
+	int wanted_len;
+	struct epoll_event events[MONITOR_EPOLL_EVENTS];
+#else
+	struct pollfd *pfds;
+	int alloc;
+	int spoint;
+#endif
+	/*! The descriptors watched this pass, then the number that are ready */
+	int count;
+};
+
+static void monitor_fds_clean(void *arg)
+{
+	struct monitor_fds *mon = arg;
+
+#ifdef HAVE_EPOLL
+	ast_mutex_lock(&monitor_registered_lock);
+	ast_free(monitor_registered);
+	monitor_registered = NULL;
+	monitor_registered_len = 0;
+	ast_mutex_unlock(&monitor_registered_lock);
+	if (mon->epfd > -1) {
+		close(mon->epfd);
+	}
+	ast_free(mon->wanted);
+#else
+	ast_free(mon->pfds);
+#endif
+}
+
+static int monitor_fds_init(struct monitor_fds *mon)
+{
+	memset(mon, 0, sizeof(*mon));
+#ifdef HAVE_EPOLL
+	if ((mon->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		ast_log(LOG_ERROR, "Unable to create epoll set for the monitor thread: %s\n", strerror(errno));
+		return -1;
+	}
+#else
+	mon->alloc = -1;
+#endif
+	return 0;
+}
+
+/*!
+ * \brief Start a pass of the monitor thread
+ * \note Called with the iflock held.
+ */
+static int monitor_fds_begin(struct monitor_fds *mon)
+{
+	mon->count = 0;
+#ifdef HAVE_EPOLL
+	if (mon->wanted) {
+		memset(mon->wanted, 0, mon->wanted_len * sizeof(*mon->wanted));
+	}
+#else
+	if (!mon->pfds || (mon->alloc != ifcount)) {
+		ast_free(mon->pfds);
+		mon->pfds = NULL;
+		if (ifcount) {
+			if (!(mon->pfds = ast_calloc(1, ifcount * sizeof(*mon->pfds)))) {
+				return -1;
+			}
+		}
+		mon->alloc = ifcount;
+	}
+#endif
+	return 0;
+}
+
+/*! \brief Watch a descriptor for POLLPRI and maybe POLLIN this pass */
+static void monitor_fds_watch(struct monitor_fds *mon, int fd, short events)
+{
+#ifdef HAVE_EPOLL
+	if (fd >= mon->wanted_len) {
+		int len = MAX(fd + 1, mon->wanted_len * 2);
+		short *wanted = ast_realloc(mon->wanted, len * sizeof(*wanted));
+
+		if (!wanted) {
+			return;
+		}
+		memset(wanted + mon->wanted_len, 0, (len - mon->wanted_len) * sizeof(*wanted));
+		mon->wanted = wanted;
+		mon->wanted_len = len;
+	}
+	mon->wanted[fd] = events;
+#else
+	if (!mon->pfds || mon->count >= mon->alloc) {
+		return;
+	}
+	mon->pfds[mon->count].fd = fd;
+	mon->pfds[mon->count].events = events;
+	mon->pfds[mon->count].revents = 0;
+#endif
+	mon->count++;
+}
+
+#ifdef HAVE_EPOLL
+/*!
+ * \brief Change the epoll set to the descriptors wanted this pass
+ * \note Called with the iflock held, so no wanted descriptor is closed meanwhile.
+ */
+static void monitor_fds_update(struct monitor_fds *mon)
+{
+	struct epoll_event ev = { 0, };
+	int fd;
+	int len;
+
+	ast_mutex_lock(&monitor_registered_lock);
+	if (mon->wanted_len > monitor_registered_len) {
+		short *registered = ast_realloc(monitor_registered, mon->wanted_len * sizeof(*registered));
+
+		if (!registered) {
+			ast_mutex_unlock(&monitor_registered_lock);
+			return;
+		}
+		memset(registered + monitor_registered_len, 0,
+			(mon->wanted_len - monitor_registered_len) * sizeof(*registered));
+		monitor_registered = registered;
+		monitor_registered_len = mon->wanted_len;
+	}
+
+	len = monitor_registered_len;
+	for (fd = 0; fd < len; fd++) {
+		short wanted = fd < mon->wanted_len ? mon->wanted[fd] : 0;
+		int res;
+
+		if (wanted == monitor_registered[fd]) {
+			continue;
+		}
+
+		ev.events = ((wanted & POLLPRI) ? EPOLLPRI : 0) | ((wanted & POLLIN) ? EPOLLIN : 0);
+		ev.data.fd = fd;
+		if (!wanted) {
+			/* The channel is owned now, or not monitored at all */
+			epoll_ctl(mon->epfd, EPOLL_CTL_DEL, fd, &ev);
+			res = 0;
+		} else if (!monitor_registered[fd]) {
+			res = epoll_ctl(mon->epfd, EPOLL_CTL_ADD, fd, &ev);
+			if (res && errno == EEXIST) {
+				res = epoll_ctl(mon->epfd, EPOLL_CTL_MOD, fd, &ev);
+			}
+		} else {
+			res = epoll_ctl(mon->epfd, EPOLL_CTL_MOD, fd, &ev);
+			if (res && errno == ENOENT) {
+				res = epoll_ctl(mon->epfd, EPOLL_CTL_ADD, fd, &ev);
+			}
+		}
+		if (res) {
+			ast_log(LOG_WARNING, "Unable to monitor descriptor %d: %s\n", fd, strerror(errno));
+			wanted = 0;
+		}
+		monitor_registered[fd] = wanted;
+	}
+	ast_mutex_unlock(&monitor_registered_lock);
+}
+#endif
+
+/*!
+ * \brief End building the pass, ready to wait
+ * \note Called with the iflock held.
+ */
+static void monitor_fds_end(struct monitor_fds *mon)
+{
+#ifdef HAVE_EPOLL
+	monitor_fds_update(mon);
+#endif
+}
+
+/*! \brief Wait up to a timeout for any of the watched descriptors */
+static int monitor_fds_wait(struct monitor_fds *mon, int timeout)
+{
+	int res;
+
+#ifdef HAVE_EPOLL
+	res = epoll_wait(mon->epfd, mon->events, ARRAY_LEN(mon->events), timeout);
+	mon->count = MAX(res, 0);
+#else
+	res = poll(mon->pfds, mon->count, timeout);
+	mon->spoint = 0;
+#endif
+	return res;
+}
+
+/*! \brief The poll events ready on a descriptor */
+static int monitor_fds_revents(struct monitor_fds *mon, int fd)
+{
+#ifdef HAVE_EPOLL
+	int x;
+
+	for (x = 0; x < mon->count; x++) {
+		if (mon->events[x].data.fd == fd) {
+			return ((mon->events[x].events & EPOLLPRI) ? POLLPRI : 0)
+				| ((mon->events[x].events & EPOLLIN) ? POLLIN : 0);
+		}
+	}
+	return 0;
+#else
+	return ast_fdisset(mon->pfds, fd, mon->count, &mon->spoint);
+#endif
 }
 
 static void *do_monitor(void *data)
 {
-	int count, res, res2, spoint, pollres=0;
+	int res, res2, pollres=0;
 	struct dahdi_pvt *i;
 	struct dahdi_pvt *last = NULL;
 	struct dahdi_pvt *doomed;
 	time_t thispass = 0, lastpass = 0;
 	int found;
 	char buf[1024];
-	struct pollfd *pfds=NULL;
-	int lastalloc = -1;
+	struct monitor_fds mon;
 	/* This thread monitors all the frame relay interfaces which are not yet in use
 	   (and thus do not have a separate thread) indefinitely */
 	/* From here on out, we die whenever asked */
@@ -11355,71 +11587,63 @@ static void *do_monitor(void *data)
 #endif
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
-	pthread_cleanup_push(monitor_pfds_clean, &pfds);
+	if (monitor_fds_init(&mon)) {
+		return NULL;
+	}
+	pthread_cleanup_push(monitor_fds_clean, &mon);
 	for (;;) {
 		/* Lock the interface list */
 		ast_mutex_lock(&iflock);
-		if (!pfds || (lastalloc != ifcount)) {
-			if (pfds) {
-				ast_free(pfds);
-				pfds = NULL;
-			}
-			if (ifcount) {
-				if (!(pfds = ast_calloc(1, ifcount * sizeof(*pfds)))) {
-					ast_mutex_unlock(&iflock);
-					return NULL;
-				}
-			}
-			lastalloc = ifcount;
+		if (monitor_fds_begin(&mon)) {
+			ast_mutex_unlock(&iflock);
+			return NULL;
 		}
 		/* Build the stuff we're going to poll on, that is the socket of every
 		   dahdi_pvt that does not have an associated owner channel */
-		count = 0;
 		for (i = iflist; i; i = i->next) {
 			ast_mutex_lock(&i->lock);
-			if (pfds && (i->subs[SUB_REAL].dfd > -1) && i->sig && (!i->radio) && !(i->sig & SIG_MFCR2)) {
+			if ((i->subs[SUB_REAL].dfd > -1) && i->sig && (!i->radio) && !(i->sig & SIG_MFCR2)) {
 				if (dahdi_analog_lib_handles(i->sig, i->radio, i->oprmode)) {
 					struct analog_pvt *p = i->sig_pvt;
 
 					if (!p) {
 						ast_log(LOG_ERROR, "No sig_pvt?\n");
 					} else if (!p->owner && !p->subs[SUB_REAL].owner) {
+						short events = POLLPRI;
+
 						/* This needs to be watched, as it lacks an owner */
-						pfds[count].fd = i->subs[SUB_REAL].dfd;
-						pfds[count].events = POLLPRI;
-						pfds[count].revents = 0;
 						/* Message waiting or r2 channels also get watched for reading */
 						if (i->cidspill || i->mwisendactive || i->mwimonitor_fsk ||
 							(i->cid_start == CID_START_DTMF_NOALERT && (i->sig == SIG_FXSLS || i->sig == SIG_FXSGS || i->sig == SIG_FXSKS))) {
-							pfds[count].events |= POLLIN;
+							events |= POLLIN;
 						}
-						count++;
+						monitor_fds_watch(&mon, i->subs[SUB_REAL].dfd, events);
 					}
 				} else {
 					if (!i->owner && !i->subs[SUB_REAL].owner && !i->mwimonitoractive ) {
+						short events = POLLPRI;
+
 						/* This needs to be watched, as it lacks an owner */
-						pfds[count].fd = i->subs[SUB_REAL].dfd;
-						pfds[count].events = POLLPRI;
-						pfds[count].revents = 0;
 						/* If we are monitoring for VMWI or sending CID, we need to
 						   read from the channel as well */
 						if (i->cidspill || i->mwisendactive || i->mwimonitor_fsk ||
 							(i->cid_start == CID_START_DTMF_NOALERT && (i->sig == SIG_FXSLS || i->sig == SIG_FXSGS || i->sig == SIG_FXSKS))) {
-							pfds[count].events |= POLLIN;
+							events |= POLLIN;
 						}
-						count++;
+						monitor_fds_watch(&mon, i->subs[SUB_REAL].dfd, events);
 					}
 				}
 			}
 			ast_mutex_unlock(&i->lock);
 		}
+		monitor_fds_end(&mon);
 		/* Okay, now that we know what to do, release the interface lock */
 		ast_mutex_unlock(&iflock);
 
 		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 		pthread_testcancel();
 		/* Wait at least a second for something to happen */
-		res = poll(pfds, count, 1000);
+		res = monitor_fds_wait(&mon, 1000);
 		pthread_testcancel();
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
@@ -11433,7 +11657,6 @@ static void *do_monitor(void *data)
 		   happened */
 		ast_mutex_lock(&iflock);
 		found = 0;
-		spoint = 0;
 		lastpass = thispass;
 		thispass = time(NULL);
 		doomed = NULL;
@@ -11496,7 +11719,7 @@ static void *do_monitor(void *data)
 					}
 					continue;
 				}
-				pollres = ast_fdisset(pfds, i->subs[SUB_REAL].dfd, count, &spoint);
+				pollres = monitor_fds_revents(&mon, i->subs[SUB_REAL].dfd);
 				if (pollres & POLLIN) {
 					if (i->owner || i->subs[SUB_REAL].owner) {
 #ifdef HAVE_PRI
@@ -75,6 +75,9 @@ ASTERISK_REGISTER_FILE()
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <regex.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 #include "asterisk/paths.h"
 
@@ -341,7 +344,6 @@ static int max_reg_expire;
 
 static int srvlookup = 0;
 
-static struct ast_timer *timer;				/* Timer for trunking */
 
 static struct ast_netsock_list *netsock;
 static struct ast_netsock_list *outsock;		/*!< used if sourceaddress specified and bindaddr == INADDR_ANY */
@@ -591,10 +593,53 @@ struct iax2_trunk_peer {
 	int trunkmaxmtu;
 	int trunkerror;
 	int calls;
+	struct timeval trunkqueued;		/*!< When the first call chunk of the waiting meta-frame was queued */
+	unsigned int metaframes;		/*!< Number of meta-frames sent */
+	unsigned int overruns;			/*!< Number of meta-frames that waited longer than a trunk interval and a half */
+	unsigned int maxwait;			/*!< Longest time in milliseconds a meta-frame waited */
 	AST_LIST_ENTRY(iax2_trunk_peer) list;
 };
 
-static AST_LIST_HEAD_STATIC(tpeers, iax2_trunk_peer);
+#define DEFAULT_TRUNK_THREADS	1
+#define MAX_TRUNK_THREADS	16
+
+/*! \brief Most trunk meta-frames sent by one system call */
+#define IAX2_TRUNK_BATCH	32
+
+#ifdef HAVE_SENDMMSG
+/*! \brief Meta-frames for one socket waiting to be sent together */
+struct iax2_trunk_batch {
+	int sockfd;
+	unsigned int count;
+	struct mmsghdr msgs[IAX2_TRUNK_BATCH];
+	struct iovec iov[IAX2_TRUNK_BATCH];
+	struct ast_sockaddr addrs[IAX2_TRUNK_BATCH];
+	unsigned char *bufs[IAX2_TRUNK_BATCH];
+	size_t sizes[IAX2_TRUNK_BATCH];
+};
+#endif
+
+/*! \brief A thread sending the meta-frames of some of the trunk peers */
+struct iax2_trunk_thread {
+	pthread_t threadid;
+	/*! Ticks at the trunk frequency */
+	struct ast_timer *timer;
+	/*! The trunk peers this thread sends to, a peer always uses the same thread */
+	AST_LIST_HEAD(, iax2_trunk_peer) tpeers;
+#ifdef HAVE_SENDMMSG
+	struct iax2_trunk_batch batch;
+#endif
+	unsigned int ticks;		/*!< Number of ticks processed */
+	unsigned int overruns;		/*!< Number of ticks that took longer than the trunk interval */
+	unsigned int maxtick;		/*!< Longest tick in microseconds */
+	unsigned int stop:1;
+};
+
+static int trunkthreads = DEFAULT_TRUNK_THREADS;
+/*! \brief The trunk threads. The timer of the first is opened at load, trunking is unavailable without it. */
+static struct iax2_trunk_thread trunk_threads[MAX_TRUNK_THREADS];
+/*! \brief Number of trunk threads running */
+static int trunk_thread_count;
 
 enum iax_reg_state {
 	REG_STATE_UNREGISTERED = 0,
@@ -889,13 +934,34 @@ enum callno_type {
 #define CALLNO_ENTRY_IS_VALIDATED(a)  ((a) & 0x8000)
 #define CALLNO_ENTRY_GET_CALLNO(a)    ((a) & 0x7FFF)
 
-struct call_number_pool {
-	size_t capacity;
-	size_t available;
-	callno_entry numbers[IAX_MAX_CALLS / 2 + 1];
+/*! \brief Number of free lists in each call number pool */
+#define CALLNO_POOL_SHARDS 16
+
+/*!
+ * \brief A free list of call numbers
+ *
+ * Call numbers are taken from a random position, swapping the last one into
+ * its place, so a number just returned is not the next one handed out.
+ * Each free list has room for every call number in its pool, since all of
+ * them may be returned on the same CPU.
+ */
+struct call_number_shard {
+	ast_mutex_t lock;
+	int available;
+	uint16_t numbers[IAX_MAX_CALLS / 2 + 1];
 };
 
-AST_MUTEX_DEFINE_STATIC(callno_pool_lock);
+/*!
+ * \brief Call numbers available to be allocated
+ *
+ * Without a pool wide lock: each CPU allocates from and returns to its own
+ * free list, taking from the others only when its own is empty.
+ */
+struct call_number_pool {
+	int capacity;
+	volatile int available;
+	struct call_number_shard shards[CALLNO_POOL_SHARDS];
+};
 
 /*! table of available call numbers */
 static struct call_number_pool callno_pool;
@@ -955,7 +1021,7 @@ static uint16_t global_maxcallno;
 /*! Total num of call numbers allowed to be allocated without calltoken validation */
 static uint16_t global_maxcallno_nonval;
 
-static uint16_t total_nonval_callno_used = 0;
+static volatile int total_nonval_callno_used = 0;
 
 /*! peer connection private, keeps track of all the call numbers
  *  consumed by a single ip address */
@@ -2864,17 +2930,17 @@ static char *handle_cli_iax2_show_callno_limits(struct ast_cli_entry *e, int cmd
 		ao2_iterator_destroy(&i);
 
 		if (a->argc == 4) {
-			size_t pool_avail = callno_pool.available;
-			size_t trunk_pool_avail = callno_pool_trunk.available;
+			int pool_avail = callno_pool.available;
+			int trunk_pool_avail = callno_pool_trunk.available;
 
 			ast_cli(a->fd, "\nNon-CallToken Validation Callno Limit: %d\n"
 			                 "Non-CallToken Validated Callno Used:   %d\n",
 				global_maxcallno_nonval,
 				total_nonval_callno_used);
 
-			ast_cli(a->fd,   "Total Available Callno:                %zu\n"
-			                 "Regular Callno Available:              %zu\n"
-			                 "Trunk Callno Available:                %zu\n",
+			ast_cli(a->fd,   "Total Available Callno:                %d\n"
+			                 "Regular Callno Available:              %d\n"
+			                 "Trunk Callno Available:                %d\n",
 				pool_avail + trunk_pool_avail,
 				pool_avail,
 				trunk_pool_avail);
@@ -2889,11 +2955,52 @@ static char *handle_cli_iax2_show_callno_limits(struct ast_cli_entry *e, int cmd
 	}
 }
 
+/*! \brief The free list of a call number pool the calling thread uses */
+static unsigned int callno_pool_shard(void)
+{
+#if defined(__linux__)
+	int cpu = sched_getcpu();
+
+	if (cpu >= 0) {
+		return cpu % CALLNO_POOL_SHARDS;
+	}
+#endif
+	return (unsigned int) ast_get_tid() % CALLNO_POOL_SHARDS;
+}
+
+static void callno_shard_push(struct call_number_shard *shard, uint16_t callno)
+{
+	ast_mutex_lock(&shard->lock);
+	ast_assert(shard->available < ARRAY_LEN(shard->numbers));
+	shard->numbers[shard->available++] = callno;
+	ast_mutex_unlock(&shard->lock);
+}
+
+/*! \return A call number, or 0 if the free list is empty */
+static uint16_t callno_shard_pop(struct call_number_shard *shard)
+{
+	uint16_t callno = 0;
+
+	ast_mutex_lock(&shard->lock);
+	if (shard->available) {
+		/* Take a random one and move the last one into its place, so
+		 * call numbers stay unpredictable to anyone spoofing calls. */
+		int choice = ast_random() % shard->available;
+
+		callno = shard->numbers[choice];
+		shard->numbers[choice] = shard->numbers[--shard->available];
+	}
+	ast_mutex_unlock(&shard->lock);
+
+	return callno;
+}
+
 static int get_unused_callno(enum callno_type type, int validated, callno_entry *entry)
 {
 	struct call_number_pool *pool = NULL;
-	callno_entry swap;
-	size_t choice;
+	unsigned int shard;
+	unsigned int i;
+	uint16_t callno = 0;
 
 	switch (type) {
 	case CALLNO_TYPE_NORMAL:
@@ -2910,59 +3017,44 @@ static int get_unused_callno(enum callno_type type, int validated, callno_entry
 	/* If we fail, make sure this has a defined value */
 	*entry = 0;
 
-	/* We lock here primarily to ensure thread safety of the
-	 * total_nonval_callno_used check and increment */
-	ast_mutex_lock(&callno_pool_lock);
-
-	/* Bail out if we don't have any available call numbers */
-	if (!pool->available) {
-		ast_log(LOG_WARNING, "Out of call numbers\n");
-		ast_mutex_unlock(&callno_pool_lock);
-		return 1;
-	}
-
 	/* Only a certain number of non-validated call numbers should be allocated.
 	 * If there ever is an attack, this separates the calltoken validating users
-	 * from the non-calltoken validating users. */
-	if (!validated && total_nonval_callno_used >= global_maxcallno_nonval) {
-		ast_log(LOG_WARNING,
-			"NON-CallToken callnumber limit is reached. Current: %d Max: %d\n",
-			total_nonval_callno_used,
-			global_maxcallno_nonval);
-		ast_mutex_unlock(&callno_pool_lock);
-		return 1;
+	 * from the non-calltoken validating users.  One is claimed before looking
+	 * for a call number, and given back if there is none. */
+	if (!validated) {
+		int used = ast_atomic_fetchadd_int(&total_nonval_callno_used, +1);
+
+		if (used >= global_maxcallno_nonval) {
+			ast_atomic_fetchadd_int(&total_nonval_callno_used, -1);
+			ast_log(LOG_WARNING,
+				"NON-CallToken callnumber limit is reached. Current: %d Max: %d\n",
+				used,
+				global_maxcallno_nonval);
+			return 1;
+		}
 	}
 
-	/* We use a modified Fisher-Yates-Durstenfeld Shuffle to maintain a list of
-	 * available call numbers.  The array of call numbers begins as an ordered
-	 * list from 1 -> n, and we keep a running tally of how many remain unclaimed
-	 * - let's call that x.  When a call number is needed we pick a random index
-	 * into the array between 0 and x and use that as our call number.  In a
-	 * typical FYD shuffle, we would swap the value that we are extracting with
-	 * the number at x, but in our case we swap and don't touch the value at x
-	 * because it is effectively invisible.  We rely on the rest of the IAX2 core
-	 * to return the number to us at some point.  Finally, we decrement x by 1
-	 * which establishes our new unused range.
-	 *
-	 * When numbers are returned to the pool, we put them just past x and bump x
-	 * by 1 so that this number is now available for re-use. */
-
-	choice = ast_random() % pool->available;
-
-	*entry = pool->numbers[choice];
-	swap = pool->numbers[pool->available - 1];
+	/* Take from the free list of this CPU, then from the others in turn */
+	shard = callno_pool_shard();
+	for (i = 0; i < CALLNO_POOL_SHARDS && !callno; i++) {
+		callno = callno_shard_pop(&pool->shards[(shard + i) % CALLNO_POOL_SHARDS]);
+	}
 
-	pool->numbers[choice] = swap;
-	pool->available--;
+	/* Bail out if we don't have any available call numbers */
+	if (!callno) {
+		ast_log(LOG_WARNING, "Out of call numbers\n");
+		if (!validated) {
+			ast_atomic_fetchadd_int(&total_nonval_callno_used, -1);
+		}
+		return 1;
+	}
+	ast_atomic_fetchadd_int(&pool->available, -1);
 
+	*entry = callno;
 	if (validated) {
 		CALLNO_ENTRY_SET_VALIDATED(*entry);
-	} else {
-		total_nonval_callno_used++;
 	}
 
-	ast_mutex_unlock(&callno_pool_lock);
-
 	return 0;
 }
 
@@ -2971,14 +3063,9 @@ static int replace_callno(const void *obj)
 	callno_entry entry = PTR_TO_CALLNO_ENTRY(obj);
 	struct call_number_pool *pool;
 
-	/* We lock here primarily to ensure thread safety of the
-	 * total_nonval_callno_used check and decrement */
-	ast_mutex_lock(&callno_pool_lock);
-
 	if (!CALLNO_ENTRY_IS_VALIDATED(entry)) {
-		if (total_nonval_callno_used) {
-			total_nonval_callno_used--;
-		} else {
+		if (ast_atomic_fetchadd_int(&total_nonval_callno_used, -1) <= 0) {
+			ast_atomic_fetchadd_int(&total_nonval_callno_used, +1);
 			ast_log(LOG_ERROR,
 				"Attempted to decrement total non calltoken validated "
 				"callnumbers below zero.  Callno is: %d\n",
@@ -2997,33 +3084,52 @@ static int replace_callno(const void *obj)
 	/* This clears the validated flag */
 	entry = CALLNO_ENTRY_GET_CALLNO(entry);
 
-	pool->numbers[pool->available] = entry;
-	pool->available++;
-
-	ast_mutex_unlock(&callno_pool_lock);
+	callno_shard_push(&pool->shards[callno_pool_shard()], entry);
+	ast_atomic_fetchadd_int(&pool->available, +1);
 
 	return 0;
 }
 
-static int create_callno_pools(void)
+/*!
+ * \internal
+ * \brief Fill a call number pool
+ *
+ * The call numbers are shuffled and dealt out to the free lists, so they are
+ * not handed out in order.
+ */
+static void fill_callno_pool(struct call_number_pool *pool, uint16_t first, uint16_t last)
 {
-	uint16_t i;
+	uint16_t numbers[IAX_MAX_CALLS / 2 + 1];
+	int count = last - first;
+	int i;
 
-	callno_pool.available = callno_pool_trunk.available = 0;
+	for (i = 0; i < count; i++) {
+		numbers[i] = first + i;
+	}
+	/* Fisher-Yates-Durstenfeld shuffle */
+	for (i = count - 1; i > 0; i--) {
+		int choice = ast_random() % (i + 1);
+		uint16_t swap = numbers[i];
 
-	/* We start at 2.  0 and 1 are reserved. */
-	for (i = 2; i < TRUNK_CALL_START; i++) {
-		callno_pool.numbers[callno_pool.available] = i;
-		callno_pool.available++;
+		numbers[i] = numbers[choice];
+		numbers[choice] = swap;
 	}
 
-	for (i = TRUNK_CALL_START; i < IAX_MAX_CALLS; i++) {
-		callno_pool_trunk.numbers[callno_pool_trunk.available] = i;
-		callno_pool_trunk.available++;
+	for (i = 0; i < CALLNO_POOL_SHARDS; i++) {
+		ast_mutex_init(&pool->shards[i].lock);
+		pool->shards[i].available = 0;
 	}
+	for (i = 0; i < count; i++) {
+		callno_shard_push(&pool->shards[i % CALLNO_POOL_SHARDS], numbers[i]);
+	}
+	pool->capacity = pool->available = count;
+}
 
-	callno_pool.capacity = callno_pool.available;
-	callno_pool_trunk.capacity = callno_pool_trunk.available;
+static int create_callno_pools(void)
+{
+	/* We start at 2.  0 and 1 are reserved. */
+	fill_callno_pool(&callno_pool, 2, TRUNK_CALL_START);
+	fill_callno_pool(&callno_pool_trunk, TRUNK_CALL_START, IAX_MAX_CALLS);
 
 	ast_assert(callno_pool.capacity && callno_pool_trunk.capacity);
 
@@ -6224,11 +6330,15 @@ static unsigned int calc_rxstamp(struct chan_iax2_pvt *p, unsigned int offset)
 static struct iax2_trunk_peer *find_tpeer(struct ast_sockaddr *addr, int fd)
 {
 	struct iax2_trunk_peer *tpeer = NULL;
+	struct iax2_trunk_thread *thread;
+
+	/* A trunk peer always belongs to the same trunk thread */
+	thread = &trunk_threads[trunk_thread_count ? (ntohl(ast_sockaddr_hash(addr)) ^ ast_sockaddr_port(addr)) % trunk_thread_count : 0];
 
 	/* Finds and locks trunk peer */
-	AST_LIST_LOCK(&tpeers);
+	AST_LIST_LOCK(&thread->tpeers);
 
-	AST_LIST_TRAVERSE(&tpeers, tpeer, list) {
+	AST_LIST_TRAVERSE(&thread->tpeers, tpeer, list) {
 		if (!ast_sockaddr_cmp(&tpeer->addr, addr)) {
 			ast_mutex_lock(&tpeer->lock);
 			break;
@@ -6248,11 +6358,11 @@ static struct iax2_trunk_peer *find_tpeer(struct ast_sockaddr *addr, int fd)
 			setsockopt(tpeer->sockfd, SOL_SOCKET, SO_NO_CHECK, &nochecksums, sizeof(nochecksums));
 #endif
 			ast_debug(1, "Created trunk peer for '%s'\n", ast_sockaddr_stringify(&tpeer->addr));
-			AST_LIST_INSERT_TAIL(&tpeers, tpeer, list);
+			AST_LIST_INSERT_TAIL(&thread->tpeers, tpeer, list);
 		}
 	}
 
-	AST_LIST_UNLOCK(&tpeers);
+	AST_LIST_UNLOCK(&thread->tpeers);
 
 	return tpeer;
 }
@@ -6288,6 +6398,10 @@ static int iax2_trunk_queue(struct chan_iax2_pvt *pvt, struct iax_frame *fr)
 			}
 		}
 
+		if (!tpeer->trunkdatalen) {
+			tpeer->trunkqueued = ast_tvnow();
+		}
+
 		/* Append to meta frame */
 		ptr = tpeer->trunkdata + IAX2_TRUNK_PREFACE + tpeer->trunkdatalen;
 		if (ast_test_flag64(&globalflags, IAX_TRUNKTIMESTAMPS)) {
@@ -7082,6 +7196,48 @@ static char *handle_cli_iax2_show_threads(struct ast_cli_entry *e, int cmd, stru
 	return CLI_SUCCESS;
 }
 
+static char *handle_cli_iax2_show_trunks(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT2 "  %-45.45s  %-11.11s  %-9.9s  %-8.8s\n"
+#define FORMAT  "  %-45.45s  %-11u  %-9u  %-8u\n"
+	struct iax2_trunk_peer *tpeer;
+	int x;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "iax2 show trunks";
+		e->usage =
+			"Usage: iax2 show trunks\n"
+			"       Lists the trunk threads and the trunk peers each sends to, with\n"
+			"       the number of ticks and meta-frames that ran late.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+	if (a->argc != 3)
+		return CLI_SHOWUSAGE;
+
+	for (x = 0; x < trunk_thread_count; x++) {
+		struct iax2_trunk_thread *thread = &trunk_threads[x];
+
+		ast_cli(a->fd, "Trunk thread %d: ticks=%u, overruns=%u, max tick=%uus\n",
+			x, thread->ticks, thread->overruns, thread->maxtick);
+		ast_cli(a->fd, FORMAT2, "Peer", "Metaframes", "Overruns", "Max wait");
+		AST_LIST_LOCK(&thread->tpeers);
+		AST_LIST_TRAVERSE(&thread->tpeers, tpeer, list) {
+			ast_mutex_lock(&tpeer->lock);
+			ast_cli(a->fd, FORMAT, ast_sockaddr_stringify(&tpeer->addr),
+				tpeer->metaframes, tpeer->overruns, tpeer->maxwait);
+			ast_mutex_unlock(&tpeer->lock);
+		}
+		AST_LIST_UNLOCK(&thread->tpeers);
+	}
+	ast_cli(a->fd, "%d of %d trunk threads running at %dms\n", trunk_thread_count, trunkthreads, trunkfreq);
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
 static char *handle_cli_iax2_unregister(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct iax2_peer *p;
@@ -9376,49 +9532,177 @@ static int iax2_poke_peer_s(const void *data)
 	return 0;
 }
 
-static int send_trunk(struct iax2_trunk_peer *tpeer, struct timeval *now)
+/*!
+ * \brief Fill in the headers of the meta-frame waiting for a trunk peer
+ *
+ * \note Called with the trunk peer locked
+ *
+ * \return The meta-frame, or NULL if no call chunks are waiting
+ */
+static struct iax_frame *trunk_meta_frame(struct iax2_trunk_peer *tpeer, struct timeval *now)
 {
-	int res = 0;
 	struct iax_frame *fr;
 	struct ast_iax2_meta_hdr *meta;
 	struct ast_iax2_meta_trunk_hdr *mth;
-	int calls = 0;
+
+	if (!tpeer->trunkdatalen) {
+		return NULL;
+	}
 
 	/* Point to frame */
 	fr = (struct iax_frame *)tpeer->trunkdata;
 	/* Point to meta data */
 	meta = (struct ast_iax2_meta_hdr *)fr->afdata;
 	mth = (struct ast_iax2_meta_trunk_hdr *)meta->data;
-	if (tpeer->trunkdatalen) {
-		/* We're actually sending a frame, so fill the meta trunk header and meta header */
-		meta->zeros = 0;
-		meta->metacmd = IAX_META_TRUNK;
-		if (ast_test_flag64(&globalflags, IAX_TRUNKTIMESTAMPS))
-			meta->cmddata = IAX_META_TRUNK_MINI;
-		else
-			meta->cmddata = IAX_META_TRUNK_SUPERMINI;
-		mth->ts = htonl(calc_txpeerstamp(tpeer, trunkfreq, now));
-		/* And the rest of the ast_iax2 header */
-		fr->direction = DIRECTION_OUTGRESS;
-		fr->retrans = -1;
-		fr->transfer = 0;
-		/* Any appropriate call will do */
-		fr->data = fr->afdata;
-		fr->datalen = tpeer->trunkdatalen + sizeof(struct ast_iax2_meta_hdr) + sizeof(struct ast_iax2_meta_trunk_hdr);
+	/* We're actually sending a frame, so fill the meta trunk header and meta header */
+	meta->zeros = 0;
+	meta->metacmd = IAX_META_TRUNK;
+	if (ast_test_flag64(&globalflags, IAX_TRUNKTIMESTAMPS))
+		meta->cmddata = IAX_META_TRUNK_MINI;
+	else
+		meta->cmddata = IAX_META_TRUNK_SUPERMINI;
+	mth->ts = htonl(calc_txpeerstamp(tpeer, trunkfreq, now));
+	/* And the rest of the ast_iax2 header */
+	fr->direction = DIRECTION_OUTGRESS;
+	fr->retrans = -1;
+	fr->transfer = 0;
+	/* Any appropriate call will do */
+	fr->data = fr->afdata;
+	fr->datalen = tpeer->trunkdatalen + sizeof(struct ast_iax2_meta_hdr) + sizeof(struct ast_iax2_meta_trunk_hdr);
+
+	return fr;
+}
+
+/*!
+ * \brief Reset a trunk peer once its meta-frame has been sent
+ *
+ * \note Called with the trunk peer locked
+ *
+ * \return The number of call chunks that were sent
+ */
+static int trunk_meta_frame_sent(struct iax2_trunk_peer *tpeer, struct timeval *now)
+{
+	int calls = tpeer->calls;
+	int64_t wait = ast_tvdiff_ms(*now, tpeer->trunkqueued);
+
+	tpeer->metaframes++;
+	if (wait > trunkfreq + trunkfreq / 2) {
+		tpeer->overruns++;
+	}
+	if (wait > tpeer->maxwait) {
+		tpeer->maxwait = wait;
+	}
+
+	/* Reset transmit trunk side data */
+	tpeer->trunkdatalen = 0;
+	tpeer->calls = 0;
+
+	return calls;
+}
+
+static int send_trunk(struct iax2_trunk_peer *tpeer, struct timeval *now)
+{
+	int res = 0;
+	struct iax_frame *fr;
+	int calls = 0;
+
+	if ((fr = trunk_meta_frame(tpeer, now))) {
 		res = transmit_trunk(fr, &tpeer->addr, tpeer->sockfd);
-		calls = tpeer->calls;
-#if 0
-		ast_debug(1, "Trunking %d call chunks in %d bytes to %s:%d, ts=%d\n", calls, fr->datalen, ast_inet_ntoa(tpeer->addr.sin_addr), ntohs(tpeer->addr.sin_port), ntohl(mth->ts));
-#endif
-		/* Reset transmit trunk side data */
-		tpeer->trunkdatalen = 0;
-		tpeer->calls = 0;
+		calls = trunk_meta_frame_sent(tpeer, now);
 	}
 	if (res < 0)
 		return res;
 	return calls;
 }
 
+#ifdef HAVE_SENDMMSG
+/*! \brief Send the meta-frames waiting in a batch */
+static void trunk_batch_flush(struct iax2_trunk_batch *batch)
+{
+	unsigned int sent = 0;
+	int res;
+
+	while (sent < batch->count) {
+		res = sendmmsg(batch->sockfd, &batch->msgs[sent], batch->count - sent, 0);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ast_debug(1, "Received error: %s\n", strerror(errno));
+			handle_error();
+			/* Drop the meta-frame that failed, as transmit_trunk() does */
+			res = 1;
+		}
+		sent += res;
+	}
+	batch->count = 0;
+}
+
+/*!
+ * \brief Copy a meta-frame into a batch
+ *
+ * \note The batch must have room for it and be for the same socket
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int trunk_batch_add(struct iax2_trunk_batch *batch, struct iax_frame *fr, struct iax2_trunk_peer *tpeer)
+{
+	unsigned int i = batch->count;
+
+	if (batch->sizes[i] < fr->datalen) {
+		unsigned char *buf = ast_realloc(batch->bufs[i], fr->datalen);
+
+		if (!buf) {
+			return -1;
+		}
+		batch->bufs[i] = buf;
+		batch->sizes[i] = fr->datalen;
+	}
+	memcpy(batch->bufs[i], fr->data, fr->datalen);
+	ast_sockaddr_copy(&batch->addrs[i], &tpeer->addr);
+
+	batch->iov[i].iov_base = batch->bufs[i];
+	batch->iov[i].iov_len = fr->datalen;
+	memset(&batch->msgs[i], 0, sizeof(batch->msgs[i]));
+	batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i].ss;
+	batch->msgs[i].msg_hdr.msg_namelen = batch->addrs[i].len;
+	batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+	batch->msgs[i].msg_hdr.msg_iovlen = 1;
+
+	batch->sockfd = tpeer->sockfd;
+	batch->count++;
+
+	return 0;
+}
+
+/*!
+ * \brief Send the meta-frame waiting for a trunk peer along with those of other peers
+ *
+ * \note Called with the trunk peer locked
+ *
+ * \return The number of call chunks sent, or -1 on failure
+ */
+static int send_trunk_batched(struct iax2_trunk_batch *batch, struct iax2_trunk_peer *tpeer, struct timeval *now)
+{
+	struct iax_frame *fr;
+
+	if (!(fr = trunk_meta_frame(tpeer, now))) {
+		return 0;
+	}
+
+	if (batch->count == IAX2_TRUNK_BATCH || (batch->count && batch->sockfd != tpeer->sockfd)) {
+		trunk_batch_flush(batch);
+	}
+	if (trunk_batch_add(batch, fr, tpeer) && transmit_trunk(fr, &tpeer->addr, tpeer->sockfd) < 0) {
+		trunk_meta_frame_sent(tpeer, now);
+		return -1;
+	}
+
+	return trunk_meta_frame_sent(tpeer, now);
+}
+#endif
+
 static inline int iax2_trunk_expired(struct iax2_trunk_peer *tpeer, struct timeval *now)
 {
 	/* Drop when trunk is about 5 seconds idle */
@@ -9427,26 +9711,27 @@ static inline int iax2_trunk_expired(struct iax2_trunk_peer *tpeer, struct timev
 	return 0;
 }
 
-static int timing_read(int *id, int fd, short events, void *cbdata)
+/*! \brief Send the meta-frames of the trunk peers of a trunk thread */
+static void trunk_thread_tick(struct iax2_trunk_thread *thread)
 {
 	int res, processed = 0, totalcalls = 0;
+	int debug = iaxtrunkdebug;
 	struct iax2_trunk_peer *tpeer = NULL, *drop = NULL;
 	struct timeval now = ast_tvnow();
+	int64_t elapsed;
 
-	if (iaxtrunkdebug) {
+	if (debug) {
 		ast_verbose("Beginning trunk processing. Trunk queue ceiling is %d bytes per host\n", trunkmaxsize);
 	}
 
-	if (timer) {
-		if (ast_timer_ack(timer, 1) < 0) {
-			ast_log(LOG_ERROR, "Timer failed acknowledge\n");
-			return 0;
-		}
+	if (ast_timer_ack(thread->timer, 1) < 0) {
+		ast_log(LOG_ERROR, "Timer failed acknowledge\n");
+		return;
 	}
 
 	/* For each peer that supports trunking... */
-	AST_LIST_LOCK(&tpeers);
-	AST_LIST_TRAVERSE_SAFE_BEGIN(&tpeers, tpeer, list) {
+	AST_LIST_LOCK(&thread->tpeers);
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&thread->tpeers, tpeer, list) {
 		processed++;
 		res = 0;
 		ast_mutex_lock(&tpeer->lock);
@@ -9458,9 +9743,13 @@ static int timing_read(int *id, int fd, short events, void *cbdata)
 			AST_LIST_REMOVE_CURRENT(list);
 			drop = tpeer;
 		} else {
+#ifdef HAVE_SENDMMSG
+			res = send_trunk_batched(&thread->batch, tpeer, &now);
+#else
 			res = send_trunk(tpeer, &now);
-			trunk_timed++;
-			if (iaxtrunkdebug) {
+#endif
+			ast_atomic_fetchadd_int(&trunk_timed, +1);
+			if (debug) {
 				ast_verbose(" - Trunk peer (%s) has %d call chunk%s in transit, %u bytes backloged and has hit a high water mark of %u bytes\n",
 							ast_sockaddr_stringify(&tpeer->addr),
 							res,
@@ -9474,7 +9763,12 @@ static int timing_read(int *id, int fd, short events, void *cbdata)
 		ast_mutex_unlock(&tpeer->lock);
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
-	AST_LIST_UNLOCK(&tpeers);
+#ifdef HAVE_SENDMMSG
+	if (thread->batch.count) {
+		trunk_batch_flush(&thread->batch);
+	}
+#endif
+	AST_LIST_UNLOCK(&thread->tpeers);
 
 	if (drop) {
 		ast_mutex_lock(&drop->lock);
@@ -9490,12 +9784,46 @@ static int timing_read(int *id, int fd, short events, void *cbdata)
 		ast_free(drop);
 	}
 
-	if (iaxtrunkdebug) {
+	elapsed = ast_tvdiff_us(ast_tvnow(), now);
+	thread->ticks++;
+	if (elapsed > trunkfreq * 1000) {
+		thread->overruns++;
+	}
+	if (elapsed > thread->maxtick) {
+		thread->maxtick = elapsed;
+	}
+
+	if (debug) {
 		ast_verbose("Ending trunk processing with %d peers and %d call chunks processed\n", processed, totalcalls);
+		iaxtrunkdebug = 0;
 	}
-	iaxtrunkdebug = 0;
+}
 
-	return 1;
+static void *trunk_thread(void *data)
+{
+	struct iax2_trunk_thread *thread = data;
+	struct pollfd pfd = {
+		.fd = ast_timer_fd(thread->timer),
+		.events = POLLIN | POLLPRI,
+	};
+	int res;
+
+	while (!thread->stop) {
+		/* Wake up once a second to notice being stopped */
+		res = ast_poll(&pfd, 1, 1000);
+		if (res < 0) {
+			if (errno != EINTR) {
+				ast_log(LOG_ERROR, "Trunk timer poll failed: %s\n", strerror(errno));
+				break;
+			}
+			continue;
+		}
+		if (res && !thread->stop) {
+			trunk_thread_tick(thread);
+		}
+	}
+
+	return NULL;
 }
 
 struct dpreq_data {
@@ -12544,10 +12872,6 @@ static struct ast_channel *iax2_request(const char *type, struct ast_format_cap
 
 static void *network_thread(void *ignore)
 {
-	if (timer) {
-		ast_io_add(io, ast_timer_fd(timer), timing_read, AST_IO_IN | AST_IO_PRI, NULL);
-	}
-
 	for (;;) {
 		pthread_testcancel();
 		/* Wake up once a second just in case SIGURG was sent while
@@ -12561,6 +12885,56 @@ static void *network_thread(void *ignore)
 	return NULL;
 }
 
+/*! \brief Stop the trunk threads, their timers are closed at unload */
+static void stop_trunk_threads(void)
+{
+	int x;
+
+	for (x = 0; x < trunk_thread_count; x++) {
+		trunk_threads[x].stop = 1;
+	}
+	for (x = 0; x < trunk_thread_count; x++) {
+		pthread_join(trunk_threads[x].threadid, NULL);
+		trunk_threads[x].threadid = AST_PTHREADT_NULL;
+	}
+	trunk_thread_count = 0;
+}
+
+/*!
+ * \brief Start the threads sending trunk meta-frames
+ *
+ * Each has its own timer and trunk peers. Fewer than trunkthreads are started
+ * if the timers cannot all be opened.
+ */
+static void start_trunk_threads(void)
+{
+	int x;
+
+	if (!trunk_threads[0].timer) {
+		return;
+	}
+
+	for (x = 0; x < trunkthreads; x++) {
+		struct iax2_trunk_thread *thread = &trunk_threads[x];
+
+		if (!thread->timer) {
+			if (!(thread->timer = ast_timer_open())) {
+				ast_log(LOG_WARNING, "Unable to open a timer for trunk thread %d, using %d trunk threads\n", x, x);
+				break;
+			}
+			ast_timer_set_rate(thread->timer, 1000 / trunkfreq);
+		}
+		thread->stop = 0;
+		if (ast_pthread_create_background(&thread->threadid, NULL, trunk_thread, thread)) {
+			ast_log(LOG_WARNING, "Failed to create trunk thread %d, using %d trunk threads\n", x, x);
+			thread->threadid = AST_PTHREADT_NULL;
+			break;
+		}
+	}
+	/* Set once, so a peer always hashes to the same one of the threads running */
+	trunk_thread_count = x;
+}
+
 static int start_network_thread(void)
 {
 	struct iax2_thread *thread;
@@ -12605,6 +12979,7 @@ static int start_network_thread(void)
 		return -1;
 	}
 	ast_verb(2, "%d helper threads started\n", threadcount);
+	start_trunk_threads();
 	return 0;
 }
 
@@ -12846,7 +13221,7 @@ static struct iax2_peer *build_peer(const char *name, struct ast_variable *v, st
 				ast_string_field_set(peer, description, v->value);
 			} else if (!strcasecmp(v->name, "trunk")) {
 				ast_set2_flag64(peer, ast_true(v->value), IAX_TRUNK);
-				if (ast_test_flag64(peer, IAX_TRUNK) && !timer) {
+				if (ast_test_flag64(peer, IAX_TRUNK) && !trunk_threads[0].timer) {
 					ast_log(LOG_WARNING, "Unable to support trunking on peer '%s' without a timing interface\n", peer->name);
 					ast_clear_flag64(peer, IAX_TRUNK);
 				}
@@ -13165,7 +13540,7 @@ static struct iax2_user *build_user(const char *name, struct ast_variable *v, st
 				iax2_parse_allow_disallow(&user->prefs, &user->capability,v->value, 0);
 			} else if (!strcasecmp(v->name, "trunk")) {
 				ast_set2_flag64(user, ast_true(v->value), IAX_TRUNK);
-				if (ast_test_flag64(user, IAX_TRUNK) && !timer) {
+				if (ast_test_flag64(user, IAX_TRUNK) && !trunk_threads[0].timer) {
 					ast_log(LOG_WARNING, "Unable to support trunking on user '%s' without a timing interface\n", user->name);
 					ast_clear_flag64(user, IAX_TRUNK);
 				}
@@ -13546,6 +13921,20 @@ static int set_config(const char *config_file, int reload, int forced)
 					iaxthreadcount = 256;
 				}
 			}
+		} else if (!strcasecmp(v->name, "trunkthreads")) {
+			if (reload) {
+				if (atoi(v->value) != trunkthreads)
+					ast_log(LOG_NOTICE, "Ignoring any changes to trunkthreads during reload\n");
+			} else {
+				trunkthreads = atoi(v->value);
+				if (trunkthreads < 1) {
+					ast_log(LOG_NOTICE, "trunkthreads must be at least 1.\n");
+					trunkthreads = 1;
+				} else if (trunkthreads > MAX_TRUNK_THREADS) {
+					ast_log(LOG_NOTICE, "Limiting trunkthreads to %d\n", MAX_TRUNK_THREADS);
+					trunkthreads = MAX_TRUNK_THREADS;
+				}
+			}
 		} else if (!strcasecmp(v->name, "iaxmaxthreadcount")) {
 			if (reload) {
 				AST_LIST_LOCK(&dynamic_list);
@@ -13678,8 +14067,10 @@ static int set_config(const char *config_file, int reload, int forced)
 				ast_log(LOG_NOTICE, "trunkfreq must be between 10ms and 1000ms, using 1000ms instead.\n");
 				trunkfreq = 1000;
 			}
-			if (timer) {
-				ast_timer_set_rate(timer, 1000 / trunkfreq);
+			for (x = 0; x < ARRAY_LEN(trunk_threads); x++) {
+				if (trunk_threads[x].timer) {
+					ast_timer_set_rate(trunk_threads[x].timer, 1000 / trunkfreq);
+				}
 			}
 		} else if (!strcasecmp(v->name, "trunkmtu")) {
 			mtuv = atoi(v->value);
@@ -14512,6 +14903,7 @@ static struct ast_cli_entry cli_iax2[] = {
 	AST_CLI_DEFINE(handle_cli_iax2_show_registry,       "Display IAX registration status"),
 	AST_CLI_DEFINE(handle_cli_iax2_show_stats,          "Display IAX statistics"),
 	AST_CLI_DEFINE(handle_cli_iax2_show_threads,        "Display IAX helper thread info"),
+	AST_CLI_DEFINE(handle_cli_iax2_show_trunks,         "Display IAX trunk thread info"),
 	AST_CLI_DEFINE(handle_cli_iax2_show_users,          "List defined IAX users"),
 	AST_CLI_DEFINE(handle_cli_iax2_test_losspct,        "Set IAX2 incoming frame loss percentage"),
 	AST_CLI_DEFINE(handle_cli_iax2_unregister,          "Unregister (force expiration) an IAX2 peer from the registry"),
@@ -14688,6 +15080,8 @@ static int __unload_module(void)
 		pthread_join(netthreadid, NULL);
 	}
 
+	stop_trunk_threads();
+
 	for (x = 0; x < ARRAY_LEN(iaxs); x++) {
 		if (iaxs[x]) {
 			iax2_destroy(x);
@@ -14733,9 +15127,22 @@ static int __unload_module(void)
 	ao2_ref(iax_transfercallno_pvts, -1);
 	ao2_ref(callno_limits, -1);
 	ao2_ref(calltoken_ignores, -1);
-	if (timer) {
-		ast_timer_close(timer);
-		timer = NULL;
+	for (x = 0; x < ARRAY_LEN(trunk_threads); x++) {
+		if (trunk_threads[x].timer) {
+			ast_timer_close(trunk_threads[x].timer);
+			trunk_threads[x].timer = NULL;
+		}
+#ifdef HAVE_SENDMMSG
+		{
+			int i;
+
+			for (i = 0; i < IAX2_TRUNK_BATCH; i++) {
+				ast_free(trunk_threads[x].batch.bufs[i]);
+				trunk_threads[x].batch.bufs[i] = NULL;
+				trunk_threads[x].batch.sizes[i] = 0;
+			}
+		}
+#endif
 	}
 	transmit_processor = ast_taskprocessor_unreference(transmit_processor);
 
@@ -15116,14 +15523,18 @@ static int load_module(void)
 	iax_set_error(iax_error_output);
 	jb_setoutput(jb_error_output, jb_warning_output, NULL);
 
-	if ((timer = ast_timer_open())) {
-		ast_timer_set_rate(timer, 1000 / trunkfreq);
+	for (x = 0; x < ARRAY_LEN(trunk_threads); x++) {
+		AST_LIST_HEAD_INIT(&trunk_threads[x].tpeers);
+		trunk_threads[x].threadid = AST_PTHREADT_NULL;
+	}
+	if ((trunk_threads[0].timer = ast_timer_open())) {
+		ast_timer_set_rate(trunk_threads[0].timer, 1000 / trunkfreq);
 	}
 
 	if (set_config(config, 0, 0) == -1) {
-		if (timer) {
-			ast_timer_close(timer);
-			timer = NULL;
+		if (trunk_threads[0].timer) {
+			ast_timer_close(trunk_threads[0].timer);
+			trunk_threads[0].timer = NULL;
 		}
 		return AST_MODULE_LOAD_DECLINE;
 	}
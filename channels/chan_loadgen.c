@@ -0,0 +1,1054 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Synthetic load generator channel
+ *
+ * Creates channels at a given rate that either run dialplan or join mixing
+ * bridges, and once answered produce a frame of audio in a given codec
+ * every 20 ms, paced by a timer, as a caller would. Frames written to them
+ * are counted and dropped. The time each channel takes to set up, to be
+ * answered and to receive its first frame is measured, so the capacity of
+ * a system, its dialplan and its bridges can be found without network
+ * traffic.
+ *
+ * \ingroup channel_drivers
+ */
+
+/*** MODULEINFO
+	<support_level>extended</support_level>
+ ***/
+
+/*** DOCUMENTATION
+	<manager name="LoadgenStart" language="en_US">
+		<synopsis>
+			Start creating synthetic channels.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Count" required="true">
+				<para>Number of channels to create.</para>
+			</parameter>
+			<parameter name="Rate" required="true">
+				<para>Channels created a second. May have a fraction.</para>
+			</parameter>
+			<parameter name="Context">
+				<para>Context each channel runs dialplan in. Either it or
+				<replaceable>BridgeSize</replaceable> must be given.</para>
+			</parameter>
+			<parameter name="Exten">
+				<para>Extension each channel runs, <literal>s</literal> by default.</para>
+			</parameter>
+			<parameter name="BridgeSize">
+				<para>Put the channels in mixing bridges of this many each
+				instead of running dialplan.</para>
+			</parameter>
+			<parameter name="Codec">
+				<para>Format of the audio the channels produce, <literal>ulaw</literal>
+				by default.</para>
+			</parameter>
+			<parameter name="Duration">
+				<para>Seconds after being answered that each channel hangs up. By
+				default they stay until hung up otherwise.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Starts creating <literal>Loadgen</literal> channels, as the CLI
+			command <literal>loadgen start</literal> does. Only one run creates
+			channels at a time.</para>
+		</description>
+		<see-also>
+			<ref type="manager">LoadgenStop</ref>
+			<ref type="manager">LoadgenStatus</ref>
+		</see-also>
+	</manager>
+	<manager name="LoadgenStop" language="en_US">
+		<synopsis>
+			Stop creating synthetic channels and hang up those there are.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+		</syntax>
+		<description>
+			<para>Stops the run creating <literal>Loadgen</literal> channels and hangs
+			up every one of them.</para>
+		</description>
+	</manager>
+	<manager name="LoadgenStatus" language="en_US">
+		<synopsis>
+			Show what the last run of synthetic channels measured.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+		</syntax>
+		<description>
+			<para>Responds with the channels the last run created, the rate it
+			created them at, and the least, average and most time in microseconds
+			they took to set up, to be answered and to receive their first frame
+			of audio, as the CLI command <literal>loadgen show</literal> does.</para>
+		</description>
+	</manager>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include <math.h>
+
+#include "asterisk/bridge.h"
+#include "asterisk/causes.h"
+#include "asterisk/channel.h"
+#include "asterisk/cli.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/frame.h"
+#include "asterisk/lock.h"
+#include "asterisk/manager.h"
+#include "asterisk/module.h"
+#include "asterisk/pbx.h"
+#include "asterisk/timing.h"
+#include "asterisk/translate.h"
+#include "asterisk/utils.h"
+
+/*! \brief Milliseconds of audio in each frame */
+#define LOADGEN_PTIME 20
+
+/*! \brief Frequency of the tone the channels produce */
+#define LOADGEN_TONE_HZ 1000
+
+/*! \brief A frame of audio, encoded once and sent by every channel of a run */
+struct loadgen_payload {
+	struct ast_format *format;
+	/*! Frames a second, for the timer */
+	unsigned int rate;
+	int samples;
+	int datalen;
+	unsigned char data[0];
+};
+
+/*! \brief What a run creates */
+struct loadgen_params {
+	unsigned int count;
+	/*! Channels created a second */
+	double rate;
+	char context[AST_MAX_CONTEXT];
+	char exten[AST_MAX_EXTENSION];
+	/*! Channels in each bridge, or 0 to run dialplan */
+	unsigned int bridge_size;
+	/*! Seconds after being answered the channels hang up, or 0 */
+	unsigned int duration;
+	struct loadgen_payload *payload;
+};
+
+/*! \brief Times one stage of setting up took */
+struct loadgen_stage {
+	unsigned int count;
+	int64_t total_us;
+	int64_t min_us;
+	int64_t max_us;
+};
+
+/*! \brief The current run, or the last. Protected by loadgen_lock. */
+static struct {
+	/*! Which run this is, so channels of earlier runs are not counted */
+	unsigned int run;
+	struct loadgen_params params;
+	struct timeval started;
+	/*! When the last channel was created, or zero while the run creates them */
+	struct timeval finished;
+	unsigned int created;
+	unsigned int failed;
+	/*! Channels of the run that have hung up */
+	unsigned int completed;
+	/*! Frames sent and received by the channels that have hung up */
+	uint64_t frames_out;
+	uint64_t frames_in;
+	/*! From starting to create a channel to handing it to the PBX or bridge */
+	struct loadgen_stage setup;
+	/*! From handing a channel over to it being answered */
+	struct loadgen_stage answer;
+	/*! From being answered to the first frame written to the channel */
+	struct loadgen_stage media;
+	/*! Set to have the generator thread stop */
+	int stop;
+} loadgen;
+
+AST_MUTEX_DEFINE_STATIC(loadgen_lock);
+static ast_cond_t loadgen_cond;
+
+/*! \brief Serializes starting and stopping runs, and owns loadgen_thread */
+AST_MUTEX_DEFINE_STATIC(loadgen_control_lock);
+static pthread_t loadgen_thread = AST_PTHREADT_NULL;
+
+/*! \brief Number of Loadgen channels there are, of any run */
+static int loadgen_active;
+
+/*! \brief A Loadgen channel */
+struct loadgen_pvt {
+	struct ast_timer *timer;
+	struct loadgen_payload *payload;
+	unsigned int run;
+	struct timeval created;
+	struct timeval handed_off;
+	struct timeval answered;
+	/*! When to hang up, or zero */
+	struct timeval hangup_at;
+	unsigned int duration;
+	unsigned int got_media:1;
+	uint64_t frames_out;
+	uint64_t frames_in;
+	struct ast_frame frame;
+	/*! AST_FRIENDLY_OFFSET, then a copy of the payload */
+	unsigned char buf[0];
+};
+
+static int loadgen_call(struct ast_channel *ast, const char *dest, int timeout);
+static int loadgen_answer(struct ast_channel *ast);
+static int loadgen_hangup(struct ast_channel *ast);
+static struct ast_frame *loadgen_read(struct ast_channel *ast);
+static int loadgen_write(struct ast_channel *ast, struct ast_frame *f);
+static int loadgen_indicate(struct ast_channel *ast, int condition, const void *data, size_t datalen);
+
+static struct ast_channel_tech loadgen_tech = {
+	.type = "Loadgen",
+	.description = "Synthetic Load Generator Channel",
+	.call = loadgen_call,
+	.answer = loadgen_answer,
+	.hangup = loadgen_hangup,
+	.read = loadgen_read,
+	.write = loadgen_write,
+	.indicate = loadgen_indicate,
+};
+
+/*! \note loadgen_lock must be held */
+static void loadgen_stage_add(struct loadgen_stage *stage, int64_t us)
+{
+	if (!stage->count || us < stage->min_us) {
+		stage->min_us = us;
+	}
+	if (us > stage->max_us) {
+		stage->max_us = us;
+	}
+	stage->total_us += us;
+	++stage->count;
+}
+
+/*! \brief Count a stage of a channel, if it belongs to the current run */
+static void loadgen_stage_record(struct loadgen_pvt *pvt, struct loadgen_stage *stage,
+	struct timeval start, struct timeval end)
+{
+	ast_mutex_lock(&loadgen_lock);
+	if (pvt->run == loadgen.run) {
+		loadgen_stage_add(stage, ast_tvdiff_us(end, start));
+	}
+	ast_mutex_unlock(&loadgen_lock);
+}
+
+static int loadgen_call(struct ast_channel *ast, const char *dest, int timeout)
+{
+	/* Dialed channels answer at once */
+	ast_queue_control(ast, AST_CONTROL_ANSWER);
+	return 0;
+}
+
+static int loadgen_answer(struct ast_channel *ast)
+{
+	struct loadgen_pvt *pvt = ast_channel_tech_pvt(ast);
+
+	if (!pvt || !ast_tvzero(pvt->answered)) {
+		return 0;
+	}
+	pvt->answered = ast_tvnow();
+	if (pvt->duration) {
+		pvt->hangup_at = ast_tvadd(pvt->answered, ast_tv(pvt->duration, 0));
+	}
+	loadgen_stage_record(pvt, &loadgen.answer, pvt->handed_off, pvt->answered);
+	return 0;
+}
+
+static int loadgen_hangup(struct ast_channel *ast)
+{
+	struct loadgen_pvt *pvt = ast_channel_tech_pvt(ast);
+
+	if (!pvt) {
+		return 0;
+	}
+
+	ast_mutex_lock(&loadgen_lock);
+	if (pvt->run == loadgen.run) {
+		++loadgen.completed;
+		loadgen.frames_out += pvt->frames_out;
+		loadgen.frames_in += pvt->frames_in;
+	}
+	ast_mutex_unlock(&loadgen_lock);
+
+	ast_channel_tech_pvt_set(ast, NULL);
+	ast_timer_close(pvt->timer);
+	ao2_ref(pvt->payload, -1);
+	ast_free(pvt);
+	ast_atomic_fetchadd_int(&loadgen_active, -1);
+	return 0;
+}
+
+static struct ast_frame *loadgen_read(struct ast_channel *ast)
+{
+	struct loadgen_pvt *pvt = ast_channel_tech_pvt(ast);
+	struct loadgen_payload *payload = pvt->payload;
+
+	ast_timer_ack(pvt->timer, 1);
+
+	if (ast_tvzero(pvt->answered)) {
+		/* Callers do not talk until they are answered */
+		return &ast_null_frame;
+	}
+	if (!ast_tvzero(pvt->hangup_at) && ast_tvcmp(ast_tvnow(), pvt->hangup_at) >= 0) {
+		return NULL;
+	}
+
+	/* Whoever reads the frame may change it, so it is copied each time */
+	memcpy(pvt->buf + AST_FRIENDLY_OFFSET, payload->data, payload->datalen);
+	memset(&pvt->frame, 0, sizeof(pvt->frame));
+	pvt->frame.frametype = AST_FRAME_VOICE;
+	pvt->frame.subclass.format = payload->format;
+	pvt->frame.data.ptr = pvt->buf + AST_FRIENDLY_OFFSET;
+	pvt->frame.offset = AST_FRIENDLY_OFFSET;
+	pvt->frame.datalen = payload->datalen;
+	pvt->frame.samples = payload->samples;
+	pvt->frame.src = "loadgen";
+	++pvt->frames_out;
+
+	return &pvt->frame;
+}
+
+static int loadgen_write(struct ast_channel *ast, struct ast_frame *f)
+{
+	struct loadgen_pvt *pvt = ast_channel_tech_pvt(ast);
+
+	if (!pvt || f->frametype != AST_FRAME_VOICE) {
+		return 0;
+	}
+	++pvt->frames_in;
+	if (!pvt->got_media && !ast_tvzero(pvt->answered)) {
+		pvt->got_media = 1;
+		loadgen_stage_record(pvt, &loadgen.media, pvt->answered, ast_tvnow());
+	}
+	return 0;
+}
+
+static int loadgen_indicate(struct ast_channel *ast, int condition, const void *data, size_t datalen)
+{
+	/* Nothing listens, so nothing need be played */
+	return 0;
+}
+
+/*! \brief Fill \a samples with a tone */
+static void loadgen_tone(int16_t *samples, int count, unsigned int rate)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		samples[i] = 8000 * sin(2 * M_PI * LOADGEN_TONE_HZ * i / rate);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Encode the frame of audio the channels of a run produce
+ *
+ * \return The payload, or NULL if the format cannot be encoded from
+ * signed linear
+ */
+static struct loadgen_payload *loadgen_payload_create(struct ast_format *format)
+{
+	unsigned int rate = ast_format_get_sample_rate(format);
+	int count = rate * LOADGEN_PTIME / 1000;
+	struct ast_format *slin = ast_format_cache_get_slin_by_rate(rate);
+	struct ast_trans_pvt *path = NULL;
+	struct loadgen_payload *payload = NULL;
+	struct ast_frame frame = { .frametype = AST_FRAME_VOICE, };
+	struct ast_frame *out = NULL;
+	int16_t *samples;
+	int i;
+
+	if (ast_format_get_type(format) != AST_MEDIA_TYPE_AUDIO || !count
+		|| !(samples = ast_calloc(count, sizeof(*samples)))) {
+		return NULL;
+	}
+	loadgen_tone(samples, count, rate);
+
+	frame.subclass.format = slin;
+	frame.data.ptr = samples;
+	frame.datalen = count * sizeof(*samples);
+	frame.samples = count;
+	frame.src = "loadgen";
+
+	if (ast_format_cmp(format, slin) == AST_FORMAT_CMP_EQUAL) {
+		out = &frame;
+	} else if ((path = ast_translator_build_path(format, slin))) {
+		/* Encoders may need more than one frame before they give one */
+		for (i = 0; i < 10 && !out; ++i) {
+			out = ast_translate(path, &frame, 0);
+		}
+	}
+
+	if (out && out->samples && out->datalen) {
+		payload = ao2_alloc_options(sizeof(*payload) + out->datalen, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	}
+	if (payload) {
+		payload->format = ao2_bump(format);
+		payload->samples = out->samples;
+		payload->datalen = out->datalen;
+		payload->rate = MAX(rate / out->samples, 1);
+		memcpy(payload->data, out->data.ptr, out->datalen);
+	}
+
+	if (out && out != &frame) {
+		ast_frfree(out);
+	}
+	if (path) {
+		ast_translator_free_path(path);
+	}
+	ast_free(samples);
+	return payload;
+}
+
+static void loadgen_payload_destroy(struct loadgen_payload *payload)
+{
+	if (payload) {
+		ao2_cleanup(payload->format);
+		ao2_ref(payload, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Create a channel and hand it to the PBX or a bridge
+ *
+ * \param params What the run creates
+ * \param run Which run this is
+ * \param seq Which channel of the run this is
+ * \param bridge The bridge being filled, replaced with the next when full
+ * \param in_bridge How many channels the bridge has been given
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int loadgen_channel_start(const struct loadgen_params *params, unsigned int run,
+	unsigned int seq, struct ast_bridge **bridge, unsigned int *in_bridge)
+{
+	struct loadgen_payload *payload = params->payload;
+	struct timeval created = ast_tvnow();
+	struct ast_format_cap *caps;
+	struct ast_channel *chan;
+	struct loadgen_pvt *pvt;
+
+	pvt = ast_calloc(1, sizeof(*pvt) + AST_FRIENDLY_OFFSET + payload->datalen);
+	if (!pvt) {
+		return -1;
+	}
+	pvt->run = run;
+	pvt->created = created;
+	pvt->duration = params->duration;
+	pvt->payload = ao2_bump(payload);
+
+	caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	pvt->timer = ast_timer_open();
+	if (!caps || !pvt->timer || ast_timer_set_rate(pvt->timer, payload->rate)) {
+		ast_log(LOG_WARNING, "Unable to open a timer for a Loadgen channel\n");
+		ao2_cleanup(caps);
+		if (pvt->timer) {
+			ast_timer_close(pvt->timer);
+		}
+		ao2_ref(pvt->payload, -1);
+		ast_free(pvt);
+		return -1;
+	}
+
+	chan = ast_channel_alloc(1, AST_STATE_DOWN, "loadgen", "Load Generator", "",
+		S_OR(params->exten, "s"), S_OR(params->context, "default"), NULL, NULL, 0,
+		"Loadgen/%u-%u", run, seq);
+	if (!chan) {
+		ao2_ref(caps, -1);
+		ast_timer_close(pvt->timer);
+		ao2_ref(pvt->payload, -1);
+		ast_free(pvt);
+		return -1;
+	}
+
+	ast_channel_tech_set(chan, &loadgen_tech);
+	ast_format_cap_append(caps, payload->format, 0);
+	ast_channel_nativeformats_set(chan, caps);
+	ast_channel_set_writeformat(chan, payload->format);
+	ast_channel_set_rawwriteformat(chan, payload->format);
+	ast_channel_set_readformat(chan, payload->format);
+	ast_channel_set_rawreadformat(chan, payload->format);
+	ast_channel_set_fd(chan, 0, ast_timer_fd(pvt->timer));
+	ast_channel_tech_pvt_set(chan, pvt);
+	ast_atomic_fetchadd_int(&loadgen_active, +1);
+	ast_channel_unlock(chan);
+	ao2_ref(caps, -1);
+
+	pvt->handed_off = ast_tvnow();
+	if (!params->bridge_size) {
+		if (ast_pbx_start(chan)) {
+			ast_hangup(chan);
+			return -1;
+		}
+	} else {
+		if (!*bridge) {
+			*bridge = ast_bridge_base_new(AST_BRIDGE_CAPABILITY_MULTIMIX,
+				AST_BRIDGE_FLAG_DISSOLVE_EMPTY, "Loadgen", NULL, NULL);
+			if (!*bridge) {
+				ast_hangup(chan);
+				return -1;
+			}
+		}
+		ast_raw_answer(chan);
+		if (ast_bridge_impart(*bridge, chan, NULL, NULL, AST_BRIDGE_IMPART_CHAN_INDEPENDENT)) {
+			ast_hangup(chan);
+			return -1;
+		}
+		if (++*in_bridge == params->bridge_size) {
+			ao2_ref(*bridge, -1);
+			*bridge = NULL;
+			*in_bridge = 0;
+		}
+	}
+
+	loadgen_stage_record(pvt, &loadgen.setup, created, ast_tvnow());
+	return 0;
+}
+
+/*! \brief Creates the channels of a run at its rate */
+static void *loadgen_generate(void *data)
+{
+	struct loadgen_params params;
+	struct ast_bridge *bridge = NULL;
+	unsigned int in_bridge = 0;
+	struct timeval started;
+	unsigned int run;
+	unsigned int i;
+
+	ast_mutex_lock(&loadgen_lock);
+	params = loadgen.params;
+	ao2_ref(params.payload, +1);
+	run = loadgen.run;
+	started = loadgen.started;
+	ast_mutex_unlock(&loadgen_lock);
+
+	for (i = 0; i < params.count; ++i) {
+		int64_t offset_us = i * 1000000.0 / params.rate;
+		struct timeval due = ast_tvadd(started, ast_tv(offset_us / 1000000, offset_us % 1000000));
+		struct timespec ts = { .tv_sec = due.tv_sec, .tv_nsec = due.tv_usec * 1000, };
+		int stop;
+		int res;
+
+		ast_mutex_lock(&loadgen_lock);
+		while (!loadgen.stop && ast_tvcmp(ast_tvnow(), due) < 0) {
+			ast_cond_timedwait(&loadgen_cond, &loadgen_lock, &ts);
+		}
+		stop = loadgen.stop;
+		ast_mutex_unlock(&loadgen_lock);
+		if (stop) {
+			break;
+		}
+
+		res = loadgen_channel_start(&params, run, i, &bridge, &in_bridge);
+
+		ast_mutex_lock(&loadgen_lock);
+		if (res) {
+			++loadgen.failed;
+		} else {
+			++loadgen.created;
+		}
+		ast_mutex_unlock(&loadgen_lock);
+	}
+
+	if (bridge && !in_bridge) {
+		ast_bridge_destroy(bridge, 0);
+	} else {
+		ao2_cleanup(bridge);
+	}
+	ao2_ref(params.payload, -1);
+
+	ast_mutex_lock(&loadgen_lock);
+	loadgen.finished = ast_tvnow();
+	ast_mutex_unlock(&loadgen_lock);
+
+	return NULL;
+}
+
+/*! \brief Whether the generator thread is creating channels */
+static int loadgen_creating(void)
+{
+	int creating;
+
+	ast_mutex_lock(&loadgen_lock);
+	creating = loadgen_thread != AST_PTHREADT_NULL && ast_tvzero(loadgen.finished);
+	ast_mutex_unlock(&loadgen_lock);
+	return creating;
+}
+
+/*!
+ * \internal
+ * \brief Start a run
+ *
+ * \param params What to create. Its payload is stolen.
+ *
+ * \return NULL on success, otherwise why the run could not start
+ */
+static const char *loadgen_start(struct loadgen_params *params)
+{
+	const char *error = NULL;
+
+	ast_mutex_lock(&loadgen_control_lock);
+	if (loadgen_creating()) {
+		error = "A run is already creating channels";
+		loadgen_payload_destroy(params->payload);
+		goto done;
+	}
+	if (loadgen_thread != AST_PTHREADT_NULL) {
+		pthread_join(loadgen_thread, NULL);
+		loadgen_thread = AST_PTHREADT_NULL;
+	}
+
+	ast_mutex_lock(&loadgen_lock);
+	loadgen_payload_destroy(loadgen.params.payload);
+	++loadgen.run;
+	loadgen.params = *params;
+	loadgen.started = ast_tvnow();
+	loadgen.finished = ast_tv(0, 0);
+	loadgen.created = 0;
+	loadgen.failed = 0;
+	loadgen.completed = 0;
+	loadgen.frames_out = 0;
+	loadgen.frames_in = 0;
+	memset(&loadgen.setup, 0, sizeof(loadgen.setup));
+	memset(&loadgen.answer, 0, sizeof(loadgen.answer));
+	memset(&loadgen.media, 0, sizeof(loadgen.media));
+	loadgen.stop = 0;
+	ast_mutex_unlock(&loadgen_lock);
+
+	if (ast_pthread_create(&loadgen_thread, NULL, loadgen_generate, NULL)) {
+		loadgen_thread = AST_PTHREADT_NULL;
+		ast_mutex_lock(&loadgen_lock);
+		loadgen.finished = ast_tvnow();
+		ast_mutex_unlock(&loadgen_lock);
+		error = "Unable to start the generator thread";
+	}
+
+done:
+	ast_mutex_unlock(&loadgen_control_lock);
+	return error;
+}
+
+static int loadgen_hangup_cb(void *obj, void *arg, void *data, int flags)
+{
+	struct ast_channel *chan = obj;
+	int *count = arg;
+
+	if (ast_channel_tech(chan) == &loadgen_tech) {
+		ast_softhangup(chan, AST_SOFTHANGUP_EXPLICIT);
+		++*count;
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Stop creating channels and hang up those there are
+ *
+ * \return The number of channels hung up
+ */
+static int loadgen_stop(void)
+{
+	int count = 0;
+
+	ast_mutex_lock(&loadgen_control_lock);
+	if (loadgen_thread != AST_PTHREADT_NULL) {
+		ast_mutex_lock(&loadgen_lock);
+		loadgen.stop = 1;
+		ast_cond_signal(&loadgen_cond);
+		ast_mutex_unlock(&loadgen_lock);
+
+		pthread_join(loadgen_thread, NULL);
+		loadgen_thread = AST_PTHREADT_NULL;
+	}
+	ast_mutex_unlock(&loadgen_control_lock);
+
+	ast_channel_callback(loadgen_hangup_cb, &count, NULL, 0);
+	return count;
+}
+
+/*!
+ * \internal
+ * \brief Check and complete the parameters of a run
+ *
+ * \param params The parameters, given a payload on success
+ * \param codec The name of the format, or NULL for ulaw
+ *
+ * \return NULL on success, otherwise what is wrong
+ */
+static const char *loadgen_params_check(struct loadgen_params *params, const char *codec)
+{
+	struct ast_format *format;
+
+	if (!params->count) {
+		return "The number of channels must be more than 0";
+	}
+	if (!(params->rate > 0)) {
+		return "The rate must be more than 0";
+	}
+	if (!params->bridge_size && ast_strlen_zero(params->context)) {
+		return "Either a context or a bridge size is needed";
+	}
+
+	format = ast_format_cache_get(S_OR(codec, "ulaw"));
+	if (!format) {
+		return "Unknown codec";
+	}
+	params->payload = loadgen_payload_create(format);
+	ao2_ref(format, -1);
+	if (!params->payload) {
+		return "Unable to encode audio in that codec";
+	}
+	return NULL;
+}
+
+static char *handle_loadgen_start(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct loadgen_params params = { 0, };
+	const char *codec = NULL;
+	const char *error;
+	char *target;
+	char *context;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "loadgen start";
+		e->usage =
+			"Usage: loadgen start <count> <rate> {<exten>@<context>|bridge <size>}\n"
+			"                     [codec <codec>] [duration <seconds>]\n"
+			"       Create <count> synthetic channels, <rate> a second, which either\n"
+			"       run the given extension or join mixing bridges of <size>\n"
+			"       channels each. Once answered each produces a 20 ms frame of a\n"
+			"       tone in <codec>, ulaw by default, and after <seconds> hangs up.\n"
+			"       See 'loadgen show' for what they measure.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc < 5
+		|| sscanf(a->argv[2], "%30u", &params.count) != 1
+		|| sscanf(a->argv[3], "%30lf", &params.rate) != 1) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!strcasecmp(a->argv[4], "bridge")) {
+		if (a->argc < 6 || sscanf(a->argv[5], "%30u", &params.bridge_size) != 1
+			|| !params.bridge_size) {
+			return CLI_SHOWUSAGE;
+		}
+		i = 6;
+	} else {
+		target = ast_strdupa(a->argv[4]);
+		context = strchr(target, '@');
+		if (!context) {
+			return CLI_SHOWUSAGE;
+		}
+		*context++ = '\0';
+		ast_copy_string(params.exten, target, sizeof(params.exten));
+		ast_copy_string(params.context, context, sizeof(params.context));
+		i = 5;
+	}
+
+	for (; i < a->argc; i += 2) {
+		if (i + 1 == a->argc) {
+			return CLI_SHOWUSAGE;
+		} else if (!strcasecmp(a->argv[i], "codec")) {
+			codec = a->argv[i + 1];
+		} else if (!strcasecmp(a->argv[i], "duration")) {
+			if (sscanf(a->argv[i + 1], "%30u", &params.duration) != 1) {
+				return CLI_SHOWUSAGE;
+			}
+		} else {
+			return CLI_SHOWUSAGE;
+		}
+	}
+
+	if ((error = loadgen_params_check(&params, codec)) || (error = loadgen_start(&params))) {
+		ast_cli(a->fd, "%s.\n", error);
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "Creating %u channels, %.1f a second.\n", params.count, params.rate);
+	return CLI_SUCCESS;
+}
+
+static char *handle_loadgen_stop(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int count;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "loadgen stop";
+		e->usage =
+			"Usage: loadgen stop\n"
+			"       Stop creating synthetic channels, and hang up those there are.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
+	}
+
+	count = loadgen_stop();
+	ast_cli(a->fd, "Hung up %d Loadgen channel%s.\n", count, ESS(count));
+	return CLI_SUCCESS;
+}
+
+static void loadgen_show_stage(int fd, const char *name, const struct loadgen_stage *stage)
+{
+	ast_cli(fd, "%-14s %8u %12" PRId64 " %12" PRId64 " %12" PRId64 "\n", name, stage->count,
+		stage->min_us, stage->count ? stage->total_us / stage->count : 0, stage->max_us);
+}
+
+static char *handle_loadgen_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct timeval end;
+	int64_t elapsed_ms;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "loadgen show";
+		e->usage =
+			"Usage: loadgen show\n"
+			"       Show what the last run of synthetic channels measured: the\n"
+			"       rate they were created at, and how long they took to set up,\n"
+			"       to be answered and to receive their first frame of audio.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_mutex_lock(&loadgen_lock);
+	if (!loadgen.run) {
+		ast_mutex_unlock(&loadgen_lock);
+		ast_cli(a->fd, "No run has been started.\n");
+		return CLI_SUCCESS;
+	}
+
+	end = ast_tvzero(loadgen.finished) ? ast_tvnow() : loadgen.finished;
+	elapsed_ms = ast_tvdiff_ms(end, loadgen.started);
+
+	ast_cli(a->fd, "Run:            %u (%s)\n", loadgen.run,
+		ast_tvzero(loadgen.finished) ? "creating" : "finished");
+	if (loadgen.params.bridge_size) {
+		ast_cli(a->fd, "Target:         %u channels, %.1f/s, in bridges of %u\n",
+			loadgen.params.count, loadgen.params.rate, loadgen.params.bridge_size);
+	} else {
+		ast_cli(a->fd, "Target:         %u channels, %.1f/s, to %s@%s\n",
+			loadgen.params.count, loadgen.params.rate,
+			S_OR(loadgen.params.exten, "s"), loadgen.params.context);
+	}
+	ast_cli(a->fd, "Codec:          %s\n", ast_format_get_name(loadgen.params.payload->format));
+	if (loadgen.params.duration) {
+		ast_cli(a->fd, "Duration:       %u s\n", loadgen.params.duration);
+	} else {
+		ast_cli(a->fd, "Duration:       until hung up\n");
+	}
+	ast_cli(a->fd, "Created:        %u (%u failed)\n", loadgen.created, loadgen.failed);
+	ast_cli(a->fd, "Setup rate:     %.1f/s\n",
+		elapsed_ms ? loadgen.created * 1000.0 / elapsed_ms : 0.0);
+	ast_cli(a->fd, "Active:         %d (of any run)\n", loadgen_active);
+	ast_cli(a->fd, "Completed:      %u\n", loadgen.completed);
+	ast_cli(a->fd, "Frames:         %" PRIu64 " sent, %" PRIu64 " received by completed channels\n",
+		loadgen.frames_out, loadgen.frames_in);
+	ast_cli(a->fd, "\n%-14s %8s %12s %12s %12s\n", "Stage", "Count", "Min (us)", "Avg (us)", "Max (us)");
+	loadgen_show_stage(a->fd, "Setup", &loadgen.setup);
+	loadgen_show_stage(a->fd, "Answer", &loadgen.answer);
+	loadgen_show_stage(a->fd, "First media", &loadgen.media);
+	ast_mutex_unlock(&loadgen_lock);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_loadgen[] = {
+	AST_CLI_DEFINE(handle_loadgen_start, "Start creating synthetic channels"),
+	AST_CLI_DEFINE(handle_loadgen_stop, "Stop creating synthetic channels and hang them up"),
+	AST_CLI_DEFINE(handle_loadgen_show, "Show what synthetic channels measured"),
+};
+
+static int manager_loadgen_start(struct mansession *s, const struct message *m)
+{
+	struct loadgen_params params = { 0, };
+	const char *count = astman_get_header(m, "Count");
+	const char *rate = astman_get_header(m, "Rate");
+	const char *bridge_size = astman_get_header(m, "BridgeSize");
+	const char *duration = astman_get_header(m, "Duration");
+	const char *error;
+
+	if (sscanf(count, "%30u", &params.count) != 1
+		|| sscanf(rate, "%30lf", &params.rate) != 1
+		|| (!ast_strlen_zero(bridge_size) && sscanf(bridge_size, "%30u", &params.bridge_size) != 1)
+		|| (!ast_strlen_zero(duration) && sscanf(duration, "%30u", &params.duration) != 1)) {
+		astman_send_error(s, m, "Count, Rate, BridgeSize and Duration must be numbers");
+		return 0;
+	}
+	ast_copy_string(params.context, astman_get_header(m, "Context"), sizeof(params.context));
+	ast_copy_string(params.exten, astman_get_header(m, "Exten"), sizeof(params.exten));
+
+	if ((error = loadgen_params_check(&params, S_OR(astman_get_header(m, "Codec"), NULL)))
+		|| (error = loadgen_start(&params))) {
+		astman_send_error(s, m, (char *) error);
+		return 0;
+	}
+
+	astman_send_ack(s, m, "Load generation started");
+	return 0;
+}
+
+static int manager_loadgen_stop(struct mansession *s, const struct message *m)
+{
+	loadgen_stop();
+	astman_send_ack(s, m, "Load generation stopped");
+	return 0;
+}
+
+static void manager_append_stage(struct mansession *s, const char *name, const struct loadgen_stage *stage)
+{
+	astman_append(s,
+		"%sCount: %u\r\n"
+		"%sMin: %" PRId64 "\r\n"
+		"%sAvg: %" PRId64 "\r\n"
+		"%sMax: %" PRId64 "\r\n",
+		name, stage->count,
+		name, stage->min_us,
+		name, stage->count ? stage->total_us / stage->count : 0,
+		name, stage->max_us);
+}
+
+static int manager_loadgen_status(struct mansession *s, const struct message *m)
+{
+	const char *actionid = astman_get_header(m, "ActionID");
+	struct timeval end;
+	int64_t elapsed_ms;
+
+	astman_append(s, "Response: Success\r\n");
+	if (!ast_strlen_zero(actionid)) {
+		astman_append(s, "ActionID: %s\r\n", actionid);
+	}
+
+	ast_mutex_lock(&loadgen_lock);
+	end = ast_tvzero(loadgen.finished) ? ast_tvnow() : loadgen.finished;
+	elapsed_ms = loadgen.run ? ast_tvdiff_ms(end, loadgen.started) : 0;
+	astman_append(s,
+		"Run: %u\r\n"
+		"Creating: %s\r\n"
+		"Created: %u\r\n"
+		"Failed: %u\r\n"
+		"Active: %d\r\n"
+		"Completed: %u\r\n"
+		"SetupRate: %.1f\r\n"
+		"FramesSent: %" PRIu64 "\r\n"
+		"FramesReceived: %" PRIu64 "\r\n",
+		loadgen.run,
+		AST_YESNO(loadgen.run && ast_tvzero(loadgen.finished)),
+		loadgen.created,
+		loadgen.failed,
+		loadgen_active,
+		loadgen.completed,
+		elapsed_ms ? loadgen.created * 1000.0 / elapsed_ms : 0.0,
+		loadgen.frames_out,
+		loadgen.frames_in);
+	manager_append_stage(s, "Setup", &loadgen.setup);
+	manager_append_stage(s, "Answer", &loadgen.answer);
+	manager_append_stage(s, "Media", &loadgen.media);
+	ast_mutex_unlock(&loadgen_lock);
+
+	astman_append(s, "\r\n");
+	return 0;
+}
+
+static int unload_module(void)
+{
+	int i;
+
+	ast_manager_unregister("LoadgenStart");
+	ast_manager_unregister("LoadgenStop");
+	ast_manager_unregister("LoadgenStatus");
+	ast_cli_unregister_multiple(cli_loadgen, ARRAY_LEN(cli_loadgen));
+
+	loadgen_stop();
+	/* Give the channels hung up a few seconds to go */
+	for (i = 0; i < 500 && loadgen_active; ++i) {
+		usleep(10000);
+	}
+	if (loadgen_active) {
+		ast_log(LOG_WARNING, "%d Loadgen channels remain, unable to unload\n", loadgen_active);
+		return -1;
+	}
+
+	ast_channel_unregister(&loadgen_tech);
+	ao2_cleanup(loadgen_tech.capabilities);
+	loadgen_tech.capabilities = NULL;
+
+	loadgen_payload_destroy(loadgen.params.payload);
+	loadgen.params.payload = NULL;
+	ast_cond_destroy(&loadgen_cond);
+
+	return 0;
+}
+
+static int load_module(void)
+{
+	ast_cond_init(&loadgen_cond, NULL);
+
+	if (!(loadgen_tech.capabilities = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_format_cap_append_by_type(loadgen_tech.capabilities, AST_MEDIA_TYPE_AUDIO);
+	if (ast_channel_register(&loadgen_tech)) {
+		ast_log(LOG_ERROR, "Unable to register channel class 'Loadgen'\n");
+		ao2_cleanup(loadgen_tech.capabilities);
+		loadgen_tech.capabilities = NULL;
+		ast_cond_destroy(&loadgen_cond);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	ast_cli_register_multiple(cli_loadgen, ARRAY_LEN(cli_loadgen));
+	ast_manager_register_xml("LoadgenStart", EVENT_FLAG_SYSTEM, manager_loadgen_start);
+	ast_manager_register_xml("LoadgenStop", EVENT_FLAG_SYSTEM, manager_loadgen_stop);
+	ast_manager_register_xml("LoadgenStatus", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING, manager_loadgen_status);
+
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_LOAD_ORDER, "Synthetic Load Generator Channel",
+	.support_level = AST_MODULE_SUPPORT_EXTENDED,
+	.load = load_module,
+	.unload = unload_module,
+	.load_pri = AST_MODPRI_CHANNEL_DRIVER,
+);
@@ -380,6 +380,7 @@ static struct ast_channel *chan_pjsip_new(struct ast_sip_session *session, int s
 {
 	struct ast_channel *chan;
 	struct ast_format_cap *caps;
+	struct ast_format_cap *interned;
 	RAII_VAR(struct chan_pjsip_pvt *, pvt, NULL, ao2_cleanup);
 	struct ast_sip_channel_pvt *channel;
 	struct ast_variable *var;
@@ -426,7 +427,10 @@ static struct ast_channel *chan_pjsip_new(struct ast_sip_session *session, int s
 		ast_format_cap_append_from_cap(caps, session->req_caps, AST_MEDIA_TYPE_UNKNOWN);
 	}
 
-	ast_channel_nativeformats_set(chan, caps);
+	/* Interned formats let bridging remember the joint formats of the pair. */
+	interned = ast_format_cap_intern(caps);
+	ast_channel_nativeformats_set(chan, interned ?: caps);
+	ao2_cleanup(interned);
 
 	if (!ast_format_cap_empty(caps)) {
 		struct ast_format *fmt;
@@ -2179,6 +2183,7 @@ static int chan_pjsip_incoming_request(struct ast_sip_session *session, struct p
 		ast_log(LOG_ERROR, "Failed to allocate new PJSIP channel on incoming SIP INVITE\n");
 		return -1;
 	}
+	ast_channel_setup_times_merge(session->channel, &session->setup_times);
 	/* channel gets created on incoming request, but we wait to call start
            so other supplements have a chance to run */
 	return 0;
@@ -128,6 +128,8 @@ static struct ast_channel *multicast_rtp_request(const char *type, struct ast_fo
 	struct ast_channel *chan;
 	struct ast_format_cap *caps = NULL;
 	struct ast_format *fmt = NULL;
+	char *fanout;
+	char *further;
 	AST_DECLARE_APP_ARGS(args,
 		AST_APP_ARG(type);
 		AST_APP_ARG(destination);
@@ -151,6 +153,10 @@ static struct ast_channel *multicast_rtp_request(const char *type, struct ast_fo
 		goto failure;
 	}
 
+	/* Further destinations, separated by '+', are sent the same packets */
+	fanout = args.destination;
+	args.destination = strsep(&fanout, "+");
+
 	if (!ast_sockaddr_parse(&destination_address, args.destination,
 				PARSE_PORT_REQUIRE)) {
 		ast_log(LOG_ERROR, "Destination address '%s' could not be parsed\n", args.destination);
@@ -173,6 +179,14 @@ static struct ast_channel *multicast_rtp_request(const char *type, struct ast_fo
 	}
 	ast_rtp_instance_set_channel_id(instance, ast_channel_uniqueid(chan));
 	ast_rtp_instance_set_remote_address(instance, &destination_address);
+	while ((further = strsep(&fanout, "+"))) {
+		if (!ast_sockaddr_parse(&destination_address, further, PARSE_PORT_REQUIRE)) {
+			ast_log(LOG_WARNING, "Destination address '%s' could not be parsed\n", further);
+			continue;
+		}
+		ast_rtp_instance_set_extended_prop(instance, AST_RTP_MULTICAST_PROPERTY_FANOUT_ADDRESS,
+			&destination_address);
+	}
 
 	ast_channel_tech_set(chan, &multicast_rtp_tech);
 
@@ -285,6 +285,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/features_config.h"
 #include "asterisk/http_websocket.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
 
 /*** DOCUMENTATION
 	<application name="SIPDtmfMode" language="en_US">
@@ -853,6 +855,16 @@ static enum channelreloadreason sip_reloadreason;       /*!< Reason for last rel
 struct ast_sched_context *sched;     /*!< The scheduling context */
 static struct io_context *io;           /*!< The IO context */
 static int *sipsock_read_id;            /*!< ID of IO entry for sipsock FD */
+
+static int udp_workers = DEFAULT_UDP_WORKERS;   /*!< Threads processing UDP messages, 0 to process them in the monitor thread */
+/*! \brief Threads processing received UDP messages */
+static struct ast_threadpool *udp_pool;
+/*! \brief Serializers of the UDP threads, a Call-ID always uses the same one */
+static struct ast_taskprocessor **udp_serializers;
+/*! \brief Number of UDP serializers */
+static unsigned int udp_serializer_count;
+/*! \brief Shutdown group of the UDP serializers */
+static struct ast_serializer_shutdown_group *udp_shutdown_group;
 struct sip_pkt;
 static AST_LIST_HEAD_STATIC(domain_list, domain);    /*!< The SIP domain list */
 
@@ -21048,6 +21060,7 @@ static char *sip_show_settings(struct ast_cli_entry *e, int cmd, struct ast_cli_
 	ast_cli(a->fd, "\n\nGlobal Settings:\n");
 	ast_cli(a->fd, "----------------\n");
 	ast_cli(a->fd, "  UDP Bindaddress:        %s\n", ast_sockaddr_stringify(&bindaddr));
+	ast_cli(a->fd, "  UDP Worker Threads:     %u\n", udp_serializer_count);
 	if (ast_sockaddr_is_ipv6(&bindaddr) && ast_sockaddr_is_any(&bindaddr)) {
 		ast_cli(a->fd, "  ** Additional Info:\n");
 		ast_cli(a->fd, "     [::] may include IPv4 in addition to IPv6, if such a feature is enabled in the OS.\n");
@@ -28291,6 +28304,96 @@ static int handle_incoming(struct sip_pvt *p, struct sip_request *req, struct as
 	return res;
 }
 
+/*! \brief A received UDP message waiting for a UDP thread */
+struct sip_udp_packet {
+	struct sip_request req;
+	struct ast_sockaddr addr;
+};
+
+/*! \brief Process a received UDP message on a UDP thread */
+static int sip_udp_packet_task(void *data)
+{
+	struct sip_udp_packet *packet = data;
+
+	handle_request_do(&packet->req, &packet->addr);
+	deinit_req(&packet->req);
+	ast_free(packet);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Hash the Call-ID header of a message that has not been parsed
+ *
+ * \param buf The message
+ *
+ * \return The hash of the Call-ID, or 0 if there is none
+ */
+static unsigned int sip_udp_callid_hash(const char *buf)
+{
+	const char *line = strchr(buf, '\n');
+
+	/* Only the headers are looked at, they end at the first empty line */
+	while (line && *++line && *line != '\r' && *line != '\n') {
+		const char *value = NULL;
+
+		if (!strncasecmp(line, "Call-ID", 7)) {
+			value = line + 7;
+		} else if (*line == 'i' || *line == 'I') {
+			value = line + 1;
+		}
+		if (value) {
+			while (*value == ' ' || *value == '\t') {
+				value++;
+			}
+		}
+		if (value && *value == ':') {
+			unsigned int hash = 0;
+
+			for (value++; *value == ' ' || *value == '\t'; value++) {
+			}
+			for (; *value && *value != '\r' && *value != '\n'; value++) {
+				hash = hash * 33 ^ (unsigned char) *value;
+			}
+			return hash;
+		}
+		line = strchr(line, '\n');
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Hand a received UDP message to a UDP thread
+ *
+ * Messages with the same Call-ID always go to the same thread, so those of a
+ * dialog are processed in the order they were received while other dialogs
+ * are processed in parallel.
+ *
+ * \note The request is taken over, whether or not it could be queued.
+ */
+static void sip_udp_queue_request(struct sip_request *req, struct ast_sockaddr *addr)
+{
+	struct sip_udp_packet *packet;
+	struct ast_taskprocessor *serializer;
+
+	if (!(packet = ast_calloc(1, sizeof(*packet)))) {
+		deinit_req(req);
+		return;
+	}
+
+	packet->req = *req;
+	ast_sockaddr_copy(&packet->addr, addr);
+
+	serializer = udp_serializers[sip_udp_callid_hash(ast_str_buffer(req->data)) % udp_serializer_count];
+	if (ast_taskprocessor_push(serializer, sip_udp_packet_task, packet)) {
+		deinit_req(&packet->req);
+		ast_free(packet);
+	}
+}
+
 /*! \brief Read data from SIP UDP socket
 \note sipsock_read locks the owner channel while we are processing the SIP message
 \return 1 on error, 0 on success
@@ -28331,6 +28434,11 @@ static int sipsock_read(int *id, int fd, short events, void *ignore)
 	req.socket.tcptls_session	= NULL;
 	req.socket.port = htons(ast_sockaddr_port(&bindaddr));
 
+	if (udp_serializer_count) {
+		sip_udp_queue_request(&req, &addr);
+		return 1;
+	}
+
 	handle_request_do(&req, &addr);
 	deinit_req(&req);
 
@@ -28347,6 +28455,8 @@ static int handle_request_do(struct sip_request *req, struct ast_sockaddr *addr)
 	struct ast_channel *owner_chan_ref = NULL;
 	int recount = 0;
 	int nounlock = 0;
+	/* With UDP threads the netlock only serializes finding or creating the dialog */
+	int serialized = !udp_serializer_count;
 
 	if (sip_debug_test_addr(addr))	/* Set the debug flag early on packet level */
 		req->debug = 1;
@@ -28379,6 +28489,9 @@ static int handle_request_do(struct sip_request *req, struct ast_sockaddr *addr)
 		ast_mutex_unlock(&netlock);
 		return 1;
 	}
+	if (!serialized) {
+		ast_mutex_unlock(&netlock);
+	}
 
 	if (p->logger_callid) {
 		ast_callid_threadassoc_add(p->logger_callid);
@@ -28416,7 +28529,9 @@ static int handle_request_do(struct sip_request *req, struct ast_sockaddr *addr)
 		ast_channel_unref(owner_chan_ref);
 	}
 	sip_pvt_unlock(p);
-	ast_mutex_unlock(&netlock);
+	if (serialized) {
+		ast_mutex_unlock(&netlock);
+	}
 
 	if (p->logger_callid) {
 		ast_callid_threadassoc_remove();
@@ -31560,6 +31675,7 @@ static int reload_config(enum channelreloadreason reason)
 	global_refer_addheaders = TRUE;
 	authlimit = DEFAULT_AUTHLIMIT;
 	authtimeout = DEFAULT_AUTHTIMEOUT;
+	udp_workers = DEFAULT_UDP_WORKERS;
 	global_store_sip_cause = DEFAULT_STORE_SIP_CAUSE;
 	min_expiry = DEFAULT_MIN_EXPIRY;
 	max_expiry = DEFAULT_MAX_EXPIRY;
@@ -31872,6 +31988,12 @@ static int reload_config(enum channelreloadreason reason)
 				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of %s\n",
 					v->name, v->value, v->lineno, config);
 			}
+		} else if (!strcasecmp(v->name, "udpworkers")) {
+			if (ast_parse_arg(v->value, PARSE_INT32|PARSE_DEFAULT|PARSE_IN_RANGE,
+					  &udp_workers, DEFAULT_UDP_WORKERS, 0, MAX_UDP_WORKERS)) {
+				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of %s\n",
+					v->name, v->value, v->lineno, config);
+			}
 		} else if (!strcasecmp(v->name, "sipdebug")) {
 			if (ast_true(v->value))
 				sipdebug |= sip_debug_config;
@@ -32943,6 +33065,7 @@ static int sip_removeheader(struct ast_channel *chan, const char *data)
 		}
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
+	ast_channel_varshead_changed(chan);
 
 	ast_channel_unlock(chan);
 	return 0;
@@ -34492,6 +34615,77 @@ static const struct ast_sip_api_tech chan_sip_api_provider = {
 	.sipinfo_send = sipinfo_send,
 };
 
+/*! \brief Stop the threads processing received UDP messages, once they have processed those queued */
+static void udp_workers_stop(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < udp_serializer_count; ++i) {
+		ast_taskprocessor_unreference(udp_serializers[i]);
+	}
+	ast_free(udp_serializers);
+	udp_serializers = NULL;
+	udp_serializer_count = 0;
+
+	if (udp_shutdown_group) {
+		if (ast_serializer_shutdown_group_join(udp_shutdown_group, 15)) {
+			ast_log(LOG_WARNING, "Timed out waiting for the SIP UDP threads to finish\n");
+		}
+		ao2_ref(udp_shutdown_group, -1);
+		udp_shutdown_group = NULL;
+	}
+
+	ast_threadpool_shutdown(udp_pool);
+	udp_pool = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start the threads processing received UDP messages
+ *
+ * Without them every UDP message is processed in the monitor thread.
+ */
+static int udp_workers_start(void)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = udp_workers,
+		.max_size = udp_workers,
+	};
+	struct ast_taskprocessor **serializers;
+	char name[32];
+	int i;
+
+	if (!udp_workers) {
+		return 0;
+	}
+
+	if (!(udp_pool = ast_threadpool_create("sip-udp", NULL, &options))
+		|| !(udp_shutdown_group = ast_serializer_shutdown_group_alloc())
+		|| !(serializers = ast_calloc(udp_workers, sizeof(*serializers)))) {
+		udp_workers_stop();
+		return -1;
+	}
+
+	for (i = 0; i < udp_workers; ++i) {
+		snprintf(name, sizeof(name), "sip-udp-%d", i);
+		if (!(serializers[i] = ast_threadpool_serializer_group(name, udp_pool, udp_shutdown_group))) {
+			udp_serializers = serializers;
+			udp_serializer_count = i;
+			udp_workers_stop();
+			return -1;
+		}
+	}
+
+	/* The monitor thread is not running yet, so it sees the serializers once they all exist */
+	udp_serializers = serializers;
+	udp_serializer_count = udp_workers;
+
+	return 0;
+}
+
 static int unload_module(void);
 
 /*!
@@ -34570,6 +34764,12 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	if (udp_workers_start()) {
+		ast_log(LOG_ERROR, "Unable to start the SIP UDP threads\n");
+		unload_module();
+		return AST_MODULE_LOAD_FAILURE;
+	}
+
 	/* Initialize bogus peer. Can be done first after reload_config() */
 	if (!(bogus_peer = temp_peer("(bogus_peer)"))) {
 		ast_log(LOG_ERROR, "Unable to create bogus_peer for authentication\n");
@@ -34799,6 +34999,9 @@ static int unload_module(void)
 		ast_mutex_unlock(&monlock);
 	}
 
+	/* No more UDP messages are received, let those already queued finish */
+	udp_workers_stop();
+
 	/* Destroy all the dialogs and free their memory */
 	i = ao2_iterator_init(dialogs, 0);
 	while ((p = ao2_t_iterator_next(&i, "iterate thru dialogs"))) {
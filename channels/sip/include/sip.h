@@ -69,6 +69,9 @@
 #define DEFAULT_AUTHLIMIT            100
 #define DEFAULT_AUTHTIMEOUT          30
 
+#define DEFAULT_UDP_WORKERS          0    /*!< Threads processing UDP messages, 0 for the monitor thread */
+#define MAX_UDP_WORKERS              64
+
 /* guard limit must be larger than guard secs */
 /* guard min must be < 1000, and should be >= 250 */
 #define EXPIRY_GUARD_SECS    15   /*!< How long before expiry do we reregister */
@@ -40,6 +40,9 @@ ASTERISK_REGISTER_FILE()
 
 #define OUTBUF_SAMPLES   11520
 
+/*! \brief Resampler quality used unless a path asks for another */
+#define RESAMPLER_QUALITY 5
+
 static struct ast_translator *translators;
 static int trans_size;
 static struct ast_codec codec_list[] = {
@@ -94,7 +97,7 @@ static int resamp_new(struct ast_trans_pvt *pvt)
 {
 	int err;
 
-	if (!(pvt->pvt = speex_resampler_init(1, pvt->t->src_codec.sample_rate, pvt->t->dst_codec.sample_rate, 5, &err))) {
+	if (!(pvt->pvt = speex_resampler_init(1, pvt->t->src_codec.sample_rate, pvt->t->dst_codec.sample_rate, RESAMPLER_QUALITY, &err))) {
 		return -1;
 	}
 
@@ -111,6 +114,28 @@ static void resamp_destroy(struct ast_trans_pvt *pvt)
 	speex_resampler_destroy(resamp_pvt);
 }
 
+static int resamp_set_quality(struct ast_trans_pvt *pvt, unsigned int quality)
+{
+	SpeexResamplerState *resamp_pvt = pvt->pvt;
+	int current;
+
+	speex_resampler_get_quality(resamp_pvt, &current);
+	if (current == (int) quality) {
+		return 0;
+	}
+
+	return speex_resampler_set_quality(resamp_pvt, quality) == RESAMPLER_ERR_SUCCESS ? 0 : -1;
+}
+
+static int resamp_reset(struct ast_trans_pvt *pvt)
+{
+	SpeexResamplerState *resamp_pvt = pvt->pvt;
+
+	speex_resampler_reset_mem(resamp_pvt);
+
+	return resamp_set_quality(pvt, RESAMPLER_QUALITY);
+}
+
 static int resamp_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 {
 	SpeexResamplerState *resamp_pvt = pvt->pvt;
@@ -165,6 +190,9 @@ static int load_module(void)
 			}
 			translators[idx].newpvt = resamp_new;
 			translators[idx].destroy = resamp_destroy;
+			translators[idx].reset = resamp_reset;
+			translators[idx].set_quality = resamp_set_quality;
+			translators[idx].track_usage = 1;
 			translators[idx].framein = resamp_framein;
 			translators[idx].desc_size = 0;
 			translators[idx].buffer_samples = OUTBUF_SAMPLES;
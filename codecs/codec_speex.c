@@ -84,6 +84,9 @@ static float pp_dereverb_level = 0.3;
 #define	BUFFER_SAMPLES	8000
 #define	SPEEX_SAMPLES	160
 
+/*! \brief Bumped on each configuration load, so coders built with old settings are not reused */
+static int config_generation;
+
 /* Sample frame data */
 #include "asterisk/slin.h"
 #include "ex_speex.h"
@@ -93,6 +96,7 @@ struct speex_coder_pvt {
 	SpeexBits bits;
 	int framesize;
 	int silent_state;
+	int generation;		/* config_generation the coder was built with */
 #ifdef _SPEEX_TYPES_H
 	SpeexPreprocessState *pp;
 	spx_int16_t buf[BUFFER_SAMPLES];
@@ -138,6 +142,7 @@ static int speex_encoder_construct(struct ast_trans_pvt *pvt, const SpeexMode *p
 	if (dtx)
 		speex_encoder_ctl(tmp->speex, SPEEX_SET_DTX, &dtx); 
 	tmp->silent_state = 0;
+	tmp->generation = config_generation;
 
 	return 0;
 }
@@ -168,6 +173,7 @@ static int speex_decoder_construct(struct ast_trans_pvt *pvt, const SpeexMode *p
 	speex_decoder_ctl(tmp->speex, SPEEX_GET_FRAME_SIZE, &tmp->framesize);
 	if (enhancement)
 		speex_decoder_ctl(tmp->speex, SPEEX_SET_ENH, &enhancement);
+	tmp->generation = config_generation;
 
 	return 0;
 }
@@ -363,6 +369,41 @@ static void lintospeex_destroy(struct ast_trans_pvt *arg)
 	speex_bits_destroy(&pvt->bits);
 }
 
+/*! \brief Clear a coder's history so another call can use it, keeping its settings */
+static int speex_coder_reset(struct ast_trans_pvt *arg, int encoder)
+{
+	struct speex_coder_pvt *pvt = arg->pvt;
+
+	if (pvt->generation != config_generation) {
+		return -1;
+	}
+#ifdef _SPEEX_TYPES_H
+	/* The preprocessor's noise estimate cannot be reset */
+	if (pvt->pp) {
+		return -1;
+	}
+#endif
+	if (encoder) {
+		speex_encoder_ctl(pvt->speex, SPEEX_RESET_STATE, NULL);
+	} else {
+		speex_decoder_ctl(pvt->speex, SPEEX_RESET_STATE, NULL);
+	}
+	speex_bits_reset(&pvt->bits);
+	pvt->silent_state = 0;
+
+	return 0;
+}
+
+static int speextolin_reset(struct ast_trans_pvt *arg)
+{
+	return speex_coder_reset(arg, 0);
+}
+
+static int lintospeex_reset(struct ast_trans_pvt *arg)
+{
+	return speex_coder_reset(arg, 1);
+}
+
 static struct ast_translator speextolin = {
 	.name = "speextolin",
 	.src_codec = {
@@ -379,6 +420,7 @@ static struct ast_translator speextolin = {
 	.newpvt = speextolin_new,
 	.framein = speextolin_framein,
 	.destroy = speextolin_destroy,
+	.reset = speextolin_reset,
 	.sample = speex_sample,
 	.desc_size = sizeof(struct speex_coder_pvt),
 	.buffer_samples = BUFFER_SAMPLES,
@@ -403,6 +445,7 @@ static struct ast_translator lintospeex = {
 	.framein = lintospeex_framein,
 	.frameout = lintospeex_frameout,
 	.destroy = lintospeex_destroy,
+	.reset = lintospeex_reset,
 	.sample = slin8_sample,
 	.desc_size = sizeof(struct speex_coder_pvt),
 	.buffer_samples = BUFFER_SAMPLES,
@@ -425,6 +468,7 @@ static struct ast_translator speexwbtolin16 = {
 	.newpvt = speexwbtolin16_new,
 	.framein = speextolin_framein,
 	.destroy = speextolin_destroy,
+	.reset = speextolin_reset,
 	.sample = speex16_sample,
 	.desc_size = sizeof(struct speex_coder_pvt),
 	.buffer_samples = BUFFER_SAMPLES,
@@ -449,6 +493,7 @@ static struct ast_translator lin16tospeexwb = {
 	.framein = lintospeex_framein,
 	.frameout = lintospeex_frameout,
 	.destroy = lintospeex_destroy,
+	.reset = lintospeex_reset,
 	.sample = slin16_sample,
 	.desc_size = sizeof(struct speex_coder_pvt),
 	.buffer_samples = BUFFER_SAMPLES,
@@ -471,6 +516,7 @@ static struct ast_translator speexuwbtolin32 = {
 	.newpvt = speexuwbtolin32_new,
 	.framein = speextolin_framein,
 	.destroy = speextolin_destroy,
+	.reset = speextolin_reset,
 	.desc_size = sizeof(struct speex_coder_pvt),
 	.buffer_samples = BUFFER_SAMPLES,
 	.buf_size = BUFFER_SAMPLES * 2,
@@ -494,6 +540,7 @@ static struct ast_translator lin32tospeexuwb = {
 	.framein = lintospeex_framein,
 	.frameout = lintospeex_frameout,
 	.destroy = lintospeex_destroy,
+	.reset = lintospeex_reset,
 	.desc_size = sizeof(struct speex_coder_pvt),
 	.buffer_samples = BUFFER_SAMPLES,
 	.buf_size = BUFFER_SAMPLES * 2, /* XXX maybe a lot less ? */
@@ -591,6 +638,7 @@ static int parse_config(int reload)
 		}
 	}
 	ast_config_destroy(cfg);
+	config_generation++;
 	return 0;
 }
 
@@ -36,6 +36,7 @@
 #endif
 
 #include "g722.h"
+#include "g722_qmf.h"
 
 #if !defined(FALSE)
 #define FALSE 0
@@ -183,7 +184,31 @@ int g722_decode_release(g722_decode_state_t *s)
 }
 /*- End of function --------------------------------------------------------*/
 
-int g722_decode(g722_decode_state_t *s, int16_t amp[], const uint8_t g722_data[], int len)
+static __inline__ int next_code(g722_decode_state_t *s, const uint8_t g722_data[], int *j)
+{
+    int code;
+
+    if (s->packed)
+    {
+        /* Unpack the code bits */
+        if (s->in_bits < s->bits_per_sample)
+        {
+            s->in_buffer |= (g722_data[(*j)++] << s->in_bits);
+            s->in_bits += 8;
+        }
+        code = s->in_buffer & ((1 << s->bits_per_sample) - 1);
+        s->in_buffer >>= s->bits_per_sample;
+        s->in_bits -= s->bits_per_sample;
+    }
+    else
+    {
+        code = g722_data[(*j)++];
+    }
+    return code;
+}
+/*- End of function --------------------------------------------------------*/
+
+static __inline__ void decode_code(g722_decode_state_t *s, int code, int *rlow_out, int *rhigh_out)
 {
     static const int wl[8] = {-60, -30, 58, 172, 334, 538, 1198, 3042 };
     static const int rl42[16] = {0, 7, 6, 5, 4, 3, 2, 1, 7, 6, 5, 4, 3,  2, 1, 0 };
@@ -235,161 +260,153 @@ int g722_decode(g722_decode_state_t *s, int16_t amp[], const uint8_t g722_data[]
            1688,   1360,   1040,    728,
             432,    136,   -432,   -136
     };
-    static const int qmf_coeffs[12] =
-    {
-           3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
-    };
 
     int dlowt;
     int rlow;
     int ihigh;
     int dhigh;
     int rhigh;
-    int xout1;
-    int xout2;
     int wd1;
     int wd2;
     int wd3;
-    int code;
-    int outlen;
-    int i;
-    int j;
 
-    outlen = 0;
     rhigh = 0;
-    for (j = 0;  j < len;  )
+    switch (s->bits_per_sample)
     {
-        if (s->packed)
-        {
-            /* Unpack the code bits */
-            if (s->in_bits < s->bits_per_sample)
-            {
-                s->in_buffer |= (g722_data[j++] << s->in_bits);
-                s->in_bits += 8;
-            }
-            code = s->in_buffer & ((1 << s->bits_per_sample) - 1);
-            s->in_buffer >>= s->bits_per_sample;
-            s->in_bits -= s->bits_per_sample;
-        }
-        else
-        {
-            code = g722_data[j++];
-        }
-
-        switch (s->bits_per_sample)
-        {
-        default:
-        case 8:
-            wd1 = code & 0x3F;
-            ihigh = (code >> 6) & 0x03;
-            wd2 = qm6[wd1];
-            wd1 >>= 2;
-            break;
-        case 7:
-            wd1 = code & 0x1F;
-            ihigh = (code >> 5) & 0x03;
-            wd2 = qm5[wd1];
-            wd1 >>= 1;
-            break;
-        case 6:
-            wd1 = code & 0x0F;
-            ihigh = (code >> 4) & 0x03;
-            wd2 = qm4[wd1];
-            break;
-        }
-        /* Block 5L, LOW BAND INVQBL */
-        wd2 = (s->band[0].det*wd2) >> 15;
-        /* Block 5L, RECONS */
-        rlow = s->band[0].s + wd2;
-        /* Block 6L, LIMIT */
-        if (rlow > 16383)
-            rlow = 16383;
-        else if (rlow < -16384)
-            rlow = -16384;
-
-        /* Block 2L, INVQAL */
+    default:
+    case 8:
+        wd1 = code & 0x3F;
+        ihigh = (code >> 6) & 0x03;
+        wd2 = qm6[wd1];
+        wd1 >>= 2;
+        break;
+    case 7:
+        wd1 = code & 0x1F;
+        ihigh = (code >> 5) & 0x03;
+        wd2 = qm5[wd1];
+        wd1 >>= 1;
+        break;
+    case 6:
+        wd1 = code & 0x0F;
+        ihigh = (code >> 4) & 0x03;
         wd2 = qm4[wd1];
-        dlowt = (s->band[0].det*wd2) >> 15;
+        break;
+    }
+    /* Block 5L, LOW BAND INVQBL */
+    wd2 = (s->band[0].det*wd2) >> 15;
+    /* Block 5L, RECONS */
+    rlow = s->band[0].s + wd2;
+    /* Block 6L, LIMIT */
+    if (rlow > 16383)
+        rlow = 16383;
+    else if (rlow < -16384)
+        rlow = -16384;
+
+    /* Block 2L, INVQAL */
+    wd2 = qm4[wd1];
+    dlowt = (s->band[0].det*wd2) >> 15;
+
+    /* Block 3L, LOGSCL */
+    wd2 = rl42[wd1];
+    wd1 = (s->band[0].nb*127) >> 7;
+    wd1 += wl[wd2];
+    if (wd1 < 0)
+        wd1 = 0;
+    else if (wd1 > 18432)
+        wd1 = 18432;
+    s->band[0].nb = wd1;
+        
+    /* Block 3L, SCALEL */
+    wd1 = (s->band[0].nb >> 6) & 31;
+    wd2 = 8 - (s->band[0].nb >> 11);
+    wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
+    s->band[0].det = wd3 << 2;
 
-        /* Block 3L, LOGSCL */
-        wd2 = rl42[wd1];
-        wd1 = (s->band[0].nb*127) >> 7;
-        wd1 += wl[wd2];
+    block4(s, 0, dlowt);
+    
+    if (!s->eight_k)
+    {
+        /* Block 2H, INVQAH */
+        wd2 = qm2[ihigh];
+        dhigh = (s->band[1].det*wd2) >> 15;
+        /* Block 5H, RECONS */
+        rhigh = dhigh + s->band[1].s;
+        /* Block 6H, LIMIT */
+        if (rhigh > 16383)
+            rhigh = 16383;
+        else if (rhigh < -16384)
+            rhigh = -16384;
+
+        /* Block 2H, INVQAH */
+        wd2 = rh2[ihigh];
+        wd1 = (s->band[1].nb*127) >> 7;
+        wd1 += wh[wd2];
         if (wd1 < 0)
             wd1 = 0;
-        else if (wd1 > 18432)
-            wd1 = 18432;
-        s->band[0].nb = wd1;
-            
-        /* Block 3L, SCALEL */
-        wd1 = (s->band[0].nb >> 6) & 31;
-        wd2 = 8 - (s->band[0].nb >> 11);
+        else if (wd1 > 22528)
+            wd1 = 22528;
+        s->band[1].nb = wd1;
+        
+        /* Block 3H, SCALEH */
+        wd1 = (s->band[1].nb >> 6) & 31;
+        wd2 = 10 - (s->band[1].nb >> 11);
         wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-        s->band[0].det = wd3 << 2;
+        s->band[1].det = wd3 << 2;
 
-        block4(s, 0, dlowt);
-        
-        if (!s->eight_k)
+        block4(s, 1, dhigh);
+    }
+    *rlow_out = rlow;
+    *rhigh_out = rhigh;
+}
+/*- End of function --------------------------------------------------------*/
+
+int g722_decode(g722_decode_state_t *s, int16_t amp[], const uint8_t g722_data[], int len)
+{
+    /* History and new samples for the QMF */
+    int16_t x[G722_QMF_TAPS - 2 + 2*G722_QMF_BLOCK];
+    int32_t xout1[G722_QMF_BLOCK];
+    int32_t xout2[G722_QMF_BLOCK];
+    int rlow;
+    int rhigh;
+    int outlen;
+    int pairs;
+    int i;
+    int j;
+
+    outlen = 0;
+    if (s->itu_test_mode  ||  s->eight_k)
+    {
+        for (j = 0;  j < len;  )
         {
-            /* Block 2H, INVQAH */
-            wd2 = qm2[ihigh];
-            dhigh = (s->band[1].det*wd2) >> 15;
-            /* Block 5H, RECONS */
-            rhigh = dhigh + s->band[1].s;
-            /* Block 6H, LIMIT */
-            if (rhigh > 16383)
-                rhigh = 16383;
-            else if (rhigh < -16384)
-                rhigh = -16384;
-
-            /* Block 2H, INVQAH */
-            wd2 = rh2[ihigh];
-            wd1 = (s->band[1].nb*127) >> 7;
-            wd1 += wh[wd2];
-            if (wd1 < 0)
-                wd1 = 0;
-            else if (wd1 > 22528)
-                wd1 = 22528;
-            s->band[1].nb = wd1;
-            
-            /* Block 3H, SCALEH */
-            wd1 = (s->band[1].nb >> 6) & 31;
-            wd2 = 10 - (s->band[1].nb >> 11);
-            wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-            s->band[1].det = wd3 << 2;
-
-            block4(s, 1, dhigh);
+            decode_code(s, next_code(s, g722_data, &j), &rlow, &rhigh);
+            amp[outlen++] = (int16_t) (rlow << 1);
+            if (s->itu_test_mode)
+                amp[outlen++] = (int16_t) (rhigh << 1);
         }
+        return outlen;
+    }
 
-        if (s->itu_test_mode)
+    /* Run the ADPCM over a block of codes, which is recursive so it stays
+       per sample, then apply the receive QMF to the whole block */
+    for (j = 0;  j < len;  )
+    {
+        for (i = 0;  i < G722_QMF_TAPS - 2;  i++)
+            x[i] = (int16_t) s->x[i + 2];
+        for (pairs = 0;  pairs < G722_QMF_BLOCK  &&  j < len;  pairs++)
         {
-            amp[outlen++] = (int16_t) (rlow << 1);
-            amp[outlen++] = (int16_t) (rhigh << 1);
+            decode_code(s, next_code(s, g722_data, &j), &rlow, &rhigh);
+            /* Both fit in 16 bits, as each band is limited to 15 bits */
+            x[G722_QMF_TAPS - 2 + 2*pairs] = (int16_t) (rlow + rhigh);
+            x[G722_QMF_TAPS - 1 + 2*pairs] = (int16_t) (rlow - rhigh);
         }
-        else
+        g722_qmf_block(x, pairs, xout2, xout1);
+        for (i = 0;  i < G722_QMF_TAPS;  i++)
+            s->x[i] = x[2*pairs - 2 + i];
+
+        for (i = 0;  i < pairs;  i++)
         {
-            if (s->eight_k)
-            {
-                amp[outlen++] = (int16_t) (rlow << 1);
-            }
-            else
-            {
-                /* Apply the receive QMF */
-                for (i = 0;  i < 22;  i++)
-                    s->x[i] = s->x[i + 2];
-                s->x[22] = rlow + rhigh;
-                s->x[23] = rlow - rhigh;
-
-                xout1 = 0;
-                xout2 = 0;
-                for (i = 0;  i < 12;  i++)
-                {
-                    xout2 += s->x[2*i]*qmf_coeffs[i];
-                    xout1 += s->x[2*i + 1]*qmf_coeffs[11 - i];
-                }
-                amp[outlen++] = (int16_t) (xout1 >> 11);
-                amp[outlen++] = (int16_t) (xout2 >> 11);
-            }
+            amp[outlen++] = (int16_t) (xout1[i] >> 11);
+            amp[outlen++] = (int16_t) (xout2[i] >> 11);
         }
     }
     return outlen;
@@ -38,6 +38,7 @@
 #endif
 
 #include "g722.h"
+#include "g722_qmf.h"
 
 #if !defined(FALSE)
 #define FALSE 0
@@ -182,7 +183,7 @@ int g722_encode_release(g722_encode_state_t *s)
 }
 /*- End of function --------------------------------------------------------*/
 
-int g722_encode(g722_encode_state_t *s, uint8_t g722_data[], const int16_t amp[], int len)
+static __inline__ int encode_pair(g722_encode_state_t *s, int xlow, int xhigh)
 {
     static const int q6[32] =
     {
@@ -232,10 +233,6 @@ int g722_encode(g722_encode_state_t *s, uint8_t g722_data[], const int16_t amp[]
     {
         -7408,  -1616,   7408,   1616
     };
-    static const int qmf_coeffs[12] =
-    {
-           3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
-    };
     static const int ihn[3] = {0, 1, 0};
     static const int ihp[3] = {0, 3, 2};
     static const int wh[3] = {0, -214, 798};
@@ -254,144 +251,160 @@ int g722_encode(g722_encode_state_t *s, uint8_t g722_data[], const int16_t amp[]
     int eh;
     int mih;
     int i;
-    int j;
-    /* Low and high band PCM from the QMF */
-    int xlow;
-    int xhigh;
-    int g722_bytes;
-    /* Even and odd tap accumulators */
-    int sumeven;
-    int sumodd;
+    int lo;
+    int hi;
     int ihigh;
     int ilow;
-    int code;
 
-    g722_bytes = 0;
-    xhigh = 0;
-    for (j = 0;  j < len;  )
+    /* Block 1L, SUBTRA */
+    el = saturate(xlow - s->band[0].s);
+
+    /* Block 1L, QUANTL */
+    wd = (el >= 0)  ?  el  :  -(el + 1);
+
+    /* The thresholds only grow, so find the first one above wd by bisection */
+    lo = 1;
+    hi = 30;
+    while (lo < hi)
     {
-        if (s->itu_test_mode)
-        {
-            xlow =
-            xhigh = amp[j++] >> 1;
-        }
+        i = (lo + hi) >> 1;
+        wd1 = (q6[i]*s->band[0].det) >> 12;
+        if (wd < wd1)
+            hi = i;
         else
-        {
-            if (s->eight_k)
-            {
-                xlow = amp[j++] >> 1;
-            }
-            else
-            {
-                /* Apply the transmit QMF */
-                /* Shuffle the buffer down */
-                for (i = 0;  i < 22;  i++)
-                    s->x[i] = s->x[i + 2];
-                s->x[22] = amp[j++];
-                s->x[23] = amp[j++];
-    
-                /* Discard every other QMF output */
-                sumeven = 0;
-                sumodd = 0;
-                for (i = 0;  i < 12;  i++)
-                {
-                    sumodd += s->x[2*i]*qmf_coeffs[i];
-                    sumeven += s->x[2*i + 1]*qmf_coeffs[11 - i];
-                }
-                xlow = (sumeven + sumodd) >> 14;
-                xhigh = (sumeven - sumodd) >> 14;
-            }
-        }
-        /* Block 1L, SUBTRA */
-        el = saturate(xlow - s->band[0].s);
+            lo = i + 1;
+    }
+    i = lo;
+    ilow = (el < 0)  ?  iln[i]  :  ilp[i];
+
+    /* Block 2L, INVQAL */
+    ril = ilow >> 2;
+    wd2 = qm4[ril];
+    dlow = (s->band[0].det*wd2) >> 15;
+
+    /* Block 3L, LOGSCL */
+    il4 = rl42[ril];
+    wd = (s->band[0].nb*127) >> 7;
+    s->band[0].nb = wd + wl[il4];
+    if (s->band[0].nb < 0)
+        s->band[0].nb = 0;
+    else if (s->band[0].nb > 18432)
+        s->band[0].nb = 18432;
+
+    /* Block 3L, SCALEL */
+    wd1 = (s->band[0].nb >> 6) & 31;
+    wd2 = 8 - (s->band[0].nb >> 11);
+    wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
+    s->band[0].det = wd3 << 2;
+
+    block4(s, 0, dlow);
+
+    if (s->eight_k)
+    {
+        /* Just leave the high bits as zero */
+        return (0xC0 | ilow) >> (8 - s->bits_per_sample);
+    }
 
-        /* Block 1L, QUANTL */
-        wd = (el >= 0)  ?  el  :  -(el + 1);
+    /* Block 1H, SUBTRA */
+    eh = saturate(xhigh - s->band[1].s);
+
+    /* Block 1H, QUANTH */
+    wd = (eh >= 0)  ?  eh  :  -(eh + 1);
+    wd1 = (564*s->band[1].det) >> 12;
+    mih = (wd >= wd1)  ?  2  :  1;
+    ihigh = (eh < 0)  ?  ihn[mih]  :  ihp[mih];
+
+    /* Block 2H, INVQAH */
+    wd2 = qm2[ihigh];
+    dhigh = (s->band[1].det*wd2) >> 15;
+
+    /* Block 3H, LOGSCH */
+    ih2 = rh2[ihigh];
+    wd = (s->band[1].nb*127) >> 7;
+    s->band[1].nb = wd + wh[ih2];
+    if (s->band[1].nb < 0)
+        s->band[1].nb = 0;
+    else if (s->band[1].nb > 22528)
+        s->band[1].nb = 22528;
+
+    /* Block 3H, SCALEH */
+    wd1 = (s->band[1].nb >> 6) & 31;
+    wd2 = 10 - (s->band[1].nb >> 11);
+    wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
+    s->band[1].det = wd3 << 2;
+
+    block4(s, 1, dhigh);
+    return ((ihigh << 6) | ilow) >> (8 - s->bits_per_sample);
+}
+/*- End of function --------------------------------------------------------*/
 
-        for (i = 1;  i < 30;  i++)
-        {
-            wd1 = (q6[i]*s->band[0].det) >> 12;
-            if (wd < wd1)
-                break;
-        }
-        ilow = (el < 0)  ?  iln[i]  :  ilp[i];
-
-        /* Block 2L, INVQAL */
-        ril = ilow >> 2;
-        wd2 = qm4[ril];
-        dlow = (s->band[0].det*wd2) >> 15;
-
-        /* Block 3L, LOGSCL */
-        il4 = rl42[ril];
-        wd = (s->band[0].nb*127) >> 7;
-        s->band[0].nb = wd + wl[il4];
-        if (s->band[0].nb < 0)
-            s->band[0].nb = 0;
-        else if (s->band[0].nb > 18432)
-            s->band[0].nb = 18432;
-
-        /* Block 3L, SCALEL */
-        wd1 = (s->band[0].nb >> 6) & 31;
-        wd2 = 8 - (s->band[0].nb >> 11);
-        wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-        s->band[0].det = wd3 << 2;
-
-        block4(s, 0, dlow);
-        
-        if (s->eight_k)
-        {
-            /* Just leave the high bits as zero */
-            code = (0xC0 | ilow) >> (8 - s->bits_per_sample);
-        }
-        else
+static __inline__ int put_code(g722_encode_state_t *s, uint8_t g722_data[], int g722_bytes, int code)
+{
+    if (s->packed)
+    {
+        /* Pack the code bits */
+        s->out_buffer |= (code << s->out_bits);
+        s->out_bits += s->bits_per_sample;
+        if (s->out_bits >= 8)
         {
-            /* Block 1H, SUBTRA */
-            eh = saturate(xhigh - s->band[1].s);
-
-            /* Block 1H, QUANTH */
-            wd = (eh >= 0)  ?  eh  :  -(eh + 1);
-            wd1 = (564*s->band[1].det) >> 12;
-            mih = (wd >= wd1)  ?  2  :  1;
-            ihigh = (eh < 0)  ?  ihn[mih]  :  ihp[mih];
-
-            /* Block 2H, INVQAH */
-            wd2 = qm2[ihigh];
-            dhigh = (s->band[1].det*wd2) >> 15;
-
-            /* Block 3H, LOGSCH */
-            ih2 = rh2[ihigh];
-            wd = (s->band[1].nb*127) >> 7;
-            s->band[1].nb = wd + wh[ih2];
-            if (s->band[1].nb < 0)
-                s->band[1].nb = 0;
-            else if (s->band[1].nb > 22528)
-                s->band[1].nb = 22528;
-
-            /* Block 3H, SCALEH */
-            wd1 = (s->band[1].nb >> 6) & 31;
-            wd2 = 10 - (s->band[1].nb >> 11);
-            wd3 = (wd2 < 0)  ?  (ilb[wd1] << -wd2)  :  (ilb[wd1] >> wd2);
-            s->band[1].det = wd3 << 2;
-
-            block4(s, 1, dhigh);
-            code = ((ihigh << 6) | ilow) >> (8 - s->bits_per_sample);
+            g722_data[g722_bytes++] = (uint8_t) (s->out_buffer & 0xFF);
+            s->out_bits -= 8;
+            s->out_buffer >>= 8;
         }
+    }
+    else
+    {
+        g722_data[g722_bytes++] = (uint8_t) code;
+    }
+    return g722_bytes;
+}
+/*- End of function --------------------------------------------------------*/
+
+int g722_encode(g722_encode_state_t *s, uint8_t g722_data[], const int16_t amp[], int len)
+{
+    /* History and new samples for the QMF */
+    int16_t x[G722_QMF_TAPS - 2 + 2*G722_QMF_BLOCK];
+    /* Even and odd tap accumulators */
+    int32_t sumodd[G722_QMF_BLOCK];
+    int32_t sumeven[G722_QMF_BLOCK];
+    int g722_bytes;
+    int pairs;
+    int xlow;
+    int i;
+    int j;
 
-        if (s->packed)
+    g722_bytes = 0;
+    if (s->itu_test_mode  ||  s->eight_k)
+    {
+        for (j = 0;  j < len;  j++)
         {
-            /* Pack the code bits */
-            s->out_buffer |= (code << s->out_bits);
-            s->out_bits += s->bits_per_sample;
-            if (s->out_bits >= 8)
-            {
-                g722_data[g722_bytes++] = (uint8_t) (s->out_buffer & 0xFF);
-                s->out_bits -= 8;
-                s->out_buffer >>= 8;
-            }
+            xlow = amp[j] >> 1;
+            g722_bytes = put_code(s, g722_data, g722_bytes,
+                                  encode_pair(s, xlow, (s->itu_test_mode)  ?  xlow  :  0));
         }
-        else
+        return g722_bytes;
+    }
+
+    /* Apply the transmit QMF to a block of samples at a time, then run the
+       ADPCM over its outputs. The ADPCM is recursive so it stays per sample. */
+    for (j = 0;  len - j >= 2;  j += 2*pairs)
+    {
+        pairs = (len - j)/2;
+        if (pairs > G722_QMF_BLOCK)
+            pairs = G722_QMF_BLOCK;
+
+        for (i = 0;  i < G722_QMF_TAPS - 2;  i++)
+            x[i] = (int16_t) s->x[i + 2];
+        memcpy(&x[G722_QMF_TAPS - 2], &amp[j], 2*pairs*sizeof(amp[0]));
+        g722_qmf_block(x, pairs, sumodd, sumeven);
+        for (i = 0;  i < G722_QMF_TAPS;  i++)
+            s->x[i] = x[2*pairs - 2 + i];
+
+        /* Discard every other QMF output */
+        for (i = 0;  i < pairs;  i++)
         {
-            g722_data[g722_bytes++] = (uint8_t) code;
+            g722_bytes = put_code(s, g722_data, g722_bytes,
+                                  encode_pair(s, (sumeven[i] + sumodd[i]) >> 14, (sumeven[i] - sumodd[i]) >> 14));
         }
     }
     return g722_bytes;
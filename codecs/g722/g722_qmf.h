@@ -0,0 +1,141 @@
+/*
+ * SpanDSP - a series of DSP components for telephony
+ *
+ * g722_qmf.h - The ITU G.722 codec, quadrature mirror filter block kernel.
+ *
+ * Written by Steve Underwood <steveu@coppice.org>
+ *
+ * Copyright (C) 2005 Steve Underwood
+ *
+ *  Despite my general liking of the GPL, I place my own contributions
+ *  to this code in the public domain for the benefit of all mankind -
+ *  even the slimy ones who might try to proprietize my work and use it
+ *  to my detriment.
+ *
+ * $Id$
+ */
+
+/*! \file */
+
+#if !defined(_G722_QMF_H_)
+#define _G722_QMF_H_
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*! Number of samples in the QMF window */
+#define G722_QMF_TAPS       24
+
+/*! Most sample pairs filtered in one block */
+#define G722_QMF_BLOCK      256
+
+/* The QMF taps, placed on the window so the odd taps multiply the even
+   samples and the even taps the odd ones, in reverse */
+static const int16_t g722_qmf_odd_coeffs[G722_QMF_TAPS] =
+{
+       3,    0,  -11,    0,   12,    0,   32,    0, -210,    0,  951,    0,
+    3876,    0, -805,    0,  362,    0, -156,    0,   53,    0,  -11,    0,
+};
+static const int16_t g722_qmf_even_coeffs[G722_QMF_TAPS] =
+{
+       0,  -11,    0,   53,    0, -156,    0,  362,    0, -805,    0, 3876,
+       0,  951,    0, -210,    0,   32,    0,   12,    0,  -11,    0,    3,
+};
+
+/*
+    Both the transmit and the receive QMF take two sums over each 24 sample
+    window: the even samples by the taps, and the odd samples by the taps in
+    reverse. The window for pair k starts at x[2*k], so x holds the 22 samples
+    of history followed by the new pairs. Each product fits in 16 bits and
+    each sum in 32 bits, so the vector versions give exactly the sums of the
+    scalar loop.
+*/
+static void g722_qmf_block(const int16_t x[], int pairs, int32_t sumodd[], int32_t sumeven[])
+{
+    int k;
+#if defined(__SSE2__)
+    __m128i co0 = _mm_loadu_si128((const __m128i *) &g722_qmf_odd_coeffs[0]);
+    __m128i co1 = _mm_loadu_si128((const __m128i *) &g722_qmf_odd_coeffs[8]);
+    __m128i co2 = _mm_loadu_si128((const __m128i *) &g722_qmf_odd_coeffs[16]);
+    __m128i ce0 = _mm_loadu_si128((const __m128i *) &g722_qmf_even_coeffs[0]);
+    __m128i ce1 = _mm_loadu_si128((const __m128i *) &g722_qmf_even_coeffs[8]);
+    __m128i ce2 = _mm_loadu_si128((const __m128i *) &g722_qmf_even_coeffs[16]);
+
+    for (k = 0;  k < pairs;  k++)
+    {
+        __m128i x0 = _mm_loadu_si128((const __m128i *) &x[2*k]);
+        __m128i x1 = _mm_loadu_si128((const __m128i *) &x[2*k + 8]);
+        __m128i x2 = _mm_loadu_si128((const __m128i *) &x[2*k + 16]);
+        __m128i so;
+        __m128i se;
+        __m128i sum;
+
+        so = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(x0, co0), _mm_madd_epi16(x1, co1)),
+                           _mm_madd_epi16(x2, co2));
+        se = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(x0, ce0), _mm_madd_epi16(x1, ce1)),
+                           _mm_madd_epi16(x2, ce2));
+        /* Reduce both at once: o0+o2, e0+e2, o1+o3, e1+e3, then fold the halves */
+        sum = _mm_add_epi32(_mm_unpacklo_epi32(so, se), _mm_unpackhi_epi32(so, se));
+        sum = _mm_add_epi32(sum, _mm_unpackhi_epi64(sum, sum));
+        sumodd[k] = _mm_cvtsi128_si32(sum);
+        sumeven[k] = _mm_cvtsi128_si32(_mm_srli_si128(sum, 4));
+    }
+#elif defined(__ARM_NEON)
+    int16x8_t co0 = vld1q_s16(&g722_qmf_odd_coeffs[0]);
+    int16x8_t co1 = vld1q_s16(&g722_qmf_odd_coeffs[8]);
+    int16x8_t co2 = vld1q_s16(&g722_qmf_odd_coeffs[16]);
+    int16x8_t ce0 = vld1q_s16(&g722_qmf_even_coeffs[0]);
+    int16x8_t ce1 = vld1q_s16(&g722_qmf_even_coeffs[8]);
+    int16x8_t ce2 = vld1q_s16(&g722_qmf_even_coeffs[16]);
+
+    for (k = 0;  k < pairs;  k++)
+    {
+        int16x8_t x0 = vld1q_s16(&x[2*k]);
+        int16x8_t x1 = vld1q_s16(&x[2*k + 8]);
+        int16x8_t x2 = vld1q_s16(&x[2*k + 16]);
+        int32x4_t so;
+        int32x4_t se;
+        int32x2_t sum;
+
+        so = vmull_s16(vget_low_s16(x0), vget_low_s16(co0));
+        so = vmlal_s16(so, vget_high_s16(x0), vget_high_s16(co0));
+        so = vmlal_s16(so, vget_low_s16(x1), vget_low_s16(co1));
+        so = vmlal_s16(so, vget_high_s16(x1), vget_high_s16(co1));
+        so = vmlal_s16(so, vget_low_s16(x2), vget_low_s16(co2));
+        so = vmlal_s16(so, vget_high_s16(x2), vget_high_s16(co2));
+        se = vmull_s16(vget_low_s16(x0), vget_low_s16(ce0));
+        se = vmlal_s16(se, vget_high_s16(x0), vget_high_s16(ce0));
+        se = vmlal_s16(se, vget_low_s16(x1), vget_low_s16(ce1));
+        se = vmlal_s16(se, vget_high_s16(x1), vget_high_s16(ce1));
+        se = vmlal_s16(se, vget_low_s16(x2), vget_low_s16(ce2));
+        se = vmlal_s16(se, vget_high_s16(x2), vget_high_s16(ce2));
+        sum = vpadd_s32(vadd_s32(vget_low_s32(so), vget_high_s32(so)),
+                        vadd_s32(vget_low_s32(se), vget_high_s32(se)));
+        sumodd[k] = vget_lane_s32(sum, 0);
+        sumeven[k] = vget_lane_s32(sum, 1);
+    }
+#else
+    int i;
+
+    for (k = 0;  k < pairs;  k++)
+    {
+        int32_t so = 0;
+        int32_t se = 0;
+
+        for (i = 0;  i < G722_QMF_TAPS/2;  i++)
+        {
+            so += x[2*k + 2*i]*g722_qmf_odd_coeffs[2*i];
+            se += x[2*k + 2*i + 1]*g722_qmf_even_coeffs[2*i + 1];
+        }
+        sumodd[k] = so;
+        sumeven[k] = se;
+    }
+#endif
+}
+/*- End of function --------------------------------------------------------*/
+
+#endif
+/*- End of file ------------------------------------------------------------*/
@@ -90,6 +90,10 @@ static void speex_free (void *ptr) {free(ptr);}
 
 #ifdef _USE_SSE
 #include "resample_sse.h"
+#elif defined(FIXED_POINT) && defined(__SSE2__) && !defined(RESAMPLE_NO_SIMD)
+#include "resample_sse2.h"
+#elif defined(FIXED_POINT) && defined(__ARM_NEON) && !defined(RESAMPLE_NO_SIMD)
+#include "resample_neon.h"
 #endif
 
 /* Numer of elements to allocate on the stack */
@@ -330,7 +334,9 @@ static int resampler_basic_direct_single(SpeexResamplerState *st, spx_uint32_t c
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
    spx_word32_t sum;
+#ifndef OVERRIDE_INNER_PRODUCT_SINGLE
    int j;
+#endif
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
    {
@@ -338,6 +344,11 @@ static int resampler_basic_direct_single(SpeexResamplerState *st, spx_uint32_t c
       const spx_word16_t *iptr = & in[last_sample];
 
 #ifndef OVERRIDE_INNER_PRODUCT_SINGLE
+#ifdef FIXED_POINT
+      /* Accumulate exactly, rather than rounding each product to a float */
+      sum = 0;
+      for(j=0;j<N;j++) sum += MULT16_16(sinc[j], iptr[j]);
+#else
       float accum[4] = {0,0,0,0};
 
       for(j=0;j<N;j+=4) {
@@ -347,11 +358,12 @@ static int resampler_basic_direct_single(SpeexResamplerState *st, spx_uint32_t c
         accum[3] += sinc[j+3]*iptr[j+3];
       }
       sum = accum[0] + accum[1] + accum[2] + accum[3];
+#endif
 #else
       sum = inner_product_single(sinc, iptr, N);
 #endif
 
-      out[out_stride * out_sample++] = PSHR32(sum, 15);
+      out[out_stride * out_sample++] = SATURATE32PSHR(sum, 15, 32767);
       last_sample += int_advance;
       samp_frac_num += frac_advance;
       if (samp_frac_num >= den_rate)
@@ -428,7 +440,9 @@ static int resampler_basic_interpolate_single(SpeexResamplerState *st, spx_uint3
    const int int_advance = st->int_advance;
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
+#ifndef OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
    int j;
+#endif
    spx_word32_t sum;
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
@@ -462,7 +476,7 @@ static int resampler_basic_interpolate_single(SpeexResamplerState *st, spx_uint3
       sum = interpolate_product_single(iptr, st->sinc_table + st->oversample + 4 - offset - 2, N, st->oversample, interp);
 #endif
       
-      out[out_stride * out_sample++] = PSHR32(sum,15);
+      out[out_stride * out_sample++] = SATURATE32PSHR(sum, 15, 32767);
       last_sample += int_advance;
       samp_frac_num += frac_advance;
       if (samp_frac_num >= den_rate)
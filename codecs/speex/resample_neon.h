@@ -0,0 +1,73 @@
+/* Copyright (C) 2026 Digium, Inc. */
+/**
+   @file resample_neon.h
+   @brief Resampler functions (fixed-point NEON version)
+
+   These give exactly the same results as the generic fixed-point loops.
+*/
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+   
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+   
+   - Neither the name of the Xiph.org Foundation nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+   
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arm_neon.h>
+
+#define OVERRIDE_INNER_PRODUCT_SINGLE
+static inline spx_word32_t inner_product_single(const spx_word16_t *a, const spx_word16_t *b, unsigned int len)
+{
+   unsigned int i = 0;
+   spx_word32_t ret;
+   int32x4_t sum = vdupq_n_s32(0);
+   int32x2_t half;
+
+   for (; i + 4 <= len; i += 4)
+   {
+      sum = vmlal_s16(sum, vld1_s16(a+i), vld1_s16(b+i));
+   }
+   half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+   half = vpadd_s32(half, half);
+   ret = vget_lane_s32(half, 0);
+   for (; i < len; i++)
+      ret += MULT16_16(a[i], b[i]);
+   return ret;
+}
+
+#define OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
+static inline spx_word32_t interpolate_product_single(const spx_word16_t *a, const spx_word16_t *b, unsigned int len, const spx_uint32_t oversample, spx_word16_t *frac)
+{
+   unsigned int i;
+   spx_int32_t accum[4];
+   int32x4_t sum = vdupq_n_s32(0);
+
+   for (i = 0; i < len; i++)
+   {
+      sum = vmlal_n_s16(sum, vld1_s16(b+i*oversample), a[i]);
+   }
+   vst1q_s32(accum, sum);
+
+   return MULT16_32_Q15(frac[0],accum[0]) + MULT16_32_Q15(frac[1],accum[1]) + MULT16_32_Q15(frac[2],accum[2]) + MULT16_32_Q15(frac[3],accum[3]);
+}
@@ -0,0 +1,88 @@
+/* Copyright (C) 2026 Digium, Inc. */
+/**
+   @file resample_sse2.h
+   @brief Resampler functions (fixed-point SSE2 version)
+
+   These give exactly the same results as the generic fixed-point loops.
+*/
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+   
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+   
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+   
+   - Neither the name of the Xiph.org Foundation nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+   
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <emmintrin.h>
+
+#define OVERRIDE_INNER_PRODUCT_SINGLE
+static inline spx_word32_t inner_product_single(const spx_word16_t *a, const spx_word16_t *b, unsigned int len)
+{
+   unsigned int i = 0;
+   spx_word32_t ret;
+   __m128i sum = _mm_setzero_si128();
+
+   for (; i + 8 <= len; i += 8)
+   {
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a+i)),
+                                              _mm_loadu_si128((const __m128i *)(b+i))));
+   }
+   if (i + 4 <= len)
+   {
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadl_epi64((const __m128i *)(a+i)),
+                                              _mm_loadl_epi64((const __m128i *)(b+i))));
+      i += 4;
+   }
+   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+   ret = _mm_cvtsi128_si32(sum);
+   for (; i < len; i++)
+      ret += MULT16_16(a[i], b[i]);
+   return ret;
+}
+
+#define OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
+static inline spx_word32_t interpolate_product_single(const spx_word16_t *a, const spx_word16_t *b, unsigned int len, const spx_uint32_t oversample, spx_word16_t *frac)
+{
+   unsigned int i = 0;
+   spx_int32_t accum[4];
+   __m128i sum = _mm_setzero_si128();
+
+   /* Interleave the taps of two inputs so one multiply-add covers both */
+   for (; i + 2 <= len; i += 2)
+   {
+      __m128i taps = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(b+i*oversample)),
+                                        _mm_loadl_epi64((const __m128i *)(b+(i+1)*oversample)));
+      __m128i in = _mm_set1_epi32((spx_int32_t)(((spx_uint32_t)(spx_uint16_t)a[i+1] << 16) | (spx_uint16_t)a[i]));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(taps, in));
+   }
+   if (i < len)
+   {
+      __m128i taps = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(b+i*oversample)), _mm_setzero_si128());
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(taps, _mm_set1_epi32((spx_uint16_t)a[i])));
+   }
+   _mm_storeu_si128((__m128i *)accum, sum);
+
+   return MULT16_32_Q15(frac[0],accum[0]) + MULT16_32_Q15(frac[1],accum[1]) + MULT16_32_Q15(frac[2],accum[2]) + MULT16_32_Q15(frac[3],accum[3]);
+}
@@ -0,0 +1,30 @@
+"""add pjsip threadpool_work_stealing
+
+Revision ID: 0889816e3c91
+Revises: 339a3bdf53fc
+Create Date: 2016-01-18 10:12:42.132714
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '0889816e3c91'
+down_revision = '339a3bdf53fc'
+
+from alembic import op
+import sqlalchemy as sa
+from sqlalchemy.dialects.postgresql import ENUM
+
+YESNO_NAME = 'yesno_values'
+YESNO_VALUES = ['yes', 'no']
+
+def upgrade():
+    ############################# Enums ##############################
+
+    # yesno_values have already been created, so use postgres enum object
+    # type to get around "already created" issue - works okay with mysql
+    yesno_values = ENUM(*YESNO_VALUES, name=YESNO_NAME, create_type=False)
+
+    op.add_column('ps_systems', sa.Column('threadpool_work_stealing', yesno_values))
+
+def downgrade():
+    op.drop_column('ps_systems', 'threadpool_work_stealing')
@@ -0,0 +1,21 @@
+"""add pjsip max qualify rate
+
+Revision ID: 1e6b4a9d3f27
+Revises: 7d5b1f3e9a24
+Create Date: 2016-02-09 11:42:37.208416
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '1e6b4a9d3f27'
+down_revision = '7d5b1f3e9a24'
+
+from alembic import op
+import sqlalchemy as sa
+
+
+def upgrade():
+    op.add_column('ps_globals', sa.Column('max_qualify_rate', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_globals', 'max_qualify_rate')
@@ -0,0 +1,21 @@
+"""add pjsip notify min interval
+
+Revision ID: 2b9d6e4f1a38
+Revises: 4f2c8b7e5d13
+Create Date: 2016-02-11 14:02:39.218477
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '2b9d6e4f1a38'
+down_revision = '4f2c8b7e5d13'
+
+from alembic import op
+import sqlalchemy as sa
+
+
+def upgrade():
+    op.add_column('ps_endpoints', sa.Column('notify_min_interval', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_endpoints', 'notify_min_interval')
@@ -0,0 +1,23 @@
+"""add pjsip endpoint identifier cache ttl
+
+Revision ID: 3c8e9f2a6b1d
+Revises: 5a3d2e81c4b7
+Create Date: 2016-02-03 14:08:12.518327
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '3c8e9f2a6b1d'
+down_revision = '5a3d2e81c4b7'
+
+from alembic import op
+import sqlalchemy as sa
+
+
+def upgrade():
+    op.add_column('ps_globals', sa.Column('endpoint_identifier_cache_ttl', sa.Integer))
+    op.add_column('ps_globals', sa.Column('endpoint_identifier_negative_cache_ttl', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_globals', 'endpoint_identifier_negative_cache_ttl')
+    op.drop_column('ps_globals', 'endpoint_identifier_cache_ttl')
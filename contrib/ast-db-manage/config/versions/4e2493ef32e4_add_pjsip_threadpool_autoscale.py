@@ -0,0 +1,25 @@
+"""add pjsip threadpool autoscale
+
+Revision ID: 4e2493ef32e4
+Revises: 0889816e3c91
+Create Date: 2016-01-25 14:03:12.849205
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '4e2493ef32e4'
+down_revision = '0889816e3c91'
+
+from alembic import op
+import sqlalchemy as sa
+
+
+def upgrade():
+    op.add_column('ps_systems', sa.Column('threadpool_autoscale_target_wait', sa.Integer))
+    op.add_column('ps_systems', sa.Column('threadpool_autoscale_min_size', sa.Integer))
+    op.add_column('ps_systems', sa.Column('threadpool_autoscale_cooldown', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_systems', 'threadpool_autoscale_cooldown')
+    op.drop_column('ps_systems', 'threadpool_autoscale_min_size')
+    op.drop_column('ps_systems', 'threadpool_autoscale_target_wait')
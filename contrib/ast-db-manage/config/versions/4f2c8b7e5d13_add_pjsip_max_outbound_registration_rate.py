@@ -0,0 +1,21 @@
+"""add pjsip max outbound registration rate
+
+Revision ID: 4f2c8b7e5d13
+Revises: 1e6b4a9d3f27
+Create Date: 2016-02-10 09:17:52.663190
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '4f2c8b7e5d13'
+down_revision = '1e6b4a9d3f27'
+
+from alembic import op
+import sqlalchemy as sa
+
+
+def upgrade():
+    op.add_column('ps_globals', sa.Column('max_outbound_registration_rate', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_globals', 'max_outbound_registration_rate')
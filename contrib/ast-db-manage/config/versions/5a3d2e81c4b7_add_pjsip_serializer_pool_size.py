@@ -0,0 +1,21 @@
+"""add pjsip serializer pool size
+
+Revision ID: 5a3d2e81c4b7
+Revises: 4e2493ef32e4
+Create Date: 2016-01-27 10:21:45.302114
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '5a3d2e81c4b7'
+down_revision = '4e2493ef32e4'
+
+from alembic import op
+import sqlalchemy as sa
+
+
+def upgrade():
+    op.add_column('ps_systems', sa.Column('serializer_pool_size', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_systems', 'serializer_pool_size')
@@ -0,0 +1,40 @@
+"""add pjsip transport receive sockets
+
+Revision ID: 7d5b1f3e9a24
+Revises: 3c8e9f2a6b1d
+Create Date: 2016-02-09 11:36:27.804519
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '7d5b1f3e9a24'
+down_revision = '3c8e9f2a6b1d'
+
+from alembic import op
+import sqlalchemy as sa
+from sqlalchemy.dialects.postgresql import ENUM
+
+PJSIP_RECEIVE_STEERING_NAME = 'pjsip_receive_steering_values'
+PJSIP_RECEIVE_STEERING_VALUES = ['flow', 'address', 'cpu']
+
+def upgrade():
+    context = op.get_context()
+
+    op.add_column('ps_transports', sa.Column('receive_sockets', sa.Integer))
+
+    if context.bind.dialect.name == 'postgresql':
+        enum = ENUM(*PJSIP_RECEIVE_STEERING_VALUES, name=PJSIP_RECEIVE_STEERING_NAME)
+        enum.create(op.get_bind(), checkfirst=False)
+
+    receive_steering_values = ENUM(*PJSIP_RECEIVE_STEERING_VALUES,
+        name=PJSIP_RECEIVE_STEERING_NAME, create_type=False)
+    op.add_column('ps_transports', sa.Column('receive_steering', receive_steering_values))
+
+def downgrade():
+    context = op.get_context()
+
+    op.drop_column('ps_transports', 'receive_steering')
+    op.drop_column('ps_transports', 'receive_sockets')
+
+    if context.bind.dialect.name == 'postgresql':
+        ENUM(name=PJSIP_RECEIVE_STEERING_NAME).drop(op.get_bind(), checkfirst=False)
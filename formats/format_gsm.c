@@ -105,12 +105,7 @@ static int gsm_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 		return -1;
 	}
 
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
-		ast_log(AST_LOG_WARNING, "Unable to seek to end of g719 filestream %p: %s\n", fs, strerror(errno));
-		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	if ((max = ast_filestream_size(fs)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in g719 filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -108,12 +108,7 @@ static int pcm_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 		return -1;
 	}
 
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
-		ast_log(AST_LOG_WARNING, "Unable to seek to end of pcm filestream %p: %s\n", fs, strerror(errno));
-		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	if ((max = ast_filestream_size(fs)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in pcm filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -141,6 +136,10 @@ static int pcm_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 		size_t left = offset - max;
 		const char *src = (ast_format_cmp(fs->fmt->format, ast_format_alaw) == AST_FORMAT_CMP_EQUAL) ? alaw_silence : ulaw_silence;
 
+		if (fseeko(fs->f, 0, SEEK_END) < 0) {
+			ast_log(AST_LOG_WARNING, "Unable to seek to end of pcm filestream %p: %s\n", fs, strerror(errno));
+			return -1;
+		}
 		while (left) {
 			size_t written = fwrite(src, 1, (left > BUF_SIZE) ? BUF_SIZE : left, fs->f);
 			if (written == -1)
@@ -398,12 +397,7 @@ static int au_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 		return -1;
 	}
 
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
-		ast_log(AST_LOG_WARNING, "Unable to seek to end of au filestream %p: %s\n", fs, strerror(errno));
-		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	if ((max = ast_filestream_size(fs)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in au filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -455,12 +455,7 @@ static int wav_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 		return -1;
 	}
 
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
-		ast_log(AST_LOG_WARNING, "Unable to seek to end of wav filestream %p: %s\n", fs, strerror(errno));
-		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	if ((max = ast_filestream_size(fs)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in wav filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
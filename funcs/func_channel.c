@@ -402,6 +402,19 @@ ASTERISK_REGISTER_FILE()
 						Note that this has no relation to the SIP Max-Forwards header.
 						</para>
 					</enum>
+					<enum name="setup_times">
+						<para>R/O The stages of the call setup the channel has reached so far,
+						as a comma separated list of <literal>stage=seconds</literal> where
+						seconds is the time from the first stage reached. The stages are
+						<literal>received</literal>, <literal>distributed</literal>,
+						<literal>identified</literal>, <literal>authenticated</literal> and
+						<literal>session</literal> for calls from PJSIP, then
+						<literal>created</literal>, <literal>dialplan</literal>,
+						<literal>dial</literal>, <literal>ringing</literal> and
+						<literal>answered</literal>. Set it as a CDR variable or in a
+						CELGenUserEvent from a hangup handler to keep it with the call
+						records, e.g. <literal>Set(CDR(setup_times)=${CHANNEL(setup_times)})</literal>.</para>
+					</enum>
 				</enumlist>
 			</parameter>
 		</syntax>
@@ -598,6 +611,13 @@ static int func_channel_read(struct ast_channel *chan, const char *function,
 		ast_channel_lock(chan);
 		snprintf(buf, len, "%d", ast_max_forwards_get(chan));
 		ast_channel_unlock(chan);
+	} else if (!strcasecmp(data, "setup_times")) {
+		struct ast_str *tmp_str = ast_str_alloca(512);
+
+		ast_channel_lock(chan);
+		ast_channel_setup_times_str(chan, &tmp_str);
+		ast_channel_unlock(chan);
+		ast_copy_string(buf, ast_str_buffer(tmp_str), len);
 	} else if (!ast_channel_tech(chan) || !ast_channel_tech(chan)->func_channel_read || ast_channel_tech(chan)->func_channel_read(chan, function, data, buf, len)) {
 		ast_log(LOG_WARNING, "Unknown or unavailable item requested: '%s'\n", data);
 		ret = -1;
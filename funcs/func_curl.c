@@ -99,6 +99,14 @@ ASTERISK_REGISTER_FILE()
 						<para>Include header information in the result
 						(boolean)</para>
 					</enum>
+					<enum name="hostconns">
+						<para>Maximum number of requests running at the same
+						time to the host of a URL, any more wait for one of
+						them to finish.  The default is 0, no limit.  Requests
+						from all channels share a pool of open connections and
+						resolved addresses, so this also bounds the connections
+						kept open to each host.</para>
+					</enum>
 					<enum name="httptimeout">
 						<para>For HTTP(S) URIs, number of seconds to wait for a
 						server response</para>
@@ -172,6 +180,7 @@ ASTERISK_REGISTER_FILE()
 	((LIBCURL_VERSION_MAJOR > (a)) || ((LIBCURL_VERSION_MAJOR == (a)) && (LIBCURL_VERSION_MINOR > (b))) || ((LIBCURL_VERSION_MAJOR == (a)) && (LIBCURL_VERSION_MINOR == (b)) && (LIBCURL_VERSION_PATCH >= (c))))
 
 #define CURLOPT_SPECIAL_HASHCOMPAT ((CURLoption) -500)
+#define CURLOPT_SPECIAL_HOSTCONNS ((CURLoption) -501)
 
 static void curlds_free(void *data);
 
@@ -279,6 +288,9 @@ static int parse_curlopt_key(const char *name, CURLoption *key, enum optiontype
 	} else if (!strcasecmp(name, "hashcompat")) {
 		*key = CURLOPT_SPECIAL_HASHCOMPAT;
 		*ot = OT_ENUM;
+	} else if (!strcasecmp(name, "hostconns")) {
+		*key = CURLOPT_SPECIAL_HOSTCONNS;
+		*ot = OT_INTEGER;
 	} else {
 		return -1;
 	}
@@ -569,6 +581,180 @@ static void curl_instance_cleanup(void *data)
 AST_THREADSTORAGE_CUSTOM(curl_instance, curl_instance_init, curl_instance_cleanup);
 AST_THREADSTORAGE(thread_escapebuf);
 
+/*!
+ * \brief Process-wide share of the resolver cache, TLS sessions and connections
+ *
+ * The easy handles are per thread and most threads are short lived channel
+ * threads, so without this nearly every request would resolve the host and
+ * set up TCP and TLS again.  A handle is only attached to the share while it
+ * performs a request, so the share can be destroyed on unload whatever
+ * threads still hold a handle.
+ */
+static CURLSH *curl_share;
+
+/*! \brief Locks of the data in the share, one per kind of data */
+static ast_mutex_t curl_share_locks[CURL_LOCK_DATA_LAST];
+
+static void curl_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+	if (data < CURL_LOCK_DATA_LAST) {
+		ast_mutex_lock(&curl_share_locks[data]);
+	}
+}
+
+static void curl_share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+	if (data < CURL_LOCK_DATA_LAST) {
+		ast_mutex_unlock(&curl_share_locks[data]);
+	}
+}
+
+static int share_create(void)
+{
+	int i;
+
+	if (!(curl_share = curl_share_init())) {
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_LEN(curl_share_locks); i++) {
+		ast_mutex_init(&curl_share_locks[i]);
+	}
+
+	curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, curl_share_lock);
+	curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, curl_share_unlock);
+	curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if CURLVERSION_ATLEAST(7,57,0)
+	curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
+	return 0;
+}
+
+static void share_destroy(void)
+{
+	int i;
+
+	if (!curl_share) {
+		return;
+	}
+
+	if (curl_share_cleanup(curl_share) != CURLSHE_OK) {
+		/* Still in use, leak it rather than pull it from under a request. */
+		ast_log(LOG_WARNING, "cURL share is still in use, not destroying it\n");
+		curl_share = NULL;
+		return;
+	}
+	curl_share = NULL;
+
+	for (i = 0; i < ARRAY_LEN(curl_share_locks); i++) {
+		ast_mutex_destroy(&curl_share_locks[i]);
+	}
+}
+
+/*! \brief Requests running to a host, for the hostconns limit */
+struct curl_host {
+	AST_LIST_ENTRY(curl_host) list;
+	/*! Number of requests running to the host */
+	int active;
+	/*! Host and port as written in the URL */
+	char name[0];
+};
+
+/*! \brief Hosts with requests running, only those are listed */
+static AST_LIST_HEAD_NOLOCK_STATIC(curl_hosts, curl_host);
+AST_MUTEX_DEFINE_STATIC(curl_hosts_lock);
+static ast_cond_t curl_hosts_cond;
+
+/*!
+ * \internal
+ * \brief Find the host and port of a URL
+ *
+ * \param url The URL
+ * \param len Set to the length of the host and port
+ *
+ * \return Start of the host and port in the URL
+ */
+static const char *url_host(const char *url, size_t *len)
+{
+	const char *host = strstr(url, "://");
+	const char *at;
+
+	host = host ? host + 3 : url;
+	*len = strcspn(host, "/?#");
+
+	/* Skip user and password */
+	if ((at = memchr(host, '@', *len))) {
+		*len -= at + 1 - host;
+		host = at + 1;
+	}
+
+	return host;
+}
+
+/*!
+ * \internal
+ * \brief Wait for the host of a URL to have fewer than max requests running
+ *
+ * \param url The URL about to be requested
+ * \param max Maximum number of requests to the host, 0 for no limit
+ *
+ * \return The host to give to curl_host_release() when the request is done,
+ * NULL if there is no limit
+ */
+static struct curl_host *curl_host_acquire(const char *url, long max)
+{
+	struct curl_host *host;
+	const char *name;
+	size_t len;
+
+	if (max <= 0) {
+		return NULL;
+	}
+
+	name = url_host(url, &len);
+
+	ast_mutex_lock(&curl_hosts_lock);
+	for (;;) {
+		AST_LIST_TRAVERSE(&curl_hosts, host, list) {
+			if (strlen(host->name) == len && !strncasecmp(host->name, name, len)) {
+				break;
+			}
+		}
+		if (!host) {
+			if (!(host = ast_calloc(1, sizeof(*host) + len + 1))) {
+				break;
+			}
+			memcpy(host->name, name, len);
+			AST_LIST_INSERT_HEAD(&curl_hosts, host, list);
+		}
+		if (host->active < max) {
+			host->active++;
+			break;
+		}
+		ast_cond_wait(&curl_hosts_cond, &curl_hosts_lock);
+	}
+	ast_mutex_unlock(&curl_hosts_lock);
+
+	return host;
+}
+
+static void curl_host_release(struct curl_host *host)
+{
+	if (!host) {
+		return;
+	}
+
+	ast_mutex_lock(&curl_hosts_lock);
+	if (!--host->active) {
+		AST_LIST_REMOVE(&curl_hosts, host, list);
+		ast_free(host);
+	}
+	ast_cond_broadcast(&curl_hosts_cond);
+	ast_mutex_unlock(&curl_hosts_lock);
+}
+
 /*!
  * \brief Check for potential HTTP injection risk.
  *
@@ -607,6 +793,8 @@ static int acf_curl_helper(struct ast_channel *chan, const char *cmd, char *info
 	struct curl_settings *cur;
 	struct ast_datastore *store = NULL;
 	int hashcompat = 0;
+	long hostconns = 0;
+	struct curl_host *host;
 	AST_LIST_HEAD(global_curl_info, curl_settings) *list = NULL;
 	char curl_errbuf[CURL_ERROR_SIZE + 1]; /* add one to be safe */
 
@@ -650,6 +838,8 @@ static int acf_curl_helper(struct ast_channel *chan, const char *cmd, char *info
 	AST_LIST_TRAVERSE(&global_curl_info, cur, list) {
 		if (cur->key == CURLOPT_SPECIAL_HASHCOMPAT) {
 			hashcompat = (long) cur->value;
+		} else if (cur->key == CURLOPT_SPECIAL_HOSTCONNS) {
+			hostconns = (long) cur->value;
 		} else {
 			curl_easy_setopt(*curl, cur->key, cur->value);
 		}
@@ -662,6 +852,8 @@ static int acf_curl_helper(struct ast_channel *chan, const char *cmd, char *info
 		AST_LIST_TRAVERSE(list, cur, list) {
 			if (cur->key == CURLOPT_SPECIAL_HASHCOMPAT) {
 				hashcompat = (long) cur->value;
+			} else if (cur->key == CURLOPT_SPECIAL_HOSTCONNS) {
+				hostconns = (long) cur->value;
 			} else {
 				curl_easy_setopt(*curl, cur->key, cur->value);
 			}
@@ -680,10 +872,16 @@ static int acf_curl_helper(struct ast_channel *chan, const char *cmd, char *info
 	curl_errbuf[0] = curl_errbuf[CURL_ERROR_SIZE] = '\0';
 	curl_easy_setopt(*curl, CURLOPT_ERRORBUFFER, curl_errbuf);
 
+	host = curl_host_acquire(args.url, hostconns);
+	curl_easy_setopt(*curl, CURLOPT_SHARE, curl_share);
+
 	if (curl_easy_perform(*curl) != 0) {
 		ast_log(LOG_WARNING, "%s ('%s')\n", curl_errbuf, args.url);
 	}
 
+	curl_easy_setopt(*curl, CURLOPT_SHARE, (CURLSH *) NULL);
+	curl_host_release(host);
+
 	/* Reset buffer to NULL so curl doesn't try to write to it when the
 	 * buffer is deallocated. Documentation is vague about allowing NULL
 	 * here, but the source allows it. See: "typecheck: allow NULL to unset
@@ -776,6 +974,7 @@ static struct ast_custom_function acf_curlopt = {
 "  ftptext        - For FTP, force a text transfer (boolean)\n"
 "  ftptimeout     - For FTP, the server response timeout\n"
 "  header         - Retrieve header information (boolean)\n"
+"  hostconns      - Maximum number of requests at once to a host\n"
 "  httptimeout    - Number of seconds to wait for HTTP response\n"
 "  maxredirs      - Maximum number of redirects to follow\n"
 "  proxy          - Hostname or IP to use as a proxy\n"
@@ -851,6 +1050,9 @@ static int unload_module(void)
 
 	AST_TEST_UNREGISTER(vulnerable_url);
 
+	share_destroy();
+	ast_cond_destroy(&curl_hosts_cond);
+
 	return res;
 }
 
@@ -865,6 +1067,12 @@ static int load_module(void)
 		}
 	}
 
+	if (share_create()) {
+		ast_log(LOG_ERROR, "Cannot create the cURL share, so func_curl cannot be loaded\n");
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_cond_init(&curl_hosts_cond, NULL);
+
 	res = ast_custom_function_register(&acf_curl);
 	res |= ast_custom_function_register(&acf_curlopt);
 
@@ -152,6 +152,8 @@ static int set_hold_intercept(struct ast_channel *chan)
 		.event_cb = hold_intercept_framehook,
 		.consume_cb = hold_intercept_framehook_consume,
 		.disable_inheritance = 1,
+		.frame_types = AST_FRAMEHOOK_BIT(AST_FRAME_CONTROL),
+		.events = AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_WRITE),
 	};
 	SCOPED_CHANNELLOCK(chan_lock, chan);
 
@@ -1007,6 +1007,7 @@ static void clearvar_prefix(struct ast_channel *chan, const char *prefix)
 		}
 	}
 	AST_LIST_TRAVERSE_SAFE_END
+	ast_channel_varshead_changed(chan);
 }
 
 static int exec_clearhash(struct ast_channel *chan, const char *data)
@@ -1726,12 +1727,12 @@ AST_TEST_DEFINE(test_FIELDNUM)
 			break;
 		}
 
-		AST_LIST_INSERT_HEAD(ast_channel_varshead(chan), var, entries);
+		ast_var_index_insert_head(ast_channel_var_index(chan), ast_channel_varshead(chan), var);
 
 		snprintf(expression, sizeof(expression), "${FIELDNUM(%s,%s,%s)}", var->name, test_args[i].delim, test_args[i].field);
 		ast_str_substitute_variables(&str, 0, chan, expression);
 
-		AST_LIST_REMOVE(ast_channel_varshead(chan), var, entries);
+		ast_var_index_remove(ast_channel_var_index(chan), ast_channel_varshead(chan), var);
 		ast_var_delete(var);
 
 		if (strcasecmp(ast_str_buffer(str), test_args[i].expected)) {
@@ -1796,12 +1797,12 @@ AST_TEST_DEFINE(test_REPLACE)
 			break;
 		}
 
-		AST_LIST_INSERT_HEAD(ast_channel_varshead(chan), var, entries);
+		ast_var_index_insert_head(ast_channel_var_index(chan), ast_channel_varshead(chan), var);
 
 		snprintf(expression, sizeof(expression), "${REPLACE(%s,%s,%s)}", var->name, test_args[i].find_chars, test_args[i].replace_char);
 		ast_str_substitute_variables(&str, 0, chan, expression);
 
-		AST_LIST_REMOVE(ast_channel_varshead(chan), var, entries);
+		ast_var_index_remove(ast_channel_var_index(chan), ast_channel_varshead(chan), var);
 		ast_var_delete(var);
 
 		if (strcasecmp(ast_str_buffer(str), test_args[i].expected)) {
@@ -1905,7 +1906,7 @@ AST_TEST_DEFINE(test_STRREPLACE)
 			return AST_TEST_FAIL;
 		}
 			
-		AST_LIST_INSERT_HEAD(ast_channel_varshead(chan), var, entries);
+		ast_var_index_insert_head(ast_channel_var_index(chan), ast_channel_varshead(chan), var);
 
 		if (test_strings[i][3]) {
 			snprintf(tmp, sizeof(tmp), "${STRREPLACE(%s,%s,%s,%s)}", "test_string", test_strings[i][1], test_strings[i][2], test_strings[i][3]);
@@ -60,6 +60,8 @@ typedef struct agi_command {
 	struct ast_module *mod;
 	/*! Linked list pointer */
 	AST_LIST_ENTRY(agi_command) list;
+	/*! The XML documentation is built when first shown (lazy documentation) \since 14.0.0 */
+	unsigned int docs_pending:1;
 } agi_command;
 
 /*!
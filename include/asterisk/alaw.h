@@ -83,4 +83,45 @@ static inline unsigned char AST_LIN2A(short sample)
 
 #define AST_ALAW(a) (__ast_alaw[(int)(a)])
 
+/*!
+ * \brief Convert a block of signed linear samples to A-law
+ *
+ * Gives the same codes as AST_LIN2A() on each sample, using vector
+ * instructions where the CPU has them.
+ *
+ * \param dst Where to write the A-law samples
+ * \param src The signed linear samples
+ * \param samples Number of samples
+ */
+void ast_alaw_encode(unsigned char *dst, const short *src, size_t samples);
+
+/*!
+ * \brief Convert a block of A-law samples to signed linear
+ *
+ * Gives the same samples as AST_ALAW() on each code, using vector
+ * instructions where the CPU has them.
+ *
+ * \param dst Where to write the signed linear samples
+ * \param src The A-law samples
+ * \param samples Number of samples
+ */
+void ast_alaw_decode(short *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Choose the kernel ast_alaw_encode() and ast_alaw_decode() use
+ *
+ * ast_alaw_init() chooses the best one the CPU has. This is for testing them.
+ *
+ * \param name "c", "sse4.1", "avx2" or "neon"
+ *
+ * \retval 0 on success
+ * \retval -1 if the kernel is not built or the CPU cannot run it
+ */
+int ast_alaw_use_kernel(const char *name);
+
+/*!
+ * \brief Get the name of the kernel ast_alaw_encode() and ast_alaw_decode() use
+ */
+const char *ast_alaw_kernel(void);
+
 #endif /* _ASTERISK_ALAW_H */
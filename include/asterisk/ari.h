@@ -99,6 +99,8 @@ struct ast_ari_response {
 	const char *response_text; /* Shouldn't http.c handle this? */
 	/*! Flag to indicate that no further response is needed */
 	int no_response:1;
+	/*! Response already encoded as JSON, sent instead of \a message */
+	struct ast_str *body;
 };
 
 /*!
@@ -229,6 +231,19 @@ __attribute__((format(printf, 4, 5)));
 void ast_ari_response_ok(struct ast_ari_response *response,
 			     struct ast_json *message);
 
+/*!
+ * \brief Fill in an \c OK (200) \a ast_ari_response with a body already
+ *        encoded as JSON, such as by an \ref ast_json_writer.
+ * \since 14.0.0
+ *
+ * The body must be encoded in the format given by ast_ari_json_format().
+ *
+ * \param response Response to fill in.
+ * \param body JSON encoding of the response. This is stolen.
+ */
+void ast_ari_response_ok_body(struct ast_ari_response *response,
+	struct ast_str *body);
+
 /*!
  * \brief Fill in a <tt>No Content</tt> (204) \a ast_ari_response.
  */
@@ -63,6 +63,7 @@ int ast_db_del(const char *family, const char *key);
  * If both parameters are NULL, the entire database will be purged.  If
  * only keytree is NULL, all entries within the family will be purged.
  * It is an error for keytree to have a value when family is NULL.
+ * The family and key tree are matched exactly, as for ast_db_gettree().
  *
  * \retval -1 An error occurred
  * \retval >= 0 Number of records deleted
@@ -78,6 +79,9 @@ int ast_db_deltree(const char *family, const char *keytree);
  * a slash).  If subkeys do not exist and keytree is specified, the tree will
  * consist of either a single entry or NULL will be returned.
  *
+ * The family and key tree are matched exactly, as a range of keys. Unlike
+ * in releases before 14, '%' and '_' are not wildcards and case matters.
+ *
  * Resulting tree should be freed by passing the return value to ast_db_freetree()
  * when usage is concluded.
  */
@@ -86,6 +90,59 @@ struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree);
 /*! \brief Free structure created by ast_db_gettree() */
 void ast_db_freetree(struct ast_db_entry *entry);
 
+/*!
+ * \brief A position in an astdb tree, for reading it a piece at a time
+ * \since 14.0.0
+ */
+struct ast_db_cursor;
+
+/*!
+ * \brief Start reading a tree a piece at a time
+ * \since 14.0.0
+ *
+ * \param family The family, or NULL for the whole database
+ * \param keytree The key tree within the family, or NULL
+ *
+ * The tree is that ast_db_gettree() would return, read in key order by
+ * ast_db_cursor_next(). Unlike ast_db_gettree(), the database is not held
+ * while the tree is read, so the pieces are not a single snapshot of it.
+ *
+ * \return The cursor, to be closed with ast_db_cursor_close()
+ * \retval NULL on error
+ */
+struct ast_db_cursor *ast_db_cursor_open(const char *family, const char *keytree);
+
+/*!
+ * \brief Start reading the keys of a family that start with a prefix
+ * \since 14.0.0
+ *
+ * \param family The family
+ * \param key_prefix What the keys within the family start with, NULL or
+ * empty for all of them
+ *
+ * \return The cursor, to be closed with ast_db_cursor_close()
+ * \retval NULL on error
+ */
+struct ast_db_cursor *ast_db_cursor_open_by_prefix(const char *family, const char *key_prefix);
+
+/*!
+ * \brief Read the next piece of a tree
+ * \since 14.0.0
+ *
+ * \param cursor The cursor
+ * \param count The most entries to read, or -1 for all that are left
+ *
+ * \return The entries, to be freed with ast_db_freetree()
+ * \retval NULL once every entry has been read
+ */
+struct ast_db_entry *ast_db_cursor_next(struct ast_db_cursor *cursor, int count);
+
+/*!
+ * \brief Stop reading a tree
+ * \since 14.0.0
+ */
+void ast_db_cursor_close(struct ast_db_cursor *cursor);
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
@@ -65,6 +65,14 @@ int __ast_vasprintf(char **strp, const char *format, va_list ap, const char *fil
 void __ast_mm_init_phase_1(void);
 void __ast_mm_init_phase_2(void);
 
+/*!
+ * \brief Get the number of regions the calling thread has allocated
+ *
+ * The difference between two calls is the number of allocations made by
+ * the code run in between, for benchmarks.
+ */
+unsigned long ast_mm_thread_allocations(void);
+
 /*!
  * \brief ASTMM_LIBC can be defined to control the meaning of standard allocators.
  *
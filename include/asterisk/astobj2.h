@@ -1152,6 +1152,68 @@ enum ao2_container_opts {
 	 * ao2_sort_fn.
 	 */
 	AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE = (3 << 1),
+	/*!
+	 * \brief Resize the hash bucket array as objects are added and removed.
+	 * \since 14.0.0
+	 *
+	 * \details The requested number of buckets is the initial and
+	 * minimum size of the container.  The container grows when it
+	 * holds more than two objects per bucket and shrinks when it
+	 * holds less than one object per eight buckets.  The objects
+	 * are moved to their new buckets a few buckets at a time while
+	 * objects are linked and unlinked so there is no pause to
+	 * rehash the whole container.
+	 *
+	 * \note The objects are not moved while the container is being
+	 * traversed or an iterator is positioned in the container.
+	 *
+	 * \note Only hash containers use this option.
+	 */
+	AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE = (1 << 3),
+	/*!
+	 * \brief Search the container by key or object without locking it.
+	 * \since 14.0.0
+	 *
+	 * \details ao2_find() and ao2_callback() searches by
+	 * OBJ_SEARCH_KEY or OBJ_SEARCH_OBJECT that do not unlink and
+	 * return at most one object read snapshots of the hash bucket
+	 * instead of taking the container lock.  Linking and unlinking
+	 * objects still lock the container and publish new snapshots.
+	 * Replaced snapshots are released once every search that could
+	 * be reading them has finished.
+	 *
+	 * \note The search callbacks can run while the container is
+	 * being changed, and can return an object that is being
+	 * unlinked at the same time.
+	 *
+	 * \note Snapshots hold a reference to their objects so an
+	 * unlinked object may be destroyed a little later than it
+	 * would be otherwise.
+	 *
+	 * \note Only hash containers use this option.
+	 */
+	AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND = (1 << 4),
+	/*!
+	 * \brief Give each group of hash buckets its own lock.
+	 * \since 14.0.0
+	 *
+	 * \details Linking objects and ao2_find() or ao2_callback()
+	 * searches by OBJ_SEARCH_KEY or OBJ_SEARCH_OBJECT that return
+	 * at most one object only lock the group of buckets holding
+	 * the key.  Different keys can then be linked, found, and
+	 * unlinked in parallel.  All other operations lock the
+	 * container and then every bucket group in order.
+	 *
+	 * \note Locking the container with ao2_lock() does not stop
+	 * objects from being linked or unlinked by key.
+	 *
+	 * \note The callback of a search by key or object must not
+	 * lock the container or traverse it without a key.
+	 *
+	 * \note Only hash containers with AO2_ALLOC_OPT_LOCK_MUTEX use
+	 * this option.
+	 */
+	AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED = (1 << 5),
 };
 
 /*!
@@ -1330,6 +1392,48 @@ struct ao2_container *__ao2_container_alloc_rbtree(unsigned int ao2_options, uns
 	ao2_sort_fn *sort_fn, ao2_callback_fn *cmp_fn,
 	const char *tag, const char *file, int line, const char *func) attribute_warn_unused_result;
 
+/*!
+ * \brief Allocate and initialize a flat hash container.
+ * \since 14.0.0
+ *
+ * \details
+ * A flat hash container keeps its objects in a single array probed
+ * from the slot the hash value of a key maps to, instead of a linked
+ * list for each bucket.  Each slot keeps the hash value of its object
+ * so lookups only compare objects with the same hash value.  The array
+ * grows and shrinks with the number of objects.  It suits lookup tables
+ * of objects with fixed keys that are searched much more often than
+ * they change.
+ *
+ * \param ao2_options Container ao2 object options (See enum ao2_alloc_opts)
+ * \param container_options Container behaviour options (See enum ao2_container_opts)
+ * \param n_slots Number of objects expected.  The container does not shrink below it.
+ * \param hash_fn Pointer to a function computing a hash value. (NULL if everything has the same hash value.)
+ * \param sort_fn Pointer to a sort function. (NULL if not needed.)
+ * \param cmp_fn Pointer to a compare function used by ao2_find. (NULL to match everything)
+ * \param tag used for debugging.
+ *
+ * \note The objects are not kept in any order.  The sort function is
+ * only used to find objects with the same key for the
+ * AO2_CONTAINER_ALLOC_OPT_DUPS options and to filter searches by key.
+ *
+ * \note The hash options of hash containers are ignored.
+ *
+ * \return A pointer to a struct container.
+ *
+ * \note Destructor is set implicitly.
+ */
+
+#define ao2_t_container_alloc_flat(ao2_options, container_options, n_slots, hash_fn, sort_fn, cmp_fn, tag) \
+	__ao2_container_alloc_flat((ao2_options), (container_options), (n_slots), (hash_fn), (sort_fn), (cmp_fn), (tag),  __FILE__, __LINE__, __PRETTY_FUNCTION__)
+#define ao2_container_alloc_flat(ao2_options, container_options, n_slots, hash_fn, sort_fn, cmp_fn) \
+	__ao2_container_alloc_flat((ao2_options), (container_options), (n_slots), (hash_fn), (sort_fn), (cmp_fn), "",  __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+struct ao2_container *__ao2_container_alloc_flat(unsigned int ao2_options,
+	unsigned int container_options, unsigned int n_slots, ao2_hash_fn *hash_fn,
+	ao2_sort_fn *sort_fn, ao2_callback_fn *cmp_fn,
+	const char *tag, const char *file, int line, const char *func) attribute_warn_unused_result;
+
 /*! \brief
  * Returns the number of elements in a container.
  */
@@ -1355,6 +1459,60 @@ int ao2_container_count(struct ao2_container *c);
  */
 int ao2_container_dup(struct ao2_container *dest, struct ao2_container *src, enum search_flags flags);
 
+/*!
+ * \brief Link an array of objects into a container while holding its lock once.
+ * \since 14.0.0
+ *
+ * \param self Container to link the objects into.
+ * \param objs Objects to link.
+ * \param count Number of objects in objs.
+ * \param flags OBJ_NOLOCK if a lock is already held on the container.
+ *
+ * \details
+ * The objects are linked one after the other with the container and all
+ * of its bucket stripes locked, so searches that lock the container see
+ * either none or all of the objects.  Searches of a container allocated
+ * with AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND do not take the lock
+ * and may find the objects already linked before the call returns.
+ *
+ * \note The objects are not linked as one operation.  If linking an
+ * object fails, the ones before it stay linked and the rest are still
+ * tried, so compare the return value with count.
+ *
+ * \return Number of objects linked.
+ */
+int ao2_container_link_bulk(struct ao2_container *self, void * const *objs, size_t count, enum search_flags flags);
+
+/*!
+ * \brief Exchange the objects of two containers.
+ * \since 14.0.0
+ *
+ * \param self Container to get the objects of other.
+ * \param other Container to get the objects of self.
+ * \param flags OBJ_NOLOCK if a lock is already held on both containers.
+ *    Otherwise, the self container is locked first.
+ *
+ * \details
+ * This is intended for reloads.  The new objects are linked into a
+ * private container, created with ao2_container_clone() or allocated
+ * with the same options as self, without holding the lock of self.
+ * The private container then replaces the contents of self in one
+ * step.  Searches of self see either all of the old objects or all of
+ * the new objects, never a mix.  Unreferencing the private container
+ * afterwards releases the old objects.
+ *
+ * \note The objects of other must be acceptable to self and the
+ * objects of self to other.  If other cannot take the objects of
+ * self, other is returned empty.
+ *
+ * \note A malloc is needed for every object in both containers.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.  The contents of self are unchanged unless
+ * they could not be restored after running out of memory.
+ */
+int ao2_container_swap_contents(struct ao2_container *self, struct ao2_container *other, enum search_flags flags);
+
 /*!
  * \brief Create a clone/copy of the given container.
  * \since 11.0
@@ -1448,6 +1606,10 @@ int ao2_container_check(struct ao2_container *self, enum search_flags flags);
  * \param self Container to register.
  * \param prnt_obj Callback function to print the given object's key. (NULL if not available)
  *
+ * \note Lock, search and bucket statistics of registered containers are
+ * always available from the CLI.  Dumping and checking the contents of a
+ * registered container needs AO2_DEBUG.
+ *
  * \retval 0 on success.
  * \retval -1 on error.
  */
@@ -263,6 +263,28 @@ struct ast_bridge_softmix {
 	 * for itself.
 	 */
 	unsigned int internal_mixing_interval;
+	/*!
+	 * \brief The number of threads softmix uses to write the mixed
+	 * audio to the participants.
+	 *
+	 * \note When set to 0 or 1, the mixing thread writes to every
+	 * participant itself.
+	 */
+	unsigned int mixing_threads;
+	/*!
+	 * \brief The maximum number of talkers softmix mixes together.
+	 *
+	 * \note When set to 0, every participant providing audio is mixed.
+	 * Otherwise the loudest talkers are chosen.
+	 */
+	unsigned int max_talkers;
+	/*!
+	 * \brief The quality of the resamplers between the participants and the mix.
+	 *
+	 * \note When set to 0, the resamplers' default quality is used.
+	 * Otherwise from 1 (cheapest) to 10 (best).
+	 */
+	unsigned int resample_quality;
 };
 
 /*!
@@ -498,6 +520,12 @@ enum ast_bridge_impart_flags {
 	AST_BRIDGE_IMPART_CHAN_INDEPENDENT = (1 << 0),
 	/*! The initial bridge join does not cause a COLP exchange. */
 	AST_BRIDGE_IMPART_INHIBIT_JOIN_COLP = (1 << 1),
+	/*!
+	 * While the channel only passes media, a shared event loop services
+	 * it instead of a thread of its own.  Only used with
+	 * AST_BRIDGE_IMPART_CHAN_INDEPENDENT.
+	 */
+	AST_BRIDGE_IMPART_EVENT_LOOP = (1 << 2),
 };
 
 /*!
@@ -555,6 +583,15 @@ enum ast_bridge_impart_flags {
  * it were placed into the bridge by ast_bridge_join().
  * Channels placed into a bridge by ast_bridge_join() are
  * removed by a third party using ast_bridge_remove().
+ *
+ * \note If you impart a channel with both
+ * AST_BRIDGE_IMPART_CHAN_INDEPENDENT and
+ * AST_BRIDGE_IMPART_EVENT_LOOP, the channel has no thread of its
+ * own while it only passes media.  One of a few event loops reads
+ * and writes its frames.  A thread is created for the channel
+ * again whenever it has to run DTMF or interval hooks, a bridge
+ * action, a control frame, an absolute timeout or is suspended,
+ * and the channel returns to an event loop afterwards.
  */
 int ast_bridge_impart(struct ast_bridge *bridge,
 	struct ast_channel *chan,
@@ -867,6 +904,34 @@ void ast_bridge_set_internal_sample_rate(struct ast_bridge *bridge, unsigned int
  */
 void ast_bridge_set_mixing_interval(struct ast_bridge *bridge, unsigned int mixing_interval);
 
+/*!
+ * \brief Adjust the number of threads writing mixed audio to the
+ * participants of a bridge during multimix mode.
+ *
+ * \param bridge Bridge to change the number of threads on.
+ * \param mixing_threads The number of threads.  If 0 or 1 is set
+ * the mixing thread writes to every participant itself.
+ */
+void ast_bridge_set_mixing_threads(struct ast_bridge *bridge, unsigned int mixing_threads);
+
+/*!
+ * \brief Limit the number of talkers mixed together during multimix mode.
+ *
+ * \param bridge Bridge to change the limit on.
+ * \param max_talkers Only the loudest max_talkers talkers are mixed.  If 0
+ * is set every participant providing audio is mixed.
+ */
+void ast_bridge_set_max_talkers(struct ast_bridge *bridge, unsigned int max_talkers);
+
+/*!
+ * \brief Set the quality of the resamplers used during multimix mode.
+ *
+ * \param bridge Bridge to change the quality on.
+ * \param quality From 1 (cheapest) to 10 (best).  If 0 is set the
+ * resamplers' default quality is used.
+ */
+void ast_bridge_set_resample_quality(struct ast_bridge *bridge, unsigned int quality);
+
 /*!
  * \brief Set a bridge to feed a single video source to all participants.
  */
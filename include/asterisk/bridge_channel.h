@@ -114,7 +114,10 @@ struct ast_bridge_channel {
 	 * technology.
 	 */
 	void *tech_pvt;
-	/*! Thread handling the bridged channel (Needed by ast_bridge_depart) */
+	/*!
+	 * Thread handling the bridged channel (Needed by ast_bridge_depart).
+	 * AST_PTHREADT_NULL while an event loop services the channel.
+	 */
 	pthread_t thread;
 	/* v-- These flags change while the bridge is locked or before the channel is in the bridge. */
 	/*! TRUE if the channel is in a bridge. */
@@ -127,6 +130,8 @@ struct ast_bridge_channel {
 	unsigned int inhibit_colp:1;
 	/*! TRUE if the channel must wait for an ast_bridge_depart to reclaim the channel. */
 	unsigned int depart_wait:1;
+	/*! TRUE if an event loop services the channel while it only passes media. */
+	unsigned int event_loop:1;
 	/* ^-- These flags change while the bridge is locked or before the channel is in the bridge. */
 	/*! Features structure for features that are specific to this channel */
 	struct ast_bridge_features *features;
@@ -145,7 +150,13 @@ struct ast_bridge_channel {
 	AST_LIST_ENTRY(ast_bridge_channel) entry;
 	/*! Queue of outgoing frames to the channel. */
 	AST_LIST_HEAD_NOLOCK(, ast_frame) wr_queue;
-	/*! Pipe to alert thread when frames are put into the wr_queue. */
+	/*!
+	 * \brief Frames queued without locking the bridge channel, newest first.
+	 *
+	 * \note The channel thread moves them to the wr_queue.
+	 */
+	struct ast_frame *wr_incoming;
+	/*! Pipe, or eventfd in both slots, to alert thread when frames are queued. */
 	int alert_pipe[2];
 	/*!
 	 * \brief The bridge channel thread activity.
@@ -374,6 +385,28 @@ void ast_bridge_channel_update_accountcodes(struct ast_bridge_channel *joining,
  */
 int ast_bridge_channel_queue_frame(struct ast_bridge_channel *bridge_channel, struct ast_frame *fr);
 
+/*!
+ * \brief Write a media frame to the channel of a bridge_channel at once if possible.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to write the frame to.
+ * \param fr Frame to write.
+ *
+ * \details
+ * Voice and video frames are written to the channel in the calling thread
+ * when the bridge_channel thread is idle and has nothing queued for the
+ * channel, saving the copy of the frame and waking that thread up.
+ * Otherwise, and for any other frame, the frame is queued as by
+ * ast_bridge_channel_queue_frame() to keep the frames in order.
+ *
+ * \note The bridge must be locked prior to calling this function, as it is
+ * when a bridge technology writes a frame.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+int ast_bridge_channel_queue_frame_direct(struct ast_bridge_channel *bridge_channel, struct ast_frame *fr);
+
 /*!
  * \brief Queue a control frame onto the bridge channel with data.
  * \since 12.0.0
@@ -182,8 +182,13 @@ void bridge_channel_internal_signal(struct bridge_channel_internal_cond *cond);
  * bridge_channel's processing of events while it is in the bridge.  It
  * will return when the channel has been instructed to leave the bridge.
  *
+ * \note If bridge_channel->event_loop is set, the bridge_channel can
+ * be handed to an event loop instead.  The event loop completes it with
+ * bridge_channel_ind_complete() once the channel leaves the bridge.
+ *
  * \retval 0 bridge channel successfully joined the bridge
  * \retval -1 bridge channel failed to join the bridge
+ * \retval 1 bridge channel is serviced by an event loop
  */
 int bridge_channel_internal_join(struct ast_bridge_channel *bridge_channel,
 				 struct bridge_channel_internal_cond *cond);
@@ -63,6 +63,8 @@ enum ast_bridge_channel_feature_flags {
 	AST_BRIDGE_CHANNEL_FLAG_LONELY = (1 << 1),
 	/*! This channel cannot be moved to another bridge. */
 	AST_BRIDGE_CHANNEL_FLAG_IMMOVABLE = (1 << 2),
+	/*! This channel carries the mix of another bridge, so a mixing bridge always mixes it. */
+	AST_BRIDGE_CHANNEL_FLAG_CASCADE = (1 << 3),
 };
 
 /*! \brief Built in DTMF features */
@@ -261,6 +263,8 @@ struct ast_bridge_hook_timer {
 struct ast_bridge_features {
 	/*! Attached DTMF feature hooks */
 	struct ao2_container *dtmf_hooks;
+	/*! Digit trie compiled from dtmf_hooks, NULL until they are next matched. Protected by the dtmf_hooks lock. */
+	struct bridge_dtmf_trie *dtmf_trie;
 	/*! Attached miscellaneous other hooks. */
 	struct ao2_container *other_hooks;
 	/*! Attached interval hooks */
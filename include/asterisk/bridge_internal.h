@@ -216,4 +216,65 @@ void bridge_reconfigured(struct ast_bridge *bridge, unsigned int colp_update);
  */
 void bridge_dissolve(struct ast_bridge *bridge, int cause);
 
+/*!
+ * \internal
+ * \brief Release an independent bridge channel after it left the bridge.
+ * \since 14.0.0
+ *
+ * \param bridge_channel The independent bridge channel.
+ *
+ * \details
+ * Disassociates the bridge_channel from its channel, drops the
+ * bridge_channel and runs the after bridge callback and goto of the
+ * channel.
+ *
+ * \return Nothing
+ */
+void bridge_channel_ind_complete(struct ast_bridge_channel *bridge_channel);
+
+struct ast_bridge_features;
+struct ast_bridge_hook_dtmf;
+
+/*! \brief How collected DTMF digits match the DTMF hooks of a feature set */
+enum bridge_dtmf_match {
+	/*! No hook starts with the digits */
+	BRIDGE_DTMF_MATCH_NONE,
+	/*! Some hooks start with the digits, more are needed */
+	BRIDGE_DTMF_MATCH_PARTIAL,
+	/*! A hook has the digits as its code */
+	BRIDGE_DTMF_MATCH_FULL,
+};
+
+/*!
+ * \internal
+ * \brief Match collected DTMF digits against the DTMF hooks of a feature set.
+ * \since 14.0.0
+ *
+ * \param features Feature set to match against.
+ * \param digits Collected digits.
+ * \param hook Set to the matched hook, with a reference, on a full match.
+ *
+ * \details
+ * The hooks are compiled into a digit trie the first time they are matched
+ * after they changed, so matching costs one step per digit however many
+ * hooks there are.
+ *
+ * \return How the digits match.
+ */
+enum bridge_dtmf_match bridge_features_dtmf_match(struct ast_bridge_features *features,
+	const char *digits, struct ast_bridge_hook_dtmf **hook);
+
+/*!
+ * \internal
+ * \brief Note that the DTMF hooks of a feature set changed.
+ * \since 14.0.0
+ *
+ * \param features Feature set whose dtmf_hooks container was changed.
+ *
+ * \note Must be called after linking or unlinking DTMF hooks directly.
+ *
+ * \return Nothing
+ */
+void bridge_features_dtmf_changed(struct ast_bridge_features *features);
+
 #endif /* _ASTERISK_PRIVATE_BRIDGING_H */
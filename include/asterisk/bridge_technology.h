@@ -55,6 +55,9 @@ struct ast_bridge_tech_optimizations {
 	/*! Whether or not the bridging technology should drop audio
 	 *  detected as silence from the mix. */
 	unsigned int drop_silence:1;
+	/*! Whether or not the channel only listens, so the bridging
+	 *  technology can ignore its audio without examining it. */
+	unsigned int listen_only:1;
 };
 
 /*!
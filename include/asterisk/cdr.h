@@ -55,7 +55,10 @@
  *
  * Dispatching of CDRs occurs to registered CDR backends. CDR backends register
  * through \ref ast_cdr_register and are responsible for taking the produced
- * CDRs and storing them in permanent storage.
+ * CDRs and storing them in permanent storage. Backends that can store many
+ * records at once more cheaply than one at a time may register through
+ * \ref ast_cdr_register_batch instead, to be given each batch whole when batch
+ * mode is enabled.
  *
  * \par CDR attributes
  *
@@ -457,6 +460,20 @@ int ast_cdr_serialize_variables(const char *channel_name, struct ast_str **buf,
  */
 typedef int (*ast_cdrbe)(struct ast_cdr *cdr);
 
+/*!
+ * \brief CDR backend callback for a batch of records
+ * \since 14.0.0
+ *
+ * \param cdrs The records, in the order they were dispatched
+ * \param count The number of records
+ *
+ * \note The records are those that would have been given one at a time to the
+ * \ref ast_cdrbe callback; each one's \c next is not part of the batch.
+ *
+ * \warning As with \ref ast_cdrbe, the channels of the records may not exist.
+ */
+typedef int (*ast_cdrbe_batch)(struct ast_cdr **cdrs, size_t count);
+
 /*! \brief Return TRUE if CDR subsystem is enabled */
 int ast_cdr_is_enabled(void);
 
@@ -509,6 +526,24 @@ void ast_cdr_free(struct ast_cdr *cdr);
  */
 int ast_cdr_register(const char *name, const char *desc, ast_cdrbe be);
 
+/*!
+ * \brief Register a CDR handling engine that can take a batch of records
+ * \since 14.0.0
+ *
+ * \param name name associated with the particular CDR handler
+ * \param desc description of the CDR handler
+ * \param be function pointer to a CDR handler, for records dispatched one at a time
+ * \param batch_be function pointer to a CDR handler, for records dispatched in a batch
+ *
+ * When batch mode is enabled, each batch of records is given to \c batch_be
+ * in one call, so the backend can store them together. Otherwise records are
+ * given to \c be. The backend is unregistered with \ref ast_cdr_unregister.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error
+ */
+int ast_cdr_register_batch(const char *name, const char *desc, ast_cdrbe be, ast_cdrbe_batch batch_be);
+
 /*!
  * \brief Unregister a CDR handling engine
  * \param name name of CDR handler to unregister
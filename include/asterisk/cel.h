@@ -224,6 +224,16 @@ void ast_cel_publish_event(struct ast_channel *chan,
  */
 struct stasis_topic *ast_cel_topic(void);
 
+/*!
+ * \brief What to do with an event for a backend whose queue is full
+ * \since 14.0.0
+ */
+enum ast_cel_backend_overflow {
+	AST_CEL_BACKEND_OVERFLOW_BLOCK = 0,	/*!< Wait for room in the queue */
+	AST_CEL_BACKEND_OVERFLOW_DROP,		/*!< Discard the event */
+	AST_CEL_BACKEND_OVERFLOW_SPOOL,		/*!< Write the event to a file until there is room */
+};
+
 /*! \brief A structure to hold CEL global configuration options */
 struct ast_cel_general_config {
 	AST_DECLARE_STRING_FIELDS(
@@ -231,6 +241,9 @@ struct ast_cel_general_config {
 	);
 	int enable;			/*!< Whether CEL is enabled */
 	int64_t events;			/*!< The events to be logged */
+	unsigned int backend_queue;	/*!< Events each backend may have waiting, or 0 to deliver them synchronously */
+	unsigned int backend_batch;	/*!< Most events given to a backend at once */
+	enum ast_cel_backend_overflow backend_overflow;	/*!< What to do when a backend's queue is full */
 	/*! The apps for which to log app start and end events. This is
 	 * ast_str_container_alloc()ed and filled with ao2-allocated
 	 * char* which are all-lowercase application names. */
@@ -304,11 +317,40 @@ typedef void (*ast_cel_backend_cb)(struct ast_event *event);
  */
 int ast_cel_backend_register(const char *name, ast_cel_backend_cb backend_callback);
 
+/*!
+ * \brief CEL backend callback for a batch of events
+ * \since 14.0.0
+ *
+ * \param events The events, oldest first
+ * \param count The number of events
+ */
+typedef void (*ast_cel_backend_batch_cb)(struct ast_event **events, size_t count);
+
+/*!
+ * \brief Register a CEL backend that can take a batch of events
+ * \since 14.0.0
+ *
+ * \param name Name of backend to register
+ * \param backend_callback Callback for events delivered one at a time
+ * \param batch_callback Callback for events delivered together
+ *
+ * When backends have queues, the events that have built up in this backend's
+ * queue are given to \c batch_callback in one call. Otherwise events are given
+ * to \c backend_callback as they happen.
+ *
+ * \retval zero on success
+ * \retval non-zero on failure
+ */
+int ast_cel_backend_register_batch(const char *name, ast_cel_backend_cb backend_callback,
+	ast_cel_backend_batch_cb batch_callback);
+
 /*!
  * \brief Unregister a CEL backend
  *
  * \param name Name of backend to unregister
  *
+ * \note Events waiting in the backend's queue are delivered before this returns.
+ *
  * \retval zero on success
  * \retval non-zero on failure
  * \since 12
@@ -762,7 +762,6 @@ struct ast_channel_tech {
 /*! Kill the channel channel driver technology descriptor. */
 extern const struct ast_channel_tech ast_kill_tech;
 
-struct ast_epoll_data;
 
 /*!
  * The high bit of the frame count is used as a debug marker, so
@@ -2208,6 +2207,21 @@ void ast_channel_undefer_dtmf(struct ast_channel *chan);
 /*! \return number of channels available for lookup */
 int ast_active_channels(void);
 
+/*!
+ * \brief Set how many destroyed channels are kept to build new ones
+ * \since 14.0.0
+ *
+ * The parts of a channel costly to make, such as its string field pool,
+ * scheduler context, timer and alertpipe, are scrubbed and kept when it is
+ * destroyed, and a new channel is built from them. The channel_pool option
+ * of asterisk.conf sets the size at startup.
+ *
+ * \param size Most channels kept, 0 to stop recycling channels
+ *
+ * \return The previous size
+ */
+int ast_channel_pool_size_set(int size);
+
 /*! \return the number of channels not yet destroyed */
 int ast_undestroyed_channels(void);
 
@@ -2279,10 +2293,19 @@ void ast_channel_set_caller_event(struct ast_channel *chan, const struct ast_par
 /*! Set the file descriptor on the channel */
 void ast_channel_set_fd(struct ast_channel *chan, int which, int fd);
 
-/*! Add a channel to an optimized waitfor */
+/*!
+ * \brief Add a channel to an optimized waitfor
+ *
+ * \note Does nothing. ast_waitfor_nandfds() keeps the file descriptors of
+ * the channels a thread waits on registered by itself.
+ */
 void ast_poll_channel_add(struct ast_channel *chan0, struct ast_channel *chan1);
 
-/*! Delete a channel from an optimized waitfor */
+/*!
+ * \brief Delete a channel from an optimized waitfor
+ *
+ * \note Does nothing. See ast_poll_channel_add().
+ */
 void ast_poll_channel_del(struct ast_channel *chan0, struct ast_channel *chan1);
 
 /*! Start a tone going */
@@ -2670,6 +2693,27 @@ struct ast_channel_iterator *ast_channel_iterator_destroy(struct ast_channel_ite
  */
 struct ast_channel_iterator *ast_channel_iterator_by_exten_new(const char *exten, const char *context);
 
+/*!
+ * \brief Create a new channel iterator based on spy group
+ *
+ * \param groups The groups, separated by ':' as in the SPYGROUP variable
+ *
+ * \details
+ * After creating an iterator using this function, the ast_channel_iterator_next()
+ * function can be used to iterate through the channels whose SPYGROUP variable
+ * may name one of the groups. The iterator may return channels in none of
+ * them, so the caller must still check SPYGROUP; it returns every channel
+ * that is in one of them.
+ *
+ * \note You must call ast_channel_iterator_destroy() when done.
+ *
+ * \retval NULL on failure
+ * \retval a new channel iterator based on the specified parameters
+ *
+ * \since 14.0.0
+ */
+struct ast_channel_iterator *ast_channel_iterator_by_spygroup_new(const char *groups);
+
 /*!
  * \brief Create a new channel iterator based on name
  *
@@ -2692,6 +2736,25 @@ struct ast_channel_iterator *ast_channel_iterator_by_exten_new(const char *exten
  */
 struct ast_channel_iterator *ast_channel_iterator_by_name_new(const char *name,	size_t name_len);
 
+/*!
+ * \brief Create a new channel iterator based on linkedid
+ *
+ * \param linkedid The linkedid to match
+ *
+ * \details
+ * After creating an iterator using this function, the ast_channel_iterator_next()
+ * function can be used to iterate through all channels that exist that have
+ * the specified linkedid.
+ *
+ * \note You must call ast_channel_iterator_destroy() when done.
+ *
+ * \retval NULL on failure
+ * \retval a new channel iterator based on the specified parameters
+ *
+ * \since 14.0.0
+ */
+struct ast_channel_iterator *ast_channel_iterator_by_linkedid_new(const char *linkedid);
+
 /*!
  * \brief Create a new channel iterator
  *
@@ -3979,8 +4042,6 @@ enum ama_flags ast_channel_amaflags(const struct ast_channel *chan);
  * \pre chan is locked
  */
 void ast_channel_amaflags_set(struct ast_channel *chan, enum ama_flags value);
-int ast_channel_epfd(const struct ast_channel *chan);
-void ast_channel_epfd_set(struct ast_channel *chan, int value);
 int ast_channel_fdno(const struct ast_channel *chan);
 void ast_channel_fdno_set(struct ast_channel *chan, int value);
 int ast_channel_hangupcause(const struct ast_channel *chan);
@@ -4118,6 +4179,30 @@ void ast_channel_dtmf_tv_set(struct ast_channel *chan, struct timeval *value);
  */
 void ast_channel_whentohangup_set(struct ast_channel *chan, struct timeval *value);
 void ast_channel_varshead_set(struct ast_channel *chan, struct varshead *value);
+
+/*!
+ * \brief Get the lookup index of the channel variables
+ * \since 14.0.0
+ *
+ * \note Pass it to the ast_var_index_*() functions along with
+ * ast_channel_varshead() to find, insert and remove channel variables.
+ *
+ * \pre chan is locked
+ */
+struct ast_var_index *ast_channel_var_index(struct ast_channel *chan);
+void ast_channel_var_index_set(struct ast_channel *chan, struct ast_var_index *value);
+
+/*!
+ * \brief Tell the channel its variables were changed directly
+ * \since 14.0.0
+ *
+ * \details Code inserting into or removing from ast_channel_varshead()
+ * with the list macros must call this afterwards, while still holding
+ * the channel lock.
+ *
+ * \pre chan is locked
+ */
+void ast_channel_varshead_changed(struct ast_channel *chan);
 struct timeval ast_channel_creationtime(struct ast_channel *chan);
 void ast_channel_creationtime_set(struct ast_channel *chan, struct timeval *value);
 struct timeval ast_channel_answertime(struct ast_channel *chan);
@@ -4172,11 +4257,14 @@ void ast_channel_internal_fd_set(struct ast_channel *chan, int which, int value)
 int ast_channel_fd(const struct ast_channel *chan, int which);
 int ast_channel_fd_isset(const struct ast_channel *chan, int which);
 
-/* epoll data internal accessors */
-#ifdef HAVE_EPOLL
-struct ast_epoll_data *ast_channel_internal_epfd_data(const struct ast_channel *chan, int which);
-void ast_channel_internal_epfd_data_set(struct ast_channel *chan, int which , struct ast_epoll_data *value);
-#endif
+/*!
+ * \brief Version of the file descriptors of a channel.
+ * \since 14.0.0
+ *
+ * The version changes whenever a file descriptor of the channel is set,
+ * and no two channels ever have the same version.
+ */
+uint64_t ast_channel_internal_fd_version(const struct ast_channel *chan);
 
 pthread_t ast_channel_blocker(const struct ast_channel *chan);
 void ast_channel_blocker_set(struct ast_channel *chan, pthread_t value);
@@ -4307,10 +4395,15 @@ struct varshead *ast_channel_get_vars(struct ast_channel *chan);
  *
  * If the given \a chan is \c NULL, ast_channel_topic_all() is returned.
  *
+ * The topics of a channel are created the first time this or
+ * ast_channel_topic_cached() is called for it, so this is for subscribing
+ * to the channel. Publish with ast_channel_publish_message() instead.
+ *
  * \param chan Channel, or \c NULL.
  *
  * \retval Topic for channel's events.
  * \retval ast_channel_topic_all() if \a chan is \c NULL.
+ * \retval NULL if the topic could not be created.
  */
 struct stasis_topic *ast_channel_topic(struct ast_channel *chan);
 
@@ -4329,6 +4422,24 @@ struct stasis_topic *ast_channel_topic(struct ast_channel *chan);
  */
 struct stasis_topic *ast_channel_topic_cached(struct ast_channel *chan);
 
+/*!
+ * \since 14.0.0
+ * \brief Publish a message for a channel
+ *
+ * The message is published to the channel's topic if it has been created,
+ * and otherwise straight to the topics that one forwards to:
+ * ast_channel_topic_all() and the topic of the channel's endpoint.
+ *
+ * Channel snapshots and their cache clears also update the channel cache,
+ * and the resulting \ref stasis_cache_update is published the same way on
+ * the cached topics. They must be published with this function, not with
+ * stasis_publish() to ast_channel_topic(), to be cached.
+ *
+ * \param chan Channel, or \c NULL to publish to ast_channel_topic_all().
+ * \param message The message to publish.
+ */
+void ast_channel_publish_message(struct ast_channel *chan, struct stasis_message *message);
+
 /*!
  * \brief Get the bridge associated with a channel
  * \since 12.0.0
@@ -4467,6 +4578,10 @@ int ast_channel_move(struct ast_channel *dest, struct ast_channel *source);
  * \since 12
  * \brief Forward channel stasis messages to the given endpoint
  *
+ * The messages of a channel are only forwarded from its topic once that is
+ * created, see ast_channel_topic(). Until then they are published to the
+ * endpoint's topic directly.
+ *
  * \param chan The channel to forward from
  * \param endpoint The endpoint to forward to
  *
@@ -4609,4 +4724,105 @@ int ast_channel_feature_hooks_append(struct ast_channel *chan, struct ast_bridge
  */
 int ast_channel_feature_hooks_replace(struct ast_channel *chan, struct ast_bridge_features *features);
 
+/*!
+ * \brief Milestones in the setup of a call, in the order they are reached
+ * \since 14.0.0
+ *
+ * The time between a stage and the previous one reached is the time the
+ * call spent getting there, e.g. from AST_CHANNEL_SETUP_DIALPLAN to
+ * AST_CHANNEL_SETUP_DIAL is the dialplan and the lookups it did.
+ */
+enum ast_channel_setup_stage {
+	/*! The request that created the call was read from the network */
+	AST_CHANNEL_SETUP_RECEIVED,
+	/*! The request was taken off the serializer queue it was distributed to */
+	AST_CHANNEL_SETUP_DISTRIBUTED,
+	/*! The endpoint the request came from was identified */
+	AST_CHANNEL_SETUP_IDENTIFIED,
+	/*! The request was authenticated, or did not need to be */
+	AST_CHANNEL_SETUP_AUTHENTICATED,
+	/*! The session of the call started on its own serializer */
+	AST_CHANNEL_SETUP_SESSION,
+	/*! The channel was allocated */
+	AST_CHANNEL_SETUP_CREATED,
+	/*! The channel started executing the dialplan */
+	AST_CHANNEL_SETUP_DIALPLAN,
+	/*! The channel started dialing out */
+	AST_CHANNEL_SETUP_DIAL,
+	/*! A dialed channel indicated ringing or progress */
+	AST_CHANNEL_SETUP_RINGING,
+	/*! A dialed channel answered */
+	AST_CHANNEL_SETUP_ANSWERED,
+	AST_CHANNEL_SETUP_STAGE_MAX,
+};
+
+/*!
+ * \brief Times the stages of the setup of a call were reached
+ * \since 14.0.0
+ *
+ * Zero for stages not reached. Code handling a call before its channel
+ * exists records the stages in one of these and merges it into the
+ * channel with ast_channel_setup_times_merge().
+ */
+struct ast_channel_setup_times {
+	struct timeval stage[AST_CHANNEL_SETUP_STAGE_MAX];
+};
+
+/*!
+ * \brief Get the name of a call setup stage
+ * \since 14.0.0
+ *
+ * \param stage The stage
+ *
+ * \return The lower case name of the stage, e.g. "dialplan"
+ */
+const char *ast_channel_setup_stage_name(enum ast_channel_setup_stage stage);
+
+/*!
+ * \brief Record the current time for a call setup stage
+ * \since 14.0.0
+ *
+ * \param times Where the stage is recorded
+ * \param stage The stage reached
+ *
+ * \note Only the first time a stage is reached is kept.
+ */
+void ast_setup_times_mark(struct ast_channel_setup_times *times, enum ast_channel_setup_stage stage);
+
+/*!
+ * \brief Record the current time for a setup stage of a channel
+ * \since 14.0.0
+ *
+ * \param chan The channel
+ * \param stage The stage reached
+ *
+ * \note Only the first time a stage is reached is kept.
+ * \note The channel is locked by this function.
+ */
+void ast_channel_setup_stage_mark(struct ast_channel *chan, enum ast_channel_setup_stage stage);
+
+/*!
+ * \brief Add the setup stages recorded before a channel existed to it
+ * \since 14.0.0
+ *
+ * \param chan The channel
+ * \param times The stages recorded, those the channel has already reached are ignored
+ *
+ * \note The channel is locked by this function.
+ */
+void ast_channel_setup_times_merge(struct ast_channel *chan, const struct ast_channel_setup_times *times);
+
+/*!
+ * \brief Write the setup stages a channel reached
+ * \since 14.0.0
+ *
+ * \param chan The channel, locked
+ * \param buf Buffer the stages are written to, replacing its contents
+ *
+ * The stages are written as a comma separated list of stage=seconds,
+ * where seconds is the time from the first stage the channel reached,
+ * e.g. "received=0.000,distributed=0.002,created=0.004".
+ */
+void ast_channel_setup_times_str(struct ast_channel *chan, struct ast_str **buf);
+
 #endif /* _ASTERISK_CHANNEL_H */
@@ -23,5 +23,30 @@ struct ast_channel *__ast_channel_internal_alloc(void (*destructor)(void *obj),
 void ast_channel_internal_finalize(struct ast_channel *chan);
 int ast_channel_internal_is_finalized(struct ast_channel *chan);
 void ast_channel_internal_cleanup(struct ast_channel *chan);
-int ast_channel_internal_setup_topics(struct ast_channel *chan);
+
+/*!
+ * \brief Keep the reusable parts of a channel being destroyed in a shell
+ * \note The parts kept are detached from the channel, the string fields and
+ * dialed causes follow in ast_channel_internal_cleanup().
+ */
+void ast_channel_internal_recycle(struct ast_channel *chan);
+/*! \brief Give a new channel the scheduler context, timer and alertpipe of its shell, if any */
+void ast_channel_internal_shell_restore(struct ast_channel *chan);
+/*! \brief Get the size of the pool of recycled channel shells, the shells in it and the shells reused */
+void ast_channel_pool_stats(int *size, int *count, unsigned int *reused);
+
+struct ast_channel_snapshot;
+struct ast_channel_snapshot *ast_channel_internal_snapshot(const struct ast_channel *chan);
+void ast_channel_internal_snapshot_set(struct ast_channel *chan, struct ast_channel_snapshot *snapshot);
+struct ast_channel_setup_times *ast_channel_internal_setup_times(struct ast_channel *chan);
+
+struct ast_datastore_index;
+struct ast_datastore_index *ast_channel_internal_datastore_index(const struct ast_channel *chan);
+void ast_channel_internal_datastore_index_set(struct ast_channel *chan, struct ast_datastore_index *value);
+struct ast_channel_index;
+struct ast_channel_index *ast_channel_internal_index(const struct ast_channel *chan);
+void ast_channel_internal_index_set(struct ast_channel *chan, struct ast_channel_index *value);
+void ast_channel_internal_index_exten_update(struct ast_channel *chan);
+void ast_channel_internal_index_linkedid_update(struct ast_channel *chan);
+void ast_channel_internal_index_spygroup_update(struct ast_channel *chan);
 
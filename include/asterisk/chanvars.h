@@ -33,6 +33,60 @@ struct ast_var_t {
 
 AST_LIST_HEAD_NOLOCK(varshead, ast_var_t);
 
+/*!
+ * \brief Hash index over the variables of a list
+ *
+ * A list of variables is always searched from its head, so a variable
+ * hides any later variable of the same name.  Once a list holds enough
+ * variables, an index maps each name to the variable a search would find.
+ * The list keeps its order, and the index is only used while the list it
+ * was built for hasn't changed behind its back.
+ */
+struct ast_var_index;
+
+struct ast_var_index *ast_var_index_alloc(void);
+void ast_var_index_destroy(struct ast_var_index *index);
+
+/*!
+ * \brief Forget the contents of an index
+ *
+ * \param index Index to reset, may be NULL.
+ *
+ * \note Must be called after variables are removed from or inserted into
+ * the indexed list without ast_var_index_insert_head() and
+ * ast_var_index_remove().
+ */
+void ast_var_index_reset(struct ast_var_index *index);
+
+/*!
+ * \brief Find the first variable of a list with a name
+ *
+ * \param index Index of the list, may be NULL.
+ * \param head List to search.
+ * \param name Name without the inheritance underscores.
+ *
+ * \return The variable, NULL if not found.
+ */
+struct ast_var_t *ast_var_index_find(struct ast_var_index *index, const struct varshead *head, const char *name);
+
+/*!
+ * \brief Insert a variable at the head of an indexed list
+ *
+ * \param index Index of the list, may be NULL.
+ * \param head List to insert into.
+ * \param var Variable to insert, may be NULL.
+ */
+void ast_var_index_insert_head(struct ast_var_index *index, struct varshead *head, struct ast_var_t *var);
+
+/*!
+ * \brief Remove a variable from an indexed list
+ *
+ * \param index Index of the list, may be NULL.
+ * \param head List to remove from.
+ * \param var Variable to remove.
+ */
+void ast_var_index_remove(struct ast_var_index *index, struct varshead *head, struct ast_var_t *var);
+
 struct varshead *ast_var_list_create(void);
 void ast_var_list_destroy(struct varshead *head);
 #ifdef MALLOC_DEBUG
@@ -747,8 +747,37 @@ int ast_realtime_is_mapping_defined(const char *family);
  * \param priority Priority of this mapping
  */
 int ast_realtime_append_mapping(const char *name, const char *driver, const char *database, const char *table, int priority);
+
+/*!
+ * \brief Cache the lookups of a family
+ *
+ * \param family Family name
+ * \param ttl Seconds a result is kept
+ * \param max Most results kept
+ * \param negative_ttl Seconds a lookup that found nothing is kept, 0 not to keep them
+ *
+ * \since 14.0.0
+ */
+int ast_realtime_append_cache(const char *family, unsigned int ttl, unsigned int max, unsigned int negative_ttl);
 #endif
 
+/*!
+ * \brief Drop the results kept by the realtime cache of a family
+ *
+ * Families are cached as set in the [cache] section of extconfig.conf.
+ * Writes through ast_update_realtime(), ast_store_realtime() and the like
+ * flush the cache of their family themselves, so this is only needed when
+ * the backend is changed some other way.
+ *
+ * \param family Family name, or NULL for all families
+ *
+ * \retval 0 on success
+ * \retval -1 if there is no such cache
+ *
+ * \since 14.0.0
+ */
+int ast_realtime_cache_flush(const char *family);
+
 /*!
  * \brief Exposed initialization method for core process
  *
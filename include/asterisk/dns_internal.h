@@ -133,6 +133,12 @@ struct ast_dns_query {
 	int rr_type;
 	/*! \brief Resource record class */
 	int rr_class;
+	/*! \brief The cache entry whose result the query waits for, if any */
+	struct dns_cache_entry *cache_entry;
+	/*! \brief Scheduler id of the delivery of a cached result, or -1 */
+	int cache_sched;
+	/*! \brief Whether the DNS cache, rather than the resolver, is answering the query */
+	unsigned int cached;
 	/*! \brief The name of what is being resolved */
 	char name[0];
 };
@@ -293,3 +299,27 @@ int dns_parse_string(char *cur, uint8_t *size, char **val);
  * \note The query must be released upon completion or cancellation using ao2_ref
  */
 struct ast_dns_query *dns_query_alloc(const char *name, int rr_type, int rr_class, ast_dns_resolve_callback callback, void *data);
+
+/*!
+ * \brief Start resolution of a DNS query
+ *
+ * The query is answered from the DNS cache if it holds a result, or waits
+ * for an identical query already in progress. Otherwise it is passed to its
+ * resolver.
+ *
+ * \param query The query, as allocated by dns_query_alloc()
+ *
+ * \retval 0 success, the callback of the query will be invoked
+ * \retval -1 failure
+ */
+int dns_query_resolve(struct ast_dns_query *query);
+
+/*!
+ * \brief Cancel resolution of a DNS query started with dns_query_resolve()
+ *
+ * \param query The query
+ *
+ * \retval 0 success, the callback of the query will not be invoked
+ * \retval -1 failure
+ */
+int dns_query_cancel(struct ast_dns_query *query);
@@ -183,4 +183,24 @@ int ast_dsp_reload(void);
  */
 int ast_dsp_init(void);
 
+/*!
+ * \brief Choose the kernel the tone detectors and energy sums use
+ *
+ * ast_dsp_init() chooses the best vector kernel the CPU has. This is for
+ * testing and benchmarking them. Every kernel gives the same results.
+ *
+ * \param name "c", "sse2", "avx2" or "neon"
+ *
+ * \retval 0 on success
+ * \retval -1 if the kernel is not built or the CPU cannot run it
+ * \since 14.0.0
+ */
+int ast_dsp_use_kernel(const char *name);
+
+/*!
+ * \brief Get the name of the kernel the tone detectors and energy sums use
+ * \since 14.0.0
+ */
+const char *ast_dsp_kernel(void);
+
 #endif /* _ASTERISK_DSP_H */
@@ -110,6 +110,27 @@ int ast_stopstream(struct ast_channel *c);
  */
 int ast_fileexists(const char *filename, const char *fmt, const char *preflang);
 
+/*!
+ * \brief Read a file ahead of its playback
+ * \since 14.0.0
+ *
+ * \param chan The channel the file will be played on, or NULL
+ * \param filename name of the file, minus the extension
+ * \param preflang the preferred language to find the file in
+ *
+ * The file is found in the same language and format as ast_openstream()
+ * would find it for the channel, or in every format when chan is NULL.
+ * What is found, and the file itself when there is room for it, is kept
+ * so that the playback does not wait on the filesystem.
+ *
+ * \note This may block on the filesystem, so it should not be called
+ * from the thread of the channel.
+ *
+ * \retval 0 The file was found
+ * \retval -1 The file does not exist
+ */
+int ast_file_prefetch(struct ast_channel *chan, const char *filename, const char *preflang);
+
 /*! 
  * \brief Renames a file 
  * \param oldname the name of the file you wish to act upon (minus the extension)
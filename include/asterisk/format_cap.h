@@ -280,6 +280,36 @@ int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struc
  */
 int ast_format_cap_iscompatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2);
 
+/*!
+ * \brief Get the interned capabilities structure with the same formats as another
+ * \since 14.0.0
+ *
+ * Interned capabilities are shared and can't be changed, any attempt fails.
+ * ast_format_cap_get_compatible() and ast_format_cap_iscompatible() remember
+ * their result for each pair of interned capabilities, so that negotiating
+ * between the same few sets again and again compares the formats once.
+ *
+ * \param cap The capabilities structure, interned or not. It is not changed
+ * and the caller keeps its reference.
+ *
+ * \return The interned capabilities with a reference, NULL on error
+ *
+ * \note Formats are compared by identity, which is the case of formats from
+ * the format cache. Capabilities with equal but distinct formats are interned
+ * separately.
+ */
+struct ast_format_cap *ast_format_cap_intern(struct ast_format_cap *cap);
+
+/*!
+ * \brief Get the identifier of an interned capabilities structure
+ * \since 14.0.0
+ *
+ * \param cap The capabilities structure
+ *
+ * \return A non-zero identifier unique to the interned capabilities, 0 if not interned
+ */
+unsigned int ast_format_cap_get_intern_id(const struct ast_format_cap *cap);
+
 /*!
  * \brief Determine if two capabilities structures are identical
  *
@@ -310,6 +340,15 @@ int ast_format_cap_has_type(const struct ast_format_cap *cap, enum ast_media_typ
  */
 const char *ast_format_cap_get_names(struct ast_format_cap *cap, struct ast_str **buf);
 
+/*!
+ * \brief Initialize the interning of capabilities
+ * \since 14.0.0
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+int ast_format_cap_init(void);
+
 #ifndef AST_FORMAT_CAP_NAMES_LEN
 /*! Buffer size for callers of ast_format_cap_get_names to allocate. */
 #define AST_FORMAT_CAP_NAMES_LEN 384
@@ -177,6 +177,12 @@ struct ast_frame {
 	long len;
 	/*! Sequence number */
 	int seqno;
+	/*!
+	 * Refcounted buffer holding data and src when AST_MALLOCD_SHARED is set.
+	 * A channel driver may set it on a frame with a static header, giving
+	 * whoever frees the frame a reference to the buffer its data is in.
+	 */
+	void *shared;
 };
 
 /*!
@@ -217,6 +223,8 @@ extern struct ast_frame ast_null_frame;
 #define AST_MALLOCD_DATA	(1 << 1)
 /*! Need the source be free'd? (haha!) */
 #define AST_MALLOCD_SRC		(1 << 2)
+/*! Are the data and source in a shared buffer the frame holds a reference to? */
+#define AST_MALLOCD_SHARED	(1 << 3)
 
 /* MODEM subclasses */
 /*! T.38 Fax-over-IP */
@@ -537,7 +545,10 @@ void ast_frame_dtor(struct ast_frame *frame);
  * Take a frame, and if it's not been malloc'd, make a malloc'd copy
  * and if the data hasn't been malloced then make the
  * data malloc'd.  If you need to store frames, say for queueing, then
- * you should call this function.
+ * you should call this function. A frame shared with \ref ast_frshare
+ * is already independent and is returned as is. A frame with a static
+ * header holding a shared buffer gets a header of its own, sharing the
+ * buffer instead of copying the data.
  * \return Returns a frame on success, NULL on error
  * \note This function may modify the frame passed to it, so you must
  * not assume the frame will be intact after the isolated frame has
@@ -554,6 +565,43 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr);
  */
 struct ast_frame *ast_frdup(const struct ast_frame *fr);
 
+/*!
+ * \brief Copies a frame, sharing its data with the copy
+ * \since 14.0.0
+ *
+ * \param fr frame to copy
+ *
+ * Voice, video and image frames are copied without their data. The copy
+ * holds a reference to a buffer with the data instead, which the frames
+ * shared from it hold as well. Sharing a frame which is not shared yet
+ * copies its data into a new buffer once. Other frames are duplicated
+ * with \ref ast_frdup.
+ *
+ * Use this to queue the same frame to several recipients.
+ *
+ * \note The data of a shared frame must not be modified, and there is no
+ * space before the data (the offset is zero). Call \ref ast_frame_unshare
+ * before modifying it.
+ *
+ * \return Returns a frame on success, NULL on error
+ */
+struct ast_frame *ast_frshare(const struct ast_frame *fr);
+
+/*!
+ * \brief Gives a shared frame its own copy of the data
+ * \since 14.0.0
+ *
+ * \param fr frame to act upon
+ *
+ * The data is copied with \ref AST_FRIENDLY_OFFSET bytes of space before it
+ * and the reference to the shared buffer is released. Frames which are not
+ * shared are left alone.
+ *
+ * \retval 0 on success
+ * \retval -1 on error, the frame stays shared
+ */
+int ast_frame_unshare(struct ast_frame *fr);
+
 void ast_swapcopy_samples(void *dst, const void *src, int samples);
 
 /* Helpers for byteswapping native samples to/from
@@ -224,7 +224,14 @@ typedef int (*ast_framehook_consume_callback)(void *data, enum ast_frame_type ty
 typedef void (*ast_framehook_chan_fixup_callback)(void *data, int framehook_id,
 	struct ast_channel *old_chan, struct ast_channel *new_chan);
 
-#define AST_FRAMEHOOK_INTERFACE_VERSION 4
+/*!
+ * \brief Bit of a frame type or event in the frame_types and events masks
+ * of struct ast_framehook_interface
+ * \since 14.0.0
+ */
+#define AST_FRAMEHOOK_BIT(value) (1U << (value))
+
+#define AST_FRAMEHOOK_INTERFACE_VERSION 5
 /*! This interface is required for attaching a framehook to a channel. */
 struct ast_framehook_interface {
 	/*! framehook interface version number */
@@ -253,6 +260,15 @@ struct ast_framehook_interface {
 	 * data pointer will be provided during each event callback which allows the framehook
 	 * to store any stateful data associated with the application using the hook. */
 	void *data;
+	/*! frame_types is optional. If set, only frames of these types are passed to the event
+	 * callback in read and write events, e.g. AST_FRAMEHOOK_BIT(AST_FRAME_CONTROL). When no
+	 * framehook on a channel wants a frame the list is not walked at all. NULL frames are
+	 * always passed. */
+	unsigned int frame_types;
+	/*! events is optional. If set, only these of the read and write events are passed to the
+	 * event callback, e.g. AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_WRITE). The attached and
+	 * detached events are always passed. */
+	unsigned int events;
 };
 
 /*!
@@ -390,4 +406,19 @@ int ast_framehook_list_contains_no_active(struct ast_framehook_list *framehooks)
 int ast_framehook_list_contains_no_active_of_type(struct ast_framehook_list *framehooks,
 	enum ast_frame_type type);
 
+/*!
+ * \brief Determine if a framehook list would pass a type of frame to any framehook
+ * \since 14.0.0
+ * \pre The channel must be locked during this function call.
+ *
+ * \param framehooks the framehook list
+ * \param event AST_FRAMEHOOK_EVENT_READ or AST_FRAMEHOOK_EVENT_WRITE
+ * \param type The type of frame
+ *
+ * \retval 0, pushing such a frame to the list would return it untouched
+ * \retval 1, a framehook wants such frames or the list has dying framehooks to detach
+ */
+int ast_framehook_list_wants_frame_type(struct ast_framehook_list *framehooks,
+	enum ast_framehook_event event, enum ast_frame_type type);
+
 #endif /* _AST_FRAMEHOOK_H */
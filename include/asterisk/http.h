@@ -200,6 +200,41 @@ void ast_http_send(struct ast_tcptls_session_instance *ser, enum ast_http_method
 	int status_code, const char *status_title, struct ast_str *http_header,
 	struct ast_str *out, int fd, unsigned int static_content);
 
+/*!
+ * \brief Send a file in response to a GET or HEAD request.
+ * \param ser TCP/TLS session object
+ * \param method GET/HEAD
+ * \param headers The request headers
+ * \param http_header An ast_str object containing extra headers, such as Content-type, or NULL
+ * \param fd The file to send
+ * \param static_content Zero if the file should not be cached; nonzero otherwise
+ *
+ * \note The response carries an ETag made from the size and modification
+ * time of the file, and a Last-Modified header. A request whose If-None-Match
+ * matches the ETag is answered with 304, and a request with a single byte
+ * range in a Range header with that part of the file. On connections without
+ * TLS the file is sent with sendfile(), where available.
+ *
+ * The http_header argument is freed by this function; the file remains open.
+ *
+ * \since 14.0.0
+ */
+void ast_http_send_file(struct ast_tcptls_session_instance *ser, enum ast_http_method method,
+	struct ast_variable *headers, struct ast_str *http_header, int fd,
+	unsigned int static_content);
+
+/*!
+ * \brief Check whether the If-None-Match header of a request matches an ETag.
+ * \param headers The request headers
+ * \param etag The ETag of the content, quotes included
+ *
+ * \retval 1 The client has the content, so a 304 response may be sent.
+ * \retval 0 It does not.
+ *
+ * \since 14.0.0
+ */
+int ast_http_etag_match(struct ast_variable *headers, const char *etag);
+
 /*!
  * \brief Creates and sends a formatted http response message.
  * \param ser                   TCP/TLS session object
@@ -434,4 +434,35 @@ AST_OPTIONAL_API(const char *, ast_websocket_client_accept_protocol,
  */
 AST_OPTIONAL_API(int, ast_websocket_set_timeout, (struct ast_websocket *session, int timeout), {return -1;});
 
+/*!
+ * \brief Offer permessage-deflate (RFC 7692) on new sessions of a \ref websocket_server.
+ *
+ * \param server The server
+ * \param enabled Non-zero to accept a client's offer of compression
+ *
+ * Messages sent and received on a session that negotiated compression are
+ * compressed transparently. This has no effect if Asterisk was built without
+ * zlib.
+ *
+ * \since 14.0.0
+ */
+AST_OPTIONAL_API(void, ast_websocket_server_set_deflate, (struct ast_websocket_server *server, int enabled), {return;});
+
+/*!
+ * \brief Coalesce the text and binary frames written to a WebSocket session.
+ *
+ * Frames written within \a ms milliseconds of each other are sent together in
+ * one write to the socket. Control frames are sent at once, along with any
+ * frames still waiting.
+ *
+ * \param session The session
+ * \param ms How long a frame may wait, 0 to send each frame at once
+ *
+ * \since 14.0.0
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+AST_OPTIONAL_API(int, ast_websocket_set_coalesce, (struct ast_websocket *session, int ms), {return -1;});
+
 #endif
@@ -151,6 +151,51 @@ void *ast_json_malloc(size_t size);
  */
 void ast_json_free(void *p);
 
+/*!
+ * \brief Allocate JSON from the calling thread's arena
+ * \since 14.0.0
+ *
+ * Until the matching ast_json_arena_end(), JSON values the thread creates,
+ * copies or dumps are allocated from an arena of large chunks instead of
+ * one heap block and mutex each. Freeing them costs nothing and the chunks
+ * are released in one step at the end. Use this around JSON that is built
+ * for serialization and then thrown away.
+ *
+ * Everything allocated in the scope must be unreferenced or freed before it
+ * ends, and must not be passed to other threads or kept, e.g. in a cache or
+ * a stasis message. Values from outside the scope may be referenced, but
+ * must not be modified in it. A chunk still in use at the end is leaked
+ * with an error rather than released.
+ *
+ * Scopes nest; only the outermost one releases the arena.
+ */
+void ast_json_arena_begin(void);
+
+/*!
+ * \brief End a scope started with ast_json_arena_begin()
+ * \since 14.0.0
+ */
+void ast_json_arena_end(void);
+
+/*!
+ * \brief Allocate JSON from the heap again within an arena scope
+ * \since 14.0.0
+ *
+ * For JSON that outlives the scope, such as a representation that is
+ * cached. Must be followed by ast_json_arena_resume().
+ *
+ * \return What to pass to ast_json_arena_resume()
+ */
+unsigned int ast_json_arena_suspend(void);
+
+/*!
+ * \brief Allocate JSON from the arena again after ast_json_arena_suspend()
+ * \since 14.0.0
+ *
+ * \param depth What ast_json_arena_suspend() returned
+ */
+void ast_json_arena_resume(unsigned int depth);
+
 /*!
  * \struct ast_json
  * \brief Abstract JSON element (object, array, string, int, ...).
@@ -797,6 +842,153 @@ int ast_json_dump_file_format(struct ast_json *root, FILE *output, enum ast_json
  */
 int ast_json_dump_new_file_format(struct ast_json *root, const char *path, enum ast_json_encoding_format format);
 
+/*!
+ * \brief A JSON document being written straight into an \ref ast_str.
+ * \since 14.0.0
+ *
+ * The document comes out as ast_json_dump_str_format() would encode the same
+ * value, without building that value first. Set one up with
+ * ast_json_writer_init() and leave its fields alone.
+ *
+ * Once anything fails to be written every later call fails too, so the result
+ * of the last call tells whether the whole document was written.
+ */
+struct ast_json_writer {
+	/*! Where the document is written */
+	struct ast_str **dst;
+	/*! Encoding format */
+	enum ast_json_encoding_format format;
+	/*! How many objects and arrays are open */
+	unsigned int depth;
+	/*! Bit n is set once the object or array at depth n has a member */
+	unsigned int members;
+	/*! Set when a key was just written, so its value follows it */
+	unsigned int after_key:1;
+	/*! Set once anything fails */
+	unsigned int failed:1;
+};
+
+/*! \brief How deeply objects and arrays may be nested by an \ref ast_json_writer */
+#define AST_JSON_WRITER_MAX_DEPTH 31
+
+/*!
+ * \brief Start writing a JSON document.
+ * \since 14.0.0
+ *
+ * \param writer Writer to set up.
+ * \param dst \ref ast_str the document is appended to. It is grown as needed.
+ * \param format encoding format type.
+ */
+void ast_json_writer_init(struct ast_json_writer *writer, struct ast_str **dst,
+	enum ast_json_encoding_format format);
+
+/*!
+ * \brief Open an object, as the next value.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_object_start(struct ast_json_writer *writer);
+
+/*!
+ * \brief Close the innermost open object.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_object_end(struct ast_json_writer *writer);
+
+/*!
+ * \brief Open an array, as the next value.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_array_start(struct ast_json_writer *writer);
+
+/*!
+ * \brief Close the innermost open array.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_array_end(struct ast_json_writer *writer);
+
+/*!
+ * \brief Write the key of the next member of an object.
+ * \since 14.0.0
+ *
+ * \param writer Writer.
+ * \param key Key, which must be valid UTF-8.
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_key(struct ast_json_writer *writer, const char *key);
+
+/*!
+ * \brief Write a string value.
+ * \since 14.0.0
+ *
+ * \param writer Writer.
+ * \param value String, which like ast_json_string_create() must not be
+ *              \c NULL and must be valid UTF-8.
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_string(struct ast_json_writer *writer, const char *value);
+
+/*!
+ * \brief Write an integer value.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_integer(struct ast_json_writer *writer, intmax_t value);
+
+/*!
+ * \brief Write a null value.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_null(struct ast_json_writer *writer);
+
+/*!
+ * \brief Write a timeval, as ast_json_timeval() would make it.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_timeval(struct ast_json_writer *writer, const struct timeval tv, const char *zone);
+
+/*!
+ * \brief Write a name/number object, as ast_json_name_number() would make it.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_name_number(struct ast_json_writer *writer, const char *name, const char *number);
+
+/*!
+ * \brief Write a context/exten/priority object, as ast_json_dialplan_cep() would make it.
+ * \since 14.0.0
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_dialplan_cep(struct ast_json_writer *writer, const char *context,
+	const char *exten, int priority);
+
+/*!
+ * \brief Write an existing JSON value.
+ * \since 14.0.0
+ *
+ * \param writer Writer.
+ * \param value JSON value, which is not stolen.
+ * \return 0 on success.
+ * \return -1 on error.
+ */
+int ast_json_writer_value(struct ast_json_writer *writer, struct ast_json *value);
+
 #define AST_JSON_ERROR_TEXT_LENGTH    160
 #define AST_JSON_ERROR_SOURCE_LENGTH   80
 
@@ -130,6 +130,12 @@ struct ast_mutex_info {
 	/*! Track which thread holds this mutex */
 	struct ast_lock_track *track;
 	unsigned int tracking:1;
+	/*! Profiling generation the holder was recorded in, while lock contention is profiled */
+	unsigned int holder_gen:31;
+	/*! Line the holder locked it from */
+	int holder_line;
+	/*! File the holder locked it from, or NULL */
+	const char *holder_file;
 };
 
 /*! \brief Structure for rwlock and tracking information.
@@ -142,6 +148,12 @@ struct ast_rwlock_info {
 	/*! Track which thread holds this lock */
 	struct ast_lock_track *track;
 	unsigned int tracking:1;
+	/*! Profiling generation the holder was recorded in, while lock contention is profiled */
+	unsigned int holder_gen:31;
+	/*! Line the holder locked it from */
+	int holder_line;
+	/*! File the holder locked it from, or NULL */
+	const char *holder_file;
 };
 
 typedef struct ast_mutex_info ast_mutex_t;
@@ -669,6 +681,7 @@ static void  __attribute__((destructor)) fini_##rwlock(void) \
  */
 
 int ast_atomic_fetchadd_int_slow(volatile int *p, int v);
+int ast_atomic_compare_and_swap_ptr_slow(void * volatile *p, void *old, void *new);
 
 #include "asterisk/inline_api.h"
 
@@ -751,4 +764,27 @@ AST_INLINE_API(int ast_atomic_dec_and_test(volatile int *p),
 })
 #endif
 
+/*! \brief Atomically replace *p by new if it is still old.
+ * This is a full memory barrier, so it can be used to build lock-free
+ * lists.
+ * \retval non-zero if *p was replaced.
+ * \since 14.0.0
+ */
+#if defined(HAVE_GCC_ATOMICS)
+AST_INLINE_API(int ast_atomic_compare_and_swap_ptr(void * volatile *p, void *old, void *new),
+{
+	return __sync_bool_compare_and_swap(p, old, new);
+})
+#elif defined(HAVE_OSX_ATOMICS)
+AST_INLINE_API(int ast_atomic_compare_and_swap_ptr(void * volatile *p, void *old, void *new),
+{
+	return OSAtomicCompareAndSwapPtrBarrier(old, new, (void * volatile *) p);
+})
+#else
+AST_INLINE_API(int ast_atomic_compare_and_swap_ptr(void * volatile *p, void *old, void *new),
+{
+	return ast_atomic_compare_and_swap_ptr_slow(p, old, new);
+})
+#endif
+
 #endif /* _ASTERISK_LOCK_H */
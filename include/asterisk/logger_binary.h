@@ -0,0 +1,137 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Binary log channel format
+ *
+ * A log channel with the [binary] formatter writes records rather than
+ * lines of text. Each message records the format string and its arguments
+ * instead of the formatted text, so the thread logging it need not format
+ * it. The astlogdecode utility turns such a file back into text.
+ *
+ * A file is a series of records, each a one byte type and a four byte
+ * length followed by that many bytes. All numbers are little endian.
+ *
+ * \li \ref AST_LOGB_RECORD_SESSION starts the records written each time the
+ *     file is opened, and forgets the strings defined before it. It holds
+ *     \ref AST_LOGB_MAGIC and a line describing the Asterisk build.
+ * \li \ref AST_LOGB_RECORD_STRING defines a string: a four byte id, then the
+ *     text. Format strings, file, function and level names are each written
+ *     once and then referred to by id.
+ * \li \ref AST_LOGB_RECORD_MESSAGE is a log message: the seconds (eight bytes)
+ *     and microseconds when it was logged, then the ids of its level name,
+ *     the thread, the callid, the id of the file name, the line, the id of
+ *     the function name, and the id of the format string, each four bytes.
+ *     The rest is the arguments, as encoded by ast_logb_args_encode(), or the
+ *     text of the message if the format string id is 0.
+ *
+ * \since 14.0.0
+ */
+
+#ifndef _ASTERISK_LOGGER_BINARY_H
+#define _ASTERISK_LOGGER_BINARY_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/*! \brief Starts each session of a binary log file */
+#define AST_LOGB_MAGIC "AstLogB1"
+
+/*! \brief Bytes before the payload of each record: its type and length */
+#define AST_LOGB_RECORD_HEADER 5
+
+/*! \brief Bytes of a message record before its arguments */
+#define AST_LOGB_MESSAGE_HEADER 40
+
+/*! \brief Most bytes of arguments kept for one message */
+#define AST_LOGB_ARGS_MAX 4096
+
+/*! \brief The types of record in a binary log file */
+enum ast_logb_record {
+	AST_LOGB_RECORD_SESSION = 1,
+	AST_LOGB_RECORD_STRING = 2,
+	AST_LOGB_RECORD_MESSAGE = 3,
+};
+
+/*! \brief Store a four byte number, little endian */
+static inline void ast_logb_put_u32(unsigned char *p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+/*! \brief Store an eight byte number, little endian */
+static inline void ast_logb_put_u64(unsigned char *p, uint64_t value)
+{
+	ast_logb_put_u32(p, value);
+	ast_logb_put_u32(p + 4, value >> 32);
+}
+
+/*! \brief Load a four byte number, little endian */
+static inline uint32_t ast_logb_get_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/*! \brief Load an eight byte number, little endian */
+static inline uint64_t ast_logb_get_u64(const unsigned char *p)
+{
+	return ast_logb_get_u32(p) | ((uint64_t) ast_logb_get_u32(p + 4) << 32);
+}
+
+/*!
+ * \brief Encode the arguments of a printf format string
+ *
+ * \param buf Where to encode the arguments
+ * \param size The size of \a buf
+ * \param fmt The format string
+ * \param ap The arguments
+ *
+ * Strings are copied, as far as their precision if they have one.
+ *
+ * \return The number of bytes encoded
+ * \retval 0 if the arguments do not fit, or the format string uses
+ * conversions that are not supported (%n, long double, positional
+ * arguments). The message must then be kept as text.
+ */
+size_t ast_logb_args_encode(unsigned char *buf, size_t size, const char *fmt, va_list ap);
+
+/*!
+ * \brief Format encoded arguments as printf would have
+ *
+ * \param out Where to put the text, always terminated
+ * \param size The size of \a out
+ * \param fmt The format string the arguments were encoded for
+ * \param args The encoded arguments
+ * \param len The number of bytes of \a args
+ *
+ * \return The length of the text, truncated to fit \a out
+ * \retval -1 if the arguments do not match the format string
+ */
+int ast_logb_render(char *out, size_t size, const char *fmt, const unsigned char *args, size_t len);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* _ASTERISK_LOGGER_BINARY_H */
@@ -158,6 +158,23 @@ int ast_media_cache_create_or_update(const char *uri, const char *file_path,
  */
 int ast_media_cache_delete(const char *uri);
 
+/*!
+ * \brief Fetch an item into the cache in the background
+ *
+ * \param uri The unique URI for the media item
+ *
+ * \retval 0 The fetch was queued
+ * \retval -1 The fetch could not be queued
+ *
+ * \details
+ * The item is retrieved as by \ref ast_media_cache_retrieve, so it is only
+ * fetched from its \ref bucket backend if it is not already in the cache
+ * or is stale. This lets media be fetched before a caller first needs it.
+ *
+ * \since 14.0.0
+ */
+int ast_media_cache_prefetch(const char *uri);
+
 /*!
  * \brief Initialize the media cache
  *
@@ -101,6 +101,25 @@ struct ao2_container *ast_media_get_media(struct ast_media_index *index);
  */
 int ast_media_index_update(struct ast_media_index *index,
 	const char *variant);
+
+/*!
+ * \brief Update a media index, using a listing of the variant's files
+ * \since 14.0.0
+ *
+ * If the listing is current, which it is if none of the variant's directories
+ * or description files has changed since it was written, the files it lists
+ * are indexed without walking the directories. Otherwise the directories are
+ * walked as by ast_media_index_update() and the listing is written anew.
+ *
+ * \param index Media index in which to query information
+ * \param variant Media variant to index
+ * \param listing_file Path of the file in which the listing is kept
+ *
+ * \retval non-zero on error
+ * \return zero on success
+ */
+int ast_media_index_update_cached(struct ast_media_index *index,
+	const char *variant, const char *listing_file);
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
@@ -0,0 +1,207 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+#ifndef _ASTERISK_METRICS_H
+#define _ASTERISK_METRICS_H
+
+/*!
+ * \file
+ * \brief Metrics exported in the Prometheus text format
+ * \since 14.0.0
+ *
+ * Metrics are pulled rather than pushed: the /metrics HTTP URI renders them
+ * when it is scraped. There are two ways to provide them.
+ *
+ * \li A metric created with ast_metric_counter_create(),
+ * ast_metric_gauge_create() or ast_metric_histogram_create() holds its
+ * value. Code updates it where the thing it measures happens, and the
+ * update is an atomic add or a short lock of the metric alone.
+ *
+ * \li A collector registered with ast_metrics_collector_register() is called
+ * on every scrape and writes samples of state that already exists, such as
+ * the sizes of containers, with ast_metrics_output_family() and
+ * ast_metrics_output_sample(). Nothing is done between scrapes.
+ *
+ * Names should start with "asterisk_" and follow the Prometheus conventions:
+ * counters end with "_total" and values are in base units, e.g. seconds.
+ */
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+struct ast_str;
+
+/*! \brief A metric holding its value */
+struct ast_metric;
+
+/*! \brief What a scrape is being written to, passed to collectors */
+struct ast_metrics_output;
+
+/*! \brief Type of a metric family */
+enum ast_metric_type {
+	/*! A value that only goes up, e.g. a number of processed messages */
+	AST_METRIC_COUNTER,
+	/*! A value that goes up and down, e.g. a queue size */
+	AST_METRIC_GAUGE,
+	/*! Observations counted in buckets, e.g. latencies */
+	AST_METRIC_HISTOGRAM,
+};
+
+/*!
+ * \brief Create and register a counter
+ * \since 14.0.0
+ *
+ * \param name Name of the metric
+ * \param help One line description of the metric
+ *
+ * \return The counter, or NULL on error
+ */
+struct ast_metric *ast_metric_counter_create(const char *name, const char *help);
+
+/*!
+ * \brief Create and register a gauge
+ * \since 14.0.0
+ *
+ * \param name Name of the metric
+ * \param help One line description of the metric
+ *
+ * \return The gauge, or NULL on error
+ */
+struct ast_metric *ast_metric_gauge_create(const char *name, const char *help);
+
+/*!
+ * \brief Create and register a histogram
+ * \since 14.0.0
+ *
+ * \param name Name of the metric
+ * \param help One line description of the metric
+ * \param bounds Upper bounds of the buckets in increasing order, copied.
+ * A last bucket without an upper bound is added.
+ * \param num_bounds Number of entries in bounds
+ *
+ * \return The histogram, or NULL on error
+ */
+struct ast_metric *ast_metric_histogram_create(const char *name, const char *help,
+	const double *bounds, size_t num_bounds);
+
+/*!
+ * \brief Unregister and destroy a metric
+ * \since 14.0.0
+ *
+ * \param metric The metric, may be NULL
+ *
+ * \note The metric must no longer be updated once this is called.
+ */
+void ast_metric_destroy(struct ast_metric *metric);
+
+/*!
+ * \brief Add to a counter or a gauge
+ * \since 14.0.0
+ *
+ * \param metric The metric, may be NULL
+ * \param delta What to add, negative only for gauges
+ */
+void ast_metric_add(struct ast_metric *metric, int64_t delta);
+
+/*!
+ * \brief Set the value of a gauge
+ * \since 14.0.0
+ *
+ * \param metric The metric, may be NULL
+ * \param value The new value
+ */
+void ast_metric_set(struct ast_metric *metric, int64_t value);
+
+/*!
+ * \brief Add an observation to a histogram
+ * \since 14.0.0
+ *
+ * \param metric The metric, may be NULL
+ * \param value The observed value
+ */
+void ast_metric_observe(struct ast_metric *metric, double value);
+
+/*!
+ * \brief Called on every scrape to write the samples of a collector
+ *
+ * \param out What the samples are written to
+ *
+ * \note The registry is locked while this is called. It must not create,
+ * destroy or register metrics or collectors.
+ */
+typedef void (*ast_metrics_collector_cb)(struct ast_metrics_output *out);
+
+/*!
+ * \brief Register a collector
+ * \since 14.0.0
+ *
+ * \param name Name of the collector, for the CLI
+ * \param callback Called on every scrape
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+int ast_metrics_collector_register(const char *name, ast_metrics_collector_cb callback);
+
+/*!
+ * \brief Unregister a collector
+ * \since 14.0.0
+ *
+ * \param callback The callback the collector was registered with
+ *
+ * \note When this returns the callback is not running and will not be called again.
+ */
+void ast_metrics_collector_unregister(ast_metrics_collector_cb callback);
+
+/*!
+ * \brief Start a metric family in the output of a collector
+ * \since 14.0.0
+ *
+ * \param out What the samples are written to
+ * \param name Name of the family
+ * \param type Type of the family, a counter or a gauge
+ * \param help One line description of the family
+ */
+void ast_metrics_output_family(struct ast_metrics_output *out, const char *name,
+	enum ast_metric_type type, const char *help);
+
+/*!
+ * \brief Write a sample of the current family in the output of a collector
+ * \since 14.0.0
+ *
+ * \param out What the samples are written to
+ * \param name Name of the family
+ * \param label Name of the label telling the samples of the family apart, NULL for none
+ * \param label_value Value of the label, escaped as needed
+ * \param value The value of the sample
+ */
+void ast_metrics_output_sample(struct ast_metrics_output *out, const char *name,
+	const char *label, const char *label_value, double value);
+
+/*!
+ * \brief Render all metrics in the Prometheus text format
+ * \since 14.0.0
+ *
+ * \param buf Buffer the metrics are appended to
+ */
+void ast_metrics_render(struct ast_str **buf);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* _ASTERISK_METRICS_H */
@@ -118,9 +118,25 @@ struct ast_filestream {
 	char *buf;		/*!< buffer pointed to by ast_frame; */
 	void *_private;	/*!< pointer to private buffer */
 	const char *orig_chan_name;
-	char *write_buffer;
+	char *stdio_buffer;	/*!< The buffer of f, if not the default one */
+	void *contents;		/*!< The sound file kept in memory that f reads, if it is */
+	unsigned int reading:1;	/*!< f is only read, so has nothing buffered to write */
 };
 
+/*!
+ * \brief Get the length of the file a stream reads or writes
+ * \since 14.0.0
+ *
+ * Unlike seeking to the end and back, this keeps what has been read ahead on
+ * a stream being read, so that seeking within it after needs no read.
+ *
+ * \param fs The stream
+ *
+ * \return The length in bytes, with the position of the stream unchanged
+ * \retval -1 on error
+ */
+off_t ast_filestream_size(struct ast_filestream *fs);
+
 /*! 
  * \brief Register a new file format capability.
  * Adds a format to Asterisk's format abilities.
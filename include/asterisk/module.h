@@ -151,13 +151,16 @@ void ast_update_use_count(void);
  * \param like
  *
  * For each of the modules loaded, modentry will be executed with the resource,
- * description, and usecount values of each particular module.
+ * description, and usecount values of each particular module, and the
+ * microseconds its load function took the last time it ran, or -1 if it
+ * has not run.
  *
  * \return the number of modules loaded
  */
 int ast_update_module_list(int (*modentry)(const char *module, const char *description,
                                            int usecnt, const char *status, const char *like,
-                                           enum ast_module_support_level support_level),
+                                           enum ast_module_support_level support_level,
+                                           int64_t load_usec),
                            const char *like);
 
 /*!
@@ -138,6 +138,9 @@ extern int option_verbose;
 extern int ast_option_maxfiles;		/*!< Max number of open file handles (files, sockets) */
 extern int option_debug;		/*!< Debugging */
 extern int ast_option_maxcalls;		/*!< Maximum number of simultaneous channels */
+extern int ast_option_config_images;	/*!< Keep compiled config images on disk */
+extern int ast_option_autoservice_threads;	/*!< Number of autoservice threads, 0 for the default */
+extern int ast_option_channel_pool;		/*!< Number of destroyed channels kept for reuse */
 extern unsigned int option_dtmfminduration;	/*!< Minimum duration of DTMF (channel.c) in ms */
 extern double ast_option_maxload;
 #if defined(HAVE_SYSINFO)
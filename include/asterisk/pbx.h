@@ -148,6 +148,9 @@ struct ast_custom_function {
 					 * 'dangerous', and should not be run directly
 					 * from external interfaces (AMI, ARI, etc.)
 					 * \since 12 */
+	unsigned int docs_pending:1;    /*!< The XML documentation is built when
+					 * first shown (lazy documentation)
+					 * \since 14.0.0 */
 
 	AST_RWLIST_ENTRY(ast_custom_function) acflist;
 };
@@ -1296,6 +1299,20 @@ int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const
 void pbx_retrieve_variable(struct ast_channel *c, const char *var, char **ret, char *workspace, int workspacelen, struct varshead *headp);
 void pbx_builtin_clear_globals(void);
 
+/*!
+ * \brief Set global variables all at once
+ *
+ * \param vars The variables.  Variables in each value are substituted as if
+ * the variables before it had already been set.
+ * \param clear Non-zero to remove every other global variable
+ *
+ * \note The global variables change from the old set to the new all at
+ * once, so a channel never sees some of them cleared or only some set.
+ *
+ * \since 14.0.0
+ */
+void pbx_builtin_load_globals(const struct ast_variable *vars, int clear);
+
 /*!
  * \brief Parse and set a single channel variable, where the name and value are separated with an '=' character.
  * \note Will lock the channel.
@@ -1368,6 +1385,34 @@ int pbx_set_autofallthrough(int newval);
   the old linear-search algorithm.  Returns previous value. */
 int pbx_set_extenpatternmatchnew(int newval);
 
+/*!
+ * \brief Set the "extenpatterncompile" flag
+ *
+ * When set, ast_merge_contexts_and_delete() compiles contexts with many
+ * extensions into automata that the new pattern matcher uses to find
+ * extensions in time proportional to their length.
+ *
+ * \param newval 1 to compile contexts, 0 not to
+ *
+ * \return The previous value
+ * \since 14.0.0
+ */
+int pbx_set_extenpatterncompile(int newval);
+
+/*!
+ * \brief Set how long to gather hint state changes
+ *
+ * Device state changes that arrive within this time of the first one to
+ * change a hint are merged, and the hint's watchers are notified once
+ * with the resulting state.
+ *
+ * \param newval Time in milliseconds, or 0 to notify watchers at once
+ *
+ * \return The previous value
+ * \since 14.0.0
+ */
+int pbx_set_hint_coalesce(int newval);
+
 /*! Set "overrideswitch" field.  If set and of nonzero length, all contexts
  * will be tried directly through the named switch prior to any other
  * matching within that context.
@@ -0,0 +1,69 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+#ifndef _ASTERISK_PROBES_H
+#define _ASTERISK_PROBES_H
+
+/*!
+ * \file
+ * \brief Static tracepoints (USDT)
+ * \since 14.0.0
+ *
+ * The probes are only compiled in when ENABLE_PROBES is selected in
+ * menuselect and configure found <sys/sdt.h> (systemtap-sdt-dev on
+ * Debian, systemtap-sdt-devel on Red Hat). Otherwise they expand to
+ * nothing and their arguments are not evaluated.
+ *
+ * When compiled in, a probe is a single nop plus a note in the ELF file
+ * describing where its arguments are. Nothing happens until a tracer
+ * attaches to it, so the build is fit for production. The provider is
+ * "asterisk" and the probes are listed with e.g.
+ *
+ * \code
+ * bpftrace -l 'usdt:/usr/sbin/asterisk:asterisk:*'
+ * perf buildid-cache --add /usr/sbin/asterisk && perf list sdt_asterisk:*
+ * \endcode
+ *
+ * The arguments are always evaluated while the probes are compiled in,
+ * so they must be cheap: pointers, integers and strings that already
+ * exist. Probes measuring a duration come in pairs ending in "__start"
+ * and "__done" with the same first argument, to be matched by a tracer.
+ *
+ * \note Double underscores in probe names are shown as dashes by DTrace
+ * and SystemTap, e.g. channel__read__start is channel-read-start.
+ */
+
+#if defined(ENABLE_PROBES) && defined(HAVE_SYS_SDT_H)
+
+#include <sys/sdt.h>
+
+#define AST_PROBE(name) DTRACE_PROBE(asterisk, name)
+#define AST_PROBE1(name, a1) DTRACE_PROBE1(asterisk, name, a1)
+#define AST_PROBE2(name, a1, a2) DTRACE_PROBE2(asterisk, name, a1, a2)
+#define AST_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(asterisk, name, a1, a2, a3)
+#define AST_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(asterisk, name, a1, a2, a3, a4)
+
+#else
+
+#define AST_PROBE(name) do { } while (0)
+#define AST_PROBE1(name, a1) do { } while (0)
+#define AST_PROBE2(name, a1, a2) do { } while (0)
+#define AST_PROBE3(name, a1, a2, a3) do { } while (0)
+#define AST_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+
+#endif
+
+#endif /* _ASTERISK_PROBES_H */
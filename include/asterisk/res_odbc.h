@@ -57,6 +57,8 @@ struct odbc_obj {
 	unsigned int tx:1;              /*!< Should this connection be unshared, regardless of the class setting? */
 	struct odbc_txn_frame *txf;     /*!< Reference back to the transaction frame, if applicable */
 	AST_LIST_ENTRY(odbc_obj) list;
+	AST_LIST_HEAD_NOLOCK(, odbc_cached_stmt) stmts; /*!< Statements prepared by ast_odbc_prepare_cached(), most recently used first */
+	unsigned int num_stmts;         /*!< How many statements are in \ref stmts */
 };
 
 /*!\brief These structures are used for adaptive capabilities */
@@ -175,6 +177,38 @@ SQLHSTMT ast_odbc_direct_execute(struct odbc_obj *obj, SQLHSTMT (*exec_cb)(struc
  */
 SQLHSTMT ast_odbc_prepare_and_execute(struct odbc_obj *obj, SQLHSTMT (*prepare_cb)(struct odbc_obj *obj, void *data), void *data);
 
+/*!
+ * \brief Get a prepared statement handle for some SQL, reusing one prepared before
+ * \param obj The ODBC object
+ * \param sql The SQL to prepare
+ *
+ * Each connection keeps the statements prepared with this, keyed by their SQL,
+ * up to the statement_cache setting of its class, so SQL that is run again on
+ * the same connection is not prepared again. Meant to be called from the
+ * prepare_cb of ast_odbc_prepare_and_execute(), which binds the parameters of
+ * the statement it returns.
+ *
+ * The statement must be given back with ast_odbc_release_stmt(), not freed.
+ *
+ * \retval a statement handle
+ * \retval NULL on error
+ * \since 14.0.0
+ */
+SQLHSTMT ast_odbc_prepare_cached(struct odbc_obj *obj, const char *sql);
+
+/*!
+ * \brief Release a statement handle when done with it
+ * \param obj The ODBC object the statement was prepared on
+ * \param stmt The statement handle
+ *
+ * A statement from ast_odbc_prepare_cached() has its cursor closed and its
+ * parameters and columns unbound, and is kept for reuse. Any other statement
+ * is freed, as SQLFreeHandle() would.
+ *
+ * \since 14.0.0
+ */
+void ast_odbc_release_stmt(struct odbc_obj *obj, SQLHSTMT stmt);
+
 /*!
  * \brief Find or create an entry describing the table specified.
  * \param database Name of an ODBC class on which to query the table
@@ -63,6 +63,21 @@ struct ast_sip_transport_state {
 
 	/*! \brief Transport factory */
 	struct pjsip_tpfactory *factory;
+
+	/*! \brief Further UDP transports sharing the address of the transport */
+	AST_VECTOR(, struct pjsip_transport *) receive_transports;
+};
+
+/*!
+ * \brief How datagrams are spread over the receive sockets of a UDP transport
+ */
+enum ast_sip_receive_steering {
+	/*! By source address and port, as the kernel does by default */
+	AST_SIP_RECEIVE_STEERING_FLOW,
+	/*! By source address only */
+	AST_SIP_RECEIVE_STEERING_ADDRESS,
+	/*! By the CPU the datagram was received on */
+	AST_SIP_RECEIVE_STEERING_CPU,
 };
 
 #define SIP_SORCERY_DOMAIN_ALIAS_TYPE "domain_alias"
@@ -132,6 +147,10 @@ struct ast_sip_transport {
 	unsigned int cos;
 	/*! Write timeout */
 	int write_timeout;
+	/*! Number of sockets receiving on a UDP transport */
+	unsigned int receive_sockets;
+	/*! How datagrams are spread over the receive sockets */
+	enum ast_sip_receive_steering receive_steering;
 };
 
 /*!
@@ -409,6 +428,8 @@ struct ast_sip_endpoint_subscription_configuration {
 	unsigned int minexpiry;
 	/*! Message waiting configuration */
 	struct ast_sip_mwi_configuration mwi;
+	/*! The minimum time in milliseconds between NOTIFYs sent on a subscription */
+	unsigned int notify_min_interval;
 };
 
 /*!
@@ -1557,6 +1578,24 @@ void ast_copy_pj_str(char *dest, const pj_str_t *src, size_t size);
  */
 struct ast_sip_endpoint *ast_pjsip_rdata_get_endpoint(pjsip_rx_data *rdata);
 
+struct ast_channel_setup_times;
+
+/*!
+ * \brief Get the call setup stages a request has reached in the distributor
+ * \since 14.0.0
+ *
+ * The distributor records when the request was received, taken off the
+ * serializer queue, identified and authenticated. The times are only
+ * available while the request is processed on the serializer it was
+ * distributed to, so they must be copied, e.g. into the session that is
+ * created for an INVITE.
+ *
+ * \param rdata The request
+ *
+ * \return The setup stages reached, NULL if the request is not being distributed
+ */
+struct ast_channel_setup_times *ast_sip_rdata_get_setup_times(pjsip_rx_data *rdata);
+
 /*!
  * \brief Add 'user=phone' parameter to URI if enabled and user is a phone number.
  *
@@ -2067,6 +2106,34 @@ unsigned int ast_sip_get_keep_alive_interval(void);
  */
 unsigned int ast_sip_get_max_initial_qualify_time(void);
 
+/*!
+ * \brief Retrieve the time an identified endpoint is cached.
+ *
+ * \retval the time in milliseconds, 0 if identified endpoints are not cached.
+ */
+unsigned int ast_sip_get_endpoint_identifier_cache_ttl(void);
+
+/*!
+ * \brief Retrieve the time a request that matched no endpoint is cached.
+ *
+ * \retval the time in milliseconds, 0 if unidentified requests are not cached.
+ */
+unsigned int ast_sip_get_endpoint_identifier_negative_cache_ttl(void);
+
+/*!
+ * \brief Retrieve the most contact qualifies to send each second.
+ *
+ * \retval the rate, 0 if qualifies are not rate limited.
+ */
+unsigned int ast_sip_get_max_qualify_rate(void);
+
+/*!
+ * \brief Retrieve the most outbound REGISTER requests to send each second.
+ *
+ * \retval the rate, 0 if outbound registrations are not rate limited.
+ */
+unsigned int ast_sip_get_max_outbound_registration_rate(void);
+
 /*!
  * \brief translate ast_sip_contact_status_type to character string.
  *
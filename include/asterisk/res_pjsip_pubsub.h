@@ -572,6 +572,20 @@ struct ast_sip_pubsub_body_generator {
 	 * \param body Body to be destroyed
 	 */
 	void (*destroy_body)(void *body);
+	/*!
+	 * \brief Describe the data a body is generated from
+	 *
+	 * Optional callback for generators whose bodies depend only on the
+	 * data passed in, and not on the subscription. Data that gives the
+	 * same key must give the same body, so that a body generated once
+	 * can be reused for every subscriber to the same state.
+	 *
+	 * \param data The subscription data used to populate the body
+	 * \param key The key to append to
+	 * \retval 0 Success
+	 * \retval non-zero The body must be generated
+	 */
+	int (*cache_key)(void *data, struct ast_str **key);
 	AST_LIST_ENTRY(ast_sip_pubsub_body_generator) list;
 };
 
@@ -44,6 +44,15 @@ struct ast_srtp_res {
 	void (*set_cb)(struct ast_srtp *srtp, const struct ast_srtp_cb *cb, void *data);
 	/* Unprotect SRTP data */
 	int (*unprotect)(struct ast_srtp *srtp, void *buf, int *size, int rtcp);
+	/*!
+	 * \brief Unprotect several SRTP packets of a session in order
+	 *
+	 * Each size is set to the size of the unprotected packet, or -1 if
+	 * the packet could not be unprotected.
+	 *
+	 * \return The number of packets unprotected
+	 */
+	int (*unprotect_batch)(struct ast_srtp *srtp, void **bufs, int *sizes, int count, int rtcp);
 	/* Protect RTP data */
 	int (*protect)(struct ast_srtp *srtp, void **buf, int *size, int rtcp);
 	/* Obtain a random cryptographic key */
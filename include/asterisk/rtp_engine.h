@@ -120,6 +120,19 @@ enum ast_rtp_property {
 	AST_RTP_PROPERTY_MAX,
 };
 
+/*!
+ * \brief Extended properties of the multicast RTP engine
+ * \since 14.0.0
+ */
+enum ast_rtp_multicast_property {
+	/*!
+	 * \brief Another address to send the same packets to, besides the remote address
+	 *
+	 * \note The value is a struct ast_sockaddr, which is copied.
+	 */
+	AST_RTP_MULTICAST_PROPERTY_FANOUT_ADDRESS = 1,
+};
+
 /*! Additional RTP options */
 enum ast_rtp_options {
 	/*! Remote side is using non-standard G.726 */
@@ -701,6 +714,97 @@ int ast_rtp_engine_register_srtp(struct ast_srtp_res *srtp_res, struct ast_srtp_
 void ast_rtp_engine_unregister_srtp(void);
 int ast_rtp_engine_srtp_is_registered(void);
 
+/*!
+ * \brief A helper that forwards RTP without passing it through Asterisk
+ *
+ * A forwarder moves packets between two RTP sockets below Asterisk, for
+ * example in the kernel, for locally bridged instances that need no media
+ * handling.
+ */
+struct ast_rtp_forwarder {
+	/*! Name of the forwarder */
+	const char *name;
+	/*! Module the forwarder is part of */
+	struct ast_module *mod;
+	/*!
+	 * \brief Forward the packets one remote address sends to a local address
+	 *
+	 * \param from_remote Address the packets come from
+	 * \param from_local Address the packets arrive at
+	 * \param to_local Address to send the packets from
+	 * \param to_remote Address to send the packets to
+	 *
+	 * \return Data of the forwarding, NULL if it could not be set up
+	 */
+	void *(*start)(const struct ast_sockaddr *from_remote, const struct ast_sockaddr *from_local,
+		const struct ast_sockaddr *to_local, const struct ast_sockaddr *to_remote);
+	/*! \brief Stop forwarding and free the data of the forwarding */
+	void (*stop)(void *data);
+	/*! \brief Get the packets and octets of payload forwarded so far */
+	void (*stats)(void *data, unsigned int *packets, unsigned int *octets);
+};
+
+/*! \brief Packets of an RTP instance that a forwarder handles */
+struct ast_rtp_forward;
+
+#define ast_rtp_engine_register_forwarder(forwarder) ast_rtp_engine_register_forwarder2(forwarder, AST_MODULE_SELF)
+
+/*!
+ * \brief Register the RTP forwarder
+ *
+ * \param forwarder The forwarder to register
+ * \param module Module that the forwarder is part of
+ *
+ * \retval 0 success
+ * \retval -1 failure, a forwarder is already registered
+ *
+ * \note A module with forwardings in progress is in use, so the forwarder
+ * can't go away while it forwards.
+ */
+int ast_rtp_engine_register_forwarder2(struct ast_rtp_forwarder *forwarder, struct ast_module *module);
+
+/*!
+ * \brief Unregister the RTP forwarder
+ *
+ * \param forwarder The forwarder to unregister
+ */
+void ast_rtp_engine_unregister_forwarder(struct ast_rtp_forwarder *forwarder);
+
+/*!
+ * \brief Start forwarding packets with the registered forwarder
+ *
+ * See the start callback of \ref ast_rtp_forwarder for the parameters.
+ *
+ * \return The forwarding, NULL if no forwarder is registered or it failed
+ */
+struct ast_rtp_forward *ast_rtp_forward_start(const struct ast_sockaddr *from_remote,
+	const struct ast_sockaddr *from_local, const struct ast_sockaddr *to_local,
+	const struct ast_sockaddr *to_remote);
+
+/*!
+ * \brief Stop a forwarding
+ *
+ * \param forward The forwarding, NULL is ignored
+ */
+void ast_rtp_forward_stop(struct ast_rtp_forward *forward);
+
+/*!
+ * \brief Get the packets and octets of payload a forwarding has moved
+ *
+ * \param forward The forwarding
+ * \param packets Set to the packets forwarded
+ * \param octets Set to the octets of payload forwarded
+ */
+void ast_rtp_forward_stats(struct ast_rtp_forward *forward, unsigned int *packets, unsigned int *octets);
+
+/*!
+ * \brief Check if a forwarder is registered
+ *
+ * \retval 1 registered
+ * \retval 0 not registered
+ */
+int ast_rtp_engine_forwarder_is_registered(void);
+
 #define ast_rtp_glue_register(glue) ast_rtp_glue_register2(glue, AST_MODULE_SELF)
 
 /*!
@@ -2357,6 +2461,30 @@ time_t ast_rtp_instance_get_last_rx(const struct ast_rtp_instance *rtp);
  */
 void ast_rtp_instance_set_last_rx(struct ast_rtp_instance *rtp, time_t time);
 
+/*!
+ * \brief Count a received RTCP reception report in the media quality summaries
+ *
+ * Reports are folded into histograms for the endpoint of the channel the
+ * instance belongs to and for the remote host of the instance. One summary
+ * of them is published per window as \ref ast_rtp_quality_summary_type.
+ *
+ * \param rtp The instance the report was received on
+ * \param jitter Interarrival jitter in milliseconds
+ * \param fraction_lost Fraction of packets lost in 256ths, as in the report block
+ * \param rtt Round trip time in milliseconds, negative if not known
+ */
+void ast_rtp_instance_quality_sample(struct ast_rtp_instance *rtp, double jitter,
+	unsigned int fraction_lost, double rtt);
+
+/*!
+ * \brief Set the length of the media quality summary windows
+ *
+ * \param seconds Length of a window, 0 to stop summarising
+ *
+ * \note A window already running ends at its old length.
+ */
+void ast_rtp_quality_set_window(unsigned int seconds);
+
 /*! \addtogroup StasisTopicsAndMessages
  * @{
  */
@@ -2377,6 +2505,16 @@ struct stasis_message_type *ast_rtp_rtcp_sent_type(void);
  */
 struct stasis_message_type *ast_rtp_rtcp_received_type(void);
 
+/*!
+ * \brief Message type for a summary of the media quality over a window
+ *
+ * The message data is an \ref ast_json_payload with the histograms of each
+ * endpoint and remote host.
+ *
+ * \retval A stasis message type
+ */
+struct stasis_message_type *ast_rtp_quality_summary_type(void);
+
 /*!
  * \since 12
  * \brief \ref stasis topic for RTP and RTCP related messages
@@ -152,6 +152,32 @@ extern "C" {
  */
 struct ast_sched_context *ast_sched_context_create(void);
 
+/*!
+ * \brief Scheduler context options
+ * \since 14.0.0
+ */
+enum ast_sched_options {
+	/*! Keep scheduled events in a binary heap. This is the default. */
+	AST_SCHED_HEAP = 0,
+	/*!
+	 * Keep scheduled events in a hierarchical timing wheel with
+	 * millisecond ticks. Adding and deleting events costs O(1) instead
+	 * of O(log n), which suits contexts holding a very large number
+	 * of events.
+	 */
+	AST_SCHED_TIMING_WHEEL = (1 << 0),
+};
+
+/*!
+ * \brief Create a scheduler context with options
+ * \since 14.0.0
+ *
+ * \param options \ref ast_sched_options selecting how events are stored
+ *
+ * \return Returns a malloc'd sched_context structure, NULL on failure
+ */
+struct ast_sched_context *ast_sched_context_create_with_options(enum ast_sched_options options);
+
 /*!
  * \brief destroys a schedule context
  *
@@ -247,6 +273,36 @@ int ast_sched_replace(int old_id, struct ast_sched_context *con, int when, ast_s
  */
 int ast_sched_add_variable(struct ast_sched_context *con, int when, ast_sched_cb callback, const void *data, int variable) attribute_warn_unused_result;
 
+/*!
+ * \brief Adds a scheduled event with a worker key
+ * \since 14.0.0
+ *
+ * Same as ast_sched_add() except that when the context was started with
+ * ast_sched_start_thread_pool() the callback runs on the worker thread
+ * selected by \a key. Callbacks of events with the same key never run
+ * concurrently. Events added without a key use key 0.
+ *
+ * \param con Scheduler context to add
+ * \param when how many milliseconds to wait for event to occur
+ * \param callback function to call when the amount of time expires
+ * \param data data to pass to the callback
+ * \param key selects the worker thread, i.e. a hash of the peer name
+ *
+ * \return Returns a schedule item ID on success, -1 on failure
+ */
+int ast_sched_add_keyed(struct ast_sched_context *con, int when, ast_sched_cb callback, const void *data, unsigned int key) attribute_warn_unused_result;
+
+/*!
+ * \brief Adds a scheduled event with rescheduling support and a worker key
+ * \since 14.0.0
+ *
+ * Same as ast_sched_add_variable() except that \a key selects the
+ * worker thread, see ast_sched_add_keyed().
+ *
+ * \return Returns a schedule item ID on success, -1 on failure
+ */
+int ast_sched_add_variable_keyed(struct ast_sched_context *con, int when, ast_sched_cb callback, const void *data, int variable, unsigned int key) attribute_warn_unused_result;
+
 /*!
  * \brief replace a scheduler entry
  * \deprecated You should use the AST_SCHED_REPLACE_VARIABLE() macro instead.
@@ -364,6 +420,27 @@ long ast_sched_when(struct ast_sched_context *con,int id);
  */
 int ast_sched_start_thread(struct ast_sched_context *con);
 
+/*!
+ * \brief Start a thread for processing scheduler entries with worker threads
+ * \since 14.0.0
+ *
+ * Like ast_sched_start_thread() one thread keeps track of when events
+ * are due, but the callbacks are run by \a num_workers worker threads so
+ * one slow callback does not delay every other event. Events are sharded
+ * over the workers by the key given to ast_sched_add_keyed(). Callbacks
+ * of events with the same key run in order on the same worker and never
+ * concurrently; callbacks of events with different keys may run
+ * concurrently with each other.
+ *
+ * \param con the scheduler context this thread will manage
+ * \param num_workers number of worker threads. 0 runs the callbacks on the
+ *        scheduler thread, the same as ast_sched_start_thread().
+ *
+ * \retval 0 success
+ * \retval non-zero failure
+ */
+int ast_sched_start_thread_pool(struct ast_sched_context *con, unsigned int num_workers);
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
@@ -0,0 +1,106 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ * \brief Saturating arithmetic on blocks of signed linear samples
+ *
+ * These give the same results as calling ast_slinear_saturated_add() and
+ * friends on each sample, using vector instructions where the CPU has them.
+ */
+
+#ifndef _ASTERISK_SLINEAR_MIX_H
+#define _ASTERISK_SLINEAR_MIX_H
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/*!
+ * \brief Choose the best kernels the CPU has
+ */
+void ast_slinear_mix_init(void);
+
+/*!
+ * \brief Add a block of samples to another, saturating
+ *
+ * \param dst The samples to add to
+ * \param src The samples to add
+ * \param samples Number of samples
+ */
+void ast_slinear_saturated_add_block(short *dst, const short *src, size_t samples);
+
+/*!
+ * \brief Subtract a block of samples from another, saturating
+ *
+ * \param dst The samples to subtract from
+ * \param src The samples to subtract
+ * \param samples Number of samples
+ */
+void ast_slinear_saturated_subtract_block(short *dst, const short *src, size_t samples);
+
+/*!
+ * \brief Multiply a block of samples by a factor, saturating
+ *
+ * \param buf The samples
+ * \param factor What to multiply them by
+ * \param samples Number of samples
+ */
+void ast_slinear_saturated_multiply_block(short *buf, short factor, size_t samples);
+
+/*!
+ * \brief Divide a block of samples by a divisor
+ *
+ * \param buf The samples
+ * \param divisor What to divide them by, which must not be 0
+ * \param samples Number of samples
+ */
+void ast_slinear_saturated_divide_block(short *buf, short divisor, size_t samples);
+
+/*!
+ * \brief Adjust the volume of a block of samples
+ *
+ * Positive adjustments multiply the samples and negative ones divide them,
+ * as ast_frame_adjust_volume() does.
+ *
+ * \param buf The samples
+ * \param adjustment The volume adjustment
+ * \param samples Number of samples
+ */
+void ast_slinear_adjust_volume_block(short *buf, int adjustment, size_t samples);
+
+/*!
+ * \brief Choose the kernel the block functions use
+ *
+ * ast_slinear_mix_init() chooses the best one the CPU has. This is for
+ * testing and benchmarking them.
+ *
+ * \param name "c", "sse2", "avx2" or "neon"
+ *
+ * \retval 0 on success
+ * \retval -1 if the kernel is not built or the CPU cannot run it
+ */
+int ast_slinear_mix_use_kernel(const char *name);
+
+/*!
+ * \brief Get the name of the kernel the block functions use
+ */
+const char *ast_slinear_mix_kernel(void);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* _ASTERISK_SLINEAR_MIX_H */
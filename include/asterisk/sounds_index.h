@@ -35,6 +35,9 @@ struct ast_media_index;
 /*!
  * \brief Reload the sounds index
  *
+ * The index is built again the next time it is used. Only the languages
+ * whose directories have changed are walked.
+ *
  * \retval zero on success
  * \retval non-zero on failure
  */
@@ -43,6 +46,8 @@ int ast_sounds_reindex(void);
 /*!
  * \brief Get the sounds index
  *
+ * The index is built here if it has not been since it was last reloaded.
+ *
  * \retval sounds index (must be ao2_cleanup()'ed)
  * \retval NULL on failure
  */
@@ -282,6 +282,27 @@ struct stasis_message_vtable {
 		struct stasis_message *message);
 };
 
+/*!
+ * \brief Stasis subscription message filters
+ */
+enum stasis_subscription_message_filter {
+	STASIS_SUBSCRIPTION_FILTER_NONE = 0,	/*!< Subscription receives all messages */
+	STASIS_SUBSCRIPTION_FILTER_SELECTIVE,	/*!< Subscription receives only accepted messages */
+};
+
+/*!
+ * \brief Stasis subscription formatter filters
+ *
+ * A message type is available in a format when its \ref stasis_message_vtable
+ * implements the corresponding method.
+ */
+enum stasis_subscription_message_formatters {
+	STASIS_SUBSCRIPTION_FORMATTER_NONE = 0,
+	STASIS_SUBSCRIPTION_FORMATTER_JSON = 1 << 0,	/*!< Supports JSON format */
+	STASIS_SUBSCRIPTION_FORMATTER_AMI = 1 << 1,	/*!< Supports AMI format */
+	STASIS_SUBSCRIPTION_FORMATTER_EVENT = 1 << 2,	/*!< Supports \ref ast_event format */
+};
+
 /*!
  * \brief Return code for Stasis message type creation attempts
  */
@@ -318,6 +339,26 @@ enum stasis_message_type_result stasis_message_type_create(const char *name,
  */
 const char *stasis_message_type_name(const struct stasis_message_type *type);
 
+/*!
+ * \brief Gets the unique identifier of a given message type
+ *
+ * Identifiers are small integers assigned in order of creation, suitable for
+ * indexing a table of message types.
+ *
+ * \param type The type to get.
+ * \return Identifier of the type.
+ */
+int stasis_message_type_id(const struct stasis_message_type *type);
+
+/*!
+ * \brief Gets the formats a given message type can be rendered in
+ *
+ * \param type The type to get.
+ * \return Bitmask of \ref stasis_subscription_message_formatters.
+ */
+enum stasis_subscription_message_formatters stasis_message_type_available_formatters(
+	const struct stasis_message_type *type);
+
 /*!
  * \brief Check whether a message type is declined
  *
@@ -414,10 +455,14 @@ const struct timeval *stasis_message_timestamp(const struct stasis_message *msg)
  * May return \c NULL, to indicate no representation. The returned object should
  * be ast_json_unref()'ed.
  *
+ * The representation is built once and kept with the message, so every
+ * consumer asking with the same \a sanitize shares the same object. It must
+ * not be modified; use ast_json_deep_copy() to get a copy that can be.
+ *
  * \param message Message to convert to JSON string.
  * \param sanitize Snapshot sanitization callback.
  *
- * \return Newly allocated string with JSON message.
+ * \return JSON message.
  * \return \c NULL on error.
  * \return \c NULL if JSON format is not supported.
  */
@@ -429,6 +474,9 @@ struct ast_json *stasis_message_to_json(struct stasis_message *message, struct s
  * May return \c NULL, to indicate no representation. The returned object should
  * be ao2_cleanup()'ed.
  *
+ * The representation is built once and shared by every consumer of the
+ * message.
+ *
  * \param message Message to convert to AMI.
  * \return \c NULL on error.
  * \return \c NULL if AMI format is not supported.
@@ -442,6 +490,8 @@ struct ast_manager_event_blob *stasis_message_to_ami(
  * May return \c NULL, to indicate no representation. The returned object should
  * be disposed of via \ref ast_event_destroy.
  *
+ * The representation is built once per message; each caller gets its own copy.
+ *
  * \param message Message to convert to AMI.
  * \return \c NULL on error.
  * \return \c NULL if AMI format is not supported.
@@ -510,6 +560,16 @@ void stasis_publish_sync(struct stasis_subscription *sub, struct stasis_message
  */
 typedef void (*stasis_subscription_cb)(void *data, struct stasis_subscription *sub, struct stasis_message *message);
 
+/*!
+ * \brief Callback function type for batched Stasis subscriptions.
+ * \param data Data field provided with subscription.
+ * \param sub Subscription the messages were delivered to.
+ * \param messages Published messages, in the order they were published.
+ * \param count Number of messages; at least one.
+ */
+typedef void (*stasis_subscription_batch_cb)(void *data, struct stasis_subscription *sub,
+	struct stasis_message **messages, size_t count);
+
 /*!
  * \brief Stasis subscription callback function that does nothing.
  *
@@ -567,6 +627,93 @@ struct stasis_subscription *stasis_subscribe(struct stasis_topic *topic,
 struct stasis_subscription *stasis_subscribe_pool(struct stasis_topic *topic,
 	stasis_subscription_cb callback, void *data);
 
+/*!
+ * \brief Create a subscription which receives its messages in batches.
+ *
+ * Messages published while the subscription's thread is busy are collected
+ * and handed to \a callback together, so a consumer pays for a wakeup, its
+ * locking or a socket write once per batch instead of once per message.
+ * A batch holds at most \a max_messages messages. When \a max_delay_us is
+ * non-zero, a batch which has not filled up yet is held back until that many
+ * microseconds have passed since its first message; otherwise it is delivered
+ * as soon as the subscription's thread gets to it.
+ *
+ * The stasis_subscription_final_message() is delivered as the last message
+ * of the last batch. Messages published with stasis_publish_sync() are
+ * delivered in a batch of their own, after the messages collected before.
+ *
+ * \param topic Topic to subscribe to.
+ * \param callback Callback function for batches of messages.
+ * \param data Data to be passed to the callback, in addition to the messages.
+ * \param max_messages Maximum number of messages in a batch.
+ * \param max_delay_us Longest time in microseconds to hold back a batch.
+ * \return New \ref stasis_subscription object.
+ * \return \c NULL on error.
+ */
+struct stasis_subscription *stasis_subscribe_batch(struct stasis_topic *topic,
+	stasis_subscription_batch_cb callback, void *data,
+	size_t max_messages, unsigned int max_delay_us);
+
+/*!
+ * \brief Indicate to a subscription that we are interested in a message type.
+ *
+ * Together with stasis_subscription_set_filter() this lets the topic skip
+ * dispatching messages of other types to the subscription altogether, rather
+ * than queueing them for the callback to ignore. Subscription change messages,
+ * including the stasis_subscription_final_message(), are always delivered.
+ *
+ * \param subscription Subscription to add the message type to.
+ * \param type The message type we wish to receive.
+ * \retval 0 on success
+ * \retval -1 failure
+ *
+ * \note Setting the accepted message types should be done before any
+ * messages the subscription relies on are published, usually right after
+ * subscribing.
+ */
+int stasis_subscription_accept_message_type(struct stasis_subscription *subscription,
+	const struct stasis_message_type *type);
+
+/*!
+ * \brief Indicate to a subscription that we are not interested in a message type.
+ *
+ * \param subscription Subscription to remove the message type from.
+ * \param type The message type we don't wish to receive.
+ * \retval 0 on success
+ * \retval -1 failure
+ */
+int stasis_subscription_decline_message_type(struct stasis_subscription *subscription,
+	const struct stasis_message_type *type);
+
+/*!
+ * \brief Indicate to a subscription that we are interested in messages with
+ * one or more formatters.
+ *
+ * Messages whose type can be rendered in one of the accepted formats are
+ * delivered to a selective subscription even if their type was not accepted.
+ *
+ * \param subscription Subscription to alter.
+ * \param formatters A bitmask of \ref stasis_subscription_message_formatters
+ *                   we wish to receive.
+ */
+void stasis_subscription_accept_formatters(struct stasis_subscription *subscription,
+	enum stasis_subscription_message_formatters formatters);
+
+/*!
+ * \brief Set the message type filtering level on a subscription
+ *
+ * A new subscription receives all messages. Once the filter is set to
+ * \ref STASIS_SUBSCRIPTION_FILTER_SELECTIVE only messages of accepted types
+ * or formatters are dispatched to it.
+ *
+ * \param subscription Subscription that should receive all messages.
+ * \param filter What filter to use
+ * \retval 0 on success
+ * \retval -1 failure
+ */
+int stasis_subscription_set_filter(struct stasis_subscription *subscription,
+	enum stasis_subscription_message_filter filter);
+
 /*!
  * \brief Cancel a subscription.
  *
@@ -675,6 +822,63 @@ int stasis_subscription_is_subscribed(const struct stasis_subscription *sub);
  */
 int stasis_subscription_final_message(struct stasis_subscription *sub, struct stasis_message *msg);
 
+/*!
+ * \brief Publish statistics of a topic.
+ * \since 14.0.0
+ */
+struct stasis_topic_statistics {
+	/*! Number of messages published to the topic */
+	uint64_t messages_published;
+	/*! Number of times a message of the topic was dispatched to a subscriber */
+	uint64_t messages_dispatched;
+	/*! Number of subscribers the topic dispatches to, including those of forwarding topics */
+	int subscribers;
+};
+
+/*!
+ * \brief Dispatch statistics of a subscription.
+ * \since 14.0.0
+ *
+ * The latency of a message is the time from the creation of the message
+ * until the subscription's callback was invoked with it.
+ */
+struct stasis_subscription_statistics {
+	/*! Number of messages dispatched to the subscription */
+	uint64_t messages_dispatched;
+	/*! Number of messages the subscription's callback was invoked with */
+	uint64_t messages_processed;
+	/*! Number of messages of types the subscription does not accept */
+	uint64_t messages_filtered;
+	/*! Total latency of the processed messages in microseconds */
+	uint64_t latency_us;
+	/*! Highest latency of a processed message in microseconds */
+	int64_t latency_max_us;
+	/*! Number of dispatched messages not processed yet */
+	long queue_size;
+	/*! Highest number of dispatched messages not processed yet */
+	long queue_max;
+};
+
+/*!
+ * \brief Get the publish statistics of a topic.
+ * \since 14.0.0
+ *
+ * \param topic Topic.
+ * \param[out] stats Statistics of the topic. Zeroed if there are none.
+ */
+void stasis_topic_statistics_get(const struct stasis_topic *topic,
+	struct stasis_topic_statistics *stats);
+
+/*!
+ * \brief Get the dispatch statistics of a subscription.
+ * \since 14.0.0
+ *
+ * \param sub Subscription.
+ * \param[out] stats Statistics of the subscription. Zeroed if there are none.
+ */
+void stasis_subscription_statistics_get(const struct stasis_subscription *sub,
+	struct stasis_subscription_statistics *stats);
+
 /*! \addtogroup StasisTopicsAndMessages
  * @{
  */
@@ -941,6 +1145,26 @@ struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn, cache_aggre
 struct stasis_caching_topic *stasis_caching_topic_create(
 	struct stasis_topic *original_topic, struct stasis_cache *cache);
 
+/*!
+ * \brief Update a cache with a message in the calling thread
+ * \since 14.0.0
+ *
+ * This does for one message what a caching topic does for each message
+ * published to its original topic, without a subscription. It is meant for
+ * objects so numerous that a caching topic each is too costly. Messages for
+ * the same entry must be passed in the order they were published, e.g. by
+ * holding the lock of the object they snapshot.
+ *
+ * \param cache The cache, which must not have aggregates
+ * \param message A snapshot message, or a stasis_cache_clear_create() message
+ *
+ * \return The stasis_cache_update() message to publish to the caching topic,
+ *         which must be unreffed
+ * \return \c NULL if the message is not cached by \a cache, or on error
+ */
+struct stasis_message *stasis_cache_put_message(struct stasis_cache *cache,
+	struct stasis_message *message);
+
 /*!
  * \brief Unsubscribes a caching topic from its upstream topic.
  *
@@ -1060,6 +1284,38 @@ struct ao2_container *stasis_cache_get_all(struct stasis_cache *cache, struct st
  */
 struct ao2_container *stasis_cache_dump(struct stasis_cache *cache, struct stasis_message_type *type);
 
+/*!
+ * \brief Callback for stasis_cache_iterate().
+ *
+ * \param snapshot Cached snapshot. A reference is held for the duration of
+ *                 the call.
+ * \param data Data pointer given to stasis_cache_iterate().
+ *
+ * \retval 0 to continue the iteration.
+ * \retval non-zero to stop the iteration.
+ */
+typedef int (*stasis_cache_iterate_cb)(struct stasis_message *snapshot, void *data);
+
+/*!
+ * \brief Iterate over the cached items for the ast_eid_default entity.
+ *
+ * Unlike stasis_cache_dump(), the snapshots are not all collected first. The
+ * cache is split into shards which are visited one after another, and \a cb
+ * is called for the snapshots of a shard after its lock has been released.
+ * Updates of the cache are therefore never blocked for long, and the
+ * iteration may or may not see updates made while it is running.
+ *
+ * \param cache The cache to iterate.
+ * \param type Type of message to iterate (any type if \c NULL).
+ * \param cb Callback called for each cached snapshot.
+ * \param data Data pointer passed to \a cb.
+ *
+ * \retval 0 on success, including when \a cb stopped the iteration.
+ * \retval -1 on allocation error.
+ */
+int stasis_cache_iterate(struct stasis_cache *cache, struct stasis_message_type *type,
+	stasis_cache_iterate_cb cb, void *data);
+
 /*!
  * \brief Dump cached items to a subscription for a specific entity.
  * \since 12.2.0
@@ -58,8 +58,9 @@
 /*!
  * \brief Callback for Stasis application handler.
  *
- * The message given to the handler is a borrowed copy. If you want to keep a
- * reference to it, you should use \c ao2_ref() to keep it around.
+ * The message given to the handler is a borrowed copy. It may be allocated
+ * from the dispatching thread's JSON arena (see ast_json_arena_begin()), so
+ * to keep it around, make a copy of it with the arena suspended.
  *
  * \param data Data ptr given when registered.
  * \param app_name Name of the application being dispatched to.
@@ -115,8 +116,9 @@ void stasis_app_unregister(const char *app_name);
 /*!
  * \brief Send a message to the given Stasis application.
  *
- * The message given to the handler is a borrowed copy. If you want to keep a
- * reference to it, you should use \c ao2_ref() to keep it around.
+ * The message given to the handler is a borrowed copy. It may be allocated
+ * from the dispatching thread's JSON arena (see ast_json_arena_begin()), so
+ * to keep it around, make a copy of it with the arena suspended.
  *
  * \param app_name Name of the application to invoke.
  * \param message Message to send (borrowed reference)
@@ -326,6 +328,56 @@ enum stasis_app_subscribe_res stasis_app_unsubscribe(const char *app_name,
 enum stasis_app_subscribe_res stasis_app_subscribe_channel(const char *app_name,
 	struct ast_channel *chan);
 
+/*! \brief Return code for stasis_app_event_filter_set() */
+enum stasis_app_event_filter_res {
+	STASIS_AEF_OK,
+	STASIS_AEF_APP_NOT_FOUND,
+	STASIS_AEF_BAD_FILTER,
+	STASIS_AEF_INTERNAL_ERROR,
+};
+
+/*!
+ * \brief Replace the event filter of an application.
+ *
+ * The filter is an object which may have these members:
+ * - \c allowed: a list of objects, such as <tt>{"type": "StasisStart"}</tt>.
+ *   If not empty, only events of the listed types are sent.
+ * - \c disallowed: a list of objects like \c allowed. Events of the listed
+ *   types are not sent.
+ * - \c omitted: a list of names. The members of those names are left out of
+ *   every object in an event, such as the \c channelvars or \c dialplan of a
+ *   channel.
+ *
+ * \param app_name Name of the application.
+ * \param filter The new filter, or \c NULL to send every event in full.
+ * \param json Optional output pointer for JSON representation of the app
+ *             after setting the filter.
+ *
+ * \return \ref stasis_app_event_filter_res return code.
+ *
+ * \since 14.0.0
+ */
+enum stasis_app_event_filter_res stasis_app_event_filter_set(const char *app_name,
+	struct ast_json *filter, struct ast_json **json);
+
+/*!
+ * \brief Set whether an application is sent compact events.
+ *
+ * Channel, bridge and endpoint snapshots in compact events are reduced to
+ * their id, and to the member a snapshot update event is about, such as the
+ * \c state in a ChannelStateChange. Events that introduce a snapshot, such as
+ * StasisStart, still carry it in full.
+ *
+ * \param app_name Name of the application.
+ * \param compact Non-zero for compact events, zero for full events.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the application does not exist.
+ *
+ * \since 14.0.0
+ */
+int stasis_app_compact_set(const char *app_name, int compact);
+
 /*! @} */
 
 /*! @{ */
@@ -260,6 +260,22 @@ void ast_bridge_publish_leave(struct ast_bridge *bridge, struct ast_channel *cha
 struct ast_json *ast_bridge_snapshot_to_json(const struct ast_bridge_snapshot *snapshot,
 	const struct stasis_message_sanitizer *sanitize);
 
+/*!
+ * \brief Write a \ref ast_bridge_snapshot as the next value of a JSON document.
+ * \since 14.0.0
+ *
+ * Writes what ast_bridge_snapshot_to_json() would build, without building it.
+ *
+ * \param snapshot The bridge snapshot to write
+ * \param sanitize The message sanitizer to use on the snapshot
+ * \param writer The document being written
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int ast_bridge_snapshot_json_write(const struct ast_bridge_snapshot *snapshot,
+	const struct stasis_message_sanitizer *sanitize, struct ast_json_writer *writer);
+
 /*!
  * \brief Pair showing a bridge snapshot and a specific channel snapshot belonging to the bridge
  */
@@ -35,33 +35,52 @@
  *
  * While not enforced programmatically, this object is shared across multiple
  * threads, and should be treated as an immutable object.
+ *
+ * The string members point into reference counted segments, grouped by how
+ * often they change. A new snapshot of a channel takes the segments of the
+ * previous one where none of their strings changed, so e.g. a dialplan step
+ * only copies the dialplan strings.
  */
 struct ast_channel_snapshot {
-	AST_DECLARE_STRING_FIELDS(
-		AST_STRING_FIELD(name);             /*!< ASCII unique channel name */
-		AST_STRING_FIELD(uniqueid);         /*!< Unique Channel Identifier */
-		AST_STRING_FIELD(linkedid);         /*!< Linked Channel Identifier -- gets propagated by linkage */
-		AST_STRING_FIELD(appl);             /*!< Current application */
-		AST_STRING_FIELD(data);             /*!< Data passed to current application */
-		AST_STRING_FIELD(context);          /*!< Dialplan: Current extension context */
-		AST_STRING_FIELD(exten);            /*!< Dialplan: Current extension number */
-		AST_STRING_FIELD(accountcode);      /*!< Account code for billing */
-		AST_STRING_FIELD(peeraccount);      /*!< Peer account code for billing */
-		AST_STRING_FIELD(userfield);        /*!< Userfield for CEL billing */
-		AST_STRING_FIELD(hangupsource);     /*!< Who is responsible for hanging up this channel */
-		AST_STRING_FIELD(caller_name);      /*!< Caller ID Name */
-		AST_STRING_FIELD(caller_number);    /*!< Caller ID Number */
-		AST_STRING_FIELD(caller_dnid);      /*!< Dialed ID Number */
-		AST_STRING_FIELD(caller_ani);       /*!< Caller ID ANI Number */
-		AST_STRING_FIELD(caller_rdnis);     /*!< Caller ID RDNIS Number */
-		AST_STRING_FIELD(caller_subaddr);   /*!< Caller subaddress */
-		AST_STRING_FIELD(dialed_subaddr);   /*!< Dialed subaddress */
-		AST_STRING_FIELD(connected_name);   /*!< Connected Line Name */
-		AST_STRING_FIELD(connected_number); /*!< Connected Line Number */
-		AST_STRING_FIELD(language);         /*!< The default spoken language for the channel */
-		AST_STRING_FIELD(bridgeid);         /*!< Unique Bridge Identifier */
-		AST_STRING_FIELD(type);             /*!< Type of channel technology */
-	);
+	/* Base segment */
+	const char *name;                       /*!< ASCII unique channel name */
+	const char *uniqueid;                   /*!< Unique Channel Identifier */
+	const char *type;                       /*!< Type of channel technology */
+	const char *accountcode;                /*!< Account code for billing */
+	const char *userfield;                  /*!< Userfield for CEL billing */
+	const char *language;                   /*!< The default spoken language for the channel */
+	const char *hangupsource;               /*!< Who is responsible for hanging up this channel */
+
+	/* Peer segment */
+	const char *linkedid;                   /*!< Linked Channel Identifier -- gets propagated by linkage */
+	const char *peeraccount;                /*!< Peer account code for billing */
+
+	/* Dialplan segment */
+	const char *appl;                       /*!< Current application */
+	const char *data;                       /*!< Data passed to current application */
+	const char *context;                    /*!< Dialplan: Current extension context */
+	const char *exten;                      /*!< Dialplan: Current extension number */
+
+	/* Caller segment */
+	const char *caller_name;                /*!< Caller ID Name */
+	const char *caller_number;              /*!< Caller ID Number */
+	const char *caller_dnid;                /*!< Dialed ID Number */
+	const char *caller_ani;                 /*!< Caller ID ANI Number */
+	const char *caller_rdnis;               /*!< Caller ID RDNIS Number */
+	const char *caller_subaddr;             /*!< Caller subaddress */
+	const char *dialed_subaddr;             /*!< Dialed subaddress */
+	const char *connected_name;             /*!< Connected Line Name */
+	const char *connected_number;           /*!< Connected Line Number */
+
+	/* Bridge segment */
+	const char *bridgeid;                   /*!< Unique Bridge Identifier */
+
+	/*! Segments the string members point into, see ast_channel_snapshot_create() */
+	struct ast_channel_snapshot_segment *base;
+	struct ast_channel_snapshot_segment *peer;
+	struct ast_channel_snapshot_segment *dialplan;
+	struct ast_channel_snapshot_segment *caller;
+	struct ast_channel_snapshot_segment *bridge;
 
 	struct timeval creationtime;            /*!< The time of channel creation */
 	enum ast_channel_state state;           /*!< State of line */
@@ -141,6 +160,9 @@ struct stasis_message_type *ast_channel_snapshot_type(void);
  * \brief Generate a snapshot of the channel state. This is an ao2 object, so
  * ao2_cleanup() to deallocate.
  *
+ * The previous snapshot created for the channel is kept, and segments of it
+ * where nothing changed are shared with the new snapshot instead of copied.
+ *
  * \pre chan is locked
  *
  * \param chan The channel from which to generate a snapshot
@@ -582,6 +604,22 @@ void ast_publish_channel_state(struct ast_channel *chan);
 struct ast_json *ast_channel_snapshot_to_json(const struct ast_channel_snapshot *snapshot,
 	const struct stasis_message_sanitizer *sanitize);
 
+/*!
+ * \brief Write a \ref ast_channel_snapshot as the next value of a JSON document.
+ * \since 14.0.0
+ *
+ * Writes what ast_channel_snapshot_to_json() would build, without building it.
+ *
+ * \param snapshot The snapshot to write
+ * \param sanitize The message sanitizer to use on the snapshot
+ * \param writer The document being written
+ *
+ * \retval 0 on success
+ * \retval -1 on error, or if the sanitizer hides the snapshot, when nothing is written
+ */
+int ast_channel_snapshot_json_write(const struct ast_channel_snapshot *snapshot,
+	const struct stasis_message_sanitizer *sanitize, struct ast_json_writer *writer);
+
 /*!
  * \brief Compares the context, exten and priority of two snapshots.
  * \since 12
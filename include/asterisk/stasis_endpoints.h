@@ -223,6 +223,24 @@ struct ast_json *ast_endpoint_snapshot_to_json(
 	const struct ast_endpoint_snapshot *snapshot,
 	const struct stasis_message_sanitizer *sanitize);
 
+/*!
+ * \brief Write a \ref ast_endpoint_snapshot as the next value of a JSON document.
+ * \since 14.0.0
+ *
+ * Writes what ast_endpoint_snapshot_to_json() would build, without building it.
+ *
+ * \param snapshot Endpoint snapshot.
+ * \param sanitize The message sanitizer to use on the snapshot
+ * \param writer The document being written
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int ast_endpoint_snapshot_json_write(
+	const struct ast_endpoint_snapshot *snapshot,
+	const struct stasis_message_sanitizer *sanitize,
+	struct ast_json_writer *writer);
+
 /*!
  * \brief Initialization function for endpoint stasis support.
  *
@@ -37,6 +37,10 @@
  * route's \a callback is invoked just as if it were a callback for a
  * subscription; but it only gets called for messages of the specified type.
  *
+ * Until a default route is set, the router's subscription only accepts the
+ * message types it has routes for, so the topic does not dispatch other
+ * messages to the router at all.
+ *
  * \since 12
  */
 
@@ -208,6 +212,27 @@ void stasis_message_router_remove_cache_update(
 	struct stasis_message_router *router,
 	struct stasis_message_type *message_type);
 
+/*!
+ * \brief Sets the default route of a router with formatters.
+ *
+ * Unlike stasis_message_router_set_default(), the router's subscription
+ * keeps filtering messages: the default route only receives messages that
+ * can be rendered in one of the given \a formatters.
+ *
+ * \param router Router to set the default route of.
+ * \param callback Callback to forward messages which otherwise have no home.
+ * \param data Data pointer to pass to \a callback.
+ * \param formatters A bitmask of \ref stasis_subscription_message_formatters
+ *                   the default route wants to receive.
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+int stasis_message_router_set_formatters_default(struct stasis_message_router *router,
+	stasis_subscription_cb callback,
+	void *data,
+	enum stasis_subscription_message_formatters formatters);
+
 /*!
  * \brief Sets the default route of a router.
  *
@@ -85,6 +85,19 @@
   ast_string_field_ptr_build_va(x, &x->bar, fmt, args)
   \endcode
 
+  Values shared by many objects that rarely change, such as contexts,
+  languages, account codes and technology names, can be interned instead:
+  ast_string_field_set_interned() points the field at a copy of the string
+  kept once for all objects. Setting a field from a field that is interned,
+  including with ast_string_fields_copy(), copies the pointer rather than the
+  string. Interned strings are never freed, so only intern values that come
+  from a bounded set.
+
+  \code
+  ast_string_field_set_interned(x, foo, "default");
+  ast_string_field_set(y, foo, x->foo); // y->foo shares x->foo
+  \endcode
+
   When the structure instance is no longer needed, the fields
   and their storage pool must be freed:
   
@@ -211,6 +224,28 @@ void __ast_string_field_ptr_build_va(struct ast_string_field_mgr *mgr,
 				     struct ast_string_field_pool **pool_head,
 				     ast_string_field *ptr, const char *format, va_list ap) __attribute__((format(printf, 4, 0)));
 
+/*!
+  \internal
+  \brief Whether a string is in the interned string arena
+  \param str The string
+  \retval non-zero if interned
+  \retval zero if not
+*/
+int __ast_string_field_is_interned(const char *str);
+
+/*!
+  \internal
+  \brief Set a field to the interned copy of a string
+  \param mgr Pointer to the pool manager structure
+  \param pool_head Pointer to the current pool
+  \param ptr Pointer to a field within the structure
+  \param data String value to be interned
+  \retval zero on success
+  \retval non-zero on error
+*/
+int __ast_string_field_ptr_set_interned(struct ast_string_field_mgr *mgr,
+	struct ast_string_field_pool **pool_head, ast_string_field *ptr, const char *data);
+
 /*!
   \brief Declare a string field
   \param name The field name
@@ -326,6 +361,9 @@ void __ast_string_field_release_active(struct ast_string_field_pool *pool_head,
     if (__dlen__ == 1) {                                                                       \
         __ast_string_field_release_active(field_mgr_pool, *__p__);                             \
         *__p__ = __ast_string_field_empty;                                                     \
+    } else if (__ast_string_field_is_interned(__d__)) {                                        \
+        __ast_string_field_release_active(field_mgr_pool, *__p__);                             \
+        *__p__ = __d__;                                                                        \
     } else if ((__dlen__ <= AST_STRING_FIELD_ALLOCATION(*__p__)) ||                            \
            (!__ast_string_field_ptr_grow(&field_mgr, &field_mgr_pool, __dlen__, __p__)) ||     \
            (target = __ast_string_field_alloc_space(&field_mgr, &field_mgr_pool, __dlen__))) { \
@@ -350,6 +388,37 @@ void __ast_string_field_release_active(struct ast_string_field_pool *pool_head,
 */
 #define ast_string_field_set(x, field, data) ast_string_field_ptr_set(x, &(x)->field, data)
 
+/*!
+  \brief Set a field to a shared, interned copy of a string
+  \since 14.0.0
+  \param x Pointer to a structure containing fields
+  \param ptr Pointer to a field within the structure
+  \param data String value to be interned
+
+  The string is copied once into an arena shared by all objects and the
+  field points at that copy. Strings too long to intern, or set once the
+  arena is full, are copied into the pool as by ast_string_field_ptr_set().
+
+  \note Interned strings are never freed. Only use this for values from a
+  bounded set, such as configured names.
+
+  \retval zero on success
+  \retval non-zero on error
+*/
+#define ast_string_field_ptr_set_interned(x, ptr, data) \
+	__ast_string_field_ptr_set_interned(&(x)->__field_mgr, &(x)->__field_mgr_pool, (ast_string_field *) (ptr), data)
+
+/*!
+  \brief Set a field to a shared, interned copy of a string
+  \since 14.0.0
+  \param x Pointer to a structure containing fields
+  \param field Name of the field to set
+  \param data String value to be interned
+  \retval zero on success
+  \retval non-zero on error
+*/
+#define ast_string_field_set_interned(x, field, data) ast_string_field_ptr_set_interned(x, &(x)->field, data)
+
 /*!
   \brief Set a field to a complex (built) value
   \param x Pointer to a structure containing fields
@@ -56,6 +56,7 @@
 
 struct ast_taskprocessor;
 
+/*! \brief Default queue size at which a taskprocessor raises an overload alert */
 #define AST_TASKPROCESSOR_HIGH_WATER_LEVEL 500
 
 /*!
@@ -71,6 +72,16 @@ enum ast_tps_options {
 	TPS_REF_DEFAULT = 0,
 	/*! \brief return a reference to a taskprocessor ONLY if it already exists */
 	TPS_REF_IF_EXISTS = (1 << 0),
+	/*!
+	 * \brief if the taskprocessor gets created, give it a lock-free task queue
+	 * \since 14.0.0
+	 *
+	 * Pushing a task then only takes an atomic exchange instead of the
+	 * taskprocessor lock, which helps taskprocessors fed by many producer
+	 * threads. The queue supports a single consumer, which the default
+	 * listener guarantees. Ignored on platforms without atomic builtins.
+	 */
+	TPS_QUEUE_LOCKFREE = (1 << 1),
 };
 
 struct ast_taskprocessor_listener;
@@ -154,7 +165,7 @@ struct ast_taskprocessor_listener *ast_taskprocessor_listener_alloc(const struct
  * disabled by specifying the TPS_REF_IF_EXISTS ast_tps_options as the second argument to ast_taskprocessor_get().
  * \param name The name of the taskprocessor
  * \param create Use 0 by default or specify TPS_REF_IF_EXISTS to return NULL if the taskprocessor does
- * not already exist
+ * not already exist. TPS_QUEUE_LOCKFREE may be added to give a newly created taskprocessor a lock-free queue.
  * return A pointer to a reference counted taskprocessor under normal conditions, or NULL if the
  * TPS_REF_IF_EXISTS reference type is specified and the taskprocessor does not exist
  * \since 1.6.1
@@ -248,6 +259,30 @@ int ast_taskprocessor_push_local(struct ast_taskprocessor *tps,
  */
 int ast_taskprocessor_execute(struct ast_taskprocessor *tps);
 
+/*! \brief Largest number of tasks ast_taskprocessor_execute_batch() executes per call */
+#define AST_TASKPROCESSOR_BATCH_MAX 64
+
+/*!
+ * \brief Pop several tasks off the taskprocessor and execute them.
+ * \since 14.0.0
+ *
+ * Up to \a max_tasks queued tasks are taken off the queue at once and
+ * executed back to back, so the taskprocessor is locked once per batch
+ * instead of once per task. Tasks are executed in the order they
+ * were queued.
+ *
+ * \note The local data passed to tasks pushed with ast_taskprocessor_push_local()
+ * is the local data that was set when the batch was taken off the queue.
+ *
+ * \param tps The taskprocessor from which to execute.
+ * \param max_tasks The maximum number of tasks to execute. Limited to
+ * \ref AST_TASKPROCESSOR_BATCH_MAX.
+ * \param[out] executed If non-NULL, set to the number of tasks executed.
+ * \retval 0 There is no further work to be done.
+ * \retval 1 Tasks still remain in the taskprocessor queue.
+ */
+int ast_taskprocessor_execute_batch(struct ast_taskprocessor *tps, int max_tasks, int *executed);
+
 /*!
  * \brief Am I the given taskprocessor's current task.
  * \since 12.7.0
@@ -270,4 +305,121 @@ const char *ast_taskprocessor_name(struct ast_taskprocessor *tps);
  */
 long ast_taskprocessor_size(struct ast_taskprocessor *tps);
 
+/*!
+ * \brief Return the number of tasks queued, counting the one executing
+ *
+ * Unlike ast_taskprocessor_size(), a taskprocessor held up by a task that
+ * takes a long time to execute is not reported as empty.
+ *
+ * \note The result is read without locking, so it is only an estimate.
+ * \since 14.0.0
+ */
+long ast_taskprocessor_depth(struct ast_taskprocessor *tps);
+
+/*!
+ * \brief Set the high and low alert water marks of the given taskprocessor queue.
+ * \since 14.0.0
+ *
+ * When the queue grows to \a high_water tasks the taskprocessor raises an
+ * overload alert, which is cleared again once the queue has drained down
+ * to \a low_water tasks. Producers can check the alerts to shed or defer
+ * work while the system is overloaded.
+ *
+ * Taskprocessors start with a high water level of
+ * \ref AST_TASKPROCESSOR_HIGH_WATER_LEVEL.
+ *
+ * \param tps Taskprocessor to set the water levels of.
+ * \param low_water Queue size at which to clear the alert. (-1 to set to 90% of high_water)
+ * \param high_water Queue size at which to raise the alert. (Must be positive)
+ *
+ * \retval 0 on success.
+ * \retval -1 on error (water levels not set).
+ */
+int ast_taskprocessor_alert_set_levels(struct ast_taskprocessor *tps, long low_water, long high_water);
+
+/*!
+ * \brief Get the current taskprocessor high water alert count.
+ * \since 14.0.0
+ *
+ * \retval 0 if no taskprocessors are in high water alert.
+ * \retval non-zero if some task processors are in high water alert.
+ */
+unsigned int ast_taskprocessor_alert_get(void);
+
+/*!
+ * \brief Determine if the given taskprocessor is in high water alert.
+ * \since 14.0.0
+ *
+ * \param tps Taskprocessor to check.
+ *
+ * \retval non-zero if the taskprocessor queue has reached its high water
+ * level and not yet drained to its low water level.
+ */
+int ast_taskprocessor_is_overloaded(struct ast_taskprocessor *tps);
+
+/*! \brief Number of buckets in each taskprocessor latency histogram */
+#define AST_TASKPROCESSOR_HISTOGRAM_BUCKETS 7
+
+/*!
+ * \brief Latency statistics for a taskprocessor
+ * \since 14.0.0
+ *
+ * Each histogram bucket counts the tasks whose time fell below the bucket's
+ * upper bound, see ast_taskprocessor_histogram_bucket_name(). The last bucket
+ * has no upper bound.
+ */
+struct ast_taskprocessor_latency {
+	/*! \brief Time tasks spent queued before they started executing */
+	unsigned long wait[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	/*! \brief Time tasks spent executing */
+	unsigned long execute[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	/*! \brief Longest time in microseconds a task spent queued */
+	int64_t wait_max;
+	/*! \brief Longest time in microseconds a task spent executing */
+	int64_t execute_max;
+};
+
+/*!
+ * \brief Get a copy of the latency statistics of a taskprocessor
+ * \since 14.0.0
+ *
+ * \param tps Taskprocessor to get the statistics of
+ * \param latency Filled in with the statistics
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+int ast_taskprocessor_latency_get(struct ast_taskprocessor *tps, struct ast_taskprocessor_latency *latency);
+
+/*!
+ * \brief Get a short label describing the upper bound of a latency histogram bucket
+ * \since 14.0.0
+ *
+ * \param bucket Index of the bucket
+ *
+ * \return The label, i.e. "1ms". An empty string if the bucket does not exist.
+ */
+const char *ast_taskprocessor_histogram_bucket_name(int bucket);
+
+/*!
+ * \brief Get the latency histogram bucket a time falls in
+ * \since 14.0.0
+ *
+ * \param usec The time in microseconds
+ *
+ * \return The index of the bucket
+ */
+int ast_taskprocessor_histogram_bucket(int64_t usec);
+
+/*!
+ * \brief Get the upper bound of a latency histogram bucket
+ * \since 14.0.0
+ *
+ * \param bucket Index of the bucket
+ *
+ * \return The upper bound in microseconds
+ * \retval -1 The bucket has no upper bound or does not exist
+ */
+int64_t ast_taskprocessor_histogram_bucket_limit(int bucket);
+
 #endif /* __AST_TASKPROCESSOR_H__ */
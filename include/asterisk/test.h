@@ -112,6 +112,46 @@
    'test generate results xml' will generate a test report in xml format
    'test generate results txt' will generate a test report in txt format
 \endcode
+
+\section UnitTestBench Benchmarks
+
+   A benchmark is a test that runs one operation many times and measures it.
+   Define it with the AST_BENCH_DEFINE macro, filling in a struct
+   ast_bench_info with the operation and, if it needs them, functions to set
+   up and tear down the state it works on. The framework runs the operation
+   some number of times to warm up, then measures the iterations and reports
+   the time per operation, operations per second, percentile latencies and,
+   when built with MALLOC_DEBUG, allocations per operation.
+
+\code
+   static int sample_op(void *data, unsigned int iteration)
+   {
+      return ast_extension_match("_NXXNXXXXXX", "2565551234") ? 0 : -1;
+   }
+
+   AST_BENCH_DEFINE(sample_bench)
+   {
+      bench->name = "sample_bench";
+      bench->category = "/bench/main/";
+      bench->summary = "sample benchmark for example purpose";
+      bench->description = "This demonstrates how to define a benchmark";
+      bench->iterations = 100000;
+      bench->batch = 100;
+      bench->op = sample_op;
+   }
+\endcode
+
+   A benchmark is registered and unregistered with AST_TEST_REGISTER and
+   AST_TEST_UNREGISTER like any other test, and runs with 'test execute' as
+   well. The 'bench' CLI commands run only benchmarks and show what they
+   measured:
+
+\code
+   'bench execute category /bench/'  will run every benchmark in /bench/
+   'bench show results'               will show the last measurements
+   'bench generate results json'      will write them to a JSON file
+   'bench generate results junit'     will write them to a JUnit XML file
+\endcode
 */
 
 /*! Macros used for defining and registering a test */
@@ -121,11 +161,27 @@
 #define AST_TEST_REGISTER(cb) ast_test_register(cb)
 #define AST_TEST_UNREGISTER(cb) ast_test_unregister(cb)
 
+/*!
+ * \brief Define a benchmark
+ *
+ * Defines a test named \a hdr, registered with AST_TEST_REGISTER(), and
+ * starts the definition of the function filling in its struct
+ * ast_bench_info, which is named \c bench.
+ */
+#define AST_BENCH_DEFINE(hdr) \
+	static void hdr##_bench_info(struct ast_bench_info *bench); \
+	AST_TEST_DEFINE(hdr) \
+	{ \
+		return __ast_bench_run(hdr##_bench_info, info, cmd, test); \
+	} \
+	static void hdr##_bench_info(struct ast_bench_info *bench)
+
 #else
 
 #define AST_TEST_DEFINE(hdr) static enum ast_test_result_state attribute_unused hdr(struct ast_test_info *info, enum ast_test_command cmd, struct ast_test *test)
 #define AST_TEST_REGISTER(cb)
 #define AST_TEST_UNREGISTER(cb)
+#define AST_BENCH_DEFINE(hdr) static void attribute_unused hdr##_bench_info(struct ast_bench_info *bench)
 #define ast_test_status_update(a,b,c...)
 #define ast_test_debug(test, fmt, ...)	ast_cli		/* Dummy function that should not be called. */
 
@@ -334,6 +390,73 @@ int ast_test_register_init(const char *category, ast_test_init_cb_t *cb);
  */
 int ast_test_register_cleanup(const char *category, ast_test_cleanup_cb_t *cb);
 
+/*!
+ * \since 14.0.0
+ * \brief What a benchmark measures, and how
+ *
+ * Filled in by the function AST_BENCH_DEFINE() starts. Counts left at 0
+ * take their defaults.
+ */
+struct ast_bench_info {
+	/*! \brief name of the benchmark, unique to category */
+	const char *name;
+	/*! \brief benchmark category, as for \ref ast_test_info, normally under /bench/ */
+	const char *category;
+	/*! \brief Short summary of the benchmark, without a trailing newline */
+	const char *summary;
+	/*! \brief More detailed description, without a trailing newline */
+	const char *description;
+	/*! \brief Operations run before measuring, 1000 by default */
+	unsigned int warmup;
+	/*! \brief Operations measured, 10000 by default */
+	unsigned int iterations;
+	/*!
+	 * \brief Operations timed together as one latency sample, 1 by default
+	 *
+	 * Reading the clock takes tens of nanoseconds, so operations cheaper
+	 * than a microsecond or so should be timed in batches. The percentile
+	 * latencies are then those of the batches, divided by its size.
+	 */
+	unsigned int batch;
+	/*!
+	 * \brief Set up the state the operation works on (optional)
+	 *
+	 * \param test The benchmark, for ast_test_status_update()
+	 * \param data Set to what is passed to the operation and teardown
+	 *
+	 * \retval 0 success
+	 * \retval non-zero failure, which fails the benchmark
+	 */
+	int (*setup)(struct ast_test *test, void **data);
+	/*!
+	 * \brief Run the operation once (required)
+	 *
+	 * \param data What setup gave, or NULL
+	 * \param iteration Counts up from 0, through the warm-up and then the
+	 *        measured operations
+	 *
+	 * \retval 0 success
+	 * \retval non-zero failure, which stops and fails the benchmark
+	 */
+	int (*op)(void *data, unsigned int iteration);
+	/*!
+	 * \brief Release what setup made (optional)
+	 *
+	 * Called whenever setup succeeded, even if the operation failed.
+	 */
+	void (*teardown)(void *data);
+};
+
+/*! \brief The function AST_BENCH_DEFINE() starts the definition of */
+typedef void (ast_bench_info_cb_t)(struct ast_bench_info *bench);
+
+/*!
+ * \since 14.0.0
+ * \brief Run a benchmark as a test, for AST_BENCH_DEFINE()
+ */
+enum ast_test_result_state __ast_bench_run(ast_bench_info_cb_t *info_cb,
+	struct ast_test_info *info, enum ast_test_command cmd, struct ast_test *test);
+
 
 /*!
  * \brief Unit test debug output.
@@ -0,0 +1,95 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+#ifndef ASTERISK_THREAD_AFFINITY_H
+#define ASTERISK_THREAD_AFFINITY_H
+
+/*!
+ * \file
+ *
+ * \brief Thread placement API
+ *
+ * Threads belonging to one of the classes below can be restricted to a set
+ * of CPUs configured in the [threads] section of asterisk.conf. Threads
+ * place themselves by calling ast_thread_affinity_apply() when they start.
+ *
+ * Thread placement is only supported on Linux. On other platforms the
+ * functions do nothing.
+ *
+ * \since 14.0.0
+ */
+
+/*! \brief Classes of threads that can be placed on a set of CPUs */
+enum ast_thread_class {
+	/*! \brief Threadpool worker threads */
+	AST_THREAD_CLASS_THREADPOOL = 0,
+	/*! \brief Bridge mixing threads */
+	AST_THREAD_CLASS_MIXING,
+	/*! \brief RTP I/O threads */
+	AST_THREAD_CLASS_RTP,
+	/*! \brief Channel PBX threads */
+	AST_THREAD_CLASS_PBX,
+	/*! \brief Transcoding service worker threads */
+	AST_THREAD_CLASS_TRANSCODE,
+	/*! \brief Number of thread classes. Must be last. */
+	AST_THREAD_CLASS_MAX,
+};
+
+/*! \brief Largest number of NUMA nodes known to the thread placement API */
+#define AST_THREAD_AFFINITY_MAX_NODES 8
+
+/*!
+ * \brief Place the calling thread on the CPUs configured for its class
+ *
+ * \param thread_class The class of the calling thread
+ *
+ * \retval 0 The thread was placed, or no CPUs are configured for the class.
+ * \retval -1 The thread could not be placed.
+ */
+int ast_thread_affinity_apply(enum ast_thread_class thread_class);
+
+/*!
+ * \brief Place the calling thread on the CPUs of a NUMA node
+ *
+ * The thread is placed on the CPUs configured for its class that belong to
+ * \a node. If none of them do, or \a node is not known, this is the same as
+ * ast_thread_affinity_apply().
+ *
+ * \param thread_class The class of the calling thread
+ * \param node The NUMA node to place the thread on
+ *
+ * \retval 0 The thread was placed.
+ * \retval -1 The thread could not be placed.
+ */
+int ast_thread_affinity_apply_node(enum ast_thread_class thread_class, int node);
+
+/*!
+ * \brief Get the NUMA node the calling thread is currently running on
+ *
+ * \return The node, between 0 and \ref AST_THREAD_AFFINITY_MAX_NODES - 1.
+ * \retval -1 The node is not known.
+ */
+int ast_thread_affinity_current_node(void);
+
+/*!
+ * \brief Determine if bridge mixing threads should follow their participants
+ *
+ * \retval non-zero if mixing threads should run on the NUMA node most of
+ * the bridge's participants run on.
+ */
+int ast_thread_affinity_mixing_follows_participants(void);
+
+#endif /* ASTERISK_THREAD_AFFINITY_H */
@@ -122,6 +122,44 @@ struct ast_threadpool_options {
 	 * a thread completes
 	 */
 	void (*thread_end)(void);
+	/*!
+	 * \brief Use per-worker task queues with work stealing
+	 * \since 14.0.0
+	 *
+	 * By default all tasks pushed into a threadpool go through a single
+	 * shared queue. When this is non-zero, each worker thread is given
+	 * its own queue instead. Tasks pushed from within a worker thread
+	 * stay on that worker's queue, tasks pushed from elsewhere are
+	 * spread across the queues, and workers that run out of work steal
+	 * tasks from the queues of busy workers.
+	 *
+	 * Serializers created on the pool still execute their tasks in order.
+	 */
+	int work_stealing;
+	/*!
+	 * \brief Target queue wait time in milliseconds for autoscaling
+	 * \since 14.0.0
+	 *
+	 * When positive, the pool measures how long tasks wait before a thread
+	 * starts executing them. The pool grows when the 99th percentile of the
+	 * wait time is above this target and shrinks when it is well below the
+	 * target and threads are idle. The pool never grows beyond max_size.
+	 *
+	 * Zero disables autoscaling.
+	 */
+	int autoscale_target_wait;
+	/*!
+	 * \brief Number of threads the autoscaler keeps in the pool
+	 * \since 14.0.0
+	 *
+	 * Threads may still exit after idle_timeout.
+	 */
+	int autoscale_min_size;
+	/*!
+	 * \brief Minimum number of seconds between two resizes by the autoscaler
+	 * \since 14.0.0
+	 */
+	int autoscale_cooldown;
 };
 
 /*!
@@ -163,6 +163,19 @@ struct ast_translator {
 	                                       /*!< cleanup private data, if needed 
 	                                        *   (often unnecessary). */
 
+	int (*reset)(struct ast_trans_pvt *pvt);
+	                                       /*!< Return private data to the state newpvt
+	                                        *   left it in, so the instance can be kept
+	                                        *   for reuse by another path. Return non-zero
+	                                        *   if it cannot be reused. Optional; without
+	                                        *   it instances are always destroyed. */
+
+	int (*set_quality)(struct ast_trans_pvt *pvt, unsigned int quality);
+	                                       /*!< Change the quality of an instance, from
+	                                        *   1 (cheapest) to 10 (best), for translators
+	                                        *   that can trade quality for CPU time. reset
+	                                        *   must restore the default. Optional. */
+
 	struct ast_frame * (*sample)(void);    /*!< Generate an example frame */
 
 	/*!\brief size of outbuf, in samples. Leave it 0 if you want the framein
@@ -179,6 +192,8 @@ struct ast_translator {
 
 	int desc_size;                         /*!< size of private descriptor in pvt->pvt, if any */
 	int native_plc;                        /*!< true if the translator can do native plc */
+	int track_usage;                       /*!< true to count the time spent in framein, shown
+	                                        *   by 'core show translation stats' */
 
 	struct ast_module *module;             /*!< opaque reference to the parent module */
 
@@ -186,6 +201,11 @@ struct ast_translator {
 	int src_fmt_index;                     /*!< index of the source format in the matrix table */
 	int dst_fmt_index;                     /*!< index of the destination format in the matrix table */
 	AST_LIST_ENTRY(ast_translator) list;   /*!< link field */
+	struct ast_trans_pvt *pool;            /*!< Idle reset instances, linked by next */
+	int pool_size;                         /*!< Number of instances in the pool */
+	uint64_t usage_frames;                 /*!< Frames translated, if track_usage is set */
+	uint64_t usage_samples;                /*!< Samples translated, if track_usage is set */
+	uint64_t usage_ns;                     /*!< Nanoseconds spent in framein, if track_usage is set */
 };
 
 /*! \brief
@@ -231,6 +251,10 @@ struct ast_trans_pvt {
 	 * explicit_dst contains an attribute which describes whether both parties
 	 * want to do forward-error correction (FEC). */
 	struct ast_format *explicit_dst;
+	/*! Frame being translated by the transcoding service, on the head of a path */
+	struct transcode_job *offload;
+	/*! Set once the path missed the latency budget and translates inline */
+	int offload_inline;
 };
 
 /*! \brief generic frameout function */
@@ -277,6 +301,14 @@ void ast_translator_activate(struct ast_translator *t);
  */
 void ast_translator_deactivate(struct ast_translator *t);
 
+/*!
+ * \brief Set the quality of every step of a translation path that supports it
+ *
+ * \param path The translation path
+ * \param quality From 1 (cheapest) to 10 (best)
+ */
+void ast_translator_set_quality(struct ast_trans_pvt *path, unsigned int quality);
+
 /*!
  * \brief Chooses the best translation path
  *
@@ -307,7 +339,8 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dest, struct
 
 /*!
  * \brief Frees a translator path
- * Frees the given translator path structure
+ * Frees the given translator path structure. Steps whose translator can
+ * reset them are kept for reuse by later paths instead.
  * \param tr translator path to get rid of
  */
 void ast_translator_free_path(struct ast_trans_pvt *tr);
@@ -323,6 +356,30 @@ void ast_translator_free_path(struct ast_trans_pvt *tr);
  */
 struct ast_frame *ast_translate(struct ast_trans_pvt *tr, struct ast_frame *f, int consume);
 
+/*!
+ * \brief translates one or more frames, on the transcoding service if enabled
+ *
+ * \param path translator structure to use for translation
+ * \param f frame to translate
+ * \param consume Whether or not to free the original frame
+ *
+ * When the [transcode] section of asterisk.conf enables worker threads, \a f
+ * is handed to them and the translation of the frame passed on the previous
+ * call is returned instead, so channels translating with the same codec are
+ * batched together. The path falls back to ast_translate() for good if a
+ * translation takes longer than the configured latency budget.
+ *
+ * \note The path must only be used by one thread at a time, as with
+ * ast_translate(). ast_translator_free_path() waits for a frame still being
+ * translated.
+ *
+ * \return an ast_frame of the new translation format on success
+ * \retval NULL on failure, or if no translated frame is ready yet
+ *
+ * \since 14.0.0
+ */
+struct ast_frame *ast_translate_offload(struct ast_trans_pvt *path, struct ast_frame *f, int consume);
+
 /*!
  * \brief Returns the number of steps required to convert from 'src' to 'dest'.
  * \param dest destination format
@@ -355,6 +412,50 @@ void ast_translate_available_formats(struct ast_format_cap *dest, struct ast_for
  */
 const char *ast_translate_path_to_str(struct ast_trans_pvt *t, struct ast_str **str);
 
+/*!
+ * \brief Results of benchmarking a translator
+ */
+struct ast_translator_bench {
+	/*! Frames fed to the translator */
+	unsigned int frames;
+	/*! Samples the translator produced */
+	unsigned int samples;
+	/*! CPU time taken per frame fed in, in nanoseconds */
+	double ns_per_frame;
+	/*! CPU time taken per second of audio produced, in microseconds */
+	double us_per_second;
+	/*! Allocations made per frame fed in, or -1 if they are not counted */
+	double allocs_per_frame;
+	/*! Cache misses per frame fed in, or -1 if they are not counted */
+	double cache_misses_per_frame;
+};
+
+/*!
+ * \brief Callback given the results of benchmarking a translator
+ *
+ * \param t The translator, which stays registered during the call
+ * \param bench Its results
+ * \param data The data given to ast_translator_benchmark()
+ */
+typedef void (*ast_translator_bench_cb)(const struct ast_translator *t,
+	const struct ast_translator_bench *bench, void *data);
+
+/*!
+ * \brief Benchmark every registered translator
+ *
+ * Each translator with sample frames translates at least the given
+ * seconds of audio, on the calling thread, measured with that thread's CPU
+ * time. Allocations are counted when Asterisk is built with MALLOC_DEBUG,
+ * and cache misses where the kernel lets them be counted.
+ *
+ * \param seconds Seconds of audio each translator produces
+ * \param cb Called with the results of each translator
+ * \param data Passed to the callback
+ *
+ * \return The number of translators benchmarked
+ */
+int ast_translator_benchmark(int seconds, ast_translator_bench_cb cb, void *data);
+
 /*!
  * \brief Initialize the translation matrix and index to format conversion table.
  * \retval 0 on success
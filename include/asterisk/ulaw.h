@@ -84,4 +84,45 @@ static inline unsigned char AST_LIN2MU(short sample)
 
 #define AST_MULAW(a) (__ast_mulaw[(a)])
 
+/*!
+ * \brief Convert a block of signed linear samples to mu-law
+ *
+ * Gives the same codes as AST_LIN2MU() on each sample, using vector
+ * instructions where the CPU has them.
+ *
+ * \param dst Where to write the mu-law samples
+ * \param src The signed linear samples
+ * \param samples Number of samples
+ */
+void ast_ulaw_encode(unsigned char *dst, const short *src, size_t samples);
+
+/*!
+ * \brief Convert a block of mu-law samples to signed linear
+ *
+ * Gives the same samples as AST_MULAW() on each code, using vector
+ * instructions where the CPU has them.
+ *
+ * \param dst Where to write the signed linear samples
+ * \param src The mu-law samples
+ * \param samples Number of samples
+ */
+void ast_ulaw_decode(short *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Choose the kernel ast_ulaw_encode() and ast_ulaw_decode() use
+ *
+ * ast_ulaw_init() chooses the best one the CPU has. This is for testing them.
+ *
+ * \param name "c", "sse4.1", "avx2" or "neon"
+ *
+ * \retval 0 on success
+ * \retval -1 if the kernel is not built or the CPU cannot run it
+ */
+int ast_ulaw_use_kernel(const char *name);
+
+/*!
+ * \brief Get the name of the kernel ast_ulaw_encode() and ast_ulaw_decode() use
+ */
+const char *ast_ulaw_kernel(void);
+
 #endif /* _ASTERISK_ULAW_H */
@@ -476,6 +476,27 @@ void ast_replace_subargument_delimiter(char *s);
  */
 char *ast_process_quotes_and_slashes(char *start, char find, char replace_with);
 
+/*!
+ * \brief Fill a buffer with cryptographically strong random bytes
+ * \since 14.0.0
+ *
+ * Each thread runs its own ChaCha20 generator, seeded and periodically
+ * reseeded from /dev/urandom, so this takes no locks and normally makes no
+ * system calls.
+ *
+ * \param buf Buffer to fill
+ * \param len Number of bytes to fill it with
+ *
+ * \retval 0 success
+ * \retval -1 failure, e.g. /dev/urandom is not available
+ */
+int ast_random_bytes(void *buf, size_t len);
+
+/*!
+ * \brief Returns a random number between 0 and RAND_MAX, inclusive
+ *
+ * Taken from ast_random_bytes(), or random() if that fails.
+ */
 long int ast_random(void);
 
 /*!
@@ -516,15 +537,58 @@ long int ast_random(void);
 #define ast_std_realloc realloc
 #define ast_std_free free
 
+#if !defined(STANDALONE)
+/*!
+ * \brief One in how many allocations the allocation profiler samples
+ *
+ * 0 while the profiler is stopped, which is all the allocation wrappers
+ * check. Started and stopped with 'memory profile' in the CLI.
+ */
+extern unsigned int ast_mm_sample_period;
+
+/*! \brief The number of allocations sampled that have not been freed */
+extern int ast_mm_sampled_live;
+
+void __ast_mm_sample_alloc(void *p, size_t len, const char *file, int lineno, const char *func);
+void __ast_mm_sample_free(void *p);
+
+/*! \brief Let the allocation profiler see an allocation, if it is running */
+#define AST_MM_SAMPLE_ALLOC(p, len) \
+	do { \
+		if (__builtin_expect(ast_mm_sample_period != 0, 0)) { \
+			__ast_mm_sample_alloc((p), (len), file, lineno, func); \
+		} \
+	} while (0)
+
+/*! \brief Let the allocation profiler know an allocation it may have sampled is freed */
+#define AST_MM_SAMPLE_FREE(p) \
+	do { \
+		if (__builtin_expect(ast_mm_sampled_live != 0, 0)) { \
+			__ast_mm_sample_free(p); \
+		} \
+	} while (0)
+#else
+#define AST_MM_SAMPLE_ALLOC(p, len)
+#define AST_MM_SAMPLE_FREE(p)
+#endif
+
 /*!
  * \brief free() wrapper
  *
  * ast_free_ptr should be used when a function pointer for free() needs to be passed
  * as the argument to a function. Otherwise, astmm will cause seg faults.
  */
-#define ast_free free
+#define ast_free _ast_free
 #define ast_free_ptr ast_free
 
+AST_INLINE_API(
+void _ast_free(void *p),
+{
+	AST_MM_SAMPLE_FREE(p);
+	free(p);
+}
+)
+
 #if defined(AST_IN_CORE)
 #define MALLOC_FAILURE_MSG \
 	ast_log_safe(LOG_ERROR, "Memory Allocation Failure in function %s at line %d of %s\n", func, lineno, file)
@@ -553,6 +617,8 @@ void * attribute_malloc _ast_malloc(size_t len, const char *file, int lineno, co
 
 	if (!(p = malloc(len))) {
 		MALLOC_FAILURE_MSG;
+	} else {
+		AST_MM_SAMPLE_ALLOC(p, len);
 	}
 
 	return p;
@@ -579,6 +645,8 @@ void * attribute_malloc _ast_calloc(size_t num, size_t len, const char *file, in
 
 	if (!(p = calloc(num, len))) {
 		MALLOC_FAILURE_MSG;
+	} else {
+		AST_MM_SAMPLE_ALLOC(p, num * len);
 	}
 
 	return p;
@@ -616,8 +684,12 @@ void * attribute_malloc _ast_realloc(void *p, size_t len, const char *file, int
 
 	DEBUG_CHAOS_RETURN(DEBUG_CHAOS_ALLOC_CHANCE, NULL);
 
+	/* Forgotten first, as the memory may be reused by another thread once moved */
+	AST_MM_SAMPLE_FREE(p);
 	if (!(newp = realloc(p, len))) {
 		MALLOC_FAILURE_MSG;
+	} else {
+		AST_MM_SAMPLE_ALLOC(newp, len);
 	}
 
 	return newp;
@@ -649,6 +721,8 @@ char * attribute_malloc _ast_strdup(const char *str, const char *file, int linen
 	if (str) {
 		if (!(newstr = strdup(str))) {
 			MALLOC_FAILURE_MSG;
+		} else {
+			AST_MM_SAMPLE_ALLOC(newstr, strlen(newstr) + 1);
 		}
 	}
 
@@ -681,6 +755,8 @@ char * attribute_malloc _ast_strndup(const char *str, size_t len, const char *fi
 	if (str) {
 		if (!(newstr = strndup(str, len))) {
 			MALLOC_FAILURE_MSG;
+		} else {
+			AST_MM_SAMPLE_ALLOC(newstr, strlen(newstr) + 1);
 		}
 	}
 
@@ -723,6 +799,8 @@ int _ast_vasprintf(char **ret, const char *file, int lineno, const char *func, c
 
 	if ((res = vasprintf(ret, fmt, ap)) == -1) {
 		MALLOC_FAILURE_MSG;
+	} else {
+		AST_MM_SAMPLE_ALLOC(*ret, res + 1);
 	}
 
 	return res;
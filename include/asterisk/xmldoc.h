@@ -201,6 +201,20 @@ struct ao2_container *ast_xmldoc_build_documentation(const char *type);
  */
 int ast_xmldoc_regenerate_doc_item(struct ast_xml_doc_item *item);
 
+/*!
+ *  \brief Whether the documentation is only built when first asked for
+ *
+ *  With lazy_documentation set in asterisk.conf the XML documentation is not
+ *  parsed at startup, and registering an application, function or manager
+ *  action does not build its documentation. Callers that keep documentation
+ *  built from XML build it the first time it is shown instead.
+ *
+ *  \retval non-zero if documentation is lazy
+ *
+ *  \since 14.0.0
+ */
+int ast_xmldoc_lazy(void);
+
 #endif /* AST_XML_DOCS */
 
 #endif /* _ASTERISK_XMLDOC_H */
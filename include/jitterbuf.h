@@ -42,6 +42,10 @@ extern "C" {
 #define JB_TARGET_EXTRA 40
 	/*! ms between growing and shrinking; may not be honored if jitterbuffer runs out of space */
 #define JB_ADJUST_DELAY 40
+	/*! number of timestamp slots indexing the queue, a power of 2 */
+#define JB_QUEUE_SLOTS		512
+	/*! log2 of the ms of timestamps covered by a queue slot */
+#define JB_QUEUE_SLOT_SHIFT	3
 /*@} */
 
 enum jb_return_code {
@@ -110,13 +114,14 @@ typedef struct jitterbuf {
 	/* history */
 	long history[JB_HISTORY_SZ];   		/*!< history */
 	int  hist_ptr;				/*!< points to index in history for next entry */
-	long hist_maxbuf[JB_HISTORY_MAXBUF_SZ];	/*!< a sorted buffer of the max delays (highest first) */
-	long hist_minbuf[JB_HISTORY_MAXBUF_SZ];	/*!< a sorted buffer of the min delays (lowest first) */
-	int  hist_maxbuf_valid;			/*!< are the "maxbuf"/minbuf valid? */
+	long hist_sorted[JB_HISTORY_SZ];	/*!< the delays in history, lowest first */
 	unsigned int dropem:1;                  /*!< flag to indicate dropping frames (overload) */
+	unsigned int slots_invalid:1;		/*!< the queue spans more than its slots, so they are unused until it empties */
 
 	jb_frame *frames; 		/*!< queued frames */
 	jb_frame *free; 		/*!< free frames (avoid malloc?) */
+	jb_frame *slot_last[JB_QUEUE_SLOTS];	/*!< last queued frame of each timestamp slot */
+	uint64_t slot_used[JB_QUEUE_SLOTS / 64];	/*!< bitmap of the slots with queued frames */
 } jitterbuf;
 
 
@@ -289,7 +289,7 @@ int ast_jb_put(struct ast_channel *chan, struct ast_frame *f)
 		return -1;
 	}
 
-	frr = ast_frdup(f);
+	frr = (f->mallocd & AST_MALLOCD_SHARED) ? ast_frshare(f) : ast_frdup(f);
 
 	if (!frr) {
 		ast_log(LOG_ERROR, "Failed to isolate frame for the jitterbuffer on channel '%s'\n", ast_channel_name(chan));
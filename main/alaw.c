@@ -33,6 +33,21 @@ ASTERISK_REGISTER_FILE()
 
 #include "asterisk/alaw.h"
 #include "asterisk/logger.h"
+#include "asterisk/utils.h"
+
+/*
+ * The vector kernels compute the same codes as the default tables. They are
+ * not built for the G711_NEW_ALGORITHM tables, which round differently.
+ */
+#if !defined(G711_NEW_ALGORITHM) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ALAW_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if !defined(G711_NEW_ALGORITHM) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define ALAW_NEON_KERNELS
+#include <arm_neon.h>
+#endif
 
 #ifndef G711_NEW_ALGORITHM
 #define AMI_MASK 0x55
@@ -151,6 +166,256 @@ unsigned char __ast_lin2a[AST_ALAW_TAB_SIZE];
 #endif
 short __ast_alaw[256];
 
+/*! \brief Encode with the lookup table, one sample at a time */
+static void alaw_encode_c(unsigned char *dst, const short *src, size_t samples)
+{
+	while (samples--) {
+		*dst++ = AST_LIN2A(*src++);
+	}
+}
+
+/*! \brief Decode with the lookup table, one sample at a time */
+static void alaw_decode_c(short *dst, const unsigned char *src, size_t samples)
+{
+	while (samples--) {
+		*dst++ = AST_ALAW(*src++);
+	}
+}
+
+/*
+ * The vector kernels work out linear2alaw() of each sample with its three low
+ * bits set, which is the sample the table entry for it was built from.
+ *
+ * The segment is how many of the magnitude thresholds 0x100, 0x200, ...
+ * 0x4000 are reached, and the mantissa is the magnitude shifted right by the
+ * segment plus 3, or by 4 in the first segment.
+ */
+
+#ifdef ALAW_X86_KERNELS
+__attribute__((target("sse4.1")))
+static void alaw_encode_sse4(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i *) (src + i)), _mm_set1_epi16(7));
+		__m128i mask = _mm_xor_si128(_mm_set1_epi16(AMI_MASK | 0x80),
+			_mm_and_si128(_mm_srai_epi16(x, 15), _mm_set1_epi16(0x80)));
+		__m128i pcm = _mm_abs_epi16(x);
+		__m128i seg = _mm_sub_epi16(_mm_setzero_si128(), _mm_cmpgt_epi16(pcm, _mm_set1_epi16(0xff)));
+		/* Multiplying by this and keeping the high half does the mantissa shift */
+		__m128i shift = _mm_set1_epi16(1 << 12);
+		__m128i code;
+		int k;
+
+		for (k = 1; k < 7; ++k) {
+			__m128i above = _mm_cmpgt_epi16(pcm, _mm_set1_epi16((0x100 << k) - 1));
+
+			seg = _mm_sub_epi16(seg, above);
+			shift = _mm_blendv_epi8(shift, _mm_srli_epi16(shift, 1), above);
+		}
+
+		code = _mm_or_si128(_mm_slli_epi16(seg, 4), _mm_and_si128(_mm_mulhi_epu16(pcm, shift), _mm_set1_epi16(0x0f)));
+		code = _mm_xor_si128(code, mask);
+		_mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(code, code));
+	}
+
+	alaw_encode_c(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("sse4.1")))
+static void alaw_decode_sse4(short *dst, const unsigned char *src, size_t samples)
+{
+	const __m128i powers = _mm_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_xor_si128(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (src + i))),
+			_mm_set1_epi16(AMI_MASK));
+		__m128i seg = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi16(7));
+		/* The high byte of each index has its top bit set so it looks up zero */
+		__m128i scale = _mm_shuffle_epi8(powers, _mm_or_si128(seg, _mm_set1_epi16(0x8000)));
+		__m128i sample = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x0f)), 4), _mm_set1_epi16(8));
+		__m128i negative = _mm_cmpeq_epi16(_mm_and_si128(a, _mm_set1_epi16(0x80)), _mm_setzero_si128());
+
+		sample = _mm_add_epi16(sample, _mm_andnot_si128(_mm_cmpeq_epi16(seg, _mm_setzero_si128()),
+			_mm_set1_epi16(0x100)));
+		sample = _mm_mullo_epi16(sample, scale);
+		sample = _mm_sub_epi16(_mm_xor_si128(sample, negative), negative);
+		_mm_storeu_si128((__m128i *) (dst + i), sample);
+	}
+
+	alaw_decode_c(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void alaw_encode_avx2(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (src + i)), _mm256_set1_epi16(7));
+		__m256i mask = _mm256_xor_si256(_mm256_set1_epi16(AMI_MASK | 0x80),
+			_mm256_and_si256(_mm256_srai_epi16(x, 15), _mm256_set1_epi16(0x80)));
+		__m256i pcm = _mm256_abs_epi16(x);
+		__m256i seg = _mm256_sub_epi16(_mm256_setzero_si256(), _mm256_cmpgt_epi16(pcm, _mm256_set1_epi16(0xff)));
+		__m256i shift = _mm256_set1_epi16(1 << 12);
+		__m256i code;
+		int k;
+
+		for (k = 1; k < 7; ++k) {
+			__m256i above = _mm256_cmpgt_epi16(pcm, _mm256_set1_epi16((0x100 << k) - 1));
+
+			seg = _mm256_sub_epi16(seg, above);
+			shift = _mm256_blendv_epi8(shift, _mm256_srli_epi16(shift, 1), above);
+		}
+
+		code = _mm256_or_si256(_mm256_slli_epi16(seg, 4),
+			_mm256_and_si256(_mm256_mulhi_epu16(pcm, shift), _mm256_set1_epi16(0x0f)));
+		code = _mm256_xor_si256(code, mask);
+		/* Packing works within each 128 bit lane, so gather the two halves */
+		code = _mm256_permute4x64_epi64(_mm256_packus_epi16(code, code), 0x08);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm256_castsi256_si128(code));
+	}
+
+	alaw_encode_sse4(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void alaw_decode_avx2(short *dst, const unsigned char *src, size_t samples)
+{
+	const __m256i powers = _mm256_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_xor_si256(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (src + i))),
+			_mm256_set1_epi16(AMI_MASK));
+		__m256i seg = _mm256_and_si256(_mm256_srli_epi16(a, 4), _mm256_set1_epi16(7));
+		__m256i scale = _mm256_shuffle_epi8(powers, _mm256_or_si256(seg, _mm256_set1_epi16(0x8000)));
+		__m256i sample = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(a, _mm256_set1_epi16(0x0f)), 4),
+			_mm256_set1_epi16(8));
+		__m256i negative = _mm256_cmpeq_epi16(_mm256_and_si256(a, _mm256_set1_epi16(0x80)), _mm256_setzero_si256());
+
+		sample = _mm256_add_epi16(sample, _mm256_andnot_si256(_mm256_cmpeq_epi16(seg, _mm256_setzero_si256()),
+			_mm256_set1_epi16(0x100)));
+		sample = _mm256_mullo_epi16(sample, scale);
+		sample = _mm256_sub_epi16(_mm256_xor_si256(sample, negative), negative);
+		_mm256_storeu_si256((__m256i *) (dst + i), sample);
+	}
+
+	alaw_decode_sse4(dst + i, src + i, samples - i);
+}
+#endif /* ALAW_X86_KERNELS */
+
+#ifdef ALAW_NEON_KERNELS
+static void alaw_encode_neon(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t x = vorrq_s16(vld1q_s16(src + i), vdupq_n_s16(7));
+		uint16x8_t mask = veorq_u16(vdupq_n_u16(AMI_MASK | 0x80),
+			vandq_u16(vreinterpretq_u16_s16(vshrq_n_s16(x, 15)), vdupq_n_u16(0x80)));
+		uint16x8_t pcm = vreinterpretq_u16_s16(vabsq_s16(x));
+		/* The segment is the position of the top bit of the magnitude over 256 */
+		uint16x8_t seg = vsubq_u16(vdupq_n_u16(16), vclzq_u16(vshrq_n_u16(pcm, 8)));
+		int16x8_t shift = vnegq_s16(vreinterpretq_s16_u16(vaddq_u16(vmaxq_u16(seg, vdupq_n_u16(1)),
+			vdupq_n_u16(3))));
+		uint16x8_t code = vorrq_u16(vshlq_n_u16(seg, 4), vandq_u16(vshlq_u16(pcm, shift), vdupq_n_u16(0x0f)));
+
+		vst1_u8(dst + i, vmovn_u16(veorq_u16(code, mask)));
+	}
+
+	alaw_encode_c(dst + i, src + i, samples - i);
+}
+
+static void alaw_decode_neon(short *dst, const unsigned char *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		uint16x8_t a = vmovl_u8(veor_u8(vld1_u8(src + i), vdup_n_u8(AMI_MASK)));
+		uint16x8_t seg = vandq_u16(vshrq_n_u16(a, 4), vdupq_n_u16(7));
+		uint16x8_t magnitude = vaddq_u16(vshlq_n_u16(vandq_u16(a, vdupq_n_u16(0x0f)), 4), vdupq_n_u16(8));
+		int16x8_t sample;
+
+		magnitude = vaddq_u16(magnitude, vandq_u16(vtstq_u16(seg, seg), vdupq_n_u16(0x100)));
+		magnitude = vshlq_u16(magnitude, vreinterpretq_s16_u16(vqsubq_u16(seg, vdupq_n_u16(1))));
+		sample = vreinterpretq_s16_u16(magnitude);
+		sample = vbslq_s16(vtstq_u16(a, vdupq_n_u16(0x80)), sample, vnegq_s16(sample));
+		vst1q_s16(dst + i, sample);
+	}
+
+	alaw_decode_c(dst + i, src + i, samples - i);
+}
+#endif /* ALAW_NEON_KERNELS */
+
+/*! \brief A way of encoding and decoding blocks of samples */
+struct alaw_kernel {
+	const char *name;
+	void (*encode)(unsigned char *dst, const short *src, size_t samples);
+	void (*decode)(short *dst, const unsigned char *src, size_t samples);
+};
+
+/*! \brief The kernels, best last */
+static const struct alaw_kernel alaw_kernels[] = {
+	{ "c", alaw_encode_c, alaw_decode_c },
+#ifdef ALAW_X86_KERNELS
+	{ "sse4.1", alaw_encode_sse4, alaw_decode_sse4 },
+	{ "avx2", alaw_encode_avx2, alaw_decode_avx2 },
+#endif
+#ifdef ALAW_NEON_KERNELS
+	{ "neon", alaw_encode_neon, alaw_decode_neon },
+#endif
+};
+
+/*! \brief The kernel in use */
+static const struct alaw_kernel *alaw_kernel = &alaw_kernels[0];
+
+/*! \brief Whether the CPU can run a kernel */
+static int alaw_kernel_supported(const struct alaw_kernel *kernel)
+{
+#ifdef ALAW_X86_KERNELS
+	if (!strcmp(kernel->name, "sse4.1")) {
+		return __builtin_cpu_supports("sse4.1");
+	}
+	if (!strcmp(kernel->name, "avx2")) {
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+	return 1;
+}
+
+int ast_alaw_use_kernel(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(alaw_kernels); ++i) {
+		if (!strcmp(alaw_kernels[i].name, name) && alaw_kernel_supported(&alaw_kernels[i])) {
+			alaw_kernel = &alaw_kernels[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+const char *ast_alaw_kernel(void)
+{
+	return alaw_kernel->name;
+}
+
+void ast_alaw_encode(unsigned char *dst, const short *src, size_t samples)
+{
+	alaw_kernel->encode(dst, src, samples);
+}
+
+void ast_alaw_decode(short *dst, const unsigned char *src, size_t samples)
+{
+	alaw_kernel->decode(dst, src, samples);
+}
+
 void ast_alaw_init(void)
 {
 	int i;
@@ -213,5 +478,15 @@ void ast_alaw_init(void)
 	ast_log(LOG_NOTICE, "a-Law tandem transcoding test complete.\n");
 #endif /* TEST_TANDEM_TRANSCODING */
 
+	/* Use the best kernel the CPU has */
+#ifdef ALAW_X86_KERNELS
+	__builtin_cpu_init();
+#endif
+	for (i = ARRAY_LEN(alaw_kernels) - 1; i > 0; --i) {
+		if (alaw_kernel_supported(&alaw_kernels[i])) {
+			break;
+		}
+	}
+	alaw_kernel = &alaw_kernels[i];
 }
 
@@ -205,6 +205,7 @@ int daemon(int, int);  /* defined in libresolv of all places */
 #include "asterisk/acl.h"
 #include "asterisk/ulaw.h"
 #include "asterisk/alaw.h"
+#include "asterisk/slinear_mix.h"
 #include "asterisk/callerid.h"
 #include "asterisk/image.h"
 #include "asterisk/tdd.h"
@@ -327,6 +328,9 @@ int option_debug;				/*!< Debug level */
 double ast_option_maxload;			/*!< Max load avg on system */
 int ast_option_maxcalls;			/*!< Max number of active calls */
 int ast_option_maxfiles;			/*!< Max number of open file handles (files, sockets) */
+int ast_option_config_images;			/*!< Keep compiled config images on disk */
+int ast_option_autoservice_threads;		/*!< Number of autoservice threads, 0 for the default */
+int ast_option_channel_pool;			/*!< Number of destroyed channels kept for reuse */
 unsigned int option_dtmfminduration;		/*!< Minimum duration of DTMF. */
 #if defined(HAVE_SYSINFO)
 long option_minmemfree;				/*!< Minimum amount of free system memory - stop accepting calls if free memory falls below this watermark */
@@ -3557,6 +3561,9 @@ static void ast_readconfig(void)
 		/* Specify cache directory */
 		}  else if (!strcasecmp(v->name, "record_cache_dir")) {
 			ast_copy_string(record_cache_dir, v->value, AST_CACHE_DIR_LEN);
+		/* Keep compiled config images on disk for the next start */
+		} else if (!strcasecmp(v->name, "cache_config_images")) {
+			ast_option_config_images = ast_true(v->value);
 		/* Build transcode paths via SLINEAR, instead of directly */
 		} else if (!strcasecmp(v->name, "transcode_via_sln")) {
 			ast_set2_flag(&ast_options, ast_true(v->value), AST_OPT_FLAG_TRANSCODE_VIA_SLIN);
@@ -3578,6 +3585,15 @@ static void ast_readconfig(void)
 			if ((sscanf(v->value, "%30d", &ast_option_maxcalls) != 1) || (ast_option_maxcalls < 0)) {
 				ast_option_maxcalls = 0;
 			}
+		} else if (!strcasecmp(v->name, "autoservice_threads")) {
+			if ((sscanf(v->value, "%30d", &ast_option_autoservice_threads) != 1) || (ast_option_autoservice_threads < 0)) {
+				ast_option_autoservice_threads = 0;
+			}
+		} else if (!strcasecmp(v->name, "channel_pool")) {
+			if ((sscanf(v->value, "%30d", &ast_option_channel_pool) != 1) || (ast_option_channel_pool < 0)) {
+				ast_log(LOG_WARNING, "Invalid channel_pool '%s', not recycling channels\n", v->value);
+				ast_option_channel_pool = 0;
+			}
 		} else if (!strcasecmp(v->name, "maxload")) {
 			double test[1];
 
@@ -4340,6 +4356,7 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 	ast_json_init();
 	ast_ulaw_init();
 	ast_alaw_init();
+	ast_slinear_mix_init();
 	tdd_init();
 	callerid_init();
 	ast_builtins_init();
@@ -4349,11 +4366,24 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 		exit(1);
 	}
 
+	ast_lock_contention_init();
+	ast_metrics_init();
+
+	if (ast_thread_affinity_init()) {
+		printf("Failed: ast_thread_affinity_init\n%s", term_quit());
+		exit(1);
+	}
+
 	if (ast_tps_init()) {
 		printf("Failed: ast_tps_init\n%s", term_quit());
 		exit(1);
 	}
 
+	if (ast_threadpool_init()) {
+		printf("Failed: ast_threadpool_init\n%s", term_quit());
+		exit(1);
+	}
+
 	if (ast_fd_init()) {
 		printf("Failed: ast_fd_init\n%s", term_quit());
 		exit(1);
@@ -4394,6 +4424,11 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 		exit(1);
 	}
 
+	if (ast_format_cap_init()) {
+		printf("Failed: ast_format_cap_init\n%s", term_quit());
+		exit(1);
+	}
+
 	if (ast_format_cache_init()) {
 		printf("Failed: ast_format_cache_init\n%s", term_quit());
 		exit(1);
@@ -4411,6 +4446,11 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 
 	aco_init();
 
+	if (ast_tps_manager_init()) {
+		printf("Failed: ast_tps_manager_init\n%s", term_quit());
+		exit(1);
+	}
+
 	if (ast_bucket_init()) {
 		printf("Failed: ast_bucket_init\n%s", term_quit());
 		exit(1);
@@ -4535,6 +4575,11 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 		exit(1);
 	}
 
+	if (ast_dns_core_init()) {
+		printf("Failed: ast_dns_core_init\n%s", term_quit());
+		exit(1);
+	}
+
 	if (ast_dns_system_resolver_init()) {		/* Initialize the default DNS resolver */
 		printf("Failed: ast_dns_system_resolver_init\n%s", term_quit());
 		exit(1);
@@ -4664,6 +4709,8 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 
 #if defined(__AST_DEBUG_MALLOC)
 	__ast_mm_init_phase_2();
+#else
+	ast_mm_profile_init();
 #endif	/* defined(__AST_DEBUG_MALLOC) */
 
 	ast_lastreloadtime = ast_startuptime = ast_tvnow();
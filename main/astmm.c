@@ -28,6 +28,27 @@
 	<support_level>core</support_level>
  ***/
 
+/*** DOCUMENTATION
+	<manager name="MemoryProfile" language="en_US">
+		<synopsis>
+			List where the allocations sampled by the memory profiler were made.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Count">
+				<para>The most sites to list. Default is 20.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Lists the places memory was allocated from, by the bytes
+			still allocated, as estimated from the allocations sampled since
+			the profiler was started with <literal>memory profile start</literal>
+			in the CLI. A <literal>MemoryProfileSite</literal> event is sent
+			for each.</para>
+		</description>
+	</manager>
+ ***/
+
 #define ASTMM_LIBC ASTMM_IGNORE
 #include "asterisk.h"
 
@@ -68,6 +89,9 @@ enum func_type {
 
 static FILE *mmlog;
 
+/*! Number of regions allocated by this thread */
+static __thread unsigned long thread_allocations;
+
 struct ast_region {
 	AST_LIST_ENTRY(ast_region) node;
 	struct ast_bt *bt;
@@ -252,9 +276,16 @@ static void *__ast_alloc_region(size_t size, const enum func_type which, const c
 	regions[hash] = reg;
 	ast_mutex_unlock(&reglock);
 
+	++thread_allocations;
+
 	return reg->data;
 }
 
+unsigned long ast_mm_thread_allocations(void)
+{
+	return thread_allocations;
+}
+
 /*!
  * \internal
  * \brief Wipe the region payload data with a known value.
@@ -1487,4 +1518,607 @@ void __ast_mm_init_phase_2(void)
 	ast_register_cleanup(mm_atexit_ast);
 }
 
+#else	/* !defined(__AST_DEBUG_MALLOC) */
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/_private.h"
+#include "asterisk/cli.h"
+#include "asterisk/lock.h"
+#include "asterisk/manager.h"
+#include "asterisk/backtrace.h"
+
+#ifdef HAVE_BKTR
+#include <execinfo.h>
+#endif
+
+/*
+ * The allocation profiler. While it runs, about one in every
+ * ast_mm_sample_period allocations made through the ast_malloc() family is
+ * recorded with where it was made and a few frames of the stack. Each
+ * stands for that many allocations, so the bytes still allocated and the
+ * allocations made from each place are estimated without tracking them all.
+ * Freeing memory costs a check of sample_marks[] while sampled allocations
+ * are live, and nothing otherwise.
+ */
+
+/*! \brief Sampled one in this many allocations unless told otherwise */
+#define MM_SAMPLE_DEFAULT_PERIOD 10000
+
+/*! \brief Frames of the stack kept for each place memory is allocated from */
+#define MM_SAMPLE_FRAMES 6
+
+#define MM_SAMPLE_BUCKETS 4099
+#define MM_SITE_BUCKETS 1021
+#define MM_SAMPLE_MARKS 65536
+
+unsigned int ast_mm_sample_period;
+int ast_mm_sampled_live;
+
+/*! \brief A place memory is allocated from: the caller and the stack leading to it */
+struct mm_site {
+	struct mm_site *next;
+	unsigned int id;
+	int lineno;
+	char file[64];
+	char func[40];
+	int num_frames;
+	void *frames[MM_SAMPLE_FRAMES];
+	/*! Estimates, each sample counting as the period it was taken at */
+	uint64_t live_bytes;
+	uint64_t live_count;
+	uint64_t allocations;
+};
+
+/*! \brief A sampled allocation not yet freed */
+struct mm_sample {
+	struct mm_sample *next;
+	void *ptr;
+	size_t len;
+	unsigned int weight;
+	struct mm_site *site;
+};
+
+static struct mm_sample *samples[MM_SAMPLE_BUCKETS];
+static struct mm_site *sites[MM_SITE_BUCKETS];
+static unsigned int next_site_id = 1;
+
+/*! \brief Number of live samples whose address hashes to each mark, so frees can be checked without locking */
+static unsigned int sample_marks[MM_SAMPLE_MARKS];
+
+/*! \brief Milliseconds the profiler ran for before it was last started */
+static int64_t profile_elapsed;
+/*! \brief When the profiler was last started, if running */
+static struct timeval profile_started;
+
+/*! Tracking this mutex will cause infinite recursion, as the mutex tracking
+ *  code allocates memory */
+AST_MUTEX_DEFINE_STATIC_NOTRACKING(profile_lock);
+
+/*! \brief Allocations this thread makes before it samples another */
+static __thread unsigned int sample_countdown;
+static __thread unsigned int sample_random;
+/*! \brief Set while this thread is in the profiler, so its own allocations are not sampled */
+static __thread int in_profiler;
+
+#define SAMPLE_HASH(p) ((((uintptr_t) (p)) >> 4) % MM_SAMPLE_BUCKETS)
+#define SAMPLE_MARK(p) (((((uintptr_t) (p)) >> 4) * 2654435761u) % MM_SAMPLE_MARKS)
+
+static void profile_lock_enter(void)
+{
+	in_profiler = 1;
+	ast_mutex_lock(&profile_lock);
+}
+
+static void profile_lock_leave(void)
+{
+	ast_mutex_unlock(&profile_lock);
+	in_profiler = 0;
+}
+
+/*!
+ * \internal
+ * \brief The allocations to skip before the next sample
+ *
+ * Taken at random around the period, so allocations made in a fixed pattern
+ * are not always or never sampled.
+ */
+static unsigned int sample_next_countdown(unsigned int period)
+{
+	if (!sample_random) {
+		sample_random = ((uintptr_t) &sample_random >> 4) ^ (unsigned int) time(NULL) ^ 0x9e3779b9;
+	}
+	/* xorshift32 */
+	sample_random ^= sample_random << 13;
+	sample_random ^= sample_random >> 17;
+	sample_random ^= sample_random << 5;
+
+	return sample_random % (2 * period);
+}
+
+static unsigned int site_hash(const char *file, int lineno, void **frames, int num_frames)
+{
+	unsigned int hash = ast_str_hash(file) + lineno;
+	int i;
+
+	for (i = 0; i < num_frames; ++i) {
+		hash = hash * 31 + (unsigned int) ((uintptr_t) frames[i] >> 2);
+	}
+	return hash % MM_SITE_BUCKETS;
+}
+
+/*!
+ * \internal
+ * \brief Find or add the place an allocation was made from
+ *
+ * \pre profile_lock is held
+ */
+static struct mm_site *site_get(const char *file, int lineno, const char *func, void **frames, int num_frames)
+{
+	unsigned int hash = site_hash(file, lineno, frames, num_frames);
+	struct mm_site *site;
+
+	for (site = sites[hash]; site; site = site->next) {
+		if (site->lineno == lineno && site->num_frames == num_frames
+			&& !memcmp(site->frames, frames, num_frames * sizeof(*frames))
+			&& !strncmp(site->file, file, sizeof(site->file) - 1)
+			&& !strncmp(site->func, func, sizeof(site->func) - 1)) {
+			return site;
+		}
+	}
+
+	site = calloc(1, sizeof(*site));
+	if (!site) {
+		return NULL;
+	}
+	site->id = next_site_id++;
+	site->lineno = lineno;
+	ast_copy_string(site->file, file, sizeof(site->file));
+	ast_copy_string(site->func, func, sizeof(site->func));
+	site->num_frames = num_frames;
+	memcpy(site->frames, frames, num_frames * sizeof(*frames));
+	site->next = sites[hash];
+	sites[hash] = site;
+	return site;
+}
+
+/*!
+ * \internal
+ * \brief Take a sample out of the live ones
+ *
+ * \pre profile_lock is held
+ */
+static struct mm_sample *sample_unlink(void *ptr)
+{
+	struct mm_sample **prev;
+	struct mm_sample *sample;
+
+	for (prev = &samples[SAMPLE_HASH(ptr)]; (sample = *prev); prev = &sample->next) {
+		if (sample->ptr == ptr) {
+			*prev = sample->next;
+			sample->site->live_bytes -= (uint64_t) sample->len * sample->weight;
+			sample->site->live_count -= sample->weight;
+			--sample_marks[SAMPLE_MARK(ptr)];
+			--ast_mm_sampled_live;
+			return sample;
+		}
+	}
+	return NULL;
+}
+
+void __ast_mm_sample_alloc(void *p, size_t len, const char *file, int lineno, const char *func)
+{
+	void *frames[MM_SAMPLE_FRAMES + 1];
+	int num_frames = 0;
+	unsigned int period = ast_mm_sample_period;
+	struct mm_sample *sample;
+	struct mm_sample *stale;
+
+	if (!p || in_profiler || !period) {
+		return;
+	}
+	if (sample_countdown) {
+		--sample_countdown;
+		return;
+	}
+	sample_countdown = sample_next_countdown(period);
+
+	in_profiler = 1;
+#ifdef HAVE_BKTR
+	/* The first frame is this function */
+	num_frames = backtrace(frames, ARRAY_LEN(frames));
+#endif
+	num_frames = MAX(num_frames - 1, 0);
+
+	if (!(sample = malloc(sizeof(*sample)))) {
+		in_profiler = 0;
+		return;
+	}
+	sample->ptr = p;
+	sample->len = len;
+	sample->weight = period;
+
+	profile_lock_enter();
+	if (!ast_mm_sample_period
+		|| !(sample->site = site_get(file, lineno, func, frames + 1, num_frames))) {
+		profile_lock_leave();
+		free(sample);
+		return;
+	}
+
+	/* Memory freed with free() rather than ast_free() looks live until reused */
+	stale = sample_marks[SAMPLE_MARK(p)] ? sample_unlink(p) : NULL;
+
+	sample->next = samples[SAMPLE_HASH(p)];
+	samples[SAMPLE_HASH(p)] = sample;
+	++sample_marks[SAMPLE_MARK(p)];
+	++ast_mm_sampled_live;
+	sample->site->live_bytes += (uint64_t) len * period;
+	sample->site->live_count += period;
+	sample->site->allocations += period;
+	profile_lock_leave();
+
+	free(stale);
+}
+
+void __ast_mm_sample_free(void *p)
+{
+	struct mm_sample *sample;
+
+	/* Unlocked, but a sample is marked before its memory is handed out */
+	if (!p || in_profiler || !sample_marks[SAMPLE_MARK(p)]) {
+		return;
+	}
+
+	profile_lock_enter();
+	sample = sample_unlink(p);
+	profile_lock_leave();
+
+	free(sample);
+}
+
+/*!
+ * \internal
+ * \brief Forget all samples and sites
+ *
+ * \pre profile_lock is held
+ */
+static void profile_reset(void)
+{
+	struct mm_sample *sample;
+	struct mm_site *site;
+	int i;
+
+	for (i = 0; i < MM_SAMPLE_BUCKETS; ++i) {
+		while ((sample = samples[i])) {
+			samples[i] = sample->next;
+			free(sample);
+		}
+	}
+	for (i = 0; i < MM_SITE_BUCKETS; ++i) {
+		while ((site = sites[i])) {
+			sites[i] = site->next;
+			free(site);
+		}
+	}
+	memset(sample_marks, 0, sizeof(sample_marks));
+	ast_mm_sampled_live = 0;
+	profile_elapsed = 0;
+	if (ast_mm_sample_period) {
+		profile_started = ast_tvnow();
+	}
+}
+
+static int site_live_bytes_cmp(const void *left, const void *right)
+{
+	const struct mm_site *l = left;
+	const struct mm_site *r = right;
+
+	return l->live_bytes < r->live_bytes ? 1 : l->live_bytes > r->live_bytes ? -1 : l->id - r->id;
+}
+
+/*!
+ * \internal
+ * \brief Copy the sites, most bytes still allocated first
+ *
+ * \param[out] count The number of sites
+ * \param[out] seconds How long the profiler has run for
+ *
+ * \return The sites, to be freed with ast_free(), or NULL if there are none
+ */
+static struct mm_site *profile_snapshot(int *count, double *seconds)
+{
+	struct mm_site *copy = NULL;
+	struct mm_site *site;
+	int64_t elapsed;
+	int i;
+
+	*count = 0;
+
+	profile_lock_enter();
+	for (i = 0; i < MM_SITE_BUCKETS; ++i) {
+		for (site = sites[i]; site; site = site->next) {
+			++*count;
+		}
+	}
+	if (*count && (copy = malloc(*count * sizeof(*copy)))) {
+		*count = 0;
+		for (i = 0; i < MM_SITE_BUCKETS; ++i) {
+			for (site = sites[i]; site; site = site->next) {
+				copy[(*count)++] = *site;
+			}
+		}
+	} else {
+		*count = 0;
+	}
+	elapsed = profile_elapsed;
+	if (ast_mm_sample_period) {
+		elapsed += ast_tvdiff_ms(ast_tvnow(), profile_started);
+	}
+	profile_lock_leave();
+
+	*seconds = MAX(elapsed, 1) / 1000.0;
+	if (copy) {
+		qsort(copy, *count, sizeof(*copy), site_live_bytes_cmp);
+	}
+	return copy;
+}
+
+static char *handle_memory_profile_start(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned int period = MM_SAMPLE_DEFAULT_PERIOD;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "memory profile start";
+		e->usage =
+			"Usage: memory profile start [<period>]\n"
+			"       Sample one in every <period> memory allocations, 10000 by\n"
+			"       default, recording where each was made. Sampling more\n"
+			"       often gives better estimates but slows allocation.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%30u", &period) != 1 || !period) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	profile_lock_enter();
+	if (!ast_mm_sample_period) {
+		profile_started = ast_tvnow();
+	}
+	ast_mm_sample_period = period;
+	profile_lock_leave();
+
+	ast_cli(a->fd, "Sampling one in %u memory allocations.\n", period);
+	return CLI_SUCCESS;
+}
+
+static char *handle_memory_profile_stop(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "memory profile stop";
+		e->usage =
+			"Usage: memory profile stop\n"
+			"       Stop sampling memory allocations. Those already sampled\n"
+			"       are still followed until freed.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	profile_lock_enter();
+	if (ast_mm_sample_period) {
+		profile_elapsed += ast_tvdiff_ms(ast_tvnow(), profile_started);
+	}
+	ast_mm_sample_period = 0;
+	profile_lock_leave();
+
+	ast_cli(a->fd, "Memory allocations are no longer sampled.\n");
+	return CLI_SUCCESS;
+}
+
+static char *handle_memory_profile_reset(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "memory profile reset";
+		e->usage =
+			"Usage: memory profile reset\n"
+			"       Forget the memory allocations sampled so far.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	profile_lock_enter();
+	profile_reset();
+	profile_lock_leave();
+
+	ast_cli(a->fd, "Forgot the sampled memory allocations.\n");
+	return CLI_SUCCESS;
+}
+
+static char *handle_memory_profile_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct mm_site *copy;
+	uint64_t live_bytes = 0;
+	double seconds;
+	int limit = 20;
+	int count;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "memory profile show";
+		e->usage =
+			"Usage: memory profile show [<count>]\n"
+			"       Show the <count> places, 20 by default, with the most\n"
+			"       bytes still allocated, as estimated from the sampled\n"
+			"       allocations, and how many allocations a second each makes.\n"
+			"       See 'memory profile backtrace' for the stack of each.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%30d", &limit) != 1 || limit <= 0) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	copy = profile_snapshot(&count, &seconds);
+	if (!count) {
+		ast_cli(a->fd, "No memory allocations have been sampled.\n");
+		return CLI_SUCCESS;
+	}
+
+	ast_cli(a->fd, "%6s %14s %11s %11s  %s\n", "ID", "Live bytes", "Live allocs", "Allocs/sec", "Site");
+	for (i = 0; i < count; ++i) {
+		live_bytes += copy[i].live_bytes;
+		if (i < limit) {
+			ast_cli(a->fd, "%6u %14" PRIu64 " %11" PRIu64 " %11.1f  %s() line %d of %s\n",
+				copy[i].id, copy[i].live_bytes, copy[i].live_count,
+				copy[i].allocations / seconds, copy[i].func, copy[i].lineno, copy[i].file);
+		}
+	}
+	ast_cli(a->fd, "About %" PRIu64 " bytes live from %d places, sampling %s.\n", live_bytes, count,
+		ast_mm_sample_period ? "running" : "stopped");
+	free(copy);
+
+	return CLI_SUCCESS;
+}
+
+static char *handle_memory_profile_backtrace(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct mm_site *site = NULL;
+	struct mm_site copy;
+	char **symbols;
+	unsigned int id;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "memory profile backtrace";
+		e->usage =
+			"Usage: memory profile backtrace <id>\n"
+			"       Show the stack memory was allocated from at a place\n"
+			"       listed by 'memory profile show'.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 4 || sscanf(a->argv[3], "%30u", &id) != 1) {
+		return CLI_SHOWUSAGE;
+	}
+
+	profile_lock_enter();
+	for (i = 0; i < MM_SITE_BUCKETS && !site; ++i) {
+		for (site = sites[i]; site && site->id != id; site = site->next) {
+		}
+	}
+	if (site) {
+		copy = *site;
+	}
+	profile_lock_leave();
+
+	if (!site) {
+		ast_cli(a->fd, "No place with id %u.\n", id);
+		return CLI_SUCCESS;
+	}
+
+	ast_cli(a->fd, "%s() line %d of %s\n", copy.func, copy.lineno, copy.file);
+	symbols = copy.num_frames ? ast_bt_get_symbols(copy.frames, copy.num_frames) : NULL;
+	for (i = 0; i < copy.num_frames; ++i) {
+		ast_cli(a->fd, "  [%p] %s\n", copy.frames[i], symbols ? symbols[i] : "");
+	}
+	ast_std_free(symbols);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_memory_profile[] = {
+	AST_CLI_DEFINE(handle_memory_profile_start, "Start sampling memory allocations"),
+	AST_CLI_DEFINE(handle_memory_profile_stop, "Stop sampling memory allocations"),
+	AST_CLI_DEFINE(handle_memory_profile_reset, "Forget sampled memory allocations"),
+	AST_CLI_DEFINE(handle_memory_profile_show, "Show where sampled memory allocations were made"),
+	AST_CLI_DEFINE(handle_memory_profile_backtrace, "Show the stack sampled memory allocations were made from"),
+};
+
+static int manager_memory_profile(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *count_header = astman_get_header(m, "Count");
+	char id_text[128] = "";
+	struct mm_site *copy;
+	double seconds;
+	int limit = 20;
+	int count;
+	int i;
+
+	if (!ast_strlen_zero(count_header) && (sscanf(count_header, "%30d", &limit) != 1 || limit <= 0)) {
+		astman_send_error(s, m, "Invalid Count");
+		return 0;
+	}
+	if (!ast_strlen_zero(id)) {
+		snprintf(id_text, sizeof(id_text), "ActionID: %s\r\n", id);
+	}
+
+	copy = profile_snapshot(&count, &seconds);
+	astman_send_listack(s, m, "Memory profile sites will follow", "start");
+	for (i = 0; i < count && i < limit; ++i) {
+		astman_append(s,
+			"Event: MemoryProfileSite\r\n"
+			"%s"
+			"SiteID: %u\r\n"
+			"File: %s\r\n"
+			"Line: %d\r\n"
+			"Function: %s\r\n"
+			"LiveBytes: %" PRIu64 "\r\n"
+			"LiveAllocations: %" PRIu64 "\r\n"
+			"AllocationsPerSecond: %.1f\r\n"
+			"\r\n",
+			id_text, copy[i].id, copy[i].file, copy[i].lineno, copy[i].func,
+			copy[i].live_bytes, copy[i].live_count, copy[i].allocations / seconds);
+	}
+	astman_send_list_complete_start(s, m, "MemoryProfileComplete", i);
+	astman_append(s, "SamplePeriod: %u\r\n", ast_mm_sample_period);
+	astman_send_list_complete_end(s);
+	free(copy);
+
+	return 0;
+}
+
+static void mm_profile_shutdown(void)
+{
+	ast_cli_unregister_multiple(cli_memory_profile, ARRAY_LEN(cli_memory_profile));
+	ast_manager_unregister("MemoryProfile");
+}
+
+void ast_mm_profile_init(void)
+{
+	ast_cli_register_multiple(cli_memory_profile, ARRAY_LEN(cli_memory_profile));
+	ast_manager_register_xml_core("MemoryProfile", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING, manager_memory_profile);
+	ast_register_cleanup(mm_profile_shutdown);
+}
+
 #endif	/* defined(__AST_DEBUG_MALLOC) */
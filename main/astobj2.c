@@ -35,6 +35,7 @@ ASTERISK_REGISTER_FILE()
 #include "astobj2_container_private.h"
 #include "asterisk/cli.h"
 #include "asterisk/paths.h"
+#include "asterisk/threadstorage.h"
 
 /* Use ast_log_safe in place of ast_log. */
 #define ast_log ast_log_safe
@@ -148,6 +149,293 @@ struct ao2_stats ao2;
  */
 #define EXTERNAL_OBJ(_p)	((_p) == NULL ? NULL : (_p)->user_data)
 
+#if !defined(LOW_MEMORY) && !defined(__AST_DEBUG_MALLOC)
+/*!
+ * \brief Small objects are allocated from per-thread pools of freed object memory.
+ *
+ * \note Malloc debugging needs the callers of ao2_alloc() recorded
+ * for each allocation so the pools are not used with it.
+ */
+#define AO2_OBJ_POOLS
+#endif
+
+#if defined(AO2_OBJ_POOLS)
+static void ao2_pool_cleanup(void *data);
+static int ao2_pool_init(void *data);
+
+/*! \brief A per-thread pool of freed object memory */
+AST_THREADSTORAGE_CUSTOM(ao2_pool, ao2_pool_init, ao2_pool_cleanup);
+
+/*!
+ * \brief Allocation sizes of the pool size classes, including the object header.
+ *
+ * Objects larger than the largest class are allocated from the heap.
+ */
+static const size_t ao2_pool_sizes[] = { 64, 96, 128, 192, 256, 384, 512, };
+
+/*! \brief Number of pool size classes */
+#define AO2_POOL_CLASSES ARRAY_LEN(ao2_pool_sizes)
+
+/*!
+ * \brief Maximum number of free blocks of a size class kept by a thread
+ *
+ * The last reference to an ao2 object is dropped by whichever thread
+ * happens to hold it, so the memory lands in the pool of that thread
+ * rather than the one that allocated it: a stasis message is released by
+ * the taskprocessor of its last subscriber, a channel snapshot by the one
+ * updating the cache that replaces it.  The size classes of those threads
+ * would fill up while the allocating threads keep missing, so a full class
+ * hands AO2_POOL_BATCH blocks to the depot of that size class.
+ */
+#define AO2_POOL_MAX_SIZE 64
+
+/*! \brief Number of blocks moved between a thread's pool and the depot at once */
+#define AO2_POOL_BATCH 32
+
+/*! \brief Maximum number of free blocks of a size class kept in the depot */
+#define AO2_POOL_DEPOT_MAX_SIZE 2048
+
+/*! \brief A free block of object memory */
+struct ao2_pool_block {
+	struct ao2_pool_block *next;
+};
+
+/*! \brief Free blocks and counters of a size class */
+struct ao2_pool_class {
+	/*! Free blocks of the size class */
+	struct ao2_pool_block *free;
+	/*! Number of free blocks */
+	unsigned int size;
+	/*! Number of allocations that reused a free block */
+	unsigned long hits;
+	/*! Number of allocations that needed new memory */
+	unsigned long misses;
+};
+
+/*! \brief The pools of a thread */
+struct ao2_pool {
+	AST_LIST_ENTRY(ao2_pool) list;
+	struct ao2_pool_class classes[AO2_POOL_CLASSES];
+};
+
+/*! \brief Lock for the depot and the list of thread pools */
+AST_MUTEX_DEFINE_STATIC(ao2_pool_lock);
+/*! \brief Pools of all running threads, for statistics */
+static AST_LIST_HEAD_NOLOCK_STATIC(ao2_pools, ao2_pool);
+/*! \brief Free blocks shared between threads and the counters of exited threads */
+static struct ao2_pool_class ao2_pool_depot[AO2_POOL_CLASSES];
+/*! \brief Set at shutdown to free released memory instead of keeping it */
+static int ao2_pool_disabled;
+
+static int ao2_pool_init(void *data)
+{
+	struct ao2_pool *pool = data;
+
+	ast_mutex_lock(&ao2_pool_lock);
+	AST_LIST_INSERT_TAIL(&ao2_pools, pool, list);
+	ast_mutex_unlock(&ao2_pool_lock);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Move up to count blocks from a thread's pool to the depot, freeing what does not fit
+ *
+ * \note ao2_pool_lock must be held
+ */
+static void ao2_pool_drain(int idx, struct ao2_pool_class *cls, unsigned int count)
+{
+	struct ao2_pool_class *depot = &ao2_pool_depot[idx];
+	struct ao2_pool_block *block;
+
+	while (count-- && (block = cls->free)) {
+		cls->free = block->next;
+		--cls->size;
+		if (!ao2_pool_disabled && depot->size < AO2_POOL_DEPOT_MAX_SIZE) {
+			block->next = depot->free;
+			depot->free = block;
+			++depot->size;
+		} else {
+			ast_free(block);
+		}
+	}
+}
+
+static void ao2_pool_cleanup(void *data)
+{
+	struct ao2_pool *pool = data;
+	int idx;
+
+	ast_mutex_lock(&ao2_pool_lock);
+	AST_LIST_REMOVE(&ao2_pools, pool, list);
+	for (idx = 0; idx < AO2_POOL_CLASSES; ++idx) {
+		ao2_pool_drain(idx, &pool->classes[idx], pool->classes[idx].size);
+		ao2_pool_depot[idx].hits += pool->classes[idx].hits;
+		ao2_pool_depot[idx].misses += pool->classes[idx].misses;
+	}
+	ast_mutex_unlock(&ao2_pool_lock);
+	ast_free(pool);
+}
+
+/*!
+ * \internal
+ * \brief Get the size class of an allocation size
+ *
+ * \retval -1 if the size is too large to be pooled.
+ */
+static int ao2_pool_class(size_t size)
+{
+	int idx;
+
+	for (idx = 0; idx < AO2_POOL_CLASSES; ++idx) {
+		if (size <= ao2_pool_sizes[idx]) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+/*!
+ * \internal
+ * \brief Allocate zeroed memory for an object from the thread's pool or the heap
+ *
+ * \param size Allocation size including the object header.
+ */
+static void *ao2_pool_alloc(size_t size)
+{
+	struct ao2_pool *pool;
+	struct ao2_pool_class *cls;
+	struct ao2_pool_block *block;
+	int idx;
+	int count;
+
+	idx = ao2_pool_class(size);
+	if (idx < 0) {
+		return ast_calloc(1, size);
+	}
+	/* Always allocate the whole class so the memory can be pooled when released. */
+	if (!(pool = ast_threadstorage_get(&ao2_pool, sizeof(*pool)))) {
+		return ast_calloc(1, ao2_pool_sizes[idx]);
+	}
+
+	cls = &pool->classes[idx];
+	if (!cls->free) {
+		/* Refill the empty pool from the depot. */
+		ast_mutex_lock(&ao2_pool_lock);
+		for (count = AO2_POOL_BATCH; count-- && (block = ao2_pool_depot[idx].free);) {
+			ao2_pool_depot[idx].free = block->next;
+			--ao2_pool_depot[idx].size;
+			block->next = cls->free;
+			cls->free = block;
+			++cls->size;
+		}
+		ast_mutex_unlock(&ao2_pool_lock);
+	}
+
+	block = cls->free;
+	if (!block) {
+		++cls->misses;
+		return ast_calloc(1, ao2_pool_sizes[idx]);
+	}
+	cls->free = block->next;
+	--cls->size;
+	++cls->hits;
+	memset(block, 0, size);
+	return block;
+}
+
+/*!
+ * \internal
+ * \brief Release the memory of an object to the thread's pool or the heap
+ *
+ * \param mem Memory allocated by ao2_pool_alloc().
+ * \param size Allocation size including the object header.
+ */
+static void ao2_pool_free(void *mem, size_t size)
+{
+	struct ao2_pool *pool;
+	struct ao2_pool_class *cls;
+	struct ao2_pool_block *block = mem;
+	int idx;
+
+	idx = ao2_pool_class(size);
+	if (idx < 0 || ao2_pool_disabled
+		|| !(pool = ast_threadstorage_get(&ao2_pool, sizeof(*pool)))) {
+		ast_free(mem);
+		return;
+	}
+
+	cls = &pool->classes[idx];
+	if (AO2_POOL_MAX_SIZE <= cls->size) {
+		ast_mutex_lock(&ao2_pool_lock);
+		ao2_pool_drain(idx, cls, AO2_POOL_BATCH);
+		ast_mutex_unlock(&ao2_pool_lock);
+	}
+	block->next = cls->free;
+	cls->free = block;
+	++cls->size;
+}
+
+static char *handle_astobj2_pools(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT "%6s %12s %12s %7s %8s %8s\n"
+#define FORMAT2 "%6d %12lu %12lu %6lu%% %8u %8u\n"
+	struct ao2_pool *pool;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned int cached;
+	int threads = 0;
+	int idx;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "astobj2 show pools";
+		e->usage =
+			"Usage: astobj2 show pools\n"
+			"       Shows how often small astobj2 objects reuse the memory of\n"
+			"       released objects and how many free blocks each size class\n"
+			"       keeps in the thread pools and the shared depot.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, FORMAT, "Size", "Reused", "New", "Reuse", "Cached", "Depot");
+	ast_mutex_lock(&ao2_pool_lock);
+	AST_LIST_TRAVERSE(&ao2_pools, pool, list) {
+		++threads;
+	}
+	for (idx = 0; idx < AO2_POOL_CLASSES; ++idx) {
+		/* The counters of running threads are read without locking them. */
+		hits = ao2_pool_depot[idx].hits;
+		misses = ao2_pool_depot[idx].misses;
+		cached = 0;
+		AST_LIST_TRAVERSE(&ao2_pools, pool, list) {
+			hits += pool->classes[idx].hits;
+			misses += pool->classes[idx].misses;
+			cached += pool->classes[idx].size;
+		}
+		ast_cli(a->fd, FORMAT2, (int) ao2_pool_sizes[idx], hits, misses,
+			hits + misses ? hits * 100 / (hits + misses) : 0UL,
+			cached, ao2_pool_depot[idx].size);
+	}
+	ast_mutex_unlock(&ao2_pool_lock);
+	ast_cli(a->fd, "%d threads with pools\n", threads);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
+static struct ast_cli_entry cli_astobj2_pools[] = {
+	AST_CLI_DEFINE(handle_astobj2_pools, "Show astobj2 object pool statistics"),
+};
+#endif	/* defined(AO2_OBJ_POOLS) */
+
 int internal_is_ao2_object(void *user_data)
 {
 	struct astobj2 *p;
@@ -541,16 +829,28 @@ int __ao2_ref(void *user_data, int delta,
 		obj_mutex = INTERNAL_OBJ_MUTEX(user_data);
 		ast_mutex_destroy(&obj_mutex->mutex.lock);
 
+#if defined(AO2_OBJ_POOLS)
+		ao2_pool_free(obj_mutex, sizeof(*obj_mutex) + obj->priv_data.data_size);
+#else
 		ast_free(obj_mutex);
+#endif
 		break;
 	case AO2_ALLOC_OPT_LOCK_RWLOCK:
 		obj_rwlock = INTERNAL_OBJ_RWLOCK(user_data);
 		ast_rwlock_destroy(&obj_rwlock->rwlock.lock);
 
+#if defined(AO2_OBJ_POOLS)
+		ao2_pool_free(obj_rwlock, sizeof(*obj_rwlock) + obj->priv_data.data_size);
+#else
 		ast_free(obj_rwlock);
+#endif
 		break;
 	case AO2_ALLOC_OPT_LOCK_NOLOCK:
+#if defined(AO2_OBJ_POOLS)
+		ao2_pool_free(obj, sizeof(*obj) + obj->priv_data.data_size);
+#else
 		ast_free(obj);
+#endif
 		break;
 	default:
 		ast_log(__LOG_ERROR, file, line, func,
@@ -593,6 +893,8 @@ void *__ao2_alloc(size_t data_size, ao2_destructor_fn destructor_fn, unsigned in
 	case AO2_ALLOC_OPT_LOCK_MUTEX:
 #if defined(__AST_DEBUG_MALLOC)
 		obj_mutex = __ast_calloc(1, sizeof(*obj_mutex) + data_size, file, line, func);
+#elif defined(AO2_OBJ_POOLS)
+		obj_mutex = ao2_pool_alloc(sizeof(*obj_mutex) + data_size);
 #else
 		obj_mutex = ast_calloc(1, sizeof(*obj_mutex) + data_size);
 #endif
@@ -606,6 +908,8 @@ void *__ao2_alloc(size_t data_size, ao2_destructor_fn destructor_fn, unsigned in
 	case AO2_ALLOC_OPT_LOCK_RWLOCK:
 #if defined(__AST_DEBUG_MALLOC)
 		obj_rwlock = __ast_calloc(1, sizeof(*obj_rwlock) + data_size, file, line, func);
+#elif defined(AO2_OBJ_POOLS)
+		obj_rwlock = ao2_pool_alloc(sizeof(*obj_rwlock) + data_size);
 #else
 		obj_rwlock = ast_calloc(1, sizeof(*obj_rwlock) + data_size);
 #endif
@@ -619,6 +923,8 @@ void *__ao2_alloc(size_t data_size, ao2_destructor_fn destructor_fn, unsigned in
 	case AO2_ALLOC_OPT_LOCK_NOLOCK:
 #if defined(__AST_DEBUG_MALLOC)
 		obj = __ast_calloc(1, sizeof(*obj) + data_size, file, line, func);
+#elif defined(AO2_OBJ_POOLS)
+		obj = ao2_pool_alloc(sizeof(*obj) + data_size);
 #else
 		obj = ast_calloc(1, sizeof(*obj) + data_size);
 #endif
@@ -1137,6 +1443,26 @@ static void astobj2_cleanup(void)
 		fclose(ref_log);
 		ref_log = NULL;
 	}
+
+#if defined(AO2_OBJ_POOLS)
+	ast_cli_unregister_multiple(cli_astobj2_pools, ARRAY_LEN(cli_astobj2_pools));
+	{
+		struct ao2_pool_block *block;
+		int idx;
+
+		/* Objects released from now on are freed. */
+		ast_mutex_lock(&ao2_pool_lock);
+		ao2_pool_disabled = 1;
+		for (idx = 0; idx < AO2_POOL_CLASSES; ++idx) {
+			while ((block = ao2_pool_depot[idx].free)) {
+				ao2_pool_depot[idx].free = block->next;
+				ast_free(block);
+			}
+			ao2_pool_depot[idx].size = 0;
+		}
+		ast_mutex_unlock(&ao2_pool_lock);
+	}
+#endif
 }
 
 int astobj2_init(void)
@@ -1159,6 +1485,9 @@ int astobj2_init(void)
 #if defined(AO2_DEBUG)
 	ast_cli_register_multiple(cli_astobj2, ARRAY_LEN(cli_astobj2));
 #endif	/* defined(AO2_DEBUG) */
+#if defined(AO2_OBJ_POOLS)
+	ast_cli_register_multiple(cli_astobj2_pools, ARRAY_LEN(cli_astobj2_pools));
+#endif
 
 	ast_register_cleanup(astobj2_cleanup);
 
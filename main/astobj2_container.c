@@ -53,6 +53,9 @@ int __container_unlink_node_debug(struct ao2_container_node *node, uint32_t flag
 	}
 
 	node->obj = NULL;
+	if (container && container->v_table->unlinked_node) {
+		container->v_table->unlinked_node(container, node);
+	}
 
 	if (flags & AO2_UNLINK_NODE_DEC_COUNT) {
 		ast_atomic_fetchadd_int(&container->elements, -1);
@@ -78,6 +81,99 @@ int __container_unlink_node_debug(struct ao2_container_node *node, uint32_t flag
 	return 1;
 }
 
+/*! \brief Measure how long the container lock is held for one in this many locks. */
+#define CONTAINER_HOLD_SAMPLE_RATE 16
+
+void container_lock_stat_wait(struct ao2_container *self, struct timeval start)
+{
+	int64_t wait;
+
+	wait = ast_tvdiff_us(ast_tvnow(), start);
+	ast_atomic_fetchadd_int(&self->lock_stats.contended, +1);
+	__sync_fetch_and_add(&self->lock_stats.wait_us, wait < 0 ? 0 : wait);
+}
+
+/*!
+ * \internal
+ * \brief Lock a container for an operation and record lock statistics.
+ * \since 14.0.0
+ *
+ * \param self Container to lock.
+ * \param lock_how Type of lock to get.
+ * \param held Set to when the lock was got if its hold time is measured, else zero.
+ *
+ * \return Nothing
+ */
+static void container_lock(struct ao2_container *self, enum ao2_lock_req lock_how, struct timeval *held)
+{
+	struct timeval start;
+	int count;
+
+	count = ast_atomic_fetchadd_int(&self->lock_stats.locks, +1);
+	if (__ao2_trylock(self, lock_how, __FILE__, __PRETTY_FUNCTION__, __LINE__, "self")) {
+		start = ast_tvnow();
+		__ao2_lock(self, lock_how, __FILE__, __PRETTY_FUNCTION__, __LINE__, "self");
+		container_lock_stat_wait(self, start);
+	}
+	*held = (count % CONTAINER_HOLD_SAMPLE_RATE) ? ast_tv(0, 0) : ast_tvnow();
+}
+
+/*!
+ * \internal
+ * \brief Unlock a container locked by container_lock().
+ * \since 14.0.0
+ *
+ * \param self Container to unlock.
+ * \param held When the lock was got if its hold time is measured, else zero.
+ *
+ * \return Nothing
+ */
+static void container_unlock(struct ao2_container *self, struct timeval held)
+{
+	int64_t hold;
+
+	if (!ast_tvzero(held)) {
+		hold = ast_tvdiff_us(ast_tvnow(), held);
+		__sync_fetch_and_add(&self->lock_stats.hold_us, hold < 0 ? 0 : hold);
+		ast_atomic_fetchadd_int(&self->lock_stats.hold_samples, +1);
+	}
+	ao2_unlock(self);
+}
+
+/*!
+ * \internal
+ * \brief Lock all stripes of a striped container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container must be locked.
+ *
+ * \return Nothing
+ */
+static void container_lock_stripes(struct ao2_container *self)
+{
+	if (self->v_table->lock_stripes) {
+		self->v_table->lock_stripes(self);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Unlock all stripes of a striped container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \return Nothing
+ */
+static void container_unlock_stripes(struct ao2_container *self)
+{
+	if (self->v_table->unlock_stripes) {
+		self->v_table->unlock_stripes(self);
+	}
+}
+
 /*!
  * \internal
  * \brief Link an object into this container.  (internal)
@@ -99,6 +195,8 @@ int __ao2_link(struct ao2_container *self, void *obj_new, int flags,
 	int res;
 	enum ao2_lock_req orig_lock;
 	struct ao2_container_node *node;
+	struct timeval held = { 0, };
+	int stripe = -1;
 
 	if (!__is_ao2_object(obj_new, file, line, func)
 		|| !__is_ao2_object(self, file, line, func)
@@ -108,18 +206,25 @@ int __ao2_link(struct ao2_container *self, void *obj_new, int flags,
 		return 0;
 	}
 
-	if (flags & OBJ_NOLOCK) {
-		orig_lock = __adjust_lock(self, AO2_LOCK_REQ_WRLOCK, 1);
-	} else {
-		ao2_wrlock(self);
-		orig_lock = AO2_LOCK_REQ_MUTEX;
+	if (!(flags & OBJ_NOLOCK) && self->v_table->stripe_lock) {
+		/* Only the stripe holding the object needs to be locked. */
+		stripe = self->v_table->stripe_lock(self, OBJ_SEARCH_OBJECT, obj_new);
+	}
+	if (stripe < 0) {
+		if (flags & OBJ_NOLOCK) {
+			orig_lock = __adjust_lock(self, AO2_LOCK_REQ_WRLOCK, 1);
+		} else {
+			container_lock(self, AO2_LOCK_REQ_WRLOCK, &held);
+			orig_lock = AO2_LOCK_REQ_MUTEX;
+		}
+		container_lock_stripes(self);
 	}
 
 	res = 0;
 	node = self->v_table->new_node(self, obj_new, tag, file, line, func);
 	if (node) {
 #if defined(AO2_DEBUG)
-		if (ao2_container_check(self, OBJ_NOLOCK)) {
+		if (stripe < 0 && ao2_container_check(self, OBJ_NOLOCK)) {
 			ast_log(LOG_ERROR, "Container integrity failed before insert.\n");
 		}
 #endif	/* defined(AO2_DEBUG) */
@@ -130,7 +235,7 @@ int __ao2_link(struct ao2_container *self, void *obj_new, int flags,
 			node->is_linked = 1;
 			ast_atomic_fetchadd_int(&self->elements, 1);
 #if defined(AO2_DEBUG)
-			AO2_DEVMODE_STAT(++self->nodes);
+			AO2_DEVMODE_STAT(ast_atomic_fetchadd_int(&self->nodes, +1));
 			if (self->v_table->link_stat) {
 				self->v_table->link_stat(self, node);
 			}
@@ -138,7 +243,7 @@ int __ao2_link(struct ao2_container *self, void *obj_new, int flags,
 			/* Fall through */
 		case AO2_CONTAINER_INSERT_NODE_OBJ_REPLACED:
 #if defined(AO2_DEBUG)
-			if (ao2_container_check(self, OBJ_NOLOCK)) {
+			if (stripe < 0 && ao2_container_check(self, OBJ_NOLOCK)) {
 				ast_log(LOG_ERROR, "Container integrity failed after insert or replace.\n");
 			}
 #endif	/* defined(AO2_DEBUG) */
@@ -150,10 +255,15 @@ int __ao2_link(struct ao2_container *self, void *obj_new, int flags,
 		}
 	}
 
-	if (flags & OBJ_NOLOCK) {
-		__adjust_lock(self, orig_lock, 0);
+	if (0 <= stripe) {
+		self->v_table->stripe_unlock(self, stripe);
 	} else {
-		ao2_unlock(self);
+		container_unlock_stripes(self);
+		if (flags & OBJ_NOLOCK) {
+			__adjust_lock(self, orig_lock, 0);
+		} else {
+			container_unlock(self, held);
+		}
 	}
 
 	return res;
@@ -187,6 +297,24 @@ void *__ao2_unlink(struct ao2_container *c, void *user_data, int flags,
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Let the container do deferred maintenance after unlinking objects.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container must be write locked.
+ *
+ * \return Nothing
+ */
+static void container_rehash(struct ao2_container *self)
+{
+	if (self->v_table->rehash && !self->traversals && !self->destroying) {
+		self->v_table->rehash(self);
+	}
+}
+
 /*!
  * \brief special callback that matches all
  */
@@ -236,6 +364,10 @@ static void *internal_ao2_traverse(struct ao2_container *self, enum search_flags
 	ao2_callback_data_fn *cb_withdata = NULL;
 	struct ao2_container_node *node;
 	void *traversal_state;
+	void *doomed = NULL;
+	struct timeval held = { 0, };
+	int stripe = -1;
+	int bulk_seq;
 
 	enum ao2_lock_req orig_lock;
 	struct ao2_container *multi_container = NULL;
@@ -291,22 +423,51 @@ static void *internal_ao2_traverse(struct ao2_container *self, enum search_flags
 		}
 	}
 
+	ast_atomic_fetchadd_int(&self->lock_stats.searches, +1);
+	bulk_seq = self->bulk_seq;
+	if (self->v_table->find_lockless
+		&& !(flags & (OBJ_UNLINK | OBJ_MULTIPLE))
+		&& ((flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_OBJECT
+			|| (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY)
+		&& !(bulk_seq & 1)
+		&& !self->v_table->find_lockless(self, flags,
+			cb_withdata ? (void *) cb_withdata : (void *) cb_default, arg, data, type,
+			&ret, tag, file, line, func)
+		&& (ret || bulk_seq == self->bulk_seq)) {
+		/*
+		 * A miss while the contents were being replaced is redone
+		 * with the container locked.
+		 */
+		return ret;
+	}
+
+	orig_lock = AO2_LOCK_REQ_MUTEX;
+	if (self->v_table->stripe_lock
+		&& !(flags & (OBJ_NOLOCK | OBJ_MULTIPLE))
+		&& ((flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_OBJECT
+			|| (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY)) {
+		/* Only the stripe holding the key needs to be locked. */
+		stripe = self->v_table->stripe_lock(self, flags & OBJ_SEARCH_MASK, arg);
+	}
+
 	/* avoid modifications to the content */
-	if (flags & OBJ_NOLOCK) {
-		if (flags & OBJ_UNLINK) {
-			orig_lock = __adjust_lock(self, AO2_LOCK_REQ_WRLOCK, 1);
-		} else {
-			orig_lock = __adjust_lock(self, AO2_LOCK_REQ_RDLOCK, 1);
-		}
-	} else {
-		orig_lock = AO2_LOCK_REQ_MUTEX;
-		if (flags & OBJ_UNLINK) {
-			ao2_wrlock(self);
+	if (stripe < 0) {
+		if (flags & OBJ_NOLOCK) {
+			if (flags & OBJ_UNLINK) {
+				orig_lock = __adjust_lock(self, AO2_LOCK_REQ_WRLOCK, 1);
+			} else {
+				orig_lock = __adjust_lock(self, AO2_LOCK_REQ_RDLOCK, 1);
+			}
 		} else {
-			ao2_rdlock(self);
+			container_lock(self, (flags & OBJ_UNLINK) ? AO2_LOCK_REQ_WRLOCK : AO2_LOCK_REQ_RDLOCK,
+				&held);
 		}
+		container_lock_stripes(self);
 	}
 
+	/* Container nodes must stay put while we traverse them. */
+	ast_atomic_fetchadd_int(&self->traversals, +1);
+
 	/* Create a buffer for the traversal state. */
 	traversal_state = alloca(AO2_TRAVERSAL_STATE_SIZE);
 
@@ -367,6 +528,11 @@ static void *internal_ao2_traverse(struct ao2_container *self, enum search_flags
 				int ulflag = AO2_UNLINK_NODE_UNREF_NODE | AO2_UNLINK_NODE_DEC_COUNT;
 				if (multi_container || (flags & OBJ_NODATA)) {
 					ulflag |= AO2_UNLINK_NODE_UNLINK_OBJECT;
+					if (0 <= stripe) {
+						/* Don't destroy the object while holding the stripe. */
+						doomed = node->obj;
+						ulflag |= AO2_UNLINK_NODE_NOUNREF_OBJECT;
+					}
 				}
 				__container_unlink_node_debug(node, ulflag, tag, file, line, func);
 			}
@@ -384,11 +550,23 @@ static void *internal_ao2_traverse(struct ao2_container *self, enum search_flags
 		/* Unref the node from self->v_table->traverse_first/traverse_next() */
 		ao2_t_ref(node, -1, NULL);
 	}
+	ast_atomic_fetchadd_int(&self->traversals, -1);
 
-	if (flags & OBJ_NOLOCK) {
-		__adjust_lock(self, orig_lock, 0);
+	if (0 <= stripe) {
+		self->v_table->stripe_unlock(self, stripe);
+		if (doomed) {
+			__ao2_ref(doomed, -1, tag ?: "Remove obj from container", file, line, func);
+		}
 	} else {
-		ao2_unlock(self);
+		if (flags & OBJ_UNLINK) {
+			container_rehash(self);
+		}
+		container_unlock_stripes(self);
+		if (flags & OBJ_NOLOCK) {
+			__adjust_lock(self, orig_lock, 0);
+		} else {
+			container_unlock(self, held);
+		}
 	}
 
 	/* if multi_container was created, we are returning multiple objects */
@@ -477,10 +655,13 @@ void ao2_iterator_restart(struct ao2_iterator *iter)
 			orig_lock = AO2_LOCK_REQ_MUTEX;
 			ao2_rdlock(iter->c);
 		}
+		container_lock_stripes(iter->c);
 
 		ao2_t_ref(iter->last_node, -1, NULL);
 		iter->last_node = NULL;
+		ast_atomic_fetchadd_int(&iter->c->traversals, -1);
 
+		container_unlock_stripes(iter->c);
 		if (iter->flags & AO2_ITERATOR_DONTLOCK) {
 			__adjust_lock(iter->c, orig_lock, 0);
 		} else {
@@ -519,6 +700,7 @@ void *__ao2_iterator_next(struct ao2_iterator *iter,
 {
 	enum ao2_lock_req orig_lock;
 	struct ao2_container_node *node;
+	struct timeval held = { 0, };
 	void *ret;
 
 	if (!__is_ao2_object(iter->c, file, line, func)
@@ -541,12 +723,11 @@ void *__ao2_iterator_next(struct ao2_iterator *iter,
 		}
 	} else {
 		orig_lock = AO2_LOCK_REQ_MUTEX;
-		if (iter->flags & AO2_ITERATOR_UNLINK) {
-			ao2_wrlock(iter->c);
-		} else {
-			ao2_rdlock(iter->c);
-		}
+		container_lock(iter->c,
+			(iter->flags & AO2_ITERATOR_UNLINK) ? AO2_LOCK_REQ_WRLOCK : AO2_LOCK_REQ_RDLOCK,
+			&held);
 	}
+	container_lock_stripes(iter->c);
 
 	node = iter->c->v_table->iterator_next(iter->c, iter->last_node, iter->flags);
 	if (node) {
@@ -573,13 +754,25 @@ void *__ao2_iterator_next(struct ao2_iterator *iter,
 	/* Replace the iterator's node */
 	if (iter->last_node) {
 		ao2_t_ref(iter->last_node, -1, NULL);
+		if (!node) {
+			/* The iterator is no longer positioned in the container. */
+			ast_atomic_fetchadd_int(&iter->c->traversals, -1);
+			if (iter->flags & AO2_ITERATOR_UNLINK) {
+				container_rehash(iter->c);
+			}
+		}
+	} else if (node) {
+		/* Container nodes must stay put while the iterator is positioned. */
+		ast_atomic_fetchadd_int(&iter->c->traversals, +1);
+		ast_atomic_fetchadd_int(&iter->c->lock_stats.searches, +1);
 	}
 	iter->last_node = node;
 
+	container_unlock_stripes(iter->c);
 	if (iter->flags & AO2_ITERATOR_DONTLOCK) {
 		__adjust_lock(iter->c, orig_lock, 0);
 	} else {
-		ao2_unlock(iter->c);
+		container_unlock(iter->c, held);
 	}
 
 	return ret;
@@ -655,6 +848,77 @@ int ao2_container_dup(struct ao2_container *dest, struct ao2_container *src, enu
 	return res;
 }
 
+int ao2_container_link_bulk(struct ao2_container *self, void * const *objs, size_t count, enum search_flags flags)
+{
+	size_t idx;
+	int linked = 0;
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_wrlock(self);
+	}
+	/* Keep the stripes locked so striped links cannot slip in between. */
+	container_lock_stripes(self);
+	for (idx = 0; idx < count; ++idx) {
+		if (ao2_t_link_flags(self, objs[idx], OBJ_NOLOCK, NULL)) {
+			++linked;
+		}
+	}
+	container_unlock_stripes(self);
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_unlock(self);
+	}
+
+	return linked;
+}
+
+int ao2_container_swap_contents(struct ao2_container *self, struct ao2_container *other, enum search_flags flags)
+{
+	struct ao2_container *outgoing;
+	int res = -1;
+
+	/* Holds the objects of self while the objects of other move in. */
+	outgoing = ao2_t_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL,
+		"Swap container contents");
+	if (!outgoing) {
+		return -1;
+	}
+
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_wrlock(self);
+		ao2_wrlock(other);
+	}
+	container_lock_stripes(self);
+	container_lock_stripes(other);
+
+	if (!ao2_container_dup(outgoing, self, OBJ_NOLOCK)) {
+		ast_atomic_fetchadd_int(&self->bulk_seq, +1);
+		ao2_t_callback(self, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL,
+			NULL, "Swap out the old contents");
+		if (!ao2_container_dup(self, other, OBJ_NOLOCK)) {
+			ao2_t_callback(other, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL,
+				NULL, "Swap in the new contents");
+			if (ao2_container_dup(other, outgoing, OBJ_NOLOCK)) {
+				ast_log(LOG_WARNING, "Old container contents could not be swapped out.\n");
+			}
+			res = 0;
+		} else if (ao2_container_dup(self, outgoing, OBJ_NOLOCK)) {
+			ast_log(LOG_ERROR, "Container contents lost restoring them after a failed swap.\n");
+		}
+		ast_atomic_fetchadd_int(&self->bulk_seq, +1);
+	}
+
+	container_unlock_stripes(other);
+	container_unlock_stripes(self);
+	if (!(flags & OBJ_NOLOCK)) {
+		ao2_unlock(other);
+		ao2_unlock(self);
+	}
+
+	/* Any old objects not taken by other are released outside of the locks. */
+	ao2_t_ref(outgoing, -1, "Swap container contents done");
+	return res;
+}
+
 struct ao2_container *__ao2_container_clone(struct ao2_container *orig, enum search_flags flags, const char *tag, const char *file, int line, const char *func)
 {
 	struct ao2_container *clone;
@@ -698,6 +962,7 @@ void ao2_container_dump(struct ao2_container *self, enum search_flags flags, con
 	if (!(flags & OBJ_NOLOCK)) {
 		ao2_rdlock(self);
 	}
+	container_lock_stripes(self);
 	if (name) {
 		prnt(where, "Container name: %s\n", name);
 	}
@@ -709,6 +974,7 @@ void ao2_container_dump(struct ao2_container *self, enum search_flags flags, con
 	{
 		prnt(where, "Container dump not available.\n");
 	}
+	container_unlock_stripes(self);
 	if (!(flags & OBJ_NOLOCK)) {
 		ao2_unlock(self);
 	}
@@ -725,10 +991,28 @@ void ao2_container_stats(struct ao2_container *self, enum search_flags flags, co
 	if (!(flags & OBJ_NOLOCK)) {
 		ao2_rdlock(self);
 	}
+	container_lock_stripes(self);
 	if (name) {
 		prnt(where, "Container name: %s\n", name);
 	}
 	prnt(where, "Number of objects: %d\n", self->elements);
+	if (self->v_table->occupancy) {
+		int buckets;
+		int used;
+		int max_chain;
+
+		self->v_table->occupancy(self, &buckets, &used, &max_chain);
+		prnt(where, "Buckets in use: %d of %d\n", used, buckets);
+		prnt(where, "Longest bucket chain: %d\n", max_chain);
+	}
+	prnt(where, "Number of searches: %d\n", self->lock_stats.searches);
+	prnt(where, "Number of locks: %d\n", self->lock_stats.locks);
+	prnt(where, "Number of contended locks: %d\n", self->lock_stats.contended);
+	prnt(where, "Lock wait time: %" PRIu64 " us\n", self->lock_stats.wait_us);
+	prnt(where, "Average lock hold time: %.2f us (%d samples)\n",
+		self->lock_stats.hold_samples
+			? (double) self->lock_stats.hold_us / self->lock_stats.hold_samples : 0.0,
+		self->lock_stats.hold_samples);
 #if defined(AO2_DEBUG)
 	prnt(where, "Number of nodes: %d\n", self->nodes);
 	prnt(where, "Number of empty nodes: %d\n", self->nodes - self->elements);
@@ -746,6 +1030,7 @@ void ao2_container_stats(struct ao2_container *self, enum search_flags flags, co
 		self->v_table->stats(self, where, prnt);
 	}
 #endif	/* defined(AO2_DEBUG) */
+	container_unlock_stripes(self);
 	if (!(flags & OBJ_NOLOCK)) {
 		ao2_unlock(self);
 	}
@@ -769,7 +1054,9 @@ int ao2_container_check(struct ao2_container *self, enum search_flags flags)
 	if (!(flags & OBJ_NOLOCK)) {
 		ao2_rdlock(self);
 	}
+	container_lock_stripes(self);
 	res = self->v_table->integrity(self);
+	container_unlock_stripes(self);
 	if (!(flags & OBJ_NOLOCK)) {
 		ao2_unlock(self);
 	}
@@ -777,7 +1064,6 @@ int ao2_container_check(struct ao2_container *self, enum search_flags flags)
 	return res;
 }
 
-#if defined(AO2_DEBUG)
 static struct ao2_container *reg_containers;
 
 struct ao2_reg_container {
@@ -802,9 +1088,7 @@ struct ao2_reg_match {
 	/*! Count of the matches already found. */
 	int count;
 };
-#endif	/* defined(AO2_DEBUG) */
 
-#if defined(AO2_DEBUG)
 static int ao2_reg_sort_cb(const void *obj_left, const void *obj_right, int flags)
 {
 	const struct ao2_reg_container *reg_left = obj_left;
@@ -840,9 +1124,7 @@ static int ao2_reg_sort_cb(const void *obj_left, const void *obj_right, int flag
 	}
 	return cmp;
 }
-#endif	/* defined(AO2_DEBUG) */
 
-#if defined(AO2_DEBUG)
 static void ao2_reg_destructor(void *v_doomed)
 {
 	struct ao2_reg_container *doomed = v_doomed;
@@ -851,12 +1133,10 @@ static void ao2_reg_destructor(void *v_doomed)
 		ao2_t_ref(doomed->registered, -1, "Releasing registered container.");
 	}
 }
-#endif	/* defined(AO2_DEBUG) */
 
 int ao2_container_register(const char *name, struct ao2_container *self, ao2_prnt_obj_fn *prnt_obj)
 {
 	int res = 0;
-#if defined(AO2_DEBUG)
 	struct ao2_reg_container *reg;
 
 	reg = ao2_t_alloc_options(sizeof(*reg) + strlen(name), ao2_reg_destructor,
@@ -876,19 +1156,15 @@ int ao2_container_register(const char *name, struct ao2_container *self, ao2_prn
 	}
 
 	ao2_t_ref(reg, -1, "Done registering container.");
-#endif	/* defined(AO2_DEBUG) */
 	return res;
 }
 
 void ao2_container_unregister(const char *name)
 {
-#if defined(AO2_DEBUG)
 	ao2_t_find(reg_containers, name, OBJ_UNLINK | OBJ_NODATA | OBJ_SEARCH_KEY,
 		"Unregister container");
-#endif	/* defined(AO2_DEBUG) */
 }
 
-#if defined(AO2_DEBUG)
 static int ao2_complete_reg_cb(void *obj, void *arg, void *data, int flags)
 {
 	struct ao2_reg_match *which = data;
@@ -896,9 +1172,7 @@ static int ao2_complete_reg_cb(void *obj, void *arg, void *data, int flags)
 	/* ao2_reg_sort_cb() has already filtered the search to matching keys */
 	return (which->find_nth < ++which->count) ? (CMP_MATCH | CMP_STOP) : 0;
 }
-#endif	/* defined(AO2_DEBUG) */
 
-#if defined(AO2_DEBUG)
 static char *complete_container_names(struct ast_cli_args *a)
 {
 	struct ao2_reg_partial_key partial_key;
@@ -924,9 +1198,7 @@ static char *complete_container_names(struct ast_cli_args *a)
 	}
 	return name;
 }
-#endif	/* defined(AO2_DEBUG) */
 
-#if defined(AO2_DEBUG)
 AST_THREADSTORAGE(ao2_out_buf);
 
 /*!
@@ -958,7 +1230,6 @@ static void cli_output(void *where, const char *fmt, ...)
 		ast_cli(*(int *) where, "%s", ast_str_buffer(buf));
 	}
 }
-#endif	/* defined(AO2_DEBUG) */
 
 #if defined(AO2_DEBUG)
 /*! \brief Show container contents - CLI command */
@@ -996,7 +1267,6 @@ static char *handle_cli_astobj2_container_dump(struct ast_cli_entry *e, int cmd,
 }
 #endif	/* defined(AO2_DEBUG) */
 
-#if defined(AO2_DEBUG)
 /*! \brief Show container statistics - CLI command */
 static char *handle_cli_astobj2_container_stats(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
@@ -1029,7 +1299,6 @@ static char *handle_cli_astobj2_container_stats(struct ast_cli_entry *e, int cmd
 
 	return CLI_SUCCESS;
 }
-#endif	/* defined(AO2_DEBUG) */
 
 #if defined(AO2_DEBUG)
 /*! \brief Show container check results - CLI command */
@@ -1067,15 +1336,115 @@ static char *handle_cli_astobj2_container_check(struct ast_cli_entry *e, int cmd
 }
 #endif	/* defined(AO2_DEBUG) */
 
-#if defined(AO2_DEBUG)
+/*! \brief Statistics of a registered container for ranking. */
+struct ao2_reg_contention {
+	/*! Container registration. */
+	struct ao2_reg_container *reg;
+	/*! Total lock wait time in microseconds. */
+	uint64_t wait_us;
+};
+
+static int ao2_reg_contention_cmp(const void *left, const void *right)
+{
+	const struct ao2_reg_contention *reg_left = left;
+	const struct ao2_reg_contention *reg_right = right;
+
+	if (reg_left->wait_us == reg_right->wait_us) {
+		return strcasecmp(reg_left->reg->name, reg_right->reg->name);
+	}
+	return reg_left->wait_us < reg_right->wait_us ? 1 : -1;
+}
+
+/*! \brief Rank registered containers by lock wait time - CLI command */
+static char *handle_cli_astobj2_container_contention(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT  "%-30.30s %8s %10s %10s %12s %8s %10s %13s %5s\n"
+#define FORMAT2 "%-30.30s %8d %10d %10d %12" PRIu64 " %8.2f %10d %6d/%-6d %5d\n"
+	struct ao2_reg_contention *regs;
+	struct ao2_reg_container *reg;
+	struct ao2_container *self;
+	struct ao2_iterator iter;
+	int count;
+	int idx;
+	int buckets;
+	int used;
+	int max_chain;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "astobj2 container contention";
+		e->usage =
+			"Usage: astobj2 container contention\n"
+			"	Show lock and search statistics of the registered containers,\n"
+			"	ranked by the time spent waiting for their locks.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ao2_rdlock(reg_containers);
+	count = ao2_container_count(reg_containers);
+	regs = ast_calloc(count ?: 1, sizeof(*regs));
+	if (!regs) {
+		ao2_unlock(reg_containers);
+		return CLI_FAILURE;
+	}
+	iter = ao2_iterator_init(reg_containers, AO2_ITERATOR_DONTLOCK);
+	for (idx = 0; idx < count && (reg = ao2_iterator_next(&iter)); ++idx) {
+		regs[idx].reg = reg;
+		regs[idx].wait_us = reg->registered->lock_stats.wait_us;
+	}
+	ao2_iterator_destroy(&iter);
+	ao2_unlock(reg_containers);
+	count = idx;
+
+	qsort(regs, count, sizeof(*regs), ao2_reg_contention_cmp);
+
+	ast_cli(a->fd, FORMAT, "Container", "Objects", "Locks", "Contended", "Wait (us)",
+		"Hold (us)", "Searches", "Buckets used", "Chain");
+	for (idx = 0; idx < count; ++idx) {
+		reg = regs[idx].reg;
+		self = reg->registered;
+
+		buckets = 0;
+		used = 0;
+		max_chain = 0;
+		if (self->v_table->occupancy) {
+			ao2_rdlock(self);
+			container_lock_stripes(self);
+			self->v_table->occupancy(self, &buckets, &used, &max_chain);
+			container_unlock_stripes(self);
+			ao2_unlock(self);
+		}
+
+		/* The counters are read without locking the container. */
+		ast_cli(a->fd, FORMAT2, reg->name, self->elements, self->lock_stats.locks,
+			self->lock_stats.contended, regs[idx].wait_us,
+			self->lock_stats.hold_samples
+				? (double) self->lock_stats.hold_us / self->lock_stats.hold_samples : 0.0,
+			self->lock_stats.searches, used, buckets, max_chain);
+		ao2_t_ref(reg, -1, "Done with registered container object.");
+	}
+	ast_free(regs);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
 static struct ast_cli_entry cli_astobj2[] = {
+#if defined(AO2_DEBUG)
 	AST_CLI_DEFINE(handle_cli_astobj2_container_dump, "Show container contents"),
-	AST_CLI_DEFINE(handle_cli_astobj2_container_stats, "Show container statistics"),
 	AST_CLI_DEFINE(handle_cli_astobj2_container_check, "Perform a container integrity check"),
-};
 #endif	/* defined(AO2_DEBUG) */
+	AST_CLI_DEFINE(handle_cli_astobj2_container_stats, "Show container statistics"),
+	AST_CLI_DEFINE(handle_cli_astobj2_container_contention, "Rank containers by lock wait time"),
+};
 
-#if defined(AO2_DEBUG)
 static void container_cleanup(void)
 {
 	ao2_t_ref(reg_containers, -1, "Releasing container registration container");
@@ -1083,11 +1452,9 @@ static void container_cleanup(void)
 
 	ast_cli_unregister_multiple(cli_astobj2, ARRAY_LEN(cli_astobj2));
 }
-#endif	/* defined(AO2_DEBUG) */
 
 int container_init(void)
 {
-#if defined(AO2_DEBUG)
 	reg_containers = ao2_t_container_alloc_list(AO2_ALLOC_OPT_LOCK_RWLOCK,
 		AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE, ao2_reg_sort_cb, NULL,
 		"Container registration container.");
@@ -1097,7 +1464,6 @@ int container_init(void)
 
 	ast_cli_register_multiple(cli_astobj2, ARRAY_LEN(cli_astobj2));
 	ast_register_cleanup(container_cleanup);
-#endif	/* defined(AO2_DEBUG) */
 
 	return 0;
 }
@@ -172,6 +172,97 @@ typedef void (*ao2_container_find_cleanup_fn)(void *v_state);
  */
 typedef struct ao2_container_node *(*ao2_iterator_next_fn)(struct ao2_container *self, struct ao2_container_node *prev, enum ao2_iterator_flags flags);
 
+/*!
+ * \brief Perform deferred maintenance on the container after unlinking objects.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is already write locked and no traversals
+ * or iterators are positioned in it.
+ *
+ * \return Nothing
+ */
+typedef void (*ao2_container_rehash_fn)(struct ao2_container *self);
+
+/*!
+ * \brief Find an object in the container without locking it.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param flags search_flags to control the search.
+ * \param cb_fn Comparison callback function.
+ * \param arg Comparison callback arg parameter.
+ * \param data Data comparison callback data parameter.
+ * \param type Type of comparison callback cb_fn.
+ * \param result Where to put the found object (Reffed unless OBJ_NODATA).
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ *
+ * \note Only called for searches by key or object that do not
+ * unlink and return at most one object.
+ *
+ * \retval 0 if the search was done.
+ * \retval -1 if the search must be done with the container locked.
+ */
+typedef int (*ao2_container_find_lockless_fn)(struct ao2_container *self,
+	enum search_flags flags, void *cb_fn, void *arg, void *data, enum ao2_callback_type type,
+	void **result, const char *tag, const char *file, int line, const char *func);
+
+/*!
+ * \brief An object was removed from a container node.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param node Container node the object was removed from.
+ *
+ * \note The container is already write locked.
+ *
+ * \return Nothing
+ */
+typedef void (*ao2_container_unlinked_node_fn)(struct ao2_container *self, struct ao2_container_node *node);
+
+/*!
+ * \brief Lock the container stripe holding the given key or object.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param flags OBJ_SEARCH_OBJECT or OBJ_SEARCH_KEY.
+ * \param arg Object or key to lock the stripe of.
+ *
+ * \note The container lock must not be held.
+ *
+ * \retval stripe Locked stripe number.
+ * \retval -1 if the operation must lock the whole container.
+ */
+typedef int (*ao2_container_stripe_lock_fn)(struct ao2_container *self,
+	enum search_flags flags, void *arg);
+
+/*!
+ * \brief Unlock a container stripe.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param stripe Stripe number returned by the stripe lock method.
+ *
+ * \return Nothing
+ */
+typedef void (*ao2_container_stripe_unlock_fn)(struct ao2_container *self, int stripe);
+
+/*!
+ * \brief Lock or unlock all stripes of the container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container lock must be held.
+ *
+ * \return Nothing
+ */
+typedef void (*ao2_container_stripes_fn)(struct ao2_container *self);
+
 /*!
  * \brief Display contents of the specified container.
  *
@@ -233,6 +324,45 @@ typedef void (*ao2_link_node_stat_fn)(struct ao2_container *container, struct ao
  */
 typedef void (*ao2_unlink_node_stat_fn)(struct ao2_container *container, struct ao2_container_node *node);
 
+/*!
+ * \internal
+ * \brief Get how the objects of the container are spread over its buckets.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param buckets Set to the number of buckets.
+ * \param used Set to the number of buckets holding objects.
+ * \param max_chain Set to the largest number of objects in a bucket.
+ *
+ * \note The container is already locked for reading.
+ *
+ * \return Nothing
+ */
+typedef void (*ao2_container_occupancy_fn)(struct ao2_container *self, int *buckets, int *used, int *max_chain);
+
+/*!
+ * \brief Container lock and search statistics.
+ *
+ * \note The counters are always kept, so they must stay cheap.  The
+ * time waiting for a lock is only measured when the lock is not
+ * immediately available, and the time holding it is only measured
+ * for one in every CONTAINER_HOLD_SAMPLE_RATE locks.
+ */
+struct ao2_container_lock_stats {
+	/*! Number of times the container or one of its stripes was locked. */
+	int locks;
+	/*! Number of times the lock was held by another thread. */
+	int contended;
+	/*! Number of hold times measured. */
+	int hold_samples;
+	/*! Number of searches and traversals of the container. */
+	int searches;
+	/*! Total time spent waiting for the lock in microseconds. */
+	uint64_t wait_us;
+	/*! Total time the lock was held by the measured locks in microseconds. */
+	uint64_t hold_us;
+};
+
 /*! Container virtual methods template. */
 struct ao2_container_methods {
 	/*! Destroy this container. */
@@ -251,6 +381,22 @@ struct ao2_container_methods {
 	ao2_container_find_cleanup_fn traverse_cleanup;
 	/*! Find the next iteration element in the container. */
 	ao2_iterator_next_fn iterator_next;
+	/*! Perform deferred maintenance after unlinking objects. (Optional) */
+	ao2_container_rehash_fn rehash;
+	/*! Find an object without locking the container. (Optional) */
+	ao2_container_find_lockless_fn find_lockless;
+	/*! An object was removed from a container node. (Optional) */
+	ao2_container_unlinked_node_fn unlinked_node;
+	/*! Lock the stripe holding a key or object. (Optional) */
+	ao2_container_stripe_lock_fn stripe_lock;
+	/*! Unlock a stripe locked by stripe_lock. (Optional) */
+	ao2_container_stripe_unlock_fn stripe_unlock;
+	/*! Lock all stripes after locking the container. (Optional) */
+	ao2_container_stripes_fn lock_stripes;
+	/*! Unlock all stripes before unlocking the container. (Optional) */
+	ao2_container_stripes_fn unlock_stripes;
+	/*! Get the bucket occupancy of the container. (Optional) */
+	ao2_container_occupancy_fn occupancy;
 #if defined(AO2_DEBUG)
 	/*! Increment the container linked object statistic. */
 	ao2_link_node_stat_fn link_stat;
@@ -290,6 +436,21 @@ struct ao2_container {
 	uint32_t options;
 	/*! Number of elements in the container. */
 	int elements;
+	/*!
+	 * \brief Number of traversals and iterators positioned in the container.
+	 *
+	 * \note Container nodes must not be moved while this is non-zero.
+	 */
+	int traversals;
+	/*!
+	 * \brief Bulk update sequence.  Odd while the contents are being replaced.
+	 *
+	 * \note Searches without the container lock are redone with the
+	 * lock if this changes while they do not find anything.
+	 */
+	volatile int bulk_seq;
+	/*! Lock and search statistics. */
+	struct ao2_container_lock_stats lock_stats;
 #if defined(AO2_DEBUG)
 	/*! Number of nodes in the container. */
 	int nodes;
@@ -326,6 +487,18 @@ int __container_unlink_node_debug(struct ao2_container_node *node, uint32_t flag
 	__container_unlink_node_debug(node, flags, NULL, __FILE__, __LINE__, __PRETTY_FUNCTION__)
 
 void container_destruct(void *_c);
+/*!
+ * \internal
+ * \brief Record that a container lock had to be waited for.
+ * \since 14.0.0
+ *
+ * \param self Container whose lock was contended.
+ * \param start When the thread started waiting for the lock.
+ *
+ * \return Nothing
+ */
+void container_lock_stat_wait(struct ao2_container *self, struct timeval start);
+
 int container_init(void);
 
 #endif /* ASTOBJ2_CONTAINER_PRIVATE_H_ */
@@ -0,0 +1,1090 @@
+/*
+ * astobj2_flat - Open addressing hash table implementation for astobj2.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Open addressing hash table functions implementing astobj2 containers.
+ *
+ * \details
+ * The nodes of a flat hash container are held in a single array of
+ * slots probed linearly from the slot the hash value of a key maps
+ * to.  Each slot keeps the full hash value of its node so a search
+ * only has to look at the nodes of objects with the same hash value.
+ *
+ * Container nodes must not move while a traversal or iterator is
+ * positioned in the container.  Objects linked while the slot array
+ * is too full to take them and the array cannot be resized go on an
+ * overflow list instead.  The array is resized and the overflow list
+ * emptied once the container is no longer being traversed.
+ */
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/_private.h"
+#include "asterisk/astobj2.h"
+#include "astobj2_private.h"
+#include "astobj2_container_private.h"
+#include "asterisk/dlinkedlists.h"
+#include "asterisk/utils.h"
+
+/*! Smallest number of slots in a flat hash container. */
+#define FLAT_MIN_SLOTS 8
+
+/*! Slot of a node that is on the overflow list. */
+#define FLAT_OVERFLOW_SLOT -1
+
+/*! A flat hash container node. */
+struct flat_node {
+	/*!
+	 * \brief Items common to all container nodes.
+	 * \note Must be first in the specific node struct.
+	 */
+	struct ao2_container_node common;
+	/*! Overflow list links.  Only used when the node is on the overflow list. */
+	AST_DLLIST_ENTRY(flat_node) links;
+	/*! Hash value of the object. */
+	unsigned int hash;
+	/*! Slot holding the node or FLAT_OVERFLOW_SLOT. */
+	int slot;
+};
+
+/*! A flat hash container slot. */
+struct flat_slot {
+	/*! Hash value of the node's object. */
+	unsigned int hash;
+	/*! Node in the slot, NULL if the slot was never used or flat_deleted if the node was removed. */
+	struct flat_node *node;
+};
+
+/*!
+ * \brief Node marking a slot whose node was removed.
+ *
+ * \details
+ * Searches have to continue probing past a removed node since the
+ * node they are looking for may have been put in a later slot.
+ */
+static struct flat_node flat_deleted;
+
+/*!
+ * A flat hash container in addition to values common to all
+ * container types, stores the hash callback function and the
+ * array of slots.
+ */
+struct ao2_container_flat {
+	/*!
+	 * \brief Items common to all containers.
+	 * \note Must be first in the specific container struct.
+	 */
+	struct ao2_container common;
+	ao2_hash_fn *hash_fn;
+	/*! Number of slots.  Always a power of two. */
+	int n_slots;
+	/*! Number of slots holding a node or marked as removed. */
+	int used_slots;
+	/*! Requested number of slots.  The container does not shrink below it. */
+	int min_slots;
+	/*! Slot array of n_slots. */
+	struct flat_slot *slots;
+	/*! Nodes linked while the slot array could not take them. */
+	AST_DLLIST_HEAD_NOLOCK(, flat_node) overflow;
+};
+
+/*! Traversal state to restart a flat hash container traversal. */
+struct flat_traversal_state {
+	/*! Active sort function in the traversal if not NULL. */
+	ao2_sort_fn *sort_fn;
+	/*! Saved comparison callback arg pointer. */
+	void *arg;
+	/*! Saved search flags to control traversing the container. */
+	enum search_flags flags;
+	/*! Hash value of the search key. */
+	unsigned int hash;
+	/*! Slot the search key hashes to. */
+	int home;
+	/*! TRUE if only the nodes with the hash value of the search key are visited. */
+	unsigned int hashed:1;
+	/*! TRUE if it is a descending search */
+	unsigned int descending:1;
+};
+
+struct flat_traversal_state_check {
+	/*
+	 * If we have a division by zero compile error here then there
+	 * is not enough room for the state.  Increase AO2_TRAVERSAL_STATE_SIZE.
+	 */
+	char check[1 / (AO2_TRAVERSAL_STATE_SIZE / sizeof(struct flat_traversal_state))];
+};
+
+/*!
+ * \internal
+ * \brief Get the slot a hash value maps to.
+ * \since 14.0.0
+ *
+ * \param n_slots Number of slots.  Must be a power of two.
+ * \param hash Hash value.
+ *
+ * \details
+ * The hash value is scrambled first since many hash functions
+ * return small or sequential values.
+ *
+ * \return Slot number.
+ */
+static int flat_home_slot(int n_slots, unsigned int hash)
+{
+	return (hash * 2654435761U) & (n_slots - 1);
+}
+
+/*!
+ * \internal
+ * \brief Determine if a slot holds a node.
+ * \since 14.0.0
+ */
+static int flat_slot_has_node(const struct flat_slot *slot)
+{
+	return slot->node && slot->node != &flat_deleted;
+}
+
+/*!
+ * \internal
+ * \brief Create an empty copy of this container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ *
+ * \retval empty-clone-container on success.
+ * \retval NULL on error.
+ */
+static struct ao2_container *flat_ao2_alloc_empty_clone(struct ao2_container_flat *self,
+	const char *tag, const char *file, int line, const char *func)
+{
+	if (!__is_ao2_object(self, file, line, func)) {
+		return NULL;
+	}
+
+	return __ao2_container_alloc_flat(ao2_options_get(self), self->common.options,
+		self->min_slots, self->hash_fn, self->common.sort_fn, self->common.cmp_fn,
+		tag, file, line, func);
+}
+
+/*!
+ * \internal
+ * \brief Destroy a flat hash container node.
+ * \since 14.0.0
+ *
+ * \param v_doomed Container node to destroy.
+ *
+ * \details
+ * The container node removes itself from its slot as part of its
+ * destruction.  The slot is marked as removed so searches still
+ * probe past it.
+ *
+ * \note The container must be locked when the node is
+ * unreferenced.
+ *
+ * \return Nothing
+ */
+static void flat_ao2_node_destructor(void *v_doomed)
+{
+	struct flat_node *doomed = v_doomed;
+
+	if (doomed->common.is_linked) {
+		struct ao2_container_flat *my_container;
+
+		/*
+		 * Promote to write lock if not already there.  Since
+		 * adjust_lock() can potentially release and block waiting for a
+		 * write lock, care must be taken to ensure that node references
+		 * are released before releasing the container references.
+		 *
+		 * Node references held by an iterator can only be held while
+		 * the iterator also holds a reference to the container.  These
+		 * node references must be unreferenced before the container can
+		 * be unreferenced to ensure that the node will not get a
+		 * negative reference and the destructor called twice for the
+		 * same node.
+		 */
+		my_container = (struct ao2_container_flat *) doomed->common.my_container;
+		ast_assert(is_ao2_object(my_container));
+
+		__adjust_lock(my_container, AO2_LOCK_REQ_WRLOCK, 1);
+
+#if defined(AO2_DEBUG)
+		if (!my_container->common.destroying
+			&& ao2_container_check(doomed->common.my_container, OBJ_NOLOCK)) {
+			ast_log(LOG_ERROR, "Container integrity failed before node deletion.\n");
+		}
+#endif	/* defined(AO2_DEBUG) */
+		if (doomed->slot == FLAT_OVERFLOW_SLOT) {
+			AST_DLLIST_REMOVE(&my_container->overflow, doomed, links);
+		} else {
+			my_container->slots[doomed->slot].node = &flat_deleted;
+		}
+		AO2_DEVMODE_STAT(--my_container->common.nodes);
+	}
+
+	/*
+	 * We could have an object in the node if the container is being
+	 * destroyed or the node had not been linked in yet.
+	 */
+	if (doomed->common.obj) {
+		__container_unlink_node(&doomed->common, AO2_UNLINK_NODE_UNLINK_OBJECT);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Create a new container node.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param obj_new Object to put into the node.
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ *
+ * \retval initialized-node on success.
+ * \retval NULL on error.
+ */
+static struct flat_node *flat_ao2_new_node(struct ao2_container_flat *self, void *obj_new, const char *tag, const char *file, int line, const char *func)
+{
+	struct flat_node *node;
+
+	node = ao2_t_alloc_options(sizeof(*node), flat_ao2_node_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK, NULL);
+	if (!node) {
+		return NULL;
+	}
+
+	__ao2_ref(obj_new, +1, tag ?: "Container node creation", file, line, func);
+	node->common.obj = obj_new;
+	node->common.my_container = (struct ao2_container *) self;
+	node->hash = self->hash_fn(obj_new, OBJ_SEARCH_OBJECT);
+	node->slot = FLAT_OVERFLOW_SLOT;
+
+	return node;
+}
+
+/*!
+ * \internal
+ * \brief Put a node into the first free slot of its probe sequence.
+ * \since 14.0.0
+ *
+ * \param slots Slot array.
+ * \param n_slots Number of slots.
+ * \param node Node to put into the slot array.
+ *
+ * \note A slot marked as removed is only reused when the array is
+ * rebuilt so searches positioned in the array are not disturbed.
+ *
+ * \retval 0 on success.
+ * \retval -1 if there are no free slots.
+ */
+static int flat_place_node(struct flat_slot *slots, int n_slots, struct flat_node *node)
+{
+	int idx;
+	int probes;
+
+	idx = flat_home_slot(n_slots, node->hash);
+	for (probes = 0; probes < n_slots; ++probes) {
+		if (!slots[idx].node) {
+			slots[idx].hash = node->hash;
+			slots[idx].node = node;
+			node->slot = idx;
+			return 0;
+		}
+		idx = (idx + 1) & (n_slots - 1);
+	}
+	return -1;
+}
+
+/*!
+ * \internal
+ * \brief Rebuild the slot array to fit the linked nodes.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \details
+ * Drops the slots marked as removed, resizes the array so it is at
+ * most half full and moves the nodes on the overflow list into it.
+ * The container is left as it was if memory cannot be allocated.
+ *
+ * \note The container must be write locked and not being traversed.
+ *
+ * \return Nothing
+ */
+static void flat_ao2_rebuild(struct ao2_container_flat *self)
+{
+	struct flat_slot *slots;
+	struct flat_node *node;
+	int n_slots;
+	int idx;
+
+	n_slots = self->min_slots;
+	while (n_slots < self->common.elements * 2 + 2) {
+		n_slots *= 2;
+	}
+
+	slots = ast_calloc(n_slots, sizeof(*slots));
+	if (!slots) {
+		return;
+	}
+
+	self->used_slots = 0;
+	for (idx = 0; idx < self->n_slots; ++idx) {
+		if (flat_slot_has_node(&self->slots[idx])) {
+			flat_place_node(slots, n_slots, self->slots[idx].node);
+			++self->used_slots;
+		}
+	}
+	while ((node = AST_DLLIST_REMOVE_HEAD(&self->overflow, links))) {
+		flat_place_node(slots, n_slots, node);
+		++self->used_slots;
+	}
+
+	ast_free(self->slots);
+	self->slots = slots;
+	self->n_slots = n_slots;
+}
+
+/*!
+ * \internal
+ * \brief Determine if the slot array is too full to take another node.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \retval non-zero if the array is more than three quarters used.
+ */
+static int flat_ao2_too_full(struct ao2_container_flat *self)
+{
+	return self->n_slots * 3 < (self->used_slots + 1) * 4;
+}
+
+/*!
+ * \internal
+ * \brief Let the container do deferred maintenance after unlinking objects.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \details
+ * Rebuilds the slot array if nodes are waiting on the overflow list,
+ * a quarter of the slots are marked as removed, or the array has
+ * become much larger than needed.
+ *
+ * \note The container must be write locked and not being traversed.
+ *
+ * \return Nothing
+ */
+static void flat_ao2_rehash(struct ao2_container_flat *self)
+{
+	if (!AST_DLLIST_EMPTY(&self->overflow)
+		|| self->n_slots < (self->used_slots - self->common.elements) * 4
+		|| (self->min_slots < self->n_slots && self->common.elements * 8 < self->n_slots)) {
+		flat_ao2_rebuild(self);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Find the node of an object with the same key as a new node.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param node New container node.
+ *
+ * \retval node-ptr of the node with the same key.
+ * \retval NULL if there is none.
+ */
+static struct flat_node *flat_ao2_find_dup(struct ao2_container_flat *self,
+	struct flat_node *node)
+{
+	ao2_sort_fn *sort_fn = self->common.sort_fn;
+	uint32_t options = self->common.options;
+	struct flat_slot *slot;
+	struct flat_node *cur;
+	int idx;
+	int probes;
+
+	idx = flat_home_slot(self->n_slots, node->hash);
+	for (probes = 0; probes < self->n_slots; ++probes) {
+		slot = &self->slots[idx];
+		if (!slot->node) {
+			break;
+		}
+		if (slot->hash == node->hash && slot->node != &flat_deleted) {
+			cur = slot->node;
+			if (cur->common.obj
+				&& !sort_fn(cur->common.obj, node->common.obj, OBJ_SEARCH_OBJECT)
+				&& ((options & AO2_CONTAINER_ALLOC_OPT_DUPS_MASK) != AO2_CONTAINER_ALLOC_OPT_DUPS_OBJ_REJECT
+					|| cur->common.obj == node->common.obj)) {
+				return cur;
+			}
+		}
+		idx = (idx + 1) & (self->n_slots - 1);
+	}
+
+	AST_DLLIST_TRAVERSE(&self->overflow, cur, links) {
+		if (cur->hash == node->hash
+			&& cur->common.obj
+			&& !sort_fn(cur->common.obj, node->common.obj, OBJ_SEARCH_OBJECT)
+			&& ((options & AO2_CONTAINER_ALLOC_OPT_DUPS_MASK) != AO2_CONTAINER_ALLOC_OPT_DUPS_OBJ_REJECT
+				|| cur->common.obj == node->common.obj)) {
+			return cur;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Insert a node into this container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param node Container node to insert into the container.
+ *
+ * \return enum ao2_container_insert value.
+ */
+static enum ao2_container_insert flat_ao2_insert_node(struct ao2_container_flat *self,
+	struct flat_node *node)
+{
+	struct flat_node *cur;
+
+	if (self->common.sort_fn
+		&& (self->common.options & AO2_CONTAINER_ALLOC_OPT_DUPS_MASK) != AO2_CONTAINER_ALLOC_OPT_DUPS_ALLOW) {
+		cur = flat_ao2_find_dup(self, node);
+		if (cur) {
+			switch (self->common.options & AO2_CONTAINER_ALLOC_OPT_DUPS_MASK) {
+			case AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE:
+				SWAP(cur->common.obj, node->common.obj);
+				ao2_t_ref(node, -1, "Discard the new node.");
+				return AO2_CONTAINER_INSERT_NODE_OBJ_REPLACED;
+			default:
+				/* Reject objects with the same key or the same object. */
+				return AO2_CONTAINER_INSERT_NODE_REJECTED;
+			}
+		}
+	}
+
+	if ((flat_ao2_too_full(self) || !AST_DLLIST_EMPTY(&self->overflow))
+		&& !self->common.traversals) {
+		flat_ao2_rebuild(self);
+	}
+	if (flat_ao2_too_full(self) || flat_place_node(self->slots, self->n_slots, node)) {
+		/* The slots cannot be rearranged while the container is traversed. */
+		node->slot = FLAT_OVERFLOW_SLOT;
+		AST_DLLIST_INSERT_TAIL(&self->overflow, node, links);
+	} else {
+		++self->used_slots;
+	}
+
+	return AO2_CONTAINER_INSERT_NODE_INSERTED;
+}
+
+/*!
+ * \internal
+ * \brief Determine if a node is visited by a traversal.
+ * \since 14.0.0
+ *
+ * \param state Traversal state.
+ * \param node Node to check.
+ *
+ * \retval non-zero if the node is to be visited.
+ */
+static int flat_ao2_visit(struct flat_traversal_state *state, struct flat_node *node)
+{
+	if (!node->common.obj) {
+		/* Node is empty */
+		return 0;
+	}
+	if (state->hashed && node->hash != state->hash) {
+		return 0;
+	}
+	if (state->sort_fn
+		&& state->sort_fn(node->common.obj, state->arg, state->flags & OBJ_SEARCH_MASK)) {
+		/* Filter node through the sort_fn */
+		return 0;
+	}
+	return 1;
+}
+
+/*!
+ * \internal
+ * \brief Find the next node visited by a traversal.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param state Traversal state.
+ * \param prev Previous node visited.  NULL to start the traversal.
+ *
+ * \details
+ * A hashed traversal probes the slots from the home slot of the
+ * search key and then looks through the overflow list.  Other
+ * traversals visit every slot and then the overflow list, in reverse
+ * if descending.
+ *
+ * \return the next node (not reffed) or NULL.
+ */
+static struct flat_node *flat_ao2_visit_next(struct ao2_container_flat *self,
+	struct flat_traversal_state *state, struct flat_node *prev)
+{
+	struct flat_node *node;
+	int mask = self->n_slots - 1;
+	int idx;
+	int probes;
+
+	if (state->hashed) {
+		if (!prev) {
+			idx = state->home;
+			probes = 0;
+		} else if (prev->slot != FLAT_OVERFLOW_SLOT) {
+			idx = (prev->slot + 1) & mask;
+			probes = ((prev->slot - state->home) & mask) + 1;
+		} else {
+			node = prev;
+			goto hashed_overflow;
+		}
+		for (; probes < self->n_slots; ++probes) {
+			if (!self->slots[idx].node) {
+				break;
+			}
+			if (self->slots[idx].hash == state->hash
+				&& self->slots[idx].node != &flat_deleted
+				&& flat_ao2_visit(state, self->slots[idx].node)) {
+				return self->slots[idx].node;
+			}
+			idx = (idx + 1) & mask;
+		}
+		node = NULL;
+
+hashed_overflow:
+		for (node = node ? AST_DLLIST_NEXT(node, links) : AST_DLLIST_FIRST(&self->overflow);
+			node;
+			node = AST_DLLIST_NEXT(node, links)) {
+			if (flat_ao2_visit(state, node)) {
+				return node;
+			}
+		}
+		return NULL;
+	}
+
+	if (state->descending) {
+		if (!prev) {
+			node = AST_DLLIST_LAST(&self->overflow);
+			idx = self->n_slots;
+		} else if (prev->slot == FLAT_OVERFLOW_SLOT) {
+			node = AST_DLLIST_PREV(prev, links);
+			idx = self->n_slots;
+		} else {
+			node = NULL;
+			idx = prev->slot;
+		}
+		for (; node; node = AST_DLLIST_PREV(node, links)) {
+			if (flat_ao2_visit(state, node)) {
+				return node;
+			}
+		}
+		while (0 <= --idx) {
+			if (flat_slot_has_node(&self->slots[idx])
+				&& flat_ao2_visit(state, self->slots[idx].node)) {
+				return self->slots[idx].node;
+			}
+		}
+		return NULL;
+	}
+
+	if (!prev) {
+		idx = -1;
+	} else if (prev->slot == FLAT_OVERFLOW_SLOT) {
+		node = prev;
+		goto ascending_overflow;
+	} else {
+		idx = prev->slot;
+	}
+	while (++idx < self->n_slots) {
+		if (flat_slot_has_node(&self->slots[idx])
+			&& flat_ao2_visit(state, self->slots[idx].node)) {
+			return self->slots[idx].node;
+		}
+	}
+	node = NULL;
+
+ascending_overflow:
+	for (node = node ? AST_DLLIST_NEXT(node, links) : AST_DLLIST_FIRST(&self->overflow);
+		node;
+		node = AST_DLLIST_NEXT(node, links)) {
+		if (flat_ao2_visit(state, node)) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Find the first flat hash container node in a traversal.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param flags search_flags to control traversing the container
+ * \param arg Comparison callback arg parameter.
+ * \param state Traversal state to restart flat hash container traversal.
+ *
+ * \retval node-ptr of found node (Reffed).
+ * \retval NULL when no node found.
+ */
+static struct flat_node *flat_ao2_find_first(struct ao2_container_flat *self, enum search_flags flags, void *arg, struct flat_traversal_state *state)
+{
+	struct flat_node *node;
+
+	memset(state, 0, sizeof(*state));
+	state->arg = arg;
+	state->flags = flags;
+
+	/* Determine traversal order. */
+	switch (flags & OBJ_ORDER_MASK) {
+	case OBJ_ORDER_POST:
+	case OBJ_ORDER_DESCENDING:
+		state->descending = 1;
+		break;
+	case OBJ_ORDER_PRE:
+	case OBJ_ORDER_ASCENDING:
+	default:
+		break;
+	}
+
+	/*
+	 * If lookup by pointer or search key, run the hash and optional
+	 * sort functions.  Otherwise, traverse the whole container.
+	 */
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+	case OBJ_SEARCH_KEY:
+		state->hash = self->hash_fn(arg, flags & OBJ_SEARCH_MASK);
+		state->home = flat_home_slot(self->n_slots, state->hash);
+		state->hashed = 1;
+		state->sort_fn = self->common.sort_fn;
+		break;
+	case OBJ_SEARCH_PARTIAL_KEY:
+		/* scan all slots for partial key matches */
+		state->sort_fn = self->common.sort_fn;
+		break;
+	default:
+		/* don't know, let's scan all slots */
+		break;
+	}
+
+	node = flat_ao2_visit_next(self, state, NULL);
+	if (node) {
+		/* We have the first traversal node */
+		ao2_t_ref(node, +1, NULL);
+	}
+	return node;
+}
+
+/*!
+ * \internal
+ * \brief Find the next flat hash container node in a traversal.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param state Traversal state to restart flat hash container traversal.
+ * \param prev Previous node returned by the traversal search functions.
+ *    The ref ownership is passed back to this function.
+ *
+ * \retval node-ptr of found node (Reffed).
+ * \retval NULL when no node found.
+ */
+static struct flat_node *flat_ao2_find_next(struct ao2_container_flat *self, struct flat_traversal_state *state, struct flat_node *prev)
+{
+	struct flat_node *node;
+
+	for (;;) {
+		node = flat_ao2_visit_next(self, state, prev);
+		if (!node) {
+			break;
+		}
+
+		/* We have the next traversal node */
+		ao2_t_ref(node, +1, NULL);
+
+		/*
+		 * Dereferencing the prev node may result in our next node
+		 * object being removed by another thread.  This could happen if
+		 * the container uses RW locks and the container was read
+		 * locked.
+		 */
+		ao2_t_ref(prev, -1, NULL);
+		if (node->common.obj) {
+			return node;
+		}
+		prev = node;
+	}
+
+	/* No more nodes in the container left to traverse. */
+	ao2_t_ref(prev, -1, NULL);
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Find the next non-empty iteration node in the container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param node Previous node returned by the iterator.
+ * \param flags search_flags to control iterating the container.
+ *   Only AO2_ITERATOR_DESCENDING is useful by the method.
+ *
+ * \note The container is already locked.
+ *
+ * \retval node on success.
+ * \retval NULL on error or no more nodes in the container.
+ */
+static struct flat_node *flat_ao2_iterator_next(struct ao2_container_flat *self, struct flat_node *node, enum ao2_iterator_flags flags)
+{
+	struct flat_traversal_state state;
+
+	memset(&state, 0, sizeof(state));
+	state.descending = (flags & AO2_ITERATOR_DESCENDING) ? 1 : 0;
+	return flat_ao2_visit_next(self, &state, node);
+}
+
+/*!
+ * \internal
+ * \brief Get how the objects of the flat hash container are spread over its slots.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param buckets Set to the number of slots.
+ * \param used Set to the number of slots holding objects.
+ * \param max_chain Set to the longest probe sequence needed to find an object.
+ *
+ * \note The container is already locked for reading.
+ *
+ * \return Nothing
+ */
+static void flat_ao2_occupancy(struct ao2_container_flat *self, int *buckets, int *used, int *max_chain)
+{
+	int idx;
+	int probes;
+
+	*buckets = self->n_slots;
+	*used = 0;
+	*max_chain = 0;
+	for (idx = 0; idx < self->n_slots; ++idx) {
+		if (!flat_slot_has_node(&self->slots[idx]) || !self->slots[idx].node->common.obj) {
+			continue;
+		}
+		++*used;
+		probes = ((idx - flat_home_slot(self->n_slots, self->slots[idx].hash))
+			& (self->n_slots - 1)) + 1;
+		if (*max_chain < probes) {
+			*max_chain = probes;
+		}
+	}
+}
+
+/*!
+ * \internal
+ *
+ * \brief Destroy this container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \return Nothing
+ */
+static void flat_ao2_destroy(struct ao2_container_flat *self)
+{
+	int idx;
+
+	/* Check that the container no longer has any nodes */
+	for (idx = self->n_slots; idx--;) {
+		if (flat_slot_has_node(&self->slots[idx])) {
+			ast_log(LOG_ERROR, "Node ref leak.  Flat hash container still has nodes!\n");
+			ast_assert(0);
+			break;
+		}
+	}
+	if (!AST_DLLIST_EMPTY(&self->overflow)) {
+		ast_log(LOG_ERROR, "Node ref leak.  Flat hash container still has overflow nodes!\n");
+		ast_assert(0);
+	}
+	ast_free(self->slots);
+	self->slots = NULL;
+}
+
+#if defined(AO2_DEBUG)
+/*!
+ * \internal
+ * \brief Display contents of the specified container.
+ * \since 14.0.0
+ *
+ * \param self Container to dump.
+ * \param where User data needed by prnt to determine where to put output.
+ * \param prnt Print output callback function to use.
+ * \param prnt_obj Callback function to print the given object's key. (NULL if not available)
+ *
+ * \return Nothing
+ */
+static void flat_ao2_dump(struct ao2_container_flat *self, void *where, ao2_prnt_fn *prnt, ao2_prnt_obj_fn *prnt_obj)
+{
+#define FORMAT  "%6s, %16s, %10s, %16s, %s\n"
+#define FORMAT2 "%6d, %16p, %10u, %16p, "
+
+	struct flat_node *node;
+	int idx;
+	int suppressed_slots = 0;
+
+	prnt(where, "Number of slots: %d\n\n", self->n_slots);
+
+	prnt(where, FORMAT, "Slot", "Node", "Hash", "Obj", "Key");
+	for (idx = 0; idx < self->n_slots; ++idx) {
+		if (!flat_slot_has_node(&self->slots[idx])) {
+			if (!suppressed_slots) {
+				suppressed_slots = 1;
+				prnt(where, "...\n");
+			}
+			continue;
+		}
+		suppressed_slots = 0;
+		node = self->slots[idx].node;
+		prnt(where, FORMAT2, idx, node, node->hash, node->common.obj);
+		if (node->common.obj && prnt_obj) {
+			prnt_obj(node->common.obj, where, prnt);
+		}
+		prnt(where, "\n");
+	}
+	AST_DLLIST_TRAVERSE(&self->overflow, node, links) {
+		prnt(where, FORMAT2, FLAT_OVERFLOW_SLOT, node, node->hash, node->common.obj);
+		if (node->common.obj && prnt_obj) {
+			prnt_obj(node->common.obj, where, prnt);
+		}
+		prnt(where, "\n");
+	}
+
+#undef FORMAT
+#undef FORMAT2
+}
+#endif	/* defined(AO2_DEBUG) */
+
+#if defined(AO2_DEBUG)
+/*!
+ * \internal
+ * \brief Display statistics of the specified container.
+ * \since 14.0.0
+ *
+ * \param self Container to display statistics.
+ * \param where User data needed by prnt to determine where to put output.
+ * \param prnt Print output callback function to use.
+ *
+ * \note The container is already locked for reading.
+ *
+ * \return Nothing
+ */
+static void flat_ao2_stats(struct ao2_container_flat *self, void *where, ao2_prnt_fn *prnt)
+{
+	struct flat_node *node;
+	int overflow = 0;
+
+	AST_DLLIST_TRAVERSE(&self->overflow, node, links) {
+		++overflow;
+	}
+	prnt(where, "Number of slots: %d\n", self->n_slots);
+	prnt(where, "Used slots: %d\n", self->used_slots);
+	prnt(where, "Overflow nodes: %d\n", overflow);
+}
+#endif	/* defined(AO2_DEBUG) */
+
+#if defined(AO2_DEBUG)
+/*!
+ * \internal
+ * \brief Perform an integrity check on the specified container.
+ * \since 14.0.0
+ *
+ * \param self Container to check integrity.
+ *
+ * \note The container is already locked for reading.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int flat_ao2_integrity(struct ao2_container_flat *self)
+{
+	struct flat_node *node;
+	int count_total_obj = 0;
+	int count_total_node = 0;
+	int count_used = 0;
+	int idx;
+	int home;
+
+	for (idx = 0; idx < self->n_slots; ++idx) {
+		if (!self->slots[idx].node) {
+			continue;
+		}
+		++count_used;
+		if (self->slots[idx].node == &flat_deleted) {
+			continue;
+		}
+		node = self->slots[idx].node;
+		if (node->slot != idx) {
+			ast_log(LOG_ERROR, "Slot %d node claims to be in slot %d!\n", idx, node->slot);
+			return -1;
+		}
+		if (node->hash != self->slots[idx].hash) {
+			ast_log(LOG_ERROR, "Slot %d hash does not match its node!\n", idx);
+			return -1;
+		}
+
+		/* Every slot from the home slot must be in use or searches miss the node. */
+		for (home = flat_home_slot(self->n_slots, node->hash); home != idx;
+			home = (home + 1) & (self->n_slots - 1)) {
+			if (!self->slots[home].node) {
+				ast_log(LOG_ERROR, "Slot %d node cannot be found from its home slot!\n", idx);
+				return -1;
+			}
+		}
+
+		++count_total_node;
+		if (!node->common.obj) {
+			/* Node is empty. */
+			continue;
+		}
+		++count_total_obj;
+		if (node->hash != self->hash_fn(node->common.obj, OBJ_SEARCH_OBJECT)) {
+			ast_log(LOG_ERROR, "Slot %d object hash changed!\n", idx);
+			return -1;
+		}
+	}
+	AST_DLLIST_TRAVERSE(&self->overflow, node, links) {
+		if (node->slot != FLAT_OVERFLOW_SLOT) {
+			ast_log(LOG_ERROR, "Overflow node claims to be in slot %d!\n", node->slot);
+			return -1;
+		}
+		++count_total_node;
+		if (node->common.obj) {
+			++count_total_obj;
+		}
+	}
+
+	if (count_used != self->used_slots) {
+		ast_log(LOG_ERROR, "Used slot count of %d does not match stat of %d!\n",
+			count_used, self->used_slots);
+		return -1;
+	}
+
+	/* Check total obj count. */
+	if (count_total_obj != ao2_container_count(&self->common)) {
+		ast_log(LOG_ERROR,
+			"Total object count of %d does not match ao2_container_count() of %d!\n",
+			count_total_obj, ao2_container_count(&self->common));
+		return -1;
+	}
+
+	/* Check total node count. */
+	if (count_total_node != self->common.nodes) {
+		ast_log(LOG_ERROR, "Total node count of %d does not match stat of %d!\n",
+			count_total_node, self->common.nodes);
+		return -1;
+	}
+
+	return 0;
+}
+#endif	/* defined(AO2_DEBUG) */
+
+/*! Flat hash container virtual method table. */
+static const struct ao2_container_methods v_table_flat = {
+	.alloc_empty_clone = (ao2_container_alloc_empty_clone_fn) flat_ao2_alloc_empty_clone,
+	.new_node = (ao2_container_new_node_fn) flat_ao2_new_node,
+	.insert = (ao2_container_insert_fn) flat_ao2_insert_node,
+	.traverse_first = (ao2_container_find_first_fn) flat_ao2_find_first,
+	.traverse_next = (ao2_container_find_next_fn) flat_ao2_find_next,
+	.iterator_next = (ao2_iterator_next_fn) flat_ao2_iterator_next,
+	.rehash = (ao2_container_rehash_fn) flat_ao2_rehash,
+	.occupancy = (ao2_container_occupancy_fn) flat_ao2_occupancy,
+	.destroy = (ao2_container_destroy_fn) flat_ao2_destroy,
+#if defined(AO2_DEBUG)
+	.dump = (ao2_container_display) flat_ao2_dump,
+	.stats = (ao2_container_statistics) flat_ao2_stats,
+	.integrity = (ao2_container_integrity) flat_ao2_integrity,
+#endif	/* defined(AO2_DEBUG) */
+};
+
+/*!
+ * \brief always zero hash function
+ *
+ * \returns 0
+ */
+static int flat_hash_zero(const void *user_obj, const int flags)
+{
+	return 0;
+}
+
+struct ao2_container *__ao2_container_alloc_flat(unsigned int ao2_options,
+	unsigned int container_options, unsigned int n_slots, ao2_hash_fn *hash_fn,
+	ao2_sort_fn *sort_fn, ao2_callback_fn *cmp_fn,
+	const char *tag, const char *file, int line, const char *func)
+{
+	struct ao2_container_flat *self;
+	int min_slots;
+
+	/* Hash containers are the only ones that know these options. */
+	container_options &= ~(AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE
+		| AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND
+		| AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED);
+
+	/* Room for n_slots objects without resizing. */
+	min_slots = FLAT_MIN_SLOTS;
+	while (min_slots < (1 << 30) && (unsigned int) min_slots / 2 < n_slots) {
+		min_slots *= 2;
+	}
+
+	self = __ao2_alloc(sizeof(*self), container_destruct, ao2_options,
+		tag ?: __PRETTY_FUNCTION__, file, line, func);
+	if (!self) {
+		return NULL;
+	}
+
+	self->common.v_table = &v_table_flat;
+	self->common.sort_fn = sort_fn;
+	self->common.cmp_fn = cmp_fn;
+	self->common.options = container_options;
+	self->hash_fn = hash_fn ? hash_fn : flat_hash_zero;
+	self->min_slots = min_slots;
+
+#ifdef AO2_DEBUG
+	ast_atomic_fetchadd_int(&ao2.total_containers, 1);
+#endif	/* defined(AO2_DEBUG) */
+
+	self->slots = ast_calloc(min_slots, sizeof(*self->slots));
+	if (!self->slots) {
+		ao2_t_ref(self, -1, "Failed to allocate flat hash container slots");
+		return NULL;
+	}
+	self->n_slots = min_slots;
+
+	return (struct ao2_container *) self;
+}
@@ -30,6 +30,7 @@ ASTERISK_REGISTER_FILE()
 #include "astobj2_private.h"
 #include "astobj2_container_private.h"
 #include "asterisk/dlinkedlists.h"
+#include "asterisk/linkedlists.h"
 #include "asterisk/utils.h"
 
 /*!
@@ -46,6 +47,8 @@ struct hash_bucket_node {
 	AST_DLLIST_ENTRY(hash_bucket_node) links;
 	/*! Hash bucket holding the node. */
 	int my_bucket;
+	/*! Hash value of the object held by the node. */
+	int hash;
 };
 
 struct hash_bucket {
@@ -59,10 +62,85 @@ struct hash_bucket {
 #endif	/* defined(AO2_DEBUG) */
 };
 
+/*!
+ * Header of memory that lockless searches may still be using.
+ *
+ * \details
+ * Memory replaced while lockless searches may be reading it is
+ * released once every search that could have seen it has finished.
+ */
+struct hash_retired {
+	/*! Next retired memory of the container. */
+	struct hash_retired *next;
+	/*! Value of the reader epoch when the memory was retired. */
+	int epoch;
+	/*! Release the memory. */
+	void (*release)(struct hash_retired *doomed);
+};
+
+/*! Objects of a hash bucket published for lockless searches. */
+struct hash_snapshot {
+	/*!
+	 * \brief Retired memory header.
+	 * \note Must be first in the struct.
+	 */
+	struct hash_retired retired;
+	/*! Number of objects in the snapshot. */
+	int count;
+	/*! Objects of the bucket in bucket order.  The snapshot holds a ref to each one. */
+	void *objs[0];
+};
+
+/*! Bucket snapshots of a hash container published for lockless searches. */
+struct hash_lockless_table {
+	/*!
+	 * \brief Retired memory header.
+	 * \note Must be first in the struct.
+	 */
+	struct hash_retired retired;
+	/*! Number of hash buckets in the container. */
+	int n_buckets;
+	/*! Number of hash buckets being rehashed from.  Zero if not rehashing. */
+	int old_n_buckets;
+	/*! Number of bucket snapshot slots. */
+	int n_slots;
+	/*! Snapshot of each hash bucket.  NULL if the bucket is empty.  Variable size. */
+	struct hash_snapshot *buckets[0];
+};
+
+/*! Number of old buckets migrated by each resizable container rehash step. */
+#define HASH_REHASH_STEP_BUCKETS	4
+
+/*! Grow a resizable container when it holds more objects per bucket than this. */
+#define HASH_GROW_LOAD	2
+
+/*! Shrink a resizable container when it holds fewer objects per bucket than 1/this. */
+#define HASH_SHRINK_LOAD	8
+
+/*! Number of bucket group locks of a striped container. */
+#define HASH_LOCK_STRIPES	16
+
 /*!
  * A hash container in addition to values common to all
  * container types, stores the hash callback function, the
  * number of hash buckets, and the hash bucket heads.
+ *
+ * \details
+ * A container allocated with AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE
+ * changes its number of buckets as objects are added and removed.
+ * The nodes are moved to the new buckets a few old buckets at a
+ * time by incremental rehash steps.  While a rehash is in progress
+ * an object whose old bucket has not been migrated yet still lives
+ * in its old bucket.  All other objects live in their new bucket.
+ * Objects with the same hash value are therefore always in the
+ * same bucket.
+ *
+ * A container allocated with AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED
+ * also has a lock for each group of buckets.  Linking, finding, and
+ * unlinking a single object by key only lock the stripe of its
+ * bucket.  Everything else locks the container and then all of the
+ * stripes in order.  The buckets are only rehashed while all of the
+ * stripes are locked.
  */
 struct ao2_container_hash {
 	/*!
@@ -73,8 +151,30 @@ struct ao2_container_hash {
 	ao2_hash_fn *hash_fn;
 	/*! Number of hash buckets in this container. */
 	int n_buckets;
-	/*! Hash bucket array of n_buckets.  Variable size. */
-	struct hash_bucket buckets[0];
+	/*! Number of hash buckets being rehashed from.  Zero if not rehashing. */
+	int old_n_buckets;
+	/*! Next old hash bucket to migrate when rehashing. */
+	int rehash_bucket;
+	/*! Requested number of hash buckets.  A resizable container does not shrink below it. */
+	int min_buckets;
+	/*! Number of hash buckets allocated in the buckets array. */
+	int allocated_buckets;
+	/*! Hash bucket array of allocated_buckets. */
+	struct hash_bucket *buckets;
+	/*! Bucket snapshots for lockless searches.  NULL if searches lock the container. */
+	struct hash_lockless_table *lockless;
+	/*! Memory waiting for lockless searches to finish with it. */
+	struct hash_retired *retired;
+	/*! Set when a stripe could not publish a bucket for lockless searches. */
+	volatile int lockless_stale;
+	/*! Bucket group locks.  NULL if the container is not striped. */
+	ast_mutex_t *stripes;
+	/*! Number of times the thread holding all of the stripes locked them. */
+	int stripes_exclusive;
+	/*! Protects the retired list of a striped container. */
+	ast_mutex_t retired_lock;
+	/*! Hash bucket array of a container that cannot be resized.  Variable size. */
+	struct hash_bucket fixed_buckets[0];
 };
 
 /*! Traversal state to restart a hash container traversal. */
@@ -93,13 +193,606 @@ struct hash_traversal_state {
 	unsigned int descending:1;
 };
 
-struct hash_traversal_state_check {
-	/*
-	 * If we have a division by zero compile error here then there
-	 * is not enough room for the state.  Increase AO2_TRAVERSAL_STATE_SIZE.
-	 */
-	char check[1 / (AO2_TRAVERSAL_STATE_SIZE / sizeof(struct hash_traversal_state))];
-};
+struct hash_traversal_state_check {
+	/*
+	 * If we have a division by zero compile error here then there
+	 * is not enough room for the state.  Increase AO2_TRAVERSAL_STATE_SIZE.
+	 */
+	char check[1 / (AO2_TRAVERSAL_STATE_SIZE / sizeof(struct hash_traversal_state))];
+};
+
+/*! A thread that searches containers without locking them. */
+struct hash_reader {
+	/*! Next registered reader thread. */
+	AST_LIST_ENTRY(hash_reader) list;
+	/*! Value of the reader epoch when the outermost lockless search started. */
+	volatile int epoch;
+	/*! Non-zero while the thread is doing a lockless search. */
+	volatile int active;
+	/*! Number of nested lockless searches by the thread. */
+	int nesting;
+};
+
+/*!
+ * \brief Reader epoch.
+ *
+ * \details
+ * Advanced every time memory is retired.  Retired memory can be
+ * released when every active reader started after it was retired.
+ */
+static volatile int hash_reader_epoch = 1;
+
+/*! Protects the registered reader threads list. */
+AST_MUTEX_DEFINE_STATIC(hash_readers_lock);
+
+/*! Threads that have done lockless searches. */
+static AST_LIST_HEAD_NOLOCK_STATIC(hash_readers, hash_reader);
+
+static int hash_reader_init(void *data)
+{
+	struct hash_reader *reader = data;
+
+	ast_mutex_lock(&hash_readers_lock);
+	AST_LIST_INSERT_HEAD(&hash_readers, reader, list);
+	ast_mutex_unlock(&hash_readers_lock);
+	return 0;
+}
+
+static void hash_reader_cleanup(void *data)
+{
+	struct hash_reader *reader = data;
+
+	ast_mutex_lock(&hash_readers_lock);
+	AST_LIST_REMOVE(&hash_readers, reader, list);
+	ast_mutex_unlock(&hash_readers_lock);
+	ast_free(reader);
+}
+
+/*! Lockless search state of each thread. */
+AST_THREADSTORAGE_CUSTOM(hash_reader_storage, hash_reader_init, hash_reader_cleanup);
+
+/*!
+ * \internal
+ * \brief Start a lockless search.
+ * \since 14.0.0
+ *
+ * \param reader Lockless search state of the calling thread.
+ *
+ * \return Nothing
+ */
+static void hash_reader_enter(struct hash_reader *reader)
+{
+	if (reader->nesting++) {
+		/* The outermost search already holds off releasing retired memory. */
+		return;
+	}
+	reader->epoch = hash_reader_epoch;
+	__sync_synchronize();
+	reader->active = 1;
+	/* Announce the search before reading anything published. */
+	__sync_synchronize();
+}
+
+/*!
+ * \internal
+ * \brief Finish a lockless search.
+ * \since 14.0.0
+ *
+ * \param reader Lockless search state of the calling thread.
+ *
+ * \return Nothing
+ */
+static void hash_reader_exit(struct hash_reader *reader)
+{
+	if (--reader->nesting) {
+		return;
+	}
+	__sync_synchronize();
+	reader->active = 0;
+}
+
+/*!
+ * \internal
+ * \brief Retire memory that lockless searches may still be using.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param doomed Memory no longer published for lockless searches.
+ *
+ * \note The container or the stripe of the bucket must be write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_retire(struct ao2_container_hash *self, struct hash_retired *doomed)
+{
+	/* The replacement must be visible before the epoch advances. */
+	__sync_synchronize();
+	doomed->epoch = ast_atomic_fetchadd_int(&hash_reader_epoch, +1);
+	if (self->stripes) {
+		ast_mutex_lock(&self->retired_lock);
+	}
+	doomed->next = self->retired;
+	self->retired = doomed;
+	if (self->stripes) {
+		ast_mutex_unlock(&self->retired_lock);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Release retired memory that no lockless search can be using.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container must be write locked unless it is striped.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_reclaim(struct ao2_container_hash *self)
+{
+	struct hash_retired **prev;
+	struct hash_retired *doomed;
+	struct hash_retired *released = NULL;
+	struct hash_reader *reader;
+	int oldest = 0;
+	int active = 0;
+
+	if (!self->retired) {
+		return;
+	}
+
+	/* Find the epoch of the oldest active search. */
+	ast_mutex_lock(&hash_readers_lock);
+	AST_LIST_TRAVERSE(&hash_readers, reader, list) {
+		if (reader->active
+			&& (!active || (int) ((unsigned int) reader->epoch - (unsigned int) oldest) < 0)) {
+			oldest = reader->epoch;
+			active = 1;
+		}
+	}
+	ast_mutex_unlock(&hash_readers_lock);
+
+	if (self->stripes) {
+		ast_mutex_lock(&self->retired_lock);
+	}
+	for (prev = &self->retired; (doomed = *prev);) {
+		if (active && (int) ((unsigned int) oldest - (unsigned int) doomed->epoch) <= 0) {
+			/* A search that started before this was retired is still active. */
+			prev = &doomed->next;
+			continue;
+		}
+		*prev = doomed->next;
+		doomed->next = released;
+		released = doomed;
+	}
+	if (self->stripes) {
+		ast_mutex_unlock(&self->retired_lock);
+	}
+
+	/* Releasing a snapshot can destroy objects so don't hold the list lock. */
+	while ((doomed = released)) {
+		released = doomed->next;
+		doomed->release(doomed);
+	}
+}
+
+static void hash_snapshot_release(struct hash_retired *doomed)
+{
+	struct hash_snapshot *snapshot = (struct hash_snapshot *) doomed;
+	int idx;
+
+	for (idx = 0; idx < snapshot->count; ++idx) {
+		ao2_t_ref(snapshot->objs[idx], -1, "Release lockless search snapshot");
+	}
+	ast_free(snapshot);
+}
+
+static void hash_lockless_table_release(struct hash_retired *doomed)
+{
+	ast_free(doomed);
+}
+
+/*!
+ * \internal
+ * \brief Stop publishing the container for lockless searches.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \details
+ * Called when the snapshots cannot be kept up to date.  Later
+ * searches lock the container.
+ *
+ * \note The container must be write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_lockless_disable(struct ao2_container_hash *self)
+{
+	struct hash_lockless_table *table = self->lockless;
+	int idx;
+
+	self->lockless = NULL;
+	for (idx = 0; idx < table->n_slots; ++idx) {
+		if (table->buckets[idx]) {
+			hash_ao2_retire(self, &table->buckets[idx]->retired);
+		}
+	}
+	hash_ao2_retire(self, &table->retired);
+}
+
+/*!
+ * \internal
+ * \brief Publish the objects of a hash bucket for lockless searches.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param idx Hash bucket that changed.
+ *
+ * \note The container must be write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_publish_bucket(struct ao2_container_hash *self, int idx)
+{
+	struct hash_lockless_table *table = self->lockless;
+	struct hash_snapshot *snapshot = NULL;
+	struct hash_snapshot *old;
+	struct hash_bucket_node *node;
+	int count = 0;
+
+	if (!table) {
+		return;
+	}
+
+	AST_DLLIST_TRAVERSE(&self->buckets[idx].list, node, links) {
+		if (node->common.obj) {
+			++count;
+		}
+	}
+	if (count) {
+		snapshot = ast_malloc(sizeof(*snapshot) + count * sizeof(snapshot->objs[0]));
+		if (!snapshot) {
+			if (self->stripes && !self->stripes_exclusive) {
+				/*
+				 * Other stripes may be publishing their buckets.  Searches
+				 * lock the container until all of the stripes are locked
+				 * to stop publishing.
+				 */
+				self->lockless_stale = 1;
+				__sync_synchronize();
+				return;
+			}
+			hash_ao2_lockless_disable(self);
+			return;
+		}
+		snapshot->retired.release = hash_snapshot_release;
+		snapshot->count = 0;
+		AST_DLLIST_TRAVERSE(&self->buckets[idx].list, node, links) {
+			if (node->common.obj) {
+				ao2_t_ref(node->common.obj, +1, "Lockless search snapshot");
+				snapshot->objs[snapshot->count++] = node->common.obj;
+			}
+		}
+	}
+
+	old = table->buckets[idx];
+	/* The snapshot must be complete before searches can see it. */
+	__sync_synchronize();
+	table->buckets[idx] = snapshot;
+	if (old) {
+		hash_ao2_retire(self, &old->retired);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Publish a new bucket layout of the container for lockless searches.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container must be write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_publish_layout(struct ao2_container_hash *self)
+{
+	struct hash_lockless_table *old = self->lockless;
+	struct hash_lockless_table *table;
+
+	if (!old) {
+		return;
+	}
+
+	table = ast_calloc(1, sizeof(*table) + self->allocated_buckets * sizeof(table->buckets[0]));
+	if (!table) {
+		hash_ao2_lockless_disable(self);
+		return;
+	}
+	table->retired.release = hash_lockless_table_release;
+	table->n_buckets = self->n_buckets;
+	table->old_n_buckets = self->old_n_buckets;
+	table->n_slots = self->allocated_buckets;
+	/* Any slots past the new number of slots are for empty buckets. */
+	memcpy(table->buckets, old->buckets,
+		MIN(old->n_slots, table->n_slots) * sizeof(table->buckets[0]));
+
+	/* The table must be complete before searches can see it. */
+	__sync_synchronize();
+	self->lockless = table;
+	hash_ao2_retire(self, &old->retired);
+}
+
+/*!
+ * \internal
+ * \brief Get the hash bucket holding objects with the given hash value.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param hash Hash value of the object.
+ *
+ * \return Hash bucket index.
+ */
+static int hash_ao2_bucket(struct ao2_container_hash *self, int hash)
+{
+	int bucket;
+
+	if (self->old_n_buckets) {
+		bucket = abs(hash % self->old_n_buckets);
+		if (self->rehash_bucket <= bucket) {
+			/* The old bucket has not been migrated yet. */
+			return bucket;
+		}
+	}
+	return abs(hash % self->n_buckets);
+}
+
+/*!
+ * \internal
+ * \brief Find a prime number of hash buckets not less than the given number.
+ * \since 14.0.0
+ *
+ * \param n_buckets Minimum number of buckets.
+ *
+ * \return Number of buckets.
+ */
+static int hash_ao2_prime_buckets(int n_buckets)
+{
+	int divisor;
+
+	if (n_buckets <= 2) {
+		return 2;
+	}
+	for (n_buckets |= 1; ; n_buckets += 2) {
+		for (divisor = 3; divisor <= n_buckets / divisor; divisor += 2) {
+			if (!(n_buckets % divisor)) {
+				break;
+			}
+		}
+		if (n_buckets / divisor < divisor) {
+			return n_buckets;
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Start rehashing the container to a new number of buckets.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param n_buckets New number of buckets.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_rehash_start(struct ao2_container_hash *self, int n_buckets)
+{
+	struct hash_bucket *buckets;
+
+	if (self->allocated_buckets < n_buckets) {
+		buckets = ast_realloc(self->buckets, n_buckets * sizeof(*buckets));
+		if (!buckets) {
+			/* Keep the current buckets.  We will try again later. */
+			return;
+		}
+		/*
+		 * Moving the bucket heads is safe since the nodes do not
+		 * point back at them.
+		 */
+		memset(&buckets[self->allocated_buckets], 0,
+			(n_buckets - self->allocated_buckets) * sizeof(*buckets));
+		self->buckets = buckets;
+		self->allocated_buckets = n_buckets;
+	}
+
+	self->old_n_buckets = self->n_buckets;
+	self->n_buckets = n_buckets;
+	self->rehash_bucket = 0;
+	hash_ao2_publish_layout(self);
+}
+
+/*!
+ * \internal
+ * \brief Finish rehashing the container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_rehash_finish(struct ao2_container_hash *self)
+{
+	struct hash_bucket *buckets;
+
+	self->old_n_buckets = 0;
+	self->rehash_bucket = 0;
+
+	if (self->n_buckets < self->allocated_buckets) {
+		/* The buckets past the new number of buckets are now empty. */
+		buckets = ast_realloc(self->buckets, self->n_buckets * sizeof(*buckets));
+		if (buckets) {
+			self->buckets = buckets;
+			self->allocated_buckets = self->n_buckets;
+		}
+	}
+	hash_ao2_publish_layout(self);
+}
+
+/*!
+ * \internal
+ * \brief Move the nodes of an old hash bucket to their new buckets.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param idx Old hash bucket to migrate.
+ *
+ * \note The objects keep their relative order so sorted buckets
+ * stay sorted.
+ *
+ * \note Lockless searches look in the old bucket before the new
+ * bucket so the new bucket is published first.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_rehash_bucket(struct ao2_container_hash *self, int idx)
+{
+	struct hash_bucket_node *node;
+	struct hash_bucket_node *cur;
+	struct hash_bucket *bucket;
+	int new_bucket;
+	int moved = 0;
+
+	AST_DLLIST_TRAVERSE_SAFE_BEGIN(&self->buckets[idx].list, node, links) {
+		new_bucket = abs(node->hash % self->n_buckets);
+		if (new_bucket == idx) {
+			continue;
+		}
+		AST_DLLIST_REMOVE_CURRENT(links);
+#if defined(AO2_DEBUG)
+		if (node->common.obj) {
+			--self->buckets[idx].elements;
+		}
+#endif	/* defined(AO2_DEBUG) */
+
+		bucket = &self->buckets[new_bucket];
+		if (self->common.sort_fn && node->common.obj) {
+			/* Keep the new bucket sorted. */
+			AST_DLLIST_TRAVERSE_BACKWARDS(&bucket->list, cur, links) {
+				if (cur->common.obj
+					&& self->common.sort_fn(cur->common.obj, node->common.obj, OBJ_SEARCH_OBJECT) <= 0) {
+					break;
+				}
+			}
+			if (cur) {
+				AST_DLLIST_INSERT_AFTER(&bucket->list, cur, node, links);
+			} else {
+				AST_DLLIST_INSERT_HEAD(&bucket->list, node, links);
+			}
+		} else {
+			AST_DLLIST_INSERT_TAIL(&bucket->list, node, links);
+		}
+		node->my_bucket = new_bucket;
+#if defined(AO2_DEBUG)
+		if (node->common.obj) {
+			++bucket->elements;
+			if (bucket->max_elements < bucket->elements) {
+				bucket->max_elements = bucket->elements;
+			}
+		}
+#endif	/* defined(AO2_DEBUG) */
+		if (node->common.obj) {
+			hash_ao2_publish_bucket(self, new_bucket);
+			moved = 1;
+		}
+	}
+	AST_DLLIST_TRAVERSE_SAFE_END;
+
+	if (moved) {
+		hash_ao2_publish_bucket(self, idx);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Get the number of buckets a resizable container should be rehashed to.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \retval n_buckets if the number of objects per bucket is out of bounds.
+ * \retval 0 if the container does not need resizing.
+ */
+static int hash_ao2_rehash_target(struct ao2_container_hash *self)
+{
+	int elements;
+	int n_buckets;
+
+	elements = ao2_container_count(&self->common);
+	if (self->n_buckets < INT_MAX / (2 * HASH_GROW_LOAD)
+		&& HASH_GROW_LOAD * self->n_buckets < elements) {
+		return hash_ao2_prime_buckets(2 * self->n_buckets);
+	}
+	if (self->min_buckets < self->n_buckets
+		&& elements < self->n_buckets / HASH_SHRINK_LOAD) {
+		n_buckets = MAX(self->min_buckets, self->n_buckets / 2);
+		if (self->min_buckets < n_buckets) {
+			n_buckets = hash_ao2_prime_buckets(n_buckets);
+		}
+		if (n_buckets < self->n_buckets) {
+			return n_buckets;
+		}
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Perform an incremental rehash step on a resizable container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \details
+ * Starts growing or shrinking the container when the number of
+ * objects per bucket is out of bounds and migrates the next few
+ * old buckets of a rehash in progress.
+ *
+ * \note The container must be write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_rehash_step(struct ao2_container_hash *self)
+{
+	int n_buckets;
+	int count;
+
+	if (!(self->common.options & AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE)
+		|| self->common.traversals || self->common.destroying) {
+		/* Nodes cannot be moved now. */
+		return;
+	}
+
+	if (!self->old_n_buckets) {
+		n_buckets = hash_ao2_rehash_target(self);
+		if (n_buckets) {
+			hash_ao2_rehash_start(self, n_buckets);
+		}
+		if (!self->old_n_buckets) {
+			return;
+		}
+	}
+
+	for (count = HASH_REHASH_STEP_BUCKETS;
+		count-- && self->rehash_bucket < self->old_n_buckets;
+		++self->rehash_bucket) {
+		hash_ao2_rehash_bucket(self, self->rehash_bucket);
+	}
+	if (self->rehash_bucket == self->old_n_buckets) {
+		hash_ao2_rehash_finish(self);
+	}
+}
 
 /*!
  * \internal
@@ -123,7 +816,7 @@ static struct ao2_container *hash_ao2_alloc_empty_clone(struct ao2_container_has
 	}
 
 	return __ao2_container_alloc_hash(ao2_options_get(self), self->common.options,
-		self->n_buckets, self->hash_fn, self->common.sort_fn, self->common.cmp_fn,
+		self->min_buckets, self->hash_fn, self->common.sort_fn, self->common.cmp_fn,
 		tag, file, line, func);
 }
 
@@ -139,8 +832,8 @@ static struct ao2_container *hash_ao2_alloc_empty_clone(struct ao2_container_has
  * of its destruction.  The node must be destroyed while the
  * container is already locked.
  *
- * \note The container must be locked when the node is
- * unreferenced.
+ * \note The container or the stripe of the node's bucket must be
+ * locked when the node is unreferenced.
  *
  * \return Nothing
  */
@@ -172,13 +865,14 @@ static void hash_ao2_node_destructor(void *v_doomed)
 
 #if defined(AO2_DEBUG)
 		if (!my_container->common.destroying
+			&& (!my_container->stripes || my_container->stripes_exclusive)
 			&& ao2_container_check(doomed->common.my_container, OBJ_NOLOCK)) {
 			ast_log(LOG_ERROR, "Container integrity failed before node deletion.\n");
 		}
 #endif	/* defined(AO2_DEBUG) */
 		bucket = &my_container->buckets[doomed->my_bucket];
 		AST_DLLIST_REMOVE(&bucket->list, doomed, links);
-		AO2_DEVMODE_STAT(--my_container->common.nodes);
+		AO2_DEVMODE_STAT(ast_atomic_fetchadd_int(&my_container->common.nodes, -1));
 	}
 
 	/*
@@ -208,26 +902,25 @@ static void hash_ao2_node_destructor(void *v_doomed)
 static struct hash_bucket_node *hash_ao2_new_node(struct ao2_container_hash *self, void *obj_new, const char *tag, const char *file, int line, const char *func)
 {
 	struct hash_bucket_node *node;
-	int i;
 
 	node = ao2_t_alloc_options(sizeof(*node), hash_ao2_node_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK, NULL);
 	if (!node) {
 		return NULL;
 	}
 
-	i = abs(self->hash_fn(obj_new, OBJ_SEARCH_OBJECT) % self->n_buckets);
+	node->hash = self->hash_fn(obj_new, OBJ_SEARCH_OBJECT);
 
 	__ao2_ref(obj_new, +1, tag ?: "Container node creation", file, line, func);
 	node->common.obj = obj_new;
 	node->common.my_container = (struct ao2_container *) self;
-	node->my_bucket = i;
+	node->my_bucket = hash_ao2_bucket(self, node->hash);
 
 	return node;
 }
 
 /*!
  * \internal
- * \brief Insert a node into this container.
+ * \brief Insert a node into its hash bucket.
  * \since 12.0.0
  *
  * \param self Container to operate upon.
@@ -235,7 +928,7 @@ static struct hash_bucket_node *hash_ao2_new_node(struct ao2_container_hash *sel
  *
  * \return enum ao2_container_insert value.
  */
-static enum ao2_container_insert hash_ao2_insert_node(struct ao2_container_hash *self,
+static enum ao2_container_insert hash_ao2_insert_into_bucket(struct ao2_container_hash *self,
 	struct hash_bucket_node *node)
 {
 	int cmp;
@@ -318,6 +1011,208 @@ static enum ao2_container_insert hash_ao2_insert_node(struct ao2_container_hash
 	return AO2_CONTAINER_INSERT_NODE_INSERTED;
 }
 
+/*!
+ * \internal
+ * \brief Insert a node into this container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param node Container node to insert into the container.
+ *
+ * \return enum ao2_container_insert value.
+ */
+static enum ao2_container_insert hash_ao2_insert_node(struct ao2_container_hash *self,
+	struct hash_bucket_node *node)
+{
+	enum ao2_container_insert res;
+	int bucket;
+
+	if (!self->stripes || self->stripes_exclusive) {
+		/* Make progress resizing the container before picking the bucket. */
+		hash_ao2_rehash_step(self);
+	}
+	bucket = hash_ao2_bucket(self, node->hash);
+	node->my_bucket = bucket;
+
+	res = hash_ao2_insert_into_bucket(self, node);
+	if (res != AO2_CONTAINER_INSERT_NODE_REJECTED && self->lockless) {
+		/* The node may be gone if it replaced an object. */
+		hash_ao2_publish_bucket(self, bucket);
+		if (!self->stripes) {
+			hash_ao2_reclaim(self);
+		}
+	}
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Search the objects of a hash bucket snapshot.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param snapshot Hash bucket snapshot to search.  (NULL if bucket is empty)
+ * \param flags search_flags to control the search.
+ * \param cb_fn Comparison callback function.
+ * \param arg Comparison callback arg parameter.
+ * \param data Data comparison callback data parameter.
+ * \param type Type of comparison callback cb_fn.
+ * \param found Where to put the matching object.
+ *
+ * \retval CMP_STOP if the search is done.
+ * \retval 0 if the search continues.
+ */
+static int hash_snapshot_search(struct ao2_container_hash *self, struct hash_snapshot *snapshot,
+	enum search_flags flags, void *cb_fn, void *arg, void *data, enum ao2_callback_type type,
+	void **found)
+{
+	ao2_sort_fn *sort_fn = self->common.sort_fn;
+	void *obj;
+	int descending;
+	int match;
+	int cmp;
+	int idx;
+
+	if (!snapshot) {
+		return 0;
+	}
+
+	switch (flags & OBJ_ORDER_MASK) {
+	case OBJ_ORDER_POST:
+	case OBJ_ORDER_DESCENDING:
+		descending = 1;
+		break;
+	default:
+		descending = 0;
+		break;
+	}
+
+	for (idx = 0; idx < snapshot->count; ++idx) {
+		obj = snapshot->objs[descending ? snapshot->count - 1 - idx : idx];
+
+		if (sort_fn) {
+			/* Filter the object through the sort_fn */
+			cmp = sort_fn(obj, arg, flags & OBJ_SEARCH_MASK);
+			if (descending ? 0 < cmp : cmp < 0) {
+				continue;
+			}
+			if (cmp) {
+				/* No more objects in this bucket are possible to match. */
+				break;
+			}
+		}
+
+		match = (CMP_MATCH | CMP_STOP);
+		if (type == AO2_CALLBACK_WITH_DATA) {
+			match &= ((ao2_callback_data_fn *) cb_fn)(obj, arg, data, flags);
+		} else {
+			match &= ((ao2_callback_fn *) cb_fn)(obj, arg, flags);
+		}
+		if (!match) {
+			continue;
+		}
+		if (match & CMP_MATCH) {
+			*found = obj;
+		}
+		return CMP_STOP;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find an object in the container without locking it.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param flags search_flags to control the search.
+ * \param cb_fn Comparison callback function.
+ * \param arg Comparison callback arg parameter.
+ * \param data Data comparison callback data parameter.
+ * \param type Type of comparison callback cb_fn.
+ * \param result Where to put the found object (Reffed unless OBJ_NODATA).
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ *
+ * \details
+ * The search reads the bucket snapshots published by the writers.
+ * An object found is protected by its snapshot until the search
+ * finishes, since the snapshot memory is not released while a
+ * search that could have seen it is still active.
+ *
+ * \retval 0 if the search was done.
+ * \retval -1 if the search must be done with the container locked.
+ */
+static int hash_ao2_find_lockless(struct ao2_container_hash *self, enum search_flags flags,
+	void *cb_fn, void *arg, void *data, enum ao2_callback_type type,
+	void **result, const char *tag, const char *file, int line, const char *func)
+{
+	struct hash_reader *reader;
+	struct hash_lockless_table *table;
+	void *found = NULL;
+	int bucket[2];
+	int n_search;
+	int hash;
+	int idx;
+
+	if (!self->lockless
+		|| !(reader = ast_threadstorage_get(&hash_reader_storage, sizeof(*reader)))) {
+		return -1;
+	}
+
+	hash_reader_enter(reader);
+	table = self->lockless;
+	if (!table || self->lockless_stale) {
+		hash_reader_exit(reader);
+		return -1;
+	}
+
+	/*
+	 * While rehashing, an object may be in its old or its new
+	 * bucket.  Objects are published in their new bucket before
+	 * they are removed from their old bucket, so look in the old
+	 * bucket first.
+	 */
+	hash = self->hash_fn(arg, flags & OBJ_SEARCH_MASK);
+	n_search = 0;
+	if (table->old_n_buckets) {
+		bucket[n_search++] = abs(hash % table->old_n_buckets);
+	}
+	idx = abs(hash % table->n_buckets);
+	if (!n_search || bucket[0] != idx) {
+		bucket[n_search++] = idx;
+	}
+
+	for (idx = 0; idx < n_search; ++idx) {
+		/* Read each snapshot after the previous one. */
+		__sync_synchronize();
+		if (hash_snapshot_search(self, table->buckets[bucket[idx]], flags, cb_fn, arg,
+			data, type, &found)) {
+			break;
+		}
+	}
+	if (found && !(flags & OBJ_NODATA)) {
+		__ao2_ref(found, +1, tag ?: "Traversal found object", file, line, func);
+	} else {
+		found = NULL;
+	}
+	hash_reader_exit(reader);
+
+	if (self->retired && !reader->nesting
+		&& (ao2_options_get(self) & AO2_ALLOC_OPT_LOCK_MASK) != AO2_ALLOC_OPT_LOCK_NOLOCK
+		&& !ao2_trywrlock(self)) {
+		/* Help release memory retired by the last writer. */
+		hash_ao2_reclaim(self);
+		ao2_unlock(self);
+	}
+
+	*result = found;
+	return 0;
+}
+
 /*!
  * \internal
  * \brief Find the first hash container node in a traversal.
@@ -361,8 +1256,7 @@ static struct hash_bucket_node *hash_ao2_find_first(struct ao2_container_hash *s
 	case OBJ_SEARCH_OBJECT:
 	case OBJ_SEARCH_KEY:
 		/* we know hash can handle this case */
-		bucket_cur = abs(self->hash_fn(arg, flags & OBJ_SEARCH_MASK)
-				% self->n_buckets);
+		bucket_cur = hash_ao2_bucket(self, self->hash_fn(arg, flags & OBJ_SEARCH_MASK));
 		state->sort_fn = self->common.sort_fn;
 		break;
 	case OBJ_SEARCH_PARTIAL_KEY:
@@ -384,7 +1278,7 @@ static struct hash_bucket_node *hash_ao2_find_first(struct ao2_container_hash *s
 		 * bucket_cur downto state->bucket_last
 		 */
 		if (bucket_cur < 0) {
-			bucket_cur = self->n_buckets - 1;
+			bucket_cur = self->allocated_buckets - 1;
 			state->bucket_last = 0;
 		} else {
 			state->bucket_last = bucket_cur;
@@ -427,7 +1321,7 @@ static struct hash_bucket_node *hash_ao2_find_first(struct ao2_container_hash *s
 		 */
 		if (bucket_cur < 0) {
 			bucket_cur = 0;
-			state->bucket_last = self->n_buckets;
+			state->bucket_last = self->allocated_buckets;
 		} else {
 			state->bucket_last = bucket_cur + 1;
 		}
@@ -630,7 +1524,7 @@ static struct hash_bucket_node *hash_ao2_iterator_next(struct ao2_container_hash
 			}
 		} else {
 			/* Find first non-empty node. */
-			cur_bucket = self->n_buckets;
+			cur_bucket = self->allocated_buckets;
 		}
 
 		/* Find a non-empty node in the remaining buckets */
@@ -665,7 +1559,7 @@ static struct hash_bucket_node *hash_ao2_iterator_next(struct ao2_container_hash
 		}
 
 		/* Find a non-empty node in the remaining buckets */
-		while (++cur_bucket < self->n_buckets) {
+		while (++cur_bucket < self->allocated_buckets) {
 			node = AST_DLLIST_FIRST(&self->buckets[cur_bucket].list);
 			while (node) {
 				if (node->common.obj) {
@@ -740,13 +1634,205 @@ static void hash_ao2_destroy(struct ao2_container_hash *self)
 	int idx;
 
 	/* Check that the container no longer has any nodes */
-	for (idx = self->n_buckets; idx--;) {
+	for (idx = self->allocated_buckets; idx--;) {
 		if (!AST_DLLIST_EMPTY(&self->buckets[idx].list)) {
 			ast_log(LOG_ERROR, "Node ref leak.  Hash container still has nodes!\n");
 			ast_assert(0);
 			break;
 		}
 	}
+
+	if (self->buckets != self->fixed_buckets) {
+		ast_free(self->buckets);
+	}
+
+	/* No one can be searching a container being destroyed. */
+	if (self->lockless) {
+		hash_ao2_lockless_disable(self);
+	}
+	while (self->retired) {
+		struct hash_retired *doomed = self->retired;
+
+		self->retired = doomed->next;
+		doomed->release(doomed);
+	}
+
+	if (self->stripes) {
+		for (idx = 0; idx < HASH_LOCK_STRIPES; ++idx) {
+			ast_mutex_destroy(&self->stripes[idx]);
+		}
+		ast_free(self->stripes);
+		self->stripes = NULL;
+		ast_mutex_destroy(&self->retired_lock);
+	}
+}
+
+/*!
+ * \internal
+ * \brief An object was removed from a container node.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param node Container node the object was removed from.
+ *
+ * \note The container or the stripe of the node's bucket is
+ * already write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_unlinked_node(struct ao2_container_hash *self, struct hash_bucket_node *node)
+{
+	if (!self->lockless || !node->common.is_linked || self->common.destroying) {
+		return;
+	}
+	hash_ao2_publish_bucket(self, node->my_bucket);
+	if (!self->stripes) {
+		hash_ao2_reclaim(self);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Lock the stripe of the bucket holding the given key or object.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param flags OBJ_SEARCH_OBJECT or OBJ_SEARCH_KEY.
+ * \param arg Object or key to lock the stripe of.
+ *
+ * \retval stripe Locked stripe number.
+ * \retval -1 if the operation must lock the whole container.
+ */
+static int hash_ao2_stripe_lock(struct ao2_container_hash *self, enum search_flags flags, void *arg)
+{
+	struct timeval start;
+	int hash;
+	int stripe;
+
+	if (!self->stripes
+		|| (self->common.options & AO2_CONTAINER_ALLOC_OPT_DUPS_MASK)
+			== AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE) {
+		/* Replacing an object could destroy it while holding the stripe. */
+		return -1;
+	}
+
+	hash = self->hash_fn(arg, flags & OBJ_SEARCH_MASK);
+	for (;;) {
+		stripe = hash_ao2_bucket(self, hash) % HASH_LOCK_STRIPES;
+		ast_atomic_fetchadd_int(&self->common.lock_stats.locks, +1);
+		if (ast_mutex_trylock(&self->stripes[stripe])) {
+			start = ast_tvnow();
+			ast_mutex_lock(&self->stripes[stripe]);
+			container_lock_stat_wait(&self->common, start);
+		}
+
+		/*
+		 * The buckets cannot be rehashed while we hold a stripe
+		 * but they may have been before we got it.
+		 */
+		if (hash_ao2_bucket(self, hash) % HASH_LOCK_STRIPES == stripe) {
+			break;
+		}
+		ast_mutex_unlock(&self->stripes[stripe]);
+	}
+
+	if ((self->common.options & AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE)
+		&& (self->old_n_buckets || hash_ao2_rehash_target(self))) {
+		/* Rehashing moves nodes between stripes. */
+		ast_mutex_unlock(&self->stripes[stripe]);
+		return -1;
+	}
+
+	return stripe;
+}
+
+/*!
+ * \internal
+ * \brief Unlock a stripe locked by hash_ao2_stripe_lock().
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param stripe Stripe number to unlock.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_stripe_unlock(struct ao2_container_hash *self, int stripe)
+{
+	ast_mutex_unlock(&self->stripes[stripe]);
+	if (self->lockless) {
+		hash_ao2_reclaim(self);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Lock all stripes of the container in order.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is already locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_lock_stripes(struct ao2_container_hash *self)
+{
+	int idx;
+
+	if (!self->stripes) {
+		return;
+	}
+	for (idx = 0; idx < HASH_LOCK_STRIPES; ++idx) {
+		ast_mutex_lock(&self->stripes[idx]);
+	}
+	++self->stripes_exclusive;
+}
+
+/*!
+ * \internal
+ * \brief Unlock all stripes of the container.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is still locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_unlock_stripes(struct ao2_container_hash *self)
+{
+	int idx;
+
+	if (!self->stripes) {
+		return;
+	}
+	if (self->lockless_stale && self->lockless) {
+		/* A stripe could not keep its snapshot up to date. */
+		hash_ao2_lockless_disable(self);
+	}
+	--self->stripes_exclusive;
+	for (idx = HASH_LOCK_STRIPES; idx--;) {
+		ast_mutex_unlock(&self->stripes[idx]);
+	}
+	if (self->lockless || self->retired) {
+		hash_ao2_reclaim(self);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Perform deferred maintenance after unlinking objects.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is already write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_rehash(struct ao2_container_hash *self)
+{
+	hash_ao2_rehash_step(self);
 }
 
 #if defined(AO2_DEBUG)
@@ -771,10 +1857,15 @@ static void hash_ao2_dump(struct ao2_container_hash *self, void *where, ao2_prnt
 	int suppressed_buckets = 0;
 	struct hash_bucket_node *node;
 
-	prnt(where, "Number of buckets: %d\n\n", self->n_buckets);
+	prnt(where, "Number of buckets: %d\n", self->n_buckets);
+	if (self->old_n_buckets) {
+		prnt(where, "Rehashing from %d buckets, next old bucket: %d\n",
+			self->old_n_buckets, self->rehash_bucket);
+	}
+	prnt(where, "\n");
 
 	prnt(where, FORMAT, "Bucket", "Node", "Prev", "Next", "Obj", "Key");
-	for (bucket = 0; bucket < self->n_buckets; ++bucket) {
+	for (bucket = 0; bucket < self->allocated_buckets; ++bucket) {
 		node = AST_DLLIST_FIRST(&self->buckets[bucket].list);
 		if (node) {
 			suppressed_buckets = 0;
@@ -825,10 +1916,15 @@ static void hash_ao2_stats(struct ao2_container_hash *self, void *where, ao2_prn
 	int bucket;
 	int suppressed_buckets = 0;
 
-	prnt(where, "Number of buckets: %d\n\n", self->n_buckets);
+	prnt(where, "Number of buckets: %d\n", self->n_buckets);
+	if (self->old_n_buckets) {
+		prnt(where, "Rehashing from %d buckets, next old bucket: %d\n",
+			self->old_n_buckets, self->rehash_bucket);
+	}
+	prnt(where, "\n");
 
 	prnt(where, FORMAT, "Bucket", "Objects", "Max");
-	for (bucket = 0; bucket < self->n_buckets; ++bucket) {
+	for (bucket = 0; bucket < self->allocated_buckets; ++bucket) {
 		if (self->buckets[bucket].max_elements) {
 			suppressed_buckets = 0;
 			prnt(where, FORMAT2, bucket, self->buckets[bucket].elements,
@@ -844,6 +1940,45 @@ static void hash_ao2_stats(struct ao2_container_hash *self, void *where, ao2_prn
 }
 #endif	/* defined(AO2_DEBUG) */
 
+/*!
+ * \internal
+ * \brief Get how the objects of the hash container are spread over its buckets.
+ * \since 14.0.0
+ *
+ * \param self Container to operate upon.
+ * \param buckets Set to the number of buckets.
+ * \param used Set to the number of buckets holding objects.
+ * \param max_chain Set to the largest number of objects in a bucket.
+ *
+ * \note The container is already locked for reading.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_occupancy(struct ao2_container_hash *self, int *buckets, int *used, int *max_chain)
+{
+	struct hash_bucket_node *node;
+	int bucket;
+	int chain;
+
+	*buckets = self->n_buckets;
+	*used = 0;
+	*max_chain = 0;
+	for (bucket = 0; bucket < self->allocated_buckets; ++bucket) {
+		chain = 0;
+		AST_DLLIST_TRAVERSE(&self->buckets[bucket].list, node, links) {
+			if (node->common.obj) {
+				++chain;
+			}
+		}
+		if (chain) {
+			++*used;
+			if (*max_chain < chain) {
+				*max_chain = chain;
+			}
+		}
+	}
+}
+
 #if defined(AO2_DEBUG)
 /*!
  * \internal
@@ -873,7 +2008,7 @@ static int hash_ao2_integrity(struct ao2_container_hash *self)
 	count_total_node = 0;
 
 	/* For each bucket in the container. */
-	for (bucket = 0; bucket < self->n_buckets; ++bucket) {
+	for (bucket = 0; bucket < self->allocated_buckets; ++bucket) {
 		if (!AST_DLLIST_FIRST(&self->buckets[bucket].list)
 			&& !AST_DLLIST_LAST(&self->buckets[bucket].list)) {
 			/* The bucket list is empty. */
@@ -959,8 +2094,11 @@ static int hash_ao2_integrity(struct ao2_container_hash *self)
 			++count_obj;
 
 			/* Check container hash key for expected bucket. */
-			bucket_exp = abs(self->hash_fn(node->common.obj, OBJ_SEARCH_OBJECT)
-					% self->n_buckets);
+			if (node->hash != self->hash_fn(node->common.obj, OBJ_SEARCH_OBJECT)) {
+				ast_log(LOG_ERROR, "Bucket %d node hash value is stale!\n", bucket);
+				return -1;
+			}
+			bucket_exp = hash_ao2_bucket(self, node->hash);
 			if (bucket != bucket_exp) {
 				ast_log(LOG_ERROR, "Bucket %d node hashes to bucket %d!\n",
 					bucket, bucket_exp);
@@ -1018,6 +2156,14 @@ static const struct ao2_container_methods v_table_hash = {
 	.traverse_next = (ao2_container_find_next_fn) hash_ao2_find_next,
 	.iterator_next = (ao2_iterator_next_fn) hash_ao2_iterator_next,
 	.destroy = (ao2_container_destroy_fn) hash_ao2_destroy,
+	.rehash = (ao2_container_rehash_fn) hash_ao2_rehash,
+	.find_lockless = (ao2_container_find_lockless_fn) hash_ao2_find_lockless,
+	.unlinked_node = (ao2_container_unlinked_node_fn) hash_ao2_unlinked_node,
+	.stripe_lock = (ao2_container_stripe_lock_fn) hash_ao2_stripe_lock,
+	.stripe_unlock = (ao2_container_stripe_unlock_fn) hash_ao2_stripe_unlock,
+	.lock_stripes = (ao2_container_stripes_fn) hash_ao2_lock_stripes,
+	.unlock_stripes = (ao2_container_stripes_fn) hash_ao2_unlock_stripes,
+	.occupancy = (ao2_container_occupancy_fn) hash_ao2_occupancy,
 #if defined(AO2_DEBUG)
 	.link_stat = hash_ao2_link_node_stat,
 	.unlink_stat = hash_ao2_unlink_node_stat,
@@ -1067,11 +2213,54 @@ static struct ao2_container *hash_ao2_container_init(
 	self->common.options = options;
 	self->hash_fn = hash_fn ? hash_fn : hash_zero;
 	self->n_buckets = n_buckets;
+	self->min_buckets = n_buckets;
+	self->allocated_buckets = n_buckets;
 
 #ifdef AO2_DEBUG
 	ast_atomic_fetchadd_int(&ao2.total_containers, 1);
 #endif	/* defined(AO2_DEBUG) */
 
+	if (options & AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE) {
+		self->buckets = ast_calloc(n_buckets, sizeof(*self->buckets));
+		if (!self->buckets) {
+			/* Don't try to free the bucket array when destroyed. */
+			self->buckets = self->fixed_buckets;
+			self->allocated_buckets = 0;
+			ao2_t_ref(self, -1, "Failed to allocate hash buckets");
+			return NULL;
+		}
+	} else {
+		self->buckets = self->fixed_buckets;
+	}
+
+	if (options & AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND) {
+		self->lockless = ast_calloc(1,
+			sizeof(*self->lockless) + n_buckets * sizeof(self->lockless->buckets[0]));
+		if (!self->lockless) {
+			ao2_t_ref(self, -1, "Failed to allocate lockless search table");
+			return NULL;
+		}
+		self->lockless->retired.release = hash_lockless_table_release;
+		self->lockless->n_buckets = n_buckets;
+		self->lockless->n_slots = n_buckets;
+	}
+
+	if (options & AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED) {
+		ast_mutex_t *stripes;
+		int idx;
+
+		stripes = ast_calloc(HASH_LOCK_STRIPES, sizeof(*stripes));
+		if (!stripes) {
+			ao2_t_ref(self, -1, "Failed to allocate hash stripe locks");
+			return NULL;
+		}
+		for (idx = 0; idx < HASH_LOCK_STRIPES; ++idx) {
+			ast_mutex_init(&stripes[idx]);
+		}
+		ast_mutex_init(&self->retired_lock);
+		self->stripes = stripes;
+	}
+
 	return (struct ao2_container *) self;
 }
 
@@ -1084,8 +2273,21 @@ struct ao2_container *__ao2_container_alloc_hash(unsigned int ao2_options,
 	size_t container_size;
 	struct ao2_container_hash *self;
 
-	num_buckets = hash_fn ? n_buckets : 1;
-	container_size = sizeof(struct ao2_container_hash) + num_buckets * sizeof(struct hash_bucket);
+	if (!hash_fn) {
+		/* A list container does not need to be resized or striped. */
+		n_buckets = 1;
+		container_options &= ~(AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE
+			| AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED);
+	}
+	if ((ao2_options & AO2_ALLOC_OPT_LOCK_MASK) != AO2_ALLOC_OPT_LOCK_MUTEX) {
+		/* Stripes need the container lock to be recursive. */
+		container_options &= ~AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED;
+	}
+	num_buckets = n_buckets;
+	container_size = sizeof(struct ao2_container_hash);
+	if (!(container_options & AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE)) {
+		container_size += num_buckets * sizeof(struct hash_bucket);
+	}
 
 	self = __ao2_alloc(container_size, container_destruct, ao2_options,
 		tag ?: __PRETTY_FUNCTION__, file, line, func);
@@ -42,17 +42,34 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/frame.h"
 #include "asterisk/translate.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/slinear_mix.h"
 
 #define AST_AUDIOHOOK_SYNC_TOLERANCE 100 /*!< Tolerance in milliseconds for audiohooks synchronization */
 #define AST_AUDIOHOOK_SMALL_QUEUE_TOLERANCE 100 /*!< When small queue is enabled, this is the maximum amount of audio that can remain queued at a time. */
 
 #define DEFAULT_INTERNAL_SAMPLE_RATE 8000
 
+#define AST_AUDIOHOOK_MAX_TAPS 4 /*!< Number of spy sample rates a list converts its audio to, per direction */
+
 struct ast_audiohook_translate {
 	struct ast_trans_pvt *trans_pvt;
 	struct ast_format *format;
 };
 
+/*!
+ * \brief Shared conversion of the audio of a list to the sample rate of some of its spies
+ *
+ * Spies running at another rate than the list are fed audio converted once
+ * per frame for all of them, instead of each of their factories converting
+ * it with its own translation path.
+ */
+struct ast_audiohook_tap {
+	/*! Sample rate of the spies fed from this tap, 0 if unused */
+	int rate;
+	/*! Translation path from the signed linear format of the list to the rate */
+	struct ast_audiohook_translate translate;
+};
+
 struct ast_audiohook_list {
 	/* If all the audiohooks in this list are capable
 	 * of processing slinear at any sample rate, this
@@ -63,6 +80,7 @@ struct ast_audiohook_list {
 
 	struct ast_audiohook_translate in_translate[2];
 	struct ast_audiohook_translate out_translate[2];
+	struct ast_audiohook_tap taps[2][AST_AUDIOHOOK_MAX_TAPS];
 	AST_LIST_HEAD_NOLOCK(, ast_audiohook) spy_list;
 	AST_LIST_HEAD_NOLOCK(, ast_audiohook) whisper_list;
 	AST_LIST_HEAD_NOLOCK(, ast_audiohook) manipulate_list;
@@ -201,8 +219,16 @@ int ast_audiohook_write_frame(struct ast_audiohook *audiohook, enum ast_audiohoo
 			muteme = 1;
 	}
 
+	/* The frame may be shared with other audiohooks, so feed a silent copy */
 	if (muteme && frame->datalen > 0) {
-		ast_frame_clear(frame);
+		struct ast_frame *silence = ast_alloca(sizeof(*silence));
+
+		*silence = *frame;
+		silence->mallocd = 0;
+		silence->data.ptr = ast_alloca(frame->datalen);
+		memset(silence->data.ptr, 0, frame->datalen);
+		AST_LIST_NEXT(silence, frame_list) = NULL;
+		frame = silence;
 	}
 
 	/* Write frame out to respective factory */
@@ -253,10 +279,8 @@ static struct ast_frame *audiohook_read_frame_single(struct ast_audiohook *audio
 
 static struct ast_frame *audiohook_read_frame_both(struct ast_audiohook *audiohook, size_t samples, struct ast_frame **read_reference, struct ast_frame **write_reference)
 {
-	int count;
 	int usable_read;
 	int usable_write;
-	short adjust_value;
 	short buf1[samples];
 	short buf2[samples];
 	short *read_buf = NULL;
@@ -295,14 +319,7 @@ static struct ast_frame *audiohook_read_frame_both(struct ast_audiohook *audioho
 			read_buf = buf1;
 			/* Adjust read volume if need be */
 			if (audiohook->options.read_volume) {
-				adjust_value = abs(audiohook->options.read_volume);
-				for (count = 0; count < samples; count++) {
-					if (audiohook->options.read_volume > 0) {
-						ast_slinear_saturated_multiply(&buf1[count], &adjust_value);
-					} else if (audiohook->options.read_volume < 0) {
-						ast_slinear_saturated_divide(&buf1[count], &adjust_value);
-					}
-				}
+				ast_slinear_adjust_volume_block(buf1, audiohook->options.read_volume, samples);
 			}
 		}
 	} else {
@@ -315,14 +332,7 @@ static struct ast_frame *audiohook_read_frame_both(struct ast_audiohook *audioho
 			write_buf = buf2;
 			/* Adjust write volume if need be */
 			if (audiohook->options.write_volume) {
-				adjust_value = abs(audiohook->options.write_volume);
-				for (count = 0; count < samples; count++) {
-					if (audiohook->options.write_volume > 0) {
-						ast_slinear_saturated_multiply(&buf2[count], &adjust_value);
-					} else if (audiohook->options.write_volume < 0) {
-						ast_slinear_saturated_divide(&buf2[count], &adjust_value);
-					}
-				}
+				ast_slinear_adjust_volume_block(buf2, audiohook->options.write_volume, samples);
 			}
 		}
 	} else {
@@ -345,9 +355,7 @@ static struct ast_frame *audiohook_read_frame_both(struct ast_audiohook *audioho
 	if (read_buf) {
 		frame.data.ptr = read_buf;
 		if (write_buf) {
-			for (count = 0; count < samples; count++) {
-				ast_slinear_saturated_add(read_buf++, write_buf++);
-			}
+			ast_slinear_saturated_add_block(read_buf, write_buf, samples);
 		}
 	} else if (write_buf) {
 		frame.data.ptr = write_buf;
@@ -591,13 +599,21 @@ void ast_audiohook_detach_list(struct ast_audiohook_list *audiohook_list)
 
 	/* Drop translation paths if present */
 	for (i = 0; i < 2; i++) {
+		int tap;
+
 		if (audiohook_list->in_translate[i].trans_pvt) {
 			ast_translator_free_path(audiohook_list->in_translate[i].trans_pvt);
-			ao2_cleanup(audiohook_list->in_translate[i].format);
 		}
+		ao2_cleanup(audiohook_list->in_translate[i].format);
 		if (audiohook_list->out_translate[i].trans_pvt) {
 			ast_translator_free_path(audiohook_list->out_translate[i].trans_pvt);
-			ao2_cleanup(audiohook_list->in_translate[i].format);
+		}
+		ao2_cleanup(audiohook_list->out_translate[i].format);
+		for (tap = 0; tap < AST_AUDIOHOOK_MAX_TAPS; tap++) {
+			if (audiohook_list->taps[i][tap].translate.trans_pvt) {
+				ast_translator_free_path(audiohook_list->taps[i][tap].translate.trans_pvt);
+			}
+			ao2_cleanup(audiohook_list->taps[i][tap].translate.format);
 		}
 	}
 
@@ -872,6 +888,75 @@ static struct ast_frame *audiohook_list_translate_to_native(struct ast_audiohook
 	return outframe;
 }
 
+/*!
+ * \brief Get the audio of a list converted to the sample rate of a spy.
+ *
+ * \param audiohook_list audiohook_list data object
+ * \param direction Direction the frame is coming in from
+ * \param slin_frame The signed linear frame of the list
+ * \param rate The sample rate of the spy
+ * \param tap_frames Frames already converted in this pass, indexed like the taps
+ *
+ * \return The frame to feed the spy with. If no tap is available for the rate
+ * or the conversion failed this is slin_frame, which the factory of the spy
+ * converts itself.
+ */
+static struct ast_frame *audiohook_list_tap(struct ast_audiohook_list *audiohook_list,
+	enum ast_audiohook_direction direction, struct ast_frame *slin_frame, int rate,
+	struct ast_frame **tap_frames)
+{
+	struct ast_audiohook_tap *taps = (direction == AST_AUDIOHOOK_DIRECTION_READ ? audiohook_list->taps[0] : audiohook_list->taps[1]);
+	struct ast_audiohook_tap *tap;
+	struct ast_frame *tap_frame;
+	int i;
+
+	if (ast_format_get_sample_rate(slin_frame->subclass.format) == rate) {
+		return slin_frame;
+	}
+
+	for (i = 0; i < AST_AUDIOHOOK_MAX_TAPS; i++) {
+		if (!taps[i].rate) {
+			taps[i].rate = rate;
+		}
+		if (taps[i].rate == rate) {
+			break;
+		}
+	}
+	if (i == AST_AUDIOHOOK_MAX_TAPS) {
+		return slin_frame;
+	}
+	if (tap_frames[i]) {
+		return tap_frames[i];
+	}
+	tap = &taps[i];
+
+	if (ast_format_cmp(slin_frame->subclass.format, tap->translate.format) == AST_FORMAT_CMP_NOT_EQUAL) {
+		struct ast_trans_pvt *new_trans;
+
+		new_trans = ast_translator_build_path(ast_format_cache_get_slin_by_rate(rate), slin_frame->subclass.format);
+		if (!new_trans) {
+			tap_frames[i] = slin_frame;
+			return slin_frame;
+		}
+		if (tap->translate.trans_pvt) {
+			ast_translator_free_path(tap->translate.trans_pvt);
+		}
+		tap->translate.trans_pvt = new_trans;
+		ao2_replace(tap->translate.format, slin_frame->subclass.format);
+	}
+
+	tap_frame = ast_translate(tap->translate.trans_pvt, slin_frame, 0);
+	/* Spies are fed one frame, so let their factories convert audio that came out in pieces */
+	if (tap_frame && AST_LIST_NEXT(tap_frame, frame_list)) {
+		ast_frfree(tap_frame);
+		tap_frame = NULL;
+	}
+
+	/* Not converting again for the other spies at this rate keeps the path in step */
+	tap_frames[i] = tap_frame ? tap_frame : slin_frame;
+	return tap_frames[i];
+}
+
 /*!
  *\brief Set the audiohook's internal sample rate to the audiohook_list's rate,
  *       but only when native slin compatibility is turned on.
@@ -902,6 +987,46 @@ static void audiohook_list_set_hook_rate(struct ast_audiohook_list *audiohook_li
 	}
 }
 
+/*!
+ * \brief Determine if any audiohook in a list needs the audio of a frame
+ *
+ * \details
+ * Spies and manipulators always do. Whisper sources only do when they have
+ * audio waiting to be mixed in this direction, otherwise the frame would be
+ * translated to SLINEAR and back for nothing. Hooks that are no longer
+ * running also need a pass through the list to be removed from it.
+ *
+ * \param audiohook_list List of audiohooks
+ * \param direction Direction frame is coming in from
+ *
+ * \retval 0 the frame can be passed through untouched
+ * \retval 1 the frame needs to go through the list
+ */
+static int audiohook_list_wants_audio(struct ast_audiohook_list *audiohook_list, enum ast_audiohook_direction direction)
+{
+	struct ast_audiohook *audiohook;
+	int wants = 0;
+
+	if (!AST_LIST_EMPTY(&audiohook_list->spy_list)
+		|| !AST_LIST_EMPTY(&audiohook_list->manipulate_list)) {
+		return 1;
+	}
+
+	AST_LIST_TRAVERSE(&audiohook_list->whisper_list, audiohook, list) {
+		struct ast_slinfactory *factory = (direction == AST_AUDIOHOOK_DIRECTION_READ ? &audiohook->read_factory : &audiohook->write_factory);
+
+		ast_audiohook_lock(audiohook);
+		wants = audiohook->status != AST_AUDIOHOOK_STATUS_RUNNING
+			|| ast_slinfactory_available(factory);
+		ast_audiohook_unlock(audiohook);
+		if (wants) {
+			break;
+		}
+	}
+
+	return wants;
+}
+
 /*!
  * \brief Pass an AUDIO frame off to be handled by the audiohook core
  *
@@ -933,6 +1058,12 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 	int middle_frame_manipulated = 0;
 	int removed = 0;
 	int internal_sample_rate;
+	struct ast_frame *tap_frames[AST_AUDIOHOOK_MAX_TAPS] = { NULL, };
+	int i;
+
+	if (!audiohook_list_wants_audio(audiohook_list, direction)) {
+		return frame;
+	}
 
 	/* ---Part_1. translate start_frame to SLINEAR if necessary. */
 	if (!(middle_frame = audiohook_list_translate_to_slin(audiohook_list, direction, start_frame))) {
@@ -954,7 +1085,7 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 	internal_sample_rate = audiohook_list->list_internal_samp_rate;
 
 	/* ---Part_2: Send middle_frame to spy and manipulator lists.  middle_frame is guaranteed to be SLINEAR here.*/
-	/* Queue up signed linear frame to each spy */
+	/* Queue up signed linear frame to each spy, converted once for all spies at each other rate */
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&audiohook_list->spy_list, audiohook, list) {
 		ast_audiohook_lock(audiohook);
 		if (audiohook->status != AST_AUDIOHOOK_STATUS_RUNNING) {
@@ -968,15 +1099,22 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 			continue;
 		}
 		audiohook_list_set_hook_rate(audiohook_list, audiohook, &internal_sample_rate);
-		ast_audiohook_write_frame(audiohook, direction, middle_frame);
+		ast_audiohook_write_frame(audiohook, direction, audiohook_list_tap(audiohook_list,
+			direction, middle_frame, audiohook->hook_internal_samp_rate, tap_frames));
 		ast_audiohook_unlock(audiohook);
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
+	for (i = 0; i < AST_AUDIOHOOK_MAX_TAPS; i++) {
+		if (tap_frames[i] && tap_frames[i] != middle_frame) {
+			ast_frfree(tap_frames[i]);
+		}
+	}
 
 	/* If this frame is being written out to the channel then we need to use whisper sources */
 	if (!AST_LIST_EMPTY(&audiohook_list->whisper_list)) {
-		int i = 0;
-		short read_buf[samples], combine_buf[samples], *data1 = NULL, *data2 = NULL;
+		short read_buf[samples], combine_buf[samples];
+		int whispered = 0;
+
 		memset(&combine_buf, 0, sizeof(combine_buf));
 		AST_LIST_TRAVERSE_SAFE_BEGIN(&audiohook_list->whisper_list, audiohook, list) {
 			struct ast_slinfactory *factory = (direction == AST_AUDIOHOOK_DIRECTION_READ ? &audiohook->read_factory : &audiohook->write_factory);
@@ -994,18 +1132,19 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 			audiohook_list_set_hook_rate(audiohook_list, audiohook, &internal_sample_rate);
 			if (ast_slinfactory_available(factory) >= samples && ast_slinfactory_read(factory, read_buf, samples)) {
 				/* Take audio from this whisper source and combine it into our main buffer */
-				for (i = 0, data1 = combine_buf, data2 = read_buf; i < samples; i++, data1++, data2++) {
-					ast_slinear_saturated_add(data1, data2);
-				}
+				ast_slinear_saturated_add_block(combine_buf, read_buf, samples);
+				whispered = 1;
 			}
 			ast_audiohook_unlock(audiohook);
 		}
 		AST_LIST_TRAVERSE_SAFE_END;
-		/* We take all of the combined whisper sources and combine them into the audio being written out */
-		for (i = 0, data1 = middle_frame->data.ptr, data2 = combine_buf; i < samples; i++, data1++, data2++) {
-			ast_slinear_saturated_add(data1, data2);
+		/* We take all of the combined whisper sources and combine them into the audio being
+		 * written out. When none had audio the frame is left as it was, so it does not need
+		 * to be translated back. */
+		if (whispered) {
+			ast_slinear_saturated_add_block(middle_frame->data.ptr, combine_buf, samples);
+			middle_frame_manipulated = 1;
 		}
-		middle_frame_manipulated = 1;
 	}
 
 	/* Pass off frame to manipulate audiohooks */
@@ -51,7 +51,13 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/lock.h"
 #include "asterisk/utils.h"
 
-#define MAX_AUTOMONS 1500
+#include "asterisk/options.h"
+
+/*! \brief Number of autoservice threads when asterisk.conf does not set it */
+#define AUTOSERVICE_DEFAULT_THREADS 4
+
+/*! \brief Maximum number of autoservice threads */
+#define AUTOSERVICE_MAX_THREADS 64
 
 struct asent {
 	struct ast_channel *chan;
@@ -68,16 +74,48 @@ struct asent {
 	AST_LIST_ENTRY(asent) list;
 };
 
-static AST_LIST_HEAD_STATIC(aslist, asent);
-static ast_cond_t as_cond;
+/*!
+ * \brief A thread servicing a share of the channels in autoservice
+ *
+ * A channel always goes to the same thread, picked by autoservice_thread_get(),
+ * so each thread only waits on its own channels. The thread waits with
+ * ast_waitfor_n(), which keeps the file descriptors of the channels in an
+ * epoll set of the thread between waits.
+ */
+struct as_thread {
+	/*! Channels serviced by the thread, new ones at the tail */
+	AST_LIST_HEAD(, asent) list;
+	/*! Signaled when the list is no longer empty */
+	ast_cond_t cond;
+	pthread_t thread;
+	/*! Number of channels in the list */
+	int count;
+	/*! Incremented each time the thread rebuilds its array of channels */
+	int chan_list_state;
+};
 
-static pthread_t asthread = AST_PTHREADT_NULL;
+static struct as_thread as_threads[AUTOSERVICE_MAX_THREADS];
+static int as_num_threads;
 static volatile int asexit = 0;
 
-static int as_chan_list_state;
+/*!
+ * \internal
+ * \brief Get the thread servicing a channel.
+ */
+static struct as_thread *autoservice_thread_get(struct ast_channel *chan)
+{
+	/* Channels are allocated with the same size, so mix the address bits. */
+	uint64_t key = ((uint64_t) (uintptr_t) chan >> 4) * 0x9E3779B97F4A7C15ULL;
 
-static void *autoservice_run(void *ign)
+	return &as_threads[(key >> 32) % as_num_threads];
+}
+
+static void *autoservice_run(void *data)
 {
+	struct as_thread *thread = data;
+	struct ast_channel **mons = NULL;
+	struct asent **ents = NULL;
+	int size = 0;
 	ast_callid callid = 0;
 	struct ast_frame hangup_frame = {
 		.frametype = AST_FRAME_CONTROL,
@@ -85,36 +123,48 @@ static void *autoservice_run(void *ign)
 	};
 
 	while (!asexit) {
-		struct ast_channel *mons[MAX_AUTOMONS];
-		struct asent *ents[MAX_AUTOMONS];
 		struct ast_channel *chan;
 		struct asent *as;
 		int i, x = 0, ms = 50;
 		struct ast_frame *f = NULL;
 		struct ast_frame *defer_frame = NULL;
 
-		AST_LIST_LOCK(&aslist);
+		AST_LIST_LOCK(&thread->list);
 
 		/* At this point, we know that no channels that have been removed are going
 		 * to get used again. */
-		as_chan_list_state++;
+		thread->chan_list_state++;
 
-		if (AST_LIST_EMPTY(&aslist)) {
-			ast_cond_wait(&as_cond, &aslist.lock);
+		if (AST_LIST_EMPTY(&thread->list)) {
+			ast_cond_wait(&thread->cond, &thread->list.lock);
 		}
 
-		AST_LIST_TRAVERSE(&aslist, as, list) {
+		if (thread->count > size) {
+			struct ast_channel **new_mons = ast_realloc(mons, thread->count * sizeof(*mons));
+			struct asent **new_ents = new_mons ? ast_realloc(ents, thread->count * sizeof(*ents)) : NULL;
+
+			if (new_mons) {
+				mons = new_mons;
+			}
+			if (new_ents) {
+				ents = new_ents;
+				size = thread->count;
+			}
+		}
+
+		AST_LIST_TRAVERSE(&thread->list, as, list) {
 			if (!ast_check_hangup(as->chan)) {
-				if (x < MAX_AUTOMONS) {
+				if (x < size) {
 					ents[x] = as;
 					mons[x++] = as->chan;
 				} else {
-					ast_log(LOG_WARNING, "Exceeded maximum number of automatic monitoring events.  Fix autoservice.c\n");
+					ast_log(LOG_WARNING, "Unable to service all channels in autoservice\n");
+					break;
 				}
 			}
 		}
 
-		AST_LIST_UNLOCK(&aslist);
+		AST_LIST_UNLOCK(&thread->list);
 
 		if (!x) {
 			/* If we don't sleep, this becomes a busy loop, which causes
@@ -182,7 +232,9 @@ static void *autoservice_run(void *ign)
 	}
 
 	ast_callid_threadassoc_change(0);
-	asthread = AST_PTHREADT_NULL;
+	thread->thread = AST_PTHREADT_NULL;
+	ast_free(mons);
+	ast_free(ents);
 
 	return NULL;
 }
@@ -191,15 +243,16 @@ int ast_autoservice_start(struct ast_channel *chan)
 {
 	int res = 0;
 	struct asent *as;
+	struct as_thread *thread = autoservice_thread_get(chan);
 
-	AST_LIST_LOCK(&aslist);
-	AST_LIST_TRAVERSE(&aslist, as, list) {
+	AST_LIST_LOCK(&thread->list);
+	AST_LIST_TRAVERSE(&thread->list, as, list) {
 		if (as->chan == chan) {
 			as->use_count++;
 			break;
 		}
 	}
-	AST_LIST_UNLOCK(&aslist);
+	AST_LIST_UNLOCK(&thread->list);
 
 	if (as) {
 		/* Entry exists, autoservice is already handling this channel */
@@ -219,29 +272,33 @@ int ast_autoservice_start(struct ast_channel *chan)
 		ast_set_flag(ast_channel_flags(chan), AST_FLAG_END_DTMF_ONLY);
 	ast_channel_unlock(chan);
 
-	AST_LIST_LOCK(&aslist);
+	AST_LIST_LOCK(&thread->list);
 
-	if (AST_LIST_EMPTY(&aslist) && asthread != AST_PTHREADT_NULL) {
-		ast_cond_signal(&as_cond);
+	if (AST_LIST_EMPTY(&thread->list) && thread->thread != AST_PTHREADT_NULL) {
+		ast_cond_signal(&thread->cond);
 	}
 
-	AST_LIST_INSERT_HEAD(&aslist, as, list);
+	/* At the tail, the channels already serviced keep their place in the
+	 * epoll set of the thread. */
+	AST_LIST_INSERT_TAIL(&thread->list, as, list);
+	thread->count++;
 
-	if (asthread == AST_PTHREADT_NULL) { /* need start the thread */
-		if (ast_pthread_create_background(&asthread, NULL, autoservice_run, NULL)) {
+	if (thread->thread == AST_PTHREADT_NULL) { /* need start the thread */
+		if (ast_pthread_create_background(&thread->thread, NULL, autoservice_run, thread)) {
 			ast_log(LOG_WARNING, "Unable to create autoservice thread :(\n");
 			/* There will only be a single member in the list at this point,
 			   the one we just added. */
-			AST_LIST_REMOVE(&aslist, as, list);
+			AST_LIST_REMOVE(&thread->list, as, list);
+			thread->count--;
 			ast_free(as);
-			asthread = AST_PTHREADT_NULL;
+			thread->thread = AST_PTHREADT_NULL;
 			res = -1;
 		} else {
-			pthread_kill(asthread, SIGURG);
+			pthread_kill(thread->thread, SIGURG);
 		}
 	}
 
-	AST_LIST_UNLOCK(&aslist);
+	AST_LIST_UNLOCK(&thread->list);
 
 	return res;
 }
@@ -252,22 +309,24 @@ int ast_autoservice_stop(struct ast_channel *chan)
 	struct asent *as, *removed = NULL;
 	struct ast_frame *f;
 	int chan_list_state;
+	struct as_thread *thread = autoservice_thread_get(chan);
 
-	AST_LIST_LOCK(&aslist);
+	AST_LIST_LOCK(&thread->list);
 
 	/* Save the autoservice channel list state.  We _must_ verify that the channel
 	 * list has been rebuilt before we return.  Because, after we return, the channel
 	 * could get destroyed and we don't want our poor autoservice thread to step on
 	 * it after its gone! */
-	chan_list_state = as_chan_list_state;
+	chan_list_state = thread->chan_list_state;
 
 	/* Find the entry, but do not free it because it still can be in the
 	   autoservice thread array */
-	AST_LIST_TRAVERSE_SAFE_BEGIN(&aslist, as, list) {
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&thread->list, as, list) {
 		if (as->chan == chan) {
 			as->use_count--;
 			if (as->use_count < 1) {
 				AST_LIST_REMOVE_CURRENT(list);
+				thread->count--;
 				removed = as;
 			}
 			break;
@@ -275,18 +334,18 @@ int ast_autoservice_stop(struct ast_channel *chan)
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
 
-	if (removed && asthread != AST_PTHREADT_NULL) {
-		pthread_kill(asthread, SIGURG);
+	if (removed && thread->thread != AST_PTHREADT_NULL) {
+		pthread_kill(thread->thread, SIGURG);
 	}
 
-	AST_LIST_UNLOCK(&aslist);
+	AST_LIST_UNLOCK(&thread->list);
 
 	if (!removed) {
 		return 0;
 	}
 
 	/* Wait while autoservice thread rebuilds its list. */
-	while (chan_list_state == as_chan_list_state) {
+	while (chan_list_state == thread->chan_list_state) {
 		usleep(1000);
 	}
 
@@ -329,32 +388,55 @@ int ast_autoservice_ignore(struct ast_channel *chan, enum ast_frame_type ftype)
 {
 	struct asent *as;
 	int res = -1;
+	struct as_thread *thread = autoservice_thread_get(chan);
 
-	AST_LIST_LOCK(&aslist);
-	AST_LIST_TRAVERSE(&aslist, as, list) {
+	AST_LIST_LOCK(&thread->list);
+	AST_LIST_TRAVERSE(&thread->list, as, list) {
 		if (as->chan == chan) {
 			res = 0;
 			as->ignore_frame_types |= (1 << ftype);
 			break;
 		}
 	}
-	AST_LIST_UNLOCK(&aslist);
+	AST_LIST_UNLOCK(&thread->list);
 	return res;
 }
 
 static void autoservice_shutdown(void)
 {
-	pthread_t th = asthread;
+	pthread_t th;
+	int i;
+
 	asexit = 1;
-	if (th != AST_PTHREADT_NULL) {
-		ast_cond_signal(&as_cond);
-		pthread_kill(th, SIGURG);
-		pthread_join(th, NULL);
+	for (i = 0; i < as_num_threads; i++) {
+		AST_LIST_LOCK(&as_threads[i].list);
+		th = as_threads[i].thread;
+		ast_cond_signal(&as_threads[i].cond);
+		AST_LIST_UNLOCK(&as_threads[i].list);
+		if (th != AST_PTHREADT_NULL) {
+			pthread_kill(th, SIGURG);
+			pthread_join(th, NULL);
+		}
 	}
 }
 
 void ast_autoservice_init(void)
 {
+	int i;
+
+	as_num_threads = ast_option_autoservice_threads;
+	if (as_num_threads < 1) {
+		as_num_threads = AUTOSERVICE_DEFAULT_THREADS;
+	} else if (as_num_threads > AUTOSERVICE_MAX_THREADS) {
+		ast_log(LOG_WARNING, "Limiting autoservice threads to %d\n", AUTOSERVICE_MAX_THREADS);
+		as_num_threads = AUTOSERVICE_MAX_THREADS;
+	}
+
+	for (i = 0; i < as_num_threads; i++) {
+		AST_LIST_HEAD_INIT(&as_threads[i].list);
+		ast_cond_init(&as_threads[i].cond, NULL);
+		as_threads[i].thread = AST_PTHREADT_NULL;
+	}
+
 	ast_register_cleanup(autoservice_shutdown);
-	ast_cond_init(&as_cond, NULL);
 }
@@ -104,6 +104,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/musiconhold.h"
 #include "asterisk/features.h"
 #include "asterisk/cli.h"
+#include "asterisk/metrics.h"
 #include "asterisk/parking.h"
 #include "asterisk/core_local.h"
 #include "asterisk/core_unreal.h"
@@ -1604,19 +1605,9 @@ static void *bridge_channel_depart_thread(void *data)
 	return NULL;
 }
 
-/*! \brief Thread responsible for independent imparted bridged channels */
-static void *bridge_channel_ind_thread(void *data)
+void bridge_channel_ind_complete(struct ast_bridge_channel *bridge_channel)
 {
-	struct bridge_channel_internal_cond *cond = data;
-	struct ast_bridge_channel *bridge_channel = cond->bridge_channel;
-	struct ast_channel *chan;
-
-	if (bridge_channel->callid) {
-		ast_callid_threadassoc_add(bridge_channel->callid);
-	}
-
-	bridge_channel_internal_join(bridge_channel, cond);
-	chan = bridge_channel->chan;
+	struct ast_channel *chan = bridge_channel->chan;
 
 	/* cleanup */
 	ast_channel_lock(chan);
@@ -1633,6 +1624,23 @@ static void *bridge_channel_ind_thread(void *data)
 
 	ast_bridge_run_after_callback(chan);
 	ast_bridge_run_after_goto(chan);
+}
+
+/*! \brief Thread responsible for independent imparted bridged channels */
+static void *bridge_channel_ind_thread(void *data)
+{
+	struct bridge_channel_internal_cond *cond = data;
+	struct ast_bridge_channel *bridge_channel = cond->bridge_channel;
+
+	if (bridge_channel->callid) {
+		ast_callid_threadassoc_add(bridge_channel->callid);
+	}
+
+	if (bridge_channel_internal_join(bridge_channel, cond) > 0) {
+		/* An event loop completes the bridge channel when it leaves. */
+		return NULL;
+	}
+	bridge_channel_ind_complete(bridge_channel);
 	return NULL;
 }
 
@@ -1683,6 +1691,8 @@ int ast_bridge_impart(struct ast_bridge *bridge,
 	bridge_channel->inhibit_colp = !!(flags & AST_BRIDGE_IMPART_INHIBIT_JOIN_COLP);
 	bridge_channel->depart_wait =
 		(flags & AST_BRIDGE_IMPART_CHAN_MASK) == AST_BRIDGE_IMPART_CHAN_DEPARTABLE;
+	bridge_channel->event_loop = (flags & AST_BRIDGE_IMPART_EVENT_LOOP)
+		&& !bridge_channel->depart_wait;
 	bridge_channel->callid = ast_read_threadstorage_callid();
 
 	/* allow subclass to peek at swap channel before it can hangup */
@@ -3048,6 +3058,7 @@ int ast_bridge_dtmf_hook(struct ast_bridge_features *features,
 
 	/* Once done we put it in the container. */
 	res = ao2_link(features->dtmf_hooks, hook) ? 0 : -1;
+	bridge_features_dtmf_changed(features);
 	if (res) {
 		/*
 		 * Could not link the hook into the container.
@@ -3353,6 +3364,7 @@ static void hooks_remove_heap(struct ast_heap *hooks, enum ast_bridge_hook_remov
 void ast_bridge_features_remove(struct ast_bridge_features *features, enum ast_bridge_hook_remove_flags remove_flags)
 {
 	hooks_remove_container(features->dtmf_hooks, remove_flags);
+	bridge_features_dtmf_changed(features);
 	hooks_remove_container(features->other_hooks, remove_flags);
 	hooks_remove_heap(features->interval_hooks, remove_flags);
 }
@@ -3410,6 +3422,186 @@ static int bridge_dtmf_hook_sort(const void *obj_left, const void *obj_right, in
 	return cmp;
 }
 
+/*! \brief Number of DTMF digits a trie node can be followed by: 0-9, *, # and A-D */
+#define DTMF_TRIE_DIGITS 16
+
+/*! \brief Node of a DTMF hook digit trie */
+struct bridge_dtmf_trie_node {
+	/*! Index of the node reached by each next digit, 0 for none */
+	unsigned short next[DTMF_TRIE_DIGITS];
+	/*! Hook whose code ends at this node, with a reference */
+	struct ast_bridge_hook_dtmf *hook;
+};
+
+/*!
+ * \brief Digit trie compiled from the DTMF hooks of a features structure
+ *
+ * Matching collected digits walks one node per digit instead of comparing
+ * them with the code of every hook. The trie is never changed once built:
+ * changing the hooks drops it and the next match builds a new one.
+ */
+struct bridge_dtmf_trie {
+	/*! Number of nodes in use */
+	unsigned int used;
+	/*! Number of nodes allocated */
+	unsigned int size;
+	/*! The nodes, the root being the first */
+	struct bridge_dtmf_trie_node nodes[0];
+};
+
+/*!
+ * \internal
+ * \brief Get the index of a DTMF digit in a trie node.
+ *
+ * \retval -1 if the character is not a DTMF digit.
+ */
+static int dtmf_trie_digit(char digit)
+{
+	switch (digit) {
+	case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9':
+		return digit - '0';
+	case '*':
+		return 10;
+	case '#':
+		return 11;
+	case 'A': case 'B': case 'C': case 'D':
+		return 12 + digit - 'A';
+	case 'a': case 'b': case 'c': case 'd':
+		return 12 + digit - 'a';
+	}
+	return -1;
+}
+
+static void dtmf_trie_destroy(void *obj)
+{
+	struct bridge_dtmf_trie *trie = obj;
+	unsigned int idx;
+
+	for (idx = 0; idx < trie->used; ++idx) {
+		ao2_cleanup(trie->nodes[idx].hook);
+	}
+}
+
+static int dtmf_trie_count_cb(void *obj, void *arg, int flags)
+{
+	struct ast_bridge_hook_dtmf *hook = obj;
+	unsigned int *size = arg;
+
+	*size += strlen(hook->dtmf.code);
+	return 0;
+}
+
+static int dtmf_trie_insert_cb(void *obj, void *arg, int flags)
+{
+	struct ast_bridge_hook_dtmf *hook = obj;
+	struct bridge_dtmf_trie *trie = arg;
+	unsigned int node = 0;
+	const char *code;
+	int digit;
+
+	if (ast_strlen_zero(hook->dtmf.code)) {
+		return 0;
+	}
+
+	/* A code with other characters can never be collected. */
+	for (code = hook->dtmf.code; *code; ++code) {
+		if (dtmf_trie_digit(*code) < 0) {
+			ast_debug(1, "DTMF feature hook %p code '%s' is not made of DTMF digits\n",
+				hook, hook->dtmf.code);
+			return 0;
+		}
+	}
+
+	for (code = hook->dtmf.code; *code; ++code) {
+		digit = dtmf_trie_digit(*code);
+		if (!trie->nodes[node].next[digit]) {
+			ast_assert(trie->used < trie->size);
+			trie->nodes[node].next[digit] = trie->used++;
+		}
+		node = trie->nodes[node].next[digit];
+	}
+
+	/* Codes differing only in case end at the same node. */
+	ao2_cleanup(trie->nodes[node].hook);
+	trie->nodes[node].hook = ao2_bump(hook);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Compile a digit trie from a DTMF hooks container.
+ *
+ * \note The container must be locked.
+ */
+static struct bridge_dtmf_trie *dtmf_trie_build(struct ao2_container *dtmf_hooks)
+{
+	struct bridge_dtmf_trie *trie;
+	unsigned int size = 1;
+
+	ao2_callback(dtmf_hooks, OBJ_NODATA, dtmf_trie_count_cb, &size);
+	if (size > USHRT_MAX) {
+		return NULL;
+	}
+
+	trie = ao2_alloc_options(sizeof(*trie) + size * sizeof(trie->nodes[0]),
+		dtmf_trie_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!trie) {
+		return NULL;
+	}
+	trie->used = 1;
+	trie->size = size;
+
+	ao2_callback(dtmf_hooks, OBJ_NODATA, dtmf_trie_insert_cb, trie);
+	return trie;
+}
+
+enum bridge_dtmf_match bridge_features_dtmf_match(struct ast_bridge_features *features,
+	const char *digits, struct ast_bridge_hook_dtmf **hook)
+{
+	struct bridge_dtmf_trie *trie;
+	enum bridge_dtmf_match match = BRIDGE_DTMF_MATCH_PARTIAL;
+	unsigned int node = 0;
+	int digit;
+
+	*hook = NULL;
+
+	ao2_lock(features->dtmf_hooks);
+	if (!features->dtmf_trie) {
+		features->dtmf_trie = dtmf_trie_build(features->dtmf_hooks);
+	}
+	trie = ao2_bump(features->dtmf_trie);
+	ao2_unlock(features->dtmf_hooks);
+	if (!trie) {
+		return BRIDGE_DTMF_MATCH_NONE;
+	}
+
+	for (; *digits; ++digits) {
+		digit = dtmf_trie_digit(*digits);
+		if (digit < 0 || !(node = trie->nodes[node].next[digit])) {
+			match = BRIDGE_DTMF_MATCH_NONE;
+			break;
+		}
+	}
+
+	/* A code equal to the digits wins over longer ones, as with the sorted container. */
+	if (match != BRIDGE_DTMF_MATCH_NONE && node && trie->nodes[node].hook) {
+		*hook = ao2_bump(trie->nodes[node].hook);
+		match = BRIDGE_DTMF_MATCH_FULL;
+	}
+
+	ao2_ref(trie, -1);
+	return match;
+}
+
+void bridge_features_dtmf_changed(struct ast_bridge_features *features)
+{
+	ao2_lock(features->dtmf_hooks);
+	ao2_cleanup(features->dtmf_trie);
+	features->dtmf_trie = NULL;
+	ao2_unlock(features->dtmf_hooks);
+}
+
 /*! \brief Callback for merging hook ao2_containers */
 static int merge_container_cb(void *obj, void *data, int flags)
 {
@@ -3451,6 +3643,7 @@ void ast_bridge_features_merge(struct ast_bridge_features *into, const struct as
 
 	/* Merge hook containers */
 	ao2_callback(from->dtmf_hooks, 0, merge_container_cb, into->dtmf_hooks);
+	bridge_features_dtmf_changed(into);
 	ao2_callback(from->other_hooks, 0, merge_container_cb, into->other_hooks);
 
 	/* Merge hook heaps */
@@ -3517,7 +3710,9 @@ void ast_bridge_features_cleanup(struct ast_bridge_features *features)
 	ao2_cleanup(features->other_hooks);
 	features->other_hooks = NULL;
 
-	/* Destroy the DTMF hooks container. */
+	/* Destroy the DTMF hooks container and the trie compiled from it. */
+	ao2_cleanup(features->dtmf_trie);
+	features->dtmf_trie = NULL;
 	ao2_cleanup(features->dtmf_hooks);
 	features->dtmf_hooks = NULL;
 }
@@ -3553,6 +3748,27 @@ void ast_bridge_set_mixing_interval(struct ast_bridge *bridge, unsigned int mixi
 	ast_bridge_unlock(bridge);
 }
 
+void ast_bridge_set_mixing_threads(struct ast_bridge *bridge, unsigned int mixing_threads)
+{
+	ast_bridge_lock(bridge);
+	bridge->softmix.mixing_threads = mixing_threads;
+	ast_bridge_unlock(bridge);
+}
+
+void ast_bridge_set_max_talkers(struct ast_bridge *bridge, unsigned int max_talkers)
+{
+	ast_bridge_lock(bridge);
+	bridge->softmix.max_talkers = max_talkers;
+	ast_bridge_unlock(bridge);
+}
+
+void ast_bridge_set_resample_quality(struct ast_bridge *bridge, unsigned int quality)
+{
+	ast_bridge_lock(bridge);
+	bridge->softmix.resample_quality = quality;
+	ast_bridge_unlock(bridge);
+}
+
 void ast_bridge_set_internal_sample_rate(struct ast_bridge *bridge, unsigned int sample_rate)
 {
 	ast_bridge_lock(bridge);
@@ -5299,6 +5515,97 @@ static void bridge_prnt_obj(void *v_obj, void *where, ao2_prnt_fn *prnt)
 		bridge->uniqueid, bridge->v_table->name, bridge->num_channels);
 }
 
+/*! \brief Most bridge types counted separately in the metrics */
+#define BRIDGE_METRICS_TYPES 32
+
+/*! \brief Bridges counted by technology and by type for the metrics */
+struct bridge_metrics_counts {
+	struct {
+		const struct ast_bridge_technology *technology;
+		unsigned int count;
+	} *technologies;
+	size_t num_technologies;
+	struct {
+		const struct ast_bridge_methods *v_table;
+		unsigned int count;
+	} types[BRIDGE_METRICS_TYPES];
+	size_t num_types;
+};
+
+static int bridge_metrics_count_cb(void *obj, void *arg, int flags)
+{
+	struct ast_bridge *bridge = obj;
+	struct bridge_metrics_counts *counts = arg;
+	size_t i;
+
+	for (i = 0; i < counts->num_technologies; ++i) {
+		if (counts->technologies[i].technology == bridge->technology) {
+			++counts->technologies[i].count;
+			break;
+		}
+	}
+
+	for (i = 0; i < counts->num_types; ++i) {
+		if (counts->types[i].v_table == bridge->v_table) {
+			break;
+		}
+	}
+	if (i == counts->num_types) {
+		if (i == ARRAY_LEN(counts->types)) {
+			return 0;
+		}
+		counts->types[i].v_table = bridge->v_table;
+		counts->types[i].count = 0;
+		++counts->num_types;
+	}
+	++counts->types[i].count;
+
+	return 0;
+}
+
+static void bridge_metrics_collect(struct ast_metrics_output *out)
+{
+	struct bridge_metrics_counts counts;
+	struct ast_bridge_technology *technology;
+	size_t i;
+
+	counts.num_technologies = 0;
+	counts.num_types = 0;
+
+	/* The technologies stay registered until the bridges have been counted */
+	AST_RWLIST_RDLOCK(&bridge_technologies);
+	AST_RWLIST_TRAVERSE(&bridge_technologies, technology, entry) {
+		++counts.num_technologies;
+	}
+	counts.technologies = ast_alloca(counts.num_technologies * sizeof(*counts.technologies));
+	i = 0;
+	AST_RWLIST_TRAVERSE(&bridge_technologies, technology, entry) {
+		counts.technologies[i].technology = technology;
+		counts.technologies[i++].count = 0;
+	}
+
+	/*
+	 * The bridge container lock keeps the bridges, and with them their
+	 * types, from going away while they are counted.
+	 */
+	ao2_callback(bridges, OBJ_NODATA, bridge_metrics_count_cb, &counts);
+
+	ast_metrics_output_family(out, "asterisk_bridges_by_technology", AST_METRIC_GAUGE,
+		"Bridges by bridge technology");
+	for (i = 0; i < counts.num_technologies; ++i) {
+		ast_metrics_output_sample(out, "asterisk_bridges_by_technology", "technology",
+			counts.technologies[i].technology->name, counts.technologies[i].count);
+	}
+	AST_RWLIST_UNLOCK(&bridge_technologies);
+
+	ast_metrics_output_family(out, "asterisk_bridges_by_type", AST_METRIC_GAUGE,
+		"Bridges by bridge type");
+	for (i = 0; i < counts.num_types; ++i) {
+		ast_metrics_output_sample(out, "asterisk_bridges_by_type", "type",
+			counts.types[i].v_table->name, counts.types[i].count);
+	}
+}
+
 /*!
  * \internal
  * \brief Shutdown the bridging system.  Stuff to do on graceful shutdown.
@@ -5312,6 +5619,7 @@ static void bridge_cleanup(void)
 	ast_manager_unregister("BridgeTechnologySuspend");
 	ast_manager_unregister("BridgeTechnologyUnsuspend");
 	ast_cli_unregister_multiple(bridge_cli, ARRAY_LEN(bridge_cli));
+	ast_metrics_collector_unregister(bridge_metrics_collect);
 	ao2_container_unregister("bridges");
 
 	ao2_cleanup(bridges);
@@ -5343,6 +5651,7 @@ int ast_bridging_init(void)
 	ast_bridging_init_basic();
 
 	ast_cli_register_multiple(bridge_cli, ARRAY_LEN(bridge_cli));
+	ast_metrics_collector_register("bridge", bridge_metrics_collect);
 
 	ast_manager_register_xml_core("BridgeTechnologyList", 0, manager_bridge_tech_list);
 	ast_manager_register_xml_core("BridgeTechnologySuspend", 0, manager_bridge_tech_suspend);
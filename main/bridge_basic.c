@@ -3038,6 +3038,8 @@ static int attach_framehook(struct attended_transfer_properties *props, struct a
 		.destroy_cb = transfer_target_framehook_destroy_cb,
 		.consume_cb = transfer_target_framehook_consume,
 		.disable_inheritance = 1,
+		.frame_types = AST_FRAMEHOOK_BIT(AST_FRAME_CONTROL),
+		.events = AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_READ),
 	};
 
 	ao2_ref(props, +1);
@@ -35,6 +35,9 @@
 ASTERISK_REGISTER_FILE()
 
 #include <signal.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #include "asterisk/heap.h"
 #include "asterisk/astobj2.h"
@@ -53,9 +56,11 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/musiconhold.h"
 #include "asterisk/features_config.h"
 #include "asterisk/parking.h"
+#include "asterisk/probes.h"
 #include "asterisk/causes.h"
 #include "asterisk/test.h"
 #include "asterisk/sem.h"
+#include "asterisk/vector.h"
 
 /*!
  * \brief Used to queue an action frame onto a bridge channel and write an action frame into a bridge.
@@ -896,10 +901,75 @@ static void bridge_frame_free(struct ast_frame *frame)
 	ast_frfree(frame);
 }
 
+/*!
+ * \internal
+ * \brief Alert the bridge channel thread that frames are queued.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to alert.
+ *
+ * \return Nothing
+ */
+static void bridge_channel_alert_signal(struct ast_bridge_channel *bridge_channel)
+{
+#ifdef __linux__
+	uint64_t nudge = 1;
+#else
+	char nudge = 0;
+#endif
+
+	if (write(bridge_channel->alert_pipe[1], &nudge, sizeof(nudge)) != sizeof(nudge)) {
+		ast_log(LOG_ERROR, "We couldn't write alert pipe for %p(%s)... something is VERY wrong\n",
+			bridge_channel, ast_channel_name(bridge_channel->chan));
+	}
+}
+
+/*!
+ * \internal
+ * \brief Move the frames queued without the lock to the wr_queue.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to collect frames of.
+ *
+ * \note On entry, bridge_channel is already locked.
+ *
+ * \retval non-zero if any frames were moved.
+ */
+static int bridge_channel_collect_wr_queue(struct ast_bridge_channel *bridge_channel)
+{
+	struct ast_frame *head;
+	struct ast_frame *first = NULL;
+	struct ast_frame *next;
+
+	do {
+		head = bridge_channel->wr_incoming;
+		if (!head) {
+			return 0;
+		}
+	} while (!ast_atomic_compare_and_swap_ptr((void * volatile *) &bridge_channel->wr_incoming, head, NULL));
+
+	/* The frames were pushed newest first. */
+	for (; head; head = next) {
+		next = AST_LIST_NEXT(head, frame_list);
+		AST_LIST_NEXT(head, frame_list) = first;
+		first = head;
+	}
+	if (AST_LIST_EMPTY(&bridge_channel->wr_queue)) {
+		AST_LIST_FIRST(&bridge_channel->wr_queue) = first;
+	} else {
+		AST_LIST_NEXT(AST_LIST_LAST(&bridge_channel->wr_queue), frame_list) = first;
+	}
+	for (; AST_LIST_NEXT(first, frame_list); first = AST_LIST_NEXT(first, frame_list)) {
+	}
+	AST_LIST_LAST(&bridge_channel->wr_queue) = first;
+
+	return 1;
+}
+
 int ast_bridge_channel_queue_frame(struct ast_bridge_channel *bridge_channel, struct ast_frame *fr)
 {
 	struct ast_frame *dup;
-	char nudge = 0;
+	struct ast_frame *head;
 
 	if (bridge_channel->suspended
 		/* Also defer DTMF frames. */
@@ -914,31 +984,57 @@ int ast_bridge_channel_queue_frame(struct ast_bridge_channel *bridge_channel, st
 		return 0;
 	}
 
-	dup = ast_frdup(fr);
+	/* A frame queued to several channels keeps sharing its data */
+	dup = (fr->mallocd & AST_MALLOCD_SHARED) ? ast_frshare(fr) : ast_frdup(fr);
 	if (!dup) {
 		return -1;
 	}
 
-	ast_bridge_channel_lock(bridge_channel);
 	if (bridge_channel->state != BRIDGE_CHANNEL_STATE_WAIT) {
 		/* Drop frames on channels leaving the bridge. */
-		ast_bridge_channel_unlock(bridge_channel);
 		bridge_frame_free(dup);
 		return 0;
 	}
 
-	AST_LIST_INSERT_TAIL(&bridge_channel->wr_queue, dup, frame_list);
-	if (write(bridge_channel->alert_pipe[1], &nudge, sizeof(nudge)) != sizeof(nudge)) {
-		ast_log(LOG_ERROR, "We couldn't write alert pipe for %p(%s)... something is VERY wrong\n",
-			bridge_channel, ast_channel_name(bridge_channel->chan));
+	/*
+	 * Push without the bridge channel lock.  Only the frame finding
+	 * nothing queued alerts the thread, which takes everything queued
+	 * until then in one go.
+	 */
+	do {
+		head = bridge_channel->wr_incoming;
+		AST_LIST_NEXT(dup, frame_list) = head;
+	} while (!ast_atomic_compare_and_swap_ptr((void * volatile *) &bridge_channel->wr_incoming, head, dup));
+	if (!head) {
+		bridge_channel_alert_signal(bridge_channel);
 	}
-	ast_bridge_channel_unlock(bridge_channel);
+	return 0;
+}
+
+int ast_bridge_channel_queue_frame_direct(struct ast_bridge_channel *bridge_channel, struct ast_frame *fr)
+{
+	/*
+	 * The bridge lock keeps the channel from being suspended to play or
+	 * run something while the frame is written.  An idle thread with
+	 * nothing queued is not about to write anything the frame must follow.
+	 */
+	if ((fr->frametype != AST_FRAME_VOICE && fr->frametype != AST_FRAME_VIDEO)
+		|| bridge_channel->suspended
+		|| bridge_channel->state != BRIDGE_CHANNEL_STATE_WAIT
+		|| bridge_channel->activity != BRIDGE_CHANNEL_THREAD_IDLE
+		|| bridge_channel->wr_incoming
+		|| !AST_LIST_EMPTY(&bridge_channel->wr_queue)) {
+		return ast_bridge_channel_queue_frame(bridge_channel, fr);
+	}
+
+	ast_write(bridge_channel->chan, fr);
 	return 0;
 }
 
 int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel, struct ast_frame *frame)
 {
 	struct ast_bridge_channel *cur;
+	struct ast_frame *shared = NULL;
 	int not_written = -1;
 
 	if (frame->frametype == AST_FRAME_NULL) {
@@ -946,6 +1042,20 @@ int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_
 		return 0;
 	}
 
+	/*
+	 * Copy the data of a frame going to several channels once instead
+	 * of once per channel. The channels copy it again only if they
+	 * need to modify it when writing it.
+	 */
+	if (bridge->num_channels > 2
+		&& (frame->frametype == AST_FRAME_VOICE || frame->frametype == AST_FRAME_VIDEO)) {
+		shared = ast_frshare(frame);
+		if (!shared) {
+			return -1;
+		}
+		frame = shared;
+	}
+
 	AST_LIST_TRAVERSE(&bridge->channels, cur, entry) {
 		if (cur == bridge_channel) {
 			continue;
@@ -954,6 +1064,9 @@ int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_
 			not_written = 0;
 		}
 	}
+	if (shared) {
+		ast_frfree(shared);
+	}
 	return not_written;
 }
 
@@ -1585,18 +1698,19 @@ void ast_bridge_channel_feature_digit(struct ast_bridge_channel *bridge_channel,
 	}
 
 	while (digit) {
+		enum bridge_dtmf_match match;
+
 		/* See if a DTMF feature hook matches or can match */
-		hook = ao2_find(features->dtmf_hooks, bridge_channel->dtmf_hook_state.collected,
-			OBJ_SEARCH_PARTIAL_KEY);
-		if (!hook) {
+		match = bridge_features_dtmf_match(features, bridge_channel->dtmf_hook_state.collected,
+			&hook);
+		if (match == BRIDGE_DTMF_MATCH_NONE) {
 			ast_debug(1, "No DTMF feature hooks on %p(%s) match '%s'\n",
 				bridge_channel, ast_channel_name(bridge_channel->chan),
 				bridge_channel->dtmf_hook_state.collected);
 			break;
-		} else if (dtmf_len != strlen(hook->dtmf.code)) {
+		} else if (match == BRIDGE_DTMF_MATCH_PARTIAL) {
 			unsigned int digit_timeout;
 			/* Need more digits to match */
-			ao2_ref(hook, -1);
 			digit_timeout = bridge_channel_feature_digit_timeout(bridge_channel);
 			bridge_channel->dtmf_hook_state.interdigit_timeout =
 				ast_tvadd(ast_tvnow(), ast_samp2tv(digit_timeout, 1000));
@@ -1629,6 +1743,7 @@ void ast_bridge_channel_feature_digit(struct ast_bridge_channel *bridge_channel,
 				ast_debug(1, "DTMF hook %p is being removed from %p(%s)\n",
 					hook, bridge_channel, ast_channel_name(bridge_channel->chan));
 				ao2_unlink(features->dtmf_hooks, hook);
+				bridge_features_dtmf_changed(features);
 			}
 			testsuite_notify_feature_success(bridge_channel->chan, hook->dtmf.code);
 			ao2_ref(hook, -1);
@@ -2035,6 +2150,7 @@ void bridge_channel_internal_pull(struct ast_bridge_channel *bridge_channel)
 
 	bridge->reconfigured = 1;
 	ast_bridge_publish_leave(bridge, bridge_channel->chan);
+	AST_PROBE3(bridge__leave, bridge->uniqueid, bridge_channel->chan, bridge->num_channels);
 }
 
 int bridge_channel_internal_push(struct ast_bridge_channel *bridge_channel)
@@ -2100,6 +2216,7 @@ int bridge_channel_internal_push(struct ast_bridge_channel *bridge_channel)
 		bridge->uniqueid);
 
 	ast_bridge_publish_enter(bridge, bridge_channel->chan, swap ? swap->chan : NULL);
+	AST_PROBE3(bridge__join, bridge->uniqueid, bridge_channel->chan, bridge->num_channels);
 
 	/* Clear any BLINDTRANSFER and ATTENDEDTRANSFER since the transfer has completed. */
 	pbx_builtin_setvar_helper(bridge_channel->chan, "BLINDTRANSFER", NULL);
@@ -2187,20 +2304,40 @@ static void bridge_channel_handle_control(struct ast_bridge_channel *bridge_chan
 
 /*!
  * \internal
- * \param bridge_channel Channel to read wr_queue alert pipe.
+ * \brief Clear the wr_queue alert once the wr_queue is empty.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to clear the alert of.
+ *
+ * \details
+ * The alert stays up while frames are queued, so the thread comes back
+ * for the rest after handling one.  A frame queued while the alert is
+ * cleared is collected and alerted again.
+ *
+ * \note On entry, bridge_channel is already locked.
  *
  * \return Nothing
  */
-static void bridge_channel_read_wr_queue_alert(struct ast_bridge_channel *bridge_channel)
+static void bridge_channel_clear_wr_queue_alert(struct ast_bridge_channel *bridge_channel)
 {
-	char nudge;
+#ifdef __linux__
+	uint64_t nudge;
+#else
+	char nudge[64];
+#endif
+	ssize_t res;
 
-	if (read(bridge_channel->alert_pipe[0], &nudge, sizeof(nudge)) < 0) {
-		if (errno != EINTR && errno != EAGAIN) {
-			ast_log(LOG_WARNING, "read() failed for alert pipe on %p(%s): %s\n",
-				bridge_channel, ast_channel_name(bridge_channel->chan),
-				strerror(errno));
-		}
+	do {
+		res = read(bridge_channel->alert_pipe[0], &nudge, sizeof(nudge));
+	} while (res > 0 && sizeof(nudge) > sizeof(uint64_t));
+	if (res < 0 && errno != EINTR && errno != EAGAIN) {
+		ast_log(LOG_WARNING, "read() failed for alert pipe on %p(%s): %s\n",
+			bridge_channel, ast_channel_name(bridge_channel->chan),
+			strerror(errno));
+	}
+
+	if (bridge_channel_collect_wr_queue(bridge_channel)) {
+		bridge_channel_alert_signal(bridge_channel);
 	}
 }
 
@@ -2220,13 +2357,10 @@ static void bridge_channel_handle_write(struct ast_bridge_channel *bridge_channe
 
 	ast_bridge_channel_lock(bridge_channel);
 
-	/* It's not good to have unbalanced frames and alert_pipe alerts. */
-	ast_assert(!AST_LIST_EMPTY(&bridge_channel->wr_queue));
+	bridge_channel_collect_wr_queue(bridge_channel);
 	if (AST_LIST_EMPTY(&bridge_channel->wr_queue)) {
-		/* No frame, flush the alert pipe of excess alerts. */
-		ast_log(LOG_WARNING, "Weird.  No frame from bridge for %s to process?\n",
-			ast_channel_name(bridge_channel->chan));
-		bridge_channel_read_wr_queue_alert(bridge_channel);
+		/* An alert raised again while collecting frames it was for. */
+		bridge_channel_clear_wr_queue_alert(bridge_channel);
 		ast_bridge_channel_unlock(bridge_channel);
 		return;
 	}
@@ -2242,12 +2376,14 @@ static void bridge_channel_handle_write(struct ast_bridge_channel *bridge_channe
 				break;
 			}
 		}
-		bridge_channel_read_wr_queue_alert(bridge_channel);
 		AST_LIST_REMOVE_CURRENT(frame_list);
 		break;
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
 
+	if (AST_LIST_EMPTY(&bridge_channel->wr_queue)) {
+		bridge_channel_clear_wr_queue_alert(bridge_channel);
+	}
 	ast_bridge_channel_unlock(bridge_channel);
 	if (!fr) {
 		/*
@@ -2295,7 +2431,7 @@ static struct ast_frame *bridge_handle_dtmf(struct ast_bridge_channel *bridge_ch
 	dtmf[0] = frame->subclass.integer;
 	dtmf[1] = '\0';
 	if (bridge_channel->dtmf_hook_state.collected[0]
-		|| (hook = ao2_find(features->dtmf_hooks, dtmf, OBJ_SEARCH_PARTIAL_KEY))) {
+		|| bridge_features_dtmf_match(features, dtmf, &hook) != BRIDGE_DTMF_MATCH_NONE) {
 		enum ast_frame_type frametype = frame->frametype;
 
 		bridge_frame_free(frame);
@@ -2571,6 +2707,636 @@ static void bridge_channel_event_join_leave(struct ast_bridge_channel *bridge_ch
 	ao2_iterator_destroy(&iter);
 }
 
+/*!
+ * \internal
+ * \brief Take the bridge_channel out of the bridge after it was told to leave.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel leaving the bridge.
+ * \param swap Swap channel reference to release if the push failed.
+ *
+ * \note This function assumes bridge_channel->bridge is locked and unlocks it.
+ *
+ * \return Nothing
+ */
+static void bridge_channel_leave(struct ast_bridge_channel *bridge_channel, struct ast_channel *swap)
+{
+	bridge_channel_internal_pull(bridge_channel);
+	bridge_channel_settle_owed_events(bridge_channel->bridge, bridge_channel);
+	bridge_reconfigured(bridge_channel->bridge, 1);
+
+	ast_bridge_unlock(bridge_channel->bridge);
+
+	/* Must release any swap ref after unlocking the bridge. */
+	ao2_t_cleanup(swap, "Bridge push with swap failed or exited immediately");
+
+	/* Complete any active hold before exiting the bridge. */
+	if (ast_channel_hold_state(bridge_channel->chan) == AST_CONTROL_HOLD) {
+		ast_debug(1, "Channel %s simulating UNHOLD for bridge end.\n",
+			ast_channel_name(bridge_channel->chan));
+		ast_indicate(bridge_channel->chan, AST_CONTROL_UNHOLD);
+	}
+
+	/* Complete any partial DTMF digit before exiting the bridge. */
+	if (ast_channel_sending_dtmf_digit(bridge_channel->chan)) {
+		ast_channel_end_dtmf(bridge_channel->chan,
+			ast_channel_sending_dtmf_digit(bridge_channel->chan),
+			ast_channel_sending_dtmf_tv(bridge_channel->chan), "bridge end");
+	}
+
+	/* Indicate a source change since this channel is leaving the bridge system. */
+	ast_indicate(bridge_channel->chan, AST_CONTROL_SRCCHANGE);
+
+	/*
+	 * Wait for any dual redirect to complete.
+	 *
+	 * Must be done while "still in the bridge" for ast_async_goto()
+	 * to work right.
+	 */
+	while (ast_test_flag(ast_channel_flags(bridge_channel->chan), AST_FLAG_BRIDGE_DUAL_REDIRECT_WAIT)) {
+		sched_yield();
+	}
+	ast_channel_lock(bridge_channel->chan);
+	ast_channel_internal_bridge_set(bridge_channel->chan, NULL);
+	ast_channel_unlock(bridge_channel->chan);
+
+	ast_bridge_channel_restore_formats(bridge_channel);
+}
+
+/*! \brief Number of event loops servicing bridge channels imparted with AST_BRIDGE_IMPART_EVENT_LOOP */
+#define BRIDGE_EVENT_LOOPS 4
+
+/*!
+ * \brief Longest time in milliseconds an event loop waits before checking its channels
+ *
+ * A channel stops being eligible for an event loop without an event in some
+ * cases, such as when an absolute timeout is set on it.
+ */
+#define BRIDGE_EVENT_LOOP_SWEEP_MS 1000
+
+/*! \brief Milliseconds an event loop waits before trying again to create a thread for a channel */
+#define BRIDGE_EVENT_LOOP_RETRY_MS 100
+
+/*! \brief An event loop servicing bridge channels that only pass media */
+struct bridge_event_loop {
+	/*! Lock for the pending bridge channels */
+	ast_mutex_t lock;
+	/*! The event loop thread */
+	pthread_t thread;
+	/*! Pipe to alert the thread of pending bridge channels */
+	int alert_pipe[2];
+	/*! Number of bridge channels attached to the event loop */
+	int count;
+	/*! Bridge channels attached but not picked up by the thread yet */
+	AST_VECTOR(, struct ast_bridge_channel *) pending;
+	/*! Bridge channels serviced by the thread (Only used by the thread) */
+	AST_VECTOR(, struct ast_bridge_channel *) channels;
+	/*! Bridge channels waiting for a thread of their own (Only used by the thread) */
+	AST_VECTOR(, struct ast_bridge_channel *) detaching;
+};
+
+/*! \brief Where a serviced bridge channel is in the pollfd array of an event loop */
+struct bridge_event_loop_span {
+	/*! Position of the first file descriptor of the channel */
+	int start;
+	/*! Position of the alert pipe of the bridge channel, after the channel's */
+	int alert;
+};
+
+static struct bridge_event_loop event_loops[BRIDGE_EVENT_LOOPS];
+
+/*! \brief Number of started event loops (Only grows) */
+static int event_loops_started;
+
+AST_MUTEX_DEFINE_STATIC(event_loops_lock);
+
+static int pipe_init_nonblock(int *my_pipe);
+static void pipe_close(int *my_pipe);
+static int bridge_channel_service(struct ast_bridge_channel *bridge_channel);
+
+/*!
+ * \internal
+ * \brief Determine if an event loop can service the bridge_channel.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to check.
+ *
+ * \details
+ * An event loop only services bridge channels passing media.  Anything
+ * needing a timer or possibly blocking for long, such as DTMF and interval
+ * hooks or a pending absolute timeout, needs a thread of its own.
+ *
+ * \retval non-zero if the channel can be serviced by an event loop.
+ */
+static int bridge_channel_event_loop_eligible(struct ast_bridge_channel *bridge_channel)
+{
+	struct ast_bridge_features *features = bridge_channel->features;
+	int eligible;
+
+	if (bridge_channel->state != BRIDGE_CHANNEL_STATE_WAIT
+		|| bridge_channel->suspended
+		|| bridge_channel->dtmf_hook_state.collected[0]
+		|| ao2_container_count(features->dtmf_hooks)
+		|| ast_heap_size(features->interval_hooks)) {
+		return 0;
+	}
+
+	ast_channel_lock(bridge_channel->chan);
+	eligible = ast_tvzero(*ast_channel_whentohangup(bridge_channel->chan));
+	ast_channel_unlock(bridge_channel->chan);
+
+	return eligible;
+}
+
+/*!
+ * \internal
+ * \brief Determine if the next frame to write to the bridge_channel is media.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to check.
+ *
+ * \note Bridge actions and control frames can run dialplan or wait,
+ * so they are only handled by a thread of the channel.
+ *
+ * \retval non-zero if the next frame can be written by an event loop.
+ */
+static int bridge_channel_write_is_media(struct ast_bridge_channel *bridge_channel)
+{
+	struct ast_frame *fr;
+	int media = 1;
+
+	ast_bridge_channel_lock(bridge_channel);
+	bridge_channel_collect_wr_queue(bridge_channel);
+	fr = AST_LIST_FIRST(&bridge_channel->wr_queue);
+	if (fr) {
+		switch (fr->frametype) {
+		case AST_FRAME_BRIDGE_ACTION:
+		case AST_FRAME_BRIDGE_ACTION_SYNC:
+		case AST_FRAME_CONTROL:
+			media = 0;
+			break;
+		default:
+			break;
+		}
+	}
+	ast_bridge_channel_unlock(bridge_channel);
+
+	return media;
+}
+
+/*!
+ * \internal
+ * \brief Handle a reconfiguration request of the channel, as bridge_channel_wait() does.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to check.
+ *
+ * \return Nothing
+ */
+static void bridge_channel_check_unbridged(struct ast_bridge_channel *bridge_channel)
+{
+	if (ast_channel_unbridged(bridge_channel->chan)) {
+		ast_channel_set_unbridged(bridge_channel->chan, 0);
+		ast_bridge_channel_lock_bridge(bridge_channel);
+		bridge_channel->bridge->reconfigured = 1;
+		bridge_reconfigured(bridge_channel->bridge, 0);
+		ast_bridge_unlock(bridge_channel->bridge);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Handle an event of a bridge_channel serviced by an event loop.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel the event is for.
+ * \param fdno Index of the ready channel file descriptor, -1 if none.
+ * \param exception Non-zero if the ready channel file descriptor has priority data.
+ * \param alert Non-zero if a frame is queued to write to the channel.
+ *
+ * \retval 0 if the event loop keeps servicing the channel.
+ * \retval -1 if the channel needs a thread of its own.
+ */
+static int bridge_event_loop_service(struct ast_bridge_channel *bridge_channel,
+	int fdno, int exception, int alert)
+{
+	if (!bridge_channel_event_loop_eligible(bridge_channel)) {
+		return -1;
+	}
+	if (fdno < 0 && !alert) {
+		return 0;
+	}
+
+	ast_callid_threadassoc_change(bridge_channel->callid);
+	bridge_channel_check_unbridged(bridge_channel);
+	if (fdno > -1) {
+		if (exception) {
+			ast_set_flag(ast_channel_flags(bridge_channel->chan), AST_FLAG_EXCEPTION);
+		} else {
+			ast_clear_flag(ast_channel_flags(bridge_channel->chan), AST_FLAG_EXCEPTION);
+		}
+		ast_channel_fdno_set(bridge_channel->chan, fdno);
+		bridge_channel->activity = BRIDGE_CHANNEL_THREAD_FRAME;
+		bridge_handle_trip(bridge_channel);
+	} else if (bridge_channel_write_is_media(bridge_channel)) {
+		bridge_channel->activity = BRIDGE_CHANNEL_THREAD_FRAME;
+		bridge_channel_handle_write(bridge_channel);
+	} else {
+		return -1;
+	}
+	bridge_channel->activity = BRIDGE_CHANNEL_THREAD_IDLE;
+
+	return bridge_channel_event_loop_eligible(bridge_channel) ? 0 : -1;
+}
+
+/*! \brief Thread servicing a bridge channel an event loop handed back */
+static void *bridge_channel_event_loop_resume(void *data)
+{
+	struct ast_bridge_channel *bridge_channel = data;
+
+	bridge_channel->thread = pthread_self();
+	if (bridge_channel->callid) {
+		ast_callid_threadassoc_add(bridge_channel->callid);
+	}
+
+	if (bridge_channel_service(bridge_channel)) {
+		/* An event loop services the bridge channel again. */
+		return NULL;
+	}
+	bridge_channel_leave(bridge_channel, NULL);
+	bridge_channel_ind_complete(bridge_channel);
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Create a thread of its own for a bridge_channel serviced by an event loop.
+ * \since 14.0.0
+ *
+ * \param loop Event loop servicing the channel.
+ * \param bridge_channel Channel to hand back.
+ *
+ * \retval 0 on success.  The event loop must stop using the bridge_channel.
+ * \retval -1 if no thread could be created.
+ */
+static int bridge_event_loop_spawn(struct bridge_event_loop *loop, struct ast_bridge_channel *bridge_channel)
+{
+	pthread_t thread;
+
+	ast_debug(3, "Bridge %s: %p(%s) is leaving the event loop\n",
+		bridge_channel->bridge->uniqueid, bridge_channel,
+		ast_channel_name(bridge_channel->chan));
+
+	bridge_channel->activity = BRIDGE_CHANNEL_THREAD_IDLE;
+	if (ast_pthread_create_detached(&thread, NULL, bridge_channel_event_loop_resume, bridge_channel)) {
+		return -1;
+	}
+	ast_atomic_fetchadd_int(&loop->count, -1);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Hand a bridge_channel serviced by an event loop to a thread of its own.
+ * \since 14.0.0
+ *
+ * \param loop Event loop servicing the channel.
+ * \param bridge_channel Channel to hand back.
+ *
+ * \details
+ * If no thread can be created right now, the event loop tries again
+ * later.  The channel is not serviced meanwhile, but the other channels
+ * of the event loop are.
+ *
+ * \retval 0 on success.  The caller must stop using the bridge_channel.
+ * \retval -1 if the caller has to keep the bridge_channel.
+ */
+static int bridge_event_loop_detach(struct bridge_event_loop *loop, struct ast_bridge_channel *bridge_channel)
+{
+	if (!bridge_event_loop_spawn(loop, bridge_channel)) {
+		return 0;
+	}
+
+	ast_log(LOG_WARNING, "Bridge %s: Could not create a thread for %s, trying again\n",
+		bridge_channel->bridge->uniqueid, ast_channel_name(bridge_channel->chan));
+	return AST_VECTOR_APPEND(&loop->detaching, bridge_channel) ? -1 : 0;
+}
+
+/*! \brief Size of the pollfd array of an event loop servicing count channels */
+#define BRIDGE_EVENT_LOOP_FDS(count) (1 + (count) * (AST_MAX_FDS + 1))
+
+/*!
+ * \internal
+ * \brief Grow the poll arrays of an event loop.
+ * \since 14.0.0
+ *
+ * \param pfds The pollfd array.
+ * \param fdnos The channel file descriptor index of each pollfd.
+ * \param spans The pollfd positions of each channel.
+ * \param size Number of pollfds to make room for.
+ *
+ * \note The arrays keep their contents, and keep any growth on failure.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int bridge_event_loop_grow(struct pollfd **pfds, int **fdnos,
+	struct bridge_event_loop_span **spans, int size)
+{
+	struct pollfd *new_pfds;
+	int *new_fdnos;
+	struct bridge_event_loop_span *new_spans;
+
+	new_pfds = ast_realloc(*pfds, size * sizeof(**pfds));
+	if (!new_pfds) {
+		return -1;
+	}
+	*pfds = new_pfds;
+	new_fdnos = ast_realloc(*fdnos, size * sizeof(**fdnos));
+	if (!new_fdnos) {
+		return -1;
+	}
+	*fdnos = new_fdnos;
+	new_spans = ast_realloc(*spans, size * sizeof(**spans));
+	if (!new_spans) {
+		return -1;
+	}
+	*spans = new_spans;
+
+	return 0;
+}
+
+/*! \brief Thread of an event loop servicing bridge channels */
+static void *bridge_event_loop_thread(void *data)
+{
+	struct bridge_event_loop *loop = data;
+	struct pollfd *pfds = NULL;
+	int *fdnos = NULL;
+	struct bridge_event_loop_span *spans = NULL;
+	int size = 0;
+	struct timeval sweep = ast_tvnow();
+
+	for (;;) {
+		struct ast_bridge_channel *bridge_channel;
+		int idx;
+		int x;
+		int max;
+		int ms;
+		int res;
+		int sweeping;
+		int count;
+
+		/* Try again to create the threads that could not be created before. */
+		for (idx = AST_VECTOR_SIZE(&loop->detaching); idx--;) {
+			if (!bridge_event_loop_spawn(loop, AST_VECTOR_GET(&loop->detaching, idx))) {
+				AST_VECTOR_REMOVE_UNORDERED(&loop->detaching, idx);
+			}
+		}
+
+		/* Pick up the attached bridge channels. */
+		ast_mutex_lock(&loop->lock);
+		while (AST_VECTOR_SIZE(&loop->pending)) {
+			bridge_channel = AST_VECTOR_GET(&loop->pending, 0);
+			if (AST_VECTOR_APPEND(&loop->channels, bridge_channel)
+				&& bridge_event_loop_detach(loop, bridge_channel)) {
+				/* Leave it pending until there is room for it. */
+				break;
+			}
+			AST_VECTOR_REMOVE_UNORDERED(&loop->pending, 0);
+		}
+		ast_mutex_unlock(&loop->lock);
+
+		x = BRIDGE_EVENT_LOOP_FDS(AST_VECTOR_SIZE(&loop->channels));
+		if (size < x) {
+			if (bridge_event_loop_grow(&pfds, &fdnos, &spans, x)) {
+				/* Hand back the channels that don't fit. */
+				while (AST_VECTOR_SIZE(&loop->channels)
+					&& size < BRIDGE_EVENT_LOOP_FDS(AST_VECTOR_SIZE(&loop->channels))
+					&& !bridge_event_loop_detach(loop, AST_VECTOR_GET(&loop->channels,
+						AST_VECTOR_SIZE(&loop->channels) - 1))) {
+					AST_VECTOR_REMOVE_UNORDERED(&loop->channels, AST_VECTOR_SIZE(&loop->channels) - 1);
+				}
+				if (!size) {
+					usleep(1000);
+					continue;
+				}
+			} else {
+				size = x;
+			}
+		}
+
+		/* Only the channels that fit are polled, the others wait for room. */
+		count = MIN(AST_VECTOR_SIZE(&loop->channels), (size - 1) / (AST_MAX_FDS + 1));
+
+		/* The alert pipe of the event loop comes first, then each channel's fds and alert pipe. */
+		max = 0;
+		max += ast_add_fd(&pfds[max], loop->alert_pipe[0]);
+		for (idx = 0; idx < count; idx++) {
+			bridge_channel = AST_VECTOR_GET(&loop->channels, idx);
+			spans[idx].start = max;
+			for (x = 0; x < AST_MAX_FDS; x++) {
+				fdnos[max] = x;
+				max += ast_add_fd(&pfds[max], ast_channel_fd(bridge_channel->chan, x));
+			}
+			spans[idx].alert = max;
+			max += ast_add_fd(&pfds[max], bridge_channel->alert_pipe[0]);
+		}
+
+		ms = BRIDGE_EVENT_LOOP_SWEEP_MS - ast_tvdiff_ms(ast_tvnow(), sweep);
+		if (AST_VECTOR_SIZE(&loop->detaching) || count < AST_VECTOR_SIZE(&loop->channels)) {
+			ms = MIN(ms, BRIDGE_EVENT_LOOP_RETRY_MS);
+		}
+		res = ast_poll(pfds, max, MAX(ms, 0));
+		if (res < 0) {
+			if (errno != EINTR) {
+				ast_log(LOG_WARNING, "Bridge event loop poll failed: %s\n", strerror(errno));
+				usleep(1000);
+			}
+			continue;
+		}
+
+		if (pfds[0].revents) {
+			char nudge[64];
+
+			while (read(loop->alert_pipe[0], nudge, sizeof(nudge)) > 0) {
+			}
+		}
+
+		sweeping = ast_tvdiff_ms(ast_tvnow(), sweep) >= BRIDGE_EVENT_LOOP_SWEEP_MS;
+		if (sweeping) {
+			/* Check every channel, whether it has an event or not. */
+			sweep = ast_tvnow();
+		} else if (!res) {
+			continue;
+		}
+
+		/*
+		 * Go backwards so removing a channel only moves a channel
+		 * that was already serviced, or is not polled, in its place.
+		 */
+		for (idx = count; idx--;) {
+			int fdno = -1;
+			int exception = 0;
+
+			bridge_channel = AST_VECTOR_GET(&loop->channels, idx);
+
+			/* The last ready file descriptor wins, as with ast_waitfor_n(). */
+			for (x = spans[idx].start; x < spans[idx].alert; x++) {
+				if (pfds[x].revents) {
+					fdno = fdnos[x];
+					exception = pfds[x].revents & POLLPRI;
+				}
+			}
+			if (fdno < 0 && !pfds[spans[idx].alert].revents && !sweeping) {
+				continue;
+			}
+			if (bridge_event_loop_service(bridge_channel, fdno, exception,
+				pfds[spans[idx].alert].revents)
+				&& !bridge_event_loop_detach(loop, bridge_channel)) {
+				AST_VECTOR_REMOVE_UNORDERED(&loop->channels, idx);
+			}
+		}
+		ast_callid_threadassoc_change(0);
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start the bridge channel event loops.
+ * \since 14.0.0
+ *
+ * \retval 0 if at least one event loop runs.
+ * \retval -1 on error.
+ */
+static int bridge_event_loops_start(void)
+{
+	struct bridge_event_loop *loop;
+
+	ast_mutex_lock(&event_loops_lock);
+	while (event_loops_started < BRIDGE_EVENT_LOOPS) {
+		loop = &event_loops[event_loops_started];
+		ast_mutex_init(&loop->lock);
+		if (AST_VECTOR_INIT(&loop->pending, 8)
+			|| AST_VECTOR_INIT(&loop->channels, 32)
+			|| AST_VECTOR_INIT(&loop->detaching, 8)
+			|| pipe_init_nonblock(loop->alert_pipe)
+			|| ast_pthread_create_detached_background(&loop->thread, NULL,
+				bridge_event_loop_thread, loop)) {
+			pipe_close(loop->alert_pipe);
+			AST_VECTOR_FREE(&loop->detaching);
+			AST_VECTOR_FREE(&loop->channels);
+			AST_VECTOR_FREE(&loop->pending);
+			ast_mutex_destroy(&loop->lock);
+			break;
+		}
+		++event_loops_started;
+	}
+	ast_mutex_unlock(&event_loops_lock);
+
+	return event_loops_started ? 0 : -1;
+}
+
+/*!
+ * \internal
+ * \brief Hand a bridge_channel to the least busy event loop.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to hand over.
+ *
+ * \note The calling thread must stop using the bridge_channel on success.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the channel needs a thread of its own.
+ */
+static int bridge_event_loop_attach(struct ast_bridge_channel *bridge_channel)
+{
+	struct bridge_event_loop *loop;
+	int started;
+	int idx;
+	int res;
+	char nudge = 0;
+
+	if (!bridge_channel_event_loop_eligible(bridge_channel)) {
+		return -1;
+	}
+
+	started = event_loops_started;
+	if (!started) {
+		if (bridge_event_loops_start()) {
+			bridge_channel->event_loop = 0;
+			return -1;
+		}
+		started = event_loops_started;
+	}
+
+	loop = &event_loops[0];
+	for (idx = 1; idx < started; idx++) {
+		if (event_loops[idx].count < loop->count) {
+			loop = &event_loops[idx];
+		}
+	}
+
+	ast_debug(3, "Bridge %s: %p(%s) is entering an event loop\n",
+		bridge_channel->bridge->uniqueid, bridge_channel,
+		ast_channel_name(bridge_channel->chan));
+
+	/*
+	 * The channel has no thread of its own while the event loop services
+	 * it, so pokes always queue a frame to wake up the event loop.
+	 */
+	bridge_channel->thread = AST_PTHREADT_NULL;
+
+	ast_mutex_lock(&loop->lock);
+	res = AST_VECTOR_APPEND(&loop->pending, bridge_channel);
+	if (res) {
+		bridge_channel->thread = pthread_self();
+	} else {
+		ast_atomic_fetchadd_int(&loop->count, +1);
+		if (write(loop->alert_pipe[1], &nudge, sizeof(nudge)) != sizeof(nudge)) {
+			/* The pipe is full, so the event loop is awake anyway. */
+		}
+	}
+	ast_mutex_unlock(&loop->lock);
+
+	return res ? -1 : 0;
+}
+
+/*!
+ * \internal
+ * \brief Service the bridge_channel until it leaves the bridge.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to service.
+ *
+ * \note On return of 0, bridge_channel->bridge is locked.
+ *
+ * \retval 0 when the channel was told to leave the bridge.
+ * \retval 1 when an event loop services the channel now.
+ */
+static int bridge_channel_service(struct ast_bridge_channel *bridge_channel)
+{
+	while (bridge_channel->state == BRIDGE_CHANNEL_STATE_WAIT) {
+		if (bridge_channel->event_loop && !bridge_event_loop_attach(bridge_channel)) {
+			return 1;
+		}
+
+		/* Wait for something to do. */
+		bridge_channel_wait(bridge_channel);
+	}
+
+	/* Force a timeout on any accumulated DTMF hook digits. */
+	ast_bridge_channel_feature_digit(bridge_channel, 0);
+
+	bridge_channel_event_join_leave(bridge_channel, AST_BRIDGE_HOOK_TYPE_LEAVE);
+	ast_bridge_channel_lock_bridge(bridge_channel);
+
+	return 0;
+}
+
 void bridge_channel_internal_wait(struct bridge_channel_internal_cond *cond)
 {
 	ast_mutex_lock(&cond->lock);
@@ -2677,58 +3443,13 @@ int bridge_channel_internal_join(struct ast_bridge_channel *bridge_channel,
 
 		bridge_channel_event_join_leave(bridge_channel, AST_BRIDGE_HOOK_TYPE_JOIN);
 
-		while (bridge_channel->state == BRIDGE_CHANNEL_STATE_WAIT) {
-			/* Wait for something to do. */
-			bridge_channel_wait(bridge_channel);
+		if (bridge_channel_service(bridge_channel)) {
+			/* An event loop services the bridge channel now. */
+			return 1;
 		}
-
-		/* Force a timeout on any accumulated DTMF hook digits. */
-		ast_bridge_channel_feature_digit(bridge_channel, 0);
-
-		bridge_channel_event_join_leave(bridge_channel, AST_BRIDGE_HOOK_TYPE_LEAVE);
-		ast_bridge_channel_lock_bridge(bridge_channel);
 	}
 
-	bridge_channel_internal_pull(bridge_channel);
-	bridge_channel_settle_owed_events(bridge_channel->bridge, bridge_channel);
-	bridge_reconfigured(bridge_channel->bridge, 1);
-
-	ast_bridge_unlock(bridge_channel->bridge);
-
-	/* Must release any swap ref after unlocking the bridge. */
-	ao2_t_cleanup(swap, "Bridge push with swap failed or exited immediately");
-
-	/* Complete any active hold before exiting the bridge. */
-	if (ast_channel_hold_state(bridge_channel->chan) == AST_CONTROL_HOLD) {
-		ast_debug(1, "Channel %s simulating UNHOLD for bridge end.\n",
-			ast_channel_name(bridge_channel->chan));
-		ast_indicate(bridge_channel->chan, AST_CONTROL_UNHOLD);
-	}
-
-	/* Complete any partial DTMF digit before exiting the bridge. */
-	if (ast_channel_sending_dtmf_digit(bridge_channel->chan)) {
-		ast_channel_end_dtmf(bridge_channel->chan,
-			ast_channel_sending_dtmf_digit(bridge_channel->chan),
-			ast_channel_sending_dtmf_tv(bridge_channel->chan), "bridge end");
-	}
-
-	/* Indicate a source change since this channel is leaving the bridge system. */
-	ast_indicate(bridge_channel->chan, AST_CONTROL_SRCCHANGE);
-
-	/*
-	 * Wait for any dual redirect to complete.
-	 *
-	 * Must be done while "still in the bridge" for ast_async_goto()
-	 * to work right.
-	 */
-	while (ast_test_flag(ast_channel_flags(bridge_channel->chan), AST_FLAG_BRIDGE_DUAL_REDIRECT_WAIT)) {
-		sched_yield();
-	}
-	ast_channel_lock(bridge_channel->chan);
-	ast_channel_internal_bridge_set(bridge_channel->chan, NULL);
-	ast_channel_unlock(bridge_channel->chan);
-
-	ast_bridge_channel_restore_formats(bridge_channel);
+	bridge_channel_leave(bridge_channel, swap);
 
 	return res;
 }
@@ -2784,7 +3505,8 @@ int bridge_channel_internal_queue_attended_transfer(struct ast_channel *transfer
 int bridge_channel_internal_allows_optimization(struct ast_bridge_channel *bridge_channel)
 {
 	return bridge_channel->in_bridge
-		&& AST_LIST_EMPTY(&bridge_channel->wr_queue);
+		&& AST_LIST_EMPTY(&bridge_channel->wr_queue)
+		&& !bridge_channel->wr_incoming;
 }
 
 /*!
@@ -2843,6 +3565,52 @@ static int pipe_init_nonblock(int *my_pipe)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Create the wr_queue alert of a bridge channel.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to create the alert of.
+ *
+ * \details
+ * An eventfd is used where available, in both slots of the alert pipe.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int bridge_channel_alert_init(struct ast_bridge_channel *bridge_channel)
+{
+#ifdef __linux__
+	bridge_channel->alert_pipe[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (bridge_channel->alert_pipe[0] > -1) {
+		bridge_channel->alert_pipe[1] = bridge_channel->alert_pipe[0];
+		return 0;
+	}
+	ast_log(LOG_WARNING, "Can't create eventfd! Try increasing max file descriptors with ulimit -n\n");
+	bridge_channel->alert_pipe[1] = -1;
+	return -1;
+#else
+	return pipe_init_nonblock(bridge_channel->alert_pipe);
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Close the wr_queue alert of a bridge channel.
+ * \since 14.0.0
+ *
+ * \param bridge_channel Channel to close the alert of.
+ *
+ * \return Nothing
+ */
+static void bridge_channel_alert_close(struct ast_bridge_channel *bridge_channel)
+{
+	if (bridge_channel->alert_pipe[0] == bridge_channel->alert_pipe[1]) {
+		bridge_channel->alert_pipe[1] = -1;
+	}
+	pipe_close(bridge_channel->alert_pipe);
+}
+
 /* Destroy elements of the bridge channel structure and the bridge channel structure itself */
 static void bridge_channel_destroy(void *obj)
 {
@@ -2859,10 +3627,11 @@ static void bridge_channel_destroy(void *obj)
 	}
 
 	/* Flush any unhandled wr_queue frames. */
+	bridge_channel_collect_wr_queue(bridge_channel);
 	while ((fr = AST_LIST_REMOVE_HEAD(&bridge_channel->wr_queue, frame_list))) {
 		bridge_frame_free(fr);
 	}
-	pipe_close(bridge_channel->alert_pipe);
+	bridge_channel_alert_close(bridge_channel);
 
 	ast_cond_destroy(&bridge_channel->cond);
 
@@ -2879,7 +3648,7 @@ struct ast_bridge_channel *bridge_channel_internal_alloc(struct ast_bridge *brid
 		return NULL;
 	}
 	ast_cond_init(&bridge_channel->cond, NULL);
-	if (pipe_init_nonblock(bridge_channel->alert_pipe)) {
+	if (bridge_channel_alert_init(bridge_channel)) {
 		ao2_ref(bridge_channel, -1);
 		return NULL;
 	}
@@ -71,6 +71,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/stasis_bridges.h"
 #include "asterisk/stasis_message_router.h"
 #include "asterisk/astobj2.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
 
 /*** DOCUMENTATION
 	<configInfo name="cdr" language="en_US">
@@ -290,6 +292,7 @@ struct cdr_beitem {
 	char name[20];
 	char desc[80];
 	ast_cdrbe be;
+	ast_cdrbe_batch batch_be;
 	AST_RWLIST_ENTRY(cdr_beitem) list;
 	int suspended:1;
 };
@@ -335,6 +338,24 @@ static struct ao2_container *active_cdrs_by_channel;
 /*! \brief Message router for stasis messages regarding channel state */
 static struct stasis_message_router *stasis_router;
 
+/*! \brief The number of serializers CDR messages are shared out between */
+#define NUM_CDR_SHARDS 8
+
+/*! \brief The threads the CDR serializers run on */
+static struct ast_threadpool *cdr_pool;
+
+/*!
+ * \brief The serializers that run the CDR state machines
+ *
+ * Every message about a channel goes to the same serializer, chosen by the
+ * linkedid the channel had when its CDR was created, so the messages of a call
+ * are processed in order while other calls are processed in parallel.
+ */
+static struct ast_taskprocessor *cdr_shards[NUM_CDR_SHARDS];
+
+/*! \brief Lock that lets one channel at a time make pairings as it enters a bridge */
+AST_MUTEX_DEFINE_STATIC(cdr_bridge_enter_lock);
+
 /*! \brief Our subscription for bridges */
 static struct stasis_forward *bridge_subscription;
 
@@ -685,6 +706,7 @@ struct cdr_object {
 	struct timeval end;                     /*!< When this CDR was finalized */
 	unsigned int sequence;                  /*!< A monotonically increasing number for each CDR */
 	struct ast_flags flags;                 /*!< Flags on the CDR */
+	unsigned int shard;                     /*!< The serializer that processes Party A's messages */
 	AST_DECLARE_STRING_FIELDS(
 		AST_STRING_FIELD(linkedid);         /*!< Linked ID. Cached here as it may change out from party A, which must be immutable */
 		AST_STRING_FIELD(uniqueid);			/*!< Unique id of party A. Cached here as it is the primary key of this CDR */
@@ -1902,6 +1924,170 @@ static int filter_channel_cache_message(struct ast_channel_snapshot *old_snapsho
 	return ret;
 }
 
+/* CDR SHARDS */
+
+/*! \brief The shard for the messages of a call */
+static unsigned int cdr_shard_for_linkedid(const char *linkedid)
+{
+	return (unsigned int) ast_str_hash(linkedid) % NUM_CDR_SHARDS;
+}
+
+/*!
+ * \internal
+ * \brief The shard for the messages about a channel
+ *
+ * A channel keeps the shard it was given when its CDR was created, even if its
+ * linkedid changes later.
+ */
+static unsigned int cdr_shard_for_channel(struct ast_channel_snapshot *snapshot)
+{
+	struct cdr_object *cdr;
+	unsigned int shard;
+
+	cdr = ao2_find(active_cdrs_by_channel, snapshot->uniqueid, OBJ_KEY);
+	if (!cdr) {
+		return cdr_shard_for_linkedid(snapshot->linkedid);
+	}
+	shard = cdr->shard;
+	ao2_ref(cdr, -1);
+	return shard;
+}
+
+/*! \brief Whether the current thread is running one of the CDR serializers */
+static int cdr_shard_is_current(void)
+{
+	struct ast_taskprocessor *current = ast_threadpool_serializer_get_current();
+	int i;
+
+	if (!current) {
+		return 0;
+	}
+	for (i = 0; i < NUM_CDR_SHARDS; ++i) {
+		if (cdr_shards[i] == current) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*! \brief A message waiting on a shard for its handler */
+struct cdr_shard_task {
+	stasis_subscription_cb handler;
+	struct stasis_message *message;
+};
+
+static int cdr_shard_task_exec(void *data)
+{
+	struct cdr_shard_task *task = data;
+
+	task->handler(NULL, NULL, task->message);
+	ao2_ref(task->message, -1);
+	ast_free(task);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Have a shard run a handler on a message
+ */
+static void cdr_shard_push(unsigned int shard, stasis_subscription_cb handler,
+	struct stasis_message *message)
+{
+	struct cdr_shard_task *task;
+
+	task = ast_malloc(sizeof(*task));
+	if (!task) {
+		return;
+	}
+	task->handler = handler;
+	task->message = ao2_bump(message);
+	if (ast_taskprocessor_push(cdr_shards[shard], cdr_shard_task_exec, task)) {
+		ao2_ref(task->message, -1);
+		ast_free(task);
+	}
+}
+
+struct cdr_shard_sync_data {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	int done;
+};
+
+static int cdr_shard_sync_task(void *data)
+{
+	struct cdr_shard_sync_data *sync = data;
+
+	ast_mutex_lock(&sync->lock);
+	sync->done = 1;
+	ast_cond_signal(&sync->cond);
+	ast_mutex_unlock(&sync->lock);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Wait for a shard to process the messages already given to it
+ *
+ * \retval 0 if there was no need to wait
+ * \retval 1 if the shard was waited on
+ */
+static int cdr_shard_sync(unsigned int shard)
+{
+	struct cdr_shard_sync_data sync = { .done = 0, };
+
+	/* A shard waiting on a shard could wait forever */
+	if (!cdr_shards[shard] || cdr_shard_is_current()) {
+		return 0;
+	}
+
+	ast_mutex_init(&sync.lock);
+	ast_cond_init(&sync.cond, NULL);
+	if (!ast_taskprocessor_push(cdr_shards[shard], cdr_shard_sync_task, &sync)) {
+		ast_mutex_lock(&sync.lock);
+		while (!sync.done) {
+			ast_cond_wait(&sync.cond, &sync.lock);
+		}
+		ast_mutex_unlock(&sync.lock);
+	}
+	ast_cond_destroy(&sync.cond);
+	ast_mutex_destroy(&sync.lock);
+	return 1;
+}
+
+/*! \brief Wait for every shard to process the messages already given to it */
+static void cdr_shards_sync(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_CDR_SHARDS; ++i) {
+		cdr_shard_sync(i);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Run a callback on every active CDR, each with its lock held
+ *
+ * Other shards may be processing the CDRs at the same time, so each one is
+ * locked in turn, without the container locked.
+ */
+static void cdr_object_callback_locked(ao2_callback_fn *cb, void *arg)
+{
+	struct ao2_iterator *it_cdrs;
+	struct cdr_object *cdr;
+
+	it_cdrs = ao2_callback(active_cdrs_by_channel, OBJ_MULTIPLE, NULL, NULL);
+	if (!it_cdrs) {
+		return;
+	}
+	for (; (cdr = ao2_iterator_next(it_cdrs)); ao2_ref(cdr, -1)) {
+		ao2_lock(cdr);
+		cb(cdr, arg, 0);
+		ao2_unlock(cdr);
+	}
+	ao2_iterator_destroy(it_cdrs);
+}
+
 /* TOPIC ROUTER CALLBACKS */
 
 /*!
@@ -2091,18 +2277,8 @@ static void handle_channel_cache_message(void *data, struct stasis_subscription
 		return;
 	}
 
-	if (new_snapshot && !old_snapshot) {
-		cdr = cdr_object_alloc(new_snapshot);
-		if (!cdr) {
-			return;
-		}
-		ao2_link(active_cdrs_by_channel, cdr);
-	}
-
-	/* Handle Party A */
-	if (!cdr) {
-		cdr = ao2_find(active_cdrs_by_channel, uniqueid, OBJ_KEY);
-	}
+	/* Handle Party A, whose CDR was made when the message was given to us */
+	cdr = ao2_find(active_cdrs_by_channel, uniqueid, OBJ_KEY);
 	if (!cdr) {
 		ast_log(AST_LOG_WARNING, "No CDR for channel %s\n", name);
 		ast_assert(0);
@@ -2137,11 +2313,9 @@ static void handle_channel_cache_message(void *data, struct stasis_subscription
 
 	/* Handle Party B */
 	if (new_snapshot) {
-		ao2_callback(active_cdrs_by_channel, OBJ_NODATA, cdr_object_update_party_b,
-			new_snapshot);
+		cdr_object_callback_locked(cdr_object_update_party_b, new_snapshot);
 	} else {
-		ao2_callback(active_cdrs_by_channel, OBJ_NODATA, cdr_object_finalize_party_b,
-			old_snapshot);
+		cdr_object_callback_locked(cdr_object_finalize_party_b, old_snapshot);
 	}
 
 }
@@ -2255,9 +2429,7 @@ static void handle_bridge_leave_message(void *data, struct stasis_subscription *
 
 	if (strcmp(bridge->subclass, "parking")) {
 		/* Party B */
-		ao2_callback(active_cdrs_by_channel, OBJ_NODATA,
-				cdr_object_party_b_left_bridge_cb,
-				&leave_data);
+		cdr_object_callback_locked(cdr_object_party_b_left_bridge_cb, &leave_data);
 	}
 }
 
@@ -2537,7 +2709,11 @@ static void handle_bridge_enter_message(void *data, struct stasis_subscription *
 	if (!strcmp(bridge->subclass, "parking")) {
 		handle_parking_bridge_enter_message(cdr, bridge, channel);
 	} else {
+		/* Pairing locks the CDRs of the others in the bridge while holding
+		 * ours, so only one shard may do it at a time */
+		ast_mutex_lock(&cdr_bridge_enter_lock);
 		handle_standard_bridge_enter_message(cdr, bridge, channel);
+		ast_mutex_unlock(&cdr_bridge_enter_lock);
 	}
 }
 
@@ -2618,7 +2794,99 @@ static void handle_parked_call_message(void *data, struct stasis_subscription *s
 static void handle_cdr_sync_message(void *data, struct stasis_subscription *sub,
 		struct stasis_message *message)
 {
-	return;
+	cdr_shards_sync();
+}
+
+/*!
+ * \internal
+ * \brief Give a message about a channel to the channel's shard
+ */
+static void dispatch_channel_message(struct ast_channel_snapshot *snapshot,
+		stasis_subscription_cb handler, struct stasis_message *message)
+{
+	cdr_shard_push(cdr_shard_for_channel(snapshot), handler, message);
+}
+
+/*!
+ * \brief Give a channel cache update to the channel's shard
+ *
+ * The CDR of a new channel is created here rather than by the shard, so the
+ * channel's later messages find it and go to the same shard.
+ */
+static void dispatch_channel_cache_message(void *data, struct stasis_subscription *sub,
+		struct stasis_message *message)
+{
+	struct stasis_cache_update *update = stasis_message_data(message);
+	struct ast_channel_snapshot *old_snapshot;
+	struct ast_channel_snapshot *new_snapshot;
+	struct cdr_object *cdr;
+
+	old_snapshot = stasis_message_data(update->old_snapshot);
+	new_snapshot = stasis_message_data(update->new_snapshot);
+
+	if (filter_channel_cache_message(old_snapshot, new_snapshot)) {
+		return;
+	}
+
+	if (new_snapshot && !old_snapshot) {
+		cdr = cdr_object_alloc(new_snapshot);
+		if (!cdr) {
+			return;
+		}
+		cdr->shard = cdr_shard_for_linkedid(new_snapshot->linkedid);
+		ao2_link(active_cdrs_by_channel, cdr);
+		cdr_shard_push(cdr->shard, handle_channel_cache_message, message);
+		ao2_ref(cdr, -1);
+		return;
+	}
+
+	dispatch_channel_message(new_snapshot ? new_snapshot : old_snapshot,
+		handle_channel_cache_message, message);
+}
+
+/*! \brief Give a dial message to the shard of the caller, or of the peer if there is none */
+static void dispatch_dial_message(void *data, struct stasis_subscription *sub,
+		struct stasis_message *message)
+{
+	struct ast_multi_channel_blob *payload = stasis_message_data(message);
+	struct ast_channel_snapshot *channel;
+
+	channel = ast_multi_channel_blob_get_channel(payload, "caller");
+	if (!channel) {
+		channel = ast_multi_channel_blob_get_channel(payload, "peer");
+	}
+	if (channel) {
+		dispatch_channel_message(channel, handle_dial_message, message);
+	}
+}
+
+/*! \brief Give a bridge enter message to the channel's shard */
+static void dispatch_bridge_enter_message(void *data, struct stasis_subscription *sub,
+		struct stasis_message *message)
+{
+	struct ast_bridge_blob *update = stasis_message_data(message);
+
+	dispatch_channel_message(update->channel, handle_bridge_enter_message, message);
+}
+
+/*! \brief Give a bridge leave message to the channel's shard */
+static void dispatch_bridge_leave_message(void *data, struct stasis_subscription *sub,
+		struct stasis_message *message)
+{
+	struct ast_bridge_blob *update = stasis_message_data(message);
+
+	dispatch_channel_message(update->channel, handle_bridge_leave_message, message);
+}
+
+/*! \brief Give a parked call message to the parkee's shard */
+static void dispatch_parked_call_message(void *data, struct stasis_subscription *sub,
+		struct stasis_message *message)
+{
+	struct ast_parked_call_payload *payload = stasis_message_data(message);
+
+	if (payload->parkee) {
+		dispatch_channel_message(payload->parkee, handle_parked_call_message, message);
+	}
 }
 
 struct ast_cdr_config *ast_cdr_get_config(void)
@@ -2681,7 +2949,8 @@ int ast_cdr_backend_unsuspend(const char *name)
 	return success;
 }
 
-static int cdr_generic_register(struct be_list *generic_list, const char *name, const char *desc, ast_cdrbe be)
+static int cdr_generic_register(struct be_list *generic_list, const char *name, const char *desc,
+	ast_cdrbe be, ast_cdrbe_batch batch_be)
 {
 	struct cdr_beitem *i = NULL;
 
@@ -2706,6 +2975,7 @@ static int cdr_generic_register(struct be_list *generic_list, const char *name,
 		return -1;
 
 	i->be = be;
+	i->batch_be = batch_be;
 	ast_copy_string(i->name, name, sizeof(i->name));
 	ast_copy_string(i->desc, desc, sizeof(i->desc));
 
@@ -2717,12 +2987,17 @@ static int cdr_generic_register(struct be_list *generic_list, const char *name,
 
 int ast_cdr_register(const char *name, const char *desc, ast_cdrbe be)
 {
-	return cdr_generic_register(&be_list, name, desc, be);
+	return cdr_generic_register(&be_list, name, desc, be, NULL);
+}
+
+int ast_cdr_register_batch(const char *name, const char *desc, ast_cdrbe be, ast_cdrbe_batch batch_be)
+{
+	return cdr_generic_register(&be_list, name, desc, be, batch_be);
 }
 
 int ast_cdr_modifier_register(const char *name, const char *desc, ast_cdrbe be)
 {
-	return cdr_generic_register((struct be_list *)&mo_list, name, desc, be);
+	return cdr_generic_register((struct be_list *)&mo_list, name, desc, be, NULL);
 }
 
 static int ast_cdr_generic_unregister(struct be_list *generic_list, const char *name)
@@ -2925,6 +3200,38 @@ static int cdr_object_get_by_name_cb(void *obj, void *arg, int flags)
 	return 0;
 }
 
+/*! \internal
+ * \brief Look up and retrieve a CDR object by channel name
+ * \param name The name of the channel
+ * \retval NULL on error
+ * \retval The \ref cdr_object for the channel on success, with the reference
+ *	count bumped by one.
+ */
+static struct cdr_object *cdr_object_get_by_name(const char *name)
+{
+	struct cdr_object *cdr;
+	char *param;
+
+	if (ast_strlen_zero(name)) {
+		return NULL;
+	}
+
+	param = ast_strdupa(name);
+	cdr = ao2_callback(active_cdrs_by_channel, 0, cdr_object_get_by_name_cb, param);
+
+	/* Let the channel's shard catch up, so the CDR is as the messages already
+	 * published about the channel left it */
+	if (cdr && cdr_shard_sync(cdr->shard)) {
+		struct cdr_object *current;
+
+		/* The channel may have hung up meanwhile */
+		current = ao2_find(active_cdrs_by_channel, cdr->uniqueid, OBJ_KEY);
+		ao2_ref(cdr, -1);
+		cdr = current;
+	}
+	return cdr;
+}
+
 /* Read Only CDR variables */
 static const char * const cdr_readonly_vars[] = {
 	"clid",
@@ -2965,6 +3272,9 @@ int ast_cdr_setvar(const char *channel_name, const char *name, const char *value
 		}
 	}
 
+	/* Let the channel's shard catch up first */
+	ao2_cleanup(cdr_object_get_by_name(channel_name));
+
 	it_cdrs = ao2_callback(active_cdrs_by_channel, OBJ_MULTIPLE, cdr_object_select_all_by_name_cb, arg);
 	if (!it_cdrs) {
 		ast_log(AST_LOG_ERROR, "Unable to find CDR for channel %s\n", channel_name);
@@ -3077,25 +3387,6 @@ static int cdr_object_format_property(struct cdr_object *cdr_obj, const char *na
 	return 0;
 }
 
-/*! \internal
- * \brief Look up and retrieve a CDR object by channel name
- * \param name The name of the channel
- * \retval NULL on error
- * \retval The \ref cdr_object for the channel on success, with the reference
- *	count bumped by one.
- */
-static struct cdr_object *cdr_object_get_by_name(const char *name)
-{
-	char *param;
-
-	if (ast_strlen_zero(name)) {
-		return NULL;
-	}
-
-	param = ast_strdupa(name);
-	return ao2_callback(active_cdrs_by_channel, 0, cdr_object_get_by_name_cb, param);
-}
-
 int ast_cdr_getvar(const char *channel_name, const char *name, char *value, size_t length)
 {
 	RAII_VAR(struct cdr_object *, cdr, cdr_object_get_by_name(channel_name), ao2_cleanup);
@@ -3271,37 +3562,74 @@ void ast_cdr_setuserfield(const char *channel_name, const char *userfield)
 
 }
 
-static void post_cdr(struct ast_cdr *cdr)
+/*!
+ * \internal
+ * \brief Run the modifiers on a record and decide whether the backends get it
+ *
+ * \retval 1 if the record is to be posted
+ * \retval 0 if it is not
+ */
+static int prepare_post_cdr(struct module_config *mod_cfg, struct ast_cdr *cdr)
 {
-	RAII_VAR(struct module_config *, mod_cfg, ao2_global_obj_ref(module_configs), ao2_cleanup);
 	struct cdr_beitem *i;
 
-	for (; cdr ; cdr = cdr->next) {
-		/* For people, who don't want to see unanswered single-channel events */
-		if (!ast_test_flag(&mod_cfg->general->settings, CDR_UNANSWERED) &&
-				cdr->disposition < AST_CDR_ANSWERED &&
-				(ast_strlen_zero(cdr->channel) || ast_strlen_zero(cdr->dstchannel))) {
-			ast_debug(1, "Skipping CDR  for %s since we weren't answered\n", cdr->channel);
-			continue;
-		}
+	/* For people, who don't want to see unanswered single-channel events */
+	if (!ast_test_flag(&mod_cfg->general->settings, CDR_UNANSWERED) &&
+			cdr->disposition < AST_CDR_ANSWERED &&
+			(ast_strlen_zero(cdr->channel) || ast_strlen_zero(cdr->dstchannel))) {
+		ast_debug(1, "Skipping CDR  for %s since we weren't answered\n", cdr->channel);
+		return 0;
+	}
 
-		/* Modify CDR's */
-		AST_RWLIST_RDLOCK(&mo_list);
-		AST_RWLIST_TRAVERSE(&mo_list, i, list) {
-			i->be(cdr);
-		}
-		AST_RWLIST_UNLOCK(&mo_list);
+	/* Modify CDR's */
+	AST_RWLIST_RDLOCK(&mo_list);
+	AST_RWLIST_TRAVERSE(&mo_list, i, list) {
+		i->be(cdr);
+	}
+	AST_RWLIST_UNLOCK(&mo_list);
+
+	return !ast_test_flag(cdr, AST_CDR_FLAG_DISABLE);
+}
+
+/*!
+ * \internal
+ * \brief Give records to the backends
+ *
+ * Backends that take batches are given all of them in one call.
+ */
+static void post_cdrs(struct ast_cdr **cdrs, size_t count)
+{
+	struct cdr_beitem *i;
+	size_t x;
 
-		if (ast_test_flag(cdr, AST_CDR_FLAG_DISABLE)) {
+	if (!count) {
+		return;
+	}
+
+	AST_RWLIST_RDLOCK(&be_list);
+	AST_RWLIST_TRAVERSE(&be_list, i, list) {
+		if (i->suspended) {
 			continue;
 		}
-		AST_RWLIST_RDLOCK(&be_list);
-		AST_RWLIST_TRAVERSE(&be_list, i, list) {
-			if (!i->suspended) {
-				i->be(cdr);
-			}
+		if (i->batch_be && count > 1) {
+			i->batch_be(cdrs, count);
+			continue;
+		}
+		for (x = 0; x < count; x++) {
+			i->be(cdrs[x]);
+		}
+	}
+	AST_RWLIST_UNLOCK(&be_list);
+}
+
+static void post_cdr(struct ast_cdr *cdr)
+{
+	RAII_VAR(struct module_config *, mod_cfg, ao2_global_obj_ref(module_configs), ao2_cleanup);
+
+	for (; cdr ; cdr = cdr->next) {
+		if (prepare_post_cdr(mod_cfg, cdr)) {
+			post_cdrs(&cdr, 1);
 		}
-		AST_RWLIST_UNLOCK(&be_list);
 	}
 }
 
@@ -3498,12 +3826,42 @@ static int init_batch(void)
 
 static void *do_batch_backend_process(void *data)
 {
+	RAII_VAR(struct module_config *, mod_cfg, ao2_global_obj_ref(module_configs), ao2_cleanup);
 	struct cdr_batch_item *processeditem;
-	struct cdr_batch_item *batchitem = data;
+	struct cdr_batch_item *batchitem;
+	struct ast_cdr **cdrs;
+	struct ast_cdr *cdr;
+	size_t count = 0;
+
+	for (batchitem = data; batchitem; batchitem = batchitem->next) {
+		for (cdr = batchitem->cdr; cdr; cdr = cdr->next) {
+			count++;
+		}
+	}
+
+	/* Push the CDRs into storage mechanism(s) together, or one at a time if
+	 * there is no room to gather them */
+	cdrs = ast_malloc(MAX(count, 1) * sizeof(*cdrs));
+	count = 0;
+	for (batchitem = data; batchitem; batchitem = batchitem->next) {
+		if (!cdrs) {
+			post_cdr(batchitem->cdr);
+			continue;
+		}
+		for (cdr = batchitem->cdr; cdr; cdr = cdr->next) {
+			if (prepare_post_cdr(mod_cfg, cdr)) {
+				cdrs[count++] = cdr;
+			}
+		}
+	}
+	if (cdrs) {
+		post_cdrs(cdrs, count);
+		ast_free(cdrs);
+	}
 
-	/* Push each CDR into storage mechanism(s) and free all the memory */
+	/* Free all the memory */
+	batchitem = data;
 	while (batchitem) {
-		post_cdr(batchitem->cdr);
 		ast_cdr_free(batchitem->cdr);
 		processeditem = batchitem;
 		batchitem = batchitem->next;
@@ -4101,10 +4459,56 @@ static void cdr_engine_cleanup(void)
 	destroy_subscriptions();
 }
 
+/*! \brief Create the serializers that run the CDR state machines */
+static int cdr_shards_create(void)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = NUM_CDR_SHARDS,
+		.max_size = 0,
+	};
+	char name[32];
+	int i;
+
+	cdr_pool = ast_threadpool_create("cdr", NULL, &options);
+	if (!cdr_pool) {
+		return -1;
+	}
+	for (i = 0; i < NUM_CDR_SHARDS; ++i) {
+		snprintf(name, sizeof(name), "cdr-shard-%d", i);
+		cdr_shards[i] = ast_threadpool_serializer(name, cdr_pool);
+		if (!cdr_shards[i]) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*! \brief Process the messages left on the CDR serializers and stop them */
+static void cdr_shards_destroy(void)
+{
+	int i;
+
+	if (!cdr_pool) {
+		return;
+	}
+
+	cdr_shards_sync();
+	for (i = 0; i < NUM_CDR_SHARDS; ++i) {
+		ast_taskprocessor_unreference(cdr_shards[i]);
+		cdr_shards[i] = NULL;
+	}
+	ast_threadpool_shutdown(cdr_pool);
+	cdr_pool = NULL;
+}
+
 static void cdr_engine_shutdown(void)
 {
 	stasis_message_router_unsubscribe_and_join(stasis_router);
 	stasis_router = NULL;
+	cdr_shards_destroy();
 
 	ao2_cleanup(cdr_topic);
 	cdr_topic = NULL;
@@ -4219,11 +4623,15 @@ int ast_cdr_engine_init(void)
 		return -1;
 	}
 
-	stasis_message_router_add_cache_update(stasis_router, ast_channel_snapshot_type(), handle_channel_cache_message, NULL);
-	stasis_message_router_add(stasis_router, ast_channel_dial_type(), handle_dial_message, NULL);
-	stasis_message_router_add(stasis_router, ast_channel_entered_bridge_type(), handle_bridge_enter_message, NULL);
-	stasis_message_router_add(stasis_router, ast_channel_left_bridge_type(), handle_bridge_leave_message, NULL);
-	stasis_message_router_add(stasis_router, ast_parked_call_type(), handle_parked_call_message, NULL);
+	if (cdr_shards_create()) {
+		return -1;
+	}
+
+	stasis_message_router_add_cache_update(stasis_router, ast_channel_snapshot_type(), dispatch_channel_cache_message, NULL);
+	stasis_message_router_add(stasis_router, ast_channel_dial_type(), dispatch_dial_message, NULL);
+	stasis_message_router_add(stasis_router, ast_channel_entered_bridge_type(), dispatch_bridge_enter_message, NULL);
+	stasis_message_router_add(stasis_router, ast_channel_left_bridge_type(), dispatch_bridge_leave_message, NULL);
+	stasis_message_router_add(stasis_router, ast_parked_call_type(), dispatch_parked_call_message, NULL);
 	stasis_message_router_add(stasis_router, cdr_sync_message_type(), handle_cdr_sync_message, NULL);
 
 	active_cdrs_by_channel = ao2_container_alloc(NUM_CDR_BUCKETS,
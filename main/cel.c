@@ -42,6 +42,8 @@ ASTERISK_REGISTER_FILE()
 
 #include "asterisk/_private.h"
 
+#include <sys/stat.h>
+
 #include "asterisk/channel.h"
 #include "asterisk/pbx.h"
 #include "asterisk/cel.h"
@@ -59,6 +61,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/parking.h"
 #include "asterisk/pickup.h"
 #include "asterisk/core_local.h"
+#include "asterisk/paths.h"
 
 /*** DOCUMENTATION
 	<configInfo name="cel" language="en_US">
@@ -71,6 +74,33 @@ ASTERISK_REGISTER_FILE()
 				<configOption name="dateformat">
 					<synopsis>The format to be used for dates when logging</synopsis>
 				</configOption>
+				<configOption name="backendqueue">
+					<synopsis>How many events each backend may have waiting</synopsis>
+					<description><para>When non-zero, events are queued for each backend
+					and given to it by a thread of its own, so a slow backend does not hold
+					up the others or the processing of events. When zero, events are given
+					to the backends as they happen.</para></description>
+				</configOption>
+				<configOption name="backendbatch">
+					<synopsis>The most queued events given to a backend at once</synopsis>
+				</configOption>
+				<configOption name="backendoverflow">
+					<synopsis>What to do with an event for a backend whose queue is full</synopsis>
+					<description>
+					<enumlist>
+						<enum name="block">
+							<para>Wait for the backend to make room.</para>
+						</enum>
+						<enum name="drop">
+							<para>Discard the event.</para>
+						</enum>
+						<enum name="spool">
+							<para>Write the event to a file in the spool directory, to be
+							queued once the queue has emptied.</para>
+						</enum>
+					</enumlist>
+					</description>
+				</configOption>
 				<configOption name="apps">
 					<synopsis>List of apps for CEL to track</synopsis>
 					<description><para>A case-insensitive, comma-separated list of applications
@@ -304,11 +334,315 @@ static const char * const cel_event_types[CEL_MAX_EVENT_IDS] = {
 	[AST_CEL_LOCAL_OPTIMIZE]   = "LOCAL_OPTIMIZE",
 };
 
+/*! \brief Most events given to a backend at once */
+#define CEL_MAX_BACKEND_BATCH 1000
+
+/*! \brief An event waiting to be given to a backend */
+struct cel_queued_event {
+	AST_LIST_ENTRY(cel_queued_event) list;
+	struct ast_event *event;
+};
+
+/*!
+ * \brief The events waiting for a backend, and the thread that gives them to it
+ *
+ * Events that do not fit are written to a spool file, if so configured, and
+ * queued again once the queue has emptied.
+ */
+struct cel_backend_queue {
+	AST_LIST_HEAD_NOLOCK(, cel_queued_event) events;
+	/*! Signalled when events are queued or taken, and when stopping */
+	ast_cond_t cond;
+	pthread_t thread;
+	FILE *spool;                /*!< Events that did not fit, oldest first */
+	long spool_read;            /*!< Where the next event to queue again is in the spool */
+	unsigned int size;          /*!< Events that may be queued */
+	unsigned int batch;         /*!< Most events given to the backend at once */
+	unsigned int depth;         /*!< Events queued */
+	unsigned int peak_depth;    /*!< Most events ever queued */
+	unsigned int spooled;       /*!< Events in the spool */
+	unsigned int stop:1;        /*!< The backend is being unregistered */
+	unsigned int dropping:1;    /*!< Events are being dropped */
+	uint64_t delivered;         /*!< Events given to the backend */
+	uint64_t dropped;           /*!< Events that did not fit and were discarded */
+	uint64_t total_spooled;     /*!< Events that did not fit and were spooled */
+	int64_t latency_total_us;   /*!< Time the backend has taken with the events */
+	int64_t latency_max_us;     /*!< Longest the backend has taken with one delivery */
+};
+
 struct cel_backend {
 	ast_cel_backend_cb callback; /*!< Callback for this backend */
+	ast_cel_backend_batch_cb batch_callback; /*!< Callback for a batch of events, if any */
+	struct cel_backend_queue *queue; /*!< Events waiting for this backend */
 	char name[0];                /*!< Name of this backend */
 };
 
+static void cel_backend_queue_dtor(void *obj)
+{
+	struct cel_backend_queue *queue = obj;
+	struct cel_queued_event *queued;
+
+	while ((queued = AST_LIST_REMOVE_HEAD(&queue->events, list))) {
+		ast_event_destroy(queued->event);
+		ast_free(queued);
+	}
+	if (queue->spool) {
+		fclose(queue->spool);
+	}
+	ast_cond_destroy(&queue->cond);
+}
+
+static void cel_backend_dtor(void *obj)
+{
+	struct cel_backend *backend = obj;
+
+	ao2_cleanup(backend->queue);
+}
+
+/*!
+ * \internal
+ * \brief Write an event that does not fit in a backend's queue to its spool
+ *
+ * \note Call with the queue locked
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int cel_backend_queue_spool(struct cel_backend *backend, const struct ast_event *event)
+{
+	struct cel_backend_queue *queue = backend->queue;
+	uint32_t size = ast_event_get_size(event);
+
+	if (!queue->spool) {
+		char path[PATH_MAX];
+
+		snprintf(path, sizeof(path), "%s/cel", ast_config_AST_SPOOL_DIR);
+		ast_mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/cel/%s.queue", ast_config_AST_SPOOL_DIR, backend->name);
+		queue->spool = fopen(path, "w+");
+		if (!queue->spool) {
+			ast_log(LOG_ERROR, "Unable to open CEL spool '%s': %s\n", path, strerror(errno));
+			return -1;
+		}
+		/* The spool only holds events while this process runs */
+		unlink(path);
+		queue->spool_read = 0;
+	}
+
+	if (fseek(queue->spool, 0, SEEK_END)
+		|| fwrite(&size, sizeof(size), 1, queue->spool) != 1
+		|| fwrite(event, size, 1, queue->spool) != 1) {
+		ast_log(LOG_ERROR, "Unable to write to the CEL spool for backend '%s': %s\n",
+			backend->name, strerror(errno));
+		return -1;
+	}
+	++queue->spooled;
+	++queue->total_spooled;
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue again as many spooled events as fit
+ *
+ * \note Call with the queue locked
+ */
+static void cel_backend_queue_unspool(struct cel_backend *backend)
+{
+	struct cel_backend_queue *queue = backend->queue;
+
+	if (fseek(queue->spool, queue->spool_read, SEEK_SET)) {
+		goto failed;
+	}
+	while (queue->spooled && queue->depth < queue->size) {
+		struct cel_queued_event *queued;
+		uint32_t size;
+
+		if (fread(&size, sizeof(size), 1, queue->spool) != 1
+			|| size < ast_event_minimum_length()) {
+			goto failed;
+		}
+		queued = ast_calloc(1, sizeof(*queued));
+		if (!queued || !(queued->event = ast_malloc(size))
+			|| fread(queued->event, size, 1, queue->spool) != 1) {
+			if (queued) {
+				ast_free(queued->event);
+			}
+			ast_free(queued);
+			goto failed;
+		}
+		AST_LIST_INSERT_TAIL(&queue->events, queued, list);
+		++queue->depth;
+		--queue->spooled;
+	}
+	queue->spool_read = ftell(queue->spool);
+
+	if (!queue->spooled) {
+		fclose(queue->spool);
+		queue->spool = NULL;
+	}
+	return;
+
+failed:
+	ast_log(LOG_ERROR, "Unable to read the CEL spool for backend '%s'; discarding %u events\n",
+		backend->name, queue->spooled);
+	queue->dropped += queue->spooled;
+	queue->spooled = 0;
+	fclose(queue->spool);
+	queue->spool = NULL;
+}
+
+/*! \brief Give the events queued for a backend to it, until it is unregistered */
+static void *cel_backend_queue_thread(void *data)
+{
+	struct cel_backend *backend = data;
+	struct cel_backend_queue *queue = backend->queue;
+	struct ast_event *batch[CEL_MAX_BACKEND_BATCH];
+
+	ao2_lock(queue);
+	for (;;) {
+		struct cel_queued_event *queued;
+		struct timeval start;
+		int64_t elapsed;
+		size_t count = 0;
+		size_t i;
+
+		while (!queue->depth && !queue->spooled && !queue->stop) {
+			ast_cond_wait(&queue->cond, ao2_object_get_lockaddr(queue));
+		}
+		if (!queue->depth && queue->spooled) {
+			cel_backend_queue_unspool(backend);
+		}
+		if (!queue->depth) {
+			if (queue->stop && !queue->spooled) {
+				break;
+			}
+			continue;
+		}
+
+		while (count < queue->batch && (queued = AST_LIST_REMOVE_HEAD(&queue->events, list))) {
+			batch[count++] = queued->event;
+			ast_free(queued);
+		}
+		queue->depth -= count;
+		ast_cond_broadcast(&queue->cond);
+		ao2_unlock(queue);
+
+		start = ast_tvnow();
+		if (backend->batch_callback && count > 1) {
+			backend->batch_callback(batch, count);
+		} else {
+			for (i = 0; i < count; ++i) {
+				backend->callback(batch[i]);
+			}
+		}
+		elapsed = ast_tvdiff_us(ast_tvnow(), start);
+		for (i = 0; i < count; ++i) {
+			ast_event_destroy(batch[i]);
+		}
+
+		ao2_lock(queue);
+		queue->delivered += count;
+		queue->latency_total_us += elapsed;
+		queue->latency_max_us = MAX(queue->latency_max_us, elapsed);
+	}
+	ao2_unlock(queue);
+
+	ao2_ref(backend, -1);
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Queue an event for a backend
+ *
+ * \param backend The backend
+ * \param event The event, which is copied
+ * \param general The configuration to apply to the queue
+ */
+static void cel_backend_queue_push(struct cel_backend *backend, const struct ast_event *event,
+	const struct ast_cel_general_config *general)
+{
+	struct cel_backend_queue *queue = backend->queue;
+	struct cel_queued_event *queued;
+	size_t size = ast_event_get_size(event);
+	SCOPED_AO2LOCK(lock, queue);
+
+	queue->size = general->backend_queue;
+	queue->batch = general->backend_batch;
+
+	if (queue->thread == AST_PTHREADT_NULL && !queue->stop) {
+		if (ast_pthread_create_background(&queue->thread, NULL, cel_backend_queue_thread,
+			ao2_bump(backend))) {
+			ao2_ref(backend, -1);
+			queue->thread = AST_PTHREADT_NULL;
+			ast_log(LOG_ERROR, "Unable to start the queue for CEL backend '%s'\n", backend->name);
+			backend->callback((struct ast_event *) event);
+			return;
+		}
+	}
+
+	if (general->backend_overflow == AST_CEL_BACKEND_OVERFLOW_BLOCK) {
+		while (queue->depth >= queue->size && !queue->stop) {
+			ast_cond_wait(&queue->cond, ao2_object_get_lockaddr(queue));
+		}
+	}
+	if (queue->stop) {
+		return;
+	}
+
+	/* Once events are spooled, later ones are too, so they keep their order */
+	if (queue->depth >= queue->size
+		|| (queue->spooled && general->backend_overflow == AST_CEL_BACKEND_OVERFLOW_SPOOL)) {
+		if (general->backend_overflow == AST_CEL_BACKEND_OVERFLOW_SPOOL
+			&& !cel_backend_queue_spool(backend, event)) {
+			ast_cond_broadcast(&queue->cond);
+			return;
+		}
+		++queue->dropped;
+		if (!queue->dropping) {
+			ast_log(LOG_WARNING, "CEL backend '%s' is not keeping up; dropping events\n",
+				backend->name);
+			queue->dropping = 1;
+		}
+		return;
+	}
+	queue->dropping = 0;
+
+	queued = ast_calloc(1, sizeof(*queued));
+	if (!queued || !(queued->event = ast_malloc(size))) {
+		ast_free(queued);
+		++queue->dropped;
+		return;
+	}
+	memcpy(queued->event, event, size);
+	AST_LIST_INSERT_TAIL(&queue->events, queued, list);
+	++queue->depth;
+	queue->peak_depth = MAX(queue->peak_depth, queue->depth);
+	ast_cond_broadcast(&queue->cond);
+}
+
+/*!
+ * \internal
+ * \brief Stop a backend's queue, once the events in it have been delivered
+ */
+static void cel_backend_queue_stop(struct cel_backend *backend)
+{
+	struct cel_backend_queue *queue = backend->queue;
+	pthread_t thread;
+
+	ao2_lock(queue);
+	queue->stop = 1;
+	thread = queue->thread;
+	queue->thread = AST_PTHREADT_NULL;
+	ast_cond_broadcast(&queue->cond);
+	ao2_unlock(queue);
+
+	if (thread != AST_PTHREADT_NULL) {
+		pthread_join(thread, NULL);
+	}
+}
+
 /*! \brief Hashing function for cel_backend */
 static int cel_backend_hash(const void *obj, int flags)
 {
@@ -509,7 +843,21 @@ static char *handle_cli_status(struct ast_cli_entry *e, int cmd, struct ast_cli_
 
 		iter = ao2_iterator_init(backends, 0);
 		for (; (backend = ao2_iterator_next(&iter)); ao2_ref(backend, -1)) {
+			struct cel_backend_queue *queue = backend->queue;
+
 			ast_cli(a->fd, "CEL Event Subscriber: %s\n", backend->name);
+
+			ao2_lock(queue);
+			if (queue->size) {
+				ast_cli(a->fd, "  Queued: %u of %u (peak %u), spooled: %u\n",
+					queue->depth, queue->size, queue->peak_depth, queue->spooled);
+				ast_cli(a->fd, "  Delivered: %" PRIu64 ", dropped: %" PRIu64 ", ever spooled: %" PRIu64 "\n",
+					queue->delivered, queue->dropped, queue->total_spooled);
+				ast_cli(a->fd, "  Backend latency: %" PRId64 "us per event, %" PRId64 "us longest delivery\n",
+					queue->delivered ? queue->latency_total_us / (int64_t) queue->delivered : 0,
+					queue->latency_max_us);
+			}
+			ao2_unlock(queue);
 		}
 		ao2_iterator_destroy(&iter);
 	}
@@ -573,6 +921,24 @@ static int events_handler(const struct aco_option *opt, struct ast_variable *var
 	return 0;
 }
 
+static int backend_overflow_handler(const struct aco_option *opt, struct ast_variable *var, void *obj)
+{
+	struct ast_cel_general_config *cfg = obj;
+
+	if (!strcasecmp(var->value, "block")) {
+		cfg->backend_overflow = AST_CEL_BACKEND_OVERFLOW_BLOCK;
+	} else if (!strcasecmp(var->value, "drop")) {
+		cfg->backend_overflow = AST_CEL_BACKEND_OVERFLOW_DROP;
+	} else if (!strcasecmp(var->value, "spool")) {
+		cfg->backend_overflow = AST_CEL_BACKEND_OVERFLOW_SPOOL;
+	} else {
+		ast_log(LOG_ERROR, "Unknown backendoverflow value '%s'\n", var->value);
+		return -1;
+	}
+
+	return 0;
+}
+
 static int apps_handler(const struct aco_option *opt, struct ast_variable *var, void *obj)
 {
 	struct ast_cel_general_config *cfg = obj;
@@ -653,11 +1019,22 @@ struct ast_event *ast_cel_create_event(struct ast_channel_snapshot *snapshot,
 		AST_EVENT_IE_END);
 }
 
+/*! \brief An event and the configuration it is sent under */
+struct cel_backend_send_data {
+	struct ast_event *event;
+	struct ast_cel_general_config *general;
+};
+
 static int cel_backend_send_cb(void *obj, void *arg, int flags)
 {
 	struct cel_backend *backend = obj;
+	struct cel_backend_send_data *data = arg;
 
-	backend->callback(arg);
+	if (data->general->backend_queue) {
+		cel_backend_queue_push(backend, data->event, data->general);
+	} else {
+		backend->callback(data->event);
+	}
 	return 0;
 }
 
@@ -666,6 +1043,7 @@ static int cel_report_event(struct ast_channel_snapshot *snapshot,
 		struct ast_json *extra, const char *peer_str)
 {
 	struct ast_event *ev;
+	struct cel_backend_send_data send_data;
 	RAII_VAR(struct cel_config *, cfg, ao2_global_obj_ref(cel_configs), ao2_cleanup);
 	RAII_VAR(struct ao2_container *, backends, ao2_global_obj_ref(cel_backends), ao2_cleanup);
 
@@ -697,7 +1075,9 @@ static int cel_report_event(struct ast_channel_snapshot *snapshot,
 	}
 
 	/* Distribute event to backends */
-	ao2_callback(backends, OBJ_MULTIPLE | OBJ_NODATA, cel_backend_send_cb, ev);
+	send_data.event = ev;
+	send_data.general = cfg->general;
+	ao2_callback(backends, OBJ_MULTIPLE | OBJ_NODATA, cel_backend_send_cb, &send_data);
 	ast_event_destroy(ev);
 
 	return 0;
@@ -1741,6 +2121,9 @@ int ast_cel_engine_init(void)
 	aco_option_register(&cel_cfg_info, "dateformat", ACO_EXACT, general_options, "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_cel_general_config, date_format));
 	aco_option_register_custom(&cel_cfg_info, "apps", ACO_EXACT, general_options, "", apps_handler, 0);
 	aco_option_register_custom(&cel_cfg_info, "events", ACO_EXACT, general_options, "", events_handler, 0);
+	aco_option_register(&cel_cfg_info, "backendqueue", ACO_EXACT, general_options, "0", OPT_UINT_T, 0, FLDSET(struct ast_cel_general_config, backend_queue));
+	aco_option_register(&cel_cfg_info, "backendbatch", ACO_EXACT, general_options, "100", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct ast_cel_general_config, backend_batch), 1, CEL_MAX_BACKEND_BATCH);
+	aco_option_register_custom(&cel_cfg_info, "backendoverflow", ACO_EXACT, general_options, "block", backend_overflow_handler, 0);
 
 	if (aco_process_config(&cel_cfg_info, 0)) {
 		struct cel_config *cel_cfg = cel_config_alloc();
@@ -1861,16 +2244,22 @@ void ast_cel_set_config(struct ast_cel_general_config *config)
 int ast_cel_backend_unregister(const char *name)
 {
 	struct ao2_container *backends = ao2_global_obj_ref(cel_backends);
+	struct cel_backend *backend;
 
 	if (backends) {
-		ao2_find(backends, name, OBJ_SEARCH_KEY | OBJ_NODATA | OBJ_UNLINK);
+		backend = ao2_find(backends, name, OBJ_SEARCH_KEY | OBJ_UNLINK);
+		if (backend) {
+			cel_backend_queue_stop(backend);
+			ao2_ref(backend, -1);
+		}
 		ao2_ref(backends, -1);
 	}
 
 	return 0;
 }
 
-int ast_cel_backend_register(const char *name, ast_cel_backend_cb backend_callback)
+int ast_cel_backend_register_batch(const char *name, ast_cel_backend_cb backend_callback,
+	ast_cel_backend_batch_cb batch_callback)
 {
 	RAII_VAR(struct ao2_container *, backends, ao2_global_obj_ref(cel_backends), ao2_cleanup);
 	struct cel_backend *backend;
@@ -1880,15 +2269,30 @@ int ast_cel_backend_register(const char *name, ast_cel_backend_cb backend_callba
 	}
 
 	/* The backend object is immutable so it doesn't need a lock of its own. */
-	backend = ao2_alloc_options(sizeof(*backend) + 1 + strlen(name), NULL,
+	backend = ao2_alloc_options(sizeof(*backend) + 1 + strlen(name), cel_backend_dtor,
 		AO2_ALLOC_OPT_LOCK_NOLOCK);
 	if (!backend) {
 		return -1;
 	}
 	strcpy(backend->name, name);/* Safe */
 	backend->callback = backend_callback;
+	backend->batch_callback = batch_callback;
+
+	/* The queue is locked as events are queued and taken */
+	backend->queue = ao2_alloc(sizeof(*backend->queue), cel_backend_queue_dtor);
+	if (!backend->queue) {
+		ao2_ref(backend, -1);
+		return -1;
+	}
+	ast_cond_init(&backend->queue->cond, NULL);
+	backend->queue->thread = AST_PTHREADT_NULL;
 
 	ao2_link(backends, backend);
 	ao2_ref(backend, -1);
 	return 0;
 }
+
+int ast_cel_backend_register(const char *name, ast_cel_backend_cb backend_callback)
+{
+	return ast_cel_backend_register_batch(name, backend_callback, NULL);
+}
@@ -40,6 +40,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/paths.h"	/* use ast_config_AST_SYSTEM_NAME */
 
 #include "asterisk/pbx.h"
+#include "asterisk/probes.h"
 #include "asterisk/frame.h"
 #include "asterisk/mod_format.h"
 #include "asterisk/sched.h"
@@ -50,6 +51,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/cli.h"
 #include "asterisk/translate.h"
 #include "asterisk/manager.h"
+#include "asterisk/metrics.h"
 #include "asterisk/chanvars.h"
 #include "asterisk/linkedlists.h"
 #include "asterisk/indications.h"
@@ -75,6 +77,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/test.h"
 #include "asterisk/stasis_channels.h"
 #include "asterisk/max_forwards.h"
+#include "asterisk/vector.h"
 
 /*** DOCUMENTATION
  ***/
@@ -89,11 +92,6 @@ ASTERISK_REGISTER_FILE()
 #endif	/* defined(HAVE_PRI) */
 #endif	/* defined(KEEP_TILL_CHANNEL_PARTY_NUMBER_INFO_NEEDED) */
 
-struct ast_epoll_data {
-	struct ast_channel *chan;
-	int which;
-};
-
 /* uncomment if you have problems with 'monitoring' synchronized files */
 #if 0
 #define MONITOR_CONSTANT_DELAY
@@ -135,6 +133,558 @@ static AST_RWLIST_HEAD_STATIC(backends, chanlist);
 /*! \brief All active channels on the system */
 static struct ao2_container *channels;
 
+/*!
+ * \brief Number of context\@exten keys of a channel
+ *
+ * A channel matches a context and extension by either its context or macro
+ * context and either its extension or macro extension.
+ */
+#define CHANNEL_INDEX_EXTEN_KEYS 4
+
+/*!
+ * \brief Number of spy groups of a channel that are indexed
+ *
+ * A channel in more groups is indexed by CHANNEL_INDEX_SPYGROUP_ANY
+ * instead, which every spy group lookup includes.
+ */
+#define CHANNEL_INDEX_SPYGROUPS 8
+
+/*!
+ * \brief Key of the channels in too many spy groups to index
+ *
+ * \note A group could have this name, but it only makes its lookups
+ * return more channels than they need to.
+ */
+#define CHANNEL_INDEX_SPYGROUP_ANY ":"
+
+/*! \brief An entry of a channel in a secondary index keyed by a string */
+struct channel_index_entry {
+	/*!
+	 * \brief The channel
+	 *
+	 * \note Not a reference.  The entry is removed before the channel
+	 * can go away, and lookups take their references while holding
+	 * channel_index_lock.
+	 */
+	struct ast_channel *chan;
+	/*! The key of the entry */
+	char key[0];
+};
+
+/*! \brief The entries of a channel in the secondary indexes */
+struct ast_channel_index {
+	/*! Entry in channels_by_linkedid */
+	struct channel_index_entry *linkedid;
+	/*! Entries in channels_by_exten */
+	struct channel_index_entry *exten[CHANNEL_INDEX_EXTEN_KEYS];
+	/*! Entries in channels_by_spygroup */
+	struct channel_index_entry *spygroup[CHANNEL_INDEX_SPYGROUPS];
+};
+
+/*! \brief A channel name or uniqueid prefix to search an index with */
+struct channel_index_prefix {
+	/*! The prefix */
+	const char *prefix;
+	/*! Number of characters of the prefix to match */
+	size_t len;
+};
+
+/*!
+ * \brief Lock for the secondary indexes of the channels container
+ *
+ * \note Protects every index container and the index entries of every
+ * channel.  Nothing else may be locked while holding it.
+ */
+AST_RWLOCK_DEFINE_STATIC(channel_index_lock);
+
+/*! \brief The channels sorted by name, for name prefix searches */
+static struct ao2_container *channels_by_name;
+
+/*! \brief The channels sorted by uniqueid, for uniqueid prefix searches */
+static struct ao2_container *channels_by_uniqueid;
+
+/*! \brief Index entries of the channels keyed by context\@exten */
+static struct ao2_container *channels_by_exten;
+
+/*! \brief Index entries of the channels keyed by linkedid */
+static struct ao2_container *channels_by_linkedid;
+
+/*! \brief Index entries of the channels keyed by each group of their SPYGROUP variable */
+static struct ao2_container *channels_by_spygroup;
+
+/*!
+ * \brief TRUE if a channel could not be added to an index
+ *
+ * \note Lookups scan the channels container instead from then on.
+ */
+static int channel_index_degraded;
+
+static int channel_name_sort_cb(const void *obj_left, const void *obj_right, int flags)
+{
+	const struct ast_channel *left = obj_left;
+	const struct channel_index_prefix *prefix;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		return strcasecmp(ast_channel_name(left), ast_channel_name(obj_right));
+	case OBJ_SEARCH_KEY:
+		return strcasecmp(ast_channel_name(left), obj_right);
+	case OBJ_SEARCH_PARTIAL_KEY:
+		prefix = obj_right;
+		return strncasecmp(ast_channel_name(left), prefix->prefix, prefix->len);
+	default:
+		ast_assert(0);
+		return 0;
+	}
+}
+
+static int channel_uniqueid_sort_cb(const void *obj_left, const void *obj_right, int flags)
+{
+	const struct ast_channel *left = obj_left;
+	const struct channel_index_prefix *prefix;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		return strcasecmp(ast_channel_uniqueid(left), ast_channel_uniqueid(obj_right));
+	case OBJ_SEARCH_KEY:
+		return strcasecmp(ast_channel_uniqueid(left), obj_right);
+	case OBJ_SEARCH_PARTIAL_KEY:
+		prefix = obj_right;
+		return strncasecmp(ast_channel_uniqueid(left), prefix->prefix, prefix->len);
+	default:
+		ast_assert(0);
+		return 0;
+	}
+}
+
+static int channel_index_entry_hash_cb(const void *obj, const int flags)
+{
+	const struct channel_index_entry *entry = obj;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		return ast_str_case_hash(obj);
+	case OBJ_SEARCH_OBJECT:
+		return ast_str_case_hash(entry->key);
+	default:
+		ast_assert(0);
+		return 0;
+	}
+}
+
+static int channel_index_entry_cmp_cb(void *obj, void *arg, int flags)
+{
+	const struct channel_index_entry *entry = obj;
+	const char *key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		key = ((const struct channel_index_entry *) arg)->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcasecmp(entry->key, key) ? 0 : CMP_MATCH;
+	default:
+		return CMP_MATCH;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Build the context\@exten key of an extension index entry.
+ *
+ * \param buf Where to put the key.
+ * \param size Size of buf.
+ * \param context The context.
+ * \param exten The extension.
+ *
+ * \return buf
+ */
+static char *channel_index_exten_key(char *buf, size_t size, const char *context, const char *exten)
+{
+	snprintf(buf, size, "%s@%s", context, exten);
+	return buf;
+}
+
+/*!
+ * \internal
+ * \brief Replace an index entry of a channel if its key changed.
+ *
+ * \param container The index.
+ * \param chan The channel.
+ * \param entry The current entry of the channel in the index.
+ * \param key The key of the channel now, NULL if it has none.
+ *
+ * \note Assumes channel_index_lock is write locked.
+ *
+ * \return The new entry of the channel in the index.
+ */
+static struct channel_index_entry *channel_index_entry_update(struct ao2_container *container,
+	struct ast_channel *chan, struct channel_index_entry *entry, const char *key)
+{
+	size_t len;
+
+	if (entry && key && !strcasecmp(entry->key, key)) {
+		return entry;
+	}
+
+	if (entry) {
+		ao2_unlink_flags(container, entry, OBJ_NOLOCK);
+		ao2_ref(entry, -1);
+		entry = NULL;
+	}
+
+	if (key) {
+		len = strlen(key);
+		entry = ao2_alloc_options(sizeof(*entry) + len + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!entry || !ao2_link_flags(container, entry, OBJ_NOLOCK)) {
+			ast_log(LOG_WARNING, "Unable to index channel %s; channel lookups scan all channels now\n",
+				ast_channel_name(chan));
+			channel_index_degraded = 1;
+			ao2_cleanup(entry);
+			return NULL;
+		}
+		entry->chan = chan;
+		memcpy(entry->key, key, len + 1);
+	}
+
+	return entry;
+}
+
+/*!
+ * \internal
+ * \brief Update the context\@exten index entries of a channel.
+ *
+ * \param chan The channel.
+ * \param index The index entries of the channel.
+ *
+ * \note Assumes channel_index_lock is write locked.
+ */
+static void channel_index_exten_update(struct ast_channel *chan, struct ast_channel_index *index)
+{
+	char keys[CHANNEL_INDEX_EXTEN_KEYS][AST_MAX_CONTEXT + AST_MAX_EXTENSION + 1];
+	const char *contexts[] = { ast_channel_context(chan), ast_channel_macrocontext(chan) };
+	const char *extens[] = { ast_channel_exten(chan), ast_channel_macroexten(chan) };
+	const char *key;
+	int idx;
+	int x;
+
+	for (idx = 0; idx < CHANNEL_INDEX_EXTEN_KEYS; idx++) {
+		const char *context = contexts[idx / 2];
+		const char *exten = extens[idx % 2];
+
+		key = NULL;
+		if (!ast_strlen_zero(context) && !ast_strlen_zero(exten)) {
+			key = channel_index_exten_key(keys[idx], sizeof(keys[idx]), context, exten);
+			for (x = 0; x < idx; x++) {
+				if (!strcasecmp(keys[x], key)) {
+					/* Already indexed by a previous key. */
+					key = NULL;
+					break;
+				}
+			}
+		}
+		if (!key) {
+			keys[idx][0] = '\0';
+		}
+		index->exten[idx] = channel_index_entry_update(channels_by_exten, chan,
+			index->exten[idx], key);
+	}
+}
+
+void ast_channel_internal_index_exten_update(struct ast_channel *chan)
+{
+	struct ast_channel_index *index;
+
+	if (!ast_channel_internal_index(chan)) {
+		/* The channel is not in the channels container. */
+		return;
+	}
+
+	ast_rwlock_wrlock(&channel_index_lock);
+	index = ast_channel_internal_index(chan);
+	if (index) {
+		channel_index_exten_update(chan, index);
+	}
+	ast_rwlock_unlock(&channel_index_lock);
+}
+
+/*!
+ * \internal
+ * \brief Get the spy group index keys of a channel.
+ *
+ * \param chan The channel.
+ * \param buf Where to put the keys.
+ * \param size Size of buf.
+ * \param keys The keys, CHANNEL_INDEX_SPYGROUPS of them, NULL past the last.
+ *
+ * \note Must be called without channel_index_lock held, as it locks
+ * the channel.
+ */
+static void channel_index_spygroup_keys(struct ast_channel *chan, char *buf, size_t size, const char **keys)
+{
+	char *groups[CHANNEL_INDEX_SPYGROUPS + 1];
+	const char *group;
+	int num_groups = 0;
+	int num_keys = 0;
+	int idx;
+	int x;
+
+	memset(keys, 0, CHANNEL_INDEX_SPYGROUPS * sizeof(*keys));
+
+	ast_channel_lock(chan);
+	group = pbx_builtin_getvar_helper(chan, "SPYGROUP");
+	if (!ast_strlen_zero(group)) {
+		ast_copy_string(buf, group, size);
+		/* Split the same way ChanSpy does. */
+		num_groups = ast_app_separate_args(buf, ':', groups, ARRAY_LEN(groups));
+	}
+	ast_channel_unlock(chan);
+
+	if (num_groups > CHANNEL_INDEX_SPYGROUPS) {
+		keys[0] = CHANNEL_INDEX_SPYGROUP_ANY;
+		return;
+	}
+
+	for (idx = 0; idx < num_groups; idx++) {
+		for (x = 0; x < num_keys; x++) {
+			if (!strcasecmp(keys[x], groups[idx])) {
+				/* Already indexed by a previous key. */
+				break;
+			}
+		}
+		if (x == num_keys) {
+			keys[num_keys++] = groups[idx];
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Update the spy group index entries of a channel.
+ *
+ * \param chan The channel.
+ * \param index The index entries of the channel.
+ * \param keys The keys from channel_index_spygroup_keys().
+ *
+ * \note Assumes channel_index_lock is write locked.
+ */
+static void channel_index_spygroup_update(struct ast_channel *chan, struct ast_channel_index *index,
+	const char **keys)
+{
+	int idx;
+
+	for (idx = 0; idx < CHANNEL_INDEX_SPYGROUPS; idx++) {
+		index->spygroup[idx] = channel_index_entry_update(channels_by_spygroup, chan,
+			index->spygroup[idx], keys[idx]);
+	}
+}
+
+void ast_channel_internal_index_spygroup_update(struct ast_channel *chan)
+{
+	struct ast_channel_index *index;
+	const char *keys[CHANNEL_INDEX_SPYGROUPS];
+	char buf[512];
+
+	if (!ast_channel_internal_index(chan)) {
+		/* The channel is not in the channels container. */
+		return;
+	}
+
+	channel_index_spygroup_keys(chan, buf, sizeof(buf), keys);
+
+	ast_rwlock_wrlock(&channel_index_lock);
+	index = ast_channel_internal_index(chan);
+	if (index) {
+		channel_index_spygroup_update(chan, index, keys);
+	}
+	ast_rwlock_unlock(&channel_index_lock);
+}
+
+void ast_channel_internal_index_linkedid_update(struct ast_channel *chan)
+{
+	struct ast_channel_index *index;
+
+	if (!ast_channel_internal_index(chan)) {
+		/* The channel is not in the channels container. */
+		return;
+	}
+
+	ast_rwlock_wrlock(&channel_index_lock);
+	index = ast_channel_internal_index(chan);
+	if (index) {
+		index->linkedid = channel_index_entry_update(channels_by_linkedid, chan,
+			index->linkedid, ast_channel_linkedid(chan));
+	}
+	ast_rwlock_unlock(&channel_index_lock);
+}
+
+/*!
+ * \internal
+ * \brief Add a channel to the channels container and its indexes.
+ *
+ * \param chan The channel.
+ *
+ * \note The name and uniqueid of the channel must not change until
+ * channel_unlink() is called.
+ */
+static void channel_link(struct ast_channel *chan)
+{
+	struct ast_channel_index *index;
+	const char *spygroups[CHANNEL_INDEX_SPYGROUPS];
+	char buf[512];
+
+	ao2_link(channels, chan);
+	if (channel_index_degraded) {
+		return;
+	}
+
+	channel_index_spygroup_keys(chan, buf, sizeof(buf), spygroups);
+
+	ast_rwlock_wrlock(&channel_index_lock);
+	if (ast_channel_internal_index(chan)) {
+		/* Already indexed */
+		ast_rwlock_unlock(&channel_index_lock);
+		return;
+	}
+	index = ast_calloc(1, sizeof(*index));
+	if (!index
+		|| !ao2_link_flags(channels_by_name, chan, OBJ_NOLOCK)
+		|| !ao2_link_flags(channels_by_uniqueid, chan, OBJ_NOLOCK)) {
+		ast_log(LOG_WARNING, "Unable to index channel %s; channel lookups scan all channels now\n",
+			ast_channel_name(chan));
+		channel_index_degraded = 1;
+		ao2_unlink_flags(channels_by_name, chan, OBJ_NOLOCK);
+		ast_free(index);
+		ast_rwlock_unlock(&channel_index_lock);
+		return;
+	}
+	channel_index_exten_update(chan, index);
+	index->linkedid = channel_index_entry_update(channels_by_linkedid, chan,
+		NULL, ast_channel_linkedid(chan));
+	channel_index_spygroup_update(chan, index, spygroups);
+	ast_channel_internal_index_set(chan, index);
+	ast_rwlock_unlock(&channel_index_lock);
+}
+
+/*!
+ * \internal
+ * \brief Remove a channel from the channels container and its indexes.
+ *
+ * \param chan The channel.
+ *
+ * \note Safe, even if already unlinked.
+ */
+static void channel_unlink(struct ast_channel *chan)
+{
+	struct ast_channel_index *index;
+	int idx;
+
+	ao2_unlink(channels, chan);
+
+	if (!ast_channel_internal_index(chan)) {
+		return;
+	}
+
+	ast_rwlock_wrlock(&channel_index_lock);
+	index = ast_channel_internal_index(chan);
+	if (index) {
+		ast_channel_internal_index_set(chan, NULL);
+		ao2_unlink_flags(channels_by_name, chan, OBJ_NOLOCK);
+		ao2_unlink_flags(channels_by_uniqueid, chan, OBJ_NOLOCK);
+		for (idx = 0; idx < CHANNEL_INDEX_EXTEN_KEYS; idx++) {
+			channel_index_entry_update(channels_by_exten, chan, index->exten[idx], NULL);
+		}
+		channel_index_entry_update(channels_by_linkedid, chan, index->linkedid, NULL);
+		for (idx = 0; idx < CHANNEL_INDEX_SPYGROUPS; idx++) {
+			channel_index_entry_update(channels_by_spygroup, chan, index->spygroup[idx], NULL);
+		}
+		ast_free(index);
+	}
+	ast_rwlock_unlock(&channel_index_lock);
+}
+
+/*!
+ * \internal
+ * \brief Collect the channel of an index entry with a key.
+ *
+ * \param obj The index entry.
+ * \param arg The key.
+ * \param data The container collecting the channels.
+ * \param flags Search flags.
+ *
+ * \return 0
+ */
+static int channel_index_collect_cb(void *obj, void *arg, void *data, int flags)
+{
+	struct channel_index_entry *entry = obj;
+
+	if (!strcasecmp(entry->key, arg)) {
+		ao2_link_flags(data, entry->chan, OBJ_NOLOCK);
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Collect the channels of an index with a key.
+ *
+ * \param container The index.
+ * \param key The key.
+ *
+ * \return A container with references to the channels.
+ * \retval NULL on error or if the indexes are degraded.
+ */
+static struct ao2_container *channel_index_collect(struct ao2_container *container, const char *key)
+{
+	struct ao2_container *found;
+
+	if (channel_index_degraded) {
+		return NULL;
+	}
+
+	found = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL);
+	if (!found) {
+		return NULL;
+	}
+
+	ast_rwlock_rdlock(&channel_index_lock);
+	ao2_callback_data(container, OBJ_SEARCH_KEY | OBJ_MULTIPLE | OBJ_NODATA | OBJ_NOLOCK,
+		channel_index_collect_cb, (void *) key, found);
+	ast_rwlock_unlock(&channel_index_lock);
+
+	return found;
+}
+
+/*!
+ * \internal
+ * \brief Search a sorted channel index.
+ *
+ * \param container channels_by_name or channels_by_uniqueid.
+ * \param key The name or uniqueid, or its prefix.
+ * \param len Number of characters of key to match, 0 to match all of key.
+ * \param flags OBJ_MULTIPLE to find every match.
+ *
+ * \return What ao2_callback() returns.
+ */
+static void *channel_index_search(struct ao2_container *container, const char *key, size_t len, int flags)
+{
+	struct channel_index_prefix prefix = {
+		.prefix = key,
+		.len = len,
+	};
+	void *found;
+
+	ast_rwlock_rdlock(&channel_index_lock);
+	if (len) {
+		found = ao2_callback(container, flags | OBJ_SEARCH_PARTIAL_KEY | OBJ_NOLOCK, NULL, &prefix);
+	} else {
+		found = ao2_callback(container, flags | OBJ_SEARCH_KEY | OBJ_NOLOCK, NULL, (void *) key);
+	}
+	ast_rwlock_unlock(&channel_index_lock);
+
+	return found;
+}
+
 /*! \brief map AST_CAUSE's to readable string representations
  *
  * \ref causes.h
@@ -688,7 +1238,7 @@ static void publish_cache_clear(struct ast_channel *chan)
 	}
 
 	message = stasis_cache_clear_create(clear_msg);
-	stasis_publish(ast_channel_topic(chan), message);
+	ast_channel_publish_message(chan, message);
 }
 
 /*! \brief Gives the string form of a given channel state.
@@ -824,15 +1374,16 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 	ast_channel_internal_alertpipe_clear(tmp);
 	ast_channel_internal_fd_clear_all(tmp);
 
-#ifdef HAVE_EPOLL
-	ast_channel_epfd_set(tmp, epoll_create(25));
-#endif
+	/* Reuse the scheduler context, timer and alertpipe of a recycled channel */
+	ast_channel_internal_shell_restore(tmp);
 
-	if (!(schedctx = ast_sched_context_create())) {
-		ast_log(LOG_WARNING, "Channel allocation failed: Unable to create schedule context\n");
-		return ast_channel_unref(tmp);
+	if (!ast_channel_sched(tmp)) {
+		if (!(schedctx = ast_sched_context_create())) {
+			ast_log(LOG_WARNING, "Channel allocation failed: Unable to create schedule context\n");
+			return ast_channel_unref(tmp);
+		}
+		ast_channel_sched_set(tmp, schedctx);
 	}
-	ast_channel_sched_set(tmp, schedctx);
 
 	ast_party_dialed_init(ast_channel_dialed(tmp));
 	ast_party_caller_init(ast_channel_caller(tmp));
@@ -855,7 +1406,7 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 		}
 	}
 
-	if ((timer = ast_timer_open())) {
+	if ((timer = ast_channel_timer(tmp)) || (timer = ast_timer_open())) {
 		ast_channel_timer_set(tmp, timer);
 		if (strcmp(ast_timer_get_name(ast_channel_timer(tmp)), "timerfd")) {
 			needqueue = 0;
@@ -863,7 +1414,11 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 		ast_channel_timingfd_set(tmp, ast_timer_fd(ast_channel_timer(tmp)));
 	}
 
-	if (needqueue && ast_channel_internal_alertpipe_init(tmp)) {
+	if (!needqueue) {
+		/* A recycled channel may have brought an alertpipe this one must not have */
+		ast_channel_internal_alertpipe_close(tmp);
+	} else if (!ast_channel_internal_alert_readable(tmp)
+		&& ast_channel_internal_alertpipe_init(tmp)) {
 		return ast_channel_unref(tmp);
 	}
 
@@ -885,8 +1440,6 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 	now = ast_tvnow();
 	ast_channel_creationtime_set(tmp, &now);
 
-	ast_channel_internal_setup_topics(tmp);
-
 	if (!ast_strlen_zero(name_fmt)) {
 		char *slash, *slash2;
 		/* Almost every channel is calling this function, and setting the name via the ast_string_field_build() call.
@@ -930,6 +1483,7 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 
 	headp = ast_channel_varshead(tmp);
 	AST_LIST_HEAD_INIT_NOLOCK(headp);
+	ast_channel_var_index_set(tmp, ast_var_index_alloc());
 
 	ast_pbx_hangup_handler_init(tmp);
 	AST_LIST_HEAD_INIT_NOLOCK(ast_channel_datastores(tmp));
@@ -946,6 +1500,7 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 	}
 
 	ast_channel_internal_finalize(tmp);
+	ast_setup_times_mark(ast_channel_internal_setup_times(tmp), AST_CHANNEL_SETUP_CREATED);
 
 	ast_atomic_fetchadd_int(&chancount, +1);
 
@@ -954,7 +1509,7 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 	 */
 	ast_channel_lock(tmp);
 
-	ao2_link(channels, tmp);
+	channel_link(tmp);
 
 	if (endpoint) {
 		ast_endpoint_add_channel(endpoint, tmp);
@@ -965,6 +1520,8 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 	 * the world know of its existance
 	 */
 	ast_channel_stage_snapshot_done(tmp);
+
+	AST_PROBE3(channel__alloc, tmp, ast_channel_name(tmp), ast_channel_uniqueid(tmp));
 	return tmp;
 }
 
@@ -1012,16 +1569,12 @@ struct ast_channel *__ast_dummy_channel_alloc(const char *file, int line, const
 	ast_channel_timingfd_set(tmp, -1);
 	ast_channel_internal_alertpipe_clear(tmp);
 	ast_channel_internal_fd_clear_all(tmp);
-#ifdef HAVE_EPOLL
-	ast_channel_epfd_set(tmp, -1);
-#endif
 
 	ast_channel_hold_state_set(tmp, AST_CONTROL_UNHOLD);
 
-	ast_channel_internal_setup_topics(tmp);
-
 	headp = ast_channel_varshead(tmp);
 	AST_LIST_HEAD_INIT_NOLOCK(headp);
+	ast_channel_var_index_set(tmp, ast_var_index_alloc());
 
 	return tmp;
 }
@@ -1337,9 +1890,24 @@ static int ast_channel_by_uniqueid_cb(void *obj, void *arg, void *data, int flag
 	return ret;
 }
 
-struct ast_channel_iterator {
-	/* storage for non-dynamically allocated iterator */
-	struct ao2_iterator simple_iterator;
+static int ast_channel_by_linkedid_cb(void *obj, void *arg, int flags)
+{
+	struct ast_channel *chan = obj;
+	const char *linkedid = arg;
+	int ret = CMP_MATCH;
+
+	ast_channel_lock(chan);
+	if (strcmp(ast_channel_linkedid(chan), linkedid)) {
+		ret = 0; /* linkedid match failed, keep looking */
+	}
+	ast_channel_unlock(chan);
+
+	return ret;
+}
+
+struct ast_channel_iterator {
+	/* storage for non-dynamically allocated iterator */
+	struct ao2_iterator simple_iterator;
 	/* pointer to the actual iterator (simple_iterator or a dynamically
 	 * allocated iterator)
 	 */
@@ -1354,18 +1922,49 @@ struct ast_channel_iterator *ast_channel_iterator_destroy(struct ast_channel_ite
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Collect the channels that may be in the context and extension.
+ *
+ * \param exten The extension.
+ * \param context The context.
+ *
+ * \return A container with the channels indexed by context\@exten.
+ * \retval NULL if all channels must be searched instead.
+ */
+static struct ao2_container *channel_index_collect_exten(const char *exten, const char *context)
+{
+	char key[AST_MAX_CONTEXT + AST_MAX_EXTENSION + 1];
+
+	if (ast_strlen_zero(exten) || ast_strlen_zero(context)) {
+		return NULL;
+	}
+
+	return channel_index_collect(channels_by_exten,
+		channel_index_exten_key(key, sizeof(key), context, exten));
+}
+
 struct ast_channel_iterator *ast_channel_iterator_by_exten_new(const char *exten, const char *context)
 {
 	struct ast_channel_iterator *i;
 	char *l_exten = (char *) exten;
 	char *l_context = (char *) context;
+	struct ao2_container *found;
 
 	if (!(i = ast_calloc(1, sizeof(*i)))) {
 		return NULL;
 	}
 
-	i->active_iterator = (void *) ast_channel_callback(ast_channel_by_exten_cb,
-		l_context, l_exten, OBJ_MULTIPLE);
+	found = channel_index_collect_exten(exten, context);
+	if (found) {
+		/* The key is ambiguous if the context or extension contains an '@'. */
+		i->active_iterator = (void *) ao2_callback_data(found, OBJ_MULTIPLE,
+			ast_channel_by_exten_cb, l_context, l_exten);
+		ao2_ref(found, -1);
+	} else {
+		i->active_iterator = (void *) ast_channel_callback(ast_channel_by_exten_cb,
+			l_context, l_exten, OBJ_MULTIPLE);
+	}
 	if (!i->active_iterator) {
 		ast_free(i);
 		return NULL;
@@ -1383,9 +1982,124 @@ struct ast_channel_iterator *ast_channel_iterator_by_name_new(const char *name,
 		return NULL;
 	}
 
-	i->active_iterator = (void *) ast_channel_callback(ast_channel_by_name_cb,
-		l_name, &name_len,
-		OBJ_MULTIPLE | (name_len == 0 /* match the whole word, so optimize */ ? OBJ_KEY : 0));
+	if (name_len && !ast_strlen_zero(name) && !channel_index_degraded) {
+		i->active_iterator = channel_index_search(channels_by_name, name, name_len, OBJ_MULTIPLE);
+	} else {
+		i->active_iterator = (void *) ast_channel_callback(ast_channel_by_name_cb,
+			l_name, &name_len,
+			OBJ_MULTIPLE | (name_len == 0 /* match the whole word, so optimize */ ? OBJ_KEY : 0));
+	}
+	if (!i->active_iterator) {
+		ast_free(i);
+		return NULL;
+	}
+
+	return i;
+}
+
+struct ast_channel_iterator *ast_channel_iterator_by_linkedid_new(const char *linkedid)
+{
+	struct ast_channel_iterator *i;
+	struct ao2_container *found;
+
+	if (ast_strlen_zero(linkedid)) {
+		return NULL;
+	}
+
+	if (!(i = ast_calloc(1, sizeof(*i)))) {
+		return NULL;
+	}
+
+	found = channel_index_collect(channels_by_linkedid, linkedid);
+	/* Check the linkedid again as it may have changed since. */
+	i->active_iterator = ao2_callback(found ?: channels, OBJ_MULTIPLE,
+		ast_channel_by_linkedid_cb, (char *) linkedid);
+	ao2_cleanup(found);
+	if (!i->active_iterator) {
+		ast_free(i);
+		return NULL;
+	}
+
+	return i;
+}
+
+static int channel_found_hash_cb(const void *obj, const int flags)
+{
+	/* Only ever searched for by object. */
+	return ast_str_case_hash(ast_channel_name(obj));
+}
+
+static int channel_found_cmp_cb(void *obj, void *arg, int flags)
+{
+	return obj == arg ? CMP_MATCH | CMP_STOP : 0;
+}
+
+/*!
+ * \internal
+ * \brief Collect the channel of a spy group index entry, once.
+ *
+ * \param obj The index entry.
+ * \param arg The group.
+ * \param data The container collecting the channels.
+ * \param flags Search flags.
+ *
+ * \return 0
+ */
+static int channel_index_spygroup_collect_cb(void *obj, void *arg, void *data, int flags)
+{
+	struct channel_index_entry *entry = obj;
+	struct ast_channel *found;
+
+	if (strcasecmp(entry->key, arg)) {
+		return 0;
+	}
+	found = ao2_find(data, entry->chan, OBJ_SEARCH_OBJECT | OBJ_NOLOCK);
+	if (found) {
+		ao2_ref(found, -1);
+	} else {
+		ao2_link_flags(data, entry->chan, OBJ_NOLOCK);
+	}
+	return 0;
+}
+
+struct ast_channel_iterator *ast_channel_iterator_by_spygroup_new(const char *groups)
+{
+	struct ast_channel_iterator *i;
+	struct ao2_container *found;
+	char *buf;
+	char *mygroups[128];	/* As many as ChanSpy compares */
+	int num_groups;
+	int idx;
+
+	if (channel_index_degraded || ast_strlen_zero(groups)) {
+		return ast_channel_iterator_all_new();
+	}
+
+	found = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, 61,
+		channel_found_hash_cb, NULL, channel_found_cmp_cb);
+	if (!found) {
+		return NULL;
+	}
+
+	buf = ast_strdupa(groups);
+	num_groups = ast_app_separate_args(buf, ':', mygroups, ARRAY_LEN(mygroups));
+
+	ast_rwlock_rdlock(&channel_index_lock);
+	for (idx = 0; idx < num_groups; idx++) {
+		ao2_callback_data(channels_by_spygroup, OBJ_SEARCH_KEY | OBJ_MULTIPLE | OBJ_NODATA | OBJ_NOLOCK,
+			channel_index_spygroup_collect_cb, mygroups[idx], found);
+	}
+	ao2_callback_data(channels_by_spygroup, OBJ_SEARCH_KEY | OBJ_MULTIPLE | OBJ_NODATA | OBJ_NOLOCK,
+		channel_index_spygroup_collect_cb, CHANNEL_INDEX_SPYGROUP_ANY, found);
+	ast_rwlock_unlock(&channel_index_lock);
+
+	if (!(i = ast_calloc(1, sizeof(*i)))) {
+		ao2_ref(found, -1);
+		return NULL;
+	}
+
+	i->active_iterator = ao2_callback(found, OBJ_MULTIPLE, NULL, NULL);
+	ao2_ref(found, -1);
 	if (!i->active_iterator) {
 		ast_free(i);
 		return NULL;
@@ -1425,8 +2139,12 @@ struct ast_channel *ast_channel_get_by_name_prefix(const char *name, size_t name
 	struct ast_channel *chan;
 	char *l_name = (char *) name;
 
-	chan = ast_channel_callback(ast_channel_by_name_cb, l_name, &name_len,
-		(name_len == 0) /* optimize if it is a complete name match */ ? OBJ_KEY : 0);
+	if (name_len && !ast_strlen_zero(l_name) && !channel_index_degraded) {
+		chan = channel_index_search(channels_by_name, l_name, name_len, 0);
+	} else {
+		chan = ast_channel_callback(ast_channel_by_name_cb, l_name, &name_len,
+			(name_len == 0) /* optimize if it is a complete name match */ ? OBJ_KEY : 0);
+	}
 	if (chan) {
 		return chan;
 	}
@@ -1437,6 +2155,9 @@ struct ast_channel *ast_channel_get_by_name_prefix(const char *name, size_t name
 	}
 
 	/* Now try a search for uniqueid. */
+	if (!channel_index_degraded) {
+		return channel_index_search(channels_by_uniqueid, l_name, name_len, 0);
+	}
 	return ast_channel_callback(ast_channel_by_uniqueid_cb, l_name, &name_len, 0);
 }
 
@@ -1449,8 +2170,19 @@ struct ast_channel *ast_channel_get_by_exten(const char *exten, const char *cont
 {
 	char *l_exten = (char *) exten;
 	char *l_context = (char *) context;
+	struct ao2_container *found;
+	struct ast_channel *chan;
+
+	found = channel_index_collect_exten(exten, context);
+	if (!found) {
+		return ast_channel_callback(ast_channel_by_exten_cb, l_context, l_exten, 0);
+	}
 
-	return ast_channel_callback(ast_channel_by_exten_cb, l_context, l_exten, 0);
+	/* The key is ambiguous if the context or extension contains an '@'. */
+	chan = ao2_callback_data(found, 0, ast_channel_by_exten_cb, l_context, l_exten);
+	ao2_ref(found, -1);
+
+	return chan;
 }
 
 int ast_is_deferrable_frame(const struct ast_frame *frame)
@@ -1561,7 +2293,7 @@ int ast_safe_sleep(struct ast_channel *chan, int ms)
 struct ast_channel *ast_channel_release(struct ast_channel *chan)
 {
 	/* Safe, even if already unlinked. */
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 	return ast_channel_unref(chan);
 }
 
@@ -2165,13 +2897,156 @@ void ast_party_redirecting_free(struct ast_party_redirecting *doomed)
 	ast_party_redirecting_reason_free(&doomed->orig_reason);
 }
 
+/*! \brief Number of datastores a channel needs before they are indexed */
+#define DATASTORE_INDEX_MIN_DATASTORES 8
+
+/*! \brief First datastore of a channel with a type */
+struct datastore_index_entry {
+	const struct ast_datastore_info *info;
+	struct ast_datastore *datastore;
+};
+
+/*!
+ * \brief Index of the datastores of a channel by type
+ *
+ * Holds, sorted by type, the datastore a search of the list from its
+ * head would find first.  It is only used while the first and last
+ * datastores of the list are those it was last updated with; anything
+ * else rebuilds it.
+ */
+struct ast_datastore_index {
+	const struct ast_datastore *first;
+	const struct ast_datastore *last;
+	AST_VECTOR(, struct datastore_index_entry) entries;
+	/*! The index has to be rebuilt before it can be used */
+	unsigned int stale:1;
+};
+
+static void datastore_index_destroy(struct ast_datastore_index *index)
+{
+	if (!index) {
+		return;
+	}
+	AST_VECTOR_FREE(&index->entries);
+	ast_free(index);
+}
+
+/*!
+ * \brief Find the position of a type in an index
+ *
+ * \return The position of the type, or where to insert it if not found.
+ */
+static size_t datastore_index_position(const struct ast_datastore_index *index,
+	const struct ast_datastore_info *info, int *found)
+{
+	size_t low = 0;
+	size_t high = AST_VECTOR_SIZE(&index->entries);
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		uintptr_t key = (uintptr_t) AST_VECTOR_GET_ADDR(&index->entries, middle)->info;
+
+		if (key == (uintptr_t) info) {
+			*found = 1;
+			return middle;
+		}
+		if (key < (uintptr_t) info) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	*found = 0;
+	return low;
+}
+
+/*!
+ * \brief Make a datastore the first of its type in an index
+ *
+ * \retval 0 on success.
+ * \retval -1 on failure.
+ */
+static int datastore_index_set(struct ast_datastore_index *index, struct ast_datastore *datastore)
+{
+	struct datastore_index_entry entry = { datastore->info, datastore };
+	int found;
+	size_t pos = datastore_index_position(index, datastore->info, &found);
+
+	if (found) {
+		AST_VECTOR_GET_ADDR(&index->entries, pos)->datastore = datastore;
+		return 0;
+	}
+	return AST_VECTOR_INSERT_AT(&index->entries, pos, entry);
+}
+
+static void datastore_index_update(struct ast_datastore_index *index, struct ast_datastore_list *list)
+{
+	index->first = AST_LIST_FIRST(list);
+	index->last = AST_LIST_LAST(list);
+}
+
+/*!
+ * \brief Get the datastore index of a channel, if the channel has one
+ *
+ * \pre chan is locked
+ *
+ * \return The up to date index, NULL if the channel has too few
+ * datastores to index or memory ran out.
+ */
+static struct ast_datastore_index *channel_datastore_index(struct ast_channel *chan)
+{
+	struct ast_datastore_list *list = ast_channel_datastores(chan);
+	struct ast_datastore_index *index = ast_channel_internal_datastore_index(chan);
+	struct ast_datastore *datastore;
+	size_t count = 0;
+	int found;
+
+	if (index && !index->stale
+		&& index->first == AST_LIST_FIRST(list) && index->last == AST_LIST_LAST(list)) {
+		return index;
+	}
+
+	AST_LIST_TRAVERSE(list, datastore, entry) {
+		if (++count == DATASTORE_INDEX_MIN_DATASTORES) {
+			break;
+		}
+	}
+	if (count < DATASTORE_INDEX_MIN_DATASTORES) {
+		if (index) {
+			index->stale = 1;
+		}
+		return NULL;
+	}
+
+	if (!index) {
+		index = ast_calloc(1, sizeof(*index));
+		if (!index) {
+			return NULL;
+		}
+		AST_VECTOR_INIT(&index->entries, 0);
+		ast_channel_internal_datastore_index_set(chan, index);
+	}
+
+	AST_VECTOR_RESET(&index->entries, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	index->stale = 1;
+	AST_LIST_TRAVERSE(list, datastore, entry) {
+		size_t pos = datastore_index_position(index, datastore->info, &found);
+		struct datastore_index_entry new_entry = { datastore->info, datastore };
+
+		if (!found && AST_VECTOR_INSERT_AT(&index->entries, pos, new_entry)) {
+			return NULL;
+		}
+	}
+	datastore_index_update(index, list);
+	index->stale = 0;
+
+	return index;
+}
+
 /*! \brief Free a channel structure */
 static void ast_channel_destructor(void *obj)
 {
 	struct ast_channel *chan = obj;
-#ifdef HAVE_EPOLL
-	int i;
-#endif
 	struct ast_var_t *vardata;
 	struct ast_frame *f;
 	struct varshead *headp;
@@ -2207,6 +3082,8 @@ static void ast_channel_destructor(void *obj)
 	ast_channel_lock(chan);
 
 	/* Get rid of each of the data stores on the channel */
+	datastore_index_destroy(ast_channel_internal_datastore_index(chan));
+	ast_channel_internal_datastore_index_set(chan, NULL);
 	while ((datastore = AST_LIST_REMOVE_HEAD(ast_channel_datastores(chan), entry)))
 		/* Free the data store */
 		ast_datastore_free(datastore);
@@ -2227,6 +3104,9 @@ static void ast_channel_destructor(void *obj)
 		ast_free(ast_channel_tech_pvt(chan));
 	}
 
+	/* Keep what the next channel can use, the rest is freed below */
+	ast_channel_internal_recycle(chan);
+
 	if (ast_channel_sched(chan)) {
 		ast_sched_context_destroy(ast_channel_sched(chan));
 	}
@@ -2269,19 +3149,13 @@ static void ast_channel_destructor(void *obj)
 		ast_timer_close(ast_channel_timer(chan));
 		ast_channel_timer_set(chan, NULL);
 	}
-#ifdef HAVE_EPOLL
-	for (i = 0; i < AST_MAX_FDS; i++) {
-		if (ast_channel_internal_epfd_data(chan, i)) {
-			ast_free(ast_channel_internal_epfd_data(chan, i));
-		}
-	}
-	close(ast_channel_epfd(chan));
-#endif
 	while ((f = AST_LIST_REMOVE_HEAD(ast_channel_readq(chan), frame_list)))
 		ast_frfree(f);
 
 	/* loop over the variables list, freeing all data and deleting list items */
 	/* no need to lock the list, as the channel is already locked */
+	ast_var_index_destroy(ast_channel_var_index(chan));
+	ast_channel_var_index_set(chan, NULL);
 	headp = ast_channel_varshead(chan);
 	while ((vardata = AST_LIST_REMOVE_HEAD(headp, entries)))
 		ast_var_delete(vardata);
@@ -2332,6 +3206,8 @@ static void ast_dummy_channel_destructor(void *obj)
 	ast_pbx_hangup_handler_destroy(chan);
 
 	/* Get rid of each of the data stores on the channel */
+	datastore_index_destroy(ast_channel_internal_datastore_index(chan));
+	ast_channel_internal_datastore_index_set(chan, NULL);
 	while ((datastore = AST_LIST_REMOVE_HEAD(ast_channel_datastores(chan), entry))) {
 		/* Free the data store */
 		ast_datastore_free(datastore);
@@ -2345,6 +3221,8 @@ static void ast_dummy_channel_destructor(void *obj)
 
 	/* loop over the variables list, freeing all data and deleting list items */
 	/* no need to lock the list, as the channel is already locked */
+	ast_var_index_destroy(ast_channel_var_index(chan));
+	ast_channel_var_index_set(chan, NULL);
 	headp = ast_channel_varshead(chan);
 	while ((vardata = AST_LIST_REMOVE_HEAD(headp, entries)))
 		ast_var_delete(vardata);
@@ -2386,26 +3264,79 @@ int ast_channel_datastore_inherit(struct ast_channel *from, struct ast_channel *
 
 int ast_channel_datastore_add(struct ast_channel *chan, struct ast_datastore *datastore)
 {
+	struct ast_datastore_index *index = channel_datastore_index(chan);
 	int res = 0;
 
 	AST_LIST_INSERT_HEAD(ast_channel_datastores(chan), datastore, entry);
 
+	if (index) {
+		if (datastore_index_set(index, datastore)) {
+			index->stale = 1;
+		} else {
+			datastore_index_update(index, ast_channel_datastores(chan));
+		}
+	}
+
 	return res;
 }
 
 int ast_channel_datastore_remove(struct ast_channel *chan, struct ast_datastore *datastore)
 {
-	return AST_LIST_REMOVE(ast_channel_datastores(chan), datastore, entry) ? 0 : -1;
+	struct ast_datastore_index *index = channel_datastore_index(chan);
+	struct ast_datastore *next = NULL;
+	size_t pos = 0;
+	int found = 0;
+
+	if (index) {
+		pos = datastore_index_position(index, datastore->info, &found);
+		if (found && AST_VECTOR_GET_ADDR(&index->entries, pos)->datastore == datastore) {
+			/* The next datastore of the type becomes the first. */
+			for (next = AST_LIST_NEXT(datastore, entry); next; next = AST_LIST_NEXT(next, entry)) {
+				if (next->info == datastore->info) {
+					break;
+				}
+			}
+		} else {
+			found = 0;
+		}
+	}
+
+	if (!AST_LIST_REMOVE(ast_channel_datastores(chan), datastore, entry)) {
+		return -1;
+	}
+
+	if (index) {
+		if (found && next) {
+			AST_VECTOR_GET_ADDR(&index->entries, pos)->datastore = next;
+		} else if (found) {
+			AST_VECTOR_REMOVE_ORDERED(&index->entries, pos);
+		}
+		datastore_index_update(index, ast_channel_datastores(chan));
+	}
+
+	return 0;
 }
 
 struct ast_datastore *ast_channel_datastore_find(struct ast_channel *chan, const struct ast_datastore_info *info, const char *uid)
 {
-	struct ast_datastore *datastore = NULL;
+	struct ast_datastore_index *index;
+	struct ast_datastore *datastore;
+	int found;
 
 	if (info == NULL)
 		return NULL;
 
-	AST_LIST_TRAVERSE(ast_channel_datastores(chan), datastore, entry) {
+	/* Start from the first datastore of the type, if the channel has an index. */
+	index = channel_datastore_index(chan);
+	if (index) {
+		size_t pos = datastore_index_position(index, info, &found);
+
+		datastore = found ? AST_VECTOR_GET_ADDR(&index->entries, pos)->datastore : NULL;
+	} else {
+		datastore = AST_LIST_FIRST(ast_channel_datastores(chan));
+	}
+
+	for (; datastore; datastore = AST_LIST_NEXT(datastore, entry)) {
 		if (datastore->info != info) {
 			continue;
 		}
@@ -2427,33 +3358,6 @@ struct ast_datastore *ast_channel_datastore_find(struct ast_channel *chan, const
 /*! Set the file descriptor on the channel */
 void ast_channel_set_fd(struct ast_channel *chan, int which, int fd)
 {
-#ifdef HAVE_EPOLL
-	struct epoll_event ev;
-	struct ast_epoll_data *aed = NULL;
-
-	if (ast_channel_fd_isset(chan, which)) {
-		epoll_ctl(ast_channel_epfd(chan), EPOLL_CTL_DEL, ast_channel_fd(chan, which), &ev);
-		aed = ast_channel_internal_epfd_data(chan, which);
-	}
-
-	/* If this new fd is valid, add it to the epoll */
-	if (fd > -1) {
-		if (!aed && (!(aed = ast_calloc(1, sizeof(*aed)))))
-			return;
-
-		ast_channel_internal_epfd_data_set(chan, which, aed);
-		aed->chan = chan;
-		aed->which = which;
-
-		ev.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
-		ev.data.ptr = aed;
-		epoll_ctl(ast_channel_epfd(chan), EPOLL_CTL_ADD, fd, &ev);
-	} else if (aed) {
-		/* We don't have to keep around this epoll data structure now */
-		ast_free(aed);
-		ast_channel_epfd_data_set(chan, which, NULL);
-	}
-#endif
 	ast_channel_internal_fd_set(chan, which, fd);
 	return;
 }
@@ -2461,45 +3365,13 @@ void ast_channel_set_fd(struct ast_channel *chan, int which, int fd)
 /*! Add a channel to an optimized waitfor */
 void ast_poll_channel_add(struct ast_channel *chan0, struct ast_channel *chan1)
 {
-#ifdef HAVE_EPOLL
-	struct epoll_event ev;
-	int i = 0;
-
-	if (ast_channel_epfd(chan0) == -1)
-		return;
-
-	/* Iterate through the file descriptors on chan1, adding them to chan0 */
-	for (i = 0; i < AST_MAX_FDS; i++) {
-		if (!ast_channel_fd_isset(chan1, i)) {
-			continue;
-		}
-		ev.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
-		ev.data.ptr = ast_channel_internal_epfd_data(chan1, i);
-		epoll_ctl(ast_channel_epfd(chan0), EPOLL_CTL_ADD, ast_channel_fd(chan1, i), &ev);
-	}
-
-#endif
+	/* The wait set of the waiting thread follows the channels it waits on. */
 	return;
 }
 
 /*! Delete a channel from an optimized waitfor */
 void ast_poll_channel_del(struct ast_channel *chan0, struct ast_channel *chan1)
 {
-#ifdef HAVE_EPOLL
-	struct epoll_event ev;
-	int i = 0;
-
-	if (ast_channel_epfd(chan0) == -1)
-		return;
-
-	for (i = 0; i < AST_MAX_FDS; i++) {
-		if (!ast_channel_fd_isset(chan1, i)) {
-			continue;
-		}
-		epoll_ctl(ast_channel_epfd(chan0), EPOLL_CTL_DEL, ast_channel_fd(chan1, i), &ev);
-	}
-
-#endif
 	return;
 }
 
@@ -2613,6 +3485,138 @@ static void destroy_hooks(struct ast_channel *chan)
 	ast_framehook_list_destroy(chan);
 }
 
+/*! \brief Names of the call setup stages */
+static const char * const setup_stage_names[AST_CHANNEL_SETUP_STAGE_MAX] = {
+	[AST_CHANNEL_SETUP_RECEIVED] = "received",
+	[AST_CHANNEL_SETUP_DISTRIBUTED] = "distributed",
+	[AST_CHANNEL_SETUP_IDENTIFIED] = "identified",
+	[AST_CHANNEL_SETUP_AUTHENTICATED] = "authenticated",
+	[AST_CHANNEL_SETUP_SESSION] = "session",
+	[AST_CHANNEL_SETUP_CREATED] = "created",
+	[AST_CHANNEL_SETUP_DIALPLAN] = "dialplan",
+	[AST_CHANNEL_SETUP_DIAL] = "dial",
+	[AST_CHANNEL_SETUP_RINGING] = "ringing",
+	[AST_CHANNEL_SETUP_ANSWERED] = "answered",
+};
+
+static const double setup_stage_metric_bounds[] = {
+	0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30
+};
+
+/*! \brief Time taken to reach each setup stage from the previous one reached */
+static struct ast_metric *setup_stage_metrics[AST_CHANNEL_SETUP_STAGE_MAX];
+
+const char *ast_channel_setup_stage_name(enum ast_channel_setup_stage stage)
+{
+	if (stage < 0 || stage >= AST_CHANNEL_SETUP_STAGE_MAX) {
+		return "unknown";
+	}
+	return setup_stage_names[stage];
+}
+
+void ast_setup_times_mark(struct ast_channel_setup_times *times, enum ast_channel_setup_stage stage)
+{
+	if (ast_tvzero(times->stage[stage])) {
+		times->stage[stage] = ast_tvnow();
+	}
+}
+
+void ast_channel_setup_stage_mark(struct ast_channel *chan, enum ast_channel_setup_stage stage)
+{
+	ast_channel_lock(chan);
+	ast_setup_times_mark(ast_channel_internal_setup_times(chan), stage);
+	ast_channel_unlock(chan);
+}
+
+void ast_channel_setup_times_merge(struct ast_channel *chan, const struct ast_channel_setup_times *times)
+{
+	struct ast_channel_setup_times *chan_times;
+	int stage;
+
+	ast_channel_lock(chan);
+	chan_times = ast_channel_internal_setup_times(chan);
+	for (stage = 0; stage < AST_CHANNEL_SETUP_STAGE_MAX; ++stage) {
+		if (ast_tvzero(chan_times->stage[stage])) {
+			chan_times->stage[stage] = times->stage[stage];
+		}
+	}
+	ast_channel_unlock(chan);
+}
+
+void ast_channel_setup_times_str(struct ast_channel *chan, struct ast_str **buf)
+{
+	struct ast_channel_setup_times *times = ast_channel_internal_setup_times(chan);
+	struct timeval first = { 0, };
+	int stage;
+
+	for (stage = 0; stage < AST_CHANNEL_SETUP_STAGE_MAX; ++stage) {
+		if (!ast_tvzero(times->stage[stage])
+			&& (ast_tvzero(first) || ast_tvcmp(times->stage[stage], first) < 0)) {
+			first = times->stage[stage];
+		}
+	}
+
+	ast_str_reset(*buf);
+	for (stage = 0; stage < AST_CHANNEL_SETUP_STAGE_MAX; ++stage) {
+		if (ast_tvzero(times->stage[stage])) {
+			continue;
+		}
+		ast_str_append(buf, 0, "%s%s=%.3f", ast_str_strlen(*buf) ? "," : "",
+			setup_stage_names[stage], ast_tvdiff_us(times->stage[stage], first) / 1000000.0);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Add the time a hung up channel took between its setup stages to the metrics
+ *
+ * \param chan The channel, locked
+ */
+static void setup_times_observe(struct ast_channel *chan)
+{
+	struct ast_channel_setup_times *times = ast_channel_internal_setup_times(chan);
+	int previous = -1;
+	int stage;
+
+	for (stage = 0; stage < AST_CHANNEL_SETUP_STAGE_MAX; ++stage) {
+		if (ast_tvzero(times->stage[stage])) {
+			continue;
+		}
+		if (previous >= 0) {
+			int64_t elapsed = ast_tvdiff_us(times->stage[stage], times->stage[previous]);
+
+			ast_metric_observe(setup_stage_metrics[stage], MAX(elapsed, 0) / 1000000.0);
+		}
+		previous = stage;
+	}
+}
+
+static void setup_stage_metrics_destroy(void)
+{
+	int stage;
+
+	for (stage = 0; stage < AST_CHANNEL_SETUP_STAGE_MAX; ++stage) {
+		ast_metric_destroy(setup_stage_metrics[stage]);
+		setup_stage_metrics[stage] = NULL;
+	}
+}
+
+static void setup_stage_metrics_create(void)
+{
+	char name[64];
+	char help[128];
+	int stage;
+
+	/* The first stage is never reached from another */
+	for (stage = 1; stage < AST_CHANNEL_SETUP_STAGE_MAX; ++stage) {
+		snprintf(name, sizeof(name), "asterisk_channel_setup_%s_seconds", setup_stage_names[stage]);
+		snprintf(help, sizeof(help), "Time calls took to reach the %s setup stage from the previous one",
+			setup_stage_names[stage]);
+		setup_stage_metrics[stage] = ast_metric_histogram_create(name, help,
+			setup_stage_metric_bounds, ARRAY_LEN(setup_stage_metric_bounds));
+	}
+}
+
 /*! \brief Hangup a channel */
 void ast_hangup(struct ast_channel *chan)
 {
@@ -2621,6 +3625,8 @@ void ast_hangup(struct ast_channel *chan)
 		return;
 	}
 
+	AST_PROBE3(channel__hangup__start, chan, ast_channel_name(chan), ast_channel_hangupcause(chan));
+
 	ast_autoservice_stop(chan);
 
 	ast_channel_lock(chan);
@@ -2632,6 +3638,8 @@ void ast_hangup(struct ast_channel *chan)
 	/* Mark as a zombie so a masquerade cannot be setup on this channel. */
 	ast_set_flag(ast_channel_flags(chan), AST_FLAG_ZOMBIE);
 
+	setup_times_observe(chan);
+
 	ast_channel_unlock(chan);
 
 	/*
@@ -2644,7 +3652,7 @@ void ast_hangup(struct ast_channel *chan)
 	 * longer be needed.
 	 */
 	ast_pbx_hangup_handler_run(chan);
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 	ast_channel_lock(chan);
 
 	destroy_hooks(chan);
@@ -2689,6 +3697,8 @@ void ast_hangup(struct ast_channel *chan)
 
 	ast_cc_offer(chan);
 
+	AST_PROBE2(channel__hangup__done, chan, ast_channel_name(chan));
+
 	ast_channel_unref(chan);
 }
 
@@ -2948,57 +3958,258 @@ static int generator_force(const void *data)
 	return 0;
 }
 
-int ast_activate_generator(struct ast_channel *chan, struct ast_generator *gen, void *params)
+int ast_activate_generator(struct ast_channel *chan, struct ast_generator *gen, void *params)
+{
+	int res = 0;
+	void *generatordata = NULL;
+
+	ast_channel_lock(chan);
+	if (ast_channel_generatordata(chan)) {
+		struct ast_generator *generator_old = ast_channel_generator(chan);
+
+		if (generator_old && generator_old->release) {
+			generator_old->release(chan, ast_channel_generatordata(chan));
+		}
+	}
+	if (gen->alloc && !(generatordata = gen->alloc(chan, params))) {
+		res = -1;
+	}
+	ast_channel_generatordata_set(chan, generatordata);
+	if (!res) {
+		ast_settimeout(chan, 50, generator_force, chan);
+		ast_channel_generator_set(chan, gen);
+	}
+	ast_channel_unlock(chan);
+
+	ast_prod(chan);
+
+	return res;
+}
+
+/*! \brief Wait for x amount of time on a file descriptor to have input.  */
+int ast_waitfor_n_fd(int *fds, int n, int *ms, int *exception)
+{
+	int winner = -1;
+	ast_waitfor_nandfds(NULL, 0, fds, n, exception, &winner, ms);
+	return winner;
+}
+
+#ifdef HAVE_EPOLL
+/*!
+ * \brief Wait with a thread's epoll set when waiting on at least this many channels
+ *
+ * Rebuilding a pollfd array is cheaper than keeping an epoll set in sync for
+ * the few channels most threads wait on.
+ */
+#define WAITSET_MIN_CHANNELS 4
+
+/*! \brief Maximum number of ready file descriptors reported by one wait */
+#define WAITSET_MAX_EVENTS 32
+
+/*! \brief File descriptors of a channel registered in a wait set */
+struct channel_waitset_entry {
+	/*! Version of the channel's file descriptors when registered, 0 if none */
+	uint64_t version;
+	/*! The registered file descriptors, -1 if not registered */
+	int fds[AST_MAX_FDS];
+};
+
+/*!
+ * \brief The epoll set a thread waits on channels with
+ *
+ * The set holds the file descriptors of the channels the thread waited on
+ * last, by their position in the channel array. A wait only changes the
+ * registrations of the channels whose position or file descriptors changed
+ * since, which ast_channel_internal_fd_version() tells without a system call.
+ */
+struct channel_waitset {
+	/*! The epoll set, -1 if the thread can't use one */
+	int epfd;
+	/*! Number of entries in use */
+	int count;
+	/*! Number of entries allocated */
+	int size;
+	/*! Registered file descriptors by channel position */
+	struct channel_waitset_entry *entries;
+};
+
+static int channel_waitset_init(void *data)
+{
+	struct channel_waitset *waitset = data;
+
+	waitset->epfd = epoll_create1(EPOLL_CLOEXEC);
+	return 0;
+}
+
+static void channel_waitset_cleanup(void *data)
+{
+	struct channel_waitset *waitset = data;
+
+	if (waitset->epfd > -1) {
+		close(waitset->epfd);
+	}
+	ast_free(waitset->entries);
+	ast_free(waitset);
+}
+
+AST_THREADSTORAGE_CUSTOM(channel_waitset_storage, channel_waitset_init, channel_waitset_cleanup);
+
+/*!
+ * \internal
+ * \brief Stop using the epoll set of a thread.
+ *
+ * The thread waits with poll from now on.
+ */
+static void channel_waitset_disable(struct channel_waitset *waitset)
+{
+	ast_debug(1, "Waiting on channels with poll: %s\n", strerror(errno));
+	close(waitset->epfd);
+	waitset->epfd = -1;
+	waitset->count = 0;
+}
+
+/*!
+ * \internal
+ * \brief Register the file descriptors of the channels to wait on.
+ *
+ * \param waitset The wait set of the thread
+ * \param c The channels
+ * \param n Number of channels
+ *
+ * \retval 0 on success
+ * \retval -1 if the thread must wait with poll
+ */
+static int channel_waitset_sync(struct channel_waitset *waitset, struct ast_channel **c, int n)
+{
+	struct channel_waitset_entry *entry;
+	struct epoll_event ev = { 0, };
+	uint64_t version;
+	int removed = 0;
+	int x, y, fd;
+
+	if (n > waitset->size) {
+		entry = ast_realloc(waitset->entries, n * sizeof(*entry));
+		if (!entry) {
+			return -1;
+		}
+		waitset->entries = entry;
+		for (x = waitset->size; x < n; x++) {
+			waitset->entries[x].version = 0;
+			for (y = 0; y < AST_MAX_FDS; y++) {
+				waitset->entries[x].fds[y] = -1;
+			}
+		}
+		waitset->size = n;
+	}
+
+	/*
+	 * Remove every file descriptor of the channels whose file descriptors
+	 * changed, even those with the same number: the old one may have been
+	 * closed, which dropped it from the set, and the number reused by a new
+	 * one. Removing them all first also lets a file descriptor moving to
+	 * another position be registered again.
+	 */
+	for (x = 0; x < waitset->count; x++) {
+		entry = &waitset->entries[x];
+		if (x < n && entry->version == ast_channel_internal_fd_version(c[x])) {
+			continue;
+		}
+		for (y = 0; y < AST_MAX_FDS; y++) {
+			if (entry->fds[y] > -1) {
+				/* Closed file descriptors are already gone from the set. */
+				epoll_ctl(waitset->epfd, EPOLL_CTL_DEL, entry->fds[y], &ev);
+				entry->fds[y] = -1;
+				removed = 1;
+			}
+		}
+		entry->version = 0;
+	}
+
+	for (x = 0; x < n; x++) {
+		entry = &waitset->entries[x];
+		version = ast_channel_internal_fd_version(c[x]);
+		/*
+		 * A file descriptor removed above may be shared with a channel
+		 * which did not change, and must be registered for it instead.
+		 */
+		if (entry->version == version && !removed) {
+			continue;
+		}
+		for (y = 0; y < AST_MAX_FDS; y++) {
+			fd = ast_channel_fd(c[x], y);
+			if (fd < 0 || fd == entry->fds[y]) {
+				continue;
+			}
+			ev.events = EPOLLIN | EPOLLPRI;
+			ev.data.u64 = (uint64_t) x * AST_MAX_FDS + y;
+			if (!epoll_ctl(waitset->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+				entry->fds[y] = fd;
+			} else if (errno != EEXIST) {
+				/* Not pollable with epoll, such as a regular file */
+				channel_waitset_disable(waitset);
+				return -1;
+			}
+			/* Otherwise another channel shares the file descriptor and reports it. */
+		}
+		entry->version = version;
+	}
+	waitset->count = n;
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Get the epoll set the thread waits on channels with.
+ *
+ * \param c The channels to wait on
+ * \param n Number of channels
+ * \param nfds Number of extra file descriptors to wait on
+ *
+ * \return The wait set, with the channels registered
+ * \retval NULL if the thread must wait with poll
+ */
+static struct channel_waitset *channel_waitset_get(struct ast_channel **c, int n, int nfds)
 {
-	int res = 0;
-	void *generatordata = NULL;
-
-	ast_channel_lock(chan);
-	if (ast_channel_generatordata(chan)) {
-		struct ast_generator *generator_old = ast_channel_generator(chan);
+	struct channel_waitset *waitset;
 
-		if (generator_old && generator_old->release) {
-			generator_old->release(chan, ast_channel_generatordata(chan));
-		}
-	}
-	if (gen->alloc && !(generatordata = gen->alloc(chan, params))) {
-		res = -1;
-	}
-	ast_channel_generatordata_set(chan, generatordata);
-	if (!res) {
-		ast_settimeout(chan, 50, generator_force, chan);
-		ast_channel_generator_set(chan, gen);
+	if (n < WAITSET_MIN_CHANNELS || nfds) {
+		return NULL;
 	}
-	ast_channel_unlock(chan);
-
-	ast_prod(chan);
 
-	return res;
+	waitset = ast_threadstorage_get(&channel_waitset_storage, sizeof(*waitset));
+	if (!waitset || waitset->epfd < 0 || channel_waitset_sync(waitset, c, n)) {
+		return NULL;
+	}
+	return waitset;
 }
+#endif
 
-/*! \brief Wait for x amount of time on a file descriptor to have input.  */
-int ast_waitfor_n_fd(int *fds, int n, int *ms, int *exception)
+/*!
+ * \internal
+ * \brief Wait for file descriptors with poll or with a wait set.
+ */
+static int channel_wait(struct pollfd *pfds, int max, int epfd, void *events, int timeout)
 {
-	int winner = -1;
-	ast_waitfor_nandfds(NULL, 0, fds, n, exception, &winner, ms);
-	return winner;
+#ifdef HAVE_EPOLL
+	if (epfd > -1) {
+		return epoll_wait(epfd, events, WAITSET_MAX_EVENTS, timeout);
+	}
+#endif
+	return ast_poll(pfds, max, timeout);
 }
 
 /*! \brief Wait for x amount of time on a file descriptor to have input.  */
-#ifdef HAVE_EPOLL
-static struct ast_channel *ast_waitfor_nandfds_classic(struct ast_channel **c, int n, int *fds, int nfds,
-					int *exception, int *outfd, int *ms)
-#else
 struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds, int nfds,
 					int *exception, int *outfd, int *ms)
-#endif
 {
 	struct timeval start = { 0 , 0 };
 	struct pollfd *pfds = NULL;
 	int res;
 	long rms;
-	int x, y, max;
+	int x, y, max = 0;
 	int sz;
+	int epfd = -1;
 	struct timeval now = { 0, 0 };
 	struct timeval whentohangup = { 0, 0 }, diff;
 	struct ast_channel *winner = NULL;
@@ -3006,6 +4217,12 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 		int chan;
 		int fdno;
 	} *fdmap = NULL;
+#ifdef HAVE_EPOLL
+	struct epoll_event events[WAITSET_MAX_EVENTS];
+	struct channel_waitset *waitset;
+#else
+	void *events = NULL;
+#endif
 
 	if (outfd) {
 		*outfd = -99999;
@@ -3014,10 +4231,7 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 		*exception = 0;
 	}
 
-	if ((sz = n * AST_MAX_FDS + nfds)) {
-		pfds = ast_alloca(sizeof(*pfds) * sz);
-		fdmap = ast_alloca(sizeof(*fdmap) * sz);
-	} else {
+	if (!(sz = n * AST_MAX_FDS + nfds)) {
 		/* nothing to allocate and no FDs to check */
 		return NULL;
 	}
@@ -3052,24 +4266,38 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 		/* Tiny corner case... call would need to last >24 days */
 		rms = INT_MAX;
 	}
-	/*
-	 * Build the pollfd array, putting the channels' fds first,
-	 * followed by individual fds. Order is important because
-	 * individual fd's must have priority over channel fds.
-	 */
-	max = 0;
-	for (x = 0; x < n; x++) {
-		for (y = 0; y < AST_MAX_FDS; y++) {
-			fdmap[max].fdno = y;  /* fd y is linked to this pfds */
-			fdmap[max].chan = x;  /* channel x is linked to this pfds */
-			max += ast_add_fd(&pfds[max], ast_channel_fd(c[x], y));
+
+#ifdef HAVE_EPOLL
+	/* Many channels are waited on with the thread's epoll set instead */
+	if ((waitset = channel_waitset_get(c, n, nfds))) {
+		epfd = waitset->epfd;
+		for (x = 0; x < n; x++) {
+			CHECK_BLOCKING(c[x]);
+		}
+	} else
+#endif
+	{
+		pfds = ast_alloca(sizeof(*pfds) * sz);
+		fdmap = ast_alloca(sizeof(*fdmap) * sz);
+
+		/*
+		 * Build the pollfd array, putting the channels' fds first,
+		 * followed by individual fds. Order is important because
+		 * individual fd's must have priority over channel fds.
+		 */
+		for (x = 0; x < n; x++) {
+			for (y = 0; y < AST_MAX_FDS; y++) {
+				fdmap[max].fdno = y;  /* fd y is linked to this pfds */
+				fdmap[max].chan = x;  /* channel x is linked to this pfds */
+				max += ast_add_fd(&pfds[max], ast_channel_fd(c[x], y));
+			}
+			CHECK_BLOCKING(c[x]);
+		}
+		/* Add the individual fds */
+		for (x = 0; x < nfds; x++) {
+			fdmap[max].chan = -1;
+			max += ast_add_fd(&pfds[max], fds[x]);
 		}
-		CHECK_BLOCKING(c[x]);
-	}
-	/* Add the individual fds */
-	for (x = 0; x < nfds; x++) {
-		fdmap[max].chan = -1;
-		max += ast_add_fd(&pfds[max], fds[x]);
 	}
 
 	if (*ms > 0) {
@@ -3082,13 +4310,13 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 			if (kbrms > 600000) {
 				kbrms = 600000;
 			}
-			res = ast_poll(pfds, max, kbrms);
+			res = channel_wait(pfds, max, epfd, events, kbrms);
 			if (!res) {
 				rms -= kbrms;
 			}
 		} while (!res && (rms > 0));
 	} else {
-		res = ast_poll(pfds, max, rms);
+		res = channel_wait(pfds, max, epfd, events, rms);
 	}
 	for (x = 0; x < n; x++) {
 		ast_clear_flag(ast_channel_flags(c[x]), AST_FLAG_BLOCKING);
@@ -3115,6 +4343,29 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 		*ms = 0;	/* XXX use 0 since we may not have an exact timeout. */
 		return winner;
 	}
+#ifdef HAVE_EPOLL
+	if (epfd > -1) {
+		int found = -1;
+		uint32_t revents = 0;
+
+		/* The channel and fd that would be last in a pollfd array wins, as with poll */
+		for (x = 0; x < res; x++) {
+			if (events[x].data.u64 < (uint64_t) n * AST_MAX_FDS && (int) events[x].data.u64 > found) {
+				found = events[x].data.u64;
+				revents = events[x].events;
+			}
+		}
+		if (found > -1) {
+			winner = c[found / AST_MAX_FDS];
+			if (revents & EPOLLPRI) {
+				ast_set_flag(ast_channel_flags(winner), AST_FLAG_EXCEPTION);
+			} else {
+				ast_clear_flag(ast_channel_flags(winner), AST_FLAG_EXCEPTION);
+			}
+			ast_channel_fdno_set(winner, found % AST_MAX_FDS);
+		}
+	}
+#endif
 	/*
 	 * Then check if any channel or fd has a pending event.
 	 * Remember to check channels first and fds last, as they
@@ -3152,205 +4403,6 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 	return winner;
 }
 
-#ifdef HAVE_EPOLL
-static struct ast_channel *ast_waitfor_nandfds_simple(struct ast_channel *chan, int *ms)
-{
-	struct timeval start = { 0 , 0 };
-	int res = 0;
-	struct epoll_event ev[1];
-	long diff, rms = *ms;
-	struct ast_channel *winner = NULL;
-	struct ast_epoll_data *aed = NULL;
-
-	ast_channel_lock(chan);
-	/* Figure out their timeout */
-	if (!ast_tvzero(*ast_channel_whentohangup(chan))) {
-		if ((diff = ast_tvdiff_ms(*ast_channel_whentohangup(chan), ast_tvnow())) < 0) {
-			/* They should already be hungup! */
-			ast_channel_softhangup_internal_flag_add(chan, AST_SOFTHANGUP_TIMEOUT);
-			ast_channel_unlock(chan);
-			return NULL;
-		}
-		/* If this value is smaller then the current one... make it priority */
-		if (rms > diff) {
-			rms = diff;
-		}
-	}
-
-	ast_channel_unlock(chan);
-
-	/* Time to make this channel block... */
-	CHECK_BLOCKING(chan);
-
-	if (*ms > 0) {
-		start = ast_tvnow();
-	}
-
-	/* We don't have to add any file descriptors... they are already added, we just have to wait! */
-	res = epoll_wait(ast_channel_epfd(chan), ev, 1, rms);
-
-	/* Stop blocking */
-	ast_clear_flag(ast_channel_flags(chan), AST_FLAG_BLOCKING);
-
-	/* Simulate a timeout if we were interrupted */
-	if (res < 0) {
-		if (errno != EINTR) {
-			*ms = -1;
-		}
-		return NULL;
-	}
-
-	/* If this channel has a timeout see if it expired */
-	if (!ast_tvzero(*ast_channel_whentohangup(chan))) {
-		if (ast_tvdiff_ms(ast_tvnow(), *ast_channel_whentohangup(chan)) >= 0) {
-			ast_channel_softhangup_internal_flag_add(chan, AST_SOFTHANGUP_TIMEOUT);
-			winner = chan;
-		}
-	}
-
-	/* No fd ready, reset timeout and be done for now */
-	if (!res) {
-		*ms = 0;
-		return winner;
-	}
-
-	/* See what events are pending */
-	aed = ev[0].data.ptr;
-	ast_channel_fdno_set(chan, aed->which);
-	if (ev[0].events & EPOLLPRI) {
-		ast_set_flag(ast_channel_flags(chan), AST_FLAG_EXCEPTION);
-	} else {
-		ast_clear_flag(ast_channel_flags(chan), AST_FLAG_EXCEPTION);
-	}
-
-	if (*ms > 0) {
-		*ms -= ast_tvdiff_ms(ast_tvnow(), start);
-		if (*ms < 0) {
-			*ms = 0;
-		}
-	}
-
-	return chan;
-}
-
-static struct ast_channel *ast_waitfor_nandfds_complex(struct ast_channel **c, int n, int *ms)
-{
-	struct timeval start = { 0 , 0 };
-	int res = 0, i;
-	struct epoll_event ev[25] = { { 0, } };
-	struct timeval now = { 0, 0 };
-	long whentohangup = 0, diff = 0, rms = *ms;
-	struct ast_channel *winner = NULL;
-
-	for (i = 0; i < n; i++) {
-		ast_channel_lock(c[i]);
-		if (!ast_tvzero(*ast_channel_whentohangup(c[i]))) {
-			if (whentohangup == 0) {
-				now = ast_tvnow();
-			}
-			if ((diff = ast_tvdiff_ms(*ast_channel_whentohangup(c[i]), now)) < 0) {
-				ast_channel_softhangup_internal_flag_add(c[i], AST_SOFTHANGUP_TIMEOUT);
-				ast_channel_unlock(c[i]);
-				return c[i];
-			}
-			if (!whentohangup || whentohangup > diff) {
-				whentohangup = diff;
-			}
-		}
-		ast_channel_unlock(c[i]);
-		CHECK_BLOCKING(c[i]);
-	}
-
-	rms = *ms;
-	if (whentohangup) {
-		rms = whentohangup;
-		if (*ms >= 0 && *ms < rms) {
-			rms = *ms;
-		}
-	}
-
-	if (*ms > 0) {
-		start = ast_tvnow();
-	}
-
-	res = epoll_wait(ast_channel_epfd(c[0]), ev, 25, rms);
-
-	for (i = 0; i < n; i++) {
-		ast_clear_flag(ast_channel_flags(c[i]), AST_FLAG_BLOCKING);
-	}
-
-	if (res < 0) {
-		if (errno != EINTR) {
-			*ms = -1;
-		}
-		return NULL;
-	}
-
-	if (whentohangup) {
-		now = ast_tvnow();
-		for (i = 0; i < n; i++) {
-			if (!ast_tvzero(*ast_channel_whentohangup(c[i])) && ast_tvdiff_ms(now, *ast_channel_whentohangup(c[i])) >= 0) {
-				ast_channel_softhangup_internal_flag_add(c[i], AST_SOFTHANGUP_TIMEOUT);
-				if (!winner) {
-					winner = c[i];
-				}
-			}
-		}
-	}
-
-	if (!res) {
-		*ms = 0;
-		return winner;
-	}
-
-	for (i = 0; i < res; i++) {
-		struct ast_epoll_data *aed = ev[i].data.ptr;
-
-		if (!ev[i].events || !aed) {
-			continue;
-		}
-
-		winner = aed->chan;
-		if (ev[i].events & EPOLLPRI) {
-			ast_set_flag(ast_channel_flags(winner), AST_FLAG_EXCEPTION);
-		} else {
-			ast_clear_flag(ast_channel_flags(winner), AST_FLAG_EXCEPTION);
-		}
-		ast_channel_fdno_set(winner, aed->which);
-	}
-
-	if (*ms > 0) {
-		*ms -= ast_tvdiff_ms(ast_tvnow(), start);
-		if (*ms < 0) {
-			*ms = 0;
-		}
-	}
-
-	return winner;
-}
-
-struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds, int nfds,
-					int *exception, int *outfd, int *ms)
-{
-	/* Clear all provided values in one place. */
-	if (outfd) {
-		*outfd = -99999;
-	}
-	if (exception) {
-		*exception = 0;
-	}
-
-	/* If no epoll file descriptor is available resort to classic nandfds */
-	if (!n || nfds || ast_channel_epfd(c[0]) == -1) {
-		return ast_waitfor_nandfds_classic(c, n, fds, nfds, exception, outfd, ms);
-	} else if (!nfds && n == 1) {
-		return ast_waitfor_nandfds_simple(c[0], ms);
-	} else {
-		return ast_waitfor_nandfds_complex(c, n, ms);
-	}
-}
-#endif
-
 struct ast_channel *ast_waitfor_n(struct ast_channel **c, int n, int *ms)
 {
 	return ast_waitfor_nandfds(c, n, NULL, 0, NULL, NULL, ms);
@@ -3709,6 +4761,8 @@ static struct ast_frame *__ast_read(struct ast_channel *chan, int dropaudio)
 	/* this function is very long so make sure there is only one return
 	 * point at the end (there are only two exceptions to this).
 	 */
+	AST_PROBE2(channel__read__start, chan, dropaudio);
+
 	ast_channel_lock(chan);
 
 	/* Stop if we're a zombie or need a soft hangup */
@@ -3790,6 +4844,7 @@ static struct ast_frame *__ast_read(struct ast_channel *chan, int dropaudio)
 			}
 
 			/* cannot 'goto done' because the channel is already unlocked */
+			AST_PROBE2(channel__read__done, chan, AST_FRAME_NULL);
 			return &ast_null_frame;
 
 		case AST_TIMING_EVENT_CONTINUOUS:
@@ -4270,6 +5325,7 @@ done:
 		ast_channel_audiohooks_set(chan, NULL);
 	}
 	ast_channel_unlock(chan);
+	AST_PROBE2(channel__read__done, chan, f ? (int) f->frametype : -1);
 	return f;
 }
 
@@ -4494,7 +5550,8 @@ int ast_indicate_data(struct ast_channel *chan, int _condition,
 		goto indicate_cleanup;
 	}
 
-	if (!ast_framehook_list_is_empty(ast_channel_framehooks(chan))) {
+	if (ast_framehook_list_wants_frame_type(ast_channel_framehooks(chan),
+			AST_FRAMEHOOK_EVENT_WRITE, AST_FRAME_CONTROL)) {
 		/* Do framehooks now, do it, go, go now */
 		struct ast_frame frame = {
 			.frametype = AST_FRAME_CONTROL,
@@ -4979,11 +6036,14 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 	struct ast_frame *f = NULL;
 	int count = 0;
 
+	AST_PROBE2(channel__write__start, chan, (int) fr->frametype);
+
 	/*Deadlock avoidance*/
 	while(ast_channel_trylock(chan)) {
 		/*cannot goto done since the channel is not locked*/
 		if(count++ > 10) {
 			ast_debug(1, "Deadlock avoided for write to channel '%s'\n", ast_channel_name(chan));
+			AST_PROBE2(channel__write__done, chan, 0);
 			return 0;
 		}
 		usleep(1);
@@ -4992,6 +6052,11 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 	if (ast_test_flag(ast_channel_flags(chan), AST_FLAG_ZOMBIE) || ast_check_hangup(chan))
 		goto done;
 
+	/* Framehooks may modify the frame, so it needs its own data for them. */
+	if (!ast_framehook_list_is_empty(ast_channel_framehooks(chan)) && ast_frame_unshare(fr)) {
+		goto done;
+	}
+
 	/* Perform the framehook write event here. After the frame enters the framehook list
 	 * there is no telling what will happen, how awesome is that!!! */
 	if (!(fr = ast_framehook_list_write_event(ast_channel_framehooks(chan), fr))) {
@@ -5086,7 +6151,8 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 		if (ast_channel_tech(chan)->write == NULL)
 			break;	/*! \todo XXX should return 0 maybe ? */
 
-		if (ast_opt_generic_plc && ast_format_cmp(fr->subclass.format, ast_format_slin) == AST_FORMAT_CMP_EQUAL) {
+		if (ast_opt_generic_plc && ast_format_cmp(fr->subclass.format, ast_format_slin) == AST_FORMAT_CMP_EQUAL
+			&& !ast_frame_unshare(fr)) {
 			apply_plc(chan, fr);
 		}
 
@@ -5119,7 +6185,7 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 					break;
 				}
 			}
-			f = ast_channel_writetrans(chan) ? ast_translate(ast_channel_writetrans(chan), fr, 0) : fr;
+			f = ast_channel_writetrans(chan) ? ast_translate_offload(ast_channel_writetrans(chan), fr, 0) : fr;
 		}
 
 		if (!f) {
@@ -5133,6 +6199,9 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 
 			if (f != fr) {
 				freeoldlist = 1;
+			} else if (ast_frame_unshare(fr)) {
+				/* Audiohooks may modify the frame, such as to adjust its volume. */
+				break;
 			}
 
 			/* Since ast_audiohook_write may return a new frame, and the cur frame is
@@ -5276,6 +6345,7 @@ done:
 		ast_channel_audiohooks_set(chan, NULL);
 	}
 	ast_channel_unlock(chan);
+	AST_PROBE2(channel__write__done, chan, res);
 	return res;
 }
 
@@ -6419,9 +7489,9 @@ void ast_change_name(struct ast_channel *chan, const char *newname)
 	/* We must re-link, as the hash value will change here. */
 	ao2_lock(channels);
 	ast_channel_lock(chan);
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 	__ast_change_name_nolink(chan, newname);
-	ao2_link(channels, chan);
+	channel_link(chan);
 	ast_channel_unlock(chan);
 	ao2_unlock(channels);
 }
@@ -6462,6 +7532,7 @@ void ast_channel_inherit_variables(const struct ast_channel *parent, struct ast_
 				ast_var_full_name(newvar), ast_channel_name(parent),
 				ast_channel_name(child));
 			AST_LIST_INSERT_TAIL(ast_channel_varshead(child), newvar, entries);
+			ast_channel_varshead_changed(child);
 			ast_channel_publish_varset(child, ast_var_full_name(newvar),
 				ast_var_value(newvar));
 		}
@@ -6491,6 +7562,9 @@ static void clone_variables(struct ast_channel *original, struct ast_channel *cl
 		if (newvar)
 			AST_LIST_INSERT_TAIL(ast_channel_varshead(clonechan), newvar, entries);
 	}
+
+	ast_channel_varshead_changed(original);
+	ast_channel_varshead_changed(clonechan);
 }
 
 
@@ -6569,8 +7643,8 @@ static void channel_do_masquerade(struct ast_channel *original, struct ast_chann
 	ast_channel_ref(clonechan);
 
 	/* unlink from channels container as name (which is the hash value) will change */
-	ao2_unlink(channels, original);
-	ao2_unlink(channels, clonechan);
+	channel_unlink(original);
+	channel_unlink(clonechan);
 
 	moh_is_playing = ast_test_flag(ast_channel_flags(original), AST_FLAG_MOH);
 	if (moh_is_playing) {
@@ -6960,8 +8034,8 @@ static void channel_do_masquerade(struct ast_channel *original, struct ast_chann
 	ast_channel_unlock(original);
 	ast_channel_unlock(clonechan);
 
-	ao2_link(channels, clonechan);
-	ao2_link(channels, original);
+	channel_link(clonechan);
+	channel_link(original);
 	ao2_unlock(channels);
 
 	/* Release our held safety references. */
@@ -7727,28 +8801,137 @@ struct varshead *ast_channel_get_manager_vars(struct ast_channel *chan)
 	return ret;
 }
 
+/*! \brief Number of channels of one channel technology */
+struct channel_tech_count {
+	const struct ast_channel_tech *tech;
+	unsigned int count;
+};
+
+/*! \brief The channel technologies channels are counted for */
+struct channel_tech_counts {
+	struct channel_tech_count *techs;
+	size_t num_techs;
+};
+
+static int channel_tech_count_cb(void *obj, void *arg, int flags)
+{
+	struct channel_tech_counts *counts = arg;
+	const struct ast_channel_tech *tech = ast_channel_tech(obj);
+	size_t i;
+
+	for (i = 0; i < counts->num_techs; ++i) {
+		if (counts->techs[i].tech == tech) {
+			++counts->techs[i].count;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void channels_metrics_collect(struct ast_metrics_output *out)
+{
+	struct channel_tech_counts counts = { NULL, 0 };
+	struct chanlist *cl;
+	size_t i;
+	int pool_size;
+	int pool_count;
+	unsigned int pool_reused;
+
+	ast_metrics_output_family(out, "asterisk_channels", AST_METRIC_GAUGE,
+		"Channels by channel technology");
+
+	/* The technologies stay registered until the channels have been counted */
+	AST_RWLIST_RDLOCK(&backends);
+	AST_RWLIST_TRAVERSE(&backends, cl, list) {
+		++counts.num_techs;
+	}
+	counts.techs = ast_alloca(counts.num_techs * sizeof(*counts.techs));
+	i = 0;
+	AST_RWLIST_TRAVERSE(&backends, cl, list) {
+		counts.techs[i].tech = cl->tech;
+		counts.techs[i++].count = 0;
+	}
+
+	/* One pass over the channels, without a reference or lock on each */
+	ao2_callback(channels, OBJ_NODATA, channel_tech_count_cb, &counts);
+
+	for (i = 0; i < counts.num_techs; ++i) {
+		ast_metrics_output_sample(out, "asterisk_channels", "tech",
+			counts.techs[i].tech->type, counts.techs[i].count);
+	}
+	AST_RWLIST_UNLOCK(&backends);
+
+	ast_channel_pool_stats(&pool_size, &pool_count, &pool_reused);
+	if (pool_size) {
+		ast_metrics_output_family(out, "asterisk_channel_pool_shells", AST_METRIC_GAUGE,
+			"Destroyed channels kept to build new ones");
+		ast_metrics_output_sample(out, "asterisk_channel_pool_shells", NULL, NULL, pool_count);
+		ast_metrics_output_family(out, "asterisk_channel_pool_reused_total", AST_METRIC_COUNTER,
+			"Channels built from a destroyed one");
+		ast_metrics_output_sample(out, "asterisk_channel_pool_reused_total", NULL, NULL, pool_reused);
+	}
+}
+
 static void channels_shutdown(void)
 {
 	free_channelvars();
 
+	ast_metrics_collector_unregister(channels_metrics_collect);
+	setup_stage_metrics_destroy();
 	ast_data_unregister(NULL);
 	ast_cli_unregister_multiple(cli_channel, ARRAY_LEN(cli_channel));
+	ast_channel_pool_size_set(0);
 	if (channels) {
 		ao2_container_unregister("channels");
 		ao2_ref(channels, -1);
 		channels = NULL;
 	}
+	ao2_cleanup(channels_by_name);
+	channels_by_name = NULL;
+	ao2_cleanup(channels_by_uniqueid);
+	channels_by_uniqueid = NULL;
+	ao2_cleanup(channels_by_exten);
+	channels_by_exten = NULL;
+	ao2_cleanup(channels_by_linkedid);
+	channels_by_linkedid = NULL;
+	ao2_cleanup(channels_by_spygroup);
+	channels_by_spygroup = NULL;
 	ast_channel_unregister(&surrogate_tech);
 }
 
 void ast_channels_init(void)
 {
-	channels = ao2_container_alloc(NUM_CHANNEL_BUCKETS,
-			ast_channel_hash_cb, ast_channel_cmp_cb);
+	ast_channel_pool_size_set(ast_option_channel_pool);
+
+	channels = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE | AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND
+			| AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED,
+		NUM_CHANNEL_BUCKETS,
+		ast_channel_hash_cb, NULL, ast_channel_cmp_cb);
 	if (channels) {
 		ao2_container_register("channels", channels, prnt_channel_key);
 	}
 
+	channels_by_name = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_NOLOCK,
+		AO2_CONTAINER_ALLOC_OPT_DUPS_OBJ_REJECT, channel_name_sort_cb, NULL);
+	channels_by_uniqueid = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_NOLOCK,
+		AO2_CONTAINER_ALLOC_OPT_DUPS_OBJ_REJECT, channel_uniqueid_sort_cb, NULL);
+	channels_by_exten = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE, NUM_CHANNEL_BUCKETS,
+		channel_index_entry_hash_cb, NULL, channel_index_entry_cmp_cb);
+	channels_by_linkedid = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE, NUM_CHANNEL_BUCKETS,
+		channel_index_entry_hash_cb, NULL, channel_index_entry_cmp_cb);
+	channels_by_spygroup = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE, NUM_CHANNEL_BUCKETS,
+		channel_index_entry_hash_cb, NULL, channel_index_entry_cmp_cb);
+	if (!channels_by_name || !channels_by_uniqueid || !channels_by_exten || !channels_by_linkedid
+		|| !channels_by_spygroup) {
+		/* Search the channels container for everything. */
+		channel_index_degraded = 1;
+	}
+
 	ast_channel_register(&surrogate_tech);
 
 	ast_stasis_channels_init();
@@ -7759,6 +8942,9 @@ void ast_channels_init(void)
 
 	ast_plc_reload();
 
+	ast_metrics_collector_register("channel", channels_metrics_collect);
+	setup_stage_metrics_create();
+
 	ast_register_cleanup(channels_shutdown);
 
 }
@@ -10335,7 +11521,7 @@ int ast_channel_get_cc_agent_type(struct ast_channel *chan, char *agent_type, si
 
 void ast_channel_unlink(struct ast_channel *chan)
 {
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 }
 
 struct ast_bridge *ast_channel_get_bridge(const struct ast_channel *chan)
@@ -10594,6 +11780,7 @@ int ast_channel_suppress(struct ast_channel *chan, unsigned int direction, enum
 	suppress->direction |= direction;
 
 	interface.data = suppress;
+	interface.frame_types = AST_FRAMEHOOK_BIT(frametype);
 
 	framehook_id = ast_framehook_attach(chan, &interface);
 	if (framehook_id < 0) {
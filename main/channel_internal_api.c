@@ -44,11 +44,13 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/data.h"
 #include "asterisk/endpoints.h"
 #include "asterisk/indications.h"
+#include "asterisk/sched.h"
 #include "asterisk/stasis_cache_pattern.h"
 #include "asterisk/stasis_channels.h"
 #include "asterisk/stasis_endpoints.h"
 #include "asterisk/stringfields.h"
 #include "asterisk/test.h"
+#include "asterisk/timing.h"
 
 /*!
  * \brief Channel UniqueId structure
@@ -97,9 +99,6 @@ struct ast_channel {
 							 *   in the CHANNEL dialplan function */
 	struct ast_channel_monitor *monitor;		/*!< Channel monitoring */
 	ast_callid callid;			/*!< Bound call identifier pointer */
-#ifdef HAVE_EPOLL
-	struct ast_epoll_data *epfd_data[AST_MAX_FDS];
-#endif
 	struct ao2_container *dialed_causes;		/*!< Contains tech-specific and Asterisk cause data from dialed channels */
 
 	AST_DECLARE_STRING_FIELDS(
@@ -153,6 +152,7 @@ struct ast_channel {
 
 	struct ast_frame dtmff;				/*!< DTMF frame */
 	struct varshead varshead;			/*!< A linked list for channel variables. See \ref AstChanVar */
+	struct ast_var_index *var_index;		/*!< Lookup index of varshead */
 	ast_group_t callgroup;				/*!< Call group for call pickups */
 	ast_group_t pickupgroup;			/*!< Pickup group - which calls groups can be picked up? */
 	struct ast_namedgroups *named_callgroups;	/*!< Named call group for call pickups */
@@ -164,6 +164,7 @@ struct ast_channel {
 	struct timeval dtmf_tv;				/*!< The time that an in process digit began, or the last digit ended */
 	struct ast_hangup_handler_list hangup_handlers;/*!< Hangup handlers on the channel. */
 	struct ast_datastore_list datastores; /*!< Data stores on the channel */
+	struct ast_datastore_index *datastore_index; /*!< Lookup index of datastores, see channel.c */
 	struct ast_autochan_list autochans; /*!< Autochans on the channel */
 	unsigned long insmpl;				/*!< Track the read/written samples for monitor use */
 	unsigned long outsmpl;				/*!< Track the read/written samples for monitor use */
@@ -171,6 +172,8 @@ struct ast_channel {
 	int fds[AST_MAX_FDS];				/*!< File descriptors for channel -- Drivers will poll on
 							 *   these file descriptors, so at least one must be non -1.
 							 *   See \arg \ref AstFileDesc */
+	uint64_t fd_version;				/*!< Changes whenever fds changes; unique among all channels */
+	struct ast_channel_index *index;		/*!< Entries of the channel in the secondary indexes of channel.c */
 	int softhangup;				/*!< Whether or not we have been hung up...  Do not set this value
 							 *   directly, use ast_softhangup() */
 	int unbridged;              /*!< If non-zero, the bridge core needs to re-evaluate the current
@@ -200,9 +203,6 @@ struct ast_channel {
 	struct ast_format *rawreadformat;         /*!< Raw read format (before translation) */
 	struct ast_format *rawwriteformat;        /*!< Raw write format (after translation) */
 	unsigned int emulate_dtmf_duration;		/*!< Number of ms left to emulate DTMF for */
-#ifdef HAVE_EPOLL
-	int epfd;
-#endif
 	int visible_indication;                         /*!< Indication currently playing on the channel */
 	int hold_state;							/*!< Current Hold/Unhold state */
 
@@ -211,6 +211,7 @@ struct ast_channel {
 	struct ast_bridge *bridge;                      /*!< Bridge this channel is participating in */
 	struct ast_bridge_channel *bridge_channel;/*!< The bridge_channel this channel is linked with. */
 	struct ast_timer *timer;			/*!< timer object that provided timingfd */
+	struct channel_shell *shell;			/*!< Recycled parts, kept while the channel exists */
 
 	char context[AST_MAX_CONTEXT];			/*!< Dialplan: Current extension context */
 	char exten[AST_MAX_EXTENSION];			/*!< Dialplan: Current extension number */
@@ -219,9 +220,10 @@ struct ast_channel {
 	char dtmf_digit_to_emulate;			/*!< Digit being emulated */
 	char sending_dtmf_digit;			/*!< Digit this channel is currently sending out. (zero if not sending) */
 	struct timeval sending_dtmf_tv;		/*!< The time this channel started sending the current digit. (Invalid if sending_dtmf_digit is zero.) */
-	struct stasis_cp_single *topics;		/*!< Topic for all channel's events */
-	struct stasis_forward *endpoint_forward;	/*!< Subscription for event forwarding to endpoint's topic */
-	struct stasis_forward *endpoint_cache_forward; /*!< Subscription for cache updates to endpoint's topic */
+	struct channel_topics *topics;		/*!< Topics for the channel's events, created when first subscribed to */
+	struct ast_endpoint *endpoint;		/*!< Endpoint the channel's events are also published to */
+	struct ast_channel_snapshot *snapshot;	/*!< The last snapshot created, whose segments the next can share */
+	struct ast_channel_setup_times setup_times;	/*!< When the call setup stages were reached */
 };
 
 /*! \brief The monotonically increasing integer counter for channel uniqueids */
@@ -434,12 +436,16 @@ int ast_channel_data_cmp_structure(const struct ast_data_search *tree,
 
 /* ACCESSORS */
 
-#define DEFINE_STRINGFIELD_SETTERS_FOR(field, publish, assert_on_null) \
+#define DEFINE_STRINGFIELD_SETTERS_FOR(field, publish, assert_on_null, interned) \
 void ast_channel_##field##_set(struct ast_channel *chan, const char *value) \
 { \
 	if ((assert_on_null)) ast_assert(!ast_strlen_zero(value)); \
 	if (!strcmp(value, chan->field)) return; \
-	ast_string_field_set(chan, field, value); \
+	if ((interned)) { \
+		ast_string_field_set_interned(chan, field, value); \
+	} else { \
+		ast_string_field_set(chan, field, value); \
+	} \
 	if (publish && ast_channel_internal_is_finalized(chan)) ast_channel_publish_snapshot(chan); \
 } \
   \
@@ -456,17 +462,21 @@ void ast_channel_##field##_build(struct ast_channel *chan, const char *fmt, ...)
 	va_end(ap); \
 }
 
-DEFINE_STRINGFIELD_SETTERS_FOR(name, 0, 1);
-DEFINE_STRINGFIELD_SETTERS_FOR(language, 1, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(musicclass, 0, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(latest_musicclass, 0, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(accountcode, 1, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(peeraccount, 1, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(userfield, 0, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(call_forward, 0, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(parkinglot, 0, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(hangupsource, 0, 0);
-DEFINE_STRINGFIELD_SETTERS_FOR(dialcontext, 0, 0);
+/*
+ * Languages come from a small set shared by many channels, so they are
+ * interned.  The dialplan can set the other fields to anything.
+ */
+DEFINE_STRINGFIELD_SETTERS_FOR(name, 0, 1, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(language, 1, 0, 1);
+DEFINE_STRINGFIELD_SETTERS_FOR(musicclass, 0, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(latest_musicclass, 0, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(accountcode, 1, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(peeraccount, 1, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(userfield, 0, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(call_forward, 0, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(parkinglot, 0, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(hangupsource, 0, 0, 0);
+DEFINE_STRINGFIELD_SETTERS_FOR(dialcontext, 0, 0, 0);
 
 #define DEFINE_STRINGFIELD_GETTER_FOR(field) const char *ast_channel_##field(const struct ast_channel *chan) \
 { \
@@ -529,6 +539,7 @@ const char *ast_channel_context(const struct ast_channel *chan)
 void ast_channel_context_set(struct ast_channel *chan, const char *value)
 {
 	ast_copy_string(chan->context, value, sizeof(chan->context));
+	ast_channel_internal_index_exten_update(chan);
 }
 const char *ast_channel_exten(const struct ast_channel *chan)
 {
@@ -537,6 +548,7 @@ const char *ast_channel_exten(const struct ast_channel *chan)
 void ast_channel_exten_set(struct ast_channel *chan, const char *value)
 {
 	ast_copy_string(chan->exten, value, sizeof(chan->exten));
+	ast_channel_internal_index_exten_update(chan);
 }
 const char *ast_channel_macrocontext(const struct ast_channel *chan)
 {
@@ -545,6 +557,7 @@ const char *ast_channel_macrocontext(const struct ast_channel *chan)
 void ast_channel_macrocontext_set(struct ast_channel *chan, const char *value)
 {
 	ast_copy_string(chan->macrocontext, value, sizeof(chan->macrocontext));
+	ast_channel_internal_index_exten_update(chan);
 }
 const char *ast_channel_macroexten(const struct ast_channel *chan)
 {
@@ -553,6 +566,7 @@ const char *ast_channel_macroexten(const struct ast_channel *chan)
 void ast_channel_macroexten_set(struct ast_channel *chan, const char *value)
 {
 	ast_copy_string(chan->macroexten, value, sizeof(chan->macroexten));
+	ast_channel_internal_index_exten_update(chan);
 }
 
 char ast_channel_dtmf_digit_to_emulate(const struct ast_channel *chan)
@@ -596,16 +610,6 @@ void ast_channel_amaflags_set(struct ast_channel *chan, enum ama_flags value)
 	ast_channel_publish_snapshot(chan);
 }
 
-#ifdef HAVE_EPOLL
-int ast_channel_epfd(const struct ast_channel *chan)
-{
-	return chan->epfd;
-}
-void ast_channel_epfd_set(struct ast_channel *chan, int value)
-{
-	chan->epfd = value;
-}
-#endif
 int ast_channel_fdno(const struct ast_channel *chan)
 {
 	return chan->fdno;
@@ -1092,6 +1096,21 @@ void ast_channel_whentohangup_set(struct ast_channel *chan, struct timeval *valu
 void ast_channel_varshead_set(struct ast_channel *chan, struct varshead *value)
 {
 	chan->varshead = *value;
+	ast_var_index_reset(chan->var_index);
+	ast_channel_internal_index_spygroup_update(chan);
+}
+struct ast_var_index *ast_channel_var_index(struct ast_channel *chan)
+{
+	return chan->var_index;
+}
+void ast_channel_var_index_set(struct ast_channel *chan, struct ast_var_index *value)
+{
+	chan->var_index = value;
+}
+void ast_channel_varshead_changed(struct ast_channel *chan)
+{
+	ast_var_index_reset(chan->var_index);
+	ast_channel_internal_index_spygroup_update(chan);
 }
 struct timeval ast_channel_creationtime(struct ast_channel *chan)
 {
@@ -1301,10 +1320,35 @@ void ast_channel_internal_alertpipe_swap(struct ast_channel *chan1, struct ast_c
 	}
 }
 
+/*! \brief Last version given to the file descriptors of a channel */
+static uint64_t fd_version_seq;
+
 /* file descriptor array accessors */
 void ast_channel_internal_fd_set(struct ast_channel *chan, int which, int value)
 {
 	chan->fds[which] = value;
+	chan->fd_version = __sync_add_and_fetch(&fd_version_seq, 1);
+}
+uint64_t ast_channel_internal_fd_version(const struct ast_channel *chan)
+{
+	return chan->fd_version;
+}
+
+struct ast_datastore_index *ast_channel_internal_datastore_index(const struct ast_channel *chan)
+{
+	return chan->datastore_index;
+}
+void ast_channel_internal_datastore_index_set(struct ast_channel *chan, struct ast_datastore_index *value)
+{
+	chan->datastore_index = value;
+}
+struct ast_channel_index *ast_channel_internal_index(const struct ast_channel *chan)
+{
+	return chan->index;
+}
+void ast_channel_internal_index_set(struct ast_channel *chan, struct ast_channel_index *value)
+{
+	chan->index = value;
 }
 void ast_channel_internal_fd_clear(struct ast_channel *chan, int which)
 {
@@ -1326,16 +1370,6 @@ int ast_channel_fd_isset(const struct ast_channel *chan, int which)
 	return ast_channel_fd(chan, which) > -1;
 }
 
-#ifdef HAVE_EPOLL
-struct ast_epoll_data *ast_channel_internal_epfd_data(const struct ast_channel *chan, int which)
-{
-	return chan->epfd_data[which];
-}
-void ast_channel_internal_epfd_data_set(struct ast_channel *chan, int which , struct ast_epoll_data *value)
-{
-	chan->epfd_data[which] = value;
-}
-#endif
 
 pthread_t ast_channel_blocker(const struct ast_channel *chan)
 {
@@ -1443,11 +1477,209 @@ static int pvt_cause_cmp_fn(void *obj, void *vstr, int flags)
 	return !strcmp(pc_str, str) ? CMP_MATCH | CMP_STOP : 0;
 }
 
+/*!
+ * \brief Parts of a destroyed channel kept to build a new one
+ *
+ * The channel structure itself is freed by astobj2 once its destructor
+ * returns, so what is recycled is what hangs off it and is costly to make:
+ * the string field pool, the dialed causes container, the scheduler context,
+ * the timer and the alertpipe. Each is scrubbed before it is kept, and any
+ * of them may be missing from a shell.
+ */
+struct channel_shell {
+	/*! String field pool, emptied */
+	struct ast_string_field_pool *pool;
+	/*! Dialed causes container, emptied */
+	struct ao2_container *dialed_causes;
+	/*! Scheduler context without events */
+	struct ast_sched_context *sched;
+	/*! Disarmed timerfd timer */
+	struct ast_timer *timer;
+	/*! Drained alertpipe, -1 when there is none */
+	int alertpipe[2];
+	AST_LIST_ENTRY(channel_shell) entry;
+};
+
+/*! \brief Shells waiting to be reused */
+static struct {
+	ast_mutex_t lock;
+	AST_LIST_HEAD_NOLOCK(, channel_shell) shells;
+	/*! Number of shells kept */
+	int count;
+	/*! Most shells kept, 0 when channels are not recycled */
+	int size;
+	/*! Channels built from a shell */
+	unsigned int reused;
+} channel_pool = {
+	.lock = AST_MUTEX_INIT_VALUE,
+};
+
+static void channel_shell_free(struct channel_shell *shell)
+{
+	struct ast_string_field_pool *pool = shell->pool;
+
+	while (pool) {
+		struct ast_string_field_pool *prev = pool->prev;
+
+		ast_free(pool);
+		pool = prev;
+	}
+	ao2_cleanup(shell->dialed_causes);
+	if (shell->sched) {
+		ast_sched_context_destroy(shell->sched);
+	}
+	if (shell->timer) {
+		ast_timer_close(shell->timer);
+	}
+	if (shell->alertpipe[0] > -1) {
+		close(shell->alertpipe[0]);
+	}
+	if (shell->alertpipe[1] > -1) {
+		close(shell->alertpipe[1]);
+	}
+	ast_free(shell);
+}
+
+/*! \brief Take a shell from the pool, NULL if it is empty */
+static struct channel_shell *channel_shell_get(void)
+{
+	struct channel_shell *shell;
+
+	if (!channel_pool.size) {
+		return NULL;
+	}
+
+	ast_mutex_lock(&channel_pool.lock);
+	if ((shell = AST_LIST_REMOVE_HEAD(&channel_pool.shells, entry))) {
+		--channel_pool.count;
+		++channel_pool.reused;
+	}
+	ast_mutex_unlock(&channel_pool.lock);
+
+	return shell;
+}
+
+/*! \brief Put a shell in the pool, or free it if the pool is full */
+static void channel_shell_put(struct channel_shell *shell)
+{
+	ast_mutex_lock(&channel_pool.lock);
+	if (channel_pool.count < channel_pool.size) {
+		AST_LIST_INSERT_HEAD(&channel_pool.shells, shell, entry);
+		++channel_pool.count;
+		shell = NULL;
+	}
+	ast_mutex_unlock(&channel_pool.lock);
+
+	if (shell) {
+		channel_shell_free(shell);
+	}
+}
+
+int ast_channel_pool_size_set(int size)
+{
+	AST_LIST_HEAD_NOLOCK(, channel_shell) excess;
+	struct channel_shell *shell;
+	int old;
+
+	AST_LIST_HEAD_INIT_NOLOCK(&excess);
+
+	ast_mutex_lock(&channel_pool.lock);
+	old = channel_pool.size;
+	channel_pool.size = MAX(size, 0);
+	while (channel_pool.count > channel_pool.size) {
+		shell = AST_LIST_REMOVE_HEAD(&channel_pool.shells, entry);
+		AST_LIST_INSERT_HEAD(&excess, shell, entry);
+		--channel_pool.count;
+	}
+	ast_mutex_unlock(&channel_pool.lock);
+
+	while ((shell = AST_LIST_REMOVE_HEAD(&excess, entry))) {
+		channel_shell_free(shell);
+	}
+
+	return old;
+}
+
+void ast_channel_pool_stats(int *size, int *count, unsigned int *reused)
+{
+	ast_mutex_lock(&channel_pool.lock);
+	*size = channel_pool.size;
+	*count = channel_pool.count;
+	*reused = channel_pool.reused;
+	ast_mutex_unlock(&channel_pool.lock);
+}
+
+void ast_channel_internal_recycle(struct ast_channel *chan)
+{
+	struct channel_shell *shell;
+	char buf[64];
+
+	/* Racy, only spares building a shell the pool has no room for */
+	if (!channel_pool.size || channel_pool.count >= channel_pool.size) {
+		return;
+	}
+
+	if (!(shell = chan->shell)) {
+		if (!(shell = ast_calloc(1, sizeof(*shell)))) {
+			return;
+		}
+		shell->alertpipe[0] = shell->alertpipe[1] = -1;
+		chan->shell = shell;
+	}
+
+	/* Events left would fire on the next channel */
+	if (!shell->sched && chan->sched && ast_sched_wait(chan->sched) < 0) {
+		shell->sched = chan->sched;
+		chan->sched = NULL;
+	}
+
+	/*
+	 * Other timers alert the channel in continuous mode instead of the
+	 * alertpipe, disarming them does not always forget their ticks.
+	 */
+	if (!shell->timer && chan->timer && !strcmp(ast_timer_get_name(chan->timer), "timerfd")
+		&& !ast_timer_disable_continuous(chan->timer)
+		&& !ast_timer_set_rate(chan->timer, 0)) {
+		shell->timer = chan->timer;
+		chan->timer = NULL;
+		chan->timingfd = -1;
+	}
+
+	if (shell->alertpipe[0] == -1 && chan->alertpipe[0] > -1 && chan->alertpipe[1] > -1) {
+		while (read(chan->alertpipe[0], buf, sizeof(buf)) > 0) {
+		}
+		shell->alertpipe[0] = chan->alertpipe[0];
+		shell->alertpipe[1] = chan->alertpipe[1];
+		ast_channel_internal_alertpipe_clear(chan);
+	}
+
+	/* The string fields and dialed causes are taken by ast_channel_internal_cleanup() */
+}
+
+void ast_channel_internal_shell_restore(struct ast_channel *chan)
+{
+	struct channel_shell *shell = chan->shell;
+
+	if (!shell) {
+		return;
+	}
+
+	/* The emptied shell stays with the channel to be filled again */
+	chan->sched = shell->sched;
+	shell->sched = NULL;
+	chan->timer = shell->timer;
+	shell->timer = NULL;
+	chan->alertpipe[0] = shell->alertpipe[0];
+	chan->alertpipe[1] = shell->alertpipe[1];
+	shell->alertpipe[0] = shell->alertpipe[1] = -1;
+}
+
 #define DIALED_CAUSES_BUCKETS 37
 
 struct ast_channel *__ast_channel_internal_alloc(void (*destructor)(void *obj), const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor, const char *file, int line, const char *function)
 {
 	struct ast_channel *tmp;
+	struct channel_shell *shell;
 
 	tmp = __ao2_alloc(sizeof(*tmp), destructor,
 		AO2_ALLOC_OPT_LOCK_MUTEX, "", file, line, function);
@@ -1456,11 +1688,24 @@ struct ast_channel *__ast_channel_internal_alloc(void (*destructor)(void *obj),
 		return NULL;
 	}
 
-	if ((ast_string_field_init(tmp, 128))) {
+	/* What is left of the shell is handed over by ast_channel_internal_shell_restore() */
+	if ((shell = channel_shell_get())) {
+		tmp->shell = shell;
+		if (shell->pool) {
+			tmp->__field_mgr_pool = shell->pool;
+			shell->pool = NULL;
+			ast_string_field_init(tmp, 0);
+		}
+		tmp->dialed_causes = shell->dialed_causes;
+		shell->dialed_causes = NULL;
+	}
+
+	if (!tmp->__field_mgr_pool && ast_string_field_init(tmp, 128)) {
 		return ast_channel_unref(tmp);
 	}
 
-	if (!(tmp->dialed_causes = ao2_container_alloc(DIALED_CAUSES_BUCKETS, pvt_cause_hash_fn, pvt_cause_cmp_fn))) {
+	if (!tmp->dialed_causes
+		&& !(tmp->dialed_causes = ao2_container_alloc(DIALED_CAUSES_BUCKETS, pvt_cause_hash_fn, pvt_cause_cmp_fn))) {
 		return ast_channel_unref(tmp);
 	}
 
@@ -1517,6 +1762,7 @@ void ast_channel_internal_copy_linkedid(struct ast_channel *dest, struct ast_cha
 		return;
 	}
 	dest->linkedid = source->linkedid;
+	ast_channel_internal_index_linkedid_update(dest);
 	ast_channel_publish_snapshot(dest);
 }
 
@@ -1535,11 +1781,16 @@ void ast_channel_internal_swap_uniqueid_and_linkedid(struct ast_channel *a, stru
 
 void ast_channel_internal_swap_topics(struct ast_channel *a, struct ast_channel *b)
 {
-	struct stasis_cp_single *temp;
+	struct channel_topics *temp;
+	struct ast_endpoint *temp_endpoint;
 
 	temp = a->topics;
 	a->topics = b->topics;
 	b->topics = temp;
+
+	temp_endpoint = a->endpoint;
+	a->endpoint = b->endpoint;
+	b->endpoint = temp_endpoint;
 }
 
 void ast_channel_internal_set_fake_ids(struct ast_channel *chan, const char *uniqueid, const char *linkedid)
@@ -1548,8 +1799,39 @@ void ast_channel_internal_set_fake_ids(struct ast_channel *chan, const char *uni
 	ast_copy_string(chan->linkedid.unique_id, linkedid, sizeof(chan->linkedid.unique_id));
 }
 
+struct ast_channel_snapshot *ast_channel_internal_snapshot(const struct ast_channel *chan)
+{
+	return chan->snapshot;
+}
+
+void ast_channel_internal_snapshot_set(struct ast_channel *chan, struct ast_channel_snapshot *snapshot)
+{
+	ao2_replace(chan->snapshot, snapshot);
+}
+
+struct ast_channel_setup_times *ast_channel_internal_setup_times(struct ast_channel *chan)
+{
+	return &chan->setup_times;
+}
+
 void ast_channel_internal_cleanup(struct ast_channel *chan)
 {
+	struct channel_shell *shell = chan->shell;
+
+	if (shell) {
+		chan->shell = NULL;
+		if (!shell->pool && chan->__field_mgr_pool && !ast_string_field_init(chan, 0)) {
+			shell->pool = chan->__field_mgr_pool;
+			chan->__field_mgr_pool = NULL;
+		}
+		if (!shell->dialed_causes && chan->dialed_causes) {
+			ao2_callback(chan->dialed_causes, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+			shell->dialed_causes = chan->dialed_causes;
+			chan->dialed_causes = NULL;
+		}
+		channel_shell_put(shell);
+	}
+
 	if (chan->dialed_causes) {
 		ao2_t_ref(chan->dialed_causes, -1,
 			"done with dialed causes since the channel is going away");
@@ -1558,11 +1840,13 @@ void ast_channel_internal_cleanup(struct ast_channel *chan)
 
 	ast_string_field_free_memory(chan);
 
-	chan->endpoint_forward = stasis_forward_cancel(chan->endpoint_forward);
-	chan->endpoint_cache_forward = stasis_forward_cancel(chan->endpoint_cache_forward);
+	ao2_cleanup(chan->snapshot);
+	chan->snapshot = NULL;
 
-	stasis_cp_single_unsubscribe(chan->topics);
+	ao2_cleanup(chan->topics);
 	chan->topics = NULL;
+	ao2_cleanup(chan->endpoint);
+	chan->endpoint = NULL;
 }
 
 void ast_channel_internal_finalize(struct ast_channel *chan)
@@ -1575,60 +1859,219 @@ int ast_channel_internal_is_finalized(struct ast_channel *chan)
 	return chan->finalized;
 }
 
+/*!
+ * \brief The topics of a channel
+ *
+ * Most channels are never subscribed to on their own, so these are only
+ * created when something first asks for ast_channel_topic() or
+ * ast_channel_topic_cached(). Until then ast_channel_publish_message()
+ * publishes straight to the topics they would forward to.
+ */
+struct channel_topics {
+	/*! Topic for the channel's events */
+	struct stasis_topic *topic;
+	/*! Topic for the channel's cache updates */
+	struct stasis_topic *topic_cached;
+	/*! Forward of topic to ast_channel_topic_all() */
+	struct stasis_forward *forward;
+	/*! Forward of topic_cached to ast_channel_topic_all_cached() */
+	struct stasis_forward *cached_forward;
+	/*! Forward of topic to the endpoint's topic */
+	struct stasis_forward *endpoint_forward;
+	/*! Forward of topic_cached to the endpoint's topic */
+	struct stasis_forward *endpoint_cache_forward;
+};
+
+static void channel_topics_dtor(void *obj)
+{
+	struct channel_topics *topics = obj;
+
+	stasis_forward_cancel(topics->endpoint_forward);
+	stasis_forward_cancel(topics->endpoint_cache_forward);
+	stasis_forward_cancel(topics->forward);
+	stasis_forward_cancel(topics->cached_forward);
+	ao2_cleanup(topics->topic);
+	ao2_cleanup(topics->topic_cached);
+}
+
+/*!
+ * \internal
+ * \brief Forward the topics of a channel to the topic of its endpoint
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int channel_topics_forward_endpoint(struct channel_topics *topics,
+	struct ast_endpoint *endpoint)
+{
+	int res = 0;
+
+	ao2_lock(topics);
+	topics->endpoint_forward = stasis_forward_cancel(topics->endpoint_forward);
+	topics->endpoint_cache_forward = stasis_forward_cancel(topics->endpoint_cache_forward);
+
+	topics->endpoint_forward = stasis_forward_all(topics->topic, ast_endpoint_topic(endpoint));
+	topics->endpoint_cache_forward = stasis_forward_all(topics->topic_cached,
+		ast_endpoint_topic(endpoint));
+	if (!topics->endpoint_forward || !topics->endpoint_cache_forward) {
+		topics->endpoint_forward = stasis_forward_cancel(topics->endpoint_forward);
+		topics->endpoint_cache_forward = stasis_forward_cancel(topics->endpoint_cache_forward);
+		res = -1;
+	}
+	ao2_unlock(topics);
+
+	return res;
+}
+
+static struct channel_topics *channel_topics_create(struct ast_channel *chan)
+{
+	struct channel_topics *topics;
+	const char *topic_name = chan->uniqueid.unique_id;
+	char *cached_name;
+
+	if (ast_strlen_zero(topic_name)) {
+		topic_name = "<dummy-channel>";
+	}
+
+	topics = ao2_alloc(sizeof(*topics), channel_topics_dtor);
+	if (!topics) {
+		return NULL;
+	}
+
+	if (ast_asprintf(&cached_name, "%s-cached", topic_name) < 0) {
+		ao2_ref(topics, -1);
+		return NULL;
+	}
+	topics->topic = stasis_topic_create(topic_name);
+	topics->topic_cached = stasis_topic_create(cached_name);
+	ast_free(cached_name);
+	if (!topics->topic || !topics->topic_cached) {
+		ao2_ref(topics, -1);
+		return NULL;
+	}
+
+	topics->forward = stasis_forward_all(topics->topic, ast_channel_topic_all());
+	topics->cached_forward = stasis_forward_all(topics->topic_cached,
+		ast_channel_topic_all_cached());
+	if (!topics->forward || !topics->cached_forward) {
+		ao2_ref(topics, -1);
+		return NULL;
+	}
+
+	return topics;
+}
+
+/*!
+ * \internal
+ * \brief Get the topics of a channel, creating them if needed
+ */
+static struct channel_topics *channel_topics_get(struct ast_channel *chan)
+{
+	struct channel_topics *topics = chan->topics;
+	struct ast_endpoint *endpoint;
+
+	if (topics) {
+		return topics;
+	}
+
+	topics = channel_topics_create(chan);
+	if (!topics) {
+		return NULL;
+	}
+
+	/* Creating the topics does not lock the channel, so they may race */
+	if (!ast_atomic_compare_and_swap_ptr((void **) &chan->topics, NULL, topics)) {
+		ao2_ref(topics, -1);
+		return chan->topics;
+	}
+
+	/* Pairs with the barrier in ast_channel_forward_endpoint() */
+	__sync_synchronize();
+	endpoint = chan->endpoint;
+	if (endpoint) {
+		channel_topics_forward_endpoint(topics, endpoint);
+	}
+
+	return topics;
+}
+
 struct stasis_topic *ast_channel_topic(struct ast_channel *chan)
 {
+	struct channel_topics *topics;
+
 	if (!chan) {
 		return ast_channel_topic_all();
 	}
 
-	return stasis_cp_single_topic(chan->topics);
+	topics = channel_topics_get(chan);
+	return topics ? topics->topic : NULL;
 }
 
 struct stasis_topic *ast_channel_topic_cached(struct ast_channel *chan)
 {
+	struct channel_topics *topics;
+
 	if (!chan) {
 		return ast_channel_topic_all_cached();
 	}
 
-	return stasis_cp_single_topic_cached(chan->topics);
+	topics = channel_topics_get(chan);
+	return topics ? topics->topic_cached : NULL;
 }
 
-int ast_channel_forward_endpoint(struct ast_channel *chan,
-	struct ast_endpoint *endpoint)
+void ast_channel_publish_message(struct ast_channel *chan, struct stasis_message *message)
 {
-	ast_assert(chan != NULL);
-	ast_assert(endpoint != NULL);
+	struct channel_topics *topics;
+	struct ast_endpoint *endpoint;
+	struct stasis_message *update;
 
-	chan->endpoint_forward =
-		stasis_forward_all(ast_channel_topic(chan),
-			ast_endpoint_topic(endpoint));
-	if (!chan->endpoint_forward) {
-		return -1;
+	if (!chan) {
+		stasis_publish(ast_channel_topic_all(), message);
+		return;
 	}
 
-	chan->endpoint_cache_forward = stasis_forward_all(ast_channel_topic_cached(chan),
-		ast_endpoint_topic(endpoint));
-	if (!chan->endpoint_cache_forward) {
-		chan->endpoint_forward = stasis_forward_cancel(chan->endpoint_forward);
-		return -1;
+	topics = chan->topics;
+	endpoint = chan->endpoint;
+	if (topics) {
+		stasis_publish(topics->topic, message);
+	} else {
+		stasis_publish(ast_channel_topic_all(), message);
+		if (endpoint) {
+			stasis_publish(ast_endpoint_topic(endpoint), message);
+		}
 	}
 
-	return 0;
+	update = stasis_cache_put_message(ast_channel_cache(), message);
+	if (!update) {
+		return;
+	}
+
+	if (topics) {
+		stasis_publish(topics->topic_cached, update);
+	} else {
+		stasis_publish(ast_channel_topic_all_cached(), update);
+		if (endpoint) {
+			stasis_publish(ast_endpoint_topic(endpoint), update);
+		}
+	}
+	ao2_ref(update, -1);
 }
 
-int ast_channel_internal_setup_topics(struct ast_channel *chan)
+int ast_channel_forward_endpoint(struct ast_channel *chan,
+	struct ast_endpoint *endpoint)
 {
-	const char *topic_name = chan->uniqueid.unique_id;
-	ast_assert(chan->topics == NULL);
+	struct channel_topics *topics;
 
-	if (ast_strlen_zero(topic_name)) {
-		topic_name = "<dummy-channel>";
-	}
+	ast_assert(chan != NULL);
+	ast_assert(endpoint != NULL);
 
-	chan->topics = stasis_cp_single_create(
-		ast_channel_cache_all(), topic_name);
-	if (!chan->topics) {
-		return -1;
+	ao2_replace(chan->endpoint, endpoint);
+
+	/* Pairs with the barrier in channel_topics_get() */
+	__sync_synchronize();
+	topics = chan->topics;
+	if (topics) {
+		return channel_topics_forward_endpoint(topics, endpoint);
 	}
 
 	return 0;
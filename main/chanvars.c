@@ -154,3 +154,247 @@ struct varshead *ast_var_list_clone(struct varshead *head)
 
 	return clone;
 }
+
+/*! \brief Number of variables a list needs before it is indexed */
+#define VAR_INDEX_MIN_VARS 16
+
+/*! \brief Smallest number of slots of an index */
+#define VAR_INDEX_MIN_SLOTS 32
+
+struct ast_var_index {
+	/*! First variable of the list when the index was last updated */
+	const struct ast_var_t *first;
+	/*! Last variable of the list when the index was last updated */
+	const struct ast_var_t *last;
+	/*! Variables in the slots */
+	size_t used;
+	/*! Number of slots, a power of two */
+	size_t size;
+	/*! Open addressed slots, probed linearly */
+	struct ast_var_t **slots;
+	/*! The index has to be rebuilt before it can be used */
+	unsigned int stale:1;
+	/*! Some variable of the list is hidden by another of the same name */
+	unsigned int hidden:1;
+};
+
+struct ast_var_index *ast_var_index_alloc(void)
+{
+	struct ast_var_index *index;
+
+	index = ast_calloc(1, sizeof(*index));
+	if (!index) {
+		return NULL;
+	}
+	index->stale = 1;
+	return index;
+}
+
+void ast_var_index_destroy(struct ast_var_index *index)
+{
+	if (!index) {
+		return;
+	}
+	ast_free(index->slots);
+	ast_free(index);
+}
+
+void ast_var_index_reset(struct ast_var_index *index)
+{
+	if (index) {
+		index->stale = 1;
+	}
+}
+
+/*! \brief Find the first variable of a list with a name without an index */
+static struct ast_var_t *var_list_find(const struct varshead *head, const char *name)
+{
+	struct ast_var_t *var;
+
+	AST_LIST_TRAVERSE(head, var, entries) {
+		if (!strcmp(name, ast_var_name(var))) {
+			break;
+		}
+	}
+	return var;
+}
+
+/*! \brief Find the slot of a name, or the empty slot ending its probe */
+static size_t var_index_slot(const struct ast_var_index *index, const char *name)
+{
+	size_t mask = index->size - 1;
+	size_t slot = ast_str_hash(name) & mask;
+
+	while (index->slots[slot] && strcmp(name, ast_var_name(index->slots[slot]))) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*!
+ * \brief Add a variable to the slots
+ *
+ * \param index Index with a free slot.
+ * \param var Variable to add.
+ * \param hides Non-zero if the variable is ahead of any other of its name.
+ */
+static void var_index_add(struct ast_var_index *index, struct ast_var_t *var, int hides)
+{
+	size_t slot = var_index_slot(index, ast_var_name(var));
+
+	if (!index->slots[slot]) {
+		index->slots[slot] = var;
+		++index->used;
+		return;
+	}
+	index->hidden = 1;
+	if (hides) {
+		index->slots[slot] = var;
+	}
+}
+
+/*!
+ * \brief Remove a variable from the slots
+ *
+ * \retval 1 if the variable was in the slots.
+ * \retval 0 if it wasn't.
+ */
+static int var_index_delete(struct ast_var_index *index, struct ast_var_t *var)
+{
+	size_t mask = index->size - 1;
+	size_t hole = var_index_slot(index, ast_var_name(var));
+	size_t slot;
+
+	if (index->slots[hole] != var) {
+		return 0;
+	}
+	index->slots[hole] = NULL;
+	--index->used;
+
+	/* Move the rest of the probe sequence up so no lookup stops at the hole. */
+	for (slot = (hole + 1) & mask; index->slots[slot]; slot = (slot + 1) & mask) {
+		size_t home = ast_str_hash(ast_var_name(index->slots[slot])) & mask;
+
+		if (hole < slot ? (home <= hole || slot < home) : (home <= hole && slot < home)) {
+			index->slots[hole] = index->slots[slot];
+			index->slots[slot] = NULL;
+			hole = slot;
+		}
+	}
+	return 1;
+}
+
+/*!
+ * \brief Resize the slots to hold a number of variables
+ *
+ * \note The slots are emptied.
+ *
+ * \retval 0 on success.
+ * \retval -1 on failure.
+ */
+static int var_index_resize(struct ast_var_index *index, size_t count)
+{
+	size_t size = VAR_INDEX_MIN_SLOTS;
+	struct ast_var_t **slots;
+
+	while (size < count * 2) {
+		size *= 2;
+	}
+	if (size != index->size) {
+		slots = ast_realloc(index->slots, size * sizeof(*slots));
+		if (!slots) {
+			return -1;
+		}
+		index->slots = slots;
+		index->size = size;
+	}
+	memset(index->slots, 0, size * sizeof(*index->slots));
+	index->used = 0;
+	index->hidden = 0;
+	return 0;
+}
+
+/*!
+ * \brief Rebuild an index from its list
+ *
+ * \retval 0 if the index can be used.
+ * \retval -1 if the list is too short to index or memory ran out.
+ */
+static int var_index_rebuild(struct ast_var_index *index, const struct varshead *head)
+{
+	struct ast_var_t *var;
+	size_t count = 0;
+
+	AST_LIST_TRAVERSE(head, var, entries) {
+		++count;
+	}
+	if (count < VAR_INDEX_MIN_VARS || var_index_resize(index, count)) {
+		index->stale = 1;
+		return -1;
+	}
+	AST_LIST_TRAVERSE(head, var, entries) {
+		var_index_add(index, var, 0);
+	}
+	index->first = AST_LIST_FIRST(head);
+	index->last = AST_LIST_LAST(head);
+	index->stale = 0;
+	return 0;
+}
+
+/*! \brief Check that an index is up to date with its list */
+static int var_index_is_current(const struct ast_var_index *index, const struct varshead *head)
+{
+	return index && !index->stale
+		&& index->first == AST_LIST_FIRST(head) && index->last == AST_LIST_LAST(head);
+}
+
+struct ast_var_t *ast_var_index_find(struct ast_var_index *index, const struct varshead *head, const char *name)
+{
+	if (!index
+		|| (!var_index_is_current(index, head) && var_index_rebuild(index, head))) {
+		return var_list_find(head, name);
+	}
+	return index->slots[var_index_slot(index, name)];
+}
+
+void ast_var_index_insert_head(struct ast_var_index *index, struct varshead *head, struct ast_var_t *var)
+{
+	int current;
+
+	if (!var) {
+		return;
+	}
+
+	current = var_index_is_current(index, head);
+	AST_LIST_INSERT_HEAD(head, var, entries);
+	if (!current) {
+		return;
+	}
+
+	if ((index->used + 1) * 2 > index->size) {
+		/* Grow from the list, which now holds the new variable. */
+		var_index_rebuild(index, head);
+		return;
+	}
+	var_index_add(index, var, 1);
+	index->first = AST_LIST_FIRST(head);
+	index->last = AST_LIST_LAST(head);
+}
+
+void ast_var_index_remove(struct ast_var_index *index, struct varshead *head, struct ast_var_t *var)
+{
+	int current = var_index_is_current(index, head);
+
+	AST_LIST_REMOVE(head, var, entries);
+	if (!current) {
+		return;
+	}
+
+	if (var_index_delete(index, var) && index->hidden) {
+		/* A variable of the same name further down the list may show now. */
+		index->stale = 1;
+		return;
+	}
+	index->first = AST_LIST_FIRST(head);
+	index->last = AST_LIST_LAST(head);
+}
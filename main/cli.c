@@ -772,20 +772,25 @@ static char *handle_unload(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 	return CLI_SUCCESS;
 }
 
-#define MODLIST_FORMAT  "%-30s %-40.40s %-10d %-11s %13s\n"
-#define MODLIST_FORMAT2 "%-30s %-40.40s %-10s %-11s %13s\n"
+#define MODLIST_FORMAT  "%-30s %-40.40s %-10d %-11s %13s %10s\n"
+#define MODLIST_FORMAT2 "%-30s %-40.40s %-10s %-11s %13s %10s\n"
 
 AST_MUTEX_DEFINE_STATIC(climodentrylock);
 static int climodentryfd = -1;
 
 static int modlist_modentry(const char *module, const char *description,
 		int usecnt, const char *status, const char *like,
-		enum ast_module_support_level support_level)
+		enum ast_module_support_level support_level, int64_t load_usec)
 {
 	/* Comparing the like with the module */
 	if (strcasestr(module, like) ) {
+		char load_time[32] = "";
+
+		if (load_usec >= 0) {
+			snprintf(load_time, sizeof(load_time), "%" PRId64 ".%03d ms", load_usec / 1000, (int) (load_usec % 1000));
+		}
 		ast_cli(climodentryfd, MODLIST_FORMAT, module, description, usecnt,
-				status, ast_module_support_level_to_string(support_level));
+				status, ast_module_support_level_to_string(support_level), load_time);
 		return 1;
 	}
 	return 0;
@@ -893,7 +898,8 @@ static char *handle_modlist(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 		e->command = "module show [like]";
 		e->usage =
 			"Usage: module show [like keyword]\n"
-			"       Shows Asterisk modules currently in use, and usage statistics.\n";
+			"       Shows Asterisk modules currently in use, and usage statistics.\n"
+			"       Load Time is how long the module took to load when last loaded.\n";
 		return NULL;
 
 	case CLI_GENERATE:
@@ -914,7 +920,7 @@ static char *handle_modlist(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 
 	ast_mutex_lock(&climodentrylock);
 	climodentryfd = a->fd; /* global, protected by climodentrylock */
-	ast_cli(a->fd, MODLIST_FORMAT2, "Module", "Description", "Use Count", "Status", "Support Level");
+	ast_cli(a->fd, MODLIST_FORMAT2, "Module", "Description", "Use Count", "Status", "Support Level", "Load Time");
 	ast_cli(a->fd,"%d modules loaded\n", ast_update_module_list(modlist_modentry, like));
 	climodentryfd = -1;
 	ast_mutex_unlock(&climodentrylock);
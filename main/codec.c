@@ -40,7 +40,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/module.h"
 #include "asterisk/cli.h"
 
-/*! \brief Number of buckets to use for codecs (should be prime for performance reasons) */
+/*! \brief Number of codecs the codec registry is sized for */
 #define CODEC_BUCKETS 53
 
 /*! \brief Current identifier value for newly registered codec */
@@ -239,7 +239,8 @@ static void codec_shutdown(void)
 
 int ast_codec_init(void)
 {
-	codecs = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_RWLOCK, CODEC_BUCKETS, codec_hash, codec_cmp);
+	codecs = ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_RWLOCK, 0, CODEC_BUCKETS,
+		codec_hash, NULL, codec_cmp);
 	if (!codecs) {
 		return -1;
 	}
@@ -37,7 +37,9 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/paths.h"	/* use ast_config_AST_CONFIG_DIR */
 #include "asterisk/network.h"	/* we do some sockaddr manipulation here */
 #include <time.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <math.h>	/* HUGE_VAL */
 #include <regex.h>
@@ -53,6 +55,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/astobj2.h"
 #include "asterisk/strings.h"	/* for the ast_str_*() API */
 #include "asterisk/netsock2.h"
+#include "asterisk/dlinkedlists.h"
+#include "asterisk/vector.h"
 
 #define MAX_NESTED_COMMENTS 128
 #define COMMENT_START ";--"
@@ -1618,6 +1622,828 @@ static void config_cache_attribute(const char *configfile, enum config_cache_att
 	AST_LIST_UNLOCK(&cfmtime_head);
 }
 
+/*
+ * A config file loaded on its own, rather than into a config that already
+ * holds something, is kept as a compiled image: a flat copy of the categories,
+ * variables and includes it parsed to, with the size and modification time of
+ * every file read to make it. The next load of the file builds the config from
+ * the image instead of parsing the files again, if none of them has changed.
+ * Images are kept in memory for reloads, and in astvarlibdir/config_images for
+ * the next start if cache_config_images is set in asterisk.conf.
+ *
+ * Loads that give more than the files say are not kept: those with comments,
+ * #exec, wildcard includes, a file included more than once, or an include a
+ * realtime engine provides.
+ *
+ * An image is a series of native byte order numbers and strings. Each string
+ * is its length in four bytes, then its bytes and a terminating NUL, so it
+ * can be used where the image is mapped.
+ */
+
+#define CONFIG_IMAGE_MAGIC "AstCfgI1"
+#define CONFIG_IMAGE_BYTE_ORDER 0x01020304
+#define CONFIG_IMAGE_NONE 0xffffffff
+
+/*! The load flags an image was compiled for, which change what the files parse to */
+#define CONFIG_IMAGE_NOREALTIME (1 << 0)
+#define CONFIG_IMAGE_EXEC_INCLUDES (1 << 1)
+
+struct config_image {
+	AST_LIST_ENTRY(config_image) list;
+	unsigned char *data;
+	size_t len;
+	/*! Set if data is mapped from a file rather than allocated */
+	unsigned int mapped:1;
+	unsigned int flags;
+	/*! The full path of the file the image is of */
+	char filename[0];
+};
+
+static AST_LIST_HEAD_STATIC(config_images, config_image);
+
+/*! \brief A file read while compiling an image */
+struct config_compile_file {
+	char *filename;
+	/*! Set if the file was there to stat() */
+	int present;
+	unsigned long stat_size;
+	unsigned long stat_mtime_nsec;
+	time_t stat_mtime;
+	/*! The #include arguments in the file, for the cfmtime list */
+	AST_VECTOR(, char *) includes;
+};
+
+/*! \brief What a load being compiled has read */
+struct config_compile {
+	/*! Set if what the files parse to depends on more than the files */
+	int uncacheable;
+	AST_VECTOR(, struct config_compile_file) files;
+};
+
+/*! \brief The load being compiled by this thread, if any */
+AST_THREADSTORAGE(config_compile_buf);
+
+static struct ast_config_engine *find_engine(const char *family, int priority, char *database, int dbsiz, char *table, int tabsiz);
+
+static struct config_compile *config_compile_current(void)
+{
+	struct config_compile **current;
+
+	current = ast_threadstorage_get(&config_compile_buf, sizeof(*current));
+	return current ? *current : NULL;
+}
+
+/*! \brief Mark the load being compiled, if any, as not to be kept */
+static void config_compile_uncacheable(void)
+{
+	struct config_compile *compile = config_compile_current();
+
+	if (compile) {
+		compile->uncacheable = 1;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Record a file read by the load being compiled
+ *
+ * \param filename The full path of the file
+ * \param statbuf What stat() gave, or NULL if the file is not there
+ */
+static void config_compile_file(const char *filename, struct stat *statbuf)
+{
+	struct config_compile *compile = config_compile_current();
+	struct config_compile_file file = { .present = !!statbuf, };
+
+	if (!compile) {
+		return;
+	}
+	if (statbuf) {
+		struct cache_file_mtime cfm_buf;
+
+		cfmstat_save(&cfm_buf, statbuf);
+		file.stat_size = cfm_buf.stat_size;
+		file.stat_mtime_nsec = cfm_buf.stat_mtime_nsec;
+		file.stat_mtime = cfm_buf.stat_mtime;
+	}
+	if (!(file.filename = ast_strdup(filename))
+		|| AST_VECTOR_INIT(&file.includes, 0)
+		|| AST_VECTOR_APPEND(&compile->files, file)) {
+		ast_free(file.filename);
+		AST_VECTOR_FREE(&file.includes);
+		compile->uncacheable = 1;
+	}
+}
+
+/*! \brief Record an #include in a file read by the load being compiled */
+static void config_compile_include(const char *filename, const char *include)
+{
+	struct config_compile *compile = config_compile_current();
+	char *dup;
+	int i;
+
+	if (!compile) {
+		return;
+	}
+	for (i = AST_VECTOR_SIZE(&compile->files) - 1; i >= 0; --i) {
+		struct config_compile_file *file = AST_VECTOR_GET_ADDR(&compile->files, i);
+
+		if (!strcmp(file->filename, filename)) {
+			if (!(dup = ast_strdup(include)) || AST_VECTOR_APPEND(&file->includes, dup)) {
+				ast_free(dup);
+				compile->uncacheable = 1;
+			}
+			return;
+		}
+	}
+	compile->uncacheable = 1;
+}
+
+static void config_compile_cleanup(struct config_compile *compile)
+{
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&compile->files); ++i) {
+		struct config_compile_file *file = AST_VECTOR_GET_ADDR(&compile->files, i);
+
+		ast_free(file->filename);
+		AST_VECTOR_CALLBACK_VOID(&file->includes, ast_free);
+		AST_VECTOR_FREE(&file->includes);
+	}
+	AST_VECTOR_FREE(&compile->files);
+}
+
+/*! \brief An image being written */
+struct config_image_buf {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+	int error;
+};
+
+static void image_put(struct config_image_buf *buf, const void *data, size_t len)
+{
+	if (buf->error) {
+		return;
+	}
+	if (buf->len + len > buf->size) {
+		size_t size = MAX(buf->size * 2, buf->len + len + 4096);
+		unsigned char *grown = ast_realloc(buf->data, size);
+
+		if (!grown) {
+			buf->error = 1;
+			return;
+		}
+		buf->data = grown;
+		buf->size = size;
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void image_put_u32(struct config_image_buf *buf, uint32_t value)
+{
+	image_put(buf, &value, sizeof(value));
+}
+
+static void image_put_u64(struct config_image_buf *buf, uint64_t value)
+{
+	image_put(buf, &value, sizeof(value));
+}
+
+static void image_put_str(struct config_image_buf *buf, const char *str)
+{
+	uint32_t len = str ? strlen(str) : 0;
+
+	image_put_u32(buf, len);
+	image_put(buf, S_OR(str, ""), len + 1);
+}
+
+/*! \brief An image being read, which sets error rather than read past its end */
+struct config_image_reader {
+	const unsigned char *pos;
+	const unsigned char *end;
+	int error;
+};
+
+static uint32_t image_get_u32(struct config_image_reader *r)
+{
+	uint32_t value;
+
+	if (r->error || r->end - r->pos < sizeof(value)) {
+		r->error = 1;
+		return 0;
+	}
+	memcpy(&value, r->pos, sizeof(value));
+	r->pos += sizeof(value);
+	return value;
+}
+
+static uint64_t image_get_u64(struct config_image_reader *r)
+{
+	uint64_t value;
+
+	if (r->error || r->end - r->pos < sizeof(value)) {
+		r->error = 1;
+		return 0;
+	}
+	memcpy(&value, r->pos, sizeof(value));
+	r->pos += sizeof(value);
+	return value;
+}
+
+static const char *image_get_str(struct config_image_reader *r)
+{
+	uint32_t len = image_get_u32(r);
+	const char *str = (const char *) r->pos;
+
+	if (r->error || r->end - r->pos <= len || str[len]) {
+		r->error = 1;
+		return "";
+	}
+	r->pos += len + 1;
+	return str;
+}
+
+/*! \brief Read the header of an image, returning the filename it is of */
+static const char *image_get_header(struct config_image_reader *r, unsigned int *flags)
+{
+	if (r->end - r->pos < strlen(CONFIG_IMAGE_MAGIC)
+		|| memcmp(r->pos, CONFIG_IMAGE_MAGIC, strlen(CONFIG_IMAGE_MAGIC))) {
+		r->error = 1;
+		return "";
+	}
+	r->pos += strlen(CONFIG_IMAGE_MAGIC);
+	if (image_get_u32(r) != CONFIG_IMAGE_BYTE_ORDER) {
+		r->error = 1;
+		return "";
+	}
+	*flags = image_get_u32(r);
+	return image_get_str(r);
+}
+
+static unsigned int config_image_flags(struct ast_flags flags)
+{
+	return (ast_test_flag(&flags, CONFIG_FLAG_NOREALTIME) ? CONFIG_IMAGE_NOREALTIME : 0)
+		| (ast_opt_exec_includes ? CONFIG_IMAGE_EXEC_INCLUDES : 0);
+}
+
+static void config_image_destroy(struct config_image *image)
+{
+	if (image->mapped) {
+		munmap(image->data, image->len);
+	} else {
+		ast_free(image->data);
+	}
+	ast_free(image);
+}
+
+static struct config_image *config_image_new(const char *filename, unsigned int flags)
+{
+	struct config_image *image;
+
+	image = ast_calloc(1, sizeof(*image) + strlen(filename) + 1);
+	if (image) {
+		image->flags = flags;
+		strcpy(image->filename, filename); /* Safe */
+	}
+	return image;
+}
+
+/*! \brief Where the image of a file is kept on disk */
+static void config_image_path(char *path, size_t size, const char *filename, unsigned int flags)
+{
+	char *c;
+	int len;
+
+	len = snprintf(path, size, "%s/config_images/", ast_config_AST_VAR_DIR);
+	snprintf(path + len, size - len, "%s-%u.img", filename, flags);
+	for (c = path + len; *c; ++c) {
+		if (*c == '/') {
+			*c = '_';
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Map the image of a file kept on disk
+ *
+ * \return The image, or NULL if there is none for the file and flags
+ */
+static struct config_image *config_image_read(const char *filename, unsigned int flags)
+{
+	struct config_image *image;
+	struct config_image_reader r;
+	struct stat statbuf;
+	char path[PATH_MAX];
+	unsigned int image_flags;
+	void *data;
+	int fd;
+
+	config_image_path(path, sizeof(path), filename, flags);
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &statbuf) || !statbuf.st_size
+		|| (data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	r.pos = data;
+	r.end = r.pos + statbuf.st_size;
+	r.error = 0;
+	if (strcmp(image_get_header(&r, &image_flags), filename) || r.error || image_flags != flags
+		|| !(image = config_image_new(filename, flags))) {
+		munmap(data, statbuf.st_size);
+		return NULL;
+	}
+	image->data = data;
+	image->len = statbuf.st_size;
+	image->mapped = 1;
+	return image;
+}
+
+/*! \brief Keep the image of a file on disk, for the next start */
+static void config_image_write(const struct config_image *image)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 8];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/config_images", ast_config_AST_VAR_DIR);
+	if (ast_mkdir(path, 0755)) {
+		ast_log(LOG_WARNING, "Unable to create '%s' for config images: %s\n", path, strerror(errno));
+		return;
+	}
+
+	config_image_path(path, sizeof(path), image->filename, image->flags);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if (!(f = fopen(tmp, "w"))) {
+		ast_log(LOG_WARNING, "Unable to write config image '%s': %s\n", tmp, strerror(errno));
+		return;
+	}
+	if (fwrite(image->data, image->len, 1, f) != 1) {
+		ast_log(LOG_WARNING, "Unable to write config image '%s': %s\n", tmp, strerror(errno));
+		fclose(f);
+		unlink(tmp);
+		return;
+	}
+	if (fclose(f)) {
+		ast_log(LOG_WARNING, "Unable to write config image '%s': %s\n", tmp, strerror(errno));
+		unlink(tmp);
+		return;
+	}
+	if (rename(tmp, path)) {
+		ast_log(LOG_WARNING, "Unable to rename config image to '%s': %s\n", path, strerror(errno));
+		unlink(tmp);
+	}
+}
+
+/*! \brief The index of a category in a config, or CONFIG_IMAGE_NONE */
+static uint32_t config_image_category_index(const struct ast_config *cfg, const struct ast_category *cat)
+{
+	const struct ast_category *cur;
+	uint32_t i = 0;
+
+	for (cur = cfg->root; cur; cur = cur->next, ++i) {
+		if (cur == cat) {
+			return i;
+		}
+	}
+	return CONFIG_IMAGE_NONE;
+}
+
+/*!
+ * \internal
+ * \brief Compile a config just parsed into an image of its file, and keep it
+ *
+ * \param filename The full path of the file
+ * \param flags The image flags
+ * \param cfg What the file parsed to
+ * \param compile The files read to parse it
+ */
+static void config_image_save(const char *filename, unsigned int flags, const struct ast_config *cfg, struct config_compile *compile)
+{
+	struct config_image_buf buf = { NULL, };
+	struct config_image *image;
+	struct config_image *old;
+	struct ast_config_include *incl;
+	struct ast_category *cat;
+	uint32_t count;
+	int i;
+	int j;
+
+	image_put(&buf, CONFIG_IMAGE_MAGIC, strlen(CONFIG_IMAGE_MAGIC));
+	image_put_u32(&buf, CONFIG_IMAGE_BYTE_ORDER);
+	image_put_u32(&buf, flags);
+	image_put_str(&buf, filename);
+
+	image_put_u32(&buf, AST_VECTOR_SIZE(&compile->files));
+	for (i = 0; i < AST_VECTOR_SIZE(&compile->files); ++i) {
+		struct config_compile_file *file = AST_VECTOR_GET_ADDR(&compile->files, i);
+
+		image_put_str(&buf, file->filename);
+		image_put_u32(&buf, file->present);
+		image_put_u64(&buf, file->stat_size);
+		image_put_u64(&buf, file->stat_mtime_nsec);
+		image_put_u64(&buf, file->stat_mtime);
+		image_put_u32(&buf, AST_VECTOR_SIZE(&file->includes));
+		for (j = 0; j < AST_VECTOR_SIZE(&file->includes); ++j) {
+			image_put_str(&buf, AST_VECTOR_GET(&file->includes, j));
+		}
+	}
+
+	for (count = 0, incl = cfg->includes; incl; incl = incl->next) {
+		++count;
+	}
+	image_put_u32(&buf, count);
+	for (incl = cfg->includes; incl; incl = incl->next) {
+		image_put_str(&buf, incl->include_location_file);
+		image_put_u32(&buf, incl->include_location_lineno);
+		image_put_u32(&buf, incl->exec);
+		image_put_str(&buf, incl->exec_file);
+		image_put_str(&buf, incl->included_file);
+		image_put_u32(&buf, incl->inclusion_count);
+		image_put_u32(&buf, incl->output);
+	}
+
+	for (count = 0, cat = cfg->root; cat; cat = cat->next) {
+		++count;
+	}
+	image_put_u32(&buf, count);
+	image_put_u32(&buf, cfg->current ? config_image_category_index(cfg, cfg->current) : CONFIG_IMAGE_NONE);
+	for (cat = cfg->root; cat; cat = cat->next) {
+		struct ast_category_template_instance *x;
+		struct ast_variable *var;
+
+		image_put_str(&buf, cat->name);
+		image_put_u32(&buf, cat->ignored);
+		image_put_u32(&buf, cat->include_level);
+		image_put_str(&buf, cat->file);
+		image_put_u32(&buf, cat->lineno);
+
+		count = 0;
+		AST_LIST_TRAVERSE(&cat->template_instances, x, next) {
+			++count;
+		}
+		image_put_u32(&buf, count);
+		AST_LIST_TRAVERSE(&cat->template_instances, x, next) {
+			image_put_str(&buf, x->name);
+			image_put_u32(&buf, config_image_category_index(cfg, x->inst));
+		}
+
+		for (count = 0, var = cat->root; var; var = var->next) {
+			++count;
+		}
+		image_put_u32(&buf, count);
+		for (var = cat->root; var; var = var->next) {
+			image_put_str(&buf, var->name);
+			image_put_str(&buf, var->value);
+			image_put_str(&buf, var->file);
+			image_put_u32(&buf, var->lineno);
+			image_put_u32(&buf, var->object);
+			image_put_u32(&buf, var->blanklines);
+			image_put_u32(&buf, var->inherited);
+		}
+	}
+
+	if (buf.error || !(image = config_image_new(filename, flags))) {
+		ast_free(buf.data);
+		return;
+	}
+	image->data = buf.data;
+	image->len = buf.len;
+
+	if (ast_option_config_images) {
+		config_image_write(image);
+	}
+
+	AST_LIST_LOCK(&config_images);
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&config_images, old, list) {
+		if (old->flags == flags && !strcmp(old->filename, filename)) {
+			AST_LIST_REMOVE_CURRENT(list);
+			config_image_destroy(old);
+			break;
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+	AST_LIST_INSERT_HEAD(&config_images, image, list);
+	AST_LIST_UNLOCK(&config_images);
+}
+
+/*! \brief Whether an engine other than the text file one would load an included file */
+static int config_image_include_mapped(const char *include)
+{
+	struct ast_config_engine *eng;
+	char db[256];
+	char table[256];
+
+	eng = find_engine(include, 1, db, sizeof(db), table, sizeof(table));
+	if (!eng || !eng->load_func) {
+		eng = find_engine("global", 1, db, sizeof(db), table, sizeof(table));
+	}
+	return eng && eng->load_func;
+}
+
+/*!
+ * \internal
+ * \brief Check that the files an image was compiled from have not changed
+ *
+ * \param r The image, at its files
+ * \param flags The image flags
+ *
+ * \retval 0 if the image still gives what parsing the files would
+ */
+static int config_image_check_files(struct config_image_reader *r, unsigned int flags)
+{
+	uint32_t files = image_get_u32(r);
+	uint32_t i;
+	uint32_t j;
+	int includes = 0;
+
+	for (i = 0; i < files && !r->error; ++i) {
+		struct cache_file_mtime cfm_buf;
+		struct stat statbuf;
+		const char *filename = image_get_str(r);
+		uint32_t present = image_get_u32(r);
+		uint32_t num_includes;
+
+		cfm_buf.stat_size = image_get_u64(r);
+		cfm_buf.stat_mtime_nsec = image_get_u64(r);
+		cfm_buf.stat_mtime = image_get_u64(r);
+		if (r->error) {
+			break;
+		}
+
+		if (stat(filename, &statbuf)) {
+			if (present) {
+				return -1;
+			}
+		} else if (!present || !S_ISREG(statbuf.st_mode) || cfmstat_cmp(&cfm_buf, &statbuf)) {
+			return -1;
+		}
+
+		num_includes = image_get_u32(r);
+		for (j = 0; j < num_includes && !r->error; ++j) {
+			const char *include = image_get_str(r);
+
+			/* A realtime engine may have been mapped to the file since */
+			if (!(flags & CONFIG_IMAGE_NOREALTIME) && config_engine_list
+				&& config_image_include_mapped(include)) {
+				return -1;
+			}
+			includes = 1;
+		}
+	}
+
+	/* Hooks are run as each included file is loaded */
+	if (includes && cfg_hooks && ao2_container_count(cfg_hooks)) {
+		return -1;
+	}
+
+	return r->error ? -1 : 0;
+}
+
+/*! \brief Note the files an image was compiled from in the cfmtime list, as parsing them would */
+static void config_image_note_files(struct config_image_reader *r, const char *who_asked)
+{
+	uint32_t files = image_get_u32(r);
+	uint32_t i;
+	uint32_t j;
+
+	for (i = 0; i < files && !r->error; ++i) {
+		struct cache_file_mtime *cfmtime;
+		const char *filename = image_get_str(r);
+		uint32_t present = image_get_u32(r);
+		unsigned long stat_size = image_get_u64(r);
+		unsigned long stat_mtime_nsec = image_get_u64(r);
+		time_t stat_mtime = image_get_u64(r);
+		uint32_t num_includes = image_get_u32(r);
+
+		if (r->error) {
+			break;
+		}
+		if (!present) {
+			config_cache_remove(filename, who_asked);
+			for (j = 0; j < num_includes; ++j) {
+				image_get_str(r);
+			}
+			continue;
+		}
+
+		AST_LIST_LOCK(&cfmtime_head);
+		AST_LIST_TRAVERSE(&cfmtime_head, cfmtime, list) {
+			if (!strcmp(cfmtime->filename, filename) && !strcmp(cfmtime->who_asked, who_asked)) {
+				break;
+			}
+		}
+		if (!cfmtime && (cfmtime = cfmtime_new(filename, who_asked))) {
+			AST_LIST_INSERT_SORTALPHA(&cfmtime_head, cfmtime, list, filename);
+		}
+		if (cfmtime) {
+			cfmtime->has_exec = 0;
+			config_cache_flush_includes(cfmtime);
+			cfmtime->stat_size = stat_size;
+			cfmtime->stat_mtime_nsec = stat_mtime_nsec;
+			cfmtime->stat_mtime = stat_mtime;
+		}
+		AST_LIST_UNLOCK(&cfmtime_head);
+
+		for (j = 0; j < num_includes && !r->error; ++j) {
+			config_cache_attribute(filename, ATTRIBUTE_INCLUDE, image_get_str(r), who_asked);
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Build a config from an image
+ *
+ * \param image The image
+ * \param cfg The config to build, which is empty
+ * \param flags The flags of the load
+ * \param who_asked Who is loading the config
+ *
+ * \retval 0 on success
+ * \retval -1 if the image is out of date or cannot be read
+ */
+static int config_image_build(const struct config_image *image, struct ast_config *cfg, struct ast_flags flags, const char *who_asked)
+{
+	struct config_image_reader r = { image->data, image->data + image->len, 0 };
+	struct config_image_reader files;
+	struct ast_config_include *last_incl = NULL;
+	struct ast_category **cats = NULL;
+	struct ast_config *tmp;
+	unsigned int image_flags;
+	uint32_t count;
+	uint32_t current;
+	uint32_t i;
+	uint32_t j;
+
+	image_get_header(&r, &image_flags);
+	files = r;
+	if (r.error || config_image_check_files(&r, image->flags)) {
+		return -1;
+	}
+
+	if (!(tmp = ast_config_new())) {
+		return -1;
+	}
+	tmp->include_level = cfg->include_level;
+
+	count = image_get_u32(&r);
+	for (i = 0; i < count && !r.error; ++i) {
+		struct ast_config_include *incl;
+		const char *exec_file;
+
+		if (!(incl = ast_calloc(1, sizeof(*incl)))) {
+			r.error = 1;
+			break;
+		}
+		/* Keep them in the order they were listed */
+		if (last_incl) {
+			last_incl->next = incl;
+		} else {
+			tmp->includes = incl;
+		}
+		last_incl = incl;
+
+		incl->include_location_file = ast_strdup(image_get_str(&r));
+		incl->include_location_lineno = image_get_u32(&r);
+		incl->exec = image_get_u32(&r);
+		exec_file = image_get_str(&r);
+		if (incl->exec) {
+			incl->exec_file = ast_strdup(exec_file);
+		}
+		incl->included_file = ast_strdup(image_get_str(&r));
+		incl->inclusion_count = image_get_u32(&r);
+		incl->output = image_get_u32(&r);
+		if (!incl->include_location_file || !incl->included_file || (incl->exec && !incl->exec_file)) {
+			r.error = 1;
+		}
+	}
+
+	count = image_get_u32(&r);
+	current = image_get_u32(&r);
+	if (!r.error && count && (count > image->len || !(cats = ast_calloc(count, sizeof(*cats))))) {
+		r.error = 1;
+	}
+	for (i = 0; i < count && !r.error; ++i) {
+		struct ast_category *cat;
+		const char *name = image_get_str(&r);
+		int ignored = image_get_u32(&r);
+		int include_level = image_get_u32(&r);
+		const char *file = image_get_str(&r);
+		int lineno = image_get_u32(&r);
+		uint32_t num;
+
+		if (r.error || !(cat = new_category(name, file, lineno, ignored))) {
+			r.error = 1;
+			break;
+		}
+		ast_category_append(tmp, cat);
+		cat->include_level = include_level;
+		cats[i] = cat;
+
+		num = image_get_u32(&r);
+		for (j = 0; j < num && !r.error; ++j) {
+			struct ast_category_template_instance *x;
+			const char *template = image_get_str(&r);
+			uint32_t inst = image_get_u32(&r);
+
+			if (r.error || !(x = ast_calloc(1, sizeof(*x)))) {
+				r.error = 1;
+				break;
+			}
+			ast_copy_string(x->name, template, sizeof(x->name));
+			/* What a category inherits from is always before it */
+			x->inst = inst < i ? cats[inst] : NULL;
+			AST_LIST_INSERT_TAIL(&cat->template_instances, x, next);
+		}
+
+		num = image_get_u32(&r);
+		for (j = 0; j < num && !r.error; ++j) {
+			struct ast_variable *var;
+			const char *var_name = image_get_str(&r);
+			const char *value = image_get_str(&r);
+			const char *var_file = image_get_str(&r);
+
+			if (r.error || !(var = ast_variable_new(var_name, value, var_file))) {
+				r.error = 1;
+				break;
+			}
+			var->lineno = image_get_u32(&r);
+			var->object = image_get_u32(&r);
+			var->blanklines = image_get_u32(&r);
+			var->inherited = image_get_u32(&r);
+			ast_variable_append(cat, var);
+		}
+	}
+	if (!r.error) {
+		tmp->current = current < count ? cats[current] : NULL;
+	}
+	ast_free(cats);
+
+	if (r.error) {
+		ast_config_destroy(tmp);
+		return -1;
+	}
+
+	if (!ast_test_flag(&flags, CONFIG_FLAG_NOCACHE)) {
+		config_image_note_files(&files, who_asked);
+	}
+
+	cfg->root = tmp->root;
+	cfg->last = tmp->last;
+	cfg->current = tmp->current;
+	cfg->includes = tmp->includes;
+	tmp->root = tmp->last = tmp->current = NULL;
+	tmp->includes = NULL;
+	ast_config_destroy(tmp);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Build a config from the image of its file, if it has one that is up to date
+ *
+ * \param filename The full path of the file
+ * \param flags The image flags
+ * \param cfg The config to build, which is empty
+ * \param load_flags The flags of the load
+ * \param who_asked Who is loading the config
+ *
+ * \retval 0 if the config was built from an image
+ * \retval -1 if the file must be parsed
+ */
+static int config_image_load(const char *filename, unsigned int flags, struct ast_config *cfg, struct ast_flags load_flags, const char *who_asked)
+{
+	struct config_image *image;
+	int res = -1;
+
+	AST_LIST_LOCK(&config_images);
+	AST_LIST_TRAVERSE(&config_images, image, list) {
+		if (image->flags == flags && !strcmp(image->filename, filename)) {
+			break;
+		}
+	}
+	if (!image && ast_option_config_images && (image = config_image_read(filename, flags))) {
+		AST_LIST_INSERT_HEAD(&config_images, image, list);
+	}
+	if (image && (res = config_image_build(image, cfg, load_flags, who_asked))) {
+		/* Out of date; parsing the file again replaces it */
+		AST_LIST_REMOVE(&config_images, image, list);
+		config_image_destroy(image);
+	}
+	AST_LIST_UNLOCK(&config_images);
+
+	return res;
+}
+
 /*! \brief parse one line in the configuration.
  * \verbatim
  * We can have a category header	[foo](...)
@@ -1803,6 +2629,7 @@ static int process_text_line(struct ast_config *cfg, struct ast_category **cat,
 		   We create a tmp file, then we #include it, then we delete it. */
 		if (!do_include) {
 			struct timeval now = ast_tvnow();
+			config_compile_uncacheable();
 			if (!ast_test_flag(&flags, CONFIG_FLAG_NOCACHE))
 				config_cache_attribute(configfile, ATTRIBUTE_EXEC, NULL, who_asked);
 			snprintf(exec_file, sizeof(exec_file), "/var/tmp/exec.%d%d.%ld", (int)now.tv_sec, (int)now.tv_usec, (long)pthread_self());
@@ -1810,6 +2637,7 @@ static int process_text_line(struct ast_config *cfg, struct ast_category **cat,
 			ast_safe_system(cmd);
 			cur = exec_file;
 		} else {
+			config_compile_include(configfile, cur);
 			if (!ast_test_flag(&flags, CONFIG_FLAG_NOCACHE))
 				config_cache_attribute(configfile, ATTRIBUTE_INCLUDE, cur, who_asked);
 			exec_file[0] = '\0';
@@ -1817,6 +2645,10 @@ static int process_text_line(struct ast_config *cfg, struct ast_category **cat,
 		/* A #include */
 		/* record this inclusion */
 		ast_include_new(cfg, cfg->include_level == 1 ? "" : configfile, cur, !do_include, cur2, lineno, real_inclusion_name, sizeof(real_inclusion_name));
+		if (!ast_strlen_zero(real_inclusion_name)) {
+			/* Where it is saved depends on what else is on disk */
+			config_compile_uncacheable();
+		}
 
 		do_include = ast_config_internal_load(cur, cfg, flags, real_inclusion_name, who_asked) ? 1 : 0;
 		if (!ast_strlen_zero(exec_file))
@@ -1915,7 +2747,7 @@ set_new_variable:
 	return 0;
 }
 
-static struct ast_config *config_text_file_load(const char *database, const char *table, const char *filename, struct ast_config *cfg, struct ast_flags flags, const char *suggested_include_file, const char *who_asked)
+static struct ast_config *config_text_file_parse(const char *database, const char *table, const char *filename, struct ast_config *cfg, struct ast_flags flags, const char *suggested_include_file, const char *who_asked)
 {
 	char fn[256];
 #if defined(LOW_MEMORY)
@@ -1976,6 +2808,11 @@ static struct ast_config *config_text_file_load(const char *database, const char
 		/* loop over expanded files */
 		int i;
 
+		if (globbuf.gl_pathc != 1 || strcmp(fn, globbuf.gl_pathv[0]) || strpbrk(fn, "*?[{~")) {
+			/* What the pattern matches can change without any file read changing */
+			config_compile_uncacheable();
+		}
+
 		if (!cfg && (globbuf.gl_pathc != 1 || strcmp(fn, globbuf.gl_pathv[0]))) {
 			/*
 			 * We just want a file changed answer and since we cannot
@@ -1999,6 +2836,7 @@ static struct ast_config *config_text_file_load(const char *database, const char
 			 */
 			do {
 				if (stat(fn, &statbuf)) {
+					config_compile_file(fn, NULL);
 					if (!ast_test_flag(&flags, CONFIG_FLAG_NOCACHE)) {
 						config_cache_remove(fn, who_asked);
 					}
@@ -2006,6 +2844,7 @@ static struct ast_config *config_text_file_load(const char *database, const char
 				}
 
 				if (!S_ISREG(statbuf.st_mode)) {
+					config_compile_uncacheable();
 					ast_log(LOG_WARNING, "'%s' is not a regular file, ignoring\n", fn);
 					if (!ast_test_flag(&flags, CONFIG_FLAG_NOCACHE)) {
 						config_cache_remove(fn, who_asked);
@@ -2013,6 +2852,8 @@ static struct ast_config *config_text_file_load(const char *database, const char
 					continue;
 				}
 
+				config_compile_file(fn, &statbuf);
+
 				if (!ast_test_flag(&flags, CONFIG_FLAG_NOCACHE)) {
 					/* Find our cached entry for this configuration file */
 					AST_LIST_LOCK(&cfmtime_head);
@@ -2040,7 +2881,7 @@ static struct ast_config *config_text_file_load(const char *database, const char
 
 					/* File is unchanged, what about the (cached) includes (if any)? */
 					AST_LIST_TRAVERSE(&cfmtime->includes, cfinclude, list) {
-						if (!config_text_file_load(NULL, NULL, cfinclude->include,
+						if (!config_text_file_parse(NULL, NULL, cfinclude->include,
 							NULL, flags, "", who_asked)) {
 							/* One change is enough to short-circuit and reload the whole shebang */
 							unchanged = 0;
@@ -2077,6 +2918,7 @@ static struct ast_config *config_text_file_load(const char *database, const char
 				}
 
 				if (!(f = fopen(fn, "r"))) {
+					config_compile_uncacheable();
 					ast_debug(1, "No file to parse: %s\n", fn);
 					ast_verb(2, "Parsing '%s': Not found (%s)\n", fn, strerror(errno));
 					continue;
@@ -2246,6 +3088,60 @@ static struct ast_config *config_text_file_load(const char *database, const char
 	return cfg;
 }
 
+static struct ast_config *config_text_file_load(const char *database, const char *table, const char *filename, struct ast_config *cfg, struct ast_flags flags, const char *suggested_include_file, const char *who_asked)
+{
+	struct config_compile compile = { 0, };
+	struct config_compile **current;
+	struct ast_config *result;
+	unsigned int image_flags;
+	char fn[256];
+
+	/* Only a file loaded on its own, without comments, has an image */
+	if (!cfg || cfg->include_level != 1 || cfg->root || cfg->includes
+		|| cfg->max_include_level != MAX_INCLUDE_LEVEL
+		|| !ast_strlen_zero(suggested_include_file)
+		|| ast_test_flag(&flags, CONFIG_FLAG_WITHCOMMENTS)
+		|| !(current = ast_threadstorage_get(&config_compile_buf, sizeof(*current)))
+		|| *current) {
+		return config_text_file_parse(database, table, filename, cfg, flags, suggested_include_file, who_asked);
+	}
+
+	if (filename[0] == '/') {
+		ast_copy_string(fn, filename, sizeof(fn));
+	} else {
+		snprintf(fn, sizeof(fn), "%s/%s", ast_config_AST_CONFIG_DIR, filename);
+	}
+	image_flags = config_image_flags(flags);
+
+	if (ast_test_flag(&flags, CONFIG_FLAG_FILEUNCHANGED)) {
+		result = config_text_file_parse(database, table, filename, NULL, flags, "", who_asked);
+		if (result == CONFIG_STATUS_FILEUNCHANGED) {
+			return result;
+		}
+		ast_clear_flag(&flags, CONFIG_FLAG_FILEUNCHANGED);
+	}
+
+	if (!config_image_load(fn, image_flags, cfg, flags, who_asked)) {
+		ast_debug(1, "Built %s from its compiled image\n", fn);
+		ast_verb(2, "Parsing '%s': Found (compiled)\n", fn);
+		return cfg;
+	}
+
+	if (AST_VECTOR_INIT(&compile.files, 8)) {
+		return config_text_file_parse(database, table, filename, cfg, flags, suggested_include_file, who_asked);
+	}
+	*current = &compile;
+	result = config_text_file_parse(database, table, filename, cfg, flags, suggested_include_file, who_asked);
+	*current = NULL;
+
+	if (result == cfg && !compile.uncacheable) {
+		config_image_save(fn, image_flags, cfg, &compile);
+	}
+	config_compile_cleanup(&compile);
+
+	return result;
+}
+
 
 /* NOTE: categories and variables each have a file and lineno attribute. On a save operation, these are used to determine
    which file and line number to write out to. Thus, an entire hierarchy of config files (via #include statements) can be
@@ -2711,6 +3607,345 @@ int ast_config_text_file_save2(const char *configfile, const struct ast_config *
 	return 0;
 }
 
+/*!
+ * \brief A cache of the lookups of a realtime family
+ *
+ * Set up in the [cache] section of extconfig.conf. Results are kept by the
+ * fields they were looked up with. Any write to the family through this API
+ * flushes its cache, as there is no telling which results it changed.
+ */
+struct realtime_cache {
+	unsigned int ttl;		/*!< Seconds a result is kept */
+	unsigned int negative_ttl;	/*!< Seconds a lookup that found nothing is kept, 0 not to keep them */
+	unsigned int max;		/*!< Most results kept */
+	unsigned int gen;		/*!< Changed on each flush, so results looked up before are not kept */
+	int hits;
+	int misses;
+	/*! The results, by key. Locked by the cache. */
+	struct ao2_container *entries;
+	/*! The results, oldest first */
+	AST_DLLIST_HEAD_NOLOCK(, realtime_cache_entry) order;
+	char family[0];
+};
+
+/*! \brief A result kept by a realtime cache */
+struct realtime_cache_entry {
+	AST_DLLIST_ENTRY(realtime_cache_entry) list;
+	struct timeval expires;
+	struct ast_variable *var;	/*!< The result of a single lookup */
+	struct ast_config *cfg;		/*!< The result of a multientry lookup */
+	char key[0];			/*!< The kind of lookup and its fields */
+};
+
+#define REALTIME_CACHE_BUCKETS 257
+#define REALTIME_CACHE_DEFAULT_MAX 1000
+
+/*! \brief The realtime caches, by family */
+static AO2_GLOBAL_OBJ_STATIC(realtime_caches);
+
+static int realtime_cache_hash(const void *obj, const int flags)
+{
+	const char *key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? obj : ((const struct realtime_cache *) obj)->family;
+
+	return ast_str_case_hash(key);
+}
+
+static int realtime_cache_cmp(void *obj, void *arg, int flags)
+{
+	const struct realtime_cache *cache = obj;
+	const char *key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? arg : ((const struct realtime_cache *) arg)->family;
+
+	return !strcasecmp(cache->family, key) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+static int realtime_cache_entry_hash(const void *obj, const int flags)
+{
+	const char *key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? obj : ((const struct realtime_cache_entry *) obj)->key;
+
+	return ast_str_hash(key);
+}
+
+static int realtime_cache_entry_cmp(void *obj, void *arg, int flags)
+{
+	const struct realtime_cache_entry *entry = obj;
+	const char *key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? arg : ((const struct realtime_cache_entry *) arg)->key;
+
+	return !strcmp(entry->key, key) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+static void realtime_cache_entry_destructor(void *obj)
+{
+	struct realtime_cache_entry *entry = obj;
+
+	ast_variables_destroy(entry->var);
+	if (entry->cfg) {
+		ast_config_destroy(entry->cfg);
+	}
+}
+
+static void realtime_cache_destructor(void *obj)
+{
+	struct realtime_cache *cache = obj;
+
+	ao2_cleanup(cache->entries);
+}
+
+static struct realtime_cache *realtime_cache_alloc(const char *family, unsigned int ttl, unsigned int max, unsigned int negative_ttl)
+{
+	struct realtime_cache *cache;
+
+	cache = ao2_alloc(sizeof(*cache) + strlen(family) + 1, realtime_cache_destructor);
+	if (!cache) {
+		return NULL;
+	}
+	cache->entries = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, REALTIME_CACHE_BUCKETS,
+		realtime_cache_entry_hash, NULL, realtime_cache_entry_cmp);
+	if (!cache->entries) {
+		ao2_ref(cache, -1);
+		return NULL;
+	}
+	strcpy(cache->family, family); /* SAFE */
+	cache->ttl = ttl;
+	cache->max = max;
+	cache->negative_ttl = negative_ttl;
+	AST_DLLIST_HEAD_INIT_NOLOCK(&cache->order);
+	return cache;
+}
+
+/*! \brief Find the cache of a family, if it has one */
+static struct realtime_cache *realtime_cache_find(const char *family)
+{
+	struct ao2_container *caches = ao2_global_obj_ref(realtime_caches);
+	struct realtime_cache *cache;
+
+	if (!caches) {
+		return NULL;
+	}
+	cache = ao2_find(caches, family, OBJ_SEARCH_KEY);
+	ao2_ref(caches, -1);
+	return cache;
+}
+
+/*!
+ * \internal
+ * \brief Drop a result from its cache
+ * \note The cache must be locked
+ */
+static void realtime_cache_remove(struct realtime_cache *cache, struct realtime_cache_entry *entry)
+{
+	AST_DLLIST_REMOVE(&cache->order, entry, list);
+	ao2_unlink_flags(cache->entries, entry, OBJ_NOLOCK);
+}
+
+/*! \brief Drop all the results of a cache */
+static void realtime_cache_empty(struct realtime_cache *cache)
+{
+	ao2_lock(cache);
+	cache->gen++;
+	ao2_callback(cache->entries, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+	AST_DLLIST_HEAD_INIT_NOLOCK(&cache->order);
+	ao2_unlock(cache);
+}
+
+/*! \brief Flush the cache of a family after it was written to */
+static void realtime_cache_invalidate(const char *family)
+{
+	struct realtime_cache *cache = realtime_cache_find(family);
+
+	if (cache) {
+		realtime_cache_empty(cache);
+		ao2_ref(cache, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Make the key of a lookup
+ *
+ * \param kind 'v' for a single lookup, 'm' for a multientry one
+ * \param fields The fields of the lookup
+ *
+ * \return The key, to be freed with ast_free()
+ */
+static struct ast_str *realtime_cache_key(char kind, const struct ast_variable *fields)
+{
+	struct ast_str *key = ast_str_create(64);
+	const struct ast_variable *field;
+
+	if (!key) {
+		return NULL;
+	}
+	ast_str_set(&key, 0, "%c", kind);
+	for (field = fields; field; field = field->next) {
+		/* Lengths first, so no name or value can be mistaken for another */
+		ast_str_append(&key, 0, "%zu:%s%zu:%s", strlen(field->name), field->name,
+			strlen(field->value), field->value);
+	}
+	return key;
+}
+
+/*!
+ * \internal
+ * \brief Look for a result that has not yet expired
+ *
+ * \param cache The cache
+ * \param key The key of the lookup
+ * \param gen Set to the generation of the cache, to pass to realtime_cache_put()
+ *
+ * \return The result, with a reference, or NULL if there is none
+ */
+static struct realtime_cache_entry *realtime_cache_get(struct realtime_cache *cache, const char *key, unsigned int *gen)
+{
+	struct realtime_cache_entry *entry;
+
+	ao2_lock(cache);
+	*gen = cache->gen;
+	entry = ao2_find(cache->entries, key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (entry && ast_tvcmp(ast_tvnow(), entry->expires) >= 0) {
+		realtime_cache_remove(cache, entry);
+		ao2_ref(entry, -1);
+		entry = NULL;
+	}
+	ao2_unlock(cache);
+
+	ast_atomic_fetchadd_int(entry ? &cache->hits : &cache->misses, +1);
+	return entry;
+}
+
+/*!
+ * \internal
+ * \brief Keep the result of a lookup
+ *
+ * The result is copied. It is not kept if the cache was flushed since \a gen
+ * was read, as the lookup may have raced a write.
+ */
+static void realtime_cache_put(struct realtime_cache *cache, const char *key, unsigned int gen,
+	struct ast_variable *var, const struct ast_config *cfg)
+{
+	struct realtime_cache_entry *entry;
+	struct realtime_cache_entry *old;
+
+	if (!var && !cfg && !cache->negative_ttl) {
+		return;
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + strlen(key) + 1, realtime_cache_entry_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return;
+	}
+	strcpy(entry->key, key); /* SAFE */
+	if ((var && !(entry->var = ast_variables_dup(var))) || (cfg && !(entry->cfg = ast_config_copy(cfg)))) {
+		ao2_ref(entry, -1);
+		return;
+	}
+	entry->expires = ast_tvadd(ast_tvnow(), ast_tv(var || cfg ? cache->ttl : cache->negative_ttl, 0));
+
+	ao2_lock(cache);
+	if (cache->gen == gen && cache->max) {
+		if ((old = ao2_find(cache->entries, key, OBJ_SEARCH_KEY | OBJ_NOLOCK))) {
+			realtime_cache_remove(cache, old);
+			ao2_ref(old, -1);
+		}
+		while (ao2_container_count(cache->entries) >= cache->max) {
+			realtime_cache_remove(cache, AST_DLLIST_FIRST(&cache->order));
+		}
+		ao2_link_flags(cache->entries, entry, OBJ_NOLOCK);
+		AST_DLLIST_INSERT_TAIL(&cache->order, entry, list);
+	}
+	ao2_unlock(cache);
+	ao2_ref(entry, -1);
+}
+
+/*!
+ * \internal
+ * \brief Read the [cache] section of extconfig.conf
+ *
+ * Each line is family => ttl[,max[,negative_ttl]].
+ */
+static void read_realtime_caches(struct ast_config *config)
+{
+	struct ao2_container *caches;
+	struct ast_variable *v;
+
+	caches = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 17, realtime_cache_hash, NULL, realtime_cache_cmp);
+	if (!caches) {
+		return;
+	}
+
+	for (v = ast_variable_browse(config, "cache"); v; v = v->next) {
+		struct realtime_cache *cache;
+		unsigned int ttl;
+		unsigned int max = REALTIME_CACHE_DEFAULT_MAX;
+		unsigned int negative_ttl = 0;
+
+		if (sscanf(v->value, "%30u,%30u,%30u", &ttl, &max, &negative_ttl) < 1 || !ttl) {
+			ast_log(LOG_WARNING, "Cache of realtime family '%s' must be ttl[,max[,negative_ttl]], with a ttl of a second or more\n", v->name);
+			continue;
+		}
+		if (!(cache = realtime_cache_alloc(v->name, ttl, max, negative_ttl))) {
+			continue;
+		}
+		ao2_link(caches, cache);
+		ast_verb(2, "Caching realtime family %s for %u seconds, up to %u results\n", v->name, ttl, max);
+		ao2_ref(cache, -1);
+	}
+
+	ao2_global_obj_replace_unref(realtime_caches, caches);
+	ao2_ref(caches, -1);
+}
+
+#ifdef TEST_FRAMEWORK
+int ast_realtime_append_cache(const char *family, unsigned int ttl, unsigned int max, unsigned int negative_ttl)
+{
+	struct ao2_container *caches = ao2_global_obj_ref(realtime_caches);
+	struct realtime_cache *cache;
+
+	if (!caches) {
+		caches = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 17, realtime_cache_hash, NULL, realtime_cache_cmp);
+		if (!caches) {
+			return -1;
+		}
+		ao2_global_obj_replace_unref(realtime_caches, caches);
+	}
+
+	if (!(cache = realtime_cache_alloc(family, ttl, max, negative_ttl))) {
+		ao2_ref(caches, -1);
+		return -1;
+	}
+	ao2_find(caches, family, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	ao2_link(caches, cache);
+	ao2_ref(cache, -1);
+	ao2_ref(caches, -1);
+	return 0;
+}
+#endif
+
+int ast_realtime_cache_flush(const char *family)
+{
+	struct ao2_container *caches = ao2_global_obj_ref(realtime_caches);
+	struct realtime_cache *cache;
+	struct ao2_iterator i;
+	int res = -1;
+
+	if (!caches) {
+		return -1;
+	}
+
+	i = ao2_iterator_init(caches, 0);
+	while ((cache = ao2_iterator_next(&i))) {
+		if (ast_strlen_zero(family) || !strcasecmp(family, cache->family)) {
+			realtime_cache_empty(cache);
+			res = 0;
+		}
+		ao2_ref(cache, -1);
+	}
+	ao2_iterator_destroy(&i);
+	ao2_ref(caches, -1);
+
+	return res;
+}
+
 static void clear_config_maps(void)
 {
 	struct ast_config_map *map;
@@ -2783,6 +4018,7 @@ int read_config_maps(void)
 		return -1;
 	} else if (!config) {
 		ast_config_destroy(configtmp);
+		ao2_global_obj_release(realtime_caches);
 		return 0;
 	}
 
@@ -2839,6 +4075,8 @@ int read_config_maps(void)
 			ast_realtime_append_mapping(v->name, driver, database, table, pri);
 	}
 
+	read_realtime_caches(config);
+
 	ast_config_destroy(config);
 	return 0;
 }
@@ -2995,6 +4233,12 @@ struct ast_config *ast_config_internal_load(const char *filename, struct ast_con
 		}
 	}
 
+	if (cfg->include_level > 1
+		&& (loader != &text_file_engine || (cfg_hooks && ao2_container_count(cfg_hooks)))) {
+		/* An included file the image of the file including it would not load the same way */
+		config_compile_uncacheable();
+	}
+
 	result = loader->load_func(db, table, filename, cfg, flags, suggested_include_file, who_asked);
 
 	if (result && result != CONFIG_STATUS_FILEINVALID && result != CONFIG_STATUS_FILEUNCHANGED) {
@@ -3119,7 +4363,7 @@ static int realtime_arguments_to_fields2(va_list ap, int skip, struct ast_variab
 	return 0;
 }
 
-struct ast_variable *ast_load_realtime_all_fields(const char *family, const struct ast_variable *fields)
+static struct ast_variable *realtime_load_all_fields(const char *family, const struct ast_variable *fields)
 {
 	struct ast_config_engine *eng;
 	char db[256];
@@ -3140,6 +4384,35 @@ struct ast_variable *ast_load_realtime_all_fields(const char *family, const stru
 	return res;
 }
 
+struct ast_variable *ast_load_realtime_all_fields(const char *family, const struct ast_variable *fields)
+{
+	struct realtime_cache *cache = realtime_cache_find(family);
+	struct realtime_cache_entry *entry;
+	struct ast_str *key;
+	struct ast_variable *res;
+	unsigned int gen;
+
+	if (!cache) {
+		return realtime_load_all_fields(family, fields);
+	}
+	if (!(key = realtime_cache_key('v', fields))) {
+		ao2_ref(cache, -1);
+		return realtime_load_all_fields(family, fields);
+	}
+
+	if ((entry = realtime_cache_get(cache, ast_str_buffer(key), &gen))) {
+		res = entry->var ? ast_variables_dup(entry->var) : NULL;
+		ao2_ref(entry, -1);
+	} else {
+		res = realtime_load_all_fields(family, fields);
+		realtime_cache_put(cache, ast_str_buffer(key), gen, res, NULL);
+	}
+
+	ast_free(key);
+	ao2_ref(cache, -1);
+	return res;
+}
+
 struct ast_variable *ast_load_realtime_all(const char *family, ...)
 {
 	RAII_VAR(struct ast_variable *, fields, NULL, ast_variables_destroy);
@@ -3276,10 +4549,12 @@ int ast_unload_realtime(const char *family)
 			break;
 		}
 	}
+	realtime_cache_invalidate(family);
+
 	return res;
 }
 
-struct ast_config *ast_load_realtime_multientry_fields(const char *family, const struct ast_variable *fields)
+static struct ast_config *realtime_load_multientry_fields(const char *family, const struct ast_variable *fields)
 {
 	struct ast_config_engine *eng;
 	char db[256];
@@ -3305,6 +4580,35 @@ struct ast_config *ast_load_realtime_multientry_fields(const char *family, const
 	return res;
 }
 
+struct ast_config *ast_load_realtime_multientry_fields(const char *family, const struct ast_variable *fields)
+{
+	struct realtime_cache *cache = realtime_cache_find(family);
+	struct realtime_cache_entry *entry;
+	struct ast_str *key;
+	struct ast_config *res;
+	unsigned int gen;
+
+	if (!cache) {
+		return realtime_load_multientry_fields(family, fields);
+	}
+	if (!(key = realtime_cache_key('m', fields))) {
+		ao2_ref(cache, -1);
+		return realtime_load_multientry_fields(family, fields);
+	}
+
+	if ((entry = realtime_cache_get(cache, ast_str_buffer(key), &gen))) {
+		res = entry->cfg ? ast_config_copy(entry->cfg) : NULL;
+		ao2_ref(entry, -1);
+	} else {
+		res = realtime_load_multientry_fields(family, fields);
+		realtime_cache_put(cache, ast_str_buffer(key), gen, NULL, res);
+	}
+
+	ast_free(key);
+	ao2_ref(cache, -1);
+	return res;
+}
+
 struct ast_config *ast_load_realtime_multientry(const char *family, ...)
 {
 	RAII_VAR(struct ast_variable *, fields, NULL, ast_variables_destroy);
@@ -3339,6 +4643,8 @@ int ast_update_realtime_fields(const char *family, const char *keyfield, const c
 		}
 	}
 
+	realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3375,6 +4681,8 @@ int ast_update2_realtime_fields(const char *family, const struct ast_variable *l
 		}
 	}
 
+	realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3420,6 +4728,8 @@ int ast_store_realtime_fields(const char *family, const struct ast_variable *fie
 		}
 	}
 
+	realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3456,6 +4766,8 @@ int ast_destroy_realtime_fields(const char *family, const char *keyfield, const
 		}
 	}
 
+	realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3845,15 +5157,87 @@ static char *handle_cli_config_list(struct ast_cli_entry *e, int cmd, struct ast
 	return CLI_SUCCESS;
 }
 
+static char *handle_cli_realtime_cache_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ao2_container *caches;
+	struct realtime_cache *cache;
+	struct ao2_iterator i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "realtime cache show";
+		e->usage =
+			"Usage: realtime cache show\n"
+			"   Show the realtime families with a cache, as set in the [cache]\n"
+			"   section of extconfig.conf, and how well each cache does.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!(caches = ao2_global_obj_ref(realtime_caches)) || !ao2_container_count(caches)) {
+		ast_cli(a->fd, "No realtime families are cached.\n");
+		ao2_cleanup(caches);
+		return CLI_SUCCESS;
+	}
+
+	ast_cli(a->fd, "%-20s %8s %8s %8s %8s %10s %10s\n", "Family", "TTL", "Neg TTL", "Max", "Results", "Hits", "Misses");
+	i = ao2_iterator_init(caches, 0);
+	while ((cache = ao2_iterator_next(&i))) {
+		ast_cli(a->fd, "%-20s %8u %8u %8u %8d %10d %10d\n", cache->family, cache->ttl,
+			cache->negative_ttl, cache->max, ao2_container_count(cache->entries),
+			cache->hits, cache->misses);
+		ao2_ref(cache, -1);
+	}
+	ao2_iterator_destroy(&i);
+	ao2_ref(caches, -1);
+
+	return CLI_SUCCESS;
+}
+
+static char *handle_cli_realtime_cache_flush(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "realtime cache flush";
+		e->usage =
+			"Usage: realtime cache flush [<family>]\n"
+			"   Drop the results kept by the cache of a realtime family, or\n"
+			"   of all families.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc > 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (ast_realtime_cache_flush(a->argc == 4 ? a->argv[3] : NULL)) {
+		ast_cli(a->fd, "No cache for %s.\n", a->argc == 4 ? a->argv[3] : "any realtime family");
+	} else {
+		ast_cli(a->fd, "Flushed the cache of %s.\n", a->argc == 4 ? a->argv[3] : "all realtime families");
+	}
+
+	return CLI_SUCCESS;
+}
+
 static struct ast_cli_entry cli_config[] = {
 	AST_CLI_DEFINE(handle_cli_core_show_config_mappings, "Display config mappings (file names to config engines)"),
 	AST_CLI_DEFINE(handle_cli_config_reload, "Force a reload on modules using a particular configuration file"),
 	AST_CLI_DEFINE(handle_cli_config_list, "Show all files that have loaded a configuration file"),
+	AST_CLI_DEFINE(handle_cli_realtime_cache_show, "Show the caches of realtime families"),
+	AST_CLI_DEFINE(handle_cli_realtime_cache_flush, "Flush the caches of realtime families"),
 };
 
 static void config_shutdown(void)
 {
 	struct cache_file_mtime *cfmtime;
+	struct config_image *image;
 
 	AST_LIST_LOCK(&cfmtime_head);
 	while ((cfmtime = AST_LIST_REMOVE_HEAD(&cfmtime_head, list))) {
@@ -3863,6 +5247,14 @@ static void config_shutdown(void)
 
 	ast_cli_unregister_multiple(cli_config, ARRAY_LEN(cli_config));
 
+	ao2_global_obj_release(realtime_caches);
+
+	AST_LIST_LOCK(&config_images);
+	while ((image = AST_LIST_REMOVE_HEAD(&config_images, list))) {
+		config_image_destroy(image);
+	}
+	AST_LIST_UNLOCK(&config_images);
+
 	ao2_cleanup(cfg_hooks);
 	cfg_hooks = NULL;
 }
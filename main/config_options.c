@@ -58,6 +58,7 @@ struct aco_info_internal {
 struct aco_type_internal {
 	regex_t *regex;
 	struct ao2_container *opts; /*!< The container of options registered to the aco_info */
+	struct ao2_container *regex_opts; /*!< The options matched by regex, also in opts */
 };
 
 struct aco_option {
@@ -78,6 +79,9 @@ struct aco_option {
 
 #ifdef AST_XML_DOCS
 static struct ao2_container *xmldocs;
+
+/*! \brief Serializes building xmldocs */
+AST_MUTEX_DEFINE_STATIC(xmldocs_lock);
 #endif /* AST_XML_DOCS */
 
 /*! \brief Value of the aco_option_type enum as strings */
@@ -184,6 +188,7 @@ static int link_option_to_types(struct aco_info *info, struct aco_type **types,
 			return -1;
 		}
 		if (!ao2_link(type->internal->opts, opt)
+				|| (opt->match_type == ACO_REGEX && !ao2_link(type->internal->regex_opts, opt))
 #ifdef AST_XML_DOCS
 				|| (!info->hidden &&
 					!opt->no_doc &&
@@ -192,6 +197,7 @@ static int link_option_to_types(struct aco_info *info, struct aco_type **types,
 		) {
 			do {
 				ao2_unlink(types[idx - 1]->internal->opts, opt);
+				ao2_unlink(types[idx - 1]->internal->regex_opts, opt);
 			} while (--idx);
 			return -1;
 		}
@@ -378,10 +384,10 @@ static struct aco_option *aco_option_find(struct aco_type *type, const char *nam
 		return NULL;
 	}
 
-	/* Try an exact match with OBJ_KEY for the common/fast case, then iterate through
-	 * all options for the regex cases */
-	if (!(opt = ao2_callback(type->internal->opts, OBJ_KEY, find_option_cb, (void *) name))) {
-		opt = ao2_callback(type->internal->opts, 0, find_option_cb, (void *) name);
+	/* Try an exact match in the hash for the common/fast case, then iterate
+	 * through the regex options alone, so unknown names don't walk every option */
+	if (!(opt = ao2_find(type->internal->opts, name, OBJ_SEARCH_KEY))) {
+		opt = ao2_callback(type->internal->regex_opts, 0, find_option_cb, (void *) name);
 	}
 	return opt;
 }
@@ -440,14 +446,17 @@ static int is_preload(struct aco_file *file, const char *cat)
 	return 0;
 }
 
-static int process_category(struct ast_config *cfg, struct aco_info *info, struct aco_file *file, const char *cat, int preload) {
+/*!
+ * \internal
+ * \param regex_skip The compiled skip_category of the file, NULL if it has none
+ */
+static int process_category(struct ast_config *cfg, struct aco_info *info, struct aco_file *file, const char *cat, int preload, regex_t *regex_skip) {
 	RAII_VAR(void *, new_item, NULL, ao2_cleanup);
 	struct aco_type *type;
 	/* For global types, field is the global option struct. For non-global, it is the container for items.
 	 * We do not grab a reference to these objects, as the info already holds references to them. This
 	 * pointer is just a convenience. Do not actually store it somewhere. */
 	void **field;
-	regex_t *regex_skip;
 
 	/* Skip preloaded categories if we aren't preloading */
 	if (!preload && is_preload(file, cat)) {
@@ -455,15 +464,8 @@ static int process_category(struct ast_config *cfg, struct aco_info *info, struc
 	}
 
 	/* Skip the category if we've been told to ignore it */
-	if (!ast_strlen_zero(file->skip_category)) {
-		regex_skip = build_regex(file->skip_category);
-		if (!regexec(regex_skip, cat, 0, NULL, 0)) {
-			regfree(regex_skip);
-			ast_free(regex_skip);
-			return 0;
-		}
-		regfree(regex_skip);
-		ast_free(regex_skip);
+	if (regex_skip && !regexec(regex_skip, cat, 0, NULL, 0)) {
+		return 0;
 	}
 
 	/* Find aco_type by category, if not found it is an error */
@@ -535,22 +537,37 @@ static int apply_config(struct aco_info *info)
 static enum aco_process_status internal_process_ast_config(struct aco_info *info, struct aco_file *file, struct ast_config *cfg)
 {
 	const char *cat = NULL;
+	regex_t *regex_skip = NULL;
+	enum aco_process_status res = ACO_PROCESS_OK;
+
+	/* Compiled once for the file rather than for each category */
+	if (!ast_strlen_zero(file->skip_category) && !(regex_skip = build_regex(file->skip_category))) {
+		return ACO_PROCESS_ERROR;
+	}
 
 	if (file->preload) {
 		int i;
 		for (i = 0; !ast_strlen_zero(file->preload[i]); i++) {
-			if (process_category(cfg, info, file, file->preload[i], 1)) {
-				return ACO_PROCESS_ERROR;
+			if (process_category(cfg, info, file, file->preload[i], 1, regex_skip)) {
+				res = ACO_PROCESS_ERROR;
+				goto end;
 			}
 		}
 	}
 
 	while ((cat = ast_category_browse(cfg, cat))) {
-		if (process_category(cfg, info, file, cat, 0)) {
-			return ACO_PROCESS_ERROR;
+		if (process_category(cfg, info, file, cat, 0, regex_skip)) {
+			res = ACO_PROCESS_ERROR;
+			goto end;
 		}
 	}
-	return ACO_PROCESS_OK;
+
+end:
+	if (regex_skip) {
+		regfree(regex_skip);
+		ast_free(regex_skip);
+	}
+	return res;
 }
 
 enum aco_process_status aco_process_ast_config(struct aco_info *info, struct aco_file *file, struct ast_config *cfg)
@@ -752,6 +769,8 @@ static void internal_type_destroy(struct aco_type *type)
 	}
 	ao2_cleanup(type->internal->opts);
 	type->internal->opts = NULL;
+	ao2_cleanup(type->internal->regex_opts);
+	type->internal->regex_opts = NULL;
 	ast_free(type->internal);
 	type->internal = NULL;
 }
@@ -783,6 +802,11 @@ static int internal_type_init(struct aco_type *type)
 		return -1;
 	}
 
+	if (!(type->internal->regex_opts = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_MUTEX, 0, NULL, NULL))) {
+		internal_type_destroy(type);
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -972,6 +996,11 @@ static int xmldoc_update_config_type(const char *module, const char *name, const
 	struct ast_xml_doc_item *config_type;
 	struct ast_xml_node *type, *syntax, *matchinfo, *tmp;
 
+	if (ast_xmldoc_lazy()) {
+		/* The documentation is not parsed until it is shown, so is left as written */
+		return 0;
+	}
+
 	/* If we already have a syntax element, bail. This isn't an error, since we may unload a module which
 	 * has updated the docs and then load it again. */
 	if ((results = ast_xmldoc_query("//configInfo[@name='%s']/*/configObject[@name='%s']/syntax", module, name))) {
@@ -1039,6 +1068,11 @@ static int xmldoc_update_config_option(struct aco_type **types, const char *modu
 
 	ast_assert(ARRAY_LEN(aco_option_type_string) > type);
 
+	if (ast_xmldoc_lazy()) {
+		/* The documentation is not parsed until it is shown, so is left as written */
+		return 0;
+	}
+
 	if (!config_info || !(config_option = find_xmldoc_option(config_info, types, name))) {
 		ast_log(LOG_ERROR, "XML Documentation for option '%s' in modules '%s' not found!\n", name, module);
 		return XMLDOC_STRICT ? -1 : 0;
@@ -1219,6 +1253,23 @@ static void cli_show_module_options(struct ast_cli_args *a)
 	}
 }
 
+/*! \internal
+ * \brief Build the configuration documentation if it has not been
+ */
+static int xmldocs_build(void)
+{
+	int res = 0;
+
+	ast_mutex_lock(&xmldocs_lock);
+	if (!xmldocs && !(xmldocs = ast_xmldoc_build_documentation("configInfo"))) {
+		ast_log(LOG_ERROR, "Couldn't build config documentation\n");
+		res = -1;
+	}
+	ast_mutex_unlock(&xmldocs_lock);
+
+	return res;
+}
+
 static char *cli_show_help(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	switch (cmd) {
@@ -1243,6 +1294,9 @@ static char *cli_show_help(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 			"     configuration help for that module may be incomplete.\n";
 		return NULL;
 	case CLI_GENERATE:
+		if (xmldocs_build()) {
+			return NULL;
+		}
 		switch(a->pos) {
 		case 3: return complete_config_module(a->word, a->pos, a->n);
 		case 4: return complete_config_type(a->argv[3], a->word, a->pos, a->n);
@@ -1251,6 +1305,11 @@ static char *cli_show_help(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 		}
 	}
 
+	if (xmldocs_build()) {
+		ast_cli(a->fd, "Configuration documentation could not be built\n");
+		return CLI_FAILURE;
+	}
+
 	switch (a->argc) {
 	case 3:
 		cli_show_modules(a);
@@ -1286,8 +1345,8 @@ int aco_init(void)
 {
 #ifdef AST_XML_DOCS
 	ast_register_cleanup(aco_deinit);
-	if (!(xmldocs = ast_xmldoc_build_documentation("configInfo"))) {
-		ast_log(LOG_ERROR, "Couldn't build config documentation\n");
+	/* Lazy documentation is built by the first 'config show help' */
+	if (!ast_xmldoc_lazy() && xmldocs_build()) {
 		return -1;
 	}
 	ast_cli_register_multiple(cli_aco, ARRAY_LEN(cli_aco));
@@ -388,7 +388,7 @@ static void local_optimization_started_cb(struct ast_unreal_pvt *base, struct as
 		return;
 	}
 
-	stasis_publish(ast_channel_topic(p->base.owner), msg);
+	ast_channel_publish_message(p->base.owner, msg);
 }
 
 /*! \brief Callback for \ref ast_unreal_pvt_callbacks \ref optimization_finished_cb */
@@ -419,7 +419,7 @@ static void local_optimization_finished_cb(struct ast_unreal_pvt *base, int succ
 		return;
 	}
 
-	stasis_publish(ast_channel_topic(p->base.owner), msg);
+	ast_channel_publish_message(p->base.owner, msg);
 }
 
 static struct ast_manager_event_blob *local_message_to_ami(struct stasis_message *message)
@@ -546,7 +546,7 @@ static void publish_local_bridge_message(struct local_pvt *p)
 		goto end;
 	}
 
-	stasis_publish(ast_channel_topic(owner), msg);
+	ast_channel_publish_message(owner, msg);
 
 end:
 	ast_channel_unlock(owner);
@@ -107,6 +107,8 @@ ASTERISK_REGISTER_FILE()
  ***/
 
 #define MAX_DB_FIELD 256
+/*! \brief How many entries "database show" reads at a time */
+#define DB_CLI_PAGE 1000
 AST_MUTEX_DEFINE_STATIC(dblock);
 static ast_cond_t dbcond;
 static sqlite3 *astdb;
@@ -115,6 +117,60 @@ static int doexit;
 static int dosync;
 
 static void db_sync(void);
+static int db_execute_sql(const char *sql, int (*callback)(void *, int, char **, char **), void *arg);
+
+/*!
+ * \brief Read-only connections to the database
+ *
+ * The database is in WAL mode, so these read what was last committed while
+ * the sync thread holds a transaction open on \ref astdb. Each is used by one
+ * thread at a time.
+ */
+struct db_reader {
+	ast_mutex_t lock;
+	sqlite3 *db;
+	sqlite3_stmt *get_stmt;
+	sqlite3_stmt *gettree_stmt;
+	sqlite3_stmt *gettree_next_stmt;
+	sqlite3_stmt *gettree_all_stmt;
+	sqlite3_stmt *gettree_all_next_stmt;
+};
+
+#define DB_READERS 4
+static struct db_reader readers[DB_READERS];
+/*! \brief The number of readers open, 0 if reads must use \ref astdb */
+static int num_readers;
+static int next_reader;
+
+/*!
+ * \brief A cached value, by full key
+ *
+ * The readers do not see what the open transaction has changed, so every key
+ * put or deleted in it is in the cache until it is committed.
+ */
+struct db_cache_entry {
+	/*! The transaction the value was written in, 0 if it was read */
+	unsigned int tx;
+	/*! The value, NULL if there is no such key */
+	char *value;
+	char key[0];
+};
+
+#define DB_CACHE_BUCKETS 563
+/*! \brief How many entries the cache holds before it drops those committed */
+#define DB_CACHE_MAX 10000
+/*! \brief Longer values are not cached */
+#define DB_CACHE_VALUE_MAX 1024
+
+static struct ao2_container *db_cache;
+/*! \brief Changed with the cache lock held by each write, so a read racing one does not cache what it read */
+static volatile int db_cache_gen;
+/*! \brief The open transaction, incremented by each commit */
+static unsigned int db_tx = 1;
+/*! \brief The open transaction has changes, so gettree must see them through \ref astdb */
+static volatile int db_dirty;
+/*! \brief The open transaction has changes that are not in the cache, so a miss must read \ref astdb */
+static volatile int db_uncached;
 
 #define DEFINE_SQL_STATEMENT(stmt,sql) static sqlite3_stmt *stmt; \
 	const char stmt##_sql[] = sql;
@@ -122,10 +178,20 @@ static void db_sync(void);
 DEFINE_SQL_STATEMENT(put_stmt, "INSERT OR REPLACE INTO astdb (key, value) VALUES (?, ?)")
 DEFINE_SQL_STATEMENT(get_stmt, "SELECT value FROM astdb WHERE key=?")
 DEFINE_SQL_STATEMENT(del_stmt, "DELETE FROM astdb WHERE key=?")
-DEFINE_SQL_STATEMENT(deltree_stmt, "DELETE FROM astdb WHERE key || '/' LIKE ? || '/' || '%'")
+/*
+ * Trees are read and deleted as ranges of the primary key. A tree is the key
+ * ?1 and those in [?3, ?2), where ?3 is ?1 followed by a slash and ?2 is ?1
+ * followed by the character after it. The keys between ?1 and ?3 that are not
+ * ?1 itself are filtered out as the range is scanned. A tree read a page at a
+ * time continues after the last key read, with a single lower bound so the
+ * scan starts there.
+ */
+DEFINE_SQL_STATEMENT(deltree_stmt, "DELETE FROM astdb WHERE key >= ?1 AND key < ?2 AND (key = ?1 OR key >= ?3)")
 DEFINE_SQL_STATEMENT(deltree_all_stmt, "DELETE FROM astdb")
-DEFINE_SQL_STATEMENT(gettree_stmt, "SELECT key, value FROM astdb WHERE key || '/' LIKE ? || '/' || '%' ORDER BY key")
-DEFINE_SQL_STATEMENT(gettree_all_stmt, "SELECT key, value FROM astdb ORDER BY key")
+DEFINE_SQL_STATEMENT(gettree_stmt, "SELECT key, value FROM astdb WHERE key >= ?1 AND key < ?2 AND (key = ?1 OR key >= ?3) ORDER BY key LIMIT ?4")
+DEFINE_SQL_STATEMENT(gettree_next_stmt, "SELECT key, value FROM astdb WHERE key > ?1 AND key < ?2 ORDER BY key LIMIT ?3")
+DEFINE_SQL_STATEMENT(gettree_all_stmt, "SELECT key, value FROM astdb ORDER BY key LIMIT ?1")
+DEFINE_SQL_STATEMENT(gettree_all_next_stmt, "SELECT key, value FROM astdb WHERE key > ?1 ORDER BY key LIMIT ?2")
 DEFINE_SQL_STATEMENT(showkey_stmt, "SELECT key, value FROM astdb WHERE key LIKE '%' || '/' || ? ORDER BY key")
 DEFINE_SQL_STATEMENT(create_astdb_stmt, "CREATE TABLE IF NOT EXISTS astdb(key VARCHAR(256), value VARCHAR(256), PRIMARY KEY(key))")
 
@@ -168,7 +234,9 @@ static void clean_statements(void)
 	clean_stmt(&deltree_stmt, deltree_stmt_sql);
 	clean_stmt(&deltree_all_stmt, deltree_all_stmt_sql);
 	clean_stmt(&gettree_stmt, gettree_stmt_sql);
+	clean_stmt(&gettree_next_stmt, gettree_next_stmt_sql);
 	clean_stmt(&gettree_all_stmt, gettree_all_stmt_sql);
+	clean_stmt(&gettree_all_next_stmt, gettree_all_next_stmt_sql);
 	clean_stmt(&showkey_stmt, showkey_stmt_sql);
 	clean_stmt(&put_stmt, put_stmt_sql);
 	clean_stmt(&create_astdb_stmt, create_astdb_stmt_sql);
@@ -183,7 +251,9 @@ static int init_statements(void)
 	|| init_stmt(&deltree_stmt, deltree_stmt_sql, sizeof(deltree_stmt_sql))
 	|| init_stmt(&deltree_all_stmt, deltree_all_stmt_sql, sizeof(deltree_all_stmt_sql))
 	|| init_stmt(&gettree_stmt, gettree_stmt_sql, sizeof(gettree_stmt_sql))
+	|| init_stmt(&gettree_next_stmt, gettree_next_stmt_sql, sizeof(gettree_next_stmt_sql))
 	|| init_stmt(&gettree_all_stmt, gettree_all_stmt_sql, sizeof(gettree_all_stmt_sql))
+	|| init_stmt(&gettree_all_next_stmt, gettree_all_next_stmt_sql, sizeof(gettree_all_next_stmt_sql))
 	|| init_stmt(&showkey_stmt, showkey_stmt_sql, sizeof(showkey_stmt_sql))
 	|| init_stmt(&put_stmt, put_stmt_sql, sizeof(put_stmt_sql));
 }
@@ -220,6 +290,17 @@ static int db_create_astdb(void)
 	return res;
 }
 
+/*! \brief Whether the database is in WAL mode, so readers can read while it is written */
+static int db_wal;
+
+static int db_wal_result(void *arg, int columns, char **values, char **colnames)
+{
+	int *wal = arg;
+
+	*wal = columns > 0 && values[0] && !strcasecmp(values[0], "wal");
+	return 0;
+}
+
 static int db_open(void)
 {
 	char *dbname;
@@ -258,21 +339,310 @@ static int db_open(void)
 		return -1;
 	}
 
+	if (db_execute_sql("PRAGMA journal_mode=WAL", db_wal_result, &db_wal) || !db_wal) {
+		ast_log(LOG_NOTICE, "Unable to put the Asterisk database in WAL mode, reads will wait for writes\n");
+		db_wal = 0;
+	}
 	ast_mutex_unlock(&dblock);
 
 	return 0;
 }
 
+static void db_reader_close(struct db_reader *reader)
+{
+	sqlite3_finalize(reader->get_stmt);
+	sqlite3_finalize(reader->gettree_stmt);
+	sqlite3_finalize(reader->gettree_next_stmt);
+	sqlite3_finalize(reader->gettree_all_stmt);
+	sqlite3_finalize(reader->gettree_all_next_stmt);
+	reader->get_stmt = reader->gettree_stmt = reader->gettree_next_stmt = NULL;
+	reader->gettree_all_stmt = reader->gettree_all_next_stmt = NULL;
+	sqlite3_close(reader->db);
+	reader->db = NULL;
+}
+
+static int db_reader_open(struct db_reader *reader, const char *dbname)
+{
+	if (sqlite3_open_v2(dbname, &reader->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Unable to open Asterisk database '%s' for reading: %s\n", dbname, sqlite3_errmsg(reader->db));
+		db_reader_close(reader);
+		return -1;
+	}
+
+	if (sqlite3_prepare_v2(reader->db, get_stmt_sql, sizeof(get_stmt_sql), &reader->get_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_stmt_sql, sizeof(gettree_stmt_sql), &reader->gettree_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_next_stmt_sql, sizeof(gettree_next_stmt_sql), &reader->gettree_next_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_all_stmt_sql, sizeof(gettree_all_stmt_sql), &reader->gettree_all_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_all_next_stmt_sql, sizeof(gettree_all_next_stmt_sql), &reader->gettree_all_next_stmt, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't prepare statements for reading: %s\n", sqlite3_errmsg(reader->db));
+		db_reader_close(reader);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Open the read-only connections
+ *
+ * Only once the astdb table exists, as they prepare statements on it. If
+ * none open, reads use \ref astdb as before.
+ */
+static void db_readers_open(void)
+{
+	char *dbname;
+	int i;
+
+	if (!db_wal) {
+		return;
+	}
+
+	dbname = ast_alloca(strlen(ast_config_AST_DB) + sizeof(".sqlite3"));
+	strcpy(dbname, ast_config_AST_DB);
+	strcat(dbname, ".sqlite3");
+
+	for (i = 0; i < DB_READERS; ++i) {
+		ast_mutex_init(&readers[i].lock);
+	}
+
+	ast_mutex_lock(&dblock);
+	for (i = 0; i < DB_READERS; ++i) {
+		if (db_reader_open(&readers[num_readers], dbname)) {
+			break;
+		}
+		++num_readers;
+	}
+	ast_mutex_unlock(&dblock);
+}
+
+/*!
+ * \internal
+ * \brief Take a read-only connection
+ *
+ * \return The connection, locked, or NULL if there is none. Give it back
+ * with db_reader_put().
+ */
+static struct db_reader *db_reader_get(void)
+{
+	struct db_reader *reader;
+	int count = num_readers;
+	unsigned int start;
+	int i;
+
+	if (!count) {
+		return NULL;
+	}
+
+	start = ast_atomic_fetchadd_int(&next_reader, 1);
+	for (i = 0; i < count; ++i) {
+		reader = &readers[(start + i) % count];
+		if (!ast_mutex_trylock(&reader->lock)) {
+			break;
+		}
+		reader = NULL;
+	}
+	if (!reader) {
+		/* All busy, so wait for one */
+		reader = &readers[start % count];
+		ast_mutex_lock(&reader->lock);
+	}
+
+	if (!reader->db) {
+		/* Closed for shutdown */
+		ast_mutex_unlock(&reader->lock);
+		return NULL;
+	}
+
+	return reader;
+}
+
+static void db_reader_put(struct db_reader *reader)
+{
+	ast_mutex_unlock(&reader->lock);
+}
+
+static int db_cache_hash(const void *obj, const int flags)
+{
+	const struct db_cache_entry *entry;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		entry = obj;
+		key = entry->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int db_cache_cmp(void *obj, void *arg, int flags)
+{
+	const struct db_cache_entry *entry = obj;
+	const struct db_cache_entry *other;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = arg;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		other = arg;
+		key = other->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return strcmp(entry->key, key) ? 0 : CMP_MATCH;
+}
+
+static int db_cache_committed(void *obj, void *arg, int flags)
+{
+	const struct db_cache_entry *entry = obj;
+
+	return entry->tx < db_tx ? CMP_MATCH : 0;
+}
+
+static struct db_cache_entry *db_cache_entry_alloc(const char *fullkey, const char *value, unsigned int tx)
+{
+	struct db_cache_entry *entry;
+	size_t key_len = strlen(fullkey) + 1;
+
+	entry = ao2_alloc_options(sizeof(*entry) + key_len + (value ? strlen(value) + 1 : 0),
+		NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return NULL;
+	}
+
+	entry->tx = tx;
+	memcpy(entry->key, fullkey, key_len);
+	if (value) {
+		entry->value = entry->key + key_len;
+		strcpy(entry->value, value);
+	}
+
+	return entry;
+}
+
+/*!
+ * \internal
+ * \brief Add an entry, dropping those committed if the cache is full
+ * \note The cache must be locked.
+ */
+static void db_cache_link(struct db_cache_entry *entry)
+{
+	if (ao2_container_count(db_cache) >= DB_CACHE_MAX) {
+		ao2_callback(db_cache, OBJ_NOLOCK | OBJ_UNLINK | OBJ_MULTIPLE | OBJ_NODATA,
+			db_cache_committed, NULL);
+	}
+	ao2_link_flags(db_cache, entry, OBJ_NOLOCK);
+}
+
+/*!
+ * \internal
+ * \brief Empty the cache after a write it cannot follow
+ * \note dblock must be held.
+ */
+static void db_cache_flush(void)
+{
+	ao2_lock(db_cache);
+	++db_cache_gen;
+	ao2_callback(db_cache, OBJ_NOLOCK | OBJ_UNLINK | OBJ_MULTIPLE | OBJ_NODATA, NULL, NULL);
+	db_uncached = 1;
+	ao2_unlock(db_cache);
+}
+
+/*!
+ * \internal
+ * \brief Record a key put or deleted in the open transaction
+ *
+ * \param fullkey The key
+ * \param value Its value, NULL if deleted
+ *
+ * \note dblock must be held.
+ */
+static void db_cache_write(const char *fullkey, const char *value)
+{
+	struct db_cache_entry *entry = NULL;
+
+	if (!value || strlen(value) < DB_CACHE_VALUE_MAX) {
+		entry = db_cache_entry_alloc(fullkey, value, db_tx);
+	}
+
+	ao2_lock(db_cache);
+	++db_cache_gen;
+	ao2_find(db_cache, fullkey, OBJ_SEARCH_KEY | OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA);
+	if (entry) {
+		db_cache_link(entry);
+	} else {
+		db_uncached = 1;
+	}
+	ao2_unlock(db_cache);
+
+	ao2_cleanup(entry);
+}
+
+/*!
+ * \internal
+ * \brief Cache what a reader found
+ *
+ * \param fullkey The key
+ * \param value Its value, NULL if there is no such key
+ * \param gen \ref db_cache_gen from before the cache was searched
+ *
+ * Nothing is cached if a write has happened since, as what the reader found
+ * may be older than it.
+ */
+static void db_cache_fill(const char *fullkey, const char *value, int gen)
+{
+	struct db_cache_entry *entry;
+	struct db_cache_entry *existing = NULL;
+
+	if (value && strlen(value) >= DB_CACHE_VALUE_MAX) {
+		return;
+	}
+
+	if (!(entry = db_cache_entry_alloc(fullkey, value, 0))) {
+		return;
+	}
+
+	ao2_lock(db_cache);
+	if (gen == db_cache_gen && !(existing = ao2_find(db_cache, fullkey, OBJ_SEARCH_KEY | OBJ_NOLOCK))) {
+		db_cache_link(entry);
+	}
+	ao2_unlock(db_cache);
+
+	ao2_cleanup(existing);
+	ao2_ref(entry, -1);
+}
+
 static int db_init(void)
 {
 	if (astdb) {
 		return 0;
 	}
 
+	if (!db_cache) {
+		db_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK, 0, DB_CACHE_BUCKETS,
+			db_cache_hash, NULL, db_cache_cmp);
+		if (!db_cache) {
+			return -1;
+		}
+	}
+
 	if (db_open() || db_create_astdb() || init_statements()) {
 		return -1;
 	}
 
+	db_readers_open();
+
 	return 0;
 }
 
@@ -334,12 +704,55 @@ int ast_db_put(const char *family, const char *key, const char *value)
 	}
 
 	sqlite3_reset(put_stmt);
+	if (res) {
+		db_cache_flush();
+	} else {
+		db_cache_write(fullkey, value);
+	}
 	db_sync();
 	ast_mutex_unlock(&dblock);
 
 	return res;
 }
 
+/*!
+ * \internal
+ * \brief Look up a key with a prepared get statement
+ *
+ * \param db The connection \a stmt is for
+ * \param stmt The statement
+ * \param fullkey The key
+ * \param fullkey_len Its length
+ * \param value Set to the value, which must be freed by calling ast_free()
+ *
+ * \retval 1 The key was found
+ * \retval 0 There is no such key
+ * \retval -1 An error occurred
+ */
+static int db_get_stmt(sqlite3 *db, sqlite3_stmt *stmt, const char *fullkey, size_t fullkey_len, char **value)
+{
+	const unsigned char *result;
+	int res = 1;
+
+	*value = NULL;
+	if (sqlite3_bind_text(stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(db));
+		res = -1;
+	} else if ((res = sqlite3_step(stmt)) != SQLITE_ROW) {
+		res = res == SQLITE_DONE ? 0 : -1;
+	} else if (!(result = sqlite3_column_text(stmt, 0))) {
+		ast_log(LOG_WARNING, "Couldn't get value\n");
+		res = -1;
+	} else if (!(*value = ast_strdup((const char *) result))) {
+		res = -1;
+	} else {
+		res = 1;
+	}
+	sqlite3_reset(stmt);
+
+	return res;
+}
+
 /*!
  * \internal
  * \brief Get key value specified by family/key.
@@ -348,6 +761,10 @@ int ast_db_put(const char *family, const char *key, const char *value)
  * stores it, either into the fixed sized buffer specified by \a buffer
  * and \a bufferlen, or as a heap allocated string if \a bufferlen is -1.
  *
+ * The value comes from the cache if it is there, otherwise from a read-only
+ * connection, and only from \ref astdb if the open transaction has changes
+ * the cache does not hold.
+ *
  * \note If \a bufferlen is -1, \a buffer points to heap allocated memory
  *       and must be freed by calling ast_free().
  *
@@ -356,10 +773,13 @@ int ast_db_put(const char *family, const char *key, const char *value)
  */
 static int db_get_common(const char *family, const char *key, char **buffer, int bufferlen)
 {
-	const unsigned char *result;
+	struct db_cache_entry *entry;
+	struct db_reader *reader;
 	char fullkey[MAX_DB_FIELD];
 	size_t fullkey_len;
-	int res = 0;
+	char *value = NULL;
+	int gen;
+	int res = -1;
 
 	if (strlen(family) + strlen(key) + 2 > sizeof(fullkey) - 1) {
 		ast_log(LOG_WARNING, "Family and key length must be less than %zu bytes\n", sizeof(fullkey) - 3);
@@ -368,29 +788,50 @@ static int db_get_common(const char *family, const char *key, char **buffer, int
 
 	fullkey_len = snprintf(fullkey, sizeof(fullkey), "/%s/%s", family, key);
 
-	ast_mutex_lock(&dblock);
-	if (sqlite3_bind_text(get_stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
-		ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(astdb));
-		res = -1;
-	} else if (sqlite3_step(get_stmt) != SQLITE_ROW) {
-		ast_debug(1, "Unable to find key '%s' in family '%s'\n", key, family);
-		res = -1;
-	} else if (!(result = sqlite3_column_text(get_stmt, 0))) {
-		ast_log(LOG_WARNING, "Couldn't get value\n");
-		res = -1;
-	} else {
-		const char *value = (const char *) result;
-
+	/* Before the search, so a write after it stops the result being cached */
+	gen = db_cache_gen;
+	if ((entry = ao2_find(db_cache, fullkey, OBJ_SEARCH_KEY))) {
+		if (!entry->value) {
+			ast_debug(1, "Unable to find key '%s' in family '%s'\n", key, family);
+			ao2_ref(entry, -1);
+			return -1;
+		}
 		if (bufferlen == -1) {
-			*buffer = ast_strdup(value);
+			*buffer = ast_strdup(entry->value);
 		} else {
-			ast_copy_string(*buffer, value, bufferlen);
+			ast_copy_string(*buffer, entry->value, bufferlen);
 		}
+		ao2_ref(entry, -1);
+		return 0;
 	}
-	sqlite3_reset(get_stmt);
-	ast_mutex_unlock(&dblock);
 
-	return res;
+	if (!db_uncached && (reader = db_reader_get())) {
+		res = db_get_stmt(reader->db, reader->get_stmt, fullkey, fullkey_len, &value);
+		db_reader_put(reader);
+		if (res >= 0) {
+			db_cache_fill(fullkey, value, gen);
+		}
+	}
+
+	if (res < 0) {
+		ast_mutex_lock(&dblock);
+		res = db_get_stmt(astdb, get_stmt, fullkey, fullkey_len, &value);
+		ast_mutex_unlock(&dblock);
+	}
+
+	if (res <= 0) {
+		ast_debug(1, "Unable to find key '%s' in family '%s'\n", key, family);
+		return -1;
+	}
+
+	if (bufferlen == -1) {
+		*buffer = value;
+	} else {
+		ast_copy_string(*buffer, value, bufferlen);
+		ast_free(value);
+	}
+
+	return 0;
 }
 
 int ast_db_get(const char *family, const char *key, char *value, int valuelen)
@@ -432,71 +873,126 @@ int ast_db_del(const char *family, const char *key)
 		res = -1;
 	}
 	sqlite3_reset(del_stmt);
+	if (res) {
+		db_cache_flush();
+	} else {
+		db_cache_write(fullkey, NULL);
+	}
 	db_sync();
 	ast_mutex_unlock(&dblock);
 
 	return res;
 }
 
-int ast_db_deltree(const char *family, const char *keytree)
+/*! \brief The keys of a tree, as a range of the primary key */
+struct db_range {
+	/*! No family was given, so the tree is the whole database */
+	unsigned int all:1;
+	/*! The first key of the range */
+	char lower[MAX_DB_FIELD];
+	/*! The first key after the range */
+	char upper[MAX_DB_FIELD + 1];
+	/*! The first key of the range after \a lower itself */
+	char subtree[MAX_DB_FIELD + 1];
+};
+
+/*!
+ * \internal
+ * \brief Find the range of keys of a tree
+ *
+ * \param range The range to fill in
+ * \param family The family, or NULL for the whole database
+ * \param keytree The key tree within the family, or NULL
+ * \param by_prefix Whether \a keytree is a prefix of the keys wanted rather
+ * than a key and the keys under it
+ */
+static void db_range_init(struct db_range *range, const char *family, const char *keytree, int by_prefix)
 {
-	sqlite3_stmt *stmt = deltree_stmt;
-	char prefix[MAX_DB_FIELD];
-	int res = 0;
+	size_t len;
 
-	if (!ast_strlen_zero(family)) {
-		if (!ast_strlen_zero(keytree)) {
-			/* Family and key tree */
-			snprintf(prefix, sizeof(prefix), "/%s/%s", family, keytree);
-		} else {
-			/* Family only */
-			snprintf(prefix, sizeof(prefix), "/%s", family);
-		}
+	memset(range, 0, sizeof(*range));
+	if (ast_strlen_zero(family)) {
+		range->all = 1;
+		return;
+	}
+
+	if (by_prefix) {
+		snprintf(range->lower, sizeof(range->lower), "/%s/%s", family, S_OR(keytree, ""));
+	} else if (!ast_strlen_zero(keytree)) {
+		/* Family and key tree */
+		snprintf(range->lower, sizeof(range->lower), "/%s/%s", family, keytree);
 	} else {
-		prefix[0] = '\0';
-		stmt = deltree_all_stmt;
+		/* Family only */
+		snprintf(range->lower, sizeof(range->lower), "/%s", family);
 	}
 
-	ast_mutex_lock(&dblock);
-	if (!ast_strlen_zero(prefix) && (sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
-		res = -1;
-	} else if (sqlite3_step(stmt) != SQLITE_DONE) {
-		ast_log(LOG_WARNING, "Couldn't execute stmt: %s\n", sqlite3_errmsg(astdb));
-		res = -1;
+	if (!by_prefix) {
+		/* '0' is the character after '/' */
+		snprintf(range->subtree, sizeof(range->subtree), "%s/", range->lower);
+		snprintf(range->upper, sizeof(range->upper), "%s0", range->lower);
+		return;
 	}
-	res = sqlite3_changes(astdb);
-	sqlite3_reset(stmt);
-	db_sync();
-	ast_mutex_unlock(&dblock);
 
-	return res;
+	/* Every key starting with the prefix, up to the first string that does not */
+	strcpy(range->subtree, range->lower);
+	strcpy(range->upper, range->lower);
+	for (len = strlen(range->upper); len > 1 && (unsigned char) range->upper[len - 1] == 0xff; --len) {
+	}
+	range->upper[len] = '\0';
+	++range->upper[len - 1];
 }
 
-struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
+/*! \brief A tree being read a page at a time */
+struct ast_db_cursor {
+	struct db_range range;
+	/*! The last key read, NULL before the first page */
+	char *last;
+	/*! Every page has been read */
+	unsigned int done:1;
+};
+
+/*!
+ * \internal
+ * \brief Read the next page of a cursor with prepared gettree statements
+ *
+ * \param db The connection the statements are for
+ * \param cursor The cursor
+ * \param first The statement for the first page
+ * \param next The statement for the pages after it
+ * \param count The most entries to read, -1 for all that are left
+ */
+static struct ast_db_entry *db_cursor_read_stmt(sqlite3 *db, struct ast_db_cursor *cursor,
+	sqlite3_stmt *first, sqlite3_stmt *next, int count)
 {
-	char prefix[MAX_DB_FIELD];
-	sqlite3_stmt *stmt = gettree_stmt;
+	sqlite3_stmt *stmt = first;
 	struct ast_db_entry *cur, *last = NULL, *ret = NULL;
-
-	if (!ast_strlen_zero(family)) {
-		if (!ast_strlen_zero(keytree)) {
-			/* Family and key tree */
-			snprintf(prefix, sizeof(prefix), "/%s/%s", family, keytree);
+	const char *lower = cursor->range.lower;
+	int param = 1;
+	int rows = 0;
+
+	if (cursor->last) {
+		if (cursor->range.all || strcmp(cursor->last, cursor->range.subtree) >= 0) {
+			stmt = next;
+			lower = cursor->last;
 		} else {
-			/* Family only */
-			snprintf(prefix, sizeof(prefix), "/%s", family);
+			/* Only the key of the tree itself has been read */
+			lower = cursor->range.subtree;
 		}
-	} else {
-		prefix[0] = '\0';
-		stmt = gettree_all_stmt;
 	}
 
-	ast_mutex_lock(&dblock);
-	if (!ast_strlen_zero(prefix) && (sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
+	if ((stmt == next || !cursor->range.all)
+		&& sqlite3_bind_text(stmt, param++, lower, -1, SQLITE_STATIC) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", lower, sqlite3_errmsg(db));
 		sqlite3_reset(stmt);
-		ast_mutex_unlock(&dblock);
+		cursor->done = 1;
+		return NULL;
+	}
+	if ((!cursor->range.all && (sqlite3_bind_text(stmt, param++, cursor->range.upper, -1, SQLITE_STATIC) != SQLITE_OK
+			|| (stmt == first && sqlite3_bind_text(stmt, param++, cursor->range.subtree, -1, SQLITE_STATIC) != SQLITE_OK)))
+		|| sqlite3_bind_int(stmt, param, count) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", cursor->range.lower, sqlite3_errmsg(db));
+		sqlite3_reset(stmt);
+		cursor->done = 1;
 		return NULL;
 	}
 
@@ -521,13 +1017,139 @@ struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 			ret = cur;
 		}
 		last = cur;
+		++rows;
 	}
 	sqlite3_reset(stmt);
+
+	if (count < 0 || rows < count) {
+		cursor->done = 1;
+	}
+	if (last) {
+		ast_free(cursor->last);
+		if (!(cursor->last = ast_strdup(last->key))) {
+			cursor->done = 1;
+		}
+	}
+
+	return ret;
+}
+
+/*!
+ * \internal
+ * \brief Read the next page of a cursor
+ *
+ * Only the reading of each page holds a lock, so a large tree does not hold
+ * up other users of the database while it is read.
+ */
+static struct ast_db_entry *db_cursor_read(struct ast_db_cursor *cursor, int count)
+{
+	struct db_reader *reader;
+	struct ast_db_entry *ret;
+
+	if (cursor->done) {
+		return NULL;
+	}
+
+	/* A reader would not see what the open transaction has changed */
+	if (!db_dirty && (reader = db_reader_get())) {
+		ret = db_cursor_read_stmt(reader->db, cursor,
+			cursor->range.all ? reader->gettree_all_stmt : reader->gettree_stmt,
+			cursor->range.all ? reader->gettree_all_next_stmt : reader->gettree_next_stmt, count);
+		db_reader_put(reader);
+		return ret;
+	}
+
+	ast_mutex_lock(&dblock);
+	ret = db_cursor_read_stmt(astdb, cursor,
+		cursor->range.all ? gettree_all_stmt : gettree_stmt,
+		cursor->range.all ? gettree_all_next_stmt : gettree_next_stmt, count);
+	ast_mutex_unlock(&dblock);
+
+	return ret;
+}
+
+int ast_db_deltree(const char *family, const char *keytree)
+{
+	sqlite3_stmt *stmt = deltree_stmt;
+	struct db_range range;
+	int res = 0;
+
+	db_range_init(&range, family, keytree, 0);
+	if (range.all) {
+		stmt = deltree_all_stmt;
+	}
+
+	ast_mutex_lock(&dblock);
+	if (!range.all && (sqlite3_bind_text(stmt, 1, range.lower, -1, SQLITE_STATIC) != SQLITE_OK
+		|| sqlite3_bind_text(stmt, 2, range.upper, -1, SQLITE_STATIC) != SQLITE_OK
+		|| sqlite3_bind_text(stmt, 3, range.subtree, -1, SQLITE_STATIC) != SQLITE_OK)) {
+		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", range.lower, sqlite3_errmsg(astdb));
+		res = -1;
+	} else if (sqlite3_step(stmt) != SQLITE_DONE) {
+		ast_log(LOG_WARNING, "Couldn't execute stmt: %s\n", sqlite3_errmsg(astdb));
+		res = -1;
+	}
+	res = sqlite3_changes(astdb);
+	sqlite3_reset(stmt);
+	/* The deleted keys are not known here */
+	db_cache_flush();
+	db_sync();
 	ast_mutex_unlock(&dblock);
 
+	return res;
+}
+
+struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
+{
+	struct ast_db_cursor cursor = { .last = NULL, };
+	struct ast_db_entry *ret;
+
+	db_range_init(&cursor.range, family, keytree, 0);
+	ret = db_cursor_read(&cursor, -1);
+	ast_free(cursor.last);
+
 	return ret;
 }
 
+static struct ast_db_cursor *db_cursor_alloc(const char *family, const char *keytree, int by_prefix)
+{
+	struct ast_db_cursor *cursor;
+
+	if (!ast_strlen_zero(keytree) && ast_strlen_zero(family)) {
+		return NULL;
+	}
+	if (!(cursor = ast_calloc(1, sizeof(*cursor)))) {
+		return NULL;
+	}
+	db_range_init(&cursor->range, family, keytree, by_prefix);
+
+	return cursor;
+}
+
+struct ast_db_cursor *ast_db_cursor_open(const char *family, const char *keytree)
+{
+	return db_cursor_alloc(family, keytree, 0);
+}
+
+struct ast_db_cursor *ast_db_cursor_open_by_prefix(const char *family, const char *key_prefix)
+{
+	return db_cursor_alloc(family, key_prefix, 1);
+}
+
+struct ast_db_entry *ast_db_cursor_next(struct ast_db_cursor *cursor, int count)
+{
+	return db_cursor_read(cursor, count);
+}
+
+void ast_db_cursor_close(struct ast_db_cursor *cursor)
+{
+	if (!cursor) {
+		return;
+	}
+	ast_free(cursor->last);
+	ast_free(cursor);
+}
+
 void ast_db_freetree(struct ast_db_entry *dbe)
 {
 	struct ast_db_entry *last;
@@ -657,9 +1279,10 @@ static char *handle_cli_database_deltree(struct ast_cli_entry *e, int cmd, struc
 
 static char *handle_cli_database_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	char prefix[MAX_DB_FIELD];
+	struct ast_db_cursor cursor = { .last = NULL, };
+	struct ast_db_entry *entries;
+	struct ast_db_entry *entry;
 	int counter = 0;
-	sqlite3_stmt *stmt = gettree_stmt;
 
 	switch (cmd) {
 	case CLI_INIT:
@@ -675,45 +1298,21 @@ static char *handle_cli_database_show(struct ast_cli_entry *e, int cmd, struct a
 		return NULL;
 	}
 
-	if (a->argc == 4) {
-		/* Family and key tree */
-		snprintf(prefix, sizeof(prefix), "/%s/%s", a->argv[2], a->argv[3]);
-	} else if (a->argc == 3) {
-		/* Family only */
-		snprintf(prefix, sizeof(prefix), "/%s", a->argv[2]);
-	} else if (a->argc == 2) {
-		/* Neither */
-		prefix[0] = '\0';
-		stmt = gettree_all_stmt;
-
-	} else {
+	if (a->argc > 4) {
 		return CLI_SHOWUSAGE;
 	}
 
-	ast_mutex_lock(&dblock);
-	if (!ast_strlen_zero(prefix) && (sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
-		sqlite3_reset(stmt);
-		ast_mutex_unlock(&dblock);
-		return NULL;
-	}
+	db_range_init(&cursor.range, a->argc > 2 ? a->argv[2] : NULL, a->argc > 3 ? a->argv[3] : NULL, 0);
 
-	while (sqlite3_step(stmt) == SQLITE_ROW) {
-		const char *key_s, *value_s;
-		if (!(key_s = (const char *) sqlite3_column_text(stmt, 0))) {
-			ast_log(LOG_WARNING, "Skipping invalid key!\n");
-			continue;
-		}
-		if (!(value_s = (const char *) sqlite3_column_text(stmt, 1))) {
-			ast_log(LOG_WARNING, "Skipping invalid value!\n");
-			continue;
+	/* A page at a time, so the database is not held while the CLI is written to */
+	while ((entries = db_cursor_read(&cursor, DB_CLI_PAGE))) {
+		for (entry = entries; entry; entry = entry->next) {
+			++counter;
+			ast_cli(a->fd, "%-50s: %-25s\n", entry->key, entry->data);
 		}
-		++counter;
-		ast_cli(a->fd, "%-50s: %-25s\n", key_s, value_s);
+		ast_db_freetree(entries);
 	}
-
-	sqlite3_reset(stmt);
-	ast_mutex_unlock(&dblock);
+	ast_free(cursor.last);
 
 	ast_cli(a->fd, "%d results found.\n", counter);
 	return CLI_SUCCESS;
@@ -797,6 +1396,7 @@ static char *handle_cli_database_query(struct ast_cli_entry *e, int cmd, struct
 
 	ast_mutex_lock(&dblock);
 	db_execute_sql(a->argv[2], display_results, a);
+	db_cache_flush(); /* It may have changed anything */
 	db_sync(); /* Go ahead and sync the db in case they write */
 	ast_mutex_unlock(&dblock);
 
@@ -942,6 +1542,7 @@ static int manager_dbdeltree(struct mansession *s, const struct message *m)
 static void db_sync(void)
 {
 	dosync = 1;
+	db_dirty = 1;
 	ast_cond_signal(&dbcond);
 }
 
@@ -970,7 +1571,12 @@ static void *db_sync_thread(void *data)
 		dosync = 0;
 		if (ast_db_commit_transaction()) {
 			ast_db_rollback_transaction();
+			db_cache_flush();
 		}
+		/* The readers now see all that has been written */
+		db_dirty = 0;
+		db_uncached = 0;
+		++db_tx;
 		if (doexit) {
 			ast_mutex_unlock(&dblock);
 			break;
@@ -990,6 +1596,8 @@ static void *db_sync_thread(void *data)
  */
 static void astdb_atexit(void)
 {
+	int i;
+
 	ast_cli_unregister_multiple(cli_database, ARRAY_LEN(cli_database));
 	ast_manager_unregister("DBGet");
 	ast_manager_unregister("DBPut");
@@ -1005,6 +1613,12 @@ static void astdb_atexit(void)
 
 	pthread_join(syncthread, NULL);
 	ast_mutex_lock(&dblock);
+	for (i = 0; i < num_readers; ++i) {
+		ast_mutex_lock(&readers[i].lock);
+		db_reader_close(&readers[i]);
+		ast_mutex_unlock(&readers[i].lock);
+	}
+	num_readers = 0;
 	clean_statements();
 	if (sqlite3_close(astdb) == SQLITE_OK) {
 		astdb = NULL;
@@ -87,6 +87,13 @@
  *	changes for the object. For manager, this results
  *	in events. For SIP, NOTIFY requests.
  *
+ *	A device is processed at most once per devstate_coalesce
+ *	milliseconds, set in asterisk.conf; changes queued while
+ *	it waits replace each other, so a flapping device is
+ *	published once with its latest state.
+ *	A cachable state that has not changed since it was last
+ *	published is not published again.
+ *
  *	- Device states
  *		\arg \ref devicestate.c
  *		\arg \ref devicestate.h
@@ -156,9 +163,16 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/astobj2.h"
 #include "asterisk/stasis.h"
 #include "asterisk/devicestate.h"
+#include "asterisk/heap.h"
+#include "asterisk/config.h"
 
 #define DEVSTATE_TOPIC_BUCKETS 57
 
+/*! \brief Milliseconds a device with no changes is remembered for */
+#define DEVSTATE_FORGET_MS 60000
+
+#define STATE_CHANGE_BUCKETS 563
+
 /*! \brief Device state strings for printing */
 static const char * const devstatestring[][2] = {
 	{ /* 0 AST_DEVICE_UNKNOWN */     "Unknown",     "UNKNOWN"     }, /*!< Valid, but unknown state */
@@ -199,15 +213,35 @@ struct devstate_prov {
 /*! \brief A list of providers */
 static AST_RWLIST_HEAD_STATIC(devstate_provs, devstate_prov);
 
+/*! \brief The changes to a device, and when it was last processed */
 struct state_change {
-	AST_LIST_ENTRY(state_change) list;
+	/*! The latest state given, or AST_DEVICE_UNKNOWN to ask the provider */
+	enum ast_device_state state;
 	enum ast_devstate_cache cachable;
-	char device[1];
+	/*! The cachable state last published, or AST_DEVICE_TOTAL. Only used by the change thread. */
+	enum ast_device_state published;
+	/*! When the change is processed */
+	struct timeval due;
+	/*! When a change was last processed */
+	struct timeval last;
+	/*! Whether a change is waiting to be processed */
+	unsigned int queued:1;
+	ssize_t __heap_index;
+	char device[0];
 };
 
-/*! \brief The state change queue. State changes are queued
+/*! \brief The devices changed, by name. State changes are queued
 	for processing by a separate thread */
-static AST_LIST_HEAD_STATIC(state_changes, state_change);
+static struct ao2_container *state_changes;
+
+/*! \brief The devices with a change queued, the soonest due first */
+static struct ast_heap *state_change_queue;
+
+/*! \brief Protects \ref state_changes and \ref state_change_queue */
+AST_MUTEX_DEFINE_STATIC(change_lock);
+
+/*! \brief Milliseconds within which changes to one device are coalesced */
+static int devstate_coalesce;
 
 /*! \brief The device state change notification thread */
 static pthread_t change_thread = AST_PTHREADT_NULL;
@@ -475,10 +509,112 @@ static void do_state_change(const char *device, enum ast_devstate_cache cachable
 	ast_publish_device_state(device, state, cachable);
 }
 
-int ast_devstate_changed_literal(enum ast_device_state state, enum ast_devstate_cache cachable, const char *device)
+static int state_change_hash(const void *obj, const int flags)
+{
+	const struct state_change *change;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		change = obj;
+		key = change->device;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int state_change_cmp(void *obj, void *arg, int flags)
+{
+	const struct state_change *change = obj;
+	const struct state_change *right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->device;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(change->device, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+/*! \brief Order the queue soonest first */
+static int state_change_due_cmp(void *elm1, void *elm2)
+{
+	const struct state_change *change1 = elm1;
+	const struct state_change *change2 = elm2;
+
+	return -ast_tvcmp(change1->due, change2->due);
+}
+
+static int state_change_forget_cb(void *obj, void *arg, int flags)
+{
+	const struct state_change *change = obj;
+
+	return !change->queued && ast_tvdiff_ms(*(struct timeval *) arg, change->last) >= DEVSTATE_FORGET_MS
+		? CMP_MATCH : 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue a change to a device, or coalesce it with the one queued
+ *
+ * \note change_lock must be held.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the change could not be queued.
+ */
+static int state_change_queue_add(enum ast_device_state state, enum ast_devstate_cache cachable, const char *device)
 {
 	struct state_change *change;
 
+	change = ao2_find(state_changes, device, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!change) {
+		change = ao2_alloc_options(sizeof(*change) + strlen(device) + 1, NULL,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!change) {
+			return -1;
+		}
+		strcpy(change->device, device); /* Safe */
+		change->published = AST_DEVICE_TOTAL;
+		if (!ao2_link_flags(state_changes, change, OBJ_NOLOCK)) {
+			ao2_ref(change, -1);
+			return -1;
+		}
+	}
+
+	/* The latest change replaces any still waiting */
+	change->state = state;
+	change->cachable = cachable;
+
+	if (!change->queued) {
+		change->due = ast_tvadd(change->last, ast_samp2tv(devstate_coalesce, 1000));
+		/* The queue keeps the reference */
+		if (ast_heap_push(state_change_queue, change)) {
+			ao2_ref(change, -1);
+			return -1;
+		}
+		change->queued = 1;
+		ast_cond_signal(&change_pending);
+	} else {
+		ao2_ref(change, -1);
+	}
+
+	return 0;
+}
+
+int ast_devstate_changed_literal(enum ast_device_state state, enum ast_devstate_cache cachable, const char *device)
+{
+	int res = -1;
+
 	/*
 	 * If we know the state change (how nice of the caller of this function!)
 	 * then we can just generate a device state event.
@@ -493,22 +629,24 @@ int ast_devstate_changed_literal(enum ast_device_state state, enum ast_devstate_
 	 *     state callback, then we will look through the channel list to
 	 *     see if we can determine a state based on active calls.
 	 *   - Once a state has been determined, a device state event is generated.
+	 *
+	 * Either way the change is queued, so that changes to a device within
+	 * devstate_coalesce milliseconds of each other are published once.
 	 */
 
-	if (state != AST_DEVICE_UNKNOWN) {
-		ast_publish_device_state(device, state, cachable);
-	} else if (change_thread == AST_PTHREADT_NULL || !(change = ast_calloc(1, sizeof(*change) + strlen(device)))) {
-		/* we could not allocate a change struct, or */
+	if (change_thread != AST_PTHREADT_NULL) {
+		ast_mutex_lock(&change_lock);
+		res = state_change_queue_add(state, cachable, device);
+		ast_mutex_unlock(&change_lock);
+	}
+	if (res) {
+		/* we could not queue the change, or */
 		/* there is no background thread, so process the change now */
-		do_state_change(device, cachable);
-	} else {
-		/* queue the change */
-		strcpy(change->device, device);
-		change->cachable = cachable;
-		AST_LIST_LOCK(&state_changes);
-		AST_LIST_INSERT_TAIL(&state_changes, change, list);
-		ast_cond_signal(&change_pending);
-		AST_LIST_UNLOCK(&state_changes);
+		if (state != AST_DEVICE_UNKNOWN) {
+			ast_publish_device_state(device, state, cachable);
+		} else {
+			do_state_change(device, cachable);
+		}
 	}
 
 	return 0;
@@ -543,27 +681,94 @@ int ast_device_state_changed(const char *fmt, ...)
 	return ast_devstate_changed_literal(AST_DEVICE_UNKNOWN, AST_DEVSTATE_CACHABLE, buf);
 }
 
+/*!
+ * \internal
+ * \brief Publish the state of a device taken off the queue
+ *
+ * \note Only called by the change thread.
+ */
+static void state_change_process(struct state_change *change, enum ast_device_state state,
+	enum ast_devstate_cache cachable)
+{
+	struct stasis_message *cached_msg;
+	int unchanged = 0;
+
+	if (state == AST_DEVICE_UNKNOWN) {
+		state = _ast_device_state(change->device, 0);
+	}
+
+	if (cachable == AST_DEVSTATE_CACHABLE && state == change->published) {
+		/* Only skip it if the cache agrees, in case it was cleared or published to since */
+		cached_msg = stasis_cache_get_by_eid(ast_device_state_cache(),
+			ast_device_state_message_type(), change->device, &ast_eid_default);
+		if (cached_msg) {
+			struct ast_device_state_message *device_state = stasis_message_data(cached_msg);
+
+			unchanged = device_state->state == state;
+			ao2_ref(cached_msg, -1);
+		}
+	}
+	change->published = cachable == AST_DEVSTATE_CACHABLE ? state : AST_DEVICE_TOTAL;
+
+	if (unchanged) {
+		ast_debug(4, "State for %s is still %u (%s)\n", change->device, state, ast_devstate2str(state));
+		return;
+	}
+
+	ast_debug(3, "Changing state for %s - state %u (%s)\n", change->device, state, ast_devstate2str(state));
+
+	ast_publish_device_state(change->device, state, cachable);
+}
+
 /*! \brief Go through the dev state change queue and update changes in the dev state thread */
 static void *do_devstate_changes(void *data)
 {
-	struct state_change *next, *current;
+	struct state_change *change;
+	enum ast_device_state state;
+	enum ast_devstate_cache cachable;
+	struct timeval forgotten = ast_tvnow();
+	struct timeval now;
+	struct timespec due;
 
+	ast_mutex_lock(&change_lock);
 	for (;;) {
-		/* This basically pops off any state change entries, resets the list back to NULL, unlocks, and processes each state change */
-		AST_LIST_LOCK(&state_changes);
-		if (AST_LIST_EMPTY(&state_changes))
-			ast_cond_wait(&change_pending, &state_changes.lock);
-		next = AST_LIST_FIRST(&state_changes);
-		AST_LIST_HEAD_INIT_NOLOCK(&state_changes);
-		AST_LIST_UNLOCK(&state_changes);
-
-		/* Process each state change */
-		while ((current = next)) {
-			next = AST_LIST_NEXT(current, list);
-			do_state_change(current->device, current->cachable);
-			ast_free(current);
+		now = ast_tvnow();
+		if (ast_tvdiff_ms(now, forgotten) >= DEVSTATE_FORGET_MS) {
+			/* Forget the devices that have not changed for a while */
+			ao2_callback(state_changes, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE,
+				state_change_forget_cb, &now);
+			forgotten = now;
+		}
+
+		change = ast_heap_peek(state_change_queue, 1);
+		if (!change) {
+			due.tv_sec = now.tv_sec + DEVSTATE_FORGET_MS / 1000;
+			due.tv_nsec = now.tv_usec * 1000;
+			ast_cond_timedwait(&change_pending, &change_lock, &due);
+			continue;
+		}
+		if (ast_tvcmp(change->due, now) > 0) {
+			/* Let more changes to it coalesce */
+			due.tv_sec = change->due.tv_sec;
+			due.tv_nsec = change->due.tv_usec * 1000;
+			ast_cond_timedwait(&change_pending, &change_lock, &due);
+			continue;
 		}
+
+		/* Take the reference the queue had */
+		ast_heap_pop(state_change_queue);
+		change->queued = 0;
+		change->last = now;
+		state = change->state;
+		cachable = change->cachable;
+		ast_mutex_unlock(&change_lock);
+
+		state_change_process(change, state, cachable);
+		ao2_ref(change, -1);
+
+		ast_mutex_lock(&change_lock);
 	}
+	ast_mutex_unlock(&change_lock);
 
 	return NULL;
 }
@@ -629,6 +834,28 @@ static void devstate_change_cb(void *data, struct stasis_subscription *sub, stru
 /*! \brief Initialize the device state engine in separate thread */
 int ast_device_state_engine_init(void)
 {
+	struct ast_flags config_flags = { 0 };
+	struct ast_config *cfg;
+	const char *coalesce;
+
+	if ((cfg = ast_config_load2("asterisk.conf", "" /* core can't reload */, config_flags))
+		&& cfg != CONFIG_STATUS_FILEINVALID) {
+		if ((coalesce = ast_variable_retrieve(cfg, "options", "devstate_coalesce"))
+			&& (sscanf(coalesce, "%30d", &devstate_coalesce) != 1 || devstate_coalesce < 0)) {
+			ast_log(LOG_WARNING, "Invalid devstate_coalesce '%s', not coalescing device state changes\n", coalesce);
+			devstate_coalesce = 0;
+		}
+		ast_config_destroy(cfg);
+	}
+
+	state_changes = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, STATE_CHANGE_BUCKETS,
+		state_change_hash, state_change_cmp);
+	state_change_queue = ast_heap_create(8, state_change_due_cmp, -1);
+	if (!state_changes || !state_change_queue) {
+		ast_log(LOG_ERROR, "Unable to allocate the device state change queue.\n");
+		return -1;
+	}
+
 	ast_cond_init(&change_pending, NULL);
 	if (ast_pthread_create_background(&change_thread, NULL, do_devstate_changes, NULL) < 0) {
 		ast_log(LOG_ERROR, "Unable to start device state change thread.\n");
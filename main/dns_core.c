@@ -35,6 +35,9 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/astobj2.h"
 #include "asterisk/strings.h"
 #include "asterisk/sched.h"
+#include "asterisk/cli.h"
+#include "asterisk/config.h"
+#include "asterisk/_private.h"
 #include "asterisk/dns_core.h"
 #include "asterisk/dns_srv.h"
 #include "asterisk/dns_tlsa.h"
@@ -228,6 +231,7 @@ struct ast_dns_query *dns_query_alloc(const char *name, int rr_type, int rr_clas
 	query->user_data = ao2_bump(data);
 	query->rr_type = rr_type;
 	query->rr_class = rr_class;
+	query->cache_sched = -1;
 	strcpy(query->name, name); /* SAFE */
 
 	AST_RWLIST_RDLOCK(&resolvers);
@@ -244,6 +248,407 @@ struct ast_dns_query *dns_query_alloc(const char *name, int rr_type, int rr_clas
 	return query;
 }
 
+/*!
+ * \brief Results of DNS queries, by name, type and class
+ *
+ * With dns_cache_size set in asterisk.conf the results of queries are kept
+ * for as long as their records live, and results with no records for
+ * dns_cache_negative_ttl seconds, so queries for the same thing are answered
+ * without going to the resolver. A query for something already being
+ * resolved waits for that resolution rather than starting its own.
+ *
+ * Each entry has a query of its own that goes to the resolver. Once it is
+ * answered the result is copied into each query waiting, with the TTLs of
+ * its records lowered by the time it was kept.
+ */
+static struct ao2_container *dns_cache;
+
+/*! \brief Entries the DNS cache may hold, from asterisk.conf; 0 disables the cache */
+static int dns_cache_size;
+
+/*! \brief Seconds results with no records are kept */
+static int dns_cache_negative_ttl = 30;
+
+/*! \brief Most seconds any result is kept */
+static int dns_cache_max_ttl = 3600;
+
+/*! \brief How well the DNS cache does, protected by its container lock */
+static struct {
+	unsigned int hits;		/*!< Queries answered from the cache */
+	unsigned int negative_hits;	/*!< Of those, with a result with no records */
+	unsigned int coalesced;		/*!< Queries that waited for an identical one */
+	unsigned int misses;		/*!< Queries that went to the resolver */
+} dns_cache_stats;
+
+/*! \brief A name, type and class resolved or being resolved */
+struct dns_cache_entry {
+	/*! \brief The query sent to the resolver, until it is answered */
+	struct ast_dns_query *query;
+	/*! \brief The result, once answered; NULL if resolution failed */
+	struct ast_dns_result *result;
+	/*! \brief When the result is no longer used */
+	struct timeval expires;
+	/*! \brief Whether the query has been answered */
+	unsigned int completed;
+	/*! \brief Queries waiting for the answer */
+	AST_VECTOR(, struct ast_dns_query *) waiters;
+	int rr_type;
+	int rr_class;
+	char name[0];
+};
+
+/*! \brief The key of an entry in the DNS cache */
+struct dns_cache_key {
+	const char *name;
+	int rr_type;
+	int rr_class;
+};
+
+static int dns_cache_hash_fn(const void *obj, const int flags)
+{
+	const struct dns_cache_entry *entry;
+	const struct dns_cache_key *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		return ast_str_case_hash(key->name) + key->rr_type;
+	case OBJ_SEARCH_OBJECT:
+		entry = obj;
+		return ast_str_case_hash(entry->name) + entry->rr_type;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+}
+
+static int dns_cache_cmp_fn(void *obj, void *arg, int flags)
+{
+	const struct dns_cache_entry *entry = obj;
+	const struct dns_cache_entry *right;
+	const struct dns_cache_key *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = arg;
+		return entry->rr_type == key->rr_type && entry->rr_class == key->rr_class
+			&& !strcasecmp(entry->name, key->name) ? CMP_MATCH : 0;
+	case OBJ_SEARCH_OBJECT:
+		right = arg;
+		return entry->rr_type == right->rr_type && entry->rr_class == right->rr_class
+			&& !strcasecmp(entry->name, right->name) ? CMP_MATCH : 0;
+	default:
+		return 0;
+	}
+}
+
+static void dns_cache_entry_destroy(void *obj)
+{
+	struct dns_cache_entry *entry = obj;
+
+	ao2_cleanup(entry->query);
+	ast_dns_result_free(entry->result);
+	AST_VECTOR_CALLBACK_VOID(&entry->waiters, ao2_cleanup);
+	AST_VECTOR_FREE(&entry->waiters);
+}
+
+/*! \brief Whether a result has no records to return */
+static int dns_result_negative(const struct ast_dns_result *result)
+{
+	return result->rcode == ns_r_nxdomain || !ast_dns_result_get_records(result);
+}
+
+/*!
+ * \internal
+ * \brief Give a query a copy of a result from the cache, and complete it
+ */
+static void dns_cache_complete(struct ast_dns_query *query, const struct ast_dns_result *result,
+	struct timeval expires)
+{
+	const struct ast_dns_record *record;
+	int remaining;
+
+	ast_dns_result_free(query->result);
+	query->result = NULL;
+
+	if (result && !ast_dns_resolver_set_result(query, result->secure, result->bogus, result->rcode,
+		result->canonical, result->answer, result->answer_size)) {
+		remaining = MAX(ast_tvdiff_ms(expires, ast_tvnow()) / 1000, 0);
+		for (record = ast_dns_result_get_records(result); record; record = ast_dns_record_get_next(record)) {
+			ast_dns_resolver_add_record(query, record->rr_type, record->rr_class,
+				MIN(record->ttl, remaining), record->data_ptr, record->data_len);
+		}
+	}
+
+	ast_dns_resolver_completed(query);
+}
+
+/*! \brief Callback for the query of a cache entry, giving the result to the queries waiting */
+static void dns_cache_callback(const struct ast_dns_query *query)
+{
+	struct dns_cache_entry *entry = ast_dns_query_get_data(query);
+	struct ast_dns_query *waiter;
+	int ttl = 0;
+	int i;
+
+	ao2_lock(dns_cache);
+	entry->result = query->result;
+	((struct ast_dns_query *)query)->result = NULL;
+	entry->completed = 1;
+
+	if (entry->result) {
+		ttl = dns_result_negative(entry->result) ? dns_cache_negative_ttl
+			: MIN(ast_dns_result_get_lowest_ttl(entry->result), dns_cache_max_ttl);
+	}
+	entry->expires = ast_tvadd(ast_tvnow(), ast_samp2tv(ttl, 1));
+	if (!ttl) {
+		ao2_unlink_flags(dns_cache, entry, OBJ_NOLOCK);
+	}
+
+	/* The entry query refers back to the entry, which ends with it */
+	ao2_ref(entry->query, -1);
+	entry->query = NULL;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&entry->waiters); ++i) {
+		AST_VECTOR_GET(&entry->waiters, i)->cache_entry = NULL;
+	}
+	ao2_unlock(dns_cache);
+
+	/* No more are added once completed, so the waiters can be gone through unlocked */
+	while (AST_VECTOR_SIZE(&entry->waiters)) {
+		waiter = AST_VECTOR_REMOVE_UNORDERED(&entry->waiters, 0);
+		dns_cache_complete(waiter, entry->result, entry->expires);
+		ao2_ref(waiter, -1);
+	}
+}
+
+/*! \brief Scheduler callback giving a query a result found in the cache */
+static int dns_cache_deliver(const void *data)
+{
+	struct ast_dns_query *query = (struct ast_dns_query *)data;
+	struct dns_cache_entry *entry;
+
+	ao2_lock(dns_cache);
+	entry = query->cache_entry;
+	query->cache_entry = NULL;
+	query->cache_sched = -1;
+	ao2_unlock(dns_cache);
+
+	dns_cache_complete(query, entry->result, entry->expires);
+	ao2_ref(entry, -1);
+	ao2_ref(query, -1);
+
+	return 0;
+}
+
+static int dns_cache_expired_cb(void *obj, void *arg, int flags)
+{
+	struct dns_cache_entry *entry = obj;
+
+	return entry->completed && ast_tvcmp(entry->expires, *(struct timeval *)arg) <= 0 ? CMP_MATCH : 0;
+}
+
+static int dns_cache_earliest_cb(void *obj, void *arg, int flags)
+{
+	struct dns_cache_entry *entry = obj;
+	struct dns_cache_entry **earliest = arg;
+
+	if (entry->completed && (!*earliest || ast_tvcmp(entry->expires, (*earliest)->expires) < 0)) {
+		*earliest = entry;
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Make room for another entry in the DNS cache
+ *
+ * \pre The cache is locked
+ *
+ * \retval 0 if there is room
+ * \retval -1 if every entry is still being resolved
+ */
+static int dns_cache_make_room(struct timeval now)
+{
+	struct dns_cache_entry *earliest = NULL;
+
+	if (ao2_container_count(dns_cache) < dns_cache_size) {
+		return 0;
+	}
+
+	ao2_callback(dns_cache, OBJ_NOLOCK | OBJ_UNLINK | OBJ_MULTIPLE | OBJ_NODATA,
+		dns_cache_expired_cb, &now);
+	if (ao2_container_count(dns_cache) < dns_cache_size) {
+		return 0;
+	}
+
+	ao2_callback(dns_cache, OBJ_NOLOCK | OBJ_NODATA, dns_cache_earliest_cb, &earliest);
+	if (!earliest) {
+		return -1;
+	}
+	ao2_unlink_flags(dns_cache, earliest, OBJ_NOLOCK);
+	return 0;
+}
+
+int dns_query_resolve(struct ast_dns_query *query)
+{
+	struct dns_cache_key key = { query->name, query->rr_type, query->rr_class, };
+	struct dns_cache_entry *entry;
+	struct ast_dns_query *entry_query;
+	struct timeval now;
+
+	if (!dns_cache) {
+		return query->resolver->resolve(query);
+	}
+
+	now = ast_tvnow();
+
+	ao2_lock(dns_cache);
+	entry = ao2_find(dns_cache, &key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (entry && entry->completed && ast_tvcmp(entry->expires, now) <= 0) {
+		ao2_unlink_flags(dns_cache, entry, OBJ_NOLOCK);
+		ao2_ref(entry, -1);
+		entry = NULL;
+	}
+
+	if (entry && entry->completed) {
+		/* Delivered from the scheduler, as the callback may not be invoked before this returns */
+		query->cache_entry = entry;
+		query->cache_sched = ast_sched_add(sched, 0, dns_cache_deliver, ao2_bump(query));
+		if (query->cache_sched < 0) {
+			query->cache_entry = NULL;
+			ao2_unlock(dns_cache);
+			ao2_ref(query, -1);
+			ao2_ref(entry, -1);
+			return -1;
+		}
+		query->cached = 1;
+		dns_cache_stats.hits++;
+		if (!entry->result || dns_result_negative(entry->result)) {
+			dns_cache_stats.negative_hits++;
+		}
+		ao2_unlock(dns_cache);
+		return 0;
+	} else if (entry) {
+		if (AST_VECTOR_APPEND(&entry->waiters, query)) {
+			ao2_unlock(dns_cache);
+			ao2_ref(entry, -1);
+			return -1;
+		}
+		ao2_ref(query, +1);
+		query->cache_entry = entry;
+		query->cached = 1;
+		dns_cache_stats.coalesced++;
+		ao2_unlock(dns_cache);
+		ao2_ref(entry, -1);
+		return 0;
+	}
+
+	dns_cache_stats.misses++;
+	if (dns_cache_make_room(now)) {
+		ao2_unlock(dns_cache);
+		return query->resolver->resolve(query);
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + strlen(query->name) + 1, dns_cache_entry_destroy,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		ao2_unlock(dns_cache);
+		return -1;
+	}
+	entry->rr_type = query->rr_type;
+	entry->rr_class = query->rr_class;
+	strcpy(entry->name, query->name); /* SAFE */
+
+	entry->query = dns_query_alloc(query->name, query->rr_type, query->rr_class, dns_cache_callback, entry);
+	if (!entry->query || AST_VECTOR_INIT(&entry->waiters, 2)
+		|| AST_VECTOR_APPEND(&entry->waiters, query)) {
+		ao2_unlock(dns_cache);
+		/* The entry query refers back to the entry */
+		ao2_cleanup(entry->query);
+		entry->query = NULL;
+		ao2_ref(entry, -1);
+		return -1;
+	}
+	ao2_ref(query, +1);
+	entry->query->resolver = query->resolver;
+	query->cache_entry = entry;
+	query->cached = 1;
+	ao2_link_flags(dns_cache, entry, OBJ_NOLOCK);
+	entry_query = ao2_bump(entry->query);
+	ao2_unlock(dns_cache);
+
+	/* The resolver may answer before returning, so the cache can not stay locked */
+	if (entry_query->resolver->resolve(entry_query)) {
+		/* Any query that joined meanwhile gets the failure the usual way */
+		ao2_lock(dns_cache);
+		ao2_unlink_flags(dns_cache, entry, OBJ_NOLOCK);
+		AST_VECTOR_REMOVE_CMP_UNORDERED(&entry->waiters, query, AST_VECTOR_ELEM_DEFAULT_CMP, ao2_cleanup);
+		query->cache_entry = NULL;
+		query->cached = 0;
+		ao2_unlock(dns_cache);
+		dns_cache_callback(entry_query);
+		ao2_ref(entry_query, -1);
+		ao2_ref(entry, -1);
+		return -1;
+	}
+
+	ao2_ref(entry_query, -1);
+	ao2_ref(entry, -1);
+	return 0;
+}
+
+int dns_query_cancel(struct ast_dns_query *query)
+{
+	struct dns_cache_entry *entry;
+	int id;
+
+	if (!query->cached) {
+		return query->resolver->cancel(query);
+	}
+
+	ao2_lock(dns_cache);
+	id = query->cache_sched;
+	entry = query->cache_entry;
+	if (id < 0 && entry) {
+		/* Still waiting for the resolver, which carries on for the others and the cache */
+		AST_VECTOR_REMOVE_CMP_UNORDERED(&entry->waiters, query, AST_VECTOR_ELEM_DEFAULT_CMP, ao2_cleanup);
+		query->cache_entry = NULL;
+		ao2_unlock(dns_cache);
+		return 0;
+	}
+	ao2_unlock(dns_cache);
+
+	/* The delivery takes the cache lock, and deleting it waits for a delivery running */
+	if (id < 0 || ast_sched_del(sched, id)) {
+		/* Already answered */
+		return -1;
+	}
+
+	ao2_lock(dns_cache);
+	entry = query->cache_entry;
+	query->cache_entry = NULL;
+	query->cache_sched = -1;
+	ao2_unlock(dns_cache);
+	ao2_cleanup(entry);
+	ao2_ref(query, -1);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Forget all the results in the DNS cache
+ *
+ * Queries still being resolved are answered, but their results not kept.
+ */
+static void dns_cache_flush(void)
+{
+	if (dns_cache) {
+		ao2_callback(dns_cache, OBJ_UNLINK | OBJ_MULTIPLE | OBJ_NODATA, NULL, NULL);
+	}
+}
+
 struct ast_dns_query_active *ast_dns_resolve_async(const char *name, int rr_type, int rr_class, ast_dns_resolve_callback callback, void *data)
 {
 	struct ast_dns_query_active *active;
@@ -259,7 +664,7 @@ struct ast_dns_query_active *ast_dns_resolve_async(const char *name, int rr_type
 		return NULL;
 	}
 
-	if (active->query->resolver->resolve(active->query)) {
+	if (dns_query_resolve(active->query)) {
 		ast_log(LOG_ERROR, "Resolver '%s' returned an error when resolving '%s' of class '%d' and type '%d'\n",
 			active->query->resolver->name, name, rr_class, rr_type);
 		ao2_ref(active, -1);
@@ -271,7 +676,7 @@ struct ast_dns_query_active *ast_dns_resolve_async(const char *name, int rr_type
 
 int ast_dns_resolve_cancel(struct ast_dns_query_active *active)
 {
-	return active->query->resolver->cancel(active->query);
+	return dns_query_cancel(active->query);
 }
 
 /*! \brief Structure used for signaling back for synchronous resolution completion */
@@ -601,6 +1006,9 @@ int ast_dns_resolver_register(struct ast_dns_resolver *resolver)
 
 	AST_RWLIST_UNLOCK(&resolvers);
 
+	/* Results may differ from those of the resolver used before */
+	dns_cache_flush();
+
 	ast_verb(2, "Registered DNS resolver '%s' with priority '%d'\n", resolver->name, resolver->priority);
 
 	return 0;
@@ -624,9 +1032,129 @@ void ast_dns_resolver_unregister(struct ast_dns_resolver *resolver)
 	AST_RWLIST_TRAVERSE_SAFE_END;
 	AST_RWLIST_UNLOCK(&resolvers);
 
+	dns_cache_flush();
+
 	ast_verb(2, "Unregistered DNS resolver '%s'\n", resolver->name);
 }
 
+static char *handle_cli_dns_cache_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "dns cache show";
+		e->usage =
+			"Usage: dns cache show\n"
+			"   Show how many DNS results are cached, and how well the\n"
+			"   cache does.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!dns_cache) {
+		ast_cli(a->fd, "DNS results are not cached.\n");
+		return CLI_SUCCESS;
+	}
+
+	ao2_lock(dns_cache);
+	ast_cli(a->fd, "Entries:       %d of %d\n", ao2_container_count(dns_cache), dns_cache_size);
+	ast_cli(a->fd, "Hits:          %u (%u negative)\n", dns_cache_stats.hits, dns_cache_stats.negative_hits);
+	ast_cli(a->fd, "Coalesced:     %u\n", dns_cache_stats.coalesced);
+	ast_cli(a->fd, "Misses:        %u\n", dns_cache_stats.misses);
+	if (dns_cache_stats.hits + dns_cache_stats.coalesced + dns_cache_stats.misses) {
+		ast_cli(a->fd, "Hit rate:      %.1f%%\n", 100.0 * (dns_cache_stats.hits + dns_cache_stats.coalesced)
+			/ (dns_cache_stats.hits + dns_cache_stats.coalesced + dns_cache_stats.misses));
+	}
+	ao2_unlock(dns_cache);
+
+	return CLI_SUCCESS;
+}
+
+static char *handle_cli_dns_cache_flush(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "dns cache flush";
+		e->usage =
+			"Usage: dns cache flush\n"
+			"   Drop the DNS results kept by the cache, and reset its\n"
+			"   statistics.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!dns_cache) {
+		ast_cli(a->fd, "DNS results are not cached.\n");
+		return CLI_SUCCESS;
+	}
+
+	dns_cache_flush();
+	ao2_lock(dns_cache);
+	memset(&dns_cache_stats, 0, sizeof(dns_cache_stats));
+	ao2_unlock(dns_cache);
+	ast_cli(a->fd, "Flushed the DNS cache.\n");
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_dns[] = {
+	AST_CLI_DEFINE(handle_cli_dns_cache_show, "Show the DNS cache statistics"),
+	AST_CLI_DEFINE(handle_cli_dns_cache_flush, "Flush the DNS cache"),
+};
+
+static void dns_core_shutdown(void)
+{
+	ast_cli_unregister_multiple(cli_dns, ARRAY_LEN(cli_dns));
+	dns_cache_flush();
+}
+
+int ast_dns_core_init(void)
+{
+	struct ast_flags config_flags = { 0 };
+	struct ast_config *cfg;
+	const char *value;
+
+	if ((cfg = ast_config_load2("asterisk.conf", "" /* core can't reload */, config_flags))
+		&& cfg != CONFIG_STATUS_FILEINVALID) {
+		if ((value = ast_variable_retrieve(cfg, "options", "dns_cache_size"))
+			&& (sscanf(value, "%30d", &dns_cache_size) != 1 || dns_cache_size < 0)) {
+			ast_log(LOG_WARNING, "Invalid dns_cache_size '%s', not caching DNS results\n", value);
+			dns_cache_size = 0;
+		}
+		if ((value = ast_variable_retrieve(cfg, "options", "dns_cache_negative_ttl"))
+			&& (sscanf(value, "%30d", &dns_cache_negative_ttl) != 1 || dns_cache_negative_ttl < 0)) {
+			ast_log(LOG_WARNING, "Invalid dns_cache_negative_ttl '%s', using 30\n", value);
+			dns_cache_negative_ttl = 30;
+		}
+		if ((value = ast_variable_retrieve(cfg, "options", "dns_cache_max_ttl"))
+			&& (sscanf(value, "%30d", &dns_cache_max_ttl) != 1 || dns_cache_max_ttl < 0)) {
+			ast_log(LOG_WARNING, "Invalid dns_cache_max_ttl '%s', using 3600\n", value);
+			dns_cache_max_ttl = 3600;
+		}
+		ast_config_destroy(cfg);
+	}
+
+	/* The cache is never freed, as queries may still be completing at shutdown */
+	if (dns_cache_size && !(dns_cache = ao2_container_alloc(dns_cache_size < 1000 ? 61 : 563,
+		dns_cache_hash_fn, dns_cache_cmp_fn))) {
+		return -1;
+	}
+
+	ast_cli_register_multiple(cli_dns, ARRAY_LEN(cli_dns));
+	ast_register_cleanup(dns_core_shutdown);
+
+	return 0;
+}
+
 char *dns_find_record(const char *record, size_t record_size, const char *response, size_t response_size)
 {
 	size_t remaining_size = response_size;
@@ -188,7 +188,7 @@ void ast_dns_query_set_resolve_async(struct ast_dns_query_set *query_set, ast_dn
 
 		query->query->user_data = ao2_bump(query_set);
 
-		if (!query->query->resolver->resolve(query->query)) {
+		if (!dns_query_resolve(query->query)) {
 			query->started = 1;
 			continue;
 		}
@@ -273,7 +273,7 @@ int ast_dns_query_set_resolve_cancel(struct ast_dns_query_set *query_set)
 		struct dns_query_set_query *query = AST_VECTOR_GET_ADDR(&query_set->queries, idx);
 
 		if (query->started) {
-			if (!query->query->resolver->cancel(query->query)) {
+			if (!dns_query_cancel(query->query)) {
 				query_set->queries_cancelled++;
 				dns_query_set_callback(query->query);
 			}
@@ -361,6 +361,311 @@ static inline void goertzel_reset(goertzel_state_t *s)
 	s->v2 = s->v3 = s->chunky = 0.0;
 }
 
+/*! \brief The most goertzels a bank kernel updates at once */
+#define GOERTZEL_BANK_MAX 8
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+/*
+ * The bank kernels run one goertzel in each vector lane, doing exactly the
+ * integer arithmetic of goertzel_sample() so the results are the same. The
+ * shift by chunky is masked to 5 bits, as the x86 and AArch64 scalar shifts
+ * do, for runaway inputs that would otherwise shift by 32 or more.
+ */
+
+#ifdef DSP_X86_KERNELS
+__attribute__((target("avx2")))
+static void goertzel_bank_avx2(goertzel_state_t * const *bank, int count, const int16_t *amp, int samples)
+{
+	int v2s[GOERTZEL_BANK_MAX] = { 0, };
+	int v3s[GOERTZEL_BANK_MAX] = { 0, };
+	int chunkys[GOERTZEL_BANK_MAX] = { 0, };
+	int facs[GOERTZEL_BANK_MAX] = { 0, };
+	const __m256i limit = _mm256_set1_epi32(32768);
+	const __m256i shift_mask = _mm256_set1_epi32(31);
+	__m256i v2;
+	__m256i v3;
+	__m256i chunky;
+	__m256i fac;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		v2s[i] = bank[i]->v2;
+		v3s[i] = bank[i]->v3;
+		chunkys[i] = bank[i]->chunky;
+		facs[i] = bank[i]->fac;
+	}
+	v2 = _mm256_loadu_si256((const __m256i *) v2s);
+	v3 = _mm256_loadu_si256((const __m256i *) v3s);
+	chunky = _mm256_loadu_si256((const __m256i *) chunkys);
+	fac = _mm256_loadu_si256((const __m256i *) facs);
+
+	for (i = 0; i < samples; i++) {
+		__m256i sample = _mm256_srav_epi32(_mm256_set1_epi32(amp[i]), _mm256_and_si256(chunky, shift_mask));
+		__m256i v1 = v2;
+		__m256i over;
+
+		v2 = v3;
+		v3 = _mm256_srai_epi32(_mm256_mullo_epi32(fac, v2), 15);
+		v3 = _mm256_add_epi32(_mm256_sub_epi32(v3, v1), sample);
+		over = _mm256_cmpgt_epi32(_mm256_abs_epi32(v3), limit);
+		/* Rescaling is rare, so skip the blends when no lane needs it */
+		if (!_mm256_testz_si256(over, over)) {
+			chunky = _mm256_sub_epi32(chunky, over);
+			v3 = _mm256_blendv_epi8(v3, _mm256_srai_epi32(v3, 1), over);
+			v2 = _mm256_blendv_epi8(v2, _mm256_srai_epi32(v2, 1), over);
+		}
+	}
+
+	_mm256_storeu_si256((__m256i *) v2s, v2);
+	_mm256_storeu_si256((__m256i *) v3s, v3);
+	_mm256_storeu_si256((__m256i *) chunkys, chunky);
+	for (i = 0; i < count; i++) {
+		bank[i]->v2 = v2s[i];
+		bank[i]->v3 = v3s[i];
+		bank[i]->chunky = chunkys[i];
+	}
+}
+#endif /* DSP_X86_KERNELS */
+
+#ifdef DSP_NEON_KERNELS
+static void goertzel_bank_neon(goertzel_state_t * const *bank, int count, const int16_t *amp, int samples)
+{
+	int v2s[GOERTZEL_BANK_MAX] = { 0, };
+	int v3s[GOERTZEL_BANK_MAX] = { 0, };
+	int chunkys[GOERTZEL_BANK_MAX] = { 0, };
+	int facs[GOERTZEL_BANK_MAX] = { 0, };
+	const int32x4_t limit = vdupq_n_s32(32768);
+	const int32x4_t shift_mask = vdupq_n_s32(31);
+	int32x4_t v2[2];
+	int32x4_t v3[2];
+	int32x4_t chunky[2];
+	int32x4_t fac[2];
+	int i;
+	int h;
+
+	for (i = 0; i < count; i++) {
+		v2s[i] = bank[i]->v2;
+		v3s[i] = bank[i]->v3;
+		chunkys[i] = bank[i]->chunky;
+		facs[i] = bank[i]->fac;
+	}
+	for (h = 0; h < 2; h++) {
+		v2[h] = vld1q_s32(v2s + h * 4);
+		v3[h] = vld1q_s32(v3s + h * 4);
+		chunky[h] = vld1q_s32(chunkys + h * 4);
+		fac[h] = vld1q_s32(facs + h * 4);
+	}
+
+	for (i = 0; i < samples; i++) {
+		const int32x4_t sample = vdupq_n_s32(amp[i]);
+
+		for (h = 0; h < 2; h++) {
+			int32x4_t v1 = v2[h];
+			uint32x4_t over;
+
+			v2[h] = v3[h];
+			v3[h] = vshrq_n_s32(vmulq_s32(fac[h], v2[h]), 15);
+			/* A left shift by a negative count is an arithmetic right shift */
+			v3[h] = vaddq_s32(vsubq_s32(v3[h], v1),
+				vshlq_s32(sample, vnegq_s32(vandq_s32(chunky[h], shift_mask))));
+			over = vcgtq_s32(vabsq_s32(v3[h]), limit);
+			chunky[h] = vsubq_s32(chunky[h], vreinterpretq_s32_u32(over));
+			v3[h] = vbslq_s32(over, vshrq_n_s32(v3[h], 1), v3[h]);
+			v2[h] = vbslq_s32(over, vshrq_n_s32(v2[h], 1), v2[h]);
+		}
+	}
+
+	for (h = 0; h < 2; h++) {
+		vst1q_s32(v2s + h * 4, v2[h]);
+		vst1q_s32(v3s + h * 4, v3[h]);
+		vst1q_s32(chunkys + h * 4, chunky[h]);
+	}
+	for (i = 0; i < count; i++) {
+		bank[i]->v2 = v2s[i];
+		bank[i]->v3 = v3s[i];
+		bank[i]->chunky = chunkys[i];
+	}
+}
+#endif /* DSP_NEON_KERNELS */
+
+/*! \brief Samples summed between checks for an early finish in the energy kernels */
+#define ENERGY_CHUNK 64
+
+/*
+ * The energy kernels sum the magnitudes of a block of samples. Once the sum
+ * reaches limit they may stop and return what they have so far, which the
+ * callers use when they only need to know whether a threshold was reached.
+ */
+
+static int energy_c(const int16_t *s, int len, int limit)
+{
+	int accum = 0;
+	int x = 0;
+
+	while (x < len) {
+		int end = MIN(x + ENERGY_CHUNK, len);
+
+		for (; x < end; x++) {
+			accum += abs(s[x]);
+		}
+		if (accum >= limit) {
+			break;
+		}
+	}
+
+	return accum;
+}
+
+#ifdef DSP_X86_KERNELS
+__attribute__((target("sse2")))
+static int energy_sse2(const int16_t *s, int len, int limit)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int lanes[4];
+	int accum = 0;
+	int x = 0;
+
+	while (x + ENERGY_CHUNK <= len) {
+		__m128i sum = zero;
+		int end = x + ENERGY_CHUNK;
+
+		for (; x < end; x += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *) (s + x));
+
+			/* -32768 stays 0x8000, which is right once widened unsigned */
+			a = _mm_max_epi16(a, _mm_sub_epi16(zero, a));
+			sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(a, zero));
+			sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(a, zero));
+		}
+		_mm_storeu_si128((__m128i *) lanes, sum);
+		accum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		if (accum >= limit) {
+			return accum;
+		}
+	}
+
+	return accum + energy_c(s + x, len - x, limit - accum);
+}
+
+__attribute__((target("avx2")))
+static int energy_avx2(const int16_t *s, int len, int limit)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	int lanes[8];
+	int accum = 0;
+	int x = 0;
+
+	while (x + ENERGY_CHUNK <= len) {
+		__m256i sum = zero;
+		int end = x + ENERGY_CHUNK;
+
+		for (; x < end; x += 16) {
+			__m256i a = _mm256_abs_epi16(_mm256_loadu_si256((const __m256i *) (s + x)));
+
+			sum = _mm256_add_epi32(sum, _mm256_unpacklo_epi16(a, zero));
+			sum = _mm256_add_epi32(sum, _mm256_unpackhi_epi16(a, zero));
+		}
+		_mm256_storeu_si256((__m256i *) lanes, sum);
+		accum += lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+		if (accum >= limit) {
+			return accum;
+		}
+	}
+
+	return accum + energy_c(s + x, len - x, limit - accum);
+}
+#endif /* DSP_X86_KERNELS */
+
+#ifdef DSP_NEON_KERNELS
+static int energy_neon(const int16_t *s, int len, int limit)
+{
+	uint32_t lanes[4];
+	int accum = 0;
+	int x = 0;
+
+	while (x + ENERGY_CHUNK <= len) {
+		uint32x4_t sum = vdupq_n_u32(0);
+		int end = x + ENERGY_CHUNK;
+
+		for (; x < end; x += 8) {
+			/* vabsq_s16() leaves -32768 as 0x8000, which is right read unsigned */
+			sum = vpadalq_u16(sum, vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(s + x))));
+		}
+		vst1q_u32(lanes, sum);
+		accum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		if (accum >= limit) {
+			return accum;
+		}
+	}
+
+	return accum + energy_c(s + x, len - x, limit - accum);
+}
+#endif /* DSP_NEON_KERNELS */
+
+/*! \brief A set of DSP block functions */
+struct dsp_kernel {
+	const char *name;
+	/*! Feeds samples to up to GOERTZEL_BANK_MAX goertzels, or NULL to call goertzel_sample() on each */
+	void (*goertzel_bank)(goertzel_state_t * const *bank, int count, const int16_t *amp, int samples);
+	/*! Sums the magnitudes of samples, stopping early once the sum reaches limit */
+	int (*energy)(const int16_t *s, int len, int limit);
+};
+
+/*! \brief The kernels, best last */
+static const struct dsp_kernel dsp_kernels[] = {
+	{ "c", NULL, energy_c },
+#ifdef DSP_X86_KERNELS
+	/* SSE2 has no per-lane variable shift for the goertzels */
+	{ "sse2", NULL, energy_sse2 },
+	{ "avx2", goertzel_bank_avx2, energy_avx2 },
+#endif
+#ifdef DSP_NEON_KERNELS
+	{ "neon", goertzel_bank_neon, energy_neon },
+#endif
+};
+
+/*! \brief The kernel in use */
+static const struct dsp_kernel *dsp_kernel = &dsp_kernels[0];
+
+/*! \brief Whether the CPU can run a kernel */
+static int dsp_kernel_supported(const struct dsp_kernel *kernel)
+{
+#ifdef DSP_X86_KERNELS
+	if (!strcmp(kernel->name, "sse2")) {
+		return __builtin_cpu_supports("sse2");
+	}
+	if (!strcmp(kernel->name, "avx2")) {
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+	return 1;
+}
+
+/*! \brief Choose the best kernel the CPU has */
+static void dsp_kernel_init(void)
+{
+	int i;
+
+#ifdef DSP_X86_KERNELS
+	__builtin_cpu_init();
+#endif
+	for (i = ARRAY_LEN(dsp_kernels) - 1; i > 0; --i) {
+		if (dsp_kernel_supported(&dsp_kernels[i])) {
+			break;
+		}
+	}
+	dsp_kernel = &dsp_kernels[i];
+}
+
 typedef struct {
 	int start;
 	int end;
@@ -667,6 +972,10 @@ static int dtmf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp
 	int hit;
 	int limit;
 	fragment_t mute = {0, 0};
+	goertzel_state_t * const bank[] = {
+		&s->td.dtmf.row_out[0], &s->td.dtmf.row_out[1], &s->td.dtmf.row_out[2], &s->td.dtmf.row_out[3],
+		&s->td.dtmf.col_out[0], &s->td.dtmf.col_out[1], &s->td.dtmf.col_out[2], &s->td.dtmf.col_out[3],
+	};
 
 	if (squelch && s->td.dtmf.mute_samples > 0) {
 		mute.end = (s->td.dtmf.mute_samples < samples) ? s->td.dtmf.mute_samples : samples;
@@ -681,21 +990,29 @@ static int dtmf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp
 		} else {
 			limit = samples;
 		}
-		/* The following unrolled loop takes only 35% (rough estimate) of the
-		   time of a rolled loop on the machine on which it was developed */
-		for (j = sample; j < limit; j++) {
-			samp = amp[j];
-			s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
-			/* With GCC 2.95, the following unrolled code seems to take about 35%
-			   (rough estimate) as long as a neat little 0-3 loop */
-			goertzel_sample(s->td.dtmf.row_out, samp);
-			goertzel_sample(s->td.dtmf.col_out, samp);
-			goertzel_sample(s->td.dtmf.row_out + 1, samp);
-			goertzel_sample(s->td.dtmf.col_out + 1, samp);
-			goertzel_sample(s->td.dtmf.row_out + 2, samp);
-			goertzel_sample(s->td.dtmf.col_out + 2, samp);
-			goertzel_sample(s->td.dtmf.row_out + 3, samp);
-			goertzel_sample(s->td.dtmf.col_out + 3, samp);
+		if (dsp_kernel->goertzel_bank) {
+			for (j = sample; j < limit; j++) {
+				samp = amp[j];
+				s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
+			}
+			dsp_kernel->goertzel_bank(bank, ARRAY_LEN(bank), amp + sample, limit - sample);
+		} else {
+			/* The following unrolled loop takes only 35% (rough estimate) of the
+			   time of a rolled loop on the machine on which it was developed */
+			for (j = sample; j < limit; j++) {
+				samp = amp[j];
+				s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
+				/* With GCC 2.95, the following unrolled code seems to take about 35%
+				   (rough estimate) as long as a neat little 0-3 loop */
+				goertzel_sample(s->td.dtmf.row_out, samp);
+				goertzel_sample(s->td.dtmf.col_out, samp);
+				goertzel_sample(s->td.dtmf.row_out + 1, samp);
+				goertzel_sample(s->td.dtmf.col_out + 1, samp);
+				goertzel_sample(s->td.dtmf.row_out + 2, samp);
+				goertzel_sample(s->td.dtmf.col_out + 2, samp);
+				goertzel_sample(s->td.dtmf.row_out + 3, samp);
+				goertzel_sample(s->td.dtmf.col_out + 3, samp);
+			}
 		}
 		s->td.dtmf.current_sample += (limit - sample);
 		if (s->td.dtmf.current_sample < DTMF_GSIZE) {
@@ -869,6 +1186,10 @@ static int mf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp[]
 	int hit;
 	int limit;
 	fragment_t mute = {0, 0};
+	goertzel_state_t * const bank[] = {
+		&s->td.mf.tone_out[0], &s->td.mf.tone_out[1], &s->td.mf.tone_out[2],
+		&s->td.mf.tone_out[3], &s->td.mf.tone_out[4], &s->td.mf.tone_out[5],
+	};
 
 	if (squelch && s->td.mf.mute_samples > 0) {
 		mute.end = (s->td.mf.mute_samples < samples) ? s->td.mf.mute_samples : samples;
@@ -884,18 +1205,22 @@ static int mf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp[]
 		} else {
 			limit = samples;
 		}
-		/* The following unrolled loop takes only 35% (rough estimate) of the
-		   time of a rolled loop on the machine on which it was developed */
-		for (j = sample; j < limit; j++) {
-			/* With GCC 2.95, the following unrolled code seems to take about 35%
-			   (rough estimate) as long as a neat little 0-3 loop */
-			samp = amp[j];
-			goertzel_sample(s->td.mf.tone_out, samp);
-			goertzel_sample(s->td.mf.tone_out + 1, samp);
-			goertzel_sample(s->td.mf.tone_out + 2, samp);
-			goertzel_sample(s->td.mf.tone_out + 3, samp);
-			goertzel_sample(s->td.mf.tone_out + 4, samp);
-			goertzel_sample(s->td.mf.tone_out + 5, samp);
+		if (dsp_kernel->goertzel_bank) {
+			dsp_kernel->goertzel_bank(bank, ARRAY_LEN(bank), amp + sample, limit - sample);
+		} else {
+			/* The following unrolled loop takes only 35% (rough estimate) of the
+			   time of a rolled loop on the machine on which it was developed */
+			for (j = sample; j < limit; j++) {
+				/* With GCC 2.95, the following unrolled code seems to take about 35%
+				   (rough estimate) as long as a neat little 0-3 loop */
+				samp = amp[j];
+				goertzel_sample(s->td.mf.tone_out, samp);
+				goertzel_sample(s->td.mf.tone_out + 1, samp);
+				goertzel_sample(s->td.mf.tone_out + 2, samp);
+				goertzel_sample(s->td.mf.tone_out + 3, samp);
+				goertzel_sample(s->td.mf.tone_out + 4, samp);
+				goertzel_sample(s->td.mf.tone_out + 5, samp);
+			}
 		}
 		s->td.mf.current_sample += (limit - sample);
 		if (s->td.mf.current_sample < MF_GSIZE) {
@@ -1039,6 +1364,11 @@ static int __ast_dsp_call_progress(struct ast_dsp *dsp, short *s, int len)
 	int newstate = DSP_TONE_STATE_SILENCE;
 	int res = 0;
 	int freqcount = dsp->freqcount > FREQ_ARRAY_SIZE ? FREQ_ARRAY_SIZE : dsp->freqcount;
+	goertzel_state_t *bank[FREQ_ARRAY_SIZE];
+
+	for (y = 0; y < freqcount; y++) {
+		bank[y] = &dsp->freqs[y];
+	}
 
 	while (len) {
 		/* Take the lesser of the number of samples we need and what we have */
@@ -1046,11 +1376,19 @@ static int __ast_dsp_call_progress(struct ast_dsp *dsp, short *s, int len)
 		if (pass > dsp->gsamp_size - dsp->gsamps) {
 			pass = dsp->gsamp_size - dsp->gsamps;
 		}
-		for (x = 0; x < pass; x++) {
-			samp = s[x];
-			dsp->genergy += (int32_t) samp * (int32_t) samp;
-			for (y = 0; y < freqcount; y++) {
-				goertzel_sample(&dsp->freqs[y], samp);
+		if (dsp_kernel->goertzel_bank) {
+			for (x = 0; x < pass; x++) {
+				samp = s[x];
+				dsp->genergy += (int32_t) samp * (int32_t) samp;
+			}
+			dsp_kernel->goertzel_bank(bank, freqcount, s, pass);
+		} else {
+			for (x = 0; x < pass; x++) {
+				samp = s[x];
+				dsp->genergy += (int32_t) samp * (int32_t) samp;
+				for (y = 0; y < freqcount; y++) {
+					goertzel_sample(&dsp->freqs[y], samp);
+				}
 			}
 		}
 		s += pass;
@@ -1188,17 +1526,20 @@ int ast_dsp_call_progress(struct ast_dsp *dsp, struct ast_frame *inf)
 static int __ast_dsp_silence_noise(struct ast_dsp *dsp, short *s, int len, int *totalsilence, int *totalnoise, int *frames_energy)
 {
 	int accum;
-	int x;
 	int res = 0;
 
 	if (!len) {
 		return 0;
 	}
-	accum = 0;
-	for (x = 0; x < len; x++) {
-		accum += abs(s[x]);
+	if (frames_energy) {
+		accum = dsp_kernel->energy(s, len, INT_MAX) / len;
+	} else {
+		/*
+		 * Only whether the average reaches the threshold matters, so the
+		 * sum can stop as soon as it does.
+		 */
+		accum = dsp_kernel->energy(s, len, MIN((long long) dsp->threshold * len, INT_MAX)) / len;
 	}
-	accum /= len;
 	if (accum < dsp->threshold) {
 		/* Silent */
 		dsp->totalsilence += len / (dsp->sample_rate / 1000);
@@ -1931,6 +2272,7 @@ int ast_dsp_get_threshold_from_settings(enum threshold which)
 
 int ast_dsp_init(void)
 {
+	dsp_kernel_init();
 	return _dsp_init(0);
 }
 
@@ -1938,3 +2280,22 @@ int ast_dsp_reload(void)
 {
 	return _dsp_init(1);
 }
+
+int ast_dsp_use_kernel(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(dsp_kernels); ++i) {
+		if (!strcmp(dsp_kernels[i].name, name) && dsp_kernel_supported(&dsp_kernels[i])) {
+			dsp_kernel = &dsp_kernels[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+const char *ast_dsp_kernel(void)
+{
+	return dsp_kernel->name;
+}
@@ -288,8 +288,8 @@ static struct ast_endpoint *endpoint_internal_create(const char *tech, const cha
 	if (ast_string_field_init(endpoint, 80) != 0) {
 		return NULL;
 	}
-	ast_string_field_set(endpoint, tech, tech);
-	ast_string_field_set(endpoint, resource, S_OR(resource, ""));
+	ast_string_field_set_interned(endpoint, tech, tech);
+	ast_string_field_set_interned(endpoint, resource, S_OR(resource, ""));
 	ast_string_field_build(endpoint, id, "%s%s%s",
 		tech,
 		!ast_strlen_zero(resource) ? "/" : "",
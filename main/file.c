@@ -54,6 +54,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/stasis.h"
 #include "asterisk/json.h"
 #include "asterisk/stasis_system.h"
+#include "asterisk/taskprocessor.h"
 
 /*! \brief
  * The following variable controls the layout of localized sound files.
@@ -69,6 +70,309 @@ int ast_language_is_prefix = 1;
 
 static AST_RWLIST_HEAD_STATIC(formats, ast_format_def);
 
+/*!
+ * \brief Sound files looked for, and the contents of those played
+ *
+ * Playing a prompt looks for it in several languages and formats, and then
+ * reads it from the file. With the sound cache enabled the result of each
+ * stat() is kept, whether the file was found or not, and files played are
+ * read into memory once and read from there with fmemopen(). Each file is
+ * checked again after SOUND_CACHE_CHECK seconds, and its contents dropped if
+ * it changed. Files written, deleted or renamed through this API are
+ * forgotten at once.
+ */
+static struct ao2_container *sound_files;
+
+/*! \brief Seconds a sound file is trusted before it is checked again */
+#define SOUND_CACHE_CHECK 2
+
+/*! \brief Sound files bigger than this are always read from the file */
+#define SOUND_CACHE_MAX_FILE (4 * 1024 * 1024)
+
+/*! \brief Sound files looked for that are kept; all are forgotten beyond it */
+#define SOUND_CACHE_MAX_FILES 50000
+
+/*! \brief Seconds after which a sound file not played may be dropped to make room */
+#define SOUND_CACHE_IDLE 300
+
+/*! \brief Bytes read at a time from a sound file being played, about four seconds of G.711 */
+#define FILESTREAM_READ_AHEAD 65536
+
+/*! \brief Bytes of sound files that may be kept in memory, from asterisk.conf; 0 disables the cache */
+static int sound_cache_max;
+
+/*! \brief Bytes of sound files kept in memory, including those dropped but still playing */
+static int sound_cache_used;
+
+/*! \brief The contents of a sound file, held by each stream playing it */
+struct sound_contents {
+	size_t len;
+	char buf[0];
+};
+
+/*! \brief A sound file looked for */
+struct sound_file {
+	time_t checked;			/*!< When stat() was last called on the file */
+	int exists;
+	struct stat st;			/*!< What stat() gave, if it exists */
+	struct sound_contents *contents;	/*!< What is in it, if kept */
+	char path[0];
+};
+
+static void sound_contents_destructor(void *obj)
+{
+	struct sound_contents *contents = obj;
+
+	ast_atomic_fetchadd_int(&sound_cache_used, -(int) contents->len);
+}
+
+static void sound_file_destructor(void *obj)
+{
+	struct sound_file *sf = obj;
+
+	ao2_cleanup(sf->contents);
+}
+
+static int sound_file_hash_fn(const void *obj, const int flags)
+{
+	const char *path = (flags & OBJ_KEY) ? obj : ((const struct sound_file *) obj)->path;
+
+	return ast_str_hash(path);
+}
+
+static int sound_file_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct sound_file *sf = obj;
+	const char *path = (flags & OBJ_KEY) ? arg : ((struct sound_file *) arg)->path;
+
+	return !strcmp(sf->path, path) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+/*!
+ * \internal
+ * \brief stat() a sound file, or use what it gave a moment ago
+ */
+static int sound_file_stat(const char *path, struct stat *st)
+{
+	struct sound_file *sf;
+	time_t now;
+	int res;
+
+	if (!sound_cache_max) {
+		return stat(path, st);
+	}
+
+	now = time(NULL);
+	ao2_lock(sound_files);
+	if ((sf = ao2_find(sound_files, path, OBJ_KEY | OBJ_NOLOCK)) && now - sf->checked < SOUND_CACHE_CHECK) {
+		res = sf->exists ? 0 : -1;
+		if (sf->exists) {
+			*st = sf->st;
+		}
+		ao2_unlock(sound_files);
+		ao2_ref(sf, -1);
+		return res;
+	}
+	ao2_unlock(sound_files);
+
+	res = stat(path, st);
+
+	ao2_lock(sound_files);
+	if (!sf) {
+		if (ao2_container_count(sound_files) >= SOUND_CACHE_MAX_FILES) {
+			ao2_callback(sound_files, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE | OBJ_NOLOCK, NULL, NULL);
+		}
+		/* Found again if it was added while unlocked */
+		if (!(sf = ao2_find(sound_files, path, OBJ_KEY | OBJ_NOLOCK))
+			&& (sf = ao2_alloc_options(sizeof(*sf) + strlen(path) + 1, sound_file_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+			strcpy(sf->path, path); /* SAFE */
+			ao2_link_flags(sound_files, sf, OBJ_NOLOCK);
+		}
+	}
+	if (sf) {
+		/* Drop the contents if the file changed */
+		if (sf->contents && (res || sf->st.st_ino != st->st_ino || sf->st.st_dev != st->st_dev
+			|| sf->st.st_size != st->st_size || sf->st.st_mtime != st->st_mtime)) {
+			ao2_ref(sf->contents, -1);
+			sf->contents = NULL;
+		}
+		sf->exists = !res;
+		if (!res) {
+			sf->st = *st;
+		}
+		sf->checked = now;
+	}
+	ao2_unlock(sound_files);
+	ao2_cleanup(sf);
+
+	return res;
+}
+
+#ifdef HAVE_FMEMOPEN
+static int sound_file_idle_cb(void *obj, void *arg, int flags)
+{
+	struct sound_file *sf = obj;
+	time_t *now = arg;
+
+	if (sf->contents && *now - sf->checked > SOUND_CACHE_IDLE) {
+		ao2_ref(sf->contents, -1);
+		sf->contents = NULL;
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Read a sound file into memory, if there is room for it
+ *
+ * \return The contents, or NULL with the file position unknown
+ */
+static struct sound_contents *sound_contents_read(FILE *f, const struct stat *st)
+{
+	static time_t last_sweep;
+	struct sound_contents *contents;
+	time_t now;
+
+	if (st->st_size <= 0 || st->st_size > SOUND_CACHE_MAX_FILE) {
+		return NULL;
+	}
+	if (ast_atomic_fetchadd_int(&sound_cache_used, st->st_size) + st->st_size > sound_cache_max) {
+		ast_atomic_fetchadd_int(&sound_cache_used, -(int) st->st_size);
+
+		/* Make room by dropping the files not played for a while, now and then */
+		now = time(NULL);
+		if (now - last_sweep < SOUND_CACHE_CHECK) {
+			return NULL;
+		}
+		last_sweep = now;
+		ao2_callback(sound_files, OBJ_NODATA | OBJ_MULTIPLE, sound_file_idle_cb, &now);
+		if (ast_atomic_fetchadd_int(&sound_cache_used, st->st_size) + st->st_size > sound_cache_max) {
+			ast_atomic_fetchadd_int(&sound_cache_used, -(int) st->st_size);
+			return NULL;
+		}
+	}
+
+	if (!(contents = ao2_alloc_options(sizeof(*contents) + st->st_size, sound_contents_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		ast_atomic_fetchadd_int(&sound_cache_used, -(int) st->st_size);
+		return NULL;
+	}
+	contents->len = st->st_size;
+	if (fread(contents->buf, 1, contents->len, f) != contents->len) {
+		ao2_ref(contents, -1);
+		return NULL;
+	}
+	return contents;
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Open a sound file to play it, from memory if it is kept
+ *
+ * \param path The file, just given to sound_file_stat()
+ * \param[out] contents What the stream reads, to be released once it is closed
+ */
+static FILE *sound_file_open(const char *path, struct sound_contents **contents)
+{
+#ifdef HAVE_FMEMOPEN
+	struct sound_file *sf = NULL;
+	struct sound_contents *kept = NULL;
+	struct stat st;
+	FILE *f;
+
+	*contents = NULL;
+	if (!sound_cache_max) {
+		return fopen(path, "r");
+	}
+
+	ao2_lock(sound_files);
+	if ((sf = ao2_find(sound_files, path, OBJ_KEY | OBJ_NOLOCK))) {
+		kept = ao2_bump(sf->contents);
+	}
+	ao2_unlock(sound_files);
+
+	if (!kept) {
+		if (!(f = fopen(path, "r"))) {
+			ao2_cleanup(sf);
+			return NULL;
+		}
+		if (!sf || fstat(fileno(f), &st)) {
+			ao2_cleanup(sf);
+			return f;
+		}
+		kept = sound_contents_read(f, &st);
+		fclose(f);
+		if (!kept) {
+			/* Opened again so that the stream can be set up to read ahead */
+			ao2_cleanup(sf);
+			return fopen(path, "r");
+		}
+
+		/* Kept for the next to play it, if it is still the file that was found */
+		ao2_lock(sound_files);
+		if (!sf->contents && sf->exists && st.st_ino == sf->st.st_ino && st.st_dev == sf->st.st_dev
+			&& st.st_size == sf->st.st_size && st.st_mtime == sf->st.st_mtime) {
+			sf->contents = ao2_bump(kept);
+		}
+		ao2_unlock(sound_files);
+	}
+	ao2_cleanup(sf);
+
+	if (!(f = fmemopen(kept->buf, kept->len, "r"))) {
+		ao2_ref(kept, -1);
+		return fopen(path, "r");
+	}
+	*contents = kept;
+	return f;
+#else
+	*contents = NULL;
+	return fopen(path, "r");
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Forget what is known about a sound file that is being changed
+ */
+static void sound_file_forget(const char *path)
+{
+	if (sound_cache_max && path) {
+		ao2_find(sound_files, path, OBJ_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Read a sound file ahead of its playback
+ *
+ * The file is kept in memory if there is room for it, otherwise the kernel
+ * is asked to read it into the page cache.
+ */
+static void sound_file_warm(const char *path)
+{
+	struct sound_contents *contents;
+	FILE *f;
+
+	if (sound_cache_max) {
+		if ((f = sound_file_open(path, &contents))) {
+			fclose(f);
+			ao2_cleanup(contents);
+		}
+		return;
+	}
+#ifdef POSIX_FADV_WILLNEED
+	{
+		int fd = open(path, O_RDONLY);
+
+		if (fd >= 0) {
+			posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+			close(fd);
+		}
+	}
+#endif
+}
+
 STASIS_MESSAGE_TYPE_DEFN(ast_format_register_type);
 STASIS_MESSAGE_TYPE_DEFN(ast_format_unregister_type);
 
@@ -399,8 +703,10 @@ static void filestream_destructor(void *arg)
 	if (f->f) {
 		fclose(f->f);
 	}
+	ao2_cleanup(f->contents);
 
 	if (f->realfilename && f->filename) {
+		sound_file_forget(f->realfilename);
 		pid = ast_safe_fork(0);
 		if (!pid) {
 			execl("/bin/mv", "mv", "-f", f->filename, f->realfilename, SENTINEL);
@@ -416,7 +722,7 @@ static void filestream_destructor(void *arg)
 	ast_free(f->realfilename);
 	if (f->vfs)
 		ast_closestream(f->vfs);
-	ast_free(f->write_buffer);
+	ast_free(f->stdio_buffer);
 	ast_free((void *)f->orig_chan_name);
 	ao2_cleanup(f->lastwriteformat);
 	ao2_cleanup(f->fr.subclass.format);
@@ -451,6 +757,58 @@ static struct ast_filestream *get_filestream(struct ast_format_def *fmt, FILE *b
 	return s;
 }
 
+/*!
+ * \internal
+ * \brief Set up a stream that is to be read
+ *
+ * A file is read ahead a block at a time, rather than a frame or the default
+ * stdio buffer at a time, so that playing it takes a read every second or
+ * so. This must be done before anything is read from the stream.
+ */
+static void filestream_read_ahead(struct ast_filestream *s)
+{
+	size_t size = FILESTREAM_READ_AHEAD;
+	struct stat st;
+
+	s->reading = 1;
+	if (s->contents) {
+		/* Read from memory */
+		return;
+	}
+	if (!fstat(fileno(s->f), &st) && st.st_size < size) {
+		if (st.st_size <= BUFSIZ) {
+			return;
+		}
+		/* Room to read it whole, and to see the end of it */
+		size = st.st_size + 1;
+	}
+	if ((s->stdio_buffer = ast_malloc(size))) {
+		setvbuf(s->f, s->stdio_buffer, _IOFBF, size);
+	}
+}
+
+off_t ast_filestream_size(struct ast_filestream *fs)
+{
+	struct stat st;
+	off_t cur;
+	off_t max;
+
+	/* Nothing is waiting to be written to a stream being read, so the file
+	 * has it all. A stream reading from memory has no file to stat. */
+	if (fs->reading && fileno(fs->f) >= 0 && !fstat(fileno(fs->f), &st)) {
+		return st.st_size;
+	}
+
+	if ((cur = ftello(fs->f)) < 0 || fseeko(fs->f, 0, SEEK_END) < 0) {
+		return -1;
+	}
+	max = ftello(fs->f);
+	if (fseeko(fs->f, cur, SEEK_SET) < 0) {
+		return -1;
+	}
+	return max;
+}
+
 /*
  * Default implementations of open and rewrite.
  * Only use them if you don't have expensive stuff to do.
@@ -489,7 +847,8 @@ enum file_action {
 	ACTION_DELETE,	/* delete file, return 0 on success, -1 on error */
 	ACTION_RENAME,	/* rename file. return 0 on success, -1 on error */
 	ACTION_OPEN,
-	ACTION_COPY	/* copy file. return 0 on success, -1 on error */
+	ACTION_COPY,	/* copy file. return 0 on success, -1 on error */
+	ACTION_PREFETCH	/* read file ahead of its playback. return 0 if found, -1 otherwise */
 };
 
 /*!
@@ -500,6 +859,7 @@ enum file_action {
  *  optional ast_format_cap holding all the formats found for a file, for EXISTS.
  *	destination file name (const char *) for COPY and RENAME
  *	struct ast_channel * for OPEN
+ *	optional struct ast_format * to limit PREFETCH to, for PREFETCH
  * if fmt is NULL, OPEN will return the first matching entry,
  * whereas other functions will run on all matching entries.
  */
@@ -515,6 +875,10 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 
 		if (fmt && !exts_compare(f->exts, fmt))
 			continue;
+		if (action == ACTION_PREFETCH && arg2
+			&& ast_format_cmp((struct ast_format *) arg2, f->format) == AST_FORMAT_CMP_NOT_EQUAL) {
+			continue;
+		}
 
 		/* Look for a file matching the supported extensions.
 		 * The file must exist, and for OPEN, must match
@@ -528,7 +892,7 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 			if (fn == NULL)
 				continue;
 
-			if ( stat(fn, &st) ) { /* file not existent */
+			if ( sound_file_stat(fn, &st) ) { /* file not existent */
 				ast_free(fn);
 				continue;
 			}
@@ -539,6 +903,7 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 				struct ast_channel *chan = (struct ast_channel *)arg2;
 				FILE *bfile;
 				struct ast_filestream *s;
+				struct sound_contents *contents;
 
 				if ((ast_format_cmp(ast_channel_writeformat(chan), f->format) == AST_FORMAT_CMP_NOT_EQUAL) &&
 				     !(((ast_format_get_type(f->format) == AST_MEDIA_TYPE_AUDIO) && fmt) ||
@@ -546,16 +911,19 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 					ast_free(fn);
 					continue;	/* not a supported format */
 				}
-				if ( (bfile = fopen(fn, "r")) == NULL) {
+				if ( (bfile = sound_file_open(fn, &contents)) == NULL) {
 					ast_free(fn);
 					continue;	/* cannot open file */
 				}
 				s = get_filestream(f, bfile);
 				if (!s) {
 					fclose(bfile);
+					ao2_cleanup(contents);
 					ast_free(fn);	/* cannot allocate descriptor */
 					continue;
 				}
+				s->contents = contents;
+				filestream_read_ahead(s);
 				if (open_wrapper(s)) {
 					ast_free(fn);
 					ast_closestream(s);
@@ -595,7 +963,13 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 				res = 1; /* file does exist and format it exists in is returned in arg2 */
 				break;
 
+			case ACTION_PREFETCH:
+				sound_file_warm(fn);
+				res = 0;
+				break;
+
 			case ACTION_DELETE:
+				sound_file_forget(fn);
 				if ( (res = unlink(fn)) )
 					ast_log(LOG_WARNING, "unlink(%s) failed: %s\n", fn, strerror(errno));
 				break;
@@ -606,6 +980,8 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 				if (!nfn)
 					ast_log(LOG_WARNING, "Out of memory\n");
 				else {
+					sound_file_forget(fn);
+					sound_file_forget(nfn);
 					res = action == ACTION_COPY ? copy(fn, nfn) : rename(fn, nfn);
 					if (res)
 						ast_log(LOG_WARNING, "%s(%s,%s) failed: %s\n",
@@ -626,6 +1002,234 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 	return res;
 }
 
+/*!
+ * \brief Directory of prompts transcoded into the formats of the channels playing them
+ *
+ * A prompt that exists only in formats the channel playing it does not
+ * speak is translated for every frame of every playback. With transcoding
+ * enabled in asterisk.conf, the first playback queues the prompt to be
+ * transcoded once into the format chosen for the channel, under this
+ * directory with the same path. Later playbacks find that variant and play
+ * it as it is, as long as it is newer than the prompt.
+ */
+static char *sound_variant_dir;
+
+/*! \brief Variants being transcoded, by file name */
+static struct ao2_container *sound_variants_pending;
+
+/*! \brief Transcodes variants, one at a time */
+static struct ast_taskprocessor *sound_variant_tps;
+
+/*! \brief A prompt to transcode */
+struct sound_variant {
+	struct ast_format *src;
+	struct ast_format *dst;
+	char *name;		/*!< The prompt, as given to ast_readfile() */
+	char *src_ext;
+	char *variant;		/*!< The variant, without an extension */
+	char *dst_ext;
+	char *dst_fn;		/*!< The variant file, the key in sound_variants_pending */
+};
+
+static void sound_variant_free(struct sound_variant *v)
+{
+	ao2_cleanup(v->src);
+	ao2_cleanup(v->dst);
+	ast_free(v->name);
+	ast_free(v->src_ext);
+	ast_free(v->variant);
+	ast_free(v->dst_ext);
+	ast_free(v->dst_fn);
+	ast_free(v);
+}
+
+/*!
+ * \internal
+ * \brief Find the extension a format's files are written with
+ *
+ * \retval 0 if there is a format module for \a format
+ * \retval -1 if not, or \a writable and it cannot write files
+ */
+static int sound_format_ext(struct ast_format *format, int writable, char *ext, size_t len)
+{
+	struct ast_format_def *f;
+	int res = -1;
+
+	AST_RWLIST_RDLOCK(&formats);
+	AST_RWLIST_TRAVERSE(&formats, f, list) {
+		if (ast_format_cmp(f->format, format) == AST_FORMAT_CMP_NOT_EQUAL
+			|| (writable && !f->write)) {
+			continue;
+		}
+		ast_copy_string(ext, f->exts, len);
+		ext[strcspn(ext, "|")] = '\0';
+		res = 0;
+		break;
+	}
+	AST_RWLIST_UNLOCK(&formats);
+	return res;
+}
+
+static int sound_variant_task(void *data)
+{
+	struct sound_variant *v = data;
+	struct ast_filestream *in = NULL;
+	struct ast_filestream *out = NULL;
+	struct ast_trans_pvt *trans = NULL;
+	struct ast_frame *fr;
+	char *dir = ast_strdupa(v->variant);
+	char *tmp = NULL;
+	int res = -1;
+
+	*strrchr(dir, '/') = '\0';
+	if (ast_mkdir(dir, 0777)) {
+		ast_log(LOG_WARNING, "Unable to create directory %s for transcoded prompts: %s\n", dir, strerror(errno));
+		goto done;
+	}
+	if (ast_asprintf(&tmp, "%s-new", v->variant) < 0
+		|| !(trans = ast_translator_build_path(v->dst, v->src))
+		|| !(in = ast_readfile(v->name, v->src_ext, NULL, O_RDONLY, 0, 0))
+		|| !(out = ast_writefile(tmp, v->dst_ext, NULL, O_CREAT | O_TRUNC | O_WRONLY, 0, AST_FILE_MODE))) {
+		goto done;
+	}
+
+	res = 0;
+	while (!res && (fr = ast_readframe(in))) {
+		struct ast_frame *translated = ast_translate(trans, fr, 0);
+		struct ast_frame *cur;
+
+		ast_frfree(fr);
+		for (cur = translated; cur && !res; cur = AST_LIST_NEXT(cur, frame_list)) {
+			res = ast_writestream(out, cur);
+		}
+		if (translated) {
+			ast_frfree(translated);
+		}
+	}
+
+done:
+	if (in) {
+		ast_closestream(in);
+	}
+	if (out) {
+		ast_closestream(out);
+		if (!res) {
+			res = ast_filerename(tmp, v->variant, v->dst_ext);
+		}
+		if (res) {
+			ast_filedelete(tmp, v->dst_ext);
+		}
+	}
+	if (res) {
+		ast_log(LOG_WARNING, "Unable to transcode %s.%s into %s\n", v->name, v->src_ext, v->dst_fn);
+	} else {
+		ast_debug(1, "Transcoded %s.%s into %s\n", v->name, v->src_ext, v->dst_fn);
+	}
+	if (trans) {
+		ast_translator_free_path(trans);
+	}
+	ast_free(tmp);
+	ast_str_container_remove(sound_variants_pending, v->dst_fn);
+	sound_variant_free(v);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find a variant of a prompt the channel can play without translating
+ *
+ * \param chan The channel to play it on
+ * \param name The prompt found, without an extension
+ * \param file_cap The formats it was found in
+ *
+ * If the prompt must be translated for the channel and there is no fresh
+ * variant, one is queued to be transcoded.
+ *
+ * \return The variant, without an extension, to be freed with ast_free()
+ * \retval NULL to play the prompt itself
+ */
+static char *sound_variant_find(struct ast_channel *chan, const char *name, struct ast_format_cap *file_cap)
+{
+	struct ast_format_cap *native;
+	struct ast_format *src = NULL;
+	struct ast_format *dst = NULL;
+	struct sound_variant *v = NULL;
+	char src_ext[32];
+	char dst_ext[32];
+	char *src_fn = NULL;
+	char *variant = NULL;
+	char *dst_fn = NULL;
+	struct stat src_st;
+	struct stat dst_st;
+
+	if (!sound_variant_dir) {
+		return NULL;
+	}
+
+	ast_channel_lock(chan);
+	native = ao2_bump(ast_channel_nativeformats(chan));
+	ast_channel_unlock(chan);
+	if (!native || ast_translator_best_choice(native, file_cap, &dst, &src)
+		|| ast_format_cmp(dst, src) != AST_FORMAT_CMP_NOT_EQUAL
+		|| ast_format_get_type(src) != AST_MEDIA_TYPE_AUDIO
+		|| sound_format_ext(src, 0, src_ext, sizeof(src_ext))
+		|| sound_format_ext(dst, 1, dst_ext, sizeof(dst_ext))) {
+		goto done;
+	}
+
+	if (!(src_fn = build_filename(name, src_ext)) || sound_file_stat(src_fn, &src_st)) {
+		goto done;
+	}
+	/* The variant has the path of the prompt, under the variant directory */
+	if (ast_asprintf(&variant, "%s%.*s", sound_variant_dir,
+			(int) (strlen(src_fn) - strlen(src_ext) - 1), src_fn) < 0) {
+		variant = NULL;
+		goto done;
+	}
+	if (!(dst_fn = build_filename(variant, dst_ext))) {
+		goto done;
+	}
+	if (!sound_file_stat(dst_fn, &dst_st) && dst_st.st_mtime >= src_st.st_mtime) {
+		ast_free(src_fn);
+		ast_free(dst_fn);
+		ao2_ref(native, -1);
+		ao2_ref(src, -1);
+		ao2_ref(dst, -1);
+		return variant;
+	}
+
+	/* Play it translated this time, and transcode it for next time */
+	if (ao2_find(sound_variants_pending, dst_fn, OBJ_KEY | OBJ_NODATA)
+		|| ast_str_container_add(sound_variants_pending, dst_fn)) {
+		goto done;
+	}
+	if (!(v = ast_calloc(1, sizeof(*v)))) {
+		ast_str_container_remove(sound_variants_pending, dst_fn);
+		goto done;
+	}
+	v->src = ao2_bump(src);
+	v->dst = ao2_bump(dst);
+	v->dst_fn = dst_fn;
+	dst_fn = NULL;
+	v->variant = variant;
+	variant = NULL;
+	if (!(v->name = ast_strdup(name)) || !(v->src_ext = ast_strdup(src_ext))
+		|| !(v->dst_ext = ast_strdup(dst_ext))
+		|| ast_taskprocessor_push(sound_variant_tps, sound_variant_task, v)) {
+		ast_str_container_remove(sound_variants_pending, v->dst_fn);
+		sound_variant_free(v);
+	}
+
+done:
+	ast_free(src_fn);
+	ast_free(variant);
+	ast_free(dst_fn);
+	ao2_cleanup(native);
+	ao2_cleanup(src);
+	ao2_cleanup(dst);
+	return NULL;
+}
+
 static int is_absolute_path(const char *filename)
 {
 	return filename[0] == '/';
@@ -748,6 +1352,7 @@ struct ast_filestream *ast_openstream_full(struct ast_channel *chan, const char
 	int res;
 	int buflen;
 	char *buf;
+	char *variant;
 
 	if (!asis) {
 		/* do this first, otherwise we detect the wrong writeformat */
@@ -771,6 +1376,20 @@ struct ast_filestream *ast_openstream_full(struct ast_channel *chan, const char
 		return NULL;
 	}
 
+	/* Prefer a variant transcoded into a format the channel speaks */
+	if ((variant = sound_variant_find(chan, buf, file_fmt_cap))) {
+		struct ast_format_cap *variant_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+
+		if (variant_cap && filehelper(variant, variant_cap, NULL, ACTION_EXISTS)) {
+			ao2_ref(file_fmt_cap, -1);
+			file_fmt_cap = variant_cap;
+			buf = ast_strdupa(variant);
+		} else {
+			ao2_cleanup(variant_cap);
+		}
+		ast_free(variant);
+	}
+
 	/* Set the channel to a format we can work with and save off the previous format. */
 	ast_channel_lock(chan);
 	ast_channel_set_oldwriteformat(chan, ast_channel_writeformat(chan));
@@ -1066,6 +1685,64 @@ int ast_fileexists(const char *filename, const char *fmt, const char *preflang)
 	return fileexists_core(filename, fmt, preflang, buf, buflen, NULL) ? 1 : 0;
 }
 
+int ast_file_prefetch(struct ast_channel *chan, const char *filename, const char *preflang)
+{
+	struct ast_format_cap *file_fmt_cap;
+	struct ast_format_cap *native = NULL;
+	struct ast_format *dst = NULL;
+	struct ast_format *src = NULL;
+	char *variant = NULL;
+	char *buf;
+	int buflen;
+	int res;
+
+	if (preflang == NULL) {
+		preflang = "";
+	}
+	buflen = strlen(preflang) + strlen(filename) + 4;
+	buf = ast_alloca(buflen);
+
+	if (!(file_fmt_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
+		return -1;
+	}
+	if (!fileexists_core(filename, NULL, preflang, buf, buflen, file_fmt_cap)
+		|| !ast_format_cap_has_type(file_fmt_cap, AST_MEDIA_TYPE_AUDIO)) {
+		ao2_ref(file_fmt_cap, -1);
+		return -1;
+	}
+
+	if (chan) {
+		/* What ast_openstream_full() would open, queueing the variant if it is missing */
+		if ((variant = sound_variant_find(chan, buf, file_fmt_cap))) {
+			struct ast_format_cap *variant_cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+
+			if (variant_cap && filehelper(variant, variant_cap, NULL, ACTION_EXISTS)) {
+				ao2_ref(file_fmt_cap, -1);
+				file_fmt_cap = variant_cap;
+				buf = ast_strdupa(variant);
+			} else {
+				ao2_cleanup(variant_cap);
+			}
+			ast_free(variant);
+		}
+
+		ast_channel_lock(chan);
+		native = ao2_bump(ast_channel_nativeformats(chan));
+		ast_channel_unlock(chan);
+		if (native && ast_translator_best_choice(native, file_fmt_cap, &dst, &src)) {
+			src = NULL;
+		}
+	}
+
+	res = filehelper(buf, src, NULL, ACTION_PREFETCH);
+
+	ao2_cleanup(src);
+	ao2_cleanup(dst);
+	ao2_cleanup(native);
+	ao2_ref(file_fmt_cap, -1);
+	return res;
+}
+
 int ast_filedelete(const char *filename, const char *fmt)
 {
 	return filehelper(filename, NULL, fmt, ACTION_DELETE);
@@ -1157,7 +1834,10 @@ struct ast_filestream *ast_readfile(const char *filename, const char *type, cons
 		errno = 0;
 		bfile = fopen(fn, "r");
 
-		if (!bfile || (fs = get_filestream(f, bfile)) == NULL || open_wrapper(fs) ) {
+		if (bfile && (fs = get_filestream(f, bfile))) {
+			filestream_read_ahead(fs);
+		}
+		if (!bfile || !fs || open_wrapper(fs)) {
 			ast_log(LOG_WARNING, "Unable to open %s\n", fn);
 			if (fs) {
 				ast_closestream(fs);
@@ -1225,6 +1905,7 @@ struct ast_filestream *ast_writefile(const char *filename, const char *type, con
 		if (!fn) {
 			continue;
 		}
+		sound_file_forget(fn);
 		fd = open(fn, flags | myflags, mode);
 		if (fd > -1) {
 			/* fdopen() the resulting file stream */
@@ -1271,8 +1952,8 @@ struct ast_filestream *ast_writefile(const char *filename, const char *type, con
 			errno = 0;
 			fs = get_filestream(f, bfile);
 			if (fs) {
-				if ((fs->write_buffer = ast_malloc(32768))) {
-					setvbuf(fs->f, fs->write_buffer, _IOFBF, 32768);
+				if ((fs->stdio_buffer = ast_malloc(32768))) {
+					setvbuf(fs->f, fs->stdio_buffer, _IOFBF, 32768);
 				}
 			}
 			if (!fs || rewrite_wrapper(fs, comment)) {
@@ -1773,10 +2454,47 @@ static void file_shutdown(void)
 	ast_cli_unregister_multiple(cli_file, ARRAY_LEN(cli_file));
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_format_register_type);
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_format_unregister_type);
+	sound_cache_max = 0;
+	ao2_cleanup(sound_files);
+	sound_files = NULL;
+	ast_free(sound_variant_dir);
+	sound_variant_dir = NULL;
+	sound_variant_tps = ast_taskprocessor_unreference(sound_variant_tps);
+	ao2_cleanup(sound_variants_pending);
+	sound_variants_pending = NULL;
 }
 
 int ast_file_init(void)
 {
+	struct ast_flags config_flags = { 0 };
+	struct ast_config *cfg;
+	const char *size;
+	int megabytes = 0;
+	int transcode = 0;
+
+	if ((cfg = ast_config_load2("asterisk.conf", "" /* core can't reload */, config_flags))
+		&& cfg != CONFIG_STATUS_FILEINVALID) {
+		if ((size = ast_variable_retrieve(cfg, "options", "sound_cache_size"))
+			&& (sscanf(size, "%30d", &megabytes) != 1 || megabytes < 0 || megabytes > 1024)) {
+			ast_log(LOG_WARNING, "Invalid sound_cache_size '%s', not keeping sound files\n", size);
+			megabytes = 0;
+		}
+		transcode = ast_true(ast_variable_retrieve(cfg, "options", "sound_transcode"));
+		ast_config_destroy(cfg);
+	}
+	if (megabytes && (sound_files = ao2_container_alloc(1021, sound_file_hash_fn, sound_file_cmp_fn))) {
+		sound_cache_max = megabytes * 1024 * 1024;
+	}
+	if (transcode) {
+		sound_variants_pending = ast_str_container_alloc(37);
+		sound_variant_tps = ast_taskprocessor_get("file_transcode", TPS_REF_DEFAULT);
+		if (!sound_variants_pending || !sound_variant_tps
+			|| ast_asprintf(&sound_variant_dir, "%s/transcoded", ast_config_AST_SPOOL_DIR) < 0) {
+			ast_log(LOG_WARNING, "Unable to transcode prompts\n");
+			sound_variant_dir = NULL;
+		}
+	}
+
 	STASIS_MESSAGE_TYPE_INIT(ast_format_register_type);
 	STASIS_MESSAGE_TYPE_INIT(ast_format_unregister_type);
 	ast_cli_register_multiple(cli_file, ARRAY_LEN(cli_file));
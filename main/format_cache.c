@@ -232,7 +232,7 @@ struct ast_format *ast_format_t140_red;
  */
 struct ast_format *ast_format_none;
 
-/*! \brief Number of buckets to use for the media format cache (should be prime for performance reasons) */
+/*! \brief Number of formats the media format cache is sized for */
 #define CACHE_BUCKETS 53
 
 /*! \brief Cached formats */
@@ -335,8 +335,8 @@ static void format_cache_shutdown(void)
 
 int ast_format_cache_init(void)
 {
-	formats = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_RWLOCK, CACHE_BUCKETS,
-		format_hash_cb, format_cmp_cb);
+	formats = ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_RWLOCK, 0, CACHE_BUCKETS,
+		format_hash_cb, NULL, format_cmp_cb);
 	if (!formats) {
 		return -1;
 	}
@@ -60,6 +60,8 @@ struct ast_format_cap {
 	AST_VECTOR(, struct format_cap_framed *) preference_order;
 	/*! \brief Global framing size, applies to all formats if no framing present on format */
 	unsigned int framing;
+	/*! \brief Identifier of an interned structure, which must not change, 0 if not interned */
+	unsigned int interned;
 };
 
 /*! \brief Linked list for formats */
@@ -68,6 +70,55 @@ AST_LIST_HEAD_NOLOCK(format_cap_framed_list, format_cap_framed);
 /*! \brief Dummy empty list for when we are inserting a new list */
 static const struct format_cap_framed_list format_cap_framed_list_empty = AST_LIST_HEAD_NOLOCK_INIT_VALUE;
 
+/*! \brief Number of buckets for the interned capabilities */
+#define INTERNED_CAP_BUCKETS 127
+
+/*! \brief Maximum number of interned capabilities, unused ones are dropped past it */
+#define INTERNED_CAP_MAX 1024
+
+/*! \brief Number of buckets for the joint capabilities of interned pairs */
+#define JOINT_CAP_BUCKETS 251
+
+/*! \brief Maximum number of joint capabilities remembered, all are forgotten past it */
+#define JOINT_CAP_MAX 4096
+
+/*! \brief Interned capabilities, keyed by their formats and framing */
+static struct ao2_container *interned_caps;
+
+/*! \brief Last identifier given to an interned capabilities structure, protected by the interned_caps lock */
+static unsigned int interned_caps_last_id;
+
+/*! \brief Joint capabilities of a pair of interned capabilities */
+struct format_cap_joint {
+	/*! \brief Identifier of the first interned capabilities */
+	unsigned int id1;
+	/*! \brief Identifier of the second interned capabilities */
+	unsigned int id2;
+	/*! \brief The joint capabilities, never changed once stored */
+	struct ast_format_cap *joint;
+};
+
+/*! \brief Joint capabilities of interned pairs, keyed by the identifiers of the pair */
+static struct ao2_container *joint_caps;
+
+/*!
+ * \internal
+ * \brief Refuse to change an interned capabilities structure
+ *
+ * \retval 1 the structure is interned
+ * \retval 0 the structure may be changed
+ */
+static int format_cap_immutable(const struct ast_format_cap *cap)
+{
+	if (cap->interned) {
+		ast_log(LOG_ERROR, "Interned format capabilities can't be changed\n");
+		ast_assert(0);
+		return 1;
+	}
+
+	return 0;
+}
+
 /*! \brief Destructor for format capabilities structure */
 static void format_cap_destroy(void *obj)
 {
@@ -137,6 +188,10 @@ struct ast_format_cap *__ast_format_cap_alloc(enum ast_format_cap_flags flags,
 
 void ast_format_cap_set_framing(struct ast_format_cap *cap, unsigned int framing)
 {
+	if (format_cap_immutable(cap)) {
+		return;
+	}
+
 	cap->framing = framing;
 }
 
@@ -197,6 +252,10 @@ int __ast_format_cap_append(struct ast_format_cap *cap, struct ast_format *forma
 
 	ast_assert(format != NULL);
 
+	if (format_cap_immutable(cap)) {
+		return -1;
+	}
+
 	if (format_in_format_cap(cap, format)) {
 		return 0;
 	}
@@ -301,6 +360,10 @@ void ast_format_cap_replace_from_cap(struct ast_format_cap *dst, const struct as
 {
 	int idx;
 
+	if (format_cap_immutable(dst)) {
+		return;
+	}
+
 	for (idx = 0; (idx < AST_VECTOR_SIZE(&src->preference_order)); ++idx) {
 		struct format_cap_framed *framed = AST_VECTOR_GET(&src->preference_order, idx);
 
@@ -494,6 +557,10 @@ int ast_format_cap_remove(struct ast_format_cap *cap, struct ast_format *format)
 
 	ast_assert(format != NULL);
 
+	if (format_cap_immutable(cap)) {
+		return -1;
+	}
+
 	if (ast_format_get_codec_id(format) >= AST_VECTOR_SIZE(&cap->formats)) {
 		return -1;
 	}
@@ -519,6 +586,10 @@ void ast_format_cap_remove_by_type(struct ast_format_cap *cap, enum ast_media_ty
 {
 	int idx;
 
+	if (format_cap_immutable(cap)) {
+		return;
+	}
+
 	for (idx = 0; idx < AST_VECTOR_SIZE(&cap->formats); ++idx) {
 		struct format_cap_framed_list *list = AST_VECTOR_GET_ADDR(&cap->formats, idx);
 		struct format_cap_framed *framed;
@@ -620,7 +691,8 @@ int ast_format_cap_has_type(const struct ast_format_cap *cap, enum ast_media_typ
 	return 0;
 }
 
-int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2,
+/*! \internal \brief Add the joint capabilities of two capabilities structures to a third */
+static int format_cap_get_compatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2,
 	struct ast_format_cap *result)
 {
 	int idx, res = 0;
@@ -645,10 +717,114 @@ int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struc
 	return res;
 }
 
+static int format_cap_joint_hash(const void *obj, const int flags)
+{
+	const struct format_cap_joint *joint = obj;
+
+	return (int) ((joint->id1 * 31 + joint->id2) & INT_MAX);
+}
+
+static int format_cap_joint_cmp(void *obj, void *arg, int flags)
+{
+	const struct format_cap_joint *joint = obj;
+	const struct format_cap_joint *key = arg;
+
+	return (joint->id1 == key->id1 && joint->id2 == key->id2) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+static void format_cap_joint_destroy(void *obj)
+{
+	struct format_cap_joint *joint = obj;
+
+	ao2_cleanup(joint->joint);
+}
+
+/*!
+ * \internal
+ * \brief Get the joint capabilities of two interned capabilities structures
+ *
+ * They are computed on first use and remembered for the pair.
+ *
+ * \return The joint capabilities, not to be changed, with a reference. NULL on error.
+ */
+static struct ast_format_cap *format_cap_joint_get(const struct ast_format_cap *cap1,
+	const struct ast_format_cap *cap2)
+{
+	struct format_cap_joint key = {
+		.id1 = cap1->interned,
+		.id2 = cap2->interned,
+	};
+	struct format_cap_joint *joint;
+	struct ast_format_cap *result;
+
+	joint = ao2_find(joint_caps, &key, OBJ_SEARCH_OBJECT);
+	if (joint) {
+		result = ao2_bump(joint->joint);
+		ao2_ref(joint, -1);
+		return result;
+	}
+
+	result = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!result) {
+		return NULL;
+	}
+	if (format_cap_get_compatible(cap1, cap2, result)) {
+		ao2_ref(result, -1);
+		return NULL;
+	}
+
+	joint = ao2_alloc_options(sizeof(*joint), format_cap_joint_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!joint) {
+		return result;
+	}
+	*joint = key;
+	joint->joint = ao2_bump(result);
+
+	ao2_lock(joint_caps);
+	if (ao2_container_count(joint_caps) >= JOINT_CAP_MAX) {
+		ao2_callback(joint_caps, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+	}
+	/* Another thread may have added the pair meanwhile, the result is the same. */
+	ao2_find(joint_caps, &key, OBJ_SEARCH_OBJECT | OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA);
+	ao2_link_flags(joint_caps, joint, OBJ_NOLOCK);
+	ao2_unlock(joint_caps);
+	ao2_ref(joint, -1);
+
+	return result;
+}
+
+int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2,
+	struct ast_format_cap *result)
+{
+	struct ast_format_cap *joint;
+	int res;
+
+	if (!cap1->interned || !cap2->interned
+		|| !(joint = format_cap_joint_get(cap1, cap2))) {
+		return format_cap_get_compatible(cap1, cap2, result);
+	}
+
+	res = ast_format_cap_append_from_cap(result, joint, AST_MEDIA_TYPE_UNKNOWN);
+	ao2_ref(joint, -1);
+
+	return res;
+}
+
 int ast_format_cap_iscompatible(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2)
 {
 	int idx;
 
+	if (cap1->interned && cap2->interned) {
+		struct ast_format_cap *joint = format_cap_joint_get(cap1, cap2);
+
+		if (joint) {
+			int res = AST_VECTOR_SIZE(&joint->preference_order) ? 1 : 0;
+
+			ao2_ref(joint, -1);
+			return res;
+		}
+	}
+
 	for (idx = 0; idx < AST_VECTOR_SIZE(&cap1->preference_order); ++idx) {
 		struct format_cap_framed *framed = AST_VECTOR_GET(&cap1->preference_order, idx);
 
@@ -732,3 +908,108 @@ int ast_format_cap_empty(struct ast_format_cap *cap)
 
 	return 0;
 }
+
+unsigned int ast_format_cap_get_intern_id(const struct ast_format_cap *cap)
+{
+	return cap->interned;
+}
+
+static int interned_cap_hash(const void *obj, const int flags)
+{
+	const struct ast_format_cap *cap = obj;
+	unsigned int hash = cap->framing;
+	int idx;
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&cap->preference_order); ++idx) {
+		struct format_cap_framed *framed = AST_VECTOR_GET(&cap->preference_order, idx);
+
+		hash = hash * 31 + (unsigned int) ((uintptr_t) framed->format >> 4) + framed->framing;
+	}
+
+	return (int) (hash & INT_MAX);
+}
+
+static int interned_cap_cmp(void *obj, void *arg, int flags)
+{
+	const struct ast_format_cap *cap = obj;
+	const struct ast_format_cap *key = arg;
+	int idx;
+
+	if (cap->framing != key->framing
+		|| AST_VECTOR_SIZE(&cap->preference_order) != AST_VECTOR_SIZE(&key->preference_order)) {
+		return 0;
+	}
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&cap->preference_order); ++idx) {
+		struct format_cap_framed *framed1 = AST_VECTOR_GET(&cap->preference_order, idx);
+		struct format_cap_framed *framed2 = AST_VECTOR_GET(&key->preference_order, idx);
+
+		if (framed1->format != framed2->format || framed1->framing != framed2->framing) {
+			return 0;
+		}
+	}
+
+	return CMP_MATCH | CMP_STOP;
+}
+
+/*! \internal \brief Match interned capabilities no one else holds a reference to */
+static int interned_cap_unused(void *obj, void *arg, int flags)
+{
+	return ao2_ref(obj, 0) == 1 ? CMP_MATCH : 0;
+}
+
+struct ast_format_cap *ast_format_cap_intern(struct ast_format_cap *cap)
+{
+	struct ast_format_cap *interned;
+
+	if (cap->interned) {
+		return ao2_bump(cap);
+	}
+
+	ao2_lock(interned_caps);
+	interned = ao2_find(interned_caps, cap, OBJ_SEARCH_OBJECT | OBJ_NOLOCK);
+	if (!interned) {
+		interned = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+		if (!interned || ast_format_cap_append_from_cap(interned, cap, AST_MEDIA_TYPE_UNKNOWN)) {
+			ao2_unlock(interned_caps);
+			ao2_cleanup(interned);
+			return NULL;
+		}
+		interned->framing = cap->framing;
+
+		if (ao2_container_count(interned_caps) >= INTERNED_CAP_MAX) {
+			ao2_callback(interned_caps, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE,
+				interned_cap_unused, NULL);
+		}
+		/* Past the limit the copy is immutable all the same, just not shared. */
+		interned->interned = ++interned_caps_last_id ? interned_caps_last_id : ++interned_caps_last_id;
+		if (ao2_container_count(interned_caps) < INTERNED_CAP_MAX) {
+			ao2_link_flags(interned_caps, interned, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(interned_caps);
+
+	return interned;
+}
+
+static void format_cap_shutdown(void)
+{
+	ao2_cleanup(joint_caps);
+	joint_caps = NULL;
+	ao2_cleanup(interned_caps);
+	interned_caps = NULL;
+}
+
+int ast_format_cap_init(void)
+{
+	interned_caps = ao2_container_alloc(INTERNED_CAP_BUCKETS, interned_cap_hash, interned_cap_cmp);
+	joint_caps = ao2_container_alloc(JOINT_CAP_BUCKETS, format_cap_joint_hash, format_cap_joint_cmp);
+	if (!interned_caps || !joint_caps) {
+		format_cap_shutdown();
+		return -1;
+	}
+
+	ast_register_cleanup(format_cap_shutdown);
+
+	return 0;
+}
@@ -44,6 +44,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/translate.h"
 #include "asterisk/dsp.h"
 #include "asterisk/file.h"
+#include "asterisk/slinear_mix.h"
 
 #if !defined(LOW_MEMORY)
 static void frame_cache_cleanup(void *data);
@@ -52,7 +53,7 @@ static void frame_cache_cleanup(void *data);
 AST_THREADSTORAGE_CUSTOM(frame_cache, NULL, frame_cache_cleanup);
 
 /*!
- * \brief Maximum ast_frame cache size
+ * \brief Maximum ast_frame cache size of each size class
  *
  * In most cases where the frame header cache will be useful, the size
  * of the cache will stay very small.  However, it is not always the case that
@@ -62,14 +63,66 @@ AST_THREADSTORAGE_CUSTOM(frame_cache, NULL, frame_cache_cleanup);
  */
 #define FRAME_CACHE_MAX_SIZE	10
 
+/*!
+ * \brief Payload sizes of the size classes of the frame cache
+ *
+ * A frame duplicated with its payload is allocated with room for the
+ * largest payload of its class, so any cached frame of a class can hold
+ * any payload of the class. The first class holds only a header.
+ */
+static const size_t frame_cache_payloads[] = {
+	0,
+	160,	/* 20 ms of ulaw, alaw or G.722 */
+	320,	/* 20 ms of slin */
+	640,	/* 20 ms of slin16 */
+	1500,	/* A video packet filling a typical MTU */
+	1920,	/* 20 ms of slin48 */
+};
+
+/*! \brief Number of size classes of the frame cache */
+#define FRAME_CACHE_CLASSES ARRAY_LEN(frame_cache_payloads)
+
 /*! \brief This is just so ast_frames, a list head struct for holding a list of
  *  ast_frame structures, is defined. */
 AST_LIST_HEAD_NOLOCK(ast_frames, ast_frame);
 
 struct ast_frame_cache {
-	struct ast_frames list;
-	size_t size;
+	/*! Cached frames of each size class */
+	struct ast_frames list[FRAME_CACHE_CLASSES];
+	/*! Number of cached frames of each size class */
+	size_t size[FRAME_CACHE_CLASSES];
 };
+
+/*! \brief Allocation size of the frames of a size class */
+static size_t frame_cache_class_len(int size_class)
+{
+	if (!frame_cache_payloads[size_class]) {
+		return sizeof(struct ast_frame);
+	}
+	return sizeof(struct ast_frame) + AST_FRIENDLY_OFFSET + frame_cache_payloads[size_class];
+}
+
+/*!
+ * \brief Find the size class of a frame allocation
+ *
+ * \param len Bytes needed
+ * \param exact Only match a class of exactly \a len bytes
+ *
+ * \return The smallest class holding \a len bytes, or -1 if there is none
+ */
+static int frame_cache_class(size_t len, int exact)
+{
+	int size_class;
+
+	for (size_class = 0; size_class < FRAME_CACHE_CLASSES; ++size_class) {
+		size_t class_len = frame_cache_class_len(size_class);
+
+		if (class_len >= len) {
+			return (!exact || class_len == len) ? size_class : -1;
+		}
+	}
+	return -1;
+}
 #endif
 
 struct ast_frame ast_null_frame = { AST_FRAME_NULL, };
@@ -82,12 +135,12 @@ static struct ast_frame *ast_frame_header_new(void)
 	struct ast_frame_cache *frames;
 
 	if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))) {
-		if ((f = AST_LIST_REMOVE_HEAD(&frames->list, frame_list))) {
+		if ((f = AST_LIST_REMOVE_HEAD(&frames->list[0], frame_list))) {
 			size_t mallocd_len = f->mallocd_hdr_len;
 			memset(f, 0, sizeof(*f));
 			f->mallocd_hdr_len = mallocd_len;
 			f->mallocd = AST_MALLOCD_HDR;
-			frames->size--;
+			frames->size[0]--;
 			return f;
 		}
 	}
@@ -108,9 +161,12 @@ static void frame_cache_cleanup(void *data)
 {
 	struct ast_frame_cache *frames = data;
 	struct ast_frame *f;
+	int size_class;
 
-	while ((f = AST_LIST_REMOVE_HEAD(&frames->list, frame_list)))
-		ast_free(f);
+	for (size_class = 0; size_class < FRAME_CACHE_CLASSES; ++size_class) {
+		while ((f = AST_LIST_REMOVE_HEAD(&frames->list[size_class], frame_list)))
+			ast_free(f);
+	}
 
 	ast_free(frames);
 }
@@ -121,20 +177,29 @@ static void __frame_free(struct ast_frame *fr, int cache)
 	if (!fr->mallocd)
 		return;
 
+	if (fr->mallocd & AST_MALLOCD_SHARED) {
+		/* The data and src go away with the last frame sharing them */
+		ao2_cleanup(fr->shared);
+		fr->shared = NULL;
+		fr->mallocd &= ~AST_MALLOCD_SHARED;
+	}
+
 #if !defined(LOW_MEMORY)
 	if (cache && fr->mallocd == AST_MALLOCD_HDR) {
 		/* Cool, only the header is malloc'd, let's just cache those for now
 		 * to keep things simple... */
 		struct ast_frame_cache *frames;
-		if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames))) &&
-		    (frames->size < FRAME_CACHE_MAX_SIZE)) {
+		int size_class = frame_cache_class(fr->mallocd_hdr_len, 1);
+
+		if (size_class >= 0 && (frames = ast_threadstorage_get(&frame_cache, sizeof(*frames))) &&
+		    (frames->size[size_class] < FRAME_CACHE_MAX_SIZE)) {
 			if ((fr->frametype == AST_FRAME_VOICE) || (fr->frametype == AST_FRAME_VIDEO) ||
 				(fr->frametype == AST_FRAME_IMAGE)) {
 				ao2_cleanup(fr->subclass.format);
 			}
 
-			AST_LIST_INSERT_HEAD(&frames->list, fr, frame_list);
-			frames->size++;
+			AST_LIST_INSERT_HEAD(&frames->list[size_class], fr, frame_list);
+			frames->size[size_class]++;
 			return;
 		}
 	}
@@ -196,6 +261,11 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		return ast_frdup(fr);
 	}
 
+	/* a shared frame holds its data, it only needs a header of its own */
+	if (fr->mallocd & AST_MALLOCD_SHARED) {
+		return (fr->mallocd & AST_MALLOCD_HDR) ? fr : ast_frshare(fr);
+	}
+
 	/* if everything is already malloc'd, we are done */
 	if ((fr->mallocd & (AST_MALLOCD_HDR | AST_MALLOCD_SRC | AST_MALLOCD_DATA)) ==
 	    (AST_MALLOCD_HDR | AST_MALLOCD_SRC | AST_MALLOCD_DATA)) {
@@ -280,6 +350,7 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 
 #if !defined(LOW_MEMORY)
 	struct ast_frame_cache *frames;
+	int size_class;
 #endif
 
 	/* Start with standard stuff */
@@ -295,20 +366,17 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 		len += srclen + 1;
 
 #if !defined(LOW_MEMORY)
-	if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))) {
-		AST_LIST_TRAVERSE_SAFE_BEGIN(&frames->list, out, frame_list) {
-			if (out->mallocd_hdr_len >= len) {
-				size_t mallocd_len = out->mallocd_hdr_len;
-
-				AST_LIST_REMOVE_CURRENT(frame_list);
-				memset(out, 0, sizeof(*out));
-				out->mallocd_hdr_len = mallocd_len;
-				buf = out;
-				frames->size--;
-				break;
-			}
+	size_class = frame_cache_class(len, 0);
+	if (size_class >= 0) {
+		/* Allocate the whole class so the frame can be cached for any payload of it */
+		len = frame_cache_class_len(size_class);
+		if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))
+			&& (out = AST_LIST_REMOVE_HEAD(&frames->list[size_class], frame_list))) {
+			memset(out, 0, sizeof(*out));
+			out->mallocd_hdr_len = len;
+			buf = out;
+			frames->size[size_class]--;
 		}
-		AST_LIST_TRAVERSE_SAFE_END;
 	}
 #endif
 
@@ -359,6 +427,96 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 	return out;
 }
 
+/*! \brief Can the data of the frame be shared? */
+static int frame_is_shareable(const struct ast_frame *f)
+{
+	return ((f->frametype == AST_FRAME_VOICE) || (f->frametype == AST_FRAME_VIDEO) ||
+		(f->frametype == AST_FRAME_IMAGE)) && f->datalen > 0;
+}
+
+struct ast_frame *ast_frshare(const struct ast_frame *f)
+{
+	struct ast_frame *out;
+	void *shared;
+	const char *src;
+	int srclen = 0;
+
+	if (!frame_is_shareable(f)) {
+		return ast_frdup(f);
+	}
+
+	if (f->mallocd & AST_MALLOCD_SHARED) {
+		shared = ao2_bump(f->shared);
+		src = f->src;
+	} else {
+		/* Copy the data into a buffer the frames can share */
+		if (f->src) {
+			srclen = strlen(f->src);
+		}
+		shared = ao2_alloc_options(f->datalen + srclen + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!shared) {
+			return NULL;
+		}
+		memcpy(shared, f->data.ptr, f->datalen);
+		if (srclen > 0) {
+			src = (char *) shared + f->datalen;
+			strcpy((char *) src, f->src); /* Safe */
+		} else {
+			src = NULL;
+		}
+	}
+
+	if (!(out = ast_frame_header_new())) {
+		ao2_ref(shared, -1);
+		return NULL;
+	}
+
+	out->frametype = f->frametype;
+	out->subclass.format = ao2_bump(f->subclass.format);
+	out->datalen = f->datalen;
+	out->samples = f->samples;
+	out->delivery = f->delivery;
+	out->mallocd = AST_MALLOCD_HDR | AST_MALLOCD_SHARED;
+	out->offset = 0;
+	out->shared = shared;
+	out->data.ptr = (f->mallocd & AST_MALLOCD_SHARED) ? f->data.ptr : shared;
+	out->src = src;
+	ast_copy_flags(out, f, AST_FLAGS_ALL);
+	out->ts = f->ts;
+	out->len = f->len;
+	out->seqno = f->seqno;
+	return out;
+}
+
+int ast_frame_unshare(struct ast_frame *fr)
+{
+	void *newdata;
+	char *src = NULL;
+
+	if (!(fr->mallocd & AST_MALLOCD_SHARED)) {
+		return 0;
+	}
+
+	if (fr->src && !(src = ast_strdup(fr->src))) {
+		return -1;
+	}
+	if (!(newdata = ast_malloc(fr->datalen + AST_FRIENDLY_OFFSET))) {
+		ast_free(src);
+		return -1;
+	}
+	newdata += AST_FRIENDLY_OFFSET;
+	memcpy(newdata, fr->data.ptr, fr->datalen);
+
+	ao2_ref(fr->shared, -1);
+	fr->shared = NULL;
+	fr->data.ptr = newdata;
+	fr->offset = AST_FRIENDLY_OFFSET;
+	fr->src = src;
+	fr->mallocd &= ~AST_MALLOCD_SHARED;
+	fr->mallocd |= AST_MALLOCD_DATA | AST_MALLOCD_SRC;
+	return 0;
+}
+
 void ast_swapcopy_samples(void *dst, const void *src, int samples)
 {
 	int i;
@@ -649,10 +807,6 @@ void ast_frame_dump(const char *name, struct ast_frame *f, char *prefix)
 
 int ast_frame_adjust_volume(struct ast_frame *f, int adjustment)
 {
-	int count;
-	short *fdata = f->data.ptr;
-	short adjust_value = abs(adjustment);
-
 	if ((f->frametype != AST_FRAME_VOICE) || !(ast_format_cache_is_slinear(f->subclass.format))) {
 		return -1;
 	}
@@ -661,22 +815,13 @@ int ast_frame_adjust_volume(struct ast_frame *f, int adjustment)
 		return 0;
 	}
 
-	for (count = 0; count < f->samples; count++) {
-		if (adjustment > 0) {
-			ast_slinear_saturated_multiply(&fdata[count], &adjust_value);
-		} else if (adjustment < 0) {
-			ast_slinear_saturated_divide(&fdata[count], &adjust_value);
-		}
-	}
+	ast_slinear_adjust_volume_block(f->data.ptr, adjustment, f->samples);
 
 	return 0;
 }
 
 int ast_frame_slinear_sum(struct ast_frame *f1, struct ast_frame *f2)
 {
-	int count;
-	short *data1, *data2;
-
 	if ((f1->frametype != AST_FRAME_VOICE) || (ast_format_cmp(f1->subclass.format, ast_format_slin) != AST_FORMAT_CMP_NOT_EQUAL))
 		return -1;
 
@@ -686,10 +831,7 @@ int ast_frame_slinear_sum(struct ast_frame *f1, struct ast_frame *f2)
 	if (f1->samples != f2->samples)
 		return -1;
 
-	for (count = 0, data1 = f1->data.ptr, data2 = f2->data.ptr;
-	     count < f1->samples;
-	     count++, data1++, data2++)
-		ast_slinear_saturated_add(data1, data2);
+	ast_slinear_saturated_add_block(f1->data.ptr, f2->data.ptr, f1->samples);
 
 	return 0;
 }
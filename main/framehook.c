@@ -53,6 +53,10 @@ struct ast_framehook_list {
 	unsigned int count;
 	/*! id for next framehook added */
 	unsigned int id_count;
+	/*! the number of hooks signaled for destruction but not yet detached */
+	unsigned int dying;
+	/*! frame types wanted by any live hook, indexed by read or write event */
+	unsigned int frame_types[2];
 	AST_LIST_HEAD_NOLOCK(, ast_framehook) list;
 };
 
@@ -82,6 +86,43 @@ static void framehook_detach(struct ast_framehook *framehook, enum framehook_det
 	ast_free(framehook);
 }
 
+/*! \brief Whether a framehook wants a frame pushed with a read or write event */
+static int framehook_wants(struct ast_framehook *framehook, struct ast_frame *frame,
+	enum ast_framehook_event event)
+{
+	if (!frame) {
+		/* NULL frames are passed to every hook, as they always were. */
+		return 1;
+	}
+	if (framehook->i.events && !(framehook->i.events & AST_FRAMEHOOK_BIT(event))) {
+		return 0;
+	}
+	return !framehook->i.frame_types
+		|| (framehook->i.frame_types & AST_FRAMEHOOK_BIT(frame->frametype));
+}
+
+/*! \brief Recompute the frame types the live hooks of a list want */
+static void framehook_list_update_types(struct ast_framehook_list *framehooks)
+{
+	struct ast_framehook *framehook;
+
+	framehooks->frame_types[AST_FRAMEHOOK_EVENT_READ] = 0;
+	framehooks->frame_types[AST_FRAMEHOOK_EVENT_WRITE] = 0;
+	AST_LIST_TRAVERSE(&framehooks->list, framehook, list) {
+		unsigned int frame_types = framehook->i.frame_types ? framehook->i.frame_types : ~0U;
+
+		if (framehook->detach_and_destroy_me) {
+			continue;
+		}
+		if (!framehook->i.events || (framehook->i.events & AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_READ))) {
+			framehooks->frame_types[AST_FRAMEHOOK_EVENT_READ] |= frame_types;
+		}
+		if (!framehook->i.events || (framehook->i.events & AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_WRITE))) {
+			framehooks->frame_types[AST_FRAMEHOOK_EVENT_WRITE] |= frame_types;
+		}
+	}
+}
+
 static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *framehooks, struct ast_frame *frame, enum ast_framehook_event event)
 {
 	struct ast_framehook *framehook;
@@ -93,6 +134,11 @@ static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *fr
 		return frame;
 	}
 
+	/* Nothing to do unless a hook wants the frame or is waiting to be detached. */
+	if (frame && !ast_framehook_list_wants_frame_type(framehooks, event, frame->frametype)) {
+		return frame;
+	}
+
 	skip_size = sizeof(int) * framehooks->count;
 	skip = ast_alloca(skip_size);
 	memset(skip, 0, skip_size);
@@ -105,12 +151,13 @@ static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *fr
 			if (framehook->detach_and_destroy_me) {
 				/* this guy is signaled for destruction */
 				AST_LIST_REMOVE_CURRENT(list);
+				framehooks->dying--;
 				framehook_detach(framehook, FRAMEHOOK_DETACH_DESTROY);
 				continue;
 			}
 
 			/* If this framehook has been marked as needing to be skipped, do so */
-			if (skip[num]) {
+			if (skip[num] || !framehook_wants(framehook, frame, event)) {
 				num++;
 				continue;
 			}
@@ -159,6 +206,7 @@ int ast_framehook_attach(struct ast_channel *chan, struct ast_framehook_interfac
 	ast_channel_framehooks(chan)->count++;
 	framehook->id = ++ast_channel_framehooks(chan)->id_count;
 	AST_LIST_INSERT_TAIL(&ast_channel_framehooks(chan)->list, framehook, list);
+	framehook_list_update_types(ast_channel_framehooks(chan));
 
 	/* Tell the event callback we're live and rocking */
 	frame = framehook->i.event_cb(framehook->chan, NULL, AST_FRAMEHOOK_EVENT_ATTACHED, framehook->i.data);
@@ -191,7 +239,11 @@ int ast_framehook_detach(struct ast_channel *chan, int id)
 			 * it needs to be safe for this function to be called within the
 			 * event callback.  If we allowed the hook to actually be destroyed
 			 * immediately here, the event callback would crash on exit. */
-			framehook->detach_and_destroy_me = 1;
+			if (!framehook->detach_and_destroy_me) {
+				framehook->detach_and_destroy_me = 1;
+				ast_channel_framehooks(chan)->dying++;
+				framehook_list_update_types(ast_channel_framehooks(chan));
+			}
 			res = 0;
 			break;
 		}
@@ -271,6 +323,8 @@ void ast_framehook_list_fixup(struct ast_channel *old_chan, struct ast_channel *
 			framehook_detach(framehook, FRAMEHOOK_DETACH_PRESERVE);
 		}
 	}
+	ast_channel_framehooks(old_chan)->dying = 0;
+	framehook_list_update_types(ast_channel_framehooks(old_chan));
 }
 
 int ast_framehook_list_is_empty(struct ast_framehook_list *framehooks)
@@ -303,6 +357,9 @@ int ast_framehook_list_contains_no_active_of_type(struct ast_framehook_list *fra
 		if (cur->detach_and_destroy_me) {
 			continue;
 		}
+		if (type && cur->i.frame_types && !(cur->i.frame_types & AST_FRAMEHOOK_BIT(type))) {
+			continue;
+		}
 		if (type && cur->i.consume_cb && !cur->i.consume_cb(cur->i.data, type)) {
 			continue;
 		}
@@ -312,6 +369,16 @@ int ast_framehook_list_contains_no_active_of_type(struct ast_framehook_list *fra
 	return 1;
 }
 
+int ast_framehook_list_wants_frame_type(struct ast_framehook_list *framehooks,
+	enum ast_framehook_event event, enum ast_frame_type type)
+{
+	if (!framehooks) {
+		return 0;
+	}
+
+	return framehooks->dying || (framehooks->frame_types[event] & AST_FRAMEHOOK_BIT(type)) ? 1 : 0;
+}
+
 struct ast_frame *ast_framehook_list_write_event(struct ast_framehook_list *framehooks, struct ast_frame *frame)
 {
 	return framehook_list_push_event(framehooks, frame, AST_FRAMEHOOK_EVENT_WRITE);
@@ -51,6 +51,12 @@ ASTERISK_REGISTER_FILE()
 #include <sys/stat.h>
 #include <sys/signal.h>
 #include <fcntl.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+#if defined(HAVE_SENDFILE) && defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 #include "asterisk/paths.h"	/* use ast_config_AST_DATA_DIR */
 #include "asterisk/cli.h"
@@ -66,6 +72,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/astobj2.h"
 #include "asterisk/netsock2.h"
 #include "asterisk/json.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/metrics.h"
 
 #define MAX_PREFIX 80
 #define DEFAULT_PORT 8088
@@ -102,6 +110,8 @@ static int session_limit = DEFAULT_SESSION_LIMIT;
 static int session_inactivity = DEFAULT_SESSION_INACTIVITY;
 static int session_keep_alive = DEFAULT_SESSION_KEEP_ALIVE;
 static int session_count = 0;
+/*! Threads serving parked connections, 0 to keep each connection on its own thread */
+static int session_workers;
 
 static struct ast_tls_config http_tls_cfg;
 
@@ -135,6 +145,7 @@ static AST_RWLIST_HEAD_STATIC(uris, ast_http_uri);	/*!< list of supported handle
 /* all valid URIs must be prepended by the string in prefix. */
 static char prefix[MAX_PREFIX];
 static int enablestatic;
+static int enablemetrics;
 
 /*! \brief Limit the kinds of files we're willing to serve up */
 static struct {
@@ -244,11 +255,6 @@ static int static_callback(struct ast_tcptls_session_instance *ser,
 	int len;
 	int fd;
 	struct ast_str *http_header;
-	struct timeval tv;
-	struct ast_tm tm;
-	char timebuf[80], etag[23];
-	struct ast_variable *v;
-	int not_modified = 0;
 
 	if (method != AST_HTTP_GET && method != AST_HTTP_HEAD) {
 		ast_http_error(ser, 501, "Not Implemented", "Attempt to use unimplemented / unsupported method");
@@ -303,24 +309,6 @@ static int static_callback(struct ast_tcptls_session_instance *ser,
 		goto out403;
 	}
 
-	/* make "Etag:" http header value */
-	snprintf(etag, sizeof(etag), "\"%ld\"", (long)st.st_mtime);
-
-	/* make "Last-Modified:" http header value */
-	tv.tv_sec = st.st_mtime;
-	tv.tv_usec = 0;
-	ast_strftime(timebuf, sizeof(timebuf), "%a, %d %b %Y %H:%M:%S GMT", ast_localtime(&tv, &tm, "GMT"));
-
-	/* check received "If-None-Match" request header and Etag value for file */
-	for (v = headers; v; v = v->next) {
-		if (!strcasecmp(v->name, "If-None-Match")) {
-			if (!strcasecmp(v->value, etag)) {
-				not_modified = 1;
-			}
-			break;
-		}
-	}
-
 	http_header = ast_str_create(255);
 	if (!http_header) {
 		ast_http_request_close_on_completion(ser);
@@ -329,19 +317,10 @@ static int static_callback(struct ast_tcptls_session_instance *ser,
 		return 0;
 	}
 
-	ast_str_set(&http_header, 0, "Content-type: %s\r\n"
-		"ETag: %s\r\n"
-		"Last-Modified: %s\r\n",
-		mtype,
-		etag,
-		timebuf);
+	ast_str_set(&http_header, 0, "Content-type: %s\r\n", mtype);
 
-	/* ast_http_send() frees http_header, so we don't need to do it before returning */
-	if (not_modified) {
-		ast_http_send(ser, method, 304, "Not Modified", http_header, NULL, 0, 1);
-	} else {
-		ast_http_send(ser, method, 200, NULL, http_header, NULL, fd, 1); /* static content flag is set */
-	}
+	/* ast_http_send_file() frees http_header, so we don't need to do it before returning */
+	ast_http_send_file(ser, method, headers, http_header, fd, 1); /* static content flag is set */
 	close(fd);
 	return 0;
 
@@ -408,6 +387,41 @@ static int httpstatus_callback(struct ast_tcptls_session_instance *ser,
 	return 0;
 }
 
+static int metrics_callback(struct ast_tcptls_session_instance *ser,
+	const struct ast_http_uri *urih, const char *uri,
+	enum ast_http_method method, struct ast_variable *get_vars,
+	struct ast_variable *headers)
+{
+	struct ast_str *out;
+	struct ast_str *http_header;
+
+	if (method != AST_HTTP_GET && method != AST_HTTP_HEAD) {
+		ast_http_error(ser, 501, "Not Implemented", "Attempt to use unimplemented / unsupported method");
+		return 0;
+	}
+
+	if (!enablemetrics) {
+		ast_http_error(ser, 404, "Not Found", "The requested URL was not found on this server.");
+		return 0;
+	}
+
+	out = ast_str_create(16384);
+	http_header = ast_str_create(64);
+	if (!out || !http_header) {
+		ast_free(out);
+		ast_free(http_header);
+		ast_http_request_close_on_completion(ser);
+		ast_http_error(ser, 500, "Server Error", "Out of memory");
+		return 0;
+	}
+
+	ast_metrics_render(&out);
+
+	ast_str_set(&http_header, 0, "Content-type: text/plain; version=0.0.4\r\n");
+	ast_http_send(ser, method, 200, NULL, http_header, out, 0, 0);
+	return 0;
+}
+
 static struct ast_http_uri statusuri = {
 	.callback = httpstatus_callback,
 	.description = "Asterisk HTTP General Status",
@@ -426,6 +440,15 @@ static struct ast_http_uri staticuri = {
 	.key= __FILE__,
 };
 
+static struct ast_http_uri metricsuri = {
+	.callback = metrics_callback,
+	.description = "Asterisk Metrics in the Prometheus Text Format",
+	.uri = "metrics",
+	.has_subtree = 0,
+	.data = NULL,
+	.key = __FILE__,
+};
+
 enum http_private_flags {
 	/*! TRUE if the HTTP request has a body. */
 	HTTP_FLAG_HAS_BODY = (1 << 0),
@@ -443,15 +466,75 @@ struct http_worker_private_data {
 	struct ast_flags flags;
 };
 
-void ast_http_send(struct ast_tcptls_session_instance *ser,
+/*!
+ * \internal
+ * \brief Send part of a file as the body of a response
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int http_send_fd(struct ast_tcptls_session_instance *ser, int fd, off_t offset, off_t length)
+{
+	char buf[8192];
+	ssize_t len;
+
+#if defined(HAVE_SENDFILE) && defined(__linux__)
+	if (!ser->ssl) {
+		/* Without TLS the file can go straight to the socket, after what is buffered */
+		if (fflush(ser->f)) {
+			return -1;
+		}
+		while (length > 0) {
+			len = sendfile(ser->fd, fd, &offset, MIN(length, 1 << 30));
+			if (len > 0) {
+				length -= len;
+			} else if (!len) {
+				/* The file is shorter than it was */
+				return -1;
+			} else if (errno == EAGAIN) {
+				if (ast_wait_for_output(ser->fd, session_inactivity) <= 0) {
+					return -1;
+				}
+			} else if (errno == EINVAL || errno == ENOSYS) {
+				/* Not a file sendfile() can send, so copy it instead */
+				break;
+			} else if (errno != EINTR) {
+				return -1;
+			}
+		}
+	}
+#endif
+
+	while (length > 0) {
+		if ((len = pread(fd, buf, MIN(sizeof(buf), length), offset)) <= 0) {
+			return -1;
+		}
+		if (fwrite(buf, len, 1, ser->f) != 1) {
+			return -1;
+		}
+		offset += len;
+		length -= len;
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Send a response, with part of a file as its body
+ *
+ * \param fd The file, or a descriptor below 1 for none.
+ * \param offset Where in the file the body starts.
+ * \param length How much of the file is sent.
+ */
+static void http_send_range(struct ast_tcptls_session_instance *ser,
 	enum ast_http_method method, int status_code, const char *status_title,
-	struct ast_str *http_header, struct ast_str *out, int fd,
+	struct ast_str *http_header, struct ast_str *out, int fd, off_t offset, off_t length,
 	unsigned int static_content)
 {
 	struct timeval now = ast_tvnow();
 	struct ast_tm tm;
 	char timebuf[80];
-	int content_length = 0;
+	off_t content_length = 0;
 	int close_connection;
 	struct ast_str *server_header_field = ast_str_create(MAX_SERVER_NAME_LENGTH);
 
@@ -499,9 +582,8 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 		content_length += ast_str_strlen(out);
 	}
 
-	if (fd) {
-		content_length += lseek(fd, 0, SEEK_END);
-		lseek(fd, 0, SEEK_SET);
+	if (fd > 0) {
+		content_length += length;
 	}
 
 	/* send http header */
@@ -512,7 +594,7 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 		"%s"
 		"%s"
 		"%s"
-		"Content-Length: %d\r\n"
+		"Content-Length: %jd\r\n"
 		"\r\n",
 		status_code, status_title ? status_title : "OK",
 		ast_str_buffer(server_header_field),
@@ -520,7 +602,7 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 		close_connection ? "Connection: close\r\n" : "",
 		static_content ? "" : "Cache-Control: no-cache, no-store\r\n",
 		http_header ? ast_str_buffer(http_header) : "",
-		content_length
+		(intmax_t) content_length
 		);
 
 	/* send content */
@@ -532,17 +614,9 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 			}
 		}
 
-		if (fd) {
-			char buf[256];
-			int len;
-
-			while ((len = read(fd, buf, sizeof(buf))) > 0) {
-				if (fwrite(buf, len, 1, ser->f) != 1) {
-					ast_log(LOG_WARNING, "fwrite() failed: %s\n", strerror(errno));
-					close_connection = 1;
-					break;
-				}
-			}
+		if (fd > 0 && http_send_fd(ser, fd, offset, length)) {
+			ast_log(LOG_WARNING, "Sending file failed: %s\n", strerror(errno));
+			close_connection = 1;
 		}
 	}
 
@@ -558,6 +632,161 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 	}
 }
 
+void ast_http_send(struct ast_tcptls_session_instance *ser,
+	enum ast_http_method method, int status_code, const char *status_title,
+	struct ast_str *http_header, struct ast_str *out, int fd,
+	unsigned int static_content)
+{
+	off_t length = 0;
+
+	if (fd > 0) {
+		length = lseek(fd, 0, SEEK_END);
+		lseek(fd, 0, SEEK_SET);
+		if (length < 0) {
+			length = 0;
+		}
+	}
+	http_send_range(ser, method, status_code, status_title, http_header, out, fd, 0, length,
+		static_content);
+}
+
+int ast_http_etag_match(struct ast_variable *headers, const char *etag)
+{
+	struct ast_variable *v;
+
+	for (v = headers; v; v = v->next) {
+		if (!strcasecmp(v->name, "If-None-Match")) {
+			return !strcmp(v->value, "*") || strstr(v->value, etag);
+		}
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Parse a Range request header
+ *
+ * Only a single range is served, a request for several getting the whole file.
+ *
+ * \retval 1 The range is in \a offset and \a length.
+ * \retval 0 There is no range to serve, so the whole file is sent.
+ * \retval -1 The range is beyond the end of the file.
+ */
+static int http_parse_range(const char *range, off_t size, off_t *offset, off_t *length)
+{
+	long long first;
+	long long last;
+	char *end;
+
+	if (strncasecmp(range, "bytes=", 6) || strchr(range, ',')) {
+		return 0;
+	}
+	range = ast_skip_blanks(range + 6);
+
+	if (*range == '-') {
+		/* The last bytes of the file */
+		last = strtoll(range + 1, &end, 10);
+		if (end == range + 1 || !ast_strlen_zero(ast_skip_blanks(end))) {
+			return 0;
+		}
+		if (last <= 0 || !size) {
+			return -1;
+		}
+		*length = MIN(last, size);
+		*offset = size - *length;
+		return 1;
+	}
+
+	first = strtoll(range, &end, 10);
+	if (end == range || *end != '-') {
+		return 0;
+	}
+	range = end + 1;
+	if (ast_strlen_zero(ast_skip_blanks(range))) {
+		last = size - 1;
+	} else {
+		last = strtoll(range, &end, 10);
+		if (end == range || !ast_strlen_zero(ast_skip_blanks(end)) || last < first) {
+			return 0;
+		}
+	}
+	if (first >= size) {
+		return -1;
+	}
+	*offset = first;
+	*length = MIN(last, size - 1) - first + 1;
+	return 1;
+}
+
+void ast_http_send_file(struct ast_tcptls_session_instance *ser,
+	enum ast_http_method method, struct ast_variable *headers,
+	struct ast_str *http_header, int fd, unsigned int static_content)
+{
+	struct ast_variable *v;
+	const char *range = NULL;
+	const char *if_range = NULL;
+	struct stat st;
+	struct timeval tv;
+	struct ast_tm tm;
+	char timebuf[80];
+	char etag[48];
+	off_t offset;
+	off_t length;
+
+	if (!http_header && !(http_header = ast_str_create(128))) {
+		ast_http_request_close_on_completion(ser);
+		ast_http_error(ser, 500, "Server Error", "Out of memory");
+		return;
+	}
+	if (fstat(fd, &st)) {
+		ast_free(http_header);
+		ast_http_error(ser, 500, "Server Error", "Could not read file");
+		return;
+	}
+
+	/* The file is taken to be the same as long as its time and size are */
+	snprintf(etag, sizeof(etag), "\"%lx-%jx\"", (long) st.st_mtime, (intmax_t) st.st_size);
+	tv.tv_sec = st.st_mtime;
+	tv.tv_usec = 0;
+	ast_strftime(timebuf, sizeof(timebuf), "%a, %d %b %Y %H:%M:%S GMT", ast_localtime(&tv, &tm, "GMT"));
+	ast_str_append(&http_header, 0, "ETag: %s\r\n"
+		"Last-Modified: %s\r\n"
+		"Accept-Ranges: bytes\r\n",
+		etag, timebuf);
+
+	if (ast_http_etag_match(headers, etag)) {
+		http_send_range(ser, method, 304, "Not Modified", http_header, NULL, 0, 0, 0, static_content);
+		return;
+	}
+
+	for (v = headers; v; v = v->next) {
+		if (!strcasecmp(v->name, "Range")) {
+			range = v->value;
+		} else if (!strcasecmp(v->name, "If-Range")) {
+			if_range = v->value;
+		}
+	}
+
+	/* A range of a file that has changed since is not wanted, the whole file is */
+	if (range && (!if_range || !strcmp(if_range, etag))) {
+		switch (http_parse_range(range, st.st_size, &offset, &length)) {
+		case 1:
+			ast_str_append(&http_header, 0, "Content-Range: bytes %jd-%jd/%jd\r\n",
+				(intmax_t) offset, (intmax_t) (offset + length - 1), (intmax_t) st.st_size);
+			http_send_range(ser, method, 206, "Partial Content", http_header, NULL, fd,
+				offset, length, static_content);
+			return;
+		case -1:
+			ast_str_append(&http_header, 0, "Content-Range: bytes */%jd\r\n", (intmax_t) st.st_size);
+			http_send_range(ser, method, 416, "Range Not Satisfiable", http_header, NULL, 0,
+				0, 0, static_content);
+			return;
+		}
+	}
+
+	http_send_range(ser, method, 200, NULL, http_header, NULL, fd, 0, st.st_size, static_content);
+}
+
 void ast_http_create_response(struct ast_tcptls_session_instance *ser, int status_code,
 	const char *status_title, struct ast_str *http_header_data, const char *text)
 {
@@ -1910,6 +2139,297 @@ static int httpd_process_request(struct ast_tcptls_session_instance *ser)
 	return res;
 }
 
+/*!
+ * \internal
+ * \brief Close a connection once done with it
+ *
+ * \param ser The connection, whose reference is released.
+ */
+static void httpd_session_close(struct ast_tcptls_session_instance *ser)
+{
+	ast_atomic_fetchadd_int(&session_count, -1);
+
+	if (ser->f) {
+		ast_debug(1, "HTTP closing session.  Top level\n");
+		ast_tcptls_close_session_file(ser);
+	}
+	ao2_ref(ser, -1);
+}
+
+static void httpd_serve(struct ast_tcptls_session_instance *ser, int timeout);
+
+#ifdef HAVE_EPOLL
+/*!
+ * Connections waiting for their next request are parked in an epoll set
+ * instead of each holding a thread. When a request comes in, the connection
+ * is served by one of the session_workers threads until it is parked again.
+ */
+
+/*! \brief A connection waiting for its next request */
+struct http_parked {
+	struct ast_tcptls_session_instance *ser;
+	struct timeval expires;
+	AST_LIST_ENTRY(http_parked) list;
+};
+
+static AST_LIST_HEAD_STATIC(parked_sessions, http_parked);
+
+/*! \brief Number of parked connections */
+static int parked_count;
+
+/*! \brief The epoll set of the parked connections */
+static int park_epfd = -1;
+
+/*! \brief The thread waiting on the parked connections */
+static pthread_t park_thread = AST_PTHREADT_NULL;
+
+/*! \brief Set to stop park_thread */
+static int park_stop;
+
+/*! \brief The threads serving the requests of parked connections */
+static struct ast_threadpool *park_pool;
+
+/*! \brief Serve the connection of a parked connection that has a request */
+static int http_park_resume(void *data)
+{
+	httpd_serve(data, session_keep_alive);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Park a connection until its next request
+ *
+ * \param ser The connection, whose reference is taken if it is parked.
+ * \param timeout How long to wait for the request, in ms.
+ *
+ * \retval 0 The connection is parked and must not be touched.
+ * \retval -1 It could not be parked.
+ */
+static int http_park(struct ast_tcptls_session_instance *ser, int timeout)
+{
+	struct http_parked *parked;
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, };
+
+	if (!(parked = ast_calloc(1, sizeof(*parked)))) {
+		return -1;
+	}
+	parked->ser = ser;
+	parked->expires = ast_tvadd(ast_tvnow(), ast_samp2tv(timeout, 1000));
+	ev.data.ptr = parked;
+
+	AST_LIST_LOCK(&parked_sessions);
+	if (park_stop || epoll_ctl(park_epfd, EPOLL_CTL_ADD, ser->fd, &ev)) {
+		AST_LIST_UNLOCK(&parked_sessions);
+		ast_free(parked);
+		return -1;
+	}
+	AST_LIST_INSERT_TAIL(&parked_sessions, parked, list);
+	++parked_count;
+	AST_LIST_UNLOCK(&parked_sessions);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Take a connection out of the parked ones
+ *
+ * \note The parked sessions list must be locked.
+ *
+ * \return The connection
+ */
+static struct ast_tcptls_session_instance *http_unpark(struct http_parked *parked)
+{
+	struct ast_tcptls_session_instance *ser = parked->ser;
+
+	epoll_ctl(park_epfd, EPOLL_CTL_DEL, ser->fd, NULL);
+	AST_LIST_REMOVE(&parked_sessions, parked, list);
+	--parked_count;
+	ast_free(parked);
+	return ser;
+}
+
+/*! \brief Hand parked connections with a request to the workers, and close idle ones */
+static void *http_park_monitor(void *data)
+{
+	struct epoll_event events[64];
+	AST_LIST_HEAD_NOLOCK(, http_parked) expired;
+
+	while (!park_stop) {
+		struct http_parked *parked;
+		struct timeval now;
+		int res;
+		int i;
+
+		res = epoll_wait(park_epfd, events, ARRAY_LEN(events), 1000);
+		if (res < 0 && errno != EINTR) {
+			ast_log(LOG_WARNING, "epoll_wait() on parked HTTP sessions failed: %s\n",
+				strerror(errno));
+			usleep(100000);
+		}
+
+		AST_LIST_HEAD_INIT_NOLOCK(&expired);
+		AST_LIST_LOCK(&parked_sessions);
+		for (i = 0; i < res; ++i) {
+			struct ast_tcptls_session_instance *ser = http_unpark(events[i].data.ptr);
+
+			if (ast_threadpool_push(park_pool, http_park_resume, ser)) {
+				httpd_session_close(ser);
+			}
+		}
+
+		now = ast_tvnow();
+		AST_LIST_TRAVERSE_SAFE_BEGIN(&parked_sessions, parked, list) {
+			if (ast_tvcmp(parked->expires, now) > 0) {
+				continue;
+			}
+			epoll_ctl(park_epfd, EPOLL_CTL_DEL, parked->ser->fd, NULL);
+			AST_LIST_REMOVE_CURRENT(list);
+			--parked_count;
+			AST_LIST_INSERT_TAIL(&expired, parked, list);
+		}
+		AST_LIST_TRAVERSE_SAFE_END;
+		AST_LIST_UNLOCK(&parked_sessions);
+
+		while ((parked = AST_LIST_REMOVE_HEAD(&expired, list))) {
+			ast_debug(1, "HTTP idle timeout of parked session.\n");
+			httpd_session_close(parked->ser);
+			ast_free(parked);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start parking connections, or resize the workers
+ *
+ * Once started, parking continues until shutdown, any connection already
+ * parked needing the workers.
+ */
+static void http_park_start(void)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = session_workers,
+		.max_size = 0,
+	};
+
+	if (!session_workers) {
+		return;
+	}
+	if (park_pool) {
+		ast_threadpool_set_size(park_pool, session_workers);
+		return;
+	}
+
+	if ((park_epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		ast_log(LOG_WARNING, "Unable to create the epoll set for parked HTTP sessions: %s\n",
+			strerror(errno));
+		return;
+	}
+	if (!(park_pool = ast_threadpool_create("http-session", NULL, &options))) {
+		close(park_epfd);
+		park_epfd = -1;
+		return;
+	}
+	if (ast_pthread_create_background(&park_thread, NULL, http_park_monitor, NULL)) {
+		ast_log(LOG_WARNING, "Unable to start the parked HTTP session thread\n");
+		park_thread = AST_PTHREADT_NULL;
+		ast_threadpool_shutdown(park_pool);
+		park_pool = NULL;
+		close(park_epfd);
+		park_epfd = -1;
+	}
+}
+
+static void http_park_stop(void)
+{
+	struct http_parked *parked;
+
+	if (park_thread == AST_PTHREADT_NULL) {
+		return;
+	}
+
+	AST_LIST_LOCK(&parked_sessions);
+	park_stop = 1;
+	AST_LIST_UNLOCK(&parked_sessions);
+	pthread_join(park_thread, NULL);
+	park_thread = AST_PTHREADT_NULL;
+
+	AST_LIST_LOCK(&parked_sessions);
+	while ((parked = AST_LIST_FIRST(&parked_sessions))) {
+		httpd_session_close(http_unpark(parked));
+	}
+	AST_LIST_UNLOCK(&parked_sessions);
+
+	ast_threadpool_shutdown(park_pool);
+	park_pool = NULL;
+	close(park_epfd);
+	park_epfd = -1;
+}
+#endif	/* HAVE_EPOLL */
+
+/*!
+ * \internal
+ * \brief Serve the requests of a connection until it is closed or parked
+ *
+ * \param ser The connection, whose reference is taken.
+ * \param timeout How long to wait for the first request, in ms.
+ */
+static void httpd_serve(struct ast_tcptls_session_instance *ser, int timeout)
+{
+	for (;;) {
+		int ch;
+		int waited = 0;
+
+#ifdef HAVE_EPOLL
+		if (session_workers && park_thread != AST_PTHREADT_NULL) {
+			/* Only read what has already come in, otherwise wait without a thread */
+			ast_tcptls_stream_set_exclusive_input(ser->stream_cookie, 0);
+			ch = fgetc(ser->f);
+			ast_tcptls_stream_set_exclusive_input(ser->stream_cookie, 1);
+			if (ch != EOF || !ferror(ser->f) || errno != EAGAIN) {
+				waited = 1;
+			} else {
+				clearerr(ser->f);
+				if (!http_park(ser, timeout)) {
+					return;
+				}
+			}
+		}
+#endif
+
+		if (!waited) {
+			/* Wait for next potential HTTP request message. */
+			ast_tcptls_stream_set_timeout_inactivity(ser->stream_cookie, timeout);
+			ch = fgetc(ser->f);
+		}
+		if (ch == EOF || ungetc(ch, ser->f) == EOF) {
+			/* Between request idle timeout */
+			ast_debug(1, "HTTP idle timeout or peer closed connection.\n");
+			break;
+		}
+
+		ast_tcptls_stream_set_timeout_inactivity(ser->stream_cookie, session_inactivity);
+		if (httpd_process_request(ser) || !ser->f || feof(ser->f)) {
+			/* Break the connection or the connection closed */
+			break;
+		}
+
+		timeout = session_keep_alive;
+		if (timeout <= 0) {
+			/* Persistent connections not enabled. */
+			break;
+		}
+	}
+
+	httpd_session_close(ser);
+}
+
 static void *httpd_helper_thread(void *data)
 {
 	struct ast_tcptls_session_instance *ser = data;
@@ -1975,39 +2495,11 @@ static void *httpd_helper_thread(void *data)
 	/* We can let the stream wait for data to arrive. */
 	ast_tcptls_stream_set_exclusive_input(ser->stream_cookie, 1);
 
-	for (;;) {
-		int ch;
-
-		/* Wait for next potential HTTP request message. */
-		ast_tcptls_stream_set_timeout_inactivity(ser->stream_cookie, timeout);
-		ch = fgetc(ser->f);
-		if (ch == EOF || ungetc(ch, ser->f) == EOF) {
-			/* Between request idle timeout */
-			ast_debug(1, "HTTP idle timeout or peer closed connection.\n");
-			break;
-		}
-
-		ast_tcptls_stream_set_timeout_inactivity(ser->stream_cookie, session_inactivity);
-		if (httpd_process_request(ser) || !ser->f || feof(ser->f)) {
-			/* Break the connection or the connection closed */
-			break;
-		}
-
-		timeout = session_keep_alive;
-		if (timeout <= 0) {
-			/* Persistent connections not enabled. */
-			break;
-		}
-	}
+	httpd_serve(ser, timeout);
+	return NULL;
 
 done:
-	ast_atomic_fetchadd_int(&session_count, -1);
-
-	if (ser->f) {
-		ast_debug(1, "HTTP closing session.  Top level\n");
-		ast_tcptls_close_session_file(ser);
-	}
-	ao2_ref(ser, -1);
+	httpd_session_close(ser);
 	return NULL;
 }
 
@@ -2075,6 +2567,7 @@ static int __ast_http_load(int reload)
 	struct ast_variable *v;
 	int enabled=0;
 	int newenablestatic=0;
+	int newenablemetrics=0;
 	char newprefix[MAX_PREFIX] = "";
 	char server_name[MAX_SERVER_NAME_LENGTH];
 	struct http_uri_redirect *redirect;
@@ -2118,6 +2611,7 @@ static int __ast_http_load(int reload)
 	session_limit = DEFAULT_SESSION_LIMIT;
 	session_inactivity = DEFAULT_SESSION_INACTIVITY;
 	session_keep_alive = DEFAULT_SESSION_KEEP_ALIVE;
+	session_workers = 0;
 
 	snprintf(server_name, sizeof(server_name), "Asterisk/%s", ast_get_version());
 
@@ -2147,6 +2641,8 @@ static int __ast_http_load(int reload)
 			enabled = ast_true(v->value);
 		} else if (!strcasecmp(v->name, "enablestatic")) {
 			newenablestatic = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "enablemetrics")) {
+			newenablemetrics = ast_true(v->value);
 		} else if (!strcasecmp(v->name, "bindport")) {
 			if (ast_parse_arg(v->value, PARSE_UINT32 | PARSE_IN_RANGE | PARSE_DEFAULT,
 				&bindport, DEFAULT_PORT, 0, 65535)) {
@@ -2185,6 +2681,18 @@ static int __ast_http_load(int reload)
 				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of http.conf\n",
 					v->name, v->value, v->lineno);
 			}
+		} else if (!strcasecmp(v->name, "session_workers")) {
+			if (ast_parse_arg(v->value, PARSE_INT32 | PARSE_DEFAULT | PARSE_IN_RANGE,
+				&session_workers, 0, 0, INT_MAX)) {
+				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of http.conf\n",
+					v->name, v->value, v->lineno);
+			}
+#ifndef HAVE_EPOLL
+			if (session_workers) {
+				ast_log(LOG_WARNING, "session_workers requires epoll, ignoring it\n");
+				session_workers = 0;
+			}
+#endif
 		} else {
 			ast_log(LOG_WARNING, "Ignoring unknown option '%s' in http.conf\n", v->name);
 		}
@@ -2198,6 +2706,11 @@ static int __ast_http_load(int reload)
 
 	ast_copy_string(http_server_name, server_name, sizeof(http_server_name));
 	enablestatic = newenablestatic;
+	enablemetrics = newenablemetrics;
+
+#ifdef HAVE_EPOLL
+	http_park_start();
+#endif
 
 	if (num_addrs && enabled) {
 		int i;
@@ -2279,6 +2792,12 @@ static char *handle_show_http(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 		}
 	}
 
+#ifdef HAVE_EPOLL
+	if (park_thread != AST_PTHREADT_NULL) {
+		ast_cli(a->fd, "Parked sessions: %d, served by %d threads\n\n", parked_count, session_workers);
+	}
+#endif
+
 	ast_cli(a->fd, "Enabled URI's:\n");
 	AST_RWLIST_RDLOCK(&uris);
 	if (AST_RWLIST_EMPTY(&uris)) {
@@ -2319,12 +2838,16 @@ static void http_shutdown(void)
 	if (http_tls_cfg.enabled) {
 		ast_tcptls_server_stop(&https_desc);
 	}
+#ifdef HAVE_EPOLL
+	http_park_stop();
+#endif
 	ast_free(http_tls_cfg.certfile);
 	ast_free(http_tls_cfg.pvtfile);
 	ast_free(http_tls_cfg.cipher);
 
 	ast_http_uri_unlink(&statusuri);
 	ast_http_uri_unlink(&staticuri);
+	ast_http_uri_unlink(&metricsuri);
 
 	AST_RWLIST_WRLOCK(&uri_redirects);
 	while ((redirect = AST_RWLIST_REMOVE_HEAD(&uri_redirects, entry))) {
@@ -2337,6 +2860,7 @@ int ast_http_init(void)
 {
 	ast_http_uri_link(&statusuri);
 	ast_http_uri_link(&staticuri);
+	ast_http_uri_link(&metricsuri);
 	ast_cli_register_multiple(cli_http, ARRAY_LEN(cli_http));
 	ast_register_cleanup(http_shutdown);
 
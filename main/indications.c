@@ -38,6 +38,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/indications.h"
 #include "asterisk/frame.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/ulaw.h"
+#include "asterisk/alaw.h"
 #include "asterisk/channel.h"
 #include "asterisk/utils.h"
 #include "asterisk/cli.h"
@@ -88,14 +90,143 @@ static struct ao2_container *ast_tone_zones;
  */
 static struct ast_tone_zone *default_tone_zone;
 
-struct playtones_item {
-	int fac1;
-	int init_v2_1;
-	int init_v3_1;
-	int fac2;
-	int init_v2_2;
-	int init_v3_2;
+/*! \brief Rate of the tables, in samples per second */
+#define PLAYTONES_RATE 8000
+
+/*! \brief Maximum number of samples generated at once */
+#define PLAYTONES_MAX_SAMPLES 2000
+
+/*! \brief Maximum number of tables kept in the cache */
+#define PLAYTONES_CACHE_MAX 128
+
+#define PLAYTONES_TABLE_BUCKETS 31
+
+/*!
+ * \brief One period of a tone, synthesized once and shared by all channels playing it
+ *
+ * A tone always starts at phase 0, so it is the same samples for everyone
+ * and the generator only copies slices of the table.  The table holds one
+ * period followed by PLAYTONES_MAX_SAMPLES more samples, so that a slice
+ * starting anywhere in the period is contiguous.  It is kept encoded in
+ * signed linear, mu-law and a-law so that channels writing either law need
+ * no translation.
+ */
+struct playtones_table {
+	unsigned int freq1;
+	unsigned int freq2;
 	int modulate;
+	int vol;
+	/*! Number of samples in a period */
+	int period;
+	unsigned char *ulaw;
+	unsigned char *alaw;
+	short slin[0];
+};
+
+/*! \brief Cache of the tables, keyed by frequencies, modulation and volume */
+static struct ao2_container *playtones_tables;
+
+static int playtones_table_hash(const void *obj, const int flags)
+{
+	const struct playtones_table *table = obj;
+
+	return abs((int) (table->freq1 * 31 + table->freq2) * 3 + table->modulate + table->vol * 7);
+}
+
+static int playtones_table_cmp(void *obj, void *arg, int flags)
+{
+	const struct playtones_table *table = obj;
+	const struct playtones_table *key = arg;
+
+	return (table->freq1 == key->freq1 && table->freq2 == key->freq2
+		&& table->modulate == key->modulate && table->vol == key->vol) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int r = a % b;
+
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/*!
+ * \internal
+ * \brief Synthesize the table of a tone
+ */
+static struct playtones_table *playtones_table_alloc(const struct playtones_table *key)
+{
+	struct playtones_table *table;
+	unsigned int freqs = gcd(key->freq1 % PLAYTONES_RATE, key->freq2 % PLAYTONES_RATE);
+	int period = freqs ? PLAYTONES_RATE / gcd(PLAYTONES_RATE, freqs) : 1;
+	int len = period + PLAYTONES_MAX_SAMPLES;
+	double w1 = 2.0 * M_PI * key->freq1 / PLAYTONES_RATE;
+	double w2 = 2.0 * M_PI * key->freq2 / PLAYTONES_RATE;
+	int x;
+
+	table = ao2_alloc_options(sizeof(*table) + len * (sizeof(short) + 2), NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!table) {
+		return NULL;
+	}
+	*table = *key;
+	table->period = period;
+	table->ulaw = (unsigned char *) (table->slin + len);
+	table->alaw = table->ulaw + len;
+
+	for (x = 0; x < len; x++) {
+		int v1 = sin(w1 * (x % period)) * key->vol;
+		int v2 = sin(w2 * (x % period)) * key->vol;
+
+		if (key->modulate) {
+			int p = abs(v2 - 32768);
+
+			p = ((p * 9) / 10) + 1;
+			table->slin[x] = (v1 * p) >> 15;
+		} else {
+			table->slin[x] = v1 + v2;
+		}
+		table->ulaw[x] = AST_LIN2MU(table->slin[x]);
+		table->alaw[x] = AST_LIN2A(table->slin[x]);
+	}
+
+	return table;
+}
+
+/*!
+ * \internal
+ * \brief Find the table of a tone in the cache or synthesize it
+ *
+ * \return The table with a reference, NULL on error
+ */
+static struct playtones_table *playtones_table_get(unsigned int freq1, unsigned int freq2,
+	int modulate, int vol)
+{
+	struct playtones_table key = {
+		.freq1 = freq1,
+		.freq2 = freq2,
+		.modulate = modulate,
+		.vol = vol,
+	};
+	struct playtones_table *table;
+
+	ao2_lock(playtones_tables);
+	table = ao2_find(playtones_tables, &key, OBJ_SEARCH_OBJECT | OBJ_NOLOCK);
+	if (!table && (table = playtones_table_alloc(&key))
+		&& ao2_container_count(playtones_tables) < PLAYTONES_CACHE_MAX) {
+		/* Past the limit the table is only shared by the items of one call. */
+		ao2_link_flags(playtones_tables, table, OBJ_NOLOCK);
+	}
+	ao2_unlock(playtones_tables);
+
+	return table;
+}
+
+struct playtones_item {
+	struct playtones_table *table;
 	int duration;
 };
 
@@ -108,35 +239,39 @@ struct playtones_def {
 };
 
 struct playtones_state {
-	int vol;
-	int v1_1;
-	int v2_1;
-	int v3_1;
-	int v1_2;
-	int v2_2;
-	int v3_2;
 	int reppos;
 	int nitems;
 	struct playtones_item *items;
 	int npos;
-	int oldnpos;
 	int pos;
 	struct ast_format *origwfmt;
+	/*! Format written, one of the formats of the tables */
+	struct ast_format *wfmt;
 	struct ast_frame f;
 	unsigned char offset[AST_FRIENDLY_OFFSET];
-	short data[4000];
+	short data[PLAYTONES_MAX_SAMPLES];
 };
 
+static void playtones_items_free(struct playtones_item *items, int nitems)
+{
+	int i;
+
+	for (i = 0; i < nitems; i++) {
+		ao2_cleanup(items[i].table);
+	}
+	ast_free(items);
+}
+
 static void playtones_release(struct ast_channel *chan, void *params)
 {
 	struct playtones_state *ps = params;
 
-	if (chan) {
+	if (chan && ps->wfmt != ps->origwfmt) {
 		ast_set_write_format(chan, ps->origwfmt);
 	}
 
 	ao2_cleanup(ps->origwfmt);
-	ast_free(ps->items);
+	playtones_items_free(ps->items, ps->nitems);
 
 	ast_free(ps);
 }
@@ -152,16 +287,23 @@ static void *playtones_alloc(struct ast_channel *chan, void *params)
 
 	ps->origwfmt = ao2_bump(ast_channel_writeformat(chan));
 
-	if (ast_set_write_format(chan, ast_format_slin)) {
+	/* Channels writing either law get the tables as they are. */
+	if (ast_format_cmp(ps->origwfmt, ast_format_ulaw) == AST_FORMAT_CMP_EQUAL) {
+		ps->wfmt = ps->origwfmt;
+	} else if (ast_format_cmp(ps->origwfmt, ast_format_alaw) == AST_FORMAT_CMP_EQUAL) {
+		ps->wfmt = ps->origwfmt;
+	} else {
+		ps->wfmt = ast_format_slin;
+	}
+
+	if (ps->wfmt != ps->origwfmt && ast_set_write_format(chan, ast_format_slin)) {
 		ast_log(LOG_WARNING, "Unable to set '%s' to signed linear format (write)\n", ast_channel_name(chan));
 		playtones_release(NULL, ps);
 		ps = NULL;
 	} else {
-		ps->vol = pd->vol;
 		ps->reppos = pd->reppos;
 		ps->nitems = pd->nitems;
 		ps->items = pd->items;
-		ps->oldnpos = -1;
 	}
 
 	/* Let interrupts interrupt :) */
@@ -178,13 +320,10 @@ static int playtones_generator(struct ast_channel *chan, void *data, int len, in
 {
 	struct playtones_state *ps = data;
 	struct playtones_item *pi;
-	int x;
-
-	/* we need to prepare a frame with 16 * timelen samples as we're
-	 * generating SLIN audio */
+	struct playtones_table *table;
+	int offset;
 
-	len = samples * 2;
-	if (len > sizeof(ps->data) / 2 - 1) {
+	if (samples > PLAYTONES_MAX_SAMPLES) {
 		ast_log(LOG_WARNING, "Can't generate that much data!\n");
 		return -1;
 	}
@@ -192,41 +331,20 @@ static int playtones_generator(struct ast_channel *chan, void *data, int len, in
 	memset(&ps->f, 0, sizeof(ps->f));
 
 	pi = &ps->items[ps->npos];
+	table = pi->table;
+	offset = ps->pos % table->period;
 
-	if (ps->oldnpos != ps->npos) {
-		/* Load new parameters */
-		ps->v1_1 = 0;
-		ps->v2_1 = pi->init_v2_1;
-		ps->v3_1 = pi->init_v3_1;
-		ps->v1_2 = 0;
-		ps->v2_2 = pi->init_v2_2;
-		ps->v3_2 = pi->init_v3_2;
-		ps->oldnpos = ps->npos;
-	}
-
-	for (x = 0; x < samples; x++) {
-		ps->v1_1 = ps->v2_1;
-		ps->v2_1 = ps->v3_1;
-		ps->v3_1 = (pi->fac1 * ps->v2_1 >> 15) - ps->v1_1;
-
-		ps->v1_2 = ps->v2_2;
-		ps->v2_2 = ps->v3_2;
-		ps->v3_2 = (pi->fac2 * ps->v2_2 >> 15) - ps->v1_2;
-		if (pi->modulate) {
-			int p;
-			p = ps->v3_2 - 32768;
-			if (p < 0) {
-				p = -p;
-			}
-			p = ((p * 9) / 10) + 1;
-			ps->data[x] = (ps->v3_1 * p) >> 15;
-		} else {
-			ps->data[x] = ps->v3_1 + ps->v3_2;
-		}
+	if (ps->wfmt == ast_format_slin) {
+		len = samples * sizeof(short);
+		memcpy(ps->data, table->slin + offset, len);
+	} else {
+		len = samples;
+		memcpy(ps->data, ast_format_cmp(ps->wfmt, ast_format_ulaw) == AST_FORMAT_CMP_EQUAL
+			? table->ulaw + offset : table->alaw + offset, len);
 	}
 
 	ps->f.frametype = AST_FRAME_VOICE;
-	ps->f.subclass.format = ast_format_slin;
+	ps->f.subclass.format = ps->wfmt;
 	ps->f.datalen = len;
 	ps->f.samples = samples;
 	ps->f.offset = AST_FRIENDLY_OFFSET;
@@ -236,9 +354,12 @@ static int playtones_generator(struct ast_channel *chan, void *data, int len, in
 		return -1;
 	}
 
-	ps->pos += x;
+	ps->pos += samples;
 
-	if (pi->duration && ps->pos >= pi->duration * 8) {	/* item finished? */
+	if (!pi->duration) {
+		/* Played until stopped, keep the position from overflowing. */
+		ps->pos %= table->period;
+	} else if (ps->pos >= pi->duration * 8) {	/* item finished? */
 		ps->pos = 0;					/* start new item */
 		ps->npos++;
 		if (ps->npos >= ps->nitems) {			/* last item? */
@@ -321,8 +442,6 @@ int ast_playtones_start(struct ast_channel *chan, int vol, const char *playlst,
 	struct playtones_def d = { vol, -1, 0, 1, NULL };
 	char *stringp;
 	char *separator;
-	static const float sample_rate = 8000.0;
-	static const float max_sample_val = 32768.0;
 
 	if (vol < 1) {
 		d.vol = 7219; /* Default to -8db */
@@ -374,21 +493,18 @@ int ast_playtones_start(struct ast_channel *chan, int vol, const char *playlst,
 
 		new_items = ast_realloc(d.items, (d.nitems + 1) * sizeof(*d.items));
 		if (!new_items) {
-			ast_free(d.items);
+			playtones_items_free(d.items, d.nitems);
 			return -1;
 		}
 		d.items = new_items;
 
-		d.items[d.nitems].fac1 = 2.0 * cos(2.0 * M_PI * (tone_data.freq1 / sample_rate)) * max_sample_val;
-		d.items[d.nitems].init_v2_1 = sin(-4.0 * M_PI * (tone_data.freq1 / sample_rate)) * d.vol;
-		d.items[d.nitems].init_v3_1 = sin(-2.0 * M_PI * (tone_data.freq1 / sample_rate)) * d.vol;
-
-		d.items[d.nitems].fac2 = 2.0 * cos(2.0 * M_PI * (tone_data.freq2 / sample_rate)) * max_sample_val;
-		d.items[d.nitems].init_v2_2 = sin(-4.0 * M_PI * (tone_data.freq2 / sample_rate)) * d.vol;
-		d.items[d.nitems].init_v3_2 = sin(-2.0 * M_PI * (tone_data.freq2 / sample_rate)) * d.vol;
-
+		d.items[d.nitems].table = playtones_table_get(tone_data.freq1, tone_data.freq2,
+			tone_data.modulate, d.vol);
+		if (!d.items[d.nitems].table) {
+			playtones_items_free(d.items, d.nitems);
+			return -1;
+		}
 		d.items[d.nitems].duration = tone_data.time;
-		d.items[d.nitems].modulate = tone_data.modulate;
 
 		d.nitems++;
 	}
@@ -399,7 +515,7 @@ int ast_playtones_start(struct ast_channel *chan, int vol, const char *playlst,
 	}
 
 	if (ast_activate_generator(chan, &playtones, &d)) {
-		ast_free(d.items);
+		playtones_items_free(d.items, d.nitems);
 		return -1;
 	}
 
@@ -1168,6 +1284,8 @@ static void indications_shutdown(void)
 		ao2_ref(ast_tone_zones, -1);
 		ast_tone_zones = NULL;
 	}
+	ao2_cleanup(playtones_tables);
+	playtones_tables = NULL;
 }
 
 /*! \brief Load indications module */
@@ -1178,6 +1296,12 @@ int ast_indications_init(void)
 		return -1;
 	}
 
+	if (!(playtones_tables = ao2_container_alloc(PLAYTONES_TABLE_BUCKETS,
+			playtones_table_hash, playtones_table_cmp))) {
+		indications_shutdown();
+		return -1;
+	}
+
 	if (load_indications(0)) {
 		indications_shutdown();
 		return -1;
@@ -146,7 +146,6 @@ static int check_resync(jitterbuf *jb, long ts, long now, long ms, const enum jb
 			if ((jb->info.cnt_delay_discont > 3) || (type == JB_TYPE_CONTROL)) {
 				jb->info.cnt_delay_discont = 0;
 				jb->hist_ptr = 0;
-				jb->hist_maxbuf_valid = 0;
 				jb_warn("Resyncing the jb. last_delay %ld, this delay %ld, threshold %ld, new offset %ld\n", jb->info.last_delay, *delay, threshold, ts - now);
 				jb->info.resync_offset = ts - now;
 				jb->info.last_delay = *delay = 0; /* after resync, frame is right on time */
@@ -162,136 +161,56 @@ static int check_resync(jitterbuf *jb, long ts, long now, long ms, const enum jb
 	return 0;
 }
 
-static int history_put(jitterbuf *jb, long ts, long now, long ms, long delay)
+/*! \brief find where a delay goes in the sorted history, after any equal delays */
+static int history_sorted_upper(jitterbuf *jb, int count, long delay)
 {
-	long kicked;
-
-	/* don't add special/negative times to history */
-	if (ts <= 0)
-		return 0;
-
-	kicked = jb->history[jb->hist_ptr % JB_HISTORY_SZ];
-
-	jb->history[(jb->hist_ptr++) % JB_HISTORY_SZ] = delay;
-
-	/* optimization; the max/min buffers don't need to be recalculated, if this packet's
-	 * entry doesn't change them.  This happens if this packet is not involved, _and_ any packet
-	 * that got kicked out of the history is also not involved
-	 * We do a number of comparisons, but it's probably still worthwhile, because it will usually
-	 * succeed, and should be a lot faster than going through all 500 packets in history */
-	if (!jb->hist_maxbuf_valid)
-		return 0;
-
-	/* don't do this until we've filled history
-	 * (reduces some edge cases below) */
-	if (jb->hist_ptr < JB_HISTORY_SZ)
-		goto invalidate;
+	int lo = 0, hi = count;
 
-	/* if the new delay would go into min */
-	if (delay < jb->hist_minbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
 
-	/* or max.. */
-	if (delay > jb->hist_maxbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	/* or the kicked delay would be in min */
-	if (kicked <= jb->hist_minbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	if (kicked >= jb->hist_maxbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	/* if we got here, we don't need to invalidate, 'cause this delay didn't
-	 * affect things */
-	return 0;
-	/* end optimization */
-
-
-invalidate:
-	jb->hist_maxbuf_valid = 0;
-	return 0;
+		if (jb->hist_sorted[mid] <= delay)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
 }
 
-static void history_calc_maxbuf(jitterbuf *jb)
+static int history_put(jitterbuf *jb, long ts, long now, long ms, long delay)
 {
-	int i,j;
-
-	if (jb->hist_ptr == 0)
-		return;
-
-
-	/* initialize maxbuf/minbuf to the latest value */
-	for (i=0;i<JB_HISTORY_MAXBUF_SZ;i++) {
-/*
- * jb->hist_maxbuf[i] = jb->history[(jb->hist_ptr-1) % JB_HISTORY_SZ];
- * jb->hist_minbuf[i] = jb->history[(jb->hist_ptr-1) % JB_HISTORY_SZ];
- */
-		jb->hist_maxbuf[i] = JB_LONGMIN;
-		jb->hist_minbuf[i] = JB_LONGMAX;
-	}
-
-	/* use insertion sort to populate maxbuf */
-	/* we want it to be the top "n" values, in order */
-
-	/* start at the beginning, or JB_HISTORY_SZ frames ago */
-	i = (jb->hist_ptr > JB_HISTORY_SZ) ? (jb->hist_ptr - JB_HISTORY_SZ) : 0;
-
-	for (;i<jb->hist_ptr;i++) {
-		long toins = jb->history[i % JB_HISTORY_SZ];
-
-		/* if the maxbuf should get this */
-		if (toins > jb->hist_maxbuf[JB_HISTORY_MAXBUF_SZ-1])  {
-
-			/* insertion-sort it into the maxbuf */
-			for (j=0;j<JB_HISTORY_MAXBUF_SZ;j++) {
-				/* found where it fits */
-				if (toins > jb->hist_maxbuf[j]) {
-					/* move over */
-					if (j != JB_HISTORY_MAXBUF_SZ - 1) {
-						memmove(jb->hist_maxbuf + j + 1, jb->hist_maxbuf + j, (JB_HISTORY_MAXBUF_SZ - (j + 1)) * sizeof(jb->hist_maxbuf[0]));
-					}
-					/* insert */
-					jb->hist_maxbuf[j] = toins;
-
-					break;
-				}
-			}
-		}
+	int count;
+	int pos;
 
-		/* if the minbuf should get this */
-		if (toins < jb->hist_minbuf[JB_HISTORY_MAXBUF_SZ-1])  {
-
-			/* insertion-sort it into the maxbuf */
-			for (j=0;j<JB_HISTORY_MAXBUF_SZ;j++) {
-				/* found where it fits */
-				if (toins < jb->hist_minbuf[j]) {
-					/* move over */
-					if (j != JB_HISTORY_MAXBUF_SZ - 1) {
-						memmove(jb->hist_minbuf + j + 1, jb->hist_minbuf + j, (JB_HISTORY_MAXBUF_SZ - (j + 1)) * sizeof(jb->hist_minbuf[0]));
-					}
-					/* insert */
-					jb->hist_minbuf[j] = toins;
-
-					break;
-				}
-			}
-		}
+	/* don't add special/negative times to history */
+	if (ts <= 0)
+		return 0;
 
-		if (0) {
-			int k;
-			fprintf(stderr, "toins = %ld\n", toins);
-			fprintf(stderr, "maxbuf =");
-			for (k=0;k<JB_HISTORY_MAXBUF_SZ;k++)
-				fprintf(stderr, "%ld ", jb->hist_maxbuf[k]);
-			fprintf(stderr, "\nminbuf =");
-			for (k=0;k<JB_HISTORY_MAXBUF_SZ;k++)
-				fprintf(stderr, "%ld ", jb->hist_minbuf[k]);
-			fprintf(stderr, "\n");
+	/* keep the delays in history sorted as they come and go, so the
+	 * percentiles can be read directly instead of being searched for */
+	count = (jb->hist_ptr < JB_HISTORY_SZ) ? jb->hist_ptr : JB_HISTORY_SZ;
+	pos = history_sorted_upper(jb, count, delay);
+
+	if (count == JB_HISTORY_SZ) {
+		long kicked = jb->history[jb->hist_ptr % JB_HISTORY_SZ];
+		/* the last copy of the kicked delay */
+		int old = history_sorted_upper(jb, count, kicked) - 1;
+
+		/* only the entries between the kicked and the new delay move */
+		if (old < pos) {
+			pos--;
+			memmove(jb->hist_sorted + old, jb->hist_sorted + old + 1, (pos - old) * sizeof(jb->hist_sorted[0]));
+		} else if (old > pos) {
+			memmove(jb->hist_sorted + pos + 1, jb->hist_sorted + pos, (old - pos) * sizeof(jb->hist_sorted[0]));
 		}
+	} else {
+		memmove(jb->hist_sorted + pos + 1, jb->hist_sorted + pos, (count - pos) * sizeof(jb->hist_sorted[0]));
 	}
+	jb->hist_sorted[pos] = delay;
 
-	jb->hist_maxbuf_valid = 1;
+	jb->history[(jb->hist_ptr++) % JB_HISTORY_SZ] = delay;
+
+	return 0;
 }
 
 static void history_get(jitterbuf *jb)
@@ -300,12 +219,13 @@ static void history_get(jitterbuf *jb)
 	int idx;
 	int count;
 
-	if (!jb->hist_maxbuf_valid)
-		history_calc_maxbuf(jb);
-
 	/* count is how many items in history we're examining */
 	count = (jb->hist_ptr < JB_HISTORY_SZ) ? jb->hist_ptr : JB_HISTORY_SZ;
 
+	/* nothing new since a resync, keep the last values */
+	if (!count)
+		return;
+
 	/* idx is the "n"ths highest/lowest that we'll look for */
 	idx = count * JB_HISTORY_DROPPCT / 100;
 
@@ -313,28 +233,48 @@ static void history_get(jitterbuf *jb)
 	if (idx > (JB_HISTORY_MAXBUF_SZ - 1))
 		idx = JB_HISTORY_MAXBUF_SZ - 1;
 
-	if (idx < 0) {
-		jb->info.min = 0;
-		jb->info.jitter = 0;
-		return;
-	}
-
-	max = jb->hist_maxbuf[idx];
-	min = jb->hist_minbuf[idx];
+	max = jb->hist_sorted[count - 1 - idx];
+	min = jb->hist_sorted[idx];
 
 	jitter = max - min;
 
-	/* these debug stmts compare the difference between looking at the absolute jitter, and the
-	 * values we get by throwing away the outliers */
-	/*
-	fprintf(stderr, "[%d] min=%d, max=%d, jitter=%d\n", index, min, max, jitter);
-	fprintf(stderr, "[%d] min=%d, max=%d, jitter=%d\n", 0, jb->hist_minbuf[0], jb->hist_maxbuf[0], jb->hist_maxbuf[0]-jb->hist_minbuf[0]);
-	*/
-
 	jb->info.min = min;
 	jb->info.jitter = jitter;
 }
 
+/*! \brief the timestamp slot indexing a queued frame */
+static int queue_slot(long ts)
+{
+	return (ts >> JB_QUEUE_SLOT_SHIFT) & (JB_QUEUE_SLOTS - 1);
+}
+
+/*! \brief find the nearest slot before the given one that has queued frames, wrapping around */
+static int queue_slot_prev(jitterbuf *jb, int slot)
+{
+	unsigned int bit = (slot - 1) & (JB_QUEUE_SLOTS - 1);
+	int i;
+
+	for (i = 0; i <= JB_QUEUE_SLOTS / 64; i++) {
+		/* the bits of this word up to and including bit */
+		uint64_t word = jb->slot_used[bit / 64] & (~0ULL >> (63 - bit % 64));
+
+		if (word)
+			return (bit & ~63U) + 63 - __builtin_clzll(word);
+
+		/* go to the last bit of the previous word */
+		bit = ((bit | 63) - 64) & (JB_QUEUE_SLOTS - 1);
+	}
+	return -1;
+}
+
+/*! \brief stop using the slots until the queue empties, when it spans more than they cover */
+static void queue_slots_invalidate(jitterbuf *jb)
+{
+	jb->slots_invalid = 1;
+	memset(jb->slot_used, 0, sizeof(jb->slot_used));
+	memset(jb->slot_last, 0, sizeof(jb->slot_last));
+}
+
 /* returns 1 if frame was inserted into head of queue, 0 otherwise */
 static int queue_put(jitterbuf *jb, void *data, const enum jb_frame_type type, long ms, long ts)
 {
@@ -342,6 +282,7 @@ static int queue_put(jitterbuf *jb, void *data, const enum jb_frame_type type, l
 	jb_frame *p;
 	int head = 0;
 	long resync_ts = ts - jb->info.resync_offset;
+	int slot;
 
 	if ((frame = jb->free)) {
 		jb->free = frame->next;
@@ -357,6 +298,21 @@ static int queue_put(jitterbuf *jb, void *data, const enum jb_frame_type type, l
 	frame->ms = ms;
 	frame->type = type;
 
+	/*
+	 * the slots index the queue by timestamp as long as it spans fewer
+	 * timestamps than they cover, so that no two slots collide
+	 */
+	if (jb->frames && !jb->slots_invalid) {
+		long lo = resync_ts < jb->frames->ts ? resync_ts : jb->frames->ts;
+		long hi = resync_ts > jb->frames->prev->ts ? resync_ts : jb->frames->prev->ts;
+
+		if ((hi >> JB_QUEUE_SLOT_SHIFT) - (lo >> JB_QUEUE_SLOT_SHIFT) >= JB_QUEUE_SLOTS) {
+			jb_dbg("queue spans %ld ms, no longer indexing it\n", hi - lo);
+			queue_slots_invalidate(jb);
+		}
+	}
+	slot = queue_slot(resync_ts);
+
 	/*
 	 * frames are a circular list, jb-frames points to to the lowest ts,
 	 * jb->frames->prev points to the highest ts
@@ -367,6 +323,7 @@ static int queue_put(jitterbuf *jb, void *data, const enum jb_frame_type type, l
 		frame->next = frame;
 		frame->prev = frame;
 		head = 1;
+		jb->slots_invalid = 0;
 	} else if (resync_ts < jb->frames->ts) {
 		frame->next = jb->frames;
 		frame->prev = jb->frames->prev;
@@ -383,10 +340,24 @@ static int queue_put(jitterbuf *jb, void *data, const enum jb_frame_type type, l
 		p = jb->frames;
 
 		/* frame is out of order */
-		if (resync_ts < p->prev->ts) jb->info.frames_ooo++;
+		if (resync_ts < p->prev->ts) {
+			jb->info.frames_ooo++;
 
-		while (resync_ts < p->prev->ts && p->prev != jb->frames)
-			p = p->prev;
+			if (jb->slots_invalid) {
+				while (resync_ts < p->prev->ts && p->prev != jb->frames)
+					p = p->prev;
+			} else {
+				/* start from the last frame of this slot or of the nearest slot before it,
+				 * and only walk back over the frames of this slot that are later */
+				if (!jb->slot_last[slot]) {
+					p = jb->slot_last[queue_slot_prev(jb, slot)]->next;
+				} else {
+					p = jb->slot_last[slot]->next;
+					while (resync_ts < p->prev->ts && p->prev != jb->frames)
+						p = p->prev;
+				}
+			}
+		}
 
 		frame->next = p;
 		frame->prev = p->prev;
@@ -394,6 +365,13 @@ static int queue_put(jitterbuf *jb, void *data, const enum jb_frame_type type, l
 		frame->next->prev = frame;
 		frame->prev->next = frame;
 	}
+
+	if (!jb->slots_invalid) {
+		if (!jb->slot_last[slot] || jb->slot_last[slot]->ts <= resync_ts) {
+			jb->slot_last[slot] = frame;
+		}
+		jb->slot_used[slot / 64] |= 1ULL << (slot % 64);
+	}
 	return head;
 }
 
@@ -424,6 +402,14 @@ static jb_frame *_queue_get(jitterbuf *jb, long ts, int all)
 	/*jb_warn("queue_get: ASK %ld FIRST %ld\n", ts, frame->ts); */
 
 	if (all || ts >= frame->ts) {
+		/* the lowest frame is the last of its slot only if it is alone in it */
+		if (!jb->slots_invalid && jb->slot_last[queue_slot(frame->ts)] == frame) {
+			int slot = queue_slot(frame->ts);
+
+			jb->slot_last[slot] = NULL;
+			jb->slot_used[slot / 64] &= ~(1ULL << (slot % 64));
+		}
+
 		/* remove this frame */
 		frame->prev->next = frame->next;
 		frame->next->prev = frame->prev;
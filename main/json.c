@@ -49,18 +49,69 @@ ASTERISK_REGISTER_FILE()
 /*! \brief Magic number, for safety checks. */
 #define JSON_MAGIC 0x1541992
 
-/*! \brief Internal structure for allocated memory blocks */
+/*! \brief Magic number of blocks allocated from an arena. */
+#define JSON_ARENA_MAGIC 0x1541993
+
+/*! \brief Size of the chunks of a JSON arena */
+#define JSON_ARENA_CHUNK_SIZE 16384
+
+/*! \brief Largest allocation made from a JSON arena, larger ones use the heap */
+#define JSON_ARENA_MAX_ALLOC (JSON_ARENA_CHUNK_SIZE / 4)
+
+/*! \brief Alignment of the blocks allocated from a JSON arena */
+#define JSON_ARENA_ALIGN 16
+
+/*!
+ * \brief Internal structure for allocated memory blocks
+ *
+ * The magic number is last, right in front of the data, as it is for
+ * \ref json_arena_mem.
+ */
 struct json_mem {
-	/*! Magic number, for safety checks */
-	uint32_t magic;
 	/*! Mutext for locking this memory block */
 	ast_mutex_t mutex;
 	/*! Linked list pointer for the free list */
 	AST_LIST_ENTRY(json_mem) list;
+	/*! Magic number, for safety checks */
+	uintptr_t magic;
 	/*! Data section of the allocation; void pointer for proper alignment */
 	void *data[];
 };
 
+/*! \brief A chunk of a JSON arena */
+struct json_arena_chunk {
+	/*! The previous chunk of the arena */
+	struct json_arena_chunk *next;
+	/*! Space in the chunk */
+	size_t size;
+	/*! Space used in the chunk */
+	size_t used;
+	/*! Number of blocks allocated from the chunk and not freed yet */
+	size_t live;
+	/*! Space the blocks are allocated from */
+	char data[0] __attribute__((aligned(JSON_ARENA_ALIGN)));
+};
+
+/*! \brief Header of a block allocated from a JSON arena */
+struct json_arena_mem {
+	/*! The chunk the block was allocated from */
+	struct json_arena_chunk *chunk;
+	/*! Magic number, for safety checks */
+	uintptr_t magic;
+	/*! Data section of the allocation */
+	void *data[];
+};
+
+/*! \brief A thread's JSON arena */
+struct json_arena {
+	/*! Number of ast_json_arena_begin() not ended yet, 0 when not allocating from it */
+	unsigned int depth;
+	/*! The chunk blocks are allocated from, followed by the previous ones */
+	struct json_arena_chunk *chunks;
+	/*! An empty chunk kept for the next scope */
+	struct json_arena_chunk *spare;
+};
+
 /*! \brief Free a \ref json_mem block. */
 static void json_mem_free(struct json_mem *mem)
 {
@@ -69,6 +120,18 @@ static void json_mem_free(struct json_mem *mem)
 	ast_free(mem);
 }
 
+/*! \brief Whether a pointer is \c NULL or a Jansson singleton (null, true, false) */
+static inline int is_json_singleton(void *p)
+{
+	return p == NULL || p == json_null() || p == json_true() || p == json_false();
+}
+
+/*! \brief Magic number in front of a pointer allocated via ast_json_malloc(). */
+static inline uintptr_t json_mem_magic(void *p)
+{
+	return ((uintptr_t *) p)[-1];
+}
+
 /*!
  * \brief Get the \ref json_mem block for a pointer allocated via
  * ast_json_malloc().
@@ -78,13 +141,13 @@ static void json_mem_free(struct json_mem *mem)
  *
  * \param p Pointer, usually to a \c json_t or \ref ast_json.
  * \return \ref json_mem object with extra allocation info.
+ * \return \c NULL for singletons and blocks allocated from an arena.
  */
 static inline struct json_mem *to_json_mem(void *p)
 {
 	struct json_mem *mem;
 	/* Avoid ref'ing the singleton values */
-	if (p == NULL || p == json_null() || p == json_true() ||
-		p == json_false()) {
+	if (is_json_singleton(p) || json_mem_magic(p) == JSON_ARENA_MAGIC) {
 		return NULL;
 	}
 	mem = (struct json_mem *)((char *) (p) - sizeof(*mem));
@@ -99,6 +162,9 @@ static inline struct json_mem *to_json_mem(void *p)
  * safely ignores it and returns \c NULL. Otherwise, \a json must have been
  * allocates using ast_json_malloc().
  *
+ * JSON allocated from an arena belongs to the thread that allocated it and
+ * is not locked either.
+ *
  * \param json JSON instance to lock.
  * \return \ref Corresponding \ref json_mem block.
  * \return \c NULL if \a json was not allocated.
@@ -135,9 +201,139 @@ static void json_mem_unlock(struct json_mem *mem)
 	RAII_VAR(struct json_mem *, __mem_ ## __LINE__, \
 		json_mem_lock(json), json_mem_unlock)
 
+static void json_arena_cleanup(void *data)
+{
+	struct json_arena *arena = data;
+
+	/* Chunks still in use when the thread exits are leaked, as by ast_json_arena_end() */
+	ast_free(arena->spare);
+	ast_free(arena);
+}
+
+AST_THREADSTORAGE_CUSTOM(json_arena_ts, NULL, json_arena_cleanup);
+
+/*! \brief The calling thread's JSON arena */
+static struct json_arena *json_arena(void)
+{
+	return ast_threadstorage_get(&json_arena_ts, sizeof(struct json_arena));
+}
+
+/*!
+ * \brief Allocate a block from a JSON arena
+ *
+ * \return The data of the block
+ * \return \c NULL if it should be allocated from the heap
+ */
+static void *json_arena_malloc(struct json_arena *arena, size_t size)
+{
+	struct json_arena_chunk *chunk = arena->chunks;
+	struct json_arena_mem *mem;
+	size_t needed = (sizeof(*mem) + size + JSON_ARENA_ALIGN - 1) & ~(size_t) (JSON_ARENA_ALIGN - 1);
+
+	if (size > JSON_ARENA_MAX_ALLOC) {
+		return NULL;
+	}
+
+	if (!chunk || chunk->used + needed > chunk->size) {
+		if (arena->spare) {
+			chunk = arena->spare;
+			arena->spare = NULL;
+		} else if (!(chunk = ast_malloc(sizeof(*chunk) + JSON_ARENA_CHUNK_SIZE))) {
+			return NULL;
+		}
+		chunk->size = JSON_ARENA_CHUNK_SIZE;
+		chunk->used = 0;
+		chunk->live = 0;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	mem = (struct json_arena_mem *) (chunk->data + chunk->used);
+	chunk->used += needed;
+	++chunk->live;
+	mem->chunk = chunk;
+	mem->magic = JSON_ARENA_MAGIC;
+	return mem->data;
+}
+
+void ast_json_arena_begin(void)
+{
+	struct json_arena *arena = json_arena();
+
+	if (arena) {
+		++arena->depth;
+	}
+}
+
+void ast_json_arena_end(void)
+{
+	struct json_arena *arena = json_arena();
+	struct json_arena_chunk *chunk;
+	size_t leaked = 0;
+
+	if (!arena || !arena->depth) {
+		ast_assert(0);
+		return;
+	}
+
+	if (--arena->depth) {
+		return;
+	}
+
+	while ((chunk = arena->chunks)) {
+		arena->chunks = chunk->next;
+		if (chunk->live) {
+			/* Still referenced, so it cannot be reused or freed */
+			leaked += chunk->live;
+		} else if (!arena->spare) {
+			arena->spare = chunk;
+		} else {
+			ast_free(chunk);
+		}
+	}
+
+	if (leaked) {
+		ast_log(LOG_ERROR, "%zu JSON allocations outlived their arena, leaking them\n", leaked);
+		ast_assert(0);
+	}
+}
+
+unsigned int ast_json_arena_suspend(void)
+{
+	struct json_arena *arena = json_arena();
+	unsigned int depth;
+
+	if (!arena) {
+		return 0;
+	}
+	depth = arena->depth;
+	arena->depth = 0;
+	return depth;
+}
+
+void ast_json_arena_resume(unsigned int depth)
+{
+	struct json_arena *arena = json_arena();
+
+	if (arena) {
+		arena->depth = depth;
+	}
+}
+
 void *ast_json_malloc(size_t size)
 {
-	struct json_mem *mem = ast_malloc(size + sizeof(*mem));
+	struct json_arena *arena = json_arena();
+	struct json_mem *mem;
+
+	if (arena && arena->depth) {
+		void *data = json_arena_malloc(arena, size);
+
+		if (data) {
+			return data;
+		}
+	}
+
+	mem = ast_malloc(size + sizeof(*mem));
 	if (!mem) {
 		return NULL;
 	}
@@ -167,6 +363,15 @@ void ast_json_free(void *p)
 {
 	struct json_mem *mem;
 	struct json_mem_list *free_list;
+
+	if (!is_json_singleton(p) && json_mem_magic(p) == JSON_ARENA_MAGIC) {
+		/* Released with the rest of its arena */
+		struct json_arena_mem *arena_mem = (struct json_arena_mem *) ((char *) p - sizeof(*arena_mem));
+
+		--arena_mem->chunk->live;
+		return;
+	}
+
 	mem = to_json_mem(p);
 
 	if (!mem) {
@@ -614,6 +819,367 @@ int ast_json_dump_new_file_format(struct ast_json *root, const char *path, enum
 	return json_dump_file((json_t *)root, path, dump_flags(format));
 }
 
+/*! \brief Append to the document, or fail for good */
+static int writer_append(struct ast_json_writer *writer, const char *buf, size_t len)
+{
+	if (writer->failed || write_to_ast_str(buf, len, writer->dst)) {
+		writer->failed = 1;
+		return -1;
+	}
+	return 0;
+}
+
+/*! \brief Start a new line indented for \a depth, when pretty */
+static int writer_newline(struct ast_json_writer *writer, unsigned int depth)
+{
+	static const char indent[] = "\n"
+		"                                                              ";
+
+	if (writer->format != AST_JSON_PRETTY) {
+		return 0;
+	}
+	return writer_append(writer, indent, 1 + 2 * depth);
+}
+
+/*! \brief Separate the next value or key from the one before it */
+static int writer_begin_value(struct ast_json_writer *writer)
+{
+	unsigned int bit = 1U << writer->depth;
+
+	if (writer->failed) {
+		return -1;
+	}
+	if (writer->after_key) {
+		writer->after_key = 0;
+		return 0;
+	}
+	if (!writer->depth) {
+		return 0;
+	}
+	if ((writer->members & bit) && writer_append(writer, ",", 1)) {
+		return -1;
+	}
+	writer->members |= bit;
+	return writer_newline(writer, writer->depth);
+}
+
+/*!
+ * \brief Length of the UTF-8 sequence that starts with a byte over 0x7f
+ *
+ * \return The length, or 0 if the sequence is not one Jansson would accept.
+ */
+static size_t utf8_sequence_length(const unsigned char *s)
+{
+	int32_t value;
+	size_t len;
+	size_t i;
+
+	if (*s < 0xc2 || *s > 0xf4) {
+		return 0;
+	} else if (*s <= 0xdf) {
+		len = 2;
+		value = *s & 0x1f;
+	} else if (*s <= 0xef) {
+		len = 3;
+		value = *s & 0x0f;
+	} else {
+		len = 4;
+		value = *s & 0x07;
+	}
+
+	for (i = 1; i < len; ++i) {
+		if ((s[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+		value = (value << 6) | (s[i] & 0x3f);
+	}
+
+	if ((len == 3 && value < 0x800) || (len == 4 && value < 0x10000)
+		|| value > 0x10ffff || (value >= 0xd800 && value <= 0xdfff)) {
+		return 0;
+	}
+	return len;
+}
+
+/*! \brief Write a quoted string, escaped as Jansson escapes it */
+static int writer_quoted(struct ast_json_writer *writer, const char *value)
+{
+	const unsigned char *pos = (const unsigned char *) value;
+	const unsigned char *run = pos;
+
+	if (!value) {
+		writer->failed = 1;
+		return -1;
+	}
+
+	if (writer_append(writer, "\"", 1)) {
+		return -1;
+	}
+	while (*pos) {
+		const char *escape;
+		char hex[8];
+		size_t len;
+
+		if (*pos >= 0x80) {
+			if (!(len = utf8_sequence_length(pos))) {
+				writer->failed = 1;
+				return -1;
+			}
+			pos += len;
+			continue;
+		}
+
+		switch (*pos) {
+		case '"':
+			escape = "\\\"";
+			break;
+		case '\\':
+			escape = "\\\\";
+			break;
+		case '\b':
+			escape = "\\b";
+			break;
+		case '\f':
+			escape = "\\f";
+			break;
+		case '\n':
+			escape = "\\n";
+			break;
+		case '\r':
+			escape = "\\r";
+			break;
+		case '\t':
+			escape = "\\t";
+			break;
+		default:
+			if (*pos >= 0x20) {
+				++pos;
+				continue;
+			}
+			snprintf(hex, sizeof(hex), "\\u%04X", *pos);
+			escape = hex;
+			break;
+		}
+
+		/* Copy everything up to the character in one go, then its escape */
+		if (writer_append(writer, (const char *) run, pos - run)
+			|| writer_append(writer, escape, strlen(escape))) {
+			return -1;
+		}
+		run = ++pos;
+	}
+
+	if (writer_append(writer, (const char *) run, pos - run)) {
+		return -1;
+	}
+	return writer_append(writer, "\"", 1);
+}
+
+void ast_json_writer_init(struct ast_json_writer *writer, struct ast_str **dst,
+	enum ast_json_encoding_format format)
+{
+	memset(writer, 0, sizeof(*writer));
+	writer->dst = dst;
+	writer->format = format;
+}
+
+/*! \brief Open an object or array */
+static int writer_open(struct ast_json_writer *writer, const char *bracket)
+{
+	if (writer_begin_value(writer)) {
+		return -1;
+	}
+	if (writer->depth >= AST_JSON_WRITER_MAX_DEPTH) {
+		writer->failed = 1;
+		return -1;
+	}
+	++writer->depth;
+	writer->members &= ~(1U << writer->depth);
+	return writer_append(writer, bracket, 1);
+}
+
+/*! \brief Close an object or array */
+static int writer_close(struct ast_json_writer *writer, const char *bracket)
+{
+	unsigned int bit = 1U << writer->depth;
+
+	if (writer->failed || !writer->depth || writer->after_key) {
+		writer->failed = 1;
+		return -1;
+	}
+	--writer->depth;
+	if ((writer->members & bit) && writer_newline(writer, writer->depth)) {
+		return -1;
+	}
+	writer->members &= ~bit;
+	return writer_append(writer, bracket, 1);
+}
+
+int ast_json_writer_object_start(struct ast_json_writer *writer)
+{
+	return writer_open(writer, "{");
+}
+
+int ast_json_writer_object_end(struct ast_json_writer *writer)
+{
+	return writer_close(writer, "}");
+}
+
+int ast_json_writer_array_start(struct ast_json_writer *writer)
+{
+	return writer_open(writer, "[");
+}
+
+int ast_json_writer_array_end(struct ast_json_writer *writer)
+{
+	return writer_close(writer, "]");
+}
+
+int ast_json_writer_key(struct ast_json_writer *writer, const char *key)
+{
+	if (writer->after_key || !writer->depth) {
+		writer->failed = 1;
+		return -1;
+	}
+	if (writer_begin_value(writer) || writer_quoted(writer, key)) {
+		return -1;
+	}
+	if (writer->format == AST_JSON_PRETTY ? writer_append(writer, ": ", 2) : writer_append(writer, ":", 1)) {
+		return -1;
+	}
+	writer->after_key = 1;
+	return 0;
+}
+
+int ast_json_writer_string(struct ast_json_writer *writer, const char *value)
+{
+	if (writer_begin_value(writer)) {
+		return -1;
+	}
+	return writer_quoted(writer, value);
+}
+
+int ast_json_writer_integer(struct ast_json_writer *writer, intmax_t value)
+{
+	char buf[32];
+
+	if (writer_begin_value(writer)) {
+		return -1;
+	}
+	return writer_append(writer, buf, snprintf(buf, sizeof(buf), "%jd", value));
+}
+
+int ast_json_writer_null(struct ast_json_writer *writer)
+{
+	if (writer_begin_value(writer)) {
+		return -1;
+	}
+	return writer_append(writer, "null", 4);
+}
+
+int ast_json_writer_timeval(struct ast_json_writer *writer, const struct timeval tv, const char *zone)
+{
+	char buf[AST_ISO8601_LEN];
+	struct ast_tm tm = {};
+
+	ast_localtime(&tv, &tm, zone);
+	ast_strftime(buf, sizeof(buf), AST_ISO8601_FORMAT, &tm);
+
+	return ast_json_writer_string(writer, buf);
+}
+
+int ast_json_writer_name_number(struct ast_json_writer *writer, const char *name, const char *number)
+{
+	ast_json_writer_object_start(writer);
+	ast_json_writer_key(writer, "name");
+	ast_json_writer_string(writer, name);
+	ast_json_writer_key(writer, "number");
+	ast_json_writer_string(writer, number);
+	return ast_json_writer_object_end(writer);
+}
+
+int ast_json_writer_dialplan_cep(struct ast_json_writer *writer, const char *context,
+	const char *exten, int priority)
+{
+	ast_json_writer_object_start(writer);
+	ast_json_writer_key(writer, "context");
+	if (context) {
+		ast_json_writer_string(writer, context);
+	} else {
+		ast_json_writer_null(writer);
+	}
+	ast_json_writer_key(writer, "exten");
+	if (exten) {
+		ast_json_writer_string(writer, exten);
+	} else {
+		ast_json_writer_null(writer);
+	}
+	ast_json_writer_key(writer, "priority");
+	if (priority != -1) {
+		ast_json_writer_integer(writer, priority);
+	} else {
+		ast_json_writer_null(writer);
+	}
+	return ast_json_writer_object_end(writer);
+}
+
+int ast_json_writer_value(struct ast_json_writer *writer, struct ast_json *value)
+{
+	struct ast_json_iter *iter;
+	char buf[32];
+	size_t i;
+
+	/* Unlike dumping, walking a value does not mark it, so needs no lock */
+	switch (value ? ast_json_typeof(value) : AST_JSON_NULL) {
+	case AST_JSON_OBJECT:
+		ast_json_writer_object_start(writer);
+		for (iter = ast_json_object_iter(value); iter; iter = ast_json_object_iter_next(value, iter)) {
+			ast_json_writer_key(writer, ast_json_object_iter_key(iter));
+			ast_json_writer_value(writer, ast_json_object_iter_value(iter));
+		}
+		return ast_json_writer_object_end(writer);
+	case AST_JSON_ARRAY:
+		ast_json_writer_array_start(writer);
+		for (i = 0; i < ast_json_array_size(value); ++i) {
+			ast_json_writer_value(writer, ast_json_array_get(value, i));
+		}
+		return ast_json_writer_array_end(writer);
+	case AST_JSON_STRING:
+		return ast_json_writer_string(writer, ast_json_string_get(value));
+	case AST_JSON_INTEGER:
+		return ast_json_writer_integer(writer, ast_json_integer_get(value));
+	case AST_JSON_REAL:
+		if (writer_begin_value(writer)) {
+			return -1;
+		}
+		snprintf(buf, sizeof(buf), "%.17g", ast_json_real_get(value));
+		/* Jansson makes sure a real does not read back as an integer */
+		if (!strpbrk(buf, ".eE")) {
+			strcat(buf, ".0");
+		}
+		return writer_append(writer, buf, strlen(buf));
+	case AST_JSON_TRUE:
+		if (writer_begin_value(writer)) {
+			return -1;
+		}
+		return writer_append(writer, "true", 4);
+	case AST_JSON_FALSE:
+		if (writer_begin_value(writer)) {
+			return -1;
+		}
+		return writer_append(writer, "false", 5);
+	case AST_JSON_NULL:
+		if (!value) {
+			writer->failed = 1;
+			return -1;
+		}
+		return ast_json_writer_null(writer);
+	}
+
+	writer->failed = 1;
+	return -1;
+}
+
 /*!
  * \brief Copy Jansson error struct to ours.
  */
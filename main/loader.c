@@ -54,6 +54,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/dsp.h"
 #include "asterisk/udptl.h"
 #include "asterisk/heap.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/vector.h"
 #include "asterisk/app.h"
 #include "asterisk/test.h"
 #include "asterisk/sounds_index.h"
@@ -127,10 +129,12 @@ struct ast_module {
 	void *lib;					/* the shared lib, or NULL if embedded */
 	int usecount;					/* the number of 'users' currently in this module */
 	struct module_user_list users;			/* the list of users in the module */
+	int64_t load_usec;				/* how long its load function took the last time it ran */
 	struct {
 		unsigned int running:1;
 		unsigned int declined:1;
 		unsigned int keepuntilshutdown:1;
+		unsigned int load_timed:1;		/* its load function has run, so load_usec is set */
 	} flags;
 	AST_LIST_ENTRY(ast_module) list_entry;
 	AST_DLLIST_ENTRY(ast_module) entry;
@@ -996,23 +1000,29 @@ static unsigned int inspect_module(const struct ast_module *mod)
 	return 0;
 }
 
-static enum ast_module_load_result start_resource(struct ast_module *mod)
+/*! \brief Run the load function of a module, timing it */
+static enum ast_module_load_result run_load(struct ast_module *mod)
 {
-	char tmp[256];
+	struct timeval start = ast_tvnow();
 	enum ast_module_load_result res;
 
-	if (mod->flags.running) {
-		return AST_MODULE_LOAD_SUCCESS;
-	}
+	res = mod->info->load();
 
-	if (!mod->info->load) {
-		return AST_MODULE_LOAD_FAILURE;
-	}
+	mod->load_usec = ast_tvdiff_us(ast_tvnow(), start);
+	mod->flags.load_timed = 1;
 
-	if (!ast_fully_booted) {
-		ast_verb(1, "Loading %s.\n", mod->resource);
-	}
-	res = mod->info->load();
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Note the result of the load function of a module
+ *
+ * \note module_list must not be locked by another thread.
+ */
+static enum ast_module_load_result start_resource_finish(struct ast_module *mod, enum ast_module_load_result res)
+{
+	char tmp[256];
 
 	switch (res) {
 	case AST_MODULE_LOAD_SUCCESS:
@@ -1044,6 +1054,23 @@ static enum ast_module_load_result start_resource(struct ast_module *mod)
 	return res;
 }
 
+static enum ast_module_load_result start_resource(struct ast_module *mod)
+{
+	if (mod->flags.running) {
+		return AST_MODULE_LOAD_SUCCESS;
+	}
+
+	if (!mod->info->load) {
+		return AST_MODULE_LOAD_FAILURE;
+	}
+
+	if (!ast_fully_booted) {
+		ast_verb(1, "Loading %s.\n", mod->resource);
+	}
+
+	return start_resource_finish(mod, run_load(mod));
+}
+
 /*! loads a resource based upon resource_name. If global_symbols_only is set
  *  only modules with global symbols will be loaded.
  *
@@ -1151,13 +1178,16 @@ static struct load_order_entry *add_to_load_order(const char *resource, struct l
 	return order;
 }
 
-static int mod_load_cmp(void *a, void *b)
+static int mod_load_pri(const struct ast_module *mod)
 {
-	struct ast_module *a_mod = (struct ast_module *) a;
-	struct ast_module *b_mod = (struct ast_module *) b;
 	/* if load_pri is not set, default is 128.  Lower is better */
-	int a_pri = ast_test_flag(a_mod->info, AST_MODFLAG_LOAD_ORDER) ? a_mod->info->load_pri : 128;
-	int b_pri = ast_test_flag(b_mod->info, AST_MODFLAG_LOAD_ORDER) ? b_mod->info->load_pri : 128;
+	return ast_test_flag(mod->info, AST_MODFLAG_LOAD_ORDER) ? mod->info->load_pri : 128;
+}
+
+static int mod_load_cmp(void *a, void *b)
+{
+	int a_pri = mod_load_pri(a);
+	int b_pri = mod_load_pri(b);
 
 	/*
 	 * Returns comparison values for a min-heap
@@ -1168,10 +1198,243 @@ static int mod_load_cmp(void *a, void *b)
 	return b_pri - a_pri;
 }
 
+/*!
+ * Modules of the same load priority are started together on a threadpool
+ * when load_threads is set in modules.conf. Those of a lower priority are
+ * all started first, as they are when loading one at a time, and a module
+ * waits for those of its own priority it names in nonoptreq. Each module is
+ * moved to the end of module_list as it finishes, so it is unloaded before
+ * the modules it waited for.
+ */
+
+/*! \brief A module started alongside others of the same load priority */
+struct load_task {
+	struct ast_module *mod;
+	struct load_wave *wave;
+	enum ast_module_load_result res;
+	/*! The modules of the same priority this one waits for */
+	AST_VECTOR(, struct load_task *) deps;
+	unsigned int started:1;
+	unsigned int done:1;
+};
+
+/*! \brief The modules of one load priority being started */
+struct load_wave {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! Tasks whose load function has returned, for the loader to finish */
+	AST_VECTOR(, struct load_task *) finished;
+};
+
+static int load_task_run(void *data)
+{
+	struct load_task *task = data;
+	struct load_wave *wave = task->wave;
+
+	task->res = run_load(task->mod);
+
+	ast_mutex_lock(&wave->lock);
+	/* There is room for every task, so this cannot fail */
+	AST_VECTOR_APPEND(&wave->finished, task);
+	ast_cond_signal(&wave->cond);
+	ast_mutex_unlock(&wave->lock);
+
+	return 0;
+}
+
+/*! \brief Whether a module names another in its nonoptreq */
+static int load_task_requires(const struct ast_module *mod, const struct ast_module *other)
+{
+	char *reqs;
+	char *req;
+
+	if (ast_strlen_zero(mod->info->nonoptreq)) {
+		return 0;
+	}
+	reqs = ast_strdupa(mod->info->nonoptreq);
+	while ((req = strsep(&reqs, ","))) {
+		req = ast_strip(req);
+		if (!ast_strlen_zero(req) && !resource_name_match(req, other->resource)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int load_task_ready(const struct load_task *task)
+{
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&task->deps); ++i) {
+		if (!AST_VECTOR_GET(&task->deps, i)->done) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*! \brief Start modules one at a time, as if there were no threadpool */
+static int start_resource_serial(struct ast_module **mods, int num, int *count)
+{
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		switch (start_resource(mods[i])) {
+		case AST_MODULE_LOAD_SUCCESS:
+			++*count;
+			break;
+		case AST_MODULE_LOAD_FAILURE:
+			return -1;
+		case AST_MODULE_LOAD_DECLINE:
+		case AST_MODULE_LOAD_SKIP:
+		case AST_MODULE_LOAD_PRIORITY:
+			break;
+		}
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Start modules of the same load priority on a threadpool
+ *
+ * \param mods The modules, in the order they would be started one at a time
+ * \param num The number of modules
+ * \param pool The threadpool to start them on
+ * \param count Incremented for each module started
+ *
+ * \note Called with module_list locked once by this thread, which is unlocked
+ * while the modules start so their load functions may use it.
+ *
+ * \retval 0 on success
+ * \retval -1 if a module failed to load; those already started still finish
+ */
+static int start_resource_wave(struct ast_module **mods, int num, struct ast_threadpool *pool, int *count)
+{
+	struct load_wave wave;
+	struct load_task *tasks;
+	int remaining = num;
+	int running = 0;
+	int failed = 0;
+	int i;
+	int j;
+
+	if (!(tasks = ast_calloc(num, sizeof(*tasks)))) {
+		return start_resource_serial(mods, num, count);
+	}
+	if (AST_VECTOR_INIT(&wave.finished, num)) {
+		ast_free(tasks);
+		return start_resource_serial(mods, num, count);
+	}
+	ast_mutex_init(&wave.lock);
+	ast_cond_init(&wave.cond, NULL);
+
+	for (i = 0; i < num; ++i) {
+		tasks[i].mod = mods[i];
+		tasks[i].wave = &wave;
+		AST_VECTOR_INIT(&tasks[i].deps, 0);
+		for (j = 0; j < num; ++j) {
+			if (j != i && load_task_requires(mods[i], mods[j])) {
+				AST_VECTOR_APPEND(&tasks[i].deps, &tasks[j]);
+			}
+		}
+	}
+
+	AST_DLLIST_UNLOCK(&module_list);
+
+	while (remaining) {
+		int started = 0;
+
+		for (i = 0; i < num && !failed; ++i) {
+			struct load_task *task = &tasks[i];
+
+			if (task->started || !load_task_ready(task)) {
+				continue;
+			}
+			task->started = 1;
+			started = 1;
+
+			if (task->mod->flags.running || !task->mod->info->load) {
+				/* Nothing to run; start_resource() gives its result */
+				task->res = task->mod->flags.running ? AST_MODULE_LOAD_SUCCESS : AST_MODULE_LOAD_FAILURE;
+				task->done = 1;
+				--remaining;
+				if (task->res == AST_MODULE_LOAD_SUCCESS) {
+					++*count;
+				} else {
+					failed = 1;
+				}
+				/* Others may have been waiting for it */
+				i = -1;
+				continue;
+			}
+
+			ast_verb(1, "Loading %s.\n", task->mod->resource);
+			++running;
+			if (ast_threadpool_push(pool, load_task_run, task)) {
+				load_task_run(task);
+			}
+		}
+
+		if (!running) {
+			if (failed || !remaining) {
+				break;
+			}
+			if (!started) {
+				/* The modules left wait for each other; start the first as one at a time would */
+				for (i = 0; tasks[i].started; ++i) {
+				}
+				AST_VECTOR_RESET(&tasks[i].deps, AST_VECTOR_ELEM_CLEANUP_NOOP);
+			}
+			continue;
+		}
+
+		ast_mutex_lock(&wave.lock);
+		while (!AST_VECTOR_SIZE(&wave.finished)) {
+			ast_cond_wait(&wave.cond, &wave.lock);
+		}
+		while (AST_VECTOR_SIZE(&wave.finished)) {
+			struct load_task *task = AST_VECTOR_REMOVE(&wave.finished, 0, 1);
+
+			ast_mutex_unlock(&wave.lock);
+			switch (start_resource_finish(task->mod, task->res)) {
+			case AST_MODULE_LOAD_SUCCESS:
+				++*count;
+				break;
+			case AST_MODULE_LOAD_FAILURE:
+				failed = 1;
+				break;
+			case AST_MODULE_LOAD_DECLINE:
+			case AST_MODULE_LOAD_SKIP:
+			case AST_MODULE_LOAD_PRIORITY:
+				break;
+			}
+			task->done = 1;
+			--running;
+			--remaining;
+			ast_mutex_lock(&wave.lock);
+		}
+		ast_mutex_unlock(&wave.lock);
+	}
+
+	AST_DLLIST_LOCK(&module_list);
+
+	for (i = 0; i < num; ++i) {
+		AST_VECTOR_FREE(&tasks[i].deps);
+	}
+	ast_free(tasks);
+	AST_VECTOR_FREE(&wave.finished);
+	ast_cond_destroy(&wave.cond);
+	ast_mutex_destroy(&wave.lock);
+
+	return failed ? -1 : 0;
+}
+
 /*! loads modules in order by load_pri, updates mod_count
+	\param pool If not NULL, modules of the same priority are started together on it
 	\return -1 on failure to load module, -2 on failure to load required module, otherwise 0
 */
-static int load_resource_list(struct load_order *load_order, unsigned int global_symbols, int *mod_count)
+static int load_resource_list(struct load_order *load_order, unsigned int global_symbols, int *mod_count, struct ast_threadpool *pool)
 {
 	struct ast_heap *resource_heap;
 	struct load_order_entry *order;
@@ -1209,6 +1472,24 @@ static int load_resource_list(struct load_order *load_order, unsigned int global
 	AST_LIST_TRAVERSE_SAFE_END;
 
 	/* second remove modules from heap sorted by priority */
+	while (pool && (mod = ast_heap_peek(resource_heap, 1))) {
+		AST_VECTOR(, struct ast_module *) wave;
+		int pri = mod_load_pri(mod);
+
+		if (AST_VECTOR_INIT(&wave, 8)) {
+			break;
+		}
+		while ((mod = ast_heap_peek(resource_heap, 1)) && mod_load_pri(mod) == pri
+			&& !AST_VECTOR_APPEND(&wave, mod)) {
+			ast_heap_pop(resource_heap);
+		}
+		if (start_resource_wave(AST_VECTOR_GET_ADDR(&wave, 0), AST_VECTOR_SIZE(&wave), pool, &count)) {
+			AST_VECTOR_FREE(&wave);
+			res = -1;
+			goto done;
+		}
+		AST_VECTOR_FREE(&wave);
+	}
 	while ((mod = ast_heap_pop(resource_heap))) {
 		switch (start_resource(mod)) {
 		case AST_MODULE_LOAD_SUCCESS:
@@ -1244,6 +1525,9 @@ int load_modules(unsigned int preload_only)
 	int res = 0;
 	struct ast_flags config_flags = { 0 };
 	int modulecount = 0;
+	struct ast_threadpool *pool = NULL;
+	const char *load_threads;
+	int threads = 1;
 
 #ifdef LOADABLE_MODULES
 	struct dirent *dirent;
@@ -1346,6 +1630,28 @@ int load_modules(unsigned int preload_only)
 		AST_LIST_TRAVERSE_SAFE_END;
 	}
 
+	/* Modules loaded before the core is up are always loaded one at a time */
+	if (!preload_only) {
+		load_threads = ast_variable_retrieve(cfg, "modules", "load_threads");
+		if (!ast_strlen_zero(load_threads)
+			&& (sscanf(load_threads, "%30d", &threads) != 1 || threads < 1)) {
+			ast_log(LOG_WARNING, "Invalid load_threads '%s' in %s, loading modules one at a time.\n",
+				load_threads, AST_MODULE_CONFIG);
+			threads = 1;
+		}
+	}
+	if (threads > 1) {
+		struct ast_threadpool_options options = {
+			.version = AST_THREADPOOL_OPTIONS_VERSION,
+			.initial_size = threads,
+			.max_size = threads,
+		};
+
+		if (!(pool = ast_threadpool_create("module_loader", NULL, &options))) {
+			ast_log(LOG_WARNING, "Unable to create threads to load modules, loading them one at a time.\n");
+		}
+	}
+
 	/* we are done with the config now, all the information we need is in the
 	   load_order list */
 	ast_config_destroy(cfg);
@@ -1358,16 +1664,20 @@ int load_modules(unsigned int preload_only)
 		ast_log(LOG_NOTICE, "%u modules will be loaded.\n", load_count);
 
 	/* first, load only modules that provide global symbols */
-	if ((res = load_resource_list(&load_order, 1, &modulecount)) < 0) {
+	if ((res = load_resource_list(&load_order, 1, &modulecount, pool)) < 0) {
 		goto done;
 	}
 
 	/* now load everything else */
-	if ((res = load_resource_list(&load_order, 0, &modulecount)) < 0) {
+	if ((res = load_resource_list(&load_order, 0, &modulecount, pool)) < 0) {
 		goto done;
 	}
 
 done:
+	if (pool) {
+		ast_threadpool_shutdown(pool);
+	}
+
 	while ((order = AST_LIST_REMOVE_HEAD(&load_order, entry))) {
 		ast_free(order->resource);
 		ast_free(order);
@@ -1391,7 +1701,8 @@ void ast_update_use_count(void)
 
 int ast_update_module_list(int (*modentry)(const char *module, const char *description,
                                            int usecnt, const char *status, const char *like,
-										   enum ast_module_support_level support_level),
+										   enum ast_module_support_level support_level,
+                                           int64_t load_usec),
                            const char *like)
 {
 	struct ast_module *cur;
@@ -1409,7 +1720,8 @@ int ast_update_module_list(int (*modentry)(const char *module, const char *descr
 
 	while ((cur = AST_LIST_REMOVE_HEAD(&alpha_module_list, list_entry))) {
 		total_mod_loaded += modentry(cur->resource, cur->info->description, cur->usecount,
-						cur->flags.running ? "Running" : "Not Running", like, cur->info->support_level);
+						cur->flags.running ? "Running" : "Not Running", like, cur->info->support_level,
+						cur->flags.load_timed ? cur->load_usec : -1);
 	}
 
 	if (unlock) {
@@ -31,6 +31,8 @@ ASTERISK_REGISTER_FILE()
 
 #include "asterisk/utils.h"
 #include "asterisk/lock.h"
+#include "asterisk/cli.h"
+#include "asterisk/_private.h"
 
 /* Allow direct use of pthread_mutex_* / pthread_cond_* */
 #undef pthread_mutex_init
@@ -122,6 +124,227 @@ static inline void delete_reentrancy_cs(struct ast_lock_track **plt)
 
 #endif /* DEBUG_THREADS */
 
+/*
+ * Lock contention profiling. While it runs, a lock that cannot be taken at
+ * once is timed, and waits of at least contention_threshold microseconds
+ * are added up by where the lock was waited for and what it is called, with
+ * a histogram of the waits and where the holder locked it from. Locks note
+ * where they were locked from only while it runs, and a lock taken at once
+ * costs one extra check otherwise. It needs neither DEBUG_THREADS nor lock
+ * tracking, but is not done with DETECT_DEADLOCKS, which polls instead.
+ */
+
+/*! \brief Microseconds a wait must last to be recorded; 0 while not profiling */
+static unsigned int contention_threshold;
+
+/*! \brief Changed each time profiling starts, so holders noted before are not trusted */
+static unsigned int contention_gen;
+
+#define CONTENTION_BUCKETS 1021
+#define CONTENTION_HOLDERS 4
+
+/*! \brief Upper bounds of the wait histogram buckets, in microseconds; the last is unbounded */
+static const int64_t contention_bounds[] = { 10, 100, 1000, 10000, 100000, 1000000, };
+#define CONTENTION_HISTOGRAM (ARRAY_LEN(contention_bounds) + 1)
+
+enum contention_type {
+	CONTENTION_MUTEX,
+	CONTENTION_RDLOCK,
+	CONTENTION_WRLOCK,
+};
+
+static const char * const contention_type_names[] = {
+	[CONTENTION_MUTEX] = "mutex",
+	[CONTENTION_RDLOCK] = "rdlock",
+	[CONTENTION_WRLOCK] = "wrlock",
+};
+
+/*! \brief Where a lock was held from while it was waited for */
+struct contention_holder {
+	char file[64];
+	int lineno;
+	unsigned int waits;
+	int64_t total;
+};
+
+/*! \brief The waits for a lock at one place */
+struct lock_contention {
+	struct lock_contention *next;
+	enum contention_type type;
+	char name[48];
+	char file[64];
+	char func[40];
+	int lineno;
+	unsigned int waits;
+	/*! Microseconds waited in all, and at most */
+	int64_t total;
+	int64_t max;
+	unsigned int histogram[CONTENTION_HISTOGRAM];
+	/*! Waits where the holder was not known */
+	unsigned int unknown_holder;
+	struct contention_holder holders[CONTENTION_HOLDERS];
+};
+
+static struct lock_contention *contentions[CONTENTION_BUCKETS];
+
+/* Not an ast_mutex_t, which would record its own contention */
+static pthread_mutex_t contention_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*! \brief Set while this thread records contention, so the locks it takes are not profiled */
+static __thread int in_contention;
+
+#define CONTENTION_HOLDER_SET(t, file, line) \
+	do { \
+		(t)->holder_file = (file); \
+		(t)->holder_line = (line); \
+		(t)->holder_gen = contention_gen; \
+	} while (0)
+
+#define CONTENTION_HOLDER_CLEAR(t) \
+	do { \
+		if (contention_threshold) { \
+			(t)->holder_file = NULL; \
+		} \
+	} while (0)
+
+/*!
+ * \internal
+ * \brief Add a wait to the contention of a lock
+ *
+ * \param holder_file Where the holder locked it from, or NULL if not known
+ */
+static void contention_record(enum contention_type type, const char *name, const char *filename,
+	int lineno, const char *func, const char *holder_file, int holder_line, int64_t waited)
+{
+	struct lock_contention *entry;
+	struct contention_holder *holder = NULL;
+	unsigned int hash = (ast_str_hash(filename) + lineno) % CONTENTION_BUCKETS;
+	int bucket;
+	int i;
+
+	if (in_contention) {
+		return;
+	}
+	in_contention = 1;
+	pthread_mutex_lock(&contention_lock);
+
+	for (entry = contentions[hash]; entry; entry = entry->next) {
+		if (entry->lineno == lineno && entry->type == type
+			&& !strncmp(entry->file, filename, sizeof(entry->file) - 1)
+			&& !strncmp(entry->name, name, sizeof(entry->name) - 1)) {
+			break;
+		}
+	}
+	if (!entry && (entry = ast_std_calloc(1, sizeof(*entry)))) {
+		entry->type = type;
+		ast_copy_string(entry->name, name, sizeof(entry->name));
+		ast_copy_string(entry->file, filename, sizeof(entry->file));
+		ast_copy_string(entry->func, func, sizeof(entry->func));
+		entry->lineno = lineno;
+		entry->next = contentions[hash];
+		contentions[hash] = entry;
+	}
+
+	if (entry) {
+		++entry->waits;
+		entry->total += waited;
+		entry->max = MAX(entry->max, waited);
+		for (bucket = 0; bucket < ARRAY_LEN(contention_bounds) && waited >= contention_bounds[bucket]; ++bucket) {
+		}
+		++entry->histogram[bucket];
+
+		if (holder_file) {
+			/* Kept are the holders seen first, and the one waited for the least gives way */
+			for (i = 0; i < CONTENTION_HOLDERS; ++i) {
+				if (!entry->holders[i].waits
+					|| (entry->holders[i].lineno == holder_line
+						&& !strncmp(entry->holders[i].file, holder_file, sizeof(entry->holders[i].file) - 1))) {
+					holder = &entry->holders[i];
+					break;
+				}
+				if (!holder || entry->holders[i].total < holder->total) {
+					holder = &entry->holders[i];
+				}
+			}
+			if (!holder->waits || holder->lineno != holder_line
+				|| strncmp(holder->file, holder_file, sizeof(holder->file) - 1)) {
+				ast_copy_string(holder->file, holder_file, sizeof(holder->file));
+				holder->lineno = holder_line;
+				holder->waits = 0;
+				holder->total = 0;
+			}
+			++holder->waits;
+			holder->total += waited;
+		} else {
+			++entry->unknown_holder;
+		}
+	}
+
+	pthread_mutex_unlock(&contention_lock);
+	in_contention = 0;
+}
+
+/*!
+ * \internal
+ * \brief Where a lock is held from, if noted since profiling started
+ */
+#define CONTENTION_HOLDER_GET(t, file, line) \
+	do { \
+		(file) = (t)->holder_gen == contention_gen ? (t)->holder_file : NULL; \
+		(line) = (t)->holder_line; \
+	} while (0)
+
+static int contention_mutex_lock(const char *filename, int lineno, const char *func,
+	const char *mutex_name, ast_mutex_t *t)
+{
+	const char *holder_file;
+	int holder_line;
+	struct timeval start;
+	int64_t waited;
+	int res;
+
+	res = pthread_mutex_trylock(&t->mutex);
+	if (res == EBUSY) {
+		CONTENTION_HOLDER_GET(t, holder_file, holder_line);
+		start = ast_tvnow();
+		res = pthread_mutex_lock(&t->mutex);
+		waited = ast_tvdiff_us(ast_tvnow(), start);
+		if (waited >= contention_threshold) {
+			contention_record(CONTENTION_MUTEX, mutex_name, filename, lineno, func,
+				holder_file, holder_line, waited);
+		}
+	}
+	if (!res) {
+		CONTENTION_HOLDER_SET(t, filename, lineno);
+	}
+	return res;
+}
+
+static int contention_rwlock_lock(enum contention_type type, const char *filename, int lineno,
+	const char *func, ast_rwlock_t *t, const char *name)
+{
+	const char *holder_file;
+	int holder_line;
+	struct timeval start;
+	int64_t waited;
+	int res;
+
+	res = type == CONTENTION_RDLOCK ? pthread_rwlock_tryrdlock(&t->lock) : pthread_rwlock_trywrlock(&t->lock);
+	if (res == EBUSY) {
+		CONTENTION_HOLDER_GET(t, holder_file, holder_line);
+		start = ast_tvnow();
+		res = type == CONTENTION_RDLOCK ? pthread_rwlock_rdlock(&t->lock) : pthread_rwlock_wrlock(&t->lock);
+		waited = ast_tvdiff_us(ast_tvnow(), start);
+		if (waited >= contention_threshold) {
+			contention_record(type, name, filename, lineno, func, holder_file, holder_line, waited);
+		}
+	}
+	if (!res) {
+		CONTENTION_HOLDER_SET(t, filename, lineno);
+	}
+	return res;
+}
+
 int __ast_pthread_mutex_init(int tracking, const char *filename, int lineno, const char *func,
 						const char *mutex_name, ast_mutex_t *t)
 {
@@ -304,13 +527,17 @@ int __ast_pthread_mutex_lock(const char *filename, int lineno, const char *func,
 		} while (res == EBUSY);
 	}
 #else /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
+	if (contention_threshold && !in_contention) {
+		res = contention_mutex_lock(filename, lineno, func, mutex_name, t);
+	} else {
 #ifdef	HAVE_MTX_PROFILE
-	ast_mark(mtx_prof, 1);
-	res = pthread_mutex_trylock(&t->mutex);
-	ast_mark(mtx_prof, 0);
-	if (res)
+		ast_mark(mtx_prof, 1);
+		res = pthread_mutex_trylock(&t->mutex);
+		ast_mark(mtx_prof, 0);
+		if (res)
 #endif
-	res = pthread_mutex_lock(&t->mutex);
+		res = pthread_mutex_lock(&t->mutex);
+	}
 #endif /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
 
 #ifdef DEBUG_THREADS
@@ -482,6 +709,7 @@ int __ast_pthread_mutex_unlock(const char *filename, int lineno, const char *fun
 	}
 #endif /* DEBUG_THREADS */
 
+	CONTENTION_HOLDER_CLEAR(t);
 	res = pthread_mutex_unlock(&t->mutex);
 
 #ifdef DEBUG_THREADS
@@ -595,6 +823,7 @@ int __ast_cond_wait(const char *filename, int lineno, const char *func,
 	}
 #endif /* DEBUG_THREADS */
 
+	CONTENTION_HOLDER_CLEAR(t);
 	res = pthread_cond_wait(cond, &t->mutex);
 
 #ifdef DEBUG_THREADS
@@ -663,6 +892,7 @@ int __ast_cond_timedwait(const char *filename, int lineno, const char *func,
 	}
 #endif /* DEBUG_THREADS */
 
+	CONTENTION_HOLDER_CLEAR(t);
 	res = pthread_cond_timedwait(cond, &t->mutex, abstime);
 
 #ifdef DEBUG_THREADS
@@ -824,6 +1054,7 @@ int __ast_rwlock_unlock(const char *filename, int line, const char *func, ast_rw
 	}
 #endif /* DEBUG_THREADS */
 
+	CONTENTION_HOLDER_CLEAR(t);
 	res = pthread_rwlock_unlock(&t->lock);
 
 #ifdef DEBUG_THREADS
@@ -906,7 +1137,11 @@ int __ast_rwlock_rdlock(const char *filename, int line, const char *func, ast_rw
 		} while (res == EBUSY);
 	}
 #else /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
-	res = pthread_rwlock_rdlock(&t->lock);
+	if (contention_threshold && !in_contention) {
+		res = contention_rwlock_lock(CONTENTION_RDLOCK, filename, line, func, t, name);
+	} else {
+		res = pthread_rwlock_rdlock(&t->lock);
+	}
 #endif /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
 
 #ifdef DEBUG_THREADS
@@ -1015,7 +1250,11 @@ int __ast_rwlock_wrlock(const char *filename, int line, const char *func, ast_rw
 		} while (res == EBUSY);
 	}
 #else /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
-	res = pthread_rwlock_wrlock(&t->lock);
+	if (contention_threshold && !in_contention) {
+		res = contention_rwlock_lock(CONTENTION_WRLOCK, filename, line, func, t, name);
+	} else {
+		res = pthread_rwlock_wrlock(&t->lock);
+	}
 #endif /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
 
 #ifdef DEBUG_THREADS
@@ -1357,3 +1596,204 @@ int __ast_rwlock_trywrlock(const char *filename, int line, const char *func, ast
 
 	return res;
 }
+
+static char *handle_lock_contention_start(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned int threshold = 1000;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "lock contention start";
+		e->usage =
+			"Usage: lock contention start [<microseconds>]\n"
+			"       Record waits for mutexes, read/write locks and ao2 object\n"
+			"       locks that last at least this long, 1000 microseconds by\n"
+			"       default.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%30u", &threshold) != 1 || !threshold) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	pthread_mutex_lock(&contention_lock);
+	if (!contention_threshold) {
+		contention_gen = (contention_gen + 1) & 0x7fffffff;
+	}
+	contention_threshold = threshold;
+	pthread_mutex_unlock(&contention_lock);
+
+	ast_cli(a->fd, "Recording lock waits of at least %u microseconds.\n", threshold);
+	return CLI_SUCCESS;
+}
+
+static char *handle_lock_contention_stop(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "lock contention stop";
+		e->usage =
+			"Usage: lock contention stop\n"
+			"       Stop recording lock waits. Those recorded are kept.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	contention_threshold = 0;
+
+	ast_cli(a->fd, "Lock waits are no longer recorded.\n");
+	return CLI_SUCCESS;
+}
+
+static char *handle_lock_contention_reset(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct lock_contention *entry;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "lock contention reset";
+		e->usage =
+			"Usage: lock contention reset\n"
+			"       Forget the lock waits recorded so far.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	pthread_mutex_lock(&contention_lock);
+	for (i = 0; i < CONTENTION_BUCKETS; ++i) {
+		while ((entry = contentions[i])) {
+			contentions[i] = entry->next;
+			ast_std_free(entry);
+		}
+	}
+	pthread_mutex_unlock(&contention_lock);
+
+	ast_cli(a->fd, "Forgot the recorded lock waits.\n");
+	return CLI_SUCCESS;
+}
+
+static int contention_total_cmp(const void *left, const void *right)
+{
+	const struct lock_contention *l = left;
+	const struct lock_contention *r = right;
+
+	return l->total < r->total ? 1 : l->total > r->total ? -1 : 0;
+}
+
+static char *handle_lock_contention_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct lock_contention *copy = NULL;
+	struct lock_contention *entry;
+	int limit = 20;
+	int count = 0;
+	int i;
+	int j;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "lock contention show";
+		e->usage =
+			"Usage: lock contention show [<count>]\n"
+			"       Show the <count> places, 20 by default, that waited for\n"
+			"       a lock the longest in all, with a histogram of the waits\n"
+			"       and where the lock was held from meanwhile.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%30d", &limit) != 1 || limit <= 0) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	/* Copied with the locks of this thread not profiled, as ours is held */
+	in_contention = 1;
+	pthread_mutex_lock(&contention_lock);
+	for (i = 0; i < CONTENTION_BUCKETS; ++i) {
+		for (entry = contentions[i]; entry; entry = entry->next) {
+			++count;
+		}
+	}
+	if (count && (copy = ast_std_malloc(count * sizeof(*copy)))) {
+		count = 0;
+		for (i = 0; i < CONTENTION_BUCKETS; ++i) {
+			for (entry = contentions[i]; entry; entry = entry->next) {
+				copy[count++] = *entry;
+			}
+		}
+	} else {
+		count = 0;
+	}
+	pthread_mutex_unlock(&contention_lock);
+	in_contention = 0;
+
+	if (!count) {
+		ast_cli(a->fd, "No lock waits have been recorded.\n");
+		return CLI_SUCCESS;
+	}
+	qsort(copy, count, sizeof(*copy), contention_total_cmp);
+
+	ast_cli(a->fd, "Waits by total time; histogram of waits under 10us 100us 1ms 10ms 100ms 1s, and longer\n\n");
+	for (i = 0; i < count && i < limit; ++i) {
+		entry = &copy[i];
+		ast_cli(a->fd, "%s '%s' at %s() line %d of %s\n", contention_type_names[entry->type],
+			entry->name, entry->func, entry->lineno, entry->file);
+		ast_cli(a->fd, "    %u waits, %.3f ms in all, %.3f ms at most; histogram",
+			entry->waits, entry->total / 1000.0, entry->max / 1000.0);
+		for (j = 0; j < CONTENTION_HISTOGRAM; ++j) {
+			ast_cli(a->fd, " %u", entry->histogram[j]);
+		}
+		ast_cli(a->fd, "\n");
+		for (j = 0; j < CONTENTION_HOLDERS && entry->holders[j].waits; ++j) {
+			ast_cli(a->fd, "    held from line %d of %s: %u waits, %.3f ms\n", entry->holders[j].lineno,
+				entry->holders[j].file, entry->holders[j].waits, entry->holders[j].total / 1000.0);
+		}
+		if (entry->unknown_holder) {
+			ast_cli(a->fd, "    held from unknown places: %u waits\n", entry->unknown_holder);
+		}
+	}
+	ast_cli(a->fd, "\n%d places waited for locks; recording is %s.\n", count,
+		contention_threshold ? "running" : "stopped");
+	ast_std_free(copy);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_lock_contention[] = {
+	AST_CLI_DEFINE(handle_lock_contention_start, "Start recording lock contention"),
+	AST_CLI_DEFINE(handle_lock_contention_stop, "Stop recording lock contention"),
+	AST_CLI_DEFINE(handle_lock_contention_reset, "Forget recorded lock contention"),
+	AST_CLI_DEFINE(handle_lock_contention_show, "Show the most contended locks"),
+};
+
+static void lock_contention_shutdown(void)
+{
+	ast_cli_unregister_multiple(cli_lock_contention, ARRAY_LEN(cli_lock_contention));
+}
+
+void ast_lock_contention_init(void)
+{
+	ast_cli_register_multiple(cli_lock_contention, ARRAY_LEN(cli_lock_contention));
+	ast_register_cleanup(lock_contention_shutdown);
+}
@@ -70,6 +70,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/ast_version.h"
 #include "asterisk/backtrace.h"
 #include "asterisk/json.h"
+#include "asterisk/logger_binary.h"
 
 /*** DOCUMENTATION
  ***/
@@ -81,6 +82,10 @@ static char exec_after_rotate[256] = "";
 
 static int filesize_reload_needed;
 static unsigned int global_logmask = 0xFFFF;
+/*! \brief The levels binary channels want, which keep the arguments of messages */
+static unsigned int binary_logmask;
+/*! \brief The levels the other channels want, which need messages formatted */
+static unsigned int text_logmask = 0xFFFF;
 static int queuelog_init;
 static int logger_initialized;
 static volatile int next_unique_callid = 1; /* Used to assign unique call_ids to calls */
@@ -144,6 +149,10 @@ struct logchannel {
 	int lineno;
 	/*! Whether this log channel was created dynamically */
 	int dynamic;
+	/*! Whether this log channel writes binary records */
+	int binary;
+	/*! The strings a binary log channel has written */
+	struct logb_strings *strings;
 	/*! Components (levels) from last config load */
 	char components[0];
 };
@@ -161,26 +170,143 @@ struct logmsg {
 	int line;
 	int lwp;
 	ast_callid callid;
+	/*! When the message was logged, formatted into date by the logger thread */
+	struct timeval when;
+	/*! The arguments of fmt, for binary channels */
+	unsigned char *args;
+	size_t args_len;
+	/*! The message is to be formatted from fmt and args */
+	unsigned int unformatted:1;
 	AST_DECLARE_STRING_FIELDS(
 		AST_STRING_FIELD(date);
 		AST_STRING_FIELD(file);
 		AST_STRING_FIELD(function);
 		AST_STRING_FIELD(message);
 		AST_STRING_FIELD(level_name);
+		AST_STRING_FIELD(fmt);
 	);
 	AST_LIST_ENTRY(logmsg) list;
 };
 
 static void logmsg_free(struct logmsg *msg)
 {
+	ast_free(msg->args);
 	ast_free(msg);
 }
 
+/*! \brief Buckets of the strings a binary log channel has written */
+#define LOGB_STRING_BUCKETS 1024
+
+/*! \brief A string a binary log channel has written, and its id */
+struct logb_string {
+	struct logb_string *next;
+	uint32_t id;
+	char text[0];
+};
+
+/*! \brief The strings a binary log channel has written since it was opened */
+struct logb_strings {
+	uint32_t next_id;
+	struct logb_string *buckets[LOGB_STRING_BUCKETS];
+};
+
+static void logchannel_free(struct logchannel *chan)
+{
+	if (chan->strings) {
+		int i;
+
+		for (i = 0; i < LOGB_STRING_BUCKETS; ++i) {
+			struct logb_string *str;
+
+			while ((str = chan->strings->buckets[i])) {
+				chan->strings->buckets[i] = str->next;
+				ast_free(str);
+			}
+		}
+		ast_free(chan->strings);
+	}
+	ast_free(chan);
+}
+
+/*! \brief Add the levels a channel wants to those wanted */
+static void logchannel_add_logmask(struct logchannel *chan)
+{
+	global_logmask |= chan->logmask;
+	if (chan->binary) {
+		binary_logmask |= chan->logmask;
+	} else {
+		text_logmask |= chan->logmask;
+	}
+}
+
 static AST_LIST_HEAD_STATIC(logmsgs, logmsg);
 static pthread_t logthread = AST_PTHREADT_NULL;
 static ast_cond_t logcond;
 static int close_logger_thread = 0;
 
+/*! \brief Messages each thread may have waiting for the logger thread (a power of 2) */
+#define LOGMSG_RING_SIZE 1024
+
+/*!
+ * \brief The messages logged by one thread, waiting for the logger thread
+ *
+ * Only the owning thread adds messages and only the logger thread takes them,
+ * so neither needs a lock. When a thread's ring is full, its messages are
+ * dropped and counted rather than waiting for room.
+ */
+struct logmsg_ring {
+	struct logmsg *msgs[LOGMSG_RING_SIZE];
+	/*! Messages taken, only changed by the logger thread */
+	volatile int head;
+	/*! Messages added, only changed by the owning thread */
+	volatile int tail;
+	/*! The owning thread has exited, so the logger thread frees the ring once empty */
+	volatile int orphaned;
+	AST_LIST_ENTRY(logmsg_ring) list;
+};
+
+/*! \brief The rings of every thread that has logged, locked only to add and remove rings */
+static AST_LIST_HEAD_STATIC(logmsg_rings, logmsg_ring);
+
+/*! \brief What a thread keeps of its ring */
+struct logmsg_ring_ref {
+	struct logmsg_ring *ring;
+};
+
+/*! \brief Non-zero while the logger thread waits, so it must be signalled */
+static volatile int logger_waiting;
+
+/*! \brief Messages dropped since the logger thread last reported them */
+static volatile int logmsgs_dropped;
+
+/*! \brief Messages dropped since the logger started */
+static unsigned int logmsgs_dropped_total;
+
+static int logmsg_ring_ref_init(void *data)
+{
+	struct logmsg_ring_ref *ref = data;
+
+	ref->ring = ast_calloc(1, sizeof(*ref->ring));
+	if (!ref->ring) {
+		return -1;
+	}
+	AST_LIST_LOCK(&logmsg_rings);
+	AST_LIST_INSERT_TAIL(&logmsg_rings, ref->ring, list);
+	AST_LIST_UNLOCK(&logmsg_rings);
+	return 0;
+}
+
+static void logmsg_ring_ref_free(void *data)
+{
+	struct logmsg_ring_ref *ref = data;
+
+	/* The messages still in the ring are the logger thread's now, and so is the ring */
+	ast_atomic_fetchadd_int(&ref->ring->orphaned, 1);
+	ast_free(ref);
+}
+
+AST_THREADSTORAGE_CUSTOM(logmsg_ring_ref, logmsg_ring_ref_init, logmsg_ring_ref_free);
+
 static FILE *qlog;
 
 /*! \brief Logging channels used in the Asterisk logging system
@@ -247,6 +373,8 @@ AST_THREADSTORAGE(verbose_build_buf);
 AST_THREADSTORAGE(log_buf);
 #define LOG_BUF_INIT_SIZE       256
 
+AST_THREADSTORAGE(log_args_buf);
+
 static int format_log_json(struct logchannel *channel, struct logmsg *msg, char *buf, size_t size)
 {
 	struct ast_json *json;
@@ -358,6 +486,122 @@ static struct logformatter logformatter_default = {
 	.format_log = format_log_default,
 };
 
+/* Binary channels write records of their own; see logger_write_binary() */
+static struct logformatter logformatter_binary = {
+	.name = "binary",
+	.format_log = format_log_default,
+};
+
+/*!
+ * \internal
+ * \brief Find the id of a string a binary log channel has written, writing it if need be
+ *
+ * \retval 0 if the string could not be written
+ */
+static uint32_t logb_string_id(struct logchannel *chan, const char *text)
+{
+	unsigned int bucket = ast_str_hash(text) % LOGB_STRING_BUCKETS;
+	unsigned char header[AST_LOGB_RECORD_HEADER + 4];
+	struct logb_string *str;
+	size_t len;
+
+	for (str = chan->strings->buckets[bucket]; str; str = str->next) {
+		if (!strcmp(str->text, text)) {
+			return str->id;
+		}
+	}
+
+	len = strlen(text);
+	str = ast_malloc(sizeof(*str) + len + 1);
+	if (!str) {
+		return 0;
+	}
+	str->id = ++chan->strings->next_id;
+	strcpy(str->text, text); /* Safe */
+
+	header[0] = AST_LOGB_RECORD_STRING;
+	ast_logb_put_u32(header + 1, 4 + len);
+	ast_logb_put_u32(header + AST_LOGB_RECORD_HEADER, str->id);
+	if (fwrite(header, sizeof(header), 1, chan->fileptr) != 1
+		|| (len && fwrite(text, len, 1, chan->fileptr) != 1)) {
+		ast_free(str);
+		return 0;
+	}
+
+	str->next = chan->strings->buckets[bucket];
+	chan->strings->buckets[bucket] = str;
+	return str->id;
+}
+
+/*!
+ * \internal
+ * \brief Write a message to a binary log channel
+ *
+ * \return The bytes written, or -1 on error
+ */
+static int logger_write_binary(struct logchannel *chan, struct logmsg *msg)
+{
+	unsigned char header[AST_LOGB_RECORD_HEADER + AST_LOGB_MESSAGE_HEADER];
+	unsigned char *p = header + AST_LOGB_RECORD_HEADER;
+	uint32_t level_id = logb_string_id(chan, msg->level_name);
+	uint32_t file_id = logb_string_id(chan, msg->file);
+	uint32_t function_id = logb_string_id(chan, msg->function);
+	uint32_t fmt_id = 0;
+	const void *body;
+	size_t body_len;
+
+	if (msg->args) {
+		fmt_id = logb_string_id(chan, msg->fmt);
+		if (!fmt_id) {
+			return -1;
+		}
+		body = msg->args;
+		body_len = msg->args_len;
+	} else {
+		body = msg->message;
+		body_len = strlen(msg->message);
+	}
+	if (!level_id || !file_id || !function_id) {
+		return -1;
+	}
+
+	header[0] = AST_LOGB_RECORD_MESSAGE;
+	ast_logb_put_u32(header + 1, AST_LOGB_MESSAGE_HEADER + body_len);
+	ast_logb_put_u64(p, msg->when.tv_sec);
+	ast_logb_put_u32(p + 8, msg->when.tv_usec);
+	ast_logb_put_u32(p + 12, level_id);
+	ast_logb_put_u32(p + 16, msg->lwp);
+	ast_logb_put_u32(p + 20, msg->callid);
+	ast_logb_put_u32(p + 24, file_id);
+	ast_logb_put_u32(p + 28, msg->line);
+	ast_logb_put_u32(p + 32, function_id);
+	ast_logb_put_u32(p + 36, fmt_id);
+
+	if (fwrite(header, sizeof(header), 1, chan->fileptr) != 1
+		|| (body_len && fwrite(body, body_len, 1, chan->fileptr) != 1)) {
+		return -1;
+	}
+	return sizeof(header) + body_len;
+}
+
+/*!
+ * \internal
+ * \brief Format a message whose arguments were kept instead, for a channel that wants the text
+ */
+static void logmsg_format(struct logmsg *logmsg)
+{
+	char text[BUFSIZ];
+
+	if (!logmsg->unformatted) {
+		return;
+	}
+	logmsg->unformatted = 0;
+
+	if (ast_logb_render(text, sizeof(text), logmsg->fmt, logmsg->args, logmsg->args_len) >= 0) {
+		ast_string_field_set(logmsg, message, text);
+	}
+}
+
 static void make_components(struct logchannel *chan)
 {
 	char *w;
@@ -382,6 +626,15 @@ static void make_components(struct logchannel *chan)
 
 			if (!strcasecmp(formatter_name, "json")) {
 				memcpy(&chan->formatter, &logformatter_json, sizeof(chan->formatter));
+			} else if (!strcasecmp(formatter_name, "binary")) {
+				if (chan->type == LOGTYPE_FILE && chan->strings) {
+					memcpy(&chan->formatter, &logformatter_binary, sizeof(chan->formatter));
+					chan->binary = 1;
+				} else {
+					fprintf(stderr, "Logger Warning: The binary formatter is only for log files, not %s; using 'default'\n",
+						chan->filename);
+					memcpy(&chan->formatter, &logformatter_default, sizeof(chan->formatter));
+				}
 			} else if (!strcasecmp(formatter_name, "default")) {
 				memcpy(&chan->formatter, &logformatter_default, sizeof(chan->formatter));
 			} else {
@@ -542,20 +795,40 @@ static struct logchannel *make_logchannel(const char *channel, const char *compo
 			ast_console_puts_mutable("'\n", __LOG_ERROR);
 			ast_free(chan);
 			return NULL;
-		} else {
-			/* Create our date/time */
-			ast_localtime(&now, &tm, NULL);
-			ast_strftime(datestring, sizeof(datestring), dateformat, &tm);
-
-			fprintf(chan->fileptr, "[%s] Asterisk %s built by %s @ %s on a %s running %s on %s\n",
-				datestring, ast_get_version(), ast_build_user, ast_build_hostname,
-				ast_build_machine, ast_build_os, ast_build_date);
-			fflush(chan->fileptr);
 		}
 		chan->type = LOGTYPE_FILE;
+		if (strcasestr(components, "[binary]")) {
+			chan->strings = ast_calloc(1, sizeof(*chan->strings));
+		}
 	}
 	make_components(chan);
 
+	if (chan->type == LOGTYPE_FILE) {
+		char banner[512];
+
+		/* Create our date/time */
+		ast_localtime(&now, &tm, NULL);
+		ast_strftime(datestring, sizeof(datestring), dateformat, &tm);
+
+		snprintf(banner, sizeof(banner), "[%s] Asterisk %s built by %s @ %s on a %s running %s on %s\n",
+			datestring, ast_get_version(), ast_build_user, ast_build_hostname,
+			ast_build_machine, ast_build_os, ast_build_date);
+		if (chan->binary) {
+			unsigned char header[AST_LOGB_RECORD_HEADER];
+			size_t len = strlen(banner);
+
+			/* Starts a session, so the strings written before are not relied on */
+			header[0] = AST_LOGB_RECORD_SESSION;
+			ast_logb_put_u32(header + 1, strlen(AST_LOGB_MAGIC) + len);
+			fwrite(header, sizeof(header), 1, chan->fileptr);
+			fwrite(AST_LOGB_MAGIC, strlen(AST_LOGB_MAGIC), 1, chan->fileptr);
+			fwrite(banner, len, 1, chan->fileptr);
+		} else {
+			fputs(banner, chan->fileptr);
+		}
+		fflush(chan->fileptr);
+	}
+
 	return chan;
 }
 
@@ -594,9 +867,11 @@ static int init_logger_chain(int locked, const char *altconf)
 
 	/* delete our list of log channels */
 	while ((chan = AST_RWLIST_REMOVE_HEAD(&logchannels, list))) {
-		ast_free(chan);
+		logchannel_free(chan);
 	}
 	global_logmask = 0;
+	binary_logmask = 0;
+	text_logmask = 0;
 	if (!locked) {
 		AST_RWLIST_UNLOCK(&logchannels);
 	}
@@ -619,7 +894,7 @@ static int init_logger_chain(int locked, const char *altconf)
 			AST_RWLIST_WRLOCK(&logchannels);
 		}
 		AST_RWLIST_INSERT_HEAD(&logchannels, chan, list);
-		global_logmask |= chan->logmask;
+		logchannel_add_logmask(chan);
 		if (!locked) {
 			AST_RWLIST_UNLOCK(&logchannels);
 		}
@@ -689,7 +964,7 @@ static int init_logger_chain(int locked, const char *altconf)
 			continue;
 		}
 		AST_RWLIST_INSERT_HEAD(&logchannels, chan, list);
-		global_logmask |= chan->logmask;
+		logchannel_add_logmask(chan);
 	}
 
 	if (qlog) {
@@ -1280,6 +1555,8 @@ static char *handle_logger_show_channels(struct ast_cli_entry *e, int cmd, struc
 	}
 	AST_RWLIST_UNLOCK(&logchannels);
 	ast_cli(a->fd, "\n");
+	ast_cli(a->fd, "Messages dropped: %u\n", logmsgs_dropped_total);
+	ast_cli(a->fd, "\n");
 
 	return CLI_SUCCESS;
 }
@@ -1307,7 +1584,7 @@ int ast_logger_create_channel(const char *log_channel, const char *components)
 	}
 
 	AST_RWLIST_INSERT_HEAD(&logchannels, chan, list);
-	global_logmask |= chan->logmask;
+	logchannel_add_logmask(chan);
 
 	AST_RWLIST_UNLOCK(&logchannels);
 
@@ -1326,7 +1603,7 @@ static char *handle_logger_add_channel(struct ast_cli_entry *e, int cmd, struct
 			"       <levels> is a comma-separated list of desired logger\n"
 			"       levels such as: verbose,warning,error\n"
 			"       An optional formatter may be specified with the levels;\n"
-			"       valid values are '[json]' and '[default]'.\n";
+			"       valid values are '[json]', '[binary]' and '[default]'.\n";
 		return NULL;
 	case CLI_GENERATE:
 		return NULL;
@@ -1369,7 +1646,7 @@ int ast_logger_remove_channel(const char *log_channel)
 		fclose(chan->fileptr);
 		chan->fileptr = NULL;
 	}
-	ast_free(chan);
+	logchannel_free(chan);
 	chan = NULL;
 
 	return AST_LOGGER_SUCCESS;
@@ -1487,6 +1764,13 @@ static void logger_print_normal(struct logmsg *logmsg)
 	struct verb *v = NULL;
 	char *tmpmsg;
 	int level = 0;
+	struct ast_tm tm;
+	char datestring[256];
+
+	/* The date is formatted here rather than by the thread logging the message */
+	ast_localtime(&logmsg->when, &tm, NULL);
+	ast_strftime(datestring, sizeof(datestring), dateformat, &tm);
+	ast_string_field_set(logmsg, date, datestring);
 
 	if (logmsg->level == __LOG_VERBOSE) {
 
@@ -1522,6 +1806,10 @@ static void logger_print_normal(struct logmsg *logmsg)
 				continue;
 			}
 
+			if (!chan->binary) {
+				logmsg_format(logmsg);
+			}
+
 			switch (chan->type) {
 			case LOGTYPE_SYSLOG:
 				{
@@ -1557,15 +1845,19 @@ static void logger_print_normal(struct logmsg *logmsg)
 						continue;
 					}
 
-					if (chan->formatter.format_log(chan, logmsg, buf, BUFSIZ)) {
-						continue;
-					}
+					if (chan->binary) {
+						res = logger_write_binary(chan, logmsg);
+					} else {
+						if (chan->formatter.format_log(chan, logmsg, buf, BUFSIZ)) {
+							continue;
+						}
 
-					/* Print out to the file */
-					res = fprintf(chan->fileptr, "%s", buf);
+						/* Print out to the file */
+						res = fprintf(chan->fileptr, "%s", buf);
+					}
 					if (res > 0) {
 						fflush(chan->fileptr);
-					} else if (res <= 0 && !ast_strlen_zero(logmsg->message)) {
+					} else if (res <= 0 && (chan->binary || !ast_strlen_zero(logmsg->message))) {
 						fprintf(stderr, "**** Asterisk Logging Error: ***********\n");
 						if (errno == ENOMEM || errno == ENOSPC) {
 							fprintf(stderr, "Asterisk logging error: Out of disk space, can't log to log file %s\n", chan->filename);
@@ -1591,6 +1883,7 @@ static void logger_print_normal(struct logmsg *logmsg)
 			}
 		}
 	} else if (logmsg->level != __LOG_VERBOSE) {
+		logmsg_format(logmsg);
 		fputs(logmsg->message, stdout);
 	}
 
@@ -1605,26 +1898,204 @@ static void logger_print_normal(struct logmsg *logmsg)
 	return;
 }
 
+/*!
+ * \internal
+ * \brief Queue a message for the logger thread
+ *
+ * The message goes in the logging thread's own ring, so threads logging at
+ * once do not contend. Only when the logger thread is waiting for messages is
+ * the lock taken, to wake it.
+ */
+static void logmsg_queue(struct logmsg *logmsg)
+{
+	struct logmsg_ring_ref *ref = ast_threadstorage_get(&logmsg_ring_ref, sizeof(*ref));
+	struct logmsg_ring *ring;
+	int tail;
+
+	if (!ref) {
+		/* Without a ring of our own, share the locked list */
+		AST_LIST_LOCK(&logmsgs);
+		if (close_logger_thread) {
+			/* Logger is either closing or closed.  We cannot log this message. */
+			logmsg_free(logmsg);
+		} else {
+			AST_LIST_INSERT_TAIL(&logmsgs, logmsg, list);
+			ast_cond_signal(&logcond);
+		}
+		AST_LIST_UNLOCK(&logmsgs);
+		return;
+	}
+
+	if (close_logger_thread) {
+		logmsg_free(logmsg);
+		return;
+	}
+
+	ring = ref->ring;
+	tail = ring->tail;
+	if ((unsigned int) (tail - ast_atomic_fetchadd_int(&ring->head, 0)) >= LOGMSG_RING_SIZE) {
+		ast_atomic_fetchadd_int(&logmsgs_dropped, 1);
+		logmsg_free(logmsg);
+		return;
+	}
+	ring->msgs[tail & (LOGMSG_RING_SIZE - 1)] = logmsg;
+	/* Publishes the message, and orders it before the check for a waiting logger thread */
+	ast_atomic_fetchadd_int(&ring->tail, 1);
+
+	if (ast_atomic_fetchadd_int(&logger_waiting, 0)) {
+		AST_LIST_LOCK(&logmsgs);
+		ast_cond_signal(&logcond);
+		AST_LIST_UNLOCK(&logmsgs);
+	}
+}
+
+/*! \brief The messages of one ring taken in a pass of the logger thread */
+struct logmsg_run {
+	struct logmsg_ring *ring;
+	int pos;
+	int end;
+};
+
+/*!
+ * \internal
+ * \brief Find the messages waiting in each ring, freeing rings no longer used
+ *
+ * \return The number of messages found
+ */
+static int logger_collect_runs(struct logmsg_run **runs, size_t *size, size_t *count)
+{
+	struct logmsg_ring *ring;
+	int total = 0;
+
+	*count = 0;
+	AST_LIST_LOCK(&logmsg_rings);
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&logmsg_rings, ring, list) {
+		/* Read orphaned first, so no message can be added after tail is read */
+		int orphaned = ast_atomic_fetchadd_int(&ring->orphaned, 0);
+		int end = ast_atomic_fetchadd_int(&ring->tail, 0);
+
+		if (end == ring->head) {
+			if (orphaned) {
+				AST_LIST_REMOVE_CURRENT(list);
+				ast_free(ring);
+			}
+			continue;
+		}
+
+		if (*count == *size) {
+			size_t new_size = *size ? *size * 2 : 16;
+			struct logmsg_run *new_runs = ast_realloc(*runs, new_size * sizeof(**runs));
+
+			if (!new_runs) {
+				break;
+			}
+			*runs = new_runs;
+			*size = new_size;
+		}
+		(*runs)[*count].ring = ring;
+		(*runs)[*count].pos = ring->head;
+		(*runs)[*count].end = end;
+		++*count;
+		total += end - ring->head;
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+	AST_LIST_UNLOCK(&logmsg_rings);
+
+	return total;
+}
+
+/*! \brief When the next message of a run was logged */
+static struct timeval logmsg_run_when(const struct logmsg_run *run)
+{
+	return run->ring->msgs[run->pos & (LOGMSG_RING_SIZE - 1)]->when;
+}
+
+/*!
+ * \internal
+ * \brief Move a run down a min-heap of runs, ordered by their next message
+ */
+static void logmsg_run_sift_down(struct logmsg_run *runs, size_t count, size_t i)
+{
+	for (;;) {
+		size_t child = 2 * i + 1;
+		struct logmsg_run swap;
+
+		if (child >= count) {
+			break;
+		}
+		if (child + 1 < count
+			&& ast_tvcmp(logmsg_run_when(&runs[child + 1]), logmsg_run_when(&runs[child])) < 0) {
+			++child;
+		}
+		if (ast_tvcmp(logmsg_run_when(&runs[child]), logmsg_run_when(&runs[i])) >= 0) {
+			break;
+		}
+		swap = runs[i];
+		runs[i] = runs[child];
+		runs[child] = swap;
+		i = child;
+	}
+}
+
 /*! \brief Actual logging thread */
 static void *logger_thread(void *data)
 {
 	struct logmsg *next = NULL, *msg = NULL;
+	struct logmsg_run *runs = NULL;
+	size_t runs_size = 0;
+	size_t runs_count;
+	size_t i;
+	int dropped;
 
 	for (;;) {
+		int pending = logger_collect_runs(&runs, &runs_size, &runs_count);
+
 		/* We lock the message list, and see if any message exists... if not we wait on the condition to be signalled */
 		AST_LIST_LOCK(&logmsgs);
-		if (AST_LIST_EMPTY(&logmsgs)) {
-			if (close_logger_thread) {
-				AST_LIST_UNLOCK(&logmsgs);
-				break;
-			} else {
+		if (!pending && AST_LIST_EMPTY(&logmsgs)) {
+			/* Orders the flag before looking at the rings again, for threads that just added to one */
+			ast_atomic_fetchadd_int(&logger_waiting, 1);
+			if (!logger_collect_runs(&runs, &runs_size, &runs_count)) {
+				if (close_logger_thread) {
+					ast_atomic_fetchadd_int(&logger_waiting, -1);
+					AST_LIST_UNLOCK(&logmsgs);
+					break;
+				}
 				ast_cond_wait(&logcond, &logmsgs.lock);
 			}
+			ast_atomic_fetchadd_int(&logger_waiting, -1);
+			AST_LIST_UNLOCK(&logmsgs);
+			continue;
 		}
 		next = AST_LIST_FIRST(&logmsgs);
 		AST_LIST_HEAD_INIT_NOLOCK(&logmsgs);
 		AST_LIST_UNLOCK(&logmsgs);
 
+		/*
+		 * Merge the rings by when each message was logged, taking the
+		 * earliest from a min-heap of the runs. The messages of each
+		 * thread stay in the order that thread logged them.
+		 */
+		for (i = runs_count / 2; i-- > 0;) {
+			logmsg_run_sift_down(runs, runs_count, i);
+		}
+		while (runs_count) {
+			struct logmsg_run *first = &runs[0];
+
+			msg = first->ring->msgs[first->pos & (LOGMSG_RING_SIZE - 1)];
+			++first->pos;
+			/* The slot may be used again once head passes it */
+			ast_atomic_fetchadd_int(&first->ring->head, 1);
+
+			if (first->pos == first->end) {
+				runs[0] = runs[--runs_count];
+			}
+			logmsg_run_sift_down(runs, runs_count, 0);
+
+			logger_print_normal(msg);
+			logmsg_free(msg);
+		}
+
 		/* Otherwise go through and process each message in the order added */
 		while ((msg = next)) {
 			/* Get the next entry now so that we can free our current structure later */
@@ -1636,8 +2107,18 @@ static void *logger_thread(void *data)
 			/* Free the data since we are done */
 			logmsg_free(msg);
 		}
+
+		dropped = ast_atomic_fetchadd_int(&logmsgs_dropped, 0);
+		if (dropped) {
+			ast_atomic_fetchadd_int(&logmsgs_dropped, -dropped);
+			logmsgs_dropped_total += dropped;
+			ast_log(LOG_WARNING, "Dropped %d log messages logged faster than they could be written\n",
+				dropped);
+		}
 	}
 
+	ast_free(runs);
+
 	return NULL;
 }
 
@@ -1771,7 +2252,7 @@ void close_logger(void)
 			fclose(f->fileptr);
 			f->fileptr = NULL;
 		}
-		ast_free(f);
+		logchannel_free(f);
 	}
 
 	closelog(); /* syslog */
@@ -1913,10 +2394,10 @@ static void __attribute__((format(printf, 6, 0))) ast_log_full(int level, const
 {
 	struct logmsg *logmsg = NULL;
 	struct ast_str *buf = NULL;
-	struct ast_tm tm;
-	struct timeval now = ast_tvnow();
+	unsigned char *args;
+	size_t args_len = 0;
+	int formatted = 0;
 	int res = 0;
-	char datestring[256];
 
 	if (!(buf = ast_str_thread_get(&log_buf, LOG_BUF_INIT_SIZE)))
 		return;
@@ -1939,12 +2420,27 @@ static void __attribute__((format(printf, 6, 0))) ast_log_full(int level, const
 	if (level != __LOG_VERBOSE && !(global_logmask & (1 << level)))
 		return;
 
-	/* Build string */
-	res = ast_str_set_va(&buf, BUFSIZ, fmt, ap);
+	/* Binary channels keep the arguments rather than the formatted string */
+	if (level != __LOG_VERBOSE && (binary_logmask & (1 << level))
+		&& (args = ast_threadstorage_get(&log_args_buf, AST_LOGB_ARGS_MAX))) {
+		va_list aq;
 
-	/* If the build failed, then abort and free this structure */
-	if (res == AST_DYNSTR_BUILD_FAILED)
-		return;
+		va_copy(aq, ap);
+		args_len = ast_logb_args_encode(args, AST_LOGB_ARGS_MAX, fmt, aq);
+		va_end(aq);
+	}
+
+	/* Build string, unless only binary channels want it */
+	if (!args_len || (text_logmask & (1 << level))) {
+		res = ast_str_set_va(&buf, BUFSIZ, fmt, ap);
+
+		/* If the build failed, then abort and free this structure */
+		if (res == AST_DYNSTR_BUILD_FAILED)
+			return;
+		formatted = 1;
+	} else {
+		ast_str_reset(buf);
+	}
 
 	/* Create a new logging message */
 	if (!(logmsg = ast_calloc_with_stringfields(1, struct logmsg, res + 128)))
@@ -1953,6 +2449,17 @@ static void __attribute__((format(printf, 6, 0))) ast_log_full(int level, const
 	/* Copy string over */
 	ast_string_field_set(logmsg, message, ast_str_buffer(buf));
 
+	if (args_len) {
+		if (!(logmsg->args = ast_malloc(args_len))) {
+			logmsg_free(logmsg);
+			return;
+		}
+		memcpy(logmsg->args, args, args_len);
+		logmsg->args_len = args_len;
+		logmsg->unformatted = !formatted;
+		ast_string_field_set(logmsg, fmt, fmt);
+	}
+
 	/* Set type */
 	if (level == __LOG_VERBOSE) {
 		logmsg->type = LOGMSG_VERBOSE;
@@ -1964,10 +2471,8 @@ static void __attribute__((format(printf, 6, 0))) ast_log_full(int level, const
 		logmsg->callid = callid;
 	}
 
-	/* Create our date/time */
-	ast_localtime(&now, &tm, NULL);
-	ast_strftime(datestring, sizeof(datestring), dateformat, &tm);
-	ast_string_field_set(logmsg, date, datestring);
+	/* The date is formatted when the message is printed */
+	logmsg->when = ast_tvnow();
 
 	/* Copy over data */
 	logmsg->level = level;
@@ -1977,17 +2482,9 @@ static void __attribute__((format(printf, 6, 0))) ast_log_full(int level, const
 	ast_string_field_set(logmsg, function, function);
 	logmsg->lwp = ast_get_tid();
 
-	/* If the logger thread is active, append it to the tail end of the list - otherwise skip that step */
+	/* If the logger thread is active, queue it for that thread - otherwise skip that step */
 	if (logthread != AST_PTHREADT_NULL) {
-		AST_LIST_LOCK(&logmsgs);
-		if (close_logger_thread) {
-			/* Logger is either closing or closed.  We cannot log this message. */
-			logmsg_free(logmsg);
-		} else {
-			AST_LIST_INSERT_TAIL(&logmsgs, logmsg, list);
-			ast_cond_signal(&logcond);
-		}
-		AST_LIST_UNLOCK(&logmsgs);
+		logmsg_queue(logmsg);
 	} else {
 		logger_print_normal(logmsg);
 		logmsg_free(logmsg);
@@ -2327,10 +2824,12 @@ static void update_logchannels(void)
 	AST_RWLIST_WRLOCK(&logchannels);
 
 	global_logmask = 0;
+	binary_logmask = 0;
+	text_logmask = 0;
 
 	AST_RWLIST_TRAVERSE(&logchannels, cur, list) {
 		make_components(cur);
-		global_logmask |= cur->logmask;
+		logchannel_add_logmask(cur);
 	}
 
 	AST_RWLIST_UNLOCK(&logchannels);
@@ -2405,6 +2904,8 @@ void ast_logger_unregister_level(const char *name)
 		 */
 
 		global_logmask &= ~(1 << x);
+		binary_logmask &= ~(1 << x);
+		text_logmask &= ~(1 << x);
 
 		ast_free(levels[x]);
 		levels[x] = NULL;
@@ -0,0 +1,537 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Binary log channel format
+ *
+ * The arguments of a log message are encoded by the thread logging it and
+ * formatted, if at all, by the logger thread or by astlogdecode. This file is
+ * built into both, so it uses nothing but the C library.
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "asterisk/logger_binary.h"
+
+/*! \brief The types of encoded argument */
+enum logb_arg {
+	LOGB_ARG_SIGNED = 'i',		/*!< Eight bytes */
+	LOGB_ARG_UNSIGNED = 'u',	/*!< Eight bytes */
+	LOGB_ARG_DOUBLE = 'f',		/*!< Eight bytes, the bits of the double */
+	LOGB_ARG_STRING = 's',		/*!< Four bytes of length, then the text */
+	LOGB_ARG_NULL = 'z',		/*!< A NULL string, nothing more */
+	LOGB_ARG_POINTER = 'p',		/*!< Eight bytes */
+};
+
+/*! \brief The length modifier of a conversion */
+enum logb_length {
+	LOGB_LENGTH_NONE,
+	LOGB_LENGTH_HH,
+	LOGB_LENGTH_H,
+	LOGB_LENGTH_L,
+	LOGB_LENGTH_LL,
+	LOGB_LENGTH_J,
+	LOGB_LENGTH_Z,
+	LOGB_LENGTH_T,
+};
+
+/*! \brief Width or precision given as an argument */
+#define LOGB_STAR -2
+
+/*! \brief One conversion of a format string */
+struct logb_conv {
+	char flags[8];
+	int width;			/*!< -1 if none, or LOGB_STAR */
+	int precision;			/*!< -1 if none, or LOGB_STAR */
+	enum logb_length length;
+	char conversion;
+};
+
+/*!
+ * \internal
+ * \brief Parse the conversion after a '%'
+ *
+ * \return Just past the conversion, or NULL if it is not supported
+ */
+static const char *logb_parse(const char *p, struct logb_conv *conv)
+{
+	size_t flags = 0;
+
+	while (*p && strchr("-+ #0'", *p)) {
+		if (flags < sizeof(conv->flags) - 1) {
+			conv->flags[flags++] = *p;
+		}
+		++p;
+	}
+	conv->flags[flags] = '\0';
+
+	conv->width = -1;
+	if (*p == '*') {
+		conv->width = LOGB_STAR;
+		++p;
+	} else if (isdigit(*p)) {
+		conv->width = 0;
+		while (isdigit(*p)) {
+			if (conv->width < 100000) {
+				conv->width = conv->width * 10 + *p - '0';
+			}
+			++p;
+		}
+		if (*p == '$') {
+			/* Positional arguments */
+			return NULL;
+		}
+	}
+
+	conv->precision = -1;
+	if (*p == '.') {
+		++p;
+		if (*p == '*') {
+			conv->precision = LOGB_STAR;
+			++p;
+		} else {
+			conv->precision = 0;
+			while (isdigit(*p)) {
+				if (conv->precision < 100000) {
+					conv->precision = conv->precision * 10 + *p - '0';
+				}
+				++p;
+			}
+		}
+	}
+
+	conv->length = LOGB_LENGTH_NONE;
+	switch (*p) {
+	case 'h':
+		conv->length = p[1] == 'h' ? LOGB_LENGTH_HH : LOGB_LENGTH_H;
+		p += conv->length == LOGB_LENGTH_HH ? 2 : 1;
+		break;
+	case 'l':
+		conv->length = p[1] == 'l' ? LOGB_LENGTH_LL : LOGB_LENGTH_L;
+		p += conv->length == LOGB_LENGTH_LL ? 2 : 1;
+		break;
+	case 'q':
+		conv->length = LOGB_LENGTH_LL;
+		++p;
+		break;
+	case 'j':
+		conv->length = LOGB_LENGTH_J;
+		++p;
+		break;
+	case 'z':
+	case 'Z':
+		conv->length = LOGB_LENGTH_Z;
+		++p;
+		break;
+	case 't':
+		conv->length = LOGB_LENGTH_T;
+		++p;
+		break;
+	}
+
+	if (!*p || !strchr("diouxXcseEfFgGaAp%", *p)) {
+		/* %n, %m, long double, wide characters and anything unknown */
+		return NULL;
+	}
+	if (conv->length != LOGB_LENGTH_NONE && strchr("cspeEfFgGaA", *p)
+		&& !(conv->length == LOGB_LENGTH_L && strchr("eEfFgGaA", *p))) {
+		return NULL;
+	}
+	conv->conversion = *p;
+
+	return p + 1;
+}
+
+/*! \brief Where arguments are being encoded */
+struct logb_writer {
+	unsigned char *buf;
+	size_t size;
+	size_t used;
+	int failed;
+};
+
+static void logb_put(struct logb_writer *writer, enum logb_arg type, const void *data, size_t len)
+{
+	if (writer->failed || writer->size - writer->used < len + 1) {
+		writer->failed = 1;
+		return;
+	}
+	writer->buf[writer->used++] = type;
+	memcpy(writer->buf + writer->used, data, len);
+	writer->used += len;
+}
+
+static void logb_put_number(struct logb_writer *writer, enum logb_arg type, uint64_t value)
+{
+	unsigned char le[8];
+
+	ast_logb_put_u64(le, value);
+	logb_put(writer, type, le, sizeof(le));
+}
+
+static void logb_put_string(struct logb_writer *writer, const char *str, int precision)
+{
+	size_t len;
+	unsigned char le[4];
+
+	if (!str) {
+		logb_put(writer, LOGB_ARG_NULL, NULL, 0);
+		return;
+	}
+
+	/* With a precision, the string need not be terminated */
+	if (precision >= 0) {
+		for (len = 0; len < precision && str[len]; ++len) {
+		}
+	} else {
+		len = strlen(str);
+	}
+
+	ast_logb_put_u32(le, len);
+	logb_put(writer, LOGB_ARG_STRING, le, sizeof(le));
+	if (writer->failed || writer->size - writer->used < len) {
+		writer->failed = 1;
+		return;
+	}
+	memcpy(writer->buf + writer->used, str, len);
+	writer->used += len;
+}
+
+size_t ast_logb_args_encode(unsigned char *buf, size_t size, const char *fmt, va_list ap)
+{
+	struct logb_writer writer = { .buf = buf, .size = size, };
+	const char *p = fmt;
+
+	while (!writer.failed && (p = strchr(p, '%'))) {
+		struct logb_conv conv;
+		int precision;
+
+		p = logb_parse(p + 1, &conv);
+		if (!p) {
+			return 0;
+		}
+
+		if (conv.width == LOGB_STAR) {
+			logb_put_number(&writer, LOGB_ARG_SIGNED, (int64_t) va_arg(ap, int));
+		}
+		precision = conv.precision;
+		if (precision == LOGB_STAR) {
+			precision = va_arg(ap, int);
+			logb_put_number(&writer, LOGB_ARG_SIGNED, (int64_t) precision);
+		}
+
+		switch (conv.conversion) {
+		case '%':
+			break;
+		case 'd':
+		case 'i':
+		case 'c':
+			{
+				int64_t value;
+
+				/* Narrowed as printf narrows them */
+				switch (conv.length) {
+				case LOGB_LENGTH_HH:
+					value = (signed char) va_arg(ap, int);
+					break;
+				case LOGB_LENGTH_H:
+					value = (short) va_arg(ap, int);
+					break;
+				case LOGB_LENGTH_L:
+					value = va_arg(ap, long);
+					break;
+				case LOGB_LENGTH_LL:
+					value = va_arg(ap, long long);
+					break;
+				case LOGB_LENGTH_J:
+					value = va_arg(ap, intmax_t);
+					break;
+				case LOGB_LENGTH_Z:
+					value = va_arg(ap, ssize_t);
+					break;
+				case LOGB_LENGTH_T:
+					value = va_arg(ap, ptrdiff_t);
+					break;
+				default:
+					value = va_arg(ap, int);
+					break;
+				}
+				logb_put_number(&writer, LOGB_ARG_SIGNED, value);
+			}
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			{
+				uint64_t value;
+
+				switch (conv.length) {
+				case LOGB_LENGTH_HH:
+					value = (unsigned char) va_arg(ap, unsigned int);
+					break;
+				case LOGB_LENGTH_H:
+					value = (unsigned short) va_arg(ap, unsigned int);
+					break;
+				case LOGB_LENGTH_L:
+					value = va_arg(ap, unsigned long);
+					break;
+				case LOGB_LENGTH_LL:
+					value = va_arg(ap, unsigned long long);
+					break;
+				case LOGB_LENGTH_J:
+					value = va_arg(ap, uintmax_t);
+					break;
+				case LOGB_LENGTH_Z:
+					value = va_arg(ap, size_t);
+					break;
+				case LOGB_LENGTH_T:
+					value = (size_t) va_arg(ap, ptrdiff_t);
+					break;
+				default:
+					value = va_arg(ap, unsigned int);
+					break;
+				}
+				logb_put_number(&writer, LOGB_ARG_UNSIGNED, value);
+			}
+			break;
+		case 's':
+			logb_put_string(&writer, va_arg(ap, const char *), precision);
+			break;
+		case 'p':
+			logb_put_number(&writer, LOGB_ARG_POINTER, (uintptr_t) va_arg(ap, void *));
+			break;
+		default:
+			{
+				double value = va_arg(ap, double);
+				uint64_t bits;
+
+				memcpy(&bits, &value, sizeof(bits));
+				logb_put_number(&writer, LOGB_ARG_DOUBLE, bits);
+			}
+			break;
+		}
+	}
+
+	return writer.failed ? 0 : writer.used;
+}
+
+/*! \brief Where arguments are being decoded from */
+struct logb_reader {
+	const unsigned char *args;
+	size_t len;
+	size_t pos;
+};
+
+/*! \retval 0 if the next argument is not of that type */
+static int logb_get_number(struct logb_reader *reader, enum logb_arg type, uint64_t *value)
+{
+	if (reader->len - reader->pos < 9 || reader->args[reader->pos] != type) {
+		return 0;
+	}
+	*value = ast_logb_get_u64(reader->args + reader->pos + 1);
+	reader->pos += 9;
+	return 1;
+}
+
+/*! \brief Append text to what has been rendered, as far as it fits */
+static void logb_append(char *out, size_t size, size_t *used, const char *text, size_t len)
+{
+	if (len > size - 1 - *used) {
+		len = size - 1 - *used;
+	}
+	memcpy(out + *used, text, len);
+	*used += len;
+	out[*used] = '\0';
+}
+
+/*
+ * The conversion is rebuilt from a format string whose arguments the compiler
+ * checked when the message was logged, so it is called through a pointer that
+ * does not ask for the check again.
+ */
+static int (*logb_snprintf)(char *str, size_t size, const char *format, ...) = snprintf;
+
+int ast_logb_render(char *out, size_t size, const char *fmt, const unsigned char *args, size_t len)
+{
+	struct logb_reader reader = { .args = args, .len = len, };
+	const char *p = fmt;
+	size_t used = 0;
+
+	if (!size) {
+		return -1;
+	}
+	out[0] = '\0';
+
+	while (*p) {
+		const char *percent = strchr(p, '%');
+		struct logb_conv conv;
+		char spec[48];
+		size_t spec_len;
+		uint64_t value;
+		int has_width;
+		int width;
+		int precision;
+		int res;
+
+		if (!percent) {
+			logb_append(out, size, &used, p, strlen(p));
+			break;
+		}
+		logb_append(out, size, &used, p, percent - p);
+
+		p = logb_parse(percent + 1, &conv);
+		if (!p) {
+			return -1;
+		}
+		if (conv.conversion == '%') {
+			logb_append(out, size, &used, "%", 1);
+			continue;
+		}
+
+		width = conv.width;
+		has_width = width != -1;
+		if (width == LOGB_STAR) {
+			if (!logb_get_number(&reader, LOGB_ARG_SIGNED, &value)) {
+				return -1;
+			}
+			width = (int) (int64_t) value;
+		}
+		precision = conv.precision;
+		if (precision == LOGB_STAR) {
+			if (!logb_get_number(&reader, LOGB_ARG_SIGNED, &value)) {
+				return -1;
+			}
+			/* A negative precision is taken as none */
+			precision = (int) (int64_t) value;
+			if (precision < 0) {
+				precision = -1;
+			}
+		}
+
+		/* A negative width is taken as the '-' flag */
+		spec_len = snprintf(spec, sizeof(spec), "%%%s%s", conv.flags, has_width && width < 0 ? "-" : "");
+		if (has_width) {
+			spec_len += snprintf(spec + spec_len, sizeof(spec) - spec_len, "%d", abs(width));
+		}
+
+		if (reader.pos >= reader.len) {
+			return -1;
+		}
+		switch (conv.conversion) {
+		case 's':
+			{
+				const char *str;
+				uint32_t str_len;
+
+				if (reader.args[reader.pos] == LOGB_ARG_NULL) {
+					/* As glibc prints it */
+					str = precision >= 0 && precision < 6 ? "" : "(null)";
+					str_len = strlen(str);
+					++reader.pos;
+				} else if (reader.args[reader.pos] == LOGB_ARG_STRING && reader.len - reader.pos >= 5) {
+					str_len = ast_logb_get_u32(reader.args + reader.pos + 1);
+					reader.pos += 5;
+					if (reader.len - reader.pos < str_len) {
+						return -1;
+					}
+					str = (const char *) reader.args + reader.pos;
+					reader.pos += str_len;
+				} else {
+					return -1;
+				}
+				snprintf(spec + spec_len, sizeof(spec) - spec_len, ".%us", (unsigned int) str_len);
+				res = logb_snprintf(out + used, size - used, spec, str);
+			}
+			break;
+		case 'p':
+			if (!logb_get_number(&reader, LOGB_ARG_POINTER, &value)) {
+				return -1;
+			}
+			snprintf(spec + spec_len, sizeof(spec) - spec_len, "p");
+			res = logb_snprintf(out + used, size - used, spec, (void *) (uintptr_t) value);
+			break;
+		case 'd':
+		case 'i':
+		case 'c':
+			if (!logb_get_number(&reader, LOGB_ARG_SIGNED, &value)) {
+				return -1;
+			}
+			if (precision >= 0) {
+				spec_len += snprintf(spec + spec_len, sizeof(spec) - spec_len, ".%d", precision);
+			}
+			if (conv.conversion == 'c') {
+				snprintf(spec + spec_len, sizeof(spec) - spec_len, "c");
+				res = logb_snprintf(out + used, size - used, spec, (int) (int64_t) value);
+			} else {
+				snprintf(spec + spec_len, sizeof(spec) - spec_len, "ll%c", conv.conversion);
+				res = logb_snprintf(out + used, size - used, spec, (long long) (int64_t) value);
+			}
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			if (!logb_get_number(&reader, LOGB_ARG_UNSIGNED, &value)) {
+				return -1;
+			}
+			if (precision >= 0) {
+				spec_len += snprintf(spec + spec_len, sizeof(spec) - spec_len, ".%d", precision);
+			}
+			snprintf(spec + spec_len, sizeof(spec) - spec_len, "ll%c", conv.conversion);
+			res = logb_snprintf(out + used, size - used, spec, (unsigned long long) value);
+			break;
+		default:
+			{
+				double number;
+
+				if (!logb_get_number(&reader, LOGB_ARG_DOUBLE, &value)) {
+					return -1;
+				}
+				memcpy(&number, &value, sizeof(number));
+				if (precision >= 0) {
+					spec_len += snprintf(spec + spec_len, sizeof(spec) - spec_len, ".%d", precision);
+				}
+				snprintf(spec + spec_len, sizeof(spec) - spec_len, "%c", conv.conversion);
+				res = logb_snprintf(out + used, size - used, spec, number);
+			}
+			break;
+		}
+
+		if (res > 0) {
+			used += res;
+			if (used > size - 1) {
+				used = size - 1;
+			}
+		}
+	}
+
+	return used;
+}
@@ -67,6 +67,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/channel.h"
 #include "asterisk/file.h"
 #include "asterisk/manager.h"
+#include "asterisk/metrics.h"
 #include "asterisk/module.h"
 #include "asterisk/config.h"
 #include "asterisk/callerid.h"
@@ -100,6 +101,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/rtp_engine.h"
 #include "asterisk/format_cache.h"
 #include "asterisk/translate.h"
+#include "asterisk/spinlock.h"
+#include "asterisk/threadpool.h"
 
 /*** DOCUMENTATION
 	<manager name="Ping" language="en_US">
@@ -526,6 +529,24 @@ ASTERISK_REGISTER_FILE()
 			<para>This action will dump the categories in a given file.</para>
 		</description>
 	</manager>
+	<manager name="RealtimeCacheFlush" language="en_US">
+		<synopsis>
+			Flush the cache of a realtime family.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Family">
+				<para>The realtime family whose cache to flush. If not given, the
+				caches of all families are flushed.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Drops the lookups kept by the caches set up in the
+			<literal>[cache]</literal> section of <filename>extconfig.conf</filename>,
+			for use when the realtime backend has been changed by something other
+			than Asterisk.</para>
+		</description>
+	</manager>
 	<manager name="Redirect" language="en_US">
 		<synopsis>
 			Redirect (transfer) a call.
@@ -645,11 +666,69 @@ ASTERISK_REGISTER_FILE()
 			<ref type="managerEvent">OriginateResponse</ref>
 		</see-also>
 	</manager>
+	<manager name="BulkOriginate" language="en_US">
+		<synopsis>
+			Originate several calls.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Channel(0)" required="true">
+				<para>Channel name to call. The calls are numbered from 0, with
+				<literal>Channel(1)</literal>, <literal>Channel(2)</literal> and so on
+				for the others, up to 100 calls.</para>
+			</parameter>
+			<parameter name="Exten(0)">
+				<para>Extension for a call, otherwise that of <literal>Exten</literal>.</para>
+			</parameter>
+			<parameter name="CallerID(0)">
+				<para>Caller ID for a call, otherwise that of <literal>CallerID</literal>.</para>
+			</parameter>
+			<parameter name="Variable(0)">
+				<para>Comma-separated channel variables to set for a call, as well as
+				those of <literal>Variable</literal>.</para>
+			</parameter>
+			<parameter name="ChannelId(0)">
+				<para>Channel UniqueId to be set on the channel of a call.</para>
+			</parameter>
+			<parameter name="OtherChannelId(0)">
+				<para>Channel UniqueId to be set on the second local channel of a call.</para>
+			</parameter>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Exten'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Context'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Priority'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Application'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Data'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Timeout'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='CallerID'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Variable'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Account'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='EarlyMedia'])" />
+			<xi:include xpointer="xpointer(/docs/manager[@name='Originate']/syntax/parameter[@name='Codecs'])" />
+		</syntax>
+		<description>
+			<para>Generates several outgoing calls at once, as asynchronous
+			<literal>Originate</literal> actions would. The headers without a
+			number apply to every call. All of the calls are checked before any is
+			queued, so either all of them are queued or none is.</para>
+			<para>The calls are dialed by the same threads as asynchronous
+			<literal>Originate</literal> actions, of which there are at most
+			<literal>originatethreads</literal> in <filename>manager.conf</filename>.
+			An <literal>OriginateResponse</literal> event with the number of the call
+			in <literal>BulkIndex</literal> is raised for each call.</para>
+		</description>
+		<see-also>
+			<ref type="manager">Originate</ref>
+			<ref type="managerEvent">OriginateResponse</ref>
+		</see-also>
+	</manager>
 	<managerEvent language="en_US" name="OriginateResponse">
 		<managerEventInstance class="EVENT_FLAG_CALL">
 			<synopsis>Raised in response to an Originate command.</synopsis>
 			<syntax>
 				<parameter name="ActionID" required="false"/>
+				<parameter name="BulkIndex" required="false">
+					<para>The number of the call, for a <literal>BulkOriginate</literal>.</para>
+				</parameter>
 				<parameter name="Response">
 					<enumlist>
 						<enum name="Failure"/>
@@ -666,6 +745,7 @@ ASTERISK_REGISTER_FILE()
 			</syntax>
 			<see-also>
 				<ref type="manager">Originate</ref>
+				<ref type="manager">BulkOriginate</ref>
 			</see-also>
 		</managerEventInstance>
 	</managerEvent>
@@ -1287,6 +1367,21 @@ ASTERISK_REGISTER_FILE()
 			</syntax>
 		</managerEventInstance>
 	</managerEvent>
+	<managerEvent name="EventQueueOverflow" language="en_US">
+		<managerEventInstance class="EVENT_FLAG_SYSTEM">
+			<synopsis>Raised when a session has fallen so far behind that events it had not yet received were discarded.</synopsis>
+			<syntax>
+				<parameter name="EventsLost">
+					<para>The number of events discarded before they were sent to this session.</para>
+				</parameter>
+			</syntax>
+			<description>
+				<para>This event is only sent to the session that lost the events, and only if
+				<literal>eventqueueoverflow</literal> in <filename>manager.conf</filename> is
+				<literal>drop</literal>.</para>
+			</description>
+		</managerEventInstance>
+	</managerEvent>
  ***/
 
 /*! \addtogroup Group_AMI AMI functions
@@ -1316,34 +1411,59 @@ enum add_filter_result {
 };
 
 /*!
- * Linked list of events.
- * Global events are appended to the list by append_event().
- * The usecount is the number of stored pointers to the element,
- * excluding the list pointers. So an element that is only in
- * the list has a usecount of 0, not 1.
+ * Ring of events.
+ * Global events are given the next sequence number by append_event()
+ * and stored in the slot of the ring for that number, replacing the
+ * event EVENTQ_SIZE before it. Appending takes no lock shared by all
+ * events, only the slot's lock while the pointers are exchanged.
  *
- * Clients have a pointer to the last event processed, and for each
- * of these clients we track the usecount of the elements.
- * If we have a pointer to an entry in the list, it is safe to navigate
- * it forward because elements will not be deleted, but only appended.
- * The worst that can happen is seeing the pointer still NULL.
+ * Clients hold the sequence number of the next event they need. An
+ * event is an ao2 object, so a client holding a reference can use it
+ * after it has left the ring. A client that falls more than the size
+ * of the ring behind loses the events that were replaced, and is
+ * either told how many or disconnected, as eventqueueoverflow says.
  *
- * When the usecount of an element drops to 0, and the element is the
- * first in the list, we can remove it. Removal is done within the
- * main thread, which is woken up for the purpose.
- *
- * For simplicity of implementation, we make sure the list is never empty.
+ * Events every client has processed are released from the ring by
+ * purge_events(), which the main thread calls periodically.
  */
 struct eventqent {
-	int usecount;		/*!< # of clients who still need the event */
 	int category;
 	unsigned int seq;	/*!< sequence number */
 	struct timeval tv;  /*!< When event was allocated */
-	AST_RWLIST_ENTRY(eventqent) eq_next;
+	/*! Results of filter sets already run on the event, see event_filter_cache_get() */
+	void * volatile filter_results[4];
 	char eventdata[1];	/*!< really variable size, allocated by append_event() */
 };
 
-static AST_RWLIST_HEAD_STATIC(all_events, eventqent);
+/*! \brief Number of events kept in the ring, a power of 2 */
+#define EVENTQ_SIZE 16384
+
+/*! \brief A slot of the event ring */
+struct eventq_slot {
+	ast_spinlock_t lock;
+	struct eventqent *event;
+};
+
+static struct eventq_slot event_ring[EVENTQ_SIZE];
+
+/*! \brief Whether the slot locks are initialized, no events are queued before */
+static int event_ring_ready;
+
+/*! \brief The sequence number of the next event appended */
+static volatile int event_seq;
+
+/*! \brief The events before this sequence number have been released from the ring */
+static unsigned int event_purged;
+
+/*! \brief What to do with a client that falls too far behind the event ring */
+enum eventq_overflow_policy {
+	/*! Skip the events lost and send an EventQueueOverflow event saying how many */
+	EVENTQ_OVERFLOW_DROP,
+	/*! Disconnect the client */
+	EVENTQ_OVERFLOW_DISCONNECT,
+};
+
+static enum eventq_overflow_policy eventq_overflow = EVENTQ_OVERFLOW_DROP;
 
 static int displayconnects = 1;
 static int allowmultiplelogin = 1;
@@ -1358,6 +1478,21 @@ static int authtimeout;
 static int authlimit;
 static char *manager_channelvars;
 
+/*! \brief Threads running actions for TCP sessions, 0 to run them on the session thread */
+static int action_threads;
+
+/*! \brief The threads running actions, created the first time action_threads is set */
+static struct ast_threadpool *action_pool;
+
+/*! \brief Most asynchronous originates dialing at once, 0 for no limit */
+static int originate_threads;
+
+/*! \brief The threads dialing asynchronous originates */
+static struct ast_threadpool *originate_pool;
+
+/*! \brief The originate_threads originate_pool was made with */
+static int originate_pool_size;
+
 #define DEFAULT_REALM		"asterisk"
 static char global_realm[MAXHOSTNAMELEN];	/*!< Default realm */
 
@@ -1475,12 +1610,14 @@ struct mansession_session {
 	int inlen;		/*!< number of buffered bytes */
 	struct ao2_container *whitefilters;	/*!< Manager event filters - white list */
 	struct ao2_container *blackfilters;	/*!< Manager event filters - black list */
+	struct event_filter_set *filterset;	/*!< The filters above, shared with sessions having the same, NULL until needed */
 	struct ast_variable *chanvars;  /*!< Channel variables to set for originate */
 	int send_events;	/*!<  XXX what ? */
-	struct eventqent *last_ev;	/*!< last event processed. */
+	unsigned int event_cursor;	/*!< Sequence number of the next event to process */
 	int writetimeout;	/*!< Timeout for ast_carefulwrite() */
 	time_t authstart;
 	int pending_event;         /*!< Pending events indicator in case when waiting_thread is NULL */
+	int closed;		/*!< The session thread is done, responses of actions still running are dropped */
 	time_t noncetime;	/*!< Timer for nonce value expiration */
 	unsigned long oldnonce;	/*!< Stale nonce value */
 	unsigned long nc;	/*!< incremental  nonce counter */
@@ -1506,6 +1643,7 @@ struct mansession {
 	enum mansession_message_parsing parsing;
 	int write_error:1;
 	struct manager_custom_hook *hook;
+	struct ast_str *outbuf;	/*!< Output collected to be written at once, NULL to write it straight away */
 	ast_mutex_t lock;
 };
 
@@ -1547,9 +1685,15 @@ static AST_RWLIST_HEAD_STATIC(manager_hooks, manager_custom_hook);
 /*! \brief A container of event documentation nodes */
 static AO2_GLOBAL_OBJ_STATIC(event_docs);
 
+#ifdef AST_XML_DOCS
+/*! \brief Serializes building lazy event documentation */
+AST_MUTEX_DEFINE_STATIC(event_docs_lock);
+#endif
+
 static enum add_filter_result manager_add_filter(const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters);
 
-static int match_filter(struct mansession *s, char *eventdata);
+static int match_filter(struct mansession *s, struct eventqent *eqe);
+static int event_filters_match(struct ao2_container *whitefilters, struct ao2_container *blackfilters, char *eventdata);
 
 /*!
  * @{ \brief Define AMI message types.
@@ -1774,56 +1918,60 @@ int check_webmanager_enabled(void)
 	return (webmanager_enabled && manager_enabled);
 }
 
-/*!
- * Grab a reference to the last event, update usecount as needed.
- * Can handle a NULL pointer.
- */
-static struct eventqent *grab_last(void)
+/*! \brief The sequence number the next event appended will have */
+static unsigned int event_head(void)
 {
-	struct eventqent *ret;
-
-	AST_RWLIST_WRLOCK(&all_events);
-	ret = AST_RWLIST_LAST(&all_events);
-	/* the list is never empty now, but may become so when
-	 * we optimize it in the future, so be prepared.
-	 */
-	if (ret) {
-		ast_atomic_fetchadd_int(&ret->usecount, 1);
-	}
-	AST_RWLIST_UNLOCK(&all_events);
-	return ret;
+	return (unsigned int) event_seq;
 }
 
 /*!
- * Purge unused events. Remove elements from the head
- * as long as their usecount is 0 and there is a next element.
+ * \internal
+ * \brief Take the next event for a session from the ring
+ *
+ * \param session The session, locked
+ * \param[out] lost The number of events the session lost by falling behind
+ *
+ * \return The event with a reference, or NULL if there are no more events
+ * or some were lost.
  */
-static void purge_events(void)
+static struct eventqent *session_next_event(struct mansession_session *session, unsigned int *lost)
 {
+	unsigned int seq = session->event_cursor;
+	unsigned int head = event_head();
+	struct eventq_slot *slot;
 	struct eventqent *ev;
-	struct timeval now = ast_tvnow();
 
-	AST_RWLIST_WRLOCK(&all_events);
-	while ( (ev = AST_RWLIST_FIRST(&all_events)) &&
-	    ev->usecount == 0 && AST_RWLIST_NEXT(ev, eq_next)) {
-		AST_RWLIST_REMOVE_HEAD(&all_events, eq_next);
-		ast_free(ev);
+	*lost = 0;
+	if (!event_ring_ready || (int) (head - seq) <= 0) {
+		return NULL;
 	}
 
-	AST_RWLIST_TRAVERSE_SAFE_BEGIN(&all_events, ev, eq_next) {
-		/* Never release the last event */
-		if (!AST_RWLIST_NEXT(ev, eq_next)) {
-			break;
-		}
+	slot = &event_ring[seq & (EVENTQ_SIZE - 1)];
+	ast_spinlock_lock(&slot->lock);
+	ev = slot->event;
+	if (ev && ev->seq == seq) {
+		ao2_ref(ev, +1);
+		ast_spinlock_unlock(&slot->lock);
+		session->event_cursor = seq + 1;
+		return ev;
+	}
+	ast_spinlock_unlock(&slot->lock);
 
-		/* 2.5 times whatever the HTTP timeout is (maximum 2.5 hours) is the maximum time that we will definitely cache an event */
-		if (ev->usecount == 0 && ast_tvdiff_sec(now, ev->tv) > (httptimeout > 3600 ? 3600 : httptimeout) * 2.5) {
-			AST_RWLIST_REMOVE_CURRENT(eq_next);
-			ast_free(ev);
+	if (ev && (int) (ev->seq - seq) > 0) {
+		/* Replaced before it was read, skip to well inside the ring */
+		session->event_cursor = head - EVENTQ_SIZE / 2;
+		if ((int) (session->event_cursor - seq) <= 0) {
+			session->event_cursor = seq + 1;
 		}
+		*lost = session->event_cursor - seq;
+	} else if ((int) (event_purged - seq) > 0) {
+		/* Released before the session was seen, so it never needed it */
+		session->event_cursor = event_purged;
+		return session_next_event(session, lost);
 	}
-	AST_RWLIST_TRAVERSE_SAFE_END;
-	AST_RWLIST_UNLOCK(&all_events);
+	/* Otherwise the event is still being stored */
+
+	return NULL;
 }
 
 /*!
@@ -2007,16 +2155,77 @@ static struct mansession_session *unref_mansession(struct mansession_session *s)
 	return NULL;
 }
 
+/*!
+ * \brief An event filter
+ *
+ * Any match of the regex contains the literal, so events without it are
+ * passed over without running the regex, and if the whole pattern is
+ * literal the regex is never run.
+ */
+struct event_filter {
+	regex_t regex;
+	/*! Text every match contains, empty if none is known */
+	const char *literal;
+	/*! The pattern has nothing but literal text */
+	unsigned int literal_only:1;
+	unsigned int compiled:1;
+	char pattern[0];
+};
+
 static void event_filter_destructor(void *obj)
 {
-	regex_t *regex_filter = obj;
-	regfree(regex_filter);
+	struct event_filter *filter = obj;
+
+	if (filter->compiled) {
+		regfree(&filter->regex);
+	}
+}
+
+/*!
+ * \brief The filters of a session, shared by the sessions with the same filters
+ *
+ * Each is given an id, and the result of running it on an event is kept in
+ * the event for the other sessions sharing it.
+ */
+struct event_filter_set {
+	unsigned int id;
+	struct ao2_container *whitefilters;
+	struct ao2_container *blackfilters;
+	char key[0];
+};
+
+/*! \brief Filter sets in use, by their patterns */
+static struct ao2_container *event_filter_sets;
+
+#define EVENT_FILTER_SET_BUCKETS 31
+
+static void event_filter_set_destructor(void *obj)
+{
+	struct event_filter_set *set = obj;
+
+	ao2_cleanup(set->whitefilters);
+	ao2_cleanup(set->blackfilters);
+}
+
+static int event_filter_set_hash_fn(const void *obj, const int flags)
+{
+	const struct event_filter_set *set = obj;
+	const char *key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? obj : set->key;
+
+	return ast_str_hash(key);
+}
+
+static int event_filter_set_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct event_filter_set *set = obj;
+	const char *key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? arg : ((struct event_filter_set *) arg)->key;
+
+	return strcmp(set->key, key) ? 0 : CMP_MATCH;
 }
 
 static void session_destructor(void *obj)
 {
 	struct mansession_session *session = obj;
-	struct eventqent *eqe = session->last_ev;
 	struct ast_datastore *datastore;
 
 	/* Get rid of each of the data stores on the session */
@@ -2029,9 +2238,6 @@ static void session_destructor(void *obj)
 		fflush(session->f);
 		fclose(session->f);
 	}
-	if (eqe) {
-		ast_atomic_fetchadd_int(&eqe->usecount, -1);
-	}
 	if (session->chanvars) {
 		ast_variables_destroy(session->chanvars);
 	}
@@ -2043,6 +2249,8 @@ static void session_destructor(void *obj)
 	if (session->blackfilters) {
 		ao2_t_ref(session->blackfilters, -1, "decrement ref for black container, should be last one");
 	}
+
+	ao2_cleanup(session->filterset);
 }
 
 /*! \brief Allocate manager session structure and add it to the list of sessions */
@@ -2153,6 +2361,7 @@ static int manager_displayconnects(struct mansession_session *session)
 }
 
 static void print_event_instance(struct ast_cli_args *a, struct ast_xml_doc_item *instance);
+static void action_docs(struct manager_action *cur);
 
 static char *handle_showmancmd(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
@@ -2208,6 +2417,7 @@ static char *handle_showmancmd(struct ast_cli_entry *e, int cmd, struct ast_cli_
 		for (num = 3; num < a->argc; num++) {
 			if (!strcasecmp(cur->action, a->argv[num])) {
 				auth_str = authority_to_str(cur->authority, &authority);
+				action_docs(cur);
 
 #ifdef AST_XML_DOCS
 				if (cur->docsrc == AST_XML_DOC) {
@@ -2434,6 +2644,7 @@ static char *handle_showmancmds(struct ast_cli_entry *e, int cmd, struct ast_cli
 	ast_cli(a->fd, HSMC_FORMAT, name_len, name_len, "------", space_remaining, "--------");
 
 	AST_RWLIST_TRAVERSE(&actions, cur, list) {
+		action_docs(cur);
 		ast_cli(a->fd, HSMC_FORMAT, name_len, name_len, cur->action, space_remaining, cur->synopsis);
 	}
 	AST_RWLIST_UNLOCK(&actions);
@@ -2495,7 +2706,9 @@ static char *handle_showmanconn(struct ast_cli_entry *e, int cmd, struct ast_cli
 /* Should change to "manager show connected" */
 static char *handle_showmaneventq(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct eventqent *s;
+	unsigned int seq;
+	unsigned int head;
+
 	switch (cmd) {
 	case CLI_INIT:
 		e->command = "manager show eventq";
@@ -2507,13 +2720,29 @@ static char *handle_showmaneventq(struct ast_cli_entry *e, int cmd, struct ast_c
 	case CLI_GENERATE:
 		return NULL;
 	}
-	AST_RWLIST_RDLOCK(&all_events);
-	AST_RWLIST_TRAVERSE(&all_events, s, eq_next) {
-		ast_cli(a->fd, "Usecount: %d\n", s->usecount);
-		ast_cli(a->fd, "Category: %d\n", s->category);
-		ast_cli(a->fd, "Event:\n%s", s->eventdata);
+	if (!event_ring_ready) {
+		return CLI_SUCCESS;
+	}
+	head = event_head();
+	for (seq = head - EVENTQ_SIZE; seq != head; seq++) {
+		struct eventq_slot *slot = &event_ring[seq & (EVENTQ_SIZE - 1)];
+		struct eventqent *ev;
+
+		ast_spinlock_lock(&slot->lock);
+		if ((ev = slot->event)) {
+			ao2_ref(ev, +1);
+		}
+		ast_spinlock_unlock(&slot->lock);
+		if (!ev) {
+			continue;
+		}
+		if (ev->seq == seq) {
+			ast_cli(a->fd, "Sequence: %u\n", ev->seq);
+			ast_cli(a->fd, "Category: %d\n", ev->category);
+			ast_cli(a->fd, "Event:\n%s", ev->eventdata);
+		}
+		ao2_ref(ev, -1);
 	}
-	AST_RWLIST_UNLOCK(&all_events);
 
 	return CLI_SUCCESS;
 }
@@ -2538,19 +2767,6 @@ static char *handle_manager_reload(struct ast_cli_entry *e, int cmd, struct ast_
 	return CLI_SUCCESS;
 }
 
-static struct eventqent *advance_event(struct eventqent *e)
-{
-	struct eventqent *next;
-
-	AST_RWLIST_RDLOCK(&all_events);
-	if ((next = AST_RWLIST_NEXT(e, eq_next))) {
-		ast_atomic_fetchadd_int(&next->usecount, 1);
-		ast_atomic_fetchadd_int(&e->usecount, -1);
-	}
-	AST_RWLIST_UNLOCK(&all_events);
-	return next;
-}
-
 #define	GET_HEADER_FIRST_MATCH	0
 #define	GET_HEADER_LAST_MATCH	1
 #define	GET_HEADER_SKIP_EMPTY	2
@@ -2793,6 +3009,10 @@ static int send_string(struct mansession *s, char *string)
 		return 0;
 	}
 
+	if (s->outbuf) {
+		return ast_str_append(&s->outbuf, 0, "%s", string) < 0 ? -1 : 0;
+	}
+
 	if ((res = ast_careful_fwrite(f, fd, string, strlen(string), s->session->writetimeout))) {
 		s->write_error = 1;
 	}
@@ -3212,7 +3432,7 @@ static int authenticate(struct mansession *s, const struct message *m)
 	const char *password = astman_get_header(m, "Secret");
 	int error = -1;
 	struct ast_manager_user *user = NULL;
-	regex_t *regex_filter;
+	struct event_filter *regex_filter;
 	struct ao2_iterator filter_iter;
 
 	if (ast_strlen_zero(username)) {	/* missing username */
@@ -3292,6 +3512,8 @@ static int authenticate(struct mansession *s, const struct message *m)
 		ao2_t_ref(regex_filter, -1, "remove iterator ref");
 	}
 	ao2_iterator_destroy(&filter_iter);
+	ao2_cleanup(s->session->filterset);
+	s->session->filterset = NULL;
 
 	s->session->sessionstart = time(NULL);
 	s->session->sessionstart_tv = ast_tvnow();
@@ -3421,6 +3643,19 @@ static int action_listcategories(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+static int action_realtimecacheflush(struct mansession *s, const struct message *m)
+{
+	const char *family = astman_get_header(m, "Family");
+
+	if (ast_realtime_cache_flush(family)) {
+		astman_send_error(s, m, "No realtime cache found");
+		return 0;
+	}
+
+	astman_send_ack(s, m, "Realtime cache flushed");
+	return 0;
+}
+
 /*! The amount of space in out must be at least ( 2 * strlen(in) + 1 ) */
 static void json_escape(char *out, const char *in)
 {
@@ -3905,12 +4140,57 @@ static int action_createconfig(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Tell a session it fell behind the event ring
+ *
+ * \param s The session, its mansession_session locked
+ * \param lost The number of events it lost
+ * \param append Whether to append to the response rather than send directly
+ *
+ * \retval 0 to carry on
+ * \retval -1 to disconnect the session
+ */
+static int session_events_lost(struct mansession *s, unsigned int lost, int append)
+{
+	char buf[128];
+
+	if (eventq_overflow == EVENTQ_OVERFLOW_DISCONNECT) {
+		ast_log(LOG_WARNING, "Manager session '%s' from %s lost %u events, disconnecting\n",
+			s->session->username, ast_sockaddr_stringify_addr(&s->session->addr), lost);
+		return -1;
+	}
+
+	ast_debug(1, "Manager session '%s' from %s lost %u events\n",
+		s->session->username, ast_sockaddr_stringify_addr(&s->session->addr), lost);
+	/* Only to sessions that would get any other system event */
+	if (!s->session->authenticated
+		|| !(s->session->readperm & EVENT_FLAG_SYSTEM)
+		|| !(s->session->send_events & EVENT_FLAG_SYSTEM)) {
+		return 0;
+	}
+	snprintf(buf, sizeof(buf),
+		"Event: EventQueueOverflow\r\n"
+		"Privilege: system,all\r\n"
+		"EventsLost: %u\r\n"
+		"\r\n", lost);
+	if (!event_filters_match(s->session->whitefilters, s->session->blackfilters, buf)) {
+		return 0;
+	}
+	if (append) {
+		astman_append(s, "%s", buf);
+		return 0;
+	}
+	return send_string(s, buf) < 0 ? -1 : 0;
+}
+
 static int action_waitevent(struct mansession *s, const struct message *m)
 {
 	const char *timeouts = astman_get_header(m, "Timeout");
 	int timeout = -1;
 	int x;
 	int needexit = 0;
+	int res = 0;
 	const char *id = astman_get_header(m, "ActionID");
 	char idText[256];
 
@@ -3960,7 +4240,7 @@ static int action_waitevent(struct mansession *s, const struct message *m)
 
 	for (x = 0; x < timeout || timeout < 0; x++) {
 		ao2_lock(s->session);
-		if (AST_RWLIST_NEXT(s->session->last_ev, eq_next)) {
+		if (s->session->event_cursor != event_head()) {
 			needexit = 1;
 		}
 		/* We can have multiple HTTP session point to the same mansession entry.
@@ -3989,15 +4269,27 @@ static int action_waitevent(struct mansession *s, const struct message *m)
 
 	ao2_lock(s->session);
 	if (s->session->waiting_thread == pthread_self()) {
-		struct eventqent *eqe = s->session->last_ev;
+		struct eventqent *eqe;
+		unsigned int lost;
+
 		astman_send_response(s, m, "Success", "Waiting for Event completed.");
-		while ((eqe = advance_event(eqe))) {
+		for (;;) {
+			if (!(eqe = session_next_event(s->session, &lost))) {
+				if (!lost) {
+					break;
+				}
+				if (session_events_lost(s, lost, 1)) {
+					res = -1;
+					break;
+				}
+				continue;
+			}
 			if (((s->session->readperm & eqe->category) == eqe->category)
 				&& ((s->session->send_events & eqe->category) == eqe->category)
-				&& match_filter(s, eqe->eventdata)) {
+				&& match_filter(s, eqe)) {
 				astman_append(s, "%s", eqe->eventdata);
 			}
-			s->session->last_ev = eqe;
+			ao2_ref(eqe, -1);
 		}
 		astman_append(s,
 			"Event: WaitEventComplete\r\n"
@@ -4009,7 +4301,7 @@ static int action_waitevent(struct mansession *s, const struct message *m)
 	}
 	ao2_unlock(s->session);
 
-	return 0;
+	return res;
 }
 
 static int action_listcommands(struct mansession *s, const struct message *m)
@@ -4021,6 +4313,7 @@ static int action_listcommands(struct mansession *s, const struct message *m)
 	AST_RWLIST_RDLOCK(&actions);
 	AST_RWLIST_TRAVERSE(&actions, cur, list) {
 		if ((s->session->writeperm & cur->authority) || cur->authority == 0) {
+			action_docs(cur);
 			astman_append(s, "%s: %s (Priv: %s)\r\n",
 				cur->action, cur->synopsis, authority_to_str(cur->authority, &temp));
 		}
@@ -4944,6 +5237,7 @@ struct fast_originate_helper {
 		AST_STRING_FIELD(otherchannelid);
 	);
 	int priority;
+	int bulk_index;		/*!< Index of the originate in a BulkOriginate, -1 for Originate */
 	struct ast_variable *vars;
 };
 
@@ -4962,13 +5256,14 @@ static void destroy_fast_originate_helper(struct fast_originate_helper *doomed)
 	ast_free(doomed);
 }
 
-static void *fast_originate(void *data)
+static int fast_originate(void *data)
 {
 	struct fast_originate_helper *in = data;
 	int res;
 	int reason = 0;
 	struct ast_channel *chan = NULL, *chans[1];
 	char requested_channel[AST_CHANNEL_NAME];
+	char bulk_index[32] = "";
 	struct ast_assigned_ids assignedids = {
 		.uniqueid = in->channelid,
 		.uniqueid2 = in->otherchannelid
@@ -4991,9 +5286,13 @@ static void *fast_originate(void *data)
 	if (!chan) {
 		snprintf(requested_channel, AST_CHANNEL_NAME, "%s/%s", in->tech, in->data);
 	}
+	if (in->bulk_index >= 0) {
+		snprintf(bulk_index, sizeof(bulk_index), "BulkIndex: %d\r\n", in->bulk_index);
+	}
 	/* Tell the manager what happened with the channel */
 	chans[0] = chan;
 	ast_manager_event_multichan(EVENT_FLAG_CALL, "OriginateResponse", chan ? 1 : 0, chans,
+		"%s"
 		"%s"
 		"Response: %s\r\n"
 		"Channel: %s\r\n"
@@ -5003,7 +5302,7 @@ static void *fast_originate(void *data)
 		"Uniqueid: %s\r\n"
 		"CallerIDNum: %s\r\n"
 		"CallerIDName: %s\r\n",
-		in->idtext, res ? "Failure" : "Success",
+		in->idtext, bulk_index, res ? "Failure" : "Success",
 		chan ? ast_channel_name(chan) : requested_channel, in->context, in->exten, reason,
 		chan ? ast_channel_uniqueid(chan) : "<null>",
 		S_OR(in->cid_num, "<unknown>"),
@@ -5016,7 +5315,25 @@ static void *fast_originate(void *data)
 		ast_channel_unref(chan);
 	}
 	destroy_fast_originate_helper(in);
-	return NULL;
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue an originate to the originate threads
+ *
+ * \param fast The originate, freed if it cannot be queued.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int fast_originate_queue(struct fast_originate_helper *fast)
+{
+	if (!originate_pool || ast_threadpool_push(originate_pool, fast_originate, fast)) {
+		destroy_fast_originate_helper(fast);
+		return -1;
+	}
+	return 0;
 }
 
 static int aocmessage_get_unit_entry(const struct message *m, struct ast_aoc_unit_entry *entry, unsigned int entry_num)
@@ -5249,6 +5566,39 @@ aocmessage_cleanup:
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Check a session may originate to an application
+ *
+ * \return NULL if it may, otherwise the header it may not give.
+ */
+static const char *originate_forbidden(struct mansession *s, const char *app, const char *appdata)
+{
+	int bad_appdata = 0;
+
+	if (ast_strlen_zero(app) || !s->session) {
+		return NULL;
+	}
+	/* To run the System application (or anything else that goes to
+	 * shell), you must have the additional System privilege */
+	if (!(s->session->writeperm & EVENT_FLAG_SYSTEM)
+		&& (
+			strcasestr(app, "system") ||      /* System(rm -rf /)
+			                                     TrySystem(rm -rf /)       */
+			strcasestr(app, "exec") ||        /* Exec(System(rm -rf /))
+			                                     TryExec(System(rm -rf /)) */
+			strcasestr(app, "agi") ||         /* AGI(/bin/rm,-rf /)
+			                                     EAGI(/bin/rm,-rf /)       */
+			strcasestr(app, "mixmonitor") ||  /* MixMonitor(blah,,rm -rf)  */
+			strcasestr(app, "externalivr") || /* ExternalIVR(rm -rf)       */
+			(strstr(appdata, "SHELL") && (bad_appdata = 1)) ||       /* NoOp(${SHELL(rm -rf /)})  */
+			(strstr(appdata, "EVAL") && (bad_appdata = 1))           /* NoOp(${EVAL(${some_var_containing_SHELL})}) */
+			)) {
+		return bad_appdata ? "Data" : "Application";
+	}
+	return NULL;
+}
+
 static int action_originate(struct mansession *s, const struct message *m)
 {
 	const char *name = astman_get_header(m, "Channel");
@@ -5278,8 +5628,8 @@ static int action_originate(struct mansession *s, const struct message *m)
 	char tmp[256];
 	char tmp2[256];
 	struct ast_format_cap *cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
-	pthread_t th;
 	int bridge_early = 0;
+	const char *forbidden;
 
 	if (!cap) {
 		astman_send_error(s, m, "Internal Error. Memory allocation failure.");
@@ -5339,29 +5689,10 @@ static int action_originate(struct mansession *s, const struct message *m)
 		ast_format_cap_update_by_allow_disallow(cap, codecs, 1);
 	}
 
-	if (!ast_strlen_zero(app) && s->session) {
-		int bad_appdata = 0;
-		/* To run the System application (or anything else that goes to
-		 * shell), you must have the additional System privilege */
-		if (!(s->session->writeperm & EVENT_FLAG_SYSTEM)
-			&& (
-				strcasestr(app, "system") ||      /* System(rm -rf /)
-				                                     TrySystem(rm -rf /)       */
-				strcasestr(app, "exec") ||        /* Exec(System(rm -rf /))
-				                                     TryExec(System(rm -rf /)) */
-				strcasestr(app, "agi") ||         /* AGI(/bin/rm,-rf /)
-				                                     EAGI(/bin/rm,-rf /)       */
-				strcasestr(app, "mixmonitor") ||  /* MixMonitor(blah,,rm -rf)  */
-				strcasestr(app, "externalivr") || /* ExternalIVR(rm -rf)       */
-				(strstr(appdata, "SHELL") && (bad_appdata = 1)) ||       /* NoOp(${SHELL(rm -rf /)})  */
-				(strstr(appdata, "EVAL") && (bad_appdata = 1))           /* NoOp(${EVAL(${some_var_containing_SHELL})}) */
-				)) {
-			char error_buf[64];
-			snprintf(error_buf, sizeof(error_buf), "Originate Access Forbidden: %s", bad_appdata ? "Data" : "Application");
-			astman_send_error(s, m, error_buf);
-			res = 0;
-			goto fast_orig_cleanup;
-		}
+	if ((forbidden = originate_forbidden(s, app, appdata))) {
+		astman_send_error_va(s, m, "Originate Access Forbidden: %s", forbidden);
+		res = 0;
+		goto fast_orig_cleanup;
 	}
 
 	/* Check early if the extension exists. If not, we need to bail out here. */
@@ -5424,12 +5755,8 @@ static int action_originate(struct mansession *s, const struct message *m)
 			fast->timeout = to;
 			fast->early_media = bridge_early;
 			fast->priority = pi;
-			if (ast_pthread_create_detached(&th, NULL, fast_originate, fast)) {
-				destroy_fast_originate_helper(fast);
-				res = -1;
-			} else {
-				res = 0;
-			}
+			fast->bulk_index = -1;
+			res = fast_originate_queue(fast);
 		}
 	} else if (!ast_strlen_zero(app)) {
 		res = ast_pbx_outgoing_app(tech, cap, data, to, app, appdata, &reason, 1, l, n, vars, account, NULL, assignedids.uniqueid ? &assignedids : NULL);
@@ -5456,59 +5783,279 @@ fast_orig_cleanup:
 	return 0;
 }
 
-static int action_mailboxstatus(struct mansession *s, const struct message *m)
+/*! \brief Most originates in one BulkOriginate */
+#define BULK_ORIGINATE_MAX 100
+
+/*!
+ * \internal
+ * \brief Get a header of one originate in a BulkOriginate
+ *
+ * \return The header given for the originate, otherwise the one given for all.
+ */
+static const char *bulk_originate_header(const struct message *m, char *name, int index)
 {
-	const char *mailbox = astman_get_header(m, "Mailbox");
-	int ret;
+	char hdr[64];
+	const char *val;
 
-	if (ast_strlen_zero(mailbox)) {
-		astman_send_error(s, m, "Mailbox not specified");
-		return 0;
-	}
-	ret = ast_app_has_voicemail(mailbox, NULL);
-	astman_start_ack(s, m);
-	astman_append(s, "Message: Mailbox Status\r\n"
-			 "Mailbox: %s\r\n"
-			 "Waiting: %d\r\n\r\n", mailbox, ret);
-	return 0;
+	snprintf(hdr, sizeof(hdr), "%s(%d)", name, index);
+	val = astman_get_header(m, hdr);
+	return ast_strlen_zero(val) ? astman_get_header(m, name) : val;
 }
 
-static int action_mailboxcount(struct mansession *s, const struct message *m)
+static int action_bulkoriginate(struct mansession *s, const struct message *m)
 {
-	const char *mailbox = astman_get_header(m, "Mailbox");
-	int newmsgs = 0, oldmsgs = 0, urgentmsgs = 0;;
+	const char *context = astman_get_header(m, "Context");
+	const char *priority = astman_get_header(m, "Priority");
+	const char *timeout = astman_get_header(m, "Timeout");
+	const char *account = astman_get_header(m, "Account");
+	const char *app = astman_get_header(m, "Application");
+	const char *appdata = astman_get_header(m, "Data");
+	const char *id = astman_get_header(m, "ActionID");
+	const char *codecs = astman_get_header(m, "Codecs");
+	int bridge_early = ast_true(astman_get_header(m, "EarlyMedia"));
+	struct fast_originate_helper *fast[BULK_ORIGINATE_MAX] = { NULL, };
+	struct ast_format_cap *cap = NULL;
+	struct ast_variable *vars = NULL;
+	const char *forbidden;
+	int label_priority;
+	int pi = 0;
+	int to = 30000;
+	int count;
+	int queued;
+	int i;
 
-	if (ast_strlen_zero(mailbox)) {
-		astman_send_error(s, m, "Mailbox not specified");
+	/* What all the originates share is checked once */
+	if (!ast_strlen_zero(timeout) && (sscanf(timeout, "%30d", &to) != 1)) {
+		astman_send_error(s, m, "Invalid timeout");
 		return 0;
 	}
-	ast_app_inboxcount2(mailbox, &urgentmsgs, &newmsgs, &oldmsgs);
-	astman_start_ack(s, m);
-	astman_append(s,   "Message: Mailbox Message Count\r\n"
-			   "Mailbox: %s\r\n"
-			   "UrgMessages: %d\r\n"
-			   "NewMessages: %d\r\n"
-			   "OldMessages: %d\r\n"
-			   "\r\n",
-			   mailbox, urgentmsgs, newmsgs, oldmsgs);
-	return 0;
-}
+	if ((forbidden = originate_forbidden(s, app, appdata))) {
+		astman_send_error_va(s, m, "Originate Access Forbidden: %s", forbidden);
+		return 0;
+	}
+	if (ast_strlen_zero(app) && (ast_strlen_zero(context) || ast_strlen_zero(priority))) {
+		astman_send_error(s, m, "BulkOriginate with 'Exten' requires 'Context' and 'Priority'");
+		return 0;
+	}
+	label_priority = !ast_strlen_zero(priority) && sscanf(priority, "%30d", &pi) != 1;
 
-static int action_extensionstate(struct mansession *s, const struct message *m)
-{
-	const char *exten = astman_get_header(m, "Exten");
-	const char *context = astman_get_header(m, "Context");
-	char hint[256] = "";
-	int status;
-	if (ast_strlen_zero(exten)) {
-		astman_send_error(s, m, "Extension not specified");
+	for (count = 0; count <= BULK_ORIGINATE_MAX; ++count) {
+		char hdr[32];
+
+		snprintf(hdr, sizeof(hdr), "Channel(%d)", count);
+		if (ast_strlen_zero(astman_get_header(m, hdr))) {
+			break;
+		}
+	}
+	if (!count) {
+		astman_send_error(s, m, "Channel(0) not specified");
 		return 0;
 	}
-	if (ast_strlen_zero(context)) {
-		context = "default";
+	if (count > BULK_ORIGINATE_MAX) {
+		astman_send_error_va(s, m, "No more than %d originates allowed", BULK_ORIGINATE_MAX);
+		return 0;
 	}
-	status = ast_extension_state(NULL, context, exten);
-	ast_get_hint(hint, sizeof(hint) - 1, NULL, 0, NULL, context, exten);
+
+	if (!(cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
+		astman_send_error(s, m, "Internal Error. Memory allocation failure.");
+		return 0;
+	}
+	ast_format_cap_append(cap, ast_format_slin, 0);
+	if (!ast_strlen_zero(codecs)) {
+		ast_format_cap_remove_by_type(cap, AST_MEDIA_TYPE_UNKNOWN);
+		ast_format_cap_update_by_allow_disallow(cap, codecs, 1);
+	}
+
+	/* The variables of the action override those of the user */
+	vars = astman_get_variables_order(m, ORDER_NATURAL);
+	if (s->session && s->session->chanvars) {
+		struct ast_variable *user_vars = ast_variables_dup(s->session->chanvars);
+
+		if (user_vars && vars) {
+			ast_variable_list_append(&user_vars, vars);
+		}
+		vars = user_vars ? user_vars : vars;
+	}
+
+	/* Then each originate, none being queued unless all of them are valid */
+	for (i = 0; i < count; ++i) {
+		const char *exten = bulk_originate_header(m, "Exten", i);
+		const char *callerid = bulk_originate_header(m, "CallerID", i);
+		struct ast_assigned_ids assignedids;
+		struct ast_variable *entry_vars;
+		char hdr[32];
+		char tmp[256];
+		char tmp2[256];
+		char *tech, *data;
+		char *l = NULL, *n = NULL;
+		int entry_pi = pi;
+
+		snprintf(hdr, sizeof(hdr), "Channel(%d)", i);
+		ast_copy_string(tmp, astman_get_header(m, hdr), sizeof(tmp));
+		tech = tmp;
+		if (!(data = strchr(tmp, '/'))) {
+			astman_send_error_va(s, m, "Invalid channel in originate %d", i);
+			goto bulk_orig_cleanup;
+		}
+		*data++ = '\0';
+
+		snprintf(hdr, sizeof(hdr), "ChannelId(%d)", i);
+		assignedids.uniqueid = astman_get_header(m, hdr);
+		snprintf(hdr, sizeof(hdr), "OtherChannelId(%d)", i);
+		assignedids.uniqueid2 = astman_get_header(m, hdr);
+		if (AST_MAX_PUBLIC_UNIQUEID < strlen(assignedids.uniqueid)
+			|| AST_MAX_PUBLIC_UNIQUEID < strlen(assignedids.uniqueid2)) {
+			astman_send_error_va(s, m, "Uniqueid length exceeds maximum of %d in originate %d",
+				AST_MAX_PUBLIC_UNIQUEID, i);
+			goto bulk_orig_cleanup;
+		}
+
+		ast_copy_string(tmp2, callerid, sizeof(tmp2));
+		ast_callerid_parse(tmp2, &n, &l);
+		if (n && ast_strlen_zero(n)) {
+			n = NULL;
+		}
+		if (l) {
+			ast_shrink_phone_number(l);
+			if (ast_strlen_zero(l)) {
+				l = NULL;
+			}
+		}
+
+		if (ast_strlen_zero(app)) {
+			if (ast_strlen_zero(exten)) {
+				astman_send_error_va(s, m, "Exten not specified for originate %d", i);
+				goto bulk_orig_cleanup;
+			}
+			if (label_priority
+				&& (entry_pi = ast_findlabel_extension(NULL, context, exten, priority, NULL)) < 1) {
+				astman_send_error_va(s, m, "Invalid priority for originate %d", i);
+				goto bulk_orig_cleanup;
+			}
+			if (!ast_exists_extension(NULL, context, exten, entry_pi, l)) {
+				astman_send_error_va(s, m, "Extension does not exist for originate %d", i);
+				goto bulk_orig_cleanup;
+			}
+		}
+
+		snprintf(hdr, sizeof(hdr), "Variable(%d)", i);
+		entry_vars = ast_variables_reverse(man_do_variable_value(NULL, astman_get_header(m, hdr)));
+
+		fast[i] = ast_calloc(1, sizeof(*fast[i]));
+		if (!fast[i] || ast_string_field_init(fast[i], 252)) {
+			ast_free(fast[i]);
+			fast[i] = NULL;
+			ast_variables_destroy(entry_vars);
+			astman_send_error(s, m, "Internal Error. Memory allocation failure.");
+			goto bulk_orig_cleanup;
+		}
+		if (!ast_strlen_zero(id)) {
+			ast_string_field_build(fast[i], idtext, "ActionID: %s\r\n", id);
+		}
+		ast_string_field_set(fast[i], tech, tech);
+		ast_string_field_set(fast[i], data, data);
+		ast_string_field_set(fast[i], app, app);
+		ast_string_field_set(fast[i], appdata, appdata);
+		ast_string_field_set(fast[i], cid_num, l);
+		ast_string_field_set(fast[i], cid_name, n);
+		ast_string_field_set(fast[i], context, context);
+		ast_string_field_set(fast[i], exten, exten);
+		ast_string_field_set(fast[i], account, account);
+		ast_string_field_set(fast[i], channelid, assignedids.uniqueid);
+		ast_string_field_set(fast[i], otherchannelid, assignedids.uniqueid2);
+		fast[i]->vars = vars ? ast_variables_dup(vars) : NULL;
+		if (entry_vars) {
+			ast_variable_list_append(&fast[i]->vars, entry_vars);
+		}
+		fast[i]->cap = ao2_bump(cap);
+		fast[i]->timeout = to;
+		fast[i]->early_media = bridge_early;
+		fast[i]->priority = entry_pi;
+		fast[i]->bulk_index = i;
+	}
+
+	for (queued = 0; queued < count; ++queued) {
+		/* Taken by the originate threads, or freed */
+		struct fast_originate_helper *helper = fast[queued];
+
+		fast[queued] = NULL;
+		if (fast_originate_queue(helper)) {
+			break;
+		}
+	}
+	if (queued < count) {
+		astman_send_error_va(s, m, "Originate failed, %d of %d queued", queued, count);
+	} else {
+		astman_start_ack(s, m);
+		astman_append(s, "Message: Originates successfully queued\r\n"
+			"Queued: %d\r\n"
+			"\r\n", queued);
+	}
+
+bulk_orig_cleanup:
+	for (i = 0; i < count; ++i) {
+		if (fast[i]) {
+			destroy_fast_originate_helper(fast[i]);
+		}
+	}
+	ast_variables_destroy(vars);
+	ao2_cleanup(cap);
+	return 0;
+}
+
+static int action_mailboxstatus(struct mansession *s, const struct message *m)
+{
+	const char *mailbox = astman_get_header(m, "Mailbox");
+	int ret;
+
+	if (ast_strlen_zero(mailbox)) {
+		astman_send_error(s, m, "Mailbox not specified");
+		return 0;
+	}
+	ret = ast_app_has_voicemail(mailbox, NULL);
+	astman_start_ack(s, m);
+	astman_append(s, "Message: Mailbox Status\r\n"
+			 "Mailbox: %s\r\n"
+			 "Waiting: %d\r\n\r\n", mailbox, ret);
+	return 0;
+}
+
+static int action_mailboxcount(struct mansession *s, const struct message *m)
+{
+	const char *mailbox = astman_get_header(m, "Mailbox");
+	int newmsgs = 0, oldmsgs = 0, urgentmsgs = 0;;
+
+	if (ast_strlen_zero(mailbox)) {
+		astman_send_error(s, m, "Mailbox not specified");
+		return 0;
+	}
+	ast_app_inboxcount2(mailbox, &urgentmsgs, &newmsgs, &oldmsgs);
+	astman_start_ack(s, m);
+	astman_append(s,   "Message: Mailbox Message Count\r\n"
+			   "Mailbox: %s\r\n"
+			   "UrgMessages: %d\r\n"
+			   "NewMessages: %d\r\n"
+			   "OldMessages: %d\r\n"
+			   "\r\n",
+			   mailbox, urgentmsgs, newmsgs, oldmsgs);
+	return 0;
+}
+
+static int action_extensionstate(struct mansession *s, const struct message *m)
+{
+	const char *exten = astman_get_header(m, "Exten");
+	const char *context = astman_get_header(m, "Context");
+	char hint[256] = "";
+	int status;
+	if (ast_strlen_zero(exten)) {
+		astman_send_error(s, m, "Extension not specified");
+		return 0;
+	}
+	if (ast_strlen_zero(context)) {
+		context = "default";
+	}
+	status = ast_extension_state(NULL, context, exten);
+	ast_get_hint(hint, sizeof(hint) - 1, NULL, 0, NULL, context, exten);
 	astman_start_ack(s, m);
 	astman_append(s,   "Message: Extension Status\r\n"
 			   "Exten: %s\r\n"
@@ -5595,13 +6142,25 @@ static int action_timeout(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*! \brief Whether an event filter matches an event */
+static int event_filter_match(struct event_filter *filter, const char *eventdata)
+{
+	if (*filter->literal && !strstr(eventdata, filter->literal)) {
+		return 0;
+	}
+	if (filter->literal_only) {
+		return 1;
+	}
+	return !regexec(&filter->regex, eventdata, 0, NULL, 0);
+}
+
 static int whitefilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 {
-	regex_t *regex_filter = obj;
+	struct event_filter *regex_filter = obj;
 	const char *eventdata = arg;
 	int *result = data;
 
-	if (!regexec(regex_filter, eventdata, 0, NULL, 0)) {
+	if (event_filter_match(regex_filter, eventdata)) {
 		*result = 1;
 		return (CMP_MATCH | CMP_STOP);
 	}
@@ -5611,11 +6170,11 @@ static int whitefilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 
 static int blackfilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 {
-	regex_t *regex_filter = obj;
+	struct event_filter *regex_filter = obj;
 	const char *eventdata = arg;
 	int *result = data;
 
-	if (!regexec(regex_filter, eventdata, 0, NULL, 0)) {
+	if (event_filter_match(regex_filter, eventdata)) {
 		*result = 0;
 		return (CMP_MATCH | CMP_STOP);
 	}
@@ -5636,6 +6195,10 @@ static int action_filter(struct mansession *s, const struct message *m)
 
 	if (!strcasecmp(operation, "Add")) {
 		res = manager_add_filter(filter, s->session->whitefilters, s->session->blackfilters);
+		ao2_lock(s->session);
+		ao2_cleanup(s->session->filterset);
+		s->session->filterset = NULL;
+		ao2_unlock(s->session);
 
 	        if (res != FILTER_SUCCESS) {
 		        if (res == FILTER_ALLOC_FAILED) {
@@ -5658,6 +6221,39 @@ static int action_filter(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Find the literal text at the start of a filter pattern
+ *
+ * Any match of the pattern contains the text, unless the pattern has
+ * alternatives or is anchored, when none is given.
+ *
+ * \param pattern The extended regular expression
+ * \param[out] literal The text, at most as long as the pattern
+ *
+ * \retval 1 if the whole pattern is literal text
+ */
+static int event_filter_literal(const char *pattern, char *literal)
+{
+	static const char metachars[] = ".[]()*+?{}|^$\\";
+	size_t len = strcspn(pattern, metachars);
+
+	*literal = '\0';
+	if (strchr(pattern, '|') || pattern[0] == '^') {
+		return 0;
+	}
+	if (!pattern[len]) {
+		strcpy(literal, pattern);
+		return 1;
+	}
+	/* The last character is optional, or repeated from none */
+	if (len && strchr("*?{", pattern[len])) {
+		len--;
+	}
+	ast_copy_string(literal, pattern, len + 1);
+	return 0;
+}
+
 /*!
  * \brief Add an event filter to a manager session
  *
@@ -5680,12 +6276,9 @@ static int action_filter(struct mansession *s, const struct message *m)
  *
  */
 static enum add_filter_result manager_add_filter(const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters) {
-	regex_t *new_filter = ao2_t_alloc(sizeof(*new_filter), event_filter_destructor, "event_filter allocation");
+	struct event_filter *new_filter;
 	int is_blackfilter;
-
-	if (!new_filter) {
-		return FILTER_ALLOC_FAILED;
-	}
+	size_t len;
 
 	if (filter_pattern[0] == '!') {
 		is_blackfilter = 1;
@@ -5694,10 +6287,20 @@ static enum add_filter_result manager_add_filter(const char *filter_pattern, str
 		is_blackfilter = 0;
 	}
 
-	if (regcomp(new_filter, filter_pattern, REG_EXTENDED | REG_NOSUB)) {
+	len = strlen(filter_pattern);
+	new_filter = ao2_t_alloc(sizeof(*new_filter) + 2 * (len + 1), event_filter_destructor, "event_filter allocation");
+	if (!new_filter) {
+		return FILTER_ALLOC_FAILED;
+	}
+	strcpy(new_filter->pattern, filter_pattern);
+	new_filter->literal = new_filter->pattern + len + 1;
+	new_filter->literal_only = event_filter_literal(filter_pattern, (char *) new_filter->literal);
+
+	if (regcomp(&new_filter->regex, filter_pattern, REG_EXTENDED | REG_NOSUB)) {
 		ao2_t_ref(new_filter, -1, "failed to make regex");
 		return FILTER_COMPILE_FAIL;
 	}
+	new_filter->compiled = 1;
 
 	if (is_blackfilter) {
 		ao2_t_link(blackfilters, new_filter, "link new filter into black user container");
@@ -5710,27 +6313,170 @@ static enum add_filter_result manager_add_filter(const char *filter_pattern, str
 	return FILTER_SUCCESS;
 }
 
-static int match_filter(struct mansession *s, char *eventdata)
+/*! \brief Run white and black filters on an event */
+static int event_filters_match(struct ao2_container *whitefilters, struct ao2_container *blackfilters, char *eventdata)
 {
 	int result = 0;
 
-	ast_debug(3, "Examining AMI event:\n%s\n", eventdata);
-	if (!ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
+	if (!ao2_container_count(whitefilters) && !ao2_container_count(blackfilters)) {
 		return 1; /* no filtering means match all */
-	} else if (ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
+	} else if (ao2_container_count(whitefilters) && !ao2_container_count(blackfilters)) {
 		/* white filters only: implied black all filter processed first, then white filters */
-		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
-	} else if (!ao2_container_count(s->session->whitefilters) && ao2_container_count(s->session->blackfilters)) {
+		ao2_t_callback_data(whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+	} else if (!ao2_container_count(whitefilters) && ao2_container_count(blackfilters)) {
 		/* black filters only: implied white all filter processed first, then black filters */
-		ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
 	} else {
 		/* white and black filters: implied black all filter processed first, then white filters, and lastly black filters */
-		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
 		if (result) {
 			result = 0;
-			ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+			ao2_t_callback_data(blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		}
+	}
+
+	return result;
+}
+
+static void event_filter_set_key(struct ast_str **key, struct ao2_container *filters, char type)
+{
+	struct ao2_iterator i = ao2_iterator_init(filters, 0);
+	struct event_filter *filter;
+
+	while ((filter = ao2_iterator_next(&i))) {
+		ast_str_append(key, 0, "%c%s\n", type, filter->pattern);
+		ao2_ref(filter, -1);
+	}
+	ao2_iterator_destroy(&i);
+}
+
+static void event_filter_set_copy(struct ao2_container *dst, struct ao2_container *src)
+{
+	struct ao2_iterator i = ao2_iterator_init(src, 0);
+	struct event_filter *filter;
+
+	while ((filter = ao2_iterator_next(&i))) {
+		ao2_link(dst, filter);
+		ao2_ref(filter, -1);
+	}
+	ao2_iterator_destroy(&i);
+}
+
+/*!
+ * \internal
+ * \brief Find the filter set with the filters of a session, or make one
+ *
+ * \note The session is locked.
+ *
+ * \return The filter set with a reference, or NULL on failure
+ */
+static struct event_filter_set *event_filter_set_get(struct mansession_session *session)
+{
+	static int next_id;
+	struct ast_str *key = ast_str_create(128);
+	struct event_filter_set *set;
+
+	if (!key || !event_filter_sets) {
+		ast_free(key);
+		return NULL;
+	}
+	event_filter_set_key(&key, session->whitefilters, '+');
+	event_filter_set_key(&key, session->blackfilters, '-');
+
+	ao2_lock(event_filter_sets);
+	set = ao2_find(event_filter_sets, ast_str_buffer(key), OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!set && (set = ao2_alloc_options(sizeof(*set) + ast_str_strlen(key) + 1,
+		event_filter_set_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		strcpy(set->key, ast_str_buffer(key));
+		/* Never 0, and the result fits next to it in a pointer */
+		set->id = ((unsigned int) ast_atomic_fetchadd_int(&next_id, 1) & 0x3FFFFFFF) + 1;
+		set->whitefilters = ao2_container_alloc(1, NULL, NULL);
+		set->blackfilters = ao2_container_alloc(1, NULL, NULL);
+		if (!set->whitefilters || !set->blackfilters) {
+			ao2_ref(set, -1);
+			set = NULL;
+		} else {
+			event_filter_set_copy(set->whitefilters, session->whitefilters);
+			event_filter_set_copy(set->blackfilters, session->blackfilters);
+			ao2_link_flags(event_filter_sets, set, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(event_filter_sets);
+	ast_free(key);
+
+	return set;
+}
+
+/*!
+ * \internal
+ * \brief The result of a filter set already run on an event
+ *
+ * Each entry holds the id of a filter set shifted up by one with the
+ * result in the lowest bit, so it is set with a single compare and swap.
+ *
+ * \retval -1 if the filter set has not been run on the event
+ */
+static int event_filter_cache_get(struct eventqent *eqe, unsigned int id)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(eqe->filter_results); i++) {
+		uintptr_t entry = (uintptr_t) eqe->filter_results[i];
+
+		if (!entry) {
+			break;
+		}
+		if ((entry >> 1) == id) {
+			return entry & 1;
+		}
+	}
+	return -1;
+}
+
+static void event_filter_cache_put(struct eventqent *eqe, unsigned int id, int result)
+{
+	void *entry = (void *) (((uintptr_t) id << 1) | (result ? 1 : 0));
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(eqe->filter_results); i++) {
+		if (ast_atomic_compare_and_swap_ptr(&eqe->filter_results[i], NULL, entry)) {
+			return;
 		}
 	}
+}
+
+/*! \brief Release the filter sets no session uses */
+static int event_filter_set_unused(void *obj, void *arg, int flags)
+{
+	/* Only the container has a reference, and no one can find it while it is locked */
+	return ao2_ref(obj, 0) == 1 ? CMP_MATCH : 0;
+}
+
+/*!
+ * \note The session is locked.
+ */
+static int match_filter(struct mansession *s, struct eventqent *eqe)
+{
+	struct event_filter_set *set;
+	int result;
+
+	ast_debug(3, "Examining AMI event:\n%s\n", eqe->eventdata);
+	if (!ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
+		return 1; /* no filtering means match all */
+	}
+
+	if (!s->session->filterset) {
+		s->session->filterset = event_filter_set_get(s->session);
+	}
+	if (!(set = s->session->filterset)) {
+		return event_filters_match(s->session->whitefilters, s->session->blackfilters, eqe->eventdata);
+	}
+
+	/* Sessions with the same filters only run them once on each event */
+	if ((result = event_filter_cache_get(eqe, set->id)) < 0) {
+		result = event_filters_match(set->whitefilters, set->blackfilters, eqe->eventdata);
+		event_filter_cache_put(eqe, set->id, result);
+	}
 
 	return result;
 }
@@ -5746,9 +6492,19 @@ static int process_events(struct mansession *s)
 
 	ao2_lock(s->session);
 	if (s->session->f != NULL) {
-		struct eventqent *eqe = s->session->last_ev;
+		struct eventqent *eqe;
+		unsigned int lost;
 
-		while ((eqe = advance_event(eqe))) {
+		for (;;) {
+			if (!(eqe = session_next_event(s->session, &lost))) {
+				if (!lost) {
+					break;
+				}
+				if (!ret && session_events_lost(s, lost, 0)) {
+					ret = -1;
+				}
+				continue;
+			}
 			if (eqe->category == EVENT_FLAG_SHUTDOWN) {
 				ast_debug(3, "Received CloseSession event\n");
 				ret = -1;
@@ -5756,12 +6512,12 @@ static int process_events(struct mansession *s)
 			if (!ret && s->session->authenticated &&
 			    (s->session->readperm & eqe->category) == eqe->category &&
 			    (s->session->send_events & eqe->category) == eqe->category) {
-					if (match_filter(s, eqe->eventdata)) {
+					if (match_filter(s, eqe)) {
 						if (send_string(s, eqe->eventdata) < 0)
 							ret = -1;	/* don't send more */
 					}
 			}
-			s->session->last_ev = eqe;
+			ao2_ref(eqe, -1);
 		}
 	}
 	ao2_unlock(s->session);
@@ -5901,16 +6657,65 @@ static int action_reload(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+struct coreshowchannels_data {
+	struct mansession *s;
+	const char *idText;
+	int numchans;
+};
+
+static int coreshowchannels_cb(struct stasis_message *msg, void *data)
+{
+	struct coreshowchannels_data *show = data;
+	struct ast_channel_snapshot *cs = stasis_message_data(msg);
+	struct ast_str *built = ast_manager_build_channel_state_string_prefix(cs, "");
+	char durbuf[10] = "";
+
+	if (!built) {
+		return 0;
+	}
+
+	if (!ast_tvzero(cs->creationtime)) {
+		int duration, durh, durm, durs;
+
+		duration = (int)(ast_tvdiff_ms(ast_tvnow(), cs->creationtime) / 1000);
+		durh = duration / 3600;
+		durm = (duration % 3600) / 60;
+		durs = duration % 60;
+		snprintf(durbuf, sizeof(durbuf), "%02d:%02d:%02d", durh, durm, durs);
+	}
+
+	astman_append(show->s,
+		"Event: CoreShowChannel\r\n"
+		"%s"
+		"%s"
+		"Application: %s\r\n"
+		"ApplicationData: %s\r\n"
+		"Duration: %s\r\n"
+		"BridgeId: %s\r\n"
+		"\r\n",
+		show->idText,
+		ast_str_buffer(built),
+		cs->appl,
+		cs->data,
+		durbuf,
+		cs->bridgeid);
+
+	show->numchans++;
+
+	ast_free(built);
+	return 0;
+}
+
 /*! \brief  Manager command "CoreShowChannels" - List currently defined channels
  *          and some information about them. */
 static int action_coreshowchannels(struct mansession *s, const struct message *m)
 {
 	const char *actionid = astman_get_header(m, "ActionID");
 	char idText[256];
-	int numchans = 0;
-	RAII_VAR(struct ao2_container *, channels, NULL, ao2_cleanup);
-	struct ao2_iterator it_chans;
-	struct stasis_message *msg;
+	struct coreshowchannels_data show = {
+		.s = s,
+		.idText = idText,
+	};
 
 	if (!ast_strlen_zero(actionid)) {
 		snprintf(idText, sizeof(idText), "ActionID: %s\r\n", actionid);
@@ -5918,56 +6723,15 @@ static int action_coreshowchannels(struct mansession *s, const struct message *m
 		idText[0] = '\0';
 	}
 
-	if (!(channels = stasis_cache_dump(ast_channel_cache_by_name(), ast_channel_snapshot_type()))) {
-		astman_send_error(s, m, "Could not get cached channels");
-		return 0;
-	}
-
 	astman_send_listack(s, m, "Channels will follow", "start");
 
-	it_chans = ao2_iterator_init(channels, 0);
-	for (; (msg = ao2_iterator_next(&it_chans)); ao2_ref(msg, -1)) {
-		struct ast_channel_snapshot *cs = stasis_message_data(msg);
-		struct ast_str *built = ast_manager_build_channel_state_string_prefix(cs, "");
-		char durbuf[10] = "";
-
-		if (!built) {
-			continue;
-		}
-
-		if (!ast_tvzero(cs->creationtime)) {
-			int duration, durh, durm, durs;
-
-			duration = (int)(ast_tvdiff_ms(ast_tvnow(), cs->creationtime) / 1000);
-			durh = duration / 3600;
-			durm = (duration % 3600) / 60;
-			durs = duration % 60;
-			snprintf(durbuf, sizeof(durbuf), "%02d:%02d:%02d", durh, durm, durs);
-		}
-
-		astman_append(s,
-			"Event: CoreShowChannel\r\n"
-			"%s"
-			"%s"
-			"Application: %s\r\n"
-			"ApplicationData: %s\r\n"
-			"Duration: %s\r\n"
-			"BridgeId: %s\r\n"
-			"\r\n",
-			idText,
-			ast_str_buffer(built),
-			cs->appl,
-			cs->data,
-			durbuf,
-			cs->bridgeid);
-
-		numchans++;
-
-		ast_free(built);
+	/* Stream the channels without holding up updates of the whole cache */
+	if (stasis_cache_iterate(ast_channel_cache_by_name(), ast_channel_snapshot_type(),
+		coreshowchannels_cb, &show)) {
+		ast_log(LOG_WARNING, "Could not list all cached channels\n");
 	}
-	ao2_iterator_destroy(&it_chans);
 
-	astman_send_list_complete_start(s, m, "CoreShowChannelsComplete", numchans);
+	astman_send_list_complete_start(s, m, "CoreShowChannelsComplete", show.numchans);
 	astman_send_list_complete_end(s);
 
 	return 0;
@@ -6094,11 +6858,168 @@ static int manager_moduleload(struct mansession *s, const struct message *m)
  * the appropriate handler.
  */
 
-/*! \brief
- * Process an AMI message, performing desired action.
+/*!
+ * \internal
+ * \brief Write the output collected for an action
+ *
+ * The output is written at once with the session locked, so that it is not
+ * cut into by events or by the responses of other actions.
+ */
+static void mansession_flush(struct mansession *s)
+{
+	struct ast_str *buf = s->outbuf;
+
+	if (!buf) {
+		return;
+	}
+	s->outbuf = NULL;
+
+	if (ast_str_strlen(buf)) {
+		ao2_lock(s->session);
+		if (!s->session->closed && s->session->f) {
+			send_string(s, ast_str_buffer(buf));
+		}
+		ao2_unlock(s->session);
+	}
+	ast_free(buf);
+}
+
+/*! \brief An action queued to run on the action threads */
+struct async_action {
+	struct mansession_session *session;
+	struct ast_tcptls_session_instance *tcptls_session;
+	struct manager_action *act;
+	struct message m;	/*!< A copy of the request, the session thread frees its own */
+};
+
+static void async_action_destroy(struct async_action *aa)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < aa->m.hdrcount; ++idx) {
+		ast_free((void *) aa->m.headers[idx]);
+	}
+	ao2_lock(aa->act);
+	if (aa->act->module) {
+		ast_module_unref(aa->act->module);
+	}
+	ao2_unlock(aa->act);
+	ao2_t_ref(aa->act, -1, "done with queued action");
+	ao2_ref(aa->session, -1);
+	ao2_ref(aa->tcptls_session, -1);
+	ast_free(aa);
+}
+
+/*! \brief Run a queued action and write its response */
+static int async_action_exec(void *data)
+{
+	struct async_action *aa = data;
+	struct mansession s = {
+		.session = aa->session,
+		.tcptls_session = aa->tcptls_session,
+	};
+	int registered;
+
+	ast_mutex_init(&s.lock);
+	s.outbuf = ast_str_create(1024);
+	if (s.outbuf) {
+		ao2_lock(aa->act);
+		registered = aa->act->registered && aa->act->func;
+		ao2_unlock(aa->act);
+
+		if (registered) {
+			ast_debug(1, "Running action '%s' for %s\n", aa->act->action,
+				ast_sockaddr_stringify_addr(&aa->session->addr));
+			if (aa->act->func(&s, &aa->m)) {
+				ast_debug(1, "Action '%s' asked to end the session, ignored on an action thread\n",
+					aa->act->action);
+			}
+		} else {
+			report_req_not_allowed(&s, aa->act->action);
+			mansession_lock(&s);
+			astman_send_error(&s, &aa->m, "Permission denied");
+			mansession_unlock(&s);
+		}
+		mansession_flush(&s);
+	}
+	ast_mutex_destroy(&s.lock);
+
+	async_action_destroy(aa);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Whether an action may be run on the action threads
+ *
+ * Only actions of authenticated TCP sessions with an ActionID to match the
+ * response to, and none that change the session itself.
+ */
+static int action_async_ok(struct mansession *s, const struct message *m, const char *action)
+{
+	static const char * const session_actions[] = {
+		"Login", "Logoff", "Challenge", "Events", "Filter", "WaitEvent",
+	};
+	int idx;
+
+	if (!s->outbuf || !action_threads || !action_pool
+		|| !s->session->authenticated
+		|| ast_strlen_zero(astman_get_header(m, "ActionID"))) {
+		return 0;
+	}
+	for (idx = 0; idx < ARRAY_LEN(session_actions); ++idx) {
+		if (!strcasecmp(action, session_actions[idx])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*!
+ * \internal
+ * \brief Queue an action to run on the action threads
+ *
+ * \note The action must be locked.
+ *
+ * \retval 0 The action was queued
+ * \retval -1 It was not, and must be run on the session thread
+ */
+static int action_dispatch(struct mansession *s, const struct message *m, struct manager_action *act)
+{
+	struct async_action *aa;
+
+	if (!(aa = ast_calloc(1, sizeof(*aa)))) {
+		return -1;
+	}
+	for (aa->m.hdrcount = 0; aa->m.hdrcount < m->hdrcount; ++aa->m.hdrcount) {
+		if (!(aa->m.headers[aa->m.hdrcount] = ast_strdup(m->headers[aa->m.hdrcount]))) {
+			break;
+		}
+	}
+
+	ao2_ref(s->session, +1);
+	aa->session = s->session;
+	ao2_ref(s->tcptls_session, +1);
+	aa->tcptls_session = s->tcptls_session;
+	ao2_t_ref(act, +1, "queued action");
+	aa->act = act;
+	if (act->module) {
+		ast_module_ref(act->module);
+	}
+
+	if (aa->m.hdrcount < m->hdrcount || ast_threadpool_push(action_pool, async_action_exec, aa)) {
+		async_action_destroy(aa);
+		return -1;
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Run the action of an AMI message, or queue it to the action threads
  * Return 0 on success, -1 on error that require the session to be destroyed.
  */
-static int process_message(struct mansession *s, const struct message *m)
+static int process_action(struct mansession *s, const struct message *m)
 {
 	int ret = 0;
 	struct manager_action *act_found;
@@ -6159,17 +7080,22 @@ static int process_message(struct mansession *s, const struct message *m)
 			/* We have the authority to execute the action. */
 			ao2_lock(act_found);
 			if (act_found->registered && act_found->func) {
-				ast_debug(1, "Running action '%s'\n", act_found->action);
-				if (act_found->module) {
-					ast_module_ref(act_found->module);
+				if (action_async_ok(s, m, act_found->action)
+					&& !action_dispatch(s, m, act_found)) {
+					ast_debug(1, "Queued action '%s'\n", act_found->action);
+				} else {
+					ast_debug(1, "Running action '%s'\n", act_found->action);
+					if (act_found->module) {
+						ast_module_ref(act_found->module);
+					}
+					ao2_unlock(act_found);
+					ret = act_found->func(s, m);
+					ao2_lock(act_found);
+					if (act_found->module) {
+						ast_module_unref(act_found->module);
+					}
 				}
-				ao2_unlock(act_found);
-				ret = act_found->func(s, m);
 				acted = 1;
-				ao2_lock(act_found);
-				if (act_found->module) {
-					ast_module_unref(act_found->module);
-				}
 			}
 			ao2_unlock(act_found);
 		}
@@ -6194,6 +7120,26 @@ static int process_message(struct mansession *s, const struct message *m)
 		astman_send_error(s, m, buf);
 		mansession_unlock(s);
 	}
+	return ret;
+}
+
+/*! \brief
+ * Process an AMI message, performing desired action.
+ * Return 0 on success, -1 on error that require the session to be destroyed.
+ */
+static int process_message(struct mansession *s, const struct message *m)
+{
+	int ret;
+
+	if (action_threads && !s->session->managerid && !s->hook) {
+		/*
+		 * Responses from the action threads may be written at any time,
+		 * so this one is collected and written at once as well.
+		 */
+		s->outbuf = ast_str_create(1024);
+	}
+	ret = process_action(s, m);
+	mansession_flush(s);
 	if (ret) {
 		return ret;
 	}
@@ -6319,7 +7265,10 @@ static int get_input(struct mansession *s, char *output)
 static void handle_parse_error(struct mansession *s, struct message *m, char *error)
 {
 	mansession_lock(s);
+	/* Not to be cut into by the responses of the action threads */
+	ao2_lock(s->session);
 	astman_send_error(s, m, error);
+	ao2_unlock(s->session);
 	s->parsing = MESSAGE_OKAY;
 	mansession_unlock(s);
 }
@@ -6373,7 +7322,9 @@ static int do_message(struct mansession *s)
 			if (ast_strlen_zero(header_buf)) {
 				if (hdr_loss) {
 					mansession_lock(s);
+					ao2_lock(s->session);
 					astman_send_error(s, &m, "Too many lines in message or allocation failure");
+					ao2_unlock(s->session);
 					mansession_unlock(s);
 					res = 0;
 				} else {
@@ -6468,7 +7419,7 @@ static void *session_do(void *data)
 
 	ao2_lock(session);
 	/* Hook to the tail of the event queue */
-	session->last_ev = grab_last();
+	session->event_cursor = event_head();
 
 	ast_mutex_init(&s.lock);
 
@@ -6519,6 +7470,10 @@ static void *session_do(void *data)
 		}
 	}
 
+	/* Actions still running on the action threads hold the session */
+	ao2_lock(session);
+	session->closed = 1;
+	ao2_unlock(session);
 	session_destroy(session);
 
 	ast_mutex_destroy(&s.lock);
@@ -6568,24 +7523,32 @@ static void purge_sessions(int n_max)
  */
 static int append_event(const char *str, int category)
 {
-	struct eventqent *tmp = ast_malloc(sizeof(*tmp) + strlen(str));
-	static int seq;	/* sequence number */
+	struct eventqent *tmp;
+	struct eventq_slot *slot;
 
+	if (!event_ring_ready) {
+		return -1;
+	}
+
+	tmp = ao2_alloc_options(sizeof(*tmp) + strlen(str), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
 	if (!tmp) {
 		return -1;
 	}
 
-	/* need to init all fields, because ast_malloc() does not */
-	tmp->usecount = 0;
 	tmp->category = category;
-	tmp->seq = ast_atomic_fetchadd_int(&seq, 1);
 	tmp->tv = ast_tvnow();
-	AST_RWLIST_NEXT(tmp, eq_next) = NULL;
+	memset((void *) tmp->filter_results, 0, sizeof(tmp->filter_results));
 	strcpy(tmp->eventdata, str);
+	tmp->seq = ast_atomic_fetchadd_int(&event_seq, 1);
 
-	AST_RWLIST_WRLOCK(&all_events);
-	AST_RWLIST_INSERT_TAIL(&all_events, tmp, eq_next);
-	AST_RWLIST_UNLOCK(&all_events);
+	/* Replace the event EVENTQ_SIZE before, unless one after has got here first */
+	slot = &event_ring[tmp->seq & (EVENTQ_SIZE - 1)];
+	ast_spinlock_lock(&slot->lock);
+	if (!slot->event || (int) (tmp->seq - slot->event->seq) > 0) {
+		SWAP(slot->event, tmp);
+	}
+	ast_spinlock_unlock(&slot->lock);
+	ao2_cleanup(tmp);
 
 	return 0;
 }
@@ -6829,6 +7792,63 @@ static void action_destroy(void *obj)
 	ao2_cleanup(doomed->list_responses);
 }
 
+#ifdef AST_XML_DOCS
+/*!
+ * \internal
+ * \brief Build the documentation of an AMI action from XML.
+ *
+ * \param cur Action to build the documentation of.
+ */
+static void action_build_docs(struct manager_action *cur)
+{
+	char *tmpxml;
+
+	tmpxml = ast_xmldoc_build_synopsis("manager", cur->action, NULL);
+	ast_string_field_set(cur, synopsis, tmpxml);
+	ast_free(tmpxml);
+
+	tmpxml = ast_xmldoc_build_syntax("manager", cur->action, NULL);
+	ast_string_field_set(cur, syntax, tmpxml);
+	ast_free(tmpxml);
+
+	tmpxml = ast_xmldoc_build_description("manager", cur->action, NULL);
+	ast_string_field_set(cur, description, tmpxml);
+	ast_free(tmpxml);
+
+	tmpxml = ast_xmldoc_build_seealso("manager", cur->action, NULL);
+	ast_string_field_set(cur, seealso, tmpxml);
+	ast_free(tmpxml);
+
+	tmpxml = ast_xmldoc_build_arguments("manager", cur->action, NULL);
+	ast_string_field_set(cur, arguments, tmpxml);
+	ast_free(tmpxml);
+
+	cur->final_response = ast_xmldoc_build_final_response("manager", cur->action, NULL);
+	cur->list_responses = ast_xmldoc_build_list_responses("manager", cur->action, NULL);
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Make sure the documentation of an AMI action is built.
+ *
+ * \param cur Action about to have its documentation shown.
+ *
+ * With lazy documentation the XML documentation of an action is
+ * only built the first time something shows it.
+ */
+static void action_docs(struct manager_action *cur)
+{
+#ifdef AST_XML_DOCS
+	ao2_lock(cur);
+	if (cur->docs_pending) {
+		action_build_docs(cur);
+		cur->docs_pending = 0;
+	}
+	ao2_unlock(cur);
+#endif
+}
+
 /*! \brief register a new command with manager, including online help. This is
 	the preferred way to register a manager command */
 int ast_manager_register2(const char *action, int auth, int (*func)(struct mansession *s, const struct message *m), struct ast_module *module, const char *synopsis, const char *description)
@@ -6850,31 +7870,11 @@ int ast_manager_register2(const char *action, int auth, int (*func)(struct manse
 	cur->module = module;
 #ifdef AST_XML_DOCS
 	if (ast_strlen_zero(synopsis) && ast_strlen_zero(description)) {
-		char *tmpxml;
-
-		tmpxml = ast_xmldoc_build_synopsis("manager", action, NULL);
-		ast_string_field_set(cur, synopsis, tmpxml);
-		ast_free(tmpxml);
-
-		tmpxml = ast_xmldoc_build_syntax("manager", action, NULL);
-		ast_string_field_set(cur, syntax, tmpxml);
-		ast_free(tmpxml);
-
-		tmpxml = ast_xmldoc_build_description("manager", action, NULL);
-		ast_string_field_set(cur, description, tmpxml);
-		ast_free(tmpxml);
-
-		tmpxml = ast_xmldoc_build_seealso("manager", action, NULL);
-		ast_string_field_set(cur, seealso, tmpxml);
-		ast_free(tmpxml);
-
-		tmpxml = ast_xmldoc_build_arguments("manager", action, NULL);
-		ast_string_field_set(cur, arguments, tmpxml);
-		ast_free(tmpxml);
-
-		cur->final_response = ast_xmldoc_build_final_response("manager", action, NULL);
-		cur->list_responses = ast_xmldoc_build_list_responses("manager", action, NULL);
-
+		if (ast_xmldoc_lazy()) {
+			cur->docs_pending = 1;
+		} else {
+			action_build_docs(cur);
+		}
 		cur->docsrc = AST_XML_DOC;
 	} else
 #endif
@@ -7411,7 +8411,7 @@ static int generic_http_callback(struct ast_tcptls_session_instance *ser,
 		 */
 		while ((session->managerid = ast_random() ^ (unsigned long) session) == 0) {
 		}
-		session->last_ev = grab_last();
+		session->event_cursor = event_head();
 		AST_LIST_HEAD_INIT_NOLOCK(&session->datastores);
 	}
 	ao2_unlock(session);
@@ -7725,7 +8725,7 @@ static int auth_http_callback(struct ast_tcptls_session_instance *ser,
 
 		ast_copy_string(session->username, u_username, sizeof(session->username));
 		session->managerid = nonce;
-		session->last_ev = grab_last();
+		session->event_cursor = event_head();
 		AST_LIST_HEAD_INIT_NOLOCK(&session->datastores);
 
 		session->readperm = u_readperm;
@@ -8110,6 +9110,60 @@ static struct ast_custom_function managerclient_function = {
 
 static int webregged = 0;
 
+/*!
+ * Release the events every session has processed from the ring,
+ * so they are not kept until they are replaced.
+ */
+static void purge_events(void)
+{
+	struct ao2_container *sessions;
+	struct mansession_session *session;
+	struct ao2_iterator i;
+	unsigned int head = event_head();
+	unsigned int oldest = head;
+
+	if (!event_ring_ready) {
+		return;
+	}
+
+	sessions = ao2_global_obj_ref(mgr_sessions);
+	if (sessions) {
+		i = ao2_iterator_init(sessions, 0);
+		ao2_ref(sessions, -1);
+		while ((session = ao2_iterator_next(&i))) {
+			ao2_lock(session);
+			if ((int) (session->event_cursor - oldest) < 0) {
+				oldest = session->event_cursor;
+			}
+			ao2_unlock(session);
+			unref_mansession(session);
+		}
+		ao2_iterator_destroy(&i);
+	}
+
+	if (event_filter_sets) {
+		ao2_callback(event_filter_sets, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, event_filter_set_unused, NULL);
+	}
+
+	/* Those replaced already are gone */
+	if ((int) (head - EVENTQ_SIZE - event_purged) > 0) {
+		event_purged = head - EVENTQ_SIZE;
+	}
+	while ((int) (oldest - event_purged) > 0) {
+		struct eventq_slot *slot = &event_ring[event_purged & (EVENTQ_SIZE - 1)];
+		struct eventqent *ev = NULL;
+
+		ast_spinlock_lock(&slot->lock);
+		if (slot->event && slot->event->seq == event_purged) {
+			ev = slot->event;
+			slot->event = NULL;
+		}
+		ast_spinlock_unlock(&slot->lock);
+		ao2_cleanup(ev);
+		event_purged++;
+	}
+}
+
 /*! \brief cleanup code called at each iteration of server_root,
  * guaranteed to happen every 5 seconds at most
  */
@@ -8190,6 +9244,35 @@ static int ast_xml_doc_item_cmp_fn(const void *a, const void *b)
 	return strcmp((*item_a)->name, (*item_b)->name);
 }
 
+/*!
+ * \internal
+ * \brief Get the manager event documentation, building it if it is lazy.
+ *
+ * \retval NULL if there is no event documentation.
+ * \return The container of event documentation, with a reference.
+ */
+static struct ao2_container *event_docs_ref(void)
+{
+	struct ao2_container *events;
+
+	events = ao2_global_obj_ref(event_docs);
+	if (events || !ast_xmldoc_lazy()) {
+		return events;
+	}
+
+	ast_mutex_lock(&event_docs_lock);
+	events = ao2_global_obj_ref(event_docs);
+	if (!events) {
+		events = ast_xmldoc_build_documentation("managerEvent");
+		if (events) {
+			ao2_global_obj_replace_unref(event_docs, events);
+		}
+	}
+	ast_mutex_unlock(&event_docs_lock);
+
+	return events;
+}
+
 static char *handle_manager_show_events(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct ao2_container *events;
@@ -8218,7 +9301,7 @@ static char *handle_manager_show_events(struct ast_cli_entry *e, int cmd, struct
 		return CLI_SUCCESS;
 	}
 
-	events = ao2_global_obj_ref(event_docs);
+	events = event_docs_ref();
 	if (!events) {
 		ast_cli(a->fd, "No manager event documentation loaded\n");
 		ast_free(buffer);
@@ -8325,7 +9408,7 @@ static char *handle_manager_show_event(struct ast_cli_entry *e, int cmd, struct
 		return NULL;
 	}
 
-	events = ao2_global_obj_ref(event_docs);
+	events = event_docs_ref();
 	if (!events) {
 		ast_cli(a->fd, "No manager event documentation loaded\n");
 		return CLI_SUCCESS;
@@ -8427,6 +9510,18 @@ static void manager_free_user(struct ast_manager_user *user)
 	ast_free(user);
 }
 
+static void manager_metrics_collect(struct ast_metrics_output *out)
+{
+	struct ao2_container *sessions;
+
+	ast_metrics_output_family(out, "asterisk_ami_sessions", AST_METRIC_GAUGE,
+		"AMI sessions, over TCP and HTTP");
+	sessions = ao2_global_obj_ref(mgr_sessions);
+	ast_metrics_output_sample(out, "asterisk_ami_sessions", NULL, NULL,
+		sessions ? ao2_container_count(sessions) : 0);
+	ao2_cleanup(sessions);
+}
+
 /*!
  * \internal
  * \brief Clean up resources on Asterisk shutdown
@@ -8452,9 +9547,11 @@ static void manager_shutdown(void)
 	ast_manager_unregister("UpdateConfig");
 	ast_manager_unregister("CreateConfig");
 	ast_manager_unregister("ListCategories");
+	ast_manager_unregister("RealtimeCacheFlush");
 	ast_manager_unregister("Redirect");
 	ast_manager_unregister("Atxfer");
 	ast_manager_unregister("Originate");
+	ast_manager_unregister("BulkOriginate");
 	ast_manager_unregister("Command");
 	ast_manager_unregister("ExtensionState");
 	ast_manager_unregister("PresenceState");
@@ -8502,6 +9599,16 @@ static void manager_shutdown(void)
 	ast_tcptls_server_stop(&ami_desc);
 	ast_tcptls_server_stop(&amis_desc);
 
+	action_threads = 0;
+	if (action_pool) {
+		ast_threadpool_shutdown(action_pool);
+		action_pool = NULL;
+	}
+	if (originate_pool) {
+		ast_threadpool_shutdown(originate_pool);
+		originate_pool = NULL;
+	}
+
 	ast_free(ami_tls_cfg.certfile);
 	ami_tls_cfg.certfile = NULL;
 	ast_free(ami_tls_cfg.pvtfile);
@@ -8509,6 +9616,7 @@ static void manager_shutdown(void)
 	ast_free(ami_tls_cfg.cipher);
 	ami_tls_cfg.cipher = NULL;
 
+	ast_metrics_collector_unregister(manager_metrics_collect);
 	ao2_global_obj_release(mgr_sessions);
 
 	while ((user = AST_LIST_REMOVE_HEAD(&users, list))) {
@@ -8540,8 +9648,9 @@ static int manager_subscriptions_init(void)
 		return -1;
 	}
 
-	res |= stasis_message_router_set_default(stasis_router,
-		manager_default_msg_cb, NULL);
+	/* The default route only renders messages with an AMI representation */
+	res |= stasis_message_router_set_formatters_default(stasis_router,
+		manager_default_msg_cb, NULL, STASIS_SUBSCRIPTION_FORMATTER_AMI);
 
 	res |= stasis_message_router_add(stasis_router,
 		ast_manager_get_generic_type(), manager_generic_msg_cb, NULL);
@@ -8590,6 +9699,9 @@ static void manager_set_defaults(void)
 	authtimeout = 30;
 	authlimit = 50;
 	manager_debug = 0;		/* Debug disabled by default */
+	eventq_overflow = EVENTQ_OVERFLOW_DROP;
+	action_threads = 0;
+	originate_threads = 0;
 
 	/* default values */
 	ast_copy_string(global_realm, S_OR(ast_config_AST_SYSTEM_NAME, DEFAULT_REALM),
@@ -8628,6 +9740,7 @@ static int __init_manager(int reload, int by_external_config)
 		struct ao2_container *temp_event_docs;
 #endif
 		int res;
+		int x;
 
 		ast_register_cleanup(manager_shutdown);
 
@@ -8655,9 +9768,11 @@ static int __init_manager(int reload, int by_external_config)
 		ast_manager_register_xml_core("UpdateConfig", EVENT_FLAG_CONFIG, action_updateconfig);
 		ast_manager_register_xml_core("CreateConfig", EVENT_FLAG_CONFIG, action_createconfig);
 		ast_manager_register_xml_core("ListCategories", EVENT_FLAG_CONFIG, action_listcategories);
+		ast_manager_register_xml_core("RealtimeCacheFlush", EVENT_FLAG_SYSTEM | EVENT_FLAG_CONFIG, action_realtimecacheflush);
 		ast_manager_register_xml_core("Redirect", EVENT_FLAG_CALL, action_redirect);
 		ast_manager_register_xml_core("Atxfer", EVENT_FLAG_CALL, action_atxfer);
 		ast_manager_register_xml_core("Originate", EVENT_FLAG_ORIGINATE, action_originate);
+		ast_manager_register_xml_core("BulkOriginate", EVENT_FLAG_ORIGINATE, action_bulkoriginate);
 		ast_manager_register_xml_core("Command", EVENT_FLAG_COMMAND, action_command);
 		ast_manager_register_xml_core("ExtensionState", EVENT_FLAG_CALL | EVENT_FLAG_REPORTING, action_extensionstate);
 		ast_manager_register_xml_core("PresenceState", EVENT_FLAG_CALL | EVENT_FLAG_REPORTING, action_presencestate);
@@ -8687,13 +9802,20 @@ static int __init_manager(int reload, int by_external_config)
 		__ast_custom_function_register(&managerclient_function, NULL);
 		ast_extension_state_add(NULL, NULL, manager_state_cb, NULL);
 
-		/* Append placeholder event so master_eventq never runs dry */
-		if (append_event("Event: Placeholder\r\n\r\n", 0)) {
+		for (x = 0; x < EVENTQ_SIZE; x++) {
+			ast_spinlock_init(&event_ring[x].lock);
+		}
+		event_ring_ready = 1;
+
+		event_filter_sets = ao2_container_alloc(EVENT_FILTER_SET_BUCKETS,
+			event_filter_set_hash_fn, event_filter_set_cmp_fn);
+		if (!event_filter_sets) {
 			return -1;
 		}
 
 #ifdef AST_XML_DOCS
-		temp_event_docs = ast_xmldoc_build_documentation("managerEvent");
+		/* Lazy event documentation is built by the first 'manager show event' */
+		temp_event_docs = ast_xmldoc_lazy() ? NULL : ast_xmldoc_build_documentation("managerEvent");
 		if (temp_event_docs) {
 			ao2_t_global_obj_replace_unref(event_docs, temp_event_docs, "Toss old event docs");
 			ao2_t_ref(temp_event_docs, -1, "Remove creation ref - container holds only ref now");
@@ -8707,6 +9829,7 @@ static int __init_manager(int reload, int by_external_config)
 		}
 		ao2_global_obj_replace_unref(mgr_sessions, sessions);
 		ao2_ref(sessions, -1);
+		ast_metrics_collector_register("manager", manager_metrics_collect);
 
 		/* Initialize all settings before first configuration load. */
 		manager_set_defaults();
@@ -8786,6 +9909,24 @@ static int __init_manager(int reload, int by_external_config)
 			manager_debug = ast_true(val);
 		} else if (!strcasecmp(var->name, "httptimeout")) {
 			newhttptimeout = atoi(val);
+		} else if (!strcasecmp(var->name, "eventqueueoverflow")) {
+			if (!strcasecmp(val, "drop")) {
+				eventq_overflow = EVENTQ_OVERFLOW_DROP;
+			} else if (!strcasecmp(val, "disconnect")) {
+				eventq_overflow = EVENTQ_OVERFLOW_DISCONNECT;
+			} else {
+				ast_log(LOG_WARNING, "Invalid eventqueueoverflow value '%s', using 'drop'\n", val);
+			}
+		} else if (!strcasecmp(var->name, "actionthreads")) {
+			if (sscanf(val, "%30d", &action_threads) != 1 || action_threads < 0) {
+				ast_log(LOG_WARNING, "Invalid actionthreads value '%s', running actions on the session threads\n", val);
+				action_threads = 0;
+			}
+		} else if (!strcasecmp(var->name, "originatethreads")) {
+			if (sscanf(val, "%30d", &originate_threads) != 1 || originate_threads < 0) {
+				ast_log(LOG_WARNING, "Invalid originatethreads value '%s', using no limit\n", val);
+				originate_threads = 0;
+			}
 		} else if (!strcasecmp(var->name, "authtimeout")) {
 			int timeout = atoi(var->value);
 
@@ -8810,6 +9951,43 @@ static int __init_manager(int reload, int by_external_config)
 		}
 	}
 
+	if (action_threads && !action_pool) {
+		struct ast_threadpool_options options = {
+			.version = AST_THREADPOOL_OPTIONS_VERSION,
+			.idle_timeout = 0,
+			.auto_increment = 0,
+			.initial_size = action_threads,
+			.max_size = 0,
+		};
+
+		if (!(action_pool = ast_threadpool_create("manager-actions", NULL, &options))) {
+			ast_log(LOG_WARNING, "Failed to start the action threads, running actions on the session threads\n");
+			action_threads = 0;
+		}
+	} else if (action_threads) {
+		ast_threadpool_set_size(action_pool, action_threads);
+	}
+	/* Once started the threads are kept, to run the actions already queued */
+
+	if (!originate_pool) {
+		/* Threads are started as originates need them and stop when idle */
+		struct ast_threadpool_options options = {
+			.version = AST_THREADPOOL_OPTIONS_VERSION,
+			.idle_timeout = 60,
+			.auto_increment = 1,
+			.initial_size = 0,
+			.max_size = originate_threads,
+		};
+
+		if (!(originate_pool = ast_threadpool_create("manager-originate", NULL, &options))) {
+			ast_log(LOG_ERROR, "Failed to start the originate threads\n");
+			return -1;
+		}
+		originate_pool_size = originate_threads;
+	} else if (originate_threads != originate_pool_size) {
+		ast_log(LOG_NOTICE, "Changing originatethreads requires a restart\n");
+	}
+
 	if (manager_enabled && !subscribed) {
 		if (subscribe_all() != 0) {
 			ast_log(LOG_ERROR, "Manager subscription error\n");
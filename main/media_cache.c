@@ -28,6 +28,26 @@
 	<support_level>core</support_level>
  ***/
 
+/*** DOCUMENTATION
+	<manager name="MediaCachePrefetch" language="en_US">
+		<synopsis>
+			Fetch an item into the media cache.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="URI" required="true">
+				<para>The URI of the media to fetch.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Queues the media at the URI to be fetched into the media cache in
+			the background, unless a fresh copy is already there, so that the first
+			caller to play it does not wait for it to be fetched. The response only
+			says the fetch was queued.</para>
+		</description>
+	</manager>
+ ***/
+
 #include "asterisk.h"
 
 ASTERISK_REGISTER_FILE()
@@ -37,7 +57,12 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/bucket.h"
 #include "asterisk/astdb.h"
 #include "asterisk/cli.h"
+#include "asterisk/dlinkedlists.h"
+#include "asterisk/manager.h"
 #include "asterisk/media_cache.h"
+#include "asterisk/sched.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/vector.h"
 
 /*! The name of the AstDB family holding items in the cache. */
 #define AST_DB_FAMILY "MediaCache"
@@ -106,6 +131,153 @@ static int media_cache_cmp(void *obj, void *arg, int flags)
 	return cmp ? 0 : CMP_MATCH | CMP_STOP;
 }
 
+/*!
+ * \brief How recently an item fetched into the cache was used, and its size
+ *
+ * Only items the cache fetched from a backend are kept here; they are the
+ * ones whose files the cache owns, and so the ones evicted when the cache
+ * grows beyond the limits set in asterisk.conf. Items created from local
+ * files are never evicted.
+ */
+struct media_cache_usage {
+	AST_DLLIST_ENTRY(media_cache_usage) list;
+	/*! The size of the file */
+	off_t size;
+	/*! Retrievals since the last refresh */
+	unsigned int hits;
+	char uri[0];
+};
+
+/*! Usage of fetched items, by URI. Protected by the media_cache lock. */
+static struct ao2_container *media_cache_usages;
+
+/*! Fetched items, most recently used first. Protected by the media_cache lock. */
+static AST_DLLIST_HEAD_NOLOCK(, media_cache_usage) media_cache_lru;
+
+/*! Bytes of fetched items. Protected by the media_cache lock. */
+static off_t media_cache_bytes;
+
+/*! Bytes of fetched items kept, from asterisk.conf; 0 for no limit */
+static off_t media_cache_max_bytes;
+
+/*! Fetched items kept, from asterisk.conf; 0 for no limit */
+static int media_cache_max_items;
+
+/*! Seconds between refreshes of items used since the last, from asterisk.conf; 0 disables them */
+static int media_cache_refresh_interval;
+
+/*! Fetches items in the background, for prefetching and refreshing */
+static struct ast_taskprocessor *media_cache_tps;
+
+/*! Schedules refreshes */
+static struct ast_sched_context *media_cache_sched;
+
+/*! The metadata marking an item as fetched by the cache, holding when */
+#define MEDIA_CACHE_FETCHED "fetched"
+
+/*! \brief Whether the cache fetched an item from a backend, so owns its file */
+static int media_cache_is_fetched(struct ast_bucket_file *bucket_file)
+{
+	struct ast_bucket_metadata *metadata;
+
+	metadata = ast_bucket_file_metadata_get(bucket_file, MEDIA_CACHE_FETCHED);
+	ao2_cleanup(metadata);
+
+	return metadata != NULL;
+}
+
+static int media_cache_usage_hash(const void *obj, const int flags)
+{
+	const struct media_cache_usage *usage = obj;
+
+	return ast_str_hash(flags & OBJ_KEY ? obj : usage->uri);
+}
+
+static int media_cache_usage_cmp(void *obj, void *arg, int flags)
+{
+	struct media_cache_usage *usage = obj;
+	struct media_cache_usage *other = arg;
+
+	return !strcmp(usage->uri, flags & OBJ_KEY ? arg : other->uri) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+/*!
+ * \internal
+ * \brief Note that an item was retrieved from the cache
+ * \note Must be called with the media_cache locked
+ */
+static void media_cache_usage_touch(const char *uri)
+{
+	struct media_cache_usage *usage;
+
+	usage = ao2_find(media_cache_usages, uri, OBJ_KEY | OBJ_NOLOCK);
+	if (!usage) {
+		return;
+	}
+	usage->hits++;
+	if (AST_DLLIST_FIRST(&media_cache_lru) != usage) {
+		AST_DLLIST_REMOVE(&media_cache_lru, usage, list);
+		AST_DLLIST_INSERT_HEAD(&media_cache_lru, usage, list);
+	}
+	ao2_ref(usage, -1);
+}
+
+/*!
+ * \internal
+ * \brief Stop tracking an item
+ * \note Must be called with the media_cache locked
+ */
+static void media_cache_usage_forget(const char *uri)
+{
+	struct media_cache_usage *usage;
+
+	usage = ao2_find(media_cache_usages, uri, OBJ_KEY | OBJ_UNLINK | OBJ_NOLOCK);
+	if (!usage) {
+		return;
+	}
+	AST_DLLIST_REMOVE(&media_cache_lru, usage, list);
+	media_cache_bytes -= usage->size;
+	ao2_ref(usage, -1);
+}
+
+/*!
+ * \internal
+ * \brief Start tracking an item fetched into the cache, as the most recently used
+ * \note Must be called with the media_cache locked
+ */
+static void media_cache_usage_add(struct ast_bucket_file *bucket_file)
+{
+	const char *uri = ast_sorcery_object_get_id(bucket_file);
+	struct media_cache_usage *usage;
+	struct stat st;
+
+	media_cache_usage_forget(uri);
+
+	usage = ao2_alloc_options(sizeof(*usage) + strlen(uri) + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!usage) {
+		return;
+	}
+	strcpy(usage->uri, uri); /* Safe */
+	if (!stat(bucket_file->path, &st)) {
+		usage->size = st.st_size;
+	}
+	media_cache_bytes += usage->size;
+	ao2_link_flags(media_cache_usages, usage, OBJ_NOLOCK);
+	AST_DLLIST_INSERT_HEAD(&media_cache_lru, usage, list);
+	ao2_ref(usage, -1);
+}
+
+/*!
+ * \internal
+ * \brief Whether the fetched items are more than the cache may keep
+ * \note Must be called with the media_cache locked
+ */
+static int media_cache_over_limit(void)
+{
+	return (media_cache_max_bytes && media_cache_bytes > media_cache_max_bytes)
+		|| (media_cache_max_items && ao2_container_count(media_cache_usages) > media_cache_max_items);
+}
+
 
 int ast_media_cache_exists(const char *uri)
 {
@@ -202,10 +374,53 @@ static void bucket_file_update_path(struct ast_bucket_file *bucket_file,
 		sizeof(bucket_file->path));
 }
 
+/*!
+ * \internal
+ * \brief Remove a fetched item and its file, as the least recently used
+ * \note Must be called with the media_cache locked
+ */
+static void media_cache_evict_item(const char *uri)
+{
+	struct ast_bucket_file *bucket_file;
+
+	bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NOLOCK);
+	if (bucket_file) {
+		ast_debug(3, "Evicting '%s' from the media cache\n", uri);
+		unlink(bucket_file->path);
+		media_cache_item_del_from_astdb(bucket_file);
+		ao2_ref(bucket_file, -1);
+	}
+	media_cache_usage_forget(uri);
+}
+
+/*!
+ * \internal
+ * \brief Evict the least recently used fetched items beyond the limits
+ * \param keep An item that is not evicted, as it was just fetched
+ * \note Must be called with the media_cache locked
+ */
+static void media_cache_evict(const char *keep)
+{
+	struct media_cache_usage *usage;
+
+	AST_DLLIST_TRAVERSE_BACKWARDS_SAFE_BEGIN(&media_cache_lru, usage, list) {
+		if (!media_cache_over_limit()) {
+			break;
+		}
+		if (!strcmp(usage->uri, keep)) {
+			continue;
+		}
+		media_cache_evict_item(usage->uri);
+	}
+	AST_DLLIST_TRAVERSE_BACKWARDS_SAFE_END;
+}
+
 int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	char *file_path, size_t len)
 {
 	struct ast_bucket_file *bucket_file;
+	struct ast_bucket_file *stale;
+	char fetched[32];
 	SCOPED_AO2LOCK(media_lock, media_cache);
 
 	if (ast_strlen_zero(uri)) {
@@ -216,16 +431,16 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	 * matching the requested URI, ask the appropriate backend if it is
 	 * stale. If not; return it.
 	 */
-	bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_NOLOCK);
-	if (bucket_file) {
-		if (!ast_bucket_file_is_stale(bucket_file)) {
-			ast_copy_string(file_path, bucket_file->path, len);
-			ao2_ref(bucket_file, -1);
+	stale = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (stale) {
+		if (!ast_bucket_file_is_stale(stale)) {
+			ast_copy_string(file_path, stale->path, len);
+			media_cache_usage_touch(uri);
+			ao2_ref(stale, -1);
 			return 0;
 		}
 
-		/* Stale! Drop the ref, as we're going to retrieve it next. */
-		ao2_ref(bucket_file, -1);
+		/* Stale! Keep the ref, to replace it with what we retrieve next. */
 	}
 
 	/* Either this is new or the resource is stale; do a full retrieve
@@ -234,6 +449,7 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	bucket_file = ast_bucket_file_retrieve(uri);
 	if (!bucket_file) {
 		ast_log(LOG_WARNING, "Failed to obtain media at '%s'\n", uri);
+		ao2_cleanup(stale);
 		return -1;
 	}
 
@@ -241,9 +457,24 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	 * let anyone know of its existence yet
 	 */
 	bucket_file_update_path(bucket_file, preferred_file_name);
+	snprintf(fetched, sizeof(fetched), "%ld", (long) time(NULL));
+	ast_bucket_file_metadata_set(bucket_file, MEDIA_CACHE_FETCHED, fetched);
+
+	if (stale) {
+		/* The file of a stale item the cache fetched is its own to remove */
+		ao2_unlink_flags(media_cache, stale, OBJ_NOLOCK);
+		if (media_cache_is_fetched(stale) && strcmp(stale->path, bucket_file->path)) {
+			unlink(stale->path);
+		}
+		media_cache_item_del_from_astdb(stale);
+		ao2_ref(stale, -1);
+	}
+
 	media_cache_item_sync_to_astdb(bucket_file);
 	ast_copy_string(file_path, bucket_file->path, len);
 	ao2_link_flags(media_cache, bucket_file, OBJ_NOLOCK);
+	media_cache_usage_add(bucket_file);
+	media_cache_evict(uri);
 	ao2_ref(bucket_file, -1);
 
 	return 0;
@@ -311,6 +542,7 @@ int ast_media_cache_create_or_update(const char *uri, const char *file_path,
 
 		/* Remove the old bucket_file. We'll replace it if we succeed below. */
 		ao2_unlink_flags(media_cache, bucket_file, OBJ_NOLOCK);
+		media_cache_usage_forget(uri);
 		ao2_ref(bucket_file, -1);
 
 		bucket_file = clone;
@@ -339,6 +571,9 @@ int ast_media_cache_create_or_update(const char *uri, const char *file_path,
 		ast_bucket_file_metadata_set(bucket_file, "ext", ext + 1);
 	}
 
+	/* The file is the caller's, so the cache neither evicts nor removes it */
+	ast_bucket_file_metadata_unset(bucket_file, MEDIA_CACHE_FETCHED);
+
 	for (it_metadata = metadata; it_metadata; it_metadata = it_metadata->next) {
 		ast_bucket_file_metadata_set(bucket_file, it_metadata->name, it_metadata->value);
 	}
@@ -364,7 +599,10 @@ int ast_media_cache_delete(const char *uri)
 		return -1;
 	}
 
-	bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	ao2_lock(media_cache);
+	bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NOLOCK);
+	media_cache_usage_forget(uri);
+	ao2_unlock(media_cache);
 	if (!bucket_file) {
 		return -1;
 	}
@@ -441,7 +679,13 @@ static int media_cache_item_populate_from_astdb(const char *uri, const char *has
 		return -1;
 	}
 
-	ao2_link(media_cache, bucket_file);
+	ao2_lock(media_cache);
+	ao2_link_flags(media_cache, bucket_file, OBJ_NOLOCK);
+	if (media_cache_is_fetched(bucket_file)) {
+		/* Restored in the order stored, so none is more recently used */
+		media_cache_usage_add(bucket_file);
+	}
+	ao2_unlock(media_cache);
 	ao2_ref(bucket_file, -1);
 
 	return 0;
@@ -463,6 +707,93 @@ static void media_cache_populate_from_astdb(void)
 		}
 	}
 	ast_db_freetree(db_tree);
+
+	ao2_lock(media_cache);
+	media_cache_evict("");
+	ao2_unlock(media_cache);
+}
+
+/*!
+ * \internal
+ * \brief Fetch an item into the cache in the background
+ */
+static int media_cache_fetch_task(void *data)
+{
+	char *uri = data;
+	char file_path[PATH_MAX];
+
+	if (!ast_media_cache_retrieve(uri, NULL, file_path, sizeof(file_path))) {
+		ast_debug(3, "Fetched '%s' into the media cache at '%s'\n", uri, file_path);
+	}
+	ast_free(uri);
+
+	return 0;
+}
+
+int ast_media_cache_prefetch(const char *uri)
+{
+	char *task_uri;
+
+	if (ast_strlen_zero(uri) || !media_cache_tps) {
+		return -1;
+	}
+
+	task_uri = ast_strdup(uri);
+	if (!task_uri || ast_taskprocessor_push(media_cache_tps, media_cache_fetch_task, task_uri)) {
+		ast_free(task_uri);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Fetch again the items used since the last refresh that have gone stale
+ *
+ * Items in use are fetched again in the background, so a caller retrieving
+ * one does not wait for it to be fetched. Items not used since the last
+ * refresh are left to be fetched when next retrieved, or evicted.
+ */
+static int media_cache_refresh(const void *data)
+{
+	struct media_cache_usage *usage;
+	struct ast_bucket_file *bucket_file;
+	AST_VECTOR(, char *) hot;
+	int i;
+
+	if (AST_VECTOR_INIT(&hot, 16)) {
+		return media_cache_refresh_interval * 1000;
+	}
+
+	ao2_lock(media_cache);
+	AST_DLLIST_TRAVERSE(&media_cache_lru, usage, list) {
+		char *uri;
+
+		if (!usage->hits) {
+			continue;
+		}
+		usage->hits = 0;
+		if ((uri = ast_strdup(usage->uri)) && AST_VECTOR_APPEND(&hot, uri)) {
+			ast_free(uri);
+		}
+	}
+	ao2_unlock(media_cache);
+
+	for (i = 0; i < AST_VECTOR_SIZE(&hot); i++) {
+		char *uri = AST_VECTOR_GET(&hot, i);
+
+		bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY);
+		if (bucket_file && ast_bucket_file_is_stale(bucket_file)) {
+			ast_debug(3, "Refreshing '%s' in the media cache\n", uri);
+			ast_media_cache_prefetch(uri);
+		}
+		ao2_cleanup(bucket_file);
+		ast_free(uri);
+	}
+	AST_VECTOR_FREE(&hot);
+
+	return media_cache_refresh_interval * 1000;
 }
 
 /*!
@@ -676,16 +1007,82 @@ static struct ast_cli_entry cli_media_cache[] = {
 	AST_CLI_DEFINE(media_cache_handle_create_item, "Create an item in the media cache"),
 };
 
+static int manager_media_cache_prefetch(struct mansession *s, const struct message *m)
+{
+	const char *uri = astman_get_header(m, "URI");
+
+	if (ast_strlen_zero(uri)) {
+		astman_send_error(s, m, "URI must be provided");
+		return 0;
+	}
+
+	if (ast_media_cache_prefetch(uri)) {
+		astman_send_error(s, m, "Unable to queue the fetch");
+		return 0;
+	}
+
+	astman_send_ack(s, m, "Fetch queued");
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Load the limits of the media cache from asterisk.conf
+ */
+static void media_cache_load_limits(void)
+{
+	struct ast_flags config_flags = { 0 };
+	struct ast_config *cfg;
+	const char *value;
+	int megabytes = 0;
+
+	cfg = ast_config_load2("asterisk.conf", "" /* core can't reload */, config_flags);
+	if (!cfg || cfg == CONFIG_STATUS_FILEINVALID) {
+		return;
+	}
+
+	if ((value = ast_variable_retrieve(cfg, "options", "media_cache_size"))
+		&& (sscanf(value, "%30d", &megabytes) != 1 || megabytes < 0)) {
+		ast_log(LOG_WARNING, "Invalid media_cache_size '%s', not limiting the media cache size\n", value);
+		megabytes = 0;
+	}
+	media_cache_max_bytes = (off_t) megabytes * 1024 * 1024;
+
+	if ((value = ast_variable_retrieve(cfg, "options", "media_cache_items"))
+		&& (sscanf(value, "%30d", &media_cache_max_items) != 1 || media_cache_max_items < 0)) {
+		ast_log(LOG_WARNING, "Invalid media_cache_items '%s', not limiting the media cache items\n", value);
+		media_cache_max_items = 0;
+	}
+
+	if ((value = ast_variable_retrieve(cfg, "options", "media_cache_refresh"))
+		&& (sscanf(value, "%30d", &media_cache_refresh_interval) != 1 || media_cache_refresh_interval < 0)) {
+		ast_log(LOG_WARNING, "Invalid media_cache_refresh '%s', not refreshing the media cache\n", value);
+		media_cache_refresh_interval = 0;
+	}
+
+	ast_config_destroy(cfg);
+}
+
 /*!
  * \internal
  * \brief Shutdown the media cache
  */
 static void media_cache_shutdown(void)
 {
+	ast_manager_unregister("MediaCachePrefetch");
+	ast_cli_unregister_multiple(cli_media_cache, ARRAY_LEN(cli_media_cache));
+
+	if (media_cache_sched) {
+		ast_sched_context_destroy(media_cache_sched);
+		media_cache_sched = NULL;
+	}
+	media_cache_tps = ast_taskprocessor_unreference(media_cache_tps);
+
 	ao2_ref(media_cache, -1);
 	media_cache = NULL;
 
-	ast_cli_unregister_multiple(cli_media_cache, ARRAY_LEN(cli_media_cache));
+	ao2_cleanup(media_cache_usages);
+	media_cache_usages = NULL;
 }
 
 int ast_media_cache_init(void)
@@ -698,8 +1095,32 @@ int ast_media_cache_init(void)
 		return -1;
 	}
 
+	media_cache_usages = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, AO2_BUCKETS,
+		media_cache_usage_hash, media_cache_usage_cmp);
+	if (!media_cache_usages) {
+		return -1;
+	}
+
+	media_cache_tps = ast_taskprocessor_get("media_cache_fetch", TPS_REF_DEFAULT);
+	if (!media_cache_tps) {
+		return -1;
+	}
+
+	media_cache_load_limits();
+	if (media_cache_refresh_interval) {
+		if (!(media_cache_sched = ast_sched_context_create())
+			|| ast_sched_start_thread(media_cache_sched)
+			|| ast_sched_add(media_cache_sched, media_cache_refresh_interval * 1000,
+				media_cache_refresh, NULL) < 0) {
+			ast_log(LOG_WARNING, "Unable to schedule media cache refreshes\n");
+		}
+	}
+
 	if (ast_cli_register_multiple(cli_media_cache, ARRAY_LEN(cli_media_cache))) {
-		ao2_ref(media_cache, -1);
+		return -1;
+	}
+
+	if (ast_manager_register_xml_core("MediaCachePrefetch", EVENT_FLAG_SYSTEM, manager_media_cache_prefetch)) {
 		return -1;
 	}
 
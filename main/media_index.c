@@ -516,15 +516,74 @@ static int process_file(struct ast_media_index *index, const char *variant_str,
 	return 0;
 }
 
+/*!
+ * \brief The magic first line of a media listing file
+ *
+ * A listing records what indexing a variant found, so that it can be indexed
+ * again without walking its directories. After this line, each line is one of:
+ *
+ * \li "D\t<mtime>\t<subdir>" for each directory, "" being the variant's own
+ * \li "T\t<mtime>\t<path>" for each description file
+ * \li "F\t<path>" for each other file with an extension
+ *
+ * Paths are relative to the variant's directory. All the files of the variant
+ * are listed, not just those with a registered format, so the listing stays
+ * good when formats are registered or unregistered. The listing is current as
+ * long as none of the directories or description files has been changed,
+ * since adding, removing or renaming a file changes its directory.
+ */
+#define MEDIA_LISTING_MAGIC "AstMediaIndex1"
+
+/*! \brief A media listing being written while a variant is indexed */
+struct media_listing {
+	FILE *f;		/*!< The listing, or NULL if none is being written */
+	time_t started;		/*!< When indexing started */
+	int failed;		/*!< Something could not be listed, so the listing must not be kept */
+};
+
+/*! \brief Write the modification time of a directory or description file to a listing */
+static void media_listing_stamp(struct media_listing *listing, char type, time_t mtime, const char *path)
+{
+	if (!listing->f) {
+		return;
+	}
+	if (strchr(path, '\n') || strchr(path, '\t')) {
+		listing->failed = 1;
+		return;
+	}
+	/* Something changed in the same second as the indexing may not be in the
+	 * index, and would not change the time, so such a stamp never matches */
+	fprintf(listing->f, "%c\t%ld\t%s\n", type, mtime >= listing->started ? -1L : (long) mtime, path);
+}
+
+/*! \brief Write a media file to a listing */
+static void media_listing_file(struct media_listing *listing, const char *subdir, const char *filename)
+{
+	if (!listing->f) {
+		return;
+	}
+	if (strchr(filename, '\n') || strchr(filename, '\t')) {
+		listing->failed = 1;
+		return;
+	}
+	if (ast_strlen_zero(subdir)) {
+		fprintf(listing->f, "F\t%s\n", filename);
+	} else {
+		fprintf(listing->f, "F\t%s/%s\n", subdir, filename);
+	}
+}
+
 /*! \brief internal function for updating the index, recursive */
 static int media_index_update(struct ast_media_index *index,
 	const char *variant,
-	const char *subdir)
+	const char *subdir,
+	struct media_listing *listing)
 {
 	struct dirent* dent;
 	DIR* srcdir;
 	RAII_VAR(struct ast_str *, index_dir, ast_str_create(64), ast_free);
 	RAII_VAR(struct ast_str *, statfile, ast_str_create(64), ast_free);
+	struct stat st;
 	int res = 0;
 
 	if (!index_dir) {
@@ -545,8 +604,16 @@ static int media_index_update(struct ast_media_index *index,
 		return -1;
 	}
 
+	if (listing->f) {
+		if (fstat(dirfd(srcdir), &st) < 0) {
+			listing->failed = 1;
+		} else {
+			media_listing_stamp(listing, 'D', st.st_mtime, S_OR(subdir, ""));
+		}
+	}
+
 	while((dent = readdir(srcdir)) != NULL) {
-		struct stat st;
+		int is_dir;
 
 		if(!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, "..")) {
 			continue;
@@ -555,18 +622,30 @@ static int media_index_update(struct ast_media_index *index,
 		ast_str_reset(statfile);
 		ast_str_set(&statfile, 0, "%s/%s", ast_str_buffer(index_dir), dent->d_name);
 
-		if (stat(ast_str_buffer(statfile), &st) < 0) {
-			ast_log(LOG_WARNING, "Failed to stat %s: %s\n", ast_str_buffer(statfile), strerror(errno));
-			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		/* Most file systems say what each entry is, so the files need not be stat'd */
+		if (dent->d_type == DT_DIR || dent->d_type == DT_REG) {
+			is_dir = dent->d_type == DT_DIR;
+		} else
+#endif
+		{
+			if (stat(ast_str_buffer(statfile), &st) < 0) {
+				ast_log(LOG_WARNING, "Failed to stat %s: %s\n", ast_str_buffer(statfile), strerror(errno));
+				continue;
+			}
+			if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+				continue;
+			}
+			is_dir = S_ISDIR(st.st_mode);
 		}
 
-		if (S_ISDIR(st.st_mode)) {
+		if (is_dir) {
 			if (ast_strlen_zero(subdir)) {
-				res = media_index_update(index, variant, dent->d_name);
+				res = media_index_update(index, variant, dent->d_name, listing);
 			} else {
 				RAII_VAR(struct ast_str *, new_subdir, ast_str_create(64), ast_free);
 				ast_str_set(&new_subdir, 0, "%s/%s", subdir, dent->d_name);
-				res = media_index_update(index, variant, ast_str_buffer(new_subdir));
+				res = media_index_update(index, variant, ast_str_buffer(new_subdir), listing);
 			}
 
 			if (res) {
@@ -575,8 +654,22 @@ static int media_index_update(struct ast_media_index *index,
 			continue;
 		}
 
-		if (!S_ISREG(st.st_mode)) {
-			continue;
+		if (listing->f) {
+			const char *ext = strrchr(dent->d_name, '.');
+
+			if (ext && !strcmp(ext, ".txt")) {
+				if (stat(ast_str_buffer(statfile), &st) < 0) {
+					listing->failed = 1;
+				} else if (ast_strlen_zero(subdir)) {
+					media_listing_stamp(listing, 'T', st.st_mtime, dent->d_name);
+				} else {
+					RAII_VAR(struct ast_str *, path, ast_str_create(64), ast_free);
+					ast_str_set(&path, 0, "%s/%s", subdir, dent->d_name);
+					media_listing_stamp(listing, 'T', st.st_mtime, ast_str_buffer(path));
+				}
+			} else if (ext) {
+				media_listing_file(listing, subdir, dent->d_name);
+			}
 		}
 
 		if (process_file(index, variant, subdir, dent->d_name)) {
@@ -592,6 +685,139 @@ static int media_index_update(struct ast_media_index *index,
 int ast_media_index_update(struct ast_media_index *index,
 	const char *variant)
 {
-	return media_index_update(index, variant, NULL);
+	struct media_listing listing = { NULL, };
+
+	return media_index_update(index, variant, NULL, &listing);
+}
+
+/*!
+ * \brief Check that none of the directories or description files in a listing has changed
+ *
+ * \retval 1 if the listing is current
+ * \retval 0 if it is not, or is not a listing
+ */
+static int media_listing_current(struct ast_media_index *index, const char *variant, FILE *f)
+{
+	char buf[PATH_MAX + 32];
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (!fgets(buf, sizeof(buf), f) || strcmp(ast_trim_blanks(buf), MEDIA_LISTING_MAGIC)) {
+		return 0;
+	}
+
+	while (fgets(buf, sizeof(buf), f)) {
+		char *rel = buf;
+		char *type;
+		char *mtime;
+		long stamp;
+
+		rel[strcspn(rel, "\n")] = '\0';
+		type = strsep(&rel, "\t");
+		if (!strcmp(type, "F")) {
+			continue;
+		}
+		mtime = strsep(&rel, "\t");
+		if ((strcmp(type, "D") && strcmp(type, "T")) || !rel
+			|| sscanf(mtime, "%ld", &stamp) != 1 || stamp < 0) {
+			return 0;
+		}
+
+		if (ast_strlen_zero(rel)) {
+			snprintf(path, sizeof(path), "%s/%s", index->base_dir, variant);
+		} else {
+			snprintf(path, sizeof(path), "%s/%s/%s", index->base_dir, variant, rel);
+		}
+		if (stat(path, &st) < 0 || st.st_mtime != stamp) {
+			ast_debug(3, "Media listing of '%s' is out of date: '%s' has changed\n", variant, path);
+			return 0;
+		}
+	}
+
+	return !ferror(f);
+}
+
+/*! \brief Index the files in a current listing */
+static int media_listing_apply(struct ast_media_index *index, const char *variant, FILE *f)
+{
+	char buf[PATH_MAX + 32];
+
+	/* Skip the magic */
+	if (!fgets(buf, sizeof(buf), f)) {
+		return -1;
+	}
+
+	while (fgets(buf, sizeof(buf), f)) {
+		char *rel = buf;
+		char *type;
+		char *filename;
+
+		rel[strcspn(rel, "\n")] = '\0';
+		type = strsep(&rel, "\t");
+		if (!strcmp(type, "D")) {
+			continue;
+		} else if (!strcmp(type, "T")) {
+			strsep(&rel, "\t");
+		}
+		if (ast_strlen_zero(rel)) {
+			continue;
+		}
+
+		filename = strrchr(rel, '/');
+		if (filename) {
+			*filename++ = '\0';
+		} else {
+			filename = rel;
+			rel = NULL;
+		}
+		if (process_file(index, variant, rel, filename)) {
+			return -1;
+		}
+	}
+
+	return ferror(f) ? -1 : 0;
 }
 
+int ast_media_index_update_cached(struct ast_media_index *index,
+	const char *variant, const char *listing_file)
+{
+	struct media_listing listing = { NULL, };
+	char *tmp;
+	FILE *f;
+	int res;
+
+	f = fopen(listing_file, "r");
+	if (f) {
+		if (media_listing_current(index, variant, f)) {
+			rewind(f);
+			res = media_listing_apply(index, variant, f);
+			fclose(f);
+			if (!res) {
+				ast_debug(1, "Indexed media variant '%s' from %s\n", variant, listing_file);
+			}
+			return res;
+		}
+		fclose(f);
+	}
+
+	if (ast_asprintf(&tmp, "%s.new", listing_file) < 0) {
+		return -1;
+	}
+	listing.f = fopen(tmp, "w");
+	if (!listing.f) {
+		ast_log(LOG_WARNING, "Unable to write media listing %s: %s\n", tmp, strerror(errno));
+	} else {
+		fprintf(listing.f, "%s\n", MEDIA_LISTING_MAGIC);
+	}
+	listing.started = time(NULL);
+
+	res = media_index_update(index, variant, NULL, &listing);
+
+	if (listing.f) {
+		if (fclose(listing.f) || res || listing.failed || rename(tmp, listing_file)) {
+			unlink(tmp);
+		}
+	}
+	ast_free(tmp);
+	return res;
+}
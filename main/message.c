@@ -760,7 +760,8 @@ static void chan_cleanup(struct ast_channel *chan)
 	/*
 	 * Destroy all other datastores.
 	 */
-	while ((ds = AST_LIST_REMOVE_HEAD(ast_channel_datastores(chan), entry))) {
+	while ((ds = AST_LIST_FIRST(ast_channel_datastores(chan)))) {
+		ast_channel_datastore_remove(chan, ds);
 		ast_datastore_free(ds);
 	}
 
@@ -771,6 +772,7 @@ static void chan_cleanup(struct ast_channel *chan)
 	while ((vardata = AST_LIST_REMOVE_HEAD(headp, entries))) {
 		ast_var_delete(vardata);
 	}
+	ast_channel_varshead_changed(chan);
 
 	/*
 	 * Remove frames from read queue
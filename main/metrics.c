@@ -0,0 +1,441 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Metrics exported in the Prometheus text format
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/_private.h"
+#include "asterisk/cli.h"
+#include "asterisk/linkedlists.h"
+#include "asterisk/lock.h"
+#include "asterisk/metrics.h"
+#include "asterisk/strings.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+struct ast_metric {
+	enum ast_metric_type type;
+	/*! Value of a counter or a gauge */
+	int64_t value;
+	/*! Protects the observations of a histogram */
+	ast_mutex_t lock;
+	/*! Upper bounds of the buckets of a histogram but the last */
+	double *bounds;
+	/*! Observations in each bucket of a histogram, not cumulative */
+	uint64_t *buckets;
+	/*! Number of entries in bounds */
+	size_t num_bounds;
+	/*! Sum of the observations of a histogram */
+	double sum;
+	/*! Number of observations of a histogram */
+	uint64_t count;
+	const char *name;
+	const char *help;
+	AST_RWLIST_ENTRY(ast_metric) entry;
+	char data[0];
+};
+
+struct metrics_collector {
+	ast_metrics_collector_cb callback;
+	AST_RWLIST_ENTRY(metrics_collector) entry;
+	char name[0];
+};
+
+struct ast_metrics_output {
+	struct ast_str **buf;
+};
+
+/*! \brief Metrics holding their values, in the order they were created */
+static AST_RWLIST_HEAD_STATIC(metrics, ast_metric);
+
+/*! \brief Collectors, in the order they were registered */
+static AST_RWLIST_HEAD_STATIC(collectors, metrics_collector);
+
+static const char *metric_type_name(enum ast_metric_type type)
+{
+	switch (type) {
+	case AST_METRIC_COUNTER:
+		return "counter";
+	case AST_METRIC_GAUGE:
+		return "gauge";
+	case AST_METRIC_HISTOGRAM:
+		return "histogram";
+	}
+	return "untyped";
+}
+
+/*! \brief Whether a name is a valid metric name, [a-zA-Z_:][a-zA-Z0-9_:]* */
+static int metric_name_valid(const char *name)
+{
+	const char *c;
+
+	if (ast_strlen_zero(name) || isdigit(*name)) {
+		return 0;
+	}
+	for (c = name; *c; ++c) {
+		if (!isalnum(*c) && *c != '_' && *c != ':') {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*! \note Must be called with the metrics list locked */
+static struct ast_metric *metric_find(const char *name)
+{
+	struct ast_metric *metric;
+
+	AST_RWLIST_TRAVERSE(&metrics, metric, entry) {
+		if (!strcmp(metric->name, name)) {
+			return metric;
+		}
+	}
+	return NULL;
+}
+
+static void metric_free(struct ast_metric *metric)
+{
+	ast_mutex_destroy(&metric->lock);
+	ast_free(metric->bounds);
+	ast_free(metric->buckets);
+	ast_free(metric);
+}
+
+static struct ast_metric *metric_create(enum ast_metric_type type, const char *name,
+	const char *help, const double *bounds, size_t num_bounds)
+{
+	struct ast_metric *metric;
+	size_t name_len;
+	size_t i;
+
+	if (!metric_name_valid(name)) {
+		ast_log(LOG_ERROR, "Invalid metric name '%s'\n", S_OR(name, ""));
+		return NULL;
+	}
+	for (i = 1; i < num_bounds; ++i) {
+		if (bounds[i] <= bounds[i - 1]) {
+			ast_log(LOG_ERROR, "Bounds of histogram '%s' are not increasing\n", name);
+			return NULL;
+		}
+	}
+
+	name_len = strlen(name) + 1;
+	metric = ast_calloc(1, sizeof(*metric) + name_len + strlen(S_OR(help, "")) + 1);
+	if (!metric) {
+		return NULL;
+	}
+	metric->type = type;
+	metric->name = strcpy(metric->data, name); /* Safe */
+	metric->help = strcpy(metric->data + name_len, S_OR(help, "")); /* Safe */
+	ast_mutex_init(&metric->lock);
+
+	if (type == AST_METRIC_HISTOGRAM) {
+		metric->bounds = ast_malloc(num_bounds * sizeof(*metric->bounds));
+		metric->buckets = ast_calloc(num_bounds + 1, sizeof(*metric->buckets));
+		if ((num_bounds && !metric->bounds) || !metric->buckets) {
+			metric_free(metric);
+			return NULL;
+		}
+		if (num_bounds) {
+			memcpy(metric->bounds, bounds, num_bounds * sizeof(*metric->bounds));
+		}
+		metric->num_bounds = num_bounds;
+	}
+
+	AST_RWLIST_WRLOCK(&metrics);
+	if (metric_find(name)) {
+		AST_RWLIST_UNLOCK(&metrics);
+		ast_log(LOG_ERROR, "Metric '%s' already exists\n", name);
+		metric_free(metric);
+		return NULL;
+	}
+	AST_RWLIST_INSERT_TAIL(&metrics, metric, entry);
+	AST_RWLIST_UNLOCK(&metrics);
+
+	return metric;
+}
+
+struct ast_metric *ast_metric_counter_create(const char *name, const char *help)
+{
+	return metric_create(AST_METRIC_COUNTER, name, help, NULL, 0);
+}
+
+struct ast_metric *ast_metric_gauge_create(const char *name, const char *help)
+{
+	return metric_create(AST_METRIC_GAUGE, name, help, NULL, 0);
+}
+
+struct ast_metric *ast_metric_histogram_create(const char *name, const char *help,
+	const double *bounds, size_t num_bounds)
+{
+	return metric_create(AST_METRIC_HISTOGRAM, name, help, bounds, num_bounds);
+}
+
+void ast_metric_destroy(struct ast_metric *metric)
+{
+	if (!metric) {
+		return;
+	}
+
+	AST_RWLIST_WRLOCK(&metrics);
+	AST_RWLIST_REMOVE(&metrics, metric, entry);
+	AST_RWLIST_UNLOCK(&metrics);
+
+	metric_free(metric);
+}
+
+void ast_metric_add(struct ast_metric *metric, int64_t delta)
+{
+	if (metric) {
+		__sync_fetch_and_add(&metric->value, delta);
+	}
+}
+
+void ast_metric_set(struct ast_metric *metric, int64_t value)
+{
+	if (metric) {
+		metric->value = value;
+	}
+}
+
+void ast_metric_observe(struct ast_metric *metric, double value)
+{
+	size_t i;
+
+	if (!metric || metric->type != AST_METRIC_HISTOGRAM) {
+		return;
+	}
+
+	for (i = 0; i < metric->num_bounds; ++i) {
+		if (value <= metric->bounds[i]) {
+			break;
+		}
+	}
+
+	ast_mutex_lock(&metric->lock);
+	++metric->buckets[i];
+	++metric->count;
+	metric->sum += value;
+	ast_mutex_unlock(&metric->lock);
+}
+
+int ast_metrics_collector_register(const char *name, ast_metrics_collector_cb callback)
+{
+	struct metrics_collector *collector;
+
+	collector = ast_calloc(1, sizeof(*collector) + strlen(name) + 1);
+	if (!collector) {
+		return -1;
+	}
+	collector->callback = callback;
+	strcpy(collector->name, name); /* Safe */
+
+	AST_RWLIST_WRLOCK(&collectors);
+	AST_RWLIST_INSERT_TAIL(&collectors, collector, entry);
+	AST_RWLIST_UNLOCK(&collectors);
+
+	return 0;
+}
+
+void ast_metrics_collector_unregister(ast_metrics_collector_cb callback)
+{
+	struct metrics_collector *collector;
+
+	AST_RWLIST_WRLOCK(&collectors);
+	AST_RWLIST_TRAVERSE_SAFE_BEGIN(&collectors, collector, entry) {
+		if (collector->callback == callback) {
+			AST_RWLIST_REMOVE_CURRENT(entry);
+			ast_free(collector);
+			break;
+		}
+	}
+	AST_RWLIST_TRAVERSE_SAFE_END;
+	AST_RWLIST_UNLOCK(&collectors);
+}
+
+/*!
+ * \internal
+ * \brief Append a string, escaping backslashes, newlines and optionally double quotes
+ */
+static void metrics_append_escaped(struct ast_str **buf, const char *str, int quotes)
+{
+	const char *c;
+
+	if (!strpbrk(str, quotes ? "\\\n\"" : "\\\n")) {
+		ast_str_append(buf, 0, "%s", str);
+		return;
+	}
+
+	for (c = str; *c; ++c) {
+		if (*c == '\\') {
+			ast_str_append(buf, 0, "\\\\");
+		} else if (*c == '\n') {
+			ast_str_append(buf, 0, "\\n");
+		} else if (*c == '"' && quotes) {
+			ast_str_append(buf, 0, "\\\"");
+		} else {
+			ast_str_append(buf, 0, "%c", *c);
+		}
+	}
+}
+
+void ast_metrics_output_family(struct ast_metrics_output *out, const char *name,
+	enum ast_metric_type type, const char *help)
+{
+	ast_str_append(out->buf, 0, "# HELP %s ", name);
+	metrics_append_escaped(out->buf, S_OR(help, ""), 0);
+	ast_str_append(out->buf, 0, "\n# TYPE %s %s\n", name, metric_type_name(type));
+}
+
+void ast_metrics_output_sample(struct ast_metrics_output *out, const char *name,
+	const char *label, const char *label_value, double value)
+{
+	if (label) {
+		ast_str_append(out->buf, 0, "%s{%s=\"", name, label);
+		metrics_append_escaped(out->buf, S_OR(label_value, ""), 1);
+		ast_str_append(out->buf, 0, "\"} %.15g\n", value);
+	} else {
+		ast_str_append(out->buf, 0, "%s %.15g\n", name, value);
+	}
+}
+
+/*! \brief Render a metric holding its value */
+static void metric_render(struct ast_metrics_output *out, struct ast_metric *metric)
+{
+	uint64_t buckets[metric->num_bounds + 1];
+	uint64_t cumulative = 0;
+	uint64_t count;
+	double sum;
+	size_t i;
+
+	ast_metrics_output_family(out, metric->name, metric->type, metric->help);
+
+	if (metric->type != AST_METRIC_HISTOGRAM) {
+		ast_str_append(out->buf, 0, "%s %" PRId64 "\n", metric->name, metric->value);
+		return;
+	}
+
+	/* Copy the histogram so its lock is not held while appending */
+	ast_mutex_lock(&metric->lock);
+	memcpy(buckets, metric->buckets, sizeof(buckets));
+	sum = metric->sum;
+	count = metric->count;
+	ast_mutex_unlock(&metric->lock);
+
+	for (i = 0; i < metric->num_bounds; ++i) {
+		cumulative += buckets[i];
+		ast_str_append(out->buf, 0, "%s_bucket{le=\"%.15g\"} %" PRIu64 "\n",
+			metric->name, metric->bounds[i], cumulative);
+	}
+	ast_str_append(out->buf, 0, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", metric->name, count);
+	ast_str_append(out->buf, 0, "%s_sum %.15g\n", metric->name, sum);
+	ast_str_append(out->buf, 0, "%s_count %" PRIu64 "\n", metric->name, count);
+}
+
+void ast_metrics_render(struct ast_str **buf)
+{
+	struct ast_metrics_output out = { .buf = buf, };
+	struct ast_metric *metric;
+	struct metrics_collector *collector;
+
+	AST_RWLIST_RDLOCK(&metrics);
+	AST_RWLIST_TRAVERSE(&metrics, metric, entry) {
+		metric_render(&out, metric);
+	}
+	AST_RWLIST_UNLOCK(&metrics);
+
+	AST_RWLIST_RDLOCK(&collectors);
+	AST_RWLIST_TRAVERSE(&collectors, collector, entry) {
+		collector->callback(&out);
+	}
+	AST_RWLIST_UNLOCK(&collectors);
+}
+
+static char *handle_cli_metrics_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_metric *metric;
+	struct metrics_collector *collector;
+	struct ast_str *buf;
+	struct timeval start;
+	int64_t elapsed;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "metrics show";
+		e->usage =
+			"Usage: metrics show\n"
+			"       Lists the metrics and collectors, and how long rendering\n"
+			"       what the /metrics HTTP URI would return takes.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "%-40s %-10s\n", "Metric", "Type");
+	AST_RWLIST_RDLOCK(&metrics);
+	AST_RWLIST_TRAVERSE(&metrics, metric, entry) {
+		ast_cli(a->fd, "%-40s %-10s\n", metric->name, metric_type_name(metric->type));
+	}
+	AST_RWLIST_UNLOCK(&metrics);
+
+	ast_cli(a->fd, "\nCollectors:");
+	AST_RWLIST_RDLOCK(&collectors);
+	AST_RWLIST_TRAVERSE(&collectors, collector, entry) {
+		ast_cli(a->fd, " %s", collector->name);
+	}
+	AST_RWLIST_UNLOCK(&collectors);
+	ast_cli(a->fd, "\n");
+
+	if (!(buf = ast_str_create(4096))) {
+		return CLI_FAILURE;
+	}
+	start = ast_tvnow();
+	ast_metrics_render(&buf);
+	elapsed = ast_tvdiff_us(ast_tvnow(), start);
+	ast_cli(a->fd, "Rendered %zu bytes in %" PRId64 " us\n", ast_str_strlen(buf), elapsed);
+	ast_free(buf);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_metrics[] = {
+	AST_CLI_DEFINE(handle_cli_metrics_show, "Show the registered metrics"),
+};
+
+static void metrics_shutdown(void)
+{
+	ast_cli_unregister_multiple(cli_metrics, ARRAY_LEN(cli_metrics));
+}
+
+void ast_metrics_init(void)
+{
+	ast_cli_register_multiple(cli_metrics, ARRAY_LEN(cli_metrics));
+	ast_register_cleanup(metrics_shutdown);
+}
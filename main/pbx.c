@@ -47,6 +47,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/cli.h"
 #include "asterisk/pbx.h"
 #include "asterisk/channel.h"
+#include "asterisk/channel_internal.h"
 #include "asterisk/file.h"
 #include "asterisk/callerid.h"
 #include "asterisk/cdr.h"
@@ -64,15 +65,18 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/app.h"
 #include "asterisk/devicestate.h"
 #include "asterisk/presencestate.h"
+#include "asterisk/probes.h"
 #include "asterisk/hashtab.h"
 #include "asterisk/module.h"
 #include "asterisk/indications.h"
 #include "asterisk/taskprocessor.h"
+#include "asterisk/thread_affinity.h"
 #include "asterisk/xmldoc.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/stasis_channels.h"
 #include "asterisk/dial.h"
 #include "asterisk/vector.h"
+#include "asterisk/sched.h"
 
 /*!
  * \note I M P O R T A N T :
@@ -914,6 +918,7 @@ struct ast_exten {
 	struct ast_hashtab *peer_table;    /*!< Priorities list in hashtab form -- only on the head of the peer list */
 	struct ast_hashtab *peer_label_table; /*!< labeled priorities in the peers -- only on the head of the peer list */
 	const char *registrar;		/*!< Registrar */
+	struct subst_template *data_template;	/*!< The data scanned for substitution, if it has any */
 	struct ast_exten *next;		/*!< Extension with a greater ID */
 	char stuff[0];
 };
@@ -982,6 +987,8 @@ struct ast_context {
 	int refcount;                   /*!< each module that would have created this context should inc/dec this as appropriate */
 	AST_LIST_HEAD_NOLOCK(, ast_sw) alts;	/*!< Alternative switches */
 	ast_mutex_t macrolock;			/*!< A lock to implement "exclusive" macros - held whilst a call is executing in the macro */
+	struct pbx_dfa *dfa;			/*!< The context compiled into an automaton, if it was */
+	int generation;				/*!< Changes whenever the extensions, includes, switches or ignorepats do */
 	char name[0];				/*!< Name of the context */
 };
 
@@ -997,6 +1004,7 @@ struct ast_app {
 	);
 #ifdef AST_XML_DOCS
 	enum ast_doc_src docsrc;		/*!< Where the documentation come from. */
+	unsigned int docs_pending:1;		/*!< The XML documentation is built when first shown */
 #endif
 	AST_RWLIST_ENTRY(ast_app) list;		/*!< Next app in list */
 	struct ast_module *module;		/*!< Module this app belongs to */
@@ -1049,6 +1057,15 @@ struct ast_hint {
 	char exten_name[AST_MAX_EXTENSION];/*!< Extension of destroyed hint extension. */
 
 	AST_VECTOR(, char *) devices; /*!< Devices associated with the hint */
+
+	/*!
+	 * \brief Last known state of each device in the hint, in order
+	 *
+	 * \note Empty until the hint state is first worked out, and again
+	 * whenever the hint extension changes.
+	 */
+	AST_VECTOR(, enum ast_device_state) device_states;
+	unsigned int pending:1; /*!< Waiting to notify watchers of a state change */
 };
 
 #define HINTDEVICE_DATA_LENGTH 16
@@ -1165,6 +1182,7 @@ static int remove_hintdevice(struct ast_hint *hint)
 }
 
 static char *parse_hint_device(struct ast_str *hint_args);
+static void acf_docs(struct ast_custom_function *acf);
 /*!
  * \internal
  * \brief Destroy the given hintdevice object.
@@ -1316,6 +1334,7 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 	const char *registrar, int lock_context);
 static struct ast_context *find_context_locked(const char *context);
 static struct ast_context *find_context(const char *context);
+static struct ast_context *find_context_in(struct ast_hashtab *table, const char *context);
 static void get_device_state_causing_channels(struct ao2_container *c);
 
 /*!
@@ -1419,11 +1438,38 @@ static unsigned int hashtab_hash_labels(const void *obj)
 }
 
 
-AST_RWLOCK_DEFINE_STATIC(globalslock);
-static struct varshead globals = AST_LIST_HEAD_NOLOCK_INIT_VALUE;
+/*! \brief A global dialplan variable */
+struct global_var {
+	struct global_var *hidden;	/*!< The variable of the same name pushed over, if any */
+	char *value;
+	char name[0];			/*!< Without the inheritance underscores */
+};
+
+/*!
+ * \brief The global dialplan variables
+ *
+ * A container of struct global_var that is never changed once it is
+ * here, so it is searched without locking.  Setting a variable puts a
+ * changed copy of the container here, sharing the variables that did
+ * not change.
+ */
+static AO2_GLOBAL_OBJ_STATIC(globals);
+
+/*! \brief Serializes changes to the global dialplan variables */
+AST_MUTEX_DEFINE_STATIC(globalslock);
+
+/*! \brief The global variables being loaded by this thread, if any */
+AST_THREADSTORAGE(globals_loading);
 
 static int autofallthrough = 1;
 static int extenpatternmatchnew = 0;
+static int extenpatterncompile = 0;
+/*! \brief How long to gather hint state changes before notifying watchers, in milliseconds */
+static int hint_coalesce_ms = 0;
+/*! \brief Changes whenever contexts, includes or switches do */
+static int dialplan_generation;
+/*! \brief Changes whenever a context is added to or removed from the dialplan */
+static int contexts_generation;
 static char *overrideswitch = NULL;
 
 /*! \brief Subscription for device state change events */
@@ -1442,6 +1488,11 @@ static int totalcalls;
  */
 static AST_RWLIST_HEAD_STATIC(acf_root, ast_custom_function);
 
+#ifdef AST_XML_DOCS
+/*! \brief Serializes building the documentation of applications and functions left for later */
+AST_MUTEX_DEFINE_STATIC(lazy_docs_lock);
+#endif
+
 /*! \brief Declaration of builtin applications */
 static struct pbx_builtin {
 	char name[AST_MAX_APP];
@@ -1715,11 +1766,13 @@ int pbx_exec(struct ast_channel *c,	/*!< Channel */
 	ast_channel_publish_snapshot(c);
 	ast_channel_unlock(c);
 
+	AST_PROBE3(pbx__exec__start, c, app->name, data);
 	if (app->module)
 		u = __ast_module_user_add(app->module, c);
 	res = app->execute(c, S_OR(data, ""));
 	if (app->module && u)
 		__ast_module_user_remove(app->module, u);
+	AST_PROBE3(pbx__exec__done, c, app->name, res);
 	/* restore channel values */
 	ast_channel_appl_set(c, saved_c_appl);
 	ast_channel_data_set(c, saved_c_data);
@@ -2568,231 +2621,857 @@ static void destroy_pattern_tree(struct match_char *pattern_tree) /* pattern tre
 	ast_free(pattern_tree);
 }
 
+/*
+ * A context full of patterns can be compiled into a deterministic automaton
+ * that finds the same extension as new_find_extension() for E_MATCH and
+ * E_SPAWN, in time proportional to the length of the dialed string.
+ *
+ * The trie nodes are numbered in the order new_find_extension() visits them,
+ * so the extension it finds is the one on the lowest numbered node that
+ * accepts the string. Each state of the automaton is the set of nodes the
+ * string so far reaches, built by the subset construction. A '.' node
+ * accepts everything after the character that reaches it, so it stays in the
+ * set, and the nodes numbered after it can never win and are dropped.
+ *
+ * When the context and everything it includes can be compiled, the included
+ * contexts go into the same automaton in the order pbx_find_extension()
+ * searches them, and each state lists what it accepts in each of them.
+ * Caller ID matches, '!', switches and timed includes cannot be compiled.
+ *
+ * Changing the extensions of a compiled context, or any context, include or
+ * switch, leaves the automaton stale and lookups use the trie again until the
+ * dialplan is reloaded.
+ */
+
+/*! \brief Fewest extensions, counting included contexts, worth compiling */
+#define PBX_DFA_MIN_EXTENSIONS	64
+/*! \brief Most states in an automaton */
+#define PBX_DFA_MAX_STATES	1000000
+/*! \brief Most entries in the transition table of an automaton */
+#define PBX_DFA_MAX_TRANSITIONS	(32 * 1024 * 1024)
+
+#define DFA_SET_HAS(set, c)	((set)->bits[(c) >> 3] & (1 << ((c) & 7)))
+#define DFA_SET_ADD(set, c)	((set)->bits[(c) >> 3] |= (1 << ((c) & 7)))
+
+/*! \brief An extension a state of an automaton accepts */
+struct pbx_dfa_accept {
+	struct ast_exten *exten;	/*!< The head of the peer list */
+	int context;			/*!< Which of the compiled contexts it is in */
+};
+
+/*! \brief A context compiled into a deterministic automaton */
+struct pbx_dfa {
+	int generation;			/*!< dialplan_generation when compiled */
+	int num_states;
+	int num_classes;		/*!< Sets of characters that always go to the same state */
+	int num_contexts;		/*!< More than 1 if the includes were flattened */
+	unsigned char classes[256];	/*!< The class of each character */
+	int *next;			/*!< The next state for each state and class, -1 if none */
+	int *accept_first;		/*!< Where the accepts of each state start, and where the last ends */
+	struct pbx_dfa_accept *accepts;
+	struct ast_context **contexts;	/*!< In the order pbx_find_extension() searches them */
+	int *context_generations;	/*!< The generation of each context when compiled */
+	const char **found_names;	/*!< The name each included context is searched by */
+};
+
+/*! \brief A trie node numbered for compiling */
+struct dfa_node {
+	struct ast_exten *exten;	/*!< The extension, if the node accepts one */
+	int child;			/*!< The first node of the next_char list, -1 if none */
+	int alt;			/*!< The next node of the alt_char list, -1 if none */
+	int context;			/*!< Which of the compiled contexts it is in */
+	int set;			/*!< Which set of characters it matches, -1 for '.' */
+};
+
+/*! \brief The characters a trie node matches */
+struct dfa_set {
+	unsigned char bits[32];
+};
+
+/*! \brief Everything needed while compiling a context */
+struct dfa_builder {
+	AST_VECTOR(, struct ast_context *) contexts;
+	AST_VECTOR(, const char *) found_names;
+	AST_VECTOR(, int) roots;		/*!< The first top level node of each context */
+	AST_VECTOR(, struct dfa_node) nodes;
+	AST_VECTOR(, struct dfa_set) sets;
+	AST_VECTOR(, int) members;		/*!< The nodes of every state, one after the other */
+	AST_VECTOR(, int) member_first;		/*!< Where the nodes of each state start */
+	AST_VECTOR(, int) hash_next;		/*!< The next state in the same bucket */
+	AST_VECTOR(, int) next;
+	AST_VECTOR(, int) accept_first;
+	AST_VECTOR(, struct pbx_dfa_accept) accepts;
+	int single_sets[256];			/*!< The set of each lone character, plus 1 */
+	int *buckets;
+	unsigned int num_buckets;
+	int num_states;
+	int num_classes;
+	unsigned char reps[256];		/*!< A character of each class */
+	int failed;
+	struct ast_hashtab *table;		/*!< Where included contexts are found */
+};
+
+static void pbx_dfa_destroy(struct pbx_dfa *dfa)
+{
+	if (!dfa) {
+		return;
+	}
+	ast_free(dfa->next);
+	ast_free(dfa->accept_first);
+	ast_free(dfa->accepts);
+	ast_free(dfa->contexts);
+	ast_free(dfa->context_generations);
+	ast_free(dfa->found_names);
+	ast_free(dfa);
+}
+
+static void dfa_builder_free(struct dfa_builder *b)
+{
+	AST_VECTOR_FREE(&b->contexts);
+	AST_VECTOR_FREE(&b->found_names);
+	AST_VECTOR_FREE(&b->roots);
+	AST_VECTOR_FREE(&b->nodes);
+	AST_VECTOR_FREE(&b->sets);
+	AST_VECTOR_FREE(&b->members);
+	AST_VECTOR_FREE(&b->member_first);
+	AST_VECTOR_FREE(&b->hash_next);
+	AST_VECTOR_FREE(&b->next);
+	AST_VECTOR_FREE(&b->accept_first);
+	AST_VECTOR_FREE(&b->accepts);
+	ast_free(b->buckets);
+	memset(b, 0, sizeof(*b));
+}
+
 /*!
  * \internal
- * \brief Get the length of the exten string.
- *
- * \param str Exten to get length.
+ * \brief Add the contexts a context includes, in the order they are searched
  *
- * \retval strlen of exten.
+ * \retval 0 if they can all be compiled together
+ * \retval -1 if not
  */
-static int ext_cmp_exten_strlen(const char *str)
+static int dfa_flatten(struct dfa_builder *b, struct ast_context *con)
 {
-	int len;
+	struct ast_include *i;
+	struct ast_context *inc;
+	int x;
 
-	len = 0;
-	for (;;) {
-		/* Ignore '-' chars as eye candy fluff. */
-		while (*str == '-') {
-			++str;
+	if (!AST_LIST_EMPTY(&con->alts)) {
+		return -1;
+	}
+	for (i = con->includes; i; i = i->next) {
+		if (i->hastime) {
+			return -1;
 		}
-		if (!*str) {
-			break;
+		/* The same check as the include stack */
+		for (x = 0; x < AST_VECTOR_SIZE(&b->contexts); ++x) {
+			if (!strcasecmp(AST_VECTOR_GET(&b->contexts, x)->name, i->rname)) {
+				break;
+			}
+		}
+		if (x < AST_VECTOR_SIZE(&b->contexts) || !(inc = find_context_in(b->table, i->rname))) {
+			continue;
+		}
+		if (AST_VECTOR_SIZE(&b->contexts) >= AST_PBX_MAX_STACK - 1
+			|| AST_VECTOR_APPEND(&b->contexts, inc)
+			|| AST_VECTOR_APPEND(&b->found_names, i->rname)
+			|| dfa_flatten(b, inc)) {
+			return -1;
 		}
-		++str;
-		++len;
 	}
-	return len;
+	return 0;
 }
 
 /*!
  * \internal
- * \brief Partial comparison of non-pattern extens.
- *
- * \param left Exten to compare.
- * \param right Exten to compare.  Also matches if this string ends first.
+ * \brief Find the set of characters a trie node matches
  *
- * \retval <0 if left < right
- * \retval =0 if left == right
- * \retval >0 if left > right
+ * \return The index of the set, or -1 on failure
  */
-static int ext_cmp_exten_partial(const char *left, const char *right)
+static int dfa_node_set(struct dfa_builder *b, const struct match_char *m)
 {
-	int cmp;
+	struct dfa_set set = { { 0, }, };
+	const unsigned char *c;
+	int i;
 
-	for (;;) {
-		/* Ignore '-' chars as eye candy fluff. */
-		while (*left == '-') {
-			++left;
+	if (m->is_pattern && (m->x[0] == 'N' || m->x[0] == 'Z' || m->x[0] == 'X')) {
+		/* As in new_find_extension(), these are ranges only on their own */
+		if (!m->x[1]) {
+			for (i = m->x[0] == 'N' ? '2' : m->x[0] == 'Z' ? '1' : '0'; i <= '9'; ++i) {
+				DFA_SET_ADD(&set, i);
+			}
 		}
-		while (*right == '-') {
-			++right;
+	} else {
+		c = (const unsigned char *) m->x;
+		if (!c[1] && b->single_sets[c[0]]) {
+			return b->single_sets[c[0]] - 1;
 		}
-
-		if (!*right) {
-			/*
-			 * Right ended first for partial match or both ended at the same
-			 * time for a match.
-			 */
-			cmp = 0;
-			break;
+		for (; *c; ++c) {
+			DFA_SET_ADD(&set, *c);
 		}
+	}
 
-		cmp = *left - *right;
-		if (cmp) {
+	for (i = 0; i < AST_VECTOR_SIZE(&b->sets); ++i) {
+		if (!memcmp(AST_VECTOR_GET_ADDR(&b->sets, i), &set, sizeof(set))) {
 			break;
 		}
-		++left;
-		++right;
 	}
-	return cmp;
+	if (i == AST_VECTOR_SIZE(&b->sets) && AST_VECTOR_APPEND(&b->sets, set)) {
+		return -1;
+	}
+	if (!m->is_pattern && m->x[0] && !m->x[1]) {
+		b->single_sets[(unsigned char) m->x[0]] = i + 1;
+	}
+	return i;
 }
 
 /*!
  * \internal
- * \brief Comparison of non-pattern extens.
- *
- * \param left Exten to compare.
- * \param right Exten to compare.
+ * \brief Number a list of trie nodes and everything below them
  *
- * \retval <0 if left < right
- * \retval =0 if left == right
- * \retval >0 if left > right
+ * \return The number of the first node, or -1 if the list is empty
  */
-static int ext_cmp_exten(const char *left, const char *right)
+static int dfa_number_nodes(struct dfa_builder *b, struct match_char *m, int context)
 {
-	int cmp;
+	int first = -1;
+	int prev = -1;
 
-	for (;;) {
-		/* Ignore '-' chars as eye candy fluff. */
-		while (*left == '-') {
-			++left;
+	for (; m && !b->failed; m = m->alt_char) {
+		struct dfa_node node = { .child = -1, .alt = -1, .context = context, .set = -1, };
+		int idx = AST_VECTOR_SIZE(&b->nodes);
+
+		if (m->x[0] == '!' || strchr(m->x, '/')) {
+			/* These match the end of the string and the caller ID */
+			b->failed = 1;
+			break;
 		}
-		while (*right == '-') {
-			++right;
+		if (m->exten && !m->deleted) {
+			node.exten = m->exten;
 		}
-
-		cmp = *left - *right;
-		if (cmp) {
+		if ((!m->is_pattern || strcmp(m->x, "."))
+			&& (node.set = dfa_node_set(b, m)) < 0) {
+			b->failed = 1;
 			break;
 		}
-		if (!*left) {
-			/*
-			 * Get here only if both strings ended at the same time.  cmp
-			 * would be non-zero if only one string ended.
-			 */
+		if (AST_VECTOR_APPEND(&b->nodes, node)) {
+			b->failed = 1;
 			break;
 		}
-		++left;
-		++right;
+		if (prev < 0) {
+			first = idx;
+		} else {
+			AST_VECTOR_GET_ADDR(&b->nodes, prev)->alt = idx;
+		}
+		prev = idx;
+
+		/* Nothing after a '.' is ever visited */
+		if (node.set >= 0 && m->next_char) {
+			int child = dfa_number_nodes(b, m->next_char, context);
+
+			AST_VECTOR_GET_ADDR(&b->nodes, idx)->child = child;
+		}
 	}
-	return cmp;
+	return first;
 }
 
-/*
- * Special characters used in patterns:
- *	'_'	underscore is the leading character of a pattern.
- *		In other position it is treated as a regular char.
- *	'-' The '-' is a separator and ignored.  Why?  So patterns like NXX-XXX-XXXX work.
- *	.	one or more of any character. Only allowed at the end of
- *		a pattern.
- *	!	zero or more of anything. Also impacts the result of CANMATCH
- *		and MATCHMORE. Only allowed at the end of a pattern.
- *		In the core routine, ! causes a match with a return code of 2.
- *		In turn, depending on the search mode: (XXX check if it is implemented)
- *		- E_MATCH retuns 1 (does match)
- *		- E_MATCHMORE returns 0 (no match)
- *		- E_CANMATCH returns 1 (does match)
- *
- *	/	should not appear as it is considered the separator of the CID info.
- *		XXX at the moment we may stop on this char.
- *
- *	X Z N	match ranges 0-9, 1-9, 2-9 respectively.
- *	[	denotes the start of a set of character. Everything inside
- *		is considered literally. We can have ranges a-d and individual
- *		characters. A '[' and '-' can be considered literally if they
- *		are just before ']'.
- *		XXX currently there is no way to specify ']' in a range, nor \ is
- *		considered specially.
- *
- * When we compare a pattern with a specific extension, all characters in the extension
- * itself are considered literally.
- * XXX do we want to consider space as a separator as well ?
- * XXX do we want to consider the separators in non-patterns as well ?
- */
-
 /*!
- * \brief helper functions to sort extension patterns in the desired way,
- * so that more specific patterns appear first.
- *
- * \details
- * The function compares individual characters (or sets of), returning
- * an int where bits 0-7 are the ASCII code of the first char in the set,
- * bits 8-15 are the number of characters in the set, and bits 16-20 are
- * for special cases.
- * This way more specific patterns (smaller character sets) appear first.
- * Wildcards have a special value, so that we can directly compare them to
- * sets by subtracting the two values. In particular:
- *  0x001xx     one character, character set starting with xx
- *  0x0yyxx     yy characters, character set starting with xx
- *  0x18000     '.' (one or more of anything)
- *  0x28000     '!' (zero or more of anything)
- *  0x30000     NUL (end of string)
- *  0x40000     error in set.
- * The pointer to the string is advanced according to needs.
- * NOTES:
- *  1. the empty set is ignored.
- *  2. given that a full set has always 0 as the first element,
- *     we could encode the special cases as 0xffXX where XX
- *     is 1, 2, 3, 4 as used above.
+ * \internal
+ * \brief Split the characters into classes no trie node tells apart
  */
-static int ext_cmp_pattern_pos(const char **p, unsigned char *bitwise)
+static void dfa_classes(struct dfa_builder *b, unsigned char *classes)
 {
-#define BITS_PER	8	/* Number of bits per unit (byte). */
-	unsigned char c;
-	unsigned char cmin;
-	int count;
-	const char *end;
+	int map[256][2];
+	int s;
+	int c;
 
-	do {
-		/* Get character and advance. (Ignore '-' chars as eye candy fluff.) */
-		do {
-			c = *(*p)++;
-		} while (c == '-');
+	memset(classes, 0, 256);
+	b->num_classes = 1;
+	for (s = 0; s < AST_VECTOR_SIZE(&b->sets); ++s) {
+		const struct dfa_set *set = AST_VECTOR_GET_ADDR(&b->sets, s);
+		int num = 0;
 
-		/* always return unless we have a set of chars */
-		switch (c) {
-		default:
-			/* ordinary character */
-			bitwise[c / BITS_PER] = 1 << ((BITS_PER - 1) - (c % BITS_PER));
-			return 0x0100 | c;
+		memset(map, -1, sizeof(map));
+		for (c = 0; c < 256; ++c) {
+			int *class = &map[classes[c]][DFA_SET_HAS(set, c) ? 1 : 0];
 
-		case 'n':
-		case 'N':
-			/* 2..9 */
-			bitwise[6] = 0x3f;
-			bitwise[7] = 0xc0;
-			return 0x0800 | '2';
+			if (*class < 0) {
+				*class = num++;
+			}
+			classes[c] = *class;
+		}
+		b->num_classes = num;
+	}
+	for (c = 255; c >= 0; --c) {
+		b->reps[classes[c]] = c;
+	}
+}
 
-		case 'x':
-		case 'X':
-			/* 0..9 */
-			bitwise[6] = 0xff;
-			bitwise[7] = 0xc0;
-			return 0x0A00 | '0';
+static unsigned int dfa_hash(const int *members, int count)
+{
+	unsigned int hash = 2166136261U;
 
-		case 'z':
-		case 'Z':
-			/* 1..9 */
-			bitwise[6] = 0x7f;
-			bitwise[7] = 0xc0;
-			return 0x0900 | '1';
+	while (count--) {
+		hash = (hash ^ *members++) * 16777619U;
+	}
+	return hash;
+}
 
-		case '.':
-			/* wildcard */
-			return 0x18000;
+static int dfa_rehash(struct dfa_builder *b, unsigned int num_buckets)
+{
+	int *buckets;
+	int s;
 
-		case '!':
-			/* earlymatch */
-			return 0x28000;	/* less specific than '.' */
+	if (!(buckets = ast_malloc(num_buckets * sizeof(*buckets)))) {
+		return -1;
+	}
+	memset(buckets, -1, num_buckets * sizeof(*buckets));
+	/* State 0 is the start, which is not in the table */
+	for (s = 1; s < b->num_states; ++s) {
+		int first = AST_VECTOR_GET(&b->member_first, s);
+		unsigned int bucket = dfa_hash(&b->members.elems[first],
+			AST_VECTOR_GET(&b->member_first, s + 1) - first) & (num_buckets - 1);
 
-		case '\0':
-			/* empty string */
-			*p = NULL;
-			return 0x30000;
+		b->hash_next.elems[s] = buckets[bucket];
+		buckets[bucket] = s;
+	}
+	ast_free(b->buckets);
+	b->buckets = buckets;
+	b->num_buckets = num_buckets;
+	return 0;
+}
 
-		case '[':
-			/* char set */
+/*!
+ * \internal
+ * \brief Find the state for a sorted set of nodes, adding it if need be
+ *
+ * \return The state, or -1 on failure
+ */
+static int dfa_state(struct dfa_builder *b, const int *members, int count)
+{
+	unsigned int hash = dfa_hash(members, count);
+	int s;
+	int i;
+	int context;
+
+	for (s = b->buckets[hash & (b->num_buckets - 1)]; s >= 0; s = b->hash_next.elems[s]) {
+		int first = b->member_first.elems[s];
+
+		if (b->member_first.elems[s + 1] - first == count
+			&& !memcmp(&b->members.elems[first], members, count * sizeof(*members))) {
+			return s;
+		}
+	}
+
+	if (b->num_states >= PBX_DFA_MAX_STATES
+		|| (b->num_states + 1) * b->num_classes > PBX_DFA_MAX_TRANSITIONS) {
+		return -1;
+	}
+
+	s = b->num_states;
+	for (i = 0; i < count; ++i) {
+		if (AST_VECTOR_APPEND(&b->members, members[i])) {
+			return -1;
+		}
+	}
+	if (AST_VECTOR_APPEND(&b->member_first, AST_VECTOR_SIZE(&b->members))
+		|| AST_VECTOR_APPEND(&b->hash_next, b->buckets[hash & (b->num_buckets - 1)])) {
+		return -1;
+	}
+	b->buckets[hash & (b->num_buckets - 1)] = s;
+
+	/* The lowest numbered node of each context that accepts wins there */
+	for (i = 0, context = -1; i < count; ++i) {
+		const struct dfa_node *node = &b->nodes.elems[members[i]];
+
+		if (node->exten && node->context != context) {
+			struct pbx_dfa_accept accept = { .exten = node->exten, .context = node->context, };
+
+			if (AST_VECTOR_APPEND(&b->accepts, accept)) {
+				return -1;
+			}
+			context = node->context;
+		}
+	}
+	if (AST_VECTOR_APPEND(&b->accept_first, AST_VECTOR_SIZE(&b->accepts))) {
+		return -1;
+	}
+	for (i = 0; i < b->num_classes; ++i) {
+		if (AST_VECTOR_APPEND(&b->next, -1)) {
+			return -1;
+		}
+	}
+
+	++b->num_states;
+	if (b->num_states > b->num_buckets && dfa_rehash(b, b->num_buckets * 2)) {
+		return -1;
+	}
+	return s;
+}
+
+/*! \brief Add the nodes of a list that a character goes to */
+static void dfa_step(struct dfa_builder *b, int first, unsigned char c, int *out, int *count)
+{
+	int i;
+
+	for (i = first; i >= 0; i = b->nodes.elems[i].alt) {
+		const struct dfa_node *node = &b->nodes.elems[i];
+
+		if (node->set < 0) {
+			if (node->exten) {
+				out[(*count)++] = i;
+			}
+		} else if ((node->exten || node->child >= 0)
+			&& DFA_SET_HAS(&b->sets.elems[node->set], c)) {
+			out[(*count)++] = i;
+		}
+	}
+}
+
+static int dfa_cmp_node(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+/*!
+ * \internal
+ * \brief Build the states of the automaton by the subset construction
+ */
+static int dfa_build_states(struct dfa_builder *b)
+{
+	int *scratch;
+	int s;
+	int k;
+	int x;
+
+	if (!(scratch = ast_malloc((AST_VECTOR_SIZE(&b->nodes) + 1) * sizeof(*scratch)))) {
+		return -1;
+	}
+
+	/* The start state has no nodes; the top of each trie follows it */
+	if (dfa_rehash(b, 1024)
+		|| AST_VECTOR_APPEND(&b->member_first, 0)
+		|| AST_VECTOR_APPEND(&b->member_first, 0)
+		|| AST_VECTOR_APPEND(&b->hash_next, -1)
+		|| AST_VECTOR_APPEND(&b->accept_first, 0)
+		|| AST_VECTOR_APPEND(&b->accept_first, 0)) {
+		ast_free(scratch);
+		return -1;
+	}
+	for (k = 0; k < b->num_classes; ++k) {
+		if (AST_VECTOR_APPEND(&b->next, -1)) {
+			ast_free(scratch);
+			return -1;
+		}
+	}
+	b->num_states = 1;
+
+	for (s = 0; s < b->num_states; ++s) {
+		for (k = 0; k < b->num_classes; ++k) {
+			int count = 0;
+			int kept = 0;
+			int context = -1;
+			int dotted = 0;
+			int to = -1;
+
+			if (!s) {
+				for (x = 0; x < AST_VECTOR_SIZE(&b->roots); ++x) {
+					dfa_step(b, AST_VECTOR_GET(&b->roots, x), b->reps[k], scratch, &count);
+				}
+			} else {
+				for (x = b->member_first.elems[s]; x < b->member_first.elems[s + 1]; ++x) {
+					int m = b->members.elems[x];
+
+					if (b->nodes.elems[m].set < 0) {
+						/* A '.' goes on accepting */
+						scratch[count++] = m;
+					} else {
+						dfa_step(b, b->nodes.elems[m].child, b->reps[k], scratch, &count);
+					}
+				}
+			}
+			qsort(scratch, count, sizeof(*scratch), dfa_cmp_node);
+
+			/* Nothing numbered after a '.' of the same context can win */
+			for (x = 0; x < count; ++x) {
+				const struct dfa_node *node = &b->nodes.elems[scratch[x]];
+
+				if (node->context != context) {
+					context = node->context;
+					dotted = 0;
+				}
+				if (!dotted) {
+					scratch[kept++] = scratch[x];
+					dotted = node->set < 0;
+				}
+			}
+
+			if (kept && (to = dfa_state(b, scratch, kept)) < 0) {
+				ast_free(scratch);
+				return -1;
+			}
+			b->next.elems[s * b->num_classes + k] = to;
+		}
+	}
+
+	ast_free(scratch);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Number the nodes of the contexts to compile
+ *
+ * \return The number of extensions in them, or -1 if they cannot be compiled
+ */
+static int dfa_collect(struct dfa_builder *b, struct ast_context *con, int flatten)
+{
+	int extensions = 0;
+	int x;
+
+	if (AST_VECTOR_APPEND(&b->contexts, con)
+		|| AST_VECTOR_APPEND(&b->found_names, con->name)
+		|| (flatten && dfa_flatten(b, con))) {
+		return -1;
+	}
+	for (x = 0; x < AST_VECTOR_SIZE(&b->contexts); ++x) {
+		struct ast_context *c = AST_VECTOR_GET(&b->contexts, x);
+
+		if (!c->pattern_tree && c->root_table) {
+			create_match_char_tree(c);
+		}
+		if (c->root_table) {
+			extensions += ast_hashtab_size(c->root_table);
+		}
+		if (AST_VECTOR_APPEND(&b->roots, dfa_number_nodes(b, c->pattern_tree, x)) || b->failed) {
+			return -1;
+		}
+	}
+	return extensions;
+}
+
+/*!
+ * \internal
+ * \brief Compile a context into an automaton
+ *
+ * \param con The context
+ * \param table The table of contexts it is in, where its includes are found
+ *
+ * \note The contexts must be locked.
+ *
+ * \return The automaton, or NULL if the context cannot or need not be compiled
+ */
+static struct pbx_dfa *dfa_compile(struct ast_context *con, struct ast_hashtab *table)
+{
+	struct dfa_builder b = { { 0, }, };
+	struct pbx_dfa *dfa;
+	int extensions;
+	int x;
+
+	/* Flatten the includes if possible, else compile the context alone */
+	b.table = table;
+	if ((extensions = dfa_collect(&b, con, 1)) < 0) {
+		dfa_builder_free(&b);
+		b.table = table;
+		extensions = dfa_collect(&b, con, 0);
+	}
+	if (extensions < PBX_DFA_MIN_EXTENSIONS || !(dfa = ast_calloc(1, sizeof(*dfa)))) {
+		dfa_builder_free(&b);
+		return NULL;
+	}
+
+	dfa_classes(&b, dfa->classes);
+	if (dfa_build_states(&b)) {
+		ast_log(LOG_WARNING, "Context '%s' is too big to compile\n", con->name);
+		dfa_builder_free(&b);
+		ast_free(dfa);
+		return NULL;
+	}
+
+	dfa->generation = dialplan_generation;
+	dfa->num_states = b.num_states;
+	dfa->num_classes = b.num_classes;
+	dfa->num_contexts = AST_VECTOR_SIZE(&b.contexts);
+	dfa->context_generations = ast_calloc(dfa->num_contexts, sizeof(*dfa->context_generations));
+	if (!dfa->context_generations) {
+		dfa_builder_free(&b);
+		ast_free(dfa);
+		return NULL;
+	}
+	for (x = 0; x < dfa->num_contexts; ++x) {
+		dfa->context_generations[x] = AST_VECTOR_GET(&b.contexts, x)->generation;
+	}
+
+	/* Take what the automaton keeps from the builder */
+	dfa->next = b.next.elems;
+	b.next.elems = NULL;
+	dfa->accept_first = b.accept_first.elems;
+	b.accept_first.elems = NULL;
+	dfa->accepts = b.accepts.elems;
+	b.accepts.elems = NULL;
+	dfa->contexts = b.contexts.elems;
+	b.contexts.elems = NULL;
+	dfa->found_names = b.found_names.elems;
+	b.found_names.elems = NULL;
+
+	dfa_builder_free(&b);
+	return dfa;
+}
+
+/*!
+ * \internal
+ * \brief Compile every context worth compiling
+ *
+ * \param list The contexts
+ * \param table The same contexts in a table
+ *
+ * \note The contexts must be write locked, unless they are not the dialplan yet.
+ */
+static void pbx_compile_contexts(struct ast_context *list, struct ast_hashtab *table)
+{
+	struct ast_context *con;
+	struct timeval begin;
+	int compiled = 0;
+
+	if (!extenpatterncompile) {
+		return;
+	}
+
+	begin = ast_tvnow();
+	for (con = list; con; con = con->next) {
+		pbx_dfa_destroy(con->dfa);
+		if ((con->dfa = dfa_compile(con, table))) {
+			++compiled;
+		}
+	}
+	ast_verb(3, "Time to compile %d contexts: %8.6f sec\n", compiled,
+		ast_tvdiff_us(ast_tvnow(), begin) / 1000000.0);
+}
+
+
+/*!
+ * \internal
+ * \brief Get the length of the exten string.
+ *
+ * \param str Exten to get length.
+ *
+ * \retval strlen of exten.
+ */
+static int ext_cmp_exten_strlen(const char *str)
+{
+	int len;
+
+	len = 0;
+	for (;;) {
+		/* Ignore '-' chars as eye candy fluff. */
+		while (*str == '-') {
+			++str;
+		}
+		if (!*str) {
+			break;
+		}
+		++str;
+		++len;
+	}
+	return len;
+}
+
+/*!
+ * \internal
+ * \brief Partial comparison of non-pattern extens.
+ *
+ * \param left Exten to compare.
+ * \param right Exten to compare.  Also matches if this string ends first.
+ *
+ * \retval <0 if left < right
+ * \retval =0 if left == right
+ * \retval >0 if left > right
+ */
+static int ext_cmp_exten_partial(const char *left, const char *right)
+{
+	int cmp;
+
+	for (;;) {
+		/* Ignore '-' chars as eye candy fluff. */
+		while (*left == '-') {
+			++left;
+		}
+		while (*right == '-') {
+			++right;
+		}
+
+		if (!*right) {
+			/*
+			 * Right ended first for partial match or both ended at the same
+			 * time for a match.
+			 */
+			cmp = 0;
+			break;
+		}
+
+		cmp = *left - *right;
+		if (cmp) {
+			break;
+		}
+		++left;
+		++right;
+	}
+	return cmp;
+}
+
+/*!
+ * \internal
+ * \brief Comparison of non-pattern extens.
+ *
+ * \param left Exten to compare.
+ * \param right Exten to compare.
+ *
+ * \retval <0 if left < right
+ * \retval =0 if left == right
+ * \retval >0 if left > right
+ */
+static int ext_cmp_exten(const char *left, const char *right)
+{
+	int cmp;
+
+	for (;;) {
+		/* Ignore '-' chars as eye candy fluff. */
+		while (*left == '-') {
+			++left;
+		}
+		while (*right == '-') {
+			++right;
+		}
+
+		cmp = *left - *right;
+		if (cmp) {
+			break;
+		}
+		if (!*left) {
+			/*
+			 * Get here only if both strings ended at the same time.  cmp
+			 * would be non-zero if only one string ended.
+			 */
+			break;
+		}
+		++left;
+		++right;
+	}
+	return cmp;
+}
+
+/*
+ * Special characters used in patterns:
+ *	'_'	underscore is the leading character of a pattern.
+ *		In other position it is treated as a regular char.
+ *	'-' The '-' is a separator and ignored.  Why?  So patterns like NXX-XXX-XXXX work.
+ *	.	one or more of any character. Only allowed at the end of
+ *		a pattern.
+ *	!	zero or more of anything. Also impacts the result of CANMATCH
+ *		and MATCHMORE. Only allowed at the end of a pattern.
+ *		In the core routine, ! causes a match with a return code of 2.
+ *		In turn, depending on the search mode: (XXX check if it is implemented)
+ *		- E_MATCH retuns 1 (does match)
+ *		- E_MATCHMORE returns 0 (no match)
+ *		- E_CANMATCH returns 1 (does match)
+ *
+ *	/	should not appear as it is considered the separator of the CID info.
+ *		XXX at the moment we may stop on this char.
+ *
+ *	X Z N	match ranges 0-9, 1-9, 2-9 respectively.
+ *	[	denotes the start of a set of character. Everything inside
+ *		is considered literally. We can have ranges a-d and individual
+ *		characters. A '[' and '-' can be considered literally if they
+ *		are just before ']'.
+ *		XXX currently there is no way to specify ']' in a range, nor \ is
+ *		considered specially.
+ *
+ * When we compare a pattern with a specific extension, all characters in the extension
+ * itself are considered literally.
+ * XXX do we want to consider space as a separator as well ?
+ * XXX do we want to consider the separators in non-patterns as well ?
+ */
+
+/*!
+ * \brief helper functions to sort extension patterns in the desired way,
+ * so that more specific patterns appear first.
+ *
+ * \details
+ * The function compares individual characters (or sets of), returning
+ * an int where bits 0-7 are the ASCII code of the first char in the set,
+ * bits 8-15 are the number of characters in the set, and bits 16-20 are
+ * for special cases.
+ * This way more specific patterns (smaller character sets) appear first.
+ * Wildcards have a special value, so that we can directly compare them to
+ * sets by subtracting the two values. In particular:
+ *  0x001xx     one character, character set starting with xx
+ *  0x0yyxx     yy characters, character set starting with xx
+ *  0x18000     '.' (one or more of anything)
+ *  0x28000     '!' (zero or more of anything)
+ *  0x30000     NUL (end of string)
+ *  0x40000     error in set.
+ * The pointer to the string is advanced according to needs.
+ * NOTES:
+ *  1. the empty set is ignored.
+ *  2. given that a full set has always 0 as the first element,
+ *     we could encode the special cases as 0xffXX where XX
+ *     is 1, 2, 3, 4 as used above.
+ */
+static int ext_cmp_pattern_pos(const char **p, unsigned char *bitwise)
+{
+#define BITS_PER	8	/* Number of bits per unit (byte). */
+	unsigned char c;
+	unsigned char cmin;
+	int count;
+	const char *end;
+
+	do {
+		/* Get character and advance. (Ignore '-' chars as eye candy fluff.) */
+		do {
+			c = *(*p)++;
+		} while (c == '-');
+
+		/* always return unless we have a set of chars */
+		switch (c) {
+		default:
+			/* ordinary character */
+			bitwise[c / BITS_PER] = 1 << ((BITS_PER - 1) - (c % BITS_PER));
+			return 0x0100 | c;
+
+		case 'n':
+		case 'N':
+			/* 2..9 */
+			bitwise[6] = 0x3f;
+			bitwise[7] = 0xc0;
+			return 0x0800 | '2';
+
+		case 'x':
+		case 'X':
+			/* 0..9 */
+			bitwise[6] = 0xff;
+			bitwise[7] = 0xc0;
+			return 0x0A00 | '0';
+
+		case 'z':
+		case 'Z':
+			/* 1..9 */
+			bitwise[6] = 0x7f;
+			bitwise[7] = 0xc0;
+			return 0x0900 | '1';
+
+		case '.':
+			/* wildcard */
+			return 0x18000;
+
+		case '!':
+			/* earlymatch */
+			return 0x28000;	/* less specific than '.' */
+
+		case '\0':
+			/* empty string */
+			*p = NULL;
+			return 0x30000;
+
+		case '[':
+			/* char set */
 			break;
 		}
 		/* locate end of set */
@@ -3221,6 +3900,85 @@ static int matchcid(const char *cidpattern, const char *callerid)
 	return ast_extension_match(cidpattern, callerid);
 }
 
+/*!
+ * \internal
+ * \brief Find an extension with the automaton of a context
+ *
+ * \param dfa The automaton
+ * \param q Search state, as for pbx_find_extension()
+ * \param context The name the context was searched by
+ * \param exten The extension to find
+ * \param pattern The priority to find
+ * \param action What to do
+ * \param found The extension found
+ *
+ * \retval 1 if the search is over, with found set to the extension or NULL
+ * \retval 0 if the context has no match and its switches and includes come next
+ * \retval -1 if the automaton cannot answer and the trie must
+ */
+static int dfa_find_extension(struct pbx_dfa *dfa, struct pbx_find_info *q,
+	const char *context, const char *exten, struct ast_exten *pattern,
+	enum ext_match_t action, struct ast_exten **found)
+{
+	const unsigned char *c;
+	int state = 0;
+	int x;
+	int y;
+
+	if ((action != E_MATCH && action != E_SPAWN)
+		|| ast_strlen_zero(exten) || strchr(exten, '/')
+		|| dfa->generation != dialplan_generation) {
+		return -1;
+	}
+	for (x = 0; x < dfa->num_contexts; ++x) {
+		if (dfa->contexts[x]->generation != dfa->context_generations[x]) {
+			return -1;
+		}
+	}
+	if (dfa->num_contexts > 1) {
+		/* The included contexts must be searched just as they would be */
+		if (!ast_strlen_zero(overrideswitch)
+			|| q->stacklen + dfa->num_contexts >= AST_PBX_MAX_STACK) {
+			return -1;
+		}
+		for (x = 0; x < q->stacklen; ++x) {
+			for (y = 1; y < dfa->num_contexts; ++y) {
+				if (!strcasecmp(q->incstack[x], dfa->contexts[y]->name)) {
+					return -1;
+				}
+			}
+		}
+	}
+
+	for (c = (const unsigned char *) exten; *c && state >= 0; ++c) {
+		state = dfa->next[state * dfa->num_classes + dfa->classes[*c]];
+	}
+
+	*found = NULL;
+	if (state >= 0) {
+		for (x = dfa->accept_first[state]; x < dfa->accept_first[state + 1]; ++x) {
+			const struct pbx_dfa_accept *accept = &dfa->accepts[x];
+
+			if (q->status < STATUS_NO_PRIORITY) {
+				q->status = STATUS_NO_PRIORITY;
+			}
+			if ((*found = ast_hashtab_lookup(accept->exten->peer_table, pattern))) {
+				q->status = STATUS_SUCCESS;
+				q->foundcontext = accept->context ? dfa->found_names[accept->context] : context;
+				return 1;
+			}
+		}
+	}
+
+	if (dfa->num_contexts == 1) {
+		return 0;
+	}
+	for (x = 0; x < dfa->num_contexts; ++x) {
+		q->incstack[q->stacklen++] = dfa->contexts[x]->name;
+	}
+	return 1;
+}
+
 struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 	struct ast_context *bypass, struct pbx_find_info *q,
 	const char *context, const char *exten, int priority,
@@ -3347,7 +4105,12 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 		}
 	} while (0);
 
-	if (extenpatternmatchnew) {
+	if (extenpatternmatchnew && !bypass && tmp->dfa
+		&& (res = dfa_find_extension(tmp->dfa, q, context, exten, &pattern, action, &e)) >= 0) {
+		if (res) {
+			return e;
+		}
+	} else if (extenpatternmatchnew) {
 		new_find_extension(exten, &score, tmp->pattern_tree, 0, 0, callerid, label, action);
 		eroot = score.exten;
 
@@ -3633,15 +4396,235 @@ static const char *ast_str_substring(struct ast_str *value, int offset, int leng
 		ast_str_update(value);
 	}
 
-	return ast_str_buffer(value);
+	return ast_str_buffer(value);
+}
+
+/*! \brief  Support for Asterisk built-in variables in the dialplan
+
+\note	See also
+	- \ref AstVar	Channel variables
+	- \ref AstCauses The HANGUPCAUSE variable
+ */
+static void global_var_destructor(void *obj)
+{
+	struct global_var *var = obj;
+
+	ao2_cleanup(var->hidden);
+}
+
+/*! \brief Skip the inheritance underscores of a variable name */
+static const char *global_var_name(const char *name)
+{
+	if (*name == '_') {
+		name++;
+		if (*name == '_') {
+			name++;
+		}
+	}
+	return name;
+}
+
+static struct global_var *global_var_alloc(const char *name, const char *value)
+{
+	struct global_var *var;
+	size_t name_len;
+
+	name = global_var_name(name);
+	name_len = strlen(name) + 1;
+	var = ao2_alloc_options(sizeof(*var) + name_len + strlen(value) + 1,
+		global_var_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!var) {
+		return NULL;
+	}
+	strcpy(var->name, name); /* SAFE */
+	var->value = var->name + name_len;
+	strcpy(var->value, value); /* SAFE */
+	return var;
+}
+
+static int global_var_hash(const void *obj, const int flags)
+{
+	const struct global_var *var;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		var = obj;
+		key = var->name;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int global_var_cmp(void *obj, void *arg, int flags)
+{
+	const struct global_var *left = obj;
+	const struct global_var *right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->name;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return strcmp(left->name, right_key) ? 0 : CMP_MATCH;
+}
+
+static struct ao2_container *globals_alloc(int n_slots)
+{
+	return ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, n_slots,
+		global_var_hash, NULL, global_var_cmp);
+}
+
+/*! \brief Get the global variables, or those this thread is loading */
+static struct ao2_container *globals_ref(void)
+{
+	struct ao2_container **loading = ast_threadstorage_get(&globals_loading, sizeof(*loading));
+
+	if (loading && *loading) {
+		return ao2_bump(*loading);
+	}
+	return ao2_global_obj_ref(globals);
+}
+
+static struct global_var *global_var_find(const char *name)
+{
+	struct ao2_container *vars = globals_ref();
+	struct global_var *var;
+
+	if (!vars) {
+		return NULL;
+	}
+	var = ao2_find(vars, name, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	ao2_ref(vars, -1);
+	return var;
+}
+
+/*!
+ * \internal
+ * \brief Copy the global variables to change them
+ *
+ * \note Must be called with the globalslock held.
+ */
+static struct ao2_container *globals_copy(void)
+{
+	struct ao2_container *old = ao2_global_obj_ref(globals);
+	struct ao2_container *vars = globals_alloc(old ? ao2_container_count(old) : 0);
+
+	if (vars && old && ao2_container_dup(vars, old, OBJ_NOLOCK)) {
+		ao2_ref(vars, -1);
+		vars = NULL;
+	}
+	ao2_cleanup(old);
+	return vars;
+}
+
+/*!
+ * \internal
+ * \brief Set a global variable
+ *
+ * \param name The name, with any inheritance underscores
+ * \param value The value, NULL to remove the variable
+ * \param push Hide the variable of the same name instead of replacing it
+ *
+ * \retval 1 if a variable with a value was replaced
+ * \retval 0 if not
+ */
+static int globals_set(const char *name, const char *value, int push)
+{
+	struct ao2_container **loading = ast_threadstorage_get(&globals_loading, sizeof(*loading));
+	struct ao2_container *vars;
+	struct global_var *var = NULL;
+	struct global_var *old;
+	int old_value_existed = 0;
+
+	if (value && !(var = global_var_alloc(name, value))) {
+		return 0;
+	}
+
+	ast_mutex_lock(&globalslock);
+	if (loading && *loading) {
+		/* Only this thread can see them until they are all loaded */
+		vars = ao2_bump(*loading);
+	} else if (!(vars = globals_copy())) {
+		ast_mutex_unlock(&globalslock);
+		ao2_cleanup(var);
+		return 0;
+	}
+
+	if (push) {
+		if (var) {
+			var->hidden = ao2_find(vars, var->name, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NOLOCK);
+		}
+	} else if ((old = ao2_find(vars, global_var_name(name), OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NOLOCK))) {
+		old_value_existed = !ast_strlen_zero(old->value);
+		if (var) {
+			var->hidden = ao2_bump(old->hidden);
+		} else if (old->hidden) {
+			/* The variable pushed over shows again */
+			ao2_link_flags(vars, old->hidden, OBJ_NOLOCK);
+		}
+		ao2_ref(old, -1);
+	}
+	if (var) {
+		ast_verb(2, "Setting global variable '%s' to '%s'\n", name, value);
+		ao2_link_flags(vars, var, OBJ_NOLOCK);
+	}
+
+	if (!loading || !*loading) {
+		ao2_global_obj_replace_unref(globals, vars);
+	}
+	ast_mutex_unlock(&globalslock);
+
+	ao2_ref(vars, -1);
+	ao2_cleanup(var);
+	return old_value_existed;
 }
 
-/*! \brief  Support for Asterisk built-in variables in the dialplan
+void pbx_builtin_load_globals(const struct ast_variable *vars, int clear)
+{
+	struct ao2_container **loading = ast_threadstorage_get(&globals_loading, sizeof(*loading));
+	struct ast_str *value = ast_str_create(256);
+	const struct ast_variable *v;
+
+	if (!loading || !value) {
+		ast_free(value);
+		return;
+	}
+
+	ast_mutex_lock(&globalslock);
+	*loading = clear ? globals_alloc(0) : globals_copy();
+	if (!*loading) {
+		ast_mutex_unlock(&globalslock);
+		ast_free(value);
+		return;
+	}
+
+	/* Each value sees the ones before it, as if they were set one at a time */
+	for (v = vars; v; v = v->next) {
+		ast_str_substitute_variables(&value, 0, NULL, v->value);
+		globals_set(v->name, ast_str_buffer(value), 0);
+		ast_channel_publish_varset(NULL, v->name, ast_str_buffer(value));
+	}
+
+	ao2_global_obj_replace_unref(globals, *loading);
+	ao2_ref(*loading, -1);
+	*loading = NULL;
+	ast_mutex_unlock(&globalslock);
+	ast_free(value);
+}
 
-\note	See also
-	- \ref AstVar	Channel variables
-	- \ref AstCauses The HANGUPCAUSE variable
- */
 void pbx_retrieve_variable(struct ast_channel *c, const char *var, char **ret, char *workspace, int workspacelen, struct varshead *headp)
 {
 	struct ast_str *str = ast_str_create(16);
@@ -3661,12 +4644,13 @@ const char *ast_str_retrieve_variable(struct ast_str **str, ssize_t maxlen, stru
 	const char *s;	/* the result */
 	int offset, length;
 	int i, need_substring;
-	struct varshead *places[2] = { headp, &globals };	/* list of places where we may look */
+	struct varshead *place = headp;	/* where we may look before the global variables */
+	struct global_var *global = NULL;
 	char workspace[20];
 
 	if (c) {
 		ast_channel_lock(c);
-		places[0] = ast_channel_varshead(c);
+		place = ast_channel_varshead(c);
 	}
 	/*
 	 * Make a copy of var because parse_variable_name() modifies the string.
@@ -3763,20 +4747,15 @@ const char *ast_str_retrieve_variable(struct ast_str **str, ssize_t maxlen, stru
 		}
 	}
 	/* if not found, look into chanvars or global vars */
-	for (i = 0; s == &not_found && i < ARRAY_LEN(places); i++) {
-		struct ast_var_t *variables;
-		if (!places[i])
-			continue;
-		if (places[i] == &globals)
-			ast_rwlock_rdlock(&globalslock);
-		AST_LIST_TRAVERSE(places[i], variables, entries) {
-			if (!strcmp(ast_var_name(variables), var)) {
-				s = ast_var_value(variables);
-				break;
-			}
+	if (s == &not_found && place) {
+		struct ast_var_t *variables = ast_var_index_find(c ? ast_channel_var_index(c) : NULL, place, var);
+
+		if (variables) {
+			s = ast_var_value(variables);
 		}
-		if (places[i] == &globals)
-			ast_rwlock_unlock(&globalslock);
+	}
+	if (s == &not_found && (global = global_var_find(var))) {
+		s = global->value;
 	}
 	if (s == &not_found || s == NULL) {
 		ast_debug(5, "Result of '%s' is NULL\n", var);
@@ -3792,6 +4771,7 @@ const char *ast_str_retrieve_variable(struct ast_str **str, ssize_t maxlen, stru
 			ast_debug(2, "Final result of '%s' is '%s'\n", var, ret);
 		}
 	}
+	ao2_cleanup(global);
 
 	if (c) {
 		ast_channel_unlock(c);
@@ -3908,6 +4888,7 @@ static char *handle_show_functions(struct ast_cli_entry *e, int cmd, struct ast_
 	AST_RWLIST_TRAVERSE(&acf_root, acf, acflist) {
 		if (!like || strstr(acf->name, a->argv[4])) {
 			count_acf++;
+			acf_docs(acf);
 			ast_cli(a->fd, "%-20.20s  %-35.35s  %s\n",
 				S_OR(acf->name, ""),
 				S_OR(acf->syntax, ""),
@@ -3987,6 +4968,7 @@ static char *handle_show_function(struct ast_cli_entry *e, int cmd, struct ast_c
 		ast_cli(a->fd, "No function by that name registered.\n");
 		return CLI_FAILURE;
 	}
+	acf_docs(acf);
 
 	syntax_size = strlen(S_OR(acf->syntax, "Not Available")) + AST_TERM_MAX_ESCAPE_CHARS;
 	if (!(syntax = ast_malloc(syntax_size))) {
@@ -4129,24 +5111,17 @@ static int write_escalates(const struct ast_custom_function *acf) {
 	return acf->write_escalates;
 }
 
+#ifdef AST_XML_DOCS
 /*! \internal
- *  \brief Retrieve the XML documentation of a specified ast_custom_function,
- *         and populate ast_custom_function string fields.
- *  \param acf ast_custom_function structure with empty 'desc' and 'synopsis'
- *             but with a function 'name'.
+ *  \brief Build the XML documentation of an ast_custom_function into its
+ *         string fields.
  *  \retval -1 On error.
  *  \retval 0 On succes.
  */
-static int acf_retrieve_docs(struct ast_custom_function *acf)
+static int acf_build_docs(struct ast_custom_function *acf)
 {
-#ifdef AST_XML_DOCS
 	char *tmpxml;
 
-	/* Let's try to find it in the Documentation XML */
-	if (!ast_strlen_zero(acf->desc) || !ast_strlen_zero(acf->synopsis)) {
-		return 0;
-	}
-
 	if (ast_string_field_init(acf, 128)) {
 		return -1;
 	}
@@ -4177,9 +5152,54 @@ static int acf_retrieve_docs(struct ast_custom_function *acf)
 	ast_free(tmpxml);
 
 	acf->docsrc = AST_XML_DOC;
+
+	return 0;
+}
 #endif
 
+/*! \internal
+ *  \brief Retrieve the XML documentation of a specified ast_custom_function,
+ *         and populate ast_custom_function string fields.
+ *  \param acf ast_custom_function structure with empty 'desc' and 'synopsis'
+ *             but with a function 'name'.
+ *  \note With lazy documentation this only notes that the documentation
+ *        is to be built when it is first shown.
+ *  \retval -1 On error.
+ *  \retval 0 On succes.
+ */
+static int acf_retrieve_docs(struct ast_custom_function *acf)
+{
+#ifdef AST_XML_DOCS
+	/* Let's try to find it in the Documentation XML */
+	if (!ast_strlen_zero(acf->desc) || !ast_strlen_zero(acf->synopsis)) {
+		return 0;
+	}
+
+	if (ast_xmldoc_lazy()) {
+		acf->docs_pending = 1;
+		return 0;
+	}
+
+	return acf_build_docs(acf);
+#else
 	return 0;
+#endif
+}
+
+/*! \internal
+ *  \brief Build the documentation of a function about to be shown, if it
+ *         was left for later.
+ */
+static void acf_docs(struct ast_custom_function *acf)
+{
+#ifdef AST_XML_DOCS
+	ast_mutex_lock(&lazy_docs_lock);
+	if (acf->docs_pending) {
+		acf_build_docs(acf);
+		acf->docs_pending = 0;
+	}
+	ast_mutex_unlock(&lazy_docs_lock);
+#endif
 }
 
 int __ast_custom_function_register(struct ast_custom_function *acf, struct ast_module *mod)
@@ -4696,6 +5716,48 @@ void ast_str_substitute_variables_varshead(struct ast_str **buf, ssize_t maxlen,
 	ast_str_substitute_variables_full(buf, maxlen, NULL, headp, templ, &used);
 }
 
+/*!
+ * \internal
+ * \brief Get the value of a variable or function for substitution
+ *
+ * \param c Channel, may be NULL
+ * \param headp Variables to use when there is no channel
+ * \param vars The variable name or function call
+ * \param isfunction Whether it is a function call
+ * \param workspace VAR_BUF_SIZE bytes of workspace
+ *
+ * \return The value, or NULL if there is none
+ */
+static char *substitute_value(struct ast_channel *c, struct varshead *headp, const char *vars, int isfunction, char *workspace)
+{
+	char *cp4 = NULL;
+
+	if (isfunction) {
+		/* Evaluate function */
+		if (c || !headp)
+			cp4 = ast_func_read(c, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
+		else {
+			struct varshead old;
+			struct ast_channel *c = ast_dummy_channel_alloc();
+			if (c) {
+				memcpy(&old, ast_channel_varshead(c), sizeof(old));
+				memcpy(ast_channel_varshead(c), headp, sizeof(*ast_channel_varshead(c)));
+				cp4 = ast_func_read(c, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
+				/* Don't deallocate the varshead that was passed in */
+				memcpy(ast_channel_varshead(c), &old, sizeof(*ast_channel_varshead(c)));
+				c = ast_channel_unref(c);
+			} else {
+				ast_log(LOG_ERROR, "Unable to allocate bogus channel for variable substitution.  Function results may be blank.\n");
+			}
+		}
+		ast_debug(2, "Function %s result is '%s'\n", vars, cp4 ? cp4 : "(null)");
+	} else {
+		/* Retrieve variable value */
+		pbx_retrieve_variable(c, vars, &cp4, workspace, VAR_BUF_SIZE, headp);
+	}
+	return cp4;
+}
+
 void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead *headp, const char *cp1, char *cp2, int count, size_t *used)
 {
 	/* Substitutes variables into cp2, based on string cp1, cp2 NO LONGER NEEDS TO BE ZEROED OUT!!!!  */
@@ -4797,29 +5859,7 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 			workspace[0] = '\0';
 
 			parse_variable_name(vars, &offset, &offset2, &isfunction);
-			if (isfunction) {
-				/* Evaluate function */
-				if (c || !headp)
-					cp4 = ast_func_read(c, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
-				else {
-					struct varshead old;
-					struct ast_channel *c = ast_dummy_channel_alloc();
-					if (c) {
-						memcpy(&old, ast_channel_varshead(c), sizeof(old));
-						memcpy(ast_channel_varshead(c), headp, sizeof(*ast_channel_varshead(c)));
-						cp4 = ast_func_read(c, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
-						/* Don't deallocate the varshead that was passed in */
-						memcpy(ast_channel_varshead(c), &old, sizeof(*ast_channel_varshead(c)));
-						c = ast_channel_unref(c);
-					} else {
-						ast_log(LOG_ERROR, "Unable to allocate bogus channel for variable substitution.  Function results may be blank.\n");
-					}
-				}
-				ast_debug(2, "Function %s result is '%s'\n", vars, cp4 ? cp4 : "(null)");
-			} else {
-				/* Retrieve variable value */
-				pbx_retrieve_variable(c, vars, &cp4, workspace, VAR_BUF_SIZE, headp);
-			}
+			cp4 = substitute_value(c, headp, vars, isfunction, workspace);
 			if (cp4) {
 				cp4 = substring(cp4, offset, offset2, workspace, VAR_BUF_SIZE);
 
@@ -4865,23 +5905,377 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 			if (!var)
 				var = ast_alloca(VAR_BUF_SIZE);
 
-			/* Store variable name (and truncate) */
-			ast_copy_string(var, vars, len + 1);
+			/* Store variable name (and truncate) */
+			ast_copy_string(var, vars, len + 1);
+
+			/* Substitute if necessary */
+			if (needsub) {
+				size_t my_used;
+
+				if (!ltmp) {
+					ltmp = ast_alloca(VAR_BUF_SIZE);
+				}
+				pbx_substitute_variables_helper_full(c, headp, var, ltmp, VAR_BUF_SIZE - 1, &my_used);
+				vars = ltmp;
+			} else {
+				vars = var;
+			}
+
+			length = ast_expr(vars, cp2, count, c);
+
+			if (length) {
+				ast_debug(1, "Expression result is '%s'\n", cp2);
+				count -= length;
+				cp2 += length;
+				*cp2 = 0;
+			}
+		}
+	}
+	*used = cp2 - orig_cp2;
+}
+
+void pbx_substitute_variables_helper(struct ast_channel *c, const char *cp1, char *cp2, int count)
+{
+	size_t used;
+	pbx_substitute_variables_helper_full(c, (c) ? ast_channel_varshead(c) : NULL, cp1, cp2, count, &used);
+}
+
+void pbx_substitute_variables_varshead(struct varshead *headp, const char *cp1, char *cp2, int count)
+{
+	size_t used;
+	pbx_substitute_variables_helper_full(NULL, headp, cp1, cp2, count, &used);
+}
+
+/*
+ * Application arguments are scanned for ${} and $[] once, when the extension
+ * is added, into a template of the text between them and the variable names
+ * and expressions. Running the template gives exactly what
+ * pbx_substitute_variables_helper_full() gives for the same string, down to
+ * how it truncates, without scanning the string again.
+ *
+ * Expressions are evaluated on the text left after substitution, where a
+ * variable can hold operators, so only those with nothing to substitute and
+ * no function calls have a result that does not change. That result is kept
+ * after the first evaluation.
+ */
+
+enum subst_segment_type {
+	SUBST_TEXT,		/*!< Only the prefix */
+	SUBST_VARIABLE,		/*!< The prefix, then a variable or function */
+	SUBST_EXPRESSION,	/*!< The prefix, then an expression */
+};
+
+/*! \brief The text up to a variable or expression, and the variable or expression */
+struct subst_segment {
+	enum subst_segment_type type;
+	char *prefix;			/*!< Text copied before the variable or expression */
+	int prefix_len;
+	int prefix_split;		/*!< How much of the prefix the scanner copies a character at a time */
+	char *text;			/*!< The variable name or expression, if it needs no substituting */
+	struct subst_template *sub;	/*!< The variable name or expression to substitute first, otherwise */
+	int offset;			/*!< The parsed variable name, if it needs no substituting */
+	int length;
+	int isfunction;
+	unsigned int constant:1;	/*!< The expression always gives the same result */
+	char *result;			/*!< The result of a constant expression, once evaluated */
+	int result_len;
+};
+
+/*! \brief A string scanned for variables and expressions to substitute */
+struct subst_template {
+	int num_segments;
+	struct subst_segment segments[0];
+};
+
+static void subst_template_destructor(void *obj)
+{
+	struct subst_template *t = obj;
+	int i;
+
+	for (i = 0; i < t->num_segments; ++i) {
+		ast_free(t->segments[i].prefix);
+		ast_free(t->segments[i].text);
+		ao2_cleanup(t->segments[i].sub);
+		ast_free(t->segments[i].result);
+	}
+}
+
+/*! \brief Whether an expression calls no functions, so always gives the same result */
+static int subst_expression_constant(const char *expr)
+{
+	const char *paren;
+
+	for (paren = strchr(expr, '('); paren; paren = strchr(paren + 1, '(')) {
+		const char *before = paren;
+
+		while (before > expr && isspace((unsigned char) before[-1])) {
+			--before;
+		}
+		if (before > expr && (isalnum((unsigned char) before[-1]) || before[-1] == '_')) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*!
+ * \internal
+ * \brief Scan a string into a template
+ *
+ * \param cp1 The string, as given to pbx_substitute_variables_helper_full()
+ *
+ * \return The template, or NULL if it cannot be made, in which case the string
+ * must be substituted the usual way. That includes strings with a missing
+ * bracket, so the warning is still logged each time.
+ */
+static struct subst_template *subst_template_build(const char *cp1)
+{
+	AST_VECTOR(, struct subst_segment) segments;
+	struct subst_template *t = NULL;
+	const char *whereweare = cp1;
+	const char *prefix = cp1;
+	const char *nextthing;
+	int failed = 0;
+	int split = 0;
+	int i;
+
+	if (AST_VECTOR_INIT(&segments, 4)) {
+		return NULL;
+	}
+
+	while (!failed && (nextthing = strchr(whereweare, '$'))) {
+		struct subst_segment seg = { .type = SUBST_TEXT, };
+		const char *vars;
+		const char *vare;
+		int brackets = 1;
+		int needsub = 0;
+		int len;
+
+		if (nextthing[1] != '{' && nextthing[1] != '[') {
+			/* Up to and including a lone '$' is copied a character at a time */
+			whereweare = nextthing + 1;
+			split = whereweare - prefix;
+			continue;
+		}
+
+		/* Find the end of it, just as pbx_substitute_variables_helper_full() does */
+		vars = vare = nextthing + 2;
+		if (nextthing[1] == '{') {
+			seg.type = SUBST_VARIABLE;
+			while (brackets && *vare) {
+				if ((vare[0] == '$') && (vare[1] == '{')) {
+					needsub++;
+				} else if (vare[0] == '{') {
+					brackets++;
+				} else if (vare[0] == '}') {
+					brackets--;
+				} else if ((vare[0] == '$') && (vare[1] == '['))
+					needsub++;
+				vare++;
+			}
+		} else {
+			seg.type = SUBST_EXPRESSION;
+			while (brackets && *vare) {
+				if ((vare[0] == '$') && (vare[1] == '[')) {
+					needsub++;
+					brackets++;
+					vare++;
+				} else if (vare[0] == '[') {
+					brackets++;
+				} else if (vare[0] == ']') {
+					brackets--;
+				} else if ((vare[0] == '$') && (vare[1] == '{')) {
+					needsub++;
+					vare++;
+				}
+				vare++;
+			}
+		}
+		len = vare - vars - 1;
+		if (brackets || len >= VAR_BUF_SIZE) {
+			failed = 1;
+			break;
+		}
+
+		seg.prefix_len = nextthing - prefix;
+		seg.prefix_split = split;
+		seg.prefix = ast_strndup(prefix, seg.prefix_len);
+		seg.text = ast_strndup(vars, len);
+		if (!seg.prefix || !seg.text) {
+			failed = 1;
+		} else if (needsub) {
+			failed = !(seg.sub = subst_template_build(seg.text));
+			ast_free(seg.text);
+			seg.text = NULL;
+		} else if (seg.type == SUBST_VARIABLE) {
+			parse_variable_name(seg.text, &seg.offset, &seg.length, &seg.isfunction);
+		} else {
+			seg.constant = subst_expression_constant(seg.text);
+		}
+		if (failed || AST_VECTOR_APPEND(&segments, seg)) {
+			ast_free(seg.prefix);
+			ast_free(seg.text);
+			ao2_cleanup(seg.sub);
+			failed = 1;
+			break;
+		}
+
+		whereweare = nextthing + len + 3;
+		prefix = whereweare;
+		split = 0;
+	}
+
+	if (!failed && *prefix) {
+		struct subst_segment seg = { .type = SUBST_TEXT, .prefix_len = strlen(prefix), };
+
+		if (!(seg.prefix = ast_strdup(prefix)) || AST_VECTOR_APPEND(&segments, seg)) {
+			ast_free(seg.prefix);
+			failed = 1;
+		}
+	}
+
+	if (!failed) {
+		t = ao2_alloc_options(sizeof(*t) + AST_VECTOR_SIZE(&segments) * sizeof(t->segments[0]),
+			subst_template_destructor, AO2_ALLOC_OPT_LOCK_MUTEX);
+	}
+	if (t) {
+		t->num_segments = AST_VECTOR_SIZE(&segments);
+		memcpy(t->segments, segments.elems, t->num_segments * sizeof(t->segments[0]));
+	} else {
+		for (i = 0; i < AST_VECTOR_SIZE(&segments); ++i) {
+			struct subst_segment *seg = AST_VECTOR_GET_ADDR(&segments, i);
+
+			ast_free(seg->prefix);
+			ast_free(seg->text);
+			ao2_cleanup(seg->sub);
+		}
+	}
+	AST_VECTOR_FREE(&segments);
+	return t;
+}
+
+/*!
+ * \internal
+ * \brief Evaluate an expression that always gives the same result
+ *
+ * \return What ast_expr() returns
+ */
+static int subst_constant_expression(struct subst_template *t, struct subst_segment *seg,
+	char *cp2, int count, struct ast_channel *c)
+{
+	char *result;
+	int length;
+
+	ao2_lock(t);
+	if (seg->result && seg->result_len < count) {
+		memcpy(cp2, seg->result, seg->result_len + 1);
+		length = seg->result_len;
+		ao2_unlock(t);
+		return length;
+	}
+	ao2_unlock(t);
+
+	length = ast_expr(seg->text, cp2, count, c);
+
+	/* Only a result that was not cut short can stand for every later one */
+	if (length < count - 1 && (result = ast_strdup(cp2))) {
+		ao2_lock(t);
+		if (!seg->result) {
+			seg->result = result;
+			seg->result_len = length;
+			result = NULL;
+		}
+		ao2_unlock(t);
+		ast_free(result);
+	}
+	return length;
+}
+
+/*!
+ * \internal
+ * \brief Substitute variables into a template
+ *
+ * The same as pbx_substitute_variables_helper_full() on the string the
+ * template was made from.
+ */
+static void subst_template_run(struct ast_channel *c, struct varshead *headp,
+	struct subst_template *t, char *cp2, int count, size_t *used)
+{
+	const char *orig_cp2 = cp2;
+	char *workspace = NULL;
+	char *ltmp = NULL;
+	char *vars;
+	char *cp4;
+	int offset, offset2, isfunction;
+	int pos, length;
+	int i;
+
+	*cp2 = 0; /* just in case nothing ends up there */
+	for (i = 0; i < t->num_segments && count; ++i) {
+		struct subst_segment *seg = &t->segments[i];
+		int stop;
+
+		if (seg->prefix_len) {
+			pos = MIN(seg->prefix_len, count);
+			memcpy(cp2, seg->prefix, pos);
+			/* The scanner stops if it runs out before the last piece of the prefix */
+			stop = count <= seg->prefix_split;
+			count -= pos;
+			cp2 += pos;
+			*cp2 = 0;
+			if (stop) {
+				break;
+			}
+		}
+
+		if (seg->type == SUBST_VARIABLE) {
+			if (!workspace) {
+				workspace = ast_alloca(VAR_BUF_SIZE);
+			}
+			workspace[0] = '\0';
 
-			/* Substitute if necessary */
-			if (needsub) {
+			if (seg->sub) {
 				size_t my_used;
 
 				if (!ltmp) {
 					ltmp = ast_alloca(VAR_BUF_SIZE);
 				}
-				pbx_substitute_variables_helper_full(c, headp, var, ltmp, VAR_BUF_SIZE - 1, &my_used);
+				subst_template_run(c, headp, seg->sub, ltmp, VAR_BUF_SIZE - 1, &my_used);
 				vars = ltmp;
+				parse_variable_name(vars, &offset, &offset2, &isfunction);
 			} else {
-				vars = var;
+				vars = seg->text;
+				offset = seg->offset;
+				offset2 = seg->length;
+				isfunction = seg->isfunction;
 			}
 
-			length = ast_expr(vars, cp2, count, c);
+			cp4 = substitute_value(c, headp, vars, isfunction, workspace);
+			if (cp4) {
+				cp4 = substring(cp4, offset, offset2, workspace, VAR_BUF_SIZE);
+
+				length = strlen(cp4);
+				if (length > count)
+					length = count;
+				memcpy(cp2, cp4, length);
+				count -= length;
+				cp2 += length;
+				*cp2 = 0;
+			}
+		} else if (seg->type == SUBST_EXPRESSION) {
+			if (seg->sub) {
+				size_t my_used;
+
+				if (!ltmp) {
+					ltmp = ast_alloca(VAR_BUF_SIZE);
+				}
+				subst_template_run(c, headp, seg->sub, ltmp, VAR_BUF_SIZE - 1, &my_used);
+				length = ast_expr(ltmp, cp2, count, c);
+			} else if (seg->constant) {
+				length = subst_constant_expression(t, seg, cp2, count, c);
+			} else {
+				length = ast_expr(seg->text, cp2, count, c);
+			}
 
 			if (length) {
 				ast_debug(1, "Expression result is '%s'\n", cp2);
@@ -4894,18 +6288,6 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 	*used = cp2 - orig_cp2;
 }
 
-void pbx_substitute_variables_helper(struct ast_channel *c, const char *cp1, char *cp2, int count)
-{
-	size_t used;
-	pbx_substitute_variables_helper_full(c, (c) ? ast_channel_varshead(c) : NULL, cp1, cp2, count, &used);
-}
-
-void pbx_substitute_variables_varshead(struct varshead *headp, const char *cp1, char *cp2, int count)
-{
-	size_t used;
-	pbx_substitute_variables_helper_full(NULL, headp, cp1, cp2, count, &used);
-}
-
 /*!
  * \brief The return value depends on the action:
  *
@@ -4931,6 +6313,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 	struct ast_exten *e;
 	struct ast_app *app;
 	char *substitute = NULL;
+	struct subst_template *template = NULL;
 	int res;
 	struct pbx_find_info q = { .stacklen = 0 }; /* the rest is reset in pbx_find_extension */
 	char passdata[EXT_DATA_SIZE];
@@ -4959,7 +6342,10 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 				*passdata = '\0';
 			} else {
 				const char *tmp;
-				if ((!(tmp = strchr(e->data, '$'))) || (!strstr(tmp, "${") && !strstr(tmp, "$["))) {
+				if (e->data_template) {
+					/* already scanned, and referenced to use after lock released */
+					template = ao2_bump(e->data_template);
+				} else if ((!(tmp = strchr(e->data, '$'))) || (!strstr(tmp, "${") && !strstr(tmp, "$["))) {
 					/* no variables to substitute, copy on through */
 					ast_copy_string(passdata, e->data, sizeof(passdata));
 				} else {
@@ -4970,6 +6356,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 			ast_unlock_contexts();
 			if (!app) {
 				ast_log(LOG_WARNING, "No application '%s' for extension (%s, %s, %d)\n", e->app, context, exten, priority);
+				ao2_cleanup(template);
 				return -1;
 			}
 			if (ast_channel_context(c) != context)
@@ -4977,7 +6364,12 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 			if (ast_channel_exten(c) != exten)
 				ast_channel_exten_set(c, exten);
 			ast_channel_priority_set(c, priority);
-			if (substitute) {
+			if (template) {
+				size_t used;
+
+				subst_template_run(c, ast_channel_varshead(c), template, passdata, sizeof(passdata) - 1, &used);
+				ao2_ref(template, -1);
+			} else if (substitute) {
 				pbx_substitute_variables_helper(c, substitute, passdata, sizeof(passdata)-1);
 			}
 			ast_debug(1, "Launching '%s'\n", app->name);
@@ -5406,17 +6798,314 @@ static void get_device_state_causing_channels(struct ao2_container *c)
 	ao2_iterator_destroy(&iter);
 }
 
+/*!
+ * \internal
+ * \brief Record the new state of a device in the hints that use it
+ *
+ * \param hint Hint using the device.
+ * \param device Name of the device.
+ * \param state New state of the device.
+ * \param hint_app Buffer for the hint application.
+ *
+ * \note The context_merge_lock must be held.
+ */
+static void hint_device_state_changed(struct ast_hint *hint, const char *device,
+	enum ast_device_state state, struct ast_str **hint_app)
+{
+	char *cur;
+	char *rest;
+	int i;
+
+	ao2_lock(hint);
+	if (!hint->exten || !AST_VECTOR_SIZE(&hint->device_states)) {
+		/* Worked out in full when watchers are next notified */
+		ao2_unlock(hint);
+		return;
+	}
+
+	ast_str_set(hint_app, 0, "%s", ast_get_extension_app(hint->exten));
+	rest = parse_hint_device(*hint_app);
+	for (i = 0; (cur = strsep(&rest, "&")) && i < AST_VECTOR_SIZE(&hint->device_states); ++i) {
+		if (!strcasecmp(cur, device)) {
+			AST_VECTOR_REPLACE(&hint->device_states, i, state);
+		}
+	}
+	ao2_unlock(hint);
+}
+
+/*!
+ * \internal
+ * \brief Work out the state of a hint from the state of each of its devices
+ *
+ * The states are kept in the hint so later changes need only the device
+ * that changed.
+ *
+ * \param hint Hint to work out the state of.
+ * \param exten Hint extension the application was copied from.
+ * \param hint_app Hint application, which is parsed.
+ *
+ * \note The context_merge_lock must be held.
+ *
+ * \return Extension state of the hint.
+ */
+static int hint_cache_device_states(struct ast_hint *hint, struct ast_exten *exten, struct ast_str *hint_app)
+{
+	struct ast_devstate_aggregate agg;
+	enum ast_device_state *states;
+	char *cur;
+	char *rest;
+	int count = 1;
+	int i;
+
+	/* One or more devices separated with a & character */
+	rest = parse_hint_device(hint_app);
+	for (cur = rest; *cur; ++cur) {
+		if (*cur == '&') {
+			++count;
+		}
+	}
+	states = ast_alloca(count * sizeof(*states));
+
+	/* No locks may be held while getting the device states */
+	ast_devstate_aggregate_init(&agg);
+	for (i = 0; (cur = strsep(&rest, "&")); ++i) {
+		states[i] = ast_device_state(cur);
+		ast_devstate_aggregate_add(&agg, states[i]);
+	}
+
+	ao2_lock(hint);
+	if (hint->exten == exten && !AST_VECTOR_SIZE(&hint->device_states)) {
+		for (i = 0; i < count; ++i) {
+			if (AST_VECTOR_APPEND(&hint->device_states, states[i])) {
+				AST_VECTOR_RESET(&hint->device_states, AST_VECTOR_ELEM_CLEANUP_NOOP);
+				break;
+			}
+		}
+	}
+	ao2_unlock(hint);
+
+	return ast_devstate_to_extenstate(ast_devstate_aggregate_result(&agg));
+}
+
+/*!
+ * \internal
+ * \brief Notify the watchers of a hint if its state changed
+ *
+ * \param hint Hint to check.
+ * \param hint_app Buffer for the hint application.
+ *
+ * \note The context_merge_lock must be held.
+ */
+static void hint_notify(struct ast_hint *hint, struct ast_str **hint_app)
+{
+	struct ast_state_cb *state_cb;
+	struct ao2_iterator cb_iter;
+	struct ao2_container *device_state_info = NULL;
+	struct ast_exten *exten;
+	char context_name[AST_MAX_CONTEXT];
+	char exten_name[AST_MAX_EXTENSION];
+	int state = -1;
+	int same_state;
+	int first_extended_cb_call = 1;
+	int i;
+
+	ao2_lock(hint);
+	if (!hint->exten) {
+		/* The extension has already been destroyed */
+		ao2_unlock(hint);
+		return;
+	}
+
+	/*
+	 * Save off strings in case the hint extension gets destroyed
+	 * while we are notifying the watchers.
+	 */
+	ast_copy_string(context_name,
+		ast_get_context_name(ast_get_extension_context(hint->exten)),
+		sizeof(context_name));
+	ast_copy_string(exten_name, ast_get_extension_name(hint->exten),
+		sizeof(exten_name));
+	ast_str_set(hint_app, 0, "%s", ast_get_extension_app(hint->exten));
+	exten = hint->exten;
+
+	if (AST_VECTOR_SIZE(&hint->device_states)) {
+		struct ast_devstate_aggregate agg;
+
+		ast_devstate_aggregate_init(&agg);
+		for (i = 0; i < AST_VECTOR_SIZE(&hint->device_states); ++i) {
+			ast_devstate_aggregate_add(&agg, AST_VECTOR_GET(&hint->device_states, i));
+		}
+		state = ast_devstate_to_extenstate(ast_devstate_aggregate_result(&agg));
+	}
+	ao2_unlock(hint);
+
+	/*
+	 * Get device state for this hint.
+	 *
+	 * NOTE: We cannot hold any locks while determining the hint
+	 * device state or notifying the watchers without causing a
+	 * deadlock.  (conlock, hints, and hint)
+	 */
+	if (state < 0) {
+		char *app = ast_strdupa(ast_str_buffer(*hint_app));
+
+		state = hint_cache_device_states(hint, exten, *hint_app);
+		ast_str_set(hint_app, 0, "%s", app);
+	}
+	if ((same_state = state == hint->laststate) && (~state & AST_EXTENSION_RINGING)) {
+		return;
+	}
+
+	/* Device state changed since last check - notify the watchers. */
+	hint->laststate = state;	/* record we saw the change */
+
+	/* For general callbacks */
+	cb_iter = ao2_iterator_init(statecbs, 0);
+	for (; !same_state && (state_cb = ao2_iterator_next(&cb_iter)); ao2_ref(state_cb, -1)) {
+		execute_state_callback(state_cb->change_cb,
+			context_name,
+			exten_name,
+			state_cb->data,
+			AST_HINT_UPDATE_DEVICE,
+			hint,
+			NULL);
+	}
+	ao2_iterator_destroy(&cb_iter);
+
+	/* For extension callbacks */
+	/* extended callbacks are called when the state changed or when AST_STATE_RINGING is
+	 * included. Normal callbacks are only called when the state changed.
+	 */
+	cb_iter = ao2_iterator_init(hint->callbacks, 0);
+	for (; (state_cb = ao2_iterator_next(&cb_iter)); ao2_ref(state_cb, -1)) {
+		if (state_cb->extended && first_extended_cb_call) {
+			/* Fill detailed device_state_info now that we know it is used by extd. callback.
+			 * If making the container failed we simply do not provide the extended state info.
+			 */
+			first_extended_cb_call = 0;
+			device_state_info = alloc_device_state_info();
+			if (device_state_info) {
+				ast_extension_state3(*hint_app, device_state_info);
+				get_device_state_causing_channels(device_state_info);
+			}
+		}
+		if (state_cb->extended || !same_state) {
+			execute_state_callback(state_cb->change_cb,
+				context_name,
+				exten_name,
+				state_cb->data,
+				AST_HINT_UPDATE_DEVICE,
+				hint,
+				state_cb->extended ? device_state_info : NULL);
+		}
+	}
+	ao2_iterator_destroy(&cb_iter);
+
+	ao2_cleanup(device_state_info);
+}
+
+/*! \brief Hints waiting for the coalescing window to pass before their watchers are notified */
+AST_VECTOR(hint_vector, struct ast_hint *);
+static struct hint_vector hints_pending;
+/*! \brief Scheduler id of the notification of the pending hints, or -1 */
+static int hints_pending_id = -1;
+/*! \brief Scheduler for notifying the watchers of pending hints */
+static struct ast_sched_context *hints_sched;
+AST_MUTEX_DEFINE_STATIC(hints_pending_lock);
+
+/*!
+ * \internal
+ * \brief Notify the watchers of every pending hint
+ *
+ * \note Runs in the hints_sched thread.
+ */
+static int hints_pending_notify(const void *data)
+{
+	struct hint_vector notifying;
+	struct ast_str *hint_app;
+	int i;
+
+	ast_mutex_lock(&hints_pending_lock);
+	notifying = hints_pending;
+	AST_VECTOR_INIT(&hints_pending, 0);
+	hints_pending_id = -1;
+	ast_mutex_unlock(&hints_pending_lock);
+
+	hint_app = ast_str_create(1024);
+
+	ast_mutex_lock(&context_merge_lock);/* Hold off ast_merge_contexts_and_delete */
+	for (i = 0; i < AST_VECTOR_SIZE(&notifying); ++i) {
+		struct ast_hint *hint = AST_VECTOR_GET(&notifying, i);
+
+		/* Changes from now on need another notification */
+		ao2_lock(hint);
+		hint->pending = 0;
+		ao2_unlock(hint);
+
+		if (hint_app) {
+			hint_notify(hint, &hint_app);
+		}
+		ao2_ref(hint, -1);
+	}
+	ast_mutex_unlock(&context_merge_lock);
+
+	AST_VECTOR_FREE(&notifying);
+	ast_free(hint_app);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Notify the watchers of a hint once the coalescing window passes
+ *
+ * \param hint Hint whose state may have changed.
+ *
+ * \retval 0 The hint is pending, perhaps already.
+ * \retval -1 The watchers must be notified now.
+ */
+static int hint_pending(struct ast_hint *hint)
+{
+	int res = 0;
+
+	if (!hints_sched || hint_coalesce_ms <= 0) {
+		return -1;
+	}
+
+	ao2_lock(hint);
+	if (hint->pending) {
+		ao2_unlock(hint);
+		return 0;
+	}
+	hint->pending = 1;
+	ao2_unlock(hint);
+
+	ast_mutex_lock(&hints_pending_lock);
+	if (AST_VECTOR_APPEND(&hints_pending, hint)) {
+		res = -1;
+	} else {
+		ao2_ref(hint, +1);
+		if (hints_pending_id < 0) {
+			hints_pending_id = ast_sched_add(hints_sched, hint_coalesce_ms,
+				hints_pending_notify, NULL);
+		}
+	}
+	ast_mutex_unlock(&hints_pending_lock);
+
+	if (res) {
+		ao2_lock(hint);
+		hint->pending = 0;
+		ao2_unlock(hint);
+	}
+	return res;
+}
+
 static void device_state_cb(void *unused, struct stasis_subscription *sub, struct stasis_message *msg)
 {
 	struct ast_device_state_message *dev_state;
-	struct ast_hint *hint;
 	struct ast_str *hint_app;
 	struct ast_hintdevice *device;
 	struct ast_hintdevice *cmpdevice;
 	struct ao2_iterator *dev_iter;
-	struct ao2_iterator cb_iter;
-	char context_name[AST_MAX_CONTEXT];
-	char exten_name[AST_MAX_EXTENSION];
 
 	if (ast_device_state_message_type() != stasis_message_type(msg)) {
 		return;
@@ -5446,102 +7135,23 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		OBJ_SEARCH_OBJECT | OBJ_MULTIPLE,
 		hintdevice_cmp_multiple,
 		cmpdevice,
-		"find devices in container");
-	if (!dev_iter) {
-		ast_mutex_unlock(&context_merge_lock);
-		ast_free(hint_app);
-		return;
-	}
-
-	for (; (device = ao2_iterator_next(dev_iter)); ao2_t_ref(device, -1, "Next device")) {
-		struct ast_state_cb *state_cb;
-		int state;
-		int same_state;
-		struct ao2_container *device_state_info;
-		int first_extended_cb_call = 1;
-
-		if (!device->hint) {
-			/* Should never happen. */
-			continue;
-		}
-		hint = device->hint;
-
-		ao2_lock(hint);
-		if (!hint->exten) {
-			/* The extension has already been destroyed */
-			ao2_unlock(hint);
-			continue;
-		}
-
-		/*
-		 * Save off strings in case the hint extension gets destroyed
-		 * while we are notifying the watchers.
-		 */
-		ast_copy_string(context_name,
-			ast_get_context_name(ast_get_extension_context(hint->exten)),
-			sizeof(context_name));
-		ast_copy_string(exten_name, ast_get_extension_name(hint->exten),
-			sizeof(exten_name));
-		ast_str_set(&hint_app, 0, "%s", ast_get_extension_app(hint->exten));
-		ao2_unlock(hint);
-
-		/*
-		 * Get device state for this hint.
-		 *
-		 * NOTE: We cannot hold any locks while determining the hint
-		 * device state or notifying the watchers without causing a
-		 * deadlock.  (conlock, hints, and hint)
-		 */
-		/* Make a container so state3 can fill it if we wish.
-		 * If that failed we simply do not provide the extended state info.
-		 */
-		device_state_info = alloc_device_state_info();
-		state = ast_extension_state3(hint_app, device_state_info);
-		if ((same_state = state == hint->laststate) && (~state & AST_EXTENSION_RINGING)) {
-			ao2_cleanup(device_state_info);
-			continue;
-		}
-
-		/* Device state changed since last check - notify the watchers. */
-		hint->laststate = state;	/* record we saw the change */
+		"find devices in container");
+	if (!dev_iter) {
+		ast_mutex_unlock(&context_merge_lock);
+		ast_free(hint_app);
+		return;
+	}
 
-		/* For general callbacks */
-		cb_iter = ao2_iterator_init(statecbs, 0);
-		for (; !same_state && (state_cb = ao2_iterator_next(&cb_iter)); ao2_ref(state_cb, -1)) {
-			execute_state_callback(state_cb->change_cb,
-				context_name,
-				exten_name,
-				state_cb->data,
-				AST_HINT_UPDATE_DEVICE,
-				hint,
-				NULL);
+	for (; (device = ao2_iterator_next(dev_iter)); ao2_t_ref(device, -1, "Next device")) {
+		if (!device->hint) {
+			/* Should never happen. */
+			continue;
 		}
-		ao2_iterator_destroy(&cb_iter);
 
-		/* For extension callbacks */
-		/* extended callbacks are called when the state changed or when AST_STATE_RINGING is
-		 * included. Normal callbacks are only called when the state changed.
-		 */
-		cb_iter = ao2_iterator_init(hint->callbacks, 0);
-		for (; (state_cb = ao2_iterator_next(&cb_iter)); ao2_ref(state_cb, -1)) {
-			if (state_cb->extended && first_extended_cb_call) {
-				/* Fill detailed device_state_info now that we know it is used by extd. callback */
-				first_extended_cb_call = 0;
-				get_device_state_causing_channels(device_state_info);
-			}
-			if (state_cb->extended || !same_state) {
-				execute_state_callback(state_cb->change_cb,
-					context_name,
-					exten_name,
-					state_cb->data,
-					AST_HINT_UPDATE_DEVICE,
-					hint,
-					state_cb->extended ? device_state_info : NULL);
-			}
+		hint_device_state_changed(device->hint, dev_state->device, dev_state->state, &hint_app);
+		if (hint_pending(device->hint)) {
+			hint_notify(device->hint, &hint_app);
 		}
-		ao2_iterator_destroy(&cb_iter);
-
-		ao2_cleanup(device_state_info);
 	}
 	ast_mutex_unlock(&context_merge_lock);
 
@@ -5791,6 +7401,7 @@ static void destroy_hint(void *obj)
 		ast_free(device);
 	}
 	AST_VECTOR_FREE(&hint->devices);
+	AST_VECTOR_FREE(&hint->device_states);
 	ast_free(hint->last_presence_subtype);
 	ast_free(hint->last_presence_message);
 }
@@ -5853,6 +7464,7 @@ static int ast_add_hint(struct ast_exten *e)
 		return -1;
 	}
 	AST_VECTOR_INIT(&hint_new->devices, 8);
+	AST_VECTOR_INIT(&hint_new->device_states, 0);
 
 	/* Initialize new hint. */
 	hint_new->callbacks = ao2_container_alloc(1, NULL, hint_id_cmp);
@@ -5967,6 +7579,7 @@ static int ast_change_hint(struct ast_exten *oe, struct ast_exten *ne)
 	/* Update the hint and put it back in the hints container. */
 	ao2_lock(hint);
 	hint->exten = ne;
+	AST_VECTOR_RESET(&hint->device_states, AST_VECTOR_ELEM_CLEANUP_NOOP);
 
 	/* Store the previous states so we know whether we need to notify state callbacks */
 	previous_device_state = hint->laststate;
@@ -6545,6 +8158,7 @@ static enum ast_pbx_result __ast_pbx_run(struct ast_channel *c,
 	}
 
 	ast_channel_pbx_set(c, pbx);
+	ast_channel_setup_stage_mark(c, AST_CHANNEL_SETUP_DIALPLAN);
 	/* Set reasonable defaults */
 	ast_channel_pbx(c)->rtimeoutms = 10000;
 	ast_channel_pbx(c)->dtimeoutms = 5000;
@@ -6878,6 +8492,7 @@ static void destroy_exten(struct ast_exten *e)
 		ast_hashtab_destroy(e->peer_label_table, 0);
 	if (e->datad)
 		e->datad(e->data);
+	ao2_cleanup(e->data_template);
 	ast_free(e);
 }
 
@@ -6893,6 +8508,7 @@ static void *pbx_thread(void *data)
 	 */
 	struct ast_channel *c = data;
 
+	ast_thread_affinity_apply(AST_THREAD_CLASS_PBX);
 	__ast_pbx_run(c, NULL);
 	decrease_call_count();
 
@@ -6977,6 +8593,33 @@ int pbx_set_extenpatternmatchnew(int newval)
 	return oldval;
 }
 
+int pbx_set_extenpatterncompile(int newval)
+{
+	int oldval = extenpatterncompile;
+	extenpatterncompile = newval;
+	return oldval;
+}
+
+int pbx_set_hint_coalesce(int newval)
+{
+	int oldval = hint_coalesce_ms;
+
+	if (newval > 0 && !hints_sched) {
+		struct ast_sched_context *sched = ast_sched_context_create();
+
+		if (!sched || ast_sched_start_thread(sched)) {
+			ast_log(LOG_WARNING, "Unable to start the hint scheduler; hint state changes will not be coalesced\n");
+			if (sched) {
+				ast_sched_context_destroy(sched);
+			}
+			return oldval;
+		}
+		hints_sched = sched;
+	}
+	hint_coalesce_ms = newval;
+	return oldval;
+}
+
 void pbx_set_overrideswitch(const char *newval)
 {
 	if (overrideswitch) {
@@ -6994,12 +8637,21 @@ void pbx_set_overrideswitch(const char *newval)
  * \retval found context or NULL if not found.
  */
 static struct ast_context *find_context(const char *context)
+{
+	return find_context_in(contexts_table, context);
+}
+
+/*!
+ * \brief lookup for a context with a given name in a table of contexts
+ * \retval found context or NULL if not found.
+ */
+static struct ast_context *find_context_in(struct ast_hashtab *table, const char *context)
 {
 	struct fake_context item;
 
 	ast_copy_string(item.name, context, sizeof(item.name));
 
-	return ast_hashtab_lookup(contexts_table, &item);
+	return ast_hashtab_lookup(table, &item);
 }
 
 /*!
@@ -7058,6 +8710,8 @@ int ast_context_remove_include2(struct ast_context *con, const char *include, co
 	int ret = -1;
 
 	ast_wrlock_context(con);
+	ast_atomic_fetchadd_int(&dialplan_generation, 1);
+	ast_atomic_fetchadd_int(&con->generation, 1);
 
 	/* find our include */
 	for (i = con->includes; i; pi = i, i = i->next) {
@@ -7115,6 +8769,8 @@ int ast_context_remove_switch2(struct ast_context *con, const char *sw, const ch
 	int ret = -1;
 
 	ast_wrlock_context(con);
+	ast_atomic_fetchadd_int(&dialplan_generation, 1);
+	ast_atomic_fetchadd_int(&con->generation, 1);
 
 	/* walk switches */
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&con->alts, i, list) {
@@ -7183,6 +8839,7 @@ int ast_context_remove_extension_callerid2(struct ast_context *con, const char *
 
 	if (!already_locked)
 		ast_wrlock_context(con);
+	ast_atomic_fetchadd_int(&con->generation, 1);
 
 #ifdef NEED_DEBUG
 	ast_verb(3,"Removing %s/%s/%d%s%s from trees, registrar=%s\n", con->name, extension, priority, matchcallerid ? "/" : "", matchcallerid ? callerid : "", registrar);
@@ -7367,15 +9024,63 @@ int ast_context_unlockmacro(const char *context)
 	return ret;
 }
 
+#ifdef AST_XML_DOCS
+/*! \internal
+ *  \brief Build the XML documentation of an application into its string fields.
+ */
+static void app_build_docs(struct ast_app *app)
+{
+	char *tmpxml;
+
+	/* load synopsis */
+	tmpxml = ast_xmldoc_build_synopsis("application", app->name, ast_module_name(app->module));
+	ast_string_field_set(app, synopsis, tmpxml);
+	ast_free(tmpxml);
+
+	/* load description */
+	tmpxml = ast_xmldoc_build_description("application", app->name, ast_module_name(app->module));
+	ast_string_field_set(app, description, tmpxml);
+	ast_free(tmpxml);
+
+	/* load syntax */
+	tmpxml = ast_xmldoc_build_syntax("application", app->name, ast_module_name(app->module));
+	ast_string_field_set(app, syntax, tmpxml);
+	ast_free(tmpxml);
+
+	/* load arguments */
+	tmpxml = ast_xmldoc_build_arguments("application", app->name, ast_module_name(app->module));
+	ast_string_field_set(app, arguments, tmpxml);
+	ast_free(tmpxml);
+
+	/* load seealso */
+	tmpxml = ast_xmldoc_build_seealso("application", app->name, ast_module_name(app->module));
+	ast_string_field_set(app, seealso, tmpxml);
+	ast_free(tmpxml);
+}
+#endif
+
+/*! \internal
+ *  \brief Build the documentation of an application about to be shown, if
+ *         it was left for later.
+ */
+static void app_docs(struct ast_app *app)
+{
+#ifdef AST_XML_DOCS
+	ast_mutex_lock(&lazy_docs_lock);
+	if (app->docs_pending) {
+		app_build_docs(app);
+		app->docs_pending = 0;
+	}
+	ast_mutex_unlock(&lazy_docs_lock);
+#endif
+}
+
 /*! \brief Dynamically register a new dial plan application */
 int ast_register_application2(const char *app, int (*execute)(struct ast_channel *, const char *), const char *synopsis, const char *description, void *mod)
 {
 	struct ast_app *tmp;
 	struct ast_app *cur;
 	int length;
-#ifdef AST_XML_DOCS
-	char *tmpxml;
-#endif
 
 	AST_RWLIST_WRLOCK(&apps);
 	cur = pbx_findapp_nolock(app);
@@ -7405,30 +9110,11 @@ int ast_register_application2(const char *app, int (*execute)(struct ast_channel
 #ifdef AST_XML_DOCS
 	/* Try to lookup the docs in our XML documentation database */
 	if (ast_strlen_zero(synopsis) && ast_strlen_zero(description)) {
-		/* load synopsis */
-		tmpxml = ast_xmldoc_build_synopsis("application", app, ast_module_name(tmp->module));
-		ast_string_field_set(tmp, synopsis, tmpxml);
-		ast_free(tmpxml);
-
-		/* load description */
-		tmpxml = ast_xmldoc_build_description("application", app, ast_module_name(tmp->module));
-		ast_string_field_set(tmp, description, tmpxml);
-		ast_free(tmpxml);
-
-		/* load syntax */
-		tmpxml = ast_xmldoc_build_syntax("application", app, ast_module_name(tmp->module));
-		ast_string_field_set(tmp, syntax, tmpxml);
-		ast_free(tmpxml);
-
-		/* load arguments */
-		tmpxml = ast_xmldoc_build_arguments("application", app, ast_module_name(tmp->module));
-		ast_string_field_set(tmp, arguments, tmpxml);
-		ast_free(tmpxml);
-
-		/* load seealso */
-		tmpxml = ast_xmldoc_build_seealso("application", app, ast_module_name(tmp->module));
-		ast_string_field_set(tmp, seealso, tmpxml);
-		ast_free(tmpxml);
+		if (ast_xmldoc_lazy()) {
+			tmp->docs_pending = 1;
+		} else {
+			app_build_docs(tmp);
+		}
 		tmp->docsrc = AST_XML_DOC;
 	} else {
 #endif
@@ -7494,6 +9180,8 @@ static void print_app_docs(struct ast_app *aa, int fd)
 {
 #ifdef AST_XML_DOCS
 	char *synopsis = NULL, *description = NULL, *arguments = NULL, *seealso = NULL;
+
+	app_docs(aa);
 	if (aa->docsrc == AST_XML_DOC) {
 		synopsis = ast_xmldoc_printable(S_OR(aa->synopsis, "Not available"), 1);
 		description = ast_xmldoc_printable(S_OR(aa->description, "Not available"), 1);
@@ -7934,6 +9622,7 @@ static char *handle_show_applications(struct ast_cli_entry *e, int cmd, struct a
 				total_match++;
 			}
 		} else if (describing) {
+			app_docs(aa);
 			if (aa->description) {
 				/* Match all words on command line */
 				int i;
@@ -7951,6 +9640,7 @@ static char *handle_show_applications(struct ast_cli_entry *e, int cmd, struct a
 		}
 
 		if (printapp) {
+			app_docs(aa);
 			ast_cli(a->fd,"  %20s: %s\n", aa->name, aa->synopsis ? aa->synopsis : "<Synopsis not available>");
 		}
 	}
@@ -8559,7 +10249,9 @@ static int manager_show_dialplan(struct mansession *s, const struct message *m)
 static char *handle_show_globals(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	int i = 0;
-	struct ast_var_t *newvariable;
+	struct ao2_container *vars;
+	struct global_var *var;
+	struct ao2_iterator it;
 
 	switch (cmd) {
 	case CLI_INIT:
@@ -8572,12 +10264,15 @@ static char *handle_show_globals(struct ast_cli_entry *e, int cmd, struct ast_cl
 		return NULL;
 	}
 
-	ast_rwlock_rdlock(&globalslock);
-	AST_LIST_TRAVERSE (&globals, newvariable, entries) {
-		i++;
-		ast_cli(a->fd, "   %s=%s\n", ast_var_name(newvariable), ast_var_value(newvariable));
+	if ((vars = ao2_global_obj_ref(globals))) {
+		it = ao2_iterator_init(vars, 0);
+		for (; (var = ao2_iterator_next(&it)); ao2_ref(var, -1)) {
+			i++;
+			ast_cli(a->fd, "   %s=%s\n", var->name, var->value);
+		}
+		ao2_iterator_destroy(&it);
+		ao2_ref(vars, -1);
 	}
-	ast_rwlock_unlock(&globalslock);
 	ast_cli(a->fd, "\n    -- %d variable(s)\n", i);
 
 	return CLI_SUCCESS;
@@ -8765,6 +10460,55 @@ static char *handle_unset_extenpatternmatchnew(struct ast_cli_entry *e, int cmd,
 	return CLI_SUCCESS;
 }
 
+static char *handle_show_compiled(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT "%-32.32s %8s %8s %8s %-5s\n"
+#define FORMAT2 "%-32.32s %8d %8d %8d %-5s\n"
+	struct ast_context *con;
+	int count = 0;
+	int x;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "dialplan show compiled";
+		e->usage =
+			"Usage: dialplan show compiled\n"
+			"       List the contexts compiled into automata, with their states,\n"
+			"       character classes and the contexts flattened into them.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, FORMAT, "Context", "States", "Classes", "Contexts", "Stale");
+	ast_rdlock_contexts();
+	for (con = contexts; con; con = con->next) {
+		struct pbx_dfa *dfa = con->dfa;
+		int stale;
+
+		if (!dfa) {
+			continue;
+		}
+		stale = dfa->generation != dialplan_generation;
+		for (x = 0; !stale && x < dfa->num_contexts; ++x) {
+			stale = dfa->contexts[x]->generation != dfa->context_generations[x];
+		}
+		ast_cli(a->fd, FORMAT2, con->name, dfa->num_states, dfa->num_classes,
+			dfa->num_contexts, AST_CLI_YESNO(stale));
+		++count;
+	}
+	ast_unlock_contexts();
+	ast_cli(a->fd, "%d compiled contexts\n", count);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
 /*
  * CLI entries for upper commands ...
  */
@@ -8792,6 +10536,7 @@ static struct ast_cli_entry pbx_cli[] = {
 	AST_CLI_DEFINE(handle_debug_dialplan, "Show fast extension pattern matching data structures"),
 	AST_CLI_DEFINE(handle_unset_extenpatternmatchnew, "Use the Old extension pattern matching algorithm."),
 	AST_CLI_DEFINE(handle_set_extenpatternmatchnew, "Use the New extension pattern matching algorithm."),
+	AST_CLI_DEFINE(handle_show_compiled, "Show contexts compiled into automata"),
 };
 
 static void unreference_cached_app(struct ast_app *app)
@@ -8870,6 +10615,7 @@ struct ast_context *ast_context_find_or_create(struct ast_context **extcontexts,
 		tmp = ast_hashtab_lookup(contexts_table, &search);
 		if (tmp) {
 			tmp->refcount++;
+			ast_atomic_fetchadd_int(&tmp->generation, 1);
 			ast_unlock_contexts();
 			return tmp;
 		}
@@ -8904,6 +10650,8 @@ struct ast_context *ast_context_find_or_create(struct ast_context **extcontexts,
 		tmp->next = *local_contexts;
 		*local_contexts = tmp;
 		ast_hashtab_insert_safe(contexts_table, tmp); /*put this context into the tree */
+		ast_atomic_fetchadd_int(&dialplan_generation, 1);
+		ast_atomic_fetchadd_int(&contexts_generation, 1);
 		ast_unlock_contexts();
 		ast_verb(3, "Registered extension context '%s'; registrar: %s\n", tmp->name, registrar);
 	} else {
@@ -8927,6 +10675,7 @@ struct store_hint {
 	int last_presence_state;
 	char *last_presence_subtype;
 	char *last_presence_message;
+	int pending;
 
 	AST_LIST_ENTRY(store_hint) list;
 	char data[1];
@@ -9057,6 +10806,151 @@ static void context_merge(struct ast_context **extcontexts, struct ast_hashtab *
 }
 
 
+/*! \brief An old context merged into a new dialplan, and how it was when merged */
+struct merged_context {
+	struct ast_context *old;	/*!< Only compared once the contexts are unlocked */
+	int generation;			/*!< The generation of the old context when merged */
+	int refcount;			/*!< The refcount of the new context before the merge, -1 if the merge made it */
+	unsigned int merged:1;
+	char name[0];
+};
+
+AST_VECTOR(merged_contexts, struct merged_context *);
+
+/*!
+ * \internal
+ * \brief Merge an old context into a new dialplan, if it is still in the dialplan
+ *
+ * \note Takes the contexts lock for just this one context.
+ */
+static void context_merge_one(struct ast_context **extcontexts, struct ast_hashtab *exttable,
+	struct merged_context *merged, int generation, const char *registrar)
+{
+	struct ast_context *new;
+
+	ast_wrlock_contexts();
+	/* A context removed since, or added again in its place, is left for the end */
+	if (contexts_generation == generation && find_context(merged->name) == merged->old) {
+		new = find_context_in(exttable, merged->name);
+		merged->generation = merged->old->generation;
+		merged->refcount = new ? new->refcount : -1;
+		merged->merged = 1;
+		context_merge(extcontexts, exttable, merged->old, registrar);
+	}
+	ast_unlock_contexts();
+}
+
+/*!
+ * \internal
+ * \brief Take out of a new context what merging an old context put there
+ *
+ * Everything the merge copies belongs to another registrar, and nothing the
+ * merge could not copy is taken out. A context the merge made is destroyed.
+ */
+static void context_unmerge(struct ast_context **extcontexts, struct ast_hashtab *exttable,
+	struct merged_context *merged, const char *registrar)
+{
+	struct ast_context *new = find_context_in(exttable, merged->name);
+	struct ast_context *tmp;
+	struct ast_context *tmpl = NULL;
+	struct ast_include *i, *pi = NULL, *ni;
+	struct ast_ignorepat *ip, *ipl = NULL, *ipn;
+	struct ast_sw *sw;
+	struct ast_hashtab_iter *exten_iter;
+	struct ast_exten *exten_item;
+	struct ast_exten *prio_item;
+	AST_VECTOR(, struct ast_exten *) foreign;
+	int x;
+
+	if (!new || !merged->merged) {
+		return;
+	}
+
+	if (merged->refcount < 0) {
+		for (tmp = *extcontexts; tmp && tmp != new; tmpl = tmp, tmp = tmp->next) {
+		}
+		if (tmpl) {
+			tmpl->next = new->next;
+		} else {
+			*extcontexts = new->next;
+		}
+		ast_hashtab_remove_this_object(exttable, new);
+		__ast_internal_context_destroy(new);
+		return;
+	}
+
+	ast_wrlock_context(new);
+	new->refcount = merged->refcount;
+
+	for (i = new->includes; i; i = ni) {
+		ni = i->next;
+		if (strcmp(i->registrar, registrar)) {
+			if (pi) {
+				pi->next = ni;
+			} else {
+				new->includes = ni;
+			}
+			ast_destroy_timing(&i->timing);
+			ast_free(i);
+			continue;
+		}
+		pi = i;
+	}
+	for (ip = new->ignorepats; ip; ip = ipn) {
+		ipn = ip->next;
+		if (strcmp(ip->registrar, registrar)) {
+			if (ipl) {
+				ipl->next = ipn;
+			} else {
+				new->ignorepats = ipn;
+			}
+			ast_free(ip);
+			continue;
+		}
+		ipl = ip;
+	}
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&new->alts, sw, list) {
+		if (strcmp(sw->registrar, registrar)) {
+			AST_LIST_REMOVE_CURRENT(list);
+			ast_free(sw);
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+
+	/* Removing a priority can destroy the table holding it, so find them all first */
+	AST_VECTOR_INIT(&foreign, 0);
+	if (new->root_table) {
+		exten_iter = ast_hashtab_start_traversal(new->root_table);
+		while ((exten_item = ast_hashtab_next(exten_iter))) {
+			struct ast_hashtab_iter *prio_iter = ast_hashtab_start_traversal(exten_item->peer_table);
+
+			while ((prio_item = ast_hashtab_next(prio_iter))) {
+				if (strcmp(prio_item->registrar, registrar)) {
+					AST_VECTOR_APPEND(&foreign, prio_item);
+				}
+			}
+			ast_hashtab_end_traversal(prio_iter);
+		}
+		ast_hashtab_end_traversal(exten_iter);
+	}
+	for (x = 0; x < AST_VECTOR_SIZE(&foreign); ++x) {
+		char extension[AST_MAX_EXTENSION];
+		char cidmatch[AST_MAX_EXTENSION] = "";
+
+		prio_item = AST_VECTOR_GET(&foreign, x);
+		ast_copy_string(extension, prio_item->exten, sizeof(extension));
+		if (prio_item->cidmatch) {
+			ast_copy_string(cidmatch, prio_item->cidmatch, sizeof(cidmatch));
+		}
+		ast_context_remove_extension_callerid2(new, extension, prio_item->priority,
+			cidmatch, prio_item->matchcid, NULL, 1);
+	}
+	AST_VECTOR_FREE(&foreign);
+
+	ast_unlock_context(new);
+}
+
+
 /* XXX this does not check that multiple contexts are merged */
 void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_hashtab *exttable, const char *registrar)
 {
@@ -9073,18 +10967,31 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	struct ast_state_cb *thiscb;
 	struct ast_hashtab_iter *iter;
 	struct ao2_iterator i;
+	struct merged_contexts merged;
+	struct merged_context *m;
+	int generation;
+	int compiled_generation;
+	int all = 0;
+	int changed = 0;
+	int x;
 	struct timeval begintime;
+	struct timeval lockedtime;
 	struct timeval writelocktime;
 	struct timeval endlocktime;
 	struct timeval enddeltime;
 
 	/*
+	 * The old dialplan is merged into the new one a context at a
+	 * time, holding the conlock for just that context, and the new
+	 * dialplan is compiled holding nothing, as nothing else can see
+	 * it yet.  Only then is the conlock held to merge again the
+	 * contexts that changed meanwhile and swap in the new dialplan.
+	 *
 	 * It is very important that this function hold the hints
-	 * container lock _and_ the conlock during its operation; not
-	 * only do we need to ensure that the list of contexts and
-	 * extensions does not change, but also that no hint callbacks
-	 * (watchers) are added or removed during the merge/delete
-	 * process
+	 * container lock _and_ the conlock for the swap; not only do we
+	 * need to ensure that the list of contexts and extensions does
+	 * not change, but also that no hint callbacks (watchers) are
+	 * added or removed while they move to the new dialplan
 	 *
 	 * In addition, the locks _must_ be taken in this order, because
 	 * there are already other code paths that use this order
@@ -9098,16 +11005,68 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 		/* Well, that's odd. There are no contexts. */
 		contexts_table = exttable;
 		contexts = *extcontexts;
+		pbx_compile_contexts(contexts, contexts_table);
 		ast_unlock_contexts();
 		ast_mutex_unlock(&context_merge_lock);
 		return;
 	}
 
+	/* Note each old context to merge it by itself */
+	AST_VECTOR_INIT(&merged, ast_hashtab_size(contexts_table));
+	generation = contexts_generation;
 	iter = ast_hashtab_start_traversal(contexts_table);
 	while ((tmp = ast_hashtab_next(iter))) {
-		context_merge(extcontexts, exttable, tmp, registrar);
+		if (!(m = ast_calloc(1, sizeof(*m) + strlen(tmp->name) + 1))
+			|| AST_VECTOR_APPEND(&merged, m)) {
+			ast_free(m);
+			all = 1;
+			break;
+		}
+		m->old = tmp;
+		strcpy(m->name, tmp->name); /* SAFE */
 	}
 	ast_hashtab_end_traversal(iter);
+	ast_unlock_contexts();
+
+	for (x = 0; !all && x < AST_VECTOR_SIZE(&merged) && contexts_generation == generation; ++x) {
+		context_merge_one(extcontexts, exttable, AST_VECTOR_GET(&merged, x), generation, registrar);
+	}
+
+	compiled_generation = dialplan_generation;
+	pbx_compile_contexts(*extcontexts, exttable);
+
+	ast_wrlock_contexts();
+	lockedtime = ast_tvnow();
+
+	/*
+	 * Merge again what changed since.  If contexts came or went, the
+	 * noted ones can no longer be trusted, so merge them all.
+	 */
+	if (all || contexts_generation != generation) {
+		for (x = 0; x < AST_VECTOR_SIZE(&merged); ++x) {
+			context_unmerge(extcontexts, exttable, AST_VECTOR_GET(&merged, x), registrar);
+		}
+		iter = ast_hashtab_start_traversal(contexts_table);
+		while ((tmp = ast_hashtab_next(iter))) {
+			context_merge(extcontexts, exttable, tmp, registrar);
+		}
+		ast_hashtab_end_traversal(iter);
+		changed = 1;
+	} else {
+		for (x = 0; x < AST_VECTOR_SIZE(&merged); ++x) {
+			m = AST_VECTOR_GET(&merged, x);
+			if (m->merged && m->old->generation == m->generation) {
+				continue;
+			}
+			ast_verb(3, "Context '%s' changed during the merge, merging it again\n", m->name);
+			context_unmerge(extcontexts, exttable, m, registrar);
+			context_merge(extcontexts, exttable, m->old, registrar);
+			changed = 1;
+		}
+	}
+	if (changed || dialplan_generation != compiled_generation) {
+		pbx_compile_contexts(*extcontexts, exttable);
+	}
 
 	ao2_lock(hints);
 	writelocktime = ast_tvnow();
@@ -9151,6 +11110,7 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 				saved_hint->last_presence_message = ast_strdup(hint->last_presence_message);
 			}
 			saved_hint->last_presence_state = hint->last_presence_state;
+			saved_hint->pending = hint->pending;
 			ao2_unlock(hint);
 			AST_LIST_INSERT_HEAD(&hints_stored, saved_hint, list);
 		}
@@ -9208,6 +11168,10 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 			hint->last_presence_subtype = saved_hint->last_presence_subtype;
 			hint->last_presence_message = saved_hint->last_presence_message;
 			ao2_unlock(hint);
+			if (saved_hint->pending) {
+				/* The old hint is gone so its watchers are notified by the new one */
+				hint_pending(hint);
+			}
 			ao2_ref(hint, -1);
 			/*
 			 * The free of saved_hint->last_presence_subtype and
@@ -9245,6 +11209,9 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	ast_mutex_unlock(&context_merge_lock);
 	endlocktime = ast_tvnow();
 
+	AST_VECTOR_CALLBACK_VOID(&merged, ast_free);
+	AST_VECTOR_FREE(&merged);
+
 	/*
 	 * The old list and hashtab no longer are relevant, delete them
 	 * while the rest of asterisk is now freely using the new stuff
@@ -9266,6 +11233,10 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	ft /= 1000000.0;
 	ast_verb(3,"Time to scan old dialplan and merge leftovers back into the new: %8.6f sec\n", ft);
 
+	ft = ast_tvdiff_us(endlocktime, lockedtime);
+	ft /= 1000000.0;
+	ast_verb(3,"Time the dialplan was locked: %8.6f sec\n", ft);
+
 	ft = ast_tvdiff_us(endlocktime, writelocktime);
 	ft /= 1000000.0;
 	ast_verb(3,"Time to restore hints and swap in new dialplan: %8.6f sec\n", ft);
@@ -9609,6 +11580,8 @@ int ast_context_add_include2(struct ast_context *con, const char *value,
 		il->next = new_include;
 	else
 		con->includes = new_include;
+	ast_atomic_fetchadd_int(&dialplan_generation, 1);
+	ast_atomic_fetchadd_int(&con->generation, 1);
 	ast_verb(3, "Including context '%s' in context '%s'\n", new_include->name, ast_get_context_name(con));
 
 	ast_unlock_context(con);
@@ -9689,6 +11662,8 @@ int ast_context_add_switch2(struct ast_context *con, const char *value,
 
 	/* ... sw new context into context list, unlock, return */
 	AST_LIST_INSERT_TAIL(&con->alts, new_sw, list);
+	ast_atomic_fetchadd_int(&dialplan_generation, 1);
+	ast_atomic_fetchadd_int(&con->generation, 1);
 
 	ast_verb(3, "Including switch '%s/%s' in context '%s'\n", new_sw->name, new_sw->data, ast_get_context_name(con));
 
@@ -9730,6 +11705,7 @@ int ast_context_remove_ignorepat2(struct ast_context *con, const char *ignorepat
 				con->ignorepats = ip->next;
 				ast_free(ip);
 			}
+			ast_atomic_fetchadd_int(&con->generation, 1);
 			ast_unlock_context(con);
 			return 0;
 		}
@@ -9792,6 +11768,7 @@ int ast_context_add_ignorepat2(struct ast_context *con, const char *value, const
 		ignorepatl->next = ignorepat;
 	else
 		con->ignorepats = ignorepat;
+	ast_atomic_fetchadd_int(&con->generation, 1);
 	ast_unlock_context(con);
 	return 0;
 
@@ -10260,10 +12237,18 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 	tmp->data = data;
 	tmp->datad = datad;
 	tmp->registrar = registrar;
+	if (priority != PRIORITY_HINT && data) {
+		const char *dollar = strchr(data, '$');
+
+		if (dollar && (strstr(dollar, "${") || strstr(dollar, "$["))) {
+			tmp->data_template = subst_template_build(data);
+		}
+	}
 
 	if (lock_context) {
 		ast_wrlock_context(con);
 	}
+	ast_atomic_fetchadd_int(&con->generation, 1);
 
 	if (con->pattern_tree) { /* usually, on initial load, the pattern_tree isn't formed until the first find_exten; so if we are adding
 								an extension, and the trie exists, then we need to incrementally add this pattern to it. */
@@ -10837,6 +12822,7 @@ static void __ast_internal_context_destroy( struct ast_context *con)
 	/* and destroy the pattern tree */
 	if (tmp->pattern_tree)
 		destroy_pattern_tree(tmp->pattern_tree);
+	pbx_dfa_destroy(tmp->dfa);
 
 	while ((sw = AST_LIST_REMOVE_HEAD(&tmp->alts, list)))
 		ast_free(sw);
@@ -10862,6 +12848,9 @@ void __ast_context_destroy(struct ast_context *list, struct ast_hashtab *context
 	struct ast_context *tmp, *tmpl=NULL;
 	struct ast_exten *exten_item, *prio_item;
 
+	ast_atomic_fetchadd_int(&dialplan_generation, 1);
+	ast_atomic_fetchadd_int(&contexts_generation, 1);
+
 	for (tmp = list; tmp; ) {
 		struct ast_context *next = NULL;	/* next starting point */
 			/* The following code used to skip forward to the next
@@ -11644,37 +13633,26 @@ int pbx_builtin_serialize_variables(struct ast_channel *chan, struct ast_str **b
 const char *pbx_builtin_getvar_helper(struct ast_channel *chan, const char *name)
 {
 	struct ast_var_t *variables;
+	struct global_var *global;
 	const char *ret = NULL;
-	int i;
-	struct varshead *places[2] = { NULL, &globals };
 
 	if (!name)
 		return NULL;
 
 	if (chan) {
 		ast_channel_lock(chan);
-		places[0] = ast_channel_varshead(chan);
-	}
-
-	for (i = 0; i < 2; i++) {
-		if (!places[i])
-			continue;
-		if (places[i] == &globals)
-			ast_rwlock_rdlock(&globalslock);
-		AST_LIST_TRAVERSE(places[i], variables, entries) {
-			if (!strcmp(name, ast_var_name(variables))) {
-				ret = ast_var_value(variables);
-				break;
-			}
+		variables = ast_var_index_find(ast_channel_var_index(chan), ast_channel_varshead(chan), name);
+		if (variables) {
+			ret = ast_var_value(variables);
 		}
-		if (places[i] == &globals)
-			ast_rwlock_unlock(&globalslock);
-		if (ret)
-			break;
+		ast_channel_unlock(chan);
 	}
 
-	if (chan)
-		ast_channel_unlock(chan);
+	if (!ret && (global = global_var_find(name))) {
+		/* Like a channel variable, the value lasts until the variable is set again */
+		ret = global->value;
+		ao2_ref(global, -1);
+	}
 
 	return ret;
 }
@@ -11683,6 +13661,7 @@ void pbx_builtin_pushvar_helper(struct ast_channel *chan, const char *name, cons
 {
 	struct ast_var_t *newvariable;
 	struct varshead *headp;
+	struct ast_var_index *index = NULL;
 
 	if (name[strlen(name)-1] == ')') {
 		char *function = ast_strdupa(name);
@@ -11692,30 +13671,30 @@ void pbx_builtin_pushvar_helper(struct ast_channel *chan, const char *name, cons
 		return;
 	}
 
-	if (chan) {
-		ast_channel_lock(chan);
-		headp = ast_channel_varshead(chan);
-	} else {
-		ast_rwlock_wrlock(&globalslock);
-		headp = &globals;
+	if (!chan) {
+		globals_set(name, value, 1);
+		return;
 	}
 
+	ast_channel_lock(chan);
+	headp = ast_channel_varshead(chan);
+	index = ast_channel_var_index(chan);
+
 	if (value && (newvariable = ast_var_assign(name, value))) {
-		if (headp == &globals)
-			ast_verb(2, "Setting global variable '%s' to '%s'\n", name, value);
-		AST_LIST_INSERT_HEAD(headp, newvariable, entries);
+		ast_var_index_insert_head(index, headp, newvariable);
+		if (!strcmp(ast_var_name(newvariable), "SPYGROUP")) {
+			ast_channel_internal_index_spygroup_update(chan);
+		}
 	}
 
-	if (chan)
-		ast_channel_unlock(chan);
-	else
-		ast_rwlock_unlock(&globalslock);
+	ast_channel_unlock(chan);
 }
 
 int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const char *value)
 {
 	struct ast_var_t *newvariable;
 	struct varshead *headp;
+	struct ast_var_index *index = NULL;
 	const char *nametail = name;
 	/*! True if the old value was not an empty string. */
 	int old_value_existed = 0;
@@ -11726,14 +13705,21 @@ int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const
 		return ast_func_write(chan, function, value);
 	}
 
-	if (chan) {
-		ast_channel_lock(chan);
-		headp = ast_channel_varshead(chan);
-	} else {
-		ast_rwlock_wrlock(&globalslock);
-		headp = &globals;
+	if (!chan) {
+		old_value_existed = globals_set(name, value, 0);
+		if (value) {
+			ast_channel_publish_varset(NULL, name, value);
+		} else if (old_value_existed) {
+			/* We just deleted a non-empty dialplan variable. */
+			ast_channel_publish_varset(NULL, name, "");
+		}
+		return 0;
 	}
 
+	ast_channel_lock(chan);
+	headp = ast_channel_varshead(chan);
+	index = ast_channel_var_index(chan);
+
 	/* For comparison purposes, we have to strip leading underscores */
 	if (*nametail == '_') {
 		nametail++;
@@ -11741,32 +13727,27 @@ int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const
 			nametail++;
 	}
 
-	AST_LIST_TRAVERSE_SAFE_BEGIN(headp, newvariable, entries) {
-		if (strcmp(ast_var_name(newvariable), nametail) == 0) {
-			/* there is already such a variable, delete it */
-			AST_LIST_REMOVE_CURRENT(entries);
-			old_value_existed = !ast_strlen_zero(ast_var_value(newvariable));
-			ast_var_delete(newvariable);
-			break;
-		}
+	newvariable = ast_var_index_find(index, headp, nametail);
+	if (newvariable) {
+		/* there is already such a variable, delete it */
+		ast_var_index_remove(index, headp, newvariable);
+		old_value_existed = !ast_strlen_zero(ast_var_value(newvariable));
+		ast_var_delete(newvariable);
 	}
-	AST_LIST_TRAVERSE_SAFE_END;
 
 	if (value && (newvariable = ast_var_assign(name, value))) {
-		if (headp == &globals) {
-			ast_verb(2, "Setting global variable '%s' to '%s'\n", name, value);
-		}
-		AST_LIST_INSERT_HEAD(headp, newvariable, entries);
+		ast_var_index_insert_head(index, headp, newvariable);
 		ast_channel_publish_varset(chan, name, value);
 	} else if (old_value_existed) {
 		/* We just deleted a non-empty dialplan variable. */
 		ast_channel_publish_varset(chan, name, "");
 	}
 
-	if (chan)
-		ast_channel_unlock(chan);
-	else
-		ast_rwlock_unlock(&globalslock);
+	if (!strcmp(nametail, "SPYGROUP")) {
+		ast_channel_internal_index_spygroup_update(chan);
+	}
+
+	ast_channel_unlock(chan);
 	return 0;
 }
 
@@ -11874,12 +13855,9 @@ static int pbx_builtin_noop(struct ast_channel *chan, const char *data)
 
 void pbx_builtin_clear_globals(void)
 {
-	struct ast_var_t *vardata;
-
-	ast_rwlock_wrlock(&globalslock);
-	while ((vardata = AST_LIST_REMOVE_HEAD(&globals, entries)))
-		ast_var_delete(vardata);
-	ast_rwlock_unlock(&globalslock);
+	ast_mutex_lock(&globalslock);
+	ao2_global_obj_release(globals);
+	ast_mutex_unlock(&globalslock);
 }
 
 int pbx_checkcondition(const char *condition)
@@ -12750,6 +14728,12 @@ static int statecbs_cmp(void *obj, void *arg, int flags)
  */
 static void pbx_shutdown(void)
 {
+	if (hints_sched) {
+		ast_sched_context_destroy(hints_sched);
+		hints_sched = NULL;
+	}
+	AST_VECTOR_CALLBACK_VOID(&hints_pending, ao2_cleanup);
+	AST_VECTOR_FREE(&hints_pending);
 	if (hints) {
 		ao2_container_unregister("hints");
 		ao2_ref(hints, -1);
@@ -12810,7 +14794,8 @@ int ast_pbx_init(void)
 	if (hints) {
 		ao2_container_register("hints", hints, print_hints_key);
 	}
-	hintdevices = ao2_container_alloc(HASH_EXTENHINT_SIZE, hintdevice_hash_cb, hintdevice_cmp_multiple);
+	hintdevices = ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		HASH_EXTENHINT_SIZE, hintdevice_hash_cb, NULL, hintdevice_cmp_multiple);
 	if (hintdevices) {
 		ao2_container_register("hintdevices", hintdevices, print_hintdevices_key);
 	}
@@ -297,7 +297,7 @@ static int send_call_pickup_stasis_message(struct ast_channel *picking_up, struc
 		return -1;
 	}
 
-	stasis_publish(ast_channel_topic(picking_up), msg);
+	ast_channel_publish_message(picking_up, msg);
 	return 0;
 }
 
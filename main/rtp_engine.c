@@ -133,6 +133,34 @@
 			</syntax>
 		</managerEventInstance>
 	</managerEvent>
+	<managerEvent language="en_US" name="RTPQualitySummary">
+		<managerEventInstance class="EVENT_FLAG_REPORTING">
+			<synopsis>Raised once per window with the media quality of the RTCP reports received in it.</synopsis>
+			<syntax>
+				<parameter name="WindowStart">
+					<para>When the window started, in seconds since the epoch</para>
+				</parameter>
+				<parameter name="WindowSeconds">
+					<para>The length of the window in seconds</para>
+				</parameter>
+				<parameter name="EndpointCount">
+					<para>The number of EndpointX headers in the message.</para>
+				</parameter>
+				<parameter name="EndpointX">
+					<para>The quality for one endpoint, as
+					<literal>name samples=N jitter=mean/p95/max loss=mean/p95/max rtt=mean/p95/max</literal>.
+					Jitter and RTT are in milliseconds and loss in percent.</para>
+				</parameter>
+				<parameter name="HostCount">
+					<para>The number of HostX headers in the message.</para>
+				</parameter>
+				<parameter name="HostX">
+					<para>The quality for the media from one remote host, in the
+					same form as EndpointX.</para>
+				</parameter>
+			</syntax>
+		</managerEventInstance>
+	</managerEvent>
  ***/
 
 #include "asterisk.h"
@@ -146,6 +174,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/module.h"
 #include "asterisk/rtp_engine.h"
 #include "asterisk/manager.h"
+#include "asterisk/metrics.h"
 #include "asterisk/options.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/pbx.h"
@@ -156,6 +185,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/stasis.h"
 #include "asterisk/json.h"
 #include "asterisk/stasis_channels.h"
+#include "asterisk/sched.h"
 
 struct ast_srtp_res *res_srtp = NULL;
 struct ast_srtp_policy_res *res_srtp_policy = NULL;
@@ -194,6 +224,8 @@ struct ast_rtp_instance {
 	time_t last_tx;
 	/*! Time of last packet received */
 	time_t last_rx;
+	/*! Endpoint the media quality of the instance is counted for */
+	char quality_endpoint[AST_CHANNEL_NAME];
 };
 
 /*! List of RTP engines that are currently registered */
@@ -448,6 +480,7 @@ const char *ast_rtp_instance_get_channel_id(struct ast_rtp_instance *instance)
 void ast_rtp_instance_set_channel_id(struct ast_rtp_instance *instance, const char *uniqueid)
 {
 	ast_copy_string(instance->channel_uniqueid, uniqueid, sizeof(instance->channel_uniqueid));
+	instance->quality_endpoint[0] = '\0';
 }
 
 void ast_rtp_instance_set_data(struct ast_rtp_instance *instance, void *data)
@@ -2052,6 +2085,101 @@ int ast_rtp_engine_srtp_is_registered(void)
 	return res_srtp && res_srtp_policy;
 }
 
+/*! \brief The registered RTP forwarder */
+static struct ast_rtp_forwarder *rtp_forwarder;
+AST_RWLOCK_DEFINE_STATIC(rtp_forwarder_lock);
+
+struct ast_rtp_forward {
+	/*! The forwarder doing the forwarding */
+	struct ast_rtp_forwarder *forwarder;
+	/*! Data of the forwarder */
+	void *data;
+};
+
+int ast_rtp_engine_register_forwarder2(struct ast_rtp_forwarder *forwarder, struct ast_module *module)
+{
+	int res = -1;
+
+	if (!forwarder || !forwarder->start || !forwarder->stop || !forwarder->stats) {
+		return -1;
+	}
+
+	ast_rwlock_wrlock(&rtp_forwarder_lock);
+	if (!rtp_forwarder) {
+		forwarder->mod = module;
+		rtp_forwarder = forwarder;
+		res = 0;
+	}
+	ast_rwlock_unlock(&rtp_forwarder_lock);
+
+	if (!res) {
+		ast_verb(2, "Registered RTP forwarder '%s'\n", forwarder->name);
+	}
+
+	return res;
+}
+
+void ast_rtp_engine_unregister_forwarder(struct ast_rtp_forwarder *forwarder)
+{
+	ast_rwlock_wrlock(&rtp_forwarder_lock);
+	if (rtp_forwarder == forwarder) {
+		rtp_forwarder = NULL;
+	}
+	ast_rwlock_unlock(&rtp_forwarder_lock);
+}
+
+int ast_rtp_engine_forwarder_is_registered(void)
+{
+	return rtp_forwarder != NULL;
+}
+
+struct ast_rtp_forward *ast_rtp_forward_start(const struct ast_sockaddr *from_remote,
+	const struct ast_sockaddr *from_local, const struct ast_sockaddr *to_local,
+	const struct ast_sockaddr *to_remote)
+{
+	struct ast_rtp_forward *forward;
+
+	if (!(forward = ast_calloc(1, sizeof(*forward)))) {
+		return NULL;
+	}
+
+	ast_rwlock_rdlock(&rtp_forwarder_lock);
+	if (rtp_forwarder) {
+		forward->forwarder = rtp_forwarder;
+		ast_module_ref(forward->forwarder->mod);
+	}
+	ast_rwlock_unlock(&rtp_forwarder_lock);
+
+	if (!forward->forwarder) {
+		ast_free(forward);
+		return NULL;
+	}
+
+	if (!(forward->data = forward->forwarder->start(from_remote, from_local, to_local, to_remote))) {
+		ast_module_unref(forward->forwarder->mod);
+		ast_free(forward);
+		return NULL;
+	}
+
+	return forward;
+}
+
+void ast_rtp_forward_stop(struct ast_rtp_forward *forward)
+{
+	if (!forward) {
+		return;
+	}
+
+	forward->forwarder->stop(forward->data);
+	ast_module_unref(forward->forwarder->mod);
+	ast_free(forward);
+}
+
+void ast_rtp_forward_stats(struct ast_rtp_forward *forward, unsigned int *packets, unsigned int *octets)
+{
+	forward->forwarder->stats(forward->data, packets, octets);
+}
+
 int ast_rtp_instance_add_srtp_policy(struct ast_rtp_instance *instance, struct ast_srtp_policy *remote_policy, struct ast_srtp_policy *local_policy)
 {
 	int res = 0;
@@ -2572,6 +2700,386 @@ void ast_rtp_publish_rtcp_message(struct ast_rtp_instance *rtp,
 	stasis_publish(ast_rtp_topic(), message);
 }
 
+/*! Buckets of a media quality histogram, the last one for anything above the bounds */
+#define QUALITY_BUCKETS 7
+
+/*! Upper bounds of the jitter buckets, in milliseconds */
+static const double quality_jitter_bounds[QUALITY_BUCKETS - 1] = { 5, 10, 20, 30, 50, 100 };
+/*! Upper bounds of the loss buckets, in percent */
+static const double quality_loss_bounds[QUALITY_BUCKETS - 1] = { 0, 1, 2, 5, 10, 20 };
+/*! Upper bounds of the round trip time buckets, in milliseconds */
+static const double quality_rtt_bounds[QUALITY_BUCKETS - 1] = { 50, 100, 150, 250, 400, 1000 };
+
+/*! \brief One media quality metric over a window */
+struct rtp_quality_metric {
+	unsigned int count;
+	double sum;
+	double max;
+	unsigned int buckets[QUALITY_BUCKETS];
+};
+
+/*! \brief The media quality of an endpoint or a host over a window */
+struct rtp_quality_summary {
+	struct rtp_quality_metric jitter;
+	struct rtp_quality_metric loss;
+	struct rtp_quality_metric rtt;
+	char name[0];
+};
+
+#define QUALITY_BUCKETS_ENDPOINTS 127
+#define QUALITY_BUCKETS_HOSTS 127
+
+/*! Protects the summaries of the current window */
+AST_MUTEX_DEFINE_STATIC(quality_lock);
+/*! Summaries of the current window, by endpoint */
+static struct ao2_container *quality_endpoints;
+/*! Summaries of the current window, by remote host */
+static struct ao2_container *quality_hosts;
+/*! When the current window started */
+static struct timeval quality_window_start;
+/*! Length of a window in seconds, 0 when not summarising */
+static unsigned int quality_window;
+/*! Scheduler ending the windows */
+static struct ast_sched_context *quality_sched;
+/*! Scheduler id of the end of the current window */
+static int quality_sched_id = -1;
+
+/*! Upper bounds of the jitter metric buckets, in seconds */
+static const double quality_jitter_metric_bounds[] = { 0.005, 0.01, 0.02, 0.03, 0.05, 0.1 };
+/*! Upper bounds of the loss metric buckets, as a ratio */
+static const double quality_loss_metric_bounds[] = { 0, 0.01, 0.02, 0.05, 0.1, 0.2 };
+/*! Upper bounds of the round trip time metric buckets, in seconds */
+static const double quality_rtt_metric_bounds[] = { 0.05, 0.1, 0.15, 0.25, 0.4, 1 };
+
+/*! Jitter of all received reception reports, whether or not summarising */
+static struct ast_metric *quality_jitter_metric;
+/*! Loss of all received reception reports */
+static struct ast_metric *quality_loss_metric;
+/*! Round trip time of all received reception reports that had one */
+static struct ast_metric *quality_rtt_metric;
+
+static int quality_summary_hash_fn(const void *obj, const int flags)
+{
+	const struct rtp_quality_summary *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->name;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int quality_summary_cmp_fn(void *obj, void *arg, int flags)
+{
+	const struct rtp_quality_summary *object_left = obj;
+	const struct rtp_quality_summary *object_right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->name;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(object_left->name, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+static void quality_metric_add(struct rtp_quality_metric *metric, const double *bounds, double value)
+{
+	int i;
+
+	for (i = 0; i < QUALITY_BUCKETS - 1; ++i) {
+		if (value <= bounds[i]) {
+			break;
+		}
+	}
+	++metric->buckets[i];
+	++metric->count;
+	metric->sum += value;
+	if (value > metric->max) {
+		metric->max = value;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Estimate the 95th percentile of a metric from its histogram
+ *
+ * \return The upper bound of the bucket the percentile falls in, the largest
+ * value seen if that is the last bucket.
+ */
+static double quality_metric_p95(const struct rtp_quality_metric *metric, const double *bounds)
+{
+	unsigned int needed = (metric->count * 95 + 99) / 100;
+	unsigned int seen = 0;
+	int i;
+
+	for (i = 0; i < QUALITY_BUCKETS - 1; ++i) {
+		seen += metric->buckets[i];
+		if (seen >= needed) {
+			return MIN(bounds[i], metric->max);
+		}
+	}
+
+	return metric->max;
+}
+
+/*! \note Must be called with quality_lock held */
+static struct rtp_quality_summary *quality_summary_get(struct ao2_container *summaries, const char *name)
+{
+	struct rtp_quality_summary *summary;
+
+	if ((summary = ao2_find(summaries, name, OBJ_SEARCH_KEY | OBJ_NOLOCK))) {
+		return summary;
+	}
+
+	if (!(summary = ao2_alloc_options(sizeof(*summary) + strlen(name) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return NULL;
+	}
+	strcpy(summary->name, name); /* Safe */
+	ao2_link_flags(summaries, summary, OBJ_NOLOCK);
+
+	return summary;
+}
+
+/*! \note Must be called with quality_lock held */
+static void quality_summary_add(struct ao2_container *summaries, const char *name,
+	double jitter, double loss, double rtt)
+{
+	struct rtp_quality_summary *summary;
+
+	if (!(summary = quality_summary_get(summaries, name))) {
+		return;
+	}
+
+	quality_metric_add(&summary->jitter, quality_jitter_bounds, jitter);
+	quality_metric_add(&summary->loss, quality_loss_bounds, loss);
+	if (rtt >= 0) {
+		quality_metric_add(&summary->rtt, quality_rtt_bounds, rtt);
+	}
+
+	ao2_ref(summary, -1);
+}
+
+void ast_rtp_instance_quality_sample(struct ast_rtp_instance *instance, double jitter,
+	unsigned int fraction_lost, double rtt)
+{
+	struct ast_sockaddr remote_address;
+	double loss = fraction_lost * 100.0 / 256;
+	const char *host;
+
+	ast_metric_observe(quality_jitter_metric, jitter / 1000);
+	ast_metric_observe(quality_loss_metric, loss / 100);
+	if (rtt >= 0) {
+		ast_metric_observe(quality_rtt_metric, rtt / 1000);
+	}
+
+	if (!quality_window) {
+		return;
+	}
+
+	/* The endpoint is the channel name without the suffix making it unique */
+	if (!instance->quality_endpoint[0] && !ast_strlen_zero(instance->channel_uniqueid)) {
+		struct ast_channel_snapshot *snapshot;
+		char *dash;
+
+		if ((snapshot = ast_channel_snapshot_get_latest(instance->channel_uniqueid))) {
+			ast_copy_string(instance->quality_endpoint, snapshot->name, sizeof(instance->quality_endpoint));
+			if ((dash = strrchr(instance->quality_endpoint, '-'))) {
+				*dash = '\0';
+			}
+			ao2_ref(snapshot, -1);
+		}
+	}
+
+	ast_rtp_instance_get_remote_address(instance, &remote_address);
+	host = ast_sockaddr_isnull(&remote_address) ? NULL : ast_sockaddr_stringify_host(&remote_address);
+
+	ast_mutex_lock(&quality_lock);
+	if (quality_endpoints && instance->quality_endpoint[0]) {
+		quality_summary_add(quality_endpoints, instance->quality_endpoint, jitter, loss, rtt);
+	}
+	if (quality_hosts && host) {
+		quality_summary_add(quality_hosts, host, jitter, loss, rtt);
+	}
+	ast_mutex_unlock(&quality_lock);
+}
+
+static struct ast_json *quality_metric_to_json(const struct rtp_quality_metric *metric, const double *bounds)
+{
+	struct ast_json *buckets = ast_json_array_create();
+	int i;
+
+	if (!buckets) {
+		return NULL;
+	}
+	for (i = 0; i < QUALITY_BUCKETS; ++i) {
+		ast_json_array_append(buckets, ast_json_integer_create(metric->buckets[i]));
+	}
+
+	return ast_json_pack("{s: i, s: f, s: f, s: f, s: o}",
+		"samples", metric->count,
+		"mean", metric->count ? metric->sum / metric->count : 0.0,
+		"p95", quality_metric_p95(metric, bounds),
+		"max", metric->max,
+		"buckets", buckets);
+}
+
+static struct ast_json *quality_summaries_to_json(struct ao2_container *summaries)
+{
+	struct ast_json *json = ast_json_array_create();
+	struct ao2_iterator iter;
+	struct rtp_quality_summary *summary;
+
+	if (!json) {
+		return NULL;
+	}
+
+	iter = ao2_iterator_init(summaries, 0);
+	for (; (summary = ao2_iterator_next(&iter)); ao2_ref(summary, -1)) {
+		ast_json_array_append(json, ast_json_pack("{s: s, s: o, s: o, s: o}",
+			"name", summary->name,
+			"jitter", quality_metric_to_json(&summary->jitter, quality_jitter_bounds),
+			"loss", quality_metric_to_json(&summary->loss, quality_loss_bounds),
+			"rtt", quality_metric_to_json(&summary->rtt, quality_rtt_bounds)));
+	}
+	ao2_iterator_destroy(&iter);
+
+	return json;
+}
+
+/*!
+ * \internal
+ * \brief End the current window, publishing one summary of it
+ */
+static int quality_window_end(const void *data)
+{
+	struct ao2_container *endpoints, *hosts;
+	struct timeval start;
+	unsigned int window;
+	RAII_VAR(struct ast_json *, blob, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json_payload *, payload, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, message, NULL, ao2_cleanup);
+
+	/* Start the next window before the reports of this one are published */
+	ast_mutex_lock(&quality_lock);
+	endpoints = quality_endpoints;
+	hosts = quality_hosts;
+	start = quality_window_start;
+	window = quality_window;
+	if (window) {
+		quality_endpoints = ao2_container_alloc(QUALITY_BUCKETS_ENDPOINTS, quality_summary_hash_fn, quality_summary_cmp_fn);
+		quality_hosts = ao2_container_alloc(QUALITY_BUCKETS_HOSTS, quality_summary_hash_fn, quality_summary_cmp_fn);
+		quality_window_start = ast_tvnow();
+	} else {
+		quality_endpoints = NULL;
+		quality_hosts = NULL;
+		quality_sched_id = -1;
+	}
+	ast_mutex_unlock(&quality_lock);
+
+	if (endpoints && hosts && (ao2_container_count(endpoints) || ao2_container_count(hosts))
+		&& ast_rtp_quality_summary_type()) {
+		blob = ast_json_pack("{s: o, s: i, s: o, s: o}",
+			"window_start", ast_json_timeval(start, NULL),
+			"window_seconds", (int) ast_tvdiff_sec(ast_tvnow(), start),
+			"endpoints", quality_summaries_to_json(endpoints),
+			"hosts", quality_summaries_to_json(hosts));
+		if (blob && (payload = ast_json_payload_create(blob))
+			&& (message = stasis_message_create(ast_rtp_quality_summary_type(), payload))) {
+			stasis_publish(ast_rtp_topic(), message);
+		}
+	}
+
+	ao2_cleanup(endpoints);
+	ao2_cleanup(hosts);
+
+	return window * 1000;
+}
+
+void ast_rtp_quality_set_window(unsigned int seconds)
+{
+	ast_mutex_lock(&quality_lock);
+	quality_window = seconds;
+	/* A running window ends at its old length and the next one has the new one */
+	if (seconds && quality_sched_id == -1 && quality_sched) {
+		quality_endpoints = ao2_container_alloc(QUALITY_BUCKETS_ENDPOINTS, quality_summary_hash_fn, quality_summary_cmp_fn);
+		quality_hosts = ao2_container_alloc(QUALITY_BUCKETS_HOSTS, quality_summary_hash_fn, quality_summary_cmp_fn);
+		quality_window_start = ast_tvnow();
+		quality_sched_id = ast_sched_add_variable(quality_sched, seconds * 1000, quality_window_end, NULL, 1);
+	}
+	ast_mutex_unlock(&quality_lock);
+}
+
+static void quality_metric_to_ami(struct ast_str **str, const char *name, struct ast_json *metric)
+{
+	ast_str_append(str, 0, " %s=%.1f/%.1f/%.1f", name,
+		ast_json_real_get(ast_json_object_get(metric, "mean")),
+		ast_json_real_get(ast_json_object_get(metric, "p95")),
+		ast_json_real_get(ast_json_object_get(metric, "max")));
+}
+
+static void quality_summaries_to_ami(struct ast_str **str, const char *header, struct ast_json *summaries)
+{
+	size_t i;
+
+	ast_str_append(str, 0, "%sCount: %zu\r\n", header, ast_json_array_size(summaries));
+	for (i = 0; i < ast_json_array_size(summaries); ++i) {
+		struct ast_json *summary = ast_json_array_get(summaries, i);
+		struct ast_json *jitter = ast_json_object_get(summary, "jitter");
+
+		ast_str_append(str, 0, "%s%zu: %s samples=%jd", header, i,
+			ast_json_string_get(ast_json_object_get(summary, "name")),
+			ast_json_integer_get(ast_json_object_get(jitter, "samples")));
+		quality_metric_to_ami(str, "jitter", jitter);
+		quality_metric_to_ami(str, "loss", ast_json_object_get(summary, "loss"));
+		quality_metric_to_ami(str, "rtt", ast_json_object_get(summary, "rtt"));
+		ast_str_append(str, 0, "\r\n");
+	}
+}
+
+static struct ast_manager_event_blob *quality_summary_to_ami(struct stasis_message *msg)
+{
+	struct ast_json_payload *payload = stasis_message_data(msg);
+	RAII_VAR(struct ast_str *, summary_string, ast_str_create(1024), ast_free);
+
+	if (!summary_string) {
+		return NULL;
+	}
+
+	ast_str_append(&summary_string, 0, "WindowStart: %s\r\n",
+		ast_json_string_get(ast_json_object_get(payload->json, "window_start")));
+	ast_str_append(&summary_string, 0, "WindowSeconds: %jd\r\n",
+		ast_json_integer_get(ast_json_object_get(payload->json, "window_seconds")));
+	quality_summaries_to_ami(&summary_string, "Endpoint", ast_json_object_get(payload->json, "endpoints"));
+	quality_summaries_to_ami(&summary_string, "Host", ast_json_object_get(payload->json, "hosts"));
+
+	return ast_manager_event_blob_create(EVENT_FLAG_REPORTING, "RTPQualitySummary",
+		"%s", ast_str_buffer(summary_string));
+}
+
+static struct ast_json *quality_summary_to_json(struct stasis_message *msg,
+	const struct stasis_message_sanitizer *sanitize)
+{
+	struct ast_json_payload *payload = stasis_message_data(msg);
+
+	return ast_json_pack("{s: s, s: O}",
+		"type", "RTPQualitySummary",
+		"summary", payload->json);
+}
+
 /*!
  * @{ \brief Define RTCP/RTP message types.
  */
@@ -2581,6 +3089,9 @@ STASIS_MESSAGE_TYPE_DEFN(ast_rtp_rtcp_sent_type,
 STASIS_MESSAGE_TYPE_DEFN(ast_rtp_rtcp_received_type,
 		.to_ami = rtcp_report_to_ami,
 		.to_json = rtcp_report_to_json,);
+STASIS_MESSAGE_TYPE_DEFN(ast_rtp_quality_summary_type,
+		.to_ami = quality_summary_to_ami,
+		.to_json = quality_summary_to_json,);
 /*! @} */
 
 struct stasis_topic *ast_rtp_topic(void)
@@ -2592,10 +3103,27 @@ static void rtp_engine_shutdown(void)
 {
 	int x;
 
+	if (quality_sched) {
+		ast_sched_context_destroy(quality_sched);
+		quality_sched = NULL;
+	}
+	ao2_cleanup(quality_endpoints);
+	quality_endpoints = NULL;
+	ao2_cleanup(quality_hosts);
+	quality_hosts = NULL;
+
+	ast_metric_destroy(quality_jitter_metric);
+	quality_jitter_metric = NULL;
+	ast_metric_destroy(quality_loss_metric);
+	quality_loss_metric = NULL;
+	ast_metric_destroy(quality_rtt_metric);
+	quality_rtt_metric = NULL;
+
 	ao2_cleanup(rtp_topic);
 	rtp_topic = NULL;
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_rtp_rtcp_received_type);
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_rtp_rtcp_sent_type);
+	STASIS_MESSAGE_TYPE_CLEANUP(ast_rtp_quality_summary_type);
 
 	ast_rwlock_wrlock(&static_RTP_PT_lock);
 	for (x = 0; x < AST_RTP_MAX_PT; x++) {
@@ -2625,8 +3153,28 @@ int ast_rtp_engine_init(void)
 	}
 	STASIS_MESSAGE_TYPE_INIT(ast_rtp_rtcp_sent_type);
 	STASIS_MESSAGE_TYPE_INIT(ast_rtp_rtcp_received_type);
+	STASIS_MESSAGE_TYPE_INIT(ast_rtp_quality_summary_type);
+
+	if (!(quality_sched = ast_sched_context_create())) {
+		return -1;
+	}
+	if (ast_sched_start_thread(quality_sched)) {
+		ast_sched_context_destroy(quality_sched);
+		quality_sched = NULL;
+		return -1;
+	}
 	ast_register_cleanup(rtp_engine_shutdown);
 
+	quality_jitter_metric = ast_metric_histogram_create("asterisk_rtp_jitter_seconds",
+		"Interarrival jitter in received RTCP reception reports",
+		quality_jitter_metric_bounds, ARRAY_LEN(quality_jitter_metric_bounds));
+	quality_loss_metric = ast_metric_histogram_create("asterisk_rtp_loss_ratio",
+		"Fraction of packets lost in received RTCP reception reports",
+		quality_loss_metric_bounds, ARRAY_LEN(quality_loss_metric_bounds));
+	quality_rtt_metric = ast_metric_histogram_create("asterisk_rtp_rtt_seconds",
+		"Round trip time computed from received RTCP reception reports",
+		quality_rtt_metric_bounds, ARRAY_LEN(quality_rtt_metric_bounds));
+
 	/* Define all the RTP mime types available */
 	set_next_mime_type(ast_format_g723, 0, "audio", "G723", 8000);
 	set_next_mime_type(ast_format_gsm, 0, "audio", "GSM", 8000);
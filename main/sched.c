@@ -48,6 +48,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/lock.h"
 #include "asterisk/utils.h"
 #include "asterisk/heap.h"
+#include "asterisk/dlinkedlists.h"
 #include "asterisk/threadstorage.h"
 
 /*!
@@ -80,6 +81,14 @@ struct sched_id {
 
 struct sched {
 	AST_LIST_ENTRY(sched) list;
+	/*! Links the event into its timing wheel slot */
+	AST_DLLIST_ENTRY(sched) wheel_slot_list;
+	/*! Links the event into the list of all timing wheel events */
+	AST_DLLIST_ENTRY(sched) wheel_list;
+	/*! The timing wheel slot the event is in */
+	struct sched_wheel_slot *wheel_slot;
+	/*! The timing wheel tick the event expires on */
+	int64_t wheel_tick;
 	/*! The ID that has been popped off the scheduler context's queue */
 	struct sched_id *sched_id;
 	struct timeval when;          /*!< Absolute time event should take place */
@@ -87,6 +96,7 @@ struct sched {
 	int variable;                 /*!< Use return value from callback to reschedule */
 	const void *data;             /*!< Data */
 	ast_sched_cb callback;        /*!< Callback */
+	unsigned int key;             /*!< Selects the worker thread that runs the callback */
 	ssize_t __heap_index;
 	/*!
 	 * Used to synchronize between thread running a task and thread
@@ -97,9 +107,66 @@ struct sched {
 	unsigned int deleted:1;
 };
 
+/*! Number of bits of the expiry tick used to index each timing wheel level */
+#define SCHED_WHEEL_BITS 6
+/*! Number of slots in each timing wheel level */
+#define SCHED_WHEEL_SIZE (1 << SCHED_WHEEL_BITS)
+#define SCHED_WHEEL_MASK (SCHED_WHEEL_SIZE - 1)
+/*! Number of timing wheel levels. With 1ms ticks this covers over two years. */
+#define SCHED_WHEEL_LEVELS 6
+
+/*! \brief Number of ticks covered by one slot of the given timing wheel level */
+#define SCHED_WHEEL_GRANULARITY(level) (INT64_C(1) << (SCHED_WHEEL_BITS * (level)))
+
+struct sched_wheel_slot {
+	AST_DLLIST_HEAD_NOLOCK(, sched) events;
+	/*! The level of the wheel the slot belongs to */
+	unsigned int level;
+};
+
+/*!
+ * \brief Hashed hierarchical timing wheel
+ *
+ * Each tick is one millisecond since the wheel was created. Level 0 has a
+ * slot for each of the next SCHED_WHEEL_SIZE ticks, and each slot of level
+ * N covers all ticks of level N - 1. When the wheel reaches the start of
+ * a slot of level N, the events of that slot are moved down to the levels
+ * below. Adding and removing an event is O(1).
+ */
+struct sched_wheel {
+	/*! The time of tick 0 */
+	struct timeval epoch;
+	/*! The next tick to expire events of */
+	int64_t tick;
+	/*! Number of events in the wheel */
+	size_t count;
+	/*! Number of events in each level */
+	size_t level_count[SCHED_WHEEL_LEVELS];
+	/*! All events in the wheel */
+	AST_DLLIST_HEAD_NOLOCK(, sched) events;
+	struct sched_wheel_slot slots[SCHED_WHEEL_LEVELS][SCHED_WHEEL_SIZE];
+};
+
+/*! \brief Thread that runs the callbacks of one shard of a context's events */
+struct sched_worker {
+	pthread_t thread;
+	ast_cond_t cond;
+	/*! The context the worker belongs to */
+	struct ast_sched_context *con;
+	/*! Events that are due and waiting to be run by this worker */
+	AST_LIST_HEAD_NOLOCK(, sched) queue;
+	/*! The event whose callback the worker is running */
+	struct sched *executing;
+	unsigned int stop:1;
+};
+
 struct sched_thread {
 	pthread_t thread;
 	ast_cond_t cond;
+	/*! Number of worker threads events are dispatched to. 0 if none. */
+	unsigned int num_workers;
+	/*! Worker threads */
+	struct sched_worker *workers;
 	unsigned int stop:1;
 };
 
@@ -108,6 +175,8 @@ struct ast_sched_context {
 	unsigned int eventcnt;                  /*!< Number of events processed */
 	unsigned int highwater;					/*!< highest count so far */
 	struct ast_heap *sched_heap;
+	/*! Timing wheel used instead of sched_heap if non-NULL */
+	struct sched_wheel *sched_wheel;
 	struct sched_thread *sched_thread;
 	/*! The scheduled task that is currently executing */
 	struct sched *currently_executing;
@@ -120,6 +189,10 @@ struct ast_sched_context {
 	AST_LIST_HEAD_NOLOCK(, sched_id) id_queue;
 	/*! The number of IDs in the id_queue */
 	int id_queue_size;
+	/*! Scheduled events indexed by ID */
+	struct sched **id_map;
+	/*! The number of entries allocated in id_map */
+	int id_map_size;
 };
 
 static void *sched_run(void *data)
@@ -163,8 +236,51 @@ static void *sched_run(void *data)
 	return NULL;
 }
 
+static void sched_release(struct ast_sched_context *con, struct sched *tmp);
+static int sched_finish(struct ast_sched_context *con, struct sched *current, int res);
+
+static void *sched_worker_run(void *data)
+{
+	struct sched_worker *worker = data;
+	struct ast_sched_context *con = worker->con;
+	struct sched *current;
+	int res;
+
+	ast_mutex_lock(&con->lock);
+	while (!worker->stop) {
+		if (!(current = AST_LIST_REMOVE_HEAD(&worker->queue, list))) {
+			ast_cond_wait(&worker->cond, &con->lock);
+			continue;
+		}
+
+		if (current->deleted) {
+			/* Deleted while waiting for its turn */
+			sched_release(con, current);
+			continue;
+		}
+
+		worker->executing = current;
+		ast_mutex_unlock(&con->lock);
+		res = current->callback(current->data);
+		ast_mutex_lock(&con->lock);
+		worker->executing = NULL;
+		ast_cond_signal(&current->cond);
+
+		if (sched_finish(con, current, res)) {
+			/* The scheduler thread may be sleeping past the new time */
+			ast_cond_signal(&con->sched_thread->cond);
+		}
+	}
+	ast_mutex_unlock(&con->lock);
+
+	return NULL;
+}
+
 static void sched_thread_destroy(struct ast_sched_context *con)
 {
+	struct sched *s;
+	unsigned int i;
+
 	if (!con->sched_thread) {
 		return;
 	}
@@ -178,6 +294,29 @@ static void sched_thread_destroy(struct ast_sched_context *con)
 		con->sched_thread->thread = AST_PTHREADT_NULL;
 	}
 
+	for (i = 0; i < con->sched_thread->num_workers; ++i) {
+		struct sched_worker *worker = &con->sched_thread->workers[i];
+
+		if (worker->thread != AST_PTHREADT_NULL) {
+			ast_mutex_lock(&con->lock);
+			worker->stop = 1;
+			ast_cond_signal(&worker->cond);
+			ast_mutex_unlock(&con->lock);
+			pthread_join(worker->thread, NULL);
+			worker->thread = AST_PTHREADT_NULL;
+		}
+
+		/* Events that were due but never got to run */
+		ast_mutex_lock(&con->lock);
+		while ((s = AST_LIST_REMOVE_HEAD(&worker->queue, list))) {
+			sched_release(con, s);
+		}
+		ast_mutex_unlock(&con->lock);
+
+		ast_cond_destroy(&worker->cond);
+	}
+	ast_free(con->sched_thread->workers);
+
 	ast_cond_destroy(&con->sched_thread->cond);
 
 	ast_free(con->sched_thread);
@@ -186,8 +325,14 @@ static void sched_thread_destroy(struct ast_sched_context *con)
 }
 
 int ast_sched_start_thread(struct ast_sched_context *con)
+{
+	return ast_sched_start_thread_pool(con, 0);
+}
+
+int ast_sched_start_thread_pool(struct ast_sched_context *con, unsigned int num_workers)
 {
 	struct sched_thread *st;
+	unsigned int i;
 
 	if (con->sched_thread) {
 		ast_log(LOG_ERROR, "Thread already started on this scheduler context\n");
@@ -204,6 +349,29 @@ int ast_sched_start_thread(struct ast_sched_context *con)
 
 	con->sched_thread = st;
 
+	if (num_workers) {
+		if (!(st->workers = ast_calloc(num_workers, sizeof(*st->workers)))) {
+			sched_thread_destroy(con);
+			return -1;
+		}
+
+		for (i = 0; i < num_workers; ++i) {
+			struct sched_worker *worker = &st->workers[i];
+
+			ast_cond_init(&worker->cond, NULL);
+			worker->con = con;
+			worker->thread = AST_PTHREADT_NULL;
+			AST_LIST_HEAD_INIT_NOLOCK(&worker->queue);
+			st->num_workers++;
+
+			if (ast_pthread_create_background(&worker->thread, NULL, sched_worker_run, worker)) {
+				ast_log(LOG_ERROR, "Failed to create scheduler worker thread\n");
+				sched_thread_destroy(con);
+				return -1;
+			}
+		}
+	}
+
 	if (ast_pthread_create_background(&st->thread, NULL, sched_run, con)) {
 		ast_log(LOG_ERROR, "Failed to create scheduler thread\n");
 		sched_thread_destroy(con);
@@ -218,7 +386,291 @@ static int sched_time_cmp(void *a, void *b)
 	return ast_tvcmp(((struct sched *) b)->when, ((struct sched *) a)->when);
 }
 
+static struct sched_wheel *sched_wheel_create(void)
+{
+	struct sched_wheel *wheel;
+	int level;
+	int slot;
+
+	if (!(wheel = ast_calloc(1, sizeof(*wheel)))) {
+		return NULL;
+	}
+
+	wheel->epoch = ast_tvnow();
+	AST_DLLIST_HEAD_INIT_NOLOCK(&wheel->events);
+	for (level = 0; level < SCHED_WHEEL_LEVELS; ++level) {
+		for (slot = 0; slot < SCHED_WHEEL_SIZE; ++slot) {
+			AST_DLLIST_HEAD_INIT_NOLOCK(&wheel->slots[level][slot].events);
+			wheel->slots[level][slot].level = level;
+		}
+	}
+
+	return wheel;
+}
+
+/*! \brief Convert an absolute time to a timing wheel tick */
+static int64_t sched_wheel_tv2tick(struct sched_wheel *wheel, struct timeval tv)
+{
+	int64_t tick = ast_tvdiff_ms(tv, wheel->epoch);
+
+	return tick < 0 ? 0 : tick;
+}
+
+/*! \brief Put an event in the slot matching its expiry tick */
+static void sched_wheel_link(struct sched_wheel *wheel, struct sched *s)
+{
+	int64_t delta = s->wheel_tick - wheel->tick;
+	int64_t placed = s->wheel_tick;
+	int level;
+	int slot;
+
+	if (delta < 0) {
+		/* Already due, expire it with the current tick */
+		level = 0;
+		slot = wheel->tick & SCHED_WHEEL_MASK;
+	} else {
+		for (level = 0; level < SCHED_WHEEL_LEVELS - 1; ++level) {
+			if (delta < SCHED_WHEEL_GRANULARITY(level + 1)) {
+				break;
+			}
+		}
+		if (delta >= SCHED_WHEEL_GRANULARITY(SCHED_WHEEL_LEVELS)) {
+			/* Beyond the end of the wheel. Park it in the furthest slot,
+			 * it will be put back in the right place when that slot is
+			 * moved down. */
+			placed = wheel->tick + SCHED_WHEEL_GRANULARITY(SCHED_WHEEL_LEVELS) - 1;
+		}
+		slot = (placed >> (SCHED_WHEEL_BITS * level)) & SCHED_WHEEL_MASK;
+	}
+
+	s->wheel_slot = &wheel->slots[level][slot];
+	AST_DLLIST_INSERT_TAIL(&s->wheel_slot->events, s, wheel_slot_list);
+	wheel->level_count[level]++;
+}
+
+static void sched_wheel_unlink(struct sched_wheel *wheel, struct sched *s)
+{
+	wheel->level_count[s->wheel_slot->level]--;
+	AST_DLLIST_REMOVE(&s->wheel_slot->events, s, wheel_slot_list);
+	s->wheel_slot = NULL;
+}
+
+static void sched_wheel_add(struct sched_wheel *wheel, struct sched *s)
+{
+	s->wheel_tick = sched_wheel_tv2tick(wheel, s->when);
+	sched_wheel_link(wheel, s);
+	AST_DLLIST_INSERT_TAIL(&wheel->events, s, wheel_list);
+	wheel->count++;
+}
+
+static void sched_wheel_remove(struct sched_wheel *wheel, struct sched *s)
+{
+	sched_wheel_unlink(wheel, s);
+	AST_DLLIST_REMOVE(&wheel->events, s, wheel_list);
+	wheel->count--;
+}
+
+/*! \brief Move the events of the current slot of a level down to the levels below */
+static void sched_wheel_cascade(struct sched_wheel *wheel, int level)
+{
+	struct sched_wheel_slot *slot;
+	struct sched *s;
+
+	slot = &wheel->slots[level][(wheel->tick >> (SCHED_WHEEL_BITS * level)) & SCHED_WHEEL_MASK];
+	while ((s = AST_DLLIST_REMOVE_HEAD(&slot->events, wheel_slot_list))) {
+		wheel->level_count[level]--;
+		sched_wheel_link(wheel, s);
+	}
+}
+
+/*!
+ * \brief Advance the wheel towards a tick
+ *
+ * Empty levels are skipped over, so this is cheap even when the
+ * wheel has not been run for a long time.
+ */
+static void sched_wheel_advance(struct sched_wheel *wheel, int64_t target)
+{
+	int64_t step;
+	int64_t next;
+	int level;
+
+	for (level = 0; level < SCHED_WHEEL_LEVELS; ++level) {
+		if (wheel->level_count[level]) {
+			break;
+		}
+	}
+	if (level == SCHED_WHEEL_LEVELS) {
+		wheel->tick = target;
+		return;
+	}
+
+	/* Nothing can expire before the next slot of the lowest populated level */
+	step = SCHED_WHEEL_GRANULARITY(level);
+	next = (wheel->tick | (step - 1)) + 1;
+	if (next > target) {
+		wheel->tick = target;
+		return;
+	}
+
+	wheel->tick = next;
+	for (level = 1; level < SCHED_WHEEL_LEVELS; ++level) {
+		if (wheel->tick & (SCHED_WHEEL_GRANULARITY(level) - 1)) {
+			break;
+		}
+		sched_wheel_cascade(wheel, level);
+	}
+}
+
+/*!
+ * \brief Remove the next event that expires before the given time
+ *
+ * \retval NULL if no event expires before the time
+ */
+static struct sched *sched_wheel_pop_due(struct sched_wheel *wheel, struct timeval limit)
+{
+	int64_t target = sched_wheel_tv2tick(wheel, limit);
+	struct sched_wheel_slot *slot;
+	struct sched *s;
+
+	for (;;) {
+		slot = &wheel->slots[0][wheel->tick & SCHED_WHEEL_MASK];
+		AST_DLLIST_TRAVERSE(&slot->events, s, wheel_slot_list) {
+			/* Everything in the slot of a past tick is due */
+			if (wheel->tick < target || ast_tvcmp(s->when, limit) < 0) {
+				sched_wheel_remove(wheel, s);
+				return s;
+			}
+		}
+
+		if (wheel->tick >= target) {
+			return NULL;
+		}
+		sched_wheel_advance(wheel, target);
+	}
+}
+
+/*!
+ * \brief Number of milliseconds until the wheel has an event to expire
+ *
+ * \note This may be earlier than the next event expires if there are
+ * events in the levels of the wheel above level 0.  Those are only
+ * looked at when their slot is moved down, so the wait ends there.
+ *
+ * \retval -1 if the wheel is empty
+ */
+static int sched_wheel_wait(struct sched_wheel *wheel)
+{
+	struct sched_wheel_slot *slot;
+	struct sched *s;
+	struct timeval when = { 0, };
+	struct timeval cascade;
+	int64_t next;
+	int ms;
+	int level;
+	int i;
+
+	if (!wheel->count) {
+		return -1;
+	}
+
+	if (wheel->level_count[0]) {
+		for (i = 0; i < SCHED_WHEEL_SIZE; ++i) {
+			slot = &wheel->slots[0][(wheel->tick + i) & SCHED_WHEEL_MASK];
+			AST_DLLIST_TRAVERSE(&slot->events, s, wheel_slot_list) {
+				if (ast_tvzero(when) || ast_tvcmp(s->when, when) < 0) {
+					when = s->when;
+				}
+			}
+			if (!ast_tvzero(when)) {
+				break;
+			}
+		}
+	}
+
+	for (level = 1; level < SCHED_WHEEL_LEVELS; ++level) {
+		if (wheel->level_count[level]) {
+			break;
+		}
+	}
+	if (level < SCHED_WHEEL_LEVELS) {
+		/* An event of a higher level may expire right after its slot is moved down */
+		next = (wheel->tick | (SCHED_WHEEL_GRANULARITY(level) - 1)) + 1;
+		cascade = ast_tvadd(wheel->epoch, ast_tv(next / 1000, (next % 1000) * 1000));
+		if (ast_tvzero(when) || ast_tvcmp(cascade, when) < 0) {
+			when = cascade;
+		}
+	}
+
+	ms = ast_tvdiff_ms(when, ast_tvnow());
+	return ms < 0 ? 0 : ms;
+}
+
+/*! \brief Number of events in the context's queue */
+static size_t sched_count(struct ast_sched_context *con)
+{
+	return con->sched_wheel ? con->sched_wheel->count : ast_heap_size(con->sched_heap);
+}
+
+/*! \brief Take a scheduled event out of the context's queue */
+static void sched_dequeue(struct ast_sched_context *con, struct sched *s)
+{
+	if (con->sched_wheel) {
+		sched_wheel_remove(con->sched_wheel, s);
+	} else if (!ast_heap_remove(con->sched_heap, s)) {
+		ast_log(LOG_WARNING,"sched entry %d not in the sched heap?\n", s->sched_id->id);
+	}
+	con->id_map[s->sched_id->id] = NULL;
+}
+
+/*!
+ * \brief Remove the first event that expires before the given time
+ *
+ * \retval NULL if no event expires before the time
+ */
+static struct sched *sched_pop_due(struct ast_sched_context *con, struct timeval limit)
+{
+	struct sched *s;
+
+	if (con->sched_wheel) {
+		s = sched_wheel_pop_due(con->sched_wheel, limit);
+	} else {
+		s = ast_heap_peek(con->sched_heap, 1);
+		if (!s || ast_tvcmp(s->when, limit) != -1) {
+			return NULL;
+		}
+		s = ast_heap_pop(con->sched_heap);
+	}
+	if (s) {
+		con->id_map[s->sched_id->id] = NULL;
+	}
+
+	return s;
+}
+
+/*!
+ * \brief Get the event at a position in the context's queue
+ *
+ * \param con Scheduler context
+ * \param prev The event at the previous position or NULL for the first
+ * \param pos Heap position for heap backed contexts, starting at 1
+ *
+ * \retval NULL past the last event
+ */
+static struct sched *sched_iter(struct ast_sched_context *con, struct sched *prev, size_t pos)
+{
+	if (con->sched_wheel) {
+		return prev ? AST_DLLIST_NEXT(prev, wheel_list) : AST_DLLIST_FIRST(&con->sched_wheel->events);
+	}
+	return ast_heap_peek(con->sched_heap, pos);
+}
+
 struct ast_sched_context *ast_sched_context_create(void)
+{
+	return ast_sched_context_create_with_options(AST_SCHED_HEAP);
+}
+
+struct ast_sched_context *ast_sched_context_create_with_options(enum ast_sched_options options)
 {
 	struct ast_sched_context *tmp;
 
@@ -231,7 +683,12 @@ struct ast_sched_context *ast_sched_context_create(void)
 
 	AST_LIST_HEAD_INIT_NOLOCK(&tmp->id_queue);
 
-	if (!(tmp->sched_heap = ast_heap_create(8, sched_time_cmp,
+	if (options & AST_SCHED_TIMING_WHEEL) {
+		if (!(tmp->sched_wheel = sched_wheel_create())) {
+			ast_sched_context_destroy(tmp);
+			return NULL;
+		}
+	} else if (!(tmp->sched_heap = ast_heap_create(8, sched_time_cmp,
 			offsetof(struct sched, __heap_index)))) {
 		ast_sched_context_destroy(tmp);
 		return NULL;
@@ -275,6 +732,16 @@ void ast_sched_context_destroy(struct ast_sched_context *con)
 		con->sched_heap = NULL;
 	}
 
+	if (con->sched_wheel) {
+		while ((s = AST_DLLIST_REMOVE_HEAD(&con->sched_wheel->events, wheel_list))) {
+			sched_free(s);
+		}
+		ast_free(con->sched_wheel);
+		con->sched_wheel = NULL;
+	}
+
+	ast_free(con->id_map);
+
 	while ((sid = AST_LIST_REMOVE_HEAD(&con->id_queue, list))) {
 		ast_free(sid);
 	}
@@ -308,6 +775,23 @@ static int add_ids(struct ast_sched_context *con)
 		/* Overflow. Cap it at INT_MAX. */
 		new_size = INT_MAX;
 	}
+
+	if (new_size >= con->id_map_size) {
+		/* Grow the map geometrically so IDs can keep being added cheaply */
+		int map_size = MAX(new_size + 1, con->id_map_size * 2);
+		struct sched **id_map;
+
+		if (map_size < 0) {
+			map_size = INT_MAX;
+		}
+		id_map = ast_realloc(con->id_map, map_size * sizeof(*id_map));
+		if (!id_map) {
+			return 0;
+		}
+		memset(id_map + con->id_map_size, 0, (map_size - con->id_map_size) * sizeof(*id_map));
+		con->id_map = id_map;
+		con->id_map_size = map_size;
+	}
 	for (i = original_size; i < new_size; ++i) {
 		struct sched_id *new_id;
 
@@ -393,15 +877,17 @@ void ast_sched_clean_by_callback(struct ast_sched_context *con, ast_sched_cb mat
 {
 	int i = 1;
 	struct sched *current;
+	struct sched *prev = NULL;
 
 	ast_mutex_lock(&con->lock);
-	while ((current = ast_heap_peek(con->sched_heap, i))) {
+	while ((current = sched_iter(con, prev, i))) {
 		if (current->callback != match) {
 			i++;
+			prev = current;
 			continue;
 		}
 
-		ast_heap_remove(con->sched_heap, current);
+		sched_dequeue(con, current);
 
 		cleanup_cb(current->data);
 		sched_release(con, current);
@@ -421,7 +907,9 @@ int ast_sched_wait(struct ast_sched_context *con)
 	DEBUG(ast_debug(1, "ast_sched_wait()\n"));
 
 	ast_mutex_lock(&con->lock);
-	if ((s = ast_heap_peek(con->sched_heap, 1))) {
+	if (con->sched_wheel) {
+		ms = sched_wheel_wait(con->sched_wheel);
+	} else if ((s = ast_heap_peek(con->sched_heap, 1))) {
 		ms = ast_tvdiff_ms(s->when, ast_tvnow());
 		if (ms < 0) {
 			ms = 0;
@@ -442,10 +930,18 @@ int ast_sched_wait(struct ast_sched_context *con)
  */
 static void schedule(struct ast_sched_context *con, struct sched *s)
 {
-	ast_heap_push(con->sched_heap, s);
+	size_t size;
+
+	if (con->sched_wheel) {
+		sched_wheel_add(con->sched_wheel, s);
+	} else {
+		ast_heap_push(con->sched_heap, s);
+	}
+	con->id_map[s->sched_id->id] = s;
 
-	if (ast_heap_size(con->sched_heap) > con->highwater) {
-		con->highwater = ast_heap_size(con->sched_heap);
+	size = sched_count(con);
+	if (size > con->highwater) {
+		con->highwater = size;
 	}
 }
 
@@ -491,6 +987,11 @@ int ast_sched_replace_variable(int old_id, struct ast_sched_context *con, int wh
  * Schedule callback(data) to happen when ms into the future
  */
 int ast_sched_add_variable(struct ast_sched_context *con, int when, ast_sched_cb callback, const void *data, int variable)
+{
+	return ast_sched_add_variable_keyed(con, when, callback, data, variable, 0);
+}
+
+int ast_sched_add_variable_keyed(struct ast_sched_context *con, int when, ast_sched_cb callback, const void *data, int variable, unsigned int key)
 {
 	struct sched *tmp;
 	int res = -1;
@@ -504,6 +1005,7 @@ int ast_sched_add_variable(struct ast_sched_context *con, int when, ast_sched_cb
 		tmp->data = data;
 		tmp->resched = when;
 		tmp->variable = variable;
+		tmp->key = key;
 		tmp->when = ast_tv(0, 0);
 		tmp->deleted = 0;
 		if (sched_settime(&tmp->when, when)) {
@@ -539,23 +1041,68 @@ int ast_sched_add(struct ast_sched_context *con, int when, ast_sched_cb callback
 	return ast_sched_add_variable(con, when, callback, data, 0);
 }
 
-static struct sched *sched_find(struct ast_sched_context *con, int id)
+int ast_sched_add_keyed(struct ast_sched_context *con, int when, ast_sched_cb callback, const void *data, unsigned int key)
 {
-	int x;
-	size_t heap_size;
+	return ast_sched_add_variable_keyed(con, when, callback, data, 0, key);
+}
+
+/*!
+ * \brief Find an event that has been handed to a worker thread
+ *
+ * \param con Scheduler context
+ * \param id ID of the event
+ * \param[out] running Set to non-zero if the event's callback is running
+ */
+static struct sched *sched_find_dispatched(struct ast_sched_context *con, int id, int *running)
+{
+	struct sched_worker *worker;
+	struct sched *s;
+	unsigned int i;
 
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		struct sched *cur = ast_heap_peek(con->sched_heap, x);
+	if (!con->sched_thread) {
+		return NULL;
+	}
 
-		if (cur->sched_id->id == id) {
-			return cur;
+	for (i = 0; i < con->sched_thread->num_workers; ++i) {
+		worker = &con->sched_thread->workers[i];
+		if (worker->executing && worker->executing->sched_id->id == id) {
+			*running = 1;
+			return worker->executing;
+		}
+		AST_LIST_TRAVERSE(&worker->queue, s, list) {
+			if (s->sched_id->id == id) {
+				*running = 0;
+				return s;
+			}
 		}
 	}
 
 	return NULL;
 }
 
+/*! \brief Check if a worker thread is running the callback of an event */
+static int sched_is_running(struct ast_sched_context *con, struct sched *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < con->sched_thread->num_workers; ++i) {
+		if (con->sched_thread->workers[i].executing == s) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static struct sched *sched_find(struct ast_sched_context *con, int id)
+{
+	if (id <= 0 || id > con->id_queue_size) {
+		return NULL;
+	}
+
+	return con->id_map[id];
+}
+
 const void *ast_sched_find_data(struct ast_sched_context *con, int id)
 {
 	struct sched *s;
@@ -587,6 +1134,7 @@ int _ast_sched_del(struct ast_sched_context *con, int id, const char *file, int
 {
 	struct sched *s = NULL;
 	int *last_id = ast_threadstorage_get(&last_del_id, sizeof(int));
+	int running = 0;
 
 	DEBUG(ast_debug(1, "ast_sched_del(%d)\n", id));
 
@@ -598,9 +1146,7 @@ int _ast_sched_del(struct ast_sched_context *con, int id, const char *file, int
 
 	s = sched_find(con, id);
 	if (s) {
-		if (!ast_heap_remove(con->sched_heap, s)) {
-			ast_log(LOG_WARNING,"sched entry %d not in the sched heap?\n", s->sched_id->id);
-		}
+		sched_dequeue(con, s);
 		sched_release(con, s);
 	} else if (con->currently_executing && (id == con->currently_executing->sched_id->id)) {
 		s = con->currently_executing;
@@ -612,6 +1158,15 @@ int _ast_sched_del(struct ast_sched_context *con, int id, const char *file, int
 			ast_cond_wait(&s->cond, &con->lock);
 		}
 		/* Do not sched_release() here because ast_sched_runq() will do it */
+	} else if ((s = sched_find_dispatched(con, id, &running))) {
+		/* The worker thread skips and releases events deleted before they run */
+		s->deleted = 1;
+		if (running) {
+			/* Wait for the callback to complete, as above */
+			while (sched_is_running(con, s)) {
+				ast_cond_wait(&s->cond, &con->lock);
+			}
+		}
 	}
 
 #ifdef DUMP_SCHEDULER
@@ -641,17 +1196,15 @@ void ast_sched_report(struct ast_sched_context *con, struct ast_str **buf, struc
 {
 	int i, x;
 	struct sched *cur;
+	struct sched *prev = NULL;
 	int countlist[cbnames->numassocs + 1];
-	size_t heap_size;
 
 	memset(countlist, 0, sizeof(countlist));
-	ast_str_set(buf, 0, " Highwater = %u\n schedcnt = %zu\n", con->highwater, ast_heap_size(con->sched_heap));
+	ast_str_set(buf, 0, " Highwater = %u\n schedcnt = %zu\n", con->highwater, sched_count(con));
 
 	ast_mutex_lock(&con->lock);
 
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		cur = ast_heap_peek(con->sched_heap, x);
+	for (x = 1; (cur = sched_iter(con, prev, x)); x++, prev = cur) {
 		/* match the callback to the cblist */
 		for (i = 0; i < cbnames->numassocs; i++) {
 			if (cur->callback == cbnames->cblist[i]) {
@@ -678,23 +1231,21 @@ void ast_sched_report(struct ast_sched_context *con, struct ast_str **buf, struc
 void ast_sched_dump(struct ast_sched_context *con)
 {
 	struct sched *q;
+	struct sched *prev = NULL;
 	struct timeval when = ast_tvnow();
 	int x;
-	size_t heap_size;
 #ifdef SCHED_MAX_CACHE
-	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u Cache, %u high-water)\n", ast_heap_size(con->sched_heap), con->eventcnt - 1, con->schedccnt, con->highwater);
+	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u Cache, %u high-water)\n", sched_count(con), con->eventcnt - 1, con->schedccnt, con->highwater);
 #else
-	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u high-water)\n", ast_heap_size(con->sched_heap), con->eventcnt - 1, con->highwater);
+	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u high-water)\n", sched_count(con), con->eventcnt - 1, con->highwater);
 #endif
 
 	ast_debug(1, "=============================================================\n");
 	ast_debug(1, "|ID    Callback          Data              Time  (sec:ms)   |\n");
 	ast_debug(1, "+-----+-----------------+-----------------+-----------------+\n");
 	ast_mutex_lock(&con->lock);
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
+	for (x = 1; (q = sched_iter(con, prev, x)); x++, prev = q) {
 		struct timeval delta;
-		q = ast_heap_peek(con->sched_heap, x);
 		delta = ast_tvsub(q->when, when);
 		ast_debug(1, "|%.4d | %-15p | %-15p | %.6ld : %.6ld |\n",
 			q->sched_id->id,
@@ -722,18 +1273,23 @@ int ast_sched_runq(struct ast_sched_context *con)
 	ast_mutex_lock(&con->lock);
 
 	when = ast_tvadd(ast_tvnow(), ast_tv(0, 1000));
-	for (numevents = 0; (current = ast_heap_peek(con->sched_heap, 1)); numevents++) {
-		/* schedule all events which are going to expire within 1ms.
-		 * We only care about millisecond accuracy anyway, so this will
-		 * help us get more than one event at one time if they are very
-		 * close together.
-		 */
-		if (ast_tvcmp(current->when, when) != -1) {
-			break;
+	/* schedule all events which are going to expire within 1ms.
+	 * We only care about millisecond accuracy anyway, so this will
+	 * help us get more than one event at one time if they are very
+	 * close together.
+	 */
+	for (numevents = 0; (current = sched_pop_due(con, when)); numevents++) {
+		if (con->sched_thread && con->sched_thread->num_workers) {
+			/* Hand the event to the worker for its key. Events sharing a key
+			 * go to the same worker so their callbacks never run concurrently. */
+			struct sched_worker *worker;
+
+			worker = &con->sched_thread->workers[current->key % con->sched_thread->num_workers];
+			AST_LIST_INSERT_TAIL(&worker->queue, current, list);
+			ast_cond_signal(&worker->cond);
+			continue;
 		}
 
-		current = ast_heap_pop(con->sched_heap);
-
 		/*
 		 * At this point, the schedule queue is still intact.  We
 		 * have removed the first event and the rest is still there,
@@ -750,20 +1306,7 @@ int ast_sched_runq(struct ast_sched_context *con)
 		con->currently_executing = NULL;
 		ast_cond_signal(&current->cond);
 
-		if (res && !current->deleted) {
-			/*
-			 * If they return non-zero, we should schedule them to be
-			 * run again.
-			 */
-			if (sched_settime(&current->when, current->variable? res : current->resched)) {
-				sched_release(con, current);
-			} else {
-				schedule(con, current);
-			}
-		} else {
-			/* No longer needed, so release it */
-			sched_release(con, current);
-		}
+		sched_finish(con, current, res);
 	}
 
 	ast_mutex_unlock(&con->lock);
@@ -771,6 +1314,35 @@ int ast_sched_runq(struct ast_sched_context *con)
 	return numevents;
 }
 
+/*!
+ * \brief Reschedule or release an event after its callback ran
+ *
+ * \note The context must be locked
+ *
+ * \retval 1 the event was scheduled again
+ * \retval 0 the event was released
+ */
+static int sched_finish(struct ast_sched_context *con, struct sched *current, int res)
+{
+	if (res && !current->deleted) {
+		/*
+		 * If they return non-zero, we should schedule them to be
+		 * run again.
+		 */
+		if (sched_settime(&current->when, current->variable? res : current->resched)) {
+			sched_release(con, current);
+		} else {
+			schedule(con, current);
+			return 1;
+		}
+	} else {
+		/* No longer needed, so release it */
+		sched_release(con, current);
+	}
+
+	return 0;
+}
+
 long ast_sched_when(struct ast_sched_context *con,int id)
 {
 	struct sched *s;
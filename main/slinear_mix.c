@@ -0,0 +1,391 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Saturating arithmetic on blocks of signed linear samples
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/slinear_mix.h"
+#include "asterisk/utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SLINEAR_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SLINEAR_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+static void add_c(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		ast_slinear_saturated_add(&dst[i], (short *) &src[i]);
+	}
+}
+
+static void subtract_c(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		ast_slinear_saturated_subtract(&dst[i], (short *) &src[i]);
+	}
+}
+
+static void multiply_c(short *buf, short factor, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		ast_slinear_saturated_multiply(&buf[i], &factor);
+	}
+}
+
+static void divide_c(short *buf, short divisor, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		ast_slinear_saturated_divide(&buf[i], &divisor);
+	}
+}
+
+/*
+ * Multiplying keeps the saturation of the scalar code by forming the 32 bit
+ * products and packing them back with signed saturation. Dividing converts
+ * to single precision, which represents every 16 bit quotient exactly enough
+ * for truncation to give the integer result, and keeps the low 16 bits as the
+ * scalar code does.
+ */
+
+#ifdef SLINEAR_X86_KERNELS
+__attribute__((target("sse2")))
+static void add_sse2(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (dst + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + i));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_adds_epi16(a, b));
+	}
+
+	add_c(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("sse2")))
+static void subtract_sse2(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (dst + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + i));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_subs_epi16(a, b));
+	}
+
+	subtract_c(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("sse2")))
+static void multiply_sse2(short *buf, short factor, size_t samples)
+{
+	const __m128i f = _mm_set1_epi16(factor);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (buf + i));
+		__m128i lo = _mm_mullo_epi16(a, f);
+		__m128i hi = _mm_mulhi_epi16(a, f);
+
+		_mm_storeu_si128((__m128i *) (buf + i),
+			_mm_packs_epi32(_mm_unpacklo_epi16(lo, hi), _mm_unpackhi_epi16(lo, hi)));
+	}
+
+	multiply_c(buf + i, factor, samples - i);
+}
+
+__attribute__((target("sse2")))
+static void divide_sse2(short *buf, short divisor, size_t samples)
+{
+	const __m128 d = _mm_set1_ps(divisor);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (buf + i));
+		/* Sign extend each half to 32 bits */
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+
+		lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(lo), d));
+		hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(hi), d));
+		/* Keep the low 16 bits without saturating */
+		lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+		hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+		_mm_storeu_si128((__m128i *) (buf + i), _mm_packs_epi32(lo, hi));
+	}
+
+	divide_c(buf + i, divisor, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (src + i));
+
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_adds_epi16(a, b));
+	}
+
+	add_sse2(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void subtract_avx2(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (src + i));
+
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_subs_epi16(a, b));
+	}
+
+	subtract_sse2(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void multiply_avx2(short *buf, short factor, size_t samples)
+{
+	const __m256i f = _mm256_set1_epi16(factor);
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (buf + i));
+		__m256i lo = _mm256_mullo_epi16(a, f);
+		__m256i hi = _mm256_mulhi_epi16(a, f);
+
+		/* Unpacking and packing both work within each 128 bit lane, so the order is kept */
+		_mm256_storeu_si256((__m256i *) (buf + i),
+			_mm256_packs_epi32(_mm256_unpacklo_epi16(lo, hi), _mm256_unpackhi_epi16(lo, hi)));
+	}
+
+	multiply_sse2(buf + i, factor, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void divide_avx2(short *buf, short divisor, size_t samples)
+{
+	const __m256 d = _mm256_set1_ps(divisor);
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (buf + i));
+		__m256i lo = _mm256_srai_epi32(_mm256_unpacklo_epi16(a, a), 16);
+		__m256i hi = _mm256_srai_epi32(_mm256_unpackhi_epi16(a, a), 16);
+
+		lo = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(lo), d));
+		hi = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(hi), d));
+		lo = _mm256_srai_epi32(_mm256_slli_epi32(lo, 16), 16);
+		hi = _mm256_srai_epi32(_mm256_slli_epi32(hi, 16), 16);
+		_mm256_storeu_si256((__m256i *) (buf + i), _mm256_packs_epi32(lo, hi));
+	}
+
+	divide_sse2(buf + i, divisor, samples - i);
+}
+#endif /* SLINEAR_X86_KERNELS */
+
+#ifdef SLINEAR_NEON_KERNELS
+static void add_neon(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+	}
+
+	add_c(dst + i, src + i, samples - i);
+}
+
+static void subtract_neon(short *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		vst1q_s16(dst + i, vqsubq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+	}
+
+	subtract_c(dst + i, src + i, samples - i);
+}
+
+static void multiply_neon(short *buf, short factor, size_t samples)
+{
+	const int16x4_t f = vdup_n_s16(factor);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t a = vld1q_s16(buf + i);
+
+		vst1q_s16(buf + i, vcombine_s16(vqmovn_s32(vmull_s16(vget_low_s16(a), f)),
+			vqmovn_s32(vmull_s16(vget_high_s16(a), f))));
+	}
+
+	multiply_c(buf + i, factor, samples - i);
+}
+
+#ifdef __aarch64__
+static void divide_neon(short *buf, short divisor, size_t samples)
+{
+	const float32x4_t d = vdupq_n_f32(divisor);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t a = vld1q_s16(buf + i);
+		int32x4_t lo = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(a))), d));
+		int32x4_t hi = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(a))), d));
+
+		vst1q_s16(buf + i, vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+	}
+
+	divide_c(buf + i, divisor, samples - i);
+}
+#else
+/* 32 bit NEON has no vector division */
+#define divide_neon divide_c
+#endif
+#endif /* SLINEAR_NEON_KERNELS */
+
+/*! \brief A set of block functions */
+struct slinear_kernel {
+	const char *name;
+	void (*add)(short *dst, const short *src, size_t samples);
+	void (*subtract)(short *dst, const short *src, size_t samples);
+	void (*multiply)(short *buf, short factor, size_t samples);
+	void (*divide)(short *buf, short divisor, size_t samples);
+};
+
+/*! \brief The kernels, best last */
+static const struct slinear_kernel slinear_kernels[] = {
+	{ "c", add_c, subtract_c, multiply_c, divide_c },
+#ifdef SLINEAR_X86_KERNELS
+	{ "sse2", add_sse2, subtract_sse2, multiply_sse2, divide_sse2 },
+	{ "avx2", add_avx2, subtract_avx2, multiply_avx2, divide_avx2 },
+#endif
+#ifdef SLINEAR_NEON_KERNELS
+	{ "neon", add_neon, subtract_neon, multiply_neon, divide_neon },
+#endif
+};
+
+/*! \brief The kernel in use */
+static const struct slinear_kernel *slinear_kernel = &slinear_kernels[0];
+
+/*! \brief Whether the CPU can run a kernel */
+static int slinear_kernel_supported(const struct slinear_kernel *kernel)
+{
+#ifdef SLINEAR_X86_KERNELS
+	if (!strcmp(kernel->name, "sse2")) {
+		return __builtin_cpu_supports("sse2");
+	}
+	if (!strcmp(kernel->name, "avx2")) {
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+	return 1;
+}
+
+void ast_slinear_mix_init(void)
+{
+	int i;
+
+#ifdef SLINEAR_X86_KERNELS
+	__builtin_cpu_init();
+#endif
+	for (i = ARRAY_LEN(slinear_kernels) - 1; i > 0; --i) {
+		if (slinear_kernel_supported(&slinear_kernels[i])) {
+			break;
+		}
+	}
+	slinear_kernel = &slinear_kernels[i];
+}
+
+int ast_slinear_mix_use_kernel(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(slinear_kernels); ++i) {
+		if (!strcmp(slinear_kernels[i].name, name) && slinear_kernel_supported(&slinear_kernels[i])) {
+			slinear_kernel = &slinear_kernels[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+const char *ast_slinear_mix_kernel(void)
+{
+	return slinear_kernel->name;
+}
+
+void ast_slinear_saturated_add_block(short *dst, const short *src, size_t samples)
+{
+	slinear_kernel->add(dst, src, samples);
+}
+
+void ast_slinear_saturated_subtract_block(short *dst, const short *src, size_t samples)
+{
+	slinear_kernel->subtract(dst, src, samples);
+}
+
+void ast_slinear_saturated_multiply_block(short *buf, short factor, size_t samples)
+{
+	slinear_kernel->multiply(buf, factor, samples);
+}
+
+void ast_slinear_saturated_divide_block(short *buf, short divisor, size_t samples)
+{
+	slinear_kernel->divide(buf, divisor, samples);
+}
+
+void ast_slinear_adjust_volume_block(short *buf, int adjustment, size_t samples)
+{
+	short value = abs(adjustment);
+
+	if (adjustment > 0) {
+		slinear_kernel->multiply(buf, value, samples);
+	} else if (adjustment < 0) {
+		slinear_kernel->divide(buf, value, samples);
+	}
+}
@@ -1895,6 +1895,11 @@ void *ast_sorcery_retrieve_by_fields(const struct ast_sorcery *sorcery, const ch
 			if (wizard->wizard->callbacks.retrieve_multiple) {
 				wizard->wizard->callbacks.retrieve_multiple(sorcery, wizard->data, object_type->name, object, fields);
 			}
+
+			/* A cache that answers for multiple objects holds everything, so the backend need not be asked */
+			if (wizard->caching && ao2_container_count(object)) {
+				break;
+			}
 		} else if (fields && wizard->wizard->callbacks.retrieve_fields) {
 			if (wizard->wizard->callbacks.retrieve_fields) {
 				object = wizard->wizard->callbacks.retrieve_fields(sorcery, wizard->data, object_type->name, fields);
@@ -1939,6 +1944,10 @@ struct ao2_container *ast_sorcery_retrieve_by_regex(const struct ast_sorcery *so
 		}
 
 		wizard->wizard->callbacks.retrieve_regex(sorcery, wizard->data, object_type->name, objects, regex);
+
+		if (wizard->caching && ao2_container_count(objects)) {
+			break;
+		}
 	}
 	AST_VECTOR_RW_UNLOCK(&object_type->wizards);
 
@@ -29,7 +29,7 @@
 #include "asterisk/lock.h"
 #include "asterisk/format.h"
 #include "asterisk/format_cap.h"
-#include "asterisk/paths.h"	/* use ast_config_AST_DATA_DIR */
+#include "asterisk/paths.h"	/* use ast_config_AST_DATA_DIR, ast_config_AST_SPOOL_DIR */
 #include "asterisk/media_index.h"
 #include "asterisk/sounds_index.h"
 #include "asterisk/file.h"
@@ -47,6 +47,15 @@
 
 static struct ast_media_index *sounds_index;
 
+/*!
+ * \brief Whether the index must be built before it is next used
+ *
+ * Building the index is put off until something uses it, so that neither
+ * starting nor reloading walks the sounds directories, and registering or
+ * unregistering a number of formats builds it only once.
+ */
+static int sounds_index_stale;
+
 static struct stasis_message_router *sounds_system_router;
 
 /*! \brief Get the languages in which sound files are available */
@@ -97,21 +106,40 @@ static struct ao2_container *get_languages(void)
 	return lang_dirs;
 }
 
+/*!
+ * \brief Directory of the listings of the files of each language
+ *
+ * A language whose directories have not changed since its listing was written
+ * is indexed from the listing, so only the languages that have changed are
+ * walked, on reloads as well as across restarts.
+ */
+static char sounds_listing_dir[PATH_MAX];
+
 /*! \brief Callback to process an individual language directory or subdirectory */
 static int update_index_cb(void *obj, void *arg, int flags)
 {
 	char *lang = obj;
 	struct ast_media_index *index = arg;
-
-	if (ast_media_index_update(index, lang)) {
-		return CMP_MATCH;
+	char listing[PATH_MAX];
+	int res;
+
+	if (ast_strlen_zero(sounds_listing_dir)) {
+		res = ast_media_index_update(index, lang);
+	} else {
+		snprintf(listing, sizeof(listing), "%s/%s", sounds_listing_dir, lang);
+		res = ast_media_index_update_cached(index, lang, listing);
 	}
-	return 0;
+	return res ? CMP_MATCH : 0;
 }
 
 AST_MUTEX_DEFINE_STATIC(reload_lock);
 
-int ast_sounds_reindex(void)
+/*!
+ * \internal
+ * \brief Build the index anew and replace the current one with it
+ * \note reload_lock must be held
+ */
+static int sounds_index_build(void)
 {
 	RAII_VAR(struct ast_str *, sounds_dir, NULL, ast_free);
 	RAII_VAR(struct ao2_container *, languages, NULL, ao2_cleanup);
@@ -119,8 +147,6 @@ int ast_sounds_reindex(void)
 	RAII_VAR(struct ast_media_index *, new_index, NULL, ao2_cleanup);
 	struct ast_media_index *old_index;
 
-	SCOPED_MUTEX(lock, &reload_lock);
-
 	old_index = sounds_index;
 	languages = get_languages();
 	sounds_dir = ast_str_create(64);
@@ -146,6 +172,14 @@ int ast_sounds_reindex(void)
 	return 0;
 }
 
+int ast_sounds_reindex(void)
+{
+	SCOPED_MUTEX(lock, &reload_lock);
+
+	sounds_index_stale = 1;
+	return 0;
+}
+
 static int show_sounds_cb(void *obj, void *arg, int flags)
 {
 	char *name = obj;
@@ -203,7 +237,10 @@ static char *handle_cli_sounds_show(struct ast_cli_entry *e, int cmd, struct ast
 	}
 
 	if (a->argc == 3) {
-		RAII_VAR(struct ao2_container *, sound_files, ast_media_get_media(sounds_index), ao2_cleanup);
+		RAII_VAR(struct ao2_container *, sound_files, NULL, ao2_cleanup);
+		RAII_VAR(struct ast_media_index *, local_index, ast_sounds_get_index(), ao2_cleanup);
+
+		sound_files = ast_media_get_media(local_index);
 		if (!sound_files) {
 			return CLI_FAILURE;
 		}
@@ -233,7 +270,8 @@ static char *handle_cli_sound_show(struct ast_cli_entry *e, int cmd, struct ast_
 		struct ao2_iterator it_sounds;
 		char *match = NULL;
 		char *filename;
-		RAII_VAR(struct ao2_container *, sound_files, ast_media_get_media(sounds_index), ao2_cleanup);
+		RAII_VAR(struct ast_media_index *, local_index, ast_sounds_get_index(), ao2_cleanup);
+		RAII_VAR(struct ao2_container *, sound_files, ast_media_get_media(local_index), ao2_cleanup);
 		if (!sound_files) {
 			return NULL;
 		}
@@ -253,7 +291,8 @@ static char *handle_cli_sound_show(struct ast_cli_entry *e, int cmd, struct ast_
 	}
 
 	if (a->argc == 4) {
-		RAII_VAR(struct ao2_container *, variants, ast_media_get_variants(sounds_index, a->argv[3]), ao2_cleanup);
+		RAII_VAR(struct ast_media_index *, local_index, ast_sounds_get_index(), ao2_cleanup);
+		RAII_VAR(struct ao2_container *, variants, ast_media_get_variants(local_index, a->argv[3]), ao2_cleanup);
 		if (!variants || !ao2_container_count(variants)) {
 			ast_cli(a->fd, "ERROR: File %s not found in index\n", a->argv[3]);
 			return CLI_FAILURE;
@@ -291,10 +330,17 @@ static void format_update_cb(void *data, struct stasis_subscription *sub,
 int ast_sounds_index_init(void)
 {
 	int res = 0;
+
 	sounds_index = NULL;
-	if (ast_sounds_reindex()) {
-		return -1;
+	sounds_index_stale = 1;
+
+	snprintf(sounds_listing_dir, sizeof(sounds_listing_dir), "%s/sounds_index", ast_config_AST_SPOOL_DIR);
+	if (ast_mkdir(sounds_listing_dir, 0755)) {
+		ast_log(LOG_WARNING, "Unable to create directory %s for sound listings: %s\n",
+			sounds_listing_dir, strerror(errno));
+		sounds_listing_dir[0] = '\0';
 	}
+
 	res |= ast_cli_register_multiple(cli_sounds, ARRAY_LEN(cli_sounds));
 
 	sounds_system_router = stasis_message_router_create(ast_system_topic());
@@ -328,6 +374,25 @@ int ast_sounds_index_init(void)
 
 struct ast_media_index *ast_sounds_get_index(void)
 {
-	ao2_ref(sounds_index, +1);
+	SCOPED_MUTEX(lock, &reload_lock);
+
+	if (sounds_index_stale) {
+		/* Even if it fails, another try would only fail the same way */
+		sounds_index_stale = 0;
+		if (sounds_index_build()) {
+			ast_log(LOG_WARNING, "Failed to index sounds\n");
+		}
+		if (!sounds_index) {
+			RAII_VAR(struct ast_str *, sounds_dir, ast_str_create(64), ast_free);
+
+			if (!sounds_dir) {
+				return NULL;
+			}
+			ast_str_set(&sounds_dir, 0, "%s/sounds", ast_config_AST_DATA_DIR);
+			sounds_index = ast_media_index_create(ast_str_buffer(sounds_dir));
+		}
+	}
+
+	ao2_bump(sounds_index);
 	return sounds_index;
 }
@@ -32,6 +32,9 @@
 ASTERISK_REGISTER_FILE();
 
 #include "asterisk/astobj2.h"
+#include "asterisk/cli.h"
+#include "asterisk/metrics.h"
+#include "asterisk/probes.h"
 #include "asterisk/stasis_internal.h"
 #include "asterisk/stasis.h"
 #include "asterisk/taskprocessor.h"
@@ -75,6 +78,34 @@ ASTERISK_REGISTER_FILE();
 				<configOption name="max_size" default="50">
 					<synopsis>Maximum number of threads in the threadpool.</synopsis>
 				</configOption>
+				<configOption name="work_stealing" default="no">
+					<synopsis>Give each thread in the threadpool its own task queue.</synopsis>
+					<description>
+						<para>When enabled, each thread of the message bus threadpool
+						has its own task queue and threads that run out of work take
+						tasks from the queues of busy threads. This reduces lock
+						contention on systems with many CPU cores. Messages for each
+						subscription are still delivered in order.</para>
+					</description>
+				</configOption>
+				<configOption name="autoscale_target_wait" default="0">
+					<synopsis>Target time in milliseconds messages wait for a thread.</synopsis>
+					<description>
+						<para>When non-zero, the threadpool measures how long messages
+						wait before a thread starts delivering them. It grows when the
+						99th percentile of the wait is above this target and shrinks
+						when the wait is well below it, between
+						<replaceable>autoscale_min_size</replaceable> and
+						<replaceable>max_size</replaceable> threads. 0 disables
+						autoscaling.</para>
+					</description>
+				</configOption>
+				<configOption name="autoscale_min_size" default="0">
+					<synopsis>Number of threads autoscaling keeps in the threadpool.</synopsis>
+				</configOption>
+				<configOption name="autoscale_cooldown" default="5">
+					<synopsis>Minimum number of seconds between two autoscaling resizes.</synopsis>
+				</configOption>
 			</configObject>
 			<configObject name="declined_message_types">
 				<synopsis>Stasis message types for which to decline creation.</synopsis>
@@ -203,6 +234,26 @@ ASTERISK_REGISTER_FILE();
 			</configObject>
 		</configFile>
 	</configInfo>
+	<manager name="StasisStatistics" language="en_US">
+		<synopsis>
+			List the busiest stasis topics and subscriptions.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Count">
+				<para>Number of topics and of subscriptions to report. Defaults to 10.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Returns a <literal>StasisTopicStatistics</literal> event for each
+			of the topics with the most published messages and a
+			<literal>StasisSubscriptionStatistics</literal> event for each of the
+			subscriptions with the most dispatched messages, followed by a
+			<literal>StasisStatisticsComplete</literal> event. Latencies are the
+			time in microseconds from the creation of a message until the
+			subscription processed it.</para>
+		</description>
+	</manager>
 ***/
 
 /*!
@@ -305,6 +356,189 @@ static struct ast_threadpool *pool;
 
 STASIS_MESSAGE_TYPE_DEFN(stasis_subscription_change_type);
 
+/*! The number of buckets to use for the statistics registries */
+#if defined(LOW_MEMORY)
+#define STATISTICS_BUCKETS 31
+#else
+#define STATISTICS_BUCKETS 1021
+#endif
+
+/*!
+ * \internal
+ * \brief Statistics of a topic.
+ *
+ * Kept apart from the topic so the registry does not keep the topic
+ * alive. The topic unlinks its statistics when it is destroyed.
+ */
+struct topic_statistics {
+	/*! The counters, updated atomically without a lock */
+	struct stasis_topic_statistics counters;
+	/*! Name of the topic */
+	char name[0];
+};
+
+/*!
+ * \internal
+ * \brief Statistics of a subscription.
+ *
+ * Kept apart from the subscription for the same reason as
+ * \ref topic_statistics.
+ */
+struct subscription_statistics {
+	/*! The counters, updated atomically without a lock */
+	struct stasis_subscription_statistics counters;
+	/*! Unique ID of the subscription */
+	char uniqueid[AST_UUID_STR_LEN];
+	/*! Name of the topic subscribed to */
+	char topic[0];
+};
+
+/*! Statistics of all topics */
+static struct ao2_container *topic_statistics_all;
+
+/*! Statistics of all subscriptions */
+static struct ao2_container *subscription_statistics_all;
+
+static int topic_statistics_hash(const void *obj, const int flags)
+{
+	const struct topic_statistics *stats = obj;
+
+	return ast_str_hash(stats->name);
+}
+
+static int subscription_statistics_hash(const void *obj, const int flags)
+{
+	const struct subscription_statistics *stats = obj;
+
+	return ast_str_hash(stats->uniqueid);
+}
+
+/*!
+ * \internal
+ * \brief Create the statistics of a topic and add them to the registry.
+ * \param name Name of the topic
+ * \return The statistics, or NULL on error
+ */
+static struct topic_statistics *topic_statistics_create(const char *name)
+{
+	struct topic_statistics *stats;
+
+	stats = ao2_alloc_options(sizeof(*stats) + strlen(name) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!stats) {
+		return NULL;
+	}
+	strcpy(stats->name, name); /* Safe */
+
+	if (topic_statistics_all) {
+		ao2_link(topic_statistics_all, stats);
+	}
+
+	return stats;
+}
+
+/*!
+ * \internal
+ * \brief Create the statistics of a subscription and add them to the registry.
+ * \param uniqueid Unique ID of the subscription
+ * \param topic Name of the topic subscribed to
+ * \return The statistics, or NULL on error
+ */
+static struct subscription_statistics *subscription_statistics_create(
+	const char *uniqueid, const char *topic)
+{
+	struct subscription_statistics *stats;
+
+	stats = ao2_alloc_options(sizeof(*stats) + strlen(topic) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!stats) {
+		return NULL;
+	}
+	ast_copy_string(stats->uniqueid, uniqueid, sizeof(stats->uniqueid));
+	strcpy(stats->topic, topic); /* Safe */
+
+	if (subscription_statistics_all) {
+		ao2_link(subscription_statistics_all, stats);
+	}
+
+	return stats;
+}
+
+/*!
+ * \internal
+ * \brief Remove statistics from their registry and release them.
+ * \param container The registry
+ * \param stats The statistics, or NULL
+ */
+static void statistics_release(struct ao2_container *container, void *stats)
+{
+	if (!stats) {
+		return;
+	}
+	if (container) {
+		ao2_unlink(container, stats);
+	}
+	ao2_ref(stats, -1);
+}
+
+/*!
+ * \internal
+ * \brief Count a message dispatched to a subscription.
+ * \param stats Statistics of the subscription
+ */
+static void subscription_statistics_dispatched(struct subscription_statistics *stats)
+{
+	long queued;
+
+	queued = __sync_add_and_fetch(&stats->counters.messages_dispatched, 1)
+		- stats->counters.messages_processed;
+	/* Racing publishers may lose an update; close enough for reporting. */
+	if (queued > stats->counters.queue_max) {
+		stats->counters.queue_max = queued;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Count messages a subscription's callback was invoked with.
+ * \param stats Statistics of the subscription
+ * \param messages The messages
+ * \param count Number of messages
+ */
+static void subscription_statistics_processed(struct subscription_statistics *stats,
+	struct stasis_message **messages, size_t count)
+{
+	struct timeval now = ast_tvnow();
+	uint64_t total = 0;
+	int64_t max = 0;
+	int64_t latency;
+	size_t idx;
+
+	for (idx = 0; idx < count; ++idx) {
+		latency = ast_tvdiff_us(now, *stasis_message_timestamp(messages[idx]));
+		if (latency < 0) {
+			latency = 0;
+		}
+		total += latency;
+		max = MAX(max, latency);
+	}
+
+	__sync_fetch_and_add(&stats->counters.messages_processed, count);
+	__sync_fetch_and_add(&stats->counters.latency_us, total);
+	if (max > stats->counters.latency_max_us) {
+		stats->counters.latency_max_us = max;
+	}
+}
+
+/*! \internal \brief Copy the counters of a subscription's statistics */
+static void subscription_statistics_copy(const struct subscription_statistics *stats,
+	struct stasis_subscription_statistics *counters)
+{
+	*counters = stats->counters;
+	counters->queue_size = counters->messages_dispatched > counters->messages_processed
+		? counters->messages_dispatched - counters->messages_processed : 0;
+}
+
 /*! \internal */
 struct stasis_topic {
 	char *name;
@@ -313,13 +547,61 @@ struct stasis_topic {
 
 	/*! Topics forwarding into this topic */
 	AST_VECTOR(, struct stasis_topic *) upstream_topics;
+
+	/*! Immutable copy of the subscribers that publishers dispatch to */
+	struct ao2_global_obj published_subscribers;
+
+	/*! Publish statistics of the topic */
+	struct topic_statistics *statistics;
+};
+
+/*!
+ * \internal
+ * \brief Immutable array of the subscribers of a topic.
+ *
+ * Publishers dispatch to the array that was current when they started
+ * without holding the topic lock. Every change to the subscribers of
+ * the topic publishes a new array. An array holds a reference to the
+ * array that replaced it, so an array is only destroyed once no
+ * publisher uses it or any older array of the topic.
+ */
+struct topic_subscribers {
+	/*! The array that replaced this one. NULL while current. */
+	struct topic_subscribers *newer;
+	/*! ao2 objects to release once no publisher can dispatch from this array */
+	AST_VECTOR(, void *) held;
+	/*! Number of subscribers in the array */
+	size_t count;
+	/*! The subscribers */
+	struct stasis_subscription *subs[0];
+};
+
+/*!
+ * \internal
+ * \brief An unsubscribe waiting for the final message to be sent.
+ *
+ * The final message of a subscription must be the last message it
+ * receives. Publishers may still be dispatching to the subscription
+ * from the arrays of the topics it was removed from, so the final
+ * message is sent when the last of those arrays releases this object.
+ */
+struct subscription_unsubscribe {
+	/*! Topic the subscription was subscribed to */
+	struct stasis_topic *topic;
+	/*! Subscription being unsubscribed */
+	struct stasis_subscription *sub;
+	/*! Set once the subscription was removed from its topic */
+	unsigned int removed:1;
 };
 
 /* Forward declarations for the tightly-coupled subscription object */
 static int topic_add_subscription(struct stasis_topic *topic,
 	struct stasis_subscription *sub);
 
-static int topic_remove_subscription(struct stasis_topic *topic, struct stasis_subscription *sub);
+static int topic_remove_subscription(struct stasis_topic *topic, struct stasis_subscription *sub,
+	void *hold);
+
+static int topic_publish_subscribers(struct stasis_topic *topic, void *hold);
 
 /*! \brief Lock two topics. */
 #define topic_lock_both(topic1, topic2) \
@@ -343,6 +625,10 @@ static void topic_dtor(void *obj)
 
 	AST_VECTOR_FREE(&topic->subscribers);
 	AST_VECTOR_FREE(&topic->upstream_topics);
+	ao2_global_obj_release(topic->published_subscribers);
+	ast_rwlock_destroy(&topic->published_subscribers.lock);
+	statistics_release(topic_statistics_all, topic->statistics);
+	topic->statistics = NULL;
 }
 
 struct stasis_topic *stasis_topic_create(const char *name)
@@ -356,9 +642,14 @@ struct stasis_topic *stasis_topic_create(const char *name)
 	}
 
 	topic->name = ast_strdup(name);
+	ast_rwlock_init(&topic->published_subscribers.lock);
 	res |= AST_VECTOR_INIT(&topic->subscribers, INITIAL_SUBSCRIBERS_MAX);
 	res |= AST_VECTOR_INIT(&topic->upstream_topics, 0);
-	if (!topic->name || res) {
+	res |= topic_publish_subscribers(topic, NULL);
+	if (topic->name) {
+		topic->statistics = topic_statistics_create(topic->name);
+	}
+	if (!topic->name || !topic->statistics || res) {
 		ao2_cleanup(topic);
 		return NULL;
 	}
@@ -392,8 +683,61 @@ struct stasis_subscription {
 	/*! Flag set when final message for sub has been processed.
 	 *  Be sure join_lock is held before reading/setting. */
 	int final_message_processed;
+
+	/*! Which messages the topic dispatches to this subscription. */
+	enum stasis_subscription_message_filter filter;
+	/*! Formatters of message types accepted in addition to accepted_types. */
+	enum stasis_subscription_message_formatters accepted_formatters;
+	/*! Table of accepted message types, indexed by type id.
+	 *  Read by publishers without a lock; replaced under the ao2 lock. */
+	struct subscription_accepted_types *accepted_types;
+
+	/*! Callback for batched delivery; NULL if messages are delivered one at a time. */
+	stasis_subscription_batch_cb batch_callback;
+	/*! Maximum number of messages in a batch */
+	size_t batch_max;
+	/*! Longest time to hold back a batch which is not full */
+	unsigned int batch_delay_us;
+	/*! Messages waiting to be delivered. Be sure the ao2 lock is held. */
+	AST_VECTOR(, struct stasis_message *) batch;
+	/*! Time the first message of the batch was collected */
+	struct timeval batch_start;
+	/*! Flag set while a batch delivery task is queued on the mailbox */
+	int batch_scheduled;
+	/*! Condition signaled when the batch is full */
+	ast_cond_t batch_cond;
+
+	/*! Dispatch statistics of the subscription */
+	struct subscription_statistics *statistics;
+};
+
+/*!
+ * \brief Table of the message types a subscription accepts
+ *
+ * Publishers read the table without locking the subscription, so a table is
+ * never freed or shrunk while the subscription exists. Growing the table
+ * publishes a larger copy, which keeps the tables it replaced until the
+ * subscription is destroyed.
+ */
+struct subscription_accepted_types {
+	/*! The table this one replaced */
+	struct subscription_accepted_types *older;
+	/*! Number of entries in accepted */
+	int len;
+	/*! Non-zero for each accepted message type id */
+	char accepted[0];
 };
 
+static void subscription_accepted_types_free(struct subscription_accepted_types *accepted_types)
+{
+	while (accepted_types) {
+		struct subscription_accepted_types *older = accepted_types->older;
+
+		ast_free(accepted_types);
+		accepted_types = older;
+	}
+}
+
 static void subscription_dtor(void *obj)
 {
 	struct stasis_subscription *sub = obj;
@@ -410,6 +754,15 @@ static void subscription_dtor(void *obj)
 	ast_taskprocessor_unreference(sub->mailbox);
 	sub->mailbox = NULL;
 	ast_cond_destroy(&sub->join_cond);
+	subscription_accepted_types_free(sub->accepted_types);
+	sub->accepted_types = NULL;
+	if (sub->batch_callback) {
+		AST_VECTOR_RESET(&sub->batch, ao2_cleanup);
+		AST_VECTOR_FREE(&sub->batch);
+		ast_cond_destroy(&sub->batch_cond);
+	}
+	statistics_release(subscription_statistics_all, sub->statistics);
+	sub->statistics = NULL;
 }
 
 /*!
@@ -429,8 +782,19 @@ static void subscription_invoke(struct stasis_subscription *sub,
 		ast_cond_signal(&sub->join_cond);
 	}
 
+	subscription_statistics_processed(sub->statistics, &message, 1);
+
+	AST_PROBE4(stasis__dispatch__start, sub->uniqueid,
+		stasis_message_type_name(stasis_message_type(message)), message, 1);
+
 	/* Since sub is mostly immutable, no need to lock sub */
-	sub->callback(sub->data, sub, message);
+	if (sub->batch_callback) {
+		sub->batch_callback(sub->data, sub, &message, 1);
+	} else {
+		sub->callback(sub->data, sub, message);
+	}
+
+	AST_PROBE1(stasis__dispatch__done, sub->uniqueid);
 
 	/* Notify that the final message has been processed */
 	if (stasis_subscription_final_message(sub, message)) {
@@ -441,6 +805,41 @@ static void subscription_invoke(struct stasis_subscription *sub,
 	}
 }
 
+/*!
+ * \internal
+ * \brief Invoke a batched subscription's callback.
+ * \param sub Subscription to invoke.
+ * \param messages Messages to deliver.
+ * \param count Number of messages.
+ */
+static void subscription_invoke_batch(struct stasis_subscription *sub,
+	struct stasis_message **messages, size_t count)
+{
+	/* The final message can only be the last one */
+	int final = stasis_subscription_final_message(sub, messages[count - 1]);
+
+	if (final) {
+		SCOPED_AO2LOCK(lock, sub);
+
+		sub->final_message_rxed = 1;
+		ast_cond_signal(&sub->join_cond);
+	}
+
+	subscription_statistics_processed(sub->statistics, messages, count);
+
+	AST_PROBE4(stasis__dispatch__start, sub->uniqueid,
+		stasis_message_type_name(stasis_message_type(messages[0])), messages[0], count);
+	sub->batch_callback(sub->data, sub, messages, count);
+	AST_PROBE1(stasis__dispatch__done, sub->uniqueid);
+
+	if (final) {
+		SCOPED_AO2LOCK(lock, sub);
+
+		sub->final_message_processed = 1;
+		ast_cond_signal(&sub->join_cond);
+	}
+}
+
 static void send_subscription_subscribe(struct stasis_topic *topic, struct stasis_subscription *sub);
 static void send_subscription_unsubscribe(struct stasis_topic *topic, struct stasis_subscription *sub);
 
@@ -448,9 +847,17 @@ void stasis_subscription_cb_noop(void *data, struct stasis_subscription *sub, st
 {
 }
 
-struct stasis_subscription *internal_stasis_subscribe(
+/*! \internal \brief Options of a batched subscription */
+struct subscription_batch_options {
+	stasis_subscription_batch_cb callback;
+	size_t max_messages;
+	unsigned int max_delay_us;
+};
+
+static struct stasis_subscription *subscribe_full(
 	struct stasis_topic *topic,
 	stasis_subscription_cb callback,
+	const struct subscription_batch_options *batch,
 	void *data,
 	int needs_mailbox,
 	int use_thread_pool)
@@ -467,6 +874,10 @@ struct stasis_subscription *internal_stasis_subscribe(
 		return NULL;
 	}
 	ast_uuid_generate_str(sub->uniqueid, sizeof(sub->uniqueid));
+	sub->statistics = subscription_statistics_create(sub->uniqueid, topic->name);
+	if (!sub->statistics) {
+		return NULL;
+	}
 
 	if (needs_mailbox) {
 		/* With a small number of subscribers, a thread-per-sub is
@@ -476,8 +887,9 @@ struct stasis_subscription *internal_stasis_subscribe(
 		if (use_thread_pool) {
 			sub->mailbox = ast_threadpool_serializer(sub->uniqueid, pool);
 		} else {
+			/* Many publishers feed a single subscriber thread */
 			sub->mailbox = ast_taskprocessor_get(sub->uniqueid,
-				TPS_REF_DEFAULT);
+				TPS_REF_DEFAULT | TPS_QUEUE_LOCKFREE);
 		}
 		if (!sub->mailbox) {
 			return NULL;
@@ -493,6 +905,16 @@ struct stasis_subscription *internal_stasis_subscribe(
 	sub->data = data;
 	ast_cond_init(&sub->join_cond, NULL);
 
+	if (batch) {
+		if (AST_VECTOR_INIT(&sub->batch, batch->max_messages)) {
+			return NULL;
+		}
+		ast_cond_init(&sub->batch_cond, NULL);
+		sub->batch_callback = batch->callback;
+		sub->batch_max = batch->max_messages;
+		sub->batch_delay_us = batch->max_delay_us;
+	}
+
 	if (topic_add_subscription(topic, sub) != 0) {
 		return NULL;
 	}
@@ -502,6 +924,16 @@ struct stasis_subscription *internal_stasis_subscribe(
 	return sub;
 }
 
+struct stasis_subscription *internal_stasis_subscribe(
+	struct stasis_topic *topic,
+	stasis_subscription_cb callback,
+	void *data,
+	int needs_mailbox,
+	int use_thread_pool)
+{
+	return subscribe_full(topic, callback, NULL, data, needs_mailbox, use_thread_pool);
+}
+
 struct stasis_subscription *stasis_subscribe(
 	struct stasis_topic *topic,
 	stasis_subscription_cb callback,
@@ -518,6 +950,21 @@ struct stasis_subscription *stasis_subscribe_pool(
 	return internal_stasis_subscribe(topic, callback, data, 1, 1);
 }
 
+struct stasis_subscription *stasis_subscribe_batch(struct stasis_topic *topic,
+	stasis_subscription_batch_cb callback, void *data,
+	size_t max_messages, unsigned int max_delay_us)
+{
+	struct subscription_batch_options batch = {
+		.callback = callback,
+		.max_messages = MAX(max_messages, 1),
+		.max_delay_us = max_delay_us,
+	};
+
+	ast_assert(callback != NULL);
+
+	return subscribe_full(topic, stasis_subscription_cb_noop, &batch, data, 1, 0);
+}
+
 static int sub_cleanup(void *data)
 {
 	struct stasis_subscription *sub = data;
@@ -525,6 +972,35 @@ static int sub_cleanup(void *data)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Send the final message to a subscription removed from its topic.
+ * \param topic Topic the subscription was subscribed to
+ * \param sub Subscription
+ */
+static void subscription_finish_unsubscribe(struct stasis_topic *topic,
+	struct stasis_subscription *sub)
+{
+	/* Now let everyone know about the unsubscribe */
+	send_subscription_unsubscribe(topic, sub);
+
+	/* When all that's done, remove the ref the mailbox has on the sub */
+	if (sub->mailbox) {
+		ast_taskprocessor_push(sub->mailbox, sub_cleanup, sub);
+	}
+}
+
+static void subscription_unsubscribe_dtor(void *obj)
+{
+	struct subscription_unsubscribe *unsub = obj;
+
+	if (unsub->removed) {
+		subscription_finish_unsubscribe(unsub->topic, unsub->sub);
+	}
+	ao2_cleanup(unsub->sub);
+	ao2_cleanup(unsub->topic);
+}
+
 struct stasis_subscription *stasis_unsubscribe(struct stasis_subscription *sub)
 {
 	/* The subscription may be the last ref to this topic. Hold
@@ -532,24 +1008,34 @@ struct stasis_subscription *stasis_unsubscribe(struct stasis_subscription *sub)
 	RAII_VAR(struct stasis_topic *, topic,
 		ao2_bump(sub ? sub->topic : NULL), ao2_cleanup);
 
+	struct subscription_unsubscribe *unsub;
+
 	if (!sub) {
 		return NULL;
 	}
 
+	unsub = ao2_alloc_options(sizeof(*unsub), subscription_unsubscribe_dtor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (unsub) {
+		unsub->topic = ao2_bump(topic);
+		unsub->sub = ao2_bump(sub);
+	}
+
 	/* We have to remove the subscription first, to ensure the unsubscribe
 	 * is the final message */
-	if (topic_remove_subscription(sub->topic, sub) != 0) {
+	if (topic_remove_subscription(sub->topic, sub, unsub) != 0) {
 		ast_log(LOG_ERROR,
 			"Internal error: subscription has invalid topic\n");
+		ao2_cleanup(unsub);
 		return NULL;
 	}
 
-	/* Now let everyone know about the unsubscribe */
-	send_subscription_unsubscribe(topic, sub);
-
-	/* When all that's done, remove the ref the mailbox has on the sub */
-	if (sub->mailbox) {
-		ast_taskprocessor_push(sub->mailbox, sub_cleanup, sub);
+	if (unsub) {
+		/* Sent once publishers no longer dispatch to the subscription */
+		unsub->removed = 1;
+		ao2_ref(unsub, -1);
+	} else {
+		subscription_finish_unsubscribe(topic, sub);
 	}
 
 	/* Unsubscribing unrefs the subscription */
@@ -557,6 +1043,138 @@ struct stasis_subscription *stasis_unsubscribe(struct stasis_subscription *sub)
 	return NULL;
 }
 
+int stasis_subscription_accept_message_type(struct stasis_subscription *subscription,
+	const struct stasis_message_type *type)
+{
+	struct subscription_accepted_types *accepted_types;
+	int id;
+
+	if (!subscription) {
+		return -1;
+	}
+
+	if (!type) {
+		/* Filtering is unreliable as this message type is not yet initialized
+		 * so force all messages through.
+		 */
+		subscription->filter = STASIS_SUBSCRIPTION_FILTER_NONE;
+		return 0;
+	}
+
+	id = stasis_message_type_id(type);
+
+	ao2_lock(subscription);
+	accepted_types = subscription->accepted_types;
+	if (!accepted_types || id >= accepted_types->len) {
+		int len = MAX(id + 1, accepted_types ? accepted_types->len * 2 : 32);
+
+		accepted_types = ast_calloc(1, sizeof(*accepted_types) + len);
+		if (!accepted_types) {
+			ao2_unlock(subscription);
+			return -1;
+		}
+		accepted_types->len = len;
+		accepted_types->older = subscription->accepted_types;
+		if (accepted_types->older) {
+			memcpy(accepted_types->accepted, accepted_types->older->accepted,
+				accepted_types->older->len);
+		}
+	}
+	accepted_types->accepted[id] = 1;
+
+	/* Publishers may read the table as soon as it is assigned */
+	__sync_synchronize();
+	subscription->accepted_types = accepted_types;
+	ao2_unlock(subscription);
+
+	return 0;
+}
+
+int stasis_subscription_decline_message_type(struct stasis_subscription *subscription,
+	const struct stasis_message_type *type)
+{
+	int id;
+
+	if (!subscription) {
+		return -1;
+	}
+
+	if (!type) {
+		return 0;
+	}
+
+	id = stasis_message_type_id(type);
+
+	ao2_lock(subscription);
+	if (subscription->accepted_types && id < subscription->accepted_types->len) {
+		subscription->accepted_types->accepted[id] = 0;
+	}
+	ao2_unlock(subscription);
+
+	return 0;
+}
+
+void stasis_subscription_accept_formatters(struct stasis_subscription *subscription,
+	enum stasis_subscription_message_formatters formatters)
+{
+	ast_assert(subscription != NULL);
+
+	ao2_lock(subscription);
+	subscription->accepted_formatters |= formatters;
+	ao2_unlock(subscription);
+}
+
+int stasis_subscription_set_filter(struct stasis_subscription *subscription,
+	enum stasis_subscription_message_filter filter)
+{
+	if (!subscription) {
+		return -1;
+	}
+
+	ao2_lock(subscription);
+	subscription->filter = filter;
+	ao2_unlock(subscription);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a topic should dispatch a message to a subscription
+ *
+ * \param sub Subscription to check.
+ * \param message Message being published.
+ *
+ * \retval non-zero if the subscription accepts the message.
+ * \retval zero if the message must be skipped.
+ */
+static int subscription_accepts_message(struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	struct stasis_message_type *type;
+	struct subscription_accepted_types *accepted_types;
+	int id;
+
+	if (sub->filter != STASIS_SUBSCRIPTION_FILTER_SELECTIVE) {
+		return 1;
+	}
+
+	type = stasis_message_type(message);
+	if (type == stasis_subscription_change_type()) {
+		/* The final message must always get through */
+		return 1;
+	}
+
+	if (stasis_message_type_available_formatters(type) & sub->accepted_formatters) {
+		return 1;
+	}
+
+	id = stasis_message_type_id(type);
+	accepted_types = sub->accepted_types;
+
+	return accepted_types && id < accepted_types->len && accepted_types->accepted[id];
+}
+
 void stasis_subscription_join(struct stasis_subscription *subscription)
 {
 	if (subscription) {
@@ -620,6 +1238,26 @@ const char *stasis_subscription_uniqueid(const struct stasis_subscription *sub)
 	return sub->uniqueid;
 }
 
+void stasis_topic_statistics_get(const struct stasis_topic *topic,
+	struct stasis_topic_statistics *stats)
+{
+	if (!topic->statistics) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = topic->statistics->counters;
+}
+
+void stasis_subscription_statistics_get(const struct stasis_subscription *sub,
+	struct stasis_subscription_statistics *stats)
+{
+	if (!sub->statistics) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	subscription_statistics_copy(sub->statistics, stats);
+}
+
 int stasis_subscription_final_message(struct stasis_subscription *sub, struct stasis_message *msg)
 {
 	struct stasis_subscription_change *change;
@@ -640,6 +1278,64 @@ int stasis_subscription_final_message(struct stasis_subscription *sub, struct st
 	return 1;
 }
 
+static void topic_subscribers_dtor(void *obj)
+{
+	struct topic_subscribers *subscribers = obj;
+
+	/* No publisher can dispatch to the removed subscriptions anymore. */
+	AST_VECTOR_RESET(&subscribers->held, ao2_cleanup);
+	AST_VECTOR_FREE(&subscribers->held);
+	ao2_cleanup(subscribers->newer);
+}
+
+/*!
+ * \internal
+ * \brief Publish a copy of the subscribers of a topic to its publishers.
+ * \param topic Topic, which must be locked
+ * \param hold ao2 object the replaced array holds a reference to until released, or NULL
+ * \return 0 on success
+ * \return Non-zero on error, the replaced array stays current
+ */
+static int topic_publish_subscribers(struct stasis_topic *topic, void *hold)
+{
+	struct topic_subscribers *subscribers;
+	struct topic_subscribers *old;
+	size_t idx;
+
+	subscribers = ao2_alloc_options(sizeof(*subscribers)
+		+ AST_VECTOR_SIZE(&topic->subscribers) * sizeof(subscribers->subs[0]),
+		topic_subscribers_dtor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!subscribers) {
+		/* Keep dispatching from the current array until it can be replaced. */
+		old = ao2_global_obj_ref(topic->published_subscribers);
+		if (old && hold && !AST_VECTOR_APPEND(&old->held, hold)) {
+			ao2_ref(hold, +1);
+		}
+		ao2_cleanup(old);
+		return -1;
+	}
+
+	AST_VECTOR_INIT(&subscribers->held, 0);
+	subscribers->count = AST_VECTOR_SIZE(&topic->subscribers);
+	for (idx = 0; idx < subscribers->count; ++idx) {
+		subscribers->subs[idx] = AST_VECTOR_GET(&topic->subscribers, idx);
+	}
+
+	old = ao2_global_obj_replace(topic->published_subscribers, subscribers);
+	if (!old) {
+		ao2_ref(subscribers, -1);
+		return 0;
+	}
+
+	/* The old array passes our reference on to keep the new one alive. */
+	old->newer = subscribers;
+	if (hold && !AST_VECTOR_APPEND(&old->held, hold)) {
+		ao2_ref(hold, +1);
+	}
+	ao2_ref(old, -1);
+	return 0;
+}
+
 /*!
  * \brief Add a subscriber to a topic.
  * \param topic Topic
@@ -658,7 +1354,15 @@ static int topic_add_subscription(struct stasis_topic *topic, struct stasis_subs
 	 *
 	 * If we bumped the refcount here, the owner would have to unsubscribe
 	 * and cleanup, which is a bit awkward. */
-	AST_VECTOR_APPEND(&topic->subscribers, sub);
+	if (AST_VECTOR_APPEND(&topic->subscribers, sub)) {
+		return -1;
+	}
+	if (topic_publish_subscribers(topic, NULL)) {
+		AST_VECTOR_REMOVE_ELEM_UNORDERED(&topic->subscribers, sub,
+			AST_VECTOR_ELEM_CLEANUP_NOOP);
+		return -1;
+	}
+	topic->statistics->counters.subscribers = AST_VECTOR_SIZE(&topic->subscribers);
 
 	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->upstream_topics); ++idx) {
 		topic_add_subscription(
@@ -668,18 +1372,33 @@ static int topic_add_subscription(struct stasis_topic *topic, struct stasis_subs
 	return 0;
 }
 
-static int topic_remove_subscription(struct stasis_topic *topic, struct stasis_subscription *sub)
+/*!
+ * \brief Remove a subscriber from a topic.
+ * \param topic Topic
+ * \param sub Subscriber
+ * \param hold ao2 object to keep until no publisher of the topic can still
+ * dispatch to the subscriber, or NULL
+ * \return 0 on success
+ * \return Non-zero if the subscriber was not subscribed to the topic
+ */
+static int topic_remove_subscription(struct stasis_topic *topic, struct stasis_subscription *sub,
+	void *hold)
 {
 	size_t idx;
 	SCOPED_AO2LOCK(lock_topic, topic);
 
 	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->upstream_topics); ++idx) {
 		topic_remove_subscription(
-			AST_VECTOR_GET(&topic->upstream_topics, idx), sub);
+			AST_VECTOR_GET(&topic->upstream_topics, idx), sub, hold);
 	}
 
-	return AST_VECTOR_REMOVE_ELEM_UNORDERED(&topic->subscribers, sub,
-		AST_VECTOR_ELEM_CLEANUP_NOOP);
+	if (AST_VECTOR_REMOVE_ELEM_UNORDERED(&topic->subscribers, sub,
+		AST_VECTOR_ELEM_CLEANUP_NOOP)) {
+		return -1;
+	}
+	topic->statistics->counters.subscribers = AST_VECTOR_SIZE(&topic->subscribers);
+	topic_publish_subscribers(topic, hold);
+	return 0;
 }
 
 /*!
@@ -698,6 +1417,121 @@ static int dispatch_exec_async(struct ast_taskprocessor_local *local)
 	return 0;
 }
 
+/*!
+ * \internal \brief Deliver the collected messages of a batched subscription
+ * \param data The subscription; the task holds a reference
+ * \return 0
+ */
+static int dispatch_exec_batch(void *data)
+{
+	struct stasis_subscription *sub = data;
+	struct stasis_message **messages;
+	size_t count;
+	size_t idx;
+
+	messages = ast_malloc(sub->batch_max * sizeof(*messages));
+
+	ao2_lock(sub);
+	if (sub->batch_delay_us) {
+		struct timeval deadline = ast_tvadd(sub->batch_start,
+			ast_samp2tv(sub->batch_delay_us, 1000000));
+		struct timespec end = {
+			.tv_sec = deadline.tv_sec,
+			.tv_nsec = deadline.tv_usec * 1000,
+		};
+
+		/* The final message is not held back */
+		while (AST_VECTOR_SIZE(&sub->batch)
+			&& AST_VECTOR_SIZE(&sub->batch) < sub->batch_max
+			&& !stasis_subscription_final_message(sub,
+				AST_VECTOR_GET(&sub->batch, AST_VECTOR_SIZE(&sub->batch) - 1))
+			&& ast_tvcmp(ast_tvnow(), deadline) < 0) {
+			if (ast_cond_timedwait(&sub->batch_cond, ao2_object_get_lockaddr(sub), &end) == ETIMEDOUT) {
+				break;
+			}
+		}
+	}
+
+	/*
+	 * Deliver everything collected, including messages collected while
+	 * delivering, so no message is left behind a later task such as the
+	 * subscription's cleanup.
+	 */
+	while (AST_VECTOR_SIZE(&sub->batch)) {
+		if (!messages) {
+			/* Deliver the messages one at a time instead */
+			struct stasis_message *message = AST_VECTOR_REMOVE_ORDERED(&sub->batch, 0);
+
+			ao2_unlock(sub);
+			subscription_invoke_batch(sub, &message, 1);
+			ao2_cleanup(message);
+			ao2_lock(sub);
+			continue;
+		}
+
+		/* Take the oldest messages; the rest start the next batch */
+		count = MIN(AST_VECTOR_SIZE(&sub->batch), sub->batch_max);
+		memcpy(messages, sub->batch.elems, count * sizeof(*messages));
+		memmove(sub->batch.elems, sub->batch.elems + count,
+			(AST_VECTOR_SIZE(&sub->batch) - count) * sizeof(*messages));
+		sub->batch.current -= count;
+		ao2_unlock(sub);
+
+		subscription_invoke_batch(sub, messages, count);
+
+		for (idx = 0; idx < count; ++idx) {
+			ao2_cleanup(messages[idx]);
+		}
+		ao2_lock(sub);
+	}
+	sub->batch_scheduled = 0;
+	ao2_unlock(sub);
+
+	ast_free(messages);
+	ao2_cleanup(sub);
+
+	return 0;
+}
+
+/*!
+ * \internal \brief Collect a message for a batched subscription
+ * \param sub The subscriber to dispatch to
+ * \param message The message to send
+ */
+static void dispatch_message_batch(struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	int schedule;
+
+	ao2_lock(sub);
+	if (AST_VECTOR_APPEND(&sub->batch, message)) {
+		ao2_unlock(sub);
+		ast_log(LOG_ERROR, "Dropping async dispatch\n");
+		__sync_fetch_and_sub(&sub->statistics->counters.messages_dispatched, 1);
+		return;
+	}
+	ao2_bump(message);
+	if (AST_VECTOR_SIZE(&sub->batch) == 1) {
+		sub->batch_start = ast_tvnow();
+	}
+	if (AST_VECTOR_SIZE(&sub->batch) >= sub->batch_max
+		|| stasis_subscription_final_message(sub, message)) {
+		ast_cond_signal(&sub->batch_cond);
+	}
+	schedule = !sub->batch_scheduled;
+	sub->batch_scheduled = 1;
+	ao2_unlock(sub);
+
+	if (schedule && ast_taskprocessor_push(sub->mailbox, dispatch_exec_batch, ao2_bump(sub))) {
+		/* Push failed; ugh. The message is delivered with the next one. */
+		ast_log(LOG_ERROR, "Dropping async dispatch\n");
+		ao2_lock(sub);
+		sub->batch_scheduled = 0;
+		ao2_unlock(sub);
+		ao2_cleanup(sub);
+	}
+}
+
 /*!
  * \internal \brief Data passed to \ref dispatch_exec_sync to synchronize
  * a published message to a subscriber
@@ -737,15 +1571,29 @@ static int dispatch_exec_sync(struct ast_taskprocessor_local *local)
  * \param message The message to send
  * \param synchronous If non-zero, synchronize on the subscriber receiving
  * the message
+ * \retval 0 if the subscriber does not accept the message
+ * \retval 1 if the message was dispatched
  */
-static void dispatch_message(struct stasis_subscription *sub,
+static int dispatch_message(struct stasis_subscription *sub,
 	struct stasis_message *message,
 	int synchronous)
 {
+	if (!subscription_accepts_message(sub, message)) {
+		__sync_fetch_and_add(&sub->statistics->counters.messages_filtered, 1);
+		return 0;
+	}
+
+	subscription_statistics_dispatched(sub->statistics);
+
+	if (sub->batch_callback && !synchronous) {
+		dispatch_message_batch(sub, message);
+		return 1;
+	}
+
 	if (!sub->mailbox) {
 		/* Dispatch directly */
 		subscription_invoke(sub, message);
-		return;
+		return 1;
 	}
 
 	/* Bump the message for the taskprocessor push. This will get de-ref'd
@@ -756,7 +1604,9 @@ static void dispatch_message(struct stasis_subscription *sub,
 		if (ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_async, message)) {
 			/* Push failed; ugh. */
 			ast_log(LOG_ERROR, "Dropping async dispatch\n");
+			__sync_fetch_and_sub(&sub->statistics->counters.messages_dispatched, 1);
 			ao2_cleanup(message);
+			return 0;
 		}
 	} else {
 		struct sync_task_data std;
@@ -769,10 +1619,11 @@ static void dispatch_message(struct stasis_subscription *sub,
 		if (ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_sync, &std)) {
 			/* Push failed; ugh. */
 			ast_log(LOG_ERROR, "Dropping sync dispatch\n");
+			__sync_fetch_and_sub(&sub->statistics->counters.messages_dispatched, 1);
 			ao2_cleanup(message);
 			ast_mutex_destroy(&std.lock);
 			ast_cond_destroy(&std.cond);
-			return;
+			return 0;
 		}
 
 		ast_mutex_lock(&std.lock);
@@ -784,6 +1635,8 @@ static void dispatch_message(struct stasis_subscription *sub,
 		ast_mutex_destroy(&std.lock);
 		ast_cond_destroy(&std.cond);
 	}
+
+	return 1;
 }
 
 /*!
@@ -796,25 +1649,34 @@ static void dispatch_message(struct stasis_subscription *sub,
 static void publish_msg(struct stasis_topic *topic,
 	struct stasis_message *message, struct stasis_subscription *sync_sub)
 {
+	struct topic_subscribers *subscribers;
+	int dispatched = 0;
 	size_t i;
 
 	ast_assert(topic != NULL);
 	ast_assert(message != NULL);
 
+	AST_PROBE3(stasis__publish, topic->name,
+		stasis_message_type_name(stasis_message_type(message)), message);
+
 	/*
 	 * The topic may be unref'ed by the subscription invocation.
 	 * Make sure we hold onto a reference while dispatching.
 	 */
 	ao2_ref(topic, +1);
-	ao2_lock(topic);
-	for (i = 0; i < AST_VECTOR_SIZE(&topic->subscribers); ++i) {
-		struct stasis_subscription *sub = AST_VECTOR_GET(&topic->subscribers, i);
+	subscribers = ao2_global_obj_ref(topic->published_subscribers);
+	if (subscribers) {
+		for (i = 0; i < subscribers->count; ++i) {
+			struct stasis_subscription *sub = subscribers->subs[i];
 
-		ast_assert(sub != NULL);
+			ast_assert(sub != NULL);
 
-		dispatch_message(sub, message, (sub == sync_sub));
+			dispatched += dispatch_message(sub, message, (sub == sync_sub));
+		}
+		ao2_ref(subscribers, -1);
 	}
-	ao2_unlock(topic);
+	__sync_fetch_and_add(&topic->statistics->counters.messages_published, 1);
+	__sync_fetch_and_add(&topic->statistics->counters.messages_dispatched, dispatched);
 	ao2_ref(topic, -1);
 }
 
@@ -869,13 +1731,22 @@ struct stasis_forward *stasis_forward_cancel(struct stasis_forward *forward)
 	to = forward->to_topic;
 
 	if (from && to) {
+		struct topic_subscribers *hold;
+
 		topic_lock_both(to, from);
 		AST_VECTOR_REMOVE_ELEM_UNORDERED(&to->upstream_topics, from,
 			AST_VECTOR_ELEM_CLEANUP_NOOP);
 
+		/*
+		 * Publishers of from may still dispatch to the subscribers of
+		 * to.  Keeping the current array of to until then holds back
+		 * the final messages of those subscribers.
+		 */
+		hold = ao2_global_obj_ref(to->published_subscribers);
 		for (idx = 0; idx < AST_VECTOR_SIZE(&to->subscribers); ++idx) {
-			topic_remove_subscription(from, AST_VECTOR_GET(&to->subscribers, idx));
+			topic_remove_subscription(from, AST_VECTOR_GET(&to->subscribers, idx), hold);
 		}
+		ao2_cleanup(hold);
 		ao2_unlock(from);
 		ao2_unlock(to);
 	}
@@ -1251,7 +2122,7 @@ void ast_multi_object_blob_single_channel_publish(struct ast_channel *chan,
 	message = stasis_message_create(type, multi);
 	if (message) {
 		/* app_userevent still publishes to channel */
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 }
 
@@ -1402,6 +2273,14 @@ struct stasis_threadpool_conf {
 	int idle_timeout_sec;
 	/*! Maximum number of thread to allow */
 	int max_size;
+	/*! Nonzero to use per-thread task queues with work stealing */
+	int work_stealing;
+	/*! Target queue wait in milliseconds for autoscaling, 0 to disable */
+	int autoscale_target_wait;
+	/*! Number of threads autoscaling keeps in the pool */
+	int autoscale_min_size;
+	/*! Minimum seconds between autoscaling resizes */
+	int autoscale_cooldown;
 };
 
 struct stasis_config {
@@ -1537,9 +2416,330 @@ STASIS_MESSAGE_TYPE_DEFN(ast_multi_user_event_type,
 
 /*! @} */
 
+/*! Number of topics and subscriptions reported when no count is given */
+#define STATISTICS_DEFAULT_COUNT 10
+
+/*! \internal \brief References to the statistics of a registry, most active first */
+struct statistics_list {
+	/*! The statistics */
+	void **stats;
+	/*! Number of statistics */
+	size_t count;
+};
+
+static int topic_statistics_cmp_published(const void *left, const void *right)
+{
+	const struct topic_statistics *lhs = *(void * const *)left;
+	const struct topic_statistics *rhs = *(void * const *)right;
+
+	if (lhs->counters.messages_published == rhs->counters.messages_published) {
+		return 0;
+	}
+	return lhs->counters.messages_published < rhs->counters.messages_published ? 1 : -1;
+}
+
+static int subscription_statistics_cmp_dispatched(const void *left, const void *right)
+{
+	const struct subscription_statistics *lhs = *(void * const *)left;
+	const struct subscription_statistics *rhs = *(void * const *)right;
+
+	if (lhs->counters.messages_dispatched == rhs->counters.messages_dispatched) {
+		return 0;
+	}
+	return lhs->counters.messages_dispatched < rhs->counters.messages_dispatched ? 1 : -1;
+}
+
+/*!
+ * \internal
+ * \brief Collect the statistics of a registry, most active first.
+ * \param list List to fill
+ * \param container The registry
+ * \param cmp Comparison ordering the most active statistics first
+ * \return 0 on success
+ * \return -1 on error
+ */
+static int statistics_list_init(struct statistics_list *list,
+	struct ao2_container *container, int (*cmp)(const void *, const void *))
+{
+	struct ao2_iterator iter;
+	void *stats;
+	size_t size;
+
+	list->count = 0;
+	list->stats = NULL;
+	if (!container) {
+		return -1;
+	}
+
+	ao2_lock(container);
+	size = ao2_container_count(container);
+	list->stats = ast_malloc(MAX(size, 1) * sizeof(*list->stats));
+	if (!list->stats) {
+		ao2_unlock(container);
+		return -1;
+	}
+	iter = ao2_iterator_init(container, AO2_ITERATOR_DONTLOCK);
+	while (list->count < size && (stats = ao2_iterator_next(&iter))) {
+		list->stats[list->count++] = stats;
+	}
+	ao2_iterator_destroy(&iter);
+	ao2_unlock(container);
+
+	/* The counters keep moving; the order is only a snapshot. */
+	qsort(list->stats, list->count, sizeof(*list->stats), cmp);
+	return 0;
+}
+
+static void statistics_list_cleanup(struct statistics_list *list)
+{
+	size_t idx;
+
+	for (idx = 0; idx < list->count; ++idx) {
+		ao2_ref(list->stats[idx], -1);
+	}
+	ast_free(list->stats);
+	list->stats = NULL;
+	list->count = 0;
+}
+
+/*! \internal \brief Average latency of the processed messages of a subscription */
+static uint64_t statistics_latency_avg(const struct stasis_subscription_statistics *counters)
+{
+	return counters->messages_processed
+		? counters->latency_us / counters->messages_processed : 0;
+}
+
+static char *statistics_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct statistics_list topics;
+	struct statistics_list subscriptions;
+	struct stasis_subscription_statistics counters;
+	int count = STATISTICS_DEFAULT_COUNT;
+	size_t idx;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "stasis statistics show";
+		e->usage =
+			"Usage: stasis statistics show [<count>]\n"
+			"	Shows the <count> topics with the most published messages and\n"
+			"	the <count> subscriptions with the most dispatched messages.\n"
+			"	Latency is the time in microseconds from the creation of a\n"
+			"	message until the subscription processed it. Subscriptions\n"
+			"	with many filtered messages or a deep queue are candidates for\n"
+			"	declining message types in stasis.conf.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%30d", &count) != 1 || count < 1) {
+			return CLI_SHOWUSAGE;
+		}
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (statistics_list_init(&topics, topic_statistics_all, topic_statistics_cmp_published)) {
+		ast_cli(a->fd, "Could not collect the topic statistics\n");
+		return CLI_FAILURE;
+	}
+	if (statistics_list_init(&subscriptions, subscription_statistics_all,
+		subscription_statistics_cmp_dispatched)) {
+		statistics_list_cleanup(&topics);
+		ast_cli(a->fd, "Could not collect the subscription statistics\n");
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "\n%-40s %12s %12s %11s\n", "Topic", "Published", "Dispatched", "Subscribers");
+	for (idx = 0; idx < topics.count && idx < count; ++idx) {
+		struct topic_statistics *stats = topics.stats[idx];
+
+		ast_cli(a->fd, "%-40.40s %12" PRIu64 " %12" PRIu64 " %11d\n",
+			stats->name, stats->counters.messages_published,
+			stats->counters.messages_dispatched, stats->counters.subscribers);
+	}
+	ast_cli(a->fd, "%zu topics\n", topics.count);
+
+	ast_cli(a->fd, "\n%-36s %-30s %12s %12s %12s %8s %8s %10s %10s\n",
+		"Subscription", "Topic", "Dispatched", "Processed", "Filtered",
+		"In Queue", "Max Queue", "Avg Lat", "Max Lat");
+	for (idx = 0; idx < subscriptions.count && idx < count; ++idx) {
+		struct subscription_statistics *stats = subscriptions.stats[idx];
+
+		subscription_statistics_copy(stats, &counters);
+		ast_cli(a->fd, "%-36s %-30.30s %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+			" %8ld %8ld %10" PRIu64 " %10" PRId64 "\n",
+			stats->uniqueid, stats->topic, counters.messages_dispatched,
+			counters.messages_processed, counters.messages_filtered,
+			counters.queue_size, counters.queue_max,
+			statistics_latency_avg(&counters), counters.latency_max_us);
+	}
+	ast_cli(a->fd, "%zu subscriptions\n\n", subscriptions.count);
+
+	statistics_list_cleanup(&subscriptions);
+	statistics_list_cleanup(&topics);
+	return CLI_SUCCESS;
+}
+
+/*!
+ * \brief Number of topics with the most published messages in the metrics
+ *
+ * Channels, bridges and endpoints each have their own topics, named after
+ * their unique ids. Exporting every topic would make a new series for
+ * every call.
+ */
+#define STATISTICS_METRICS_TOPICS 20
+
+static void stasis_metrics_collect(struct ast_metrics_output *out)
+{
+	struct statistics_list topics;
+	size_t idx;
+
+	if (statistics_list_init(&topics, topic_statistics_all, topic_statistics_cmp_published)) {
+		return;
+	}
+
+	ast_metrics_output_family(out, "asterisk_stasis_topics", AST_METRIC_GAUGE,
+		"Stasis topics");
+	ast_metrics_output_sample(out, "asterisk_stasis_topics", NULL, NULL, topics.count);
+
+	ast_metrics_output_family(out, "asterisk_stasis_topic_messages_published_total",
+		AST_METRIC_COUNTER, "Messages published to the busiest stasis topics");
+	for (idx = 0; idx < topics.count && idx < STATISTICS_METRICS_TOPICS; ++idx) {
+		struct topic_statistics *stats = topics.stats[idx];
+
+		ast_metrics_output_sample(out, "asterisk_stasis_topic_messages_published_total",
+			"topic", stats->name, stats->counters.messages_published);
+	}
+
+	ast_metrics_output_family(out, "asterisk_stasis_topic_messages_dispatched_total",
+		AST_METRIC_COUNTER, "Messages of the busiest stasis topics dispatched to subscribers");
+	for (idx = 0; idx < topics.count && idx < STATISTICS_METRICS_TOPICS; ++idx) {
+		struct topic_statistics *stats = topics.stats[idx];
+
+		ast_metrics_output_sample(out, "asterisk_stasis_topic_messages_dispatched_total",
+			"topic", stats->name, stats->counters.messages_dispatched);
+	}
+
+	ast_metrics_output_family(out, "asterisk_stasis_topic_subscribers",
+		AST_METRIC_GAUGE, "Subscribers of the busiest stasis topics");
+	for (idx = 0; idx < topics.count && idx < STATISTICS_METRICS_TOPICS; ++idx) {
+		struct topic_statistics *stats = topics.stats[idx];
+
+		ast_metrics_output_sample(out, "asterisk_stasis_topic_subscribers",
+			"topic", stats->name, stats->counters.subscribers);
+	}
+
+	statistics_list_cleanup(&topics);
+}
+
+static struct ast_cli_entry cli_stasis[] = {
+	AST_CLI_DEFINE(statistics_show, "Show the busiest stasis topics and subscriptions"),
+};
+
+static int manager_stasis_statistics(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *count_str = astman_get_header(m, "Count");
+	RAII_VAR(struct ast_str *, id_text, ast_str_create(128), ast_free);
+	struct statistics_list topics;
+	struct statistics_list subscriptions;
+	struct stasis_subscription_statistics counters;
+	int count = STATISTICS_DEFAULT_COUNT;
+	int num_items = 0;
+	size_t idx;
+
+	if (!id_text) {
+		astman_send_error(s, m, "Internal error");
+		return -1;
+	}
+
+	if (!ast_strlen_zero(count_str)
+		&& (sscanf(count_str, "%30d", &count) != 1 || count < 1)) {
+		astman_send_error(s, m, "Count must be a positive number");
+		return 0;
+	}
+
+	if (!ast_strlen_zero(id)) {
+		ast_str_set(&id_text, 0, "ActionID: %s\r\n", id);
+	}
+
+	if (statistics_list_init(&topics, topic_statistics_all, topic_statistics_cmp_published)) {
+		astman_send_error(s, m, "Internal error");
+		return -1;
+	}
+	if (statistics_list_init(&subscriptions, subscription_statistics_all,
+		subscription_statistics_cmp_dispatched)) {
+		statistics_list_cleanup(&topics);
+		astman_send_error(s, m, "Internal error");
+		return -1;
+	}
+
+	astman_send_listack(s, m, "Stasis statistics will follow", "start");
+
+	for (idx = 0; idx < topics.count && idx < count; ++idx) {
+		struct topic_statistics *stats = topics.stats[idx];
+
+		astman_append(s,
+			"Event: StasisTopicStatistics\r\n"
+			"Topic: %s\r\n"
+			"MessagesPublished: %" PRIu64 "\r\n"
+			"MessagesDispatched: %" PRIu64 "\r\n"
+			"Subscribers: %d\r\n"
+			"%s"
+			"\r\n",
+			stats->name, stats->counters.messages_published,
+			stats->counters.messages_dispatched, stats->counters.subscribers,
+			ast_str_buffer(id_text));
+		++num_items;
+	}
+
+	for (idx = 0; idx < subscriptions.count && idx < count; ++idx) {
+		struct subscription_statistics *stats = subscriptions.stats[idx];
+
+		subscription_statistics_copy(stats, &counters);
+		astman_append(s,
+			"Event: StasisSubscriptionStatistics\r\n"
+			"Subscription: %s\r\n"
+			"Topic: %s\r\n"
+			"MessagesDispatched: %" PRIu64 "\r\n"
+			"MessagesProcessed: %" PRIu64 "\r\n"
+			"MessagesFiltered: %" PRIu64 "\r\n"
+			"QueueSize: %ld\r\n"
+			"QueueMax: %ld\r\n"
+			"LatencyAvg: %" PRIu64 "\r\n"
+			"LatencyMax: %" PRId64 "\r\n"
+			"%s"
+			"\r\n",
+			stats->uniqueid, stats->topic, counters.messages_dispatched,
+			counters.messages_processed, counters.messages_filtered,
+			counters.queue_size, counters.queue_max,
+			statistics_latency_avg(&counters), counters.latency_max_us,
+			ast_str_buffer(id_text));
+		++num_items;
+	}
+
+	statistics_list_cleanup(&subscriptions);
+	statistics_list_cleanup(&topics);
+
+	astman_send_list_complete_start(s, m, "StasisStatisticsComplete", num_items);
+	astman_send_list_complete_end(s);
+
+	return 0;
+}
+
 /*! \brief Cleanup function for graceful shutdowns */
 static void stasis_cleanup(void)
 {
+	ast_cli_unregister_multiple(cli_stasis, ARRAY_LEN(cli_stasis));
+	ast_manager_unregister("StasisStatistics");
+	ast_metrics_collector_unregister(stasis_metrics_collect);
+	ao2_cleanup(topic_statistics_all);
+	topic_statistics_all = NULL;
+	ao2_cleanup(subscription_statistics_all);
+	subscription_statistics_all = NULL;
 	ast_threadpool_shutdown(pool);
 	pool = NULL;
 	STASIS_MESSAGE_TYPE_CLEANUP(stasis_subscription_change_type);
@@ -1557,6 +2757,14 @@ int stasis_init(void)
 	/* Be sure the types are cleaned up after the message bus */
 	ast_register_cleanup(stasis_cleanup);
 
+	topic_statistics_all = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		STATISTICS_BUCKETS, topic_statistics_hash, NULL, NULL);
+	subscription_statistics_all = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		STATISTICS_BUCKETS, subscription_statistics_hash, NULL, NULL);
+	if (!topic_statistics_all || !subscription_statistics_all) {
+		return -1;
+	}
+
 	if (aco_info_init(&cfg_info)) {
 		return -1;
 	}
@@ -1575,6 +2783,21 @@ int stasis_init(void)
 		threadpool_options, "50", OPT_INT_T, PARSE_IN_RANGE,
 		FLDSET(struct stasis_threadpool_conf, max_size), 0,
 		INT_MAX);
+	aco_option_register(&cfg_info, "work_stealing", ACO_EXACT,
+		threadpool_options, "no", OPT_BOOL_T, 1,
+		FLDSET(struct stasis_threadpool_conf, work_stealing));
+	aco_option_register(&cfg_info, "autoscale_target_wait", ACO_EXACT,
+		threadpool_options, "0", OPT_INT_T, PARSE_IN_RANGE,
+		FLDSET(struct stasis_threadpool_conf, autoscale_target_wait), 0,
+		INT_MAX);
+	aco_option_register(&cfg_info, "autoscale_min_size", ACO_EXACT,
+		threadpool_options, "0", OPT_INT_T, PARSE_IN_RANGE,
+		FLDSET(struct stasis_threadpool_conf, autoscale_min_size), 0,
+		INT_MAX);
+	aco_option_register(&cfg_info, "autoscale_cooldown", ACO_EXACT,
+		threadpool_options, "5", OPT_INT_T, PARSE_IN_RANGE,
+		FLDSET(struct stasis_threadpool_conf, autoscale_cooldown), 0,
+		INT_MAX);
 
 	if (aco_process_config(&cfg_info, 0) == ACO_PROCESS_ERROR) {
 		struct stasis_config *default_cfg = stasis_config_alloc();
@@ -1610,6 +2833,10 @@ int stasis_init(void)
 	threadpool_opts.auto_increment = 1;
 	threadpool_opts.max_size = cfg->threadpool_options->max_size;
 	threadpool_opts.idle_timeout = cfg->threadpool_options->idle_timeout_sec;
+	threadpool_opts.work_stealing = cfg->threadpool_options->work_stealing;
+	threadpool_opts.autoscale_target_wait = cfg->threadpool_options->autoscale_target_wait;
+	threadpool_opts.autoscale_min_size = cfg->threadpool_options->autoscale_min_size;
+	threadpool_opts.autoscale_cooldown = cfg->threadpool_options->autoscale_cooldown;
 	pool = ast_threadpool_create("stasis-core", NULL, &threadpool_opts);
 	if (!pool) {
 		ast_log(LOG_ERROR, "Failed to create 'stasis-core' threadpool\n");
@@ -1628,6 +2855,13 @@ int stasis_init(void)
 		return -1;
 	}
 
+	ast_cli_register_multiple(cli_stasis, ARRAY_LEN(cli_stasis));
+	ast_metrics_collector_register("stasis", stasis_metrics_collect);
+	if (ast_manager_register_xml_core("StasisStatistics", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING,
+		manager_stasis_statistics)) {
+		return -1;
+	}
+
 	return 0;
 }
 
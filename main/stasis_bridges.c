@@ -588,6 +588,46 @@ struct ast_json *ast_bridge_snapshot_to_json(
 	return ast_json_ref(json_bridge);
 }
 
+int ast_bridge_snapshot_json_write(
+	const struct ast_bridge_snapshot *snapshot,
+	const struct stasis_message_sanitizer *sanitize,
+	struct ast_json_writer *writer)
+{
+	struct ao2_iterator it;
+	char *item;
+
+	if (snapshot == NULL) {
+		return -1;
+	}
+
+	/* The same members in the same order as ast_bridge_snapshot_to_json() */
+	ast_json_writer_object_start(writer);
+	ast_json_writer_key(writer, "id");
+	ast_json_writer_string(writer, snapshot->uniqueid);
+	ast_json_writer_key(writer, "technology");
+	ast_json_writer_string(writer, snapshot->technology);
+	ast_json_writer_key(writer, "bridge_type");
+	ast_json_writer_string(writer, capability2str(snapshot->capabilities));
+	ast_json_writer_key(writer, "bridge_class");
+	ast_json_writer_string(writer, snapshot->subclass);
+	ast_json_writer_key(writer, "creator");
+	ast_json_writer_string(writer, snapshot->creator);
+	ast_json_writer_key(writer, "name");
+	ast_json_writer_string(writer, snapshot->name);
+	ast_json_writer_key(writer, "channels");
+	ast_json_writer_array_start(writer);
+	for (it = ao2_iterator_init(snapshot->channels, 0);
+		(item = ao2_iterator_next(&it)); ao2_ref(item, -1)) {
+		if (sanitize && sanitize->channel_id && sanitize->channel_id(item)) {
+			continue;
+		}
+		ast_json_writer_string(writer, item);
+	}
+	ao2_iterator_destroy(&it);
+	ast_json_writer_array_end(writer);
+	return ast_json_writer_object_end(writer);
+}
+
 /*!
  * \internal
  * \brief Allocate the fields of an \ref ast_bridge_channel_snapshot_pair.
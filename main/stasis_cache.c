@@ -39,14 +39,19 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/vector.h"
 
 #ifdef LOW_MEMORY
+#define NUM_CACHE_SHARDS 1
 #define NUM_CACHE_BUCKETS 17
 #else
-#define NUM_CACHE_BUCKETS 563
+/*! Number of independently locked shards the entries of a cache are split into */
+#define NUM_CACHE_SHARDS 16
+/*! Initial number of buckets of each shard */
+#define NUM_CACHE_BUCKETS 37
 #endif
 
 /*! \internal */
 struct stasis_cache {
-	struct ao2_container *entries;
+	/*! Cache entries, sharded by the hash of their key */
+	struct ao2_container *entries[NUM_CACHE_SHARDS];
 	snapshot_get_id id_fn;
 	cache_aggregate_calc_fn aggregate_calc_fn;
 	cache_aggregate_publish_fn aggregate_publish_fn;
@@ -180,6 +185,20 @@ static void cache_entry_compute_hash(struct cache_entry_key *key)
 	key->hash += ast_hashtab_hash_string(key->id);
 }
 
+/*!
+ * \internal
+ * \brief Get the shard of the cache that holds the entry with the given key.
+ *
+ * \param cache The cache.
+ * \param key Key with its hash computed.
+ *
+ * \return Container of the shard's cached entries.
+ */
+static struct ao2_container *cache_shard(struct stasis_cache *cache, const struct cache_entry_key *key)
+{
+	return cache->entries[key->hash % NUM_CACHE_SHARDS];
+}
+
 static struct stasis_cache_entry *cache_entry_create(struct stasis_message_type *type, const char *id, struct stasis_message *snapshot)
 {
 	struct stasis_cache_entry *entry;
@@ -288,9 +307,12 @@ static int cache_entry_cmp(void *obj, void *arg, int flags)
 static void cache_dtor(void *obj)
 {
 	struct stasis_cache *cache = obj;
+	int shard;
 
-	ao2_cleanup(cache->entries);
-	cache->entries = NULL;
+	for (shard = 0; shard < NUM_CACHE_SHARDS; ++shard) {
+		ao2_cleanup(cache->entries[shard]);
+		cache->entries[shard] = NULL;
+	}
 }
 
 struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn,
@@ -298,6 +320,7 @@ struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn,
 	cache_aggregate_publish_fn aggregate_publish_fn)
 {
 	struct stasis_cache *cache;
+	int shard;
 
 	cache = ao2_alloc_options(sizeof(*cache), cache_dtor,
 		AO2_ALLOC_OPT_LOCK_NOLOCK);
@@ -305,11 +328,14 @@ struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn,
 		return NULL;
 	}
 
-	cache->entries = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK, 0,
-		NUM_CACHE_BUCKETS, cache_entry_hash, NULL, cache_entry_cmp);
-	if (!cache->entries) {
-		ao2_cleanup(cache);
-		return NULL;
+	for (shard = 0; shard < NUM_CACHE_SHARDS; ++shard) {
+		cache->entries[shard] = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK,
+			AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE | AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND,
+			NUM_CACHE_BUCKETS, cache_entry_hash, NULL, cache_entry_cmp);
+		if (!cache->entries[shard]) {
+			ao2_cleanup(cache);
+			return NULL;
+		}
 	}
 
 	cache->id_fn = id_fn;
@@ -342,33 +368,44 @@ struct stasis_message *stasis_cache_entry_get_remote(struct stasis_cache_entry *
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Initialize the key of a cache entry to search for.
+ *
+ * \param key Key to initialize.
+ * \param type Type of message of the cache entry.
+ * \param id Identity of the snapshot of the cache entry.
+ */
+static void cache_key_init(struct cache_entry_key *key, struct stasis_message_type *type, const char *id)
+{
+	key->type = type;
+	key->id = id;
+	cache_entry_compute_hash(key);
+}
+
 /*!
  * \internal
  * \brief Find the cache entry in the cache entries container.
  *
- * \param entries Container of cached entries.
- * \param type Type of message to retrieve the cache entry.
- * \param id Identity of the snapshot to retrieve the cache entry.
+ * \param entries Container of cached entries of the key's shard.
+ * \param search_key Key of the cache entry.
  *
  * \note The entries container is already locked.
  *
  * \retval Cache-entry on success.
  * \retval NULL Not in cache.
  */
-static struct stasis_cache_entry *cache_find(struct ao2_container *entries, struct stasis_message_type *type, const char *id)
+static struct stasis_cache_entry *cache_find(struct ao2_container *entries, const struct cache_entry_key *search_key)
 {
-	struct cache_entry_key search_key;
 	struct stasis_cache_entry *entry;
 
-	search_key.type = type;
-	search_key.id = id;
-	cache_entry_compute_hash(&search_key);
-	entry = ao2_find(entries, &search_key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	entry = ao2_find(entries, search_key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
 
 	/* Ensure that what we looked for is what we found. */
 	ast_assert(!entry
 		|| (!strcmp(stasis_message_type_name(entry->key.type),
-			stasis_message_type_name(type)) && !strcmp(entry->key.id, id)));
+			stasis_message_type_name(search_key->type))
+			&& !strcmp(entry->key.id, search_key->id)));
 	return entry;
 }
 
@@ -470,23 +507,27 @@ static struct cache_put_snapshots cache_put(struct stasis_cache *cache,
 {
 	struct stasis_cache_entry *cached_entry;
 	struct cache_put_snapshots snapshots;
+	struct cache_entry_key search_key;
+	struct ao2_container *entries;
 
-	ast_assert(cache->entries != NULL);
 	ast_assert(eid != NULL);/* Aggregate snapshots not allowed to be put directly. */
 	ast_assert(new_snapshot == NULL ||
 		type == stasis_message_type(new_snapshot));
 
 	memset(&snapshots, 0, sizeof(snapshots));
 
-	ao2_wrlock(cache->entries);
+	cache_key_init(&search_key, type, id);
+	entries = cache_shard(cache, &search_key);
+
+	ao2_wrlock(entries);
 
-	cached_entry = cache_find(cache->entries, type, id);
+	cached_entry = cache_find(entries, &search_key);
 
 	/* Update the eid snapshot. */
 	if (!new_snapshot) {
 		/* Remove snapshot from cache */
 		if (cached_entry) {
-			snapshots.old = cache_remove(cache->entries, cached_entry, eid);
+			snapshots.old = cache_remove(entries, cached_entry, eid);
 		}
 	} else if (cached_entry) {
 		/* Update snapshot in cache */
@@ -495,7 +536,7 @@ static struct cache_put_snapshots cache_put(struct stasis_cache *cache,
 		/* Insert into the cache */
 		cached_entry = cache_entry_create(type, id, new_snapshot);
 		if (cached_entry) {
-			ao2_link_flags(cache->entries, cached_entry, OBJ_NOLOCK);
+			ao2_link_flags(entries, cached_entry, OBJ_NOLOCK);
 		}
 	}
 
@@ -506,7 +547,7 @@ static struct cache_put_snapshots cache_put(struct stasis_cache *cache,
 		cached_entry->aggregate = ao2_bump(snapshots.aggregate_new);
 	}
 
-	ao2_unlock(cache->entries);
+	ao2_unlock(entries);
 
 	ao2_cleanup(cached_entry);
 	return snapshots;
@@ -550,9 +591,10 @@ struct ao2_container *stasis_cache_get_all(struct stasis_cache *cache, struct st
 {
 	struct stasis_cache_entry *cached_entry;
 	struct ao2_container *found;
+	struct cache_entry_key search_key;
+	struct ao2_container *entries;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 	ast_assert(id != NULL);
 
 	if (!type) {
@@ -564,15 +606,18 @@ struct ao2_container *stasis_cache_get_all(struct stasis_cache *cache, struct st
 		return NULL;
 	}
 
-	ao2_rdlock(cache->entries);
+	cache_key_init(&search_key, type, id);
+	entries = cache_shard(cache, &search_key);
+
+	ao2_rdlock(entries);
 
-	cached_entry = cache_find(cache->entries, type, id);
+	cached_entry = cache_find(entries, &search_key);
 	if (cached_entry && cache_entry_dump(found, cached_entry)) {
 		ao2_cleanup(found);
 		found = NULL;
 	}
 
-	ao2_unlock(cache->entries);
+	ao2_unlock(entries);
 
 	ao2_cleanup(cached_entry);
 	return found;
@@ -622,24 +667,28 @@ struct stasis_message *stasis_cache_get_by_eid(struct stasis_cache *cache, struc
 {
 	struct stasis_cache_entry *cached_entry;
 	struct stasis_message *snapshot = NULL;
+	struct cache_entry_key search_key;
+	struct ao2_container *entries;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 	ast_assert(id != NULL);
 
 	if (!type) {
 		return NULL;
 	}
 
-	ao2_rdlock(cache->entries);
+	cache_key_init(&search_key, type, id);
+	entries = cache_shard(cache, &search_key);
+
+	ao2_rdlock(entries);
 
-	cached_entry = cache_find(cache->entries, type, id);
+	cached_entry = cache_find(entries, &search_key);
 	if (cached_entry) {
 		snapshot = cache_entry_by_eid(cached_entry, eid);
 		ao2_bump(snapshot);
 	}
 
-	ao2_unlock(cache->entries);
+	ao2_unlock(entries);
 
 	ao2_cleanup(cached_entry);
 	return snapshot;
@@ -680,9 +729,9 @@ static int cache_dump_by_eid_cb(void *obj, void *arg, int flags)
 struct ao2_container *stasis_cache_dump_by_eid(struct stasis_cache *cache, struct stasis_message_type *type, const struct ast_eid *eid)
 {
 	struct cache_dump_data cache_dump;
+	int shard;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 
 	cache_dump.eid = eid;
 	cache_dump.type = type;
@@ -691,7 +740,11 @@ struct ao2_container *stasis_cache_dump_by_eid(struct stasis_cache *cache, struc
 		return NULL;
 	}
 
-	ao2_callback(cache->entries, OBJ_MULTIPLE | OBJ_NODATA, cache_dump_by_eid_cb, &cache_dump);
+	/* Only one shard is locked at a time */
+	for (shard = 0; cache_dump.container && shard < NUM_CACHE_SHARDS; ++shard) {
+		ao2_callback(cache->entries[shard], OBJ_MULTIPLE | OBJ_NODATA,
+			cache_dump_by_eid_cb, &cache_dump);
+	}
 	return cache_dump.container;
 }
 
@@ -700,6 +753,62 @@ struct ao2_container *stasis_cache_dump(struct stasis_cache *cache, struct stasi
 	return stasis_cache_dump_by_eid(cache, type, &ast_eid_default);
 }
 
+struct cache_iterate_data {
+	/*! Snapshots of the shard being iterated */
+	AST_VECTOR(, struct stasis_message *) snapshots;
+	struct stasis_message_type *type;
+	int error;
+};
+
+static int cache_iterate_collect_cb(void *obj, void *arg, int flags)
+{
+	struct cache_iterate_data *iterate = arg;
+	struct stasis_cache_entry *entry = obj;
+
+	if ((!iterate->type || entry->key.type == iterate->type) && entry->local) {
+		if (AST_VECTOR_APPEND(&iterate->snapshots, entry->local)) {
+			iterate->error = 1;
+			return CMP_STOP;
+		}
+		ao2_bump(entry->local);
+	}
+
+	return 0;
+}
+
+int stasis_cache_iterate(struct stasis_cache *cache, struct stasis_message_type *type,
+	stasis_cache_iterate_cb cb, void *data)
+{
+	struct cache_iterate_data iterate;
+	int shard;
+	int stop = 0;
+
+	ast_assert(cache != NULL);
+	ast_assert(cb != NULL);
+
+	iterate.type = type;
+	iterate.error = 0;
+	if (AST_VECTOR_INIT(&iterate.snapshots, 32)) {
+		return -1;
+	}
+
+	for (shard = 0; !stop && !iterate.error && shard < NUM_CACHE_SHARDS; ++shard) {
+		size_t idx;
+
+		ao2_callback(cache->entries[shard], OBJ_MULTIPLE | OBJ_NODATA,
+			cache_iterate_collect_cb, &iterate);
+
+		/* The shard is no longer locked while the snapshots are handed out */
+		for (idx = 0; !stop && !iterate.error && idx < AST_VECTOR_SIZE(&iterate.snapshots); ++idx) {
+			stop = cb(AST_VECTOR_GET(&iterate.snapshots, idx), data);
+		}
+		AST_VECTOR_RESET(&iterate.snapshots, ao2_cleanup);
+	}
+
+	AST_VECTOR_FREE(&iterate.snapshots);
+	return iterate.error ? -1 : 0;
+}
+
 static int cache_dump_all_cb(void *obj, void *arg, int flags)
 {
 	struct cache_dump_data *cache_dump = arg;
@@ -719,9 +828,9 @@ static int cache_dump_all_cb(void *obj, void *arg, int flags)
 struct ao2_container *stasis_cache_dump_all(struct stasis_cache *cache, struct stasis_message_type *type)
 {
 	struct cache_dump_data cache_dump;
+	int shard;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 
 	cache_dump.eid = NULL;
 	cache_dump.type = type;
@@ -730,7 +839,11 @@ struct ao2_container *stasis_cache_dump_all(struct stasis_cache *cache, struct s
 		return NULL;
 	}
 
-	ao2_callback(cache->entries, OBJ_MULTIPLE | OBJ_NODATA, cache_dump_all_cb, &cache_dump);
+	/* Only one shard is locked at a time */
+	for (shard = 0; cache_dump.container && shard < NUM_CACHE_SHARDS; ++shard) {
+		ao2_callback(cache->entries[shard], OBJ_MULTIPLE | OBJ_NODATA,
+			cache_dump_all_cb, &cache_dump);
+	}
 	return cache_dump.container;
 }
 
@@ -792,6 +905,48 @@ static struct stasis_message *update_create(struct stasis_message *old_snapshot,
 	return msg;
 }
 
+struct stasis_message *stasis_cache_put_message(struct stasis_cache *cache,
+	struct stasis_message *message)
+{
+	struct stasis_message *msg;
+	struct stasis_message *msg_put;
+	struct stasis_message *update = NULL;
+	struct stasis_message_type *msg_type;
+	const struct ast_eid *msg_eid;
+	const char *msg_id;
+	struct cache_put_snapshots snapshots;
+
+	ast_assert(cache->aggregate_calc_fn == NULL);
+
+	msg_type = stasis_message_type(message);
+	if (stasis_cache_clear_type() == msg_type) {
+		msg_put = NULL;
+		msg = stasis_message_data(message);
+		msg_type = stasis_message_type(msg);
+	} else {
+		msg_put = message;
+		msg = message;
+	}
+
+	msg_eid = stasis_message_eid(msg);
+	msg_id = cache->id_fn(msg);
+	if (!msg_id || !msg_eid) {
+		return NULL;
+	}
+
+	snapshots = cache_put(cache, msg_type, msg_id, msg_eid, msg_put);
+	if (snapshots.old || msg_put) {
+		update = update_create(snapshots.old, msg_put);
+	} else {
+		ast_log(LOG_ERROR,
+			"Attempting to remove an item from the cache that isn't there: %s %s\n",
+			stasis_message_type_name(msg_type), msg_id);
+	}
+	ao2_cleanup(snapshots.old);
+
+	return update;
+}
+
 static void caching_topic_exec(void *data, struct stasis_subscription *sub,
 	struct stasis_message *message)
 {
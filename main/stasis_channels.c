@@ -40,6 +40,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/stasis.h"
 #include "asterisk/stasis_cache_pattern.h"
 #include "asterisk/stasis_channels.h"
+#include "asterisk/channel_internal.h"
 #include "asterisk/dial.h"
 #include "asterisk/linkedlists.h"
 
@@ -195,14 +196,211 @@ static void channel_snapshot_dtor(void *obj)
 {
 	struct ast_channel_snapshot *snapshot = obj;
 
-	ast_string_field_free_memory(snapshot);
+	ao2_cleanup(snapshot->base);
+	ao2_cleanup(snapshot->peer);
+	ao2_cleanup(snapshot->dialplan);
+	ao2_cleanup(snapshot->caller);
+	ao2_cleanup(snapshot->bridge);
 	ao2_cleanup(snapshot->manager_vars);
 }
 
+/*! \brief Strings of a channel snapshot segment */
+struct ast_channel_snapshot_segment {
+	char buf[0];
+};
+
+#define SNAPSHOT_FIELD(field) offsetof(struct ast_channel_snapshot, field)
+#define SNAPSHOT_STR(snapshot, offset) (*(const char **) ((char *) (snapshot) + (offset)))
+
+static const size_t base_fields[] = {
+	SNAPSHOT_FIELD(name),
+	SNAPSHOT_FIELD(uniqueid),
+	SNAPSHOT_FIELD(type),
+	SNAPSHOT_FIELD(accountcode),
+	SNAPSHOT_FIELD(userfield),
+	SNAPSHOT_FIELD(language),
+	SNAPSHOT_FIELD(hangupsource),
+};
+
+static const size_t peer_fields[] = {
+	SNAPSHOT_FIELD(linkedid),
+	SNAPSHOT_FIELD(peeraccount),
+};
+
+static const size_t dialplan_fields[] = {
+	SNAPSHOT_FIELD(appl),
+	SNAPSHOT_FIELD(data),
+	SNAPSHOT_FIELD(context),
+	SNAPSHOT_FIELD(exten),
+};
+
+static const size_t caller_fields[] = {
+	SNAPSHOT_FIELD(caller_name),
+	SNAPSHOT_FIELD(caller_number),
+	SNAPSHOT_FIELD(caller_dnid),
+	SNAPSHOT_FIELD(caller_ani),
+	SNAPSHOT_FIELD(caller_rdnis),
+	SNAPSHOT_FIELD(caller_subaddr),
+	SNAPSHOT_FIELD(dialed_subaddr),
+	SNAPSHOT_FIELD(connected_name),
+	SNAPSHOT_FIELD(connected_number),
+};
+
+static const size_t bridge_fields[] = {
+	SNAPSHOT_FIELD(bridgeid),
+};
+
+/*!
+ * \internal
+ * \brief Set the strings of a segment of a snapshot
+ *
+ * \param snapshot The snapshot being created
+ * \param prev The previous snapshot of the channel, or NULL
+ * \param prev_segment The segment of the previous snapshot
+ * \param fields Offsets of the members of the segment
+ * \param values Values of the members, in the same order
+ * \param count Number of members
+ *
+ * The segment of the previous snapshot is shared if all its strings are
+ * equal to the values. Otherwise the values are copied to a new segment,
+ * except those already interned, which are pointed to.
+ *
+ * \return The segment, or NULL on error
+ */
+static struct ast_channel_snapshot_segment *snapshot_segment(struct ast_channel_snapshot *snapshot,
+	struct ast_channel_snapshot *prev, struct ast_channel_snapshot_segment *prev_segment,
+	const size_t *fields, const char **values, size_t count)
+{
+	struct ast_channel_snapshot_segment *segment;
+	size_t len = 0;
+	size_t i;
+	char *pos;
+
+	if (prev && prev_segment) {
+		for (i = 0; i < count; ++i) {
+			if (strcmp(SNAPSHOT_STR(prev, fields[i]), values[i])) {
+				break;
+			}
+		}
+		if (i == count) {
+			for (i = 0; i < count; ++i) {
+				SNAPSHOT_STR(snapshot, fields[i]) = SNAPSHOT_STR(prev, fields[i]);
+			}
+			return ao2_bump(prev_segment);
+		}
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (!__ast_string_field_is_interned(values[i])) {
+			len += strlen(values[i]) + 1;
+		}
+	}
+
+	segment = ao2_alloc_options(sizeof(*segment) + len, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!segment) {
+		return NULL;
+	}
+
+	pos = segment->buf;
+	for (i = 0; i < count; ++i) {
+		if (__ast_string_field_is_interned(values[i])) {
+			SNAPSHOT_STR(snapshot, fields[i]) = values[i];
+			continue;
+		}
+		len = strlen(values[i]) + 1;
+		memcpy(pos, values[i], len);
+		SNAPSHOT_STR(snapshot, fields[i]) = pos;
+		pos += len;
+	}
+
+	return segment;
+}
+
+static struct ast_channel_snapshot_segment *snapshot_base(struct ast_channel_snapshot *snapshot,
+	struct ast_channel_snapshot *prev, struct ast_channel *chan)
+{
+	const char *values[] = {
+		ast_channel_name(chan),
+		ast_channel_uniqueid(chan),
+		ast_channel_tech(chan)->type,
+		ast_channel_accountcode(chan),
+		ast_channel_userfield(chan),
+		ast_channel_language(chan),
+		ast_channel_hangupsource(chan),
+	};
+
+	return snapshot_segment(snapshot, prev, prev ? prev->base : NULL,
+		base_fields, values, ARRAY_LEN(base_fields));
+}
+
+static struct ast_channel_snapshot_segment *snapshot_peer(struct ast_channel_snapshot *snapshot,
+	struct ast_channel_snapshot *prev, struct ast_channel *chan)
+{
+	const char *values[] = {
+		ast_channel_linkedid(chan),
+		ast_channel_peeraccount(chan),
+	};
+
+	return snapshot_segment(snapshot, prev, prev ? prev->peer : NULL,
+		peer_fields, values, ARRAY_LEN(peer_fields));
+}
+
+static struct ast_channel_snapshot_segment *snapshot_dialplan(struct ast_channel_snapshot *snapshot,
+	struct ast_channel_snapshot *prev, struct ast_channel *chan)
+{
+	const char *values[] = {
+		S_OR(ast_channel_appl(chan), ""),
+		S_OR(ast_channel_data(chan), ""),
+		ast_channel_context(chan),
+		ast_channel_exten(chan),
+	};
+
+	return snapshot_segment(snapshot, prev, prev ? prev->dialplan : NULL,
+		dialplan_fields, values, ARRAY_LEN(dialplan_fields));
+}
+
+static struct ast_channel_snapshot_segment *snapshot_caller(struct ast_channel_snapshot *snapshot,
+	struct ast_channel_snapshot *prev, struct ast_channel *chan)
+{
+	struct ast_party_caller *caller = ast_channel_caller(chan);
+	struct ast_party_connected_line *connected = ast_channel_connected(chan);
+	struct ast_party_dialed *dialed = ast_channel_dialed(chan);
+	struct ast_party_redirecting *redirecting = ast_channel_redirecting(chan);
+	const char *values[] = {
+		S_COR(caller->id.name.valid, caller->id.name.str, ""),
+		S_COR(caller->id.number.valid, caller->id.number.str, ""),
+		S_OR(dialed->number.str, ""),
+		S_COR(caller->ani.number.valid, caller->ani.number.str, ""),
+		S_COR(redirecting->from.number.valid, redirecting->from.number.str, ""),
+		S_COR(caller->id.subaddress.valid, caller->id.subaddress.str, ""),
+		S_COR(dialed->subaddress.valid, dialed->subaddress.str, ""),
+		S_COR(connected->id.name.valid, connected->id.name.str, ""),
+		S_COR(connected->id.number.valid, connected->id.number.str, ""),
+	};
+
+	return snapshot_segment(snapshot, prev, prev ? prev->caller : NULL,
+		caller_fields, values, ARRAY_LEN(caller_fields));
+}
+
+static struct ast_channel_snapshot_segment *snapshot_bridge(struct ast_channel_snapshot *snapshot,
+	struct ast_channel_snapshot *prev, struct ast_channel *chan)
+{
+	struct ast_channel_snapshot_segment *segment;
+	struct ast_bridge *bridge = ast_channel_get_bridge(chan);
+	const char *values[] = {
+		bridge ? bridge->uniqueid : "",
+	};
+
+	segment = snapshot_segment(snapshot, prev, prev ? prev->bridge : NULL,
+		bridge_fields, values, ARRAY_LEN(bridge_fields));
+	ao2_cleanup(bridge);
+	return segment;
+}
+
 struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *chan)
 {
 	struct ast_channel_snapshot *snapshot;
-	struct ast_bridge *bridge;
+	struct ast_channel_snapshot *prev;
 
 	/* no snapshots for dummy channels */
 	if (!ast_channel_tech(chan)) {
@@ -211,53 +409,20 @@ struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *cha
 
 	snapshot = ao2_alloc_options(sizeof(*snapshot), channel_snapshot_dtor,
 		AO2_ALLOC_OPT_LOCK_NOLOCK);
-	if (!snapshot || ast_string_field_init(snapshot, 1024)) {
-		ao2_cleanup(snapshot);
+	if (!snapshot) {
 		return NULL;
 	}
 
-	ast_string_field_set(snapshot, name, ast_channel_name(chan));
-	ast_string_field_set(snapshot, type, ast_channel_tech(chan)->type);
-	ast_string_field_set(snapshot, accountcode, ast_channel_accountcode(chan));
-	ast_string_field_set(snapshot, peeraccount, ast_channel_peeraccount(chan));
-	ast_string_field_set(snapshot, userfield, ast_channel_userfield(chan));
-	ast_string_field_set(snapshot, uniqueid, ast_channel_uniqueid(chan));
-	ast_string_field_set(snapshot, linkedid, ast_channel_linkedid(chan));
-	ast_string_field_set(snapshot, hangupsource, ast_channel_hangupsource(chan));
-	if (ast_channel_appl(chan)) {
-		ast_string_field_set(snapshot, appl, ast_channel_appl(chan));
-	}
-	if (ast_channel_data(chan)) {
-		ast_string_field_set(snapshot, data, ast_channel_data(chan));
-	}
-	ast_string_field_set(snapshot, context, ast_channel_context(chan));
-	ast_string_field_set(snapshot, exten, ast_channel_exten(chan));
-
-	ast_string_field_set(snapshot, caller_name,
-		S_COR(ast_channel_caller(chan)->id.name.valid, ast_channel_caller(chan)->id.name.str, ""));
-	ast_string_field_set(snapshot, caller_number,
-		S_COR(ast_channel_caller(chan)->id.number.valid, ast_channel_caller(chan)->id.number.str, ""));
-	ast_string_field_set(snapshot, caller_dnid, S_OR(ast_channel_dialed(chan)->number.str, ""));
-	ast_string_field_set(snapshot, caller_subaddr,
-		S_COR(ast_channel_caller(chan)->id.subaddress.valid, ast_channel_caller(chan)->id.subaddress.str, ""));
-	ast_string_field_set(snapshot, dialed_subaddr,
-		S_COR(ast_channel_dialed(chan)->subaddress.valid, ast_channel_dialed(chan)->subaddress.str, ""));
-	ast_string_field_set(snapshot, caller_ani,
-		S_COR(ast_channel_caller(chan)->ani.number.valid, ast_channel_caller(chan)->ani.number.str, ""));
-	ast_string_field_set(snapshot, caller_rdnis,
-		S_COR(ast_channel_redirecting(chan)->from.number.valid, ast_channel_redirecting(chan)->from.number.str, ""));
-	ast_string_field_set(snapshot, caller_dnid,
-		S_OR(ast_channel_dialed(chan)->number.str, ""));
-
-	ast_string_field_set(snapshot, connected_name,
-		S_COR(ast_channel_connected(chan)->id.name.valid, ast_channel_connected(chan)->id.name.str, ""));
-	ast_string_field_set(snapshot, connected_number,
-		S_COR(ast_channel_connected(chan)->id.number.valid, ast_channel_connected(chan)->id.number.str, ""));
-	ast_string_field_set(snapshot, language, ast_channel_language(chan));
-
-	if ((bridge = ast_channel_get_bridge(chan))) {
-		ast_string_field_set(snapshot, bridgeid, bridge->uniqueid);
-		ao2_cleanup(bridge);
+	prev = ast_channel_internal_snapshot(chan);
+	snapshot->base = snapshot_base(snapshot, prev, chan);
+	snapshot->peer = snapshot_peer(snapshot, prev, chan);
+	snapshot->dialplan = snapshot_dialplan(snapshot, prev, chan);
+	snapshot->caller = snapshot_caller(snapshot, prev, chan);
+	snapshot->bridge = snapshot_bridge(snapshot, prev, chan);
+	if (!snapshot->base || !snapshot->peer || !snapshot->dialplan
+		|| !snapshot->caller || !snapshot->bridge) {
+		ao2_ref(snapshot, -1);
+		return NULL;
 	}
 
 	snapshot->creationtime = ast_channel_creationtime(chan);
@@ -272,16 +437,15 @@ struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *cha
 	snapshot->manager_vars = ast_channel_get_manager_vars(chan);
 	snapshot->tech_properties = ast_channel_tech(chan)->properties;
 
+	/* The next snapshot of the channel shares the segments that did not change */
+	ast_channel_internal_snapshot_set(chan, snapshot);
+
 	return snapshot;
 }
 
 static void publish_message_for_channel_topics(struct stasis_message *message, struct ast_channel *chan)
 {
-	if (chan) {
-		stasis_publish(ast_channel_topic(chan), message);
-	} else {
-		stasis_publish(ast_channel_topic_all(), message);
-	}
+	ast_channel_publish_message(chan, message);
 }
 
 static void channel_blob_dtor(void *obj)
@@ -723,8 +887,7 @@ void ast_channel_publish_snapshot(struct ast_channel *chan)
 		return;
 	}
 
-	ast_assert(ast_channel_topic(chan) != NULL);
-	stasis_publish(ast_channel_topic(chan), message);
+	ast_channel_publish_message(chan, message);
 }
 
 void ast_channel_publish_cached_blob(struct ast_channel *chan, struct stasis_message_type *type, struct ast_json *blob)
@@ -737,7 +900,7 @@ void ast_channel_publish_cached_blob(struct ast_channel *chan, struct stasis_mes
 
 	message = ast_channel_blob_create_from_cache(ast_channel_uniqueid(chan), type, blob);
 	if (message) {
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	ao2_cleanup(message);
 }
@@ -752,7 +915,7 @@ void ast_channel_publish_blob(struct ast_channel *chan, struct stasis_message_ty
 
 	message = ast_channel_blob_create(chan, type, blob);
 	if (message) {
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	ao2_cleanup(message);
 }
@@ -881,8 +1044,7 @@ void ast_publish_channel_state(struct ast_channel *chan)
 		return;
 	}
 
-	ast_assert(ast_channel_topic(chan) != NULL);
-	stasis_publish(ast_channel_topic(chan), message);
+	ast_channel_publish_message(chan, message);
 }
 
 struct ast_json *ast_channel_snapshot_to_json(
@@ -921,6 +1083,40 @@ struct ast_json *ast_channel_snapshot_to_json(
 	return ast_json_ref(json_chan);
 }
 
+int ast_channel_snapshot_json_write(
+	const struct ast_channel_snapshot *snapshot,
+	const struct stasis_message_sanitizer *sanitize,
+	struct ast_json_writer *writer)
+{
+	if (snapshot == NULL
+		|| (sanitize && sanitize->channel_snapshot
+		&& sanitize->channel_snapshot(snapshot))) {
+		return -1;
+	}
+
+	/* The same members in the same order as ast_channel_snapshot_to_json() */
+	ast_json_writer_object_start(writer);
+	ast_json_writer_key(writer, "id");
+	ast_json_writer_string(writer, snapshot->uniqueid);
+	ast_json_writer_key(writer, "name");
+	ast_json_writer_string(writer, snapshot->name);
+	ast_json_writer_key(writer, "state");
+	ast_json_writer_string(writer, ast_state2str(snapshot->state));
+	ast_json_writer_key(writer, "caller");
+	ast_json_writer_name_number(writer, snapshot->caller_name, snapshot->caller_number);
+	ast_json_writer_key(writer, "connected");
+	ast_json_writer_name_number(writer, snapshot->connected_name, snapshot->connected_number);
+	ast_json_writer_key(writer, "accountcode");
+	ast_json_writer_string(writer, snapshot->accountcode);
+	ast_json_writer_key(writer, "dialplan");
+	ast_json_writer_dialplan_cep(writer, snapshot->context, snapshot->exten, snapshot->priority);
+	ast_json_writer_key(writer, "creationtime");
+	ast_json_writer_timeval(writer, snapshot->creationtime, NULL);
+	ast_json_writer_key(writer, "language");
+	ast_json_writer_string(writer, snapshot->language);
+	return ast_json_writer_object_end(writer);
+}
+
 int ast_channel_snapshot_cep_equal(
 	const struct ast_channel_snapshot *old_snapshot,
 	const struct ast_channel_snapshot *new_snapshot)
@@ -421,6 +421,38 @@ struct ast_json *ast_endpoint_snapshot_to_json(
 	return ast_json_ref(json);
 }
 
+int ast_endpoint_snapshot_json_write(
+	const struct ast_endpoint_snapshot *snapshot,
+	const struct stasis_message_sanitizer *sanitize,
+	struct ast_json_writer *writer)
+{
+	int i;
+
+	/* The same members in the same order as ast_endpoint_snapshot_to_json() */
+	ast_json_writer_object_start(writer);
+	ast_json_writer_key(writer, "technology");
+	ast_json_writer_string(writer, snapshot->tech);
+	ast_json_writer_key(writer, "resource");
+	ast_json_writer_string(writer, snapshot->resource);
+	ast_json_writer_key(writer, "state");
+	ast_json_writer_string(writer, ast_endpoint_state_to_string(snapshot->state));
+	ast_json_writer_key(writer, "channel_ids");
+	ast_json_writer_array_start(writer);
+	for (i = 0; i < snapshot->num_channels; ++i) {
+		if (sanitize && sanitize->channel_id
+			&& sanitize->channel_id(snapshot->channel_ids[i])) {
+			continue;
+		}
+		ast_json_writer_string(writer, snapshot->channel_ids[i]);
+	}
+	ast_json_writer_array_end(writer);
+	if (snapshot->max_channels != -1) {
+		ast_json_writer_key(writer, "max_channels");
+		ast_json_writer_integer(writer, snapshot->max_channels);
+	}
+	return ast_json_writer_object_end(writer);
+}
+
 static void endpoints_stasis_cleanup(void)
 {
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_endpoint_snapshot_type);
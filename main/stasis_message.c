@@ -39,10 +39,17 @@ ASTERISK_REGISTER_FILE()
 struct stasis_message_type {
 	struct stasis_message_vtable *vtable;
 	char *name;
+	/*! Unique identifier, used by subscriptions to filter by type */
+	int id;
+	/*! Formats the vtable can render messages of this type in */
+	enum stasis_subscription_message_formatters available_formatters;
 };
 
 static struct stasis_message_vtable null_vtable = {};
 
+/*! Identifier of the next message type created */
+static int message_type_id;
+
 static void message_type_dtor(void *obj)
 {
 	struct stasis_message_type *type = obj;
@@ -76,6 +83,16 @@ int stasis_message_type_create(const char *name,
 		return STASIS_MESSAGE_TYPE_ERROR;
 	}
 	type->vtable = vtable;
+	if (vtable->to_json) {
+		type->available_formatters |= STASIS_SUBSCRIPTION_FORMATTER_JSON;
+	}
+	if (vtable->to_ami) {
+		type->available_formatters |= STASIS_SUBSCRIPTION_FORMATTER_AMI;
+	}
+	if (vtable->to_event) {
+		type->available_formatters |= STASIS_SUBSCRIPTION_FORMATTER_EVENT;
+	}
+	type->id = ast_atomic_fetchadd_int(&message_type_id, +1);
 	*result = type;
 
 	return STASIS_MESSAGE_TYPE_SUCCESS;
@@ -86,6 +103,17 @@ const char *stasis_message_type_name(const struct stasis_message_type *type)
 	return type->name;
 }
 
+int stasis_message_type_id(const struct stasis_message_type *type)
+{
+	return type->id;
+}
+
+enum stasis_subscription_message_formatters stasis_message_type_available_formatters(
+	const struct stasis_message_type *type)
+{
+	return type->available_formatters;
+}
+
 /*! \internal */
 struct stasis_message {
 	/*! Time the message was created */
@@ -98,6 +126,14 @@ struct stasis_message {
 	void *data;
 	/*! Where this message originated. */
 	struct ast_eid eid;
+	/*! AMI representation, rendered by the first stasis_message_to_ami() */
+	struct ast_manager_event_blob *ami;
+	/*! JSON representation, rendered by the first stasis_message_to_json() */
+	struct ast_json *json;
+	/*! Sanitizer json was rendered with */
+	struct stasis_message_sanitizer *json_sanitize;
+	/*! Event representation, rendered by the first stasis_message_to_event() */
+	struct ast_event *event;
 };
 
 static void stasis_message_dtor(void *obj)
@@ -105,6 +141,9 @@ static void stasis_message_dtor(void *obj)
 	struct stasis_message *message = obj;
 	ao2_cleanup(message->type);
 	ao2_cleanup(message->data);
+	ao2_cleanup(message->ami);
+	ast_json_unref(message->json);
+	ast_event_destroy(message->event);
 }
 
 struct stasis_message *stasis_message_create_full(struct stasis_message_type *type, void *data, const struct ast_eid *eid)
@@ -183,19 +222,99 @@ const struct timeval *stasis_message_timestamp(const struct stasis_message *msg)
 		msg->type->vtable->fn(__VA_ARGS__);	\
 	})
 
+/*
+ * The representations are rendered once per message and shared by every
+ * consumer. They are published with the message lock held and read without
+ * it, and never change once set.
+ */
+
 struct ast_manager_event_blob *stasis_message_to_ami(struct stasis_message *msg)
 {
-	return INVOKE_VIRTUAL(to_ami, msg);
+	struct ast_manager_event_blob *ami = msg ? msg->ami : NULL;
+
+	if (ami) {
+		__sync_synchronize();
+		return ao2_bump(ami);
+	}
+
+	ami = INVOKE_VIRTUAL(to_ami, msg);
+	if (!ami) {
+		return NULL;
+	}
+
+	ao2_lock(msg);
+	if (!msg->ami) {
+		__sync_synchronize();
+		msg->ami = ao2_bump(ami);
+	}
+	ao2_unlock(msg);
+
+	return ami;
 }
 
 struct ast_json *stasis_message_to_json(
 	struct stasis_message *msg,
 	struct stasis_message_sanitizer *sanitize)
 {
-	return INVOKE_VIRTUAL(to_json, msg, sanitize);
+	struct ast_json *json = msg ? msg->json : NULL;
+	unsigned int arena_depth;
+
+	if (json) {
+		__sync_synchronize();
+		if (msg->json_sanitize == sanitize) {
+			return ast_json_ref(json);
+		}
+	}
+
+	/* The representation is kept with the message, so never from an arena */
+	arena_depth = ast_json_arena_suspend();
+	json = INVOKE_VIRTUAL(to_json, msg, sanitize);
+	ast_json_arena_resume(arena_depth);
+	if (!json) {
+		return NULL;
+	}
+
+	/* Only the representation for the first sanitizer asked for is kept */
+	ao2_lock(msg);
+	if (!msg->json) {
+		msg->json_sanitize = sanitize;
+		__sync_synchronize();
+		msg->json = ast_json_ref(json);
+	}
+	ao2_unlock(msg);
+
+	return json;
 }
 
 struct ast_event *stasis_message_to_event(struct stasis_message *msg)
 {
-	return INVOKE_VIRTUAL(to_event, msg);
+	struct ast_event *event = msg ? msg->event : NULL;
+	struct ast_event *copy;
+	size_t size;
+
+	if (!event) {
+		event = INVOKE_VIRTUAL(to_event, msg);
+		if (!event) {
+			return NULL;
+		}
+
+		ao2_lock(msg);
+		if (!msg->event) {
+			__sync_synchronize();
+			msg->event = event;
+		} else {
+			ast_event_destroy(event);
+		}
+		event = msg->event;
+		ao2_unlock(msg);
+	}
+	__sync_synchronize();
+
+	/* Callers own and destroy the event they are given */
+	size = ast_event_get_size(event);
+	copy = ast_malloc(size);
+	if (copy) {
+		memcpy(copy, event, size);
+	}
+	return copy;
 }
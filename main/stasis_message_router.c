@@ -45,22 +45,44 @@ struct stasis_message_route {
 	void *data;
 };
 
-AST_VECTOR(route_table, struct stasis_message_route);
+/*!
+ * \brief Table of routes, indexed by message type
+ *
+ * The routes are kept in a vector. An open addressed table of positions in
+ * the vector, probed linearly from the message type id, finds the route of a
+ * message type without scanning the routes. Routes are rarely added or
+ * removed after a router is set up, so the index is simply rebuilt then.
+ */
+struct route_table {
+	/*! The routes */
+	AST_VECTOR(, struct stasis_message_route) routes;
+	/*! Position in routes plus one of the route in each slot; 0 if empty */
+	size_t *index;
+	/*! Number of slots in index; a power of two */
+	size_t index_size;
+};
+
+static size_t route_table_slot(const struct route_table *table,
+	struct stasis_message_type *message_type)
+{
+	return stasis_message_type_id(message_type) & (table->index_size - 1);
+}
 
 static struct stasis_message_route *route_table_find(struct route_table *table,
 	struct stasis_message_type *message_type)
 {
-	size_t idx;
+	size_t slot;
+	size_t pos;
 	struct stasis_message_route *route;
 
-	/* While a linear search for routes may seem very inefficient, most
-	 * route tables have six routes or less. For such small data, it's
-	 * hard to beat a linear search. If we start having larger route
-	 * tables, then we can look into containers with more efficient
-	 * lookups.
-	 */
-	for (idx = 0; idx < AST_VECTOR_SIZE(table); ++idx) {
-		route = AST_VECTOR_GET_ADDR(table, idx);
+	if (!table->index_size) {
+		return NULL;
+	}
+
+	for (slot = route_table_slot(table, message_type);
+		(pos = table->index[slot]);
+		slot = (slot + 1) & (table->index_size - 1)) {
+		route = AST_VECTOR_GET_ADDR(&table->routes, pos - 1);
 		if (route->message_type == message_type) {
 			return route;
 		}
@@ -69,6 +91,55 @@ static struct stasis_message_route *route_table_find(struct route_table *table,
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Rebuild the index of a route table after its routes changed.
+ *
+ * \param table Table to rebuild the index of.
+ *
+ * \retval 0 on success.
+ * \retval -1 on allocation failure. The old index is kept.
+ */
+static int route_table_reindex(struct route_table *table)
+{
+	size_t size = table->index_size ? table->index_size : 8;
+	size_t *index;
+	size_t idx;
+
+	/*
+	 * Keep the index at most half full so probe sequences stay short. It
+	 * never shrinks, so removing a route cannot fail.
+	 */
+	while (size < AST_VECTOR_SIZE(&table->routes) * 2) {
+		size *= 2;
+	}
+
+	if (size != table->index_size) {
+		index = ast_calloc(size, sizeof(*index));
+		if (!index) {
+			return -1;
+		}
+		ast_free(table->index);
+		table->index = index;
+		table->index_size = size;
+	} else {
+		memset(table->index, 0, size * sizeof(*table->index));
+	}
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&table->routes); ++idx) {
+		struct stasis_message_route *route = AST_VECTOR_GET_ADDR(&table->routes, idx);
+		size_t slot;
+
+		for (slot = route_table_slot(table, route->message_type);
+			table->index[slot];
+			slot = (slot + 1) & (table->index_size - 1)) {
+		}
+		table->index[slot] = idx + 1;
+	}
+
+	return 0;
+}
+
 /*!
  * \brief route_table comparator for AST_VECTOR_REMOVE_CMP_UNORDERED()
  *
@@ -89,11 +160,24 @@ static struct stasis_message_route *route_table_find(struct route_table *table,
  */
 #define ROUTE_TABLE_ELEM_CLEANUP(elem)  ao2_cleanup((elem).message_type)
 
+static int route_table_init(struct route_table *table)
+{
+	table->index = NULL;
+	table->index_size = 0;
+	return AST_VECTOR_INIT(&table->routes, 0);
+}
+
 static int route_table_remove(struct route_table *table,
 	struct stasis_message_type *message_type)
 {
-	return AST_VECTOR_REMOVE_CMP_UNORDERED(table, message_type, ROUTE_TABLE_ELEM_CMP,
-		ROUTE_TABLE_ELEM_CLEANUP);
+	int res;
+
+	res = AST_VECTOR_REMOVE_CMP_UNORDERED(&table->routes, message_type,
+		ROUTE_TABLE_ELEM_CMP, ROUTE_TABLE_ELEM_CLEANUP);
+	if (!res) {
+		route_table_reindex(table);
+	}
+	return res;
 }
 
 static int route_table_add(struct route_table *table,
@@ -110,9 +194,17 @@ static int route_table_add(struct route_table *table,
 	route.callback = callback;
 	route.data = data;
 
-	res = AST_VECTOR_APPEND(table, route);
+	res = AST_VECTOR_APPEND(&table->routes, route);
 	if (res) {
 		ROUTE_TABLE_ELEM_CLEANUP(route);
+		return res;
+	}
+
+	res = route_table_reindex(table);
+	if (res) {
+		/* The last route is the one just appended */
+		AST_VECTOR_REMOVE(&table->routes, AST_VECTOR_SIZE(&table->routes) - 1, 1);
+		ROUTE_TABLE_ELEM_CLEANUP(route);
 	}
 	return res;
 }
@@ -122,11 +214,14 @@ static void route_table_dtor(struct route_table *table)
 	size_t idx;
 	struct stasis_message_route *route;
 
-	for (idx = 0; idx < AST_VECTOR_SIZE(table); ++idx) {
-		route = AST_VECTOR_GET_ADDR(table, idx);
+	for (idx = 0; idx < AST_VECTOR_SIZE(&table->routes); ++idx) {
+		route = AST_VECTOR_GET_ADDR(&table->routes, idx);
 		ROUTE_TABLE_ELEM_CLEANUP(*route);
 	}
-	AST_VECTOR_FREE(table);
+	AST_VECTOR_FREE(&table->routes);
+	ast_free(table->index);
+	table->index = NULL;
+	table->index_size = 0;
 }
 
 /*! \internal */
@@ -218,8 +313,8 @@ static struct stasis_message_router *stasis_message_router_create_internal(
 	}
 
 	res = 0;
-	res |= AST_VECTOR_INIT(&router->routes, 0);
-	res |= AST_VECTOR_INIT(&router->cache_routes, 0);
+	res |= route_table_init(&router->routes);
+	res |= route_table_init(&router->cache_routes);
 	if (res) {
 		return NULL;
 	}
@@ -233,6 +328,9 @@ static struct stasis_message_router *stasis_message_router_create_internal(
 		return NULL;
 	}
 
+	/* Only dispatch routed message types until a default route is set */
+	stasis_subscription_set_filter(router->subscription, STASIS_SUBSCRIPTION_FILTER_SELECTIVE);
+
 	ao2_ref(router, +1);
 	return router;
 }
@@ -303,6 +401,12 @@ int stasis_message_router_add(struct stasis_message_router *router,
 	}
 	ao2_lock(router);
 	res = route_table_add(&router->routes, message_type, callback, data);
+	if (!res) {
+		res = stasis_subscription_accept_message_type(router->subscription, message_type);
+		if (res) {
+			route_table_remove(&router->routes, message_type);
+		}
+	}
 	ao2_unlock(router);
 	return res;
 }
@@ -321,6 +425,13 @@ int stasis_message_router_add_cache_update(struct stasis_message_router *router,
 	}
 	ao2_lock(router);
 	res = route_table_add(&router->cache_routes, message_type, callback, data);
+	if (!res) {
+		res = stasis_subscription_accept_message_type(router->subscription,
+			stasis_cache_update_type());
+		if (res) {
+			route_table_remove(&router->cache_routes, message_type);
+		}
+	}
 	ao2_unlock(router);
 	return res;
 }
@@ -336,6 +447,7 @@ void stasis_message_router_remove(struct stasis_message_router *router,
 	}
 	ao2_lock(router);
 	route_table_remove(&router->routes, message_type);
+	stasis_subscription_decline_message_type(router->subscription, message_type);
 	ao2_unlock(router);
 }
 
@@ -351,6 +463,10 @@ void stasis_message_router_remove_cache_update(
 	}
 	ao2_lock(router);
 	route_table_remove(&router->cache_routes, message_type);
+	if (!AST_VECTOR_SIZE(&router->cache_routes.routes)) {
+		stasis_subscription_decline_message_type(router->subscription,
+			stasis_cache_update_type());
+	}
 	ao2_unlock(router);
 }
 
@@ -365,6 +481,28 @@ int stasis_message_router_set_default(struct stasis_message_router *router,
 	router->default_route.callback = callback;
 	router->default_route.data = data;
 	ao2_unlock(router);
+
+	/* The default route may want any message */
+	stasis_subscription_set_filter(router->subscription, STASIS_SUBSCRIPTION_FILTER_NONE);
+
 	/* While this implementation can never fail, it used to be able to */
 	return 0;
 }
+
+int stasis_message_router_set_formatters_default(struct stasis_message_router *router,
+	stasis_subscription_cb callback,
+	void *data,
+	enum stasis_subscription_message_formatters formatters)
+{
+	ast_assert(router != NULL);
+	ast_assert(callback != NULL);
+
+	stasis_subscription_accept_formatters(router->subscription, formatters);
+
+	ao2_lock(router);
+	router->default_route.callback = callback;
+	router->default_route.data = data;
+	ao2_unlock(router);
+
+	return 0;
+}
@@ -78,6 +78,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/linkedlists.h"
 #include "asterisk/utils.h"
 #include "asterisk/test.h"
+#include "asterisk/threadstorage.h"
 
 #ifndef lint
 #ifndef NOID
@@ -185,6 +186,10 @@ struct state {
 	time_t  mtime[2];
 #endif
 	AST_LIST_ENTRY(state) list;
+	/*! Next zone in the same hash bucket, followed without a lock */
+	struct state *hash_next;
+	/*! zone_generation after the zone was dropped from the cache, if it was */
+	int retired;
 };
 
 /* extra initialisation for sstate_alloc() */
@@ -310,8 +315,72 @@ static int		tzparse P((const char * name, struct state * sp,
 /* struct state allocator with additional setup as needed */
 static struct state *	sstate_alloc(void);
 static void		sstate_free(struct state *p);
+/* drop a zone from the cache, freeing it once no lookup can use it */
+static void		zone_retire(struct state *sp);
 
 static AST_LIST_HEAD_STATIC(zonelist, state);
+
+/*! Number of hash buckets of loaded zones. Keep it prime! */
+#define ZONE_BUCKETS 61
+
+/*!
+ * \brief Loaded zones by name.
+ *
+ * Lookups walk the buckets without a lock.  Zones are only linked and
+ * unlinked with the zonelist lock held, and an unlinked zone is kept
+ * until no thread that could have found it is still using it.
+ */
+static struct state * volatile zone_buckets[ZONE_BUCKETS];
+
+/*! Zones dropped from the cache, not yet freed.  Protected by the zonelist lock */
+static AST_LIST_HEAD_NOLOCK_STATIC(zones_retired, state);
+
+/*! Changed whenever a zone is dropped, to tell threads their last zone may be gone */
+static volatile int zone_generation;
+
+/*!
+ * \brief A thread's use of the loaded zones.
+ *
+ * While a thread uses a zone it is active, and its epoch is the
+ * zone_generation when it started.  A zone dropped at a later generation
+ * may still be in use by it, older ones may not.
+ */
+struct zone_reader {
+	/*! The zone the thread looked up last */
+	const struct state *last;
+	/*! The zone_generation when the last zone was looked up */
+	int last_generation;
+	/*! Non-zero while the thread uses a zone */
+	volatile int active;
+	/*! The zone_generation when the thread started using a zone */
+	volatile int epoch;
+	AST_LIST_ENTRY(zone_reader) list;
+};
+
+/*! All threads that have used a zone */
+static AST_LIST_HEAD_STATIC(zone_readers, zone_reader);
+
+static int zone_reader_init(void *data)
+{
+	struct zone_reader *reader = data;
+
+	AST_LIST_LOCK(&zone_readers);
+	AST_LIST_INSERT_TAIL(&zone_readers, reader, list);
+	AST_LIST_UNLOCK(&zone_readers);
+	return 0;
+}
+
+static void zone_reader_cleanup(void *data)
+{
+	struct zone_reader *reader = data;
+
+	AST_LIST_LOCK(&zone_readers);
+	AST_LIST_REMOVE(&zone_readers, reader, list);
+	AST_LIST_UNLOCK(&zone_readers);
+	ast_free(reader);
+}
+
+AST_THREADSTORAGE_CUSTOM(zone_reader_buf, zone_reader_init, zone_reader_cleanup);
 #ifdef HAVE_NEWLOCALE
 static AST_LIST_HEAD_STATIC(localelist, locale_entry);
 #endif
@@ -397,7 +466,7 @@ static void *inotify_daemon(void *data)
 		AST_LIST_TRAVERSE_SAFE_BEGIN(&zonelist, cur, list) {
 			if (cur->wd[0] == iev->wd || cur->wd[1] == iev->wd) {
 				AST_LIST_REMOVE_CURRENT(list);
-				sstate_free(cur);
+				zone_retire(cur);
 				break;
 			}
 		}
@@ -516,11 +585,11 @@ static void *kqueue_daemon(void *data)
 			sstate_free(sp);
 
 			while ((sp = AST_LIST_REMOVE_HEAD(&zonelist, list))) {
-				sstate_free(sp);
+				zone_retire(sp);
 			}
 		} else {
 			AST_LIST_REMOVE(&zonelist, sp, list);
-			sstate_free(sp);
+			zone_retire(sp);
 		}
 
 		/* Just in case the signal was sent late */
@@ -740,7 +809,7 @@ static void *notify_daemon(void *data)
 					ast_log(LOG_NOTICE, "Removing cached TZ entry '%s' because underlying file changed.\n", name);
 				}
 				AST_LIST_REMOVE_CURRENT(list);
-				sstate_free(cur);
+				zone_retire(cur);
 				continue;
 			}
 		}
@@ -774,6 +843,138 @@ static void add_notify(struct state *sp, const char *path)
 }
 #endif
 
+/*!
+ * \internal
+ * \brief Find a loaded zone without locking.
+ */
+static struct state *zone_find(const char *zone, unsigned int hash)
+{
+	struct state *sp;
+
+	for (sp = zone_buckets[hash % ZONE_BUCKETS]; sp; sp = sp->hash_next) {
+		if (!strcmp(sp->name, zone)) {
+			break;
+		}
+	}
+	return sp;
+}
+
+/*!
+ * \internal
+ * \brief Make a loaded zone visible to lookups.
+ *
+ * \note The zonelist lock must be held and the zone set up.
+ */
+static void zone_link(struct state *sp)
+{
+	struct state * volatile *bucket = &zone_buckets[ast_str_hash(sp->name) % ZONE_BUCKETS];
+
+	sp->hash_next = *bucket;
+	/* A full barrier, so the zone is set up before it can be found */
+	ast_atomic_compare_and_swap_ptr((void * volatile *) bucket, sp->hash_next, sp);
+}
+
+/*!
+ * \internal
+ * \brief Start using loaded zones in this thread.
+ *
+ * Zones found until zone_read_end() is called are not freed meanwhile.
+ *
+ * \retval NULL if the thread cannot use loaded zones
+ */
+static struct zone_reader *zone_read_begin(void)
+{
+	struct zone_reader *reader = ast_threadstorage_get(&zone_reader_buf, sizeof(*reader));
+
+	if (!reader) {
+		return NULL;
+	}
+
+	/* A full barrier, so the epoch and the lookups are read once active is set */
+	if (!ast_atomic_fetchadd_int(&reader->active, +1)) {
+		reader->epoch = ast_atomic_fetchadd_int(&zone_generation, 0);
+	}
+	return reader;
+}
+
+/*!
+ * \internal
+ * \brief Stop using the zones found since zone_read_begin().
+ */
+static void zone_read_end(struct zone_reader *reader)
+{
+	if (reader) {
+		ast_atomic_fetchadd_int(&reader->active, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Free the dropped zones no thread can be using any more.
+ *
+ * \note The zonelist lock must be held.
+ */
+static void zone_reclaim(void)
+{
+	struct zone_reader *reader;
+	struct state *cur;
+	int oldest = 0;
+	int busy = 0;
+
+	if (AST_LIST_EMPTY(&zones_retired)) {
+		return;
+	}
+
+	AST_LIST_LOCK(&zone_readers);
+	AST_LIST_TRAVERSE(&zone_readers, reader, list) {
+		if (reader->active) {
+			int epoch = reader->epoch;
+
+			if (!busy || epoch - oldest < 0) {
+				oldest = epoch;
+			}
+			busy = 1;
+		}
+	}
+	AST_LIST_UNLOCK(&zone_readers);
+
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&zones_retired, cur, list) {
+		/* Threads that started after the zone was dropped cannot have found it */
+		if (!busy || oldest - cur->retired >= 0) {
+			AST_LIST_REMOVE_CURRENT(list);
+			sstate_free(cur);
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+}
+
+/*!
+ * \internal
+ * \brief Drop a zone whose file changed, to be loaded again when next used.
+ *
+ * The zone is not freed at once, since lookups in other threads may still
+ * be using it.  It is freed once they are done with it.
+ *
+ * \note The zonelist lock must be held and the zone removed from the zonelist.
+ */
+static void zone_retire(struct state *sp)
+{
+	struct state * volatile *prev = &zone_buckets[ast_str_hash(sp->name) % ZONE_BUCKETS];
+	struct state *cur;
+
+	for (; (cur = *prev); prev = &cur->hash_next) {
+		if (cur == sp) {
+			*prev = sp->hash_next;
+			break;
+		}
+	}
+	/* A full barrier, so the zone is unlinked before the readers are checked */
+	sp->retired = ast_atomic_fetchadd_int(&zone_generation, +1) + 1;
+	AST_LIST_INSERT_TAIL(&zones_retired, sp, list);
+
+	zone_reclaim();
+}
+
 /*
  * struct state allocator with additional setup as needed
  */
@@ -1626,14 +1827,21 @@ void clean_time_zones(void)
 
 	AST_LIST_LOCK(&zonelist);
 	while ((sp = AST_LIST_REMOVE_HEAD(&zonelist, list))) {
-		sstate_free(sp);
+		zone_retire(sp);
 	}
 	AST_LIST_UNLOCK(&zonelist);
 }
 
-static const struct state *ast_tzset(const char *zone)
+/*!
+ * \internal
+ * \brief Find a zone, loading it if needed.
+ *
+ * \note The zone may only be used until zone_read_end(reader).
+ */
+static const struct state *ast_tzset(const char *zone, struct zone_reader *reader)
 {
 	struct state *sp;
+	unsigned int hash;
 
 	if (ast_strlen_zero(zone)) {
 #ifdef SOLARIS
@@ -1646,26 +1854,38 @@ static const struct state *ast_tzset(const char *zone)
 #endif
 	}
 
-	AST_LIST_LOCK(&zonelist);
-	AST_LIST_TRAVERSE(&zonelist, sp, list) {
-		if (!strcmp(sp->name, zone)) {
-			AST_LIST_UNLOCK(&zonelist);
-			return sp;
-		}
+	if (!reader) {
+		return NULL;
 	}
 
-	if (!(sp = sstate_alloc())) {
-		AST_LIST_UNLOCK(&zonelist);
-		return NULL;
+	/* Most threads use the same zone call after call */
+	if (reader->last && reader->last_generation == reader->epoch && !strcmp(reader->last->name, zone)) {
+		return reader->last;
 	}
 
-	if (tzload(zone, sp, TRUE) != 0) {
-		if (zone[0] == ':' || tzparse(zone, sp, FALSE) != 0)
-			(void) gmtload(sp);
+	hash = ast_str_hash(zone);
+	if (!(sp = zone_find(zone, hash))) {
+		AST_LIST_LOCK(&zonelist);
+		if (!(sp = zone_find(zone, hash))) {
+			if (!(sp = sstate_alloc())) {
+				AST_LIST_UNLOCK(&zonelist);
+				return NULL;
+			}
+
+			if (tzload(zone, sp, TRUE) != 0) {
+				if (zone[0] == ':' || tzparse(zone, sp, FALSE) != 0)
+					(void) gmtload(sp);
+			}
+			ast_copy_string(sp->name, zone, sizeof(sp->name));
+			AST_LIST_INSERT_TAIL(&zonelist, sp, list);
+			zone_link(sp);
+		}
+		zone_reclaim();
+		AST_LIST_UNLOCK(&zonelist);
 	}
-	ast_copy_string(sp->name, zone, sizeof(sp->name));
-	AST_LIST_INSERT_TAIL(&zonelist, sp, list);
-	AST_LIST_UNLOCK(&zonelist);
+
+	reader->last = sp;
+	reader->last_generation = reader->epoch;
 	return sp;
 }
 
@@ -1771,9 +1991,14 @@ static struct ast_tm *localsub(const struct timeval *timep, const long offset, s
 
 struct ast_tm *ast_localtime(const struct timeval *timep, struct ast_tm *tmp, const char *zone)
 {
-	const struct state *sp = ast_tzset(zone);
+	struct zone_reader *reader = zone_read_begin();
+	const struct state *sp = ast_tzset(zone, reader);
+	struct ast_tm *res;
+
 	memset(tmp, 0, sizeof(*tmp));
-	return sp ? localsub(timep, 0L, tmp, sp) : NULL;
+	res = sp ? localsub(timep, 0L, tmp, sp) : NULL;
+	zone_read_end(reader);
+	return res;
 }
 
 /*
@@ -1784,28 +2009,13 @@ struct ast_tm *ast_localtime(const struct timeval *timep, struct ast_tm *tmp, co
 ** UTC.
 */
 
-void ast_get_dst_info(const time_t * const timep, int *dst_enabled, time_t *dst_start, time_t *dst_end, int *gmt_off, const char * const zone)
+static void zone_dst_info(time_t t, int *dst_enabled, time_t *dst_start, time_t *dst_end, int *gmt_off, const struct state *sp)
 {
 	int i;
 	int transition1 = -1;
 	int transition2 = -1;
 	time_t		seconds;
 	int  bounds_exceeded = 0;
-	time_t  t = *timep;
-	const struct state *sp;
-
-	if (NULL == dst_enabled)
-		return;
-	*dst_enabled = 0;
-
-	if (NULL == dst_start || NULL == dst_end || NULL == gmt_off)
-		return;
-
-	*gmt_off = 0;
-
-	sp = ast_tzset(zone);
-	if (NULL == sp)
-		return;
 
 	/* If the desired time exceeds the bounds of the defined time transitions
 	* then give give up on determining DST info and simply look for gmt offset
@@ -1891,6 +2101,27 @@ void ast_get_dst_info(const time_t * const timep, int *dst_enabled, time_t *dst_
 	return;
 }
 
+void ast_get_dst_info(const time_t * const timep, int *dst_enabled, time_t *dst_start, time_t *dst_end, int *gmt_off, const char * const zone)
+{
+	struct zone_reader *reader;
+	const struct state *sp;
+
+	if (NULL == dst_enabled)
+		return;
+	*dst_enabled = 0;
+
+	if (NULL == dst_start || NULL == dst_end || NULL == gmt_off)
+		return;
+
+	*gmt_off = 0;
+
+	reader = zone_read_begin();
+	if ((sp = ast_tzset(zone, reader))) {
+		zone_dst_info(*timep, dst_enabled, dst_start, dst_end, gmt_off, sp);
+	}
+	zone_read_end(reader);
+}
+
 /*
 ** gmtsub is to gmtime as localsub is to localtime.
 */
@@ -1898,8 +2129,13 @@ void ast_get_dst_info(const time_t * const timep, int *dst_enabled, time_t *dst_
 static struct ast_tm *gmtsub(const struct timeval *timep, const long offset, struct ast_tm *tmp)
 {
 	struct ast_tm *	result;
+	struct zone_reader *reader;
 	struct state *sp;
 
+	if (!(reader = zone_read_begin())) {
+		return NULL;
+	}
+
 	AST_LIST_LOCK(&zonelist);
 	AST_LIST_TRAVERSE(&zonelist, sp, list) {
 		if (!strcmp(sp->name, "UTC"))
@@ -1909,6 +2145,7 @@ static struct ast_tm *gmtsub(const struct timeval *timep, const long offset, str
 	if (!sp) {
 		if (!(sp = sstate_alloc())) {
 			AST_LIST_UNLOCK(&zonelist);
+			zone_read_end(reader);
 			return NULL;
 		}
 		gmtload(sp);
@@ -1928,6 +2165,7 @@ static struct ast_tm *gmtsub(const struct timeval *timep, const long offset, str
 	else
 		tmp->TM_ZONE = sp->chars;
 #endif /* defined TM_ZONE */
+	zone_read_end(reader);
 	return result;
 }
 
@@ -2388,10 +2626,17 @@ static struct timeval time1(struct ast_tm *tmp, struct ast_tm * (* const funcp)
 
 struct timeval ast_mktime(struct ast_tm *tmp, const char *zone)
 {
+	struct zone_reader *reader = zone_read_begin();
 	const struct state *sp;
-	if (!(sp = ast_tzset(zone)))
+	struct timeval res;
+
+	if (!(sp = ast_tzset(zone, reader))) {
+		zone_read_end(reader);
 		return WRONG;
-	return time1(tmp, localsub, 0L, sp);
+	}
+	res = time1(tmp, localsub, 0L, sp);
+	zone_read_end(reader);
+	return res;
 }
 
 #ifdef HAVE_NEWLOCALE
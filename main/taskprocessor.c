@@ -27,6 +27,28 @@
 	<support_level>core</support_level>
  ***/
 
+/*** DOCUMENTATION
+	<manager name="TaskprocessorLatency" language="en_US">
+		<synopsis>
+			List taskprocessor latency statistics.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Taskprocessor">
+				<para>Only report on the taskprocessor with this name.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Returns a <literal>TaskprocessorLatency</literal> event for
+			each taskprocessor followed by a <literal>TaskprocessorLatencyComplete</literal>
+			event. The <literal>WaitHistogram</literal> header counts the tasks
+			by the time they spent queued and the <literal>ExecuteHistogram</literal>
+			header counts them by the time they spent executing. Both are a comma
+			separated list of <literal>bound=count</literal> pairs.</para>
+		</description>
+	</manager>
+ ***/
+
 #include "asterisk.h"
 
 ASTERISK_REGISTER_FILE()
@@ -36,8 +58,12 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/time.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/cli.h"
+#include "asterisk/manager.h"
+#include "asterisk/metrics.h"
+#include "asterisk/probes.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/sem.h"
+#include "asterisk/threadstorage.h"
 
 /*!
  * \brief tps_task structure is queued to a taskprocessor
@@ -56,15 +82,54 @@ struct tps_task {
 	void *datap;
 	/*! \brief AST_LIST_ENTRY overhead */
 	AST_LIST_ENTRY(tps_task) list;
+	/*! \brief When the task was queued */
+	struct timeval queued;
 	unsigned int wants_local:1;
 };
 
+/*!
+ * \brief Intrusive multi-producer/single-consumer lock-free queue of tps_tasks
+ *
+ * Producers link a task in with a single atomic exchange on \ref head.
+ * Only the thread executing the taskprocessor's tasks touches \ref tail.
+ * The list entry of struct tps_task is reused as the link, so no extra
+ * allocation is needed per task.
+ */
+struct tps_mpsc_queue {
+	/*! \brief Most recently pushed task. Producers swap themselves in here. */
+	struct tps_task *head;
+	/*! \brief Oldest task in the queue. Only accessed by the consumer. */
+	struct tps_task *tail;
+	/*! \brief Placeholder task that keeps the queue from ever being truly empty */
+	struct tps_task stub;
+	/*! \brief Number of tasks queued, including the one currently executing */
+	int pending;
+	/*! \brief Non-zero while the consumer is executing a task */
+	int executing;
+};
+
 /*! \brief tps_taskprocessor_stats maintain statistics for a taskprocessor. */
 struct tps_taskprocessor_stats {
 	/*! \brief This is the maximum number of tasks queued at any one time */
 	unsigned long max_qsize;
 	/*! \brief This is the current number of tasks processed */
 	unsigned long _tasks_processed_count;
+	/*! \brief Number of times one or more tasks were executed in one go */
+	unsigned long batches;
+	/*! \brief Largest number of tasks executed in one go */
+	unsigned long max_batch;
+	/*! \brief Queue wait and execution time histograms */
+	struct ast_taskprocessor_latency latency;
+};
+
+/*! \brief Upper bounds in microseconds of all but the last latency histogram bucket */
+static const int64_t tps_histogram_bounds[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS - 1] = {
+	100, 1000, 10000, 100000, 1000000, 10000000,
+};
+
+/*! \brief Labels of the latency histogram buckets */
+static const char * const tps_histogram_names[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS] = {
+	"100us", "1ms", "10ms", "100ms", "1s", "10s", "inf",
 };
 
 /*! \brief A ast_taskprocessor structure is a singleton by name */
@@ -76,15 +141,21 @@ struct ast_taskprocessor {
 	void *local_data;
 	/*! \brief Taskprocessor current queue size */
 	long tps_queue_size;
+	/*! \brief Queue size at which an overload alert is cleared */
+	long tps_queue_low;
+	/*! \brief Queue size at which an overload alert is raised */
+	long tps_queue_high;
+	/*! \brief Non-zero if the queue has reached its high water level. Protected by tps_alert_lock. */
+	int high_water_alert;
 	/*! \brief Taskprocessor queue */
 	AST_LIST_HEAD_NOLOCK(tps_queue, tps_task) tps_queue;
+	/*! \brief Lock-free queue. If non-NULL it is used instead of tps_queue. */
+	struct tps_mpsc_queue *mpsc;
 	struct ast_taskprocessor_listener *listener;
 	/*! Current thread executing the tasks */
 	pthread_t thread;
 	/*! Indicates if the taskprocessor is currently executing a task */
 	unsigned int executing:1;
-	/*! Indicates that a high water warning has been issued on this task processor */
-	unsigned int high_water_warned:1;
 };
 
 /*!
@@ -116,6 +187,60 @@ static ast_cond_t cli_ping_cond;
 /*! \brief CLI <example>taskprocessor ping &lt;blah&gt;</example> operation requires a ping condition lock */
 AST_MUTEX_DEFINE_STATIC(cli_ping_cond_lock);
 
+/*! \brief Lock for the taskprocessor overload alerts */
+AST_MUTEX_DEFINE_STATIC(tps_alert_lock);
+/*! \brief Number of taskprocessors that currently have an overload alert */
+static unsigned int tps_alert_count;
+
+#if !defined(LOW_MEMORY)
+static void tps_task_cache_cleanup(void *data);
+
+/*! \brief A per-thread cache of free tasks */
+AST_THREADSTORAGE_CUSTOM(tps_task_cache, NULL, tps_task_cache_cleanup);
+
+/*!
+ * \brief Maximum number of free tasks cached per thread
+ *
+ * Tasks are usually freed by a different thread than the one that
+ * allocated them, so a thread that only executes tasks would fill up
+ * its cache without ever using it. When a thread's cache is full,
+ * TPS_TASK_CACHE_BATCH tasks are moved to a shared depot where threads
+ * with an empty cache pick them up.
+ */
+#define TPS_TASK_CACHE_MAX_SIZE 64
+
+/*! \brief Number of tasks moved between a thread's cache and the depot at once */
+#define TPS_TASK_CACHE_BATCH 32
+
+/*! \brief Maximum number of free tasks kept in the shared depot */
+#define TPS_TASK_DEPOT_MAX_SIZE 4096
+
+/*! \brief Number of task allocations after which a thread adds its counters to the totals */
+#define TPS_TASK_CACHE_STATS_INTERVAL 256
+
+AST_LIST_HEAD_NOLOCK(tps_task_list, tps_task);
+
+struct tps_task_cache {
+	struct tps_task_list list;
+	size_t size;
+	/*! Allocations served from the cache not yet added to the totals */
+	unsigned int hits;
+	/*! Allocations that missed the cache not yet added to the totals */
+	unsigned int misses;
+};
+
+/*! \brief Lock for the task depot and the task cache totals */
+AST_MUTEX_DEFINE_STATIC(tps_task_depot_lock);
+/*! \brief Free tasks shared between threads */
+static struct tps_task_list tps_task_depot;
+/*! \brief Number of tasks in the depot */
+static size_t tps_task_depot_size;
+/*! \brief Total number of task allocations served from a cache */
+static unsigned long tps_task_cache_hits;
+/*! \brief Total number of task allocations that missed the cache */
+static unsigned long tps_task_cache_misses;
+#endif
+
 /*! \brief The astobj2 hash callback for taskprocessors */
 static int tps_hash_cb(const void *obj, const int flags);
 /*! \brief The astobj2 compare callback for taskprocessors */
@@ -132,12 +257,19 @@ static struct tps_task *tps_taskprocessor_pop(struct ast_taskprocessor *tps);
 
 static char *cli_tps_ping(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 static char *cli_tps_report(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
+static char *cli_tps_latency(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
+static int manager_tps_latency(struct mansession *s, const struct message *m);
+static void tps_metrics_collect(struct ast_metrics_output *out);
 
 static struct ast_cli_entry taskprocessor_clis[] = {
 	AST_CLI_DEFINE(cli_tps_ping, "Ping a named task processor"),
 	AST_CLI_DEFINE(cli_tps_report, "List instantiated task processors and statistics"),
+	AST_CLI_DEFINE(cli_tps_latency, "List task processor queue wait and execution times"),
 };
 
+/*! \brief Maximum number of tasks the default listener executes per wakeup */
+#define DEFAULT_TPS_BATCH_SIZE 32
+
 struct default_taskprocessor_listener_pvt {
 	pthread_t poll_thread;
 	int dead;
@@ -170,6 +302,7 @@ static void *default_tps_processing_function(void *data)
 	struct ast_taskprocessor *tps = listener->tps;
 	struct default_taskprocessor_listener_pvt *pvt = listener->user_data;
 	int sem_value;
+	int executed;
 	int res;
 
 	while (!pvt->dead) {
@@ -180,7 +313,12 @@ static void *default_tps_processing_function(void *data)
 			/* Just give up */
 			break;
 		}
-		ast_taskprocessor_execute(tps);
+		ast_taskprocessor_execute_batch(tps, DEFAULT_TPS_BATCH_SIZE, &executed);
+
+		/* Every executed task posted the semaphore, only the first was waited on */
+		while (--executed > 0) {
+			ast_sem_wait(&pvt->sem);
+		}
 	}
 
 	/* No posting to a dead taskprocessor! */
@@ -261,14 +399,30 @@ static const struct ast_taskprocessor_listener_callbacks default_listener_callba
 static void tps_shutdown(void)
 {
 	ast_cli_unregister_multiple(taskprocessor_clis, ARRAY_LEN(taskprocessor_clis));
+	ast_manager_unregister("TaskprocessorLatency");
+	ast_metrics_collector_unregister(tps_metrics_collect);
 	ao2_t_ref(tps_singletons, -1, "Unref tps_singletons in shutdown");
 	tps_singletons = NULL;
+
+#if !defined(LOW_MEMORY)
+	{
+		struct tps_task *t;
+
+		ast_mutex_lock(&tps_task_depot_lock);
+		while ((t = AST_LIST_REMOVE_HEAD(&tps_task_depot, list))) {
+			ast_free(t);
+		}
+		tps_task_depot_size = 0;
+		ast_mutex_unlock(&tps_task_depot_lock);
+	}
+#endif
 }
 
 /* initialize the taskprocessor container and register CLI operations */
 int ast_tps_init(void)
 {
-	if (!(tps_singletons = ao2_container_alloc(TPS_MAX_BUCKETS, tps_hash_cb, tps_cmp_cb))) {
+	if (!(tps_singletons = ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		TPS_MAX_BUCKETS, tps_hash_cb, NULL, tps_cmp_cb))) {
 		ast_log(LOG_ERROR, "taskprocessor container failed to initialize!\n");
 		return -1;
 	}
@@ -276,12 +430,110 @@ int ast_tps_init(void)
 	ast_cond_init(&cli_ping_cond, NULL);
 
 	ast_cli_register_multiple(taskprocessor_clis, ARRAY_LEN(taskprocessor_clis));
+	ast_metrics_collector_register("taskprocessor", tps_metrics_collect);
 
 	ast_register_cleanup(tps_shutdown);
 
 	return 0;
 }
 
+int ast_tps_manager_init(void)
+{
+	return ast_manager_register_xml_core("TaskprocessorLatency", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING,
+		manager_tps_latency);
+}
+
+#if !defined(LOW_MEMORY)
+/*!
+ * \brief Add a thread's task cache counters to the totals
+ *
+ * \note tps_task_depot_lock must be held
+ */
+static void tps_task_cache_stats_flush(struct tps_task_cache *cache)
+{
+	tps_task_cache_hits += cache->hits;
+	tps_task_cache_misses += cache->misses;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+/*! \brief Move up to count tasks from a thread's cache to the depot, freeing what does not fit */
+static void tps_task_cache_drain(struct tps_task_cache *cache, size_t count)
+{
+	struct tps_task *t;
+
+	ast_mutex_lock(&tps_task_depot_lock);
+	while (count-- && (t = AST_LIST_REMOVE_HEAD(&cache->list, list))) {
+		cache->size--;
+		if (tps_task_depot_size < TPS_TASK_DEPOT_MAX_SIZE) {
+			AST_LIST_INSERT_HEAD(&tps_task_depot, t, list);
+			tps_task_depot_size++;
+		} else {
+			ast_free(t);
+		}
+	}
+	tps_task_cache_stats_flush(cache);
+	ast_mutex_unlock(&tps_task_depot_lock);
+}
+
+/*! \brief Move a batch of tasks from the depot to an empty thread cache */
+static void tps_task_cache_refill(struct tps_task_cache *cache)
+{
+	struct tps_task *t;
+	int count = TPS_TASK_CACHE_BATCH;
+
+	ast_mutex_lock(&tps_task_depot_lock);
+	while (count-- && (t = AST_LIST_REMOVE_HEAD(&tps_task_depot, list))) {
+		tps_task_depot_size--;
+		AST_LIST_INSERT_HEAD(&cache->list, t, list);
+		cache->size++;
+	}
+	tps_task_cache_stats_flush(cache);
+	ast_mutex_unlock(&tps_task_depot_lock);
+}
+
+static void tps_task_cache_cleanup(void *data)
+{
+	struct tps_task_cache *cache = data;
+
+	tps_task_cache_drain(cache, cache->size);
+	ast_free(cache);
+}
+#endif
+
+/*! \brief Get a zeroed task from the thread's cache or the heap */
+static struct tps_task *tps_task_new(void)
+{
+	struct tps_task *t;
+
+#if !defined(LOW_MEMORY)
+	struct tps_task_cache *cache;
+
+	if ((cache = ast_threadstorage_get(&tps_task_cache, sizeof(*cache)))) {
+		if (AST_LIST_EMPTY(&cache->list)) {
+			tps_task_cache_refill(cache);
+		}
+		if ((t = AST_LIST_REMOVE_HEAD(&cache->list, list))) {
+			cache->size--;
+			cache->hits++;
+			memset(t, 0, sizeof(*t));
+		} else {
+			cache->misses++;
+			t = ast_calloc_cache(1, sizeof(*t));
+		}
+		if (cache->hits + cache->misses >= TPS_TASK_CACHE_STATS_INTERVAL) {
+			ast_mutex_lock(&tps_task_depot_lock);
+			tps_task_cache_stats_flush(cache);
+			ast_mutex_unlock(&tps_task_depot_lock);
+		}
+		return t;
+	}
+	return ast_calloc_cache(1, sizeof(*t));
+#else
+	return ast_calloc(1, sizeof(*t));
+#endif
+}
+
 /* allocate resources for the task */
 static struct tps_task *tps_task_alloc(int (*task_exe)(void *datap), void *datap)
 {
@@ -291,7 +543,7 @@ static struct tps_task *tps_task_alloc(int (*task_exe)(void *datap), void *datap
 		return NULL;
 	}
 
-	t = ast_calloc(1, sizeof(*t));
+	t = tps_task_new();
 	if (!t) {
 		ast_log(LOG_ERROR, "failed to allocate task!\n");
 		return NULL;
@@ -299,6 +551,7 @@ static struct tps_task *tps_task_alloc(int (*task_exe)(void *datap), void *datap
 
 	t->callback.execute = task_exe;
 	t->datap = datap;
+	t->queued = ast_tvnow();
 
 	return t;
 }
@@ -311,7 +564,7 @@ static struct tps_task *tps_task_alloc_local(int (*task_exe)(struct ast_taskproc
 		return NULL;
 	}
 
-	t = ast_calloc(1, sizeof(*t));
+	t = tps_task_new();
 	if (!t) {
 		ast_log(LOG_ERROR, "failed to allocate task!\n");
 		return NULL;
@@ -319,6 +572,7 @@ static struct tps_task *tps_task_alloc_local(int (*task_exe)(struct ast_taskproc
 
 	t->callback.execute_local = task_exe;
 	t->datap = datap;
+	t->queued = ast_tvnow();
 	t->wants_local = 1;
 
 	return t;
@@ -327,19 +581,103 @@ static struct tps_task *tps_task_alloc_local(int (*task_exe)(struct ast_taskproc
 /* release task resources */
 static void *tps_task_free(struct tps_task *task)
 {
+#if !defined(LOW_MEMORY)
+	struct tps_task_cache *cache;
+
+	if ((cache = ast_threadstorage_get(&tps_task_cache, sizeof(*cache)))) {
+		if (cache->size >= TPS_TASK_CACHE_MAX_SIZE) {
+			tps_task_cache_drain(cache, TPS_TASK_CACHE_BATCH);
+		}
+		AST_LIST_INSERT_HEAD(&cache->list, task, list);
+		cache->size++;
+		return NULL;
+	}
+#endif
 	ast_free(task);
 	return NULL;
 }
 
+#if defined(HAVE_GCC_ATOMICS)
+static struct tps_mpsc_queue *tps_mpsc_alloc(void)
+{
+	struct tps_mpsc_queue *q = ast_calloc(1, sizeof(*q));
+
+	if (!q) {
+		return NULL;
+	}
+	q->head = &q->stub;
+	q->tail = &q->stub;
+	return q;
+}
+
+/*! \brief Add a task to a lock-free queue. Safe to call from any thread. */
+static void tps_mpsc_push(struct tps_mpsc_queue *q, struct tps_task *t)
+{
+	struct tps_task *prev;
+
+	t->list.next = NULL;
+	/* Make the task contents visible before the task is published */
+	__sync_synchronize();
+	prev = __sync_lock_test_and_set(&q->head, t);
+	prev->list.next = t;
+}
+
+/*!
+ * \brief Remove the oldest task from a lock-free queue
+ *
+ * Only the consumer may call this.
+ *
+ * \retval NULL if the queue is empty or a producer is in the middle of
+ * linking the next task in.
+ */
+static struct tps_task *tps_mpsc_pop(struct tps_mpsc_queue *q)
+{
+	struct tps_task *tail;
+	struct tps_task *next;
+
+	__sync_synchronize();
+	tail = q->tail;
+	next = tail->list.next;
+
+	if (tail == &q->stub) {
+		if (!next) {
+			return NULL;
+		}
+		q->tail = next;
+		tail = next;
+		next = next->list.next;
+	}
+
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+
+	if (tail != q->head) {
+		/* A producer has swapped itself in but has not linked up yet */
+		return NULL;
+	}
+
+	/* tail is the last task. Put the stub behind it so it can be removed. */
+	tps_mpsc_push(q, &q->stub);
+	next = tail->list.next;
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+#endif
+
 /* taskprocessor tab completion */
-static char *tps_taskprocessor_tab_complete(struct ast_taskprocessor *p, struct ast_cli_args *a)
+static char *tps_taskprocessor_tab_complete(struct ast_taskprocessor *p, struct ast_cli_args *a, int pos)
 {
 	int tklen;
 	int wordnum = 0;
 	char *name = NULL;
 	struct ao2_iterator i;
 
-	if (a->pos != 3)
+	if (a->pos != pos)
 		return NULL;
 
 	tklen = strlen(a->word);
@@ -382,7 +720,7 @@ static char *cli_tps_ping(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 			"	Displays the time required for a task to be processed\n";
 		return NULL;
 	case CLI_GENERATE:
-		return tps_taskprocessor_tab_complete(tps, a);
+		return tps_taskprocessor_tab_complete(tps, a, 3);
 	}
 
 	if (a->argc != 4)
@@ -412,6 +750,54 @@ static char *cli_tps_ping(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 	return CLI_SUCCESS;
 }
 
+static unsigned long tps_metric_queue_size(struct ast_taskprocessor *tps)
+{
+	return ast_taskprocessor_size(tps);
+}
+
+static unsigned long tps_metric_max_queue_size(struct ast_taskprocessor *tps)
+{
+	return tps->stats->max_qsize;
+}
+
+static unsigned long tps_metric_processed(struct ast_taskprocessor *tps)
+{
+	return tps->stats->_tasks_processed_count;
+}
+
+/*!
+ * \internal
+ * \brief Write one metric family with a sample for each taskprocessor
+ */
+static void tps_metrics_family(struct ast_metrics_output *out, const char *name,
+	enum ast_metric_type type, const char *help, unsigned long (*value)(struct ast_taskprocessor *tps))
+{
+	struct ast_taskprocessor *tps;
+	struct ao2_iterator i;
+
+	ast_metrics_output_family(out, name, type, help);
+	i = ao2_iterator_init(tps_singletons, 0);
+	while ((tps = ao2_iterator_next(&i))) {
+		ast_metrics_output_sample(out, name, "name", tps->name, value(tps));
+		ao2_ref(tps, -1);
+	}
+	ao2_iterator_destroy(&i);
+}
+
+static void tps_metrics_collect(struct ast_metrics_output *out)
+{
+	if (!tps_singletons) {
+		return;
+	}
+
+	tps_metrics_family(out, "asterisk_taskprocessor_queue_size", AST_METRIC_GAUGE,
+		"Tasks queued in the taskprocessor", tps_metric_queue_size);
+	tps_metrics_family(out, "asterisk_taskprocessor_max_queue_size", AST_METRIC_GAUGE,
+		"Most tasks queued in the taskprocessor at any one time", tps_metric_max_queue_size);
+	tps_metrics_family(out, "asterisk_taskprocessor_tasks_processed_total", AST_METRIC_COUNTER,
+		"Tasks the taskprocessor has executed", tps_metric_processed);
+}
+
 static char *cli_tps_report(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	char name[256];
@@ -419,6 +805,13 @@ static char *cli_tps_report(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 	unsigned long qsize;
 	unsigned long maxqsize;
 	unsigned long processed;
+	unsigned long batches;
+	unsigned long maxbatch;
+#if !defined(LOW_MEMORY)
+	unsigned long hits;
+	unsigned long misses;
+	size_t depot;
+#endif
 	struct ast_taskprocessor *p;
 	struct ao2_iterator i;
 
@@ -436,22 +829,160 @@ static char *cli_tps_report(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 	if (a->argc != e->args)
 		return CLI_SHOWUSAGE;
 
-	ast_cli(a->fd, "\n\t+----- Processor -----+--- Processed ---+- In Queue -+- Max Depth -+");
+	ast_cli(a->fd, "\n\t+----- Processor -----+--- Processed ---+- In Queue -+- Max Depth -+- Avg Batch -+- Max Batch -+");
 	i = ao2_iterator_init(tps_singletons, 0);
 	while ((p = ao2_iterator_next(&i))) {
 		ast_copy_string(name, p->name, sizeof(name));
-		qsize = p->tps_queue_size;
+		qsize = ast_taskprocessor_size(p);
 		maxqsize = p->stats->max_qsize;
 		processed = p->stats->_tasks_processed_count;
-		ast_cli(a->fd, "\n%24s   %17lu %12lu %12lu", name, processed, qsize, maxqsize);
+		batches = p->stats->batches;
+		maxbatch = p->stats->max_batch;
+		ast_cli(a->fd, "\n%24s   %17lu %12lu %12lu %13.1f %13lu", name, processed, qsize, maxqsize,
+			batches ? (double) processed / batches : 0.0, maxbatch);
 		ao2_ref(p, -1);
 	}
 	ao2_iterator_destroy(&i);
 	tcount = ao2_container_count(tps_singletons);
-	ast_cli(a->fd, "\n\t+---------------------+-----------------+------------+-------------+\n\t%d taskprocessors\n\n", tcount);
+	ast_cli(a->fd, "\n\t+---------------------+-----------------+------------+-------------+-------------+-------------+\n\t%d taskprocessors, %u overloaded\n", tcount, ast_taskprocessor_alert_get());
+#if !defined(LOW_MEMORY)
+	ast_mutex_lock(&tps_task_depot_lock);
+	hits = tps_task_cache_hits;
+	misses = tps_task_cache_misses;
+	depot = tps_task_depot_size;
+	ast_mutex_unlock(&tps_task_depot_lock);
+	ast_cli(a->fd, "\tTask cache: %lu hits, %lu misses (%.1f%% hit rate), %zu in depot\n",
+		hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0, depot);
+#endif
+	ast_cli(a->fd, "\n");
+	return CLI_SUCCESS;
+}
+
+/*! \brief Build a bucket=count list of a latency histogram */
+static void tps_histogram_str(struct ast_str **buf, const unsigned long *histogram)
+{
+	int i;
+
+	ast_str_reset(*buf);
+	for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+		ast_str_append(buf, 0, "%s%s=%lu", i ? "," : "",
+			tps_histogram_names[i], histogram[i]);
+	}
+}
+
+static void cli_tps_latency_print(int fd, const char *label, const unsigned long *histogram, int64_t max)
+{
+	int i;
+
+	ast_cli(fd, "%8s", label);
+	for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+		ast_cli(fd, " %9lu", histogram[i]);
+	}
+	ast_cli(fd, " %12" PRId64 "\n", max);
+}
+
+static char *cli_tps_latency(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_taskprocessor_latency latency;
+	struct ast_taskprocessor *p;
+	struct ao2_iterator i;
+	const char *name = NULL;
+	int idx;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show taskprocessors latency";
+		e->usage =
+			"Usage: core show taskprocessors latency [<taskprocessor>]\n"
+			"	Shows histograms of how long tasks waited in the queue and how\n"
+			"	long they took to execute for all task processors, or only the\n"
+			"	named one. Each column counts the tasks that took less than the\n"
+			"	column's time. Max is in microseconds.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return tps_taskprocessor_tab_complete(NULL, a, 4);
+	}
+
+	if (a->argc == 5) {
+		name = a->argv[4];
+	} else if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "\n%8s", "");
+	for (idx = 0; idx < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++idx) {
+		ast_cli(a->fd, " %9s", tps_histogram_names[idx]);
+	}
+	ast_cli(a->fd, " %12s\n", "Max");
+
+	i = ao2_iterator_init(tps_singletons, 0);
+	while ((p = ao2_iterator_next(&i))) {
+		if ((!name || !strcasecmp(name, p->name))
+			&& !ast_taskprocessor_latency_get(p, &latency)) {
+			ast_cli(a->fd, "%s\n", p->name);
+			cli_tps_latency_print(a->fd, "wait", latency.wait, latency.wait_max);
+			cli_tps_latency_print(a->fd, "execute", latency.execute, latency.execute_max);
+		}
+		ao2_ref(p, -1);
+	}
+	ao2_iterator_destroy(&i);
+	ast_cli(a->fd, "\n");
 	return CLI_SUCCESS;
 }
 
+static int manager_tps_latency(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *name = astman_get_header(m, "Taskprocessor");
+	RAII_VAR(struct ast_str *, id_text, ast_str_create(128), ast_free);
+	RAII_VAR(struct ast_str *, wait, ast_str_create(128), ast_free);
+	RAII_VAR(struct ast_str *, execute, ast_str_create(128), ast_free);
+	struct ast_taskprocessor_latency latency;
+	struct ast_taskprocessor *p;
+	struct ao2_iterator i;
+	int num_items = 0;
+
+	if (!id_text || !wait || !execute) {
+		astman_send_error(s, m, "Internal error");
+		return -1;
+	}
+
+	if (!ast_strlen_zero(id)) {
+		ast_str_set(&id_text, 0, "ActionID: %s\r\n", id);
+	}
+
+	astman_send_listack(s, m, "Taskprocessor latency will follow", "start");
+
+	i = ao2_iterator_init(tps_singletons, 0);
+	while ((p = ao2_iterator_next(&i))) {
+		if ((ast_strlen_zero(name) || !strcasecmp(name, p->name))
+			&& !ast_taskprocessor_latency_get(p, &latency)) {
+			tps_histogram_str(&wait, latency.wait);
+			tps_histogram_str(&execute, latency.execute);
+			astman_append(s,
+				"Event: TaskprocessorLatency\r\n"
+				"Taskprocessor: %s\r\n"
+				"WaitHistogram: %s\r\n"
+				"WaitMax: %" PRId64 "\r\n"
+				"ExecuteHistogram: %s\r\n"
+				"ExecuteMax: %" PRId64 "\r\n"
+				"%s"
+				"\r\n",
+				p->name, ast_str_buffer(wait), latency.wait_max,
+				ast_str_buffer(execute), latency.execute_max,
+				ast_str_buffer(id_text));
+			++num_items;
+		}
+		ao2_ref(p, -1);
+	}
+	ao2_iterator_destroy(&i);
+
+	astman_send_list_complete_start(s, m, "TaskprocessorLatencyComplete", num_items);
+	astman_send_list_complete_end(s);
+
+	return 0;
+}
+
 /* hash callback for astobj2 */
 static int tps_hash_cb(const void *obj, const int flags)
 {
@@ -481,6 +1012,12 @@ static void tps_taskprocessor_destroy(void *tps)
 		return;
 	}
 	ast_debug(1, "destroying taskprocessor '%s'\n", t->name);
+	ast_mutex_lock(&tps_alert_lock);
+	if (t->high_water_alert) {
+		t->high_water_alert = 0;
+		--tps_alert_count;
+	}
+	ast_mutex_unlock(&tps_alert_lock);
 	/* free it */
 	ast_free(t->stats);
 	t->stats = NULL;
@@ -492,6 +1029,114 @@ static void tps_taskprocessor_destroy(void *tps)
 	while ((task = AST_LIST_REMOVE_HEAD(&t->tps_queue, list))) {
 		tps_task_free(task);
 	}
+#if defined(HAVE_GCC_ATOMICS)
+	if (t->mpsc) {
+		while ((task = tps_mpsc_pop(t->mpsc))) {
+			tps_task_free(task);
+		}
+		ast_free(t->mpsc);
+		t->mpsc = NULL;
+	}
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Raise or clear the overload alert of a taskprocessor
+ *
+ * \param tps The taskprocessor whose queue size changed
+ * \param size The new queue size
+ */
+static void tps_alert_update(struct ast_taskprocessor *tps, long size)
+{
+	int alert;
+
+	/* Most calls do not change the alert, so check before locking */
+	if (tps->high_water_alert) {
+		if (size > tps->tps_queue_low) {
+			return;
+		}
+	} else if (size < tps->tps_queue_high) {
+		return;
+	}
+
+	ast_mutex_lock(&tps_alert_lock);
+	/* Check again with the current size, another thread might have beaten us */
+	size = ast_taskprocessor_size(tps);
+	if (size >= tps->tps_queue_high) {
+		alert = 1;
+	} else if (size <= tps->tps_queue_low) {
+		alert = 0;
+	} else {
+		alert = tps->high_water_alert;
+	}
+	if (alert != tps->high_water_alert) {
+		tps->high_water_alert = alert;
+		if (alert) {
+			++tps_alert_count;
+			ast_log(LOG_WARNING, "The '%s' task processor queue reached %ld scheduled tasks.\n",
+				tps->name, size);
+		} else {
+			--tps_alert_count;
+			ast_debug(3, "The '%s' task processor queue fell to %ld scheduled tasks.\n",
+				tps->name, size);
+		}
+	}
+	ast_mutex_unlock(&tps_alert_lock);
+}
+
+unsigned int ast_taskprocessor_alert_get(void)
+{
+	unsigned int count;
+
+	ast_mutex_lock(&tps_alert_lock);
+	count = tps_alert_count;
+	ast_mutex_unlock(&tps_alert_lock);
+
+	return count;
+}
+
+int ast_taskprocessor_is_overloaded(struct ast_taskprocessor *tps)
+{
+	int alert;
+
+	if (!tps) {
+		return 0;
+	}
+
+	ast_mutex_lock(&tps_alert_lock);
+	alert = tps->high_water_alert;
+	ast_mutex_unlock(&tps_alert_lock);
+
+	return alert;
+}
+
+int ast_taskprocessor_alert_set_levels(struct ast_taskprocessor *tps, long low_water, long high_water)
+{
+	if (!tps || high_water <= 0 || high_water < low_water) {
+		return -1;
+	}
+
+	if (low_water < 0) {
+		/* Set a reasonable default */
+		low_water = (high_water * 9) / 10;
+	}
+
+	ao2_lock(tps);
+	tps->tps_queue_low = low_water;
+	tps->tps_queue_high = high_water;
+	ao2_unlock(tps);
+
+	/* Force the alert to be reevaluated against the new levels */
+	ast_mutex_lock(&tps_alert_lock);
+	if (tps->high_water_alert) {
+		tps->high_water_alert = 0;
+		--tps_alert_count;
+	}
+	ast_mutex_unlock(&tps_alert_lock);
+	tps_alert_update(tps, ast_taskprocessor_size(tps));
+
+	return 0;
 }
 
 /* pop the front task and return it */
@@ -501,13 +1146,67 @@ static struct tps_task *tps_taskprocessor_pop(struct ast_taskprocessor *tps)
 
 	if ((task = AST_LIST_REMOVE_HEAD(&tps->tps_queue, list))) {
 		tps->tps_queue_size--;
+		tps_alert_update(tps, tps->tps_queue_size);
 	}
 	return task;
 }
 
 long ast_taskprocessor_size(struct ast_taskprocessor *tps)
 {
-	return (tps) ? tps->tps_queue_size : -1;
+	if (!tps) {
+		return -1;
+	}
+	if (tps->mpsc) {
+		/* The executing task is no longer in the queue */
+		return tps->mpsc->pending - tps->mpsc->executing;
+	}
+	return tps->tps_queue_size;
+}
+
+long ast_taskprocessor_depth(struct ast_taskprocessor *tps)
+{
+	if (!tps) {
+		return -1;
+	}
+	if (tps->mpsc) {
+		return tps->mpsc->pending;
+	}
+	return tps->tps_queue_size + tps->executing;
+}
+
+int ast_taskprocessor_latency_get(struct ast_taskprocessor *tps, struct ast_taskprocessor_latency *latency)
+{
+	if (!tps || !tps->stats) {
+		return -1;
+	}
+
+	ao2_lock(tps);
+	*latency = tps->stats->latency;
+	ao2_unlock(tps);
+	return 0;
+}
+
+const char *ast_taskprocessor_histogram_bucket_name(int bucket)
+{
+	if (bucket < 0 || bucket >= AST_TASKPROCESSOR_HISTOGRAM_BUCKETS) {
+		return "";
+	}
+	return tps_histogram_names[bucket];
+}
+
+static int tps_histogram_bucket(int64_t usec);
+
+int ast_taskprocessor_histogram_bucket(int64_t usec)
+{
+	return tps_histogram_bucket(usec);
+}
+
+int64_t ast_taskprocessor_histogram_bucket_limit(int bucket)
+{
+	if (bucket < 0 || bucket >= ARRAY_LEN(tps_histogram_bounds)) {
+		return -1;
+	}
+	return tps_histogram_bounds[bucket];
 }
 
 /* taskprocessor name accessor */
@@ -577,7 +1276,8 @@ static void *default_listener_pvt_alloc(void)
 	return pvt;
 }
 
-static struct ast_taskprocessor *__allocate_taskprocessor(const char *name, struct ast_taskprocessor_listener *listener)
+static struct ast_taskprocessor *__allocate_taskprocessor(const char *name, struct ast_taskprocessor_listener *listener,
+	enum ast_tps_options options)
 {
 	RAII_VAR(struct ast_taskprocessor *, p,
 			ao2_alloc(sizeof(*p), tps_taskprocessor_destroy), ao2_cleanup);
@@ -594,6 +1294,13 @@ static struct ast_taskprocessor *__allocate_taskprocessor(const char *name, stru
 	if (!(p->name = ast_strdup(name))) {
 		return NULL;
 	}
+	p->tps_queue_low = (AST_TASKPROCESSOR_HIGH_WATER_LEVEL * 9) / 10;
+	p->tps_queue_high = AST_TASKPROCESSOR_HIGH_WATER_LEVEL;
+#if defined(HAVE_GCC_ATOMICS)
+	if ((options & TPS_QUEUE_LOCKFREE) && !(p->mpsc = tps_mpsc_alloc())) {
+		return NULL;
+	}
+#endif
 
 	ao2_ref(listener, +1);
 	p->listener = listener;
@@ -654,7 +1361,7 @@ struct ast_taskprocessor *ast_taskprocessor_get(const char *name, enum ast_tps_o
 		return NULL;
 	}
 
-	p = __allocate_taskprocessor(name, listener);
+	p = __allocate_taskprocessor(name, listener, create);
 	if (!p) {
 		ao2_ref(listener, -1);
 		return NULL;
@@ -673,7 +1380,7 @@ struct ast_taskprocessor *ast_taskprocessor_create_with_listener(const char *nam
 		ast_taskprocessor_unreference(p);
 		return NULL;
 	}
-	return __allocate_taskprocessor(name, listener);
+	return __allocate_taskprocessor(name, listener, TPS_REF_DEFAULT);
 }
 
 void ast_taskprocessor_set_local(struct ast_taskprocessor *tps,
@@ -713,6 +1420,130 @@ void *ast_taskprocessor_unreference(struct ast_taskprocessor *tps)
 	return NULL;
 }
 
+/*! \brief Find the latency histogram bucket a time in microseconds falls in */
+static int tps_histogram_bucket(int64_t usec)
+{
+	int bucket;
+
+	for (bucket = 0; bucket < ARRAY_LEN(tps_histogram_bounds); ++bucket) {
+		if (usec < tps_histogram_bounds[bucket]) {
+			break;
+		}
+	}
+	return bucket;
+}
+
+/*!
+ * \brief Record how long a task waited and executed
+ *
+ * \note Must be called by the thread executing tasks, with the
+ * taskprocessor locked unless the taskprocessor has a lock-free queue.
+ */
+static void tps_latency_record(struct tps_taskprocessor_stats *stats, int64_t wait, int64_t execute)
+{
+	stats->latency.wait[tps_histogram_bucket(wait)]++;
+	if (wait > stats->latency.wait_max) {
+		stats->latency.wait_max = wait;
+	}
+	stats->latency.execute[tps_histogram_bucket(execute)]++;
+	if (execute > stats->latency.execute_max) {
+		stats->latency.execute_max = execute;
+	}
+}
+
+/*! \brief Record the number of tasks executed by one execute call */
+static void tps_batch_record(struct tps_taskprocessor_stats *stats, int count)
+{
+	stats->batches++;
+	if (count > stats->max_batch) {
+		stats->max_batch = count;
+	}
+}
+
+#if defined(HAVE_GCC_ATOMICS)
+/* push the task into the lock-free taskprocessor queue */
+static int taskprocessor_push_lockfree(struct ast_taskprocessor *tps, struct tps_task *t)
+{
+	/* Count the task before linking it so the consumer never sees more
+	 * tasks than have been counted. The currently executing task counts
+	 * as still in queue.
+	 */
+	int previous_size = ast_atomic_fetchadd_int(&tps->mpsc->pending, +1);
+
+	tps_mpsc_push(tps->mpsc, t);
+	tps_alert_update(tps, previous_size + 1);
+
+	tps->listener->callbacks->task_pushed(tps->listener, previous_size == 0);
+	return 0;
+}
+
+/* pop up to max_tasks tasks off the lock-free taskprocessor queue and execute them */
+static int taskprocessor_execute_lockfree(struct ast_taskprocessor *tps, int max_tasks, int *executed)
+{
+	struct ast_taskprocessor_local local;
+	struct tps_task *t;
+	struct timeval start;
+	int64_t wait;
+	int count = 0;
+	int size;
+
+	if (!ast_atomic_fetchadd_int(&tps->mpsc->pending, 0)) {
+		return 0;
+	}
+
+	tps->thread = pthread_self();
+
+	do {
+		while (!(t = tps_mpsc_pop(tps->mpsc))) {
+			/* A producer has counted its task but has not finished linking it */
+			sched_yield();
+		}
+
+		tps->mpsc->executing = 1;
+
+		start = ast_tvnow();
+		wait = ast_tvdiff_us(start, t->queued);
+		AST_PROBE3(taskprocessor__execute__start, tps->name, t->callback.execute, wait);
+		if (t->wants_local) {
+			ao2_lock(tps);
+			local.local_data = tps->local_data;
+			ao2_unlock(tps);
+			local.data = t->datap;
+			t->callback.execute_local(&local);
+		} else {
+			t->callback.execute(t->datap);
+		}
+		tps_task_free(t);
+		AST_PROBE1(taskprocessor__execute__done, tps->name);
+
+		tps->mpsc->executing = 0;
+		size = ast_atomic_fetchadd_int(&tps->mpsc->pending, -1) - 1;
+		tps_alert_update(tps, size);
+		++count;
+
+		/* Only the consumer updates the stats, so no lock is needed */
+		if (tps->stats) {
+			tps->stats->_tasks_processed_count++;
+			if (size > tps->stats->max_qsize) {
+				tps->stats->max_qsize = size;
+			}
+			tps_latency_record(tps->stats, wait, ast_tvdiff_us(ast_tvnow(), start));
+		}
+	} while (size > 0 && count < max_tasks);
+
+	tps->thread = AST_PTHREADT_NULL;
+	if (tps->stats) {
+		tps_batch_record(tps->stats, count);
+	}
+	*executed = count;
+
+	if (size == 0 && tps->listener->callbacks->emptied) {
+		tps->listener->callbacks->emptied(tps->listener);
+	}
+	return size > 0;
+}
+#endif
+
 /* push the task into the taskprocessor queue */
 static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
 {
@@ -729,15 +1560,18 @@ static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
 		return -1;
 	}
 
+	AST_PROBE2(taskprocessor__push, tps->name, t->callback.execute);
+
+#if defined(HAVE_GCC_ATOMICS)
+	if (tps->mpsc) {
+		return taskprocessor_push_lockfree(tps, t);
+	}
+#endif
+
 	ao2_lock(tps);
 	AST_LIST_INSERT_TAIL(&tps->tps_queue, t, list);
 	previous_size = tps->tps_queue_size++;
-
-	if (previous_size >= AST_TASKPROCESSOR_HIGH_WATER_LEVEL && !tps->high_water_warned) {
-		ast_log(LOG_WARNING, "The '%s' task processor queue reached %d scheduled tasks.\n",
-			tps->name, previous_size);
-		tps->high_water_warned = 1;
-	}
+	tps_alert_update(tps, tps->tps_queue_size);
 
 	/* The currently executing task counts as still in queue */
 	was_empty = tps->executing ? 0 : previous_size == 0;
@@ -757,33 +1591,72 @@ int ast_taskprocessor_push_local(struct ast_taskprocessor *tps, int (*task_exe)(
 }
 
 int ast_taskprocessor_execute(struct ast_taskprocessor *tps)
+{
+	return ast_taskprocessor_execute_batch(tps, 1, NULL);
+}
+
+int ast_taskprocessor_execute_batch(struct ast_taskprocessor *tps, int max_tasks, int *executed)
 {
 	struct ast_taskprocessor_local local;
-	struct tps_task *t;
+	struct tps_task *tasks[AST_TASKPROCESSOR_BATCH_MAX];
+	int64_t wait[AST_TASKPROCESSOR_BATCH_MAX];
+	int64_t execute[AST_TASKPROCESSOR_BATCH_MAX];
+	struct timeval start;
 	long size;
+	int count;
+	int i;
+
+	if (executed) {
+		*executed = 0;
+	}
+
+	if (max_tasks < 1) {
+		max_tasks = 1;
+	} else if (max_tasks > AST_TASKPROCESSOR_BATCH_MAX) {
+		max_tasks = AST_TASKPROCESSOR_BATCH_MAX;
+	}
+
+#if defined(HAVE_GCC_ATOMICS)
+	if (tps->mpsc) {
+		count = 0;
+		size = taskprocessor_execute_lockfree(tps, max_tasks, &count);
+		if (executed) {
+			*executed = count;
+		}
+		return size;
+	}
+#endif
 
 	ao2_lock(tps);
-	t = tps_taskprocessor_pop(tps);
-	if (!t) {
+	for (count = 0; count < max_tasks; ++count) {
+		if (!(tasks[count] = tps_taskprocessor_pop(tps))) {
+			break;
+		}
+	}
+	if (!count) {
 		ao2_unlock(tps);
 		return 0;
 	}
 
 	tps->thread = pthread_self();
 	tps->executing = 1;
-
-	if (t->wants_local) {
-		local.local_data = tps->local_data;
-		local.data = t->datap;
-	}
+	local.local_data = tps->local_data;
 	ao2_unlock(tps);
 
-	if (t->wants_local) {
-		t->callback.execute_local(&local);
-	} else {
-		t->callback.execute(t->datap);
+	for (i = 0; i < count; ++i) {
+		start = ast_tvnow();
+		wait[i] = ast_tvdiff_us(start, tasks[i]->queued);
+		AST_PROBE3(taskprocessor__execute__start, tps->name, tasks[i]->callback.execute, wait[i]);
+		if (tasks[i]->wants_local) {
+			local.data = tasks[i]->datap;
+			tasks[i]->callback.execute_local(&local);
+		} else {
+			tasks[i]->callback.execute(tasks[i]->datap);
+		}
+		tps_task_free(tasks[i]);
+		execute[i] = ast_tvdiff_us(ast_tvnow(), start);
+		AST_PROBE1(taskprocessor__execute__done, tps->name);
 	}
-	tps_task_free(t);
 
 	ao2_lock(tps);
 	tps->thread = AST_PTHREADT_NULL;
@@ -795,13 +1668,21 @@ int ast_taskprocessor_execute(struct ast_taskprocessor *tps)
 	size = ast_taskprocessor_size(tps);
 	/* If we executed a task, bump the stats */
 	if (tps->stats) {
-		tps->stats->_tasks_processed_count++;
+		tps->stats->_tasks_processed_count += count;
 		if (size > tps->stats->max_qsize) {
 			tps->stats->max_qsize = size;
 		}
+		for (i = 0; i < count; ++i) {
+			tps_latency_record(tps->stats, wait[i], execute[i]);
+		}
+		tps_batch_record(tps->stats, count);
 	}
 	ao2_unlock(tps);
 
+	if (executed) {
+		*executed = count;
+	}
+
 	/* If we executed a task, check for the transition to empty */
 	if (size == 0 && tps->listener->callbacks->emptied) {
 		tps->listener->callbacks->emptied(tps->listener);
@@ -82,9 +82,23 @@ struct ast_test {
 	ast_test_cb_t *cb;                  /*!< test callback function */
 	ast_test_init_cb_t *init_cb;        /*!< test init function */
 	ast_test_cleanup_cb_t *cleanup_cb;  /*!< test cleanup function */
+	struct ast_bench_result *bench;     /*!< what it measured, if the test is a benchmark */
 	AST_LIST_ENTRY(ast_test) entry;
 };
 
+/*! \brief What a benchmark measured the last time it ran */
+struct ast_bench_result {
+	unsigned int iterations;  /*!< operations measured, 0 if it has not run or failed */
+	uint64_t total_ns;        /*!< time the measured operations took */
+	double ns_per_op;
+	double ops_per_sec;
+	double p50_ns;            /*!< median time per operation */
+	double p90_ns;
+	double p99_ns;
+	double max_ns;
+	double allocs_per_op;     /*!< -1 if allocations are not counted */
+};
+
 /*! global structure containing both total and last test execution results */
 static struct ast_test_execute_results {
 	unsigned int total_tests;  /*!< total number of tests, regardless if they have been executed or not */
@@ -269,6 +283,151 @@ void ast_test_set_result(struct ast_test *test, enum ast_test_result_state state
 	test->state = state;
 }
 
+/*! \brief Nanoseconds on a clock that does not jump */
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_sample_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*!
+ * \internal
+ * \brief Warm up and measure a benchmark
+ *
+ * \param bench What to measure
+ * \param test The benchmark being run
+ * \param result Where to put what it measured
+ */
+static enum ast_test_result_state bench_measure(const struct ast_bench_info *bench,
+	struct ast_test *test, struct ast_bench_result *result)
+{
+	unsigned int warmup = bench->warmup ?: 1000;
+	unsigned int batch = bench->batch ?: 1;
+	unsigned int num_samples = ((bench->iterations ?: 10000) + batch - 1) / batch;
+	unsigned int ops = num_samples * batch;
+	uint64_t *samples;
+	uint64_t total_ns = 0;
+	void *data = NULL;
+	unsigned int iteration = 0;
+	unsigned int i;
+	unsigned int j;
+#ifdef __AST_DEBUG_MALLOC
+	unsigned long allocs;
+#endif
+
+	memset(result, 0, sizeof(*result));
+
+	if (!bench->op) {
+		ast_test_status_update(test, "Benchmark has no operation to run\n");
+		return AST_TEST_FAIL;
+	}
+	if (!(samples = ast_malloc(num_samples * sizeof(*samples)))) {
+		return AST_TEST_FAIL;
+	}
+	if (bench->setup && bench->setup(test, &data)) {
+		ast_test_status_update(test, "Benchmark setup failed\n");
+		ast_free(samples);
+		return AST_TEST_FAIL;
+	}
+
+	for (; iteration < warmup; ++iteration) {
+		if (bench->op(data, iteration)) {
+			goto failed;
+		}
+	}
+
+#ifdef __AST_DEBUG_MALLOC
+	allocs = ast_mm_thread_allocations();
+#endif
+	for (i = 0; i < num_samples; ++i) {
+		uint64_t start = bench_now_ns();
+
+		for (j = 0; j < batch; ++j, ++iteration) {
+			if (bench->op(data, iteration)) {
+				goto failed;
+			}
+		}
+		samples[i] = bench_now_ns() - start;
+		total_ns += samples[i];
+	}
+#ifdef __AST_DEBUG_MALLOC
+	result->allocs_per_op = (double) (ast_mm_thread_allocations() - allocs) / ops;
+#else
+	result->allocs_per_op = -1;
+#endif
+
+	if (bench->teardown) {
+		bench->teardown(data);
+	}
+
+	qsort(samples, num_samples, sizeof(*samples), bench_sample_cmp);
+	result->iterations = ops;
+	result->total_ns = total_ns;
+	result->ns_per_op = (double) total_ns / ops;
+	result->ops_per_sec = total_ns ? ops * 1000000000.0 / total_ns : 0;
+	result->p50_ns = (double) samples[(num_samples - 1) * 50 / 100] / batch;
+	result->p90_ns = (double) samples[(num_samples - 1) * 90 / 100] / batch;
+	result->p99_ns = (double) samples[(num_samples - 1) * 99 / 100] / batch;
+	result->max_ns = (double) samples[num_samples - 1] / batch;
+	ast_free(samples);
+
+	ast_test_status_update(test,
+		"BENCH name=%s ops=%u ns_per_op=%.1f ops_per_sec=%.0f p50_ns=%.1f"
+		" p90_ns=%.1f p99_ns=%.1f max_ns=%.1f allocs_per_op=%.2f\n",
+		bench->name, result->iterations, result->ns_per_op, result->ops_per_sec,
+		result->p50_ns, result->p90_ns, result->p99_ns, result->max_ns,
+		result->allocs_per_op);
+	return AST_TEST_PASS;
+
+failed:
+	ast_test_status_update(test, "Operation %u failed\n", iteration);
+	if (bench->teardown) {
+		bench->teardown(data);
+	}
+	ast_free(samples);
+	return AST_TEST_FAIL;
+}
+
+enum ast_test_result_state __ast_bench_run(ast_bench_info_cb_t *info_cb,
+	struct ast_test_info *info, enum ast_test_command cmd, struct ast_test *test)
+{
+	struct ast_bench_info bench = { NULL, };
+	struct ast_bench_result result;
+
+	info_cb(&bench);
+
+	if (cmd == TEST_INIT) {
+		info->name = bench.name;
+		info->category = bench.category;
+		info->summary = bench.summary;
+		info->description = bench.description;
+		if (!test->bench) {
+			test->bench = ast_calloc(1, sizeof(*test->bench));
+		}
+		return AST_TEST_NOT_RUN;
+	}
+
+	if (!test->bench) {
+		return AST_TEST_FAIL;
+	}
+	if (bench_measure(&bench, test, &result) != AST_TEST_PASS) {
+		test->bench->iterations = 0;
+		return AST_TEST_FAIL;
+	}
+	*test->bench = result;
+	return AST_TEST_PASS;
+}
+
 static void test_xml_entry(struct ast_test *test, FILE *f)
 {
 	if (!f || !test || test->state == AST_TEST_NOT_RUN) {
@@ -610,6 +769,7 @@ static struct ast_test *test_free(struct ast_test *test)
 	}
 
 	ast_free(test->status_str);
+	ast_free(test->bench);
 	ast_free(test);
 
 	return NULL;
@@ -1000,11 +1160,353 @@ static char *test_cli_generate_results(struct ast_cli_entry *e, int cmd, struct
 	return CLI_SUCCESS;
 }
 
+static char *bench_cli_execute(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	static const char * const option1[] = { "all", "category", NULL };
+	static const char * const option2[] = { "name", NULL };
+	char result_buf[32] = { 0 };
+	const char *category = NULL;
+	const char *name = NULL;
+	struct ast_test *test;
+	int executed = 0;
+	int failed = 0;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "bench execute";
+		e->usage =
+			"Usage: bench execute can be used in three ways.\n"
+			"       1. 'bench execute all' runs all registered benchmarks\n"
+			"       2. 'bench execute category [category]' runs all benchmarks in the\n"
+			"          given category.\n"
+			"       3. 'bench execute category [category] name [name]' runs the\n"
+			"          benchmarks in a given category matching a given name\n"
+			"       Tests which are not benchmarks are not run.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 2) {
+			return ast_cli_complete(a->word, option1, a->n);
+		}
+		if (a->pos == 3) {
+			return complete_test_category(a->line, a->word, a->pos, a->n);
+		}
+		if (a->pos == 4) {
+			return ast_cli_complete(a->word, option2, a->n);
+		}
+		if (a->pos == 5) {
+			return complete_test_name(a->line, a->word, a->pos, a->n, a->argv[3]);
+		}
+		return NULL;
+	}
+
+	if (a->argc == 3 && !strcmp(a->argv[2], "all")) {
+		/* Run them all */
+	} else if (a->argc == 4 && !strcmp(a->argv[2], "category")) {
+		category = a->argv[3];
+	} else if (a->argc == 6 && !strcmp(a->argv[2], "category") && !strcmp(a->argv[4], "name")) {
+		category = a->argv[3];
+		name = a->argv[5];
+	} else {
+		return CLI_SHOWUSAGE;
+	}
+
+	AST_LIST_LOCK(&tests);
+	AST_LIST_TRAVERSE(&tests, test, entry) {
+		if (!test->bench
+			|| (category && test_cat_cmp(test->info.category, category))
+			|| (name && strcmp(test->info.name, name))) {
+			continue;
+		}
+
+		ast_cli(a->fd, "START  %s - %s \n", test->info.category, test->info.name);
+		test->cli = a;
+		test_execute(test);
+		test->cli = NULL;
+
+		++executed;
+		if (test->state == AST_TEST_FAIL) {
+			++failed;
+		}
+		term_color(result_buf, test_result2str[test->state],
+			(test->state == AST_TEST_FAIL) ? COLOR_RED : COLOR_GREEN,
+			0, sizeof(result_buf));
+		ast_cli(a->fd, "END    %s - %s Time: %s%ums Result: %s\n",
+			test->info.category, test->info.name,
+			test->time ? "" : "<", test->time ? test->time : 1,
+			result_buf);
+	}
+	AST_LIST_UNLOCK(&tests);
+
+	if (!executed) {
+		ast_cli(a->fd, "--- No Benchmarks Found! ---\n");
+	}
+	ast_cli(a->fd, "\n%d Benchmark(s) Executed  %d Passed  %d Failed\n",
+		executed, executed - failed, failed);
+	return CLI_SUCCESS;
+}
+
+static char *bench_cli_show_results(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT_BENCH "%-25.25s %-30.30s %12s %12s %10s %10s %10s %9s\n"
+	struct ast_test *test;
+	char ns_per_op[32];
+	char ops_per_sec[32];
+	char p50[32];
+	char p90[32];
+	char p99[32];
+	char allocs[32];
+	int count = 0;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "bench show results";
+		e->usage =
+			"Usage: bench show results [<category>]\n"
+			"       Show what each benchmark, or each in the given category,\n"
+			"       measured the last time it ran. Times are in nanoseconds\n"
+			"       per operation.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 3) {
+			return complete_test_category(a->line, a->word, a->pos, a->n);
+		}
+		return NULL;
+	}
+
+	if (a->argc < 3 || a->argc > 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, FORMAT_BENCH, "Category", "Name", "ns/op", "ops/sec", "p50", "p90", "p99", "allocs/op");
+	AST_LIST_LOCK(&tests);
+	AST_LIST_TRAVERSE(&tests, test, entry) {
+		if (!test->bench || !test->bench->iterations
+			|| (a->argc == 4 && test_cat_cmp(test->info.category, a->argv[3]))) {
+			continue;
+		}
+		snprintf(ns_per_op, sizeof(ns_per_op), "%.1f", test->bench->ns_per_op);
+		snprintf(ops_per_sec, sizeof(ops_per_sec), "%.0f", test->bench->ops_per_sec);
+		snprintf(p50, sizeof(p50), "%.1f", test->bench->p50_ns);
+		snprintf(p90, sizeof(p90), "%.1f", test->bench->p90_ns);
+		snprintf(p99, sizeof(p99), "%.1f", test->bench->p99_ns);
+		if (test->bench->allocs_per_op < 0) {
+			ast_copy_string(allocs, "-", sizeof(allocs));
+		} else {
+			snprintf(allocs, sizeof(allocs), "%.2f", test->bench->allocs_per_op);
+		}
+		ast_cli(a->fd, FORMAT_BENCH, test->info.category, test->info.name,
+			ns_per_op, ops_per_sec, p50, p90, p99, allocs);
+		++count;
+	}
+	AST_LIST_UNLOCK(&tests);
+
+	ast_cli(a->fd, "%d Benchmark Result(s)\n", count);
+	return CLI_SUCCESS;
+#undef FORMAT_BENCH
+}
+
+/*!
+ * \internal
+ * \brief Write what the benchmarks measured as a JUnit report
+ *
+ * Each benchmark is a testcase, with its measurements as properties.
+ *
+ * \note The tests list must be locked.
+ */
+static int bench_generate_junit(const char *path)
+{
+	struct ast_test *test;
+	unsigned int count = 0;
+	unsigned int failures = 0;
+	unsigned int time = 0;
+	FILE *f;
+
+	if (!(f = fopen(path, "w"))) {
+		ast_log(LOG_WARNING, "Could not open file %s for benchmark results\n", path);
+		return -1;
+	}
+
+	AST_LIST_TRAVERSE(&tests, test, entry) {
+		if (test->bench && test->state != AST_TEST_NOT_RUN) {
+			++count;
+			failures += test->state == AST_TEST_FAIL;
+			time += test->time;
+		}
+	}
+
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(f, "<testsuite errors=\"0\" failures=\"%u\" time=\"%u.%03u\" tests=\"%u\" "
+			"name=\"AsteriskBenchmarks\">\n",
+			failures, time / 1000, time % 1000, count);
+	fprintf(f, "\t<properties>\n");
+	fprintf(f, "\t\t<property name=\"version\" value=\"%s\"/>\n", ast_get_version());
+	fprintf(f, "\t</properties>\n");
+
+	AST_LIST_TRAVERSE(&tests, test, entry) {
+		if (!test->bench || test->state == AST_TEST_NOT_RUN) {
+			continue;
+		}
+		fprintf(f, "\t<testcase time=\"%u.%03u\" name=\"%s%s\">\n",
+			test->time / 1000, test->time % 1000,
+			test->info.category, test->info.name);
+		if (test->state == AST_TEST_FAIL) {
+			fprintf(f, "\t\t<failure><![CDATA[\n%s\n\t\t]]></failure>\n",
+				S_OR(ast_str_buffer(test->status_str), "NA"));
+		} else {
+			fprintf(f, "\t\t<properties>\n");
+			fprintf(f, "\t\t\t<property name=\"iterations\" value=\"%u\"/>\n", test->bench->iterations);
+			fprintf(f, "\t\t\t<property name=\"ns_per_op\" value=\"%.1f\"/>\n", test->bench->ns_per_op);
+			fprintf(f, "\t\t\t<property name=\"ops_per_sec\" value=\"%.0f\"/>\n", test->bench->ops_per_sec);
+			fprintf(f, "\t\t\t<property name=\"p50_ns\" value=\"%.1f\"/>\n", test->bench->p50_ns);
+			fprintf(f, "\t\t\t<property name=\"p90_ns\" value=\"%.1f\"/>\n", test->bench->p90_ns);
+			fprintf(f, "\t\t\t<property name=\"p99_ns\" value=\"%.1f\"/>\n", test->bench->p99_ns);
+			fprintf(f, "\t\t\t<property name=\"max_ns\" value=\"%.1f\"/>\n", test->bench->max_ns);
+			if (test->bench->allocs_per_op >= 0) {
+				fprintf(f, "\t\t\t<property name=\"allocs_per_op\" value=\"%.2f\"/>\n",
+					test->bench->allocs_per_op);
+			}
+			fprintf(f, "\t\t</properties>\n");
+		}
+		fprintf(f, "\t</testcase>\n");
+	}
+
+	fprintf(f, "</testsuite>\n");
+	fclose(f);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Write what the benchmarks measured as JSON
+ *
+ * \note The tests list must be locked.
+ */
+static int bench_generate_json(const char *path)
+{
+	struct ast_json *benchmarks;
+	struct ast_json *report;
+	struct ast_test *test;
+	int res;
+
+	if (!(benchmarks = ast_json_array_create())) {
+		return -1;
+	}
+
+	AST_LIST_TRAVERSE(&tests, test, entry) {
+		struct ast_json *json;
+
+		if (!test->bench || test->state == AST_TEST_NOT_RUN) {
+			continue;
+		}
+		if (test->state == AST_TEST_FAIL) {
+			json = ast_json_pack("{s: s, s: s, s: s, s: i}",
+				"category", test->info.category,
+				"name", test->info.name,
+				"result", test_result2str[test->state],
+				"time_ms", test->time);
+		} else {
+			json = ast_json_pack("{s: s, s: s, s: s, s: i, s: i, s: f, s: f, s: f, s: f, s: f, s: f, s: o}",
+				"category", test->info.category,
+				"name", test->info.name,
+				"result", test_result2str[test->state],
+				"time_ms", test->time,
+				"iterations", test->bench->iterations,
+				"ns_per_op", test->bench->ns_per_op,
+				"ops_per_sec", test->bench->ops_per_sec,
+				"p50_ns", test->bench->p50_ns,
+				"p90_ns", test->bench->p90_ns,
+				"p99_ns", test->bench->p99_ns,
+				"max_ns", test->bench->max_ns,
+				"allocs_per_op", test->bench->allocs_per_op < 0
+					? ast_json_null() : ast_json_real_create(test->bench->allocs_per_op));
+		}
+		if (ast_json_array_append(benchmarks, json)) {
+			ast_json_unref(benchmarks);
+			return -1;
+		}
+	}
+
+	report = ast_json_pack("{s: s, s: o}",
+		"version", ast_get_version(),
+		"benchmarks", benchmarks);
+	if (!report) {
+		return -1;
+	}
+	res = ast_json_dump_new_file_format(report, path, AST_JSON_PRETTY);
+	ast_json_unref(report);
+	if (res) {
+		ast_log(LOG_WARNING, "Could not write benchmark results to %s\n", path);
+	}
+	return res;
+}
+
+static char *bench_cli_generate_results(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	static const char * const option[] = { "json", "junit", NULL };
+	struct ast_str *buf = NULL;
+	const char *file;
+	int isjson;
+	int res;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "bench generate results";
+		e->usage =
+			"Usage: bench generate results {json|junit} [<path>]\n"
+			"       Write what the benchmarks measured the last time they ran\n"
+			"       as JSON or as a JUnit XML report, to the given file or to\n"
+			"       one in the log directory.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 3) {
+			return ast_cli_complete(a->word, option, a->n);
+		}
+		return NULL;
+	}
+
+	if (a->argc < 4 || a->argc > 5) {
+		return CLI_SHOWUSAGE;
+	} else if (!strcmp(a->argv[3], "json")) {
+		isjson = 1;
+	} else if (!strcmp(a->argv[3], "junit")) {
+		isjson = 0;
+	} else {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (a->argc == 5) {
+		file = a->argv[4];
+	} else {
+		if (!(buf = ast_str_create(256))) {
+			return CLI_FAILURE;
+		}
+		ast_str_set(&buf, 0, "%s/asterisk_bench_results-%ld.%s", ast_config_AST_LOG_DIR,
+			(long) ast_tvnow().tv_sec, isjson ? "json" : "xml");
+		file = ast_str_buffer(buf);
+	}
+
+	AST_LIST_LOCK(&tests);
+	res = isjson ? bench_generate_json(file) : bench_generate_junit(file);
+	AST_LIST_UNLOCK(&tests);
+
+	if (!res) {
+		ast_cli(a->fd, "Results Generated Successfully: %s\n", file);
+	} else {
+		ast_cli(a->fd, "Results Could Not Be Generated: %s\n", file);
+	}
+
+	ast_free(buf);
+	return CLI_SUCCESS;
+}
+
 static struct ast_cli_entry test_cli[] = {
 	AST_CLI_DEFINE(test_cli_show_registered,           "show registered tests"),
 	AST_CLI_DEFINE(test_cli_execute_registered,        "execute registered tests"),
 	AST_CLI_DEFINE(test_cli_show_results,              "show last test results"),
 	AST_CLI_DEFINE(test_cli_generate_results,          "generate test results to file"),
+	AST_CLI_DEFINE(bench_cli_execute,                  "execute registered benchmarks"),
+	AST_CLI_DEFINE(bench_cli_show_results,             "show last benchmark results"),
+	AST_CLI_DEFINE(bench_cli_generate_results,         "generate benchmark results to file"),
 };
 
 struct stasis_topic *ast_test_suite_topic(void)
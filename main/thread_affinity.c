@@ -0,0 +1,326 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Thread placement on CPU sets and NUMA nodes.
+ */
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "asterisk/_private.h"
+#include "asterisk/thread_affinity.h"
+#include "asterisk/config.h"
+#include "asterisk/cli.h"
+#include "asterisk/paths.h"
+#include "asterisk/utils.h"
+
+/*! \brief Configuration names of the thread classes, indexed by enum ast_thread_class */
+static const char *thread_class_names[AST_THREAD_CLASS_MAX] = {
+	[AST_THREAD_CLASS_THREADPOOL] = "threadpool",
+	[AST_THREAD_CLASS_MIXING] = "mixing",
+	[AST_THREAD_CLASS_RTP] = "rtp",
+	[AST_THREAD_CLASS_PBX] = "pbx",
+	[AST_THREAD_CLASS_TRANSCODE] = "transcode",
+};
+
+/*! \brief Configured CPU list of each thread class, for display */
+static char *thread_class_cpulists[AST_THREAD_CLASS_MAX];
+
+/*! \brief Non-zero if mixing threads follow their participants */
+static int mixing_follow_participants;
+
+#if defined(__linux__)
+/*! \brief CPUs configured for each thread class */
+static cpu_set_t thread_class_cpus[AST_THREAD_CLASS_MAX];
+/*! \brief Non-zero if CPUs are configured for the thread class */
+static int thread_class_set[AST_THREAD_CLASS_MAX];
+/*! \brief CPUs of each NUMA node */
+static cpu_set_t node_cpus[AST_THREAD_AFFINITY_MAX_NODES];
+/*! \brief Number of NUMA nodes found */
+static int node_count;
+
+/*!
+ * \internal
+ * \brief Parse a CPU list such as "0-3,8,10-11" into a CPU set
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int parse_cpulist(const char *list, cpu_set_t *cpus)
+{
+	char *buf = ast_strdupa(list);
+	char *range;
+	int first;
+	int last;
+	int found = 0;
+
+	CPU_ZERO(cpus);
+	while ((range = strsep(&buf, ","))) {
+		range = ast_strip(range);
+		if (ast_strlen_zero(range)) {
+			continue;
+		}
+		if (sscanf(range, "%30d-%30d", &first, &last) != 2) {
+			if (sscanf(range, "%30d", &first) != 1) {
+				return -1;
+			}
+			last = first;
+		}
+		if (first < 0 || last < first || last >= CPU_SETSIZE) {
+			return -1;
+		}
+		for (; first <= last; ++first) {
+			CPU_SET(first, cpus);
+			found = 1;
+		}
+	}
+
+	return found ? 0 : -1;
+}
+
+/*! \internal \brief Read the CPUs of the NUMA nodes from sysfs */
+static void load_nodes(void)
+{
+	char path[64];
+	char line[1024];
+	FILE *f;
+
+	for (node_count = 0; node_count < AST_THREAD_AFFINITY_MAX_NODES; ++node_count) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node_count);
+		if (!(f = fopen(path, "r"))) {
+			break;
+		}
+		if (!fgets(line, sizeof(line), f) || parse_cpulist(ast_strip(line), &node_cpus[node_count])) {
+			CPU_ZERO(&node_cpus[node_count]);
+		}
+		fclose(f);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Parse the CPUs configured for a thread class
+ *
+ * Besides a CPU list, "node:N" selects all CPUs of NUMA node N.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int parse_class_cpus(const char *value, cpu_set_t *cpus)
+{
+	int node;
+
+	if (!strncasecmp(value, "node:", 5)) {
+		if (sscanf(value + 5, "%30d", &node) != 1 || node < 0 || node >= node_count
+			|| !CPU_COUNT(&node_cpus[node])) {
+			return -1;
+		}
+		CPU_ZERO(cpus);
+		CPU_OR(cpus, cpus, &node_cpus[node]);
+		return 0;
+	}
+
+	return parse_cpulist(value, cpus);
+}
+
+static int set_affinity(const cpu_set_t *cpus)
+{
+	int res;
+
+	res = pthread_setaffinity_np(pthread_self(), sizeof(*cpus), cpus);
+	if (res) {
+		ast_log(LOG_WARNING, "Unable to set thread CPU affinity: %s\n", strerror(res));
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+int ast_thread_affinity_apply(enum ast_thread_class thread_class)
+{
+#if defined(__linux__)
+	if (thread_class < 0 || thread_class >= AST_THREAD_CLASS_MAX || !thread_class_set[thread_class]) {
+		return 0;
+	}
+	return set_affinity(&thread_class_cpus[thread_class]);
+#else
+	return 0;
+#endif
+}
+
+int ast_thread_affinity_apply_node(enum ast_thread_class thread_class, int node)
+{
+#if defined(__linux__)
+	cpu_set_t cpus;
+
+	if (thread_class < 0 || thread_class >= AST_THREAD_CLASS_MAX
+		|| node < 0 || node >= node_count) {
+		return ast_thread_affinity_apply(thread_class);
+	}
+
+	if (thread_class_set[thread_class]) {
+		CPU_AND(&cpus, &thread_class_cpus[thread_class], &node_cpus[node]);
+	} else {
+		CPU_ZERO(&cpus);
+		CPU_OR(&cpus, &cpus, &node_cpus[node]);
+	}
+	if (!CPU_COUNT(&cpus)) {
+		return ast_thread_affinity_apply(thread_class);
+	}
+	return set_affinity(&cpus);
+#else
+	return 0;
+#endif
+}
+
+int ast_thread_affinity_current_node(void)
+{
+#if defined(__linux__)
+	int cpu;
+	int node;
+
+	if (node_count < 2 || (cpu = sched_getcpu()) < 0) {
+		return -1;
+	}
+	for (node = 0; node < node_count; ++node) {
+		if (CPU_ISSET(cpu, &node_cpus[node])) {
+			return node;
+		}
+	}
+#endif
+	return -1;
+}
+
+int ast_thread_affinity_mixing_follows_participants(void)
+{
+	return mixing_follow_participants;
+}
+
+static char *handle_show_thread_affinity(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show thread affinity";
+		e->usage =
+			"Usage: core show thread affinity\n"
+			"       Shows the CPUs each class of threads is placed on.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "%-12s %s\n", "Class", "CPUs");
+	for (i = 0; i < AST_THREAD_CLASS_MAX; ++i) {
+		ast_cli(a->fd, "%-12s %s\n", thread_class_names[i],
+			S_OR(thread_class_cpulists[i], "(any)"));
+	}
+#if defined(__linux__)
+	ast_cli(a->fd, "\nNUMA nodes: %d\n", node_count);
+#endif
+	ast_cli(a->fd, "Mixing threads follow participants: %s\n",
+		AST_CLI_YESNO(mixing_follow_participants));
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_thread_affinity[] = {
+	AST_CLI_DEFINE(handle_show_thread_affinity, "Show thread placement"),
+};
+
+static void thread_affinity_shutdown(void)
+{
+	int i;
+
+	ast_cli_unregister_multiple(cli_thread_affinity, ARRAY_LEN(cli_thread_affinity));
+	for (i = 0; i < AST_THREAD_CLASS_MAX; ++i) {
+		ast_free(thread_class_cpulists[i]);
+		thread_class_cpulists[i] = NULL;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Configure the thread class with the given name
+ */
+static void configure_class(const char *name, const char *value)
+{
+	int i;
+
+	for (i = 0; i < AST_THREAD_CLASS_MAX; ++i) {
+		if (!strcasecmp(name, thread_class_names[i])) {
+			break;
+		}
+	}
+	if (i == AST_THREAD_CLASS_MAX) {
+		ast_log(LOG_WARNING, "Unknown thread class '%s' in [threads] section of %s\n",
+			name, ast_config_AST_CONFIG_FILE);
+		return;
+	}
+
+#if defined(__linux__)
+	if (parse_class_cpus(value, &thread_class_cpus[i])) {
+		ast_log(LOG_WARNING, "Invalid CPUs '%s' for thread class '%s' in %s\n",
+			value, name, ast_config_AST_CONFIG_FILE);
+		return;
+	}
+	thread_class_set[i] = 1;
+	ast_free(thread_class_cpulists[i]);
+	thread_class_cpulists[i] = ast_strdup(value);
+#else
+	ast_log(LOG_WARNING, "Thread placement is not supported on this platform, ignoring '%s'\n", name);
+#endif
+}
+
+int ast_thread_affinity_init(void)
+{
+	struct ast_flags config_flags = { CONFIG_FLAG_NOREALTIME };
+	struct ast_config *cfg;
+	struct ast_variable *v;
+
+#if defined(__linux__)
+	load_nodes();
+#endif
+
+	cfg = ast_config_load2(ast_config_AST_CONFIG_FILE, "" /* core, can't reload */, config_flags);
+	if (cfg && cfg != CONFIG_STATUS_FILEMISSING && cfg != CONFIG_STATUS_FILEINVALID) {
+		for (v = ast_variable_browse(cfg, "threads"); v; v = v->next) {
+			if (!strcasecmp(v->name, "mixing_follow_participants")) {
+				mixing_follow_participants = ast_true(v->value);
+			} else {
+				configure_class(v->name, v->value);
+			}
+		}
+		ast_config_destroy(cfg);
+	}
+
+	ast_cli_register_multiple(cli_thread_affinity, ARRAY_LEN(cli_thread_affinity));
+	ast_register_cleanup(thread_affinity_shutdown);
+
+	return 0;
+}
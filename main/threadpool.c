@@ -19,14 +19,56 @@
 
 #include "asterisk.h"
 
+#include "asterisk/_private.h"
 #include "asterisk/threadpool.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/astobj2.h"
+#include "asterisk/linkedlists.h"
+#include "asterisk/metrics.h"
 #include "asterisk/utils.h"
+#include "asterisk/thread_affinity.h"
 
 /* Needs to stay prime if increased */
 #define THREAD_BUCKETS 89
 
+/*! Number of worker queues for a work-stealing pool with no size hints */
+#define WORKER_QUEUES_DEFAULT 16
+/*! Upper limit on the number of worker queues in a work-stealing pool */
+#define WORKER_QUEUES_MAX 128
+
+/*! Milliseconds between two samples of the queue wait time by the autoscaler */
+#define AUTOSCALE_INTERVAL 1000
+/*! Percentile of the queue wait time the autoscaler compares to its target */
+#define AUTOSCALE_PERCENTILE 99
+
+/*!
+ * \brief A task waiting in a worker queue of a work-stealing threadpool
+ */
+struct worker_task {
+	/*! The task callback */
+	int (*task)(void *data);
+	/*! The data passed to the task callback */
+	void *data;
+	/*! When the task was queued. Only set when the pool autoscales. */
+	struct timeval queued;
+	/*! Next task in the worker queue */
+	AST_LIST_ENTRY(worker_task) next;
+};
+
+/*!
+ * \brief A task queue owned by a worker in a work-stealing threadpool
+ *
+ * Each worker prefers its own queue but any worker may take tasks
+ * from any queue. The queue has its own lock so that pushes and pops
+ * on different queues do not contend with each other.
+ */
+struct worker_queue {
+	/*! Lock protecting the tasks list */
+	ast_mutex_t lock;
+	/*! Queued tasks in FIFO order */
+	AST_LIST_HEAD_NOLOCK(, worker_task) tasks;
+};
+
 /*!
  * \brief An opaque threadpool structure
  *
@@ -98,8 +140,42 @@ struct ast_threadpool {
 	int shutting_down;
 	/*! Threadpool-specific options */
 	struct ast_threadpool_options options;
+	/*!
+	 * \brief Worker queues used in work-stealing mode
+	 *
+	 * When the pool is in work-stealing mode, tasks pushed into the
+	 * pool bypass the main taskprocessor and are placed directly in
+	 * one of these queues. NULL if work stealing is disabled.
+	 */
+	struct worker_queue *queues;
+	/*! Number of entries in the queues array */
+	unsigned int num_queues;
+	/*! Round-robin counter for tasks pushed from outside the pool */
+	int next_queue;
+	/*! Total number of tasks waiting in the worker queues */
+	int queued_tasks;
+	/*! Histogram of the time tasks waited in the worker queues (autoscaling only) */
+	int queue_wait[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	/*! Queue wait histogram at the previous autoscaler sample */
+	unsigned int autoscale_wait[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	/*! When the autoscaler takes its next sample */
+	struct timeval autoscale_next;
+	/*! When the autoscaler last changed the size of the pool */
+	struct timeval autoscale_resized;
+	/*! Non-zero while an autoscaler sample is queued on the control taskprocessor */
+	int autoscale_queued;
+	/*! Entry in the list of threadpools that have not been shut down */
+	AST_RWLIST_ENTRY(ast_threadpool) entry;
 };
 
+/*!
+ * \brief Threadpools that have not been shut down, for the metrics
+ *
+ * The list does not hold references. A pool is removed when it is shut
+ * down, before its taskprocessors are released.
+ */
+static AST_RWLIST_HEAD_STATIC(threadpools, ast_threadpool);
+
 /*!
  * \brief listener for a threadpool
  *
@@ -157,8 +233,13 @@ struct worker_thread {
 	int wake_up;
 	/*! Options for this threadpool */
 	struct ast_threadpool_options options;
+	/*! Index of the worker queue this worker prefers (work-stealing mode only) */
+	unsigned int queue;
 };
 
+/*! The worker thread running on the current thread, if any */
+AST_THREADSTORAGE_RAW(current_worker);
+
 /* Worker thread forward declarations. See definitions for documentation */
 static int worker_thread_hash(const void *obj, int flags);
 static int worker_thread_cmp(void *obj, void *arg, int flags);
@@ -170,6 +251,9 @@ static int worker_thread_start(struct worker_thread *worker);
 static int worker_idle(struct worker_thread *worker);
 static int worker_set_state(struct worker_thread *worker, enum worker_state state);
 static void worker_shutdown(struct worker_thread *worker);
+static int activate_thread(void *obj, void *arg, int flags);
+static void threadpool_emptied(struct ast_threadpool *pool);
+static void threadpool_autoscale(struct ast_threadpool *pool);
 
 /*!
  * \brief Notify the threadpool listener that the state has changed.
@@ -238,7 +322,17 @@ static int queued_active_thread_idle(void *data)
 	ao2_link(pair->pool->idle_threads, pair->worker);
 	ao2_unlink(pair->pool->active_threads, pair->worker);
 
+	/* In work-stealing mode a task may have been queued after the worker
+	 * found its queues empty but before it became idle. Wake an idle
+	 * thread back up so that the task does not sit waiting for the next push.
+	 */
+	if (pair->pool->queues && pair->pool->queued_tasks > 0) {
+		ao2_callback(pair->pool->idle_threads, OBJ_UNLINK | OBJ_NOLOCK | OBJ_NODATA,
+				activate_thread, pair->pool);
+	}
+
 	threadpool_send_state_changed(pair->pool);
+	threadpool_autoscale(pair->pool);
 
 	ao2_ref(pair, -1);
 	return 0;
@@ -354,6 +448,73 @@ static int threadpool_execute(struct ast_threadpool *pool)
 	return 0;
 }
 
+/*!
+ * \brief Remove the oldest task from a worker queue
+ *
+ * \param queue The queue to take a task from
+ * \retval NULL The queue is empty
+ * \retval non-NULL The task
+ */
+static struct worker_task *worker_queue_pop(struct worker_queue *queue)
+{
+	struct worker_task *task;
+
+	/* Unlocked peek so idle scans of empty queues stay cheap */
+	if (AST_LIST_EMPTY(&queue->tasks)) {
+		return NULL;
+	}
+
+	ast_mutex_lock(&queue->lock);
+	task = AST_LIST_REMOVE_HEAD(&queue->tasks, next);
+	ast_mutex_unlock(&queue->lock);
+	return task;
+}
+
+/*!
+ * \brief Execute a task from the worker queues of a work-stealing threadpool
+ *
+ * The worker first looks at its own queue. If that is empty, it steals a task
+ * from the queue of another worker.
+ *
+ * The shutting_down flag is read without the pool lock here. It only
+ * ever transitions from zero to non-zero, and taking the pool lock for
+ * every task would defeat the purpose of having separate queues.
+ *
+ * \param worker The worker that executes the task
+ * \retval 0 Either the pool has been shut down or there are no tasks.
+ * \retval 1 A task was executed and there may be more.
+ */
+static int threadpool_execute_queued(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+	struct worker_task *task = NULL;
+	unsigned int i;
+
+	if (pool->shutting_down) {
+		return 0;
+	}
+
+	for (i = 0; i < pool->num_queues && !task; ++i) {
+		task = worker_queue_pop(&pool->queues[(worker->queue + i) % pool->num_queues]);
+	}
+	if (!task) {
+		return 0;
+	}
+
+	if (ast_atomic_fetchadd_int(&pool->queued_tasks, -1) == 1) {
+		threadpool_emptied(pool);
+	}
+
+	if (pool->options.autoscale_target_wait > 0) {
+		ast_atomic_fetchadd_int(&pool->queue_wait[ast_taskprocessor_histogram_bucket(
+			ast_tvdiff_us(ast_tvnow(), task->queued))], 1);
+	}
+
+	task->task(task->data);
+	ast_free(task);
+	return 1;
+}
+
 /*!
  * \brief Destroy a threadpool's components.
  *
@@ -370,7 +531,18 @@ static int threadpool_execute(struct ast_threadpool *pool)
 static void threadpool_destructor(void *obj)
 {
 	struct ast_threadpool *pool = obj;
+	struct worker_task *task;
+	unsigned int i;
+
 	ao2_cleanup(pool->listener);
+
+	for (i = 0; i < pool->num_queues; ++i) {
+		while ((task = AST_LIST_REMOVE_HEAD(&pool->queues[i].tasks, next))) {
+			ast_free(task);
+		}
+		ast_mutex_destroy(&pool->queues[i].lock);
+	}
+	ast_free(pool->queues);
 }
 
 /*
@@ -417,6 +589,24 @@ static struct ast_threadpool *threadpool_alloc(const char *name, const struct as
 		return NULL;
 	}
 	pool->options = *options;
+	pool->autoscale_next = ast_tvadd(ast_tvnow(), ast_samp2tv(AUTOSCALE_INTERVAL, 1000));
+
+	if (options->work_stealing) {
+		unsigned int i;
+
+		/* Aim for one queue per worker the pool may ever have */
+		pool->num_queues = options->max_size > 0 ? options->max_size
+			: MAX(options->initial_size, WORKER_QUEUES_DEFAULT);
+		pool->num_queues = MIN(pool->num_queues, WORKER_QUEUES_MAX);
+		pool->queues = ast_calloc(pool->num_queues, sizeof(*pool->queues));
+		if (!pool->queues) {
+			pool->num_queues = 0;
+			return NULL;
+		}
+		for (i = 0; i < pool->num_queues; ++i) {
+			ast_mutex_init(&pool->queues[i].lock);
+		}
+	}
 
 	ao2_ref(pool, +1);
 	return pool;
@@ -565,6 +755,7 @@ static int queued_task_pushed(void *data)
 	/* If no idle threads could be transitioned to active grow the pool as permitted. */
 	if (ao2_container_count(pool->active_threads) == existing_active) {
 		if (!pool->options.auto_increment) {
+			threadpool_autoscale(pool);
 			ao2_ref(tpd, -1);
 			return 0;
 		}
@@ -575,23 +766,21 @@ static int queued_task_pushed(void *data)
 	}
 
 	threadpool_send_state_changed(pool);
+	threadpool_autoscale(pool);
 	ao2_ref(tpd, -1);
 	return 0;
 }
 
 /*!
- * \brief Taskprocessor listener callback called when a task is added
+ * \brief Queue the handling of a newly pushed task
  *
- * The threadpool uses this opportunity to queue a task on its control taskprocessor
- * in order to activate idle threads and notify the threadpool listener that the
- * task has been pushed.
- * \param listener The taskprocessor listener. The threadpool is the listener's private data
- * \param was_empty True if the taskprocessor was empty prior to the task being pushed
+ * A task is queued on the control taskprocessor in order to activate idle
+ * threads and notify the threadpool listener that the task has been pushed.
+ * \param pool The threadpool that had a task pushed
+ * \param was_empty True if the threadpool was empty prior to the task being pushed
  */
-static void threadpool_tps_task_pushed(struct ast_taskprocessor_listener *listener,
-		int was_empty)
+static void threadpool_task_pushed(struct ast_threadpool *pool, int was_empty)
 {
-	struct ast_threadpool *pool = ast_taskprocessor_listener_get_user_data(listener);
 	struct task_pushed_data *tpd;
 	SCOPED_AO2LOCK(lock, pool);
 
@@ -606,6 +795,21 @@ static void threadpool_tps_task_pushed(struct ast_taskprocessor_listener *listen
 	ast_taskprocessor_push(pool->control_tps, queued_task_pushed, tpd);
 }
 
+/*!
+ * \brief Taskprocessor listener callback called when a task is added
+ *
+ * The threadpool uses this opportunity to queue a task on its control taskprocessor
+ * in order to activate idle threads and notify the threadpool listener that the
+ * task has been pushed.
+ * \param listener The taskprocessor listener. The threadpool is the listener's private data
+ * \param was_empty True if the taskprocessor was empty prior to the task being pushed
+ */
+static void threadpool_tps_task_pushed(struct ast_taskprocessor_listener *listener,
+		int was_empty)
+{
+	threadpool_task_pushed(ast_taskprocessor_listener_get_user_data(listener), was_empty);
+}
+
 /*!
  * \brief Queued task that handles the case where the threadpool's taskprocessor is emptied
  *
@@ -623,15 +827,14 @@ static int queued_emptied(void *data)
 }
 
 /*!
- * \brief Taskprocessor listener emptied callback
+ * \brief Queue a notification that the threadpool has become empty
  *
  * The threadpool queues a task to let the threadpool listener know that
  * the threadpool no longer contains any tasks.
- * \param listener The taskprocessor listener. The threadpool is the listener's private data.
+ * \param pool The threadpool that has become empty
  */
-static void threadpool_tps_emptied(struct ast_taskprocessor_listener *listener)
+static void threadpool_emptied(struct ast_threadpool *pool)
 {
-	struct ast_threadpool *pool = ast_taskprocessor_listener_get_user_data(listener);
 	SCOPED_AO2LOCK(lock, pool);
 
 	if (pool->shutting_down) {
@@ -643,6 +846,16 @@ static void threadpool_tps_emptied(struct ast_taskprocessor_listener *listener)
 	}
 }
 
+/*!
+ * \brief Taskprocessor listener emptied callback
+ *
+ * \param listener The taskprocessor listener. The threadpool is the listener's private data.
+ */
+static void threadpool_tps_emptied(struct ast_taskprocessor_listener *listener)
+{
+	threadpool_emptied(ast_taskprocessor_listener_get_user_data(listener));
+}
+
 /*!
  * \brief Taskprocessor listener shutdown callback
  *
@@ -772,6 +985,184 @@ static void shrink(struct ast_threadpool *pool, int delta)
 			zombify_threads, pool, &active_threads_to_zombify);
 }
 
+/*!
+ * \brief Estimate a percentile of a latency histogram
+ *
+ * The estimate interpolates linearly within the bucket the percentile
+ * falls in. Times in the last bucket, which has no upper bound, are
+ * assumed to be ten times its lower bound.
+ *
+ * \param histogram The number of samples in each bucket
+ * \param samples The total number of samples
+ * \param percent The percentile to estimate
+ * \return The estimated latency in microseconds
+ */
+static int64_t latency_percentile(const unsigned int *histogram, unsigned int samples, int percent)
+{
+	unsigned int rank = (samples * (uint64_t) percent + 99) / 100;
+	unsigned int count = 0;
+	int64_t lower = 0;
+	int64_t upper;
+	int bucket;
+
+	for (bucket = 0; bucket < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++bucket) {
+		upper = ast_taskprocessor_histogram_bucket_limit(bucket);
+		if (upper < 0) {
+			upper = lower * 10;
+		}
+		if (count + histogram[bucket] >= rank) {
+			return lower + (upper - lower) * (rank - count) / histogram[bucket];
+		}
+		count += histogram[bucket];
+		lower = upper;
+	}
+	return lower;
+}
+
+/*!
+ * \brief Resize the threadpool based on how long tasks wait to execute
+ *
+ * Once every AUTOSCALE_INTERVAL the wait times of the tasks executed since
+ * the previous sample are examined. If the AUTOSCALE_PERCENTILE percentile
+ * is above the target the pool grows by a quarter of its size. If it is
+ * below half of the target and threads are idle the pool shrinks by a
+ * single thread. The pool is resized at most once per cooldown period so
+ * growing quickly and shrinking slowly does not make it thrash.
+ *
+ * This function is called from the threadpool control taskprocessor thread.
+ *
+ * \param pool The threadpool to resize
+ */
+static void threadpool_autoscale(struct ast_threadpool *pool)
+{
+	struct ast_taskprocessor_latency latency;
+	unsigned int wait[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	unsigned int samples = 0;
+	struct timeval now;
+	int64_t target;
+	int64_t percentile;
+	int current_size;
+	int idle_size;
+	long queued;
+	int delta = 0;
+	int i;
+
+	if (pool->options.autoscale_target_wait <= 0) {
+		return;
+	}
+
+	now = ast_tvnow();
+	if (ast_tvcmp(now, pool->autoscale_next) < 0) {
+		return;
+	}
+	pool->autoscale_next = ast_tvadd(now, ast_samp2tv(AUTOSCALE_INTERVAL, 1000));
+
+	if (pool->queues) {
+		for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+			wait[i] = ast_atomic_fetchadd_int(&pool->queue_wait[i], 0);
+		}
+		queued = pool->queued_tasks;
+	} else {
+		if (ast_taskprocessor_latency_get(pool->tps, &latency)) {
+			return;
+		}
+		for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+			wait[i] = latency.wait[i];
+		}
+		queued = ast_taskprocessor_size(pool->tps);
+	}
+
+	/* Only look at the tasks executed since the previous sample */
+	for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+		unsigned int total = wait[i];
+
+		wait[i] = total - pool->autoscale_wait[i];
+		pool->autoscale_wait[i] = total;
+		samples += wait[i];
+	}
+
+	if (pool->options.autoscale_cooldown > 0
+		&& ast_tvdiff_ms(now, pool->autoscale_resized) < pool->options.autoscale_cooldown * 1000) {
+		return;
+	}
+
+	current_size = ao2_container_count(pool->active_threads) +
+		ao2_container_count(pool->idle_threads);
+	idle_size = ao2_container_count(pool->idle_threads);
+	target = pool->options.autoscale_target_wait * 1000;
+	percentile = samples ? latency_percentile(wait, samples, AUTOSCALE_PERCENTILE) : 0;
+
+	if (current_size < pool->options.autoscale_min_size) {
+		delta = pool->options.autoscale_min_size - current_size;
+	} else if (percentile > target || (!current_size && queued > 0)) {
+		delta = MAX(1, current_size / 4);
+	} else if (percentile < target / 2 && idle_size
+		&& current_size > pool->options.autoscale_min_size) {
+		delta = -1;
+	}
+
+	if (delta > 0 && pool->options.max_size
+		&& current_size + delta > pool->options.max_size) {
+		delta = pool->options.max_size - current_size;
+	}
+	if (!delta) {
+		return;
+	}
+
+	ast_debug(3, "Autoscaling threadpool %s from %d to %d threads, p%d wait %" PRId64 "us over %u tasks\n",
+		ast_taskprocessor_name(pool->tps), current_size, current_size + delta,
+		AUTOSCALE_PERCENTILE, percentile, samples);
+
+	if (delta > 0) {
+		grow(pool, delta);
+		ao2_callback(pool->idle_threads, OBJ_UNLINK | OBJ_NOLOCK | OBJ_NODATA | OBJ_MULTIPLE,
+				activate_thread, pool);
+	} else {
+		shrink(pool, -delta);
+	}
+	pool->autoscale_resized = now;
+	threadpool_send_state_changed(pool);
+}
+
+/*!
+ * \brief Queued task that lets the autoscaler take a sample
+ *
+ * \param data The threadpool
+ * \return 0
+ */
+static int queued_autoscale(void *data)
+{
+	struct ast_threadpool *pool = data;
+
+	pool->autoscale_queued = 0;
+	threadpool_autoscale(pool);
+	ao2_ref(pool, -1);
+	return 0;
+}
+
+/*!
+ * \brief Queue an autoscaler sample if one is due
+ *
+ * Pushing a task into a work-stealing pool does not always involve the
+ * control taskprocessor so the autoscaler has to be poked explicitly.
+ *
+ * \param pool The threadpool that had a task pushed
+ */
+static void threadpool_autoscale_poke(struct ast_threadpool *pool)
+{
+	if (pool->options.autoscale_target_wait <= 0
+		|| ast_tvcmp(ast_tvnow(), pool->autoscale_next) < 0
+		|| ast_atomic_fetchadd_int(&pool->autoscale_queued, 1)) {
+		return;
+	}
+
+	ao2_ref(pool, +1);
+	if (ast_taskprocessor_push(pool->control_tps, queued_autoscale, pool)) {
+		pool->autoscale_queued = 0;
+		ao2_ref(pool, -1);
+	}
+}
+
 /*!
  * \brief Helper struct used for queued operations that change the size of the threadpool
  */
@@ -917,17 +1308,93 @@ struct ast_threadpool *ast_threadpool_create(const char *name,
 		pool->listener = listener;
 	}
 	ast_threadpool_set_size(pool, pool->options.initial_size);
+
+	AST_RWLIST_WRLOCK(&threadpools);
+	AST_RWLIST_INSERT_TAIL(&threadpools, pool, entry);
+	AST_RWLIST_UNLOCK(&threadpools);
+
 	ao2_ref(pool, +1);
 	return pool;
 }
 
+/*!
+ * \brief Push a task into the worker queues of a work-stealing threadpool
+ *
+ * Tasks pushed from one of the pool's own worker threads go to that
+ * worker's queue. Other tasks are spread across the queues round-robin.
+ *
+ * The control taskprocessor is only involved when it has something to do:
+ * when the pool was empty, when there are idle threads to wake up, or when
+ * the pool is still allowed to grow.
+ *
+ * \param pool The threadpool to add the task to
+ * \param task The task to add
+ * \param data The parameter for the task
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int threadpool_push_queued(struct ast_threadpool *pool, int (*task)(void *data), void *data)
+{
+	struct worker_thread *worker = ast_threadstorage_get_ptr(&current_worker);
+	struct worker_queue *queue;
+	struct worker_task *t;
+	int was_empty;
+	int size;
+
+	/* See threadpool_execute_queued() for why this is read unlocked */
+	if (pool->shutting_down) {
+		return -1;
+	}
+
+	t = ast_calloc(1, sizeof(*t));
+	if (!t) {
+		return -1;
+	}
+	t->task = task;
+	t->data = data;
+	if (pool->options.autoscale_target_wait > 0) {
+		t->queued = ast_tvnow();
+	}
+
+	if (worker && worker->pool == pool) {
+		queue = &pool->queues[worker->queue];
+	} else {
+		queue = &pool->queues[(unsigned int) ast_atomic_fetchadd_int(&pool->next_queue, 1)
+			% pool->num_queues];
+	}
+
+	/* Count the task before it becomes visible so the count never goes negative */
+	was_empty = ast_atomic_fetchadd_int(&pool->queued_tasks, 1) == 0;
+
+	ast_mutex_lock(&queue->lock);
+	AST_LIST_INSERT_TAIL(&queue->tasks, t, next);
+	ast_mutex_unlock(&queue->lock);
+
+	size = ao2_container_count(pool->active_threads) + ao2_container_count(pool->idle_threads);
+	if (was_empty || ao2_container_count(pool->idle_threads)
+		|| (pool->options.auto_increment
+			&& (!pool->options.max_size || size < pool->options.max_size))) {
+		threadpool_task_pushed(pool, was_empty);
+	} else {
+		threadpool_autoscale_poke(pool);
+	}
+	return 0;
+}
+
 int ast_threadpool_push(struct ast_threadpool *pool, int (*task)(void *data), void *data)
 {
-	SCOPED_AO2LOCK(lock, pool);
+	int res = -1;
+
+	if (pool->queues) {
+		return threadpool_push_queued(pool, task, data);
+	}
+
+	ao2_lock(pool);
 	if (!pool->shutting_down) {
-		return ast_taskprocessor_push(pool->tps, task, data);
+		res = ast_taskprocessor_push(pool->tps, task, data);
 	}
-	return -1;
+	ao2_unlock(pool);
+	return res;
 }
 
 void ast_threadpool_shutdown(struct ast_threadpool *pool)
@@ -935,6 +1402,11 @@ void ast_threadpool_shutdown(struct ast_threadpool *pool)
 	if (!pool) {
 		return;
 	}
+
+	AST_RWLIST_WRLOCK(&threadpools);
+	AST_RWLIST_REMOVE(&threadpools, pool, entry);
+	AST_RWLIST_UNLOCK(&threadpools);
+
 	/* Shut down the taskprocessors and everything else just
 	 * takes care of itself via the taskprocessor callbacks
 	 */
@@ -1013,6 +1485,9 @@ static void *worker_start(void *arg)
 {
 	struct worker_thread *worker = arg;
 
+	ast_threadstorage_set_ptr(&current_worker, worker);
+	ast_thread_affinity_apply(AST_THREAD_CLASS_THREADPOOL);
+
 	if (worker->options.thread_start) {
 		worker->options.thread_start();
 	}
@@ -1069,6 +1544,9 @@ static struct worker_thread *worker_thread_alloc(struct ast_threadpool *pool)
 	worker->thread = AST_PTHREADT_NULL;
 	worker->state = ALIVE;
 	worker->options = pool->options;
+	if (pool->num_queues) {
+		worker->queue = worker->id % pool->num_queues;
+	}
 	return worker;
 }
 
@@ -1100,7 +1578,11 @@ static void worker_active(struct worker_thread *worker)
 	 * optimize the code away.
 	 */
 	do {
-		alive = threadpool_execute(worker->pool);
+		if (worker->pool->queues) {
+			alive = threadpool_execute_queued(worker);
+		} else {
+			alive = threadpool_execute(worker->pool);
+		}
 	} while (alive);
 }
 
@@ -1400,5 +1882,59 @@ struct ast_taskprocessor *ast_threadpool_serializer(const char *name, struct ast
 
 long ast_threadpool_queue_size(struct ast_threadpool *pool)
 {
+	if (pool->queues) {
+		return pool->queued_tasks;
+	}
 	return ast_taskprocessor_size(pool->tps);
 }
+
+static long threadpool_metric_active(struct ast_threadpool *pool)
+{
+	return ao2_container_count(pool->active_threads);
+}
+
+static long threadpool_metric_idle(struct ast_threadpool *pool)
+{
+	return ao2_container_count(pool->idle_threads);
+}
+
+/*!
+ * \internal
+ * \brief Write one metric family with a sample for each threadpool
+ *
+ * \note Must be called with the threadpools list locked
+ */
+static void threadpool_metrics_family(struct ast_metrics_output *out, const char *name,
+	const char *help, long (*value)(struct ast_threadpool *pool))
+{
+	struct ast_threadpool *pool;
+
+	ast_metrics_output_family(out, name, AST_METRIC_GAUGE, help);
+	AST_RWLIST_TRAVERSE(&threadpools, pool, entry) {
+		ast_metrics_output_sample(out, name, "pool", ast_taskprocessor_name(pool->tps), value(pool));
+	}
+}
+
+static void threadpool_metrics_collect(struct ast_metrics_output *out)
+{
+	AST_RWLIST_RDLOCK(&threadpools);
+	threadpool_metrics_family(out, "asterisk_threadpool_active_threads",
+		"Threads of the threadpool running tasks", threadpool_metric_active);
+	threadpool_metrics_family(out, "asterisk_threadpool_idle_threads",
+		"Threads of the threadpool waiting for tasks", threadpool_metric_idle);
+	threadpool_metrics_family(out, "asterisk_threadpool_queued_tasks",
+		"Tasks waiting for a thread of the threadpool", ast_threadpool_queue_size);
+	AST_RWLIST_UNLOCK(&threadpools);
+}
+
+static void threadpool_shutdown(void)
+{
+	ast_metrics_collector_unregister(threadpool_metrics_collect);
+}
+
+int ast_threadpool_init(void)
+{
+	ast_register_cleanup(threadpool_shutdown);
+
+	return ast_metrics_collector_register("threadpool", threadpool_metrics_collect);
+}
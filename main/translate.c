@@ -34,6 +34,11 @@ ASTERISK_REGISTER_FILE()
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <math.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 #include "asterisk/lock.h"
 #include "asterisk/channel.h"
@@ -45,6 +50,11 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/term.h"
 #include "asterisk/format.h"
 #include "asterisk/linkedlists.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/config.h"
+#include "asterisk/paths.h"
+#include "asterisk/probes.h"
+#include "asterisk/thread_affinity.h"
 
 /*! \todo
  * TODO: sample frames for each supported input format.
@@ -55,6 +65,97 @@ ASTERISK_REGISTER_FILE()
 /*! max sample recalc */
 #define MAX_RECALC 1000
 
+/*! \brief Most idle instances kept for reuse by each translator */
+#define TRANSLATOR_POOL_MAX 32
+
+/*! \brief Protects the pool of every translator */
+AST_MUTEX_DEFINE_STATIC(pool_lock);
+
+/*! \brief Computational cost of a translator that has not been measured yet */
+#define UNMEASURED_COST 999999
+
+/*! \brief Measure costs by the time of the measuring thread alone, if possible */
+#ifdef RUSAGE_THREAD
+#define COST_RUSAGE RUSAGE_THREAD
+#else
+#define COST_RUSAGE RUSAGE_SELF
+#endif
+
+/*! \brief Shortest CPU time a translator is benchmarked for, in nanoseconds */
+#define BENCH_MIN_NS 50000000
+
+/*! \brief Seconds of audio 'core benchmark codecs' translates by default */
+#define BENCH_DEFAULT_SECONDS 10
+
+/*! \brief Measures computational costs in the background */
+static struct ast_taskprocessor *cost_tps;
+
+/*!
+ * \brief Held while a cost is measured, so a translator being
+ * unregistered can wait for its measurement to finish
+ */
+AST_MUTEX_DEFINE_STATIC(cost_lock);
+
+/*! \brief Most transcoding worker threads */
+#define TRANSCODE_MAX_WORKERS 64
+
+/*! \brief Default latency budget of the transcoding service, in milliseconds */
+#define TRANSCODE_DEFAULT_BUDGET 10
+
+/*! \brief Default most frames a transcoding worker translates at once */
+#define TRANSCODE_DEFAULT_BATCH 16
+
+/*! \brief A frame handed to the transcoding service */
+struct transcode_job {
+	/*! The path translating the frame */
+	struct ast_trans_pvt *path;
+	/*! The frame to translate, owned by the job */
+	struct ast_frame *in;
+	/*! The translated frames, owned by the job until collected */
+	struct ast_frame *out;
+	/*! When the job was queued */
+	struct timeval queued;
+	/*! Non-zero once the frame has been translated */
+	int done;
+	AST_LIST_ENTRY(transcode_job) list;
+};
+
+/*! \brief Frames waiting for a transcoding worker */
+static AST_LIST_HEAD_NOLOCK_STATIC(transcode_queue, transcode_job);
+
+/*! \brief Protects the transcoding queue and the jobs on it */
+AST_MUTEX_DEFINE_STATIC(transcode_lock);
+
+/*! \brief Signalled when frames are queued for the transcoding workers */
+static ast_cond_t transcode_cond;
+
+/*! \brief Signalled when the transcoding workers finish a frame */
+static ast_cond_t transcode_done_cond;
+
+/*! \brief The transcoding worker threads */
+static pthread_t *transcode_threads;
+
+/*! \brief Number of transcoding workers running, 0 if the service is disabled */
+static int transcode_workers;
+
+/*! \brief Set when the transcoding workers are told to finish */
+static int transcode_stopping;
+
+/*! \brief How long a frame may take on the transcoding service, in milliseconds */
+static int transcode_budget = TRANSCODE_DEFAULT_BUDGET;
+
+/*! \brief Most frames a transcoding worker translates at once */
+static int transcode_batch = TRANSCODE_DEFAULT_BATCH;
+
+/*! \brief Frames translated by the transcoding service */
+static uint64_t transcode_frames;
+
+/*! \brief Batches translated by the transcoding service */
+static uint64_t transcode_batches;
+
+/*! \brief Paths that missed the latency budget and went back to inline translation */
+static uint64_t transcode_fallbacks;
+
 /*! \brief the list of translators */
 static AST_RWLIST_HEAD_STATIC(translators, ast_translator);
 
@@ -97,7 +198,33 @@ static int cur_max_index;
 /*! the largest index that can be used in either the __indextable or __matrix before resize must occur */
 static int index_size;
 
-static void matrix_rebuild(int samples);
+static void matrix_rebuild(void);
+
+/*! \brief Number of entries in the cache of best choices */
+#define BEST_CHOICE_CACHE_SIZE 256
+
+/*!
+ * \brief Best choice of formats between two interned capabilities
+ *
+ * \see ast_translator_best_choice()
+ */
+struct best_choice_entry {
+	/*! Intern identifier of the destination capabilities, 0 if the entry is unused */
+	unsigned int dst_id;
+	/*! Intern identifier of the source capabilities */
+	unsigned int src_id;
+	/*! Generation of the matrix the choice was made with */
+	int generation;
+	struct ast_format *dst;
+	struct ast_format *src;
+};
+
+/*! \brief Direct mapped cache of best choices, protected by best_choice_lock */
+static struct best_choice_entry best_choice_cache[BEST_CHOICE_CACHE_SIZE];
+AST_MUTEX_DEFINE_STATIC(best_choice_lock);
+
+/*! \brief Incremented whenever the matrix is rebuilt, to forget the best choices */
+static int matrix_generation;
 
 /*!
  * \internal
@@ -241,7 +368,7 @@ static int matrix_resize(int init)
 	__matrix = tmp_matrix;
 	__indextable = tmp_table;
 
-	matrix_rebuild(0);
+	matrix_rebuild();
 	ast_rwlock_unlock(&tablelock);
 	AST_RWLIST_UNLOCK(&translators);
 
@@ -394,6 +521,105 @@ static struct ast_trans_pvt *newpvt(struct ast_translator *t, struct ast_format
 	return pvt;
 }
 
+/*!
+ * \brief Take an idle instance of a translator from its pool
+ *
+ * \note Must be called with the translators list locked, so the
+ * translator cannot be unregistered meanwhile.
+ */
+static struct ast_trans_pvt *pool_get(struct ast_translator *t, struct ast_format *explicit_dst)
+{
+	struct ast_trans_pvt **prev;
+	struct ast_trans_pvt *pvt;
+
+	ast_mutex_lock(&pool_lock);
+	for (prev = &t->pool; (pvt = *prev); prev = &pvt->next) {
+		/* The output format of an instance may depend on the negotiated attributes */
+		if (pvt->explicit_dst == explicit_dst
+			|| (pvt->explicit_dst && explicit_dst
+				&& ast_format_cmp(pvt->explicit_dst, explicit_dst) == AST_FORMAT_CMP_EQUAL)) {
+			*prev = pvt->next;
+			pvt->next = NULL;
+			t->pool_size--;
+			break;
+		}
+	}
+	ast_mutex_unlock(&pool_lock);
+
+	if (pvt) {
+		ast_module_ref(t->module);
+	}
+
+	return pvt;
+}
+
+/*!
+ * \brief Keep an instance for reuse if its translator can reset it
+ *
+ * \retval 0 if the instance was put in the pool
+ * \retval -1 if it must be destroyed
+ */
+static int pool_put(struct ast_trans_pvt *pvt)
+{
+	struct ast_translator *t = pvt->t;
+
+	if (!t->reset || t->pool_size >= TRANSLATOR_POOL_MAX || t->reset(pvt)) {
+		return -1;
+	}
+
+	pvt->samples = 0;
+	pvt->datalen = 0;
+	pvt->nextin = pvt->nextout = ast_tv(0, 0);
+	pvt->f.flags = 0;
+	pvt->f.ts = 0;
+	pvt->f.len = 0;
+	pvt->f.seqno = 0;
+	pvt->f.samples = 0;
+	pvt->f.datalen = 0;
+	pvt->f.delivery = ast_tv(0, 0);
+	pvt->offload_inline = 0;
+
+	ast_mutex_lock(&pool_lock);
+	if (t->pool_size >= TRANSLATOR_POOL_MAX) {
+		ast_mutex_unlock(&pool_lock);
+		return -1;
+	}
+	pvt->next = t->pool;
+	t->pool = pvt;
+	t->pool_size++;
+	ast_mutex_unlock(&pool_lock);
+
+	/* Idle instances must not keep the module loaded; unregistering drains them */
+	ast_module_unref(t->module);
+
+	return 0;
+}
+
+/*!
+ * \brief Destroy the idle instances of a translator
+ *
+ * \note Idle instances hold no module reference, so they are freed
+ * without dropping one.
+ */
+static void pool_drain(struct ast_translator *t)
+{
+	struct ast_trans_pvt *pvt;
+
+	ast_mutex_lock(&pool_lock);
+	pvt = t->pool;
+	t->pool = NULL;
+	t->pool_size = 0;
+	ast_mutex_unlock(&pool_lock);
+
+	while (pvt) {
+		struct ast_trans_pvt *next = pvt->next;
+
+		ast_module_ref(t->module);
+		destroy(pvt);
+		pvt = next;
+	}
+}
+
 /*! \brief framein wrapper, deals with bound checks.  */
 static int framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 {
@@ -423,6 +649,31 @@ static int framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 	return pvt->t->framein(pvt, f);
 }
 
+/*!
+ * \internal
+ * \brief Feed a frame to a step of a path, counting the time it takes if tracked
+ */
+static void framein_usage(struct ast_trans_pvt *pvt, struct ast_frame *f)
+{
+	struct ast_translator *t = pvt->t;
+	struct timespec start;
+	struct timespec end;
+
+	if (!t->track_usage) {
+		framein(pvt, f);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	framein(pvt, f);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	__sync_fetch_and_add(&t->usage_frames, 1);
+	__sync_fetch_and_add(&t->usage_samples, f->samples);
+	__sync_fetch_and_add(&t->usage_ns,
+		(end.tv_sec - start.tv_sec) * 1000000000LL + end.tv_nsec - start.tv_nsec);
+}
+
 /*! \brief generic frameout routine.
  * If samples and datalen are 0, take whatever is in pvt
  * and reset them, otherwise take the values in the caller and
@@ -459,12 +710,33 @@ static struct ast_frame *default_frameout(struct ast_trans_pvt *pvt)
 
 /* end of callback wrappers and helpers */
 
+static struct ast_frame *transcode_collect(struct ast_trans_pvt *path, int budget);
+
 void ast_translator_free_path(struct ast_trans_pvt *p)
 {
 	struct ast_trans_pvt *pn = p;
+
+	if (p && p->offload) {
+		struct ast_frame *out = transcode_collect(p, 0);
+
+		if (out) {
+			ast_frfree(out);
+		}
+	}
 	while ( (p = pn) ) {
 		pn = p->next;
-		destroy(p);
+		if (pool_put(p)) {
+			destroy(p);
+		}
+	}
+}
+
+void ast_translator_set_quality(struct ast_trans_pvt *path, unsigned int quality)
+{
+	for (; path; path = path->next) {
+		if (path->t->set_quality) {
+			path->t->set_quality(path, quality);
+		}
 	}
 }
 
@@ -497,7 +769,7 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct a
 		if ((t->dst_codec.sample_rate == ast_format_get_sample_rate(dst)) && (t->dst_codec.type == ast_format_get_type(dst)) && (!strcmp(t->dst_codec.name, ast_format_get_name(dst)))) {
 			explicit_dst = dst;
 		}
-		if (!(cur = newpvt(t, explicit_dst))) {
+		if (!(cur = pool_get(t, explicit_dst)) && !(cur = newpvt(t, explicit_dst))) {
 			ast_log(LOG_WARNING, "Failed to build translator step from %s to %s\n",
 				ast_format_get_name(src), ast_format_get_name(dst));
 			if (head) {
@@ -532,6 +804,8 @@ struct ast_frame *ast_translate(struct ast_trans_pvt *path, struct ast_frame *f,
 	long len;
 	int seqno;
 
+	AST_PROBE3(translate__start, path, path->t->name, f->samples);
+
 	has_timing_info = ast_test_flag(f, AST_FRFLAG_HAS_TIMING_INFO);
 	ts = f->ts;
 	len = f->len;
@@ -564,7 +838,7 @@ struct ast_frame *ast_translate(struct ast_trans_pvt *path, struct ast_frame *f,
 		struct ast_frame *current = out;
 
 		do {
-			framein(p, current);
+			framein_usage(p, current);
 			current = AST_LIST_NEXT(current, frame_list);
 		} while (current);
 		if (out != f) {
@@ -619,76 +893,554 @@ struct ast_frame *ast_translate(struct ast_trans_pvt *path, struct ast_frame *f,
 	if (consume) {
 		ast_frfree(f);
 	}
+	AST_PROBE2(translate__done, path, out ? out->samples : 0);
 	return out;
 }
 
 /*!
  * \internal
- * \brief Compute the computational cost of a single translation step.
+ * \brief Take the translation of the frame a path has on the transcoding service
  *
- * \note This function is only used to decide which translation path to
- * use between two translators with identical src and dst formats.  Computational
- * cost acts only as a tie breaker. This is done so hardware translators
- * can naturally have precedence over software translators.
+ * \param path The head of the path
+ * \param budget Non-zero to give up on the service for the path if the frame
+ * was not translated within the latency budget
+ *
+ * The frame is waited for either way, as the worker owns the path until then.
+ *
+ * \return the translated frames, if any
  */
-static void generate_computational_cost(struct ast_translator *t, int seconds)
+static struct ast_frame *transcode_collect(struct ast_trans_pvt *path, int budget)
+{
+	struct transcode_job *job = path->offload;
+	struct ast_frame *out;
+
+	ast_mutex_lock(&transcode_lock);
+	if (budget && !job->done) {
+		struct timeval deadline = ast_tvadd(job->queued, ast_samp2tv(transcode_budget, 1000));
+		struct timespec ts = {
+			.tv_sec = deadline.tv_sec,
+			.tv_nsec = deadline.tv_usec * 1000,
+		};
+
+		while (!job->done) {
+			if (ast_cond_timedwait(&transcode_done_cond, &transcode_lock, &ts) == ETIMEDOUT) {
+				break;
+			}
+		}
+		if (!job->done) {
+			ast_debug(1, "Translation by %s took over %dms, translating inline from now on\n",
+				path->t->name, transcode_budget);
+			path->offload_inline = 1;
+			++transcode_fallbacks;
+		}
+	}
+	while (!job->done) {
+		ast_cond_wait(&transcode_done_cond, &transcode_lock);
+	}
+	ast_mutex_unlock(&transcode_lock);
+
+	path->offload = NULL;
+	out = job->out;
+	ast_free(job);
+
+	return out;
+}
+
+/*!
+ * \internal
+ * \brief Order transcoding jobs by the translator they start with
+ */
+static int transcode_job_cmp(const void *a, const void *b)
+{
+	const struct ast_translator *ta = (*(struct transcode_job * const *) a)->path->t;
+	const struct ast_translator *tb = (*(struct transcode_job * const *) b)->path->t;
+
+	return ta < tb ? -1 : ta > tb;
+}
+
+static void *transcode_worker(void *data)
+{
+	struct transcode_job **batch;
+
+	ast_thread_affinity_apply(AST_THREAD_CLASS_TRANSCODE);
+
+	batch = ast_malloc(transcode_batch * sizeof(*batch));
+	if (!batch) {
+		return NULL;
+	}
+
+	for (;;) {
+		struct transcode_job *job;
+		int count = 0;
+		int i;
+
+		ast_mutex_lock(&transcode_lock);
+		while (!transcode_stopping && AST_LIST_EMPTY(&transcode_queue)) {
+			ast_cond_wait(&transcode_cond, &transcode_lock);
+		}
+		while (count < transcode_batch && (job = AST_LIST_REMOVE_HEAD(&transcode_queue, list))) {
+			batch[count++] = job;
+		}
+		ast_mutex_unlock(&transcode_lock);
+
+		if (!count) {
+			/* Told to finish and nothing is left to translate */
+			break;
+		}
+
+		/* Run each translator over all of its frames back to back, while its code and tables are in cache */
+		qsort(batch, count, sizeof(*batch), transcode_job_cmp);
+		for (i = 0; i < count; ++i) {
+			job = batch[i];
+			job->out = ast_translate(job->path, job->in, 1);
+			job->in = NULL;
+
+			ast_mutex_lock(&transcode_lock);
+			job->done = 1;
+			ast_cond_broadcast(&transcode_done_cond);
+			ast_mutex_unlock(&transcode_lock);
+		}
+		__sync_fetch_and_add(&transcode_frames, count);
+		__sync_fetch_and_add(&transcode_batches, 1);
+	}
+
+	ast_free(batch);
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Append a list of frames to another
+ */
+static struct ast_frame *frame_list_append(struct ast_frame *head, struct ast_frame *tail)
+{
+	struct ast_frame *last = head;
+
+	if (!head) {
+		return tail;
+	}
+	while (AST_LIST_NEXT(last, frame_list)) {
+		last = AST_LIST_NEXT(last, frame_list);
+	}
+	AST_LIST_NEXT(last, frame_list) = tail;
+
+	return head;
+}
+
+struct ast_frame *ast_translate_offload(struct ast_trans_pvt *path, struct ast_frame *f, int consume)
+{
+	struct transcode_job *job;
+	struct ast_frame *out = NULL;
+
+	if (!path->offload && (path->offload_inline || !transcode_workers
+		|| AST_LIST_NEXT(f, frame_list))) {
+		return ast_translate(path, f, consume);
+	}
+
+	if (path->offload) {
+		/* A worker owns the path until the previous frame is translated */
+		out = transcode_collect(path, 1);
+	}
+
+	job = path->offload_inline ? NULL : ast_calloc(1, sizeof(*job));
+	if (job && (job->in = ast_frdup(f))) {
+		job->path = path;
+		job->queued = ast_tvnow();
+
+		ast_mutex_lock(&transcode_lock);
+		if (!transcode_stopping) {
+			AST_LIST_INSERT_TAIL(&transcode_queue, job, list);
+			ast_cond_signal(&transcode_cond);
+			path->offload = job;
+		}
+		ast_mutex_unlock(&transcode_lock);
+	}
+
+	if (path->offload) {
+		if (consume) {
+			ast_frfree(f);
+		}
+		return out;
+	}
+
+	if (job) {
+		if (job->in) {
+			ast_frfree(job->in);
+		}
+		ast_free(job);
+	}
+
+	return frame_list_append(out, ast_translate(path, f, consume));
+}
+
+/*!
+ * \internal
+ * \brief Get the CPU time used by the calling thread, in nanoseconds
+ */
+static int64_t thread_cpu_ns(void)
+{
+	struct rusage usage;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+
+	if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+		return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	}
+#endif
+
+	getrusage(COST_RUSAGE, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL
+		+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+}
+
+/*!
+ * \internal
+ * \brief Open a counter of the calling thread's cache misses
+ *
+ * \return A disabled counter, or -1 if the kernel does not allow one
+ */
+static int cache_miss_counter_open(void)
+{
+#if defined(__linux__) && defined(__NR_perf_event_open)
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static void cache_miss_counter_start(int fd)
+{
+#if defined(__linux__) && defined(__NR_perf_event_open)
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Stop and close a cache miss counter
+ *
+ * \return The cache misses counted, or -1 if there is no counter
+ */
+static int64_t cache_miss_counter_stop(int fd)
+{
+	int64_t misses = -1;
+#if defined(__linux__) && defined(__NR_perf_event_open)
+	uint64_t count;
+
+	if (fd < 0) {
+		return -1;
+	}
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+		misses = count;
+	}
+	close(fd);
+#endif
+
+	return misses;
+}
+
+/*!
+ * \internal
+ * \brief Benchmark a single translation step
+ *
+ * Feeds sample frames through a new instance of the translator until it
+ * produces the given seconds of audio, repeating that until at least
+ * min_ns of CPU time is spent.
+ *
+ * \retval 0 on success
+ * \retval -1 if the translator cannot be benchmarked
+ */
+static int bench_translator(struct ast_translator *t, int seconds, int64_t min_ns,
+	struct ast_translator_bench *bench)
 {
-	int num_samples = 0;
 	struct ast_trans_pvt *pvt;
-	struct rusage start;
-	struct rusage end;
-	int cost;
+	int64_t start;
+	int64_t elapsed;
+	int64_t misses;
+	int64_t target = 0;
+	int64_t samples = 0;
+#ifdef __AST_DEBUG_MALLOC
+	unsigned long allocs;
+#endif
+	int misses_fd;
 	int out_rate = t->dst_codec.sample_rate;
 
+	memset(bench, 0, sizeof(*bench));
+
 	if (!seconds) {
 		seconds = 1;
 	}
 
-	/* If they don't make samples, give them a terrible score */
+	/* If they don't make samples, they can't be measured */
 	if (!t->sample) {
 		ast_debug(3, "Translator '%s' does not produce sample frames.\n", t->name);
-		t->comp_cost = 999999;
-		return;
+		return -1;
 	}
 
 	pvt = newpvt(t, NULL);
 	if (!pvt) {
 		ast_log(LOG_WARNING, "Translator '%s' appears to be broken and will probably fail.\n", t->name);
-		t->comp_cost = 999999;
+		return -1;
+	}
+
+	misses_fd = cache_miss_counter_open();
+#ifdef __AST_DEBUG_MALLOC
+	allocs = ast_mm_thread_allocations();
+#endif
+	cache_miss_counter_start(misses_fd);
+	start = thread_cpu_ns();
+
+	do {
+		target += (int64_t) seconds * out_rate;
+
+		/* Call the encoder until we've processed the required number of samples */
+		while (samples < target) {
+			struct ast_frame *f = t->sample();
+			if (!f) {
+				ast_log(LOG_WARNING, "Translator '%s' failed to produce a sample frame.\n", t->name);
+				cache_miss_counter_stop(misses_fd);
+				destroy(pvt);
+				return -1;
+			}
+			framein(pvt, f);
+			ast_frfree(f);
+			bench->frames++;
+			while ((f = t->frameout(pvt))) {
+				samples += f->samples;
+				ast_frfree(f);
+			}
+		}
+
+		elapsed = thread_cpu_ns() - start;
+	} while (elapsed < min_ns);
+
+	misses = cache_miss_counter_stop(misses_fd);
+#ifdef __AST_DEBUG_MALLOC
+	bench->allocs_per_frame = (double) (ast_mm_thread_allocations() - allocs) / bench->frames;
+#else
+	bench->allocs_per_frame = -1;
+#endif
+
+	destroy(pvt);
+
+	bench->samples = samples;
+	bench->ns_per_frame = (double) elapsed / bench->frames;
+	bench->us_per_second = (double) elapsed / 1000 / ((double) samples / out_rate);
+	bench->cache_misses_per_frame = misses < 0 ? -1 : (double) misses / bench->frames;
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Compute the computational cost of a single translation step.
+ *
+ * \note This function is only used to decide which translation path to
+ * use between two translators with identical src and dst formats.  Computational
+ * cost acts only as a tie breaker. This is done so hardware translators
+ * can naturally have precedence over software translators.
+ */
+static int generate_computational_cost(struct ast_translator *t, int seconds)
+{
+	struct ast_translator_bench bench;
+	int cost;
+
+	/* If they can't be measured, give them a terrible score */
+	if (bench_translator(t, seconds, 0, &bench)) {
+		return UNMEASURED_COST;
+	}
+
+	cost = bench.us_per_second;
+
+	return cost ? cost : 1;
+}
+
+/*! \brief A translator waiting for its computational cost to be measured */
+struct cost_request {
+	struct ast_translator *t;
+	int seconds;
+};
+
+/*!
+ * \internal
+ * \brief Whether a translator is registered
+ *
+ * \note This function expects the list of translators to be locked. The
+ * translator is only compared, never dereferenced, so it may be stale.
+ */
+static int translator_registered(struct ast_translator *t)
+{
+	struct ast_translator *u;
+
+	AST_RWLIST_TRAVERSE(&translators, u, list) {
+		if (u == t) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Measure a translator's computational cost and update the matrix
+ *
+ * Measuring never holds the translators lock, so call setup is not blocked
+ * while it runs.
+ */
+static void measure_cost(struct ast_translator *t, int seconds)
+{
+	struct ast_translator *u;
+	int registered;
+	int competed = 0;
+	int cost;
+
+	ast_mutex_lock(&cost_lock);
+
+	AST_RWLIST_RDLOCK(&translators);
+	registered = translator_registered(t);
+	AST_RWLIST_UNLOCK(&translators);
+	if (!registered) {
+		ast_mutex_unlock(&cost_lock);
 		return;
 	}
 
-	getrusage(RUSAGE_SELF, &start);
+	/* ast_unregister_translator() waits on cost_lock, so t stays valid */
+	cost = generate_computational_cost(t, seconds);
 
-	/* Call the encoder until we've processed the required number of samples */
-	while (num_samples < seconds * out_rate) {
-		struct ast_frame *f = t->sample();
-		if (!f) {
-			ast_log(LOG_WARNING, "Translator '%s' failed to produce a sample frame.\n", t->name);
-			destroy(pvt);
-			t->comp_cost = 999999;
-			return;
+	AST_RWLIST_WRLOCK(&translators);
+	if (translator_registered(t)) {
+		t->comp_cost = cost;
+		ast_debug(1, "Translator '%s' has computational cost %d\n", t->name, cost);
+
+		/* Keep translators between the same formats in order of cost */
+		AST_RWLIST_REMOVE(&translators, t, list);
+		AST_RWLIST_TRAVERSE_SAFE_BEGIN(&translators, u, list) {
+			if (u->src_fmt_index == t->src_fmt_index && u->dst_fmt_index == t->dst_fmt_index) {
+				competed = 1;
+				if (u->comp_cost > t->comp_cost) {
+					AST_RWLIST_INSERT_BEFORE_CURRENT(t, list);
+					t = NULL;
+					break;
+				}
+			}
 		}
-		framein(pvt, f);
-		ast_frfree(f);
-		while ((f = t->frameout(pvt))) {
-			num_samples += f->samples;
-			ast_frfree(f);
+		AST_RWLIST_TRAVERSE_SAFE_END;
+		if (t) {
+			AST_RWLIST_INSERT_HEAD(&translators, t, list);
+		}
+
+		/* The cost only breaks ties between translators of the same formats */
+		if (competed) {
+			matrix_rebuild();
 		}
 	}
+	AST_RWLIST_UNLOCK(&translators);
 
-	getrusage(RUSAGE_SELF, &end);
+	ast_mutex_unlock(&cost_lock);
+}
+
+static int cost_task(void *data)
+{
+	struct cost_request *req = data;
 
-	cost = ((end.ru_utime.tv_sec - start.ru_utime.tv_sec) * 1000000) + end.ru_utime.tv_usec - start.ru_utime.tv_usec;
-	cost += ((end.ru_stime.tv_sec - start.ru_stime.tv_sec) * 1000000) + end.ru_stime.tv_usec - start.ru_stime.tv_usec;
+	measure_cost(req->t, req->seconds);
+	ast_free(req);
 
-	destroy(pvt);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue a measurement of a translator's computational cost
+ *
+ * \retval 0 on success
+ * \retval -1 if it could not be queued
+ */
+static int queue_cost(struct ast_translator *t, int seconds)
+{
+	struct cost_request *req;
+
+	if (!cost_tps) {
+		return -1;
+	}
 
-	t->comp_cost = cost / seconds;
+	req = ast_malloc(sizeof(*req));
+	if (!req) {
+		return -1;
+	}
+	req->t = t;
+	req->seconds = seconds;
+
+	if (ast_taskprocessor_push(cost_tps, cost_task, req)) {
+		ast_free(req);
+		return -1;
+	}
+
+	return 0;
+}
+
+int ast_translator_benchmark(int seconds, ast_translator_bench_cb cb, void *data)
+{
+	struct ast_translator **list = NULL;
+	struct ast_translator *t;
+	struct ast_translator_bench bench;
+	int count = 0;
+	int benchmarked = 0;
+	int i;
+
+	AST_RWLIST_RDLOCK(&translators);
+	AST_RWLIST_TRAVERSE(&translators, t, list) {
+		++count;
+	}
+	if (count) {
+		list = ast_malloc(count * sizeof(*list));
+	}
+	if (list) {
+		i = 0;
+		AST_RWLIST_TRAVERSE(&translators, t, list) {
+			list[i++] = t;
+		}
+	}
+	AST_RWLIST_UNLOCK(&translators);
+
+	if (!list) {
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i) {
+		int registered;
 
-	if (!t->comp_cost) {
-		t->comp_cost = 1;
+		/* Keep the translator registered while it runs, as measure_cost() does */
+		ast_mutex_lock(&cost_lock);
+		AST_RWLIST_RDLOCK(&translators);
+		registered = translator_registered(list[i]);
+		AST_RWLIST_UNLOCK(&translators);
+		if (registered && !bench_translator(list[i], seconds, BENCH_MIN_NS, &bench)) {
+			cb(list[i], &bench, data);
+			++benchmarked;
+		}
+		ast_mutex_unlock(&cost_lock);
 	}
+
+	ast_free(list);
+
+	return benchmarked;
 }
 
 /*!
@@ -765,7 +1517,7 @@ static int generate_table_cost(struct ast_codec *src, struct ast_codec *dst)
  * \brief rebuild a translation matrix.
  * \note This function expects the list of translators to be locked
 */
-static void matrix_rebuild(int samples)
+static void matrix_rebuild(void)
 {
 	struct ast_translator *t;
 	int newtablecost;
@@ -776,6 +1528,7 @@ static void matrix_rebuild(int samples)
 	ast_debug(1, "Resetting translation matrix\n");
 
 	matrix_clear();
+	ast_atomic_fetchadd_int(&matrix_generation, 1);
 
 	/* first, compute all direct costs */
 	AST_RWLIST_TRAVERSE(&translators, t, list) {
@@ -786,10 +1539,6 @@ static void matrix_rebuild(int samples)
 		x = t->src_fmt_index;
 		z = t->dst_fmt_index;
 
-		if (samples) {
-			generate_computational_cost(t, samples);
-		}
-
 		/* This new translator is the best choice if any of the below are true.
 		 * 1. no translation path is set between x and z yet.
 		 * 2. the new table cost is less.
@@ -860,6 +1609,76 @@ static void matrix_rebuild(int samples)
 	}
 }
 
+/*!
+ * \brief add an active translator to the translation matrix.
+ *
+ * A new direct step can only make paths through it cheaper, so only the
+ * paths that can reach its source and leave its destination are updated,
+ * rather than rebuilding the whole matrix.
+ *
+ * \note This function expects the list of translators to be locked
+ */
+static void matrix_add_translator(struct ast_translator *t)
+{
+	struct translator_path *direct;
+	uint32_t cost;
+	int x = t->src_fmt_index;
+	int z = t->dst_fmt_index;
+	int i;
+	int j;
+
+	direct = matrix_get(x, z);
+	if (direct->step && !direct->multistep) {
+		/* Another translator between the same formats; let a rebuild pick one */
+		matrix_rebuild();
+		return;
+	}
+	if (direct->step && direct->table_cost < t->table_cost) {
+		/* A path through other formats is cheaper, so nothing else improves */
+		return;
+	}
+
+	cost = direct->step ? direct->table_cost : 0;
+	direct->step = t;
+	direct->table_cost = t->table_cost;
+	direct->multistep = 0;
+	if (cost == t->table_cost) {
+		return;
+	}
+
+	/* Route every path that gets cheaper through the new step */
+	for (i = 0; i < cur_max_index; i++) {
+		struct translator_path *to_src = matrix_get(i, x);
+
+		if (i != x && !to_src->step) {
+			continue;
+		}
+		for (j = 0; j < cur_max_index; j++) {
+			struct translator_path *from_dst = matrix_get(z, j);
+			struct translator_path *path;
+
+			if (i == j || (i == x && j == z) || (j != z && !from_dst->step)) {
+				continue;
+			}
+
+			cost = t->table_cost;
+			if (i != x) {
+				cost += to_src->table_cost;
+			}
+			if (j != z) {
+				cost += from_dst->table_cost;
+			}
+
+			path = matrix_get(i, j);
+			if (!path->step || cost < path->table_cost) {
+				path->step = (i == x) ? t : to_src->step;
+				path->table_cost = cost;
+				path->multistep = 1;
+			}
+		}
+	}
+}
+
 static void codec_append_name(const struct ast_codec *codec, struct ast_str **buf)
 {
 	if (codec) {
@@ -910,6 +1729,7 @@ static char *complete_trans_path_choice(const char *line, const char *word, int
 
 static void handle_cli_recalc(struct ast_cli_args *a)
 {
+	struct ast_translator *t;
 	int time = a->argv[4] ? atoi(a->argv[4]) : 1;
 
 	if (time <= 0) {
@@ -922,9 +1742,14 @@ static void handle_cli_recalc(struct ast_cli_args *a)
 		time = MAX_RECALC;
 	}
 	ast_cli(a->fd, "         Recalculating Codec Translation (number of sample seconds: %d)\n\n", time);
-	AST_RWLIST_WRLOCK(&translators);
-	matrix_rebuild(time);
+	AST_RWLIST_RDLOCK(&translators);
+	AST_RWLIST_TRAVERSE(&translators, t, list) {
+		if (queue_cost(t, time)) {
+			ast_cli(a->fd, "         Failed to queue recalculation of '%s'\n", t->name);
+		}
+	}
 	AST_RWLIST_UNLOCK(&translators);
+	ast_cli(a->fd, "         Costs are measured in the background and the matrix updated as each finishes.\n\n");
 }
 
 static char *handle_show_translation_table(struct ast_cli_args *a)
@@ -1015,6 +1840,43 @@ static char *handle_show_translation_table(struct ast_cli_args *a)
 	return CLI_SUCCESS;
 }
 
+static char *handle_show_translation_stats(struct ast_cli_args *a)
+{
+	struct ast_translator *t;
+	int count = 0;
+
+	ast_cli(a->fd, "%-24s %12s %14s %12s %12s %10s\n",
+		"Translator", "Frames", "Samples", "Time (ms)", "us/frame", "CPU %");
+
+	AST_RWLIST_RDLOCK(&translators);
+	AST_RWLIST_TRAVERSE(&translators, t, list) {
+		uint64_t frames = t->usage_frames;
+		uint64_t samples = t->usage_samples;
+		uint64_t ns = t->usage_ns;
+		double audio_ns;
+
+		if (!t->track_usage || !frames) {
+			continue;
+		}
+
+		/* Time spent as a share of the audio translated on one core */
+		audio_ns = (double) samples * 1000000000 / t->src_codec.sample_rate;
+		ast_cli(a->fd, "%-24s %12" PRIu64 " %14" PRIu64 " %12.1f %12.2f %10.3f\n",
+			t->name, frames, samples, ns / 1000000.0, ns / 1000.0 / frames,
+			audio_ns ? ns * 100.0 / audio_ns : 0.0);
+		++count;
+	}
+	AST_RWLIST_UNLOCK(&translators);
+
+	ast_cli(a->fd, "%d translators have been used.\n", count);
+	if (transcode_workers) {
+		ast_cli(a->fd, "Transcoding service: %d workers, %" PRIu64 " frames in %" PRIu64 " batches, %" PRIu64 " paths fell back to inline translation.\n",
+			transcode_workers, transcode_frames, transcode_batches, transcode_fallbacks);
+	}
+
+	return CLI_SUCCESS;
+}
+
 static char *handle_show_translation_path(struct ast_cli_args *a, const char *codec_name, unsigned int sample_rate)
 {
 	int i = 1;
@@ -1082,7 +1944,7 @@ static char *handle_show_translation_path(struct ast_cli_args *a, const char *co
 
 static char *handle_cli_core_show_translation(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	static const char * const option[] = { "recalc", "paths", NULL };
+	static const char * const option[] = { "recalc", "paths", "stats", NULL };
 
 	switch (cmd) {
 	case CLI_INIT:
@@ -1097,7 +1959,10 @@ static char *handle_cli_core_show_translation(struct ast_cli_entry *e, int cmd,
 			"       2. 'core show translation paths [codec [sample_rate]]'\n"
 			"           This will display all the translation paths associated with a codec.\n"
 			"           If a codec has multiple sample rates, the sample rate must be\n"
-			"           provided as well.\n";
+			"           provided as well.\n"
+			"       3. 'core show translation stats'\n"
+			"           This will display the time spent translating by the translators\n"
+			"           that track it, such as the resamplers.\n";
 		return NULL;
 	case CLI_GENERATE:
 		if (a->pos == 3) {
@@ -1122,6 +1987,8 @@ static char *handle_cli_core_show_translation(struct ast_cli_entry *e, int cmd,
 			return CLI_FAILURE;
 		}
 		return handle_show_translation_path(a, a->argv[4], sample_rate);
+	} else if (a->argv[3] && !strcasecmp(a->argv[3], option[2]) && a->argc == 4) {
+		return handle_show_translation_stats(a);
 	} else if (a->argv[3] && !strcasecmp(a->argv[3], option[0])) { /* recalc and then fall through to show table */
 		handle_cli_recalc(a);
 	} else if (a->argc > 3) { /* wrong input */
@@ -1131,14 +1998,96 @@ static char *handle_cli_core_show_translation(struct ast_cli_entry *e, int cmd,
 	return handle_show_translation_table(a);
 }
 
+/*! \brief Describe what a translator does, for the benchmark */
+static const char *bench_kind(const struct ast_translator *t)
+{
+	int from_slin = !strncmp(t->src_codec.name, "slin", 4);
+	int to_slin = !strncmp(t->dst_codec.name, "slin", 4);
+
+	if (from_slin && to_slin) {
+		return "resample";
+	} else if (from_slin) {
+		return "encode";
+	} else if (to_slin) {
+		return "decode";
+	}
+	return "transcode";
+}
+
+static void bench_cli_cb(const struct ast_translator *t, const struct ast_translator_bench *bench, void *data)
+{
+	struct ast_cli_args *a = data;
+	char from[32];
+	char to[32];
+	char allocs[16];
+	char misses[16];
+
+	snprintf(from, sizeof(from), "%s@%u", t->src_codec.name, t->src_codec.sample_rate);
+	snprintf(to, sizeof(to), "%s@%u", t->dst_codec.name, t->dst_codec.sample_rate);
+	if (bench->allocs_per_frame < 0) {
+		ast_copy_string(allocs, "-", sizeof(allocs));
+	} else {
+		snprintf(allocs, sizeof(allocs), "%.2f", bench->allocs_per_frame);
+	}
+	if (bench->cache_misses_per_frame < 0) {
+		ast_copy_string(misses, "-", sizeof(misses));
+	} else {
+		snprintf(misses, sizeof(misses), "%.1f", bench->cache_misses_per_frame);
+	}
+
+	ast_cli(a->fd, "%-20s %-16s %-16s %-9s %10.0f %10.1f %8s %10s\n",
+		t->name, from, to, bench_kind(t), bench->ns_per_frame,
+		bench->us_per_second, allocs, misses);
+}
+
+static char *handle_cli_core_benchmark_codecs(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int seconds = BENCH_DEFAULT_SECONDS;
+	int count;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core benchmark codecs";
+		e->usage =
+			"Usage: core benchmark codecs [<seconds>]\n"
+			"       Runs every registered translator that has sample frames until it\n"
+			"       produces the given seconds of audio, 10 by default, and for at least\n"
+			"       50ms of CPU time. Displays the CPU time taken per frame fed in and\n"
+			"       per second of audio produced, and the allocations and cache misses\n"
+			"       per frame when they can be counted.  Allocations are only counted\n"
+			"       when Asterisk is built with MALLOC_DEBUG.\n"
+			"       The benchmark runs on the CLI thread and may take some time.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc > 4) {
+		return CLI_SHOWUSAGE;
+	}
+	if (a->argc == 4) {
+		if (sscanf(a->argv[3], "%30d", &seconds) != 1 || seconds <= 0 || seconds > MAX_RECALC) {
+			ast_cli(a->fd, "Seconds must be between 1 and %d.\n", MAX_RECALC);
+			return CLI_FAILURE;
+		}
+	}
+
+	ast_cli(a->fd, "%-20s %-16s %-16s %-9s %10s %10s %8s %10s\n",
+		"Translator", "From", "To", "Kind", "ns/frame", "us/second", "allocs", "misses");
+	count = ast_translator_benchmark(seconds, bench_cli_cb, a);
+	ast_cli(a->fd, "%d translators benchmarked.\n", count);
+
+	return CLI_SUCCESS;
+}
+
 static struct ast_cli_entry cli_translate[] = {
-	AST_CLI_DEFINE(handle_cli_core_show_translation, "Display translation matrix")
+	AST_CLI_DEFINE(handle_cli_core_show_translation, "Display translation matrix"),
+	AST_CLI_DEFINE(handle_cli_core_benchmark_codecs, "Benchmark codec translators"),
 };
 
 /*! \brief register codec translator */
 int __ast_register_translator(struct ast_translator *t, struct ast_module *mod)
 {
-	struct ast_translator *u;
 	char tmp[80];
 	RAII_VAR(struct ast_codec *, src_codec, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_codec *, dst_codec, NULL, ao2_cleanup);
@@ -1214,37 +2163,27 @@ int __ast_register_translator(struct ast_translator *t, struct ast_module *mod)
 		t->frameout = default_frameout;
 	}
 
-	generate_computational_cost(t, 1);
+	/* Measured in the background, so until then this only loses ties */
+	t->comp_cost = UNMEASURED_COST;
 
-	ast_verb(2, "Registered translator '%s' from codec %s to %s, table cost, %d, computational cost %d\n",
+	ast_verb(2, "Registered translator '%s' from codec %s to %s, table cost, %d\n",
 		 term_color(tmp, t->name, COLOR_MAGENTA, COLOR_BLACK, sizeof(tmp)),
-		 t->src_codec.name, t->dst_codec.name, t->table_cost, t->comp_cost);
+		 t->src_codec.name, t->dst_codec.name, t->table_cost);
 
 	AST_RWLIST_WRLOCK(&translators);
 
-	/* find any existing translators that provide this same srcfmt/dstfmt,
-	   and put this one in order based on computational cost */
-	AST_RWLIST_TRAVERSE_SAFE_BEGIN(&translators, u, list) {
-		if ((u->src_fmt_index == t->src_fmt_index) &&
-		    (u->dst_fmt_index == t->dst_fmt_index) &&
-		    (u->comp_cost > t->comp_cost)) {
-			AST_RWLIST_INSERT_BEFORE_CURRENT(t, list);
-			t = NULL;
-			break;
-		}
-	}
-	AST_RWLIST_TRAVERSE_SAFE_END;
-
-	/* if no existing translator was found for this codec combination,
-	   add it to the beginning of the list */
-	if (t) {
-		AST_RWLIST_INSERT_HEAD(&translators, t, list);
-	}
+	/* It is ordered among translators between the same formats once its
+	   computational cost is known */
+	AST_RWLIST_INSERT_HEAD(&translators, t, list);
 
-	matrix_rebuild(0);
+	matrix_add_translator(t);
 
 	AST_RWLIST_UNLOCK(&translators);
 
+	if (queue_cost(t, 1)) {
+		measure_cost(t, 1);
+	}
+
 	return 0;
 }
 
@@ -1269,19 +2208,26 @@ int ast_unregister_translator(struct ast_translator *t)
 	AST_RWLIST_TRAVERSE_SAFE_END;
 
 	if (found) {
-		matrix_rebuild(0);
+		matrix_rebuild();
+		pool_drain(t);
 	}
 
 	AST_RWLIST_UNLOCK(&translators);
 
+	/* Wait for any measurement of its cost that is already running */
+	ast_mutex_lock(&cost_lock);
+	ast_mutex_unlock(&cost_lock);
+
 	return (u ? 0 : -1);
 }
 
 void ast_translator_activate(struct ast_translator *t)
 {
 	AST_RWLIST_WRLOCK(&translators);
-	t->active = 1;
-	matrix_rebuild(0);
+	if (!t->active) {
+		t->active = 1;
+		matrix_add_translator(t);
+	}
 	AST_RWLIST_UNLOCK(&translators);
 }
 
@@ -1289,12 +2235,12 @@ void ast_translator_deactivate(struct ast_translator *t)
 {
 	AST_RWLIST_WRLOCK(&translators);
 	t->active = 0;
-	matrix_rebuild(0);
+	matrix_rebuild();
 	AST_RWLIST_UNLOCK(&translators);
 }
 
 /*! \brief Calculate our best translator source format, given costs, and a desired destination */
-int ast_translator_best_choice(struct ast_format_cap *dst_cap,
+static int translator_best_choice(struct ast_format_cap *dst_cap,
 	struct ast_format_cap *src_cap,
 	struct ast_format **dst_fmt_out,
 	struct ast_format **src_fmt_out)
@@ -1388,6 +2334,56 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 	return 0;
 }
 
+static struct best_choice_entry *best_choice_entry_get(unsigned int dst_id, unsigned int src_id)
+{
+	return &best_choice_cache[(dst_id * 31 + src_id) % BEST_CHOICE_CACHE_SIZE];
+}
+
+int ast_translator_best_choice(struct ast_format_cap *dst_cap,
+	struct ast_format_cap *src_cap,
+	struct ast_format **dst_fmt_out,
+	struct ast_format **src_fmt_out)
+{
+	unsigned int dst_id = ast_format_cap_get_intern_id(dst_cap);
+	unsigned int src_id = ast_format_cap_get_intern_id(src_cap);
+	struct best_choice_entry *entry;
+	int generation;
+	int res;
+
+	/* The choice only depends on the capabilities and the matrix, so it is
+	 * remembered for capabilities that can't change. */
+	if (!dst_id || !src_id) {
+		return translator_best_choice(dst_cap, src_cap, dst_fmt_out, src_fmt_out);
+	}
+
+	entry = best_choice_entry_get(dst_id, src_id);
+	generation = ast_atomic_fetchadd_int(&matrix_generation, 0);
+
+	ast_mutex_lock(&best_choice_lock);
+	if (entry->dst_id == dst_id && entry->src_id == src_id && entry->generation == generation) {
+		ao2_replace(*dst_fmt_out, entry->dst);
+		ao2_replace(*src_fmt_out, entry->src);
+		ast_mutex_unlock(&best_choice_lock);
+		return 0;
+	}
+	ast_mutex_unlock(&best_choice_lock);
+
+	res = translator_best_choice(dst_cap, src_cap, dst_fmt_out, src_fmt_out);
+	if (res) {
+		return res;
+	}
+
+	ast_mutex_lock(&best_choice_lock);
+	entry->dst_id = dst_id;
+	entry->src_id = src_id;
+	entry->generation = generation;
+	ao2_replace(entry->dst, *dst_fmt_out);
+	ao2_replace(entry->src, *src_fmt_out);
+	ast_mutex_unlock(&best_choice_lock);
+
+	return 0;
+}
+
 unsigned int ast_translate_path_steps(struct ast_format *dst_format, struct ast_format *src_format)
 {
 	unsigned int res = -1;
@@ -1498,10 +2494,94 @@ void ast_translate_available_formats(struct ast_format_cap *dest, struct ast_for
 	}
 }
 
+/*!
+ * \internal
+ * \brief Start the transcoding workers configured in asterisk.conf
+ */
+static void transcode_start(void)
+{
+	struct ast_flags config_flags = { CONFIG_FLAG_NOREALTIME };
+	struct ast_config *cfg;
+	struct ast_variable *v;
+	int workers = 0;
+	int i;
+
+	cfg = ast_config_load2(ast_config_AST_CONFIG_FILE, "" /* core, can't reload */, config_flags);
+	if (!cfg || cfg == CONFIG_STATUS_FILEMISSING || cfg == CONFIG_STATUS_FILEINVALID) {
+		return;
+	}
+	for (v = ast_variable_browse(cfg, "transcode"); v; v = v->next) {
+		if (!strcasecmp(v->name, "workers")) {
+			if (sscanf(v->value, "%30d", &workers) != 1 || workers < 0 || workers > TRANSCODE_MAX_WORKERS) {
+				ast_log(LOG_WARNING, "Invalid transcoding workers '%s', must be 0 to %d\n",
+					v->value, TRANSCODE_MAX_WORKERS);
+				workers = 0;
+			}
+		} else if (!strcasecmp(v->name, "latency_budget")) {
+			if (sscanf(v->value, "%30d", &transcode_budget) != 1 || transcode_budget < 1) {
+				ast_log(LOG_WARNING, "Invalid transcoding latency budget '%s', using %dms\n",
+					v->value, TRANSCODE_DEFAULT_BUDGET);
+				transcode_budget = TRANSCODE_DEFAULT_BUDGET;
+			}
+		} else if (!strcasecmp(v->name, "batch")) {
+			if (sscanf(v->value, "%30d", &transcode_batch) != 1 || transcode_batch < 1) {
+				ast_log(LOG_WARNING, "Invalid transcoding batch '%s', using %d\n",
+					v->value, TRANSCODE_DEFAULT_BATCH);
+				transcode_batch = TRANSCODE_DEFAULT_BATCH;
+			}
+		}
+	}
+	ast_config_destroy(cfg);
+
+	if (!workers || !(transcode_threads = ast_calloc(workers, sizeof(*transcode_threads)))) {
+		return;
+	}
+
+	ast_cond_init(&transcode_cond, NULL);
+	ast_cond_init(&transcode_done_cond, NULL);
+	for (i = 0; i < workers; ++i) {
+		if (ast_pthread_create(&transcode_threads[i], NULL, transcode_worker, NULL)) {
+			ast_log(LOG_WARNING, "Failed to start transcoding worker %d\n", i);
+			break;
+		}
+	}
+	transcode_workers = i;
+	ast_verb(2, "Transcoding service started with %d workers\n", transcode_workers);
+}
+
+/*!
+ * \internal
+ * \brief Stop the transcoding workers once they finish the queued frames
+ */
+static void transcode_stop(void)
+{
+	int workers = transcode_workers;
+	int i;
+
+	if (!transcode_threads) {
+		return;
+	}
+
+	ast_mutex_lock(&transcode_lock);
+	transcode_workers = 0;
+	transcode_stopping = 1;
+	ast_cond_broadcast(&transcode_cond);
+	ast_mutex_unlock(&transcode_lock);
+
+	for (i = 0; i < workers; ++i) {
+		pthread_join(transcode_threads[i], NULL);
+	}
+	ast_free(transcode_threads);
+	transcode_threads = NULL;
+}
+
 static void translate_shutdown(void)
 {
 	int x;
 	ast_cli_unregister_multiple(cli_translate, ARRAY_LEN(cli_translate));
+	transcode_stop();
+	ast_taskprocessor_unreference(cost_tps);
+	cost_tps = NULL;
 
 	ast_rwlock_wrlock(&tablelock);
 	for (x = 0; x < index_size; x++) {
@@ -1513,6 +2593,14 @@ static void translate_shutdown(void)
 	__indextable = NULL;
 	ast_rwlock_unlock(&tablelock);
 	ast_rwlock_destroy(&tablelock);
+
+	ast_mutex_lock(&best_choice_lock);
+	for (x = 0; x < ARRAY_LEN(best_choice_cache); x++) {
+		ao2_cleanup(best_choice_cache[x].dst);
+		ao2_cleanup(best_choice_cache[x].src);
+		memset(&best_choice_cache[x], 0, sizeof(best_choice_cache[x]));
+	}
+	ast_mutex_unlock(&best_choice_lock);
 }
 
 int ast_translate_init(void)
@@ -1520,6 +2608,11 @@ int ast_translate_init(void)
 	int res = 0;
 	ast_rwlock_init(&tablelock);
 	res = matrix_resize(1);
+	cost_tps = ast_taskprocessor_get("translate_cost", TPS_REF_DEFAULT);
+	if (!cost_tps) {
+		ast_log(LOG_WARNING, "Failed to create the translator cost taskprocessor, costs will be measured on registration\n");
+	}
+	transcode_start();
 	res |= ast_cli_register_multiple(cli_translate, ARRAY_LEN(cli_translate));
 	ast_register_cleanup(translate_shutdown);
 	return res;
@@ -33,6 +33,21 @@ ASTERISK_REGISTER_FILE()
 
 #include "asterisk/ulaw.h"
 #include "asterisk/logger.h"
+#include "asterisk/utils.h"
+
+/*
+ * The vector kernels compute the same codes as the default tables. They are
+ * not built for the G711_NEW_ALGORITHM tables, which round differently.
+ */
+#if !defined(G711_NEW_ALGORITHM) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ULAW_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if !defined(G711_NEW_ALGORITHM) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define ULAW_NEON_KERNELS
+#include <arm_neon.h>
+#endif
 
 #if 0
 /* ZEROTRAP is the military recommendation to improve the encryption
@@ -169,6 +184,252 @@ static inline short ulaw2linear(unsigned char ulawbyte)
 }
 #endif
 
+/*! \brief Encode with the lookup table, one sample at a time */
+static void ulaw_encode_c(unsigned char *dst, const short *src, size_t samples)
+{
+	while (samples--) {
+		*dst++ = AST_LIN2MU(*src++);
+	}
+}
+
+/*! \brief Decode with the lookup table, one sample at a time */
+static void ulaw_decode_c(short *dst, const unsigned char *src, size_t samples)
+{
+	while (samples--) {
+		*dst++ = AST_MULAW(*src++);
+	}
+}
+
+/*
+ * The vector kernels work out linear2ulaw() of each sample with its two low
+ * bits set, which is the sample the table entry for it was built from.
+ *
+ * The exponent is how many of the magnitude thresholds 256, 512, ... 16384
+ * are reached, and the mantissa is the magnitude shifted right by the
+ * exponent plus 3. Decoding is ((mantissa << 3) + 132) << exponent, less 132.
+ */
+
+#ifdef ULAW_X86_KERNELS
+__attribute__((target("sse4.1")))
+static void ulaw_encode_sse4(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i *) (src + i)), _mm_set1_epi16(3));
+		__m128i sign = _mm_and_si128(_mm_srai_epi16(x, 8), _mm_set1_epi16(0x80));
+		__m128i mag = _mm_add_epi16(_mm_min_epi16(_mm_abs_epi16(x), _mm_set1_epi16(CLIP)), _mm_set1_epi16(BIAS));
+		__m128i exponent = _mm_setzero_si128();
+		/* Multiplying by this and keeping the high half shifts right by exponent + 3 */
+		__m128i shift = _mm_set1_epi16(1 << 13);
+		__m128i code;
+		int k;
+
+		for (k = 1; k < 8; ++k) {
+			__m128i above = _mm_cmpgt_epi16(mag, _mm_set1_epi16((128 << k) - 1));
+
+			exponent = _mm_sub_epi16(exponent, above);
+			shift = _mm_blendv_epi8(shift, _mm_srli_epi16(shift, 1), above);
+		}
+
+		code = _mm_or_si128(sign, _mm_or_si128(_mm_slli_epi16(exponent, 4),
+			_mm_and_si128(_mm_mulhi_epu16(mag, shift), _mm_set1_epi16(0x0f))));
+		code = _mm_xor_si128(code, _mm_set1_epi16(0xff));
+		_mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(code, code));
+	}
+
+	ulaw_encode_c(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("sse4.1")))
+static void ulaw_decode_sse4(short *dst, const unsigned char *src, size_t samples)
+{
+	const __m128i powers = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i mu = _mm_xor_si128(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (src + i))),
+			_mm_set1_epi16(0xff));
+		__m128i exponent = _mm_and_si128(_mm_srli_epi16(mu, 4), _mm_set1_epi16(7));
+		/* The high byte of each index has its top bit set so it looks up zero */
+		__m128i scale = _mm_shuffle_epi8(powers, _mm_or_si128(exponent, _mm_set1_epi16(0x8000)));
+		__m128i sample = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(mu, _mm_set1_epi16(0x0f)), 3),
+			_mm_set1_epi16(BIAS));
+		__m128i negative = _mm_cmpeq_epi16(_mm_and_si128(mu, _mm_set1_epi16(0x80)), _mm_set1_epi16(0x80));
+
+		sample = _mm_sub_epi16(_mm_mullo_epi16(sample, scale), _mm_set1_epi16(BIAS));
+		sample = _mm_sub_epi16(_mm_xor_si128(sample, negative), negative);
+		_mm_storeu_si128((__m128i *) (dst + i), sample);
+	}
+
+	ulaw_decode_c(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void ulaw_encode_avx2(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (src + i)), _mm256_set1_epi16(3));
+		__m256i sign = _mm256_and_si256(_mm256_srai_epi16(x, 8), _mm256_set1_epi16(0x80));
+		__m256i mag = _mm256_add_epi16(_mm256_min_epi16(_mm256_abs_epi16(x), _mm256_set1_epi16(CLIP)),
+			_mm256_set1_epi16(BIAS));
+		__m256i exponent = _mm256_setzero_si256();
+		__m256i shift = _mm256_set1_epi16(1 << 13);
+		__m256i code;
+		int k;
+
+		for (k = 1; k < 8; ++k) {
+			__m256i above = _mm256_cmpgt_epi16(mag, _mm256_set1_epi16((128 << k) - 1));
+
+			exponent = _mm256_sub_epi16(exponent, above);
+			shift = _mm256_blendv_epi8(shift, _mm256_srli_epi16(shift, 1), above);
+		}
+
+		code = _mm256_or_si256(sign, _mm256_or_si256(_mm256_slli_epi16(exponent, 4),
+			_mm256_and_si256(_mm256_mulhi_epu16(mag, shift), _mm256_set1_epi16(0x0f))));
+		code = _mm256_xor_si256(code, _mm256_set1_epi16(0xff));
+		/* Packing works within each 128 bit lane, so gather the two halves */
+		code = _mm256_permute4x64_epi64(_mm256_packus_epi16(code, code), 0x08);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm256_castsi256_si128(code));
+	}
+
+	ulaw_encode_sse4(dst + i, src + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void ulaw_decode_avx2(short *dst, const unsigned char *src, size_t samples)
+{
+	const __m256i powers = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0);
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i mu = _mm256_xor_si256(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (src + i))),
+			_mm256_set1_epi16(0xff));
+		__m256i exponent = _mm256_and_si256(_mm256_srli_epi16(mu, 4), _mm256_set1_epi16(7));
+		__m256i scale = _mm256_shuffle_epi8(powers, _mm256_or_si256(exponent, _mm256_set1_epi16(0x8000)));
+		__m256i sample = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(mu, _mm256_set1_epi16(0x0f)), 3),
+			_mm256_set1_epi16(BIAS));
+		__m256i negative = _mm256_cmpeq_epi16(_mm256_and_si256(mu, _mm256_set1_epi16(0x80)),
+			_mm256_set1_epi16(0x80));
+
+		sample = _mm256_sub_epi16(_mm256_mullo_epi16(sample, scale), _mm256_set1_epi16(BIAS));
+		sample = _mm256_sub_epi16(_mm256_xor_si256(sample, negative), negative);
+		_mm256_storeu_si256((__m256i *) (dst + i), sample);
+	}
+
+	ulaw_decode_sse4(dst + i, src + i, samples - i);
+}
+#endif /* ULAW_X86_KERNELS */
+
+#ifdef ULAW_NEON_KERNELS
+static void ulaw_encode_neon(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		int16x8_t x = vorrq_s16(vld1q_s16(src + i), vdupq_n_s16(3));
+		uint16x8_t sign = vandq_u16(vreinterpretq_u16_s16(vshrq_n_s16(x, 8)), vdupq_n_u16(0x80));
+		uint16x8_t mag = vaddq_u16(vminq_u16(vreinterpretq_u16_s16(vabsq_s16(x)), vdupq_n_u16(CLIP)),
+			vdupq_n_u16(BIAS));
+		/* The exponent is the position of the top bit of the magnitude over 128 */
+		uint16x8_t exponent = vsubq_u16(vdupq_n_u16(15),
+			vclzq_u16(vorrq_u16(vshrq_n_u16(mag, 7), vdupq_n_u16(1))));
+		int16x8_t shift = vnegq_s16(vreinterpretq_s16_u16(vaddq_u16(exponent, vdupq_n_u16(3))));
+		uint16x8_t code = vorrq_u16(sign, vorrq_u16(vshlq_n_u16(exponent, 4),
+			vandq_u16(vshlq_u16(mag, shift), vdupq_n_u16(0x0f))));
+
+		vst1_u8(dst + i, vmovn_u16(vmvnq_u16(code)));
+	}
+
+	ulaw_encode_c(dst + i, src + i, samples - i);
+}
+
+static void ulaw_decode_neon(short *dst, const unsigned char *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		uint16x8_t mu = vmovl_u8(vmvn_u8(vld1_u8(src + i)));
+		int16x8_t exponent = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(mu, 4), vdupq_n_u16(7)));
+		uint16x8_t magnitude = vaddq_u16(vshlq_n_u16(vandq_u16(mu, vdupq_n_u16(0x0f)), 3), vdupq_n_u16(BIAS));
+		int16x8_t sample = vreinterpretq_s16_u16(vsubq_u16(vshlq_u16(magnitude, exponent), vdupq_n_u16(BIAS)));
+
+		sample = vbslq_s16(vtstq_u16(mu, vdupq_n_u16(0x80)), vnegq_s16(sample), sample);
+		vst1q_s16(dst + i, sample);
+	}
+
+	ulaw_decode_c(dst + i, src + i, samples - i);
+}
+#endif /* ULAW_NEON_KERNELS */
+
+/*! \brief A way of encoding and decoding blocks of samples */
+struct ulaw_kernel {
+	const char *name;
+	void (*encode)(unsigned char *dst, const short *src, size_t samples);
+	void (*decode)(short *dst, const unsigned char *src, size_t samples);
+};
+
+/*! \brief The kernels, best last */
+static const struct ulaw_kernel ulaw_kernels[] = {
+	{ "c", ulaw_encode_c, ulaw_decode_c },
+#ifdef ULAW_X86_KERNELS
+	{ "sse4.1", ulaw_encode_sse4, ulaw_decode_sse4 },
+	{ "avx2", ulaw_encode_avx2, ulaw_decode_avx2 },
+#endif
+#ifdef ULAW_NEON_KERNELS
+	{ "neon", ulaw_encode_neon, ulaw_decode_neon },
+#endif
+};
+
+/*! \brief The kernel in use */
+static const struct ulaw_kernel *ulaw_kernel = &ulaw_kernels[0];
+
+/*! \brief Whether the CPU can run a kernel */
+static int ulaw_kernel_supported(const struct ulaw_kernel *kernel)
+{
+#ifdef ULAW_X86_KERNELS
+	if (!strcmp(kernel->name, "sse4.1")) {
+		return __builtin_cpu_supports("sse4.1");
+	}
+	if (!strcmp(kernel->name, "avx2")) {
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+	return 1;
+}
+
+int ast_ulaw_use_kernel(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(ulaw_kernels); ++i) {
+		if (!strcmp(ulaw_kernels[i].name, name) && ulaw_kernel_supported(&ulaw_kernels[i])) {
+			ulaw_kernel = &ulaw_kernels[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+const char *ast_ulaw_kernel(void)
+{
+	return ulaw_kernel->name;
+}
+
+void ast_ulaw_encode(unsigned char *dst, const short *src, size_t samples)
+{
+	ulaw_kernel->encode(dst, src, samples);
+}
+
+void ast_ulaw_decode(short *dst, const unsigned char *src, size_t samples)
+{
+	ulaw_kernel->decode(dst, src, samples);
+}
+
 /*!
  * \brief  Set up mu-law conversion table
  */
@@ -247,5 +508,16 @@ void ast_ulaw_init(void)
 	}
 	ast_log(LOG_NOTICE, "u-Law tandem transcoding test complete.\n");
 #endif /* TEST_TANDEM_TRANSCODING */
+
+	/* Use the best kernel the CPU has */
+#ifdef ULAW_X86_KERNELS
+	__builtin_cpu_init();
+#endif
+	for (i = ARRAY_LEN(ulaw_kernels) - 1; i > 0; --i) {
+		if (ulaw_kernel_supported(&ulaw_kernels[i])) {
+			break;
+		}
+	}
+	ulaw_kernel = &ulaw_kernels[i];
 }
 
@@ -1914,6 +1914,193 @@ void ast_format_duration_hh_mm_ss(int duration, char *buf, size_t length)
 
 #undef ONE_MILLION
 
+/*! \brief Bytes a thread's generator outputs before it is reseeded */
+#define RANDOM_RESEED_BYTES (1024 * 1024)
+/*! \brief ChaCha20 blocks a thread's generator computes at a time */
+#define RANDOM_BLOCKS 16
+/*! \brief Size of a ChaCha20 block */
+#define CHACHA20_BLOCK 64
+/*! \brief Size of a ChaCha20 key */
+#define CHACHA20_KEY 32
+
+/*!
+ * \brief Per-thread state of ast_random_bytes()
+ *
+ * Each refill computes RANDOM_BLOCKS ChaCha20 blocks and takes the first
+ * CHACHA20_KEY bytes as the key of the next refill ("fast key erasure"), so
+ * output already handed out cannot be recomputed from the state. Output is
+ * wiped from the buffer as it is taken.
+ */
+struct random_state {
+	/*! Key of the next refill */
+	uint32_t key[CHACHA20_KEY / 4];
+	/*! Offset of the first unused byte of buf */
+	size_t used;
+	/*! Bytes output since the key was last mixed with /dev/urandom */
+	size_t generated;
+	/*! Whether the key was ever taken from /dev/urandom */
+	int seeded;
+	unsigned char buf[RANDOM_BLOCKS * CHACHA20_BLOCK];
+};
+
+static void random_state_destroy(void *data)
+{
+	volatile unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < sizeof(struct random_state); ++i) {
+		p[i] = 0;
+	}
+	ast_free(data);
+}
+
+static int random_state_init(void *data)
+{
+	struct random_state *state = data;
+
+	state->used = sizeof(state->buf);
+	return 0;
+}
+
+AST_THREADSTORAGE_CUSTOM(random_state_buf, random_state_init, random_state_destroy);
+
+#define CHACHA20_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define CHACHA20_QUARTERROUND(a, b, c, d) do { \
+	a += b; d ^= a; d = CHACHA20_ROTL(d, 16); \
+	c += d; b ^= c; b = CHACHA20_ROTL(b, 12); \
+	a += b; d ^= a; d = CHACHA20_ROTL(d, 8); \
+	c += d; b ^= c; b = CHACHA20_ROTL(b, 7); \
+} while (0)
+
+/*!
+ * \internal
+ * \brief Compute a ChaCha20 block (RFC 7539) with an all zero nonce
+ */
+static void chacha20_block(const uint32_t key[8], uint32_t counter, unsigned char *out)
+{
+	uint32_t in[16];
+	uint32_t x[16];
+	int i;
+
+	in[0] = 0x61707865;
+	in[1] = 0x3320646e;
+	in[2] = 0x79622d32;
+	in[3] = 0x6b206574;
+	memcpy(&in[4], key, CHACHA20_KEY);
+	in[12] = counter;
+	in[13] = in[14] = in[15] = 0;
+	memcpy(x, in, sizeof(x));
+
+	for (i = 0; i < 10; ++i) {
+		CHACHA20_QUARTERROUND(x[0], x[4], x[8], x[12]);
+		CHACHA20_QUARTERROUND(x[1], x[5], x[9], x[13]);
+		CHACHA20_QUARTERROUND(x[2], x[6], x[10], x[14]);
+		CHACHA20_QUARTERROUND(x[3], x[7], x[11], x[15]);
+		CHACHA20_QUARTERROUND(x[0], x[5], x[10], x[15]);
+		CHACHA20_QUARTERROUND(x[1], x[6], x[11], x[12]);
+		CHACHA20_QUARTERROUND(x[2], x[7], x[8], x[13]);
+		CHACHA20_QUARTERROUND(x[3], x[4], x[9], x[14]);
+	}
+
+	for (i = 0; i < 16; ++i) {
+		uint32_t v = x[i] + in[i];
+
+		out[i * 4] = v;
+		out[i * 4 + 1] = v >> 8;
+		out[i * 4 + 2] = v >> 16;
+		out[i * 4 + 3] = v >> 24;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Mix bytes from /dev/urandom in to the key of a thread's generator
+ *
+ * \retval 0 success
+ * \retval -1 /dev/urandom could not be read
+ */
+static int random_state_reseed(struct random_state *state)
+{
+	uint32_t seed[CHACHA20_KEY / 4];
+	size_t got = 0;
+	int i;
+
+	while (got < sizeof(seed)) {
+		ssize_t res = dev_urandom_fd < 0 ? -1
+			: read(dev_urandom_fd, (char *) seed + got, sizeof(seed) - got);
+
+		if (res <= 0) {
+			if (res < 0 && errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		got += res;
+	}
+
+	for (i = 0; i < ARRAY_LEN(seed); ++i) {
+		state->key[i] ^= seed[i];
+	}
+	memset(seed, 0, sizeof(seed));
+	state->seeded = 1;
+	state->generated = 0;
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Refill the buffer of a thread's generator
+ *
+ * \retval 0 success
+ * \retval -1 the generator was never seeded
+ */
+static int random_state_refill(struct random_state *state)
+{
+	int i;
+
+	if (!state->seeded || state->generated >= RANDOM_RESEED_BYTES) {
+		/* Once seeded a failed reseed is not fatal, the key is still secret */
+		if (random_state_reseed(state) && !state->seeded) {
+			return -1;
+		}
+	}
+
+	for (i = 0; i < RANDOM_BLOCKS; ++i) {
+		chacha20_block(state->key, i, state->buf + i * CHACHA20_BLOCK);
+	}
+	memcpy(state->key, state->buf, CHACHA20_KEY);
+	memset(state->buf, 0, CHACHA20_KEY);
+	state->used = CHACHA20_KEY;
+	return 0;
+}
+
+int ast_random_bytes(void *buf, size_t len)
+{
+	struct random_state *state = ast_threadstorage_get(&random_state_buf, sizeof(*state));
+	unsigned char *out = buf;
+
+	if (!state) {
+		return -1;
+	}
+
+	while (len) {
+		size_t chunk;
+
+		if (state->used == sizeof(state->buf) && random_state_refill(state)) {
+			return -1;
+		}
+		chunk = MIN(len, sizeof(state->buf) - state->used);
+		memcpy(out, state->buf + state->used, chunk);
+		memset(state->buf + state->used, 0, chunk);
+		state->used += chunk;
+		state->generated += chunk;
+		out += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
 #ifndef linux
 AST_MUTEX_DEFINE_STATIC(randomlock);
 #endif
@@ -1922,14 +2109,11 @@ long int ast_random(void)
 {
 	long int res;
 
-	if (dev_urandom_fd >= 0) {
-		int read_res = read(dev_urandom_fd, &res, sizeof(res));
-		if (read_res > 0) {
-			long int rm = RAND_MAX;
-			res = res < 0 ? ~res : res;
-			rm++;
-			return res % rm;
-		}
+	if (!ast_random_bytes(&res, sizeof(res))) {
+		long int rm = RAND_MAX;
+		res = res < 0 ? ~res : res;
+		rm++;
+		return res % rm;
 	}
 
 	/* XXX - Thread safety really depends on the libc, not the OS.
@@ -2228,7 +2412,8 @@ void __ast_string_field_release_active(struct ast_string_field_pool *pool_head,
 {
 	struct ast_string_field_pool *pool, *prev;
 
-	if (ptr == __ast_string_field_empty) {
+	/* The empty string and interned strings are not in any pool */
+	if (ptr == __ast_string_field_empty || !AST_STRING_FIELD_ALLOCATION(ptr)) {
 		return;
 	}
 
@@ -2388,6 +2573,133 @@ void *__ast_calloc_with_stringfields(unsigned int num_structs, size_t struct_siz
 	return allocation;
 }
 
+/*! \brief Size of the interned string arena */
+#define INTERN_ARENA_SIZE (4 * 1024 * 1024)
+/*! \brief Longest string that is interned */
+#define INTERN_MAX_LENGTH 255
+/*! \brief Number of buckets of the interned string table */
+#define INTERN_BUCKETS 2048
+
+/*!
+ * \brief A string in the interned string arena
+ *
+ * The allocation in front of the string is 0, as for the empty string,
+ * so the stringfield code never writes to it nor releases it.
+ */
+struct interned_string {
+	/*! Next string in the bucket */
+	struct interned_string *next;
+	unsigned int hash;
+	ast_string_field_allocation allocation;
+	char str[0];
+};
+
+/*! \brief Protects the interned string table and the arena when adding to them */
+AST_RWLOCK_DEFINE_STATIC(interned_lock);
+static struct interned_string *interned_table[INTERN_BUCKETS];
+/*!
+ * \brief The arena of interned strings
+ *
+ * Its place never changes, so telling whether a string is interned takes
+ * no lock.  The pages are only backed by memory once strings are put there.
+ */
+static char intern_arena[INTERN_ARENA_SIZE] __attribute__((aligned(sizeof(void *))));
+/*! \brief Space used in the arena */
+static size_t intern_arena_used;
+
+int __ast_string_field_is_interned(const char *str)
+{
+	return (uintptr_t) str - (uintptr_t) intern_arena < INTERN_ARENA_SIZE;
+}
+
+/*! \note interned_lock must be held */
+static struct interned_string *interned_string_find(unsigned int hash, const char *str)
+{
+	struct interned_string *interned;
+
+	for (interned = interned_table[hash % INTERN_BUCKETS]; interned; interned = interned->next) {
+		if (interned->hash == hash && !strcmp(interned->str, str)) {
+			break;
+		}
+	}
+	return interned;
+}
+
+/*! \note interned_lock must be held for writing */
+static struct interned_string *interned_string_alloc(size_t len)
+{
+	static int warned;
+	struct interned_string *interned;
+	/* Keep the next entries aligned for their next pointer */
+	size_t size = (sizeof(*interned) + len + 1 + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (intern_arena_used + size > INTERN_ARENA_SIZE) {
+		if (!warned) {
+			warned = 1;
+			ast_log(LOG_WARNING, "The interned string arena is full, strings are copied instead\n");
+		}
+		return NULL;
+	}
+
+	interned = (struct interned_string *) (intern_arena + intern_arena_used);
+	intern_arena_used += size;
+	return interned;
+}
+
+/*!
+ * \internal
+ * \brief Find or add the interned copy of a string
+ *
+ * \return The interned copy, or NULL if it could not be interned
+ */
+static const char *string_field_intern(const char *str)
+{
+	size_t len = strlen(str);
+	struct interned_string *interned;
+	unsigned int hash;
+
+	if (len > INTERN_MAX_LENGTH) {
+		return NULL;
+	}
+
+	hash = ast_str_hash(str);
+	ast_rwlock_rdlock(&interned_lock);
+	interned = interned_string_find(hash, str);
+	ast_rwlock_unlock(&interned_lock);
+	if (interned) {
+		return interned->str;
+	}
+
+	ast_rwlock_wrlock(&interned_lock);
+	if (!(interned = interned_string_find(hash, str))
+		&& (interned = interned_string_alloc(len))) {
+		interned->hash = hash;
+		interned->allocation = 0;
+		memcpy(interned->str, str, len + 1);
+		interned->next = interned_table[hash % INTERN_BUCKETS];
+		interned_table[hash % INTERN_BUCKETS] = interned;
+	}
+	ast_rwlock_unlock(&interned_lock);
+
+	return interned ? interned->str : NULL;
+}
+
+int __ast_string_field_ptr_set_interned(struct ast_string_field_mgr *mgr,
+	struct ast_string_field_pool **pool_head, ast_string_field *ptr, const char *data)
+{
+	const char *interned;
+
+	if (ast_strlen_zero(data)
+		|| !(interned = __ast_string_field_is_interned(data) ? data : string_field_intern(data))) {
+		/* Stored in the pool like any other value */
+		return ast_string_field_ptr_set_by_fields(*pool_head, *mgr, ptr, data);
+	}
+
+	__ast_string_field_release_active(*pool_head, *ptr);
+	*ptr = interned;
+	return 0;
+}
+
 /* end of stringfields support */
 
 AST_MUTEX_DEFINE_STATIC(fetchadd_m); /* used for all fetc&add ops */
@@ -2402,6 +2714,18 @@ int ast_atomic_fetchadd_int_slow(volatile int *p, int v)
 	return ret;
 }
 
+int ast_atomic_compare_and_swap_ptr_slow(void * volatile *p, void *old, void *new)
+{
+	int ret;
+	ast_mutex_lock(&fetchadd_m);
+	ret = *p == old;
+	if (ret) {
+		*p = new;
+	}
+	ast_mutex_unlock(&fetchadd_m);
+	return ret;
+}
+
 /*! \brief
  * get values from config variables.
  */
@@ -2747,6 +3071,8 @@ int _ast_asprintf(char **ret, const char *file, int lineno, const char *func, co
 	va_start(ap, fmt);
 	if ((res = vasprintf(ret, fmt, ap)) == -1) {
 		MALLOC_FAILURE_MSG;
+	} else {
+		AST_MM_SAMPLE_ALLOC(*ret, res + 1);
 	}
 	va_end(ap);
 
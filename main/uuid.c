@@ -51,6 +51,18 @@ struct ast_uuid {
  */
 static void generate_uuid(struct ast_uuid *uuid)
 {
+	/* UUIDs are generated for every channel, bridge and Stasis message, so
+	 * the bytes of a random (version 4) UUID normally come from the per-thread
+	 * generator of ast_random_bytes(), which takes no locks and makes no system
+	 * calls. libuuid is only used if that fails.
+	 */
+	if (!ast_random_bytes(uuid->uu, sizeof(uuid->uu))) {
+		/* Version 4 and the RFC 4122 variant, see RFC 4122 section 4.4 */
+		uuid->uu[6] = (uuid->uu[6] & 0x0f) | 0x40;
+		uuid->uu[8] = (uuid->uu[8] & 0x3f) | 0x80;
+		return;
+	}
+
 	/* libuuid provides three methods of generating uuids,
 	 * uuid_generate(), uuid_generate_random(), and uuid_generate_time().
 	 *
@@ -52,10 +52,16 @@ static const int xmldoc_text_columns = 79;
 /*! \brief XML documentation language. */
 static char documentation_language[6];
 
+/*! \brief Only list the documentation files at startup, and parse them when first needed. */
+static int documentation_lazy;
+
+/*! \brief Whether the listed documentation files have been parsed. */
+static int documentation_opened;
+
 /*! \brief XML documentation tree */
 struct documentation_tree {
 	char *filename;					/*!< XML document filename. */
-	struct ast_xml_doc *doc;			/*!< Open document pointer. */
+	struct ast_xml_doc *doc;			/*!< Open document pointer, NULL until parsed in lazy mode. */
 	AST_RWLIST_ENTRY(documentation_tree) entry;
 };
 
@@ -76,6 +82,81 @@ static int xmldoc_parse_specialtags(struct ast_xml_node *fixnode, const char *ta
  */
 static AST_RWLIST_HEAD_STATIC(xmldoc_tree, documentation_tree);
 
+/*!
+ * \internal
+ * \brief Parse an XML documentation file
+ *
+ * \param filename The file to parse.
+ *
+ * \retval NULL if it could not be parsed or is not a documentation file.
+ * \return The document otherwise.
+ */
+static struct ast_xml_doc *xmldoc_open_document(char *filename)
+{
+	struct ast_xml_node *root_node;
+	struct ast_xml_doc *tmpdoc;
+
+	tmpdoc = ast_xml_open(filename);
+	if (!tmpdoc) {
+		ast_log(LOG_ERROR, "Could not open XML documentation at '%s'\n", filename);
+		return NULL;
+	}
+	/* Get doc root node and check if it starts with '<docs>' */
+	root_node = ast_xml_get_root(tmpdoc);
+	if (!root_node) {
+		ast_log(LOG_ERROR, "Error getting documentation root node\n");
+		ast_xml_close(tmpdoc);
+		return NULL;
+	}
+	/* Check root node name for malformed xmls. */
+	if (strcmp(ast_xml_node_get_name(root_node), "docs")) {
+		ast_log(LOG_ERROR, "Documentation file is not well formed!\n");
+		ast_xml_close(tmpdoc);
+		return NULL;
+	}
+	return tmpdoc;
+}
+
+/*!
+ * \internal
+ * \brief Parse the documentation files listed but not yet parsed in lazy mode
+ *
+ * Called before anything reads the documentation trees. Files that cannot be
+ * parsed are dropped from the list.
+ */
+static void xmldoc_open_pending(void)
+{
+	struct documentation_tree *doctree;
+	int opened;
+
+	AST_RWLIST_RDLOCK(&xmldoc_tree);
+	opened = documentation_opened;
+	AST_RWLIST_UNLOCK(&xmldoc_tree);
+	if (opened) {
+		return;
+	}
+
+	AST_RWLIST_WRLOCK(&xmldoc_tree);
+	if (!documentation_opened) {
+		ast_debug(1, "Parsing XML documentation on first use\n");
+		AST_RWLIST_TRAVERSE_SAFE_BEGIN(&xmldoc_tree, doctree, entry) {
+			if (!doctree->doc && !(doctree->doc = xmldoc_open_document(doctree->filename))) {
+				AST_RWLIST_REMOVE_CURRENT(entry);
+				ast_free(doctree->filename);
+				ast_free(doctree);
+			}
+		}
+		AST_RWLIST_TRAVERSE_SAFE_END;
+		documentation_opened = 1;
+	}
+	AST_RWLIST_UNLOCK(&xmldoc_tree);
+}
+
+int ast_xmldoc_lazy(void)
+{
+	return documentation_lazy;
+}
+
 static const struct strcolorized_tags {
 	const char *init;      /*!< Replace initial tag with this string. */
 	const char *end;       /*!< Replace end tag with this string. */
@@ -440,6 +521,7 @@ static struct ast_xml_node *xmldoc_get_node(const char *type, const char *name,
 	struct ast_xml_node *lang_match = NULL;
 	struct documentation_tree *doctree;
 
+	xmldoc_open_pending();
 	AST_RWLIST_RDLOCK(&xmldoc_tree);
 	AST_LIST_TRAVERSE(&xmldoc_tree, doctree, entry) {
 		/* the core xml documents have priority over thirdparty document. */
@@ -2561,6 +2643,7 @@ struct ast_xml_xpath_results *__attribute__((format(printf, 1, 2))) ast_xmldoc_q
 		return NULL;
 	}
 
+	xmldoc_open_pending();
 	AST_RWLIST_RDLOCK(&xmldoc_tree);
 	AST_LIST_TRAVERSE(&xmldoc_tree, doctree, entry) {
 		if (!(results = ast_xml_query(doctree->doc, ast_str_buffer(xpath_str)))) {
@@ -2662,6 +2745,7 @@ struct ao2_container *ast_xmldoc_build_documentation(const char *type)
 		return NULL;
 	}
 
+	xmldoc_open_pending();
 	AST_RWLIST_RDLOCK(&xmldoc_tree);
 	AST_LIST_TRAVERSE(&xmldoc_tree, doctree, entry) {
 		/* the core xml documents have priority over thirdparty document. */
@@ -2805,6 +2889,7 @@ static char *handle_dump_docs(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 		ast_log(LOG_ERROR, "Could not open file '%s': %s\n", a->argv[2], strerror(errno));
 		return CLI_FAILURE;
 	}
+	xmldoc_open_pending();
 	AST_RWLIST_RDLOCK(&xmldoc_tree);
 	AST_LIST_TRAVERSE(&xmldoc_tree, doctree, entry) {
 		ast_xml_doc_dump_file(f, doctree->doc);
@@ -2836,7 +2921,6 @@ static void xmldoc_unload_documentation(void)
 
 int ast_xmldoc_load_documentation(void)
 {
-	struct ast_xml_node *root_node;
 	struct ast_xml_doc *tmpdoc;
 	struct documentation_tree *doc_tree;
 	char *xmlpattern;
@@ -2858,6 +2942,8 @@ int ast_xmldoc_load_documentation(void)
 				if (!ast_strlen_zero(var->value)) {
 					snprintf(documentation_language, sizeof(documentation_language), "%s", var->value);
 				}
+			} else if (!strcasecmp(var->name, "lazy_documentation")) {
+				documentation_lazy = ast_true(var->value);
 			}
 		}
 		ast_config_destroy(cfg);
@@ -2914,22 +3000,7 @@ int ast_xmldoc_load_documentation(void)
 			continue;
 		}
 		tmpdoc = NULL;
-		tmpdoc = ast_xml_open(globbuf.gl_pathv[i]);
-		if (!tmpdoc) {
-			ast_log(LOG_ERROR, "Could not open XML documentation at '%s'\n", globbuf.gl_pathv[i]);
-			continue;
-		}
-		/* Get doc root node and check if it starts with '<docs>' */
-		root_node = ast_xml_get_root(tmpdoc);
-		if (!root_node) {
-			ast_log(LOG_ERROR, "Error getting documentation root node\n");
-			ast_xml_close(tmpdoc);
-			continue;
-		}
-		/* Check root node name for malformed xmls. */
-		if (strcmp(ast_xml_node_get_name(root_node), "docs")) {
-			ast_log(LOG_ERROR, "Documentation file is not well formed!\n");
-			ast_xml_close(tmpdoc);
+		if (!documentation_lazy && !(tmpdoc = xmldoc_open_document(globbuf.gl_pathv[i]))) {
 			continue;
 		}
 		doc_tree = ast_calloc(1, sizeof(*doc_tree));
@@ -2942,6 +3013,7 @@ int ast_xmldoc_load_documentation(void)
 		doc_tree->filename = ast_strdup(globbuf.gl_pathv[i]);
 		AST_RWLIST_INSERT_TAIL(&xmldoc_tree, doc_tree, entry);
 	}
+	documentation_opened = !documentation_lazy;
 	AST_RWLIST_UNLOCK(&xmldoc_tree);
 
 	globfree(&globbuf);
@@ -104,6 +104,8 @@ static int write_protect_config = 1;
 static int autofallthrough_config = 1;
 static int clearglobalvars_config = 0;
 static int extenpatternmatchnew_config = 0;
+static int extenpatterncompile_config = 0;
+static int hintcoalesce_config = 0;
 static char *overrideswitch_config = NULL;
 
 AST_MUTEX_DEFINE_STATIC(save_dialplan_lock);
@@ -872,13 +874,14 @@ static char *handle_cli_dialplan_save(struct ast_cli_entry *e, int cmd, struct a
 	if (overrideswitch_config) {
 		snprintf(overrideswitch, sizeof(overrideswitch), "overrideswitch=%s\n", overrideswitch_config);
 	}
-	fprintf(output, "[general]\nstatic=%s\nwriteprotect=%s\nautofallthrough=%s\nclearglobalvars=%s\n%sextenpatternmatchnew=%s\n\n",
+	fprintf(output, "[general]\nstatic=%s\nwriteprotect=%s\nautofallthrough=%s\nclearglobalvars=%s\n%sextenpatternmatchnew=%s\nextenpatterncompile=%s\n\n",
 		static_config ? "yes" : "no",
 		write_protect_config ? "yes" : "no",
                 autofallthrough_config ? "yes" : "no",
 				clearglobalvars_config ? "yes" : "no",
 				overrideswitch_config ? overrideswitch : "",
-				extenpatternmatchnew_config ? "yes" : "no");
+				extenpatternmatchnew_config ? "yes" : "no",
+				extenpatterncompile_config ? "yes" : "no");
 
 	if ((v = ast_variable_browse(cfg, "globals"))) {
 		fprintf(output, "[globals]\n");
@@ -1539,7 +1542,7 @@ static char *complete_dialplan_remove_ignorepat(struct ast_cli_args *a)
 	return NULL;
 }
 
-static int pbx_load_module(void);
+static int pbx_load_module(int clear_globals);
 
 static char *handle_cli_dialplan_reload(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
@@ -1559,10 +1562,7 @@ static char *handle_cli_dialplan_reload(struct ast_cli_entry *e, int cmd, struct
 	if (a->argc != 2)
 		return CLI_SHOWUSAGE;
 
-	if (clearglobalvars_config)
-		pbx_builtin_clear_globals();
-
-	pbx_load_module();
+	pbx_load_module(clearglobalvars_config);
 	ast_cli(a->fd, "Dialplan reloaded.\n");
 	return CLI_SUCCESS;
 }
@@ -1640,7 +1640,7 @@ static char *pbx_strsep(char **destructible, const char *delim)
 	return res;
 }
 
-static int pbx_load_config(const char *config_file)
+static int pbx_load_config(const char *config_file, int clear_globals)
 {
 	struct ast_config *cfg;
 	char *end;
@@ -1655,7 +1655,7 @@ static int pbx_load_config(const char *config_file)
 	struct ast_variable *v;
 	const char *cxt;
 	const char *aft;
-	const char *newpm, *ovsw;
+	const char *newpm, *ovsw, *compile, *coalesce;
 	struct ast_flags config_flags = { 0 };
 	char lastextension[256];
 	cfg = ast_config_load(config_file, config_flags);
@@ -1669,6 +1669,14 @@ static int pbx_load_config(const char *config_file)
 		autofallthrough_config = ast_true(aft);
 	if ((newpm = ast_variable_retrieve(cfg, "general", "extenpatternmatchnew")))
 		extenpatternmatchnew_config = ast_true(newpm);
+	if ((compile = ast_variable_retrieve(cfg, "general", "extenpatterncompile")))
+		extenpatterncompile_config = ast_true(compile);
+	if ((coalesce = ast_variable_retrieve(cfg, "general", "hintcoalesce"))) {
+		if (sscanf(coalesce, "%30d", &hintcoalesce_config) != 1 || hintcoalesce_config < 0) {
+			ast_log(LOG_WARNING, "Invalid hintcoalesce value '%s', must be a number of milliseconds\n", coalesce);
+			hintcoalesce_config = 0;
+		}
+	}
 	clearglobalvars_config = ast_true(ast_variable_retrieve(cfg, "general", "clearglobalvars"));
 	if ((ovsw = ast_variable_retrieve(cfg, "general", "overrideswitch"))) {
 		if (overrideswitch_config) {
@@ -1683,10 +1691,7 @@ static int pbx_load_config(const char *config_file)
 
 	ast_copy_string(userscontext, ast_variable_retrieve(cfg, "general", "userscontext") ?: "default", sizeof(userscontext));
 								    
-	for (v = ast_variable_browse(cfg, "globals"); v; v = v->next) {
-		pbx_substitute_variables_helper(NULL, v->value, realvalue, sizeof(realvalue) - 1);
-		pbx_builtin_setvar_helper(NULL, v->name, realvalue);
-	}
+	pbx_builtin_load_globals(ast_variable_browse(cfg, "globals"), clear_globals);
 	for (cxt = ast_category_browse(cfg, NULL);
 	     cxt;
 	     cxt = ast_category_browse(cfg, cxt)) {
@@ -2033,7 +2038,7 @@ static void pbx_load_users(void)
 	ast_config_destroy(cfg);
 }
 
-static int pbx_load_module(void)
+static int pbx_load_module(int clear_globals)
 {
 	struct ast_context *con;
 
@@ -2042,13 +2047,15 @@ static int pbx_load_module(void)
 	if (!local_table)
 		local_table = ast_hashtab_create(17, ast_hashtab_compare_contexts, ast_hashtab_resize_java, ast_hashtab_newsize_java, ast_hashtab_hash_contexts, 0);
 
-	if (!pbx_load_config(config)) {
+	if (!pbx_load_config(config, clear_globals)) {
 		ast_mutex_unlock(&reload_lock);
 		return AST_MODULE_LOAD_DECLINE;
 	}
 	
 	pbx_load_users();
 
+	/* The contexts are compiled as they are merged */
+	pbx_set_extenpatterncompile(extenpatterncompile_config);
 	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
 	local_table = NULL; /* the local table has been moved into the global one. */
 	local_contexts = NULL;
@@ -2061,6 +2068,7 @@ static int pbx_load_module(void)
 	pbx_set_overrideswitch(overrideswitch_config);
 	pbx_set_autofallthrough(autofallthrough_config);
 	pbx_set_extenpatternmatchnew(extenpatternmatchnew_config);
+	pbx_set_hint_coalesce(hintcoalesce_config);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -2083,7 +2091,7 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
-	if (pbx_load_module())
+	if (pbx_load_module(0))
 		return AST_MODULE_LOAD_DECLINE;
 
 	return AST_MODULE_LOAD_SUCCESS;
@@ -2091,9 +2099,7 @@ static int load_module(void)
 
 static int reload(void)
 {
-	if (clearglobalvars_config)
-		pbx_builtin_clear_globals();
-	return pbx_load_module();
+	return pbx_load_module(clearglobalvars_config);
 }
 
 AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_DEFAULT, "Text Extension Configuration",
@@ -42,6 +42,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/term.h"
 #include "asterisk/paths.h"
 #include "asterisk/hashtab.h"
+#include "asterisk/vector.h"
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -57,6 +58,11 @@ static char *registrar = "pbx_lua";
 #endif
 #define LUA_BUF_SIZE 4096
 
+/*! \brief Most idle lua_States kept for reuse */
+#define LUA_POOL_SIZE 64
+/*! \brief lua_States loaded ahead of the first calls on load and reload */
+#define LUA_POOL_PRELOAD 4
+
 /* This value is used by the lua engine to signal that a Goto or dialplan jump
  * was detected. Ensure this value does not conflict with any values dialplan
  * applications might return */
@@ -96,6 +102,13 @@ static void lua_create_autoservice_functions(lua_State *L);
 static void lua_create_hangup_function(lua_State *L);
 static void lua_concat_args(lua_State *L, int start, int nargs);
 
+static void lua_push_globals(lua_State *L);
+static void lua_save_globals(lua_State *L);
+static void lua_restore_globals(lua_State *L);
+static lua_State *lua_pool_get(struct ast_channel *chan);
+static void lua_pool_put(lua_State *L);
+static void lua_pool_preload(void);
+
 static void lua_state_destroy(void *data);
 static void lua_datastore_fixup(void *data, struct ast_channel *old_chan, struct ast_channel *new_chan);
 static lua_State *lua_get_state(struct ast_channel *chan);
@@ -109,6 +122,12 @@ AST_MUTEX_DEFINE_STATIC(config_file_lock);
 static char *config_file_data = NULL;
 static long config_file_size = 0;
 
+AST_MUTEX_DEFINE_STATIC(lua_pool_lock);
+/*! \brief Idle lua_States with extensions.lua loaded, ready for another call */
+static AST_VECTOR(, lua_State *) lua_pool;
+/*! \brief Changes whenever extensions.lua is reloaded, so older states are not reused */
+static int lua_pool_generation;
+
 static struct ast_context *local_contexts = NULL;
 static struct ast_hashtab *local_table = NULL;
 
@@ -125,7 +144,7 @@ static const struct ast_datastore_info lua_datastore = {
 static void lua_state_destroy(void *data)
 {
 	if (data)
-		lua_close(data);
+		lua_pool_put(data);
 }
 
 /*!
@@ -1171,6 +1190,10 @@ static int lua_load_extensions(lua_State *L, struct ast_channel *chan)
 		ast_mutex_unlock(&config_file_lock);
 		return 1;
 	}
+	ast_mutex_lock(&lua_pool_lock);
+	lua_pushinteger(L, lua_pool_generation);
+	ast_mutex_unlock(&lua_pool_lock);
+	lua_setfield(L, LUA_REGISTRYINDEX, "generation");
 	ast_mutex_unlock(&config_file_lock);
 
 	/* now we setup special tables and functions */
@@ -1184,6 +1207,9 @@ static int lua_load_extensions(lua_State *L, struct ast_channel *chan)
 	lua_create_autoservice_functions(L);
 	lua_create_hangup_function(L);
 
+	/* remember what was loaded, so the state can be reset for reuse */
+	lua_save_globals(L);
+
 	return 0;
 }
 
@@ -1215,6 +1241,13 @@ static int lua_reload_extensions(lua_State *L)
 
 	config_file_data = data;
 	config_file_size = size;
+
+	/* states loaded from the old extensions.lua are not reused */
+	ast_mutex_lock(&lua_pool_lock);
+	lua_pool_generation++;
+	AST_VECTOR_CALLBACK_VOID(&lua_pool, lua_close);
+	AST_VECTOR_RESET(&lua_pool, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	ast_mutex_unlock(&lua_pool_lock);
 	
 	/* merge our new contexts */
 	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
@@ -1237,78 +1270,257 @@ static void lua_free_extensions()
 	ast_mutex_lock(&config_file_lock);
 	config_file_size = 0;
 	ast_free(config_file_data);
+
+	ast_mutex_lock(&lua_pool_lock);
+	lua_pool_generation++;
+	AST_VECTOR_CALLBACK_VOID(&lua_pool, lua_close);
+	AST_VECTOR_FREE(&lua_pool);
+	ast_mutex_unlock(&lua_pool_lock);
 	ast_mutex_unlock(&config_file_lock);
 }
 
+/*!
+ * \brief Push the table of globals onto the stack
+ *
+ * \param L the lua_State to use
+ */
+static void lua_push_globals(lua_State *L)
+{
+#if LUA_VERSION_NUM < 502
+	lua_pushvalue(L, LUA_GLOBALSINDEX);
+#else
+	lua_pushglobaltable(L);
+#endif
+}
+
+/*!
+ * \brief Keep a copy of the globals in the registry
+ *
+ * \param L the lua_State to use
+ */
+static void lua_save_globals(lua_State *L)
+{
+	int saved, globals;
+
+	lua_newtable(L);
+	saved = lua_gettop(L);
+	lua_push_globals(L);
+	globals = lua_gettop(L);
+
+	for (lua_pushnil(L); lua_next(L, globals); lua_pop(L, 1)) {
+		lua_pushvalue(L, -2);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, saved);
+	}
+
+	lua_pop(L, 1);
+	lua_setfield(L, LUA_REGISTRYINDEX, "globals");
+}
+
+/*!
+ * \brief Put the globals back as lua_save_globals() found them
+ *
+ * Globals set since are removed and globals changed or removed since are
+ * restored.  Tables the globals refer to are not copied, so changes to what
+ * is in them are kept.
+ *
+ * \param L the lua_State to use
+ */
+static void lua_restore_globals(lua_State *L)
+{
+	int saved, globals;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, "globals");
+	saved = lua_gettop(L);
+	lua_push_globals(L);
+	globals = lua_gettop(L);
+
+	/* clearing a field while traversing the table is allowed */
+	for (lua_pushnil(L); lua_next(L, globals); lua_pop(L, 1)) {
+		lua_pushvalue(L, -2);
+		lua_rawget(L, saved);
+		if (lua_isnil(L, -1)) {
+			lua_pushvalue(L, -3);
+			lua_pushnil(L);
+			lua_rawset(L, globals);
+		}
+		lua_pop(L, 1);
+	}
+
+	for (lua_pushnil(L); lua_next(L, saved); lua_pop(L, 1)) {
+		lua_pushvalue(L, -2);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, globals);
+	}
+
+	lua_pop(L, 2);
+}
+
+/*!
+ * \brief Get a lua_State with extensions.lua loaded
+ *
+ * An idle state is taken from the pool if there is one, otherwise a new one
+ * is allocated and extensions.lua is loaded into it.
+ *
+ * \param chan the channel the state is for, or NULL
+ *
+ * \note The state should be given back with lua_pool_put().
+ *
+ * \return a lua_State, or NULL on error
+ */
+static lua_State *lua_pool_get(struct ast_channel *chan)
+{
+	lua_State *L = NULL;
+
+	ast_mutex_lock(&lua_pool_lock);
+	if (AST_VECTOR_SIZE(&lua_pool)) {
+		L = AST_VECTOR_REMOVE_UNORDERED(&lua_pool, AST_VECTOR_SIZE(&lua_pool) - 1);
+	}
+	ast_mutex_unlock(&lua_pool_lock);
+
+	if (L) {
+		lua_pushlightuserdata(L, chan);
+		lua_setfield(L, LUA_REGISTRYINDEX, "channel");
+		return L;
+	}
+
+	L = luaL_newstate();
+	if (!L) {
+		ast_log(LOG_ERROR, "Error allocating lua_State, no memory\n");
+		return NULL;
+	}
+
+	if (lua_load_extensions(L, chan)) {
+		const char *error = lua_tostring(L, -1);
+		if (chan) {
+			ast_log(LOG_ERROR, "Error loading extensions.lua for %s: %s\n", ast_channel_name(chan), error);
+		} else {
+			ast_log(LOG_ERROR, "Error loading extensions.lua: %s\n", error);
+		}
+		lua_close(L);
+		return NULL;
+	}
+
+	return L;
+}
+
+/*!
+ * \brief Give back a lua_State from lua_pool_get()
+ *
+ * The state is reset and kept in the pool for another call, unless the pool
+ * is full or extensions.lua was reloaded since the state was loaded, in
+ * which case it is closed.
+ *
+ * \param L the lua_State to give back
+ */
+static void lua_pool_put(lua_State *L)
+{
+	int generation;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, "generation");
+	generation = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+
+	ast_mutex_lock(&lua_pool_lock);
+	if (generation != lua_pool_generation || AST_VECTOR_SIZE(&lua_pool) >= LUA_POOL_SIZE) {
+		ast_mutex_unlock(&lua_pool_lock);
+		lua_close(L);
+		return;
+	}
+	ast_mutex_unlock(&lua_pool_lock);
+
+	/* forget the channel and whatever the last call left behind */
+	lua_settop(L, 0);
+
+	lua_pushlightuserdata(L, NULL);
+	lua_setfield(L, LUA_REGISTRYINDEX, "channel");
+
+	lua_pushboolean(L, 1);
+	lua_setfield(L, LUA_REGISTRYINDEX, "autoservice");
+
+	lua_pushnil(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, "context");
+	lua_pushnil(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, "exten");
+	lua_pushnil(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, "priority");
+
+	lua_restore_globals(L);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	ast_mutex_lock(&lua_pool_lock);
+	if (generation == lua_pool_generation && !AST_VECTOR_APPEND(&lua_pool, L)) {
+		L = NULL;
+	}
+	ast_mutex_unlock(&lua_pool_lock);
+
+	if (L) {
+		lua_close(L);
+	}
+}
+
+/*!
+ * \brief Load a few lua_States into the pool ahead of the first calls
+ */
+static void lua_pool_preload(void)
+{
+	lua_State *states[LUA_POOL_PRELOAD];
+	int count;
+	int i;
+
+	for (count = 0; count < LUA_POOL_PRELOAD; count++) {
+		if (!(states[count] = lua_pool_get(NULL))) {
+			break;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		lua_pool_put(states[i]);
+	}
+}
+
 /*!
  * \brief Get the lua_State for this channel
  *
- * If no channel is passed then a new state is allocated.  States with no
- * channel assocatied with them should only be used for matching extensions.
- * If the channel does not yet have a lua state associated with it, one will be
- * created.
+ * If no channel is passed then a state is taken from the pool.  States with
+ * no channel assocatied with them should only be used for matching
+ * extensions.  If the channel does not yet have a lua state associated with
+ * it, one will be taken from the pool and given back when the channel goes
+ * away.
  *
- * \note If no channel was passed then the caller is expected to free the state
- * using lua_close().
+ * \note If no channel was passed then the caller is expected to give the
+ * state back using lua_pool_put().
  *
  * \return a lua_State
  */
 static lua_State *lua_get_state(struct ast_channel *chan)
 {
 	struct ast_datastore *datastore = NULL;
-	lua_State *L;
 
 	if (!chan) {
-		L = luaL_newstate();
-		if (!L) {
-			ast_log(LOG_ERROR, "Error allocating lua_State, no memory\n");
-			return NULL;
-		}
-
-		if (lua_load_extensions(L, NULL)) {
-			const char *error = lua_tostring(L, -1);
-			ast_log(LOG_ERROR, "Error loading extensions.lua: %s\n", error);
-			lua_close(L);
-			return NULL;
-		}
-		return L;
+		return lua_pool_get(NULL);
 	} else {
 		ast_channel_lock(chan);
 		datastore = ast_channel_datastore_find(chan, &lua_datastore, NULL);
 		ast_channel_unlock(chan);
 
 		if (!datastore) {
-			/* nothing found, allocate a new lua state */
+			/* nothing found, get a lua state */
 			datastore = ast_datastore_alloc(&lua_datastore, NULL);
 			if (!datastore) {
 				ast_log(LOG_ERROR, "Error allocation channel datastore for lua_State\n");
 				return NULL;
 			}
 
-			datastore->data = luaL_newstate();
+			datastore->data = lua_pool_get(chan);
 			if (!datastore->data) {
 				ast_datastore_free(datastore);
-				ast_log(LOG_ERROR, "Error allocating lua_State, no memory\n");
 				return NULL;
 			}
 
 			ast_channel_lock(chan);
 			ast_channel_datastore_add(chan, datastore);
 			ast_channel_unlock(chan);
-
-			L = datastore->data;
-
-			if (lua_load_extensions(L, chan)) {
-				const char *error = lua_tostring(L, -1);
-				ast_log(LOG_ERROR, "Error loading extensions.lua for %s: %s\n", ast_channel_name(chan), error);
-
-				ast_channel_lock(chan);
-				ast_channel_datastore_remove(chan, datastore);
-				ast_channel_unlock(chan);
-
-				ast_datastore_free(datastore);
-				return NULL;
-			}
 		}
 
 		return datastore->data;
@@ -1333,7 +1545,7 @@ static int exists(struct ast_channel *chan, const char *context, const char *ext
 
 	res = lua_find_extension(L, context, exten, priority, &exists, 0);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_pool_put(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1356,7 +1568,7 @@ static int canmatch(struct ast_channel *chan, const char *context, const char *e
 
 	res = lua_find_extension(L, context, exten, priority, &canmatch, 0);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_pool_put(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1379,7 +1591,7 @@ static int matchmore(struct ast_channel *chan, const char *context, const char *
 	
 	res = lua_find_extension(L, context, exten, priority, &matchmore, 0);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_pool_put(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1408,7 +1620,7 @@ static int exec(struct ast_channel *chan, const char *context, const char *exten
 	if (!lua_find_extension(L, context, exten, priority, &exists, 1)) {
 		lua_pop(L, 1); /* pop the debug function */
 		ast_log(LOG_ERROR, "Could not find extension %s in context %s\n", exten, context);
-		if (!chan) lua_close(L);
+		if (!chan) lua_pool_put(L);
 		ast_module_user_remove(u);
 		return -1;
 	}
@@ -1455,7 +1667,7 @@ static int exec(struct ast_channel *chan, const char *context, const char *exten
 	}
 	lua_pop(L, 1);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_pool_put(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1640,6 +1852,10 @@ static int load_or_reload_lua_stuff(void)
 		ast_log(LOG_NOTICE, "Lua PBX Switch loaded.\n");
 	}
 	lua_close(L);
+
+	if (!res) {
+		lua_pool_preload();
+	}
 	return res;
 }
 
@@ -27,6 +27,32 @@
 	<support_level>extended</support_level>
  ***/
 
+/*** DOCUMENTATION
+	<manager name="RealtimeSwitchCacheFlush" language="en_US">
+		<synopsis>
+			Flush the cached results of realtime switch lookups
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Table">
+				<para>Only flush results from this realtime table.</para>
+			</parameter>
+			<parameter name="Context">
+				<para>Only flush results for this context.</para>
+			</parameter>
+			<parameter name="Exten">
+				<para>Only flush results for this extension.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Removes cached results of realtime switch lookups, so the next
+			lookup of each queries the realtime backend. With no filters every
+			cached result is removed. Results are cached according to
+			<filename>pbx_realtime.conf</filename>.</para>
+		</description>
+	</manager>
+ ***/
+
 #include "asterisk.h"
 
 ASTERISK_REGISTER_FILE()
@@ -53,6 +79,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/app.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/stasis_channels.h"
+#include "asterisk/dlinkedlists.h"
 
 #define MODE_MATCH 		0
 #define MODE_MATCHMORE 	1
@@ -60,6 +87,8 @@ ASTERISK_REGISTER_FILE()
 
 #define EXT_DATA_SIZE 256
 
+static const char config[] = "pbx_realtime.conf";
+
 enum option_flags {
 	OPTION_PATTERNS_DISABLED = (1 << 0),
 };
@@ -69,29 +98,86 @@ AST_APP_OPTIONS(switch_opts, {
 });
 
 struct cache_entry {
-	struct timeval when;
-	struct ast_variable *var;
+	struct timeval expires;
+	struct ast_variable *var;	/*!< Reversed result of the query, or NULL if nothing matched */
 	int priority;
+	int mode;
+	unsigned int options;		/*!< The switch options, which change the result */
+	char *table;
 	char *context;
-	char exten[2];
+	AST_DLLIST_ENTRY(cache_entry) lru;
+	char exten[0];
+};
+
+/*! \brief What a cache entry is found by */
+struct cache_key {
+	const char *table;
+	const char *context;
+	const char *exten;
+	int priority;
+	int mode;
+	unsigned int options;
 };
 
-struct ao2_container *cache;
+/*! \brief Default time results are cached for, in milliseconds */
+#define DEFAULT_CACHE_TTL 1000
+
+/*! \brief Time results are cached for, in milliseconds */
+static int cache_ttl = DEFAULT_CACHE_TTL;
+/*! \brief Time a query that matched nothing is cached for, in milliseconds */
+static int cache_negative_ttl;
+/*! \brief Most results cached, or 0 for no limit */
+static int cache_max_entries;
+
+/*! \brief Cached results, only used with cache_lock held */
+static struct ao2_container *cache;
+/*! \brief Cached results, the most recently used first */
+static AST_DLLIST_HEAD_NOLOCK_STATIC(cache_lru, cache_entry);
+AST_MUTEX_DEFINE_STATIC(cache_lock);
 pthread_t cleanup_thread = 0;
 
 static int cache_hash(const void *obj, const int flags)
 {
 	const struct cache_entry *e = obj;
-	return ast_str_case_hash(e->exten) + e->priority;
+	const struct cache_key *key = obj;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		return ast_str_case_hash(key->exten) + key->priority;
+	case OBJ_SEARCH_OBJECT:
+		return ast_str_case_hash(e->exten) + e->priority;
+	default:
+		/* Hash can only work on something with a full key. */
+		ast_assert(0);
+		return 0;
+	}
 }
 
 static int cache_cmp(void *obj, void *arg, int flags)
 {
 	struct cache_entry *e = obj, *f = arg;
-	return e->priority != f->priority ? 0 :
-		strcmp(e->exten, f->exten) ? 0 :
-		strcmp(e->context, f->context) ? 0 :
-		CMP_MATCH;
+	const struct cache_key *key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		return e->priority != key->priority ? 0 :
+			e->mode != key->mode ? 0 :
+			e->options != key->options ? 0 :
+			strcmp(e->exten, key->exten) ? 0 :
+			strcmp(e->context, key->context) ? 0 :
+			strcmp(e->table, key->table) ? 0 :
+			CMP_MATCH;
+	case OBJ_SEARCH_OBJECT:
+		return e->priority != f->priority ? 0 :
+			e->mode != f->mode ? 0 :
+			e->options != f->options ? 0 :
+			strcmp(e->exten, f->exten) ? 0 :
+			strcmp(e->context, f->context) ? 0 :
+			strcmp(e->table, f->table) ? 0 :
+			CMP_MATCH;
+	default:
+		return 0;
+	}
 }
 
 static struct ast_variable *dup_vars(struct ast_variable *v)
@@ -116,11 +202,29 @@ static void free_entry(void *obj)
 	ast_variables_destroy(e->var);
 }
 
+/*!
+ * \internal
+ * \brief Remove an entry from the cache
+ *
+ * \note The cache_lock must be held.
+ */
+static void cache_remove(struct cache_entry *e)
+{
+	AST_DLLIST_REMOVE(&cache_lru, e, lru);
+	ao2_unlink(cache, e);
+}
+
 static int purge_old_fn(void *obj, void *arg, int flags)
 {
 	struct cache_entry *e = obj;
 	struct timeval *now = arg;
-	return ast_tvdiff_ms(*now, e->when) >= 1000 ? CMP_MATCH : 0;
+
+	if (ast_tvcmp(*now, e->expires) < 0) {
+		return 0;
+	}
+	/* The container's reference goes with the unlink */
+	AST_DLLIST_REMOVE(&cache_lru, e, lru);
+	return CMP_MATCH;
 }
 
 static void *cleanup(void *unused)
@@ -135,7 +239,9 @@ static void *cleanup(void *unused)
 		}
 		pthread_testcancel();
 		now = ast_tvnow();
+		ast_mutex_lock(&cache_lock);
 		ao2_callback(cache, OBJ_MULTIPLE | OBJ_UNLINK | OBJ_NODATA, purge_old_fn, &now);
+		ast_mutex_unlock(&cache_lock);
 		pthread_testcancel();
 		nanosleep(&one_second, NULL);
 	}
@@ -143,6 +249,135 @@ static void *cleanup(void *unused)
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Find the cached result of a query
+ *
+ * \param key What was queried.
+ * \param var Set to a copy of the result, which may be NULL if nothing matched.
+ *
+ * \retval 0 The result was cached.
+ * \retval -1 It was not.
+ */
+static int cache_find(struct cache_key *key, struct ast_variable **var)
+{
+	struct cache_entry *e;
+	int res = -1;
+
+	ast_mutex_lock(&cache_lock);
+	e = ao2_find(cache, key, OBJ_SEARCH_KEY);
+	if (e) {
+		if (ast_tvcmp(ast_tvnow(), e->expires) >= 0) {
+			cache_remove(e);
+		} else {
+			AST_DLLIST_REMOVE(&cache_lru, e, lru);
+			AST_DLLIST_INSERT_HEAD(&cache_lru, e, lru);
+			*var = dup_vars(e->var);
+			/* A copy that failed is looked up again */
+			res = (e->var && !*var) ? -1 : 0;
+		}
+		ao2_ref(e, -1);
+	}
+	ast_mutex_unlock(&cache_lock);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Cache the result of a query
+ *
+ * \param key What was queried.
+ * \param var The result, or NULL if nothing matched.
+ */
+static void cache_add(struct cache_key *key, struct ast_variable *var)
+{
+	struct cache_entry *e;
+	struct cache_entry *old;
+	size_t exten_len = strlen(key->exten) + 1;
+	size_t context_len = strlen(key->context) + 1;
+	int ttl = var ? cache_ttl : cache_negative_ttl;
+
+	if (ttl <= 0) {
+		return;
+	}
+
+	if (!(e = ao2_alloc_options(sizeof(*e) + exten_len + context_len + strlen(key->table) + 1,
+		free_entry, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return;
+	}
+	if (var && !(e->var = dup_vars(var))) {
+		ao2_ref(e, -1);
+		return;
+	}
+	e->context = e->exten + exten_len;
+	e->table = e->context + context_len;
+	strcpy(e->exten, key->exten); /* SAFE */
+	strcpy(e->context, key->context); /* SAFE */
+	strcpy(e->table, key->table); /* SAFE */
+	e->priority = key->priority;
+	e->mode = key->mode;
+	e->options = key->options;
+	e->expires = ast_tvadd(ast_tvnow(), ast_samp2tv(ttl, 1000));
+
+	ast_mutex_lock(&cache_lock);
+	if ((old = ao2_find(cache, key, OBJ_SEARCH_KEY))) {
+		/* Another channel asked the same thing at the same time */
+		cache_remove(old);
+		ao2_ref(old, -1);
+	}
+	while (cache_max_entries > 0 && ao2_container_count(cache) >= cache_max_entries
+		&& (old = AST_DLLIST_REMOVE_TAIL(&cache_lru, lru))) {
+		ao2_unlink(cache, old);
+	}
+	ao2_link(cache, e);
+	AST_DLLIST_INSERT_HEAD(&cache_lru, e, lru);
+	ast_mutex_unlock(&cache_lock);
+
+	pthread_kill(cleanup_thread, SIGURG);
+	ao2_ref(e, -1);
+}
+
+/*! \brief What the cache is flushed of, where a field that is NULL matches anything */
+struct cache_filter {
+	const char *table;
+	const char *context;
+	const char *exten;
+};
+
+static int flush_fn(void *obj, void *arg, int flags)
+{
+	struct cache_entry *e = obj;
+	struct cache_filter *filter = arg;
+
+	if ((filter->table && strcmp(e->table, filter->table))
+		|| (filter->context && strcmp(e->context, filter->context))
+		|| (filter->exten && strcmp(e->exten, filter->exten))) {
+		return 0;
+	}
+	AST_DLLIST_REMOVE(&cache_lru, e, lru);
+	return CMP_MATCH;
+}
+
+/*!
+ * \internal
+ * \brief Remove the cached results that match a filter
+ *
+ * \return The number of results removed.
+ */
+static int cache_flush(struct cache_filter *filter)
+{
+	int count;
+
+	ast_mutex_lock(&cache_lock);
+	count = ao2_container_count(cache);
+	ao2_callback(cache, OBJ_MULTIPLE | OBJ_UNLINK | OBJ_NODATA, flush_fn, filter);
+	count -= ao2_container_count(cache);
+	ast_mutex_unlock(&cache_lock);
+
+	return count;
+}
+
 
 /* Realtime switch looks up extensions in the supplied realtime table.
 
@@ -223,11 +458,7 @@ static struct ast_variable *realtime_common(const char *context, const char *ext
 	char *table;
 	struct ast_variable *var=NULL;
 	struct ast_flags flags = { 0, };
-	struct cache_entry *ce;
-	struct {
-		struct cache_entry ce;
-		char exten[AST_MAX_EXTENSION];
-	} cache_search = { { .priority = priority, .context = (char *) context }, };
+	struct cache_key key;
 	char *buf = ast_strdupa(data);
 	/* "Realtime" prefix is stripped off in the parent engine.  The
 	 * remaining string is: [[context@]table][/opts] */
@@ -244,35 +475,15 @@ static struct ast_variable *realtime_common(const char *context, const char *ext
 	if (!ast_strlen_zero(opts)) {
 		ast_app_parse_options(switch_opts, &flags, NULL, opts);
 	}
-	ast_copy_string(cache_search.exten, exten, sizeof(cache_search.exten));
-	if (mode == MODE_MATCH && (ce = ao2_find(cache, &cache_search, OBJ_POINTER))) {
-		var = dup_vars(ce->var);
-		ao2_ref(ce, -1);
-	} else {
+	key.table = table;
+	key.context = ctx;
+	key.exten = exten;
+	key.priority = priority;
+	key.mode = mode;
+	key.options = flags.flags;
+	if (cache_find(&key, &var)) {
 		var = realtime_switch_common(table, ctx, exten, priority, mode, flags);
-		do {
-			struct ast_variable *new;
-			/* Only cache matches */
-			if (mode != MODE_MATCH) {
-				break;
-			}
-			if (!(new = dup_vars(var))) {
-				break;
-			}
-			if (!(ce = ao2_alloc(sizeof(*ce) + strlen(exten) + strlen(context), free_entry))) {
-				ast_variables_destroy(new);
-				break;
-			}
-			ce->context = ce->exten + strlen(exten) + 1;
-			strcpy(ce->exten, exten); /* SAFE */
-			strcpy(ce->context, context); /* SAFE */
-			ce->priority = priority;
-			ce->var = new;
-			ce->when = ast_tvnow();
-			ao2_link(cache, ce);
-			pthread_kill(cleanup_thread, SIGURG);
-			ao2_ref(ce, -1);
-		} while (0);
+		cache_add(&key, var);
 	}
 	return var;
 }
@@ -334,19 +545,26 @@ static int realtime_exec(struct ast_channel *chan, const char *context, const ch
 						 term_color(tmp2, ast_channel_name(chan), COLOR_BRMAGENTA, 0, sizeof(tmp2)),
 						 term_color(tmp3, S_OR(appdata, ""), COLOR_BRMAGENTA, 0, sizeof(tmp3)));
 				if (ast_channel_snapshot_type()) {
+					const char *saved_appl;
+					const char *saved_data;
+
+					/* pbx_exec sets application name and data, but we don't want to log
+					 * every exec. Just set them for the snapshot here instead.
+					 */
 					ast_channel_lock(chan);
+					saved_appl = ast_channel_appl(chan);
+					saved_data = ast_channel_data(chan);
+					ast_channel_appl_set(chan, app);
+					ast_channel_data_set(chan, !ast_strlen_zero(appdata) ? appdata : "(NULL)");
 					snapshot = ast_channel_snapshot_create(chan);
+					ast_channel_appl_set(chan, saved_appl);
+					ast_channel_data_set(chan, saved_data);
 					ast_channel_unlock(chan);
 				}
 				if (snapshot) {
-					/* pbx_exec sets application name and data, but we don't want to log
-					 * every exec. Just update the snapshot here instead.
-					 */
-					ast_string_field_set(snapshot, appl, app);
-					ast_string_field_set(snapshot, data, !ast_strlen_zero(appdata) ? appdata : "(NULL)");
 					msg = stasis_message_create(ast_channel_snapshot_type(), snapshot);
 					if (msg) {
-						stasis_publish(ast_channel_topic(chan), msg);
+						ast_channel_publish_message(chan, msg);
 					}
 				}
 				res = pbx_exec(chan, a, appdata);
@@ -379,8 +597,75 @@ static struct ast_switch realtime_switch =
 	.matchmore		= realtime_matchmore,
 };
 
+static int manager_cache_flush(struct mansession *s, const struct message *m)
+{
+	struct cache_filter filter = {
+		.table = S_OR(astman_get_header(m, "Table"), NULL),
+		.context = S_OR(astman_get_header(m, "Context"), NULL),
+		.exten = S_OR(astman_get_header(m, "Exten"), NULL),
+	};
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%d cached results flushed", cache_flush(&filter));
+	astman_send_ack(s, m, buf);
+	return 0;
+}
+
+static int load_config(int reload)
+{
+	struct ast_flags config_flags = { reload ? CONFIG_FLAG_FILEUNCHANGED : 0 };
+	struct ast_config *cfg;
+	struct ast_variable *v;
+	struct cache_filter all = { NULL, };
+	int ttl = DEFAULT_CACHE_TTL;
+	int negative_ttl = 0;
+	int max_entries = 0;
+
+	cfg = ast_config_load(config, config_flags);
+	if (cfg == CONFIG_STATUS_FILEUNCHANGED) {
+		return 0;
+	} else if (cfg == CONFIG_STATUS_FILEINVALID) {
+		ast_log(LOG_ERROR, "Config file %s is in an invalid format. Aborting.\n", config);
+		return -1;
+	}
+
+	if (cfg) {
+		for (v = ast_variable_browse(cfg, "general"); v; v = v->next) {
+			if (!strcasecmp(v->name, "cachettl")) {
+				if (sscanf(v->value, "%30d", &ttl) != 1 || ttl < 0) {
+					ast_log(LOG_WARNING, "Invalid cachettl '%s' at line %d of %s\n", v->value, v->lineno, config);
+					ttl = DEFAULT_CACHE_TTL;
+				}
+			} else if (!strcasecmp(v->name, "negativettl")) {
+				if (sscanf(v->value, "%30d", &negative_ttl) != 1 || negative_ttl < 0) {
+					ast_log(LOG_WARNING, "Invalid negativettl '%s' at line %d of %s\n", v->value, v->lineno, config);
+					negative_ttl = 0;
+				}
+			} else if (!strcasecmp(v->name, "cachesize")) {
+				if (sscanf(v->value, "%30d", &max_entries) != 1 || max_entries < 0) {
+					ast_log(LOG_WARNING, "Invalid cachesize '%s' at line %d of %s\n", v->value, v->lineno, config);
+					max_entries = 0;
+				}
+			} else {
+				ast_log(LOG_WARNING, "Unknown option '%s' at line %d of %s\n", v->name, v->lineno, config);
+			}
+		}
+		ast_config_destroy(cfg);
+	}
+
+	cache_ttl = ttl;
+	cache_negative_ttl = negative_ttl;
+	cache_max_entries = max_entries;
+
+	/* Results cached under the old settings are not kept */
+	cache_flush(&all);
+
+	return 0;
+}
+
 static int unload_module(void)
 {
+	ast_manager_unregister("RealtimeSwitchCacheFlush");
 	ast_unregister_switch(&realtime_switch);
 	pthread_cancel(cleanup_thread);
 	pthread_kill(cleanup_thread, SIGURG);
@@ -392,18 +677,33 @@ static int unload_module(void)
 
 static int load_module(void)
 {
-	if (!(cache = ao2_container_alloc(573, cache_hash, cache_cmp))) {
+	if (!(cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, 573, cache_hash, NULL, cache_cmp))) {
 		return AST_MODULE_LOAD_FAILURE;
 	}
 
+	if (load_config(0)) {
+		ao2_ref(cache, -1);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	if (ast_pthread_create(&cleanup_thread, NULL, cleanup, NULL)) {
 		return AST_MODULE_LOAD_FAILURE;
 	}
 
 	if (ast_register_switch(&realtime_switch))
 		return AST_MODULE_LOAD_FAILURE;
+	ast_manager_register_xml("RealtimeSwitchCacheFlush", EVENT_FLAG_CONFIG, manager_cache_flush);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
-AST_MODULE_INFO_STANDARD_EXTENDED(ASTERISK_GPL_KEY, "Realtime Switch");
+static int reload(void)
+{
+	return load_config(1);
+}
 
+AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_DEFAULT, "Realtime Switch",
+	.support_level = AST_MODULE_SUPPORT_EXTENDED,
+	.load = load_module,
+	.unload = unload_module,
+	.reload = reload,
+);
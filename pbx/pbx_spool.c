@@ -55,6 +55,11 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/options.h"
 #include "asterisk/format.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/config.h"
+#include "asterisk/astobj2.h"
+#include "asterisk/heap.h"
+#include "asterisk/sched.h"
+#include "asterisk/threadpool.h"
 
 /*
  * pbx_spool is similar in spirit to qcall, but with substantially enhanced functionality...
@@ -76,6 +81,15 @@ enum {
 static char qdir[255];
 static char qdonedir[255];
 
+/*! \brief Most calls in progress at once, 0 for no limit */
+static int maxcalls;
+
+/*! \brief The threads making the calls, started as calls need them */
+static struct ast_threadpool *attempt_pool;
+
+/*! \brief Releases the calls held back by a rate limit */
+static struct ast_sched_context *rate_sched;
+
 struct outgoing {
 	int retries;                              /*!< Current number of retries */
 	int maxretries;                           /*!< Maximum number of retries permitted */
@@ -99,18 +113,117 @@ struct outgoing {
 	struct ast_variable *vars;                /*!< Variables and Functions */
 	int maxlen;                               /*!< Maximum length of call */
 	struct ast_flags options;                 /*!< options */
+	AST_LIST_ENTRY(outgoing) list;            /*!< Waiting for its rate limit */
+};
+
+/*! \brief The rate calls to a channel or context are started at */
+struct rate_limit {
+	AST_LIST_ENTRY(rate_limit) list;
+	/*! Milliseconds between calls */
+	int interval;
+	/*! When the last call was started */
+	struct timeval last;
+	/*! The scheduled release of the next waiting call, or -1 */
+	int sched_id;
+	/*! The calls waiting to be started, oldest first */
+	AST_LIST_HEAD_NOLOCK(, outgoing) waiting;
+	/*! Non-zero to match a context, otherwise the start of Tech/Resource */
+	int is_context;
+	/*! The length of \a name */
+	size_t len;
+	char name[0];
 };
 
+/*!
+ * \brief The rate limits from pbx_spool.conf
+ *
+ * Only read when the module is loaded; the lock protects the calls waiting.
+ */
+static AST_LIST_HEAD_STATIC(rate_limits, rate_limit);
+
 #if defined(HAVE_INOTIFY) || defined(HAVE_KQUEUE)
 struct direntry {
 	AST_LIST_ENTRY(direntry) list;
 	time_t mtime;
+	ssize_t __heap_index;
 	char name[0];
 };
 
-static AST_LIST_HEAD_STATIC(dirlist, direntry);
+/*!
+ * \brief The call files waiting for their time, by name and soonest first
+ *
+ * Each entry queued is in both, and the heap holds the reference to it.
+ */
+static struct ao2_container *dirnames;
+static struct ast_heap *dirheap;
+AST_MUTEX_DEFINE_STATIC(dirlock);
 
 static void queue_file(const char *filename, time_t when);
+
+static struct direntry *direntry_alloc(const char *filename, time_t mtime)
+{
+	struct direntry *cur;
+
+	cur = ao2_alloc_options(sizeof(*cur) + strlen(filename) + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (cur) {
+		cur->mtime = mtime;
+		strcpy(cur->name, filename); /* SAFE */
+	}
+	return cur;
+}
+
+static int direntry_hash(const void *obj, const int flags)
+{
+	const struct direntry *cur;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		cur = obj;
+		key = cur->name;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int direntry_cmp(void *obj, void *arg, int flags)
+{
+	const struct direntry *cur = obj;
+	const struct direntry *right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->name;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(cur->name, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+/*! \brief Order the heap soonest first */
+static int direntry_mtime_cmp(void *elm1, void *elm2)
+{
+	const struct direntry *cur1 = elm1;
+	const struct direntry *cur2 = elm2;
+
+	return cur1->mtime < cur2->mtime ? 1 : cur1->mtime > cur2->mtime ? -1 : 0;
+}
+
+static int direntry_mtime_match(void *obj, void *arg, void *data, int flags)
+{
+	const struct direntry *cur = obj;
+
+	return cur->mtime == *(time_t *) data ? CMP_MATCH | CMP_STOP : 0;
+}
 #endif
 
 static void free_outgoing(struct outgoing *o)
@@ -332,6 +445,7 @@ static int remove_from_queue(struct outgoing *o, const char *status)
 	const char *bname;
 
 #if defined(HAVE_INOTIFY) || defined(HAVE_KQUEUE)
+	struct ao2_iterator *iter;
 	struct direntry *cur;
 #endif
 
@@ -346,16 +460,17 @@ static int remove_from_queue(struct outgoing *o, const char *status)
 	}
 
 #if defined(HAVE_INOTIFY) || defined(HAVE_KQUEUE)
-	AST_LIST_LOCK(&dirlist);
-	AST_LIST_TRAVERSE_SAFE_BEGIN(&dirlist, cur, list) {
-		if (!strcmp(cur->name, o->fn)) {
-			AST_LIST_REMOVE_CURRENT(list);
-			ast_free(cur);
-			break;
+	ast_mutex_lock(&dirlock);
+	iter = ao2_callback(dirnames, OBJ_SEARCH_KEY | OBJ_MULTIPLE | OBJ_UNLINK, NULL, (char *) o->fn);
+	if (iter) {
+		for (; (cur = ao2_iterator_next(iter)); ao2_ref(cur, -1)) {
+			if (ast_heap_remove(dirheap, cur)) {
+				ao2_ref(cur, -1);
+			}
 		}
+		ao2_iterator_destroy(iter);
 	}
-	AST_LIST_TRAVERSE_SAFE_END;
-	AST_LIST_UNLOCK(&dirlist);
+	ast_mutex_unlock(&dirlock);
 #endif
 
 	if (!ast_test_flag(&o->options, SPOOL_FLAG_ARCHIVE)) {
@@ -393,7 +508,7 @@ static int remove_from_queue(struct outgoing *o, const char *status)
 	return 0;
 }
 
-static void *attempt_thread(void *data)
+static int attempt_call(void *data)
 {
 	struct outgoing *o = data;
 	int res, reason;
@@ -427,18 +542,102 @@ static void *attempt_thread(void *data)
 		remove_from_queue(o, "Completed");
 	}
 	free_outgoing(o);
-	return NULL;
+	return 0;
+}
+
+static void start_call(struct outgoing *o)
+{
+	if (ast_threadpool_push(attempt_pool, attempt_call, o)) {
+		ast_log(LOG_WARNING, "Unable to start call to %s/%s\n", o->tech, o->dest);
+		free_outgoing(o);
+	}
+}
+
+/*! \brief Find the rate limit a call is held to, if any */
+static struct rate_limit *rate_limit_find(struct outgoing *o)
+{
+	struct rate_limit *limit;
+	struct rate_limit *found = NULL;
+	size_t tech_len = strlen(o->tech);
+
+	/* The longest channel matching, otherwise the context */
+	AST_LIST_TRAVERSE(&rate_limits, limit, list) {
+		if (limit->is_context) {
+			if (!found && ast_strlen_zero(o->app) && !strcmp(limit->name, o->context)) {
+				found = limit;
+			}
+			continue;
+		}
+		if ((found && !found->is_context && found->len >= limit->len)
+			|| strncasecmp(limit->name, o->tech, MIN(limit->len, tech_len))) {
+			continue;
+		}
+		if (limit->len <= tech_len
+			|| (limit->name[tech_len] == '/'
+				&& !strncmp(limit->name + tech_len + 1, o->dest, limit->len - tech_len - 1))) {
+			found = limit;
+		}
+	}
+	return found;
+}
+
+/*! \brief Start the call that has waited longest for a rate limit */
+static int rate_limit_release(const void *data)
+{
+	struct rate_limit *limit = (struct rate_limit *) data;
+	struct outgoing *o;
+	int res = 0;
+
+	AST_LIST_LOCK(&rate_limits);
+	o = AST_LIST_REMOVE_HEAD(&limit->waiting, list);
+	limit->last = ast_tvnow();
+	if (AST_LIST_EMPTY(&limit->waiting)) {
+		limit->sched_id = -1;
+	} else {
+		res = limit->interval;
+	}
+	AST_LIST_UNLOCK(&rate_limits);
+
+	if (o) {
+		start_call(o);
+	}
+	return res;
 }
 
 static void launch_service(struct outgoing *o)
 {
-	pthread_t t;
-	int ret;
+	struct rate_limit *limit;
+	int64_t elapsed;
 
-	if ((ret = ast_pthread_create_detached(&t, NULL, attempt_thread, o))) {
-		ast_log(LOG_WARNING, "Unable to create thread :( (returned error: %d)\n", ret);
-		free_outgoing(o);
+	AST_LIST_LOCK(&rate_limits);
+	if (!(limit = rate_limit_find(o))) {
+		AST_LIST_UNLOCK(&rate_limits);
+		start_call(o);
+		return;
+	}
+
+	elapsed = ast_tvdiff_ms(ast_tvnow(), limit->last);
+	if (AST_LIST_EMPTY(&limit->waiting) && elapsed >= limit->interval) {
+		limit->last = ast_tvnow();
+		AST_LIST_UNLOCK(&rate_limits);
+		start_call(o);
+		return;
+	}
+
+	/* Wait for its turn */
+	AST_LIST_INSERT_TAIL(&limit->waiting, o, list);
+	if (limit->sched_id == -1) {
+		limit->sched_id = ast_sched_add_variable(rate_sched,
+			MAX(limit->interval - elapsed, 1), rate_limit_release, limit, 1);
+		if (limit->sched_id == -1) {
+			AST_LIST_REMOVE(&limit->waiting, o, list);
+			AST_LIST_UNLOCK(&rate_limits);
+			ast_log(LOG_WARNING, "Unable to schedule call to %s/%s, starting it now\n", o->tech, o->dest);
+			start_call(o);
+			return;
+		}
 	}
+	AST_LIST_UNLOCK(&rate_limits);
 }
 
 /* Called from scan_thread or queue_file */
@@ -546,41 +745,28 @@ static void queue_file(const char *filename, time_t when)
 		when = st.st_mtime;
 	}
 
-	/* Need to check the existing list in order to avoid duplicates. */
-	AST_LIST_LOCK(&dirlist);
-	AST_LIST_TRAVERSE(&dirlist, cur, list) {
-		if (cur->mtime == when && !strcmp(filename, cur->name)) {
-			AST_LIST_UNLOCK(&dirlist);
-			return;
-		}
+	/* Need to check the files queued in order to avoid duplicates. */
+	ast_mutex_lock(&dirlock);
+	cur = ao2_callback_data(dirnames, OBJ_SEARCH_KEY, direntry_mtime_match, (char *) filename, &when);
+	if (cur) {
+		ao2_ref(cur, -1);
+		ast_mutex_unlock(&dirlock);
+		return;
 	}
 
 	if ((res = when) > now || (res = scan_service(filename, now)) > 0) {
-		if (!(new = ast_calloc(1, sizeof(*new) + strlen(filename) + 1))) {
-			AST_LIST_UNLOCK(&dirlist);
+		if (!(new = direntry_alloc(filename, res))) {
+			ast_mutex_unlock(&dirlock);
 			return;
 		}
-		new->mtime = res;
-		strcpy(new->name, filename);
-		/* List is ordered by mtime */
-		if (AST_LIST_EMPTY(&dirlist)) {
-			AST_LIST_INSERT_HEAD(&dirlist, new, list);
-		} else {
-			int found = 0;
-			AST_LIST_TRAVERSE_SAFE_BEGIN(&dirlist, cur, list) {
-				if (cur->mtime > new->mtime) {
-					AST_LIST_INSERT_BEFORE_CURRENT(new, list);
-					found = 1;
-					break;
-				}
-			}
-			AST_LIST_TRAVERSE_SAFE_END
-			if (!found) {
-				AST_LIST_INSERT_TAIL(&dirlist, new, list);
-			}
+		if (!ao2_link(dirnames, new)) {
+			ao2_ref(new, -1);
+		} else if (ast_heap_push(dirheap, new)) {
+			ao2_unlink(dirnames, new);
+			ao2_ref(new, -1);
 		}
 	}
-	AST_LIST_UNLOCK(&dirlist);
+	ast_mutex_unlock(&dirlock);
 }
 
 #ifdef HAVE_INOTIFY
@@ -594,12 +780,10 @@ static void queue_file_create(const char *filename)
 		}
 	}
 
-	if (!(cur = ast_calloc(1, sizeof(*cur) + strlen(filename) + 1))) {
+	/* We'll handle this file unless an IN_OPEN event occurs within 2 seconds */
+	if (!(cur = direntry_alloc(filename, time(NULL) + 2))) {
 		return;
 	}
-	strcpy(cur->name, filename);
-	/* We'll handle this file unless an IN_OPEN event occurs within 2 seconds */
-	cur->mtime = time(NULL) + 2;
 	AST_LIST_INSERT_TAIL(&createlist, cur, list);
 }
 
@@ -629,7 +813,7 @@ static void queue_created_files(void)
 
 		AST_LIST_REMOVE_CURRENT(list);
 		queue_file(cur->name, 0);
-		ast_free(cur);
+		ao2_ref(cur, -1);
 	}
 	AST_LIST_TRAVERSE_SAFE_END
 }
@@ -641,7 +825,7 @@ static void queue_file_write(const char *filename)
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&openlist, cur, list) {
 		if (!strcmp(cur->name, filename)) {
 			AST_LIST_REMOVE_CURRENT(list);
-			ast_free(cur);
+			ao2_ref(cur, -1);
 			queue_file(filename, 0);
 			break;
 		}
@@ -713,7 +897,12 @@ static void *scan_thread(void *unused)
 
 	/* Wait for either a) next timestamp to occur, or b) a change to happen */
 	for (;/* ever */;) {
-		time_t next = AST_LIST_EMPTY(&dirlist) ? INT_MAX : AST_LIST_FIRST(&dirlist)->mtime;
+		time_t next;
+
+		ast_mutex_lock(&dirlock);
+		cur = ast_heap_peek(dirheap, 1);
+		next = cur ? cur->mtime : INT_MAX;
+		ast_mutex_unlock(&dirlock);
 
 		time(&now);
 		if (next > now) {
@@ -794,14 +983,15 @@ static void *scan_thread(void *unused)
 		}
 #endif
 
-		/* Empty the list of all entries ready to be processed */
-		AST_LIST_LOCK(&dirlist);
-		while (!AST_LIST_EMPTY(&dirlist) && AST_LIST_FIRST(&dirlist)->mtime <= now) {
-			cur = AST_LIST_REMOVE_HEAD(&dirlist, list);
+		/* Take all entries ready to be processed off the queue */
+		ast_mutex_lock(&dirlock);
+		while ((cur = ast_heap_peek(dirheap, 1)) && cur->mtime <= now) {
+			ast_heap_pop(dirheap);
+			ao2_unlink(dirnames, cur);
 			queue_file(cur->name, cur->mtime);
-			ast_free(cur);
+			ao2_ref(cur, -1);
 		}
-		AST_LIST_UNLOCK(&dirlist);
+		ast_mutex_unlock(&dirlock);
 	}
 	return NULL;
 }
@@ -906,8 +1096,73 @@ static int unload_module(void)
 	return -1;
 }
 
+static struct rate_limit *rate_limit_alloc(const char *name, const char *value, int is_context)
+{
+	struct rate_limit *limit;
+	double rate;
+
+	if (sscanf(value, "%30lf", &rate) != 1 || rate <= 0) {
+		ast_log(LOG_WARNING, "Invalid rate '%s' for '%s' in pbx_spool.conf\n", value, name);
+		return NULL;
+	}
+
+	if (!(limit = ast_calloc(1, sizeof(*limit) + strlen(name) + 1))) {
+		return NULL;
+	}
+	limit->interval = MAX(1000.0 / rate, 1);
+	limit->sched_id = -1;
+	limit->is_context = is_context;
+	limit->len = strlen(name);
+	strcpy(limit->name, name); /* SAFE */
+
+	return limit;
+}
+
+static void load_config(void)
+{
+	struct ast_flags config_flags = { 0 };
+	struct ast_config *cfg;
+	struct ast_variable *var;
+	struct rate_limit *limit;
+
+	cfg = ast_config_load("pbx_spool.conf", config_flags);
+	if (!cfg || cfg == CONFIG_STATUS_FILEINVALID) {
+		return;
+	}
+
+	for (var = ast_variable_browse(cfg, "general"); var; var = var->next) {
+		if (!strcasecmp(var->name, "maxcalls")) {
+			if (sscanf(var->value, "%30d", &maxcalls) != 1 || maxcalls < 0) {
+				ast_log(LOG_WARNING, "Invalid maxcalls '%s' in pbx_spool.conf\n", var->value);
+				maxcalls = 0;
+			}
+		} else {
+			ast_log(LOG_WARNING, "Unknown option '%s' in [general] of pbx_spool.conf\n", var->name);
+		}
+	}
+
+	for (var = ast_variable_browse(cfg, "channelrates"); var; var = var->next) {
+		if ((limit = rate_limit_alloc(var->name, var->value, 0))) {
+			AST_LIST_INSERT_TAIL(&rate_limits, limit, list);
+		}
+	}
+	for (var = ast_variable_browse(cfg, "contextrates"); var; var = var->next) {
+		if ((limit = rate_limit_alloc(var->name, var->value, 1))) {
+			AST_LIST_INSERT_TAIL(&rate_limits, limit, list);
+		}
+	}
+
+	ast_config_destroy(cfg);
+}
+
 static int load_module(void)
 {
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 60,
+		.auto_increment = 1,
+		.initial_size = 0,
+	};
 	pthread_t thread;
 	int ret;
 	snprintf(qdir, sizeof(qdir), "%s/%s", ast_config_AST_SPOOL_DIR, "outgoing");
@@ -917,6 +1172,27 @@ static int load_module(void)
 	}
 	snprintf(qdonedir, sizeof(qdir), "%s/%s", ast_config_AST_SPOOL_DIR, "outgoing_done");
 
+	load_config();
+
+	/* Calls beyond maxcalls wait in the pool's queue for a thread */
+	options.max_size = maxcalls;
+	if (!(attempt_pool = ast_threadpool_create("pbx_spool", NULL, &options))) {
+		return AST_MODULE_LOAD_FAILURE;
+	}
+	if (!AST_LIST_EMPTY(&rate_limits)
+		&& (!(rate_sched = ast_sched_context_create()) || ast_sched_start_thread(rate_sched))) {
+		ast_log(LOG_WARNING, "Unable to start the scheduler for rate limits\n");
+		return AST_MODULE_LOAD_FAILURE;
+	}
+
+#if defined(HAVE_INOTIFY) || defined(HAVE_KQUEUE)
+	dirnames = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, 257, direntry_hash, direntry_cmp);
+	dirheap = ast_heap_create(8, direntry_mtime_cmp, offsetof(struct direntry, __heap_index));
+	if (!dirnames || !dirheap) {
+		return AST_MODULE_LOAD_FAILURE;
+	}
+#endif
+
 	if ((ret = ast_pthread_create_detached_background(&thread, NULL, scan_thread, NULL))) {
 		ast_log(LOG_WARNING, "Unable to create thread :( (returned error: %d)\n", ret);
 		return AST_MODULE_LOAD_FAILURE;
@@ -34,6 +34,8 @@ ASTERISK_REGISTER_FILE()
 struct ast_ari_websocket_session {
 	struct ast_websocket *ws_session;
 	int (*validator)(struct ast_json *);
+	/*! Messages are encoded here, so each does not need a string of its own */
+	struct ast_str *buf;
 };
 
 static void websocket_session_dtor(void *obj)
@@ -42,6 +44,7 @@ static void websocket_session_dtor(void *obj)
 
 	ast_websocket_unref(session->ws_session);
 	session->ws_session = NULL;
+	ast_free(session->buf);
 }
 
 /*!
@@ -82,11 +85,20 @@ struct ast_ari_websocket_session *ast_ari_websocket_session_create(
 			config->general->write_timeout);
 	}
 
+	if (ast_websocket_set_coalesce(ws_session, config->general->websocket_coalesce)) {
+		ast_log(LOG_WARNING, "Failed to set event coalescing on ARI web socket\n");
+	}
+
 	session = ao2_alloc(sizeof(*session), websocket_session_dtor);
 	if (!session) {
 		return NULL;
 	}
 
+	session->buf = ast_str_create(1024);
+	if (!session->buf) {
+		return NULL;
+	}
+
 	ao2_ref(ws_session, +1);
 	session->ws_session = ws_session;
 	session->validator = validator;
@@ -158,7 +170,8 @@ struct ast_json *ast_ari_websocket_session_read(
 int ast_ari_websocket_session_write(struct ast_ari_websocket_session *session,
 	struct ast_json *message)
 {
-	RAII_VAR(char *, str, NULL, ast_json_free);
+	struct ast_json_writer writer;
+	int res;
 
 #ifdef AST_DEVMODE
 	if (!session->validator(message)) {
@@ -167,15 +180,21 @@ int ast_ari_websocket_session_write(struct ast_ari_websocket_session *session,
 	}
 #endif
 
-	str = ast_json_dump_string_format(message, ast_ari_json_format());
-
-	if (str == NULL) {
+	ao2_lock(session);
+	ast_str_reset(session->buf);
+	ast_json_writer_init(&writer, &session->buf, ast_ari_json_format());
+	if (ast_json_writer_value(&writer, message)) {
+		ao2_unlock(session);
 		ast_log(LOG_ERROR, "Failed to encode JSON object\n");
 		return -1;
 	}
 
-	ast_debug(3, "Examining ARI event (length %u): \n%s\n", (unsigned int) strlen(str), str);
-	if (ast_websocket_write_string(session->ws_session, str)) {
+	ast_debug(3, "Examining ARI event (length %zu): \n%s\n",
+		ast_str_strlen(session->buf), ast_str_buffer(session->buf));
+	res = ast_websocket_write_string(session->ws_session, ast_str_buffer(session->buf));
+	ao2_unlock(session);
+
+	if (res) {
 		ast_log(LOG_NOTICE, "Problem occurred during websocket write, websocket closed\n");
 		return -1;
 	}
@@ -187,11 +206,20 @@ void ari_handle_websocket(struct ast_websocket_server *ws_server,
 	enum ast_http_method method, struct ast_variable *get_params,
 	struct ast_variable *headers)
 {
+	RAII_VAR(struct ast_ari_conf *, config, ast_ari_config_get(), ao2_cleanup);
 	struct ast_http_uri fake_urih = {
 		.data = ws_server,
 	};
+	unsigned int arena_depth;
+
+	if (config && config->general) {
+		ast_websocket_server_set_deflate(ws_server, config->general->websocket_compression);
+	}
+	/* The session lives for the whole connection, beyond the request's JSON arena */
+	arena_depth = ast_json_arena_suspend();
 	ast_websocket_uri_cb(ser, &fake_urih, uri, method, get_params,
 		headers);
+	ast_json_arena_resume(arena_depth);
 }
 
 const char *ast_ari_websocket_session_id(
@@ -341,6 +341,12 @@ int ast_ari_config_init(void)
 	aco_option_register(&cfg_info, "websocket_write_timeout", ACO_EXACT, general_options,
 		AST_DEFAULT_WEBSOCKET_WRITE_TIMEOUT_STR, OPT_INT_T, PARSE_IN_RANGE,
 		FLDSET(struct ast_ari_conf_general, write_timeout), 1, INT_MAX);
+	aco_option_register(&cfg_info, "websocket_compression", ACO_EXACT, general_options,
+		"no", OPT_BOOL_T, 1,
+		FLDSET(struct ast_ari_conf_general, websocket_compression));
+	aco_option_register(&cfg_info, "websocket_coalesce", ACO_EXACT, general_options,
+		"0", OPT_INT_T, PARSE_IN_RANGE,
+		FLDSET(struct ast_ari_conf_general, websocket_coalesce), 0, 1000);
 
 	/* ARI type=user category options */
 	aco_option_register(&cfg_info, "type", ACO_EXACT, user, NULL,
@@ -67,6 +67,10 @@ struct ast_ari_conf_general {
 	int enabled;
 	/*! Write timeout for websocket connections */
 	int write_timeout;
+	/*! Offer permessage-deflate on websocket connections */
+	int websocket_compression;
+	/*! Milliseconds websocket events may wait to be sent together */
+	int websocket_coalesce;
 	/*! Encoding format used during output (default compact). */
 	enum ast_json_encoding_format format;
 	/*! Authentication realm */
@@ -127,5 +127,33 @@ int ast_ari_applications_unsubscribe_parse_body(
  * \param[out] response HTTP response
  */
 void ast_ari_applications_unsubscribe(struct ast_variable *headers, struct ast_ari_applications_unsubscribe_args *args, struct ast_ari_response *response);
+/*! Argument struct for ast_ari_applications_filter() */
+struct ast_ari_applications_filter_args {
+	/*! Application's name */
+	const char *application_name;
+	/*! The body object may have "allowed" and "disallowed" lists of event types to send or not send, and an "omitted" list of members to leave out of the objects in each event. No body sends every event in full. Ex. { "allowed": [ { "type": "StasisStart" }, { "type": "ChannelStateChange" } ], "omitted": [ "channelvars", "dialplan" ] } */
+	struct ast_json *filter;
+};
+/*!
+ * \brief Body parsing function for /applications/{applicationName}/eventFilter.
+ * \param body The JSON body from which to parse parameters.
+ * \param[out] args The args structure to parse into.
+ * \retval zero on success
+ * \retval non-zero on failure
+ */
+int ast_ari_applications_filter_parse_body(
+	struct ast_json *body,
+	struct ast_ari_applications_filter_args *args);
+
+/*!
+ * \brief Filter the events sent to an application.
+ *
+ * Replaces the application's event filter. Returns the state of the application after the filter has changed
+ *
+ * \param headers HTTP headers
+ * \param args Swagger parameters
+ * \param[out] response HTTP response
+ */
+void ast_ari_applications_filter(struct ast_variable *headers, struct ast_ari_applications_filter_args *args, struct ast_ari_response *response);
 
 #endif /* _ASTERISK_RESOURCE_APPLICATIONS_H */
@@ -840,6 +840,9 @@ void ast_ari_bridges_get(struct ast_variable *headers,
 	struct ast_ari_response *response)
 {
 	RAII_VAR(struct ast_bridge_snapshot *, snapshot, ast_bridge_snapshot_get_latest(args->bridge_id), ao2_cleanup);
+	struct ast_json_writer writer;
+	struct ast_str *body;
+
 	if (!snapshot) {
 		ast_ari_response_error(
 			response, 404, "Not Found",
@@ -847,8 +850,20 @@ void ast_ari_bridges_get(struct ast_variable *headers,
 		return;
 	}
 
-	ast_ari_response_ok(response,
-		ast_bridge_snapshot_to_json(snapshot, stasis_app_get_sanitizer()));
+	body = ast_str_create(512);
+	if (!body) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	if (ast_bridge_snapshot_json_write(snapshot, stasis_app_get_sanitizer(), &writer)) {
+		ast_free(body);
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	ast_ari_response_ok_body(response, body);
 }
 
 void ast_ari_bridges_destroy(struct ast_variable *headers,
@@ -870,7 +885,8 @@ void ast_ari_bridges_list(struct ast_variable *headers,
 {
 	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
 	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	RAII_VAR(struct ast_str *, body, NULL, ast_free);
+	struct ast_json_writer writer;
 	struct ao2_iterator i;
 	void *obj;
 
@@ -889,27 +905,34 @@ void ast_ari_bridges_list(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	body = ast_str_create(4096);
+	if (!body) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
 
+	/* Each snapshot is written straight into the response */
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	ast_json_writer_array_start(&writer);
 	i = ao2_iterator_init(snapshots, 0);
 	while ((obj = ao2_iterator_next(&i))) {
 		RAII_VAR(struct stasis_message *, msg, obj, ao2_cleanup);
 		struct ast_bridge_snapshot *snapshot = stasis_message_data(msg);
-		struct ast_json *json_bridge = ast_bridge_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 
-		if (!json_bridge || ast_json_array_append(json, json_bridge)) {
+		if (ast_bridge_snapshot_json_write(snapshot, stasis_app_get_sanitizer(), &writer)) {
 			ao2_iterator_destroy(&i);
 			ast_ari_response_alloc_failed(response);
 			return;
 		}
 	}
 	ao2_iterator_destroy(&i);
+	if (ast_json_writer_array_end(&writer)) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
 
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_body(response, body);
+	body = NULL;
 }
 
 void ast_ari_bridges_create(struct ast_variable *headers,
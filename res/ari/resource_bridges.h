@@ -245,7 +245,7 @@ void ast_ari_bridges_stop_moh(struct ast_variable *headers, struct ast_ari_bridg
 struct ast_ari_bridges_play_args {
 	/*! Bridge's id */
 	const char *bridge_id;
-	/*! Media's URI to play. */
+	/*! Media's URI to play. Several URIs separated by commas are played in turn. */
 	const char *media;
 	/*! For sounds, selects language for sound. */
 	const char *lang;
@@ -283,7 +283,7 @@ struct ast_ari_bridges_play_with_id_args {
 	const char *bridge_id;
 	/*! Playback ID. */
 	const char *playback_id;
-	/*! Media's URI to play. */
+	/*! Media's URI to play. Several URIs separated by commas are played in turn. */
 	const char *media;
 	/*! For sounds, selects language for sound. */
 	const char *lang;
@@ -719,6 +719,8 @@ void ast_ari_channels_get(struct ast_variable *headers,
 	RAII_VAR(struct stasis_message *, msg, NULL, ao2_cleanup);
 	struct stasis_cache *cache;
 	struct ast_channel_snapshot *snapshot;
+	struct ast_json_writer writer;
+	struct ast_str *body;
 
 	cache = ast_channel_cache();
 	if (!cache) {
@@ -740,8 +742,20 @@ void ast_ari_channels_get(struct ast_variable *headers,
 	snapshot = stasis_message_data(msg);
 	ast_assert(snapshot != NULL);
 
-	ast_ari_response_ok(response,
-				ast_channel_snapshot_to_json(snapshot, NULL));
+	body = ast_str_create(512);
+	if (!body) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	if (ast_channel_snapshot_json_write(snapshot, NULL, &writer)) {
+		ast_free(body);
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	ast_ari_response_ok_body(response, body);
 }
 
 void ast_ari_channels_hangup(struct ast_variable *headers,
@@ -780,16 +794,41 @@ void ast_ari_channels_hangup(struct ast_variable *headers,
 	ast_ari_response_no_content(response);
 }
 
+struct channels_list_data {
+	struct ast_json_writer *writer;
+	struct stasis_message_sanitizer *sanitize;
+	int error;
+};
+
+static int channels_list_cb(struct stasis_message *msg, void *data)
+{
+	struct channels_list_data *list = data;
+	struct ast_channel_snapshot *snapshot = stasis_message_data(msg);
+
+	if (list->sanitize && list->sanitize->channel_snapshot
+		&& list->sanitize->channel_snapshot(snapshot)) {
+		return 0;
+	}
+
+	if (ast_channel_snapshot_json_write(snapshot, NULL, list->writer)) {
+		list->error = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
 void ast_ari_channels_list(struct ast_variable *headers,
 	struct ast_ari_channels_list_args *args,
 	struct ast_ari_response *response)
 {
 	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
-	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
-	struct ao2_iterator i;
-	void *obj;
-	struct stasis_message_sanitizer *sanitize = stasis_app_get_sanitizer();
+	RAII_VAR(struct ast_str *, body, NULL, ast_free);
+	struct ast_json_writer writer;
+	struct channels_list_data list = {
+		.writer = &writer,
+		.sanitize = stasis_app_get_sanitizer(),
+	};
 
 	cache = ast_channel_cache();
 	if (!cache) {
@@ -800,40 +839,23 @@ void ast_ari_channels_list(struct ast_variable *headers,
 	}
 	ao2_ref(cache, +1);
 
-	snapshots = stasis_cache_dump(cache, ast_channel_snapshot_type());
-	if (!snapshots) {
+	body = ast_str_create(4096);
+	if (!body) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	/* Each snapshot is written straight into the response */
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	ast_json_writer_array_start(&writer);
+	if (stasis_cache_iterate(cache, ast_channel_snapshot_type(), channels_list_cb, &list)
+		|| list.error || ast_json_writer_array_end(&writer)) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
 
-	i = ao2_iterator_init(snapshots, 0);
-	while ((obj = ao2_iterator_next(&i))) {
-		RAII_VAR(struct stasis_message *, msg, obj, ao2_cleanup);
-		struct ast_channel_snapshot *snapshot = stasis_message_data(msg);
-		int r;
-
-		if (sanitize && sanitize->channel_snapshot
-			&& sanitize->channel_snapshot(snapshot)) {
-			continue;
-		}
-
-		r = ast_json_array_append(
-			json, ast_channel_snapshot_to_json(snapshot, NULL));
-		if (r != 0) {
-			ast_ari_response_alloc_failed(response);
-			ao2_iterator_destroy(&i);
-			return;
-		}
-	}
-	ao2_iterator_destroy(&i);
-
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_body(response, body);
+	body = NULL;
 }
 
 /*! \brief Structure used for origination */
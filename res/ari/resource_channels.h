@@ -471,7 +471,7 @@ void ast_ari_channels_stop_silence(struct ast_variable *headers, struct ast_ari_
 struct ast_ari_channels_play_args {
 	/*! Channel's id */
 	const char *channel_id;
-	/*! Media's URI to play. */
+	/*! Media's URI to play. Several URIs separated by commas are played in turn. */
 	const char *media;
 	/*! For sounds, selects language for sound. */
 	const char *lang;
@@ -509,7 +509,7 @@ struct ast_ari_channels_play_with_id_args {
 	const char *channel_id;
 	/*! Playback ID. */
 	const char *playback_id;
-	/*! Media's URI to play. */
+	/*! Media's URI to play. Several URIs separated by commas are played in turn. */
 	const char *media;
 	/*! For sounds, selects language for sound. */
 	const char *lang;
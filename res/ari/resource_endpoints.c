@@ -42,7 +42,8 @@ void ast_ari_endpoints_list(struct ast_variable *headers,
 {
 	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
 	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	RAII_VAR(struct ast_str *, body, NULL, ast_free);
+	struct ast_json_writer writer;
 	struct ao2_iterator i;
 	void *obj;
 
@@ -61,27 +62,34 @@ void ast_ari_endpoints_list(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	body = ast_str_create(4096);
+	if (!body) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
 
+	/* Each snapshot is written straight into the response */
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	ast_json_writer_array_start(&writer);
 	i = ao2_iterator_init(snapshots, 0);
 	while ((obj = ao2_iterator_next(&i))) {
 		RAII_VAR(struct stasis_message *, msg, obj, ao2_cleanup);
 		struct ast_endpoint_snapshot *snapshot = stasis_message_data(msg);
-		struct ast_json *json_endpoint = ast_endpoint_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 
-		if (!json_endpoint || ast_json_array_append(json, json_endpoint)) {
+		if (ast_endpoint_snapshot_json_write(snapshot, stasis_app_get_sanitizer(), &writer)) {
 			ao2_iterator_destroy(&i);
 			ast_ari_response_alloc_failed(response);
 			return;
 		}
 	}
 	ao2_iterator_destroy(&i);
+	if (ast_json_writer_array_end(&writer)) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
 
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_body(response, body);
+	body = NULL;
 }
 
 void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
@@ -90,7 +98,8 @@ void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
 {
 	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
 	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	RAII_VAR(struct ast_str *, body, NULL, ast_free);
+	struct ast_json_writer writer;
 	struct ast_endpoint *tech_endpoint;
 	struct ao2_iterator i;
 	void *obj;
@@ -118,46 +127,47 @@ void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	body = ast_str_create(4096);
+	if (!body) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
 
+	/* Each snapshot is written straight into the response */
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	ast_json_writer_array_start(&writer);
 	i = ao2_iterator_init(snapshots, 0);
 	while ((obj = ao2_iterator_next(&i))) {
 		RAII_VAR(struct stasis_message *, msg, obj, ao2_cleanup);
 		struct ast_endpoint_snapshot *snapshot = stasis_message_data(msg);
-		struct ast_json *json_endpoint;
-		int r;
 
 		if (strcasecmp(args->tech, snapshot->tech) != 0) {
 			continue;
 		}
 
-		json_endpoint = ast_endpoint_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
-		if (!json_endpoint) {
-			continue;
-		}
-
-		r = ast_json_array_append(
-			json, json_endpoint);
-		if (r != 0) {
+		if (ast_endpoint_snapshot_json_write(snapshot, stasis_app_get_sanitizer(), &writer)) {
 			ao2_iterator_destroy(&i);
 			ast_ari_response_alloc_failed(response);
 			return;
 		}
 	}
 	ao2_iterator_destroy(&i);
-	ast_ari_response_ok(response, ast_json_ref(json));
+	if (ast_json_writer_array_end(&writer)) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	ast_ari_response_ok_body(response, body);
+	body = NULL;
 }
 
 void ast_ari_endpoints_get(struct ast_variable *headers,
 	struct ast_ari_endpoints_get_args *args,
 	struct ast_ari_response *response)
 {
-	struct ast_json *json;
 	RAII_VAR(struct ast_endpoint_snapshot *, snapshot, NULL, ao2_cleanup);
+	struct ast_json_writer writer;
+	struct ast_str *body;
 
 	snapshot = ast_endpoint_latest_snapshot(args->tech, args->resource);
 	if (!snapshot) {
@@ -166,13 +176,20 @@ void ast_ari_endpoints_get(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_endpoint_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
-	if (!json) {
+	body = ast_str_create(512);
+	if (!body) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	ast_json_writer_init(&writer, &body, ast_ari_json_format());
+	if (ast_endpoint_snapshot_json_write(snapshot, stasis_app_get_sanitizer(), &writer)) {
+		ast_free(body);
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
 
-	ast_ari_response_ok(response, json);
+	ast_ari_response_ok_body(response, body);
 }
 
 static void send_message(const char *to, const char *from, const char *body, struct ast_variable *variables, struct ast_ari_response *response)
@@ -29,6 +29,7 @@ ASTERISK_REGISTER_FILE()
 
 #include "resource_events.h"
 #include "asterisk/astobj2.h"
+#include "asterisk/metrics.h"
 #include "asterisk/stasis_app.h"
 #include "asterisk/vector.h"
 
@@ -78,6 +79,8 @@ static void stasis_app_message_handler(
 {
 	struct event_session *session = data;
 	const char *msg_type, *msg_application;
+	struct ast_json *queued;
+	unsigned int arena_depth;
 
 	ast_assert(session != NULL);
 
@@ -103,8 +106,14 @@ static void stasis_app_message_handler(
 		        msg_type,
 		        msg_application);
 	} else if (!session->ws_session) {
-		/* If the websocket is NULL, the message goes to the queue */
-		AST_VECTOR_APPEND(&session->message_queue, message);
+		/* If the websocket is NULL, a copy of the message goes to the queue.
+		 * The message may be from the sender's JSON arena, the copy is not. */
+		arena_depth = ast_json_arena_suspend();
+		queued = ast_json_deep_copy(message);
+		ast_json_arena_resume(arena_depth);
+		if (!queued || AST_VECTOR_APPEND(&session->message_queue, queued)) {
+			ast_json_unref(queued);
+		}
 		ast_log(LOG_WARNING,
 				"Queued '%s' message for Stasis app '%s'; websocket is not ready\n",
 				msg_type,
@@ -425,6 +434,9 @@ static int event_session_alloc(struct ast_tcptls_session_instance *ser,
 			return event_session_allocation_error_handler(
 				session, ERROR_TYPE_STASIS_REGISTRATION, ser);			
 		}
+
+		/* Replacing a compact session's application resets it too */
+		stasis_app_compact_set(app, args->compact);
 	}
 
 	/* Add the event session to the local registry */
@@ -442,8 +454,18 @@ static int event_session_shutdown_cb(void *session, void *arg, int flags)
 	return 0;
 }
 
+static void event_session_metrics_collect(struct ast_metrics_output *out)
+{
+	ast_metrics_output_family(out, "asterisk_ari_websocket_sessions", AST_METRIC_GAUGE,
+		"ARI event WebSocket sessions");
+	ast_metrics_output_sample(out, "asterisk_ari_websocket_sessions", NULL, NULL,
+		ao2_container_count(event_session_registry));
+}
+
 void ast_ari_websocket_events_event_websocket_dtor(void)
 {
+	ast_metrics_collector_unregister(event_session_metrics_collect);
+
 	ao2_callback(event_session_registry, OBJ_MULTIPLE | OBJ_NODATA, event_session_shutdown_cb, NULL);
 
 	ao2_cleanup(event_session_registry);
@@ -463,6 +485,8 @@ int ast_ari_websocket_events_event_websocket_init(void)
 		return -1;
 	}
 
+	ast_metrics_collector_register("ari", event_session_metrics_collect);
+
 	return 0;
 }
 
@@ -49,6 +49,8 @@ struct ast_ari_events_event_websocket_args {
 	char *app_parse;
 	/*! Subscribe to all Asterisk events. If provided, the applications listed will be subscribed to all events, effectively disabling the application specific subscriptions. Default is 'false'. */
 	int subscribe_all;
+	/*! Send compact events. Channels, bridges and endpoints in each event are reduced to their id, and to the member the event is about, such as the state in ChannelStateChange. StasisStart, ChannelCreated and BridgeCreated are still sent in full; fetch other snapshots from /channels, /bridges and /endpoints when needed. Default is 'false'. */
+	int compact;
 };
 
 /*!
@@ -251,6 +251,20 @@ ASTERISK_REGISTER_FILE()
 			<para>Returns <literal>1</literal> if successful, <literal>0</literal> otherwise.</para>
 		</description>
 	</agi>
+	<agi name="end session" language="en_US">
+		<synopsis>
+			Ends the AGI session
+		</synopsis>
+		<syntax />
+		<description>
+			<para>Ends the AGI session and returns control to the dialplan, as closing
+			the connection does. A FastAGI server run with the
+			<variable>AGIPERSISTENT</variable> channel variable set to <literal>yes</literal>
+			must end its sessions with this command, so the connection can be used
+			for another session.</para>
+			<para>Always returns <literal>0</literal>.</para>
+		</description>
+	</agi>
 	<agi name="exec" language="en_US">
 		<synopsis>
 			Executes a given Application
@@ -861,8 +875,17 @@ ASTERISK_REGISTER_FILE()
 			Alternatively, if you would like the AGI application to exit immediately
 			after a channel hangup is detected, set the <variable>AGIEXITONHANGUP</variable>
 			variable to <literal>yes</literal>.</para>
+			<para>When the <variable>AGIPERSISTENT</variable> channel variable is set to
+			<literal>yes</literal>, connections to a fast AGI server are kept after a session
+			and reused for the next sessions with that server. The environment sent to the
+			server then contains <literal>agi_persistent: yes</literal>, and the server must
+			end each session with the <literal>END SESSION</literal> command instead of
+			closing the connection. In any session the server may also send several
+			commands at once without waiting for their results, which are sent back in
+			order.</para>
 			<para>Use the CLI command <literal>agi show commands</literal> to list available agi
-			commands.</para>
+			commands, and <literal>agi show servers</literal> for the connections to and
+			response times of fast AGI servers.</para>
 			<para>This application sets the following channel variable upon completion:</para>
 			<variablelist>
 				<variable name="AGISTATUS">
@@ -1025,6 +1048,15 @@ static int agidebug = 0;
 /*! Special return code for "asyncagi break" command. */
 #define ASYNC_AGI_BREAK	3
 
+/*! Special return code for "end session" command. */
+#define AGI_END_SESSION 4
+
+/*! Idle connections kept for each fast AGI server */
+#define AGI_POOL_MAX_IDLE 16
+
+/*! Seconds an idle connection to a fast AGI server is kept */
+#define AGI_POOL_IDLE_TIMEOUT 60
+
 enum agi_result {
 	AGI_RESULT_FAILURE = -1,
 	AGI_RESULT_SUCCESS,
@@ -1032,8 +1064,53 @@ enum agi_result {
 	AGI_RESULT_SUCCESS_ASYNC,
 	AGI_RESULT_NOTFOUND,
 	AGI_RESULT_HANGUP,
+	/*! The script ended the session, leaving its connection open */
+	AGI_RESULT_END_SESSION,
+};
+
+/*! \brief An idle connection to a fast AGI server */
+struct agi_pooled_conn {
+	/*! The socket */
+	int fd;
+	/*! When the connection became idle */
+	struct timeval since;
+	AST_LIST_ENTRY(agi_pooled_conn) list;
+};
+
+/*!
+ * \brief A fast AGI server
+ *
+ * Holds the idle connections to the server, most recently used first, and
+ * the statistics of its sessions. Locked with its ao2 lock.
+ */
+struct agi_server {
+	/*! Idle connections */
+	AST_LIST_HEAD_NOLOCK(, agi_pooled_conn) idle;
+	/*! Number of idle connections */
+	unsigned int num_idle;
+	/*! Sessions run */
+	unsigned int sessions;
+	/*! Connections opened */
+	unsigned int connects;
+	/*! Sessions run on an idle connection */
+	unsigned int reuses;
+	/*! Failed connection attempts */
+	unsigned int failures;
+	/*! Total and longest time to connect, in microseconds */
+	uint64_t connect_time;
+	unsigned int connect_time_max;
+	/*! Commands received */
+	unsigned int commands;
+	/*! Total and longest time from a result or the environment to the next command, in microseconds */
+	uint64_t latency;
+	unsigned int latency_max;
+	/*! Host and port of the server */
+	char name[0];
 };
 
+/*! \brief The fast AGI servers connected to, by name */
+static struct ao2_container *agi_servers;
+
 static struct ast_manager_event_blob *agi_channel_to_ami(const char *type, struct stasis_message *message)
 {
 	struct ast_channel_blob *obj = stasis_message_data(message);
@@ -1548,7 +1625,8 @@ static enum agi_result launch_asyncagi(struct ast_channel *chan, int argc, char
 				}
 				break;
 			case AGI_RESULT_SUCCESS_ASYNC:
-				/* Only the "asyncagi break" command does this. */
+			case AGI_RESULT_END_SESSION:
+				/* Only the "asyncagi break" and "end session" commands do this. */
 				returnstatus = AGI_RESULT_SUCCESS_ASYNC;
 				goto async_agi_done;
 			default:
@@ -1664,28 +1742,197 @@ static int handle_connection(const char *agiurl, const struct ast_sockaddr addr,
 	return 0;
 }
 
-/* launch_netscript: The fastagi handler.
-	FastAGI defaults to port 4573 */
-static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
+static void agi_server_destructor(void *obj)
 {
-	int s = 0, flags;
-	char *host, *script;
-	int num_addrs = 0, i = 0;
-	struct ast_sockaddr *addrs;
+	struct agi_server *server = obj;
+	struct agi_pooled_conn *conn;
 
-	/* agiurl is "agi://host.domain[:port][/script/name]" */
-	host = ast_strdupa(agiurl + 6);	/* Remove agi:// */
+	while ((conn = AST_LIST_REMOVE_HEAD(&server->idle, list))) {
+		close(conn->fd);
+		ast_free(conn);
+	}
+}
 
-	/* Strip off any script name */
-	if ((script = strchr(host, '/'))) {
-		*script++ = '\0';
-	} else {
-		script = "";
+static int agi_server_hash_fn(const void *obj, const int flags)
+{
+	const struct agi_server *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->name;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_case_hash(key);
+}
+
+static int agi_server_cmp_fn(void *obj, void *arg, int flags)
+{
+	const struct agi_server *object_left = obj;
+	const struct agi_server *object_right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->name;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		if (strcasecmp(object_left->name, right_key)) {
+			return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+	return CMP_MATCH;
+}
+
+/*!
+ * \internal
+ * \brief Find a fast AGI server, adding it if needed.
+ *
+ * \param name Host and port of the server
+ *
+ * \return The server, with a reference, or NULL on error
+ */
+static struct agi_server *agi_server_get(const char *name)
+{
+	struct agi_server *server;
+
+	ao2_lock(agi_servers);
+	server = ao2_find(agi_servers, name, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!server) {
+		server = ao2_alloc(sizeof(*server) + strlen(name) + 1, agi_server_destructor);
+		if (server) {
+			strcpy(server->name, name); /* Safe */
+			ao2_link_flags(agi_servers, server, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(agi_servers);
+
+	return server;
+}
+
+/*!
+ * \internal
+ * \brief Take an idle connection to a fast AGI server.
+ *
+ * Connections idle for too long, or closed or written to by the server
+ * while idle, are closed.
+ *
+ * \return The socket of the connection, -1 if there is none
+ */
+static int agi_pool_get(struct agi_server *server)
+{
+	struct agi_pooled_conn *conn;
+	struct pollfd pfd = { .events = POLLIN, };
+	struct timeval now = ast_tvnow();
+	int fd = -1;
+
+	ao2_lock(server);
+	while (fd < 0 && (conn = AST_LIST_REMOVE_HEAD(&server->idle, list))) {
+		server->num_idle--;
+		pfd.fd = conn->fd;
+		if (ast_tvdiff_ms(now, conn->since) < AGI_POOL_IDLE_TIMEOUT * 1000
+			&& !ast_poll(&pfd, 1, 0)) {
+			fd = conn->fd;
+		} else {
+			close(conn->fd);
+		}
+		ast_free(conn);
+	}
+	ao2_unlock(server);
+
+	return fd;
+}
+
+/*!
+ * \internal
+ * \brief Keep the connection of an ended session for the next session.
+ *
+ * \param server The fast AGI server
+ * \param fd The socket of the connection, closed if it is not kept
+ */
+static void agi_pool_put(struct agi_server *server, int fd)
+{
+	struct agi_pooled_conn *conn = NULL;
+	struct timeval now = ast_tvnow();
+
+	ao2_lock(server);
+	/* The oldest connections are at the tail */
+	while ((conn = AST_LIST_LAST(&server->idle))
+		&& ast_tvdiff_ms(now, conn->since) >= AGI_POOL_IDLE_TIMEOUT * 1000) {
+		conn = AST_LIST_REMOVE(&server->idle, conn, list);
+		server->num_idle--;
+		close(conn->fd);
+		ast_free(conn);
+	}
+	if (server->num_idle < AGI_POOL_MAX_IDLE && (conn = ast_calloc(1, sizeof(*conn)))) {
+		conn->fd = fd;
+		conn->since = now;
+		AST_LIST_INSERT_HEAD(&server->idle, conn, list);
+		server->num_idle++;
+		fd = -1;
+	}
+	ao2_unlock(server);
+
+	if (fd > -1) {
+		close(fd);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Record the time a fast AGI server took to send a command.
+ *
+ * \param server The fast AGI server
+ * \param since When the server got what it needed to send the command
+ */
+static void agi_server_latency(struct agi_server *server, struct timeval since)
+{
+	int64_t latency = ast_tvdiff_us(ast_tvnow(), since);
+
+	if (latency < 0) {
+		latency = 0;
+	}
+
+	ao2_lock(server);
+	server->commands++;
+	server->latency += latency;
+	if (latency > server->latency_max) {
+		server->latency_max = MIN(latency, UINT_MAX);
 	}
+	ao2_unlock(server);
+}
+
+/*!
+ * \internal
+ * \brief Connect to a fast AGI server.
+ *
+ * \param agiurl Url that we are trying to connect to.
+ * \param host Host and port of the server.
+ * \param server The server, to record the connection in.
+ *
+ * \return The socket, -1 on error
+ */
+static int agi_connect(const char *agiurl, const char *host, struct agi_server *server)
+{
+	int s = -1, flags;
+	int num_addrs = 0, i = 0;
+	struct ast_sockaddr *addrs;
+	struct timeval start = ast_tvnow();
+	int64_t elapsed;
 
 	if (!(num_addrs = ast_sockaddr_resolve(&addrs, host, 0, AST_AF_UNSPEC))) {
 		ast_log(LOG_WARNING, "Unable to locate host '%s'\n", host);
-		return AGI_RESULT_FAILURE;
+		return -1;
 	}
 
 	for (i = 0; i < num_addrs; i++) {
@@ -1727,17 +1974,80 @@ static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
 
 	ast_free(addrs);
 
+	ao2_lock(server);
 	if (i == num_addrs) {
+		server->failures++;
+		s = -1;
+	} else {
+		elapsed = ast_tvdiff_us(ast_tvnow(), start);
+		server->connects++;
+		server->connect_time += elapsed;
+		if (elapsed > server->connect_time_max) {
+			server->connect_time_max = MIN(elapsed, UINT_MAX);
+		}
+	}
+	ao2_unlock(server);
+
+	if (s < 0) {
 		ast_log(LOG_WARNING, "Couldn't connect to any host.  FastAGI failed.\n");
+	}
+
+	return s;
+}
+
+/* launch_netscript: The fastagi handler.
+	FastAGI defaults to port 4573 */
+static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds,
+	int persistent, struct agi_server **serverp)
+{
+	int s = -1;
+	char *host, *script;
+	struct agi_server *server;
+
+	/* agiurl is "agi://host.domain[:port][/script/name]" */
+	host = ast_strdupa(agiurl + 6);	/* Remove agi:// */
+
+	/* Strip off any script name */
+	if ((script = strchr(host, '/'))) {
+		*script++ = '\0';
+	} else {
+		script = "";
+	}
+
+	if (!(server = agi_server_get(host))) {
 		return AGI_RESULT_FAILURE;
 	}
 
-	if (ast_agi_send(s, NULL, "agi_network: yes\n") < 0) {
-		if (errno != EINTR) {
-			ast_log(LOG_WARNING, "Connect to '%s' failed: %s\n", agiurl, strerror(errno));
-			close(s);
+	/* A pooled connection closed by the server only shows when written to. */
+	while (persistent && (s = agi_pool_get(server)) > -1) {
+		if (ast_agi_send(s, NULL, "agi_network: yes\n") >= 0) {
+			ao2_lock(server);
+			server->reuses++;
+			ao2_unlock(server);
+			break;
+		}
+		close(s);
+		s = -1;
+	}
+
+	if (s < 0) {
+		if ((s = agi_connect(agiurl, host, server)) < 0) {
+			ao2_ref(server, -1);
 			return AGI_RESULT_FAILURE;
 		}
+
+		if (ast_agi_send(s, NULL, "agi_network: yes\n") < 0) {
+			if (errno != EINTR) {
+				ast_log(LOG_WARNING, "Connect to '%s' failed: %s\n", agiurl, strerror(errno));
+				close(s);
+				ao2_ref(server, -1);
+				return AGI_RESULT_FAILURE;
+			}
+		}
+	}
+
+	if (persistent) {
+		ast_agi_send(s, NULL, "agi_persistent: yes\n");
 	}
 
 	/* If we have a script parameter, relay it to the fastagi server */
@@ -1746,9 +2056,14 @@ static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
 		ast_agi_send(s, NULL, "agi_network_script: %s\n", script);
 	}
 
+	ao2_lock(server);
+	server->sessions++;
+	ao2_unlock(server);
+
 	ast_debug(4, "Wow, connected!\n");
 	fds[0] = s;
 	fds[1] = s;
+	*serverp = server;
 	return AGI_RESULT_SUCCESS_FAST;
 }
 
@@ -1758,6 +2073,8 @@ static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
  * \param agiurl The request URL as passed to Agi() in the dial plan
  * \param argv The parameters after the URL passed to Agi() in the dial plan
  * \param fds Input/output file descriptors
+ * \param persistent Whether to reuse a connection and keep it after the session
+ * \param serverp Where the server connected to is stored
  *
  * Uses SRV lookups to try to connect to a list of FastAGI servers. The hostname in
  * the URI is prefixed with _agi._tcp. prior to the DNS resolution. For
@@ -1771,7 +2088,8 @@ static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
  *
  * \return the result of the AGI operation.
  */
-static enum agi_result launch_ha_netscript(char *agiurl, char *argv[], int *fds)
+static enum agi_result launch_ha_netscript(char *agiurl, char *argv[], int *fds,
+	int persistent, struct agi_server **serverp)
 {
 	char *host, *script;
 	enum agi_result result;
@@ -1798,14 +2116,14 @@ static enum agi_result launch_ha_netscript(char *agiurl, char *argv[], int *fds)
 
 	if (strchr(host, ':')) {
 		ast_log(LOG_WARNING, "Specifying a port number disables SRV lookups: %s\n", agiurl);
-		return launch_netscript(agiurl + 1, argv, fds); /* +1 to strip off leading h from hagi:// */
+		return launch_netscript(agiurl + 1, argv, fds, persistent, serverp); /* +1 to strip off leading h from hagi:// */
 	}
 
 	snprintf(service, sizeof(service), "%s%s", SRV_PREFIX, host);
 
 	while (!(srv_ret = ast_srv_lookup(&context, service, &srvhost, &srvport))) {
 		snprintf(resolved_uri, sizeof(resolved_uri), "agi://%s:%d/%s", srvhost, srvport, script);
-		result = launch_netscript(resolved_uri, argv, fds);
+		result = launch_netscript(resolved_uri, argv, fds, persistent, serverp);
 		if (result == AGI_RESULT_FAILURE || result == AGI_RESULT_NOTFOUND) {
 			ast_log(LOG_WARNING, "AGI request failed for host '%s' (%s:%d)\n", host, srvhost, srvport);
 		} else {
@@ -1825,17 +2143,18 @@ static enum agi_result launch_ha_netscript(char *agiurl, char *argv[], int *fds)
 	return AGI_RESULT_FAILURE;
 }
 
-static enum agi_result launch_script(struct ast_channel *chan, char *script, int argc, char *argv[], int *fds, int *efd, int *opid)
+static enum agi_result launch_script(struct ast_channel *chan, char *script, int argc, char *argv[], int *fds, int *efd, int *opid,
+	int persistent, struct agi_server **serverp)
 {
 	char tmp[256];
 	int pid, toast[2], fromast[2], audio[2], res;
 	struct stat st;
 
 	if (!strncasecmp(script, "agi://", 6)) {
-		return (efd == NULL) ? launch_netscript(script, argv, fds) : AGI_RESULT_FAILURE;
+		return (efd == NULL) ? launch_netscript(script, argv, fds, persistent, serverp) : AGI_RESULT_FAILURE;
 	}
 	if (!strncasecmp(script, "hagi://", 7)) {
-		return (efd == NULL) ? launch_ha_netscript(script, argv, fds) : AGI_RESULT_FAILURE;
+		return (efd == NULL) ? launch_ha_netscript(script, argv, fds, persistent, serverp) : AGI_RESULT_FAILURE;
 	}
 	if (!strncasecmp(script, "agi:async", sizeof("agi:async") - 1)) {
 		return launch_asyncagi(chan, argc, argv, efd);
@@ -2008,6 +2327,12 @@ static int handle_asyncagi_break(struct ast_channel *chan, AGI *agi, int argc, c
 	return ASYNC_AGI_BREAK;
 }
 
+static int handle_endsession(struct ast_channel *chan, AGI *agi, int argc, const char * const argv[])
+{
+	ast_agi_send(agi->fd, chan, "200 result=0\n");
+	return AGI_END_SESSION;
+}
+
 static int handle_waitfordigit(struct ast_channel *chan, AGI *agi, int argc, const char * const argv[])
 {
 	int res, to;
@@ -3334,6 +3659,7 @@ static struct agi_command commands[] = {
 	{ { "database", "deltree", NULL }, handle_dbdeltree, NULL, NULL, 1 },
 	{ { "database", "get", NULL }, handle_dbget, NULL, NULL, 1 },
 	{ { "database", "put", NULL }, handle_dbput, NULL, NULL, 1 },
+	{ { "end", "session", NULL }, handle_endsession, NULL, NULL, 1 },
 	{ { "exec", NULL }, handle_exec, NULL, NULL, 1 },
 	{ { "get", "data", NULL }, handle_getdata, NULL, NULL, 0 },
 	{ { "get", "full", "variable", NULL }, handle_getvariablefull, NULL, NULL, 1 },
@@ -3377,6 +3703,71 @@ static struct agi_command commands[] = {
 
 static AST_RWLIST_HEAD_STATIC(agi_commands, agi_command);
 
+#ifdef AST_XML_DOCS
+/*! \brief Serializes building the documentation of commands left for later */
+AST_MUTEX_DEFINE_STATIC(agi_docs_lock);
+
+/*!
+ * \internal
+ * \brief Build the XML documentation of an AGI command.
+ */
+static void agi_command_build_docs(agi_command *cmd)
+{
+	char fullcmd[MAX_CMD_LEN];
+
+	ast_join(fullcmd, sizeof(fullcmd), cmd->cmda);
+	*((char **) &cmd->summary) = ast_xmldoc_build_synopsis("agi", fullcmd, NULL);
+	*((char **) &cmd->usage) = ast_xmldoc_build_description("agi", fullcmd, NULL);
+	*((char **) &cmd->syntax) = ast_xmldoc_build_syntax("agi", fullcmd, NULL);
+	*((char **) &cmd->seealso) = ast_xmldoc_build_seealso("agi", fullcmd, NULL);
+	*((enum ast_doc_src *) &cmd->docsrc) = AST_XML_DOC;
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Make sure strings are allocated for documentation that was not found.
+ */
+static void agi_command_default_docs(agi_command *cmd)
+{
+#ifndef HAVE_NULLSAFE_PRINTF
+	if (!cmd->summary) {
+		*((char **) &cmd->summary) = ast_strdup("");
+	}
+	if (!cmd->usage) {
+		*((char **) &cmd->usage) = ast_strdup("");
+	}
+	if (!cmd->syntax) {
+		*((char **) &cmd->syntax) = ast_strdup("");
+	}
+	if (!cmd->seealso) {
+		*((char **) &cmd->seealso) = ast_strdup("");
+	}
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Build the documentation of a command about to be used, if it was
+ * left for later.
+ */
+static void agi_command_docs(agi_command *cmd)
+{
+#ifdef AST_XML_DOCS
+	ast_mutex_lock(&agi_docs_lock);
+	if (cmd->docs_pending) {
+		ast_free((char *) cmd->summary);
+		ast_free((char *) cmd->usage);
+		ast_free((char *) cmd->syntax);
+		ast_free((char *) cmd->seealso);
+		agi_command_build_docs(cmd);
+		agi_command_default_docs(cmd);
+		cmd->docs_pending = 0;
+	}
+	ast_mutex_unlock(&agi_docs_lock);
+#endif
+}
+
 static char *help_workhorse(int fd, const char * const match[])
 {
 	char fullcmd[MAX_CMD_LEN], matchstr[MAX_CMD_LEN];
@@ -3396,6 +3787,7 @@ static char *help_workhorse(int fd, const char * const match[])
 		ast_join(fullcmd, sizeof(fullcmd), e->cmda);
 		if (match && strncasecmp(matchstr, fullcmd, strlen(matchstr)))
 			continue;
+		agi_command_docs(e);
 		ast_cli(fd, "%5.5s %30.30s   %s\n", e->dead ? "Yes" : "No" , fullcmd, S_OR(e->summary, "Not available"));
 	}
 	AST_RWLIST_UNLOCK(&agi_commands);
@@ -3413,26 +3805,19 @@ int AST_OPTIONAL_API_NAME(ast_agi_register)(struct ast_module *mod, agi_command
 		*((enum ast_doc_src *) &cmd->docsrc) = AST_STATIC_DOC;
 		if (ast_strlen_zero(cmd->summary) && ast_strlen_zero(cmd->usage)) {
 #ifdef AST_XML_DOCS
-			*((char **) &cmd->summary) = ast_xmldoc_build_synopsis("agi", fullcmd, NULL);
-			*((char **) &cmd->usage) = ast_xmldoc_build_description("agi", fullcmd, NULL);
-			*((char **) &cmd->syntax) = ast_xmldoc_build_syntax("agi", fullcmd, NULL);
-			*((char **) &cmd->seealso) = ast_xmldoc_build_seealso("agi", fullcmd, NULL);
-			*((enum ast_doc_src *) &cmd->docsrc) = AST_XML_DOC;
-#endif
-#ifndef HAVE_NULLSAFE_PRINTF
-			if (!cmd->summary) {
-				*((char **) &cmd->summary) = ast_strdup("");
-			}
-			if (!cmd->usage) {
-				*((char **) &cmd->usage) = ast_strdup("");
-			}
-			if (!cmd->syntax) {
-				*((char **) &cmd->syntax) = ast_strdup("");
-			}
-			if (!cmd->seealso) {
-				*((char **) &cmd->seealso) = ast_strdup("");
+			if (ast_xmldoc_lazy()) {
+				/* Built by agi_command_docs() when first used */
+				*((char **) &cmd->summary) = NULL;
+				*((char **) &cmd->usage) = NULL;
+				*((char **) &cmd->syntax) = NULL;
+				*((char **) &cmd->seealso) = NULL;
+				*((enum ast_doc_src *) &cmd->docsrc) = AST_XML_DOC;
+				cmd->docs_pending = 1;
+			} else {
+				agi_command_build_docs(cmd);
 			}
 #endif
+			agi_command_default_docs(cmd);
 		}
 
 		cmd->mod = mod;
@@ -3679,6 +4064,7 @@ static enum agi_result agi_handle_command(struct ast_channel *chan, AGI *agi, ch
 
 			publish_async_exec_end(chan, command_id, ami_cmd, resultcode, ami_res);
 
+			agi_command_docs(c);
 			if (ast_strlen_zero(c->usage)) {
 				ast_agi_send(agi->fd, chan, "520 Invalid command syntax.  Proper usage not available.\n");
 			} else {
@@ -3703,6 +4089,13 @@ static enum agi_result agi_handle_command(struct ast_channel *chan, AGI *agi, ch
 			publish_async_exec_end(chan, command_id, ami_cmd, resultcode, ami_res);
 
 			return AGI_RESULT_SUCCESS_ASYNC;
+		case AGI_END_SESSION:
+			ami_res = "Success";
+			resultcode = 200;
+
+			publish_async_exec_end(chan, command_id, ami_cmd, resultcode, ami_res);
+
+			return AGI_RESULT_END_SESSION;
 		case RESULT_SUCCESS:
 			ami_res = "Success";
 			resultcode = 200;
@@ -3736,7 +4129,78 @@ static enum agi_result agi_handle_command(struct ast_channel *chan, AGI *agi, ch
 
 	return AGI_RESULT_SUCCESS;
 }
-static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi, int pid, int *status, int dead, int argc, char *argv[])
+/*!
+ * \brief Reads the commands of an AGI script
+ *
+ * Scripts may send several commands without waiting for their results, so
+ * the commands left in the buffer are run before waiting on the script again.
+ */
+struct agi_reader {
+	/*! File descriptor the commands are read from */
+	int fd;
+	/*! Set once the script closed its end or reading failed */
+	unsigned int eof:1;
+	/*! Number of bytes in buf */
+	size_t len;
+	char buf[AGI_BUF_LEN];
+};
+
+/*!
+ * \internal
+ * \brief Check if a command can be read without waiting for the script.
+ */
+static int agi_reader_pending(const struct agi_reader *reader)
+{
+	return reader->len
+		&& (reader->eof || reader->len == sizeof(reader->buf) - 1
+			|| memchr(reader->buf, '\n', reader->len));
+}
+
+/*!
+ * \internal
+ * \brief Read a command line from an AGI script.
+ *
+ * Waits until the line is complete, the buffer is full or the script closed
+ * its end.
+ *
+ * \param reader The reader of the script
+ * \param line Buffer of AGI_BUF_LEN bytes the line is copied to, with its
+ * newline if any. Empty when the script closed its end.
+ */
+static void agi_reader_gets(struct agi_reader *reader, char *line)
+{
+	struct pollfd pfd = { .fd = reader->fd, .events = POLLIN, };
+	char *newline;
+	ssize_t res;
+	size_t len;
+
+	while (!(newline = memchr(reader->buf, '\n', reader->len))
+		&& reader->len < sizeof(reader->buf) - 1 && !reader->eof) {
+		res = read(reader->fd, reader->buf + reader->len, sizeof(reader->buf) - 1 - reader->len);
+		if (res > 0) {
+			reader->len += res;
+		} else if (!res) {
+			reader->eof = 1;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			if (agidebug) {
+				ast_verbose("AGI Rx << temp buffer %.*s - errno %s\nNo \\n received, checking again.\n",
+					(int) reader->len, reader->buf, strerror(errno));
+			}
+			ast_poll(&pfd, 1, -1);
+		} else if (errno != EINTR) {
+			reader->eof = 1;
+		}
+	}
+
+	len = newline ? newline - reader->buf + 1 : reader->len;
+	memcpy(line, reader->buf, len);
+	line[len] = '\0';
+	reader->len -= len;
+	memmove(reader->buf, reader->buf + len, reader->len);
+}
+
+static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi, int pid, int *status, int dead, int argc, char *argv[],
+	int persistent, struct agi_server *server)
 {
 	struct ast_channel *c;
 	int outfd;
@@ -3745,8 +4209,10 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 	enum agi_result returnstatus = AGI_RESULT_SUCCESS;
 	struct ast_frame *f;
 	char buf[AGI_BUF_LEN];
-	char *res = NULL;
-	FILE *readf;
+	struct agi_reader reader = { .fd = agi->ctrl, };
+	/* When the script got what it needed to send its next command */
+	struct timeval waiting;
+	int ended = 0;
 	/* how many times we'll retry if ast_waitfor_nandfs will return without either
 	  channel or file descriptor in case select is interrupted by a system call (EINTR) */
 	int retry = AGI_NANDFS_RETRY;
@@ -3762,17 +4228,9 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 	exit_on_hangup = ast_true(exit_on_hangup_str);
 	ast_channel_unlock(chan);
 
-	if (!(readf = fdopen(agi->ctrl, "r"))) {
-		ast_log(LOG_WARNING, "Unable to fdopen file descriptor\n");
-		if (send_sighup && pid > -1)
-			kill(pid, SIGHUP);
-		close(agi->ctrl);
-		return AGI_RESULT_FAILURE;
-	}
-
-	setlinebuf(readf);
 	setup_env(chan, request, agi->fd, (agi->audio > -1), argc, argv);
-	for (;;) {
+	waiting = ast_tvnow();
+	while (!ended) {
 		if (needhup) {
 			needhup = 0;
 			dead = 1;
@@ -3788,7 +4246,11 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 			}
 		}
 		ms = -1;
-		if (dead) {
+		if (agi_reader_pending(&reader)) {
+			/* Run the commands the script already sent */
+			c = NULL;
+			outfd = agi->ctrl;
+		} else if (dead) {
 			c = ast_waitfor_nandfds(&chan, 0, &agi->ctrl, 1, NULL, &outfd, &ms);
 		} else if (!ast_check_hangup(chan)) {
 			c = ast_waitfor_nandfds(&chan, 1, &agi->ctrl, 1, NULL, &outfd, &ms);
@@ -3819,28 +4281,12 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 				ast_frfree(f);
 			}
 		} else if (outfd > -1) {
-			size_t len = sizeof(buf);
-			size_t buflen = 0;
+			size_t buflen;
 			enum agi_result cmd_status;
 
 			retry = AGI_NANDFS_RETRY;
-			buf[0] = '\0';
 
-			while (len > 1) {
-				res = fgets(buf + buflen, len, readf);
-				if (feof(readf))
-					break;
-				if (ferror(readf) && ((errno != EINTR) && (errno != EAGAIN)))
-					break;
-				if (res != NULL && !agi->fast)
-					break;
-				buflen = strlen(buf);
-				if (buflen && buf[buflen - 1] == '\n')
-					break;
-				len = sizeof(buf) - buflen;
-				if (agidebug)
-					ast_verbose("AGI Rx << temp buffer %s - errno %s\nNo \\n received, checking again.\n", buf, strerror(errno));
-			}
+			agi_reader_gets(&reader, buf);
 
 			if (!buf[0]) {
 				/* Program terminated */
@@ -3864,6 +4310,10 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 				buf[buflen - 1] = '\0';
 			}
 
+			if (server) {
+				agi_server_latency(server, waiting);
+			}
+
 			if (agidebug)
 				ast_verbose("<%s>AGI Rx << %s\n", ast_channel_name(chan), buf);
 			cmd_status = agi_handle_command(chan, agi, buf, dead);
@@ -3874,9 +4324,14 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 					returnstatus = AGI_RESULT_FAILURE;
 				}
 				break;
+			case AGI_RESULT_END_SESSION:
+				ast_verb(3, "<%s>AGI Script %s ended its session, returning %d\n", ast_channel_name(chan), request, returnstatus);
+				ended = 1;
+				break;
 			default:
 				break;
 			}
+			waiting = ast_tvnow();
 		} else {
 			if (--retry <= 0) {
 				ast_log(LOG_WARNING, "No channel, no fd?\n");
@@ -3897,14 +4352,69 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 				usleep(1);
 			}
 			waitpid(pid, status, WNOHANG);
-		} else if (agi->fast) {
+		} else if (agi->fast && !ended) {
 			ast_agi_send(agi->fd, chan, "HANGUP\n");
 		}
 	}
-	fclose(readf);
+	if (persistent && server && ended && !reader.len) {
+		agi_pool_put(server, agi->ctrl);
+	} else {
+		close(agi->ctrl);
+	}
 	return returnstatus;
 }
 
+static int show_servers_cb(void *obj, void *arg, int flags)
+{
+	struct agi_server *server = obj;
+	int *fd = arg;
+
+	ao2_lock(server);
+	ast_cli(*fd, "%-30.30s %8u %8u %8u %6u %4u %8.1f %8.1f %8u %8.1f %8.1f\n",
+		server->name, server->sessions, server->connects, server->reuses,
+		server->failures, server->num_idle,
+		server->connects ? server->connect_time / server->connects / 1000.0 : 0.0,
+		server->connect_time_max / 1000.0,
+		server->commands,
+		server->commands ? server->latency / server->commands / 1000.0 : 0.0,
+		server->latency_max / 1000.0);
+	ao2_unlock(server);
+
+	return 0;
+}
+
+static char *handle_cli_agi_show_servers(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int fd;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "agi show servers";
+		e->usage =
+			"Usage: agi show servers\n"
+			"       Shows the fast AGI servers connected to, with their sessions,\n"
+			"       connections opened and reused, failed connection attempts and\n"
+			"       idle connections. Connect is the time taken to connect, and\n"
+			"       Latency the time from the environment or the result of a\n"
+			"       command to the next command, in milliseconds.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "%-30.30s %8s %8s %8s %6s %4s %8s %8s %8s %8s %8s\n",
+		"Server", "Sessions", "Connects", "Reused", "Failed", "Idle",
+		"Conn avg", "Conn max", "Commands", "Lat avg", "Lat max");
+	fd = a->fd;
+	ao2_callback(agi_servers, OBJ_NODATA, show_servers_cb, &fd);
+
+	return CLI_SUCCESS;
+}
+
 static char *handle_cli_agi_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct agi_command *command;
@@ -3938,6 +4448,7 @@ static char *handle_cli_agi_show(struct ast_cli_entry *e, int cmd, struct ast_cl
 			char stxtitle[10 + AST_TERM_MAX_ESCAPE_CHARS];			/* [Syntax]\n with colors */
 			size_t synlen, desclen, seealsolen, stxlen;
 
+			agi_command_docs(command);
 			term_color(syntitle, "[Synopsis]\n", COLOR_MAGENTA, 0, sizeof(syntitle));
 			term_color(desctitle, "[Description]\n", COLOR_MAGENTA, 0, sizeof(desctitle));
 			term_color(deadtitle, "[Runs Dead]\n", COLOR_MAGENTA, 0, sizeof(deadtitle));
@@ -4062,6 +4573,7 @@ static int write_htmldump(const char *filename)
 		if ((command->cmda[0])[0] == '_')
 			continue;
 		ast_join(fullcmd, sizeof(fullcmd), command->cmda);
+		agi_command_docs(command);
 
 		fprintf(htmlfile, "<TR><TD><TABLE BORDER=\"1\" CELLPADDING=\"5\" WIDTH=\"100%%\">\n");
 		fprintf(htmlfile, "<TR><TH ALIGN=\"CENTER\"><B>%s - %s</B></TH></TR>\n", fullcmd, command->summary);
@@ -4120,6 +4632,8 @@ static int agi_exec_full(struct ast_channel *chan, const char *data, int enhance
 	enum agi_result res;
 	char *buf;
 	int fds[2], efd = -1, pid = -1;
+	int persistent;
+	struct agi_server *server = NULL;
 	AST_DECLARE_APP_ARGS(args,
 		AST_APP_ARG(arg)[MAX_ARGS];
 	);
@@ -4142,7 +4656,12 @@ static int agi_exec_full(struct ast_channel *chan, const char *data, int enhance
 			return -1;
 	}
 #endif
-	res = launch_script(chan, args.argv[0], args.argc, args.argv, fds, enhanced ? &efd : NULL, &pid);
+	ast_channel_lock(chan);
+	persistent = ast_true(pbx_builtin_getvar_helper(chan, "AGIPERSISTENT"));
+	ast_channel_unlock(chan);
+
+	res = launch_script(chan, args.argv[0], args.argc, args.argv, fds, enhanced ? &efd : NULL, &pid,
+		persistent, &server);
 	/* Async AGI do not require run_agi(), so just proceed if normal AGI
 	   or Fast AGI are setup with success. */
 	if (res == AGI_RESULT_SUCCESS || res == AGI_RESULT_SUCCESS_FAST) {
@@ -4151,7 +4670,8 @@ static int agi_exec_full(struct ast_channel *chan, const char *data, int enhance
 		agi.ctrl = fds[0];
 		agi.audio = efd;
 		agi.fast = (res == AGI_RESULT_SUCCESS_FAST) ? 1 : 0;
-		res = run_agi(chan, args.argv[0], &agi, pid, &status, dead, args.argc, args.argv);
+		res = run_agi(chan, args.argv[0], &agi, pid, &status, dead, args.argc, args.argv,
+			persistent, server);
 		/* If the fork'd process returns non-zero, set AGISTATUS to FAILURE */
 		if ((res == AGI_RESULT_SUCCESS || res == AGI_RESULT_SUCCESS_FAST) && status)
 			res = AGI_RESULT_FAILURE;
@@ -4160,12 +4680,14 @@ static int agi_exec_full(struct ast_channel *chan, const char *data, int enhance
 		if (efd > -1)
 			close(efd);
 	}
+	ao2_cleanup(server);
 	ast_safe_fork_cleanup();
 
 	switch (res) {
 	case AGI_RESULT_SUCCESS:
 	case AGI_RESULT_SUCCESS_FAST:
 	case AGI_RESULT_SUCCESS_ASYNC:
+	case AGI_RESULT_END_SESSION:
 		pbx_builtin_setvar_helper(chan, "AGISTATUS", "SUCCESS");
 		break;
 	case AGI_RESULT_FAILURE:
@@ -4226,6 +4748,7 @@ static struct ast_cli_entry cli_agi[] = {
 	AST_CLI_DEFINE(handle_cli_agi_add_cmd,   "Add AGI command to a channel in Async AGI"),
 	AST_CLI_DEFINE(handle_cli_agi_debug,     "Enable/Disable AGI debugging"),
 	AST_CLI_DEFINE(handle_cli_agi_show,      "List AGI commands or specific help"),
+	AST_CLI_DEFINE(handle_cli_agi_show_servers, "Show fast AGI servers"),
 	AST_CLI_DEFINE(handle_cli_agi_dump_html, "Dumps a list of AGI commands in HTML format")
 };
 
@@ -4284,6 +4807,8 @@ static int unload_module(void)
 	ast_manager_unregister("AGI");
 	ast_unregister_application(app);
 	AST_TEST_UNREGISTER(test_agi_null_docs);
+	ao2_cleanup(agi_servers);
+	agi_servers = NULL;
 	return 0;
 }
 
@@ -4291,6 +4816,12 @@ static int load_module(void)
 {
 	int err = 0;
 
+	agi_servers = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 17,
+		agi_server_hash_fn, NULL, agi_server_cmp_fn);
+	if (!agi_servers) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	err |= STASIS_MESSAGE_TYPE_INIT(agi_exec_start_type);
 	err |= STASIS_MESSAGE_TYPE_INIT(agi_exec_end_type);
 	err |= STASIS_MESSAGE_TYPE_INIT(agi_async_start_type);
@@ -103,6 +103,26 @@
 						Value is in milliseconds; default is 100 ms.</para>
 					</description>
 				</configOption>
+				<configOption name="websocket_compression" default="no">
+					<synopsis>Compress WebSocket messages with permessage-deflate</synopsis>
+					<description>
+						<para>If a client offers the permessage-deflate extension (RFC 7692)
+						when connecting its WebSocket, accept it, and compress the events sent
+						to it. The repetitive JSON of events typically shrinks many times over,
+						at the cost of some CPU and memory for each connection. Has no effect
+						if Asterisk was built without zlib.</para>
+					</description>
+				</configOption>
+				<configOption name="websocket_coalesce" default="0">
+					<synopsis>How long in milliseconds events may wait to be sent together</synopsis>
+					<description>
+						<para>Events raised within this many milliseconds of each other are
+						sent to the WebSocket in a single write, rather than one write each.
+						This adds up to the given latency to each event in exchange for
+						fewer system calls and packets. Set to 0, the default, to send each
+						event at once.</para>
+					</description>
+				</configOption>
 				<configOption name="pretty">
 					<synopsis>Responses from ARI are formatted to be human readable</synopsis>
 				</configOption>
@@ -268,6 +288,8 @@ void ast_ari_response_error(struct ast_ari_response *response,
 	va_end(ap);
 	response->message = ast_json_pack("{s: o}",
 					  "message", ast_json_ref(message));
+	ast_free(response->body);
+	response->body = NULL;
 	response->response_code = response_code;
 	response->response_text = response_text;
 }
@@ -280,6 +302,20 @@ void ast_ari_response_ok(struct ast_ari_response *response,
 	response->response_text = "OK";
 }
 
+void ast_ari_response_ok_body(struct ast_ari_response *response,
+	struct ast_str *body)
+{
+#if defined(AST_DEVMODE)
+	/* Responses are validated against the model, so it needs the JSON */
+	response->message = ast_json_load_str(body, NULL);
+#else
+	response->message = ast_json_null();
+#endif
+	response->body = body;
+	response->response_code = 200;
+	response->response_text = "OK";
+}
+
 void ast_ari_response_no_content(struct ast_ari_response *response)
 {
 	response->message = ast_json_null();
@@ -871,6 +907,7 @@ static int ast_ari_callback(struct ast_tcptls_session_instance *ser,
 	RAII_VAR(struct ast_ari_conf_user *, user, NULL, ao2_cleanup);
 	struct ast_ari_response response = {};
 	RAII_VAR(struct ast_variable *, post_vars, NULL, ast_variables_destroy);
+	int json_arena = 0;
 
 	if (!response_body) {
 		ast_http_request_close_on_completion(ser);
@@ -971,7 +1008,12 @@ static int ast_ari_callback(struct ast_tcptls_session_instance *ser,
 			ast_ari_get_docs(strchr(uri, '/') + 1, headers, &response);
 		}
 	} else {
-		/* Other RESTful resources */
+		/* Other RESTful resources. A GET only builds JSON for the
+		 * response, which is dropped once sent. */
+		json_arena = method == AST_HTTP_GET;
+		if (json_arena) {
+			ast_json_arena_begin();
+		}
 		ast_ari_invoke(ser, uri, method, get_params, headers,
 			&response);
 	}
@@ -980,6 +1022,11 @@ static int ast_ari_callback(struct ast_tcptls_session_instance *ser,
 		/* The handler indicates no further response is necessary.
 		 * Probably because it already handled it */
 		ast_free(response.headers);
+		ast_free(response.body);
+		ast_json_unref(response.message);
+		if (json_arena) {
+			ast_json_arena_end();
+		}
 		return 0;
 	}
 
@@ -993,7 +1040,14 @@ request_failed:
 	/* response.message could be NULL, in which case the empty response_body
 	 * is correct
 	 */
-	if (response.message && !ast_json_is_null(response.message)) {
+	if (response.body) {
+		/* The handler already encoded the response */
+		ast_str_append(&response.headers, 0,
+			       "Content-type: application/json\r\n");
+		ast_free(response_body);
+		response_body = response.body;
+		response.body = NULL;
+	} else if (response.message && !ast_json_is_null(response.message)) {
 		ast_str_append(&response.headers, 0,
 			       "Content-type: application/json\r\n");
 		if (ast_json_dump_str_format(response.message, &response_body,
@@ -1015,6 +1069,9 @@ request_failed:
 	response_body = NULL;
 
 	ast_json_unref(response.message);
+	if (json_arena) {
+		ast_json_arena_end();
+	}
 	return 0;
 }
 
@@ -114,6 +114,9 @@ static int ast_ari_events_event_websocket_ws_attempted_cb(struct ast_tcptls_sess
 		if (strcmp(i->name, "subscribeAll") == 0) {
 			args.subscribe_all = ast_true(i->value);
 		} else
+		if (strcmp(i->name, "compact") == 0) {
+			args.compact = ast_true(i->value);
+		} else
 		{}
 	}
 
@@ -215,6 +218,9 @@ static void ast_ari_events_event_websocket_ws_established_cb(struct ast_websocke
 		if (strcmp(i->name, "subscribeAll") == 0) {
 			args.subscribe_all = ast_true(i->value);
 		} else
+		if (strcmp(i->name, "compact") == 0) {
+			args.compact = ast_true(i->value);
+		} else
 		{}
 	}
 
@@ -41,11 +41,15 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/stasis_message_router.h"
 #include "asterisk/statsd.h"
 #include "asterisk/time.h"
+#include "asterisk/rtp_engine.h"
+#include "asterisk/json.h"
 
 /*! Regular Stasis subscription */
 static struct stasis_subscription *sub;
 /*! Stasis message router */
 static struct stasis_message_router *router;
+/*! Stasis message router for RTP messages */
+static struct stasis_message_router *rtp_router;
 
 /*!
  * \brief Subscription callback for all channel messages.
@@ -129,6 +133,63 @@ static void updates(void *data, struct stasis_subscription *sub,
 	}
 }
 
+/*!
+ * \brief Send the gauges of one media quality summary entry.
+ * \param kind Whether the entry is for an endpoint or a host.
+ * \param summary The JSON of the entry.
+ */
+static void quality_gauges(const char *kind, struct ast_json *summary)
+{
+	static const char * const metrics[] = { "jitter", "loss", "rtt" };
+	char *name = ast_strdupa(ast_json_string_get(ast_json_object_get(summary, "name")));
+	char *pos;
+	int i;
+
+	/* Statsd uses dots to separate the parts of a metric name. Values are
+	 * whole milliseconds for jitter and RTT and whole percent for loss. */
+	for (pos = name; *pos; ++pos) {
+		if (*pos == '.' || *pos == ':' || *pos == '/') {
+			*pos = '_';
+		}
+	}
+
+	for (i = 0; i < ARRAY_LEN(metrics); ++i) {
+		struct ast_json *metric = ast_json_object_get(summary, metrics[i]);
+
+		if (!ast_json_integer_get(ast_json_object_get(metric, "samples"))) {
+			continue;
+		}
+		ast_statsd_log_full_va("rtp.quality.%s.%s.%s.mean", AST_STATSD_GAUGE,
+			(intmax_t) (ast_json_real_get(ast_json_object_get(metric, "mean")) + 0.5), 1.0, kind, name, metrics[i]);
+		ast_statsd_log_full_va("rtp.quality.%s.%s.%s.p95", AST_STATSD_GAUGE,
+			(intmax_t) (ast_json_real_get(ast_json_object_get(metric, "p95")) + 0.5), 1.0, kind, name, metrics[i]);
+		ast_statsd_log_full_va("rtp.quality.%s.%s.%s.max", AST_STATSD_GAUGE,
+			(intmax_t) (ast_json_real_get(ast_json_object_get(metric, "max")) + 0.5), 1.0, kind, name, metrics[i]);
+	}
+}
+
+/*!
+ * \brief Router callback for media quality summaries.
+ * \param data Data pointer given when added to router.
+ * \param sub This subscription.
+ * \param message The message itself.
+ */
+static void quality_summary(void *data, struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	struct ast_json_payload *payload = stasis_message_data(message);
+	struct ast_json *endpoints = ast_json_object_get(payload->json, "endpoints");
+	struct ast_json *hosts = ast_json_object_get(payload->json, "hosts");
+	size_t i;
+
+	for (i = 0; i < ast_json_array_size(endpoints); ++i) {
+		quality_gauges("endpoint", ast_json_array_get(endpoints, i));
+	}
+	for (i = 0; i < ast_json_array_size(hosts); ++i) {
+		quality_gauges("host", ast_json_array_get(hosts, i));
+	}
+}
+
 /*!
  * \brief Router callback for any message that doesn't otherwise have a route.
  * \param data Data pointer given when added to router.
@@ -167,6 +228,14 @@ static int load_module(void)
 	if (!sub) {
 		return AST_MODULE_LOAD_FAILURE;
 	}
+
+	/* Media quality arrives as one summary per window */
+	rtp_router = stasis_message_router_create(ast_rtp_topic());
+	if (!rtp_router) {
+		return AST_MODULE_LOAD_FAILURE;
+	}
+	stasis_message_router_add(rtp_router, ast_rtp_quality_summary_type(),
+		quality_summary, NULL);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -176,6 +245,8 @@ static int unload_module(void)
 	sub = NULL;
 	stasis_message_router_unsubscribe_and_join(router);
 	router = NULL;
+	stasis_message_router_unsubscribe_and_join(rtp_router);
+	rtp_router = NULL;
 	return 0;
 }
 
@@ -98,24 +98,16 @@ static inline int is_text(const struct odbc_cache_columns *column)
 
 static SQLHSTMT custom_prepare(struct odbc_obj *obj, void *data)
 {
-	int res, x = 1, count = 0;
+	int x = 1, count = 0;
 	struct custom_prepare_struct *cps = data;
 	const struct ast_variable *field;
 	char encodebuf[1024];
 	SQLHSTMT stmt;
 
-	res = SQLAllocHandle(SQL_HANDLE_STMT, obj->con, &stmt);
-	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
-		ast_log(LOG_WARNING, "SQL Alloc Handle failed!\n");
-		return NULL;
-	}
-
 	ast_debug(1, "Skip: %llu; SQL: %s\n", cps->skip, cps->sql);
 
-	res = SQLPrepare(stmt, (unsigned char *)cps->sql, SQL_NTS);
-	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
-		ast_log(LOG_WARNING, "SQL Prepare failed![%s]\n", cps->sql);
-		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+	/* The same SQL is run over and over, so keep it prepared */
+	if (!(stmt = ast_odbc_prepare_cached(obj, cps->sql))) {
 		return NULL;
 	}
 
@@ -220,20 +212,20 @@ static struct ast_variable *realtime_odbc(const char *database, const char *tabl
 	res = SQLNumResultCols(stmt, &colcount);
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
 		ast_log(LOG_WARNING, "SQL Column Count error!\n[%s]\n\n", sql);
-		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+		ast_odbc_release_stmt(obj, stmt);
 		ast_odbc_release_obj(obj);
 		return NULL;
 	}
 
 	res = SQLFetch(stmt);
 	if (res == SQL_NO_DATA) {
-		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+		ast_odbc_release_stmt(obj, stmt);
 		ast_odbc_release_obj(obj);
 		return NULL;
 	}
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
 		ast_log(LOG_WARNING, "SQL Fetch error!\n[%s]\n\n", sql);
-		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+		ast_odbc_release_stmt(obj, stmt);
 		ast_odbc_release_obj(obj);
 		return NULL;
 	}
@@ -246,6 +238,7 @@ static struct ast_variable *realtime_odbc(const char *database, const char *tabl
 			ast_log(LOG_WARNING, "SQL Describe Column error!\n[%s]\n\n", sql);
 			if (var)
 				ast_variables_destroy(var);
+			ast_odbc_release_stmt(obj, stmt);
 			ast_odbc_release_obj(obj);
 			return NULL;
 		}
@@ -275,6 +268,7 @@ static struct ast_variable *realtime_odbc(const char *database, const char *tabl
 			ast_log(LOG_WARNING, "SQL Get Data error!\n[%s]\n\n", sql);
 			if (var)
 				ast_variables_destroy(var);
+			ast_odbc_release_stmt(obj, stmt);
 			ast_odbc_release_obj(obj);
 			return NULL;
 		}
@@ -298,7 +292,7 @@ static struct ast_variable *realtime_odbc(const char *database, const char *tabl
 		}
 	}
 
-	SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+	ast_odbc_release_stmt(obj, stmt);
 	ast_odbc_release_obj(obj);
 	return var;
 }
@@ -384,7 +378,7 @@ static struct ast_config *realtime_multi_odbc(const char *database, const char *
 	res = SQLNumResultCols(stmt, &colcount);
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
 		ast_log(LOG_WARNING, "SQL Column Count error!\n[%s]\n\n", sql);
-		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+		ast_odbc_release_stmt(obj, stmt);
 		ast_odbc_release_obj(obj);
 		return NULL;
 	}
@@ -392,7 +386,7 @@ static struct ast_config *realtime_multi_odbc(const char *database, const char *
 	cfg = ast_config_new();
 	if (!cfg) {
 		ast_log(LOG_WARNING, "Out of memory!\n");
-		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+		ast_odbc_release_stmt(obj, stmt);
 		ast_odbc_release_obj(obj);
 		return NULL;
 	}
@@ -462,7 +456,7 @@ static struct ast_config *realtime_multi_odbc(const char *database, const char *
 next_sql_fetch:;
 	}
 
-	SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+	ast_odbc_release_stmt(obj, stmt);
 	ast_odbc_release_obj(obj);
 	return cfg;
 }
@@ -545,7 +539,7 @@ static int update_odbc(const char *database, const char *table, const char *keyf
 	}
 
 	res = SQLRowCount(stmt, &rowcount);
-	SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+	ast_odbc_release_stmt(obj, stmt);
 	ast_odbc_release_obj(obj);
 
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
@@ -741,7 +735,7 @@ static int store_odbc(const char *database, const char *table, const struct ast_
 	}
 
 	res = SQLRowCount(stmt, &rowcount);
-	SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+	ast_odbc_release_stmt(obj, stmt);
 	ast_odbc_release_obj(obj);
 
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
@@ -810,7 +804,7 @@ static int destroy_odbc(const char *database, const char *table, const char *key
 	}
 
 	res = SQLRowCount(stmt, &rowcount);
-	SQLFreeHandle (SQL_HANDLE_STMT, stmt);
+	ast_odbc_release_stmt(obj, stmt);
 	ast_odbc_release_obj(obj);
 
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
@@ -47,6 +47,7 @@ ASTERISK_REGISTER_FILE();
 #include "asterisk/app.h"
 #include "asterisk/stasis.h"
 #include "asterisk/stasis_message_router.h"
+#include "asterisk/vector.h"
 
 AST_RWLOCK_DEFINE_STATIC(event_types_lock);
 
@@ -262,6 +263,532 @@ static void publish_device_state_to_stasis(struct ast_event *event)
 	}
 }
 
+/*!
+ * \brief Type in the header of a batch of events
+ *
+ * A batch starts with an event header of this type holding only the EID of
+ * the sender, so versions without batching ignore it.
+ */
+#define BATCH_EVENT_TYPE 0x4162
+
+/*! \brief Version of the encoding of the events in a batch */
+#define BATCH_VERSION 1
+
+/*!
+ * \brief Size of the header of a batch
+ *
+ * Event header, EID information element, version and number of events.
+ */
+#define BATCH_HEADER_SIZE (4 + 4 + sizeof(struct ast_eid) + 1 + 2)
+
+/*! \brief A batch is sent as soon as its events reach this size */
+#define BATCH_MAX_SIZE 32768
+
+/*!
+ * \brief An event waiting in the batch
+ *
+ * A batch holds the latest event of each device and mailbox. It is encoded
+ * as the type of the event on one byte followed by
+ *
+ * \li for device states: the state and cachable on one byte each, then
+ * the length of the device on two bytes and the device
+ * \li for MWI: the new and old messages on four bytes each, then the
+ * lengths of the mailbox and the context on two bytes, each followed by
+ * the string
+ *
+ * Integers are in network byte order and strings are not terminated.
+ */
+struct batched_event {
+	/*! AST_EVENT_DEVICE_STATE_CHANGE or AST_EVENT_MWI */
+	enum ast_event_type type;
+	/*! State and cachable of a device, or new and old messages of a mailbox */
+	unsigned int values[2];
+	/*! The device or the mailbox */
+	const char *name;
+	/*! The context of the mailbox */
+	const char *context;
+	/*! Size of the encoded event */
+	size_t size;
+	/*! Type, name and context, unique in the batch */
+	char key[0];
+};
+
+AST_MUTEX_DEFINE_STATIC(batch_lock);
+
+/*! \brief Events waiting to be sent, protected by batch_lock */
+static struct {
+	/*! The batched_event objects by key */
+	struct ao2_container *events;
+	/*! When the batch is sent */
+	struct timeval deadline;
+	/*! Size of the encoded events */
+	size_t size;
+	/*! Milliseconds an event waits for others, 0 to send each event on its own */
+	unsigned int window;
+} batch;
+
+/*! \brief Messages and events received from a node of the cluster */
+struct corosync_node_stats {
+	/*! Corosync ID of the node */
+	uint32_t nodeid;
+	/*! Messages delivered from the node */
+	unsigned int messages;
+	/*! Events in the messages */
+	unsigned int events;
+	/*! Size of the messages */
+	uint64_t bytes;
+};
+
+AST_MUTEX_DEFINE_STATIC(stats_lock);
+
+/*! \brief What this server sent and received, protected by stats_lock */
+static struct {
+	/*! Messages sent */
+	unsigned int messages;
+	/*! Events in the messages sent */
+	unsigned int events;
+	/*! Events replaced in the batch by a later one of the same device or mailbox */
+	unsigned int coalesced;
+	/*! Messages corosync failed to send */
+	unsigned int failures;
+	/*! Size of the messages sent */
+	uint64_t bytes;
+	/*! What was received from each node, including this one */
+	AST_VECTOR(, struct corosync_node_stats) nodes;
+} stats;
+
+/*! \brief Record a message delivered from a node */
+static void stats_received(uint32_t nodeid, unsigned int events, size_t size)
+{
+	struct corosync_node_stats *node = NULL;
+	struct corosync_node_stats new_node = { .nodeid = nodeid, };
+	int i;
+
+	ast_mutex_lock(&stats_lock);
+	for (i = 0; i < AST_VECTOR_SIZE(&stats.nodes); i++) {
+		if (AST_VECTOR_GET_ADDR(&stats.nodes, i)->nodeid == nodeid) {
+			node = AST_VECTOR_GET_ADDR(&stats.nodes, i);
+			break;
+		}
+	}
+	if (!node && !AST_VECTOR_APPEND(&stats.nodes, new_node)) {
+		node = AST_VECTOR_GET_ADDR(&stats.nodes, AST_VECTOR_SIZE(&stats.nodes) - 1);
+	}
+	if (node) {
+		node->messages++;
+		node->events += events;
+		node->bytes += size;
+	}
+	ast_mutex_unlock(&stats_lock);
+}
+
+/*!
+ * \brief Send a message to the cluster
+ *
+ * \param iov The message
+ * \param events Number of events in the message
+ */
+static void corosync_mcast(struct iovec *iov, unsigned int events)
+{
+	cs_error_t cs_err;
+
+	/* The stasis subscription will only exist if we are configured to publish
+	 * these events, so just send away. */
+	cs_err = cpg_mcast_joined(cpg_handle, CPG_TYPE_FIFO, iov, 1);
+
+	ast_mutex_lock(&stats_lock);
+	if (cs_err == CS_OK) {
+		stats.messages++;
+		stats.events += events;
+		stats.bytes += iov->iov_len;
+	} else {
+		stats.failures++;
+	}
+	ast_mutex_unlock(&stats_lock);
+
+	if (cs_err != CS_OK) {
+		ast_log(LOG_WARNING, "CPG mcast failed (%u)\n", cs_err);
+	}
+}
+
+static int batched_event_hash_fn(const void *obj, const int flags)
+{
+	const struct batched_event *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int batched_event_cmp_fn(void *obj, void *arg, int flags)
+{
+	const struct batched_event *object_left = obj;
+	const struct batched_event *object_right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		if (strcmp(object_left->key, right_key)) {
+			return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+	return CMP_MATCH;
+}
+
+static unsigned char *batch_put16(unsigned char *pos, uint16_t value)
+{
+	value = htons(value);
+	memcpy(pos, &value, sizeof(value));
+	return pos + sizeof(value);
+}
+
+static unsigned char *batch_put32(unsigned char *pos, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(pos, &value, sizeof(value));
+	return pos + sizeof(value);
+}
+
+static uint16_t batch_get16(const unsigned char *pos)
+{
+	uint16_t value;
+
+	memcpy(&value, pos, sizeof(value));
+	return ntohs(value);
+}
+
+static uint32_t batch_get32(const unsigned char *pos)
+{
+	uint32_t value;
+
+	memcpy(&value, pos, sizeof(value));
+	return ntohl(value);
+}
+
+static int batch_encode_cb(void *obj, void *arg, int flags)
+{
+	struct batched_event *batched = obj;
+	unsigned char **pos = arg;
+	size_t len;
+
+	*(*pos)++ = batched->type;
+	if (batched->type == AST_EVENT_DEVICE_STATE_CHANGE) {
+		*(*pos)++ = batched->values[0];
+		*(*pos)++ = batched->values[1];
+	} else {
+		*pos = batch_put32(*pos, batched->values[0]);
+		*pos = batch_put32(*pos, batched->values[1]);
+	}
+	len = strlen(batched->name);
+	*pos = batch_put16(*pos, len);
+	memcpy(*pos, batched->name, len);
+	*pos += len;
+	if (batched->type == AST_EVENT_MWI) {
+		len = strlen(batched->context);
+		*pos = batch_put16(*pos, len);
+		memcpy(*pos, batched->context, len);
+		*pos += len;
+	}
+
+	return CMP_MATCH;
+}
+
+/*!
+ * \internal
+ * \brief Send the events waiting in the batch.
+ *
+ * \note batch_lock must be held, so batches are sent in order.
+ */
+static void batch_send(void)
+{
+	unsigned char *buf;
+	unsigned char *pos;
+	unsigned int count;
+	struct iovec iov;
+
+	count = ao2_container_count(batch.events);
+	if (!count) {
+		return;
+	}
+
+	buf = ast_malloc(BATCH_HEADER_SIZE + batch.size);
+	if (!buf) {
+		ao2_callback(batch.events, OBJ_NODATA | OBJ_UNLINK | OBJ_MULTIPLE, NULL, NULL);
+		batch.size = 0;
+		return;
+	}
+
+	pos = batch_put16(buf, BATCH_EVENT_TYPE);
+	pos = batch_put16(pos, BATCH_HEADER_SIZE - 3);
+	pos = batch_put16(pos, AST_EVENT_IE_EID);
+	pos = batch_put16(pos, sizeof(ast_eid_default));
+	memcpy(pos, &ast_eid_default, sizeof(ast_eid_default));
+	pos += sizeof(ast_eid_default);
+	*pos++ = BATCH_VERSION;
+	pos = batch_put16(pos, count);
+
+	ao2_callback(batch.events, OBJ_NODATA | OBJ_UNLINK | OBJ_MULTIPLE, batch_encode_cb, &pos);
+
+	iov.iov_base = buf;
+	iov.iov_len = pos - buf;
+
+	ast_debug(5, "Publishing a batch of %u events to corosync\n", count);
+
+	corosync_mcast(&iov, count);
+
+	batch.size = 0;
+	ast_free(buf);
+}
+
+/*!
+ * \internal
+ * \brief Add an event to the batch.
+ *
+ * The event replaces the one of the same device or mailbox waiting in the
+ * batch, if any.
+ *
+ * \retval 0 the event is in the batch
+ * \retval -1 the event must be sent on its own
+ */
+static int batch_add(struct ast_event *event)
+{
+	enum ast_event_type type = ast_event_get_type(event);
+	struct batched_event *batched;
+	struct batched_event *replaced;
+	const char *name;
+	const char *context = "";
+	unsigned int values[2];
+	size_t name_len;
+	size_t context_len;
+	size_t key_len;
+	int res = 0;
+
+	switch (type) {
+	case AST_EVENT_DEVICE_STATE_CHANGE:
+		name = ast_event_get_ie_str(event, AST_EVENT_IE_DEVICE);
+		values[0] = ast_event_get_ie_uint(event, AST_EVENT_IE_STATE);
+		values[1] = ast_event_get_ie_uint(event, AST_EVENT_IE_CACHABLE);
+		if (values[0] > UINT8_MAX || values[1] > UINT8_MAX) {
+			return -1;
+		}
+		break;
+	case AST_EVENT_MWI:
+		name = ast_event_get_ie_str(event, AST_EVENT_IE_MAILBOX);
+		context = S_OR(ast_event_get_ie_str(event, AST_EVENT_IE_CONTEXT), "");
+		values[0] = ast_event_get_ie_uint(event, AST_EVENT_IE_NEWMSGS);
+		values[1] = ast_event_get_ie_uint(event, AST_EVENT_IE_OLDMSGS);
+		break;
+	default:
+		return -1;
+	}
+
+	if (ast_strlen_zero(name)) {
+		return -1;
+	}
+	name_len = strlen(name);
+	context_len = strlen(context);
+	if (name_len > UINT16_MAX || context_len > UINT16_MAX) {
+		return -1;
+	}
+
+	/* The type, the name, a separator and the context */
+	key_len = 1 + name_len + 1 + context_len;
+	batched = ao2_alloc_options(sizeof(*batched) + key_len + 1 + name_len + 1 + context_len + 1,
+		NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!batched) {
+		return -1;
+	}
+	batched->type = type;
+	batched->values[0] = values[0];
+	batched->values[1] = values[1];
+	sprintf(batched->key, "%c%s@%s", type == AST_EVENT_MWI ? 'M' : 'D', name, context);
+	batched->name = strcpy(batched->key + key_len + 1, name);
+	batched->context = strcpy(batched->key + key_len + 1 + name_len + 1, context);
+	if (type == AST_EVENT_DEVICE_STATE_CHANGE) {
+		batched->size = 1 + 1 + 1 + 2 + name_len;
+	} else {
+		batched->size = 1 + 4 + 4 + 2 + name_len + 2 + context_len;
+	}
+
+	ast_mutex_lock(&batch_lock);
+	if (!batch.window || !batch.events) {
+		res = -1;
+	} else {
+		replaced = ao2_find(batch.events, batched->key, OBJ_SEARCH_KEY | OBJ_UNLINK);
+		if (replaced) {
+			batch.size -= replaced->size;
+			ao2_ref(replaced, -1);
+			ast_mutex_lock(&stats_lock);
+			stats.coalesced++;
+			ast_mutex_unlock(&stats_lock);
+		} else if (!ao2_container_count(batch.events)) {
+			char wakeup = 'b';
+
+			/* Let the dispatch thread know when to send the batch */
+			batch.deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(batch.window, 1000));
+			if (dispatch_thread.alert_pipe[1] > -1
+				&& write(dispatch_thread.alert_pipe[1], &wakeup, 1) != 1) {
+				ast_log(LOG_WARNING, "Failed to wake up the CPG dispatch thread\n");
+			}
+		}
+		if (ao2_link(batch.events, batched)) {
+			batch.size += batched->size;
+			if (batch.size >= BATCH_MAX_SIZE) {
+				batch_send();
+			}
+		} else {
+			res = -1;
+		}
+	}
+	ast_mutex_unlock(&batch_lock);
+
+	ao2_ref(batched, -1);
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Send the batch if its window elapsed.
+ *
+ * \return Milliseconds until the batch is due, -1 if it is empty
+ */
+static int batch_check(void)
+{
+	int ms = -1;
+
+	ast_mutex_lock(&batch_lock);
+	if (batch.events && ao2_container_count(batch.events)) {
+		ms = ast_tvdiff_ms(batch.deadline, ast_tvnow());
+		if (ms <= 0) {
+			batch_send();
+			ms = -1;
+		}
+	}
+	ast_mutex_unlock(&batch_lock);
+
+	return ms;
+}
+
+/*!
+ * \internal
+ * \brief Publish the events of a batch received from another server.
+ */
+static void batch_deliver(const unsigned char *msg, size_t msg_len)
+{
+	const unsigned char *pos = msg + BATCH_HEADER_SIZE;
+	const unsigned char *end = msg + msg_len;
+	struct ast_eid eid;
+	char eid_str[32];
+	int subscribe_mwi;
+	int subscribe_device_state;
+	unsigned int values[2];
+	unsigned int type;
+	size_t name_len;
+	size_t context_len;
+	char *name;
+	char *context;
+
+	memcpy(&eid, msg + 8, sizeof(eid));
+
+	if (msg[BATCH_HEADER_SIZE - 3] != BATCH_VERSION) {
+		ast_eid_to_str(eid_str, sizeof(eid_str), &eid);
+		ast_debug(1, "Ignoring batch of version %u from %s\n",
+			msg[BATCH_HEADER_SIZE - 3], eid_str);
+		return;
+	}
+
+	ast_rwlock_rdlock(&event_types_lock);
+	subscribe_mwi = event_types[AST_EVENT_MWI].subscribe;
+	subscribe_device_state = event_types[AST_EVENT_DEVICE_STATE_CHANGE].subscribe;
+	ast_rwlock_unlock(&event_types_lock);
+
+	/* The strings of an event, terminated, always fit in the size of the batch */
+	if (!(name = ast_malloc(msg_len))) {
+		return;
+	}
+
+	while (end - pos > 0) {
+		type = *pos++;
+		if (type == AST_EVENT_DEVICE_STATE_CHANGE) {
+			if (end - pos < 4) {
+				break;
+			}
+			values[0] = pos[0];
+			values[1] = pos[1];
+			name_len = batch_get16(pos + 2);
+			pos += 4;
+			if (end - pos < name_len) {
+				break;
+			}
+			if (subscribe_device_state && name_len && values[0] < AST_DEVICE_TOTAL) {
+				memcpy(name, pos, name_len);
+				name[name_len] = '\0';
+				if (ast_publish_device_state_full(name, values[0], values[1], &eid)) {
+					ast_eid_to_str(eid_str, sizeof(eid_str), &eid);
+					ast_log(LOG_WARNING, "Failed to publish device state message for %s from %s\n",
+						name, eid_str);
+				}
+			}
+			pos += name_len;
+		} else if (type == AST_EVENT_MWI) {
+			if (end - pos < 10) {
+				break;
+			}
+			values[0] = MIN(batch_get32(pos), INT_MAX);
+			values[1] = MIN(batch_get32(pos + 4), INT_MAX);
+			name_len = batch_get16(pos + 8);
+			pos += 10;
+			if (end - pos < name_len + 2) {
+				break;
+			}
+			context_len = batch_get16(pos + name_len);
+			if (end - pos < name_len + 2 + context_len) {
+				break;
+			}
+			if (subscribe_mwi && name_len && context_len) {
+				memcpy(name, pos, name_len);
+				name[name_len] = '\0';
+				context = name + name_len + 1;
+				memcpy(context, pos + name_len + 2, context_len);
+				context[context_len] = '\0';
+				if (ast_publish_mwi_state_full(name, context, values[0], values[1], NULL, &eid)) {
+					ast_eid_to_str(eid_str, sizeof(eid_str), &eid);
+					ast_log(LOG_WARNING, "Failed to publish MWI message for %s@%s from %s\n",
+						name, context, eid_str);
+				}
+			}
+			pos += name_len + 2 + context_len;
+		} else {
+			/* The length of an unknown event is unknown, so stop here. */
+			break;
+		}
+	}
+
+	if (pos != end) {
+		ast_eid_to_str(eid_str, sizeof(eid_str), &eid);
+		ast_debug(1, "Ignoring the rest of a malformed batch from %s\n", eid_str);
+	}
+
+	ast_free(name);
+}
+
 static void cpg_deliver_cb(cpg_handle_t handle, const struct cpg_name *group_name,
 		uint32_t nodeid, uint32_t pid, void *msg, size_t msg_len);
 
@@ -302,12 +829,27 @@ static void cpg_deliver_cb(cpg_handle_t handle, const struct cpg_name *group_nam
 		return;
 	}
 
+	event_type = ast_event_get_type(msg);
+	if (event_type == BATCH_EVENT_TYPE) {
+		if (msg_len < BATCH_HEADER_SIZE) {
+			ast_debug(1, "Ignoring batch that's too small. %u < %u\n",
+				(unsigned int) msg_len, (unsigned int) BATCH_HEADER_SIZE);
+			return;
+		}
+		stats_received(nodeid, batch_get16((unsigned char *) msg + BATCH_HEADER_SIZE - 2), msg_len);
+	} else {
+		stats_received(nodeid, 1, msg_len);
+	}
+
 	if (!ast_eid_cmp(&ast_eid_default, ast_event_get_ie_raw(msg, AST_EVENT_IE_EID))) {
 		/* Don't feed events back in that originated locally. */
 		return;
 	}
 
-	event_type = ast_event_get_type(msg);
+	if (event_type == BATCH_EVENT_TYPE) {
+		batch_deliver(msg, msg_len);
+		return;
+	}
 	if (event_type > AST_EVENT_TOTAL) {
 		/* Egads, we don't support this */
 		return;
@@ -344,7 +886,6 @@ static void cpg_deliver_cb(cpg_handle_t handle, const struct cpg_name *group_nam
 
 static void publish_to_corosync(struct stasis_message *message)
 {
-	cs_error_t cs_err;
 	struct iovec iov;
 	struct ast_event *event;
 
@@ -366,6 +907,9 @@ static void publish_to_corosync(struct stasis_message *message)
 		eid = ast_event_get_ie_raw(event, AST_EVENT_IE_EID);
 		ast_eid_to_str(buf, sizeof(buf), (struct ast_eid *) eid);
 		ast_log(LOG_NOTICE, "Sending event PING from this server with EID: '%s'\n", buf);
+	} else if (!batch_add(event)) {
+		ast_event_destroy(event);
+		return;
 	}
 
 	iov.iov_base = (void *)event;
@@ -374,11 +918,9 @@ static void publish_to_corosync(struct stasis_message *message)
 	ast_debug(5, "Publishing event %s (%u) to corosync\n",
 		ast_event_get_type_name(event), ast_event_get_type(event));
 
-	/* The stasis subscription will only exist if we are configured to publish
-	 * these events, so just send away. */
-	if ((cs_err = cpg_mcast_joined(cpg_handle, CPG_TYPE_FIFO, &iov, 1)) != CS_OK) {
-		ast_log(LOG_WARNING, "CPG mcast failed (%u)\n", cs_err);
-	}
+	corosync_mcast(&iov, 1);
+
+	ast_event_destroy(event);
 }
 
 static void stasis_message_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
@@ -472,12 +1014,23 @@ static void *dispatch_thread_handler(void *data)
 		pfd[1].revents = 0;
 		pfd[2].revents = 0;
 
-		res = ast_poll(pfd, ARRAY_LEN(pfd), -1);
+		/* Wake up when the batch of events is due */
+		res = ast_poll(pfd, ARRAY_LEN(pfd), batch_check());
 		if (res == -1 && errno != EINTR && errno != EAGAIN) {
 			ast_log(LOG_ERROR, "poll() error: %s (%d)\n", strerror(errno), errno);
 			continue;
 		}
 
+		if (pfd[2].revents & POLLIN) {
+			char buf[32];
+
+			/* A batch was started, or the thread is stopping */
+			if (read(pfd[2].fd, buf, sizeof(buf)) < 0) {
+				ast_log(LOG_WARNING, "Failed to read from alert pipe: %s (%d)\n",
+					strerror(errno), errno);
+			}
+		}
+
 		if (pfd[0].revents & POLLIN) {
 			if ((cs_err = cpg_dispatch(cpg_handle, CS_DISPATCH_ALL)) != CS_OK) {
 				ast_log(LOG_WARNING, "Failed CPG dispatch: %u\n", cs_err);
@@ -685,6 +1238,65 @@ static char *corosync_show_config(struct ast_cli_entry *e, int cmd, struct ast_c
 	}
 	ast_rwlock_unlock(&event_types_lock);
 
+	ast_mutex_lock(&batch_lock);
+	if (batch.window) {
+		ast_cli(a->fd, "=== ==> Batching events for %u ms\n", batch.window);
+	}
+	ast_mutex_unlock(&batch_lock);
+
+	ast_cli(a->fd, "===\n"
+	               "=============================================================\n"
+	               "\n");
+
+	return CLI_SUCCESS;
+}
+
+static char *corosync_show_stats(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned int local_nodeid = 0;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "corosync show stats";
+		e->usage =
+			"Usage: corosync show stats\n"
+			"       Show the messages and events sent to the cluster\n"
+			"       and received from each of its nodes\n";
+		return NULL;
+
+	case CLI_GENERATE:
+		return NULL;	/* no completion */
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (cpg_local_get(cpg_handle, &local_nodeid) != CS_OK) {
+		local_nodeid = 0;
+	}
+
+	ast_mutex_lock(&stats_lock);
+	ast_cli(a->fd, "\n"
+	            "=============================================================\n"
+	            "=== Cluster statistics ======================================\n"
+	            "=============================================================\n"
+	            "===\n"
+	            "=== Sent: %u messages, %u events, %" PRIu64 " bytes\n"
+	            "=== --> Events coalesced: %u\n"
+	            "=== --> Send failures: %u\n"
+	            "===\n",
+	            stats.messages, stats.events, stats.bytes, stats.coalesced, stats.failures);
+	for (i = 0; i < AST_VECTOR_SIZE(&stats.nodes); i++) {
+		struct corosync_node_stats *node = AST_VECTOR_GET_ADDR(&stats.nodes, i);
+
+		ast_cli(a->fd, "=== Received from node %u%s: %u messages, %u events, %" PRIu64 " bytes\n",
+			node->nodeid, node->nodeid == local_nodeid ? " (this server)" : "",
+			node->messages, node->events, node->bytes);
+	}
+	ast_mutex_unlock(&stats_lock);
+
 	ast_cli(a->fd, "===\n"
 	               "=============================================================\n"
 	               "\n");
@@ -695,6 +1307,7 @@ static char *corosync_show_config(struct ast_cli_entry *e, int cmd, struct ast_c
 static struct ast_cli_entry corosync_cli[] = {
 	AST_CLI_DEFINE(corosync_show_config, "Show configuration"),
 	AST_CLI_DEFINE(corosync_show_members, "Show cluster members"),
+	AST_CLI_DEFINE(corosync_show_stats, "Show cluster statistics"),
 	AST_CLI_DEFINE(corosync_ping, "Send a test ping to the cluster"),
 };
 
@@ -732,6 +1345,7 @@ static int load_general_config(struct ast_config *cfg)
 	struct ast_variable *v;
 	int res = 0;
 	unsigned int i;
+	unsigned int window = 0;
 
 	ast_rwlock_wrlock(&event_types_lock);
 
@@ -745,6 +1359,12 @@ static int load_general_config(struct ast_config *cfg)
 			res = set_event(v->value, PUBLISH);
 		} else if (!strcasecmp(v->name, "subscribe_event")) {
 			res = set_event(v->value, SUBSCRIBE);
+		} else if (!strcasecmp(v->name, "batch_window")) {
+			if (sscanf(v->value, "%30u", &window) != 1 || window > 1000) {
+				ast_log(LOG_WARNING, "Invalid batch_window '%s', events are sent one by one\n",
+					v->value);
+				window = 0;
+			}
 		} else {
 			ast_log(LOG_WARNING, "Unknown option '%s'\n", v->name);
 		}
@@ -765,6 +1385,13 @@ static int load_general_config(struct ast_config *cfg)
 		}
 	}
 
+	ast_mutex_lock(&batch_lock);
+	batch.window = window;
+	if (!window && batch.events) {
+		batch_send();
+	}
+	ast_mutex_unlock(&batch_lock);
+
 	ast_rwlock_unlock(&event_types_lock);
 
 	return res;
@@ -849,6 +1476,18 @@ static void cleanup_module(void)
 		dispatch_thread.alert_pipe[1] = -1;
 	}
 
+	ast_mutex_lock(&batch_lock);
+	if (batch.events) {
+		if (cpg_handle) {
+			batch_send();
+		}
+		ao2_ref(batch.events, -1);
+		batch.events = NULL;
+	}
+	batch.size = 0;
+	batch.window = 0;
+	ast_mutex_unlock(&batch_lock);
+
 	if (cpg_handle && (cs_err = cpg_finalize(cpg_handle)) != CS_OK) {
 		ast_log(LOG_ERROR, "Failed to finalize cpg (%d)\n", (int) cs_err);
 	}
@@ -858,6 +1497,15 @@ static void cleanup_module(void)
 		ast_log(LOG_ERROR, "Failed to finalize cfg (%d)\n", (int) cs_err);
 	}
 	cfg_handle = 0;
+
+	ast_mutex_lock(&stats_lock);
+	AST_VECTOR_FREE(&stats.nodes);
+	stats.messages = 0;
+	stats.events = 0;
+	stats.coalesced = 0;
+	stats.failures = 0;
+	stats.bytes = 0;
+	ast_mutex_unlock(&stats_lock);
 }
 
 static int load_module(void)
@@ -882,6 +1530,13 @@ static int load_module(void)
 		goto failed;
 	}
 
+	batch.events = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, 257,
+		batched_event_hash_fn, NULL, batched_event_cmp_fn);
+	if (!batch.events || AST_VECTOR_INIT(&stats.nodes, 8)) {
+		ast_log(AST_LOG_ERROR, "Failed to allocate the batch of events\n");
+		goto failed;
+	}
+
 	if (load_config(0)) {
 		/* simply not configured is not a fatal error */
 		goto failed;
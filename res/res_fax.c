@@ -1430,7 +1430,7 @@ static int report_fax_status(struct ast_channel *chan, struct ast_fax_session_de
 		if (!message) {
 			return -1;
 		}
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	return 0;
 }
@@ -2044,7 +2044,7 @@ static int report_receive_fax_status(struct ast_channel *chan, const char *filen
 		if (!message) {
 			return -1;
 		}
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	return 0;
 }
@@ -2549,7 +2549,7 @@ static int report_send_fax_status(struct ast_channel *chan, struct ast_fax_sessi
 		if (!message) {
 			return -1;
 		}
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	return 0;
 }
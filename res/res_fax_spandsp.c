@@ -64,6 +64,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/res_fax.h"
 #include "asterisk/channel.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
 
 #define SPANDSP_EXPOSE_INTERNAL_STRUCTURES
 #include <spandsp.h>
@@ -72,6 +74,10 @@ ASTERISK_REGISTER_FILE()
 #define SPANDSP_FAX_SAMPLES 160
 #define SPANDSP_FAX_TIMER_RATE 8000 / SPANDSP_FAX_SAMPLES	/* 50 ticks per second, 20ms, 160 samples per second */
 #define SPANDSP_ENGAGE_UDPTL_NAT_RETRY 3
+/*! Most samples of time or audio produced by a worker in one go, 100ms */
+#define SPANDSP_TX_MAX_SAMPLES (5 * SPANDSP_FAX_SAMPLES)
+/*! Most samples of received audio waiting for a worker, 1s */
+#define SPANDSP_RX_MAX_SAMPLES 8000
 
 static void *spandsp_fax_new(struct ast_fax_session *s, struct ast_fax_tech_token *token);
 static void spandsp_fax_destroy(struct ast_fax_session *s);
@@ -143,11 +149,21 @@ static struct {
 	ast_mutex_t lock;
 	struct spandsp_fax_stats g711;
 	struct spandsp_fax_stats t38;
+	/*! Number of sessions processed on the workers which have ended */
+	int sessions;
+	/*! CPU time used by the sessions which have ended, in nanoseconds */
+	int64_t cpu_ns;
 } spandsp_global_stats;
 
+/*! Workers the FAX sessions are processed on */
+static struct ast_threadpool *spandsp_pool;
+/*! Most threads of spandsp_pool */
+static int spandsp_pool_size;
+
 struct spandsp_pvt {
 	unsigned int ist38:1;
-	unsigned int isdone:1;
+	/*! Set under the lock once the session has ended, not a bit field as a worker writes it */
+	int isdone;
 	enum ast_t38_state ast_t38_state;
 	fax_state_t fax_state;
 	t38_terminal_state_t t38_state;
@@ -160,12 +176,47 @@ struct spandsp_pvt {
 	t38_gateway_state_t t38_gw_state;
 
 	struct ast_timer *timer;
-	AST_LIST_HEAD(frame_queue, ast_frame) read_frames;
+	/*! Frames for the channel, T.38 packets or audio of a terminal. Protected by lock. */
+	AST_LIST_HEAD_NOLOCK(frame_queue, ast_frame) read_frames;
 
 	int v21_detected;
 	modem_connect_tones_rx_state_t *tone_state;
+
+	/*! The session, which the worker tasks are given */
+	struct ast_fax_session *session;
+	/*! Processes the session on the workers, in order */
+	struct ast_taskprocessor *serializer;
+	/*! Protects what is exchanged between the channel and the worker */
+	ast_mutex_t lock;
+	/*! Signalled when the worker stops processing the session */
+	ast_cond_t cond;
+	/*! A worker task is queued or running */
+	int pending;
+	/*! The session is being destroyed, nothing more is processed */
+	int closing;
+	/*! The phase E handler ran, isdone is set once the results are written */
+	int completed;
+	/*! Received T.38 packets, in order */
+	AST_LIST_HEAD_NOLOCK(, ast_frame) rx_packets;
+	/*! Received audio, given to the modems in one call */
+	int16_t *rx_audio;
+	int rx_samples;
+	int rx_size;
+	/*! Audio buffer of the worker, swapped with rx_audio */
+	int16_t *work_audio;
+	int work_size;
+	/*! Samples of time to send, or of audio to generate */
+	int tx_samples;
+	/*! Audio generated for the T.30 leg of a gateway. Protected by lock. */
+	AST_LIST_HEAD_NOLOCK(, ast_frame) gw_audio;
+	/*! CPU time used processing the session, in nanoseconds. Protected by lock. */
+	int64_t cpu_ns;
+	AST_LIST_ENTRY(spandsp_pvt) entry;
 };
 
+/*! Sessions processed on the workers */
+static AST_RWLIST_HEAD_STATIC(spandsp_sessions, spandsp_pvt);
+
 static int spandsp_v21_new(struct spandsp_pvt *p);
 static void session_destroy(struct spandsp_pvt *p);
 static int t38_tx_packet_handler(t38_core_state_t *t38_core_state, void *data, const uint8_t *buf, int len, int count);
@@ -241,19 +292,14 @@ static int t38_tx_packet_handler(t38_core_state_t *t38_core_state, void *data, c
 
 	if (s->details->caps & AST_FAX_TECH_GATEWAY) {
 		ast_set_flag(f, AST_FAX_FRFLAG_GATEWAY);
-		if (p->ast_t38_state == T38_STATE_NEGOTIATED) {
-			res = ast_write(s->chan, f);
-		} else {
-			res = ast_queue_frame(s->chan, f);
-		}
-		ast_frfree(f);
-	} else {
-		/* no need to lock, this all runs in the same thread */
-		AST_LIST_INSERT_TAIL(&p->read_frames, f, frame_list);
-		res = 0;
 	}
 
-	return res;
+	/* this may run on a worker, the channel threads send the packets */
+	ast_mutex_lock(&p->lock);
+	AST_LIST_INSERT_TAIL(&p->read_frames, f, frame_list);
+	ast_mutex_unlock(&p->lock);
+
+	return 0;
 }
 
 static int update_stats(struct spandsp_pvt *p, int completion_code)
@@ -387,7 +433,8 @@ static void t30_phase_e_handler(t30_state_t *t30_state, void *data, int completi
 
 	ast_debug(5, "FAX session '%u' entering phase E\n", s->id);
 
-	p->isdone = 1;
+	/* the session is done once the results below are set */
+	p->completed = 1;
 
 	update_stats(p, completion_code);
 
@@ -523,6 +570,289 @@ static int spandsp_modems(struct ast_fax_session_details *details)
 	return modems;
 }
 
+/*! \brief CPU time used by the calling thread, in nanoseconds */
+static int64_t spandsp_thread_cpu_ns(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+
+	if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+		return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+#endif
+	return 0;
+}
+
+/*! \brief Give received audio to the modems of a session, on its worker */
+static void spandsp_session_rx_audio(struct ast_fax_session *s, struct spandsp_pvt *p, int16_t *audio, int samples)
+{
+	if (s->details->caps & AST_FAX_TECH_GATEWAY) {
+		t38_gateway_rx(&p->t38_gw_state, audio, samples);
+	} else if (!p->ist38) {
+		fax_rx(&p->fax_state, audio, samples);
+	}
+}
+
+/*! \brief Advance a session by some samples of time, on its worker
+ *
+ * The audio it produces is queued for the channel thread, and so are the
+ * T.38 packets by t38_tx_packet_handler.
+ */
+static void spandsp_session_tx(struct ast_fax_session *s, struct spandsp_pvt *p, int samples)
+{
+	uint8_t buffer[AST_FRIENDLY_OFFSET + SPANDSP_TX_MAX_SAMPLES * sizeof(int16_t)];
+	int16_t *buf = (int16_t *) (buffer + AST_FRIENDLY_OFFSET);
+	struct ast_frame audio_frame = {
+		.frametype = AST_FRAME_VOICE,
+		.src = "res_fax_spandsp_g711",
+		.subclass.format = ast_format_slin,
+	};
+	struct ast_frame *f;
+	int gateway = s->details->caps & AST_FAX_TECH_GATEWAY;
+
+	if (gateway) {
+		audio_frame.flags = AST_FAX_FRFLAG_GATEWAY;
+		samples = t38_gateway_tx(&p->t38_gw_state, buf, samples);
+	} else if (p->ist38) {
+		t38_terminal_send_timeout(&p->t38_state, samples);
+		return;
+	} else {
+		samples = fax_tx(&p->fax_state, buf, samples);
+	}
+
+	if (samples <= 0) {
+		return;
+	}
+
+	audio_frame.samples = samples;
+	AST_FRAME_SET_BUFFER(&audio_frame, buffer, AST_FRIENDLY_OFFSET, samples * sizeof(int16_t));
+	if (!(f = ast_frisolate(&audio_frame))) {
+		return;
+	}
+
+	ast_mutex_lock(&p->lock);
+	if (gateway) {
+		AST_LIST_INSERT_TAIL(&p->gw_audio, f, frame_list);
+	} else {
+		AST_LIST_INSERT_TAIL(&p->read_frames, f, frame_list);
+	}
+	ast_mutex_unlock(&p->lock);
+}
+
+/*! \brief Process what was queued for a session, on its worker
+ *
+ * Everything received since the last run is handled together: the T.38
+ * packets in order, then the audio in one call to the modems, then the
+ * time which has passed in steps of at most SPANDSP_TX_MAX_SAMPLES.
+ */
+static int spandsp_session_work(void *data)
+{
+	struct ast_fax_session *s = data;
+	struct spandsp_pvt *p = s->tech_pvt;
+	struct ast_frame *packets;
+	struct ast_frame *f;
+	int16_t *audio;
+	int size;
+	int samples;
+	int tx;
+	int64_t used = 0;
+	int64_t start;
+
+	for (;;) {
+		ast_mutex_lock(&p->lock);
+		p->cpu_ns += used;
+		if (p->completed) {
+			p->isdone = 1;
+		}
+		if (p->closing || (AST_LIST_EMPTY(&p->rx_packets) && !p->rx_samples && !p->tx_samples)) {
+			p->pending = 0;
+			ast_cond_broadcast(&p->cond);
+			ast_mutex_unlock(&p->lock);
+			return 0;
+		}
+
+		packets = AST_LIST_FIRST(&p->rx_packets);
+		AST_LIST_HEAD_INIT_NOLOCK(&p->rx_packets);
+
+		audio = p->rx_audio;
+		size = p->rx_size;
+		samples = p->rx_samples;
+		p->rx_audio = p->work_audio;
+		p->rx_size = p->work_size;
+		p->rx_samples = 0;
+		p->work_audio = audio;
+		p->work_size = size;
+
+		tx = MIN(p->tx_samples, SPANDSP_TX_MAX_SAMPLES);
+		p->tx_samples -= tx;
+		ast_mutex_unlock(&p->lock);
+
+		start = spandsp_thread_cpu_ns();
+
+		while ((f = packets)) {
+			packets = AST_LIST_NEXT(f, frame_list);
+			t38_core_rx_ifp_packet(p->t38_core_state, f->data.ptr, f->datalen, f->seqno);
+			ast_frfree(f);
+		}
+		if (samples) {
+			spandsp_session_rx_audio(s, p, audio, samples);
+		}
+		if (tx) {
+			spandsp_session_tx(s, p, tx);
+		}
+
+		used = spandsp_thread_cpu_ns() - start;
+	}
+}
+
+/*!
+ * \brief Have a worker process a session
+ * \note p->lock must be held
+ */
+static void spandsp_session_kick(struct ast_fax_session *s, struct spandsp_pvt *p)
+{
+	if (p->pending || p->closing) {
+		return;
+	}
+
+	if (ast_taskprocessor_push(p->serializer, spandsp_session_work, s)) {
+		ast_log(LOG_WARNING, "FAX session '%u' could not be queued for processing\n", s->id);
+		return;
+	}
+	p->pending = 1;
+}
+
+/*! \brief Wait until no worker processes a session
+ * \note Used before the channel thread changes the state of the modems itself.
+ */
+static void spandsp_session_wait(struct spandsp_pvt *p)
+{
+	ast_mutex_lock(&p->lock);
+	while (p->pending) {
+		ast_cond_wait(&p->cond, &p->lock);
+	}
+	ast_mutex_unlock(&p->lock);
+}
+
+/*! \brief Queue a received frame for the worker of a session
+ * \param s fax session
+ * \param p its tech_pvt
+ * \param f the frame, slinear audio or a T.38 packet
+ * \param packet non-zero if f is a T.38 packet
+ *
+ * \retval 0 success
+ * \retval -1 failure, the frame was dropped
+ */
+static int spandsp_session_queue_rx(struct ast_fax_session *s, struct spandsp_pvt *p, const struct ast_frame *f, int packet)
+{
+	struct ast_frame *dup = NULL;
+	int16_t *audio;
+	int size;
+
+	if (packet && !(dup = ast_frdup(f))) {
+		return -1;
+	}
+
+	ast_mutex_lock(&p->lock);
+	if (dup) {
+		AST_LIST_INSERT_TAIL(&p->rx_packets, dup, frame_list);
+	} else if (f->samples > 0) {
+		if (p->rx_samples + f->samples > p->rx_size) {
+			size = MAX(p->rx_size * 2, p->rx_samples + f->samples);
+			if (size > SPANDSP_RX_MAX_SAMPLES
+				|| !(audio = ast_realloc(p->rx_audio, size * sizeof(*audio)))) {
+				ast_mutex_unlock(&p->lock);
+				ast_debug(5, "FAX session '%u' dropped %d samples of audio\n", s->id, f->samples);
+				return -1;
+			}
+			p->rx_audio = audio;
+			p->rx_size = size;
+		}
+		memcpy(p->rx_audio + p->rx_samples, f->data.ptr, f->samples * sizeof(int16_t));
+		p->rx_samples += f->samples;
+	}
+	spandsp_session_kick(s, p);
+	ast_mutex_unlock(&p->lock);
+
+	return 0;
+}
+
+/*! \brief Set up the processing of a session on the workers */
+static int spandsp_session_init(struct ast_fax_session *s, struct spandsp_pvt *p)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "spandsp/fax-%08x", s->id);
+	if (!(p->serializer = ast_threadpool_serializer(name, spandsp_pool))) {
+		return -1;
+	}
+
+	ast_mutex_init(&p->lock);
+	ast_cond_init(&p->cond, NULL);
+	AST_LIST_HEAD_INIT_NOLOCK(&p->read_frames);
+	AST_LIST_HEAD_INIT_NOLOCK(&p->rx_packets);
+	AST_LIST_HEAD_INIT_NOLOCK(&p->gw_audio);
+	p->session = s;
+
+	AST_RWLIST_WRLOCK(&spandsp_sessions);
+	AST_RWLIST_INSERT_TAIL(&spandsp_sessions, p, entry);
+	AST_RWLIST_UNLOCK(&spandsp_sessions);
+
+	return 0;
+}
+
+/*! \brief Stop the processing of a session on the workers
+ * \note The modems may still queue frames until spandsp_session_free().
+ */
+static void spandsp_session_stop(struct spandsp_pvt *p)
+{
+	if (!p->serializer) {
+		return;
+	}
+
+	ast_mutex_lock(&p->lock);
+	p->closing = 1;
+	while (p->pending) {
+		ast_cond_wait(&p->cond, &p->lock);
+	}
+	ast_mutex_unlock(&p->lock);
+	p->serializer = ast_taskprocessor_unreference(p->serializer);
+
+	AST_RWLIST_WRLOCK(&spandsp_sessions);
+	AST_RWLIST_REMOVE(&spandsp_sessions, p, entry);
+	AST_RWLIST_UNLOCK(&spandsp_sessions);
+
+	ast_mutex_lock(&spandsp_global_stats.lock);
+	spandsp_global_stats.sessions++;
+	spandsp_global_stats.cpu_ns += p->cpu_ns;
+	ast_mutex_unlock(&spandsp_global_stats.lock);
+}
+
+/*! \brief Free what was used to process a session on the workers */
+static void spandsp_session_free(struct spandsp_pvt *p)
+{
+	struct ast_frame *f;
+
+	if (!p->session) {
+		return;
+	}
+
+	while ((f = AST_LIST_REMOVE_HEAD(&p->rx_packets, frame_list))) {
+		ast_frfree(f);
+	}
+	while ((f = AST_LIST_REMOVE_HEAD(&p->gw_audio, frame_list))) {
+		ast_frfree(f);
+	}
+	while ((f = AST_LIST_REMOVE_HEAD(&p->read_frames, frame_list))) {
+		ast_frfree(f);
+	}
+	ast_free(p->rx_audio);
+	ast_free(p->work_audio);
+
+	ast_mutex_destroy(&p->lock);
+	ast_cond_destroy(&p->cond);
+}
+
 /*! \brief create an instance of the spandsp tech_pvt for a fax session */
 static void *spandsp_fax_new(struct ast_fax_session *s, struct ast_fax_tech_token *token)
 {
@@ -543,13 +873,16 @@ static void *spandsp_fax_new(struct ast_fax_session *s, struct ast_fax_tech_toke
 		return p;
 	}
 
+	if (spandsp_session_init(s, p)) {
+		ast_log(LOG_ERROR, "Channel '%s' FAX session '%u' failed to create its processing queue.\n", s->channame, s->id);
+		goto e_free;
+	}
+
 	if (s->details->caps & AST_FAX_TECH_GATEWAY) {
 		s->state = AST_FAX_STATE_INITIALIZED;
 		return p;
 	}
 
-	AST_LIST_HEAD_INIT(&p->read_frames);
-
 	if (s->details->caps & AST_FAX_TECH_RECEIVE) {
 		caller_mode = 0;
 	} else if (s->details->caps & AST_FAX_TECH_SEND) {
@@ -588,6 +921,8 @@ static void *spandsp_fax_new(struct ast_fax_session *s, struct ast_fax_tech_toke
 	return p;
 
 e_free:
+	spandsp_session_stop(p);
+	spandsp_session_free(p);
 	ast_free(p);
 e_return:
 	return NULL;
@@ -606,6 +941,8 @@ static void spandsp_fax_destroy(struct ast_fax_session *s)
 {
 	struct spandsp_pvt *p = s->tech_pvt;
 
+	spandsp_session_stop(p);
+
 	if (s->details->caps & AST_FAX_TECH_GATEWAY) {
 		spandsp_fax_gateway_cleanup(s);
 	} else if (s->details->caps & AST_FAX_TECH_V21_DETECT) {
@@ -614,53 +951,41 @@ static void spandsp_fax_destroy(struct ast_fax_session *s)
 		session_destroy(p);
 	}
 
+	spandsp_session_free(p);
 	ast_free(p);
 	s->tech_pvt = NULL;
 	s->fd = -1;
 }
 
 /*! \brief Read a frame from the spandsp fax stack.
+ *
+ * Each timer tick has the worker advance the session by a frame of time,
+ * and returns a frame it produced for an earlier tick.
  */
 static struct ast_frame *spandsp_fax_read(struct ast_fax_session *s)
 {
 	struct spandsp_pvt *p = s->tech_pvt;
-	uint8_t buffer[AST_FRIENDLY_OFFSET + SPANDSP_FAX_SAMPLES * sizeof(uint16_t)];
-	int16_t *buf = (int16_t *) (buffer + AST_FRIENDLY_OFFSET);
-	int samples;
-
-	struct ast_frame fax_frame = {
-		.frametype = AST_FRAME_VOICE,
-		.src = "res_fax_spandsp_g711",
-		.subclass.format = ast_format_slin,
-	};
-	struct ast_frame *f = &fax_frame;
+	struct ast_frame *f;
 
 	if (ast_timer_ack(p->timer, 1) < 0) {
 		ast_log(LOG_ERROR, "Failed to acknowledge timer for FAX session '%u'\n", s->id);
 		return NULL;
 	}
 
-	/* XXX do we need to lock here? */
+	ast_mutex_lock(&p->lock);
 	if (p->isdone) {
+		ast_mutex_unlock(&p->lock);
 		s->state = AST_FAX_STATE_COMPLETE;
 		ast_debug(5, "FAX session '%u' is complete.\n", s->id);
 		return NULL;
 	}
 
-	if (p->ist38) {
-		t38_terminal_send_timeout(&p->t38_state, SPANDSP_FAX_SAMPLES);
-		if ((f = AST_LIST_REMOVE_HEAD(&p->read_frames, frame_list))) {
-			return f;
-		}
-	} else {
-		if ((samples = fax_tx(&p->fax_state, buf, SPANDSP_FAX_SAMPLES)) > 0) {
-			f->samples = samples;
-			AST_FRAME_SET_BUFFER(f, buffer, AST_FRIENDLY_OFFSET, samples * sizeof(int16_t));
-			return ast_frisolate(f);
-		}
-	}
+	p->tx_samples += SPANDSP_FAX_SAMPLES;
+	spandsp_session_kick(s, p);
+	f = AST_LIST_REMOVE_HEAD(&p->read_frames, frame_list);
+	ast_mutex_unlock(&p->lock);
 
-	return &ast_null_frame;
+	return f ? f : &ast_null_frame;
 }
 
 static void spandsp_v21_tone(void *data, int code, int level, int delay)
@@ -728,7 +1053,7 @@ static int spandsp_v21_detect(struct ast_fax_session *s, const struct ast_frame
  * \param f the frame to write
  *
  * \note res_fax does not currently use the return value of this function.
- * Also the fax_rx() function never fails.
+ * The frame is processed later, on the worker of the session.
  *
  * \retval 0 success
  * \retval -1 failure
@@ -745,16 +1070,39 @@ static int spandsp_fax_write(struct ast_fax_session *s, const struct ast_frame *
 		return spandsp_fax_gateway_process(s, f);
 	}
 
-	/* XXX do we need to lock here? */
 	if (s->state == AST_FAX_STATE_COMPLETE) {
 		ast_log(LOG_WARNING, "FAX session '%u' is in the '%s' state.\n", s->id, ast_fax_state_to_str(s->state));
 		return -1;
 	}
 
-	if (p->ist38) {
-		return t38_core_rx_ifp_packet(p->t38_core_state, f->data.ptr, f->datalen, f->seqno);
-	} else {
-		return fax_rx(&p->fax_state, f->data.ptr, f->samples);
+	return spandsp_session_queue_rx(s, p, f, p->ist38);
+}
+
+/*! \brief send the T.38 packets the gateway produced
+ * \param s fax session
+ * \param p its tech_pvt
+ *
+ * \note Called on the channel threads, never on the worker.
+ */
+static void spandsp_fax_gateway_flush(struct ast_fax_session *s, struct spandsp_pvt *p)
+{
+	struct ast_frame *f;
+	struct ast_frame *next;
+
+	ast_mutex_lock(&p->lock);
+	f = AST_LIST_FIRST(&p->read_frames);
+	AST_LIST_HEAD_INIT_NOLOCK(&p->read_frames);
+	ast_mutex_unlock(&p->lock);
+
+	for (; f; f = next) {
+		next = AST_LIST_NEXT(f, frame_list);
+		AST_LIST_NEXT(f, frame_list) = NULL;
+		if (p->ast_t38_state == T38_STATE_NEGOTIATED) {
+			ast_write(s->chan, f);
+		} else {
+			ast_queue_frame(s->chan, f);
+		}
+		ast_frfree(f);
 	}
 }
 
@@ -763,34 +1111,35 @@ static int spandsp_fax_write(struct ast_fax_session *s, const struct ast_frame *
  * \param data fax session structure
  * \param len not used
  * \param samples no of samples generated
- * \return -1 on failure or 0 on sucess*/
+ * \return -1 on failure or 0 on sucess
+ *
+ * The worker generates the audio, what is written is what it generated
+ * for the earlier calls.
+ */
 static int spandsp_fax_gw_t30_gen(struct ast_channel *chan, void *data, int len, int samples)
 {
-	int res = -1;
+	int res = 0;
 	struct ast_fax_session *s = data;
 	struct spandsp_pvt *p = s->tech_pvt;
-	uint8_t buffer[AST_FRIENDLY_OFFSET + samples * sizeof(uint16_t)];
 	struct ast_frame *f;
-	struct ast_frame t30_frame = {
-		.frametype = AST_FRAME_VOICE,
-		.subclass.format = ast_format_slin,
-		.src = "res_fax_spandsp_g711",
-		.samples = samples,
-		.flags = AST_FAX_FRFLAG_GATEWAY,
-	};
-
-	AST_FRAME_SET_BUFFER(&t30_frame, buffer, AST_FRIENDLY_OFFSET, t30_frame.samples * sizeof(int16_t));
-
-	if (!(f = ast_frisolate(&t30_frame))) {
-		return p->isdone ? -1 : res;
+	struct ast_frame *next;
+
+	ast_mutex_lock(&p->lock);
+	p->tx_samples += samples;
+	spandsp_session_kick(s, p);
+	f = AST_LIST_FIRST(&p->gw_audio);
+	AST_LIST_HEAD_INIT_NOLOCK(&p->gw_audio);
+	ast_mutex_unlock(&p->lock);
+
+	for (; f; f = next) {
+		next = AST_LIST_NEXT(f, frame_list);
+		AST_LIST_NEXT(f, frame_list) = NULL;
+		if (!res) {
+			res = ast_write(chan, f);
+		}
+		ast_frfree(f);
 	}
 
-	/* generate a T.30 packet */
-	if ((f->samples = t38_gateway_tx(&p->t38_gw_state, f->data.ptr, f->samples))) {
-		f->datalen = f->samples * sizeof(int16_t);
-		res = ast_write(chan, f);
-	}
-	ast_frfree(f);
 	return p->isdone ? -1 : res;
 }
 
@@ -883,6 +1232,7 @@ static int spandsp_fax_gateway_start(struct ast_fax_session *s)
 		t38_core_send_indicator(&p->t38_gw_state.t38, T38_IND_NO_SIGNAL, p->t38_gw_state.t38.indicator_tx_count);
 #endif
 	}
+	spandsp_fax_gateway_flush(s, p);
 
 	s->state = AST_FAX_STATE_ACTIVE;
 
@@ -892,10 +1242,15 @@ static int spandsp_fax_gateway_start(struct ast_fax_session *s)
 /*! \brief process a frame from the bridge
  * \param s fax session
  * \param f frame to process
- * \return 1 on sucess 0 on incorect packet*/
+ * \return 0 on sucess -1 on incorect packet
+ *
+ * The frame is processed later, on the worker of the session. The T.38
+ * packets the worker produced meanwhile are sent.
+ */
 static int spandsp_fax_gateway_process(struct ast_fax_session *s, const struct ast_frame *f)
 {
 	struct spandsp_pvt *p = s->tech_pvt;
+	int res = -1;
 
 	/*invalid frame*/
 	if (!f->data.ptr || !f->datalen) {
@@ -904,13 +1259,15 @@ static int spandsp_fax_gateway_process(struct ast_fax_session *s, const struct a
 
 	/* Process a IFP packet */
 	if ((f->frametype == AST_FRAME_MODEM) && (f->subclass.integer == AST_MODEM_T38)) {
-		return t38_core_rx_ifp_packet(p->t38_core_state, f->data.ptr, f->datalen, f->seqno);
+		res = spandsp_session_queue_rx(s, p, f, 1);
 	} else if ((f->frametype == AST_FRAME_VOICE) &&
 		(ast_format_cmp(f->subclass.format, ast_format_slin) == AST_FORMAT_CMP_EQUAL)) {
-		return t38_gateway_rx(&p->t38_gw_state, f->data.ptr, f->samples);
+		res = spandsp_session_queue_rx(s, p, f, 0);
 	}
 
-	return -1;
+	spandsp_fax_gateway_flush(s, p);
+
+	return res;
 }
 
 /*! \brief gather data and clean up after gateway ends
@@ -1010,12 +1367,18 @@ static int spandsp_fax_cancel(struct ast_fax_session *s)
 	struct spandsp_pvt *p = s->tech_pvt;
 
 	if (s->details->caps & AST_FAX_TECH_GATEWAY) {
+		ast_mutex_lock(&p->lock);
 		p->isdone = 1;
+		ast_mutex_unlock(&p->lock);
 		return 0;
 	}
 
+	spandsp_session_wait(p);
 	t30_terminate(p->t30_state);
+
+	ast_mutex_lock(&p->lock);
 	p->isdone = 1;
+	ast_mutex_unlock(&p->lock);
 	return 0;
 }
 
@@ -1023,6 +1386,9 @@ static int spandsp_fax_cancel(struct ast_fax_session *s)
 static int spandsp_fax_switch_to_t38(struct ast_fax_session *s)
 {
 	struct spandsp_pvt *p = s->tech_pvt;
+	struct ast_frame *f;
+
+	spandsp_session_wait(p);
 
 	/* prevent the phase E handler from running, this is not a real termination */
 	t30_set_phase_e_handler(p->t30_state, NULL, NULL);
@@ -1032,6 +1398,14 @@ static int spandsp_fax_switch_to_t38(struct ast_fax_session *s)
 	s->details->option.switch_to_t38 = 1;
 	ast_atomic_fetchadd_int(&p->stats->switched, 1);
 
+	/* drop what was received and generated for the audio modems */
+	ast_mutex_lock(&p->lock);
+	p->rx_samples = 0;
+	while ((f = AST_LIST_REMOVE_HEAD(&p->read_frames, frame_list))) {
+		ast_frfree(f);
+	}
+	ast_mutex_unlock(&p->lock);
+
 	p->ist38 = 1;
 	p->stats = &spandsp_global_stats.t38;
 	spandsp_fax_start(s);
@@ -1039,6 +1413,18 @@ static int spandsp_fax_switch_to_t38(struct ast_fax_session *s)
 	return 0;
 }
 
+/*! \brief CPU time a session has used on the workers, in milliseconds */
+static double spandsp_session_cpu_ms(struct spandsp_pvt *p)
+{
+	int64_t cpu_ns;
+
+	ast_mutex_lock(&p->lock);
+	cpu_ns = p->cpu_ns;
+	ast_mutex_unlock(&p->lock);
+
+	return cpu_ns / 1000000.0;
+}
+
 /*! \brief */
 static char *spandsp_fax_cli_show_capabilities(int fd)
 {
@@ -1063,6 +1449,7 @@ static char *spandsp_fax_cli_show_session(struct ast_fax_session *s, int fd)
 			ast_cli(fd, "%-22s : %d\n", "Data Rate", stats.bit_rate);
 			ast_cli(fd, "%-22s : %d\n", "Page Number", stats.pages_transferred + 1);
 		}
+		ast_cli(fd, "%-22s : %.1f ms\n", "CPU Time", spandsp_session_cpu_ms(p));
 	} else if (s->details->caps & AST_FAX_TECH_V21_DETECT) {
 		ast_cli(fd, "%-22s : %u\n", "session", s->id);
 		ast_cli(fd, "%-22s : %s\n", "operation", "V.21 Detect");
@@ -1098,6 +1485,7 @@ static char *spandsp_fax_cli_show_session(struct ast_fax_session *s, int fd)
 			ast_cli(fd, "%-22s : %d\n", "Longest Bad Line Run", stats.longest_bad_row_run);
 			ast_cli(fd, "%-22s : %d\n", "Total Bad Lines", stats.bad_rows);
 		}
+		ast_cli(fd, "%-22s : %.1f ms\n", "CPU Time", spandsp_session_cpu_ms(p));
 	}
 	ao2_unlock(s);
 	ast_cli(fd, "\n\n");
@@ -1198,6 +1586,8 @@ skip_cap_additions:
 /*! \brief */
 static char *spandsp_fax_cli_show_stats(int fd)
 {
+	struct spandsp_pvt *p;
+
 	ast_mutex_lock(&spandsp_global_stats.lock);
 	ast_cli(fd, "\n%-20.20s\n", "Spandsp G.711");
 	ast_cli(fd, "%-20.20s : %d\n", "Success", spandsp_global_stats.g711.success);
@@ -1227,15 +1617,31 @@ static char *spandsp_fax_cli_show_stats(int fd)
 	ast_cli(fd, "%-20.20s : %d\n", "File Error", spandsp_global_stats.t38.file_error);
 	ast_cli(fd, "%-20.20s : %d\n", "Memory Error", spandsp_global_stats.t38.mem_error);
 	ast_cli(fd, "%-20.20s : %d\n", "Unknown Error", spandsp_global_stats.t38.unknown_error);
+
+	ast_cli(fd, "\n%-20.20s\n", "Spandsp Workers");
+	ast_cli(fd, "%-20.20s : %d\n", "Ended Sessions", spandsp_global_stats.sessions);
+	ast_cli(fd, "%-20.20s : %.1f ms\n", "Ended CPU Time", spandsp_global_stats.cpu_ns / 1000000.0);
+	ast_cli(fd, "%-20.20s : %.1f ms\n", "Average CPU Time", spandsp_global_stats.sessions
+		? spandsp_global_stats.cpu_ns / 1000000.0 / spandsp_global_stats.sessions : 0.0);
 	ast_mutex_unlock(&spandsp_global_stats.lock);
 
+	AST_RWLIST_RDLOCK(&spandsp_sessions);
+	if (!AST_RWLIST_EMPTY(&spandsp_sessions)) {
+		ast_cli(fd, "\n%-10.10s %-40.40s %s\n", "Session", "Channel", "CPU Time");
+	}
+	AST_RWLIST_TRAVERSE(&spandsp_sessions, p, entry) {
+		ast_cli(fd, "%-10u %-40.40s %.1f ms\n", p->session->id, p->session->channame,
+			spandsp_session_cpu_ms(p));
+	}
+	AST_RWLIST_UNLOCK(&spandsp_sessions);
+
 	return CLI_SUCCESS;
 }
 
 /*! \brief Show res_fax_spandsp settings */
 static char *spandsp_fax_cli_show_settings(int fd)
 {
-	/* no settings at the moment */
+	ast_cli(fd, "%-20.20s : %d\n", "Worker Threads", spandsp_pool_size);
 	return CLI_SUCCESS;
 }
 
@@ -1243,6 +1649,8 @@ static char *spandsp_fax_cli_show_settings(int fd)
 static int unload_module(void)
 {
 	ast_fax_tech_unregister(&spandsp_fax_tech);
+	ast_threadpool_shutdown(spandsp_pool);
+	spandsp_pool = NULL;
 	ast_mutex_destroy(&spandsp_global_stats.lock);
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -1250,10 +1658,31 @@ static int unload_module(void)
 /*! \brief load res_fax_spandsp */
 static int load_module(void)
 {
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 60,
+		.auto_increment = 1,
+		.initial_size = 0,
+	};
+
+	/* leave processors to the media of the other calls */
+	spandsp_pool_size = MAX(sysconf(_SC_NPROCESSORS_ONLN) / 2, 1);
+	options.max_size = spandsp_pool_size;
+
 	ast_mutex_init(&spandsp_global_stats.lock);
+
+	if (!(spandsp_pool = ast_threadpool_create("spandsp", NULL, &options))) {
+		ast_log(LOG_ERROR, "failed to create the FAX worker threads\n");
+		ast_mutex_destroy(&spandsp_global_stats.lock);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	spandsp_fax_tech.module = ast_module_info->self;
 	if (ast_fax_tech_register(&spandsp_fax_tech) < 0) {
 		ast_log(LOG_ERROR, "failed to register FAX technology\n");
+		ast_threadpool_shutdown(spandsp_pool);
+		spandsp_pool = NULL;
+		ast_mutex_destroy(&spandsp_global_stats.lock);
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
@@ -69,6 +69,24 @@
 				<configOption name="capture_id" default="0">
 					<synopsis>The ID for this capture agent.</synopsis>
 				</configOption>
+				<configOption name="queue_size" default="2048">
+					<synopsis>The most captured packets waiting to be sent.</synopsis>
+					<description><para>
+						Captured packets are queued and sent in batches by a
+						dedicated thread. Packets captured while the queue is full
+						are dropped and counted, as shown by <literal>hep show status</literal>.
+						</para>
+					</description>
+				</configOption>
+				<configOption name="sample_rate" default="100">
+					<synopsis>The percentage of calls whose packets are captured.</synopsis>
+					<description><para>
+						Calls are picked by a hash of the UUID of their packets,
+						so either all of the packets of a call are sent or none
+						of them are. <literal>100</literal> captures every call.
+						</para>
+					</description>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -81,7 +99,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/module.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/config_options.h"
-#include "asterisk/taskprocessor.h"
+#include "asterisk/cli.h"
+#include "asterisk/metrics.h"
 #include "asterisk/res_hep.h"
 
 #include <netinet/ip.h>
@@ -231,6 +250,8 @@ struct hep_generic {
 struct hepv3_global_config {
 	unsigned int enabled;                    /*!< Whether or not sending is enabled */
 	unsigned int capture_id;                 /*!< Capture ID for this agent */
+	unsigned int queue_size;                 /*!< Most captures waiting to be sent */
+	unsigned int sample_rate;                /*!< Percentage of calls captured */
 	AST_DECLARE_STRING_FIELDS(
 		AST_STRING_FIELD(capture_address);   /*!< Address to send to */
 		AST_STRING_FIELD(capture_password);  /*!< Password for Homer server */
@@ -269,7 +290,43 @@ static AO2_GLOBAL_OBJ_STATIC(global_config);
 /*! \brief Current module data */
 static AO2_GLOBAL_OBJ_STATIC(global_data);
 
-static struct ast_taskprocessor *hep_queue_tp;
+/*! \brief Most captures sent by one system call */
+#define HEP_SEND_BATCH 32
+
+/*! \brief Captures waiting for the sender thread */
+static struct {
+	ast_mutex_t lock;
+	/*! Signalled when a capture is queued and the queue was empty, or on stop */
+	ast_cond_t cond;
+	/*! Ring of the queued captures */
+	struct hepv3_capture_info **ring;
+	/*! Size of the ring, the most captures that can be queued */
+	unsigned int size;
+	/*! Index of the oldest queued capture */
+	unsigned int head;
+	/*! Number of queued captures */
+	unsigned int count;
+	/*! The sender thread */
+	pthread_t thread;
+	/*! Set when the sender thread should send what is queued and exit */
+	unsigned int stop:1;
+} hep_queue = {
+	.thread = AST_PTHREADT_NULL,
+};
+
+/*! \brief What happened to the captures handed to \ref hepv3_send_packet */
+static struct {
+	/*! Queued for the sender thread */
+	uint64_t queued;
+	/*! Sent to the HEP server */
+	uint64_t sent;
+	/*! Dropped because the queue was full */
+	uint64_t dropped_full;
+	/*! Left out by sampling */
+	uint64_t dropped_sampled;
+	/*! Failed to be sent */
+	uint64_t send_errors;
+} hep_stats;
 
 static void *module_config_alloc(void);
 static void hepv3_config_post_apply(void);
@@ -396,154 +453,403 @@ struct hepv3_capture_info *hepv3_create_capture_info(const void *payload, size_t
 	return info;
 }
 
-/*! \brief Callback function for the \ref hep_queue_tp taskprocessor */
-static int hep_queue_cb(void *data)
-{
-	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
-	RAII_VAR(struct hepv3_runtime_data *, hepv3_data, ao2_global_obj_ref(global_data), ao2_cleanup);
-	RAII_VAR(struct hepv3_capture_info *, capture_info, data, ao2_cleanup);
+#ifdef HAVE_SENDMMSG
+#define hep_mmsghdr mmsghdr
+#else
+/*! \brief The part of struct mmsghdr used, where sendmmsg() is missing */
+struct hep_mmsghdr {
+	struct msghdr msg_hdr;
+};
+#endif
+
+/*! \brief Number of iovecs a \ref hep_packet is sent with */
+#define HEP_PACKET_IOVECS 8
+
+/*! \brief A HEPv3 packet built around a capture, which is sent without copying it */
+struct hep_packet {
 	struct hep_generic hg_pkt;
-	unsigned int packet_len = 0, sock_buffer_len;
-	struct hep_chunk_ip4 ipv4_src, ipv4_dst;
-	struct hep_chunk_ip6 ipv6_src, ipv6_dst;
-	struct hep_chunk auth_key, payload, uuid;
-	void *sock_buffer;
-	int res;
+	union {
+		struct {
+			struct hep_chunk_ip4 src;
+			struct hep_chunk_ip4 dst;
+		} __attribute__((packed)) ipv4;
+		struct {
+			struct hep_chunk_ip6 src;
+			struct hep_chunk_ip6 dst;
+		} __attribute__((packed)) ipv6;
+	} addrs;
+	struct hep_chunk auth_key;
+	struct hep_chunk uuid;
+	struct hep_chunk payload;
+	struct iovec iov[HEP_PACKET_IOVECS];
+};
 
-	if (!capture_info || !config || !hepv3_data) {
-		return 0;
-	}
+/*!
+ * \brief Build the HEPv3 packet of a capture
+ *
+ * \param packet The packet to build, which refers to the capture and the config
+ * \param capture_info The capture
+ * \param general The general settings
+ *
+ * \return The number of iovecs of the packet
+ * \retval 0 if the capture cannot be sent
+ */
+static int hep_packet_build(struct hep_packet *packet, struct hepv3_capture_info *capture_info,
+	struct hepv3_global_config *general)
+{
+	struct hep_generic *hg_pkt = &packet->hg_pkt;
+	size_t password_len = strlen(general->capture_password);
+	size_t uuid_len = strlen(S_OR(capture_info->uuid, ""));
+	unsigned int packet_len;
+	int iovcnt = 0;
 
 	if (ast_sockaddr_is_ipv4(&capture_info->src_addr) != ast_sockaddr_is_ipv4(&capture_info->dst_addr)) {
 		ast_log(AST_LOG_NOTICE, "Unable to send packet: Address Family mismatch between source/destination\n");
-		return -1;
+		return 0;
 	}
 
-	packet_len = sizeof(hg_pkt);
-
 	/* Build HEPv3 header, capture info, and calculate the total packet size */
-	memcpy(hg_pkt.header.id, "\x48\x45\x50\x33", 4);
+	memcpy(hg_pkt->header.id, "\x48\x45\x50\x33", 4);
+
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->ip_proto, CHUNK_TYPE_IP_PROTOCOL_ID, 0x11);
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->src_port, CHUNK_TYPE_SRC_PORT, htons(ast_sockaddr_port(&capture_info->src_addr)));
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->dst_port, CHUNK_TYPE_DST_PORT, htons(ast_sockaddr_port(&capture_info->dst_addr)));
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->time_sec, CHUNK_TYPE_TIMESTAMP_SEC, htonl(capture_info->capture_time.tv_sec));
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->time_usec, CHUNK_TYPE_TIMESTAMP_USEC, htonl(capture_info->capture_time.tv_usec));
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->proto_t, CHUNK_TYPE_PROTOCOL_TYPE, capture_info->capture_type);
+	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->capt_id, CHUNK_TYPE_CAPTURE_AGENT_ID, htonl(general->capture_id));
 
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.ip_proto, CHUNK_TYPE_IP_PROTOCOL_ID, 0x11);
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.src_port, CHUNK_TYPE_SRC_PORT, htons(ast_sockaddr_port(&capture_info->src_addr)));
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.dst_port, CHUNK_TYPE_DST_PORT, htons(ast_sockaddr_port(&capture_info->dst_addr)));
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.time_sec, CHUNK_TYPE_TIMESTAMP_SEC, htonl(capture_info->capture_time.tv_sec));
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.time_usec, CHUNK_TYPE_TIMESTAMP_USEC, htonl(capture_info->capture_time.tv_usec));
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.proto_t, CHUNK_TYPE_PROTOCOL_TYPE, capture_info->capture_type);
-	INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.capt_id, CHUNK_TYPE_CAPTURE_AGENT_ID, htonl(config->general->capture_id));
+	packet->iov[iovcnt].iov_base = hg_pkt;
+	packet->iov[iovcnt++].iov_len = sizeof(*hg_pkt);
 
+	/* Addresses, copied from the socket addresses rather than converted to and from strings */
 	if (ast_sockaddr_is_ipv4(&capture_info->src_addr)) {
-		INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.ip_family,
+		INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->ip_family,
 			CHUNK_TYPE_IP_PROTOCOL_FAMILY, AF_INET);
 
-		INITIALIZE_GENERIC_HEP_CHUNK(&ipv4_src, CHUNK_TYPE_IPV4_SRC_ADDR);
-		inet_pton(AF_INET, ast_sockaddr_stringify_addr(&capture_info->src_addr), &ipv4_src.data);
+		INITIALIZE_GENERIC_HEP_CHUNK(&packet->addrs.ipv4.src, CHUNK_TYPE_IPV4_SRC_ADDR);
+		packet->addrs.ipv4.src.data = ((struct sockaddr_in *) &capture_info->src_addr.ss)->sin_addr;
 
-		INITIALIZE_GENERIC_HEP_CHUNK(&ipv4_dst, CHUNK_TYPE_IPV4_DST_ADDR);
-		inet_pton(AF_INET, ast_sockaddr_stringify_addr(&capture_info->dst_addr), &ipv4_dst.data);
+		INITIALIZE_GENERIC_HEP_CHUNK(&packet->addrs.ipv4.dst, CHUNK_TYPE_IPV4_DST_ADDR);
+		packet->addrs.ipv4.dst.data = ((struct sockaddr_in *) &capture_info->dst_addr.ss)->sin_addr;
 
-		packet_len += (sizeof(ipv4_src) + sizeof(ipv4_dst));
+		packet->iov[iovcnt].iov_len = sizeof(packet->addrs.ipv4);
 	} else {
-		INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt.ip_family,
+		INITIALIZE_GENERIC_HEP_CHUNK_DATA(&hg_pkt->ip_family,
 			CHUNK_TYPE_IP_PROTOCOL_FAMILY, AF_INET6);
 
-		INITIALIZE_GENERIC_HEP_CHUNK(&ipv6_src, CHUNK_TYPE_IPV6_SRC_ADDR);
-		inet_pton(AF_INET6, ast_sockaddr_stringify_addr(&capture_info->src_addr), &ipv6_src.data);
+		INITIALIZE_GENERIC_HEP_CHUNK(&packet->addrs.ipv6.src, CHUNK_TYPE_IPV6_SRC_ADDR);
+		packet->addrs.ipv6.src.data = ((struct sockaddr_in6 *) &capture_info->src_addr.ss)->sin6_addr;
 
-		INITIALIZE_GENERIC_HEP_CHUNK(&ipv6_dst, CHUNK_TYPE_IPV6_DST_ADDR);
-		inet_pton(AF_INET6, ast_sockaddr_stringify_addr(&capture_info->dst_addr), &ipv6_dst.data);
+		INITIALIZE_GENERIC_HEP_CHUNK(&packet->addrs.ipv6.dst, CHUNK_TYPE_IPV6_DST_ADDR);
+		packet->addrs.ipv6.dst.data = ((struct sockaddr_in6 *) &capture_info->dst_addr.ss)->sin6_addr;
 
-		packet_len += (sizeof(ipv6_src) + sizeof(ipv6_dst));
+		packet->iov[iovcnt].iov_len = sizeof(packet->addrs.ipv6);
 	}
+	packet->iov[iovcnt++].iov_base = &packet->addrs;
 
-	if (!ast_strlen_zero(config->general->capture_password))  {
-		INITIALIZE_GENERIC_HEP_IDS_VAR(&auth_key, CHUNK_TYPE_AUTH_KEY, strlen(config->general->capture_password));
-		packet_len += (sizeof(auth_key) + strlen(config->general->capture_password));
+	/* Auth Key */
+	if (password_len) {
+		INITIALIZE_GENERIC_HEP_IDS_VAR(&packet->auth_key, CHUNK_TYPE_AUTH_KEY, password_len);
+		packet->iov[iovcnt].iov_base = &packet->auth_key;
+		packet->iov[iovcnt++].iov_len = sizeof(packet->auth_key);
+		packet->iov[iovcnt].iov_base = (char *) general->capture_password;
+		packet->iov[iovcnt++].iov_len = password_len;
 	}
-	INITIALIZE_GENERIC_HEP_IDS_VAR(&uuid, CHUNK_TYPE_UUID, strlen(capture_info->uuid));
-	packet_len += (sizeof(uuid) + strlen(capture_info->uuid));
-	INITIALIZE_GENERIC_HEP_IDS_VAR(&payload,
+
+	/* UUID */
+	INITIALIZE_GENERIC_HEP_IDS_VAR(&packet->uuid, CHUNK_TYPE_UUID, uuid_len);
+	packet->iov[iovcnt].iov_base = &packet->uuid;
+	packet->iov[iovcnt++].iov_len = sizeof(packet->uuid);
+	packet->iov[iovcnt].iov_base = capture_info->uuid;
+	packet->iov[iovcnt++].iov_len = uuid_len;
+
+	/* Packet! */
+	INITIALIZE_GENERIC_HEP_IDS_VAR(&packet->payload,
 		capture_info->zipped ? CHUNK_TYPE_PAYLOAD_ZIP : CHUNK_TYPE_PAYLOAD, capture_info->len);
-	packet_len += (sizeof(payload) + capture_info->len);
-	hg_pkt.header.length = htons(packet_len);
+	packet->iov[iovcnt].iov_base = &packet->payload;
+	packet->iov[iovcnt++].iov_len = sizeof(packet->payload);
+	packet->iov[iovcnt].iov_base = capture_info->payload;
+	packet->iov[iovcnt++].iov_len = capture_info->len;
 
-	/* Build the buffer to send */
-	sock_buffer = ast_malloc(packet_len);
-	if (!sock_buffer) {
-		return -1;
+	ast_assert(iovcnt <= HEP_PACKET_IOVECS);
+
+	packet_len = sizeof(*hg_pkt) + packet->iov[1].iov_len
+		+ (password_len ? sizeof(packet->auth_key) + password_len : 0)
+		+ sizeof(packet->uuid) + uuid_len
+		+ sizeof(packet->payload) + capture_info->len;
+	hg_pkt->header.length = htons(packet_len);
+
+	return iovcnt;
+}
+
+/*!
+ * \brief Send the messages of a batch to the HEP server
+ *
+ * \return Number of messages sent
+ */
+static unsigned int hep_send_msgs(int sockfd, struct hep_mmsghdr *msgs, unsigned int count)
+{
+	unsigned int sent = 0;
+	unsigned int errors = 0;
+	int res;
+
+	while (sent + errors < count) {
+#ifdef HAVE_SENDMMSG
+		res = sendmmsg(sockfd, &msgs[sent + errors], count - sent - errors, 0);
+#else
+		res = sendmsg(sockfd, &msgs[sent + errors].msg_hdr, 0) < 0 ? -1 : 1;
+#endif
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ast_log(AST_LOG_ERROR, "Error [%d] while sending packet to HEPv3 server: %s\n",
+				errno, strerror(errno));
+			/* Drop the packet that failed and carry on with the rest */
+			++errors;
+			continue;
+		}
+		sent += res;
 	}
 
-	/* Copy in the header */
-	memcpy(sock_buffer, &hg_pkt, sizeof(hg_pkt));
-	sock_buffer_len = sizeof(hg_pkt);
+	if (errors) {
+		__sync_fetch_and_add(&hep_stats.send_errors, errors);
+	}
+	return sent;
+}
 
-	/* Addresses */
-	if (ast_sockaddr_is_ipv4(&capture_info->src_addr)) {
-		memcpy(sock_buffer + sock_buffer_len, &ipv4_src, sizeof(ipv4_src));
-		sock_buffer_len += sizeof(ipv4_src);
-		memcpy(sock_buffer + sock_buffer_len, &ipv4_dst, sizeof(ipv4_dst));
-		sock_buffer_len += sizeof(ipv4_dst);
-	} else {
-		memcpy(sock_buffer + sock_buffer_len, &ipv6_src, sizeof(ipv6_src));
-		sock_buffer_len += sizeof(ipv6_src);
-		memcpy(sock_buffer + sock_buffer_len, &ipv6_dst, sizeof(ipv6_dst));
-		sock_buffer_len += sizeof(ipv6_dst);
+/*!
+ * \brief Send a batch of captures to the HEP server
+ *
+ * \param batch The captures, still owned by the caller
+ * \param count Number of captures in the batch
+ */
+static void hep_send_batch(struct hepv3_capture_info **batch, unsigned int count)
+{
+	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
+	RAII_VAR(struct hepv3_runtime_data *, hepv3_data, ao2_global_obj_ref(global_data), ao2_cleanup);
+	struct hep_packet packets[HEP_SEND_BATCH];
+	struct hep_mmsghdr msgs[HEP_SEND_BATCH];
+	unsigned int num_msgs = 0;
+	unsigned int i;
+	int iovcnt;
+
+	if (!config || !hepv3_data) {
+		return;
 	}
 
-	/* Auth Key */
-	if (!ast_strlen_zero(config->general->capture_password)) {
-		memcpy(sock_buffer + sock_buffer_len, &auth_key, sizeof(auth_key));
-		sock_buffer_len += sizeof(auth_key);
-		memcpy(sock_buffer + sock_buffer_len, config->general->capture_password, strlen(config->general->capture_password));
-		sock_buffer_len += strlen(config->general->capture_password);
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < count; ++i) {
+		iovcnt = hep_packet_build(&packets[num_msgs], batch[i], config->general);
+		if (!iovcnt) {
+			continue;
+		}
+		msgs[num_msgs].msg_hdr.msg_name = &hepv3_data->remote_addr.ss;
+		msgs[num_msgs].msg_hdr.msg_namelen = hepv3_data->remote_addr.len;
+		msgs[num_msgs].msg_hdr.msg_iov = packets[num_msgs].iov;
+		msgs[num_msgs].msg_hdr.msg_iovlen = iovcnt;
+		++num_msgs;
 	}
 
-	/* UUID */
-	memcpy(sock_buffer + sock_buffer_len, &uuid, sizeof(uuid));
-	sock_buffer_len += sizeof(uuid);
-	memcpy(sock_buffer + sock_buffer_len, capture_info->uuid, strlen(capture_info->uuid));
-	sock_buffer_len += strlen(capture_info->uuid);
+	if (num_msgs) {
+		__sync_fetch_and_add(&hep_stats.sent, hep_send_msgs(hepv3_data->sockfd, msgs, num_msgs));
+	}
+}
 
-	/* Packet! */
-	memcpy(sock_buffer + sock_buffer_len, &payload, sizeof(payload));
-	sock_buffer_len += sizeof(payload);
-	memcpy(sock_buffer + sock_buffer_len, capture_info->payload, capture_info->len);
-	sock_buffer_len += capture_info->len;
+/*! \brief Thread sending the queued captures in batches */
+static void *hep_sender(void *unused)
+{
+	struct hepv3_capture_info *batch[HEP_SEND_BATCH];
+	unsigned int count;
+	unsigned int i;
+
+	for (;;) {
+		ast_mutex_lock(&hep_queue.lock);
+		while (!hep_queue.count && !hep_queue.stop) {
+			ast_cond_wait(&hep_queue.cond, &hep_queue.lock);
+		}
+		if (!hep_queue.count) {
+			/* Stopping, and everything queued has been sent */
+			ast_mutex_unlock(&hep_queue.lock);
+			break;
+		}
+		count = MIN(hep_queue.count, HEP_SEND_BATCH);
+		for (i = 0; i < count; ++i) {
+			batch[i] = hep_queue.ring[hep_queue.head];
+			hep_queue.head = (hep_queue.head + 1) % hep_queue.size;
+		}
+		hep_queue.count -= count;
+		ast_mutex_unlock(&hep_queue.lock);
+
+		hep_send_batch(batch, count);
+		for (i = 0; i < count; ++i) {
+			ao2_ref(batch[i], -1);
+		}
+	}
+
+	return NULL;
+}
 
-	ast_assert(sock_buffer_len == packet_len);
+/*!
+ * \brief Change the number of captures that can be queued
+ *
+ * Captures that no longer fit are dropped.
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+static int hep_queue_resize(unsigned int size)
+{
+	struct hepv3_capture_info **ring;
+	struct hepv3_capture_info **old_ring;
+	unsigned int kept;
+	unsigned int i;
 
-	res = ast_sendto(hepv3_data->sockfd, sock_buffer, sock_buffer_len, 0, &hepv3_data->remote_addr);
-	if (res < 0) {
-		ast_log(AST_LOG_ERROR, "Error [%d] while sending packet to HEPv3 server: %s\n",
-			errno, strerror(errno));
-	} else if (res != sock_buffer_len) {
-		ast_log(AST_LOG_WARNING, "Failed to send complete packet to HEPv3 server: %d of %u sent\n",
-			res, sock_buffer_len);
-		res = -1;
+	if (size == hep_queue.size) {
+		return 0;
+	}
+
+	ring = size ? ast_calloc(size, sizeof(*ring)) : NULL;
+	if (size && !ring) {
+		return -1;
 	}
 
-	ast_free(sock_buffer);
-	return res;
+	ast_mutex_lock(&hep_queue.lock);
+	kept = MIN(hep_queue.count, size);
+	for (i = 0; i < hep_queue.count; ++i) {
+		struct hepv3_capture_info *capture_info = hep_queue.ring[(hep_queue.head + i) % hep_queue.size];
+
+		if (i < kept) {
+			ring[i] = capture_info;
+		} else {
+			ao2_ref(capture_info, -1);
+			__sync_fetch_and_add(&hep_stats.dropped_full, 1);
+		}
+	}
+	old_ring = hep_queue.ring;
+	hep_queue.ring = ring;
+	hep_queue.size = size;
+	hep_queue.head = 0;
+	hep_queue.count = kept;
+	ast_mutex_unlock(&hep_queue.lock);
+
+	ast_free(old_ring);
+	return 0;
+}
+
+/*!
+ * \brief Whether the captures of a call are left out by sampling
+ *
+ * The UUID is hashed, so all of the packets of a call are either
+ * captured or not.
+ */
+static int hep_sampled_out(const struct hepv3_global_config *general, const char *uuid)
+{
+	if (general->sample_rate >= 100) {
+		return 0;
+	}
+	return ast_str_hash(S_OR(uuid, "")) % 100 >= general->sample_rate;
 }
 
 int hepv3_send_packet(struct hepv3_capture_info *capture_info)
 {
 	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
-	int res;
 
 	if (!config || !config->general->enabled) {
 		ao2_ref(capture_info, -1);
 		return 0;
 	}
 
-	res = ast_taskprocessor_push(hep_queue_tp, hep_queue_cb, capture_info);
-	if (res == -1) {
+	if (hep_sampled_out(config->general, capture_info->uuid)) {
+		__sync_fetch_and_add(&hep_stats.dropped_sampled, 1);
 		ao2_ref(capture_info, -1);
+		return 0;
+	}
+
+	ast_mutex_lock(&hep_queue.lock);
+	if (hep_queue.stop || hep_queue.count == hep_queue.size) {
+		ast_mutex_unlock(&hep_queue.lock);
+		__sync_fetch_and_add(&hep_stats.dropped_full, 1);
+		ao2_ref(capture_info, -1);
+		return -1;
+	}
+	hep_queue.ring[(hep_queue.head + hep_queue.count) % hep_queue.size] = capture_info;
+	/* The sender only waits once it has emptied the queue */
+	if (!hep_queue.count++) {
+		ast_cond_signal(&hep_queue.cond);
 	}
+	ast_mutex_unlock(&hep_queue.lock);
 
-	return res;
+	__sync_fetch_and_add(&hep_stats.queued, 1);
+	return 0;
+}
+
+/*! \brief Write the HEP counters for a metrics scrape */
+static void hep_metrics_collector(struct ast_metrics_output *out)
+{
+	unsigned int count;
+
+	ast_mutex_lock(&hep_queue.lock);
+	count = hep_queue.count;
+	ast_mutex_unlock(&hep_queue.lock);
+
+	ast_metrics_output_family(out, "asterisk_hep_queue_size", AST_METRIC_GAUGE,
+		"Captured packets waiting to be sent to the HEP server");
+	ast_metrics_output_sample(out, "asterisk_hep_queue_size", NULL, NULL, count);
+
+	ast_metrics_output_family(out, "asterisk_hep_packets_total", AST_METRIC_COUNTER,
+		"Captured packets by what happened to them");
+	ast_metrics_output_sample(out, "asterisk_hep_packets_total", "result", "queued", hep_stats.queued);
+	ast_metrics_output_sample(out, "asterisk_hep_packets_total", "result", "sent", hep_stats.sent);
+	ast_metrics_output_sample(out, "asterisk_hep_packets_total", "result", "dropped_full", hep_stats.dropped_full);
+	ast_metrics_output_sample(out, "asterisk_hep_packets_total", "result", "dropped_sampled", hep_stats.dropped_sampled);
+	ast_metrics_output_sample(out, "asterisk_hep_packets_total", "result", "send_error", hep_stats.send_errors);
 }
 
+static char *handle_cli_hep_show_status(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
+	unsigned int count;
+	unsigned int size;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "hep show status";
+		e->usage =
+			"Usage: hep show status\n"
+			"       Show the queue of packets waiting to be sent to the HEP\n"
+			"       server and what happened to the packets captured.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_mutex_lock(&hep_queue.lock);
+	count = hep_queue.count;
+	size = hep_queue.size;
+	ast_mutex_unlock(&hep_queue.lock);
+
+	ast_cli(a->fd, "Enabled:         %s\n", config && config->general->enabled ? "Yes" : "No");
+	ast_cli(a->fd, "Sample rate:     %u%%\n", config ? config->general->sample_rate : 0);
+	ast_cli(a->fd, "Queued now:      %u of %u\n", count, size);
+	ast_cli(a->fd, "Queued:          %" PRIu64 "\n", hep_stats.queued);
+	ast_cli(a->fd, "Sent:            %" PRIu64 "\n", hep_stats.sent);
+	ast_cli(a->fd, "Dropped (full):  %" PRIu64 "\n", hep_stats.dropped_full);
+	ast_cli(a->fd, "Sampled out:     %" PRIu64 "\n", hep_stats.dropped_sampled);
+	ast_cli(a->fd, "Send errors:     %" PRIu64 "\n", hep_stats.send_errors);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_hep[] = {
+	AST_CLI_DEFINE(handle_cli_hep_show_status, "Show the status of HEP packet capture"),
+};
+
 /*!
  * \brief Post-apply callback for the config framework.
  *
@@ -555,6 +861,11 @@ static void hepv3_config_post_apply(void)
 	RAII_VAR(struct module_config *, mod_cfg, ao2_global_obj_ref(global_config), ao2_cleanup);
 	struct hepv3_runtime_data *data;
 
+	if (hep_queue_resize(mod_cfg->general->queue_size)) {
+		ast_log(AST_LOG_WARNING, "Failed to resize the HEP queue to %u packets\n",
+			mod_cfg->general->queue_size);
+	}
+
 	data = hepv3_data_alloc(mod_cfg->general);
 	if (!data) {
 		return;
@@ -580,7 +891,20 @@ static int reload_module(void)
  */
 static int unload_module(void)
 {
-	hep_queue_tp = ast_taskprocessor_unreference(hep_queue_tp);
+	ast_metrics_collector_unregister(hep_metrics_collector);
+	ast_cli_unregister_multiple(cli_hep, ARRAY_LEN(cli_hep));
+
+	if (hep_queue.thread != AST_PTHREADT_NULL) {
+		ast_mutex_lock(&hep_queue.lock);
+		hep_queue.stop = 1;
+		ast_cond_signal(&hep_queue.cond);
+		ast_mutex_unlock(&hep_queue.lock);
+		pthread_join(hep_queue.thread, NULL);
+		hep_queue.thread = AST_PTHREADT_NULL;
+	}
+	hep_queue_resize(0);
+	ast_mutex_destroy(&hep_queue.lock);
+	ast_cond_destroy(&hep_queue.cond);
 
 	ao2_global_obj_release(global_config);
 	ao2_global_obj_release(global_data);
@@ -594,12 +918,11 @@ static int unload_module(void)
  */
 static int load_module(void)
 {
-	if (aco_info_init(&cfg_info)) {
-		goto error;
-	}
+	ast_mutex_init(&hep_queue.lock);
+	ast_cond_init(&hep_queue.cond, NULL);
+	hep_queue.stop = 0;
 
-	hep_queue_tp = ast_taskprocessor_get("hep_queue_tp", TPS_REF_DEFAULT);
-	if (!hep_queue_tp) {
+	if (aco_info_init(&cfg_info)) {
 		goto error;
 	}
 
@@ -607,15 +930,31 @@ static int load_module(void)
 	aco_option_register(&cfg_info, "capture_address", ACO_EXACT, global_options, DEFAULT_HEP_SERVER, OPT_STRINGFIELD_T, 0, STRFLDSET(struct hepv3_global_config, capture_address));
 	aco_option_register(&cfg_info, "capture_password", ACO_EXACT, global_options, "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct hepv3_global_config, capture_password));
 	aco_option_register(&cfg_info, "capture_id", ACO_EXACT, global_options, "0", OPT_UINT_T, 0, STRFLDSET(struct hepv3_global_config, capture_id));
+	aco_option_register(&cfg_info, "queue_size", ACO_EXACT, global_options, "2048", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct hepv3_global_config, queue_size), 16, 1000000);
+	aco_option_register(&cfg_info, "sample_rate", ACO_EXACT, global_options, "100", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct hepv3_global_config, sample_rate), 0, 100);
 
 	if (aco_process_config(&cfg_info, 0) == ACO_PROCESS_ERROR) {
 		goto error;
 	}
 
+	if (ast_pthread_create_background(&hep_queue.thread, NULL, hep_sender, NULL)) {
+		hep_queue.thread = AST_PTHREADT_NULL;
+		ast_log(AST_LOG_ERROR, "Failed to start the HEP sender thread\n");
+		goto error;
+	}
+
+	ast_cli_register_multiple(cli_hep, ARRAY_LEN(cli_hep));
+	ast_metrics_collector_register("res_hep", hep_metrics_collector);
+
 	return AST_MODULE_LOAD_SUCCESS;
 
 error:
+	ao2_global_obj_release(global_config);
+	ao2_global_obj_release(global_data);
 	aco_info_destroy(&cfg_info);
+	hep_queue_resize(0);
+	ast_mutex_destroy(&hep_queue.lock);
+	ast_cond_destroy(&hep_queue.cond);
 	return AST_MODULE_LOAD_DECLINE;
 }
 
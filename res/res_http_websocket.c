@@ -24,6 +24,7 @@
  */
 
 /*** MODULEINFO
+	<use type="external">zlib</use>
 	<support_level>extended</support_level>
  ***/
 
@@ -39,6 +40,11 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/unaligned.h"
 #include "asterisk/uri.h"
 #include "asterisk/uuid.h"
+#include "asterisk/sched.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #define AST_API_MODULE
 #include "asterisk/http_websocket.h"
@@ -73,6 +79,27 @@ ASTERISK_REGISTER_FILE()
 #define MAX_WS_HDR_SZ 14
 #define MIN_WS_HDR_SZ 2
 
+/*! \brief Maximum size of the header of an unmasked frame, as sent by the server */
+#define MAX_WS_UNMASKED_HDR_SZ 10
+
+/*! \brief Bit set in the first byte of a frame compressed with permessage-deflate */
+#define WS_RSV1 0x40
+
+/*! \brief Smallest payload worth compressing */
+#define DEFLATE_MINIMUM_PAYLOAD 64
+
+/*! \brief Largest message a compressed message may inflate to */
+#define MAXIMUM_INFLATED_SIZE (MAXIMUM_RECONSTRUCTION_CEILING * 8)
+
+/*! \brief Amount the payload grows by at a time while inflating */
+#define INFLATE_CHUNK_SIZE 4096
+
+/*! \brief Frames waiting to be coalesced are sent once they take up this much */
+#define MAXIMUM_COALESCED_SIZE 65536
+
+/*! \brief Scheduler for sending coalesced frames */
+static struct ast_sched_context *sched;
+
 /*! \brief Structure definition for session */
 struct ast_websocket {
 	FILE *f;                           /*!< Pointer to the file instance used for writing and reading */
@@ -86,7 +113,19 @@ struct ast_websocket {
 	unsigned int secure:1;             /*!< Bit to indicate that the transport is secure */
 	unsigned int closing:1;            /*!< Bit to indicate that the session is in the process of being closed */
 	unsigned int close_sent:1;         /*!< Bit to indicate that the session close opcode has been sent and no further data will be sent */
+	unsigned int deflate:1;            /*!< Bit to indicate that permessage-deflate was negotiated */
+	unsigned int inflating:1;          /*!< Bit to indicate that the message being read is compressed */
+	unsigned int no_context_takeover:1; /*!< Bit to indicate that each sent message is compressed on its own */
 	struct websocket_client *client;   /*!< Client object when connected as a client websocket */
+	char *wbuf;                        /*!< Frames assembled for writing */
+	size_t wbuf_len;                   /*!< Length of the frames waiting to be written */
+	size_t wbuf_size;                  /*!< Allocated size of the write buffer */
+	int coalesce;                      /*!< How long in milliseconds text and binary frames may wait to be written */
+	int flush_id;                      /*!< Scheduler id of the pending write of coalesced frames */
+#ifdef HAVE_ZLIB
+	z_stream deflater;                 /*!< Compression stream for sent messages */
+	z_stream inflater;                 /*!< Decompression stream for received messages */
+#endif
 	char session_id[AST_UUID_STR_LEN]; /*!< The identifier for the websocket session */
 };
 
@@ -118,6 +157,7 @@ static void protocol_destroy_fn(void *obj)
 /*! \brief Structure for a WebSocket server */
 struct ast_websocket_server {
 	struct ao2_container *protocols; /*!< Container for registered protocols */
+	int deflate;                     /*!< Whether permessage-deflate is offered to clients */
 };
 
 static void websocket_server_internal_dtor(void *obj)
@@ -162,6 +202,11 @@ struct ast_websocket_server *AST_OPTIONAL_API_NAME(ast_websocket_server_create)(
 	return websocket_server_create_impl(websocket_server_dtor);
 }
 
+void AST_OPTIONAL_API_NAME(ast_websocket_server_set_deflate)(struct ast_websocket_server *server, int enabled)
+{
+	server->deflate = enabled;
+}
+
 /*! \brief Destructor function for sessions */
 static void session_destroy_fn(void *obj)
 {
@@ -178,6 +223,13 @@ static void session_destroy_fn(void *obj)
 
 	ao2_cleanup(session->client);
 	ast_free(session->payload);
+	ast_free(session->wbuf);
+#ifdef HAVE_ZLIB
+	if (session->deflate) {
+		deflateEnd(&session->deflater);
+		inflateEnd(&session->inflater);
+	}
+#endif
 }
 
 struct ast_websocket_protocol *AST_OPTIONAL_API_NAME(ast_websocket_sub_protocol_alloc)(const char *name)
@@ -276,6 +328,51 @@ int AST_OPTIONAL_API_NAME(ast_websocket_server_remove_protocol)(struct ast_webso
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Make sure the write buffer can hold \a size bytes
+ *
+ * \note Must be called with the session locked
+ */
+static int websocket_wbuf_reserve(struct ast_websocket *session, size_t size)
+{
+	char *wbuf;
+
+	if (size <= session->wbuf_size) {
+		return 0;
+	}
+
+	size = MAX(size, session->wbuf_size * 2);
+	if (!(wbuf = ast_realloc(session->wbuf, size))) {
+		return -1;
+	}
+	session->wbuf = wbuf;
+	session->wbuf_size = size;
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Write out the frames waiting in the write buffer
+ *
+ * \note Must be called with the session locked
+ */
+static int websocket_flush(struct ast_websocket *session)
+{
+	int res;
+
+	if (!session->wbuf_len) {
+		return 0;
+	}
+
+	res = session->f ? ast_careful_fwrite(session->f, session->fd, session->wbuf,
+		session->wbuf_len, session->timeout) : -1;
+	session->wbuf_len = 0;
+
+	return res;
+}
+
 /*! \brief Close function for websocket session */
 int AST_OPTIONAL_API_NAME(ast_websocket_close)(struct ast_websocket *session, uint16_t reason)
 {
@@ -296,12 +393,23 @@ int AST_OPTIONAL_API_NAME(ast_websocket_close)(struct ast_websocket *session, ui
 	session->close_sent = 1;
 
 	ao2_lock(session);
-	res = ast_careful_fwrite(session->f, session->fd, frame, 4, session->timeout);
+	/* Send any frames still waiting to be coalesced along with the close */
+	if (websocket_wbuf_reserve(session, session->wbuf_len + sizeof(frame))) {
+		res = websocket_flush(session);
+		if (!res) {
+			res = session->f ? ast_careful_fwrite(session->f, session->fd, frame, sizeof(frame),
+				session->timeout) : -1;
+		}
+	} else {
+		memcpy(session->wbuf + session->wbuf_len, frame, sizeof(frame));
+		session->wbuf_len += sizeof(frame);
+		res = websocket_flush(session);
+	}
 
 	/* If an error occurred when trying to close this connection explicitly terminate it now.
 	 * Doing so will cause the thread polling on it to wake up and terminate.
 	 */
-	if (res) {
+	if (res && session->f) {
 		fclose(session->f);
 		session->f = NULL;
 		ast_verb(2, "WebSocket connection %s '%s' forcefully closed due to fatal write error\n",
@@ -331,61 +439,177 @@ static const char *websocket_opcode2str(enum ast_websocket_opcode opcode)
 	}
 }
 
-/*! \brief Write function for websocket traffic */
-int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, enum ast_websocket_opcode opcode, char *payload, uint64_t actual_length)
+/*! \brief Size of the header of an unmasked frame with a payload of \a length bytes */
+static size_t websocket_header_size(uint64_t length)
 {
-	size_t header_size = 2; /* The minimum size of a websocket frame is 2 bytes */
-	char *frame;
-	uint64_t length;
+	if (length < 126) {
+		return 2;
+	} else if (length < (1 << 16)) {
+		/* We need an additional 2 bytes to store the extended length */
+		return 4;
+	}
+	/* We need an additional 8 bytes to store the really really extended length */
+	return 10;
+}
 
-	ast_debug(3, "Writing websocket %s frame, length %" PRIu64 "\n",
-			websocket_opcode2str(opcode), actual_length);
+/*! \brief Fill in the header of an unmasked frame */
+static void websocket_put_header(char *frame, char flags, uint64_t actual_length)
+{
+	frame[0] = flags;
 
+	/* Use the additional available bytes to store the length */
 	if (actual_length < 126) {
-		length = actual_length;
+		frame[1] = actual_length;
 	} else if (actual_length < (1 << 16)) {
-		length = 126;
-		/* We need an additional 2 bytes to store the extended length */
-		header_size += 2;
+		frame[1] = 126;
+		put_unaligned_uint16(&frame[2], htons(actual_length));
 	} else {
-		length = 127;
-		/* We need an additional 8 bytes to store the really really extended length */
-		header_size += 8;
+		frame[1] = 127;
+		put_unaligned_uint64(&frame[2], htonll(actual_length));
 	}
+}
 
-	frame = ast_alloca(header_size);
-	memset(frame, 0, header_size);
+#ifdef HAVE_ZLIB
+/*!
+ * \internal
+ * \brief Compress a message into the write buffer
+ *
+ * \param session The session
+ * \param payload The message
+ * \param length Length of the message
+ * \param start Where in the write buffer the compressed message goes
+ * \param deflated_len Set to the length of the compressed message
+ *
+ * \note Must be called with the session locked
+ */
+static int websocket_deflate(struct ast_websocket *session, char *payload, size_t length,
+	size_t start, size_t *deflated_len)
+{
+	z_stream *zs = &session->deflater;
+	size_t pos = start;
+	int res;
 
-	frame[0] = opcode | 0x80;
-	frame[1] = length;
+	zs->next_in = (Bytef *) payload;
+	zs->avail_in = length;
+	do {
+		size_t avail = MAX(length / 2, INFLATE_CHUNK_SIZE);
 
-	/* Use the additional available bytes to store the length */
-	if (length == 126) {
-		put_unaligned_uint16(&frame[2], htons(actual_length));
-	} else if (length == 127) {
-		put_unaligned_uint64(&frame[2], htonll(actual_length));
+		if (websocket_wbuf_reserve(session, pos + avail)) {
+			return -1;
+		}
+		zs->next_out = (Bytef *) session->wbuf + pos;
+		zs->avail_out = avail;
+		res = deflate(zs, Z_SYNC_FLUSH);
+		pos += avail - zs->avail_out;
+		if (res != Z_OK && res != Z_BUF_ERROR) {
+			ast_log(LOG_WARNING, "WebSocket message could not be compressed: %s\n", zs->msg ? zs->msg : "unknown error");
+			return -1;
+		}
+	} while (!zs->avail_out);
+
+	if (session->no_context_takeover) {
+		deflateReset(zs);
 	}
 
+	/* RFC 7692 leaves off the empty block that ends a sync flush */
+	*deflated_len = pos - start - 4;
+
+	return 0;
+}
+#endif
+
+/*! \brief Scheduler callback that writes out coalesced frames */
+static int websocket_flush_cb(const void *data)
+{
+	struct ast_websocket *session = (struct ast_websocket *) data;
+	int res;
+
+	ao2_lock(session);
+	session->flush_id = -1;
+	res = websocket_flush(session);
+	ao2_unlock(session);
+
+	if (res) {
+		/* 1011 - server terminating connection due to not being able to fulfill the request */
+		ast_websocket_close(session, 1011);
+	}
+	ao2_ref(session, -1);
+
+	return 0;
+}
+
+/*! \brief Write function for websocket traffic */
+int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, enum ast_websocket_opcode opcode, char *payload, uint64_t actual_length)
+{
+	int data = opcode == AST_WEBSOCKET_OPCODE_TEXT || opcode == AST_WEBSOCKET_OPCODE_BINARY;
+	char flags = opcode | 0x80;
+	uint64_t length = actual_length;
+	size_t header_size;
+	size_t pos;
+	int res;
+
+	ast_debug(3, "Writing websocket %s frame, length %" PRIu64 "\n",
+			websocket_opcode2str(opcode), actual_length);
+
 	ao2_lock(session);
 	if (session->closing) {
 		ao2_unlock(session);
 		return -1;
 	}
-	if (ast_careful_fwrite(session->f, session->fd, frame, header_size, session->timeout)) {
-		ao2_unlock(session);
-		/* 1011 - server terminating connection due to not being able to fulfill the request */
-		ast_websocket_close(session, 1011);
-		return -1;
+
+	/* The header and payload are assembled after any frames waiting to be
+	 * coalesced so everything goes out in a single write */
+	pos = session->wbuf_len;
+#ifdef HAVE_ZLIB
+	if (session->deflate && data && actual_length >= DEFLATE_MINIMUM_PAYLOAD && actual_length <= UINT_MAX) {
+		size_t deflated_len;
+
+		if (websocket_deflate(session, payload, actual_length, pos + MAX_WS_UNMASKED_HDR_SZ, &deflated_len)) {
+			ao2_unlock(session);
+			/* 1011 - server terminating connection due to not being able to fulfill the request */
+			ast_websocket_close(session, 1011);
+			return -1;
+		}
+		flags |= WS_RSV1;
+		length = deflated_len;
+		header_size = websocket_header_size(length);
+		memmove(session->wbuf + pos + header_size, session->wbuf + pos + MAX_WS_UNMASKED_HDR_SZ, length);
+	} else
+#endif
+	{
+		header_size = websocket_header_size(length);
+		if (websocket_wbuf_reserve(session, pos + header_size + length)) {
+			ao2_unlock(session);
+			/* 1011 - server terminating connection due to not being able to fulfill the request */
+			ast_websocket_close(session, 1011);
+			return -1;
+		}
+		memcpy(session->wbuf + pos + header_size, payload, length);
 	}
+	websocket_put_header(session->wbuf + pos, flags, length);
+	session->wbuf_len = pos + header_size + length;
 
-	if (ast_careful_fwrite(session->f, session->fd, payload, actual_length, session->timeout)) {
-		ao2_unlock(session);
+	/* Text and binary frames may wait a while for others to join them */
+	if (session->coalesce && data && session->wbuf_len < MAXIMUM_COALESCED_SIZE) {
+		if (session->flush_id < 0) {
+			session->flush_id = ast_sched_add(sched, session->coalesce, websocket_flush_cb, ao2_bump(session));
+			if (session->flush_id < 0) {
+				ao2_ref(session, -1);
+			}
+		}
+		if (session->flush_id >= 0) {
+			ao2_unlock(session);
+			return 0;
+		}
+	}
+
+	res = websocket_flush(session);
+	ao2_unlock(session);
+	if (res) {
 		/* 1011 - server terminating connection due to not being able to fulfill the request */
 		ast_websocket_close(session, 1011);
 		return -1;
 	}
-	fflush(session->f);
-	ao2_unlock(session);
 
 	return 0;
 }
@@ -449,6 +673,19 @@ int AST_OPTIONAL_API_NAME(ast_websocket_set_timeout)(struct ast_websocket *sessi
 	return 0;
 }
 
+int AST_OPTIONAL_API_NAME(ast_websocket_set_coalesce)(struct ast_websocket *session, int ms)
+{
+	if (ms < 0) {
+		return -1;
+	}
+
+	ao2_lock(session);
+	session->coalesce = ms;
+	ao2_unlock(session);
+
+	return 0;
+}
+
 const char * AST_OPTIONAL_API_NAME(ast_websocket_session_id)(struct ast_websocket *session)
 {
 	return session->session_id;
@@ -543,6 +780,72 @@ static inline int ws_safe_read(struct ast_websocket *session, char *buf, int len
 	return 0;
 }
 
+#ifdef HAVE_ZLIB
+/*!
+ * \internal
+ * \brief Inflate part of a compressed message onto the end of the payload
+ */
+static int websocket_inflate_chunk(struct ast_websocket *session, char *data, size_t len)
+{
+	z_stream *zs = &session->inflater;
+	int res;
+
+	zs->next_in = (Bytef *) data;
+	zs->avail_in = len;
+	do {
+		char *new_payload;
+
+		if (session->payload_len >= MAXIMUM_INFLATED_SIZE) {
+			ast_log(LOG_WARNING, "Compressed websocket message inflates past %d bytes\n",
+				MAXIMUM_INFLATED_SIZE);
+			return -1;
+		}
+		if (!(new_payload = ast_realloc(session->payload, session->payload_len + INFLATE_CHUNK_SIZE))) {
+			return -1;
+		}
+		session->payload = new_payload;
+		zs->next_out = (Bytef *) session->payload + session->payload_len;
+		zs->avail_out = INFLATE_CHUNK_SIZE;
+		res = inflate(zs, Z_SYNC_FLUSH);
+		session->payload_len += INFLATE_CHUNK_SIZE - zs->avail_out;
+		if (res == Z_STREAM_END) {
+			/* The client ended the stream, so the next message starts a new one */
+			inflateReset(zs);
+		} else if (res != Z_OK && res != Z_BUF_ERROR) {
+			ast_log(LOG_WARNING, "Compressed websocket message could not be inflated: %s\n",
+				zs->msg ? zs->msg : "unknown error");
+			return -1;
+		}
+	} while (!zs->avail_out);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Inflate a frame of a compressed message onto the end of the payload
+ *
+ * \param session The session
+ * \param data The frame's payload
+ * \param len Length of the frame's payload
+ * \param fin Whether this is the last frame of the message
+ */
+static int websocket_inflate(struct ast_websocket *session, char *data, size_t len, int fin)
+{
+	/* RFC 7692 leaves off the empty block that ends each message, so put it back */
+	static char tail[] = { 0x00, 0x00, 0xff, 0xff };
+
+	if (len && websocket_inflate_chunk(session, data, len)) {
+		return -1;
+	}
+	if (fin && websocket_inflate_chunk(session, tail, sizeof(tail))) {
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
 int AST_OPTIONAL_API_NAME(ast_websocket_read)(struct ast_websocket *session, char **payload, uint64_t *payload_len, enum ast_websocket_opcode *opcode, int *fragmented)
 {
 	char buf[MAXIMUM_FRAME_SIZE] = "";
@@ -568,6 +871,18 @@ int AST_OPTIONAL_API_NAME(ast_websocket_read)(struct ast_websocket *session, cha
 		fin = (buf[0] >> 7) & 1;
 		mask_present = (buf[1] >> 7) & 1;
 
+		/* Only the first frame of a compressed message is marked as such */
+		if (buf[0] & WS_RSV1) {
+			if (!session->deflate
+				|| (*opcode != AST_WEBSOCKET_OPCODE_TEXT && *opcode != AST_WEBSOCKET_OPCODE_BINARY)) {
+				ast_log(LOG_WARNING, "WebSocket frame is compressed without permessage-deflate\n");
+				/* 1002 - protocol error */
+				ast_websocket_close(session, 1002);
+				return -1;
+			}
+			session->inflating = 1;
+		}
+
 		/* Based on the mask flag and payload length, determine how much more we need to read before start parsing the rest of the header */
 		options_len += mask_present ? 4 : 0;
 		options_len += (*payload_len == 126) ? 2 : (*payload_len == 127) ? 8 : 0;
@@ -620,6 +935,18 @@ int AST_OPTIONAL_API_NAME(ast_websocket_read)(struct ast_websocket *session, cha
 			return 0;
 		}
 
+#ifdef HAVE_ZLIB
+		if (session->inflating && *opcode != AST_WEBSOCKET_OPCODE_PING && *opcode != AST_WEBSOCKET_OPCODE_PONG) {
+			if (websocket_inflate(session, *payload, *payload_len, fin)) {
+				*payload_len = 0;
+				ast_websocket_close(session, 1009);
+				return -1;
+			}
+			if (fin) {
+				session->inflating = 0;
+			}
+		} else
+#endif
 		if (*payload_len) {
 			if (!(new_payload = ast_realloc(session->payload, (session->payload_len + *payload_len)))) {
 				ast_log(LOG_WARNING, "Failed allocation: %p, %zu, %"PRIu64"\n",
@@ -710,6 +1037,82 @@ static char *websocket_combine_key(const char *key, char *res, int res_size)
 	return res;
 }
 
+#ifdef HAVE_ZLIB
+/*!
+ * \internal
+ * \brief Accept a permessage-deflate offer from a Sec-WebSocket-Extensions header
+ *
+ * \param session The session to compress
+ * \param extensions The value of the client's Sec-WebSocket-Extensions header
+ * \param response Filled in with the Sec-WebSocket-Extensions header to respond with
+ * \param response_len Size of the response buffer
+ *
+ * \retval 0 if an offer was accepted
+ * \retval -1 if none was
+ */
+static int websocket_deflate_negotiate(struct ast_websocket *session, char *extensions,
+	char *response, size_t response_len)
+{
+	char *offer;
+
+	while ((offer = strsep(&extensions, ","))) {
+		char *name = ast_strip(strsep(&offer, ";"));
+		char *param;
+		char window_param[32] = "";
+		int no_context_takeover = 0;
+		int window_bits = 15;
+		int accept = 1;
+
+		if (strcasecmp(name, "permessage-deflate")) {
+			continue;
+		}
+
+		while (accept && (param = strsep(&offer, ";"))) {
+			char *value = param;
+
+			param = ast_strip(strsep(&value, "="));
+			if (value) {
+				value = ast_strip_quoted(ast_strip(value), "\"", "\"");
+			}
+
+			if (!strcasecmp(param, "server_no_context_takeover") && !value) {
+				no_context_takeover = 1;
+			} else if (!strcasecmp(param, "server_max_window_bits")) {
+				/* zlib cannot make a raw deflate stream with a window of 8 bits */
+				accept = value && sscanf(value, "%30d", &window_bits) == 1
+					&& window_bits >= 9 && window_bits <= 15;
+				/* Accepting the limit means saying so */
+				snprintf(window_param, sizeof(window_param), "; server_max_window_bits=%d", window_bits);
+			} else if (strcasecmp(param, "client_max_window_bits")
+				&& strcasecmp(param, "client_no_context_takeover")) {
+				/* Whatever window the client compresses with, the largest one inflates it */
+				accept = 0;
+			}
+		}
+		if (!accept) {
+			continue;
+		}
+
+		if (deflateInit2(&session->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -window_bits,
+				8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			return -1;
+		}
+		if (inflateInit2(&session->inflater, -15) != Z_OK) {
+			deflateEnd(&session->deflater);
+			return -1;
+		}
+		session->deflate = 1;
+		session->no_context_takeover = no_context_takeover;
+
+		snprintf(response, response_len, "Sec-WebSocket-Extensions: permessage-deflate%s%s\r\n",
+			no_context_takeover ? "; server_no_context_takeover" : "", window_param);
+		return 0;
+	}
+
+	return -1;
+}
+#endif
+
 static void websocket_bad_request(struct ast_tcptls_session_instance *ser)
 {
 	struct ast_str *http_header = ast_str_create(64);
@@ -727,6 +1130,7 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 {
 	struct ast_variable *v;
 	char *upgrade = NULL, *key = NULL, *key1 = NULL, *key2 = NULL, *protos = NULL, *requested_protocols = NULL, *protocol = NULL;
+	char *extensions = NULL;
 	int version = 0, flags = 1;
 	struct ast_websocket_protocol *protocol_handler = NULL;
 	struct ast_websocket *session;
@@ -755,6 +1159,10 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 		} else if (!strcasecmp(v->name, "Sec-WebSocket-Protocol")) {
 			requested_protocols = ast_strip(ast_strdupa(v->value));
 			protos = ast_strdupa(requested_protocols);
+		} else if (!strcasecmp(v->name, "Sec-WebSocket-Extensions")) {
+			if (!extensions) {
+				extensions = ast_strdupa(v->value);
+			}
 		} else if (!strcasecmp(v->name, "Sec-WebSocket-Version")) {
 			if (sscanf(v->value, "%30d", &version) != 1) {
 				version = 0;
@@ -805,6 +1213,7 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 	/* Determine how to respond depending on the version */
 	if (version == 7 || version == 8 || version == 13) {
 		char base64[64];
+		char extensions_header[128] = "";
 
 		if (!key || strlen(key) + strlen(WEBSOCKET_GUID) + 1 > 8192) { /* no stack overflows please */
 			websocket_bad_request(ser);
@@ -826,6 +1235,7 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 			return 0;
 		}
 		session->timeout =  AST_DEFAULT_WEBSOCKET_WRITE_TIMEOUT;
+		session->flush_id = -1;
 
 		/* Generate the session id */
 		if (!ast_uuid_generate_str(session->session_id, sizeof(session->session_id))) {
@@ -845,6 +1255,12 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 			return 0;
 		}
 
+#ifdef HAVE_ZLIB
+		if (server->deflate && extensions) {
+			websocket_deflate_negotiate(session, extensions, extensions_header, sizeof(extensions_header));
+		}
+#endif
+
 		/* RFC 6455, Section 4.1:
 		 *
 		 * 6. If the response includes a |Sec-WebSocket-Protocol| header
@@ -859,17 +1275,21 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 				"Upgrade: %s\r\n"
 				"Connection: Upgrade\r\n"
 				"Sec-WebSocket-Accept: %s\r\n"
+				"%s"
 				"Sec-WebSocket-Protocol: %s\r\n\r\n",
 				upgrade,
 				websocket_combine_key(key, base64, sizeof(base64)),
+				extensions_header,
 				protocol);
 		} else {
 			fprintf(ser->f, "HTTP/1.1 101 Switching Protocols\r\n"
 				"Upgrade: %s\r\n"
 				"Connection: Upgrade\r\n"
-				"Sec-WebSocket-Accept: %s\r\n\r\n",
+				"Sec-WebSocket-Accept: %s\r\n"
+				"%s\r\n",
 				upgrade,
-				websocket_combine_key(key, base64, sizeof(base64)));
+				websocket_combine_key(key, base64, sizeof(base64)),
+				extensions_header);
 		}
 
 		fflush(ser->f);
@@ -893,7 +1313,8 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 		return 0;
 	}
 
-	ast_verb(2, "WebSocket connection from '%s' for protocol '%s' accepted using version '%d'\n", ast_sockaddr_stringify(&ser->remote_address), protocol ? : "", version);
+	ast_verb(2, "WebSocket connection from '%s' for protocol '%s' accepted using version '%d'%s\n", ast_sockaddr_stringify(&ser->remote_address), protocol ? : "", version,
+		session->deflate ? " with permessage-deflate" : "");
 
 	/* Populate the session with all the needed details */
 	session->f = ser->f;
@@ -1172,6 +1593,7 @@ static struct ast_websocket * websocket_client_create(
 		*result = WS_ALLOCATE_ERROR;
 		return NULL;
 	}
+	ws->flush_id = -1;
 
 	if (!(ws->client = ao2_alloc(
 		      sizeof(*ws->client), websocket_client_destroy))) {
@@ -1435,8 +1857,20 @@ int AST_OPTIONAL_API_NAME(ast_websocket_write_string)
 
 static int load_module(void)
 {
+	sched = ast_sched_context_create();
+	if (!sched) {
+		return AST_MODULE_LOAD_FAILURE;
+	}
+	if (ast_sched_start_thread(sched)) {
+		ast_sched_context_destroy(sched);
+		sched = NULL;
+		return AST_MODULE_LOAD_FAILURE;
+	}
+
 	websocketuri.data = websocket_server_internal_create();
 	if (!websocketuri.data) {
+		ast_sched_context_destroy(sched);
+		sched = NULL;
 		return AST_MODULE_LOAD_FAILURE;
 	}
 	ast_http_uri_link(&websocketuri);
@@ -1451,6 +1885,8 @@ static int unload_module(void)
 	ast_http_uri_unlink(&websocketuri);
 	ao2_ref(websocketuri.data, -1);
 	websocketuri.data = NULL;
+	ast_sched_context_destroy(sched);
+	sched = NULL;
 
 	return 0;
 }
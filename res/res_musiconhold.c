@@ -48,6 +48,7 @@ ASTERISK_REGISTER_FILE()
 #include <netinet/in.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <glob.h>
 
 #ifdef SOLARIS
 #include <thread.h>
@@ -154,6 +155,7 @@ struct moh_files_state {
 #define MOH_CACHERTCLASSES	(1 << 5)	/*!< Should we use a separate instance of MOH for each user or not */
 #define MOH_ANNOUNCEMENT	(1 << 6)	/*!< Do we play announcement files between songs on this channel? */
 #define MOH_PREFERCHANNELCLASS	(1 << 7)	/*!< Should queue moh override channel moh */
+#define MOH_BROADCAST		(1 << 8)	/*!< One thread reads the files for all the channels hearing the class */
 
 /* Custom astobj2 flag */
 #define MOH_NOTDELETED          (1 << 30)       /*!< Find only records that aren't deleted? */
@@ -187,6 +189,12 @@ struct mohclass {
 	/*! Created on the fly, from RT engine */
 	unsigned int realtime:1;
 	unsigned int delete:1;
+	/*! Tells the broadcast thread to stop */
+	unsigned int bcast_stop:1;
+	/*! The thread reading the files of a broadcast class */
+	pthread_t bcast_thread;
+	/*! The formats a broadcast class is heard in */
+	AST_LIST_HEAD_NOLOCK(, moh_bcast_output) outputs;
 	AST_LIST_HEAD_NOLOCK(, mohdata) members;
 	AST_LIST_ENTRY(mohclass) list;
 };
@@ -251,7 +259,7 @@ static void moh_post_start(struct ast_channel *chan, const char *moh_class_name)
 		/* A channel snapshot must have been in the cache. */
 		ast_assert(((struct ast_channel_blob *) stasis_message_data(message))->snapshot != NULL);
 
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	ao2_cleanup(message);
 	ast_json_unref(json_object);
@@ -269,7 +277,7 @@ static void moh_post_stop(struct ast_channel *chan)
 		/* A channel snapshot must have been in the cache. */
 		ast_assert(((struct ast_channel_blob *) stasis_message_data(message))->snapshot != NULL);
 
-		stasis_publish(ast_channel_topic(chan), message);
+		ast_channel_publish_message(chan, message);
 	}
 	ao2_cleanup(message);
 }
@@ -1031,6 +1039,469 @@ static struct ast_generator mohgen = {
 	.digit    = moh_handle_digit,
 };
 
+/*!
+ * \brief Frames kept for each format of a broadcast class
+ *
+ * A channel writes the frames made since it last generated, so this is how
+ * far behind the class a channel may fall before it skips ahead.
+ */
+#define MOH_BCAST_FRAMES 16
+
+/*! \brief A frame of a broadcast class, shared by the channels hearing it */
+struct moh_bcast_frame {
+	struct ast_frame f;
+	char data[0];
+};
+
+/*! \brief A format channels hear a broadcast class in, and its latest frames */
+struct moh_bcast_output {
+	struct ast_format *format;
+	/*! Translates the file being read into format, unless it is in it */
+	struct ast_trans_pvt *trans;
+	/*! The format trans translates from */
+	struct ast_format *trans_src;
+	/*! The number of channels hearing this */
+	int listeners;
+	/*! The number of frames made */
+	unsigned int seq;
+	struct moh_bcast_frame *frames[MOH_BCAST_FRAMES];
+	AST_LIST_ENTRY(moh_bcast_output) list;
+};
+
+/*! \brief A channel hearing a broadcast class */
+struct moh_bcast_listener {
+	struct mohclass *class;
+	struct moh_bcast_output *output;
+	struct ast_format *origwfmt;
+	/*! The next frame of output to write */
+	unsigned int seq;
+};
+
+static void moh_bcast_frame_destructor(void *obj)
+{
+	struct moh_bcast_frame *frame = obj;
+
+	ao2_cleanup(frame->f.subclass.format);
+}
+
+static void moh_bcast_output_free(struct moh_bcast_output *output)
+{
+	int i;
+
+	for (i = 0; i < MOH_BCAST_FRAMES; i++) {
+		ao2_cleanup(output->frames[i]);
+	}
+	if (output->trans) {
+		ast_translator_free_path(output->trans);
+	}
+	ao2_cleanup(output->trans_src);
+	ao2_cleanup(output->format);
+	ast_free(output);
+}
+
+/*! \note Must be called with the class locked */
+static void moh_bcast_output_add(struct moh_bcast_output *output, struct ast_frame *f)
+{
+	struct moh_bcast_frame *frame;
+	int slot = output->seq % MOH_BCAST_FRAMES;
+
+	frame = ao2_alloc_options(sizeof(*frame) + AST_FRIENDLY_OFFSET + f->datalen,
+		moh_bcast_frame_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!frame) {
+		return;
+	}
+	frame->f.frametype = AST_FRAME_VOICE;
+	frame->f.subclass.format = ao2_bump(f->subclass.format);
+	frame->f.src = "moh broadcast";
+	frame->f.samples = f->samples;
+	frame->f.datalen = f->datalen;
+	frame->f.offset = AST_FRIENDLY_OFFSET;
+	frame->f.data.ptr = frame->data + AST_FRIENDLY_OFFSET;
+	memcpy(frame->f.data.ptr, f->data.ptr, f->datalen);
+
+	ao2_cleanup(output->frames[slot]);
+	output->frames[slot] = frame;
+	output->seq++;
+}
+
+/*!
+ * \brief Make a frame read from a file into a frame for each format listened in
+ * \note Must be called with the class locked
+ */
+static void moh_bcast_distribute(struct mohclass *class, struct ast_frame *f)
+{
+	struct moh_bcast_output *output;
+
+	AST_LIST_TRAVERSE(&class->outputs, output, list) {
+		struct ast_frame *translated;
+		struct ast_frame *cur;
+
+		if (ast_format_cmp(output->format, f->subclass.format) != AST_FORMAT_CMP_NOT_EQUAL) {
+			moh_bcast_output_add(output, f);
+			continue;
+		}
+
+		if (!output->trans_src || ast_format_cmp(output->trans_src, f->subclass.format) == AST_FORMAT_CMP_NOT_EQUAL) {
+			if (output->trans) {
+				ast_translator_free_path(output->trans);
+			}
+			ao2_replace(output->trans_src, f->subclass.format);
+			if (!(output->trans = ast_translator_build_path(output->format, f->subclass.format))) {
+				ast_log(LOG_WARNING, "Unable to translate music on hold class '%s' from %s to %s\n",
+					class->name, ast_format_get_name(f->subclass.format), ast_format_get_name(output->format));
+			}
+		}
+		if (!output->trans) {
+			continue;
+		}
+
+		translated = ast_translate(output->trans, f, 0);
+		for (cur = translated; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			moh_bcast_output_add(output, cur);
+		}
+		if (translated) {
+			ast_frfree(translated);
+		}
+	}
+}
+
+/*!
+ * \brief Open a sound file, in whichever format it is in
+ *
+ * \param name The file without an extension, relative to the sounds
+ * directory unless it is an absolute path
+ */
+static struct ast_filestream *moh_bcast_open(const char *name)
+{
+	struct ast_filestream *fs = NULL;
+	glob_t globbuf;
+	char *pattern;
+	int i;
+
+	if (name[0] == '/') {
+		if (ast_asprintf(&pattern, "%s.*", name) < 0) {
+			return NULL;
+		}
+	} else if (ast_asprintf(&pattern, "%s/sounds/%s.*", ast_config_AST_DATA_DIR, name) < 0) {
+		return NULL;
+	}
+
+	if (!glob(pattern, 0, NULL, &globbuf)) {
+		for (i = 0; !fs && i < globbuf.gl_pathc; i++) {
+			const char *ext = strrchr(globbuf.gl_pathv[i], '.') + 1;
+
+			if (ast_get_format_for_file_ext(ext)) {
+				fs = ast_readfile(name, ext, NULL, O_RDONLY, 0, 0);
+			}
+		}
+		globfree(&globbuf);
+	}
+	ast_free(pattern);
+
+	return fs;
+}
+
+/*! \brief Open the next file a broadcast class plays */
+static struct ast_filestream *moh_bcast_next(struct mohclass *class, int *pos, int *announcement)
+{
+	struct ast_filestream *fs = NULL;
+	int tries;
+
+	if (ast_test_flag(class, MOH_ANNOUNCEMENT) && !*announcement) {
+		*announcement = 1;
+		if ((fs = moh_bcast_open(class->announcement))) {
+			ast_debug(1, "Broadcasting announcement '%s' to class '%s'\n", class->announcement, class->name);
+			return fs;
+		}
+	}
+	*announcement = 0;
+
+	for (tries = 0; !fs && tries < 20; tries++) {
+		char *name = NULL;
+
+		ao2_lock(class);
+		if (class->total_files) {
+			if ((*pos < 0 && ast_test_flag(class, MOH_RANDOMIZE))
+				|| ast_test_flag(class, MOH_SORTMODE) == MOH_RANDOMIZE) {
+				*pos = ast_random() % class->total_files;
+			} else {
+				*pos = (*pos + 1) % class->total_files;
+			}
+			name = ast_strdup(class->filearray[*pos]);
+		}
+		ao2_unlock(class);
+
+		if (!name) {
+			break;
+		}
+		if ((fs = moh_bcast_open(name))) {
+			ast_debug(1, "Broadcasting file %d '%s' to class '%s'\n", *pos, name, class->name);
+		} else {
+			ast_log(LOG_WARNING, "Unable to open file '%s' for music on hold class '%s'\n", name, class->name);
+		}
+		ast_free(name);
+	}
+
+	return fs;
+}
+
+/*!
+ * \brief Read the files of a broadcast class, for all the channels hearing it
+ *
+ * Every 20 ms, while any channel is hearing the class, this reads the next
+ * 20 ms of the files and makes it into a frame for each format listened in.
+ */
+static void *moh_bcast_thread(void *data)
+{
+	struct mohclass *class = data;
+	struct ast_filestream *fs = NULL;
+	int pos = -1;
+	int announcement = 0;
+	/* Microseconds of audio due to be read */
+	int64_t due = 0;
+
+	while (!class->bcast_stop) {
+		struct pollfd pfd = { .fd = ast_timer_fd(class->timer), .events = POLLIN | POLLPRI, };
+		int listening;
+		int empty = 0;
+
+		if (ast_poll(&pfd, 1, 100) <= 0) {
+			continue;
+		}
+		if (ast_timer_ack(class->timer, 1) < 0) {
+			ast_log(LOG_ERROR, "Failed to acknowledge timer for music on hold class '%s'\n", class->name);
+			break;
+		}
+
+		ao2_lock(class);
+		listening = !AST_LIST_EMPTY(&class->outputs);
+		ao2_unlock(class);
+		if (!listening) {
+			/* Pause until someone listens */
+			due = 0;
+			continue;
+		}
+
+		due += 20000;
+		while (due > 0 && !class->bcast_stop) {
+			struct ast_frame *f;
+
+			if (!fs && !(fs = moh_bcast_next(class, &pos, &announcement))) {
+				due = 0;
+				break;
+			}
+			if (!(f = ast_readframe(fs))) {
+				ast_closestream(fs);
+				fs = NULL;
+				/* Don't spin on files with nothing in them */
+				if (++empty > 20) {
+					due = 0;
+				}
+				continue;
+			}
+			empty = 0;
+
+			due -= (int64_t) f->samples * 1000000 / ast_format_get_sample_rate(f->subclass.format);
+			ao2_lock(class);
+			moh_bcast_distribute(class, f);
+			ao2_unlock(class);
+			ast_frfree(f);
+		}
+	}
+
+	if (fs) {
+		ast_closestream(fs);
+	}
+
+	return NULL;
+}
+
+static int init_bcast_class(struct mohclass *class)
+{
+	if (!(class->timer = ast_timer_open())) {
+		ast_log(LOG_WARNING, "Unable to create timer: %s\n", strerror(errno));
+		return -1;
+	}
+	if (ast_timer_set_rate(class->timer, 50)) {
+		ast_log(LOG_WARNING, "Unable to set 20ms frame rate: %s\n", strerror(errno));
+		ast_timer_close(class->timer);
+		class->timer = NULL;
+		return -1;
+	}
+	if (ast_pthread_create(&class->bcast_thread, NULL, moh_bcast_thread, class)) {
+		ast_log(LOG_WARNING, "Unable to create broadcast thread for music on hold class '%s'\n", class->name);
+		class->bcast_thread = AST_PTHREADT_NULL;
+		ast_timer_close(class->timer);
+		class->timer = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void moh_bcast_release(struct ast_channel *chan, void *data)
+{
+	struct moh_bcast_listener *listener = data;
+	struct mohclass *class = listener->class;
+	struct ast_format *oldwfmt = listener->origwfmt;
+
+	ao2_lock(class);
+	if (!--listener->output->listeners) {
+		AST_LIST_REMOVE(&class->outputs, listener->output, list);
+		moh_bcast_output_free(listener->output);
+	}
+	ao2_unlock(class);
+
+	listener->class = mohclass_unref(class, "unreffing listener->class upon deactivation of generator");
+	ast_free(listener);
+
+	if (chan) {
+		struct moh_files_state *state;
+
+		state = ast_channel_music_state(chan);
+		if (state && state->class) {
+			state->class = mohclass_unref(state->class, "Unreffing channel's music class upon deactivation of generator");
+		}
+		if (oldwfmt && ast_set_write_format(chan, oldwfmt)) {
+			ast_log(LOG_WARNING, "Unable to restore channel '%s' to format %s\n",
+					ast_channel_name(chan), ast_format_get_name(oldwfmt));
+		}
+
+		moh_post_stop(chan);
+	}
+
+	ao2_cleanup(oldwfmt);
+}
+
+static void *moh_bcast_alloc(struct ast_channel *chan, void *params)
+{
+	struct mohclass *class = params;
+	struct moh_bcast_listener *listener;
+	struct moh_bcast_output *output;
+	struct moh_files_state *state;
+	struct ast_format *format;
+
+	/* Initiating music_state for current channel. Channel should know name of moh class */
+	state = ast_channel_music_state(chan);
+	if (!state && (state = ast_calloc(1, sizeof(*state)))) {
+		ast_channel_music_state_set(chan, state);
+		ast_module_ref(ast_module_info->self);
+	} else {
+		if (!state) {
+			return NULL;
+		}
+		if (state->class) {
+			mohclass_unref(state->class, "Uh Oh. Restarting MOH with an active class");
+			ast_log(LOG_WARNING, "Uh Oh. Restarting MOH with an active class\n");
+		}
+		ao2_cleanup(state->origwfmt);
+		ao2_cleanup(state->mohwfmt);
+		memset(state, 0, sizeof(*state));
+	}
+
+	/* Hear the class in the channel's own format, so nothing is translated for it alone */
+	ast_channel_lock(chan);
+	format = ast_format_cap_get_best_by_type(ast_channel_nativeformats(chan), AST_MEDIA_TYPE_AUDIO);
+	ast_channel_unlock(chan);
+	if (!format) {
+		return NULL;
+	}
+	if (!(listener = ast_calloc(1, sizeof(*listener)))) {
+		ao2_ref(format, -1);
+		return NULL;
+	}
+	listener->origwfmt = ao2_bump(ast_channel_writeformat(chan));
+	if (ast_set_write_format(chan, format)) {
+		ast_log(LOG_WARNING, "Unable to set channel '%s' to format '%s'\n", ast_channel_name(chan),
+			ast_format_get_name(format));
+		ao2_cleanup(listener->origwfmt);
+		ast_free(listener);
+		ao2_ref(format, -1);
+		return NULL;
+	}
+
+	ao2_lock(class);
+	AST_LIST_TRAVERSE(&class->outputs, output, list) {
+		if (ast_format_cmp(output->format, format) != AST_FORMAT_CMP_NOT_EQUAL) {
+			break;
+		}
+	}
+	if (!output && (output = ast_calloc(1, sizeof(*output)))) {
+		output->format = ao2_bump(format);
+		AST_LIST_INSERT_HEAD(&class->outputs, output, list);
+	}
+	if (output) {
+		output->listeners++;
+		listener->output = output;
+		/* Join where the class is */
+		listener->seq = output->seq;
+	}
+	ao2_unlock(class);
+	ao2_ref(format, -1);
+
+	if (!output) {
+		if (ast_set_write_format(chan, listener->origwfmt)) {
+			ast_log(LOG_WARNING, "Unable to restore channel '%s' to format %s\n",
+					ast_channel_name(chan), ast_format_get_name(listener->origwfmt));
+		}
+		ao2_cleanup(listener->origwfmt);
+		ast_free(listener);
+		return NULL;
+	}
+
+	listener->class = mohclass_ref(class, "Reffing music class for broadcast listener");
+	state->class = mohclass_ref(class, "Placing reference into state container");
+	moh_post_start(chan, class->name);
+
+	return listener;
+}
+
+static int moh_bcast_generate(struct ast_channel *chan, void *data, int len, int samples)
+{
+	struct moh_bcast_listener *listener = data;
+	struct moh_bcast_output *output = listener->output;
+	struct moh_bcast_frame *frames[MOH_BCAST_FRAMES];
+	int count = 0;
+	int res = 0;
+	int i;
+
+	ao2_lock(listener->class);
+	if (output->seq - listener->seq > MOH_BCAST_FRAMES) {
+		/* Fallen behind, so skip what is no longer kept */
+		listener->seq = output->seq - MOH_BCAST_FRAMES;
+	}
+	for (; listener->seq != output->seq; listener->seq++) {
+		if ((frames[count] = ao2_bump(output->frames[listener->seq % MOH_BCAST_FRAMES]))) {
+			count++;
+		}
+	}
+	ao2_unlock(listener->class);
+
+	for (i = 0; i < count; i++) {
+		/* The frame is shared, and audiohooks may change the data of the frame written */
+		struct ast_frame copy = frames[i]->f;
+		struct ast_frame *f = ast_channel_audiohooks(chan) ? ast_frdup(&copy) : &copy;
+
+		if (!res && f && ast_write(chan, f) < 0) {
+			ast_log(LOG_WARNING, "Failed to write frame to '%s': %s\n", ast_channel_name(chan), strerror(errno));
+			res = -1;
+		}
+		if (f && f != &copy) {
+			ast_frfree(f);
+		}
+		ao2_ref(frames[i], -1);
+	}
+
+	return res;
+}
+
+static struct ast_generator moh_bcast_stream = {
+	.alloc    = moh_bcast_alloc,
+	.release  = moh_bcast_release,
+	.generate = moh_bcast_generate,
+	.digit    = moh_handle_digit,
+};
+
 static void moh_parse_options(struct ast_variable *var, struct mohclass *mohclass)
 {
 	for (; var; var = var->next) {
@@ -1059,6 +1530,8 @@ static void moh_parse_options(struct ast_variable *var, struct mohclass *mohclas
 			} else if (!strcasecmp(var->value, "randstart")) {
 				ast_set_flag(mohclass, MOH_RANDSTART);
 			}
+		} else if (!strcasecmp(var->name, "broadcast")) {
+			ast_set2_flag(mohclass, ast_true(var->value), MOH_BROADCAST);
 		} else if (!strcasecmp(var->name, "format")) {
 			mohclass->format = ast_format_cache_get(var->value);
 			if (!mohclass->format) {
@@ -1209,6 +1682,10 @@ static int init_files_class(struct mohclass *class)
 		return -1;
 	}
 
+	if (ast_test_flag(class, MOH_BROADCAST)) {
+		return init_bcast_class(class);
+	}
+
 	return 0;
 }
 
@@ -1374,6 +1851,7 @@ static struct mohclass *_moh_class_malloc(const char *file, int line, const char
 	if (class) {
 		class->format = ao2_bump(ast_format_slin);
 		class->srcfd = -1;
+		class->bcast_thread = AST_PTHREADT_NULL;
 	}
 
 	return class;
@@ -1555,7 +2033,9 @@ static int local_ast_moh_start(struct ast_channel *chan, const char *mclass, con
 	}
 
 	if (!state || !state->class || strcmp(mohclass->name, state->class->name)) {
-		if (mohclass->total_files) {
+		if (mohclass->bcast_thread != AST_PTHREADT_NULL) {
+			res = ast_activate_generator(chan, &moh_bcast_stream, mohclass);
+		} else if (mohclass->total_files) {
 			res = ast_activate_generator(chan, &moh_file_stream, mohclass);
 		} else {
 			res = ast_activate_generator(chan, &mohgen, mohclass);
@@ -1600,6 +2080,12 @@ static void moh_class_destructor(void *obj)
 	}
 	ao2_unlock(class);
 
+	if (class->bcast_thread != AST_PTHREADT_NULL) {
+		class->bcast_stop = 1;
+		pthread_join(class->bcast_thread, NULL);
+		class->bcast_thread = AST_PTHREADT_NULL;
+	}
+
 	/* Kill the thread first, so it cannot restart the child process while the
 	 * class is being destroyed */
 	if (class->thread != AST_PTHREADT_NULL && class->thread != 0) {
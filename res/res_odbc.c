@@ -63,6 +63,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/strings.h"
 #include "asterisk/threadstorage.h"
 #include "asterisk/data.h"
+#include "asterisk/taskprocessor.h"
 
 /*** DOCUMENTATION
 	<function name="ODBC" language="en_US">
@@ -142,12 +143,47 @@ struct odbc_class
 	int count;                           /*!< Running count of pooled connections */
 	unsigned int idlecheck;              /*!< Recheck the connection if it is idle for this long (in seconds) */
 	unsigned int conntimeout;            /*!< Maximum time the connection process should take */
+	unsigned int statement_cache;        /*!< Maximum number of prepared statements kept on each connection */
 	/*! When a connection fails, cache that failure for how long? */
 	struct timeval negative_connection_cache;
 	/*! When a connection fails, when did that last occur? */
 	struct timeval last_negative_connect;
 	/*! List of handles associated with this class */
 	struct ao2_container *obj_container;
+	/*! Histogram of the time taken to hand out a connection */
+	int wait[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	/*! Histogram of the time taken to prepare and execute a statement */
+	int execute[AST_TASKPROCESSOR_HISTOGRAM_BUCKETS];
+	int stmt_hits;                       /*!< Statements found already prepared on the connection */
+	int stmt_misses;                     /*!< Statements prepared by ast_odbc_prepare_cached() */
+	int affinity_hits;                   /*!< Pooled connections handed to the thread that released them last */
+};
+
+/*! \brief Default for the statement_cache setting */
+#define DEFAULT_STATEMENT_CACHE 32
+
+/*! \brief A statement prepared by ast_odbc_prepare_cached() */
+struct odbc_cached_stmt {
+	AST_LIST_ENTRY(odbc_cached_stmt) list;
+	SQLHSTMT stmt;
+	unsigned int in_use:1;               /*!< Handed out, and not yet given back by ast_odbc_release_stmt() */
+	char sql[0];
+};
+
+/*! \brief How many classes each thread remembers its last pooled connection for */
+#define AFFINITY_CLASSES 4
+
+/*!
+ * \brief The pooled connections a thread released last, most recent first
+ *
+ * No references are held. The connection is only looked for, by address,
+ * among those its class still has.
+ */
+struct odbc_affinity {
+	struct {
+		const struct odbc_class *class;
+		struct odbc_obj *obj;
+	} last[AFFINITY_CLASSES];
 };
 
 static struct ao2_container *class_container;
@@ -161,6 +197,7 @@ static void odbc_txn_free(void *data);
 static void odbc_release_obj2(struct odbc_obj *obj, struct odbc_txn_frame *tx);
 
 AST_THREADSTORAGE(errors_buf);
+AST_THREADSTORAGE(affinity_buf);
 
 static const struct ast_datastore_info txn_info = {
 	.type = "ODBC_Transaction",
@@ -593,8 +630,150 @@ int ast_odbc_clear_cache(const char *database, const char *tablename)
 	return tableptr ? 0 : -1;
 }
 
+/*! \brief Count a time in a histogram */
+static void odbc_histogram_add(int *histogram, struct timeval start)
+{
+	ast_atomic_fetchadd_int(&histogram[ast_taskprocessor_histogram_bucket(ast_tvdiff_us(ast_tvnow(), start))], +1);
+}
+
+/*!
+ * \internal
+ * \brief Free the least recently used statements over the statement_cache limit
+ * \note obj must be locked
+ */
+static void odbc_stmt_cache_trim(struct odbc_obj *obj)
+{
+	struct odbc_cached_stmt *cached;
+	struct odbc_cached_stmt *oldest;
+
+	while (obj->num_stmts > obj->parent->statement_cache) {
+		oldest = NULL;
+		AST_LIST_TRAVERSE(&obj->stmts, cached, list) {
+			if (!cached->in_use) {
+				oldest = cached;
+			}
+		}
+		if (!oldest) {
+			/* The rest are trimmed as they are released */
+			break;
+		}
+		AST_LIST_REMOVE(&obj->stmts, oldest, list);
+		obj->num_stmts--;
+		SQLFreeHandle(SQL_HANDLE_STMT, oldest->stmt);
+		ast_free(oldest);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Free a statement that failed, rather than keep it for reuse
+ */
+static void odbc_discard_stmt(struct odbc_obj *obj, SQLHSTMT stmt)
+{
+	struct odbc_cached_stmt *cached;
+
+	ao2_lock(obj);
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&obj->stmts, cached, list) {
+		if (cached->stmt == stmt) {
+			AST_LIST_REMOVE_CURRENT(list);
+			obj->num_stmts--;
+			ast_free(cached);
+			break;
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+	SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+	ao2_unlock(obj);
+}
+
+SQLHSTMT ast_odbc_prepare_cached(struct odbc_obj *obj, const char *sql)
+{
+	struct odbc_cached_stmt *cached;
+	SQLHSTMT stmt;
+	int res;
+
+	ao2_lock(obj);
+
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&obj->stmts, cached, list) {
+		if (!cached->in_use && !strcmp(cached->sql, sql)) {
+			AST_LIST_REMOVE_CURRENT(list);
+			break;
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+
+	if (cached) {
+		cached->in_use = 1;
+		AST_LIST_INSERT_HEAD(&obj->stmts, cached, list);
+		ao2_unlock(obj);
+		ast_atomic_fetchadd_int(&obj->parent->stmt_hits, +1);
+		return cached->stmt;
+	}
+
+	res = SQLAllocHandle(SQL_HANDLE_STMT, obj->con, &stmt);
+	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
+		ast_log(LOG_WARNING, "SQL Alloc Handle failed!\n");
+		ao2_unlock(obj);
+		return NULL;
+	}
+
+	res = SQLPrepare(stmt, (unsigned char *)sql, SQL_NTS);
+	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
+		ast_log(LOG_WARNING, "SQL Prepare failed![%s]\n", sql);
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+		ao2_unlock(obj);
+		return NULL;
+	}
+	ast_atomic_fetchadd_int(&obj->parent->stmt_misses, +1);
+
+	/* If the same SQL is in use, as it can be on a shared connection, this is kept too */
+	if (obj->parent->statement_cache && (cached = ast_calloc(1, sizeof(*cached) + strlen(sql) + 1))) {
+		cached->stmt = stmt;
+		cached->in_use = 1;
+		strcpy(cached->sql, sql); /* SAFE */
+		AST_LIST_INSERT_HEAD(&obj->stmts, cached, list);
+		obj->num_stmts++;
+		odbc_stmt_cache_trim(obj);
+	}
+
+	ao2_unlock(obj);
+
+	return stmt;
+}
+
+void ast_odbc_release_stmt(struct odbc_obj *obj, SQLHSTMT stmt)
+{
+	struct odbc_cached_stmt *cached;
+
+	ao2_lock(obj);
+
+	AST_LIST_TRAVERSE(&obj->stmts, cached, list) {
+		if (cached->stmt == stmt) {
+			break;
+		}
+	}
+
+	if (!cached) {
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+	} else if (SQLFreeStmt(stmt, SQL_CLOSE) == SQL_ERROR
+		|| SQLFreeStmt(stmt, SQL_RESET_PARAMS) == SQL_ERROR
+		|| SQLFreeStmt(stmt, SQL_UNBIND) == SQL_ERROR) {
+		/* Not fit to be used again */
+		AST_LIST_REMOVE(&obj->stmts, cached, list);
+		obj->num_stmts--;
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+		ast_free(cached);
+	} else {
+		cached->in_use = 0;
+		odbc_stmt_cache_trim(obj);
+	}
+
+	ao2_unlock(obj);
+}
+
 SQLHSTMT ast_odbc_direct_execute(struct odbc_obj *obj, SQLHSTMT (*exec_cb)(struct odbc_obj *obj, void *data), void *data)
 {
+	struct timeval start = ast_tvnow();
 	int attempt;
 	SQLHSTMT stmt;
 
@@ -618,6 +797,8 @@ SQLHSTMT ast_odbc_direct_execute(struct odbc_obj *obj, SQLHSTMT (*exec_cb)(struc
 
 	ao2_unlock(obj);
 
+	odbc_histogram_add(obj->parent->execute, start);
+
 	return stmt;
 }
 
@@ -628,6 +809,7 @@ SQLHSTMT ast_odbc_prepare_and_execute(struct odbc_obj *obj, SQLHSTMT (*prepare_c
 	SQLSMALLINT diagbytes=0;
 	unsigned char state[10], diagnostic[256];
 	SQLHSTMT stmt;
+	struct timeval start = ast_tvnow();
 
 	ao2_lock(obj);
 
@@ -659,7 +841,7 @@ SQLHSTMT ast_odbc_prepare_and_execute(struct odbc_obj *obj, SQLHSTMT (*prepare_c
 					break;
 				} else {
 					ast_log(LOG_WARNING, "SQL Execute error %d! Verifying connection to %s [%s]...\n", res, obj->parent->name, obj->parent->dsn);
-					SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+					odbc_discard_stmt(obj, stmt);
 					stmt = NULL;
 
 					obj->up = 0;
@@ -683,6 +865,8 @@ SQLHSTMT ast_odbc_prepare_and_execute(struct odbc_obj *obj, SQLHSTMT (*prepare_c
 
 	ao2_unlock(obj);
 
+	odbc_histogram_add(obj->parent->execute, start);
+
 	return stmt;
 }
 
@@ -776,7 +960,7 @@ static int load_odbc_config(void)
 	struct ast_variable *v;
 	char *cat;
 	const char *dsn, *username, *password, *sanitysql;
-	int enabled, pooling, limit, bse, conntimeout, forcecommit, isolation;
+	int enabled, pooling, limit, bse, conntimeout, forcecommit, isolation, statement_cache;
 	struct timeval ncache = { 0, 0 };
 	unsigned int idlecheck;
 	int preconnect = 0, res = 0;
@@ -806,6 +990,7 @@ static int load_odbc_config(void)
 			conntimeout = 10;
 			forcecommit = 0;
 			isolation = SQL_TXN_READ_COMMITTED;
+			statement_cache = DEFAULT_STATEMENT_CACHE;
 			for (v = ast_variable_browse(config, cat); v; v = v->next) {
 				if (!strcasecmp(v->name, "pooling")) {
 					if (ast_true(v->value))
@@ -863,6 +1048,11 @@ static int load_odbc_config(void)
 						ast_log(LOG_ERROR, "Unrecognized value for 'isolation': '%s' in section '%s'\n", v->value, cat);
 						isolation = SQL_TXN_READ_COMMITTED;
 					}
+				} else if (!strcasecmp(v->name, "statement_cache")) {
+					if (sscanf(v->value, "%30d", &statement_cache) != 1 || statement_cache < 0) {
+						ast_log(LOG_WARNING, "statement_cache must be a non-negative integer\n");
+						statement_cache = DEFAULT_STATEMENT_CACHE;
+					}
 				}
 			}
 
@@ -900,6 +1090,7 @@ static int load_odbc_config(void)
 				new->isolation = isolation;
 				new->idlecheck = idlecheck;
 				new->conntimeout = conntimeout;
+				new->statement_cache = statement_cache;
 				new->negative_connection_cache = ncache;
 
 				if (cat)
@@ -937,6 +1128,7 @@ static char *handle_cli_odbc_show(struct ast_cli_entry *e, int cmd, struct ast_c
 	struct odbc_obj *current;
 	int length = 0;
 	int which = 0;
+	int i;
 	char *ret = NULL;
 
 	switch (cmd) {
@@ -945,7 +1137,10 @@ static char *handle_cli_odbc_show(struct ast_cli_entry *e, int cmd, struct ast_c
 		e->usage =
 				"Usage: odbc show [class]\n"
 				"       List settings of a particular ODBC class or,\n"
-				"       if not specified, all classes.\n";
+				"       if not specified, all classes.  The latency\n"
+				"       histograms count how many connections took less\n"
+				"       than each column's time to hand out (wait), and\n"
+				"       how many statements to prepare and execute.\n";
 		return NULL;
 	case CLI_GENERATE:
 		if (a->pos != 2)
@@ -1013,7 +1208,24 @@ static char *handle_cli_odbc_show(struct ast_cli_entry *e, int cmd, struct ast_c
 				}
 				ao2_iterator_destroy(&aoi2);
 			}
-			ast_cli(a->fd, "\n");
+			ast_cli(a->fd, "  Statement cache: %u per connection, %d hits, %d prepared\n",
+				class->statement_cache, class->stmt_hits, class->stmt_misses);
+			if (class->haspool) {
+				ast_cli(a->fd, "  Connections reused by the same thread: %d\n", class->affinity_hits);
+			}
+			ast_cli(a->fd, "  Latency:\n%10s", "");
+			for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+				ast_cli(a->fd, " %9s", ast_taskprocessor_histogram_bucket_name(i));
+			}
+			ast_cli(a->fd, "\n%10s", "wait");
+			for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+				ast_cli(a->fd, " %9d", class->wait[i]);
+			}
+			ast_cli(a->fd, "\n%10s", "execute");
+			for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+				ast_cli(a->fd, " %9d", class->execute[i]);
+			}
+			ast_cli(a->fd, "\n\n");
 		}
 		ao2_ref(class, -1);
 	}
@@ -1048,6 +1260,44 @@ static int odbc_register_class(struct odbc_class *class, int preconnect)
 	}
 }
 
+/*! \brief Remember the pooled connection a thread is releasing, to hand it the same one next time */
+static void odbc_affinity_set(struct odbc_obj *obj)
+{
+	struct odbc_affinity *affinity = ast_threadstorage_get(&affinity_buf, sizeof(*affinity));
+	int i;
+
+	if (!affinity) {
+		return;
+	}
+
+	for (i = 0; i < AFFINITY_CLASSES - 1; ++i) {
+		if (affinity->last[i].class == obj->parent) {
+			break;
+		}
+	}
+	memmove(&affinity->last[1], &affinity->last[0], i * sizeof(affinity->last[0]));
+	affinity->last[0].class = obj->parent;
+	affinity->last[0].obj = obj;
+}
+
+/*! \brief The pooled connection of a class the thread released last */
+static struct odbc_obj *odbc_affinity_get(const struct odbc_class *class)
+{
+	struct odbc_affinity *affinity = ast_threadstorage_get(&affinity_buf, sizeof(*affinity));
+	int i;
+
+	if (!affinity) {
+		return NULL;
+	}
+
+	for (i = 0; i < AFFINITY_CLASSES; ++i) {
+		if (affinity->last[i].class == class) {
+			return affinity->last[i].obj;
+		}
+	}
+	return NULL;
+}
+
 static void odbc_release_obj2(struct odbc_obj *obj, struct odbc_txn_frame *tx)
 {
 	SQLINTEGER nativeerror=0, numfields=0;
@@ -1096,6 +1346,10 @@ static void odbc_release_obj2(struct odbc_obj *obj, struct odbc_txn_frame *tx)
 	obj->lineno = 0;
 #endif
 
+	if (obj->parent && obj->parent->haspool) {
+		odbc_affinity_set(obj);
+	}
+
 	/* For pooled connections, this frees the connection to be
 	 * reused.  For non-pooled connections, it does nothing. */
 	obj->used = 0;
@@ -1219,6 +1473,24 @@ static int aoro2_obj_cb(void *vobj, void *arg, int flags)
 	return 0;
 }
 
+/*! \brief Claim a particular pooled connection, if it is not in use */
+static int aoro2_obj_affinity_cb(void *vobj, void *arg, int flags)
+{
+	struct odbc_obj *obj = vobj;
+	int res = CMP_STOP;
+
+	if (obj != arg) {
+		return 0;
+	}
+	ao2_lock(obj);
+	if (!obj->used) {
+		obj->used = 1;
+		res = CMP_MATCH | CMP_STOP;
+	}
+	ao2_unlock(obj);
+	return res;
+}
+
 /* This function should only be called for shared connections. Otherwise, the lack of
  * setting vobj->used breaks EOR_TX searching. For nonshared connections, use
  * aoro2_obj_cb instead. */
@@ -1234,10 +1506,12 @@ static int aoro2_obj_notx_cb(void *vobj, void *arg, int flags)
 struct odbc_obj *_ast_odbc_request_obj2(const char *name, struct ast_flags flags, const char *file, const char *function, int lineno)
 {
 	struct odbc_obj *obj = NULL;
+	struct odbc_obj *last;
 	struct odbc_class *class;
 	SQLINTEGER nativeerror=0, numfields=0;
 	SQLSMALLINT diagbytes=0, i;
 	unsigned char state[10], diagnostic[256];
+	struct timeval start = ast_tvnow();
 
 	if (!(class = ao2_callback(class_container, 0, aoro2_class_cb, (char *) name))) {
 		ast_debug(1, "Class '%s' not found!\n", name);
@@ -1247,8 +1521,14 @@ struct odbc_obj *_ast_odbc_request_obj2(const char *name, struct ast_flags flags
 	ast_assert(ao2_ref(class, 0) > 1);
 
 	if (class->haspool) {
-		/* Recycle connections before building another */
-		obj = ao2_callback(class->obj_container, 0, aoro2_obj_cb, EOR_TX);
+		/* Recycle connections before building another, preferring the one
+		 * this thread used last, whose statements are likely prepared. */
+		if ((last = odbc_affinity_get(class))
+			&& (obj = ao2_callback(class->obj_container, 0, aoro2_obj_affinity_cb, last))) {
+			ast_atomic_fetchadd_int(&class->affinity_hits, +1);
+		} else {
+			obj = ao2_callback(class->obj_container, 0, aoro2_obj_cb, EOR_TX);
+		}
 
 		if (obj) {
 			ast_assert(ao2_ref(obj, 0) > 1);
@@ -1429,6 +1709,8 @@ struct odbc_obj *_ast_odbc_request_obj2(const char *name, struct ast_flags flags
 
 	ast_assert(class == NULL);
 
+	odbc_histogram_add(obj->parent->wait, start);
+
 	ast_assert(ao2_ref(obj, 0) > 1);
 	return obj;
 }
@@ -1478,6 +1760,16 @@ static odbc_status odbc_obj_disconnect(struct odbc_obj *obj)
 	short int mlen;
 	unsigned char msg[200], state[10];
 	SQLHDBC con;
+	struct odbc_cached_stmt *cached;
+
+	/* Statements in use are freed by whoever releases them, as any other statement */
+	while ((cached = AST_LIST_REMOVE_HEAD(&obj->stmts, list))) {
+		if (!cached->in_use) {
+			SQLFreeHandle(SQL_HANDLE_STMT, cached->stmt);
+		}
+		ast_free(cached);
+	}
+	obj->num_stmts = 0;
 
 	/* Nothing to disconnect */
 	if (!obj->con) {
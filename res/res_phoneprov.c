@@ -47,6 +47,7 @@
 #include "asterisk.h"
 
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <net/if.h>
 #ifdef SOLARIS
@@ -331,6 +332,10 @@ struct http_route {
 	struct user *user;	/*!< The user that has variables to substitute into the file
 						 * NULL in the case of a static route */
 	struct phone_profile *profile;
+	char *rendered;		/*!< The file with the user's variables substituted, NULL until requested */
+	time_t rendered_mtime;	/*!< Modification time of the file rendered */
+	off_t rendered_size;	/*!< Size of the file rendered */
+	char etag[24];		/*!< ETag of the rendered file */
 };
 struct ao2_container *http_routes;
 SIMPLE_HASH_FN(http_route_hash_fn, http_route, uri)
@@ -488,6 +493,7 @@ static void route_destructor(void *obj)
 {
 	struct http_route *route = obj;
 
+	ast_free(route->rendered);
 	ast_string_field_free_memory(route);
 }
 
@@ -891,25 +897,59 @@ static int phoneprov_callback(struct ast_tcptls_session_instance *ser, const str
 			goto out500;
 		}
 
-		len = lseek(fd, 0, SEEK_END);
-		lseek(fd, 0, SEEK_SET);
-		if (len < 0) {
-			ast_log(LOG_WARNING, "Could not load file: %s (%d)\n", path, len);
-			close(fd);
-			goto out500;
-		}
-
 		http_header = ast_str_create(80);
 		ast_str_set(&http_header, 0, "Content-type: %s\r\n",
 			route->file->mime_type);
 
-		ast_http_send(ser, method, 200, NULL, http_header, NULL, fd, 0);
+		/* Phones may keep the file, but must check it has not changed */
+		ast_str_append(&http_header, 0, "Cache-Control: no-cache\r\n");
+		ast_http_send_file(ser, method, headers, http_header, fd, 1);
 
 		close(fd);
 		route = unref_route(route);
 		return 0;
 	} else { /* Dynamic file */
 		struct ast_str *tmp;
+		struct stat st;
+		char etag[sizeof(route->etag)];
+
+		if (stat(path, &st)) {
+			ast_log(LOG_WARNING, "Could not load file: %s\n", path);
+			goto out500;
+		}
+
+		/* The file is rendered again only if it has changed */
+		ao2_lock(route);
+		if (route->rendered && route->rendered_mtime == st.st_mtime
+			&& route->rendered_size == st.st_size) {
+			ast_copy_string(etag, route->etag, sizeof(etag));
+			if (ast_http_etag_match(headers, etag)) {
+				ao2_unlock(route);
+				http_header = ast_str_create(80);
+				ast_str_set(&http_header, 0, "ETag: %s\r\n"
+					"Cache-Control: no-cache\r\n", etag);
+				ast_http_send(ser, method, 304, "Not Modified", http_header, NULL, 0, 1);
+				route = unref_route(route);
+				return 0;
+			}
+			if ((result = ast_str_create(strlen(route->rendered) + 1))) {
+				ast_str_set(&result, 0, "%s", route->rendered);
+			}
+			ao2_unlock(route);
+			if (!result) {
+				goto out500;
+			}
+
+			http_header = ast_str_create(80);
+			ast_str_set(&http_header, 0, "Content-type: %s\r\n"
+				"ETag: %s\r\n"
+				"Cache-Control: no-cache\r\n",
+				route->file->mime_type, etag);
+			ast_http_send(ser, method, 200, NULL, http_header, result, 0, 1);
+			route = unref_route(route);
+			return 0;
+		}
+		ao2_unlock(route);
 
 		len = load_file(path, &file);
 		if (len < 0) {
@@ -964,9 +1004,22 @@ static int phoneprov_callback(struct ast_tcptls_session_instance *ser, const str
 
 		ast_free(file);
 
+		snprintf(etag, sizeof(etag), "\"%x-%zx\"", (unsigned int) ast_str_hash(ast_str_buffer(tmp)),
+			ast_str_strlen(tmp));
+		ao2_lock(route);
+		ast_free(route->rendered);
+		if ((route->rendered = ast_strdup(ast_str_buffer(tmp)))) {
+			route->rendered_mtime = st.st_mtime;
+			route->rendered_size = st.st_size;
+			ast_copy_string(route->etag, etag, sizeof(route->etag));
+		}
+		ao2_unlock(route);
+
 		http_header = ast_str_create(80);
-		ast_str_set(&http_header, 0, "Content-type: %s\r\n",
-			route->file->mime_type);
+		ast_str_set(&http_header, 0, "Content-type: %s\r\n"
+			"ETag: %s\r\n"
+			"Cache-Control: no-cache\r\n",
+			route->file->mime_type, etag);
 
 		if (!(result = ast_str_create(512))) {
 			ast_log(LOG_ERROR, "Could not create result string!\n");
@@ -978,7 +1031,12 @@ static int phoneprov_callback(struct ast_tcptls_session_instance *ser, const str
 		}
 		ast_str_append(&result, 0, "%s", ast_str_buffer(tmp));
 
-		ast_http_send(ser, method, 200, NULL, http_header, result, 0, 0);
+		if (ast_http_etag_match(headers, etag)) {
+			ast_free(result);
+			ast_http_send(ser, method, 304, "Not Modified", http_header, NULL, 0, 1);
+		} else {
+			ast_http_send(ser, method, 200, NULL, http_header, result, 0, 1);
+		}
 		ast_free(tmp);
 
 		route = unref_route(route);
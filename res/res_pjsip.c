@@ -39,6 +39,7 @@
 #include "asterisk/sorcery.h"
 #include "asterisk/file.h"
 #include "asterisk/cli.h"
+#include "asterisk/metrics.h"
 #include "asterisk/res_pjsip_cli.h"
 #include "asterisk/test.h"
 #include "asterisk/res_pjsip_presence_xml.h"
@@ -666,6 +667,17 @@
 				<configOption name="sub_min_expiry" default="60">
 					<synopsis>The minimum allowed expiry time for subscriptions initiated by the endpoint.</synopsis>
 				</configOption>
+				<configOption name="notify_min_interval" default="0">
+					<synopsis>The minimum time in milliseconds between NOTIFYs sent on a subscription from the endpoint.</synopsis>
+					<description><para>
+						As RFC 6665 allows, a change of state within this time of the last NOTIFY
+						sent on a subscription is held back until the time has passed. Further
+						changes in the meantime are combined with it, so a resource whose state
+						changes rapidly gives one NOTIFY carrying its latest state. NOTIFYs that
+						answer a SUBSCRIBE or end the subscription are never held back. The
+						default of 0 sends a NOTIFY for every change.
+					</para></description>
+				</configOption>
 				<configOption name="from_user">
 					<synopsis>Username to use in From header for requests to this endpoint.</synopsis>
 				</configOption>
@@ -981,6 +993,45 @@
 						</enumlist>
 					</description>
 				</configOption>
+				<configOption name="receive_sockets" default="1">
+					<synopsis>Number of sockets receiving on a UDP transport</synopsis>
+					<description><para>
+						When greater than 1, this many UDP sockets are bound to the
+						transport's address with <literal>SO_REUSEPORT</literal> and the
+						kernel spreads incoming datagrams over them. One more thread
+						handling SIP events is started for each socket after the first,
+						so datagrams on different sockets are read at the same time.
+						Requests are always sent from the first socket. Requires a
+						system that supports <literal>SO_REUSEPORT</literal>, such as
+						Linux 3.9 or later. (UDP ONLY)
+					</para></description>
+				</configOption>
+				<configOption name="receive_steering" default="flow">
+					<synopsis>How datagrams are spread over the receive sockets</synopsis>
+					<description>
+						<para>Only used when <literal>receive_sockets</literal> is
+						greater than 1. Steering other than <literal>flow</literal>
+						needs Linux 4.5 or later. (UDP ONLY)</para>
+						<enumlist>
+							<enum name="flow"><para>
+								By source address and port, so each peer always
+								arrives on the same socket.
+							</para></enum>
+							<enum name="address"><para>
+								By source address only, so all traffic from a host
+								arrives on the same socket whatever its port.
+							</para></enum>
+							<enum name="cpu"><para>
+								By the CPU the datagram was received on. When the
+								network card spreads traffic over CPUs, such as with
+								RSS or RPS, datagrams are read on the socket matching
+								the CPU that received them. This spreads a burst from a
+								single trunk over the sockets if the card hashes more
+								than the addresses.
+							</para></enum>
+						</enumlist>
+					</description>
+				</configOption>
 				<configOption name="require_client_cert" default="false">
 					<synopsis>Require client certificate (TLS ONLY)</synopsis>
 				</configOption>
@@ -1241,6 +1292,34 @@
 					<synopsis>Maximum number of threads in the res_pjsip threadpool.
 					A value of 0 indicates no maximum.</synopsis>
 				</configOption>
+				<configOption name="threadpool_work_stealing" default="no">
+					<synopsis>Give each thread in the res_pjsip threadpool its own task queue.</synopsis>
+					<description><para>
+						When enabled, each thread of the res_pjsip threadpool has its own
+						task queue and threads that run out of work take tasks from the
+						queues of busy threads. This reduces lock contention on systems
+						with many CPU cores. Tasks pushed to a serializer still execute
+						in order.
+					</para></description>
+				</configOption>
+				<configOption name="threadpool_autoscale_target_wait" default="0">
+					<synopsis>Target time in milliseconds tasks wait for a res_pjsip threadpool thread.</synopsis>
+					<description><para>
+						When non-zero, the res_pjsip threadpool measures how long tasks
+						wait before a thread starts executing them. It grows when the
+						99th percentile of the wait is above this target and shrinks when
+						the wait is well below it, between
+						<replaceable>threadpool_autoscale_min_size</replaceable> and
+						<replaceable>threadpool_max_size</replaceable> threads. A value
+						of 0 disables autoscaling.
+					</para></description>
+				</configOption>
+				<configOption name="threadpool_autoscale_min_size" default="0">
+					<synopsis>Number of threads autoscaling keeps in the res_pjsip threadpool.</synopsis>
+				</configOption>
+				<configOption name="threadpool_autoscale_cooldown" default="5">
+					<synopsis>Minimum number of seconds between two autoscaling resizes of the res_pjsip threadpool.</synopsis>
+				</configOption>
 				<configOption name="disable_tcp_switch" default="yes">
 					<synopsis>Disable automatic switching from UDP to TCP transports.</synopsis>
 					<description><para>
@@ -1248,6 +1327,18 @@
 						request is too large.  See RFC 3261 section 18.1.1.
 					</para></description>
 				</configOption>
+				<configOption name="serializer_pool_size" default="8">
+					<synopsis>Number of serializers in the default pool.</synopsis>
+					<description><para>
+						Tasks that are not tied to a dialog or endpoint, such as new
+						requests, are queued on the serializer of this pool with the
+						fewest tasks waiting, so a task that takes a long time holds up
+						only the tasks queued behind it. The CLI command
+						<literal>pjsip show serializers</literal> shows how many tasks
+						each serializer has. The pool is only created when res_pjsip
+						loads.
+					</para></description>
+				</configOption>
 				<configOption name="type">
 					<synopsis>Must be of type 'system'.</synopsis>
 				</configOption>
@@ -1291,6 +1382,48 @@
                                         set to this value if there is no better option (such as CallerID) to be
                                         used.</synopsis>
 				</configOption>
+				<configOption name="endpoint_identifier_cache_ttl" default="2000">
+					<synopsis>Time in milliseconds the endpoint an out of dialog request was identified as is remembered.</synopsis>
+					<description><para>
+						Requests from the same source address and port, received on the
+						same transport and with the same user and host in the From header,
+						are given the remembered endpoint without running the endpoint
+						identifiers again. Remembered endpoints are forgotten whenever an
+						endpoint or identify object changes, pjsip.conf is reloaded or an
+						identifier module is loaded or unloaded. Changes made directly to
+						a realtime database are only seen once the time has passed.
+						A value of 0 disables the cache.
+					</para></description>
+				</configOption>
+				<configOption name="endpoint_identifier_negative_cache_ttl" default="5000">
+					<synopsis>Time in milliseconds a request that matched no endpoint is remembered.</synopsis>
+					<description><para>
+						Like <literal>endpoint_identifier_cache_ttl</literal> but for
+						requests that no endpoint identifier matched, so repeated requests
+						from the same unknown source are rejected without running the
+						endpoint identifiers again. They are still logged and reported as
+						security events. A value of 0 disables the cache.
+					</para></description>
+				</configOption>
+				<configOption name="max_qualify_rate" default="0">
+					<synopsis>The most contact qualifies sent each second.</synopsis>
+					<description><para>
+						Qualifies are spread over each contact's <literal>qualify_frequency</literal>
+						and sent in batches from their own queue. When more are due
+						than this rate allows they wait in the queue, so a large number
+						of contacts cannot crowd out call handling. A value of 0 sends
+						them as soon as they are due.
+					</para></description>
+				</configOption>
+				<configOption name="max_outbound_registration_rate" default="0">
+					<synopsis>The most outbound REGISTER requests sent each second.</synopsis>
+					<description><para>
+						When more outbound registrations are due than this rate allows,
+						they wait their turn. Refreshes of registrations that are still
+						registered go first, then first attempts, then retries after a
+						failure. A value of 0 sends them as soon as they are due.
+					</para></description>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -1715,6 +1848,9 @@
 				<parameter name="SubMinExpiry">
 					<para><xi:include xpointer="xpointer(/docs/configInfo[@name='res_pjsip']/configFile[@name='pjsip.conf']/configObject[@name='endpoint']/configOption[@name='sub_min_expiry']/synopsis/node())"/></para>
 				</parameter>
+				<parameter name="NotifyMinInterval">
+					<para><xi:include xpointer="xpointer(/docs/configInfo[@name='res_pjsip']/configFile[@name='pjsip.conf']/configObject[@name='endpoint']/configOption[@name='notify_min_interval']/synopsis/node())"/></para>
+				</parameter>
 				<parameter name="FromUser">
 					<para><xi:include xpointer="xpointer(/docs/configInfo[@name='res_pjsip']/configFile[@name='pjsip.conf']/configObject[@name='endpoint']/configOption[@name='from_user']/synopsis/node())"/></para>
 				</parameter>
@@ -1904,14 +2040,14 @@
 
 #define MOD_DATA_CONTACT "contact"
 
-/*! Number of serializers in pool if one not supplied. */
-#define SERIALIZER_POOL_SIZE		8
+/*! Where the next search of the serializer pool starts. */
+static unsigned int serializer_pool_pos;
 
-/*! Next serializer pool index to use. */
-static int serializer_pool_pos;
+/*! Number of serializers in the pool. */
+static unsigned int serializer_pool_size;
 
 /*! Pool of serializers to use if not supplied. */
-static struct ast_taskprocessor *serializer_pool[SERIALIZER_POOL_SIZE];
+static struct ast_taskprocessor **serializer_pool;
 
 static pjsip_endpoint *ast_pjsip_endpoint;
 
@@ -2105,6 +2241,9 @@ int ast_sip_register_endpoint_identifier_with_name(struct ast_sip_endpoint_ident
 
 	ast_debug(1, "Register endpoint identifier %s (%p)\n", name, identifier);
 
+	/* Requests identified without this identifier might now match another endpoint */
+	ast_sip_distributor_identify_cache_flush();
+
 	if (ast_strlen_zero(name)) {
 		/* if an identifier has no name then place in front */
 		AST_RWLIST_INSERT_HEAD(&endpoint_identifiers, id_list_item, list);
@@ -2182,6 +2321,7 @@ void ast_sip_unregister_endpoint_identifier(struct ast_sip_endpoint_identifier *
 			AST_RWLIST_REMOVE_CURRENT(list);
 			ast_free(iter);
 			ast_debug(1, "Unregistered endpoint identifier %p\n", identifier);
+			ast_sip_distributor_identify_cache_flush();
 			ast_module_unref(ast_module_info->self);
 			break;
 		}
@@ -2266,9 +2406,42 @@ static char *cli_show_settings(struct ast_cli_entry *e, int cmd, struct ast_cli_
 	return CLI_SUCCESS;
 }
 
+static char *cli_show_serializers(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define SERIALIZER_FORMAT "%-40.40s %10s\n"
+	unsigned int idx;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip show serializers";
+		e->usage = "Usage: pjsip show serializers\n"
+		            "      Show the serializers in the default pool and how many\n"
+		            "      tasks each has queued, counting the one executing\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, SERIALIZER_FORMAT, "Serializer", "Depth");
+	for (idx = 0; idx < serializer_pool_size; ++idx) {
+		char depth[16];
+
+		snprintf(depth, sizeof(depth), "%ld", ast_taskprocessor_depth(serializer_pool[idx]));
+		ast_cli(a->fd, SERIALIZER_FORMAT, ast_taskprocessor_name(serializer_pool[idx]), depth);
+	}
+	ast_cli(a->fd, "%u serializers in the pool\n", serializer_pool_size);
+	return CLI_SUCCESS;
+#undef SERIALIZER_FORMAT
+}
+
 static struct ast_cli_entry cli_commands[] = {
         AST_CLI_DEFINE(cli_show_settings, "Show global and system configuration options"),
-        AST_CLI_DEFINE(cli_show_endpoint_identifiers, "List registered endpoint identifiers")
+        AST_CLI_DEFINE(cli_show_endpoint_identifiers, "List registered endpoint identifiers"),
+        AST_CLI_DEFINE(cli_show_serializers, "Show the default serializer pool")
 };
 
 AST_RWLIST_HEAD_STATIC(endpoint_formatters, ast_sip_endpoint_formatter);
@@ -3463,10 +3636,13 @@ static void serializer_pool_shutdown(void)
 {
 	int idx;
 
-	for (idx = 0; idx < SERIALIZER_POOL_SIZE; ++idx) {
+	for (idx = 0; idx < serializer_pool_size; ++idx) {
 		ast_taskprocessor_unreference(serializer_pool[idx]);
 		serializer_pool[idx] = NULL;
 	}
+	serializer_pool_size = 0;
+	ast_free(serializer_pool);
+	serializer_pool = NULL;
 }
 
 /*!
@@ -3481,7 +3657,13 @@ static int serializer_pool_setup(void)
 {
 	int idx;
 
-	for (idx = 0; idx < SERIALIZER_POOL_SIZE; ++idx) {
+	serializer_pool = ast_calloc(sip_get_serializer_pool_size(), sizeof(*serializer_pool));
+	if (!serializer_pool) {
+		return -1;
+	}
+	serializer_pool_size = sip_get_serializer_pool_size();
+
+	for (idx = 0; idx < serializer_pool_size; ++idx) {
 		serializer_pool[idx] = ast_sip_create_serializer();
 		if (!serializer_pool[idx]) {
 			serializer_pool_shutdown();
@@ -3491,21 +3673,56 @@ static int serializer_pool_setup(void)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Pick the serializer in the default pool with the fewest tasks.
+ * \since 14.0.0
+ *
+ * \return The serializer, or NULL if there is no pool.
+ */
+static struct ast_taskprocessor *serializer_pool_pick(void)
+{
+	struct ast_taskprocessor *serializer = NULL;
+	long least = LONG_MAX;
+	unsigned int start;
+	unsigned int idx;
+
+	if (!serializer_pool_size) {
+		return NULL;
+	}
+
+	/*
+	 * Start each search at the next serializer so equally loaded
+	 * serializers take turns.
+	 *
+	 * Note: We don't care about any reentrancy behavior
+	 * when incrementing serializer_pool_pos.  If it gets
+	 * incorrectly incremented it doesn't matter.
+	 */
+	start = serializer_pool_pos++;
+	for (idx = 0; idx < serializer_pool_size; ++idx) {
+		struct ast_taskprocessor *candidate;
+		long depth;
+
+		candidate = serializer_pool[(start + idx) % serializer_pool_size];
+		depth = ast_taskprocessor_depth(candidate);
+		if (depth < least) {
+			serializer = candidate;
+			least = depth;
+			if (!depth) {
+				/* Nothing does better than an idle serializer */
+				break;
+			}
+		}
+	}
+
+	return serializer;
+}
+
 int ast_sip_push_task(struct ast_taskprocessor *serializer, int (*sip_task)(void *), void *task_data)
 {
 	if (!serializer) {
-		unsigned int pos;
-
-		/*
-		 * Pick a serializer to use from the pool.
-		 *
-		 * Note: We don't care about any reentrancy behavior
-		 * when incrementing serializer_pool_pos.  If it gets
-		 * incorrectly incremented it doesn't matter.
-		 */
-		pos = serializer_pool_pos++;
-		pos %= SERIALIZER_POOL_SIZE;
-		serializer = serializer_pool[pos];
+		serializer = serializer_pool_pick();
 	}
 
 	if (serializer) {
@@ -3611,10 +3828,15 @@ static void *monitor_thread_exec(void *endpt)
 	return NULL;
 }
 
+/*! Threads handling events alongside the monitor thread, for UDP transports with more than one socket */
+static AST_VECTOR(, pj_thread_t *) receive_threads;
+
 static void stop_monitor_thread(void)
 {
 	monitor_continue = 0;
 	pj_thread_join(monitor_thread);
+	AST_VECTOR_CALLBACK_VOID(&receive_threads, pj_thread_join);
+	AST_VECTOR_FREE(&receive_threads);
 }
 
 AST_THREADSTORAGE(pj_thread_storage);
@@ -3646,6 +3868,34 @@ static void sip_thread_start(void)
 	}
 }
 
+static void pjsip_metrics_collect(struct ast_metrics_output *out)
+{
+	pj_thread_desc *desc;
+	pj_thread_t *thread;
+
+	/* Scrapes are collected on HTTP server threads, which PJLIB does not know about */
+	if (!pj_thread_is_registered()) {
+		desc = ast_threadstorage_get(&pj_thread_storage, sizeof(pj_thread_desc));
+		if (!desc) {
+			return;
+		}
+		pj_bzero(*desc, sizeof(*desc));
+		if (pj_thread_register("Asterisk Thread", *desc, &thread) != PJ_SUCCESS) {
+			return;
+		}
+	}
+
+	ast_metrics_output_family(out, "asterisk_pjsip_transactions", AST_METRIC_GAUGE,
+		"SIP transactions in the PJSIP transaction layer");
+	ast_metrics_output_sample(out, "asterisk_pjsip_transactions", NULL, NULL,
+		pjsip_tsx_layer_get_tsx_count());
+
+	ast_metrics_output_family(out, "asterisk_pjsip_dialog_sets", AST_METRIC_GAUGE,
+		"SIP dialog sets in the PJSIP user agent layer");
+	ast_metrics_output_sample(out, "asterisk_pjsip_dialog_sets", NULL, NULL,
+		pjsip_ua_get_dlg_set_count());
+}
+
 int ast_sip_thread_is_servant(void)
 {
 	uint32_t *servant_id;
@@ -3663,6 +3913,40 @@ int ast_sip_thread_is_servant(void)
 	return *servant_id == SIP_SERVANT_ID;
 }
 
+static void *receive_thread_exec(void *endpt)
+{
+	uint32_t *servant_id;
+
+	servant_id = ast_threadstorage_get(&servant_id_storage, sizeof(*servant_id));
+	if (servant_id) {
+		*servant_id = SIP_SERVANT_ID;
+	}
+
+	return monitor_thread_exec(endpt);
+}
+
+int ast_sip_add_receive_threads(unsigned int count)
+{
+	while (count--) {
+		pj_thread_t *thread = NULL;
+		size_t idx = AST_VECTOR_SIZE(&receive_threads);
+
+		/* Make room first so every thread started is joined when unloading */
+		if (AST_VECTOR_APPEND(&receive_threads, thread)) {
+			return -1;
+		}
+		if (pj_thread_create(memory_pool, "SIP", (pj_thread_proc *) &receive_thread_exec,
+				NULL, PJ_THREAD_DEFAULT_STACK_SIZE * 2, 0,
+				AST_VECTOR_GET_ADDR(&receive_threads, idx)) != PJ_SUCCESS) {
+			AST_VECTOR_REMOVE_UNORDERED(&receive_threads, idx);
+			ast_log(LOG_ERROR, "Failed to start SIP receive thread\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 void *ast_sip_dict_get(void *ht, const char *key)
 {
 	unsigned int hval = 0;
@@ -4030,6 +4314,7 @@ static int load_module(void)
 
 	ast_res_pjsip_init_options_handling(0);
 	ast_cli_register_multiple(cli_commands, ARRAY_LEN(cli_commands));
+	ast_metrics_collector_register("pjsip", pjsip_metrics_collect);
 
 	AST_TEST_REGISTER(xml_sanitization_end_null);
 	AST_TEST_REGISTER(xml_sanitization_exceeds_buffer);
@@ -4078,6 +4363,9 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(xml_sanitization_end_null);
 	AST_TEST_UNREGISTER(xml_sanitization_exceeds_buffer);
 
+	/* No scrape may use PJSIP once it has been shut down */
+	ast_metrics_collector_unregister(pjsip_metrics_collect);
+
 	/* The thread this is called from cannot call PJSIP/PJLIB functions,
 	 * so we have to push the work to the threadpool to handle
 	 */
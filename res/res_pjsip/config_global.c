@@ -35,6 +35,10 @@
 #define DEFAULT_ENDPOINT_IDENTIFIER_ORDER "ip,username,anonymous"
 #define DEFAULT_MAX_INITIAL_QUALIFY_TIME 0
 #define DEFAULT_FROM_USER "asterisk"
+#define DEFAULT_IDENTIFY_CACHE_TTL 2000
+#define DEFAULT_IDENTIFY_NEGATIVE_CACHE_TTL 5000
+#define DEFAULT_MAX_QUALIFY_RATE 0
+#define DEFAULT_MAX_OUTBOUND_REGISTRATION_RATE 0
 
 static char default_useragent[256];
 
@@ -56,6 +60,14 @@ struct global_config {
 	unsigned int keep_alive_interval;
 	/* The maximum time for all contacts to be qualified at startup */
 	unsigned int max_initial_qualify_time;
+	/* Milliseconds the endpoint a request is identified as is remembered */
+	unsigned int identify_cache_ttl;
+	/* Milliseconds a request that matched no endpoint is remembered */
+	unsigned int identify_negative_cache_ttl;
+	/* The most qualifies sent per second, 0 for no limit */
+	unsigned int max_qualify_rate;
+	/* The most outbound REGISTER requests sent per second, 0 for no limit */
+	unsigned int max_outbound_registration_rate;
 };
 
 static void global_destructor(void *obj)
@@ -182,6 +194,66 @@ unsigned int ast_sip_get_max_initial_qualify_time(void)
 	return time;
 }
 
+unsigned int ast_sip_get_endpoint_identifier_cache_ttl(void)
+{
+	unsigned int ttl;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_IDENTIFY_CACHE_TTL;
+	}
+
+	ttl = cfg->identify_cache_ttl;
+	ao2_ref(cfg, -1);
+	return ttl;
+}
+
+unsigned int ast_sip_get_endpoint_identifier_negative_cache_ttl(void)
+{
+	unsigned int ttl;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_IDENTIFY_NEGATIVE_CACHE_TTL;
+	}
+
+	ttl = cfg->identify_negative_cache_ttl;
+	ao2_ref(cfg, -1);
+	return ttl;
+}
+
+unsigned int ast_sip_get_max_qualify_rate(void)
+{
+	unsigned int rate;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_MAX_QUALIFY_RATE;
+	}
+
+	rate = cfg->max_qualify_rate;
+	ao2_ref(cfg, -1);
+	return rate;
+}
+
+unsigned int ast_sip_get_max_outbound_registration_rate(void)
+{
+	unsigned int rate;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_MAX_OUTBOUND_REGISTRATION_RATE;
+	}
+
+	rate = cfg->max_outbound_registration_rate;
+	ao2_ref(cfg, -1);
+	return rate;
+}
+
 void ast_sip_get_default_from_user(char *from_user, size_t size)
 {
 	struct global_config *cfg;
@@ -310,6 +382,18 @@ int ast_sip_initialize_sorcery_global(void)
 		OPT_UINT_T, 0, FLDSET(struct global_config, max_initial_qualify_time));
 	ast_sorcery_object_field_register(sorcery, "global", "default_from_user", DEFAULT_FROM_USER,
 		OPT_STRINGFIELD_T, 0, STRFLDSET(struct global_config, default_from_user));
+	ast_sorcery_object_field_register(sorcery, "global", "endpoint_identifier_cache_ttl",
+		__stringify(DEFAULT_IDENTIFY_CACHE_TTL),
+		OPT_UINT_T, 0, FLDSET(struct global_config, identify_cache_ttl));
+	ast_sorcery_object_field_register(sorcery, "global", "endpoint_identifier_negative_cache_ttl",
+		__stringify(DEFAULT_IDENTIFY_NEGATIVE_CACHE_TTL),
+		OPT_UINT_T, 0, FLDSET(struct global_config, identify_negative_cache_ttl));
+	ast_sorcery_object_field_register(sorcery, "global", "max_qualify_rate",
+		__stringify(DEFAULT_MAX_QUALIFY_RATE),
+		OPT_UINT_T, 0, FLDSET(struct global_config, max_qualify_rate));
+	ast_sorcery_object_field_register(sorcery, "global", "max_outbound_registration_rate",
+		__stringify(DEFAULT_MAX_OUTBOUND_REGISTRATION_RATE),
+		OPT_UINT_T, 0, FLDSET(struct global_config, max_outbound_registration_rate));
 
 	if (ast_sorcery_instance_observer_add(sorcery, &observer_callbacks_global)) {
 		return -1;
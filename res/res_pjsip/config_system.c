@@ -31,6 +31,7 @@
 #define TIMER_T1_MIN 100
 #define DEFAULT_TIMER_T1 500
 #define DEFAULT_TIMER_B 32000
+#define DEFAULT_SERIALIZER_POOL_SIZE 8
 
 struct system_config {
 	SORCERY_OBJECT(details);
@@ -49,9 +50,19 @@ struct system_config {
 		int idle_timeout;
 		/*! Maxumum number of threads in the threadpool */
 		int max_size;
+		/*! Nonzero to use per-thread task queues with work stealing */
+		unsigned int work_stealing;
+		/*! Target queue wait in milliseconds for autoscaling, 0 to disable */
+		int autoscale_target_wait;
+		/*! Number of threads autoscaling keeps in the threadpool */
+		int autoscale_min_size;
+		/*! Minimum seconds between autoscaling resizes */
+		int autoscale_cooldown;
 	} threadpool;
 	/*! Nonzero to disable switching from UDP to TCP transport */
 	unsigned int disable_tcp_switch;
+	/*! Number of serializers in the default pool */
+	unsigned int serializer_pool_size;
 };
 
 static struct ast_threadpool_options sip_threadpool_options = {
@@ -63,6 +74,13 @@ void sip_get_threadpool_options(struct ast_threadpool_options *threadpool_option
 	*threadpool_options = sip_threadpool_options;
 }
 
+static unsigned int sip_serializer_pool_size = DEFAULT_SERIALIZER_POOL_SIZE;
+
+unsigned int sip_get_serializer_pool_size(void)
+{
+	return sip_serializer_pool_size;
+}
+
 static struct ast_sorcery *system_sorcery;
 
 static void *system_alloc(const char *name)
@@ -106,10 +124,20 @@ static int system_apply(const struct ast_sorcery *system_sorcery, void *obj)
 	sip_threadpool_options.auto_increment = system->threadpool.auto_increment;
 	sip_threadpool_options.idle_timeout = system->threadpool.idle_timeout;
 	sip_threadpool_options.max_size = system->threadpool.max_size;
+	sip_threadpool_options.work_stealing = system->threadpool.work_stealing;
+	sip_threadpool_options.autoscale_target_wait = system->threadpool.autoscale_target_wait;
+	sip_threadpool_options.autoscale_min_size = system->threadpool.autoscale_min_size;
+	sip_threadpool_options.autoscale_cooldown = system->threadpool.autoscale_cooldown;
 
 	pjsip_cfg()->endpt.disable_tcp_switch =
 		system->disable_tcp_switch ? PJ_TRUE : PJ_FALSE;
 
+	if (!system->serializer_pool_size) {
+		ast_log(LOG_WARNING, "Serializer pool size setting is too low. Setting to 1\n");
+		system->serializer_pool_size = 1;
+	}
+	sip_serializer_pool_size = system->serializer_pool_size;
+
 	return 0;
 }
 
@@ -182,8 +210,18 @@ int ast_sip_initialize_system(void)
 			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.idle_timeout));
 	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_max_size", "50",
 			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.max_size));
+	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_work_stealing", "no",
+			OPT_BOOL_T, 1, FLDSET(struct system_config, threadpool.work_stealing));
+	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_autoscale_target_wait", "0",
+			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.autoscale_target_wait));
+	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_autoscale_min_size", "0",
+			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.autoscale_min_size));
+	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_autoscale_cooldown", "5",
+			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.autoscale_cooldown));
 	ast_sorcery_object_field_register(system_sorcery, "system", "disable_tcp_switch", "yes",
 			OPT_BOOL_T, 1, FLDSET(struct system_config, disable_tcp_switch));
+	ast_sorcery_object_field_register(system_sorcery, "system", "serializer_pool_size", __stringify(DEFAULT_SERIALIZER_POOL_SIZE),
+			OPT_UINT_T, 0, FLDSET(struct system_config, serializer_pool_size));
 
 	ast_sorcery_load(system_sorcery);
 
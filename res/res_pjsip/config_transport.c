@@ -20,6 +20,9 @@
 
 #include <pjsip.h>
 #include <pjlib.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 #include "asterisk/res_pjsip.h"
 #include "asterisk/res_pjsip_cli.h"
@@ -86,10 +89,16 @@ static int destroy_transport_state(void *data)
 static void transport_state_destroy(void *obj)
 {
 	struct ast_sip_transport_state *state = obj;
+	int i;
 
 	if (state->transport) {
 		ast_sip_push_task_synchronous(NULL, destroy_transport_state, state->transport);
 	}
+	for (i = 0; i < AST_VECTOR_SIZE(&state->receive_transports); ++i) {
+		ast_sip_push_task_synchronous(NULL, destroy_transport_state,
+			AST_VECTOR_GET(&state->receive_transports, i));
+	}
+	AST_VECTOR_FREE(&state->receive_transports);
 }
 
 /*! \brief Destructor for transport */
@@ -141,6 +150,142 @@ static void set_qos(struct ast_sip_transport *transport, pj_qos_params *qos)
 	}
 }
 
+/*!
+ * \internal
+ * \brief Create a UDP socket bound to the transport address alongside others
+ */
+static pj_status_t transport_udp_socket(struct ast_sip_transport *transport, pj_sock_t *sock)
+{
+	pj_status_t res;
+	int one = 1;
+
+	res = pj_sock_socket(transport->host.addr.sa_family, pj_SOCK_DGRAM(), 0, sock);
+	if (res != PJ_SUCCESS) {
+		return res;
+	}
+
+#ifdef SO_REUSEPORT
+	res = pj_sock_setsockopt(*sock, pj_SOL_SOCKET(), SO_REUSEPORT, &one, sizeof(one));
+#else
+	res = PJ_ENOTSUP;
+#endif
+	if (res == PJ_SUCCESS) {
+		res = pj_sock_bind(*sock, &transport->host, pj_sockaddr_get_len(&transport->host));
+	}
+	if (res != PJ_SUCCESS) {
+		pj_sock_close(*sock);
+	}
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Spread datagrams over the receive sockets as configured
+ *
+ * The kernel picks a socket by hashing the source address and port unless a
+ * program attached to the group picks one. The program gives the index of
+ * the socket in the order they were bound.
+ */
+static void transport_udp_steer(struct ast_sip_transport *transport, pj_sock_t sock)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	struct sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, 0 },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, transport->receive_sockets },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog = {
+		.len = ARRAY_LEN(code),
+		.filter = code,
+	};
+
+	switch (transport->receive_steering) {
+	case AST_SIP_RECEIVE_STEERING_FLOW:
+		return;
+	case AST_SIP_RECEIVE_STEERING_ADDRESS:
+		/* The source address, or the last word of it for IPv6 */
+		code[0].k = SKF_NET_OFF + (transport->host.addr.sa_family == pj_AF_INET6() ? 20 : 12);
+		break;
+	case AST_SIP_RECEIVE_STEERING_CPU:
+		code[0].k = SKF_AD_OFF + SKF_AD_CPU;
+		break;
+	}
+
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+		ast_log(LOG_WARNING, "Transport '%s' could not steer datagrams to its receive sockets: %s\n",
+			ast_sorcery_object_get_id(transport), strerror(errno));
+	}
+#else
+	if (transport->receive_steering != AST_SIP_RECEIVE_STEERING_FLOW) {
+		ast_log(LOG_WARNING, "Transport '%s' can not steer datagrams on this system, receive_steering ignored\n",
+			ast_sorcery_object_get_id(transport));
+	}
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Start a UDP transport with more than one socket receiving on its address
+ *
+ * Every socket is its own pjsip transport. The first is the transport used
+ * to send, the rest only receive, each read by its own thread.
+ */
+static pj_status_t transport_udp_start_multiple(struct ast_sip_transport *transport)
+{
+	pjsip_transport_type_e type = transport->host.addr.sa_family == pj_AF_INET6()
+		? PJSIP_TRANSPORT_UDP6 : PJSIP_TRANSPORT_UDP;
+	pj_sock_t first = PJ_INVALID_SOCKET;
+	pj_status_t res;
+	int i;
+
+	if (AST_VECTOR_INIT(&transport->state->receive_transports, transport->receive_sockets - 1)) {
+		return PJ_ENOMEM;
+	}
+
+	for (i = 0; i < transport->receive_sockets; ++i) {
+		pjsip_transport *udp;
+		pj_sock_t sock;
+
+		res = transport_udp_socket(transport, &sock);
+		if (res != PJ_SUCCESS) {
+			return res;
+		}
+		res = pjsip_udp_transport_attach2(ast_sip_get_pjsip_endpoint(), type, sock, NULL,
+			transport->async_operations, &udp);
+		if (res != PJ_SUCCESS) {
+			pj_sock_close(sock);
+			return res;
+		}
+
+		if (!i) {
+			first = sock;
+			transport->state->transport = udp;
+		} else if (AST_VECTOR_APPEND(&transport->state->receive_transports, udp)) {
+			pjsip_transport_shutdown(udp);
+			return PJ_ENOMEM;
+		}
+	}
+
+	transport_udp_steer(transport, first);
+
+	if (ast_sip_add_receive_threads(transport->receive_sockets - 1)) {
+		return PJ_ENOMEM;
+	}
+	return PJ_SUCCESS;
+}
+
+/*! \brief Set the QOS values of a UDP transport's socket */
+static void transport_udp_set_qos(struct ast_sip_transport *transport, pjsip_transport *udp)
+{
+	pj_sock_t sock;
+	pj_qos_params qos_params;
+
+	sock = pjsip_udp_transport_get_socket(udp);
+	pj_sock_get_qos_params(sock, &qos_params);
+	set_qos(transport, &qos_params);
+	pj_sock_set_qos_params(sock, &qos_params);
+}
+
 /*! \brief Apply handler for transports */
 static int transport_apply(const struct ast_sorcery *sorcery, void *obj)
 {
@@ -191,21 +336,27 @@ static int transport_apply(const struct ast_sorcery *sorcery, void *obj)
 		}
 	}
 
+	if (transport->type != AST_TRANSPORT_UDP && transport->receive_sockets > 1) {
+		ast_log(LOG_WARNING, "Transport '%s' is not UDP, receive_sockets ignored\n",
+			ast_sorcery_object_get_id(obj));
+	}
+
 	if (transport->type == AST_TRANSPORT_UDP) {
-		if (transport->host.addr.sa_family == pj_AF_INET()) {
+		if (transport->receive_sockets > 1) {
+			res = transport_udp_start_multiple(transport);
+		} else if (transport->host.addr.sa_family == pj_AF_INET()) {
 			res = pjsip_udp_transport_start(ast_sip_get_pjsip_endpoint(), &transport->host.ipv4, NULL, transport->async_operations, &transport->state->transport);
 		} else if (transport->host.addr.sa_family == pj_AF_INET6()) {
 			res = pjsip_udp_transport_start6(ast_sip_get_pjsip_endpoint(), &transport->host.ipv6, NULL, transport->async_operations, &transport->state->transport);
 		}
 
 		if (res == PJ_SUCCESS && (transport->tos || transport->cos)) {
-			pj_sock_t sock;
-			pj_qos_params qos_params;
+			int i;
 
-			sock = pjsip_udp_transport_get_socket(transport->state->transport);
-			pj_sock_get_qos_params(sock, &qos_params);
-			set_qos(transport, &qos_params);
-			pj_sock_set_qos_params(sock, &qos_params);
+			transport_udp_set_qos(transport, transport->state->transport);
+			for (i = 0; i < AST_VECTOR_SIZE(&transport->state->receive_transports); ++i) {
+				transport_udp_set_qos(transport, AST_VECTOR_GET(&transport->state->receive_transports, i));
+			}
 		}
 	} else if (transport->type == AST_TRANSPORT_TCP) {
 		pjsip_tcp_transport_cfg cfg;
@@ -304,6 +455,41 @@ static int transport_protocol_handler(const struct aco_option *opt, struct ast_v
 	return 0;
 }
 
+/*! \brief Custom handler for turning a string steering into an enum */
+static int transport_receive_steering_handler(const struct aco_option *opt, struct ast_variable *var, void *obj)
+{
+	struct ast_sip_transport *transport = obj;
+
+	if (!strcasecmp(var->value, "flow")) {
+		transport->receive_steering = AST_SIP_RECEIVE_STEERING_FLOW;
+	} else if (!strcasecmp(var->value, "address")) {
+		transport->receive_steering = AST_SIP_RECEIVE_STEERING_ADDRESS;
+	} else if (!strcasecmp(var->value, "cpu")) {
+		transport->receive_steering = AST_SIP_RECEIVE_STEERING_CPU;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+static const char *receive_steering_map[] = {
+	[AST_SIP_RECEIVE_STEERING_FLOW] = "flow",
+	[AST_SIP_RECEIVE_STEERING_ADDRESS] = "address",
+	[AST_SIP_RECEIVE_STEERING_CPU] = "cpu",
+};
+
+static int receive_steering_to_str(const void *obj, const intptr_t *args, char **buf)
+{
+	const struct ast_sip_transport *transport = obj;
+
+	if (ARRAY_IN_BOUNDS(transport->receive_steering, receive_steering_map)) {
+		*buf = ast_strdup(receive_steering_map[transport->receive_steering]);
+	}
+
+	return 0;
+}
+
 static const char *transport_types[] = {
 	[AST_TRANSPORT_UDP] = "udp",
 	[AST_TRANSPORT_TCP] = "tcp",
@@ -802,6 +988,8 @@ int ast_sip_initialize_sorcery_transport(void)
 	ast_sorcery_object_field_register_custom(sorcery, "transport", "local_net", "", transport_localnet_handler, localnet_to_str, localnet_to_vl, 0, 0);
 	ast_sorcery_object_field_register_custom(sorcery, "transport", "tos", "0", transport_tos_handler, tos_to_str, NULL, 0, 0);
 	ast_sorcery_object_field_register(sorcery, "transport", "cos", "0", OPT_UINT_T, 0, FLDSET(struct ast_sip_transport, cos));
+	ast_sorcery_object_field_register(sorcery, "transport", "receive_sockets", "1", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct ast_sip_transport, receive_sockets), 1, 64);
+	ast_sorcery_object_field_register_custom(sorcery, "transport", "receive_steering", "flow", transport_receive_steering_handler, receive_steering_to_str, NULL, 0, 0);
 	ast_sorcery_object_field_register(sorcery, "transport", "websocket_write_timeout", AST_DEFAULT_WEBSOCKET_WRITE_TIMEOUT_STR, OPT_INT_T, PARSE_IN_RANGE, FLDSET(struct ast_sip_transport, write_timeout), 1, INT_MAX);
 
 	internal_sip_register_endpoint_formatter(&endpoint_transport_formatter);
@@ -133,6 +133,29 @@ int ast_sip_initialize_distributor(void);
  */
 void ast_sip_destroy_distributor(void);
 
+/*!
+ * \internal
+ * \brief Forget the endpoints requests were identified as.
+ *
+ * Called when something that endpoint identification depends on changes.
+ */
+void ast_sip_distributor_identify_cache_flush(void);
+
+/*!
+ * \internal
+ * \brief Start more threads handling pjsip events.
+ *
+ * Each thread polls the same sockets as the monitor thread, so datagrams
+ * arriving on different sockets are read at the same time. The threads
+ * run until res_pjsip is unloaded.
+ *
+ * \param count Number of threads to add
+ *
+ * \retval -1 failure
+ * \retval 0 success
+ */
+int ast_sip_add_receive_threads(unsigned int count);
+
 /*!
  * \internal
  * \brief Initialize global type on a sorcery instance
@@ -240,6 +263,12 @@ void ast_res_pjsip_cleanup_options_handling(void);
  */
 void sip_get_threadpool_options(struct ast_threadpool_options *threadpool_options);
 
+/*!
+ * \internal
+ * \brief Get the number of serializers in the default pool
+ */
+unsigned int sip_get_serializer_pool_size(void);
+
 /*!
  * \internal
  * \brief Retrieve the name of the default outbound endpoint.
@@ -1074,6 +1074,7 @@ static struct ast_endpoint *persistent_endpoint_find_or_create(const struct ast_
 static int sip_endpoint_apply_handler(const struct ast_sorcery *sorcery, void *obj)
 {
 	struct ast_sip_endpoint *endpoint = obj;
+	struct ast_format_cap *codecs;
 
 	if (!(endpoint->persistent = persistent_endpoint_find_or_create(endpoint))) {
 		return -1;
@@ -1089,6 +1090,14 @@ static int sip_endpoint_apply_handler(const struct ast_sorcery *sorcery, void *o
 		return -1;
 	}
 
+	/* The codecs don't change once configured, share them with the endpoints
+	 * and channels using the same ones. */
+	if (!(codecs = ast_format_cap_intern(endpoint->media.codecs))) {
+		return -1;
+	}
+	ao2_ref(endpoint->media.codecs, -1);
+	endpoint->media.codecs = codecs;
+
 	return 0;
 }
 
@@ -1793,7 +1802,11 @@ int ast_res_pjsip_initialize_configuration(void)
 		return -1;
 	}
 
-	if (!(persistent_endpoints = ao2_container_alloc(PERSISTENT_BUCKETS, persistent_endpoint_hash, persistent_endpoint_cmp))) {
+	persistent_endpoints = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE | AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND,
+		PERSISTENT_BUCKETS,
+		persistent_endpoint_hash, NULL, persistent_endpoint_cmp);
+	if (!persistent_endpoints) {
 		return -1;
 	}
 
@@ -1899,6 +1912,7 @@ int ast_res_pjsip_initialize_configuration(void)
 	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "cos_video", "0", OPT_UINT_T, 0, FLDSET(struct ast_sip_endpoint, media.cos_video));
 	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "allow_subscribe", "yes", OPT_BOOL_T, 1, FLDSET(struct ast_sip_endpoint, subscription.allow));
 	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "sub_min_expiry", "0", OPT_UINT_T, 0, FLDSET(struct ast_sip_endpoint, subscription.minexpiry));
+	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "notify_min_interval", "0", OPT_UINT_T, 0, FLDSET(struct ast_sip_endpoint, subscription.notify_min_interval));
 	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "from_user", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_sip_endpoint, fromuser));
 	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "from_domain", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_sip_endpoint, fromdomain));
 	ast_sorcery_object_field_register(sip_sorcery, "endpoint", "mwi_from_user", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_sip_endpoint, subscription.mwi.fromuser));
@@ -22,8 +22,11 @@
 
 #include "asterisk/res_pjsip.h"
 #include "include/res_pjsip_private.h"
+#include "asterisk/channel.h"
+#include "asterisk/probes.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/threadpool.h"
+#include "asterisk/sorcery.h"
 
 static int distribute(void *data);
 static pj_bool_t distributor(pjsip_rx_data *rdata);
@@ -274,6 +277,20 @@ static pj_bool_t distributor(pjsip_rx_data *rdata)
 		pjsip_endpt_respond_stateless(ast_sip_get_pjsip_endpoint(), rdata,
 			PJSIP_SC_CALL_TSX_DOES_NOT_EXIST, NULL, NULL, NULL);
 		goto end;
+	} else if (ast_taskprocessor_alert_get()) {
+		/*
+		 * When taskprocessors are backed up it is a good indication that
+		 * the system is overloaded. Turn away new out of dialog requests
+		 * so the requests we have already accepted can be serviced.
+		 */
+		ast_debug(3, "Taskprocessor overload alert: Rejecting '%s'.\n",
+			pjsip_rx_data_get_info(rdata));
+		AST_PROBE2(pjsip__distribute__reject, rdata, PJSIP_SC_SERVICE_UNAVAILABLE);
+		if (pjsip_method_cmp(&rdata->msg_info.msg->line.req.method, &pjsip_ack_method)) {
+			pjsip_endpt_respond_stateless(ast_sip_get_pjsip_endpoint(), rdata,
+				PJSIP_SC_SERVICE_UNAVAILABLE, NULL, NULL, NULL);
+		}
+		goto end;
 	}
 
 	pjsip_rx_data_clone(rdata, 0, &clone);
@@ -287,12 +304,15 @@ static pj_bool_t distributor(pjsip_rx_data *rdata)
 		 * some sort of terrible condition and don't need to be adding more work to the threadpool.
 		 * It's in our best interest to send back a 503 response and be done with it.
 		 */
+		AST_PROBE2(pjsip__distribute__reject, rdata, 503);
 		if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG) {
 			pjsip_endpt_respond_stateless(ast_sip_get_pjsip_endpoint(), rdata, 503, NULL, NULL, NULL);
 		}
 		ao2_cleanup(clone->endpt_info.mod_data[endpoint_mod.id]);
 		pjsip_rx_data_free_cloned(clone);
 	} else {
+		AST_PROBE3(pjsip__distribute, clone, (int) rdata->msg_info.msg->type,
+			serializer ? ast_taskprocessor_name(serializer) : NULL);
 		ast_sip_push_task(serializer, distribute, clone);
 	}
 
@@ -362,17 +382,276 @@ static void log_unidentified_request(pjsip_rx_data *rdata)
 		from_buf, rdata->pkt_info.src_name, rdata->pkt_info.src_port, callid_buf);
 }
 
+/*! Number of buckets for the identification cache */
+#define IDENTIFY_CACHE_BUCKETS 257
+
+/*! Most requests remembered by the identification cache */
+#define IDENTIFY_CACHE_MAX 8192
+
+/*! \brief The endpoint requests from one source were identified as */
+struct identify_cache_entry {
+	/*! The endpoint, or NULL if no endpoint matched */
+	struct ast_sip_endpoint *endpoint;
+	/*! When the entry is no longer used */
+	struct timeval expires;
+	/*! Source, transport and From user and host of the requests */
+	char key[0];
+};
+
+/*! Requests recently identified, keyed by where they came from */
+static struct ao2_container *identify_cache;
+
+/*! Bumped under the container lock each time the cache is flushed */
+static unsigned int identify_cache_generation;
+
+/*! Milliseconds an identified endpoint is remembered */
+static unsigned int identify_cache_ttl;
+
+/*! Milliseconds a request that matched no endpoint is remembered */
+static unsigned int identify_negative_cache_ttl;
+
+static int identify_cache_hash(const void *obj, const int flags)
+{
+	const struct identify_cache_entry *entry = obj;
+
+	return ast_str_hash(flags & OBJ_SEARCH_KEY ? obj : entry->key);
+}
+
+static int identify_cache_cmp(void *obj, void *arg, int flags)
+{
+	const struct identify_cache_entry *entry1 = obj;
+	const struct identify_cache_entry *entry2 = arg;
+	const char *key = flags & OBJ_SEARCH_KEY ? arg : entry2->key;
+
+	return !strcmp(entry1->key, key) ? CMP_MATCH | CMP_STOP : 0;
+}
+
+static void identify_cache_entry_destroy(void *obj)
+{
+	struct identify_cache_entry *entry = obj;
+
+	ao2_cleanup(entry->endpoint);
+}
+
+static int identify_cache_expired(void *obj, void *arg, int flags)
+{
+	struct identify_cache_entry *entry = obj;
+	struct timeval *now = arg;
+
+	return ast_tvcmp(entry->expires, *now) <= 0 ? CMP_MATCH : 0;
+}
+
+void ast_sip_distributor_identify_cache_flush(void)
+{
+	if (!identify_cache) {
+		return;
+	}
+
+	ao2_lock(identify_cache);
+	++identify_cache_generation;
+	ao2_callback(identify_cache, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+	ao2_unlock(identify_cache);
+}
+
+/*!
+ * \internal
+ * \brief Build the identification cache key of a request
+ *
+ * The endpoint identifiers match on the source address, the user and host in
+ * the From header and the transport the request came in on, so together they
+ * pick the same endpoint while the configuration stays the same.
+ *
+ * \retval 0 The request can be cached
+ * \retval -1 The request must always be identified
+ */
+static int identify_cache_key(pjsip_rx_data *rdata, char *key, size_t size)
+{
+	static const pj_str_t LINE_STR = { "line", 4 };
+	pjsip_uri *from = rdata->msg_info.from->uri;
+	pjsip_uri *to = rdata->msg_info.to->uri;
+	pjsip_uri *ruri = rdata->msg_info.msg->line.req.uri;
+	pjsip_transport *transport = rdata->tp_info.transport;
+	pj_str_t user = { "", 0 };
+	pj_str_t host = { "", 0 };
+
+	/* Requests for an outbound registration are identified by its line instead */
+	if (((PJSIP_URI_SCHEME_IS_SIP(to) || PJSIP_URI_SCHEME_IS_SIPS(to))
+			&& pjsip_param_find(&((pjsip_sip_uri *) pjsip_uri_get_uri(to))->other_param, &LINE_STR))
+		|| ((PJSIP_URI_SCHEME_IS_SIP(ruri) || PJSIP_URI_SCHEME_IS_SIPS(ruri))
+			&& pjsip_param_find(&((pjsip_sip_uri *) pjsip_uri_get_uri(ruri))->other_param, &LINE_STR))) {
+		return -1;
+	}
+
+	if (PJSIP_URI_SCHEME_IS_SIP(from) || PJSIP_URI_SCHEME_IS_SIPS(from)) {
+		pjsip_sip_uri *sip_from = pjsip_uri_get_uri(from);
+
+		user = sip_from->user;
+		host = sip_from->host;
+	}
+
+	snprintf(key, size, "%s:%d/%s:%.*s:%d/%.*s@%.*s",
+		rdata->pkt_info.src_name, rdata->pkt_info.src_port,
+		transport->type_name, (int) transport->local_name.host.slen,
+		transport->local_name.host.ptr, transport->local_name.port,
+		(int) user.slen, user.ptr, (int) host.slen, host.ptr);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find the endpoint a request was recently identified as
+ *
+ * \param key The cache key of the request
+ * \param endpoint Set to the endpoint with a reference, or NULL if none matched
+ *
+ * \retval 0 The request was found
+ * \retval -1 The request must be identified
+ */
+static int identify_cache_find(const char *key, struct ast_sip_endpoint **endpoint)
+{
+	struct identify_cache_entry *entry;
+	int res = -1;
+
+	entry = ao2_find(identify_cache, key, OBJ_SEARCH_KEY);
+	if (!entry) {
+		return -1;
+	}
+
+	if (ast_tvcmp(entry->expires, ast_tvnow()) > 0) {
+		*endpoint = ao2_bump(entry->endpoint);
+		res = 0;
+	}
+	ao2_ref(entry, -1);
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Remember the endpoint a request was identified as
+ *
+ * \param key The cache key of the request
+ * \param endpoint The endpoint, or NULL if none matched
+ * \param generation The cache generation before the request was identified
+ */
+static void identify_cache_add(const char *key, struct ast_sip_endpoint *endpoint,
+	unsigned int generation)
+{
+	struct identify_cache_entry *entry;
+	unsigned int ttl = endpoint ? identify_cache_ttl : identify_negative_cache_ttl;
+	struct timeval now;
+
+	if (!ttl) {
+		return;
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + strlen(key) + 1,
+		identify_cache_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return;
+	}
+	strcpy(entry->key, key); /* Safe */
+	entry->endpoint = ao2_bump(endpoint);
+	now = ast_tvnow();
+	entry->expires = ast_tvadd(now, ast_samp2tv(ttl, 1000));
+
+	ao2_lock(identify_cache);
+	/* The endpoint may be stale if the cache was flushed while identifying */
+	if (generation == identify_cache_generation) {
+		ao2_find(identify_cache, key, OBJ_SEARCH_KEY | OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA);
+		if (ao2_container_count(identify_cache) >= IDENTIFY_CACHE_MAX) {
+			ao2_callback(identify_cache, OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE,
+				identify_cache_expired, &now);
+		}
+		if (ao2_container_count(identify_cache) < IDENTIFY_CACHE_MAX) {
+			ao2_link_flags(identify_cache, entry, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(identify_cache);
+	ao2_ref(entry, -1);
+}
+
+static void identify_cache_object_changed(const void *obj)
+{
+	ast_sip_distributor_identify_cache_flush();
+}
+
+static void identify_cache_type_loaded(const char *object_type)
+{
+	ast_sip_distributor_identify_cache_flush();
+}
+
+/*! \brief Flushes the identification cache when an endpoint or identify object changes */
+static const struct ast_sorcery_observer identify_cache_observer = {
+	.created = identify_cache_object_changed,
+	.updated = identify_cache_object_changed,
+	.deleted = identify_cache_object_changed,
+	.loaded = identify_cache_type_loaded,
+};
+
+static void identify_cache_object_type_registered(const char *name, struct ast_sorcery *sorcery,
+	const char *object_type)
+{
+	/* The identify type belongs to res_pjsip_endpoint_identifier_ip, which loads later */
+	if (!strcmp(object_type, "identify")) {
+		ast_sorcery_observer_add(sorcery, object_type, &identify_cache_observer);
+	}
+}
+
+static void identify_cache_object_type_loaded(const char *name, const struct ast_sorcery *sorcery,
+	const char *object_type, int reloaded)
+{
+	if (!strcmp(object_type, "global")) {
+		identify_cache_ttl = ast_sip_get_endpoint_identifier_cache_ttl();
+		identify_negative_cache_ttl = ast_sip_get_endpoint_identifier_negative_cache_ttl();
+	}
+
+	/* Domain aliases and transports are used to identify endpoints too */
+	ast_sip_distributor_identify_cache_flush();
+}
+
+static const struct ast_sorcery_instance_observer identify_cache_instance_observer = {
+	.object_type_registered = identify_cache_object_type_registered,
+	.object_type_loaded = identify_cache_object_type_loaded,
+};
+
+/*!
+ * \internal
+ * \brief Record a call setup stage reached by a request being distributed
+ */
+static void setup_stage_mark(pjsip_rx_data *rdata, enum ast_channel_setup_stage stage)
+{
+	struct ast_channel_setup_times *setup_times = ast_sip_rdata_get_setup_times(rdata);
+
+	if (setup_times) {
+		ast_setup_times_mark(setup_times, stage);
+	}
+}
+
 static pj_bool_t endpoint_lookup(pjsip_rx_data *rdata)
 {
 	struct ast_sip_endpoint *endpoint;
 	int is_ack = rdata->msg_info.msg->line.req.method.id == PJSIP_ACK_METHOD;
+	char key[PJSIP_MAX_URL_SIZE * 2];
+	int cacheable;
 
 	endpoint = rdata->endpt_info.mod_data[endpoint_mod.id];
 	if (endpoint) {
 		return PJ_FALSE;
 	}
 
-	endpoint = ast_sip_identify_endpoint(rdata);
+	cacheable = !identify_cache_key(rdata, key, sizeof(key));
+	if (!cacheable || identify_cache_find(key, &endpoint)) {
+		unsigned int generation;
+
+		ao2_lock(identify_cache);
+		generation = identify_cache_generation;
+		ao2_unlock(identify_cache);
+
+		endpoint = ast_sip_identify_endpoint(rdata);
+		if (cacheable) {
+			identify_cache_add(key, endpoint, generation);
+		}
+	}
 
 	if (!endpoint && !is_ack) {
 		char name[AST_UUID_STR_LEN] = "";
@@ -394,6 +673,7 @@ static pj_bool_t endpoint_lookup(pjsip_rx_data *rdata)
 		ast_sip_report_invalid_endpoint(name, rdata);
 	}
 	rdata->endpt_info.mod_data[endpoint_mod.id] = endpoint;
+	setup_stage_mark(rdata, AST_CHANNEL_SETUP_IDENTIFIED);
 	return PJ_FALSE;
 }
 
@@ -416,6 +696,7 @@ static pj_bool_t authenticate(pjsip_rx_data *rdata)
 		case AST_SIP_AUTHENTICATION_SUCCESS:
 			ast_sip_report_auth_success(endpoint, rdata);
 			pjsip_tx_data_dec_ref(tdata);
+			setup_stage_mark(rdata, AST_CHANNEL_SETUP_AUTHENTICATED);
 			return PJ_FALSE;
 		case AST_SIP_AUTHENTICATION_FAILED:
 			ast_sip_report_auth_failed_challenge_response(endpoint, rdata);
@@ -429,6 +710,7 @@ static pj_bool_t authenticate(pjsip_rx_data *rdata)
 		}
 	}
 
+	setup_stage_mark(rdata, AST_CHANNEL_SETUP_AUTHENTICATED);
 	return PJ_FALSE;
 }
 
@@ -449,11 +731,25 @@ static int distribute(void *data)
 	int is_request = rdata->msg_info.msg->type == PJSIP_REQUEST_MSG;
 	int is_ack = is_request ? rdata->msg_info.msg->line.req.method.id == PJSIP_ACK_METHOD : 0;
 	struct ast_sip_endpoint *endpoint;
+	struct ast_channel_setup_times setup_times = { { { 0, }, }, };
 
+	/* The setup stages reached are only available while the request is processed */
+	if (is_request && !is_ack) {
+		if (rdata->pkt_info.timestamp.sec) {
+			setup_times.stage[AST_CHANNEL_SETUP_RECEIVED] = ast_tv(rdata->pkt_info.timestamp.sec,
+				rdata->pkt_info.timestamp.msec * 1000);
+		}
+		ast_setup_times_mark(&setup_times, AST_CHANNEL_SETUP_DISTRIBUTED);
+		rdata->endpt_info.mod_data[distributor_mod.id] = &setup_times;
+	}
+
+	AST_PROBE2(pjsip__process__start, rdata, is_request);
 	pjsip_endpt_process_rx_data(ast_sip_get_pjsip_endpoint(), rdata, &param, &handled);
 	if (!handled && is_request && !is_ack) {
 		pjsip_endpt_respond_stateless(ast_sip_get_pjsip_endpoint(), rdata, 501, NULL, NULL, NULL);
 	}
+	AST_PROBE2(pjsip__process__done, rdata, (int) handled);
+	rdata->endpt_info.mod_data[distributor_mod.id] = NULL;
 
 	/* The endpoint_mod stores an endpoint reference in the mod_data of rdata. This
 	 * is the only appropriate spot to actually decrement the reference.
@@ -464,6 +760,11 @@ static int distribute(void *data)
 	return 0;
 }
 
+struct ast_channel_setup_times *ast_sip_rdata_get_setup_times(pjsip_rx_data *rdata)
+{
+	return rdata->endpt_info.mod_data[distributor_mod.id];
+}
+
 struct ast_sip_endpoint *ast_pjsip_rdata_get_endpoint(pjsip_rx_data *rdata)
 {
 	struct ast_sip_endpoint *endpoint = rdata->endpt_info.mod_data[endpoint_mod.id];
@@ -479,6 +780,20 @@ int ast_sip_initialize_distributor(void)
 		return -1;
 	}
 
+	identify_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		IDENTIFY_CACHE_BUCKETS, identify_cache_hash, NULL, identify_cache_cmp);
+	if (!identify_cache) {
+		return -1;
+	}
+	identify_cache_ttl = ast_sip_get_endpoint_identifier_cache_ttl();
+	identify_negative_cache_ttl = ast_sip_get_endpoint_identifier_negative_cache_ttl();
+	if (ast_sorcery_observer_add(ast_sip_get_sorcery(), "endpoint", &identify_cache_observer)
+		|| ast_sorcery_instance_observer_add(ast_sip_get_sorcery(), &identify_cache_instance_observer)) {
+		return -1;
+	}
+	/* The identify type is only there if res_pjsip_endpoint_identifier_ip loaded first */
+	ast_sorcery_observer_add(ast_sip_get_sorcery(), "identify", &identify_cache_observer);
+
 	if (internal_sip_register_service(&distributor_mod)) {
 		return -1;
 	}
@@ -498,6 +813,12 @@ void ast_sip_destroy_distributor(void)
 	internal_sip_unregister_service(&endpoint_mod);
 	internal_sip_unregister_service(&auth_mod);
 
+	ast_sorcery_instance_observer_remove(ast_sip_get_sorcery(), &identify_cache_instance_observer);
+	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "identify", &identify_cache_observer);
+	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "endpoint", &identify_cache_observer);
+	ao2_cleanup(identify_cache);
+	identify_cache = NULL;
+
 	ao2_cleanup(artificial_auth);
 	ao2_cleanup(artificial_endpoint);
 }
@@ -30,12 +30,17 @@
 #include "asterisk/time.h"
 #include "asterisk/test.h"
 #include "asterisk/statsd.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/dlinkedlists.h"
 #include "include/res_pjsip_private.h"
 
 #define DEFAULT_LANGUAGE "en"
 #define DEFAULT_ENCODING "text/plain"
 #define QUALIFIED_BUCKETS 211
 
+/*! Most qualifies sent by one run of the qualify serializer */
+#define QUALIFY_BATCH_SIZE 50
+
 static const char *status_map [] = {
 	[UNAVAILABLE] = "Unreachable",
 	[AVAILABLE] = "Reachable",
@@ -408,10 +413,35 @@ static struct ao2_container *sched_qualifies;
 struct sched_data {
 	/*! The scheduling id */
 	int id;
+	/*! Set while waiting in the qualify queue */
+	unsigned int queued:1;
 	/*! The the contact being checked */
 	struct ast_sip_contact *contact;
+	/*! Link in the qualify queue */
+	AST_DLLIST_ENTRY(sched_data) next;
 };
 
+/*!
+ * \internal
+ * \brief Scheduled qualifies waiting to be sent, each holding a reference.
+ */
+static AST_DLLIST_HEAD_STATIC(qualify_queue, sched_data);
+
+/*!
+ * \internal
+ * \brief Serializer sending queued qualifies, kept apart from call handling.
+ */
+static struct ast_taskprocessor *qualify_serializer;
+
+/*! Set while a run of the qualify serializer is queued or scheduled */
+static int qualify_batch_pending;
+
+/*! Qualifies that may be sent now, when rate limited. Only used by the qualify serializer. */
+static double qualify_tokens;
+
+/*! When qualify_tokens was last topped up. Only used by the qualify serializer. */
+static struct timeval qualify_tokens_time;
+
 /*!
  * \internal
  * \brief Destroy the scheduled data and remove from scheduler.
@@ -457,32 +487,171 @@ static int qualify_contact_task(void *obj)
 	return res;
 }
 
+static int qualify_batch(void *obj);
+
+/*!
+ * \internal
+ * \brief Queue another run of the qualify serializer from the scheduler.
+ */
+static int qualify_batch_sched(const void *obj)
+{
+	if (ast_sip_push_task(qualify_serializer, qualify_batch, NULL)) {
+		AST_DLLIST_LOCK(&qualify_queue);
+		qualify_batch_pending = 0;
+		AST_DLLIST_UNLOCK(&qualify_queue);
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Send queued qualifies, as many as the rate limit allows.
+ *
+ * \details Runs on the qualify serializer and sends at most QUALIFY_BATCH_SIZE
+ * qualifies before queueing itself again, so a large queue is sent in steps.
+ * When the global max_qualify_rate is reached it waits on the scheduler
+ * until another qualify may be sent.
+ */
+static int qualify_batch(void *obj)
+{
+	unsigned int rate = ast_sip_get_max_qualify_rate();
+	int allowed = QUALIFY_BATCH_SIZE;
+	int delay = 0;
+	int sent;
+
+	if (rate) {
+		struct timeval now = ast_tvnow();
+
+		/* Save up no more than one batch so an idle spell is not followed by a burst */
+		qualify_tokens += rate * (ast_tvdiff_us(now, qualify_tokens_time) / 1000000.0);
+		qualify_tokens = MIN(qualify_tokens, MIN(rate, QUALIFY_BATCH_SIZE));
+		qualify_tokens_time = now;
+		allowed = (int) qualify_tokens;
+	}
+
+	for (sent = 0; sent < allowed; ++sent) {
+		struct sched_data *data;
+
+		AST_DLLIST_LOCK(&qualify_queue);
+		data = AST_DLLIST_REMOVE_HEAD(&qualify_queue, next);
+		if (data) {
+			data->queued = 0;
+		}
+		AST_DLLIST_UNLOCK(&qualify_queue);
+		if (!data) {
+			break;
+		}
+
+		qualify_contact(NULL, data->contact);
+		ao2_t_ref(data, -1, "Done with qualify queue ref");
+	}
+
+	if (rate) {
+		qualify_tokens -= sent;
+		if (qualify_tokens < 1) {
+			delay = (int) ((1 - qualify_tokens) * 1000 / rate) + 1;
+		}
+	}
+
+	AST_DLLIST_LOCK(&qualify_queue);
+	if (AST_DLLIST_EMPTY(&qualify_queue) || !sched) {
+		qualify_batch_pending = 0;
+		AST_DLLIST_UNLOCK(&qualify_queue);
+		return 0;
+	}
+	AST_DLLIST_UNLOCK(&qualify_queue);
+
+	if (!delay || ast_sched_add(sched, delay, qualify_batch_sched, NULL) < 0) {
+		qualify_batch_sched(NULL);
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Add a scheduled contact to the qualify queue unless already there.
+ */
+static void qualify_enqueue(struct sched_data *data)
+{
+	int push;
+
+	AST_DLLIST_LOCK(&qualify_queue);
+	if (!data->queued) {
+		data->queued = 1;
+		ao2_t_ref(data, +1, "Ref for qualify queue");
+		AST_DLLIST_INSERT_TAIL(&qualify_queue, data, next);
+	}
+	push = !qualify_batch_pending;
+	qualify_batch_pending = 1;
+	AST_DLLIST_UNLOCK(&qualify_queue);
+
+	if (push) {
+		qualify_batch_sched(NULL);
+	}
+}
+
 /*!
  * \internal
- * \brief Send a scheduled qualify contact request.
+ * \brief Take a scheduled contact out of the qualify queue.
+ */
+static void qualify_dequeue(struct sched_data *data)
+{
+	int queued;
+
+	AST_DLLIST_LOCK(&qualify_queue);
+	queued = data->queued;
+	if (queued) {
+		data->queued = 0;
+		AST_DLLIST_REMOVE(&qualify_queue, data, next);
+	}
+	AST_DLLIST_UNLOCK(&qualify_queue);
+
+	if (queued) {
+		ao2_t_ref(data, -1, "Removed from qualify queue");
+	}
+}
+
+/*!
+ * \internal
+ * \brief The time until a contact's next qualify.
+ *
+ * \details The qualify frequency varied by up to 5% either way, so contacts
+ * first qualified together drift apart rather than staying in step.
+ */
+static int qualify_interval(const struct ast_sip_contact *contact)
+{
+	int interval = contact->qualify_frequency * 1000;
+
+	return interval + (int) (interval * (ast_random_double() - 0.5) / 10);
+}
+
+/*!
+ * \internal
+ * \brief Queue a scheduled qualify contact request.
  */
 static int qualify_contact_sched(const void *obj)
 {
 	struct sched_data *data = (struct sched_data *) obj;
 
-	ao2_ref(data->contact, +1);
-	if (ast_sip_push_task(NULL, qualify_contact_task, data->contact)) {
-		ao2_ref(data->contact, -1);
-	}
+	qualify_enqueue(data);
 
 	/*
 	 * Always reschedule rather than have a potential race cleaning
 	 * up the data object ref between self deletion and an external
 	 * deletion.
 	 */
-	return data->contact->qualify_frequency * 1000;
+	return qualify_interval(data->contact);
 }
 
 /*!
  * \internal
  * \brief Set up a scheduled qualify contact check.
+ *
+ * \param contact The contact to qualify
+ * \param initial_interval Milliseconds until the first scheduled qualify
+ * \param now Also queue a qualify straight away
  */
-static void schedule_qualify(struct ast_sip_contact *contact, int initial_interval)
+static void schedule_qualify(struct ast_sip_contact *contact, int initial_interval, int now)
 {
 	struct sched_data *data;
 
@@ -503,6 +672,8 @@ static void schedule_qualify(struct ast_sip_contact *contact, int initial_interv
 	} else if (!ao2_link(sched_qualifies, data)) {
 		AST_SCHED_DEL_UNREF(sched, data->id,
 			ao2_t_ref(data, -1, "Cleanup scheduler for failed ao2_link"));
+	} else if (now) {
+		qualify_enqueue(data);
 	}
 	ao2_t_ref(data, -1, "Done setting up scheduler entry");
 }
@@ -522,6 +693,7 @@ static void unschedule_qualify(struct ast_sip_contact *contact)
 
 	AST_SCHED_DEL_UNREF(sched, data->id,
 		ao2_t_ref(data, -1, "Delete scheduler entry ref"));
+	qualify_dequeue(data);
 	ao2_t_ref(data, -1, "Done with ao2_find ref");
 }
 
@@ -534,12 +706,7 @@ static void qualify_and_schedule(struct ast_sip_contact *contact)
 	unschedule_qualify(contact);
 
 	if (contact->qualify_frequency) {
-		ao2_ref(contact, +1);
-		if (ast_sip_push_task(NULL, qualify_contact_task, contact)) {
-			ao2_ref(contact, -1);
-		}
-
-		schedule_qualify(contact, contact->qualify_frequency * 1000);
+		schedule_qualify(contact, qualify_interval(contact), 1);
 	} else {
 		update_contact_status(contact, UNKNOWN);
 	}
@@ -595,8 +762,17 @@ static pj_bool_t options_start(void)
 		return -1;
 	}
 
+	qualify_serializer = ast_sip_create_serializer();
+	if (!qualify_serializer) {
+		ast_sched_context_destroy(sched);
+		sched = NULL;
+		return -1;
+	}
+
 	if (ast_sorcery_observer_add(ast_sip_get_sorcery(), "contact", &contact_observer)) {
 		ast_log(LOG_WARNING, "Unable to add contact observer\n");
+		ast_taskprocessor_unreference(qualify_serializer);
+		qualify_serializer = NULL;
 		ast_sched_context_destroy(sched);
 		sched = NULL;
 		return -1;
@@ -613,6 +789,8 @@ static int sched_qualifies_empty(void *obj, void *arg, int flags)
 
 static pj_bool_t options_stop(void)
 {
+	struct sched_data *data;
+
 	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "contact", &contact_observer);
 
 	if (sched) {
@@ -624,6 +802,16 @@ static pj_bool_t options_stop(void)
 	ao2_callback(sched_qualifies, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE,
 		sched_qualifies_empty, NULL);
 
+	AST_DLLIST_LOCK(&qualify_queue);
+	while ((data = AST_DLLIST_REMOVE_HEAD(&qualify_queue, next))) {
+		data->queued = 0;
+		ao2_t_ref(data, -1, "Release ref held by qualify queue");
+	}
+	AST_DLLIST_UNLOCK(&qualify_queue);
+
+	ast_taskprocessor_unreference(qualify_serializer);
+	qualify_serializer = NULL;
+
 	return PJ_SUCCESS;
 }
 
@@ -1058,7 +1246,7 @@ static int qualify_and_schedule_cb(void *obj, void *arg, int flags)
 
 	unschedule_qualify(contact);
 	if (contact->qualify_frequency) {
-		schedule_qualify(contact, initial_interval);
+		schedule_qualify(contact, initial_interval, 0);
 	} else {
 		update_contact_status(contact, UNKNOWN);
 	}
@@ -1114,6 +1302,7 @@ static int unschedule_all_cb(void *obj, void *arg, int flags)
 	struct sched_data *data = obj;
 
 	AST_SCHED_DEL_UNREF(sched, data->id, ao2_ref(data, -1));
+	qualify_dequeue(data);
 
 	return CMP_MATCH;
 }
@@ -1232,8 +1421,9 @@ int ast_res_pjsip_init_options_handling(int reload)
 		return 0;
 	}
 
-	sched_qualifies = ao2_t_container_alloc(QUALIFIED_BUCKETS,
-		sched_qualifies_hash_fn, sched_qualifies_cmp_fn,
+	sched_qualifies = ao2_t_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED, QUALIFIED_BUCKETS,
+		sched_qualifies_hash_fn, NULL, sched_qualifies_cmp_fn,
 		"Create container for scheduled qualifies");
 	if (!sched_qualifies) {
 		return -1;
@@ -31,6 +31,7 @@
 #include "asterisk/module.h"
 #include "asterisk/acl.h"
 #include "asterisk/manager.h"
+#include "asterisk/vector.h"
 #include "res_pjsip/include/res_pjsip_private.h"
 
 /*** DOCUMENTATION
@@ -115,24 +116,314 @@ static int ip_identify_match_check(void *obj, void *arg, int flags)
 	}
 }
 
+/*!
+ * \brief A node of the radix trie of identify match networks
+ *
+ * Each node holds a prefix of an address and the identify objects with a
+ * match network of exactly that prefix. Nodes with one child are only kept
+ * if they hold identify objects, so the trie never has more nodes than
+ * twice the number of networks.
+ */
+struct ip_trie_node {
+	/*! The prefix, with the bits after len zeroed */
+	unsigned char prefix[16];
+	/*! Number of bits in the prefix */
+	int len;
+	/*! The nodes whose next bit is 0 and 1 */
+	struct ip_trie_node *child[2];
+	/*! The identify objects with this network, each with a reference */
+	AST_VECTOR(, struct ip_identify_match *) identifies;
+};
+
+/*! \brief The match networks of all identify objects, replaced whole on change */
+struct ip_trie {
+	/*! Networks of IPv4 match entries */
+	struct ip_trie_node *root4;
+	/*! Networks of IPv6 match entries */
+	struct ip_trie_node *root6;
+};
+
+/*! \brief The current trie, or none if identify objects cannot all be known up front */
+static AO2_GLOBAL_OBJ_STATIC(current_trie);
+
+/*! \brief Serializes rebuilding the trie */
+AST_MUTEX_DEFINE_STATIC(trie_lock);
+
+static void ip_trie_node_free(struct ip_trie_node *node)
+{
+	if (!node) {
+		return;
+	}
+
+	ip_trie_node_free(node->child[0]);
+	ip_trie_node_free(node->child[1]);
+	AST_VECTOR_CALLBACK_VOID(&node->identifies, ao2_cleanup);
+	AST_VECTOR_FREE(&node->identifies);
+	ast_free(node);
+}
+
+static void ip_trie_destroy(void *obj)
+{
+	struct ip_trie *trie = obj;
+
+	ip_trie_node_free(trie->root4);
+	ip_trie_node_free(trie->root6);
+}
+
+static int ip_trie_bit(const unsigned char *key, int bit)
+{
+	return (key[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/*! \brief Number of leading bits, up to max, that two keys have in common */
+static int ip_trie_common_bits(const unsigned char *a, const unsigned char *b, int max)
+{
+	int bit;
+
+	for (bit = 0; bit < max && a[bit / 8] == b[bit / 8]; bit += 8) {
+	}
+	for (; bit < max && ip_trie_bit(a, bit) == ip_trie_bit(b, bit); ++bit) {
+	}
+	return MIN(bit, max);
+}
+
+/*!
+ * \brief The key of an address
+ *
+ * \return The number of bits in the key, 32 for IPv4 and 128 for IPv6
+ */
+static int ip_trie_key(const struct ast_sockaddr *addr, unsigned char key[16])
+{
+	if (ast_sockaddr_is_ipv4(addr)) {
+		uint32_t ipv4 = htonl(ast_sockaddr_ipv4(addr));
+
+		memcpy(key, &ipv4, sizeof(ipv4));
+		return 32;
+	}
+
+	memcpy(key, ((const struct sockaddr_in6 *) &addr->ss)->sin6_addr.s6_addr, 16);
+	return 128;
+}
+
+static struct ip_trie_node *ip_trie_node_alloc(const unsigned char *key, int len)
+{
+	struct ip_trie_node *node = ast_calloc(1, sizeof(*node));
+	int i;
+
+	if (!node) {
+		return NULL;
+	}
+
+	node->len = len;
+	for (i = 0; i < len; ++i) {
+		if (ip_trie_bit(key, i)) {
+			node->prefix[i / 8] |= 1 << (7 - i % 8);
+		}
+	}
+	return node;
+}
+
+/*! \brief Add a match network of an identify object to the trie */
+static int ip_trie_insert(struct ip_trie_node **nodep, const unsigned char *key, int len,
+	struct ip_identify_match *identify)
+{
+	struct ip_trie_node *node;
+	int i;
+
+	while ((node = *nodep)) {
+		int common = ip_trie_common_bits(node->prefix, key, MIN(node->len, len));
+
+		if (common < node->len) {
+			/* The network branches off part way along this node */
+			struct ip_trie_node *parent = ip_trie_node_alloc(key, common);
+
+			if (!parent) {
+				return -1;
+			}
+			parent->child[ip_trie_bit(node->prefix, common)] = node;
+			*nodep = node = parent;
+		}
+		if (node->len == len) {
+			break;
+		}
+		nodep = &node->child[ip_trie_bit(key, node->len)];
+	}
+
+	if (!node && !(node = *nodep = ip_trie_node_alloc(key, len))) {
+		return -1;
+	}
+
+	for (i = 0; i < AST_VECTOR_SIZE(&node->identifies); ++i) {
+		if (AST_VECTOR_GET(&node->identifies, i) == identify) {
+			return 0;
+		}
+	}
+	if (AST_VECTOR_APPEND(&node->identifies, identify)) {
+		return -1;
+	}
+	ao2_ref(identify, +1);
+	return 0;
+}
+
+/*! \brief Add the match networks of an identify object to the trie */
+static int ip_trie_add(void *obj, void *arg, int flags)
+{
+	struct ip_identify_match *identify = obj;
+	struct ip_trie *trie = arg;
+	struct ast_ha *ha;
+
+	for (ha = identify->matches; ha; ha = ha->next) {
+		unsigned char key[16];
+		unsigned char mask[16];
+		int bits;
+		int len;
+
+		/* Entries with a '!' only exclude addresses from a wider network */
+		if (ha->sense == AST_SENSE_ALLOW) {
+			continue;
+		}
+
+		bits = ip_trie_key(&ha->addr, key);
+		ip_trie_key(&ha->netmask, mask);
+		/* A mask that is not contiguous is filed under its leading bits */
+		for (len = 0; len < bits && ip_trie_bit(mask, len); ++len) {
+		}
+
+		if (ip_trie_insert(bits == 32 ? &trie->root4 : &trie->root6, key, len, identify)) {
+			return CMP_MATCH | CMP_STOP;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Whether every identify object is known to sorcery up front
+ *
+ * Objects in realtime or other backends are only seen when retrieved and
+ * changes to them are not observed, so they must be searched each time.
+ */
+static int ip_trie_possible(void)
+{
+	int count = ast_sorcery_get_wizard_mapping_count(ast_sip_get_sorcery(), "identify");
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		struct ast_sorcery_wizard *wizard;
+		int possible;
+
+		if (ast_sorcery_get_wizard_mapping(ast_sip_get_sorcery(), "identify", i, &wizard, NULL)) {
+			return 0;
+		}
+		possible = !strcmp(wizard->name, "config") || !strcmp(wizard->name, "memory");
+		ao2_ref(wizard, -1);
+		if (!possible) {
+			return 0;
+		}
+	}
+
+	return count > 0;
+}
+
+/*! \brief Build the trie from the current identify objects */
+static void ip_trie_rebuild(void)
+{
+	struct ao2_container *identifies;
+	struct ip_trie *trie = NULL;
+	struct ip_identify_match *failed = NULL;
+
+	ast_mutex_lock(&trie_lock);
+	if (ip_trie_possible()) {
+		identifies = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(), "identify",
+			AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
+		trie = ao2_alloc_options(sizeof(*trie), ip_trie_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (trie && (!identifies
+			|| (failed = ao2_callback(identifies, 0, ip_trie_add, trie)))) {
+			ao2_cleanup(failed);
+			ast_log(LOG_WARNING, "Unable to index identify match networks, searching all identify sections instead\n");
+			ao2_ref(trie, -1);
+			trie = NULL;
+		}
+		ao2_cleanup(identifies);
+	}
+	ao2_global_obj_replace_unref(current_trie, trie);
+	ao2_cleanup(trie);
+	ast_mutex_unlock(&trie_lock);
+}
+
+/*!
+ * \brief Find the identify object with the longest network matching an address
+ *
+ * Every node along the address's path holds a network that contains it.
+ * An identify object filed there still needs to match as a whole, since its
+ * other entries may exclude the address.
+ */
+static struct ip_identify_match *ip_trie_find(struct ip_trie *trie, const struct ast_sockaddr *addr)
+{
+	struct ip_trie_node *path[129];
+	struct ip_trie_node *node;
+	struct ast_sockaddr mapped;
+	unsigned char key[16];
+	int depth = 0;
+	int bits;
+	int i;
+
+	/* IPv4 match entries apply to IPv4-mapped addresses */
+	if (ast_sockaddr_is_ipv4_mapped(addr) && ast_sockaddr_ipv4_mapped(addr, &mapped)) {
+		addr = &mapped;
+	}
+	bits = ip_trie_key(addr, key);
+
+	for (node = bits == 32 ? trie->root4 : trie->root6; node; node = node->child[ip_trie_bit(key, node->len)]) {
+		if (ip_trie_common_bits(node->prefix, key, node->len) < node->len) {
+			break;
+		}
+		if (AST_VECTOR_SIZE(&node->identifies)) {
+			path[depth++] = node;
+		}
+		if (node->len == bits) {
+			break;
+		}
+	}
+
+	while (depth--) {
+		for (i = 0; i < AST_VECTOR_SIZE(&path[depth]->identifies); ++i) {
+			struct ip_identify_match *identify = AST_VECTOR_GET(&path[depth]->identifies, i);
+
+			if (ip_identify_match_check(identify, (void *) addr, 0)) {
+				return ao2_bump(identify);
+			}
+		}
+	}
+
+	return NULL;
+}
+
 static struct ast_sip_endpoint *ip_identify(pjsip_rx_data *rdata)
 {
 	struct ast_sockaddr addr = { { 0, } };
 	RAII_VAR(struct ao2_container *, candidates, NULL, ao2_cleanup);
 	RAII_VAR(struct ip_identify_match *, match, NULL, ao2_cleanup);
+	RAII_VAR(struct ip_trie *, trie, ao2_global_obj_ref(current_trie), ao2_cleanup);
 	struct ast_sip_endpoint *endpoint;
 
-	/* If no possibilities exist return early to save some time */
-	if (!(candidates = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(), "identify", AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL)) ||
-		!ao2_container_count(candidates)) {
-		ast_debug(3, "No identify sections to match against\n");
-		return NULL;
-	}
-
 	ast_sockaddr_parse(&addr, rdata->pkt_info.src_name, PARSE_PORT_FORBID);
 	ast_sockaddr_set_port(&addr, rdata->pkt_info.src_port);
 
-	if (!(match = ao2_callback(candidates, 0, ip_identify_match_check, &addr))) {
+	if (trie) {
+		match = ip_trie_find(trie, &addr);
+	} else {
+		/* If no possibilities exist return early to save some time */
+		if (!(candidates = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(), "identify", AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL)) ||
+			!ao2_container_count(candidates)) {
+			ast_debug(3, "No identify sections to match against\n");
+			return NULL;
+		}
+
+		match = ao2_callback(candidates, 0, ip_identify_match_check, &addr);
+	}
+
+	if (!match) {
 		ast_debug(3, "'%s' did not match any identify section rules\n",
 				ast_sockaddr_stringify(&addr));
 		return NULL;
@@ -149,6 +440,24 @@ static struct ast_sip_endpoint *ip_identify(pjsip_rx_data *rdata)
 	return endpoint;
 }
 
+static void ip_identify_changed(const void *obj)
+{
+	ip_trie_rebuild();
+}
+
+static void ip_identify_loaded(const char *object_type)
+{
+	ip_trie_rebuild();
+}
+
+/*! \brief Rebuilds the trie whenever identify objects change */
+static const struct ast_sorcery_observer ip_identify_observer = {
+	.created = ip_identify_changed,
+	.updated = ip_identify_changed,
+	.deleted = ip_identify_changed,
+	.loaded = ip_identify_loaded,
+};
+
 static struct ast_sip_endpoint_identifier ip_identifier = {
 	.identify_endpoint = ip_identify,
 };
@@ -465,7 +774,9 @@ static int load_module(void)
 	ast_sorcery_object_field_register(ast_sip_get_sorcery(), "identify", "type", "", OPT_NOOP_T, 0, 0);
 	ast_sorcery_object_field_register(ast_sip_get_sorcery(), "identify", "endpoint", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ip_identify_match, endpoint_name));
 	ast_sorcery_object_field_register_custom(ast_sip_get_sorcery(), "identify", "match", "", ip_identify_match_handler, match_to_str, match_to_var_list, 0, 0);
+	ast_sorcery_observer_add(ast_sip_get_sorcery(), "identify", &ip_identify_observer);
 	ast_sorcery_reload_object(ast_sip_get_sorcery(), "identify");
+	ip_trie_rebuild();
 
 	ast_sip_register_endpoint_identifier_with_name(&ip_identifier, "ip");
 	ast_sip_register_endpoint_formatter(&endpoint_identify_formatter);
@@ -502,6 +813,8 @@ static int unload_module(void)
 	ast_sip_unregister_cli_formatter(cli_formatter);
 	ast_sip_unregister_endpoint_formatter(&endpoint_identify_formatter);
 	ast_sip_unregister_endpoint_identifier(&ip_identifier);
+	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "identify", &ip_identify_observer);
+	ao2_global_obj_release(current_trie);
 
 	return 0;
 }
@@ -38,12 +38,26 @@
 #include "asterisk/sorcery.h"
 #include "asterisk/stasis.h"
 #include "asterisk/app.h"
+#include "asterisk/sched.h"
+#include "asterisk/vector.h"
 
 struct mwi_subscription;
 static struct ao2_container *unsolicited_mwi;
+static struct ao2_container *mwi_mailboxes;
+
+/*! \brief Scheduler used to pace NOTIFYs to the watchers of a mailbox */
+static struct ast_sched_context *sched;
 
 #define STASIS_BUCKETS 13
 #define MWI_BUCKETS 53
+#define MAILBOX_BUCKETS 211
+
+/*! \brief NOTIFYs queued to be sent at once when a mailbox changes */
+#define MWI_FANOUT_BATCH 50
+/*! \brief Milliseconds between batches of NOTIFYs when a mailbox changes */
+#define MWI_FANOUT_INTERVAL 10
+/*! \brief Milliseconds between batches of the initial unsolicited NOTIFYs */
+#define MWI_INITIAL_INTERVAL 100
 
 #define MWI_TYPE "application"
 #define MWI_SUBTYPE "simple-message-summary"
@@ -74,18 +88,50 @@ static struct ast_sip_subscription_handler mwi_handler = {
 };
 
 /*!
- * \brief Wrapper for stasis subscription
+ * \brief A mailbox shared by every MWI subscription to it
+ *
+ * However many endpoints watch a mailbox, it is subscribed to in stasis
+ * once. Its latest message counts are kept here, so a change is read once
+ * and not looked up again in the stasis cache for each watcher.
+ */
+struct mwi_mailbox {
+	/*! The stasis subscription to the mailbox's MWI topic */
+	struct stasis_subscription *stasis_sub;
+	/*! The \ref mwi_subscription structures watching the mailbox */
+	struct ao2_container *watchers;
+	/*! The latest count of new messages */
+	int new_msgs;
+	/*! The latest count of old messages */
+	int old_msgs;
+	/*! The mailbox name. Used as a hash key */
+	char mailbox[1];
+};
+
+/*!
+ * \brief Wrapper for a watched mailbox
  *
  * An MWI subscription has a container of these. This
- * represents a stasis subscription for MWI state.
+ * represents the MWI subscription watching a shared mailbox.
  */
 struct mwi_stasis_subscription {
-	/*! The MWI stasis subscription */
-	struct stasis_subscription *stasis_sub;
+	/*! The shared mailbox */
+	struct mwi_mailbox *shared;
+	/*! The MWI subscription watching the mailbox. Not a reference */
+	struct mwi_subscription *owner;
 	/*! The mailbox corresponding with the MWI subscription. Used as a hash key */
 	char mailbox[1];
 };
 
+/*! \brief NOTIFYs waiting to be sent to the watchers of a mailbox, a batch at a time */
+struct mwi_fanout {
+	/*! The MWI subscriptions to notify */
+	AST_VECTOR(, struct mwi_subscription *) subs;
+	/*! The next MWI subscription to notify */
+	size_t next;
+	/*! Milliseconds between batches */
+	int interval;
+};
+
 /*!
  * \brief A subscription for MWI
  *
@@ -120,10 +166,63 @@ struct mwi_subscription {
 static void mwi_stasis_cb(void *userdata, struct stasis_subscription *sub,
 		struct stasis_message *msg);
 
+static void mwi_mailbox_destructor(void *obj)
+{
+	struct mwi_mailbox *shared = obj;
+
+	ao2_cleanup(shared->watchers);
+}
+
+/*!
+ * \internal
+ * \brief Create a shared mailbox and subscribe to it in stasis
+ *
+ * \note Called with the mwi_mailboxes container lock held.
+ */
+static struct mwi_mailbox *mwi_mailbox_alloc(const char *mailbox)
+{
+	struct mwi_mailbox *shared;
+	struct stasis_message *msg;
+
+	shared = ao2_alloc(sizeof(*shared) + strlen(mailbox), mwi_mailbox_destructor);
+	if (!shared) {
+		return NULL;
+	}
+
+	/* Safe strcpy */
+	strcpy(shared->mailbox, mailbox);
+
+	shared->watchers = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_MUTEX, 0, NULL, NULL);
+	if (!shared->watchers) {
+		ao2_ref(shared, -1);
+		return NULL;
+	}
+
+	msg = stasis_cache_get(ast_mwi_state_cache(), ast_mwi_state_type(), mailbox);
+	if (msg) {
+		struct ast_mwi_state *mwi_state = stasis_message_data(msg);
+
+		shared->new_msgs = mwi_state->new_msgs;
+		shared->old_msgs = mwi_state->old_msgs;
+		ao2_ref(msg, -1);
+	}
+
+	ast_debug(3, "Creating stasis MWI subscription to mailbox %s\n", mailbox);
+	ao2_ref(shared, +1);
+	shared->stasis_sub = stasis_subscribe_pool(ast_mwi_topic(mailbox), mwi_stasis_cb, shared);
+	if (!shared->stasis_sub) {
+		/* Failed to subscribe. */
+		ao2_ref(shared, -2);
+		return NULL;
+	}
+
+	ao2_link_flags(mwi_mailboxes, shared, OBJ_NOLOCK);
+	return shared;
+}
+
 static struct mwi_stasis_subscription *mwi_stasis_subscription_alloc(const char *mailbox, struct mwi_subscription *mwi_sub)
 {
 	struct mwi_stasis_subscription *mwi_stasis_sub;
-	struct stasis_topic *topic;
 
 	if (!mwi_sub) {
 		return NULL;
@@ -134,24 +233,70 @@ static struct mwi_stasis_subscription *mwi_stasis_subscription_alloc(const char
 		return NULL;
 	}
 
-	topic = ast_mwi_topic(mailbox);
-
 	/* Safe strcpy */
 	strcpy(mwi_stasis_sub->mailbox, mailbox);
+	mwi_stasis_sub->owner = mwi_sub;
 
-	ast_debug(3, "Creating stasis MWI subscription to mailbox %s for endpoint %s\n",
-		mailbox, mwi_sub->id);
-	ao2_ref(mwi_sub, +1);
-	mwi_stasis_sub->stasis_sub = stasis_subscribe_pool(topic, mwi_stasis_cb, mwi_sub);
-	if (!mwi_stasis_sub->stasis_sub) {
-		/* Failed to subscribe. */
+	ast_debug(3, "Watching mailbox %s for endpoint %s\n", mailbox, mwi_sub->id);
+
+	/* Finding and joining the mailbox happen together so it cannot be unsubscribed in between */
+	ao2_lock(mwi_mailboxes);
+	mwi_stasis_sub->shared = ao2_find(mwi_mailboxes, mailbox, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!mwi_stasis_sub->shared) {
+		mwi_stasis_sub->shared = mwi_mailbox_alloc(mailbox);
+	}
+	if (!mwi_stasis_sub->shared || !ao2_link(mwi_stasis_sub->shared->watchers, mwi_sub)) {
+		ao2_unlock(mwi_mailboxes);
+		ao2_cleanup(mwi_stasis_sub->shared);
 		ao2_ref(mwi_stasis_sub, -1);
-		ao2_ref(mwi_sub, -1);
-		mwi_stasis_sub = NULL;
+		return NULL;
 	}
+	ao2_unlock(mwi_mailboxes);
+
 	return mwi_stasis_sub;
 }
 
+static int mailbox_hash(const void *obj, const int flags)
+{
+	const struct mwi_mailbox *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->mailbox;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int mailbox_cmp(void *obj, void *arg, int flags)
+{
+	const struct mwi_mailbox *left = obj;
+	const struct mwi_mailbox *right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->mailbox;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		if (strcmp(left->mailbox, right_key)) {
+			return 0;
+		}
+		break;
+	default:
+		break;
+	}
+	return CMP_MATCH;
+}
+
 static int stasis_sub_hash(const void *obj, const int flags)
 {
 	const struct mwi_stasis_subscription *object;
@@ -307,21 +452,13 @@ static int mwi_sub_cmp(void *obj, void *arg, int flags)
 
 static int get_message_count(void *obj, void *arg, int flags)
 {
-	struct stasis_message *msg;
 	struct mwi_stasis_subscription *mwi_stasis = obj;
 	struct ast_sip_message_accumulator *counter = arg;
-	struct ast_mwi_state *mwi_state;
-
-	msg = stasis_cache_get(ast_mwi_state_cache(), ast_mwi_state_type(), mwi_stasis->mailbox);
-	if (!msg) {
-		return 0;
-	}
-
-	mwi_state = stasis_message_data(msg);
-	counter->old_msgs += mwi_state->old_msgs;
-	counter->new_msgs += mwi_state->new_msgs;
 
-	ao2_ref(msg, -1);
+	ao2_lock(mwi_stasis->shared);
+	counter->old_msgs += mwi_stasis->shared->old_msgs;
+	counter->new_msgs += mwi_stasis->shared->new_msgs;
+	ao2_unlock(mwi_stasis->shared);
 
 	return 0;
 }
@@ -482,10 +619,30 @@ static void send_mwi_notify(struct mwi_subscription *sub)
 static int unsubscribe_stasis(void *obj, void *arg, int flags)
 {
 	struct mwi_stasis_subscription *mwi_stasis = obj;
-	if (mwi_stasis->stasis_sub) {
+	struct mwi_mailbox *shared = mwi_stasis->shared;
+	struct stasis_subscription *stasis_sub = NULL;
+
+	if (!shared) {
+		return CMP_MATCH;
+	}
+
+	/* The last watcher to leave unsubscribes the mailbox */
+	ao2_lock(mwi_mailboxes);
+	ao2_unlink(shared->watchers, mwi_stasis->owner);
+	if (!ao2_container_count(shared->watchers)) {
+		ao2_unlink_flags(mwi_mailboxes, shared, OBJ_NOLOCK);
+		stasis_sub = shared->stasis_sub;
+		shared->stasis_sub = NULL;
+	}
+	ao2_unlock(mwi_mailboxes);
+
+	if (stasis_sub) {
 		ast_debug(3, "Removing stasis subscription to mailbox %s\n", mwi_stasis->mailbox);
-		mwi_stasis->stasis_sub = stasis_unsubscribe_and_join(mwi_stasis->stasis_sub);
+		stasis_unsubscribe_and_join(stasis_sub);
 	}
+
+	mwi_stasis->shared = NULL;
+	ao2_ref(shared, -1);
 	return CMP_MATCH;
 }
 
@@ -830,21 +987,6 @@ static int serialized_notify(void *userdata)
 	return 0;
 }
 
-static int serialized_cleanup(void *userdata)
-{
-	struct mwi_subscription *mwi_sub = userdata;
-
-	/* This is getting rid of the reference that was added
-	 * just before this serialized task was pushed.
-	 */
-	ao2_cleanup(mwi_sub);
-	/* This is getting rid of the reference held by the
-	 * stasis subscription
-	 */
-	ao2_cleanup(mwi_sub);
-	return 0;
-}
-
 static int send_notify(void *obj, void *arg, int flags)
 {
 	struct mwi_subscription *mwi_sub = obj;
@@ -859,20 +1001,122 @@ static int send_notify(void *obj, void *arg, int flags)
 	return 0;
 }
 
+static void mwi_fanout_destroy(struct mwi_fanout *fanout)
+{
+	AST_VECTOR_CALLBACK_VOID(&fanout->subs, ao2_ref, -1);
+	AST_VECTOR_FREE(&fanout->subs);
+	ast_free(fanout);
+}
+
+/*! \brief Queue the next batch of NOTIFYs, returning whether any are left */
+static int mwi_fanout_batch(struct mwi_fanout *fanout)
+{
+	size_t end = MIN(fanout->next + MWI_FANOUT_BATCH, AST_VECTOR_SIZE(&fanout->subs));
+
+	for (; fanout->next < end; ++fanout->next) {
+		send_notify(AST_VECTOR_GET(&fanout->subs, fanout->next), NULL, 0);
+	}
+
+	return fanout->next < AST_VECTOR_SIZE(&fanout->subs);
+}
+
+static int mwi_fanout_sched_cb(const void *data)
+{
+	struct mwi_fanout *fanout = (struct mwi_fanout *) data;
+
+	if (mwi_fanout_batch(fanout)) {
+		return fanout->interval;
+	}
+
+	mwi_fanout_destroy(fanout);
+	return 0;
+}
+
+static int mwi_fanout_sched_cleanup(const void *data)
+{
+	mwi_fanout_destroy((struct mwi_fanout *) data);
+	return 0;
+}
+
+static int mwi_fanout_add(void *obj, void *arg, int flags)
+{
+	struct mwi_fanout *fanout = arg;
+
+	if (!AST_VECTOR_APPEND(&fanout->subs, obj)) {
+		ao2_ref(obj, +1);
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Send NOTIFYs to MWI subscriptions a batch at a time
+ *
+ * Rather than queueing a NOTIFY for every watcher of a mailbox at once,
+ * which leaves other work waiting behind them, the first batch is queued
+ * now and the rest every interval milliseconds.
+ *
+ * \param subs The MWI subscriptions to notify
+ * \param interval Milliseconds between batches
+ */
+static void mwi_fanout_start(struct ao2_container *subs, int interval)
+{
+	struct mwi_fanout *fanout;
+
+	fanout = ast_calloc(1, sizeof(*fanout));
+	if (!fanout) {
+		return;
+	}
+	fanout->interval = interval;
+
+	if (AST_VECTOR_INIT(&fanout->subs, ao2_container_count(subs) ?: 1)) {
+		ast_free(fanout);
+		return;
+	}
+	ao2_callback(subs, OBJ_NODATA, mwi_fanout_add, fanout);
+
+	if (!mwi_fanout_batch(fanout)) {
+		mwi_fanout_destroy(fanout);
+		return;
+	}
+
+	if (ast_sched_add_variable(sched, interval, mwi_fanout_sched_cb, fanout, 1) < 0) {
+		/* Send the rest now rather than not at all */
+		while (mwi_fanout_batch(fanout)) {
+		}
+		mwi_fanout_destroy(fanout);
+	}
+}
+
 static void mwi_stasis_cb(void *userdata, struct stasis_subscription *sub,
 		struct stasis_message *msg)
 {
-	struct mwi_subscription *mwi_sub = userdata;
+	struct mwi_mailbox *shared = userdata;
 
 	if (stasis_subscription_final_message(sub, msg)) {
-		if (ast_sip_push_task(NULL, serialized_cleanup, ao2_bump(mwi_sub))) {
-			ao2_ref(mwi_sub, -1);
-		}
+		ao2_ref(shared, -1);
+		return;
+	}
+
+	if (stasis_cache_clear_type() == stasis_message_type(msg)) {
+		/* The mailbox is gone, so it has no messages */
+		ao2_lock(shared);
+		shared->new_msgs = 0;
+		shared->old_msgs = 0;
+		ao2_unlock(shared);
 		return;
 	}
 
 	if (ast_mwi_state_type() == stasis_message_type(msg)) {
-		send_notify(mwi_sub, NULL, 0);
+		struct ast_mwi_state *mwi_state = stasis_message_data(msg);
+
+		ao2_lock(shared);
+		shared->new_msgs = mwi_state->new_msgs;
+		shared->old_msgs = mwi_state->old_msgs;
+		ao2_unlock(shared);
+
+		mwi_fanout_start(shared->watchers, MWI_FANOUT_INTERVAL);
 	}
 }
 
@@ -1037,10 +1281,10 @@ static const struct ast_sorcery_observer mwi_contact_observer = {
 	.updated = mwi_contact_updated,
 };
 
-/*! \brief Task invoked to send initial MWI NOTIFY for unsolicited */
+/*! \brief Task invoked to send initial MWI NOTIFY for unsolicited, paced so a large system does not send them all at once */
 static int send_initial_notify_all(void *obj)
 {
-	ao2_callback(unsolicited_mwi, OBJ_NODATA, send_notify, NULL);
+	mwi_fanout_start(unsolicited_mwi, MWI_INITIAL_INTERVAL);
 
 	return 0;
 }
@@ -1081,8 +1325,28 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	if (!(sched = ast_sched_context_create())) {
+		ast_sip_unregister_subscription_handler(&mwi_handler);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	if (ast_sched_start_thread(sched)) {
+		ast_sched_context_destroy(sched);
+		ast_sip_unregister_subscription_handler(&mwi_handler);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	mwi_mailboxes = ao2_container_alloc(MAILBOX_BUCKETS, mailbox_hash, mailbox_cmp);
+	if (!mwi_mailboxes) {
+		ast_sched_context_destroy(sched);
+		ast_sip_unregister_subscription_handler(&mwi_handler);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	unsolicited_mwi = ao2_container_alloc(MWI_BUCKETS, mwi_sub_hash, mwi_sub_cmp);
 	if (!unsolicited_mwi) {
+		ao2_ref(mwi_mailboxes, -1);
+		ast_sched_context_destroy(sched);
 		ast_sip_unregister_subscription_handler(&mwi_handler);
 		return AST_MODULE_LOAD_DECLINE;
 	}
@@ -1103,6 +1367,9 @@ static int unload_module(void)
 {
 	ao2_callback(unsolicited_mwi, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, unsubscribe, NULL);
 	ao2_ref(unsolicited_mwi, -1);
+	ast_sched_clean_by_callback(sched, mwi_fanout_sched_cb, mwi_fanout_sched_cleanup);
+	ast_sched_context_destroy(sched);
+	ao2_ref(mwi_mailboxes, -1);
 	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "contact", &mwi_contact_observer);
 	ast_sip_unregister_subscription_handler(&mwi_handler);
 	return 0;
@@ -82,6 +82,14 @@ static void mwi_destroy_body(void *body)
 	ast_free(mwi);
 }
 
+static int mwi_cache_key(void *data, struct ast_str **key)
+{
+	struct ast_sip_message_accumulator *counter = data;
+
+	ast_str_append(key, 0, "%d/%d", counter->new_msgs, counter->old_msgs);
+	return 0;
+}
+
 static struct ast_sip_pubsub_body_generator mwi_generator = {
 	.type = MWI_TYPE,
 	.subtype = MWI_SUBTYPE,
@@ -90,6 +98,7 @@ static struct ast_sip_pubsub_body_generator mwi_generator = {
 	.generate_body_content = mwi_generate_body_content,
 	.to_string = mwi_to_string,
 	.destroy_body = mwi_destroy_body,
+	.cache_key = mwi_cache_key,
 };
 
 static int load_module(void)
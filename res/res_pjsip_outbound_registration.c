@@ -36,6 +36,8 @@
 #include "asterisk/threadstorage.h"
 #include "asterisk/threadpool.h"
 #include "asterisk/statsd.h"
+#include "asterisk/sched.h"
+#include "asterisk/dlinkedlists.h"
 #include "res_pjsip/include/res_pjsip_private.h"
 
 /*** DOCUMENTATION
@@ -222,6 +224,21 @@ AST_THREADSTORAGE(register_callback_invoked);
 /*! \brief Size of the buffer for creating a unique string for the line */
 #define LINE_PARAMETER_SIZE 8
 
+/*! \brief Percentage by which re-registration and retry intervals are varied */
+#define REGISTRATION_JITTER_PERCENT 10
+
+/*! \brief Order in which registrations waiting on the rate limit are sent */
+enum registration_pacing_priority {
+	/*! \brief Refreshing a registration that is still registered */
+	REGISTRATION_PACING_REFRESH = 0,
+	/*! \brief First attempt, or any attempt not following a failure */
+	REGISTRATION_PACING_INITIAL,
+	/*! \brief Retrying after a failure */
+	REGISTRATION_PACING_RETRY,
+	/*! \brief Number of priorities */
+	REGISTRATION_PACING_PRIORITIES,
+};
+
 /*! \brief Various states that an outbound registration may be in */
 enum sip_outbound_registration_status {
 	/*! \brief Currently unregistered */
@@ -346,6 +363,16 @@ struct sip_outbound_registration_client_state {
 	unsigned int destroy:1;
 	/*! \brief Non-zero if we have attempted sending a REGISTER with authentication */
 	unsigned int auth_attempted:1;
+	/*! \brief Set while waiting on the rate limit */
+	unsigned int pacing_queued:1;
+	/*! \brief Priority it is waiting at, while pacing_queued is set */
+	enum registration_pacing_priority pacing_priority;
+	/*! \brief When it started waiting on the rate limit */
+	struct timeval pacing_time;
+	/*! \brief When the last REGISTER was sent */
+	struct timeval sent_time;
+	/*! \brief Link in the rate limit queue */
+	AST_DLLIST_ENTRY(sip_outbound_registration_client_state) pacing_next;
 };
 
 /*! \brief Outbound registration state information (persists for lifetime that registration should exist) */
@@ -362,6 +389,40 @@ struct sip_outbound_registration_state {
 /*! Shutdown group to monitor sip_outbound_registration_client_state serializers. */
 static struct ast_serializer_shutdown_group *shutdown_group;
 
+/*! \brief Registrations waiting on the rate limit, each holding a reference */
+static AST_DLLIST_HEAD_NOLOCK(, sip_outbound_registration_client_state) pacing_queues[REGISTRATION_PACING_PRIORITIES];
+
+/*! \brief Protects the rate limit queues, state and statistics */
+AST_MUTEX_DEFINE_STATIC(pacing_lock);
+
+/*! \brief Scheduler sending registrations held by the rate limit */
+static struct ast_sched_context *pacing_sched;
+
+/*! \brief Scheduler id of the next run of the rate limit, -1 if none */
+static int pacing_sched_id = -1;
+
+/*! \brief REGISTER requests the rate limit allows to be sent now */
+static double pacing_tokens;
+
+/*! \brief When pacing_tokens was last topped up */
+static struct timeval pacing_tokens_time;
+
+/*! \brief Statistics about outbound registration pacing and responses */
+static struct {
+	/*! \brief Registrations sent after waiting on the rate limit */
+	unsigned int paced;
+	/*! \brief Longest wait on the rate limit, in milliseconds */
+	int64_t wait_max;
+	/*! \brief Responses received */
+	unsigned int responses;
+	/*! \brief Sum of response round trip times, in milliseconds */
+	int64_t rtt_total;
+	/*! \brief Shortest response round trip time, in milliseconds */
+	int64_t rtt_min;
+	/*! \brief Longest response round trip time, in milliseconds */
+	int64_t rtt_max;
+} pacing_stats;
+
 /*! \brief Default number of state container buckets */
 #define DEFAULT_STATE_BUCKETS 53
 static AO2_GLOBAL_OBJ_STATIC(current_states);
@@ -494,10 +555,25 @@ static struct ast_sip_endpoint_identifier line_identifier = {
 /*! \brief Helper function which cancels the timer on a client */
 static void cancel_registration(struct sip_outbound_registration_client_state *client_state)
 {
+	int queued;
+
 	if (pj_timer_heap_cancel(pjsip_endpt_get_timer_heap(ast_sip_get_pjsip_endpoint()), &client_state->timer)) {
 		/* The timer was successfully cancelled, drop the refcount of client_state */
 		ao2_ref(client_state, -1);
 	}
+
+	ast_mutex_lock(&pacing_lock);
+	queued = client_state->pacing_queued;
+	if (queued) {
+		AST_DLLIST_REMOVE(&pacing_queues[client_state->pacing_priority], client_state, pacing_next);
+		client_state->pacing_queued = 0;
+	}
+	ast_mutex_unlock(&pacing_lock);
+
+	if (queued) {
+		/* It was waiting on the rate limit, drop the reference the queue held */
+		ao2_ref(client_state, -1);
+	}
 }
 
 static pj_str_t PATH_NAME = { "path", 4 };
@@ -517,6 +593,7 @@ static pj_status_t registration_client_send(struct sip_outbound_registration_cli
 
 	/* Due to the message going out the callback may now be invoked, so bump the count */
 	ao2_ref(client_state, +1);
+	client_state->sent_time = ast_tvnow();
 	status = pjsip_regc_send(client_state->client, tdata);
 
 	/* If the attempt to send the message failed and the callback was not invoked we need to
@@ -572,6 +649,131 @@ static int handle_client_registration(void *data)
 	return 0;
 }
 
+/*! \brief Helper function which passes a due registration, and its reference, to its serializer */
+static void registration_dispatch(struct sip_outbound_registration_client_state *client_state)
+{
+	if (ast_sip_push_task(client_state->serializer, handle_client_registration, client_state)) {
+		ast_log(LOG_WARNING, "Scheduled outbound registration could not be executed.\n");
+		ao2_ref(client_state, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Send the registrations the rate limit allows now
+ *
+ * \details Runs on the pacing scheduler. Refreshes are sent before first
+ * attempts, and first attempts before retries.
+ *
+ * \return Milliseconds until it should run again, 0 once nothing is waiting
+ */
+static int registration_pacing_run(const void *data)
+{
+	unsigned int rate = ast_sip_get_max_outbound_registration_rate();
+	struct timeval now = ast_tvnow();
+	int priority = 0;
+
+	ast_mutex_lock(&pacing_lock);
+
+	if (rate) {
+		/* Save up no more than a second's worth so an idle spell is not followed by a burst */
+		pacing_tokens += rate * (ast_tvdiff_us(now, pacing_tokens_time) / 1000000.0);
+		pacing_tokens = MIN(pacing_tokens, rate);
+	}
+	pacing_tokens_time = now;
+
+	while (!rate || pacing_tokens >= 1) {
+		struct sip_outbound_registration_client_state *client_state;
+
+		while (priority < REGISTRATION_PACING_PRIORITIES
+			&& AST_DLLIST_EMPTY(&pacing_queues[priority])) {
+			++priority;
+		}
+		if (priority == REGISTRATION_PACING_PRIORITIES) {
+			pacing_sched_id = -1;
+			ast_mutex_unlock(&pacing_lock);
+			return 0;
+		}
+
+		client_state = AST_DLLIST_REMOVE_HEAD(&pacing_queues[priority], pacing_next);
+		client_state->pacing_queued = 0;
+		pacing_stats.wait_max = MAX(pacing_stats.wait_max,
+			ast_tvdiff_ms(now, client_state->pacing_time));
+		++pacing_stats.paced;
+		if (rate) {
+			--pacing_tokens;
+		}
+
+		/* The reference held by the queue goes to the serializer */
+		registration_dispatch(client_state);
+	}
+
+	ast_mutex_unlock(&pacing_lock);
+
+	return (int) ((1 - pacing_tokens) * 1000 / rate) + 1;
+}
+
+/*!
+ * \internal
+ * \brief Send a due registration, or queue it if the rate limit is in force
+ *
+ * \param client_state The registration, whose reference is passed on
+ */
+static void registration_pace(struct sip_outbound_registration_client_state *client_state)
+{
+	enum registration_pacing_priority priority;
+
+	if (!ast_sip_get_max_outbound_registration_rate() || !pacing_sched) {
+		ast_mutex_lock(&pacing_lock);
+		if (pacing_sched_id < 0 || !pacing_sched) {
+			ast_mutex_unlock(&pacing_lock);
+			registration_dispatch(client_state);
+			return;
+		}
+		/* The limit was just lifted, let the queue empty first to keep the order */
+		ast_mutex_unlock(&pacing_lock);
+	}
+
+	switch (client_state->status) {
+	case SIP_REGISTRATION_REGISTERED:
+		priority = REGISTRATION_PACING_REFRESH;
+		break;
+	case SIP_REGISTRATION_REJECTED_TEMPORARY:
+	case SIP_REGISTRATION_REJECTED_PERMANENT:
+		priority = REGISTRATION_PACING_RETRY;
+		break;
+	default:
+		priority = REGISTRATION_PACING_INITIAL;
+		break;
+	}
+
+	ast_mutex_lock(&pacing_lock);
+	if (client_state->pacing_queued) {
+		/* Already waiting, which should not happen as the timer was cancelled */
+		ast_mutex_unlock(&pacing_lock);
+		ao2_ref(client_state, -1);
+		return;
+	}
+
+	client_state->pacing_queued = 1;
+	client_state->pacing_priority = priority;
+	client_state->pacing_time = ast_tvnow();
+	AST_DLLIST_INSERT_TAIL(&pacing_queues[priority], client_state, pacing_next);
+
+	if (pacing_sched_id < 0) {
+		pacing_sched_id = pacing_sched
+			? ast_sched_add_variable(pacing_sched, 0, registration_pacing_run, NULL, 1) : -1;
+		if (pacing_sched_id < 0) {
+			AST_DLLIST_REMOVE(&pacing_queues[priority], client_state, pacing_next);
+			client_state->pacing_queued = 0;
+			ast_mutex_unlock(&pacing_lock);
+			registration_dispatch(client_state);
+			return;
+		}
+	}
+	ast_mutex_unlock(&pacing_lock);
+}
+
 /*! \brief Timer callback function, used just for registrations */
 static void sip_outbound_registration_timer_cb(pj_timer_heap_t *timer_heap, struct pj_timer_entry *entry)
 {
@@ -580,29 +782,40 @@ static void sip_outbound_registration_timer_cb(pj_timer_heap_t *timer_heap, stru
 	entry->id = 0;
 
 	/*
-	 * Transfer client_state reference to serializer task so the
+	 * Transfer client_state reference to the rate limit so the
 	 * nominal path will not dec the client_state ref in this
 	 * pjproject callback thread.
 	 */
-	if (ast_sip_push_task(client_state->serializer, handle_client_registration, client_state)) {
-		ast_log(LOG_WARNING, "Scheduled outbound registration could not be executed.\n");
-		ao2_ref(client_state, -1);
-	}
+	registration_pace(client_state);
 }
 
-/*! \brief Helper function which sets up the timer to re-register in a specific amount of time */
-static void schedule_registration(struct sip_outbound_registration_client_state *client_state, unsigned int seconds)
+/*!
+ * \brief Helper function which sets up the timer to re-register in a specific amount of time
+ *
+ * \param client_state The registration
+ * \param seconds The time until it re-registers
+ * \param jitter Percentage of the time by which it is made longer, or shorter
+ * if negative, at random. So many registrations scheduled together do not
+ * all re-register together.
+ */
+static void schedule_registration(struct sip_outbound_registration_client_state *client_state, unsigned int seconds,
+	int jitter)
 {
-	pj_time_val delay = { .sec = seconds, };
+	int64_t ms = (int64_t) seconds * 1000;
+	pj_time_val delay;
 	pjsip_regc_info info;
 
+	ms += (int64_t) (ms * jitter / 100.0 * ast_random_double());
+	delay.sec = ms / 1000;
+	delay.msec = ms % 1000;
+
 	cancel_registration(client_state);
 
 	pjsip_regc_get_info(client_state->client, &info);
-	ast_debug(1, "Scheduling outbound registration to server '%.*s' from client '%.*s' in %d seconds\n",
+	ast_debug(1, "Scheduling outbound registration to server '%.*s' from client '%.*s' in %d.%03d seconds\n",
 			(int) info.server_uri.slen, info.server_uri.ptr,
 			(int) info.client_uri.slen, info.client_uri.ptr,
-			seconds);
+			(int) delay.sec, (int) delay.msec);
 
 	ao2_ref(client_state, +1);
 	if (pjsip_endpt_schedule_timer(ast_sip_get_pjsip_endpoint(), &client_state->timer, &delay) != PJ_SUCCESS) {
@@ -693,6 +906,8 @@ struct registration_response {
 	int expiration;
 	/*! \brief Retry-After value */
 	int retry_after;
+	/*! \brief Milliseconds from sending the request to receiving the response, -1 if none was received */
+	int64_t rtt;
 	/*! \brief Outbound registration client state */
 	struct sip_outbound_registration_client_state *client_state;
 	/*! \brief The response message */
@@ -717,6 +932,21 @@ static void registration_response_destroy(void *obj)
 	ao2_cleanup(response->client_state);
 }
 
+/*! \brief Helper function which adds a response round trip time to the statistics */
+static void registration_rtt_record(int64_t rtt)
+{
+	ast_statsd_log("PJSIP.registrations.rtt", AST_STATSD_TIMER, rtt);
+
+	ast_mutex_lock(&pacing_lock);
+	if (!pacing_stats.responses || rtt < pacing_stats.rtt_min) {
+		pacing_stats.rtt_min = rtt;
+	}
+	pacing_stats.rtt_max = MAX(pacing_stats.rtt_max, rtt);
+	pacing_stats.rtt_total += rtt;
+	++pacing_stats.responses;
+	ast_mutex_unlock(&pacing_lock);
+}
+
 /*! \brief Helper function which determines if a response code is temporal or not */
 static int sip_outbound_registration_is_temporal(unsigned int code,
 		struct sip_outbound_registration_client_state *client_state)
@@ -741,7 +971,7 @@ static void schedule_retry(struct registration_response *response, unsigned int
 			   const char *server_uri, const char *client_uri)
 {
 	update_client_state_status(response->client_state, SIP_REGISTRATION_REJECTED_TEMPORARY);
-	schedule_registration(response->client_state, interval);
+	schedule_registration(response->client_state, interval, REGISTRATION_JITTER_PERCENT);
 
 	if (response->rdata) {
 		ast_log(LOG_WARNING, "Temporal response '%d' received from '%s' on "
@@ -774,6 +1004,10 @@ static int handle_registration_response(void *data)
 	ast_debug(1, "Processing REGISTER response %d from server '%s' for client '%s'\n",
 			response->code, server_uri, client_uri);
 
+	if (response->rtt >= 0) {
+		registration_rtt_record(response->rtt);
+	}
+
 	if ((response->code == 401 || response->code == 407)
 		&& (!response->client_state->auth_attempted
 			|| response->rdata->msg_info.cseq->cseq != response->client_state->auth_cseq)) {
@@ -821,7 +1055,8 @@ static int handle_registration_response(void *data)
 				/* Re-register immediately. */
 				next_registration_round = 0;
 			}
-			schedule_registration(response->client_state, next_registration_round);
+			schedule_registration(response->client_state, next_registration_round,
+				-REGISTRATION_JITTER_PERCENT);
 		} else {
 			ast_debug(1, "Outbound unregistration to '%s' with client '%s' successful\n", server_uri, client_uri);
 			update_client_state_status(response->client_state, SIP_REGISTRATION_UNREGISTERED);
@@ -850,7 +1085,8 @@ static int handle_registration_response(void *data)
 			/* A forbidden response retry interval is configured and there are retries remaining */
 			update_client_state_status(response->client_state, SIP_REGISTRATION_REJECTED_TEMPORARY);
 			response->client_state->retries++;
-			schedule_registration(response->client_state, response->client_state->forbidden_retry_interval);
+			schedule_registration(response->client_state, response->client_state->forbidden_retry_interval,
+				REGISTRATION_JITTER_PERCENT);
 			ast_log(LOG_WARNING, "403 Forbidden fatal response received from '%s' on registration attempt to '%s', retrying in '%u' seconds\n",
 				server_uri, client_uri, response->client_state->forbidden_retry_interval);
 		} else if (response->client_state->fatal_retry_interval
@@ -858,7 +1094,8 @@ static int handle_registration_response(void *data)
 			/* Some kind of fatal failure response received, so retry according to configured interval */
 			update_client_state_status(response->client_state, SIP_REGISTRATION_REJECTED_TEMPORARY);
 			response->client_state->retries++;
-			schedule_registration(response->client_state, response->client_state->fatal_retry_interval);
+			schedule_registration(response->client_state, response->client_state->fatal_retry_interval,
+				REGISTRATION_JITTER_PERCENT);
 			ast_log(LOG_WARNING, "'%d' fatal response received from '%s' on registration attempt to '%s', retrying in '%u' seconds\n",
 				response->code, server_uri, client_uri, response->client_state->fatal_retry_interval);
 		} else {
@@ -917,10 +1154,12 @@ static void sip_outbound_registration_response_cb(struct pjsip_regc_cbparam *par
 	ast_debug(1, "Received REGISTER response %d(%.*s)\n",
 		param->code, (int) param->reason.slen, param->reason.ptr);
 
+	response->rtt = -1;
 	if (param->rdata) {
 		struct pjsip_retry_after_hdr *retry_after;
 		pjsip_transaction *tsx;
 
+		response->rtt = ast_tvdiff_ms(ast_tvnow(), client_state->sent_time);
 		retry_after = pjsip_msg_find_hdr(param->rdata->msg_info.msg, PJSIP_H_RETRY_AFTER,
 			NULL);
 		response->retry_after = retry_after ? retry_after->ivalue : 0;
@@ -1263,7 +1502,8 @@ static int sip_outbound_registration_perform(void *data)
 
 	pjsip_regc_update_expires(state->client_state->client, registration->expiration);
 
-	schedule_registration(state->client_state, (ast_random() % 10) + 1);
+	/* Spread the first attempts over one to ten seconds */
+	schedule_registration(state->client_state, 1, 900);
 
 	ao2_ref(registration, -1);
 	ao2_ref(state, -1);
@@ -1540,6 +1780,73 @@ static char *cli_register(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 	return CLI_SUCCESS;
 }
 
+static char *cli_show_statistics(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	static const char *priority_names[REGISTRATION_PACING_PRIORITIES] = {
+		[REGISTRATION_PACING_REFRESH] = "Refresh",
+		[REGISTRATION_PACING_INITIAL] = "Initial",
+		[REGISTRATION_PACING_RETRY] = "Retry",
+	};
+	unsigned int waiting[REGISTRATION_PACING_PRIORITIES] = { 0, };
+	int64_t oldest[REGISTRATION_PACING_PRIORITIES] = { 0, };
+	struct sip_outbound_registration_client_state *client_state;
+	struct timeval now = ast_tvnow();
+	unsigned int rate;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip show registrations statistics";
+		e->usage =
+			"Usage: pjsip show registrations statistics\n"
+			"       Shows how many outbound registrations are waiting on\n"
+			"       max_outbound_registration_rate and the round trip time\n"
+			"       of REGISTER responses.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	rate = ast_sip_get_max_outbound_registration_rate();
+	if (rate) {
+		ast_cli(a->fd, "Rate limit:    %u per second\n", rate);
+	} else {
+		ast_cli(a->fd, "Rate limit:    none\n");
+	}
+
+	ast_mutex_lock(&pacing_lock);
+	for (i = 0; i < REGISTRATION_PACING_PRIORITIES; ++i) {
+		AST_DLLIST_TRAVERSE(&pacing_queues[i], client_state, pacing_next) {
+			++waiting[i];
+		}
+		client_state = AST_DLLIST_FIRST(&pacing_queues[i]);
+		if (client_state) {
+			oldest[i] = ast_tvdiff_ms(now, client_state->pacing_time);
+		}
+	}
+
+	ast_cli(a->fd, "Waiting:\n");
+	for (i = 0; i < REGISTRATION_PACING_PRIORITIES; ++i) {
+		ast_cli(a->fd, "  %-12s %u, longest %" PRId64 " ms\n", priority_names[i], waiting[i], oldest[i]);
+	}
+	ast_cli(a->fd, "Paced:         %u sent after waiting, longest wait %" PRId64 " ms\n",
+		pacing_stats.paced, pacing_stats.wait_max);
+	if (pacing_stats.responses) {
+		ast_cli(a->fd, "Round trip:    %u responses, min %" PRId64 " ms, avg %" PRId64 " ms, max %" PRId64 " ms\n",
+			pacing_stats.responses, pacing_stats.rtt_min,
+			pacing_stats.rtt_total / pacing_stats.responses, pacing_stats.rtt_max);
+	} else {
+		ast_cli(a->fd, "Round trip:    no responses\n");
+	}
+	ast_mutex_unlock(&pacing_lock);
+
+	return CLI_SUCCESS;
+}
+
 static int ami_unregister(struct mansession *s, const struct message *m)
 {
 	const char *registration_name = astman_get_header(m, "Registration");
@@ -1788,6 +2095,7 @@ static char *my_cli_traverse_objects(struct ast_cli_entry *e, int cmd, struct as
 static struct ast_cli_entry cli_outbound_registration[] = {
 	AST_CLI_DEFINE(cli_unregister, "Unregisters outbound registration target"),
 	AST_CLI_DEFINE(cli_register, "Registers an outbound registration target"),
+	AST_CLI_DEFINE(cli_show_statistics, "Show PJSIP outbound registration pacing and round trip times"),
 	AST_CLI_DEFINE(my_cli_traverse_objects, "List PJSIP Registrations",
 		.command = "pjsip list registrations",
 		.usage = "Usage: pjsip list registrations [ like <pattern> ]\n"
@@ -1904,6 +2212,33 @@ static const struct ast_sorcery_instance_observer observer_callbacks_registratio
 	.object_type_loaded = registration_loaded_observer,
 };
 
+/*! \brief Stop the rate limit, releasing any registrations still waiting on it */
+static void registration_pacing_stop(void)
+{
+	struct sip_outbound_registration_client_state *client_state;
+	struct ast_sched_context *sched;
+	int i;
+
+	ast_mutex_lock(&pacing_lock);
+	sched = pacing_sched;
+	pacing_sched = NULL;
+	ast_mutex_unlock(&pacing_lock);
+
+	if (sched) {
+		ast_sched_context_destroy(sched);
+	}
+
+	ast_mutex_lock(&pacing_lock);
+	pacing_sched_id = -1;
+	for (i = 0; i < REGISTRATION_PACING_PRIORITIES; ++i) {
+		while ((client_state = AST_DLLIST_REMOVE_HEAD(&pacing_queues[i], pacing_next))) {
+			client_state->pacing_queued = 0;
+			ao2_ref(client_state, -1);
+		}
+	}
+	ast_mutex_unlock(&pacing_lock);
+}
+
 static int unload_module(void)
 {
 	int remaining;
@@ -1925,6 +2260,9 @@ static int unload_module(void)
 
 	ao2_global_obj_release(current_states);
 
+	/* Registrations waiting on the rate limit hold a reference, so stop it first. */
+	registration_pacing_stop();
+
 	/* Wait for registration serializers to get destroyed. */
 	ast_debug(2, "Waiting for registration transactions to complete for unload.\n");
 	remaining = ast_serializer_shutdown_group_join(shutdown_group, MAX_UNLOAD_TIMEOUT_TIME);
@@ -1958,6 +2296,13 @@ static int load_module(void)
 		return AST_MODULE_LOAD_FAILURE;
 	}
 
+	pacing_sched = ast_sched_context_create();
+	if (!pacing_sched || ast_sched_start_thread(pacing_sched)) {
+		ast_log(LOG_ERROR, "Unable to start outbound registration pacing scheduler\n");
+		unload_module();
+		return AST_MODULE_LOAD_FAILURE;
+	}
+
 	/* Create outbound registration states container. */
 	new_states = ao2_container_alloc(DEFAULT_STATE_BUCKETS,
 		registration_state_hash, registration_state_cmp);
@@ -237,6 +237,9 @@ static struct ast_sched_context *sched;
 /*! \brief Default expiration for subscriptions */
 #define DEFAULT_EXPIRES 3600
 
+/*! \brief Number of generated bodies kept for reuse */
+#define BODY_CACHE_SLOTS 64
+
 /*! \brief Defined method for PUBLISH */
 const pjsip_method pjsip_publish_method =
 {
@@ -413,6 +416,8 @@ struct sip_subscription_tree {
 	AST_LIST_ENTRY(sip_subscription_tree) next;
 	/*! Indicates that a NOTIFY is currently being sent on the SIP subscription */
 	int last_notify;
+	/*! When the last NOTIFY was sent on the SIP subscription */
+	struct timeval notify_sent_time;
 };
 
 /*!
@@ -472,6 +477,30 @@ AST_RWLIST_HEAD_STATIC(subscriptions, sip_subscription_tree);
 AST_RWLIST_HEAD_STATIC(body_generators, ast_sip_pubsub_body_generator);
 AST_RWLIST_HEAD_STATIC(body_supplements, ast_sip_pubsub_body_supplement);
 
+/*! \brief A generated body, kept so that the same state is not generated again */
+struct body_cache_entry {
+	/*! The body text */
+	char *body;
+	/*! Content type, subtype and the key given by the body generator */
+	char key[0];
+};
+
+/*! \brief Bodies generated for the same state, one per slot */
+static struct body_cache_entry *body_cache[BODY_CACHE_SLOTS];
+AST_MUTEX_DEFINE_STATIC(body_cache_lock);
+
+static void body_cache_clear(void)
+{
+	int i;
+
+	ast_mutex_lock(&body_cache_lock);
+	for (i = 0; i < BODY_CACHE_SLOTS; ++i) {
+		ast_free(body_cache[i]);
+		body_cache[i] = NULL;
+	}
+	ast_mutex_unlock(&body_cache_lock);
+}
+
 static void pubsub_on_evsub_state(pjsip_evsub *sub, pjsip_event *event);
 static void pubsub_on_rx_refresh(pjsip_evsub *sub, pjsip_rx_data *rdata,
 		int *p_st_code, pj_str_t **p_st_text, pjsip_hdr *res_hdr, pjsip_msg_body **p_body);
@@ -2146,6 +2175,7 @@ static int send_notify(struct sip_subscription_tree *sub_tree, unsigned int forc
 	}
 
 	sub_tree->send_scheduled_notify = 0;
+	sub_tree->notify_sent_time = ast_tvnow();
 
 	return 0;
 }
@@ -2162,6 +2192,7 @@ static int serialized_send_notify(void *userdata)
 	 * bail out here instead of sending the batched NOTIFY.
 	 */
 	if (!sub_tree->send_scheduled_notify) {
+		sub_tree->notify_sched_id = -1;
 		pjsip_dlg_dec_lock(dlg);
 		ao2_cleanup(sub_tree);
 		return 0;
@@ -2186,15 +2217,16 @@ static int sched_cb(const void *data)
 	return 0;
 }
 
-static int schedule_notification(struct sip_subscription_tree *sub_tree)
+static int schedule_notification(struct sip_subscription_tree *sub_tree, int when)
 {
 	/* There's already a notification scheduled */
 	if (sub_tree->notify_sched_id > -1) {
 		return 0;
 	}
 
-	sub_tree->notify_sched_id = ast_sched_add(sched, sub_tree->notification_batch_interval, sched_cb, ao2_bump(sub_tree));
+	sub_tree->notify_sched_id = ast_sched_add(sched, when, sched_cb, ao2_bump(sub_tree));
 	if (sub_tree->notify_sched_id < 0) {
+		ao2_ref(sub_tree, -1);
 		return -1;
 	}
 
@@ -2202,10 +2234,37 @@ static int schedule_notification(struct sip_subscription_tree *sub_tree)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief How long until the next NOTIFY may be sent on a subscription
+ *
+ * RFC 6665 section 4.2.2 has notifiers limit the rate of notifications.
+ * A state change within the endpoint's notify_min_interval of the last
+ * NOTIFY is held back until the interval has passed. Changes made in the
+ * meantime only replace the body, so they all go out in one NOTIFY.
+ *
+ * \return Milliseconds to wait, or 0 to send now
+ */
+static int notify_rate_delay(struct sip_subscription_tree *sub_tree)
+{
+	unsigned int interval;
+	int64_t elapsed;
+
+	if (!sub_tree->endpoint || ast_tvzero(sub_tree->notify_sent_time)) {
+		return 0;
+	}
+
+	interval = sub_tree->endpoint->subscription.notify_min_interval;
+	elapsed = ast_tvdiff_ms(ast_tvnow(), sub_tree->notify_sent_time);
+
+	return (elapsed >= 0 && elapsed < interval) ? interval - elapsed : 0;
+}
+
 int ast_sip_subscription_notify(struct ast_sip_subscription *sub, struct ast_sip_body_data *notify_data,
 		int terminate)
 {
 	int res;
+	int delay;
 	pjsip_dialog *dlg = sub->tree->dlg;
 
 	pjsip_dlg_inc_lock(dlg);
@@ -2226,8 +2285,9 @@ int ast_sip_subscription_notify(struct ast_sip_subscription *sub, struct ast_sip
 		sub->subscription_state = PJSIP_EVSUB_STATE_TERMINATED;
 	}
 
-	if (sub->tree->notification_batch_interval) {
-		res = schedule_notification(sub->tree);
+	delay = terminate ? 0 : notify_rate_delay(sub->tree);
+	if (sub->tree->notification_batch_interval || delay) {
+		res = schedule_notification(sub->tree, MAX(sub->tree->notification_batch_interval, delay));
 	} else {
 		/* See the note in pubsub_on_rx_refresh() for why sub->tree is refbumped here */
 		ao2_ref(sub->tree, +1);
@@ -3088,6 +3148,9 @@ void ast_sip_pubsub_unregister_body_generator(struct ast_sip_pubsub_body_generat
 		}
 	}
 	AST_RWLIST_TRAVERSE_SAFE_END;
+
+	/* A generator loaded again may not give the same bodies */
+	body_cache_clear();
 }
 
 int ast_sip_pubsub_register_body_supplement(struct ast_sip_pubsub_body_supplement *supplement)
@@ -3123,11 +3186,94 @@ const char *ast_sip_subscription_get_body_subtype(struct ast_sip_subscription *s
 	return sub->body_generator->subtype;
 }
 
+/*!
+ * \internal
+ * \brief Find the cache key for a body
+ *
+ * Only generators that can describe their data have their bodies kept, and
+ * only while no supplement can add to them.
+ *
+ * \return The key, or NULL if the body must be generated
+ */
+static struct ast_str *body_cache_key(struct ast_sip_pubsub_body_generator *generator, void *data)
+{
+	struct ast_sip_pubsub_body_supplement *supplement;
+	struct ast_str *key;
+	int supplemented = 0;
+
+	if (!generator->cache_key) {
+		return NULL;
+	}
+
+	AST_RWLIST_RDLOCK(&body_supplements);
+	AST_RWLIST_TRAVERSE(&body_supplements, supplement, list) {
+		if (!strcmp(generator->type, supplement->type) &&
+				!strcmp(generator->subtype, supplement->subtype)) {
+			supplemented = 1;
+			break;
+		}
+	}
+	AST_RWLIST_UNLOCK(&body_supplements);
+	if (supplemented) {
+		return NULL;
+	}
+
+	key = ast_str_create(64);
+	if (!key) {
+		return NULL;
+	}
+	ast_str_set(&key, 0, "%s/%s;", generator->type, generator->subtype);
+	if (generator->cache_key(data, &key)) {
+		ast_free(key);
+		return NULL;
+	}
+
+	return key;
+}
+
+static int body_cache_get(struct ast_str *key, struct ast_str **str)
+{
+	struct body_cache_entry *entry;
+	int found = 0;
+
+	ast_mutex_lock(&body_cache_lock);
+	entry = body_cache[ast_str_hash(ast_str_buffer(key)) % BODY_CACHE_SLOTS];
+	if (entry && !strcmp(entry->key, ast_str_buffer(key))) {
+		ast_str_set(str, 0, "%s", entry->body);
+		found = 1;
+	}
+	ast_mutex_unlock(&body_cache_lock);
+
+	return found;
+}
+
+static void body_cache_put(struct ast_str *key, struct ast_str *str)
+{
+	struct body_cache_entry *entry;
+	size_t key_len = ast_str_strlen(key) + 1;
+	int slot;
+
+	entry = ast_malloc(sizeof(*entry) + key_len + ast_str_strlen(str) + 1);
+	if (!entry) {
+		return;
+	}
+	memcpy(entry->key, ast_str_buffer(key), key_len);
+	entry->body = entry->key + key_len;
+	strcpy(entry->body, ast_str_buffer(str)); /* Safe */
+
+	slot = ast_str_hash(entry->key) % BODY_CACHE_SLOTS;
+	ast_mutex_lock(&body_cache_lock);
+	ast_free(body_cache[slot]);
+	body_cache[slot] = entry;
+	ast_mutex_unlock(&body_cache_lock);
+}
+
 int ast_sip_pubsub_generate_body_content(const char *type, const char *subtype,
 		struct ast_sip_body_data *data, struct ast_str **str)
 {
 	struct ast_sip_pubsub_body_supplement *supplement;
 	struct ast_sip_pubsub_body_generator *generator;
+	RAII_VAR(struct ast_str *, key, NULL, ast_free);
 	int res = 0;
 	void *body;
 
@@ -3143,6 +3289,12 @@ int ast_sip_pubsub_generate_body_content(const char *type, const char *subtype,
 		return -1;
 	}
 
+	/* The same state gives the same body, however many subscribers it goes to */
+	key = body_cache_key(generator, data->body_data);
+	if (key && body_cache_get(key, str)) {
+		return 0;
+	}
+
 	body = generator->allocate_body(data->body_data);
 	if (!body) {
 		ast_log(LOG_WARNING, "Unable to allocate a NOTIFY body of type %s/%s\n",
@@ -3169,6 +3321,9 @@ int ast_sip_pubsub_generate_body_content(const char *type, const char *subtype,
 
 	if (!res) {
 		generator->to_string(body, str);
+		if (key) {
+			body_cache_put(key, *str);
+		}
 	}
 
 end:
@@ -4487,6 +4642,7 @@ static int unload_module(void)
 	if (sched) {
 		ast_sched_context_destroy(sched);
 	}
+	body_cache_clear();
 
 	AST_TEST_UNREGISTER(resource_tree);
 	AST_TEST_UNREGISTER(complex_resource_tree);
@@ -572,6 +572,8 @@ static void refer_blind_callback(struct ast_channel *chan, struct transfer_chann
 			.destroy_cb = refer_progress_framehook_destroy,
 			.data = refer->progress,
 			.disable_inheritance = 1,
+			.frame_types = AST_FRAMEHOOK_BIT(AST_FRAME_VOICE) | AST_FRAMEHOOK_BIT(AST_FRAME_CONTROL),
+			.events = AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_WRITE),
 		};
 
 		refer->progress->transferee = ast_strdup(ast_channel_uniqueid(chan));
@@ -265,7 +265,8 @@ static int load_module(void)
 		return AST_MODULE_LOAD_FAILURE;
 	}
 
-	if (!(sched = ast_sched_context_create())) {
+	/* One event per contact, moved on every refresh */
+	if (!(sched = ast_sched_context_create_with_options(AST_SCHED_TIMING_WHEEL))) {
 		ast_log(LOG_ERROR, "Could not create scheduler for contact auto-expiration\n");
 		unload_module();
 		return AST_MODULE_LOAD_FAILURE;
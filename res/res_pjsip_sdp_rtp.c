@@ -51,6 +51,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/acl.h"
 #include "asterisk/sdp_srtp.h"
 #include "asterisk/dsp.h"
+#include "asterisk/vector.h"
+#include "asterisk/sorcery.h"
 
 #include "asterisk/res_pjsip.h"
 #include "asterisk/res_pjsip_session.h"
@@ -70,6 +72,12 @@ static const int FD_AUDIO = 0;
 static const char STR_VIDEO[] = "video";
 static const int FD_VIDEO = 2;
 
+/*! \brief Number of buckets for SDP templates */
+#define SDP_TEMPLATE_BUCKETS 53
+
+/*! \brief SDP templates, by endpoint and media type */
+static struct ao2_container *sdp_templates;
+
 /*! \brief Retrieves an ast_format_type based on the given stream_type */
 static enum ast_media_type stream_to_media_type(const char *stream_type)
 {
@@ -294,6 +302,7 @@ static int set_caps(struct ast_sip_session *session,
 	RAII_VAR(struct ast_format_cap *, caps, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_format_cap *, peer, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_format_cap *, joint, NULL, ao2_cleanup);
+	struct ast_format_cap *interned;
 	enum ast_media_type media_type = stream_to_media_type(session_media->stream_type);
 	struct ast_rtp_codecs codecs = AST_RTP_CODECS_NULL_INIT;
 	int fmts = 0;
@@ -358,7 +367,9 @@ static int set_caps(struct ast_sip_session *session,
 		 * Apply the new formats to the channel, potentially changing
 		 * raw read/write formats and translation path while doing so.
 		 */
-		ast_channel_nativeformats_set(session->channel, caps);
+		interned = ast_format_cap_intern(caps);
+		ast_channel_nativeformats_set(session->channel, interned ?: caps);
+		ao2_cleanup(interned);
 		if (media_type == AST_MEDIA_TYPE_AUDIO) {
 			ast_set_read_format(session->channel, ast_channel_readformat(session->channel));
 			ast_set_write_format(session->channel, ast_channel_writeformat(session->channel));
@@ -407,31 +418,325 @@ static pjmedia_sdp_attr* generate_rtpmap_attr(struct ast_sip_session *session, p
 	return attr;
 }
 
+/*! \brief Generate the value of a format's fmtp attribute into fmtp0, returning NULL if it has none */
+static char *generate_fmtp_value(struct ast_format *format, int rtp_code, struct ast_str **fmtp0)
+{
+	char *tmp;
+
+	ast_format_generate_sdp_fmtp(format, rtp_code, fmtp0);
+	if (!ast_str_strlen(*fmtp0)) {
+		return NULL;
+	}
+
+	tmp = ast_str_buffer(*fmtp0) + ast_str_strlen(*fmtp0) - 1;
+	/* remove any carriage return line feeds */
+	while (*tmp == '\r' || *tmp == '\n') --tmp;
+	*++tmp = '\0';
+	/* ast...generate gives us everything, just need value */
+	tmp = strchr(ast_str_buffer(*fmtp0), ':');
+	if (tmp && tmp + 1) {
+		return tmp + 1;
+	}
+	return ast_str_buffer(*fmtp0);
+}
+
 static pjmedia_sdp_attr* generate_fmtp_attr(pj_pool_t *pool, struct ast_format *format, int rtp_code)
 {
 	struct ast_str *fmtp0 = ast_str_alloca(256);
 	pj_str_t fmtp1;
-	pjmedia_sdp_attr *attr = NULL;
-	char *tmp;
+	char *value;
 
-	ast_format_generate_sdp_fmtp(format, rtp_code, &fmtp0);
-	if (ast_str_strlen(fmtp0)) {
-		tmp = ast_str_buffer(fmtp0) + ast_str_strlen(fmtp0) - 1;
-		/* remove any carriage return line feeds */
-		while (*tmp == '\r' || *tmp == '\n') --tmp;
-		*++tmp = '\0';
-		/* ast...generate gives us everything, just need value */
-		tmp = strchr(ast_str_buffer(fmtp0), ':');
-		if (tmp && tmp + 1) {
-			fmtp1 = pj_str(tmp + 1);
-		} else {
-			fmtp1 = pj_str(ast_str_buffer(fmtp0));
+	value = generate_fmtp_value(format, rtp_code, &fmtp0);
+	if (!value) {
+		return NULL;
+	}
+	return pjmedia_sdp_attr_create(pool, "fmtp", pj_cstr(&fmtp1, value));
+}
+
+/*! \brief A codec of an SDP template */
+struct sdp_template_codec {
+	/*! The format */
+	struct ast_format *format;
+	/*! The RTP payload type the format was given, or -1 if it had none */
+	int rtp_code;
+	/*! The value of the rtpmap attribute */
+	char *rtpmap;
+	/*! The value of the fmtp attribute, or NULL if there is none */
+	char *fmtp;
+};
+
+/*!
+ * \brief The codecs an endpoint offers for one type of media
+ *
+ * Looking up each codec's rtpmap and generating its fmtp is most of the
+ * work of an offer, and for most calls they come out the same every time.
+ * They are kept for each endpoint and media type, and used for as long as
+ * the endpoint keeps the same codecs and the RTP instance gives each codec
+ * the same payload type. Ports, addresses, ICE and crypto are still added
+ * for each call.
+ */
+struct sdp_template {
+	/*! The endpoint codecs the template was made from */
+	struct ast_format_cap *codecs;
+	/*! The smallest maximum packet size of the codecs */
+	int max_packet_size;
+	/*! The codecs, in the order they are offered */
+	AST_VECTOR(, struct sdp_template_codec) lines;
+	/*! Endpoint name and media type. Used as a hash key */
+	char key[0];
+};
+
+static void sdp_template_destructor(void *obj)
+{
+	struct sdp_template *template = obj;
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&template->lines); ++i) {
+		struct sdp_template_codec *line = AST_VECTOR_GET_ADDR(&template->lines, i);
+
+		ao2_cleanup(line->format);
+		ast_free(line->rtpmap);
+		ast_free(line->fmtp);
+	}
+	AST_VECTOR_FREE(&template->lines);
+	ao2_cleanup(template->codecs);
+}
+
+static int sdp_template_hash(const void *obj, const int flags)
+{
+	const struct sdp_template *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int sdp_template_cmp(void *obj, void *arg, int flags)
+{
+	const struct sdp_template *left = obj;
+	const struct sdp_template *right = arg;
+	const char *right_key = arg;
+	int cmp;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		cmp = strcmp(left->key, right_key);
+		break;
+	case OBJ_SEARCH_PARTIAL_KEY:
+		cmp = strncmp(left->key, right_key, strlen(right_key));
+		break;
+	default:
+		cmp = 0;
+		break;
+	}
+	if (cmp) {
+		return 0;
+	}
+	return CMP_MATCH;
+}
+
+/*!
+ * \internal
+ * \brief Make an SDP template from an endpoint's codecs for one type of media
+ *
+ * The payload types are those of an RTP instance nothing has been negotiated
+ * on yet, so the template applies to any new offer, and is not tied to
+ * payload types a peer chose for one call.
+ *
+ * \param key The endpoint name and media type
+ * \param session The session the offer is for
+ * \param caps The endpoint's codecs for the type of media
+ */
+static struct sdp_template *sdp_template_alloc(const char *key, struct ast_sip_session *session,
+	struct ast_format_cap *caps)
+{
+	struct ast_rtp_codecs codecs = AST_RTP_CODECS_NULL_INIT;
+	struct sdp_template *template;
+	struct ast_str *fmtp0 = ast_str_alloca(256);
+	enum ast_rtp_options options = session->endpoint->media.g726_non_standard ?
+		AST_RTP_OPT_G726_NONSTANDARD : 0;
+	int index;
+
+	template = ao2_alloc_options(sizeof(*template) + strlen(key) + 1, sdp_template_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!template) {
+		return NULL;
+	}
+	strcpy(template->key, key); /* Safe */
+
+	if (AST_VECTOR_INIT(&template->lines, ast_format_cap_count(caps))
+		|| ast_rtp_codecs_payloads_initialize(&codecs)) {
+		ao2_ref(template, -1);
+		return NULL;
+	}
+	template->codecs = ao2_bump(session->endpoint->media.codecs);
+
+	for (index = 0; index < ast_format_cap_count(caps); ++index) {
+		struct sdp_template_codec line = { .format = ast_format_cap_get_format(caps, index), };
+		const char *fmtp;
+		char rtpmap[128];
+		const char *mime;
+
+		line.rtp_code = ast_rtp_codecs_payload_code(&codecs, 1, line.format, 0);
+		if (line.rtp_code != -1) {
+			mime = ast_rtp_lookup_mime_subtype2(1, line.format, 0, options);
+			snprintf(rtpmap, sizeof(rtpmap), "%d %s/%u%s", line.rtp_code, mime,
+				ast_rtp_lookup_sample_rate2(1, line.format, 0),
+				!strcasecmp(mime, "opus") ? "/2" : "");
+			line.rtpmap = ast_strdup(rtpmap);
+			ast_str_reset(fmtp0);
+			fmtp = generate_fmtp_value(line.format, line.rtp_code, &fmtp0);
+			if (fmtp) {
+				line.fmtp = ast_strdup(fmtp);
+			}
+			if (!line.rtpmap || (fmtp && !line.fmtp)) {
+				ao2_ref(line.format, -1);
+				ast_free(line.rtpmap);
+				ast_free(line.fmtp);
+				ast_rtp_codecs_payloads_destroy(&codecs);
+				ao2_ref(template, -1);
+				return NULL;
+			}
+
+			if (ast_format_get_maximum_ms(line.format) &&
+				((ast_format_get_maximum_ms(line.format) < template->max_packet_size) || !template->max_packet_size)) {
+				template->max_packet_size = ast_format_get_maximum_ms(line.format);
+			}
+		}
+
+		if (AST_VECTOR_APPEND(&template->lines, line)) {
+			ao2_ref(line.format, -1);
+			ast_free(line.rtpmap);
+			ast_free(line.fmtp);
+			ast_rtp_codecs_payloads_destroy(&codecs);
+			ao2_ref(template, -1);
+			return NULL;
 		}
-		attr = pjmedia_sdp_attr_create(pool, "fmtp", &fmtp1);
 	}
-	return attr;
+
+	ast_rtp_codecs_payloads_destroy(&codecs);
+	return template;
+}
+
+/*!
+ * \internal
+ * \brief Find the SDP template for an endpoint's offer, making it if need be
+ *
+ * \param session The session the offer is for
+ * \param session_media The media stream
+ * \param caps The endpoint's codecs for the type of media
+ */
+static struct sdp_template *sdp_template_get(struct ast_sip_session *session,
+	struct ast_sip_session_media *session_media, struct ast_format_cap *caps)
+{
+	struct sdp_template *template;
+	char *key;
+
+	if (ast_asprintf(&key, "%s/%s", ast_sorcery_object_get_id(session->endpoint),
+		session_media->stream_type) < 0) {
+		return NULL;
+	}
+
+	template = ao2_find(sdp_templates, key, OBJ_SEARCH_KEY);
+	if (template && template->codecs != session->endpoint->media.codecs) {
+		/* The endpoint has been changed since the template was made */
+		ao2_unlink(sdp_templates, template);
+		ao2_ref(template, -1);
+		template = NULL;
+	}
+
+	if (!template) {
+		template = sdp_template_alloc(key, session, caps);
+		if (template) {
+			ao2_link(sdp_templates, template);
+		}
+	}
+
+	ast_free(key);
+	return template;
+}
+
+/*!
+ * \internal
+ * \brief Add the codecs of an SDP template to a media stream
+ *
+ * \retval 0 Success
+ * \retval -1 The RTP instance gives a codec a different payload type, so the
+ * template does not apply and nothing has been added
+ */
+static int sdp_template_apply(struct sdp_template *template, struct ast_sip_session_media *session_media,
+	pj_pool_t *pool, pjmedia_sdp_media *media)
+{
+	struct ast_rtp_codecs *codecs = ast_rtp_instance_get_codecs(session_media->rtp);
+	pj_str_t stmp;
+	char tmp[16];
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&template->lines); ++i) {
+		struct sdp_template_codec *line = AST_VECTOR_GET_ADDR(&template->lines, i);
+
+		if (ast_rtp_codecs_payload_code(codecs, 1, line->format, 0) != line->rtp_code) {
+			return -1;
+		}
+	}
+
+	for (i = 0; i < AST_VECTOR_SIZE(&template->lines); ++i) {
+		struct sdp_template_codec *line = AST_VECTOR_GET_ADDR(&template->lines, i);
+
+		if (line->rtp_code == -1) {
+			ast_log(LOG_WARNING,"Unable to get rtp codec payload code for %s\n", ast_format_get_name(line->format));
+			continue;
+		}
+
+		snprintf(tmp, sizeof(tmp), "%d", line->rtp_code);
+		pj_strdup2(pool, &media->desc.fmt[media->desc.fmt_count++], tmp);
+		media->attr[media->attr_count++] = pjmedia_sdp_attr_create(pool, "rtpmap", pj_cstr(&stmp, line->rtpmap));
+		if (line->fmtp) {
+			media->attr[media->attr_count++] = pjmedia_sdp_attr_create(pool, "fmtp", pj_cstr(&stmp, line->fmtp));
+		}
+	}
+
+	return 0;
 }
 
+/*! \brief Drop the SDP templates of an endpoint that has been changed or deleted */
+static void sdp_template_endpoint_changed(const void *object)
+{
+	char *prefix;
+
+	if (ast_asprintf(&prefix, "%s/", ast_sorcery_object_get_id(object)) < 0) {
+		return;
+	}
+	ao2_find(sdp_templates, prefix, OBJ_SEARCH_PARTIAL_KEY | OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE);
+	ast_free(prefix);
+}
+
+/*! \brief Drop every SDP template when endpoints are reloaded */
+static void sdp_template_endpoints_loaded(const char *object_type)
+{
+	ao2_callback(sdp_templates, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+}
+
+static const struct ast_sorcery_observer sdp_template_endpoint_observer = {
+	.updated = sdp_template_endpoint_changed,
+	.deleted = sdp_template_endpoint_changed,
+	.loaded = sdp_template_endpoints_loaded,
+};
+
 /*! \brief Function which adds ICE attributes to a media stream */
 static void add_ice_to_stream(struct ast_sip_session *session, struct ast_sip_session_media *session_media, pj_pool_t *pool, pjmedia_sdp_media *media)
 {
@@ -1049,6 +1354,7 @@ static int create_outgoing_sdp_stream(struct ast_sip_session *session, struct as
 	int min_packet_size = 0, max_packet_size = 0;
 	int rtp_code;
 	RAII_VAR(struct ast_format_cap *, caps, NULL, ao2_cleanup);
+	RAII_VAR(struct sdp_template *, template, NULL, ao2_cleanup);
 	enum ast_media_type media_type = stream_to_media_type(session_media->stream_type);
 	int use_override_prefs = ast_format_cap_count(session->req_caps);
 
@@ -1119,11 +1425,21 @@ static int create_outgoing_sdp_stream(struct ast_sip_session *session, struct as
 	} else if (!ast_format_cap_count(session->req_caps) ||
 		!ast_format_cap_iscompatible(session->req_caps, session->endpoint->media.codecs)) {
 		ast_format_cap_append_from_cap(caps, session->endpoint->media.codecs, media_type);
+		/* Only an offer of the endpoint's own codecs is the same from call to call */
+		template = sdp_template_get(session, session_media, caps);
 	} else {
 		ast_format_cap_append_from_cap(caps, session->req_caps, media_type);
 	}
 
-	for (index = 0; index < ast_format_cap_count(caps); ++index) {
+	if (template && !sdp_template_apply(template, session_media, pool, media)) {
+		max_packet_size = template->max_packet_size;
+		/* The codecs are already in the stream */
+		index = ast_format_cap_count(caps);
+	} else {
+		index = 0;
+	}
+
+	for (; index < ast_format_cap_count(caps); ++index) {
 		struct ast_format *format = ast_format_cap_get_format(caps, index);
 
 		if (ast_format_get_type(format) != media_type) {
@@ -1450,11 +1766,15 @@ static int unload_module(void)
 	ast_sip_session_unregister_supplement(&video_info_supplement);
 	ast_sip_session_unregister_sdp_handler(&video_sdp_handler, STR_VIDEO);
 	ast_sip_session_unregister_sdp_handler(&audio_sdp_handler, STR_AUDIO);
+	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "endpoint", &sdp_template_endpoint_observer);
 
 	if (sched) {
 		ast_sched_context_destroy(sched);
 	}
 
+	ao2_cleanup(sdp_templates);
+	sdp_templates = NULL;
+
 	return 0;
 }
 
@@ -1485,6 +1805,12 @@ static int load_module(void)
 		goto end;
 	}
 
+	sdp_templates = ao2_container_alloc(SDP_TEMPLATE_BUCKETS, sdp_template_hash, sdp_template_cmp);
+	if (!sdp_templates) {
+		goto end;
+	}
+	ast_sorcery_observer_add(ast_sip_get_sorcery(), "endpoint", &sdp_template_endpoint_observer);
+
 	if (ast_sip_session_register_sdp_handler(&audio_sdp_handler, STR_AUDIO)) {
 		ast_log(LOG_ERROR, "Unable to register SDP handler for %s stream type\n", STR_AUDIO);
 		goto end;
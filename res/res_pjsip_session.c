@@ -1903,6 +1903,8 @@ static int new_invite(void *data)
 	 * so that we will be notified so we can destroy the session properly
 	 */
 
+	ast_setup_times_mark(&invite->session->setup_times, AST_CHANNEL_SETUP_SESSION);
+
 	switch (get_destination(invite->session, invite->rdata)) {
 	case SIP_GET_DEST_EXTEN_FOUND:
 		/* Things worked. Keep going */
@@ -2005,6 +2007,10 @@ static void handle_new_invite_request(pjsip_rx_data *rdata)
 		return;
 	}
 
+	if (ast_sip_rdata_get_setup_times(rdata)) {
+		session->setup_times = *ast_sip_rdata_get_setup_times(rdata);
+	}
+
 	invite = new_invite_alloc(session, rdata);
 	if (!invite || ast_sip_push_task(session->serializer, new_invite, invite)) {
 		if (pjsip_inv_initial_answer(inv_session, rdata, 500, NULL, NULL, &tdata) == PJ_SUCCESS) {
@@ -69,6 +69,10 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/rtp_engine.h"
 #include "asterisk/smoother.h"
 #include "asterisk/test.h"
+#include "asterisk/thread_affinity.h"
+#include "asterisk/threadstorage.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/taskprocessor.h"
 
 #define MAX_TIMESTAMP_SKEW	640
 
@@ -105,6 +109,22 @@ ASTERISK_REGISTER_FILE()
 
 #define DEFAULT_LEARNING_MIN_SEQUENTIAL 4
 
+/*! Size of a receive buffer, with room for a frame header before the packet */
+#define RTP_RX_BUF_SIZE (8192 + AST_FRIENDLY_OFFSET)
+/*! Receive buffers an instance keeps for reuse */
+#define RTP_RX_BUFS 4
+
+#define DEFAULT_READ_BATCH 8
+#define DEFAULT_RTCP_EVENTS 1
+#define DEFAULT_QUALITY_WINDOW 0
+#define DEFAULT_DTLS_WORKERS 4
+/*! Most threads handling DTLS handshakes */
+#define MAX_DTLS_WORKERS 64
+/*! Most packets read from a socket with one system call */
+#define MAX_READ_BATCH 32
+/*! Room for each packet read in a batch after the first, which is read into the instance */
+#define READ_BATCH_PACKET_SIZE 2048
+
 #define SRTP_MASTER_KEY_LEN 16
 #define SRTP_MASTER_SALT_LEN 14
 #define SRTP_MASTER_LEN (SRTP_MASTER_KEY_LEN + SRTP_MASTER_SALT_LEN)
@@ -117,6 +137,10 @@ enum strict_rtp_state {
 
 #define DEFAULT_STRICT_RTP STRICT_RTP_CLOSED
 #define DEFAULT_ICESUPPORT 1
+/*! Threads for ICE and TURN, 0 for one per CPU */
+#define DEFAULT_ICE_THREADS 0
+/*! Most threads for ICE timers and for TURN sockets each */
+#define MAX_ICE_THREADS 64
 
 extern struct ast_srtp_res *res_srtp;
 extern struct ast_srtp_policy_res *res_srtp_policy;
@@ -138,11 +162,68 @@ static int nochecksums;
 #endif
 static int strictrtp = DEFAULT_STRICT_RTP; /*< Only accept RTP frames from a defined source. If we receive an indication of a changing source, enter learning mode. */
 static int learning_min_sequential = DEFAULT_LEARNING_MIN_SEQUENTIAL; /*< Number of sequential RTP frames needed from a single source during learning mode to accept new source. */
+static int read_batch = DEFAULT_READ_BATCH; /*< Most RTP packets read at once from a socket. */
+static int rtcpevents = DEFAULT_RTCP_EVENTS; /*< Whether to publish a stasis message for each RTCP report. */
+static int quality_window = DEFAULT_QUALITY_WINDOW; /*< Seconds of media quality each summary covers, 0 for none. */
+#ifdef HAVE_OPENSSL_SRTP
+static int dtls_workers = DEFAULT_DTLS_WORKERS; /*< Threads handling DTLS handshakes, 0 to handle them on the media path. */
+
+/*! \brief Threads handling DTLS handshakes */
+static struct ast_threadpool *dtls_pool;
+/*! \brief Serializers of the DTLS threads, an RTP instance always uses the same one */
+static struct ast_taskprocessor **dtls_serializers;
+/*! \brief Number of DTLS serializers */
+static unsigned int dtls_serializer_count;
+/*! \brief Lock for waiting on the DTLS threads */
+AST_MUTEX_DEFINE_STATIC(dtls_tasks_lock);
+/*! \brief Signalled when the DTLS threads are done with the packets of an instance */
+static ast_cond_t dtls_tasks_cond;
+
+/*! \brief Upper bounds in milliseconds of the DTLS handshake times counted */
+static const int dtls_latency_bounds[] = { 10, 50, 100, 250, 500, 1000, 5000 };
+/*! \brief DTLS handshakes completed within each bound, the last one for longer ones */
+static int dtls_latency_counts[ARRAY_LEN(dtls_latency_bounds) + 1];
+
+/*! \brief SSL contexts in use, shared by the instances with the same DTLS configuration */
+static struct ao2_container *dtls_contexts;
+
+#define DTLS_CONTEXT_BUCKETS 17
+#endif
+
+/*!
+ * \brief Even RTP ports of rtpstart to rtpend no RTP instance holds
+ *
+ * The ports are kept in a ring, oldest released first, so finding a port
+ * to bind takes one step and a released port is not reused right away.
+ */
+static struct {
+	/*! Ring of free ports */
+	uint16_t *ports;
+	/*! Number of even ports in the range, the size of the ring */
+	unsigned int size;
+	/*! Position of the oldest free port */
+	unsigned int head;
+	/*! Number of free ports */
+	unsigned int count;
+	/*! First even port of the range */
+	int start;
+	/*! Last port of the range */
+	int end;
+	/*! Bit for each even port, set while an RTP instance holds it */
+	unsigned int held[(MAXIMUM_RTP_PORT + 1) / 2 / 32 + 1];
+} port_pool;
+AST_MUTEX_DEFINE_STATIC(port_pool_lock);
+
+#define PORT_POOL_HELD(port) (port_pool.held[(port) / 2 / 32] & (1U << ((port) / 2 % 32)))
+#define PORT_POOL_SET_HELD(port) (port_pool.held[(port) / 2 / 32] |= (1U << ((port) / 2 % 32)))
+#define PORT_POOL_CLEAR_HELD(port) (port_pool.held[(port) / 2 / 32] &= ~(1U << ((port) / 2 % 32)))
+
 #ifdef HAVE_PJPROJECT
 static int icesupport = DEFAULT_ICESUPPORT;
 static struct sockaddr_in stunaddr;
 static pj_str_t turnaddr;
 static int turnport = DEFAULT_TURN_PORT;
+static int ice_threads = DEFAULT_ICE_THREADS; /*< Threads for ICE timers and for TURN sockets each, 0 for one per CPU. */
 static pj_str_t turnusername;
 static pj_str_t turnpassword;
 
@@ -152,13 +233,25 @@ static pj_caching_pool cachingpool;
 /*! \brief Global memory pool for configuration and timers */
 static pj_pool_t *pool;
 
-/*! \brief Global timer heap */
-static pj_timer_heap_t *timer_heap;
+/*! \brief Structure which contains ICE timer thread information */
+struct ast_rtp_timer_thread {
+	/*! \brief Timer heap for the ICE sessions */
+	pj_timer_heap_t *timerheap;
+	/*! \brief Ioqueue the thread waits on between polls of the timer heap */
+	pj_ioqueue_t *ioqueue;
+	/*! \brief The thread executing the timer heap */
+	pj_thread_t *thread;
+	/*! \brief Current number of RTP instances using the timer heap */
+	int sessions;
+};
+
+/*! \brief Threads executing the timer heaps of ICE sessions */
+static struct ast_rtp_timer_thread *timer_threads;
 
-/*! \brief Thread executing the timer heap */
-static pj_thread_t *timer_thread;
+/*! \brief Number of ICE timer threads */
+static unsigned int timer_thread_count;
 
-/*! \brief Used to tell the timer thread to terminate */
+/*! \brief Used to tell the timer threads to terminate */
 static int timer_terminate;
 
 /*! \brief Structure which contains ioqueue thread information */
@@ -190,6 +283,7 @@ static AST_LIST_HEAD_STATIC(ioqueues, ast_rtp_ioqueue_thread);
 #define FLAG_NAT_INACTIVE_NOWARN        (1 << 1)
 #define FLAG_NEED_MARKER_BIT            (1 << 3)
 #define FLAG_DTMF_COMPENSATE            (1 << 4)
+#define FLAG_FORWARD_TRIED              (1 << 5)
 
 #define TRANSPORT_SOCKET_RTP 0
 #define TRANSPORT_SOCKET_RTCP 1
@@ -211,14 +305,32 @@ struct dtls_details {
 	enum ast_rtp_dtls_setup dtls_setup; /*!< Current setup state */
 	enum ast_rtp_dtls_connection connection; /*!< Whether this is a new or existing connection */
 	int timeout_timer; /*!< Scheduler id for timeout timer */
+	int tasks; /*!< Packets queued to the DTLS threads */
+	int failed; /*!< Set by the DTLS threads if the handshake failed */
+	struct timeval start; /*!< When the handshake started */
+};
+
+/*! \brief An SSL context shared by the instances with the same DTLS configuration */
+struct dtls_context {
+	SSL_CTX *ssl_ctx;
+	/*! Fingerprint of the certificate */
+	char fingerprint[160];
+	/*! The DTLS configuration, as a string */
+	char key[0];
 };
 #endif
 
 /*! \brief RTP session description */
 struct ast_rtp {
 	int s;
+	int port;			/*!< Port taken from the port pool */
+	unsigned char relay_payload[AST_RTP_MAX_PT];	/*!< Payload type + 1 to relay each payload type as, 0 if not known */
+	struct ast_rtp_forward *forward;	/*!< Forwarding of received RTP to the bridged instance */
+	unsigned int forward_packets;	/*!< Packets of the forwarding already counted */
+	unsigned int forward_octets;	/*!< Octets of the forwarding already counted */
 	struct ast_frame f;
-	unsigned char rawdata[8192 + AST_FRIENDLY_OFFSET];
+	unsigned char *rawdata;		/*!< Receive buffer in use, one of rxbufs */
+	void *rxbufs[RTP_RX_BUFS];	/*!< Refcounted receive buffers, which the frames of their packets hold */
 	unsigned int ssrc;		/*!< Synchronization source, RFC 3550, page 10. */
 	unsigned int themssrc;		/*!< Their SSRC */
 	unsigned int rxssrc;
@@ -304,6 +416,7 @@ struct ast_rtp {
 	struct ast_sockaddr rtcp_loop; /*!< Loopback address for forwarding RTCP from TURN */
 
 	struct ast_rtp_ioqueue_thread *ioqueue; /*!< The ioqueue thread handling us */
+	struct ast_rtp_timer_thread *ice_timer; /*!< The thread executing our ICE timers */
 
 	char remote_ufrag[256];  /*!< The remote ICE username */
 	char remote_passwd[256]; /*!< The remote ICE password */
@@ -319,6 +432,7 @@ struct ast_rtp {
 
 #ifdef HAVE_OPENSSL_SRTP
 	SSL_CTX *ssl_ctx; /*!< SSL context */
+	struct dtls_context *dtls_context; /*!< Shared SSL context ssl_ctx belongs to */
 	enum ast_rtp_dtls_verify dtls_verify; /*!< What to verify */
 	enum ast_srtp_suite suite;   /*!< SRTP crypto suite */
 	enum ast_rtp_dtls_hash local_hash; /*!< Local hash used for the fingerprint */
@@ -446,6 +560,7 @@ static int ast_rtp_activate(struct ast_rtp_instance *instance);
 static void dtls_srtp_check_pending(struct ast_rtp_instance *instance, struct ast_rtp *rtp, int rtcp);
 static void dtls_srtp_start_timeout_timer(struct ast_rtp_instance *instance, struct ast_rtp *rtp, int rtcp);
 static void dtls_srtp_stop_timeout_timer(struct ast_rtp_instance *instance, struct ast_rtp *rtp, int rtcp);
+static void dtls_tasks_wait(struct dtls_details *dtls);
 #endif
 
 static int __rtp_sendto(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp, int *ice, int use_srtp);
@@ -733,7 +848,7 @@ static void ast_rtp_ice_start(struct ast_rtp_instance *instance)
 			ast_debug(3, "Successfully created ICE checklist (%p)\n", instance);
 			ast_test_suite_event_notify("ICECHECKLISTCREATE", "Result: SUCCESS");
 			pj_ice_sess_start_check(rtp->ice);
-			pj_timer_heap_poll(timer_heap, NULL);
+			pj_timer_heap_poll(rtp->ice_timer->timerheap, NULL);
 			rtp->strict_rtp_state = STRICT_RTP_OPEN;
 			return;
 		}
@@ -981,6 +1096,8 @@ static int ioqueue_worker_thread(void *data)
 {
 	struct ast_rtp_ioqueue_thread *ioqueue = data;
 
+	ast_thread_affinity_apply(AST_THREAD_CLASS_RTP);
+
 	while (!ioqueue->terminate) {
 		const pj_time_val delay = {0, 10};
 
@@ -1025,23 +1142,47 @@ static void rtp_ioqueue_thread_remove(struct ast_rtp_ioqueue_thread *ioqueue)
 	rtp_ioqueue_thread_destroy(ioqueue);
 }
 
-/*! \brief Finder and allocator for an ioqueue thread */
+/*!
+ * \brief Number of threads to use for ICE timers and for TURN sockets each
+ */
+static unsigned int rtp_ice_thread_limit(void)
+{
+	long cpus;
+
+	if (ice_threads) {
+		return ice_threads;
+	}
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cpus < 1 ? 1 : MIN(cpus, MAX_ICE_THREADS);
+}
+
+/*!
+ * \brief Finder and allocator for an ioqueue thread
+ *
+ * New threads are started until there are as many as the ICE thread limit,
+ * after that sessions go to the thread with the fewest sockets.
+ */
 static struct ast_rtp_ioqueue_thread *rtp_ioqueue_thread_get_or_create(void)
 {
-	struct ast_rtp_ioqueue_thread *ioqueue;
+	struct ast_rtp_ioqueue_thread *ioqueue, *least = NULL;
+	unsigned int threads = 0;
 	pj_lock_t *lock;
 
 	AST_LIST_LOCK(&ioqueues);
 
-	/* See if an ioqueue thread exists that can handle more */
+	/* Find the ioqueue thread that can handle more and handles the least */
 	AST_LIST_TRAVERSE(&ioqueues, ioqueue, next) {
-		if ((ioqueue->count + 2) < PJ_IOQUEUE_MAX_HANDLES) {
-			break;
+		++threads;
+		if ((ioqueue->count + 2) < PJ_IOQUEUE_MAX_HANDLES && (!least || ioqueue->count < least->count)) {
+			least = ioqueue;
 		}
 	}
 
-	/* If we found one bump it up and return it */
-	if (ioqueue) {
+	/* If we found one and may not start another bump it up and return it */
+	if (least && threads >= rtp_ice_thread_limit()) {
+		ioqueue = least;
 		ioqueue->count += 2;
 		goto end;
 	}
@@ -1260,6 +1401,8 @@ static int dtls_details_initialize(struct dtls_details *dtls, SSL_CTX *ssl_ctx,
 		SSL_set_connect_state(dtls->ssl);
 	}
 	dtls->connection = AST_RTP_DTLS_CONNECTION_NEW;
+	dtls->failed = 0;
+	dtls->start = ast_tv(0, 0);
 
 	ast_mutex_init(&dtls->lock);
 
@@ -1294,60 +1437,64 @@ static int dtls_setup_rtcp(struct ast_rtp_instance *instance)
 	return dtls_details_initialize(&rtp->rtcp->dtls, rtp->ssl_ctx, rtp->dtls.dtls_setup);
 }
 
-static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, const struct ast_rtp_dtls_cfg *dtls_cfg)
+static void dtls_context_destructor(void *obj)
 {
-	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
-	int res;
-#ifndef HAVE_OPENSSL_ECDH_AUTO
-	EC_KEY *ecdh;
-#endif
+	struct dtls_context *context = obj;
 
-	if (!dtls_cfg->enabled) {
-		return 0;
+	if (context->ssl_ctx) {
+		SSL_CTX_free(context->ssl_ctx);
 	}
+}
 
-	if (!ast_rtp_engine_srtp_is_registered()) {
-		ast_log(LOG_ERROR, "SRTP support module is not loaded or available. Try loading res_srtp.so.\n");
-		return -1;
-	}
+/*!
+ * \internal
+ * \brief Create an SSL context for a DTLS configuration
+ */
+static struct dtls_context *dtls_context_alloc(struct ast_rtp_instance *instance,
+	const struct ast_rtp_dtls_cfg *dtls_cfg, const char *key)
+{
+	struct dtls_context *context;
+#ifndef HAVE_OPENSSL_ECDH_AUTO
+	EC_KEY *ecdh;
+#endif
 
-	if (rtp->ssl_ctx) {
-		return 0;
+	if (!(context = ao2_alloc_options(sizeof(*context) + strlen(key) + 1, dtls_context_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return NULL;
 	}
+	strcpy(context->key, key); /* Safe */
 
-	if (!(rtp->ssl_ctx = SSL_CTX_new(DTLSv1_method()))) {
-		return -1;
+	if (!(context->ssl_ctx = SSL_CTX_new(DTLSv1_method()))) {
+		ao2_ref(context, -1);
+		return NULL;
 	}
 
-	SSL_CTX_set_read_ahead(rtp->ssl_ctx, 1);
+	SSL_CTX_set_read_ahead(context->ssl_ctx, 1);
 
 #ifdef HAVE_OPENSSL_ECDH_AUTO
-	SSL_CTX_set_ecdh_auto(rtp->ssl_ctx, 1);
+	SSL_CTX_set_ecdh_auto(context->ssl_ctx, 1);
 #else
 	ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
 	if (ecdh) {
-		SSL_CTX_set_tmp_ecdh(rtp->ssl_ctx, ecdh);
+		SSL_CTX_set_tmp_ecdh(context->ssl_ctx, ecdh);
 		EC_KEY_free(ecdh);
 	}
 #endif
 
-	rtp->dtls_verify = dtls_cfg->verify;
-
-	SSL_CTX_set_verify(rtp->ssl_ctx, (rtp->dtls_verify & AST_RTP_DTLS_VERIFY_FINGERPRINT) || (rtp->dtls_verify & AST_RTP_DTLS_VERIFY_CERTIFICATE) ?
-		SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT : SSL_VERIFY_NONE, !(rtp->dtls_verify & AST_RTP_DTLS_VERIFY_CERTIFICATE) ?
+	SSL_CTX_set_verify(context->ssl_ctx, (dtls_cfg->verify & AST_RTP_DTLS_VERIFY_FINGERPRINT) || (dtls_cfg->verify & AST_RTP_DTLS_VERIFY_CERTIFICATE) ?
+		SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT : SSL_VERIFY_NONE, !(dtls_cfg->verify & AST_RTP_DTLS_VERIFY_CERTIFICATE) ?
 		dtls_verify_callback : NULL);
 
 	if (dtls_cfg->suite == AST_AES_CM_128_HMAC_SHA1_80) {
-		SSL_CTX_set_tlsext_use_srtp(rtp->ssl_ctx, "SRTP_AES128_CM_SHA1_80");
+		SSL_CTX_set_tlsext_use_srtp(context->ssl_ctx, "SRTP_AES128_CM_SHA1_80");
 	} else if (dtls_cfg->suite == AST_AES_CM_128_HMAC_SHA1_32) {
-		SSL_CTX_set_tlsext_use_srtp(rtp->ssl_ctx, "SRTP_AES128_CM_SHA1_32");
+		SSL_CTX_set_tlsext_use_srtp(context->ssl_ctx, "SRTP_AES128_CM_SHA1_32");
 	} else {
 		ast_log(LOG_ERROR, "Unsupported suite specified for DTLS-SRTP on RTP instance '%p'\n", instance);
-		return -1;
+		ao2_ref(context, -1);
+		return NULL;
 	}
 
-	rtp->local_hash = dtls_cfg->hash;
-
 	if (!ast_strlen_zero(dtls_cfg->certfile)) {
 		char *private = ast_strlen_zero(dtls_cfg->pvtfile) ? dtls_cfg->certfile : dtls_cfg->pvtfile;
 		BIO *certbio;
@@ -1355,35 +1502,40 @@ static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, con
 		const EVP_MD *type;
 		unsigned int size, i;
 		unsigned char fingerprint[EVP_MAX_MD_SIZE];
-		char *local_fingerprint = rtp->local_fingerprint;
+		char *local_fingerprint = context->fingerprint;
 
-		if (!SSL_CTX_use_certificate_file(rtp->ssl_ctx, dtls_cfg->certfile, SSL_FILETYPE_PEM)) {
+		if (!SSL_CTX_use_certificate_file(context->ssl_ctx, dtls_cfg->certfile, SSL_FILETYPE_PEM)) {
 			ast_log(LOG_ERROR, "Specified certificate file '%s' for RTP instance '%p' could not be used\n",
 				dtls_cfg->certfile, instance);
-			return -1;
+			ao2_ref(context, -1);
+			return NULL;
 		}
 
-		if (!SSL_CTX_use_PrivateKey_file(rtp->ssl_ctx, private, SSL_FILETYPE_PEM) ||
-		    !SSL_CTX_check_private_key(rtp->ssl_ctx)) {
+		if (!SSL_CTX_use_PrivateKey_file(context->ssl_ctx, private, SSL_FILETYPE_PEM) ||
+		    !SSL_CTX_check_private_key(context->ssl_ctx)) {
 			ast_log(LOG_ERROR, "Specified private key file '%s' for RTP instance '%p' could not be used\n",
 				private, instance);
-			return -1;
+			ao2_ref(context, -1);
+			return NULL;
 		}
 
 		if (!(certbio = BIO_new(BIO_s_file()))) {
 			ast_log(LOG_ERROR, "Failed to allocate memory for certificate fingerprinting on RTP instance '%p'\n",
 				instance);
-			return -1;
+			ao2_ref(context, -1);
+			return NULL;
 		}
 
-		if (rtp->local_hash == AST_RTP_DTLS_HASH_SHA1) {
+		if (dtls_cfg->hash == AST_RTP_DTLS_HASH_SHA1) {
 			type = EVP_sha1();
-		} else if (rtp->local_hash == AST_RTP_DTLS_HASH_SHA256) {
+		} else if (dtls_cfg->hash == AST_RTP_DTLS_HASH_SHA256) {
 			type = EVP_sha256();
 		} else {
 			ast_log(LOG_ERROR, "Unsupported fingerprint hash type on RTP instance '%p'\n",
 				instance);
-			return -1;
+			BIO_free_all(certbio);
+			ao2_ref(context, -1);
+			return NULL;
 		}
 
 		if (!BIO_read_filename(certbio, dtls_cfg->certfile) ||
@@ -1393,7 +1545,8 @@ static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, con
 			ast_log(LOG_ERROR, "Could not produce fingerprint from certificate '%s' for RTP instance '%p'\n",
 				dtls_cfg->certfile, instance);
 			BIO_free_all(certbio);
-			return -1;
+			ao2_ref(context, -1);
+			return NULL;
 		}
 
 		for (i = 0; i < size; i++) {
@@ -1407,20 +1560,137 @@ static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, con
 	}
 
 	if (!ast_strlen_zero(dtls_cfg->cipher)) {
-		if (!SSL_CTX_set_cipher_list(rtp->ssl_ctx, dtls_cfg->cipher)) {
+		if (!SSL_CTX_set_cipher_list(context->ssl_ctx, dtls_cfg->cipher)) {
 			ast_log(LOG_ERROR, "Invalid cipher specified in cipher list '%s' for RTP instance '%p'\n",
 				dtls_cfg->cipher, instance);
-			return -1;
+			ao2_ref(context, -1);
+			return NULL;
 		}
 	}
 
 	if (!ast_strlen_zero(dtls_cfg->cafile) || !ast_strlen_zero(dtls_cfg->capath)) {
-		if (!SSL_CTX_load_verify_locations(rtp->ssl_ctx, S_OR(dtls_cfg->cafile, NULL), S_OR(dtls_cfg->capath, NULL))) {
+		if (!SSL_CTX_load_verify_locations(context->ssl_ctx, S_OR(dtls_cfg->cafile, NULL), S_OR(dtls_cfg->capath, NULL))) {
 			ast_log(LOG_ERROR, "Invalid certificate authority file '%s' or path '%s' specified for RTP instance '%p'\n",
 				S_OR(dtls_cfg->cafile, ""), S_OR(dtls_cfg->capath, ""), instance);
-			return -1;
+			ao2_ref(context, -1);
+			return NULL;
+		}
+	}
+
+	return context;
+}
+
+/*!
+ * \internal
+ * \brief Get the SSL context for a DTLS configuration, sharing one already in use
+ *
+ * Loading the certificate and key for every call is expensive, and instances
+ * configured the same way can use the same context.
+ */
+static struct dtls_context *dtls_context_get(struct ast_rtp_instance *instance,
+	const struct ast_rtp_dtls_cfg *dtls_cfg)
+{
+	struct dtls_context *context;
+	struct ast_str *key = ast_str_alloca(1024);
+
+	ast_str_set(&key, 0, "%d/%d/%d/%s/%s/%s/%s/%s", dtls_cfg->verify, dtls_cfg->suite,
+		dtls_cfg->hash, S_OR(dtls_cfg->certfile, ""), S_OR(dtls_cfg->pvtfile, ""),
+		S_OR(dtls_cfg->cipher, ""), S_OR(dtls_cfg->cafile, ""), S_OR(dtls_cfg->capath, ""));
+
+	ao2_lock(dtls_contexts);
+	if (!(context = ao2_find(dtls_contexts, ast_str_buffer(key), OBJ_SEARCH_KEY | OBJ_NOLOCK))) {
+		if ((context = dtls_context_alloc(instance, dtls_cfg, ast_str_buffer(key)))) {
+			ao2_link_flags(dtls_contexts, context, OBJ_NOLOCK);
 		}
 	}
+	ao2_unlock(dtls_contexts);
+
+	return context;
+}
+
+/*!
+ * \internal
+ * \brief Release an SSL context, forgetting it once no instance uses it
+ */
+static void dtls_context_release(struct dtls_context *context)
+{
+	if (!context) {
+		return;
+	}
+
+	ao2_lock(dtls_contexts);
+	/* The container and the caller hold the last references */
+	if (ao2_ref(context, 0) == 2) {
+		ao2_unlink_flags(dtls_contexts, context, OBJ_NOLOCK);
+	}
+	ao2_unlock(dtls_contexts);
+
+	ao2_ref(context, -1);
+}
+
+static int dtls_context_hash_fn(const void *obj, const int flags)
+{
+	const struct dtls_context *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int dtls_context_cmp_fn(void *obj, void *arg, int flags)
+{
+	const struct dtls_context *object_left = obj;
+	const struct dtls_context *object_right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(object_left->key, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, const struct ast_rtp_dtls_cfg *dtls_cfg)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	int res;
+
+	if (!dtls_cfg->enabled) {
+		return 0;
+	}
+
+	if (!ast_rtp_engine_srtp_is_registered()) {
+		ast_log(LOG_ERROR, "SRTP support module is not loaded or available. Try loading res_srtp.so.\n");
+		return -1;
+	}
+
+	if (rtp->ssl_ctx) {
+		return 0;
+	}
+
+	if (!(rtp->dtls_context = dtls_context_get(instance, dtls_cfg))) {
+		return -1;
+	}
+	rtp->ssl_ctx = rtp->dtls_context->ssl_ctx;
+
+	rtp->dtls_verify = dtls_cfg->verify;
+	rtp->local_hash = dtls_cfg->hash;
+	ast_copy_string(rtp->local_fingerprint, rtp->dtls_context->fingerprint, sizeof(rtp->local_fingerprint));
 
 	rtp->rekey = dtls_cfg->rekey;
 	rtp->suite = dtls_cfg->suite;
@@ -1446,8 +1716,15 @@ static void ast_rtp_dtls_stop(struct ast_rtp_instance *instance)
 
 	dtls_srtp_stop_timeout_timer(instance, rtp, 0);
 
+	/* Let the DTLS threads finish with the SSL sessions first */
+	dtls_tasks_wait(&rtp->dtls);
+	if (rtp->rtcp) {
+		dtls_tasks_wait(&rtp->rtcp->dtls);
+	}
+
 	if (rtp->ssl_ctx) {
-		SSL_CTX_free(rtp->ssl_ctx);
+		dtls_context_release(rtp->dtls_context);
+		rtp->dtls_context = NULL;
 		rtp->ssl_ctx = NULL;
 	}
 
@@ -1649,14 +1926,17 @@ static void dtls_perform_handshake(struct ast_rtp_instance *instance, struct dtl
 		return;
 	}
 
-	SSL_do_handshake(dtls->ssl);
-
 	/* Since the handshake is started in a thread outside of the channel thread it's possible
-	 * for the response to be handled in the channel thread before we start the timeout timer.
-	 * To ensure this doesn't actually happen we hold the DTLS lock. The channel thread will
-	 * block until we're done at which point the timeout timer will be immediately stopped.
+	 * for the response to be handled in the channel thread, or a DTLS thread, before we start
+	 * the timeout timer. To ensure this doesn't actually happen we hold the DTLS lock. The
+	 * other thread will block until we're done at which point the timeout timer will be
+	 * immediately stopped.
 	 */
 	ast_mutex_lock(&dtls->lock);
+	if (ast_tvzero(dtls->start)) {
+		dtls->start = ast_tvnow();
+	}
+	SSL_do_handshake(dtls->ssl);
 	dtls_srtp_check_pending(instance, rtp, rtcp);
 	dtls_srtp_start_timeout_timer(instance, rtp, rtcp);
 	ast_mutex_unlock(&dtls->lock);
@@ -1763,17 +2043,84 @@ static pj_ice_sess_cb ast_rtp_ice_sess_cb = {
 /*! \brief Worker thread for timerheap */
 static int timer_worker_thread(void *data)
 {
-	pj_ioqueue_t *ioqueue;
+	struct ast_rtp_timer_thread *timer = data;
+
+	while (!timer_terminate) {
+		const pj_time_val delay = {0, 10};
+
+		pj_timer_heap_poll(timer->timerheap, NULL);
+		pj_ioqueue_poll(timer->ioqueue, &delay);
+	}
+
+	return 0;
+}
 
-	if (pj_ioqueue_create(pool, 1, &ioqueue) != PJ_SUCCESS) {
+/*!
+ * \brief Pick the ICE timer thread with the fewest sessions
+ */
+static struct ast_rtp_timer_thread *rtp_timer_thread_get(void)
+{
+	struct ast_rtp_timer_thread *least = &timer_threads[0];
+	unsigned int i;
+
+	for (i = 1; i < timer_thread_count; ++i) {
+		if (timer_threads[i].sessions < least->sessions) {
+			least = &timer_threads[i];
+		}
+	}
+	ast_atomic_fetchadd_int(&least->sessions, +1);
+
+	return least;
+}
+
+static void rtp_timer_threads_stop(void)
+{
+	unsigned int i;
+
+	timer_terminate = 1;
+	for (i = 0; i < timer_thread_count; ++i) {
+		if (timer_threads[i].thread) {
+			pj_thread_join(timer_threads[i].thread);
+			pj_thread_destroy(timer_threads[i].thread);
+		}
+	}
+	ast_free(timer_threads);
+	timer_threads = NULL;
+	timer_thread_count = 0;
+}
+
+/*!
+ * \brief Start the threads executing the timer heaps of ICE sessions
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int rtp_timer_threads_start(void)
+{
+	unsigned int count = rtp_ice_thread_limit();
+	pj_lock_t *lock;
+
+	if (!(timer_threads = ast_calloc(count, sizeof(*timer_threads)))) {
 		return -1;
 	}
 
-	while (!timer_terminate) {
-		const pj_time_val delay = {0, 10};
+	timer_terminate = 0;
+	for (timer_thread_count = 0; timer_thread_count < count; ++timer_thread_count) {
+		struct ast_rtp_timer_thread *timer = &timer_threads[timer_thread_count];
+
+		if (pj_timer_heap_create(pool, 100, &timer->timerheap) != PJ_SUCCESS
+			|| pj_lock_create_recursive_mutex(pool, "rtp%p", &lock) != PJ_SUCCESS
+			|| pj_ioqueue_create(pool, 1, &timer->ioqueue) != PJ_SUCCESS) {
+			rtp_timer_threads_stop();
+			return -1;
+		}
 
-		pj_timer_heap_poll(timer_heap, NULL);
-		pj_ioqueue_poll(ioqueue, &delay);
+		pj_timer_heap_set_lock(timer->timerheap, lock, PJ_TRUE);
+
+		if (pj_thread_create(pool, "timer", &timer_worker_thread, timer, 0, 0, &timer->thread) != PJ_SUCCESS) {
+			rtp_timer_threads_stop();
+			return -1;
+		}
 	}
 
 	return 0;
@@ -2048,10 +2395,14 @@ static int dtls_srtp_setup(struct ast_rtp *rtp, struct ast_srtp *srtp, struct as
 
 	res_srtp_policy->set_ssrc(remote_policy, 0, 1);
 
+	/* The media path may be sending with the current SRTP session from another thread */
+	ao2_lock(instance);
 	if (ast_rtp_instance_add_srtp_policy(instance, remote_policy, local_policy)) {
+		ao2_unlock(instance);
 		ast_log(LOG_WARNING, "Could not set policies when setting up DTLS-SRTP on '%p'\n", rtp);
 		goto error;
 	}
+	ao2_unlock(instance);
 
 	if (rtp->rekey) {
 		ao2_ref(instance, +1);
@@ -2075,77 +2426,218 @@ error:
 }
 #endif
 
-static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp)
+#ifdef HAVE_OPENSSL_SRTP
+/*!
+ * \internal
+ * \brief Count a completed DTLS handshake in the handshake time statistics
+ */
+static void dtls_count_latency(struct dtls_details *dtls)
+{
+	int elapsed = ast_tvdiff_ms(ast_tvnow(), dtls->start);
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(dtls_latency_bounds); ++i) {
+		if (elapsed < dtls_latency_bounds[i]) {
+			break;
+		}
+	}
+	ast_atomic_fetchadd_int(&dtls_latency_counts[i], +1);
+
+	dtls->start = ast_tv(0, 0);
+}
+
+/*!
+ * \internal
+ * \brief Pass a received DTLS packet to OpenSSL
+ *
+ * \retval 0 on success
+ * \retval -1 if the DTLS session failed
+ */
+static int dtls_handle_packet(struct ast_rtp_instance *instance, void *buf, int len, int rtcp)
 {
-	int len;
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
 	struct ast_srtp *srtp = ast_rtp_instance_get_srtp(instance);
-	char *in = buf;
-#ifdef HAVE_PJPROJECT
-	struct ast_sockaddr *loop = rtcp ? &rtp->rtcp_loop : &rtp->rtp_loop;
-#endif
+	struct dtls_details *dtls = !rtcp ? &rtp->dtls : &rtp->rtcp->dtls;
+	int res = 0;
 
-	if ((len = ast_recvfrom(rtcp ? rtp->rtcp->s : rtp->s, buf, size, flags, sa)) < 0) {
-	   return len;
+	/* If no SSL session actually exists terminate things */
+	if (!dtls->ssl) {
+		ast_log(LOG_ERROR, "Received SSL traffic on RTP instance '%p' without an SSL session\n",
+			instance);
+		return -1;
 	}
 
-#ifdef HAVE_OPENSSL_SRTP
-	/* If this is an SSL packet pass it to OpenSSL for processing. RFC section for first byte value:
-	 * https://tools.ietf.org/html/rfc5764#section-5.1.2 */
-	if ((*in >= 20) && (*in <= 63)) {
-		struct dtls_details *dtls = !rtcp ? &rtp->dtls : &rtp->rtcp->dtls;
-		int res = 0;
+	/* This mutex is locked so that this thread blocks until the dtls_perform_handshake function
+	 * completes.
+	 */
+	ast_mutex_lock(&dtls->lock);
+	ast_mutex_unlock(&dtls->lock);
 
-		/* If no SSL session actually exists terminate things */
-		if (!dtls->ssl) {
-			ast_log(LOG_ERROR, "Received SSL traffic on RTP instance '%p' without an SSL session\n",
-				instance);
-			return -1;
-		}
+	/* Before we feed data into OpenSSL ensure that the timeout timer is either stopped or completed */
+	dtls_srtp_stop_timeout_timer(instance, rtp, rtcp);
 
-		/* This mutex is locked so that this thread blocks until the dtls_perform_handshake function
-		 * completes.
-		 */
-		ast_mutex_lock(&dtls->lock);
-		ast_mutex_unlock(&dtls->lock);
+	/* If we don't yet know if we are active or passive and we receive a packet... we are obviously passive */
+	if (dtls->dtls_setup == AST_RTP_DTLS_SETUP_ACTPASS) {
+		dtls->dtls_setup = AST_RTP_DTLS_SETUP_PASSIVE;
+		SSL_set_accept_state(dtls->ssl);
+	}
 
-		/* Before we feed data into OpenSSL ensure that the timeout timer is either stopped or completed */
-		dtls_srtp_stop_timeout_timer(instance, rtp, rtcp);
+	if (ast_tvzero(dtls->start) && !SSL_is_init_finished(dtls->ssl)) {
+		dtls->start = ast_tvnow();
+	}
 
-		/* If we don't yet know if we are active or passive and we receive a packet... we are obviously passive */
-		if (dtls->dtls_setup == AST_RTP_DTLS_SETUP_ACTPASS) {
-			dtls->dtls_setup = AST_RTP_DTLS_SETUP_PASSIVE;
-			SSL_set_accept_state(dtls->ssl);
-		}
+	dtls_srtp_check_pending(instance, rtp, rtcp);
 
-		dtls_srtp_check_pending(instance, rtp, rtcp);
+	BIO_write(dtls->read_bio, buf, len);
 
-		BIO_write(dtls->read_bio, buf, len);
+	len = SSL_read(dtls->ssl, buf, len);
 
-		len = SSL_read(dtls->ssl, buf, len);
+	if ((len < 0) && (SSL_get_error(dtls->ssl, len) == SSL_ERROR_SSL)) {
+		unsigned long error = ERR_get_error();
+		ast_log(LOG_ERROR, "DTLS failure occurred on RTP instance '%p' due to reason '%s', terminating\n",
+			instance, ERR_reason_error_string(error));
+		return -1;
+	}
 
-		if ((len < 0) && (SSL_get_error(dtls->ssl, len) == SSL_ERROR_SSL)) {
-			unsigned long error = ERR_get_error();
-			ast_log(LOG_ERROR, "DTLS failure occurred on RTP instance '%p' due to reason '%s', terminating\n",
-				instance, ERR_reason_error_string(error));
-			return -1;
+	dtls_srtp_check_pending(instance, rtp, rtcp);
+
+	if (SSL_is_init_finished(dtls->ssl)) {
+		if (!ast_tvzero(dtls->start)) {
+			dtls_count_latency(dtls);
+		}
+		/* Any further connections will be existing since this is now established */
+		dtls->connection = AST_RTP_DTLS_CONNECTION_EXISTING;
+		if (!rtcp) {
+			/* Use the keying material to set up key/salt information */
+			res = dtls_srtp_setup(rtp, srtp, instance);
 		}
+	} else {
+		/* Since we've sent additional traffic start the timeout timer for retransmission */
+		dtls_srtp_start_timeout_timer(instance, rtp, rtcp);
+	}
+
+	return res;
+}
 
-		dtls_srtp_check_pending(instance, rtp, rtcp);
+/*! \brief A received DTLS packet waiting for a DTLS thread */
+struct dtls_packet {
+	/*! The instance the packet was received on */
+	struct ast_rtp_instance *instance;
+	/*! Whether it was received on the RTCP socket */
+	int rtcp;
+	/*! Size of the packet */
+	int len;
+	unsigned char buf[0];
+};
 
-		if (SSL_is_init_finished(dtls->ssl)) {
-			/* Any further connections will be existing since this is now established */
-			dtls->connection = AST_RTP_DTLS_CONNECTION_EXISTING;
-			if (!rtcp) {
-				/* Use the keying material to set up key/salt information */
-				res = dtls_srtp_setup(rtp, srtp, instance);
-			}
-		} else {
-			/* Since we've sent additional traffic start the timeout timer for retransmission */
-			dtls_srtp_start_timeout_timer(instance, rtp, rtcp);
-		}
+static int dtls_packet_task(void *data)
+{
+	struct dtls_packet *packet = data;
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(packet->instance);
+	struct dtls_details *dtls = !packet->rtcp ? &rtp->dtls : &rtp->rtcp->dtls;
 
-		return res;
+	if (!dtls->failed && dtls_handle_packet(packet->instance, packet->buf, packet->len, packet->rtcp)) {
+		/* The media path hangs up on its next DTLS packet */
+		dtls->failed = 1;
+	}
+
+	if (ast_atomic_fetchadd_int(&dtls->tasks, -1) == 1) {
+		ast_mutex_lock(&dtls_tasks_lock);
+		ast_cond_broadcast(&dtls_tasks_cond);
+		ast_mutex_unlock(&dtls_tasks_lock);
+	}
+	ao2_ref(packet->instance, -1);
+	ast_free(packet);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Wait until the DTLS threads are done with the packets queued for a session
+ */
+static void dtls_tasks_wait(struct dtls_details *dtls)
+{
+	ast_mutex_lock(&dtls_tasks_lock);
+	while (dtls->tasks) {
+		ast_cond_wait(&dtls_tasks_cond, &dtls_tasks_lock);
+	}
+	ast_mutex_unlock(&dtls_tasks_lock);
+}
+
+/*!
+ * \internal
+ * \brief Hand a received DTLS packet to a DTLS thread
+ *
+ * An instance always uses the same thread so its packets are handled in the
+ * order they were received.
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int dtls_queue_packet(struct ast_rtp_instance *instance, struct dtls_details *dtls,
+	void *buf, int len, int rtcp)
+{
+	struct dtls_packet *packet;
+	struct ast_taskprocessor *serializer;
+
+	if (!(packet = ast_malloc(sizeof(*packet) + len))) {
+		return -1;
+	}
+
+	packet->instance = ao2_bump(instance);
+	packet->rtcp = rtcp;
+	packet->len = len;
+	memcpy(packet->buf, buf, len);
+
+	serializer = dtls_serializers[((uintptr_t) instance >> 4) % dtls_serializer_count];
+
+	ast_atomic_fetchadd_int(&dtls->tasks, +1);
+	if (ast_taskprocessor_push(serializer, dtls_packet_task, packet)) {
+		ast_atomic_fetchadd_int(&dtls->tasks, -1);
+		ao2_ref(instance, -1);
+		ast_free(packet);
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Pass a received packet through DTLS, ICE and SRTP
+ *
+ * \return Length of the RTP or RTCP packet left in buf, 0 if there is none,
+ * -1 on error.
+ */
+static int rtp_recv_process(struct ast_rtp_instance *instance, void *buf, int len, struct ast_sockaddr *sa, int rtcp)
+{
+#if defined(HAVE_PJPROJECT) || defined(HAVE_OPENSSL_SRTP)
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+#endif
+	struct ast_srtp *srtp;
+	char *in = buf;
+#ifdef HAVE_PJPROJECT
+	struct ast_sockaddr *loop = rtcp ? &rtp->rtcp_loop : &rtp->rtp_loop;
+#endif
+
+#ifdef HAVE_OPENSSL_SRTP
+	/* If this is an SSL packet pass it to OpenSSL for processing. RFC section for first byte value:
+	 * https://tools.ietf.org/html/rfc5764#section-5.1.2 */
+	if ((*in >= 20) && (*in <= 63)) {
+		struct dtls_details *dtls = !rtcp ? &rtp->dtls : &rtp->rtcp->dtls;
+
+		if (dtls->failed) {
+			errno = EIO;
+			return -1;
+		}
+
+		if (dtls_pool && dtls->ssl && (dtls->tasks || !SSL_is_init_finished(dtls->ssl))) {
+			return dtls_queue_packet(instance, dtls, buf, len, rtcp);
+		}
+
+		return dtls_handle_packet(instance, buf, len, rtcp);
 	}
 #endif
 
@@ -2186,6 +2678,15 @@ static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t s
 	}
 #endif
 
+#ifdef HAVE_OPENSSL_SRTP
+	/* Until the DTLS threads are done the keys may be changing under us */
+	if ((*in & 0xC0) && (!rtcp ? rtp->dtls.tasks : rtp->rtcp->dtls.tasks)) {
+		return 0;
+	}
+#endif
+
+	/* Only fetched now, as the DTLS threads replace it when a handshake completes */
+	srtp = ast_rtp_instance_get_srtp(instance);
 	if ((*in & 0xC0) && res_srtp && srtp && res_srtp->unprotect(srtp, buf, &len, rtcp) < 0) {
 	   return -1;
 	}
@@ -2193,48 +2694,295 @@ static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t s
 	return len;
 }
 
+static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	int len;
+
+	if ((len = ast_recvfrom(rtcp ? rtp->rtcp->s : rtp->s, buf, size, flags, sa)) < 0) {
+	   return len;
+	}
+
+	return rtp_recv_process(instance, buf, len, sa, rtcp);
+}
+
 static int rtcp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa)
 {
 	return __rtp_recvfrom(instance, buf, size, flags, sa, 1);
 }
 
-static int rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa)
+#ifdef HAVE_RECVMMSG
+/*!
+ * \brief RTP packets read from a socket at once
+ *
+ * ast_rtp_read() reads the first packet into the raw data of the instance
+ * and the others here.  It then processes them one by one, copying each to
+ * the raw data of the instance, before it returns.
+ */
+struct rtp_read_batch {
+	/*! The instance the packets were read for, not a reference */
+	struct ast_rtp_instance *instance;
+	/*! Packets read */
+	unsigned int count;
+	/*! Next packet to process */
+	unsigned int next;
+	/*! Whether SRTP was already removed from all the packets */
+	unsigned int unprotected;
+	/*! Size of each packet after SRTP was removed, -1 if it failed */
+	int lens[MAX_READ_BATCH];
+	struct mmsghdr msgs[MAX_READ_BATCH];
+	struct iovec iovs[MAX_READ_BATCH];
+	struct ast_sockaddr addrs[MAX_READ_BATCH];
+	/*! Packets in data there is room for */
+	unsigned int slots;
+	/*! The packets after the first */
+	unsigned char (*data)[READ_BATCH_PACKET_SIZE];
+};
+
+static void rtp_read_batch_cleanup(void *data)
 {
-	return __rtp_recvfrom(instance, buf, size, flags, sa, 0);
+	struct rtp_read_batch *batch = data;
+
+	ast_free(batch->data);
+	ast_free(batch);
 }
 
-static int __rtp_sendto(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp, int *ice, int use_srtp)
+AST_THREADSTORAGE_CUSTOM(rtp_read_batch_buf, NULL, rtp_read_batch_cleanup);
+
+/*!
+ * \internal
+ * \brief Remove SRTP from all the packets of a batch with one call
+ *
+ * This is only done when nothing but SRTP handling would look at the packets
+ * first, so there is no ICE and none of them is DTLS.
+ *
+ * \retval 1 SRTP was removed
+ * \retval 0 the packets need the usual handling one by one
+ */
+static int rtp_read_batch_unprotect(struct rtp_read_batch *batch, struct ast_rtp_instance *instance, void *buf)
 {
-	int len = size;
-	void *temp = buf;
+	struct ast_srtp *srtp;
+	void *bufs[MAX_READ_BATCH];
+	unsigned int i;
+#if defined(HAVE_PJPROJECT) || defined(HAVE_OPENSSL_SRTP)
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
-	struct ast_srtp *srtp = ast_rtp_instance_get_srtp(instance);
-	int res;
+#endif
 
-	*ice = 0;
+#ifdef HAVE_PJPROJECT
+	if (rtp->ice || !ast_sockaddr_isnull(&rtp->rtp_loop)) {
+		return 0;
+	}
+#endif
+
+#ifdef HAVE_OPENSSL_SRTP
+	/* Leave the packets to rtp_recv_process() while the keys may be changing */
+	if (rtp->dtls.tasks) {
+		return 0;
+	}
+#endif
 
-	if (use_srtp && res_srtp && srtp && res_srtp->protect(srtp, &temp, &len, rtcp) < 0) {
+	srtp = ast_rtp_instance_get_srtp(instance);
+	if (batch->count < 2 || !srtp || !res_srtp || !res_srtp->unprotect_batch) {
+		return 0;
+	}
+
+	for (i = 0; i < batch->count; ++i) {
+		bufs[i] = i ? batch->data[i - 1] : buf;
+		if (!(*(unsigned char *) bufs[i] & 0xC0) || (batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+			return 0;
+		}
+		batch->lens[i] = batch->msgs[i].msg_len;
+	}
+
+	res_srtp->unprotect_batch(srtp, bufs, batch->lens, batch->count, 0);
+
+	return 1;
+}
+
+/*!
+ * \internal
+ * \brief Read the next RTP packet of an instance, from the batch if it has one
+ *
+ * \return Length of the packet copied to buf, -1 on error with errno set.
+ */
+static int rtp_read_batch_next(struct rtp_read_batch *batch, struct ast_rtp_instance *instance,
+	void *buf, size_t size, struct ast_sockaddr *sa)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	unsigned int i;
+	int count;
+
+	if (batch->instance == instance && batch->next < batch->count) {
+		i = batch->next++;
+		if (batch->msgs[i].msg_len > size || (batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+			ast_log(LOG_WARNING, "RTP packet of %u bytes too large, dropping\n", batch->msgs[i].msg_len);
+			errno = EAGAIN;
+			return -1;
+		}
+		if (batch->unprotected) {
+			if (batch->lens[i] < 0) {
+				errno = EAGAIN;
+				return -1;
+			}
+			memcpy(buf, batch->data[i - 1], batch->lens[i]);
+			ast_sockaddr_copy(sa, &batch->addrs[i]);
+			return batch->lens[i];
+		}
+		memcpy(buf, batch->data[i - 1], batch->msgs[i].msg_len);
+		ast_sockaddr_copy(sa, &batch->addrs[i]);
+		return batch->msgs[i].msg_len;
+	}
+
+	/* The packet data is only allocated for as many as are read at once */
+	if (batch->slots < read_batch - 1) {
+		void *data = ast_realloc(batch->data, sizeof(batch->data[0]) * (read_batch - 1));
+
+		if (!data) {
+			return -1;
+		}
+		batch->data = data;
+		batch->slots = read_batch - 1;
+	}
+
+	memset(batch->msgs, 0, sizeof(batch->msgs[0]) * read_batch);
+	for (i = 0; i < read_batch; ++i) {
+		batch->iovs[i].iov_base = i ? batch->data[i - 1] : buf;
+		batch->iovs[i].iov_len = i ? sizeof(batch->data[0]) : size;
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i].ss;
+		batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i].ss);
+	}
+
+	batch->instance = instance;
+	batch->count = 0;
+	batch->next = 0;
+	batch->unprotected = 0;
+	count = recvmmsg(rtp->s, batch->msgs, read_batch, 0, NULL);
+	if (count <= 0) {
+		if (!count) {
+			errno = EAGAIN;
+		}
 		return -1;
 	}
+	for (i = 0; i < count; ++i) {
+		batch->addrs[i].len = batch->msgs[i].msg_hdr.msg_namelen;
+	}
+	batch->count = count;
+	batch->next = 1;
+
+	ast_sockaddr_copy(sa, &batch->addrs[0]);
+	if ((batch->unprotected = rtp_read_batch_unprotect(batch, instance, buf))) {
+		if (batch->lens[0] < 0) {
+			errno = EAGAIN;
+			return -1;
+		}
+		return batch->lens[0];
+	}
+	return batch->msgs[0].msg_len;
+}
+
+/*!
+ * \internal
+ * \brief Check if the batch of the current thread has packets left for an instance
+ */
+static int rtp_read_batch_pending(struct ast_rtp_instance *instance)
+{
+	struct rtp_read_batch *batch = ast_threadstorage_get(&rtp_read_batch_buf, sizeof(*batch));
+
+	return batch && batch->instance == instance && batch->next < batch->count;
+}
+
+/*!
+ * \internal
+ * \brief Forget the packets left in the batch of the current thread
+ */
+static void rtp_read_batch_clear(void)
+{
+	struct rtp_read_batch *batch = ast_threadstorage_get(&rtp_read_batch_buf, sizeof(*batch));
+
+	if (batch) {
+		batch->instance = NULL;
+		batch->count = 0;
+		batch->next = 0;
+	}
+}
+#endif
+
+static int rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa)
+{
+#ifdef HAVE_RECVMMSG
+	struct rtp_read_batch *batch;
+	int len;
+
+	if (read_batch > 1 && !flags
+		&& (batch = ast_threadstorage_get(&rtp_read_batch_buf, sizeof(*batch)))) {
+		if ((len = rtp_read_batch_next(batch, instance, buf, size, sa)) < 0) {
+			return len;
+		}
+		if (batch->unprotected) {
+			return len;
+		}
+		return rtp_recv_process(instance, buf, len, sa, 0);
+	}
+#endif
+
+	return __rtp_recvfrom(instance, buf, size, flags, sa, 0);
+}
+
+/*! \brief Send a packet that is ready to go out, over ICE if it is in use */
+static int rtp_send_packet(struct ast_rtp_instance *instance, void *buf, int len, int flags, struct ast_sockaddr *sa, int rtcp, int *ice)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	int res;
 
 #ifdef HAVE_PJPROJECT
 	if (rtp->ice) {
 		pj_thread_register_check();
 
-		if (pj_ice_sess_send_data(rtp->ice, rtcp ? AST_RTP_ICE_COMPONENT_RTCP : AST_RTP_ICE_COMPONENT_RTP, temp, len) == PJ_SUCCESS) {
+		if (pj_ice_sess_send_data(rtp->ice, rtcp ? AST_RTP_ICE_COMPONENT_RTCP : AST_RTP_ICE_COMPONENT_RTP, buf, len) == PJ_SUCCESS) {
 			*ice = 1;
 			return len;
 		}
 	}
 #endif
 
-	res = ast_sendto(rtcp ? rtp->rtcp->s : rtp->s, temp, len, flags, sa);
+	res = ast_sendto(rtcp ? rtp->rtcp->s : rtp->s, buf, len, flags, sa);
 	if (res > 0) {
 		ast_rtp_instance_set_last_tx(instance, time(NULL));
 	}
 	return res;
 }
 
+static int __rtp_sendto(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp, int *ice, int use_srtp)
+{
+	int len = size;
+	void *temp = buf;
+	struct ast_srtp *srtp;
+	int res;
+
+	*ice = 0;
+
+	if (!use_srtp || !res_srtp) {
+		return rtp_send_packet(instance, buf, len, flags, sa, rtcp, ice);
+	}
+
+	/*
+	 * A DTLS thread replaces the SRTP session when a handshake completes, and
+	 * the protected packet is in a buffer of the session until it is sent.
+	 */
+	ao2_lock(instance);
+	srtp = ast_rtp_instance_get_srtp(instance);
+	if (srtp && res_srtp->protect(srtp, &temp, &len, rtcp) < 0) {
+		res = -1;
+	} else {
+		res = rtp_send_packet(instance, temp, len, flags, sa, rtcp, ice);
+	}
+	ao2_unlock(instance);
+
+	return res;
+}
+
 static int rtcp_sendto(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int *ice)
 {
 	return __rtp_sendto(instance, buf, size, flags, sa, 1, ice, 1);
@@ -2454,7 +3202,11 @@ static int ice_create(struct ast_rtp_instance *instance, struct ast_sockaddr *ad
 
 	pj_thread_register_check();
 
-	pj_stun_config_init(&stun_config, &cachingpool.factory, 0, NULL, timer_heap);
+	if (!rtp->ice_timer) {
+		rtp->ice_timer = rtp_timer_thread_get();
+	}
+
+	pj_stun_config_init(&stun_config, &cachingpool.factory, 0, NULL, rtp->ice_timer->timerheap);
 
 	ufrag = pj_str(rtp->local_ufrag);
 	passwd = pj_str(rtp->local_passwd);
@@ -2485,12 +3237,110 @@ static int ice_create(struct ast_rtp_instance *instance, struct ast_sockaddr *ad
 }
 #endif
 
+/*!
+ * \internal
+ * \brief Fill the port pool with the free even ports of a range
+ *
+ * Ports held by RTP instances stay held and only return to the pool on
+ * release if they are in the new range.
+ */
+static int port_pool_init(int start, int end)
+{
+	uint16_t *ports;
+	unsigned int size;
+	unsigned int offset;
+	unsigned int i;
+	int port;
+
+	start = (start + 1) & ~1;
+	size = (end - start) / 2 + 1;
+	if (!(ports = ast_malloc(size * sizeof(*ports)))) {
+		return -1;
+	}
+
+	ast_mutex_lock(&port_pool_lock);
+	ast_free(port_pool.ports);
+	port_pool.ports = ports;
+	port_pool.size = size;
+	port_pool.head = 0;
+	port_pool.count = 0;
+	port_pool.start = start;
+	port_pool.end = end;
+
+	/* Start somewhere random so the first ports handed out are not predictable */
+	offset = ast_random() % size;
+	for (i = 0; i < size; ++i) {
+		port = start + ((offset + i) % size) * 2;
+		if (!PORT_POOL_HELD(port)) {
+			port_pool.ports[port_pool.count++] = port;
+		}
+	}
+	ast_mutex_unlock(&port_pool_lock);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Take the free port released the longest time ago
+ *
+ * \return The port, -1 if all ports of the range are held.
+ */
+static int port_pool_get(void)
+{
+	int port = -1;
+
+	ast_mutex_lock(&port_pool_lock);
+	if (port_pool.count) {
+		port = port_pool.ports[port_pool.head];
+		port_pool.head = (port_pool.head + 1) % port_pool.size;
+		port_pool.count--;
+		PORT_POOL_SET_HELD(port);
+	}
+	ast_mutex_unlock(&port_pool_lock);
+
+	return port;
+}
+
+/*!
+ * \internal
+ * \brief Return a port taken with port_pool_get() to the pool
+ */
+static void port_pool_put(int port)
+{
+	ast_mutex_lock(&port_pool_lock);
+	if (PORT_POOL_HELD(port)) {
+		PORT_POOL_CLEAR_HELD(port);
+		if (port >= port_pool.start && port <= port_pool.end && port_pool.count < port_pool.size) {
+			port_pool.ports[(port_pool.head + port_pool.count) % port_pool.size] = port;
+			port_pool.count++;
+		}
+	}
+	ast_mutex_unlock(&port_pool_lock);
+}
+
+/*!
+ * \internal
+ * \brief Get the number of ports in the pool
+ */
+static unsigned int port_pool_count(void)
+{
+	unsigned int count;
+
+	ast_mutex_lock(&port_pool_lock);
+	count = port_pool.count;
+	ast_mutex_unlock(&port_pool_lock);
+
+	return count;
+}
+
 static int ast_rtp_new(struct ast_rtp_instance *instance,
 		       struct ast_sched_context *sched, struct ast_sockaddr *addr,
 		       void *data)
 {
 	struct ast_rtp *rtp = NULL;
-	int x, startplace;
+	unsigned int tries;
+	int x;
 
 	/* Create a new RTP structure to hold all of our data */
 	if (!(rtp = ast_calloc(1, sizeof(*rtp)))) {
@@ -2520,31 +3370,34 @@ static int ast_rtp_new(struct ast_rtp_instance *instance,
 		return -1;
 	}
 
-	/* Now actually find a free RTP port to use */
-	x = (rtpend == rtpstart) ? rtpstart : (ast_random() % (rtpend - rtpstart)) + rtpstart;
-	x = x & ~1;
-	startplace = x;
-
+	/*
+	 * Now actually find a free RTP port to use.  The pool only knows the ports
+	 * our own instances hold, so a port may still be in use by something else.
+	 * Each such port goes to the back of the pool and the next one is tried.
+	 */
+	tries = port_pool_count();
 	for (;;) {
+		if (!tries-- || (x = port_pool_get()) < 0) {
+			ast_log(LOG_ERROR, "Oh dear... we couldn't allocate a port for RTP instance '%p'\n", instance);
+			close(rtp->s);
+			ast_free(rtp);
+			return -1;
+		}
+
 		ast_sockaddr_set_port(addr, x);
 		/* Try to bind, this will tell us whether the port is available or not */
 		if (!ast_bind(rtp->s, addr)) {
 			ast_debug(1, "Allocated port %d for RTP instance '%p'\n", x, instance);
 			ast_rtp_instance_set_local_address(instance, addr);
+			rtp->port = x;
 			break;
 		}
 
-		x += 2;
-		if (x > rtpend) {
-			x = (rtpstart + 1) & ~1;
-		}
+		port_pool_put(x);
 
-		/* See if we ran out of ports or if the bind actually failed because of something other than the address being in use */
-		if (x == startplace || (errno != EADDRINUSE && errno != EACCES)) {
-			ast_log(LOG_ERROR, "Oh dear... we couldn't allocate a port for RTP instance '%p'\n", instance);
-			close(rtp->s);
-			ast_free(rtp);
-			return -1;
+		/* See if the bind actually failed because of something other than the address being in use */
+		if (errno != EADDRINUSE && errno != EACCES) {
+			tries = 0;
 		}
 	}
 
@@ -2581,9 +3434,26 @@ static int ast_rtp_new(struct ast_rtp_instance *instance,
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Drop the reference the frame of the instance holds to a receive buffer
+ *
+ * The reference goes to whoever frees the frame.  This releases it if the
+ * frame was dropped without being freed.
+ */
+static void rtp_rx_frame_release(struct ast_rtp *rtp)
+{
+	if (rtp->f.mallocd & AST_MALLOCD_SHARED) {
+		ao2_cleanup(rtp->f.shared);
+		rtp->f.shared = NULL;
+		rtp->f.mallocd = 0;
+	}
+}
+
 static int ast_rtp_destroy(struct ast_rtp_instance *instance)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	int i;
 #ifdef HAVE_PJPROJECT
 	struct timeval wait = ast_tvadd(ast_tvnow(), ast_samp2tv(TURN_STATE_WAIT_TIME, 1000));
 	struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000, };
@@ -2598,10 +3468,19 @@ static int ast_rtp_destroy(struct ast_rtp_instance *instance)
 		ast_smoother_free(rtp->smoother);
 	}
 
+	/* Frames still holding receive buffers keep them */
+	rtp_rx_frame_release(rtp);
+	for (i = 0; i < RTP_RX_BUFS; ++i) {
+		ao2_cleanup(rtp->rxbufs[i]);
+	}
+
+	ast_rtp_forward_stop(rtp->forward);
+
 	/* Close our own socket so we no longer get packets */
 	if (rtp->s > -1) {
 		close(rtp->s);
 	}
+	port_pool_put(rtp->port);
 
 	/* Destroy RTCP if it was being used */
 	if (rtp->rtcp) {
@@ -2652,6 +3531,10 @@ static int ast_rtp_destroy(struct ast_rtp_instance *instance)
 		pj_ice_sess_destroy(rtp->ice);
 	}
 
+	if (rtp->ice_timer) {
+		ast_atomic_fetchadd_int(&rtp->ice_timer->sessions, -1);
+	}
+
 	/* Destroy any candidates */
 	if (rtp->ice_local_candidates) {
 		ao2_ref(rtp->ice_local_candidates, -1);
@@ -3001,6 +3884,54 @@ static void calculate_lost_packet_statistics(struct ast_rtp *rtp,
 	rtp->rtcp->rxlost_count++;
 }
 
+/*!
+ * \internal
+ * \brief Count the packets a forwarder moved since the last time
+ *
+ * The packets were received by the instance and sent by the bridged one.
+ *
+ * \note The RTP lock of the instance must be held.
+ */
+static void rtp_forward_count(struct ast_rtp_instance *instance)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	struct ast_rtp_instance *instance1 = ast_rtp_instance_get_bridged(instance);
+	unsigned int packets;
+	unsigned int octets;
+
+	if (!rtp->forward) {
+		return;
+	}
+
+	ast_rtp_forward_stats(rtp->forward, &packets, &octets);
+	rtp->rxcount += packets - rtp->forward_packets;
+	rtp->rxoctetcount += octets - rtp->forward_octets;
+	if (instance1 && ast_rtp_instance_get_engine(instance1) == ast_rtp_instance_get_engine(instance)) {
+		struct ast_rtp *bridged = ast_rtp_instance_get_data(instance1);
+
+		bridged->txcount += packets - rtp->forward_packets;
+		bridged->txoctetcount += octets - rtp->forward_octets;
+	}
+	rtp->forward_packets = packets;
+	rtp->forward_octets = octets;
+}
+
+/*!
+ * \internal
+ * \brief Stop the forwarding of an instance, if any
+ */
+static void rtp_forward_stop(struct ast_rtp_instance *instance)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+
+	ast_mutex_lock(&rtp->lock);
+	rtp_forward_count(instance);
+	ast_rtp_forward_stop(rtp->forward);
+	rtp->forward = NULL;
+	ast_clear_flag(rtp, FLAG_FORWARD_TRIED);
+	ast_mutex_unlock(&rtp->lock);
+}
+
 /*! \brief Send RTCP SR or RR report */
 static int ast_rtcp_write_report(struct ast_rtp_instance *instance, int sr)
 {
@@ -3043,6 +3974,10 @@ static int ast_rtcp_write_report(struct ast_rtp_instance *instance, int sr)
 		return 1;
 	}
 
+	ast_mutex_lock(&rtp->lock);
+	rtp_forward_count(instance);
+	ast_mutex_unlock(&rtp->lock);
+
 	/* Compute statistics */
 	calculate_lost_packet_statistics(rtp, &lost_packets, &fraction_lost);
 
@@ -3164,6 +4099,10 @@ static int ast_rtcp_write_report(struct ast_rtp_instance *instance, int sr)
 		str_remote_address = ast_strdupa(ast_sockaddr_stringify(&remote_address));
 	}
 
+	if (!rtcpevents) {
+		return res;
+	}
+
 	message_blob = ast_json_pack("{s: s, s: s}",
 			"to", str_remote_address,
 			"from", str_local_address);
@@ -3603,6 +4542,7 @@ static struct ast_frame *create_dtmf_frame(struct ast_rtp_instance *instance, en
 	}
 	rtp->f.datalen = 0;
 	rtp->f.samples = 0;
+	rtp_rx_frame_release(rtp);
 	rtp->f.mallocd = 0;
 	rtp->f.src = "RTP";
 	AST_LIST_NEXT(&rtp->f, frame_list) = NULL;
@@ -3975,6 +4915,7 @@ static struct ast_frame *ast_rtcp_read(struct ast_rtp_instance *instance)
 	unsigned int *rtcpheader = (unsigned int *)(rtcpdata + AST_FRIENDLY_OFFSET);
 	int res, packetwords, position = 0;
 	int report_counter = 0;
+	int rate;
 	struct ast_rtp_rtcp_report_block *report_block;
 	struct ast_frame *f = &ast_null_frame;
 	char *str_local_address;
@@ -4140,6 +5081,12 @@ static struct ast_frame *ast_rtcp_read(struct ast_rtp_instance *instance)
 				update_lost_stats(rtp, report_block->lost_count.packets);
 				rtp->rtcp->reported_jitter_count++;
 
+				rate = rtp_get_rate(rtp->lastrxformat);
+				ast_rtp_instance_quality_sample(instance,
+					(double) report_block->ia_jitter * 1000 / (rate > 0 ? rate : 8000),
+					report_block->lost_count.fraction,
+					report_block->lsr ? rtp->rtcp->rtt * 1000 : -1);
+
 				if (rtcp_debug_test_addr(&addr)) {
 					ast_verbose("  Fraction lost: %d\n", report_block->lost_count.fraction);
 					ast_verbose("  Packets lost so far: %u\n", report_block->lost_count.packets);
@@ -4167,6 +5114,10 @@ static struct ast_frame *ast_rtcp_read(struct ast_rtp_instance *instance)
 				str_remote_address = ast_strdupa(ast_sockaddr_stringify(&addr));
 			}
 
+			if (!rtcpevents) {
+				break;
+			}
+
 			message_blob = ast_json_pack("{s: s, s: s, s: f}",
 					"from", str_remote_address,
 					"to", str_local_address,
@@ -4186,6 +5137,7 @@ static struct ast_frame *ast_rtcp_read(struct ast_rtp_instance *instance)
 			rtp->f.subclass.integer = AST_CONTROL_VIDUPDATE;
 			rtp->f.datalen = 0;
 			rtp->f.samples = 0;
+			rtp_rx_frame_release(rtp);
 			rtp->f.mallocd = 0;
 			rtp->f.src = "RTP";
 			f = &rtp->f;
@@ -4234,97 +5186,278 @@ static int bridge_p2p_rtp_write(struct ast_rtp_instance *instance, unsigned int
 		return -1;
 	}
 
-	/* Otherwise adjust bridged payload to match */
-	bridged_payload = ast_rtp_codecs_payload_code_tx(ast_rtp_instance_get_codecs(instance1),
-		payload_type->asterisk_format, payload_type->format, payload_type->rtp_code);
-
-	/* If no codec could be matched between instance and instance1, then somehow things were made incompatible while we were still bridged.  Bail. */
-	if (bridged_payload < 0) {
-		return -1;
+	/* Otherwise adjust bridged payload to match */
+	bridged_payload = ast_rtp_codecs_payload_code_tx(ast_rtp_instance_get_codecs(instance1),
+		payload_type->asterisk_format, payload_type->format, payload_type->rtp_code);
+
+	/* If no codec could be matched between instance and instance1, then somehow things were made incompatible while we were still bridged.  Bail. */
+	if (bridged_payload < 0) {
+		return -1;
+	}
+
+	/* If the payload coming in is not one of the negotiated ones then send it to the core, this will cause formats to change and the bridge to break */
+	if (ast_rtp_codecs_find_payload_code(ast_rtp_instance_get_codecs(instance1), bridged_payload) == -1) {
+		ast_debug(1, "Unsupported payload type received \n");
+		return -1;
+	}
+
+	/* Let rtp_relay() forward this payload type without the lookups */
+	rtp->relay_payload[payload] = bridged_payload + 1;
+
+	/* If the marker bit has been explicitly set turn it on */
+	if (ast_test_flag(rtp, FLAG_NEED_MARKER_BIT)) {
+		mark = 1;
+		ast_clear_flag(rtp, FLAG_NEED_MARKER_BIT);
+	}
+
+	/* Reconstruct part of the packet */
+	reconstruct &= 0xFF80FFFF;
+	reconstruct |= (bridged_payload << 16);
+	reconstruct |= (mark << 23);
+	rtpheader[0] = htonl(reconstruct);
+
+	ast_rtp_instance_get_remote_address(instance1, &remote_address);
+
+	if (ast_sockaddr_isnull(&remote_address)) {
+		ast_debug(5, "Remote address is null, most likely RTP has been stopped\n");
+		return 0;
+	}
+
+	/* Send the packet back out */
+	res = rtp_sendto(instance1, (void *)rtpheader, len, 0, &remote_address, &ice);
+	if (res < 0) {
+		if (!ast_rtp_instance_get_prop(instance1, AST_RTP_PROPERTY_NAT) || (ast_rtp_instance_get_prop(instance1, AST_RTP_PROPERTY_NAT) && (ast_test_flag(bridged, FLAG_NAT_ACTIVE) == FLAG_NAT_ACTIVE))) {
+			ast_log(LOG_WARNING,
+				"RTP Transmission error of packet to %s: %s\n",
+				ast_sockaddr_stringify(&remote_address),
+				strerror(errno));
+		} else if (((ast_test_flag(bridged, FLAG_NAT_ACTIVE) == FLAG_NAT_INACTIVE) || rtpdebug) && !ast_test_flag(bridged, FLAG_NAT_INACTIVE_NOWARN)) {
+			if (option_debug || rtpdebug) {
+				ast_log(LOG_WARNING,
+					"RTP NAT: Can't write RTP to private "
+					"address %s, waiting for other end to "
+					"send audio...\n",
+					ast_sockaddr_stringify(&remote_address));
+			}
+			ast_set_flag(bridged, FLAG_NAT_INACTIVE_NOWARN);
+		}
+		return 0;
+	}
+
+	if (rtp_debug_test_addr(&remote_address)) {
+		ast_verbose("Sent RTP P2P packet to %s%s (type %-2.2d, len %-6.6d)\n",
+			    ast_sockaddr_stringify(&remote_address),
+			    ice ? " (via ICE)" : "",
+			    bridged_payload, len - hdrlen);
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Hand the RTP of a locally bridged instance to the forwarder if nothing needs to see it
+ *
+ * This is tried once per local bridge, after the source of the RTP is known.
+ * The packets must need no SRTP or ICE on either side, and every payload type
+ * must be sent on as is, since the forwarder does not touch them.
+ */
+static void rtp_forward_start(struct ast_rtp_instance *instance, struct ast_rtp_instance *instance1,
+	struct ast_sockaddr *from_remote, struct ast_sockaddr *to_remote)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	struct ast_rtp_codecs *codecs = ast_rtp_instance_get_codecs(instance);
+	struct ast_rtp_codecs *codecs1 = ast_rtp_instance_get_codecs(instance1);
+	struct ast_sockaddr from_local;
+	struct ast_sockaddr to_local;
+	struct ast_rtp_payload_type *type;
+	int payload;
+	int code;
+
+	ast_mutex_lock(&rtp->lock);
+	if (ast_test_flag(rtp, FLAG_FORWARD_TRIED)) {
+		ast_mutex_unlock(&rtp->lock);
+		return;
+	}
+	ast_set_flag(rtp, FLAG_FORWARD_TRIED);
+
+	if (ast_rtp_instance_get_srtp(instance) || ast_rtp_instance_get_srtp(instance1)) {
+		ast_mutex_unlock(&rtp->lock);
+		return;
+	}
+#ifdef HAVE_PJPROJECT
+	if (rtp->ice || ((struct ast_rtp *) ast_rtp_instance_get_data(instance1))->ice) {
+		ast_mutex_unlock(&rtp->lock);
+		return;
+	}
+#endif
+
+	for (payload = 0; payload < AST_RTP_MAX_PT; ++payload) {
+		if (!(type = ast_rtp_codecs_get_payload(codecs, payload))) {
+			continue;
+		}
+		code = ast_rtp_codecs_payload_code_tx(codecs1, type->asterisk_format, type->format, type->rtp_code);
+		ao2_ref(type, -1);
+		if (code != payload) {
+			ast_debug(3, "Not forwarding RTP of instance '%p', payload type %d is sent as %d\n",
+				instance, payload, code);
+			ast_mutex_unlock(&rtp->lock);
+			return;
+		}
+	}
+
+	ast_rtp_instance_get_local_address(instance, &from_local);
+	ast_rtp_instance_get_local_address(instance1, &to_local);
+	rtp->forward = ast_rtp_forward_start(from_remote, &from_local, &to_local, to_remote);
+	rtp->forward_packets = 0;
+	rtp->forward_octets = 0;
+	if (rtp->forward) {
+		ast_debug(1, "RTP of instance '%p' from %s is forwarded outside of Asterisk\n",
+			instance, ast_sockaddr_stringify(from_remote));
+	}
+	ast_mutex_unlock(&rtp->lock);
+}
+
+/*!
+ * \internal
+ * \brief Forward a packet of a locally bridged instance with as little work as possible
+ *
+ * Only RTP from the expected source with a payload type bridge_p2p_rtp_write()
+ * already translated is forwarded here.  Anything else takes the full path.
+ *
+ * \retval 0 the packet was forwarded
+ * \retval -1 the packet needs the full path
+ */
+static int rtp_relay(struct ast_rtp_instance *instance, unsigned int *rtpheader, int len, struct ast_sockaddr *addr)
+{
+	struct ast_rtp_instance *instance1 = ast_rtp_instance_get_bridged(instance);
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	struct ast_sockaddr remote_address;
+	unsigned int received = rtpheader[0];
+	unsigned int header = ntohl(received);
+	int bridged_payload;
+	int ice;
+
+	if ((header & 0xC0000000) != 0x80000000 || rtpdebug
+		|| ast_test_flag(rtp, FLAG_NEED_MARKER_BIT)) {
+		return -1;
+	}
+
+	switch (rtp->strict_rtp_state) {
+	case STRICT_RTP_OPEN:
+		break;
+	case STRICT_RTP_CLOSED:
+		if (ast_sockaddr_cmp(&rtp->strict_rtp_address, addr)) {
+			return -1;
+		}
+		rtp_learning_seq_init(&rtp->alt_source_learn, header);
+		break;
+	default:
+		return -1;
+	}
+
+	if (ast_rtp_instance_get_prop(instance, AST_RTP_PROPERTY_NAT)) {
+		ast_rtp_instance_get_remote_address(instance, &remote_address);
+		if (ast_sockaddr_cmp(&remote_address, addr)) {
+			return -1;
+		}
+	}
+
+	if (!(bridged_payload = rtp->relay_payload[(header & 0x7f0000) >> 16])) {
+		return -1;
+	}
+	header &= 0xFF80FFFF;
+	header |= ((bridged_payload - 1) << 16);
+	rtpheader[0] = htonl(header);
+
+	ast_rtp_instance_get_remote_address(instance1, &remote_address);
+	if (ast_sockaddr_isnull(&remote_address)) {
+		return 0;
 	}
 
-	/* If the payload coming in is not one of the negotiated ones then send it to the core, this will cause formats to change and the bridge to break */
-	if (ast_rtp_codecs_find_payload_code(ast_rtp_instance_get_codecs(instance1), bridged_payload) == -1) {
-		ast_debug(1, "Unsupported payload type received \n");
+	if (rtp_sendto(instance1, (void *)rtpheader, len, 0, &remote_address, &ice) < 0) {
+		/* Let the full path report the error */
+		rtpheader[0] = received;
 		return -1;
 	}
 
-	/* If the marker bit has been explicitly set turn it on */
-	if (ast_test_flag(rtp, FLAG_NEED_MARKER_BIT)) {
-		mark = 1;
-		ast_clear_flag(rtp, FLAG_NEED_MARKER_BIT);
+	if (!ast_test_flag(rtp, FLAG_FORWARD_TRIED) && ast_rtp_engine_forwarder_is_registered()) {
+		rtp_forward_start(instance, instance1, addr, &remote_address);
 	}
 
-	/* Reconstruct part of the packet */
-	reconstruct &= 0xFF80FFFF;
-	reconstruct |= (bridged_payload << 16);
-	reconstruct |= (mark << 23);
-	rtpheader[0] = htonl(reconstruct);
+	return 0;
+}
 
-	ast_rtp_instance_get_remote_address(instance1, &remote_address);
+/*!
+ * \internal
+ * \brief Pick a receive buffer no frame holds
+ *
+ * Frames of RTP data hold a reference to the buffer the packet was received
+ * in, so jitter buffers, bridges and recorders keep them without copying.
+ * A buffer still held is left to its frames and another one is used.
+ */
+static int rtp_rx_buf_get(struct ast_rtp *rtp)
+{
+	void *buf;
+	int current = 0;
+	int i;
 
-	if (ast_sockaddr_isnull(&remote_address)) {
-		ast_debug(5, "Remote address is null, most likely RTP has been stopped\n");
-		return 0;
-	}
+	rtp_rx_frame_release(rtp);
 
-	/* Send the packet back out */
-	res = rtp_sendto(instance1, (void *)rtpheader, len, 0, &remote_address, &ice);
-	if (res < 0) {
-		if (!ast_rtp_instance_get_prop(instance1, AST_RTP_PROPERTY_NAT) || (ast_rtp_instance_get_prop(instance1, AST_RTP_PROPERTY_NAT) && (ast_test_flag(bridged, FLAG_NAT_ACTIVE) == FLAG_NAT_ACTIVE))) {
-			ast_log(LOG_WARNING,
-				"RTP Transmission error of packet to %s: %s\n",
-				ast_sockaddr_stringify(&remote_address),
-				strerror(errno));
-		} else if (((ast_test_flag(bridged, FLAG_NAT_ACTIVE) == FLAG_NAT_INACTIVE) || rtpdebug) && !ast_test_flag(bridged, FLAG_NAT_INACTIVE_NOWARN)) {
-			if (option_debug || rtpdebug) {
-				ast_log(LOG_WARNING,
-					"RTP NAT: Can't write RTP to private "
-					"address %s, waiting for other end to "
-					"send audio...\n",
-					ast_sockaddr_stringify(&remote_address));
+	for (i = 0; i < RTP_RX_BUFS; ++i) {
+		if (!rtp->rxbufs[i]) {
+			if (!(rtp->rxbufs[i] = ao2_alloc_options(RTP_RX_BUF_SIZE, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+				break;
 			}
-			ast_set_flag(bridged, FLAG_NAT_INACTIVE_NOWARN);
+			rtp->rawdata = rtp->rxbufs[i];
+			return 0;
+		}
+		if (rtp->rxbufs[i] == rtp->rawdata) {
+			current = i;
+			if (ao2_ref(rtp->rxbufs[i], 0) == 1) {
+				return 0;
+			}
+		} else if (ao2_ref(rtp->rxbufs[i], 0) == 1) {
+			rtp->rawdata = rtp->rxbufs[i];
+			return 0;
 		}
-		return 0;
 	}
 
-	if (rtp_debug_test_addr(&remote_address)) {
-		ast_verbose("Sent RTP P2P packet to %s%s (type %-2.2d, len %-6.6d)\n",
-			    ast_sockaddr_stringify(&remote_address),
-			    ice ? " (via ICE)" : "",
-			    bridged_payload, len - hdrlen);
+	/* All of them are held, replace the one in use */
+	if (!(buf = ao2_alloc_options(RTP_RX_BUF_SIZE, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return -1;
 	}
+	ao2_cleanup(rtp->rxbufs[current]);
+	rtp->rxbufs[current] = buf;
+	rtp->rawdata = buf;
 
 	return 0;
 }
 
-static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtcp)
+/*!
+ * \internal
+ * \brief Read and handle one RTP packet
+ *
+ * \return The frames of the packet, which may use the raw data of the instance.
+ */
+static struct ast_frame *ast_rtp_read_packet(struct ast_rtp_instance *instance)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
 	struct ast_sockaddr addr;
 	int res, hdrlen = 12, version, payloadtype, padding, mark, ext, cc, prev_seqno;
-	unsigned int *rtpheader = (unsigned int*)(rtp->rawdata + AST_FRIENDLY_OFFSET), seqno, ssrc, timestamp;
+	unsigned int *rtpheader, seqno, ssrc, timestamp;
 	RAII_VAR(struct ast_rtp_payload_type *, payload, NULL, ao2_cleanup);
 	struct ast_sockaddr remote_address = { {0,} };
 	struct frame_list frames;
 
-	/* If this is actually RTCP let's hop on over and handle it */
-	if (rtcp) {
-		if (rtp->rtcp) {
-			return ast_rtcp_read(instance);
-		}
+	if (rtp_rx_buf_get(rtp)) {
 		return &ast_null_frame;
 	}
-
-	/* If we are currently sending DTMF to the remote party send a continuation packet */
-	if (rtp->sending_digit) {
-		ast_rtp_dtmf_continuation(instance);
-	}
+	rtpheader = (unsigned int *)(rtp->rawdata + AST_FRIENDLY_OFFSET);
 
 	/* Actually read in the data from the socket */
 	if ((res = rtp_recvfrom(instance, rtp->rawdata + AST_FRIENDLY_OFFSET,
-				sizeof(rtp->rawdata) - AST_FRIENDLY_OFFSET, 0,
+				RTP_RX_BUF_SIZE - AST_FRIENDLY_OFFSET, 0,
 				&addr)) < 0) {
 		ast_assert(errno != EBADF);
 		if (errno != EAGAIN) {
@@ -4353,6 +5486,11 @@ static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtc
 		return &ast_null_frame;
 	}
 
+	/* If we are directly bridged to another instance try to just relay the packet */
+	if (ast_rtp_instance_get_bridged(instance) && !rtp_relay(instance, rtpheader, res, &addr)) {
+		return &ast_null_frame;
+	}
+
 	/* Get fields and verify this is an RTP packet */
 	seqno = ntohl(rtpheader[0]);
 
@@ -4618,10 +5756,12 @@ static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtc
 	rtp->lastrxts = timestamp;
 
 	rtp->f.src = "RTP";
-	rtp->f.mallocd = 0;
 	rtp->f.datalen = res - hdrlen;
 	rtp->f.data.ptr = rtp->rawdata + hdrlen + AST_FRIENDLY_OFFSET;
 	rtp->f.offset = hdrlen + AST_FRIENDLY_OFFSET;
+	/* The frame holds the buffer, so it can be kept without copying the data */
+	rtp->f.mallocd = AST_MALLOCD_SHARED;
+	rtp->f.shared = ao2_bump(rtp->rawdata);
 	rtp->f.seqno = seqno;
 
 	if ((ast_format_cmp(rtp->f.subclass.format, ast_format_t140) == AST_FORMAT_CMP_EQUAL)
@@ -4721,6 +5861,83 @@ static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtc
 	return AST_LIST_FIRST(&frames);
 }
 
+#ifdef HAVE_RECVMMSG
+/*!
+ * \internal
+ * \brief Move the frames of a packet to a list, copying what refers to the instance
+ */
+static void rtp_read_append(struct frame_list *frames, struct ast_frame *f)
+{
+	struct ast_frame *next;
+	struct ast_frame *isolated;
+
+	if (f == &ast_null_frame) {
+		return;
+	}
+
+	for (; f; f = next) {
+		next = AST_LIST_NEXT(f, frame_list);
+		AST_LIST_NEXT(f, frame_list) = NULL;
+
+		isolated = ast_frisolate(f);
+		if (isolated != f) {
+			ast_frfree(f);
+		}
+		if (isolated) {
+			AST_LIST_INSERT_TAIL(frames, isolated, frame_list);
+		}
+	}
+}
+#endif
+
+static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtcp)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	struct ast_frame *f;
+
+	/* If this is actually RTCP let's hop on over and handle it */
+	if (rtcp) {
+		if (rtp->rtcp) {
+			return ast_rtcp_read(instance);
+		}
+		return &ast_null_frame;
+	}
+
+	/* If we are currently sending DTMF to the remote party send a continuation packet */
+	if (rtp->sending_digit) {
+		ast_rtp_dtmf_continuation(instance);
+	}
+
+	f = ast_rtp_read_packet(instance);
+
+#ifdef HAVE_RECVMMSG
+	/*
+	 * The socket had more packets queued.  Each one reuses the raw data and
+	 * frame of the instance so the frames before it get copied.
+	 */
+	if (f && rtp_read_batch_pending(instance)) {
+		struct frame_list frames;
+
+		AST_LIST_HEAD_INIT_NOLOCK(&frames);
+		rtp_read_append(&frames, f);
+		while (rtp_read_batch_pending(instance)) {
+			if (!(f = ast_rtp_read_packet(instance))) {
+				rtp_read_batch_clear();
+				if (AST_LIST_FIRST(&frames)) {
+					ast_frfree(AST_LIST_FIRST(&frames));
+				}
+				return NULL;
+			}
+			rtp_read_append(&frames, f);
+		}
+		rtp_read_batch_clear();
+		f = AST_LIST_FIRST(&frames) ? AST_LIST_FIRST(&frames) : &ast_null_frame;
+	}
+#endif
+
+	return f;
+}
+
 static void ast_rtp_prop_set(struct ast_rtp_instance *instance, enum ast_rtp_property property, int value)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
@@ -4792,6 +6009,7 @@ static void ast_rtp_prop_set(struct ast_rtp_instance *instance, enum ast_rtp_pro
 				}
 				close(rtp->rtcp->s);
 #ifdef HAVE_OPENSSL_SRTP
+				dtls_tasks_wait(&rtp->rtcp->dtls);
 				if (rtp->rtcp->dtls.ssl) {
 					SSL_free(rtp->rtcp->dtls.ssl);
 				}
@@ -4903,6 +6121,9 @@ static int ast_rtp_local_bridge(struct ast_rtp_instance *instance0, struct ast_r
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance0);
 
 	ast_set_flag(rtp, FLAG_NEED_MARKER_BIT);
+	/* The payload types or addresses may have been renegotiated */
+	memset(rtp->relay_payload, 0, sizeof(rtp->relay_payload));
+	rtp_forward_stop(instance0);
 
 	return 0;
 }
@@ -4915,6 +6136,10 @@ static int ast_rtp_get_stat(struct ast_rtp_instance *instance, struct ast_rtp_in
 		return -1;
 	}
 
+	ast_mutex_lock(&rtp->lock);
+	rtp_forward_count(instance);
+	ast_mutex_unlock(&rtp->lock);
+
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_TXCOUNT, -1, stats->txcount, rtp->txcount);
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_RXCOUNT, -1, stats->rxcount, rtp->rxcount);
 
@@ -4987,6 +6212,8 @@ static void ast_rtp_stop(struct ast_rtp_instance *instance)
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
 	struct ast_sockaddr addr = { {0,} };
 
+	rtp_forward_stop(instance);
+
 #ifdef HAVE_OPENSSL_SRTP
 	AST_SCHED_DEL_UNREF(rtp->sched, rtp->rekeyid, ao2_ref(instance, -1));
 
@@ -5244,10 +6471,91 @@ static char *handle_cli_rtcp_set_stats(struct ast_cli_entry *e, int cmd, struct
 	return CLI_SUCCESS;
 }
 
+#ifdef HAVE_PJPROJECT
+static char *handle_cli_rtp_show_ice(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_rtp_ioqueue_thread *ioqueue;
+	unsigned int i = 0;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "rtp show ice";
+		e->usage =
+			"Usage: rtp show ice\n"
+			"       Display the load on the threads handling TURN sockets and\n"
+			"       ICE timers.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "TURN socket threads (limit %u):\n", rtp_ice_thread_limit());
+	ast_cli(a->fd, "  %-6s %-10s\n", "Thread", "Sockets");
+	AST_LIST_LOCK(&ioqueues);
+	AST_LIST_TRAVERSE(&ioqueues, ioqueue, next) {
+		ast_cli(a->fd, "  %-6u %-10u\n", i++, ioqueue->count);
+	}
+	AST_LIST_UNLOCK(&ioqueues);
+
+	ast_cli(a->fd, "ICE timer threads:\n");
+	ast_cli(a->fd, "  %-6s %-10s %-10s\n", "Thread", "Sessions", "Timers");
+	for (i = 0; i < timer_thread_count; ++i) {
+		ast_cli(a->fd, "  %-6u %-10d %-10u\n", i, timer_threads[i].sessions,
+			(unsigned int) pj_timer_heap_count(timer_threads[i].timerheap));
+	}
+
+	return CLI_SUCCESS;
+}
+#endif
+
+#ifdef HAVE_OPENSSL_SRTP
+static char *handle_cli_rtp_show_dtls(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "rtp show dtls";
+		e->usage =
+			"Usage: rtp show dtls\n"
+			"       Display the DTLS threads, the SSL contexts in use and how\n"
+			"       long DTLS handshakes took to complete.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "DTLS threads:      %u%s\n", dtls_serializer_count,
+		dtls_pool ? "" : " (handshakes are handled on the media path)");
+	ast_cli(a->fd, "SSL contexts:      %d\n", ao2_container_count(dtls_contexts));
+	ast_cli(a->fd, "Handshake times:\n");
+	for (i = 0; i < ARRAY_LEN(dtls_latency_bounds); ++i) {
+		ast_cli(a->fd, "  < %5d ms:      %d\n", dtls_latency_bounds[i], dtls_latency_counts[i]);
+	}
+	ast_cli(a->fd, "  >= %4d ms:      %d\n", dtls_latency_bounds[i - 1], dtls_latency_counts[i]);
+
+	return CLI_SUCCESS;
+}
+#endif
+
 static struct ast_cli_entry cli_rtp[] = {
 	AST_CLI_DEFINE(handle_cli_rtp_set_debug,  "Enable/Disable RTP debugging"),
 	AST_CLI_DEFINE(handle_cli_rtcp_set_debug, "Enable/Disable RTCP debugging"),
 	AST_CLI_DEFINE(handle_cli_rtcp_set_stats, "Enable/Disable RTCP stats"),
+#ifdef HAVE_PJPROJECT
+	AST_CLI_DEFINE(handle_cli_rtp_show_ice,   "Display ICE and TURN thread load"),
+#endif
+#ifdef HAVE_OPENSSL_SRTP
+	AST_CLI_DEFINE(handle_cli_rtp_show_dtls,  "Display DTLS handshake statistics"),
+#endif
 };
 
 static int rtp_reload(int reload)
@@ -5266,6 +6574,12 @@ static int rtp_reload(int reload)
 	dtmftimeout = DEFAULT_DTMF_TIMEOUT;
 	strictrtp = DEFAULT_STRICT_RTP;
 	learning_min_sequential = DEFAULT_LEARNING_MIN_SEQUENTIAL;
+	read_batch = DEFAULT_READ_BATCH;
+	rtcpevents = DEFAULT_RTCP_EVENTS;
+	quality_window = DEFAULT_QUALITY_WINDOW;
+#ifdef HAVE_OPENSSL_SRTP
+	dtls_workers = DEFAULT_DTLS_WORKERS;
+#endif
 
 	/** This resource is not "reloaded" so much as unloaded and loaded again.
 	 * In the case of the TURN related variables, the memory referenced by a
@@ -5277,6 +6591,7 @@ static int rtp_reload(int reload)
 
 #ifdef HAVE_PJPROJECT
 	icesupport = DEFAULT_ICESUPPORT;
+	ice_threads = DEFAULT_ICE_THREADS;
 	turnport = DEFAULT_TURN_PORT;
 	memset(&stunaddr, 0, sizeof(stunaddr));
 	turnaddr = pj_str(NULL);
@@ -5333,10 +6648,43 @@ static int rtp_reload(int reload)
 					DEFAULT_LEARNING_MIN_SEQUENTIAL);
 			}
 		}
+#ifdef HAVE_OPENSSL_SRTP
+		if ((s = ast_variable_retrieve(cfg, "general", "dtlsworkers"))) {
+			if ((sscanf(s, "%d", &dtls_workers) <= 0) || dtls_workers < 0 || dtls_workers > MAX_DTLS_WORKERS) {
+				ast_log(LOG_WARNING, "Value for 'dtlsworkers' must be between 0 and %d, using default of '%d' instead\n",
+					MAX_DTLS_WORKERS, DEFAULT_DTLS_WORKERS);
+				dtls_workers = DEFAULT_DTLS_WORKERS;
+			}
+		}
+#endif
+		if ((s = ast_variable_retrieve(cfg, "general", "rtcpevents"))) {
+			rtcpevents = ast_true(s);
+		}
+		if ((s = ast_variable_retrieve(cfg, "general", "qualitywindow"))) {
+			if ((sscanf(s, "%d", &quality_window) <= 0) || quality_window < 0) {
+				ast_log(LOG_WARNING, "Value for 'qualitywindow' must be 0 or more, using default of '%d' instead\n",
+					DEFAULT_QUALITY_WINDOW);
+				quality_window = DEFAULT_QUALITY_WINDOW;
+			}
+		}
+		if ((s = ast_variable_retrieve(cfg, "general", "readbatch"))) {
+			if ((sscanf(s, "%d", &read_batch) <= 0) || read_batch <= 0 || read_batch > MAX_READ_BATCH) {
+				ast_log(LOG_WARNING, "Value for 'readbatch' must be between 1 and %d, using default of '%d' instead\n",
+					MAX_READ_BATCH, DEFAULT_READ_BATCH);
+				read_batch = DEFAULT_READ_BATCH;
+			}
+		}
 #ifdef HAVE_PJPROJECT
 		if ((s = ast_variable_retrieve(cfg, "general", "icesupport"))) {
 			icesupport = ast_true(s);
 		}
+		if ((s = ast_variable_retrieve(cfg, "general", "icethreads"))) {
+			if ((sscanf(s, "%d", &ice_threads) <= 0) || ice_threads < 0 || ice_threads > MAX_ICE_THREADS) {
+				ast_log(LOG_WARNING, "Value for 'icethreads' must be between 0 and %d, using default of '%d' instead\n",
+					MAX_ICE_THREADS, DEFAULT_ICE_THREADS);
+				ice_threads = DEFAULT_ICE_THREADS;
+			}
+		}
 		if ((s = ast_variable_retrieve(cfg, "general", "stunaddr"))) {
 			stunaddr.sin_port = htons(STANDARD_STUN_PORT);
 			if (ast_parse_arg(s, PARSE_INADDR, &stunaddr)) {
@@ -5369,6 +6717,10 @@ static int rtp_reload(int reload)
 		rtpstart = DEFAULT_RTP_START;
 		rtpend = DEFAULT_RTP_END;
 	}
+	ast_rtp_quality_set_window(quality_window);
+	if (port_pool_init(rtpstart, rtpend)) {
+		return -1;
+	}
 	ast_verb(2, "RTP Allocating from port range %d -> %d\n", rtpstart, rtpend);
 	return 0;
 }
@@ -5384,22 +6736,77 @@ static void rtp_terminate_pjproject(void)
 {
 	pj_thread_register_check();
 
-	if (timer_thread) {
-		timer_terminate = 1;
-		pj_thread_join(timer_thread);
-		pj_thread_destroy(timer_thread);
-	}
+	rtp_timer_threads_stop();
 
 	pj_caching_pool_destroy(&cachingpool);
 	pj_shutdown();
 }
 #endif
 
+#ifdef HAVE_OPENSSL_SRTP
+static void dtls_workers_stop(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < dtls_serializer_count; ++i) {
+		ast_taskprocessor_unreference(dtls_serializers[i]);
+	}
+	ast_free(dtls_serializers);
+	dtls_serializers = NULL;
+	dtls_serializer_count = 0;
+
+	ast_threadpool_shutdown(dtls_pool);
+	dtls_pool = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start the threads handling DTLS handshakes
+ *
+ * Without them OpenSSL runs the handshakes on the media path, where
+ * the public key operations hold up the packets of the call.
+ */
+static int dtls_workers_start(void)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = dtls_workers,
+		.max_size = dtls_workers,
+	};
+	char name[32];
+	int i;
+
+	if (!dtls_workers) {
+		return 0;
+	}
+
+	if (!(dtls_pool = ast_threadpool_create("rtp-dtls", NULL, &options))) {
+		return -1;
+	}
+
+	if (!(dtls_serializers = ast_calloc(dtls_workers, sizeof(*dtls_serializers)))) {
+		dtls_workers_stop();
+		return -1;
+	}
+
+	for (i = 0; i < dtls_workers; ++i) {
+		snprintf(name, sizeof(name), "rtp-dtls-%d", i);
+		if (!(dtls_serializers[i] = ast_threadpool_serializer(name, dtls_pool))) {
+			dtls_workers_stop();
+			return -1;
+		}
+		++dtls_serializer_count;
+	}
+
+	return 0;
+}
+#endif
+
 static int load_module(void)
 {
 #ifdef HAVE_PJPROJECT
-	pj_lock_t *lock;
-
 	if (pj_init() != PJ_SUCCESS) {
 		return AST_MODULE_LOAD_DECLINE;
 	}
@@ -5417,42 +6824,77 @@ static int load_module(void)
 	pj_caching_pool_init(&cachingpool, &pj_pool_factory_default_policy, 0);
 
 	pool = pj_pool_create(&cachingpool.factory, "timer", 512, 512, NULL);
+#endif
 
-	if (pj_timer_heap_create(pool, 100, &timer_heap) != PJ_SUCCESS) {
+	/* Ports of the default range until rtp.conf is loaded */
+	if (port_pool_init(rtpstart, rtpend)) {
+#ifdef HAVE_PJPROJECT
 		rtp_terminate_pjproject();
+#endif
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
-	if (pj_lock_create_recursive_mutex(pool, "rtp%p", &lock) != PJ_SUCCESS) {
+#ifdef HAVE_OPENSSL_SRTP
+	ast_cond_init(&dtls_tasks_cond, NULL);
+	if (!(dtls_contexts = ao2_container_alloc(DTLS_CONTEXT_BUCKETS, dtls_context_hash_fn, dtls_context_cmp_fn))) {
+#ifdef HAVE_PJPROJECT
 		rtp_terminate_pjproject();
+#endif
+		ast_free(port_pool.ports);
+		port_pool.ports = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
+#endif
 
-	pj_timer_heap_set_lock(timer_heap, lock, PJ_TRUE);
+	rtp_reload(0);
 
-	if (pj_thread_create(pool, "timer", &timer_worker_thread, NULL, 0, 0, &timer_thread) != PJ_SUCCESS) {
+#ifdef HAVE_PJPROJECT
+	/* The number of ICE timer threads comes from rtp.conf, and they must be
+	 * running before any instance can be created through the engine */
+	if (rtp_timer_threads_start()) {
 		rtp_terminate_pjproject();
+#ifdef HAVE_OPENSSL_SRTP
+		ao2_cleanup(dtls_contexts);
+		dtls_contexts = NULL;
+#endif
+		ast_free(port_pool.ports);
+		port_pool.ports = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
-
 #endif
 
 	if (ast_rtp_engine_register(&asterisk_rtp_engine)) {
 #ifdef HAVE_PJPROJECT
 		rtp_terminate_pjproject();
 #endif
+#ifdef HAVE_OPENSSL_SRTP
+		ao2_cleanup(dtls_contexts);
+		dtls_contexts = NULL;
+#endif
+		ast_free(port_pool.ports);
+		port_pool.ports = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
 	if (ast_cli_register_multiple(cli_rtp, ARRAY_LEN(cli_rtp))) {
-#ifdef HAVE_PJPROJECT
 		ast_rtp_engine_unregister(&asterisk_rtp_engine);
+#ifdef HAVE_PJPROJECT
 		rtp_terminate_pjproject();
 #endif
+#ifdef HAVE_OPENSSL_SRTP
+		ao2_cleanup(dtls_contexts);
+		dtls_contexts = NULL;
+#endif
+		ast_free(port_pool.ports);
+		port_pool.ports = NULL;
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
-	rtp_reload(0);
+#ifdef HAVE_OPENSSL_SRTP
+	if (dtls_workers_start()) {
+		ast_log(LOG_WARNING, "Could not start the DTLS threads, handling DTLS handshakes on the media path\n");
+	}
+#endif
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -5460,8 +6902,19 @@ static int load_module(void)
 static int unload_module(void)
 {
 	ast_rtp_engine_unregister(&asterisk_rtp_engine);
+	ast_rtp_quality_set_window(0);
 	ast_cli_unregister_multiple(cli_rtp, ARRAY_LEN(cli_rtp));
 
+	ast_free(port_pool.ports);
+	port_pool.ports = NULL;
+
+#ifdef HAVE_OPENSSL_SRTP
+	dtls_workers_stop();
+	ast_cond_destroy(&dtls_tasks_cond);
+	ao2_cleanup(dtls_contexts);
+	dtls_contexts = NULL;
+#endif
+
 #ifdef HAVE_PJPROJECT
 	pj_thread_register_check();
 	rtp_terminate_pjproject();
@@ -61,6 +61,9 @@ ASTERISK_REGISTER_FILE()
 /*! Command value used for Linksys paging to indicate we are stopping */
 #define LINKSYS_MCAST_STOPCMD 7
 
+/*! Most addresses the packets of one instance are fanned out to, besides the remote address */
+#define MULTICAST_MAX_FANOUT 32
+
 /*! \brief Type of paging to do */
 enum multicast_type {
 	/*! Simple multicast enabled client/receiver paging like Snom and Barix uses */
@@ -93,6 +96,10 @@ struct multicast_rtp {
 	uint16_t seqno;
 	unsigned int lastts;	
 	struct timeval txcore;
+	/*! Number of further addresses the packets are sent to */
+	int fanout_count;
+	/*! Further addresses the packets are sent to, the same packet to each */
+	struct ast_sockaddr fanout[MULTICAST_MAX_FANOUT];
 };
 
 /* Forward Declarations */
@@ -101,6 +108,7 @@ static int multicast_rtp_activate(struct ast_rtp_instance *instance);
 static int multicast_rtp_destroy(struct ast_rtp_instance *instance);
 static int multicast_rtp_write(struct ast_rtp_instance *instance, struct ast_frame *frame);
 static struct ast_frame *multicast_rtp_read(struct ast_rtp_instance *instance, int rtcp);
+static int multicast_rtp_extended_prop_set(struct ast_rtp_instance *instance, int property, void *value);
 
 /* RTP Engine Declaration */
 static struct ast_rtp_engine multicast_rtp_engine = {
@@ -110,6 +118,7 @@ static struct ast_rtp_engine multicast_rtp_engine = {
 	.destroy = multicast_rtp_destroy,
 	.write = multicast_rtp_write,
 	.read = multicast_rtp_read,
+	.extended_prop_set = multicast_rtp_extended_prop_set,
 };
 
 /*! \brief Function called to create a new multicast instance */
@@ -236,7 +245,7 @@ static int multicast_rtp_write(struct ast_rtp_instance *instance, struct ast_fra
 	struct multicast_rtp *multicast = ast_rtp_instance_get_data(instance);
 	struct ast_frame *f = frame;
 	struct ast_sockaddr remote_address;
-	int hdrlen = 12, res = 0, codec;
+	int hdrlen = 12, res = 0, codec, i;
 	unsigned char *rtpheader;
 	unsigned int ms = calc_txstamp(multicast, &frame->delivery);
 	int rate = rtp_get_rate(frame->subclass.format) / 1000;
@@ -286,6 +295,16 @@ static int multicast_rtp_write(struct ast_rtp_instance *instance, struct ast_fra
 		res = -1;
 	}
 
+	/* The packet is built once, however many receivers it goes to */
+	for (i = 0; i < multicast->fanout_count; i++) {
+		if (ast_sendto(multicast->socket, (void *) rtpheader, f->datalen + hdrlen, 0, &multicast->fanout[i]) < 0) {
+			ast_log(LOG_ERROR, "Multicast RTP Transmission error to %s: %s\n",
+				ast_sockaddr_stringify(&multicast->fanout[i]),
+				strerror(errno));
+			res = -1;
+		}
+	}
+
 	/* If we were forced to duplicate the frame free the new one */
 	if (frame != f) {
 		ast_frfree(f);
@@ -300,6 +319,24 @@ static struct ast_frame *multicast_rtp_read(struct ast_rtp_instance *instance, i
 	return &ast_null_frame;
 }
 
+static int multicast_rtp_extended_prop_set(struct ast_rtp_instance *instance, int property, void *value)
+{
+	struct multicast_rtp *multicast = ast_rtp_instance_get_data(instance);
+
+	if (property != AST_RTP_MULTICAST_PROPERTY_FANOUT_ADDRESS) {
+		return -1;
+	}
+
+	if (multicast->fanout_count == MULTICAST_MAX_FANOUT) {
+		ast_log(LOG_WARNING, "Not sending to %s; only %d further addresses are supported\n",
+			ast_sockaddr_stringify(value), MULTICAST_MAX_FANOUT);
+		return -1;
+	}
+	ast_sockaddr_copy(&multicast->fanout[multicast->fanout_count++], value);
+
+	return 0;
+}
+
 static int load_module(void)
 {
 	if (ast_rtp_engine_register(&multicast_rtp_engine)) {
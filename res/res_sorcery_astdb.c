@@ -38,6 +38,18 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/sorcery.h"
 #include "asterisk/astdb.h"
 #include "asterisk/json.h"
+#include "asterisk/astobj2.h"
+#include "asterisk/sched.h"
+#include "asterisk/lock.h"
+
+/*! \brief Milliseconds between writes of changed objects to astdb by the astdb_memory wizard */
+#define MEMORY_FLUSH_INTERVAL 1000
+
+/*! \brief Number of buckets for changes waiting to be written to astdb */
+#define MEMORY_PENDING_BUCKETS 257
+
+/*! \brief Number of entries read from astdb at a time when retrieving multiple objects */
+#define RETRIEVE_PAGE 100
 
 static void *sorcery_astdb_open(const char *data);
 static int sorcery_astdb_create(const struct ast_sorcery *sorcery, void *data, void *object);
@@ -50,6 +62,18 @@ static int sorcery_astdb_update(const struct ast_sorcery *sorcery, void *data, v
 static int sorcery_astdb_delete(const struct ast_sorcery *sorcery, void *data, void *object);
 static void sorcery_astdb_close(void *data);
 
+static void *sorcery_astdb_memory_open(const char *data);
+static void sorcery_astdb_memory_load(void *data, const struct ast_sorcery *sorcery, const char *type);
+static int sorcery_astdb_memory_create(const struct ast_sorcery *sorcery, void *data, void *object);
+static void *sorcery_astdb_memory_retrieve_id(const struct ast_sorcery *sorcery, void *data, const char *type, const char *id);
+static void *sorcery_astdb_memory_retrieve_fields(const struct ast_sorcery *sorcery, void *data, const char *type, const struct ast_variable *fields);
+static void sorcery_astdb_memory_retrieve_multiple(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects,
+					     const struct ast_variable *fields);
+static void sorcery_astdb_memory_retrieve_regex(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects, const char *regex);
+static int sorcery_astdb_memory_update(const struct ast_sorcery *sorcery, void *data, void *object);
+static int sorcery_astdb_memory_delete(const struct ast_sorcery *sorcery, void *data, void *object);
+static void sorcery_astdb_memory_close(void *data);
+
 static struct ast_sorcery_wizard astdb_object_wizard = {
 	.name = "astdb",
 	.open = sorcery_astdb_open,
@@ -63,6 +87,70 @@ static struct ast_sorcery_wizard astdb_object_wizard = {
 	.close = sorcery_astdb_close,
 };
 
+/*!
+ * \brief Wizard keeping objects in memory and writing them to astdb behind
+ *
+ * Objects are read from astdb the first time the object type is used. After
+ * that every request is answered from memory, and changes are written to
+ * astdb in batches by a scheduler thread, so creating or updating an object
+ * never waits on the database. Changes made in the last MEMORY_FLUSH_INTERVAL
+ * are lost if Asterisk stops without unloading its modules.
+ */
+static struct ast_sorcery_wizard astdb_memory_object_wizard = {
+	.name = "astdb_memory",
+	.open = sorcery_astdb_memory_open,
+	.load = sorcery_astdb_memory_load,
+	.create = sorcery_astdb_memory_create,
+	.retrieve_id = sorcery_astdb_memory_retrieve_id,
+	.retrieve_fields = sorcery_astdb_memory_retrieve_fields,
+	.retrieve_multiple = sorcery_astdb_memory_retrieve_multiple,
+	.retrieve_regex = sorcery_astdb_memory_retrieve_regex,
+	.update = sorcery_astdb_memory_update,
+	.delete = sorcery_astdb_memory_delete,
+	.close = sorcery_astdb_memory_close,
+};
+
+/*! \brief Scheduler writing the changes made through the astdb_memory wizard */
+static struct ast_sched_context *memory_sched;
+
+/*! \brief An object type kept in memory by the astdb_memory wizard */
+struct sorcery_astdb_memory {
+	/*! \brief The objects, sorted by id */
+	struct ao2_container *objects;
+	/*! \brief Changes not yet written to astdb, by id */
+	struct ao2_container *pending;
+	/*! \brief Serializes writes to astdb so changes reach it in order */
+	ast_mutex_t flush_lock;
+	/*! \brief Scheduler id of the periodic write */
+	int flush_id;
+	/*! \brief Set once the objects have been read from astdb */
+	int loaded;
+	/*! \brief The astdb family, set once the objects have been read */
+	char *family;
+	/*! \brief Prefix for family string generation */
+	char prefix[0];
+};
+
+/*! \brief A change waiting to be written to astdb */
+struct sorcery_astdb_memory_write {
+	/*! \brief The object as written by the astdb wizard, or NULL to delete it */
+	char *value;
+	/*! \brief Id of the object */
+	char id[0];
+};
+
+/*! \brief Structure used for fields comparison */
+struct sorcery_astdb_memory_fields_cmp_params {
+	/*! \brief Pointer to the sorcery structure */
+	const struct ast_sorcery *sorcery;
+	/*! \brief Pointer to the fields to check */
+	const struct ast_variable *fields;
+	/*! \brief Regular expression for checking object id */
+	regex_t *regex;
+	/*! \brief Optional container to put object into */
+	struct ao2_container *container;
+};
+
 /*! \brief Helper function which converts from a sorcery object set to a json object */
 static struct ast_json *sorcery_objectset_to_json(const struct ast_variable *objectset)
 {
@@ -138,48 +226,90 @@ static int sorcery_astdb_create(const struct ast_sorcery *sorcery, void *data, v
 	return ast_db_put(family, ast_sorcery_object_get_id(object), value);
 }
 
+/*!
+ * \internal
+ * \brief Create the object an astdb entry holds
+ *
+ * \param sorcery The sorcery instance
+ * \param type The object type
+ * \param key The id of the object
+ * \param value The entry
+ * \param criteria The fields the object must have, NULL for any object
+ * \param object Set to the object
+ *
+ * \retval -1 on error
+ * \retval 0 if the object does not have \a criteria
+ * \retval 1 if \a object was set
+ */
+static int sorcery_astdb_entry_to_object(const struct ast_sorcery *sorcery, const char *type, const char *key,
+	const char *value, struct ast_json *criteria, void **object)
+{
+	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json_error error;
+	RAII_VAR(struct ast_variable *, objset, NULL, ast_variables_destroy);
+
+	*object = NULL;
+	if (!(json = ast_json_load_string(value, &error))) {
+		return -1;
+	} else if (criteria && !sorcery_json_equal(json, criteria)) {
+		return 0;
+	} else if (!(objset = sorcery_json_to_objectset(json)) ||
+		!(*object = ast_sorcery_alloc(sorcery, type, key)) ||
+		ast_sorcery_objectset_apply(sorcery, *object, objset)) {
+		ao2_cleanup(*object);
+		*object = NULL;
+		return -1;
+	}
+
+	return 1;
+}
+
 /*! \brief Internal helper function which retrieves an object, or multiple objects, using fields for criteria */
 static void *sorcery_astdb_retrieve_fields_common(const struct ast_sorcery *sorcery, void *data, const char *type, const struct ast_variable *fields, struct ao2_container *objects)
 {
 	const char *prefix = data;
 	char family[strlen(prefix) + strlen(type) + 2];
-	RAII_VAR(struct ast_db_entry *, entries, NULL, ast_db_freetree);
 	RAII_VAR(struct ast_json *, criteria, NULL, ast_json_unref);
+	struct ast_db_cursor *cursor;
+	struct ast_db_entry *entries;
 	struct ast_db_entry *entry;
+	void *found = NULL;
+	int done = 0;
 
 	snprintf(family, sizeof(family), "%s/%s", prefix, type);
 
-	if (!(entries = ast_db_gettree(family, NULL)) || (fields && !(criteria = sorcery_objectset_to_json(fields)))) {
+	if ((fields && !(criteria = sorcery_objectset_to_json(fields))) || !(cursor = ast_db_cursor_open(family, NULL))) {
 		return NULL;
 	}
 
-	for (entry = entries; entry; entry = entry->next) {
-		const char *key = entry->key + strlen(family) + 2;
-		RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
-		struct ast_json_error error;
-		RAII_VAR(struct ast_variable *, objset, NULL, ast_variables_destroy);
-		void *object = NULL;
+	/* A page at a time, so a large family is neither held in memory nor holds up astdb */
+	while (!done && (entries = ast_db_cursor_next(cursor, RETRIEVE_PAGE))) {
+		for (entry = entries; entry; entry = entry->next) {
+			const char *key = entry->key + strlen(family) + 2;
+			void *object;
+			int res = sorcery_astdb_entry_to_object(sorcery, type, key, entry->data, criteria, &object);
+
+			if (res < 0) {
+				done = 1;
+				break;
+			} else if (!res) {
+				continue;
+			}
 
-		if (!(json = ast_json_load_string(entry->data, &error))) {
-			return NULL;
-		} else if (criteria && !sorcery_json_equal(json, criteria)) {
-			continue;
-		} else if (!(objset = sorcery_json_to_objectset(json)) ||
-			!(object = ast_sorcery_alloc(sorcery, type, key)) ||
-			ast_sorcery_objectset_apply(sorcery, object, objset)) {
-			ao2_cleanup(object);
-			return NULL;
-		}
+			if (!objects) {
+				found = object;
+				done = 1;
+				break;
+			}
 
-		if (!objects) {
-			return object;
+			ao2_link(objects, object);
+			ao2_cleanup(object);
 		}
-
-		ao2_link(objects, object);
-		ao2_cleanup(object);
+		ast_db_freetree(entries);
 	}
+	ast_db_cursor_close(cursor);
 
-	return NULL;
+	return found;
 }
 
 static void *sorcery_astdb_retrieve_fields(const struct ast_sorcery *sorcery, void *data, const char *type, const struct ast_variable *fields)
@@ -217,9 +347,10 @@ static void sorcery_astdb_retrieve_multiple(const struct ast_sorcery *sorcery, v
 
 /*!
  * \internal
- * \brief Convert regex prefix pattern to astDB prefix pattern if possible.
+ * \brief Convert regex prefix pattern to an astDB key prefix if possible.
  *
- * \param tree astDB prefix pattern buffer to fill.
+ * \param tree astDB key prefix buffer to fill, left empty if the regex
+ * is not a simple prefix pattern.
  * \param regex Extended regular expression with the start anchor character '^'.
  *
  * \note Since this is a helper function, the tree buffer is
@@ -264,9 +395,6 @@ static int make_astdb_prefix_pattern(char *tree, const char *regex)
 		}
 		*dst++ = *src;
 	}
-	if (dst != tree) {
-		*dst++ = '%';
-	}
 	*dst = '\0';
 	return 0;
 }
@@ -276,16 +404,18 @@ static void sorcery_astdb_retrieve_regex(const struct ast_sorcery *sorcery, void
 	const char *prefix = data;
 	char family[strlen(prefix) + strlen(type) + 2];
 	char tree[strlen(regex) + 1];
-	RAII_VAR(struct ast_db_entry *, entries, NULL, ast_db_freetree);
-	regex_t expression;
+	struct ast_db_cursor *cursor;
+	struct ast_db_entry *entries;
 	struct ast_db_entry *entry;
+	regex_t expression;
+	int done = 0;
 
 	snprintf(family, sizeof(family), "%s/%s", prefix, type);
 
 	if (regex[0] == '^') {
 		/*
-		 * For performance reasons, try to create an astDB prefix
-		 * pattern from the regex to reduce the number of entries
+		 * For performance reasons, try to create an astDB key
+		 * prefix from the regex to reduce the number of entries
 		 * retrieved from astDB for regex to then match.
 		 */
 		if (make_astdb_prefix_pattern(tree, regex)) {
@@ -295,32 +425,34 @@ static void sorcery_astdb_retrieve_regex(const struct ast_sorcery *sorcery, void
 		tree[0] = '\0';
 	}
 
-	if (!(entries = ast_db_gettree(family, tree))
-		|| regcomp(&expression, regex, REG_EXTENDED | REG_NOSUB)) {
+	if (regcomp(&expression, regex, REG_EXTENDED | REG_NOSUB)) {
+		return;
+	}
+	if (!(cursor = ast_db_cursor_open_by_prefix(family, tree))) {
+		regfree(&expression);
 		return;
 	}
 
-	for (entry = entries; entry; entry = entry->next) {
-		/* The key in the entry includes the family, so we need to strip it out for regex purposes */
-		const char *key = entry->key + strlen(family) + 2;
-		RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
-		struct ast_json_error error;
-		RAII_VAR(void *, object, NULL, ao2_cleanup);
-		RAII_VAR(struct ast_variable *, objset, NULL, ast_variables_destroy);
-
-		if (regexec(&expression, key, 0, NULL, 0)) {
-			continue;
-		} else if (!(json = ast_json_load_string(entry->data, &error)) ||
-			!(objset = sorcery_json_to_objectset(json)) ||
-			!(object = ast_sorcery_alloc(sorcery, type, key)) ||
-			ast_sorcery_objectset_apply(sorcery, object, objset)) {
-			regfree(&expression);
-			return;
-		}
+	while (!done && (entries = ast_db_cursor_next(cursor, RETRIEVE_PAGE))) {
+		for (entry = entries; entry; entry = entry->next) {
+			/* The key in the entry includes the family, so we need to strip it out for regex purposes */
+			const char *key = entry->key + strlen(family) + 2;
+			void *object;
+
+			if (regexec(&expression, key, 0, NULL, 0)) {
+				continue;
+			} else if (sorcery_astdb_entry_to_object(sorcery, type, key, entry->data, NULL, &object) < 0) {
+				done = 1;
+				break;
+			}
 
-		ao2_link(objects, object);
+			ao2_link(objects, object);
+			ao2_ref(object, -1);
+		}
+		ast_db_freetree(entries);
 	}
 
+	ast_db_cursor_close(cursor);
 	regfree(&expression);
 }
 
@@ -355,6 +487,450 @@ static int sorcery_astdb_delete(const struct ast_sorcery *sorcery, void *data, v
 	return ast_db_del(family, ast_sorcery_object_get_id(object));
 }
 
+/*! \brief Sorting function for objects kept by the astdb_memory wizard */
+static int sorcery_astdb_memory_sort(const void *obj_left, const void *obj_right, int flags)
+{
+	const char *right_key = obj_right;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = ast_sorcery_object_get_id(obj_right);
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(ast_sorcery_object_get_id(obj_left), right_key);
+	case OBJ_SEARCH_PARTIAL_KEY:
+		return strncmp(ast_sorcery_object_get_id(obj_left), right_key, strlen(right_key));
+	default:
+		/* Sort can only work on something with a full or partial key. */
+		ast_assert(0);
+		return 0;
+	}
+}
+
+/*! \brief Hashing function for changes waiting to be written */
+static int sorcery_astdb_memory_write_hash(const void *obj, const int flags)
+{
+	const struct sorcery_astdb_memory_write *write;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		write = obj;
+		key = write->id;
+		break;
+	default:
+		/* Hash can only work on something with a full key. */
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+/*! \brief Comparison function for changes waiting to be written */
+static int sorcery_astdb_memory_write_cmp(void *obj, void *arg, int flags)
+{
+	const struct sorcery_astdb_memory_write *object_left = obj;
+	const struct sorcery_astdb_memory_write *object_right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->id;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(object_left->id, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+static void sorcery_astdb_memory_write_destroy(void *obj)
+{
+	struct sorcery_astdb_memory_write *write = obj;
+
+	ast_json_free(write->value);
+}
+
+/*!
+ * \internal
+ * \brief Read the objects of a type from astdb the first time the type is used
+ */
+static void sorcery_astdb_memory_load_objects(const struct ast_sorcery *sorcery, struct sorcery_astdb_memory *memory, const char *type)
+{
+	struct ast_db_cursor *cursor;
+	struct ast_db_entry *entries;
+	struct ast_db_entry *entry;
+
+	if (memory->loaded) {
+		return;
+	}
+
+	ao2_lock(memory);
+	if (memory->loaded) {
+		ao2_unlock(memory);
+		return;
+	}
+
+	if (!memory->family && ast_asprintf(&memory->family, "%s/%s", memory->prefix, type) < 0) {
+		memory->family = NULL;
+		ao2_unlock(memory);
+		return;
+	}
+
+	cursor = ast_db_cursor_open(memory->family, NULL);
+	while (cursor && (entries = ast_db_cursor_next(cursor, RETRIEVE_PAGE))) {
+		for (entry = entries; entry; entry = entry->next) {
+			const char *key = entry->key + strlen(memory->family) + 2;
+			void *object;
+
+			if (sorcery_astdb_entry_to_object(sorcery, type, key, entry->data, NULL, &object) < 0) {
+				ast_log(LOG_WARNING, "Could not load object '%s' from astdb family '%s'\n",
+					key, memory->family);
+				continue;
+			}
+
+			ao2_link(memory->objects, object);
+			ao2_ref(object, -1);
+		}
+		ast_db_freetree(entries);
+	}
+	ast_db_cursor_close(cursor);
+
+	memory->loaded = 1;
+	ao2_unlock(memory);
+}
+
+/*!
+ * \internal
+ * \brief Queue a change to be written to astdb
+ *
+ * \note The objects container must be locked so changes are queued in the
+ * order they were made.
+ *
+ * \param memory The object type
+ * \param id Id of the changed object
+ * \param value The object as written by the astdb wizard, or NULL to delete it.
+ * It is freed by this function.
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int sorcery_astdb_memory_queue(struct sorcery_astdb_memory *memory, const char *id, char *value)
+{
+	struct sorcery_astdb_memory_write *write;
+
+	write = ao2_alloc_options(sizeof(*write) + strlen(id) + 1, sorcery_astdb_memory_write_destroy,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!write) {
+		ast_json_free(value);
+		return -1;
+	}
+
+	strcpy(write->id, id); /* Safe */
+	write->value = value;
+
+	/* Replaces any change to the same object that has not been written yet */
+	ao2_link(memory->pending, write);
+	ao2_ref(write, -1);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Write the queued changes to astdb
+ */
+static void sorcery_astdb_memory_flush(struct sorcery_astdb_memory *memory)
+{
+	struct ao2_iterator *writes;
+	struct sorcery_astdb_memory_write *write;
+
+	ast_mutex_lock(&memory->flush_lock);
+	writes = ao2_callback(memory->pending, OBJ_MULTIPLE | OBJ_UNLINK, NULL, NULL);
+	if (!writes) {
+		ast_mutex_unlock(&memory->flush_lock);
+		return;
+	}
+
+	while ((write = ao2_iterator_next(writes))) {
+		if (write->value) {
+			if (ast_db_put(memory->family, write->id, write->value)) {
+				ast_log(LOG_WARNING, "Could not write object '%s' to astdb family '%s'\n",
+					write->id, memory->family);
+			}
+		} else {
+			ast_db_del(memory->family, write->id);
+		}
+		ao2_ref(write, -1);
+	}
+	ao2_iterator_destroy(writes);
+	ast_mutex_unlock(&memory->flush_lock);
+}
+
+/*! \brief Scheduler function which writes the queued changes to astdb */
+static int sorcery_astdb_memory_flush_sched(const void *data)
+{
+	sorcery_astdb_memory_flush((struct sorcery_astdb_memory *) data);
+	return MEMORY_FLUSH_INTERVAL;
+}
+
+/*! \brief Helper function which turns an object into the value the astdb wizard writes */
+static char *sorcery_astdb_memory_value(const struct ast_sorcery *sorcery, void *object)
+{
+	struct ast_json *objset = ast_sorcery_objectset_json_create(sorcery, object);
+	char *value;
+
+	if (!objset) {
+		return NULL;
+	}
+
+	value = ast_json_dump_string(objset);
+	ast_json_unref(objset);
+	return value;
+}
+
+static void sorcery_astdb_memory_load(void *data, const struct ast_sorcery *sorcery, const char *type)
+{
+	sorcery_astdb_memory_load_objects(sorcery, data, type);
+}
+
+static int sorcery_astdb_memory_create(const struct ast_sorcery *sorcery, void *data, void *object)
+{
+	struct sorcery_astdb_memory *memory = data;
+	char *value;
+	int res;
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, ast_sorcery_object_get_type(object));
+	if (!(value = sorcery_astdb_memory_value(sorcery, object))) {
+		return -1;
+	}
+
+	ao2_lock(memory->objects);
+	ao2_link_flags(memory->objects, object, OBJ_NOLOCK);
+	res = sorcery_astdb_memory_queue(memory, ast_sorcery_object_get_id(object), value);
+	ao2_unlock(memory->objects);
+
+	return res;
+}
+
+static void *sorcery_astdb_memory_retrieve_id(const struct ast_sorcery *sorcery, void *data, const char *type, const char *id)
+{
+	struct sorcery_astdb_memory *memory = data;
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, type);
+	return ao2_find(memory->objects, id, OBJ_SEARCH_KEY);
+}
+
+static int sorcery_astdb_memory_fields_cmp(void *obj, void *arg, void *data, int flags)
+{
+	const struct sorcery_astdb_memory_fields_cmp_params *params = data;
+	RAII_VAR(struct ast_variable *, objset, NULL, ast_variables_destroy);
+	RAII_VAR(struct ast_variable *, diff, NULL, ast_variables_destroy);
+
+	if (params->regex) {
+		/* If a regular expression has been provided see if it matches, otherwise move on */
+		if (!regexec(params->regex, ast_sorcery_object_get_id(obj), 0, NULL, 0)) {
+			ao2_link(params->container, obj);
+		}
+		return 0;
+	} else if (params->fields &&
+	    (!(objset = ast_sorcery_objectset_create(params->sorcery, obj)) ||
+	     (ast_sorcery_changeset_create(objset, params->fields, &diff)) ||
+	     diff)) {
+		/* If we can't turn the object into an object set OR if differences exist between the fields
+		 * passed in and what are present on the object they are not a match.
+		 */
+		return 0;
+	}
+
+	if (params->container) {
+		ao2_link(params->container, obj);
+
+		/* As multiple objects are being returned keep going */
+		return 0;
+	} else {
+		/* Immediately stop and return, we only want a single object */
+		return CMP_MATCH | CMP_STOP;
+	}
+}
+
+static void *sorcery_astdb_memory_retrieve_fields(const struct ast_sorcery *sorcery, void *data, const char *type, const struct ast_variable *fields)
+{
+	struct sorcery_astdb_memory *memory = data;
+	struct sorcery_astdb_memory_fields_cmp_params params = {
+		.sorcery = sorcery,
+		.fields = fields,
+	};
+
+	/* If no fields are present return nothing, we require *something* */
+	if (!fields) {
+		return NULL;
+	}
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, type);
+	return ao2_callback_data(memory->objects, 0, sorcery_astdb_memory_fields_cmp, NULL, &params);
+}
+
+static void sorcery_astdb_memory_retrieve_multiple(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects, const struct ast_variable *fields)
+{
+	struct sorcery_astdb_memory *memory = data;
+	struct sorcery_astdb_memory_fields_cmp_params params = {
+		.sorcery = sorcery,
+		.fields = fields,
+		.container = objects,
+	};
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, type);
+	ao2_callback_data(memory->objects, OBJ_NODATA | OBJ_MULTIPLE, sorcery_astdb_memory_fields_cmp, NULL, &params);
+}
+
+static void sorcery_astdb_memory_retrieve_regex(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects, const char *regex)
+{
+	struct sorcery_astdb_memory *memory = data;
+	char tree[strlen(regex) + 1];
+	regex_t expression;
+	struct sorcery_astdb_memory_fields_cmp_params params = {
+		.sorcery = sorcery,
+		.container = objects,
+		.regex = &expression,
+	};
+	size_t len;
+
+	if (regex[0] == '^') {
+		/* Only visit the objects whose id starts with the same fixed prefix */
+		if (make_astdb_prefix_pattern(tree, regex)) {
+			return;
+		}
+		len = strlen(tree);
+		if (len && tree[len - 1] == '%') {
+			tree[len - 1] = '\0';
+		}
+	} else {
+		tree[0] = '\0';
+	}
+
+	if (regcomp(&expression, regex, REG_EXTENDED | REG_NOSUB)) {
+		return;
+	}
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, type);
+	ao2_callback_data(memory->objects, OBJ_NODATA | OBJ_MULTIPLE | (tree[0] ? OBJ_SEARCH_PARTIAL_KEY : 0),
+		sorcery_astdb_memory_fields_cmp, tree[0] ? tree : NULL, &params);
+	regfree(&expression);
+}
+
+static int sorcery_astdb_memory_update(const struct ast_sorcery *sorcery, void *data, void *object)
+{
+	struct sorcery_astdb_memory *memory = data;
+	void *existing;
+	char *value;
+	int res;
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, ast_sorcery_object_get_type(object));
+	if (!(value = sorcery_astdb_memory_value(sorcery, object))) {
+		return -1;
+	}
+
+	ao2_lock(memory->objects);
+	existing = ao2_find(memory->objects, ast_sorcery_object_get_id(object), OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!existing) {
+		ao2_unlock(memory->objects);
+		ast_json_free(value);
+		return -1;
+	}
+	ao2_link_flags(memory->objects, object, OBJ_NOLOCK);
+	res = sorcery_astdb_memory_queue(memory, ast_sorcery_object_get_id(object), value);
+	ao2_unlock(memory->objects);
+
+	ao2_ref(existing, -1);
+	return res;
+}
+
+static int sorcery_astdb_memory_delete(const struct ast_sorcery *sorcery, void *data, void *object)
+{
+	struct sorcery_astdb_memory *memory = data;
+	void *existing;
+	int res;
+
+	sorcery_astdb_memory_load_objects(sorcery, memory, ast_sorcery_object_get_type(object));
+
+	ao2_lock(memory->objects);
+	existing = ao2_find(memory->objects, ast_sorcery_object_get_id(object),
+		OBJ_SEARCH_KEY | OBJ_NOLOCK | OBJ_UNLINK);
+	if (!existing) {
+		ao2_unlock(memory->objects);
+		return -1;
+	}
+	res = sorcery_astdb_memory_queue(memory, ast_sorcery_object_get_id(object), NULL);
+	ao2_unlock(memory->objects);
+
+	ao2_ref(existing, -1);
+	return res;
+}
+
+static void sorcery_astdb_memory_destroy(void *obj)
+{
+	struct sorcery_astdb_memory *memory = obj;
+
+	ao2_cleanup(memory->objects);
+	ao2_cleanup(memory->pending);
+	ast_mutex_destroy(&memory->flush_lock);
+	ast_free(memory->family);
+}
+
+static void *sorcery_astdb_memory_open(const char *data)
+{
+	struct sorcery_astdb_memory *memory;
+
+	/* We require a prefix for family string generation, or else stuff could mix together */
+	if (ast_strlen_zero(data)) {
+		return NULL;
+	}
+
+	memory = ao2_alloc_options(sizeof(*memory) + strlen(data) + 1, sorcery_astdb_memory_destroy,
+		AO2_ALLOC_OPT_LOCK_MUTEX);
+	if (!memory) {
+		return NULL;
+	}
+
+	ast_mutex_init(&memory->flush_lock);
+	strcpy(memory->prefix, data); /* Safe */
+	memory->flush_id = -1;
+
+	memory->objects = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_RWLOCK,
+		AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE, sorcery_astdb_memory_sort, NULL);
+	memory->pending = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE, MEMORY_PENDING_BUCKETS,
+		sorcery_astdb_memory_write_hash, NULL, sorcery_astdb_memory_write_cmp);
+	if (!memory->objects || !memory->pending) {
+		ao2_ref(memory, -1);
+		return NULL;
+	}
+
+	ao2_ref(memory, +1);
+	memory->flush_id = ast_sched_add(memory_sched, MEMORY_FLUSH_INTERVAL,
+		sorcery_astdb_memory_flush_sched, memory);
+	if (memory->flush_id < 0) {
+		ao2_ref(memory, -2);
+		return NULL;
+	}
+
+	return memory;
+}
+
+static void sorcery_astdb_memory_close(void *data)
+{
+	struct sorcery_astdb_memory *memory = data;
+
+	AST_SCHED_DEL_UNREF(memory_sched, memory->flush_id, ao2_ref(memory, -1));
+
+	/* Anything changed since the last write must not be lost */
+	sorcery_astdb_memory_flush(memory);
+	ao2_ref(memory, -1);
+}
+
 static void *sorcery_astdb_open(const char *data)
 {
 	/* We require a prefix for family string generation, or else stuff could mix together */
@@ -370,19 +946,31 @@ static void sorcery_astdb_close(void *data)
 	ast_free(data);
 }
 
+static int unload_module(void)
+{
+	ast_sorcery_wizard_unregister(&astdb_object_wizard);
+	ast_sorcery_wizard_unregister(&astdb_memory_object_wizard);
+	if (memory_sched) {
+		ast_sched_context_destroy(memory_sched);
+		memory_sched = NULL;
+	}
+	return 0;
+}
+
 static int load_module(void)
 {
-	if (ast_sorcery_wizard_register(&astdb_object_wizard)) {
+	if (!(memory_sched = ast_sched_context_create()) || ast_sched_start_thread(memory_sched)) {
+		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
-	return AST_MODULE_LOAD_SUCCESS;
-}
+	if (ast_sorcery_wizard_register(&astdb_object_wizard) ||
+		ast_sorcery_wizard_register(&astdb_memory_object_wizard)) {
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
 
-static int unload_module(void)
-{
-	ast_sorcery_wizard_unregister(&astdb_object_wizard);
-	return 0;
+	return AST_MODULE_LOAD_SUCCESS;
 }
 
 AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_GLOBAL_SYMBOLS | AST_MODFLAG_LOAD_ORDER, "Sorcery Astdb Object Wizard",
@@ -40,6 +40,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/config.h"
 #include "asterisk/uuid.h"
 #include "asterisk/hashtab.h"
+#include "asterisk/vector.h"
 
 /*! \brief Structure for storing configuration file sourced objects */
 struct sorcery_config {
@@ -55,6 +56,9 @@ struct sorcery_config {
 	/*! \brief Number of buckets to use for objects */
 	unsigned int buckets;
 
+	/*! \brief Number of threads building objects on load, 0 or 1 to build them in the loading thread */
+	unsigned int threads;
+
 	/*! \brief Enable file level integrity instead of object level */
 	unsigned int file_integrity:1;
 
@@ -227,15 +231,116 @@ static int sorcery_is_criteria_met(struct ast_variable *objset, struct ast_varia
 	return (!criteria || (!ast_sorcery_changeset_create(objset, criteria, &diff) && !diff)) ? 1 : 0;
 }
 
+/*! \brief Maximum number of threads building objects on load */
+#define SORCERY_CONFIG_MAX_THREADS 32
+
+/*! \brief State of a load, shared by the threads building the objects */
+struct sorcery_config_load {
+	const struct ast_sorcery *sorcery;
+	struct sorcery_config *config;
+	const char *type;
+	/*! \brief Container of the new objects */
+	struct ao2_container *objects;
+	/*! \brief Categories to build objects from */
+	AST_VECTOR(, struct ast_category *) categories;
+	/*! \brief Index of the next category to build, taken atomically */
+	int next;
+	/*! \brief Set when the file can't be loaded, which stops the threads */
+	int failed;
+};
+
+/*!
+ * \internal
+ * \brief Build the object of a category and add it to the new objects
+ *
+ * \retval 0 the object was added or skipped
+ * \retval -1 the whole file can't be loaded
+ */
+static int sorcery_config_load_object(struct sorcery_config_load *load, struct ast_category *category)
+{
+	struct sorcery_config *config = load->config;
+	const char *id = ast_category_get_name(category);
+	RAII_VAR(void *, obj, NULL, ao2_cleanup);
+	void *existing;
+
+	/*  Confirm an object with this id does not already exist in the bucket.
+	 *  If it exists, however, the configuration is invalid so stop
+	 *  processing and destroy it. */
+	if ((existing = ao2_find(load->objects, id, OBJ_KEY))) {
+		ao2_ref(existing, -1);
+		ast_log(LOG_ERROR, "Config file '%s' could not be loaded; configuration contains a duplicate object: '%s' of type '%s'\n",
+			config->filename, id, load->type);
+		return -1;
+	}
+
+	if (!(obj = ast_sorcery_alloc(load->sorcery, load->type, id)) ||
+	    ast_sorcery_objectset_apply(load->sorcery, obj, ast_category_first(category))) {
+
+		if (config->file_integrity) {
+			ast_log(LOG_ERROR, "Config file '%s' could not be loaded due to error with object '%s' of type '%s'\n",
+				config->filename, id, load->type);
+			return -1;
+		} else {
+			ast_log(LOG_ERROR, "Could not create an object of type '%s' with id '%s' from configuration file '%s'\n",
+				load->type, id, config->filename);
+		}
+
+		ao2_cleanup(obj);
+
+		/* To ensure we don't lose the object that already exists we retrieve it from the old objects container and add it to the new one */
+		if (!(obj = sorcery_config_retrieve_id(load->sorcery, config, load->type, id))) {
+			return 0;
+		}
+
+		ast_log(LOG_NOTICE, "Retaining existing configuration for object of type '%s' with id '%s'\n", load->type, id);
+	}
+
+	/* Objects built in parallel may share an id, so check again while linking */
+	ao2_lock(load->objects);
+	if ((existing = ao2_find(load->objects, id, OBJ_KEY | OBJ_NOLOCK))) {
+		ao2_unlock(load->objects);
+		ao2_ref(existing, -1);
+		ast_log(LOG_ERROR, "Config file '%s' could not be loaded; configuration contains a duplicate object: '%s' of type '%s'\n",
+			config->filename, id, load->type);
+		return -1;
+	}
+	ao2_link_flags(load->objects, obj, OBJ_NOLOCK);
+	ao2_unlock(load->objects);
+
+	return 0;
+}
+
+/*! \internal \brief Build objects until there are no categories left or the load failed */
+static void *sorcery_config_load_thread(void *data)
+{
+	struct sorcery_config_load *load = data;
+	int idx;
+
+	while (!load->failed
+		&& (idx = ast_atomic_fetchadd_int(&load->next, 1)) < AST_VECTOR_SIZE(&load->categories)) {
+		if (sorcery_config_load_object(load, AST_VECTOR_GET(&load->categories, idx))) {
+			load->failed = 1;
+		}
+	}
+
+	return NULL;
+}
+
 static void sorcery_config_internal_load(void *data, const struct ast_sorcery *sorcery, const char *type, unsigned int reload)
 {
 	struct sorcery_config *config = data;
 	struct ast_flags flags = { reload ? CONFIG_FLAG_FILEUNCHANGED : 0 };
 	struct ast_config *cfg = ast_config_load2(config->filename, config->uuid, flags);
 	struct ast_category *category = NULL;
-	RAII_VAR(struct ao2_container *, objects, NULL, ao2_cleanup);
-	const char *id = NULL;
+	struct sorcery_config_load load = {
+		.sorcery = sorcery,
+		.config = config,
+		.type = type,
+	};
+	pthread_t threads[SORCERY_CONFIG_MAX_THREADS];
+	unsigned int num_threads = 0;
 	unsigned int buckets = 0;
+	unsigned int i;
 
 	if (!cfg) {
 		ast_log(LOG_ERROR, "Unable to load config file '%s'\n", config->filename);
@@ -248,16 +353,28 @@ static void sorcery_config_internal_load(void *data, const struct ast_sorcery *s
 		return;
 	}
 
-	if (!config->buckets) {
-		while ((category = ast_category_browse_filtered(cfg, NULL, category, NULL))) {
+	if (AST_VECTOR_INIT(&load.categories, 64)) {
+		ast_config_destroy(cfg);
+		return;
+	}
 
-			/* If given criteria has not been met skip the category, it is not applicable */
-			if (!sorcery_is_criteria_met(ast_category_first(category), config->criteria)) {
-				continue;
-			}
+	/* Gather the applicable categories once, for sizing the container and building */
+	while ((category = ast_category_browse_filtered(cfg, NULL, category, NULL))) {
+
+		/* If given criteria has not been met skip the category, it is not applicable */
+		if (!sorcery_is_criteria_met(ast_category_first(category), config->criteria)) {
+			continue;
+		}
 
-			buckets++;
+		if (AST_VECTOR_APPEND(&load.categories, category)) {
+			ast_log(LOG_ERROR, "Could not gather the objects of config file '%s', keeping existing objects\n",
+				config->filename);
+			goto end;
 		}
+	}
+
+	if (!config->buckets) {
+		buckets = AST_VECTOR_SIZE(&load.categories);
 
 		/* Determine the optimal number of buckets */
 		while (buckets && !ast_is_prime(buckets)) {
@@ -277,62 +394,36 @@ static void sorcery_config_internal_load(void *data, const struct ast_sorcery *s
 	ast_debug(2, "Using bucket size of '%d' for objects of type '%s' from '%s'\n",
 		buckets, type, config->filename);
 
-	if (!(objects = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_NOLOCK, buckets,
+	if (!(load.objects = ao2_container_alloc_options(
+		config->threads > 1 ? AO2_ALLOC_OPT_LOCK_MUTEX : AO2_ALLOC_OPT_LOCK_NOLOCK, buckets,
 		sorcery_config_hash, sorcery_config_cmp))) {
 		ast_log(LOG_ERROR, "Could not create bucket for new objects from '%s', keeping existing objects\n",
 			config->filename);
-		ast_config_destroy(cfg);
-		return;
+		goto end;
 	}
 
-	while ((category = ast_category_browse_filtered(cfg, NULL, category, NULL))) {
-		RAII_VAR(void *, obj, NULL, ao2_cleanup);
-		id = ast_category_get_name(category);
+	/* The loading thread builds objects too, so one less is started */
+	if (config->threads > 1) {
+		unsigned int wanted = MIN(MIN(config->threads, SORCERY_CONFIG_MAX_THREADS),
+			AST_VECTOR_SIZE(&load.categories));
 
-		/* If given criteria has not been met skip the category, it is not applicable */
-		if (!sorcery_is_criteria_met(ast_category_first(category), config->criteria)) {
-			continue;
-		}
-
-		/*  Confirm an object with this id does not already exist in the bucket.
-		 *  If it exists, however, the configuration is invalid so stop
-		 *  processing and destroy it. */
-		obj = ao2_find(objects, id, OBJ_KEY);
-
-		if (obj) {
-			ast_log(LOG_ERROR, "Config file '%s' could not be loaded; configuration contains a duplicate object: '%s' of type '%s'\n",
-				config->filename, id, type);
-			ast_config_destroy(cfg);
-			return;
-		}
-
-		if (!(obj = ast_sorcery_alloc(sorcery, type, id)) ||
-		    ast_sorcery_objectset_apply(sorcery, obj, ast_category_first(category))) {
-
-			if (config->file_integrity) {
-				ast_log(LOG_ERROR, "Config file '%s' could not be loaded due to error with object '%s' of type '%s'\n",
-					config->filename, id, type);
-				ast_config_destroy(cfg);
-				return;
-			} else {
-				ast_log(LOG_ERROR, "Could not create an object of type '%s' with id '%s' from configuration file '%s'\n",
-					type, id, config->filename);
-			}
-
-			ao2_cleanup(obj);
-
-			/* To ensure we don't lose the object that already exists we retrieve it from the old objects container and add it to the new one */
-			if (!(obj = sorcery_config_retrieve_id(sorcery, data, type, id))) {
-				continue;
-			}
-
-			ast_log(LOG_NOTICE, "Retaining existing configuration for object of type '%s' with id '%s'\n", type, id);
+		while (num_threads + 1 < wanted
+			&& !ast_pthread_create(&threads[num_threads], NULL, sorcery_config_load_thread, &load)) {
+			num_threads++;
 		}
+	}
+	sorcery_config_load_thread(&load);
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
 
-		ao2_link(objects, obj);
+	if (!load.failed) {
+		ao2_global_obj_replace_unref(config->objects, load.objects);
 	}
 
-	ao2_global_obj_replace_unref(config->objects, objects);
+end:
+	ao2_cleanup(load.objects);
+	AST_VECTOR_FREE(&load.categories);
 	ast_config_destroy(cfg);
 }
 
@@ -377,6 +468,12 @@ static void *sorcery_config_open(const char *data)
 				ast_log(LOG_ERROR, "Unsupported bucket size of '%s' used for configuration file '%s', defaulting to automatic determination\n",
 					value, filename);
 			}
+		} else if (!strcasecmp(name, "threads")) {
+			if (sscanf(value, "%30u", &config->threads) != 1) {
+				ast_log(LOG_ERROR, "Unsupported number of threads '%s' used for configuration file '%s', loading objects in one thread\n",
+					value, filename);
+				config->threads = 0;
+			}
 		} else if (!strcasecmp(name, "integrity")) {
 			if (!strcasecmp(value, "file")) {
 				config->file_integrity = 1;
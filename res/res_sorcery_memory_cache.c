@@ -41,6 +41,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/cli.h"
 #include "asterisk/manager.h"
 
+#include <regex.h>
+
 /*** DOCUMENTATION
 	<manager name="SorceryMemoryCacheExpireObject" language="en_US">
 		<synopsis>
@@ -120,6 +122,14 @@ struct sorcery_memory_cache {
 	unsigned int object_lifetime_stale;
 	/** \brief Whether all objects are expired when the object type is reloaded, 0 if disabled */
 	unsigned int expire_on_reload;
+	/*! \brief Whether the cache holds every object in the backend, 0 if disabled */
+	unsigned int full_backend_cache;
+	/*! \brief The type of object cached, once loaded */
+	char *object_type;
+	/*! \brief When the full backend cache was last populated, zero if it is not */
+	struct timeval populated;
+	/*! \brief Scheduler item for populating the full backend cache */
+	int populate_id;
 	/*! \brief Heap of cached objects. Oldest object is at the top. */
 	struct ast_heap *object_heap;
 	/*! \brief Scheduler item for expiring oldest object. */
@@ -156,6 +166,12 @@ static void sorcery_memory_cache_load(void *data, const struct ast_sorcery *sorc
 static void sorcery_memory_cache_reload(void *data, const struct ast_sorcery *sorcery, const char *type);
 static void *sorcery_memory_cache_retrieve_id(const struct ast_sorcery *sorcery, void *data, const char *type,
 	const char *id);
+static void *sorcery_memory_cache_retrieve_fields(const struct ast_sorcery *sorcery, void *data, const char *type,
+	const struct ast_variable *fields);
+static void sorcery_memory_cache_retrieve_multiple(const struct ast_sorcery *sorcery, void *data, const char *type,
+	struct ao2_container *objects, const struct ast_variable *fields);
+static void sorcery_memory_cache_retrieve_regex(const struct ast_sorcery *sorcery, void *data, const char *type,
+	struct ao2_container *objects, const char *regex);
 static int sorcery_memory_cache_delete(const struct ast_sorcery *sorcery, void *data, void *object);
 static void sorcery_memory_cache_close(void *data);
 
@@ -168,6 +184,9 @@ static struct ast_sorcery_wizard memory_cache_object_wizard = {
 	.load = sorcery_memory_cache_load,
 	.reload = sorcery_memory_cache_reload,
 	.retrieve_id = sorcery_memory_cache_retrieve_id,
+	.retrieve_fields = sorcery_memory_cache_retrieve_fields,
+	.retrieve_multiple = sorcery_memory_cache_retrieve_multiple,
+	.retrieve_regex = sorcery_memory_cache_retrieve_regex,
 	.close = sorcery_memory_cache_close,
 };
 
@@ -371,6 +390,7 @@ static void sorcery_memory_cache_destructor(void *obj)
 	struct sorcery_memory_cache *cache = obj;
 
 	ast_free(cache->name);
+	ast_free(cache->object_type);
 	if (cache->object_heap) {
 		ast_heap_destroy(cache->object_heap);
 	}
@@ -391,6 +411,7 @@ static void sorcery_memory_cached_object_destructor(void *obj)
 }
 
 static int schedule_cache_expiration(struct sorcery_memory_cache *cache);
+static int memory_cache_full_update(const struct ast_sorcery *sorcery, struct sorcery_memory_cache *cache);
 
 /*!
  * \internal
@@ -507,6 +528,8 @@ static void remove_all_from_cache(struct sorcery_memory_cache *cache)
 	cache->del_expire = 1;
 	AST_SCHED_DEL_UNREF(sched, cache->expire_id, ao2_ref(cache, -1));
 	cache->del_expire = 0;
+
+	cache->populated = ast_tv(0, 0);
 }
 
 /*!
@@ -577,6 +600,10 @@ static int mark_object_as_stale_in_cache(struct sorcery_memory_cache *cache, con
 static void mark_all_as_stale_in_cache(struct sorcery_memory_cache *cache)
 {
 	ao2_callback(cache->objects, OBJ_NOLOCK | OBJ_NODATA | OBJ_MULTIPLE, object_stale_callback, cache);
+
+	if (cache->full_backend_cache && !ast_tvzero(cache->populated)) {
+		cache->populated = ast_tvsub(cache->populated, ast_samp2tv(cache->object_lifetime_stale + 1, 1));
+	}
 }
 
 /*!
@@ -595,7 +622,8 @@ static int schedule_cache_expiration(struct sorcery_memory_cache *cache)
 	struct sorcery_memory_cached_object *cached;
 	int expiration = 0;
 
-	if (!cache->object_lifetime_maximum) {
+	/* A full backend cache is expired as a whole when it is next used */
+	if (!cache->object_lifetime_maximum || cache->full_backend_cache) {
 		return 0;
 	}
 
@@ -690,6 +718,30 @@ static int add_to_cache(struct sorcery_memory_cache *cache,
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Allocate a cached object wrapping a sorcery object
+ *
+ * \param object The object to cache
+ *
+ * \retval non-NULL success
+ * \retval NULL failure
+ */
+static struct sorcery_memory_cached_object *sorcery_memory_cached_object_alloc(void *object)
+{
+	struct sorcery_memory_cached_object *cached;
+
+	cached = ao2_alloc(sizeof(*cached), sorcery_memory_cached_object_destructor);
+	if (!cached) {
+		return NULL;
+	}
+	cached->object = ao2_bump(object);
+	cached->created = ast_tvnow();
+	cached->stale_update_sched_id = -1;
+
+	return cached;
+}
+
 /*!
  * \internal
  * \brief Callback function to cache an object in a memory cache
@@ -706,13 +758,10 @@ static int sorcery_memory_cache_create(const struct ast_sorcery *sorcery, void *
 	struct sorcery_memory_cache *cache = data;
 	struct sorcery_memory_cached_object *cached;
 
-	cached = ao2_alloc(sizeof(*cached), sorcery_memory_cached_object_destructor);
+	cached = sorcery_memory_cached_object_alloc(object);
 	if (!cached) {
 		return -1;
 	}
-	cached->object = ao2_bump(object);
-	cached->created = ast_tvnow();
-	cached->stale_update_sched_id = -1;
 
 	/* As there is no guarantee that this won't be called by multiple threads wanting to cache
 	 * the same object we remove any old ones, which turns this into a create/update function
@@ -834,6 +883,10 @@ static void *sorcery_memory_cache_retrieve_id(const struct ast_sorcery *sorcery,
 		return NULL;
 	}
 
+	if (cache->full_backend_cache) {
+		memory_cache_full_update(sorcery, cache);
+	}
+
 	cached = ao2_find(cache->objects, id, OBJ_SEARCH_KEY);
 	if (!cached) {
 		return NULL;
@@ -841,7 +894,8 @@ static void *sorcery_memory_cache_retrieve_id(const struct ast_sorcery *sorcery,
 
 	ast_assert(!strcmp(ast_sorcery_object_get_id(cached->object), id));
 
-	if (cache->object_lifetime_stale) {
+	/* A full backend cache refreshes every object at once instead */
+	if (cache->object_lifetime_stale && !cache->full_backend_cache) {
 		struct timeval elapsed;
 
 		elapsed = ast_tvsub(ast_tvnow(), cached->created);
@@ -874,6 +928,314 @@ static void *sorcery_memory_cache_retrieve_id(const struct ast_sorcery *sorcery,
 	return object;
 }
 
+/*!
+ * \internal
+ * \brief AO2 callback function for adding an object retrieved from the backend to a cache
+ *
+ * \pre cache->objects is write-locked
+ */
+static int full_backend_cache_add(void *obj, void *arg, int flags)
+{
+	struct sorcery_memory_cache *cache = arg;
+	struct sorcery_memory_cached_object *cached;
+
+	cached = sorcery_memory_cached_object_alloc(obj);
+	if (!cached) {
+		return 0;
+	}
+
+	/* The backend may have returned the same object more than once */
+	remove_from_cache(cache, ast_sorcery_object_get_id(obj), 0);
+	if (add_to_cache(cache, cached)) {
+		ast_log(LOG_ERROR, "Unable to add object '%s' to the cache\n",
+			ast_sorcery_object_get_id(obj));
+	}
+	ao2_ref(cached, -1);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Scheduler callback which replaces the contents of a full backend cache
+ *
+ * \param data The stale update task data, with no object
+ */
+static int full_backend_cache_populate(const void *data)
+{
+	struct stale_update_task_data *task_data = (struct stale_update_task_data *) data;
+	struct sorcery_memory_cache *cache = task_data->cache;
+	struct ao2_container *objects;
+
+	start_stale_update();
+	objects = ast_sorcery_retrieve_by_fields(task_data->sorcery, cache->object_type,
+		AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
+	end_stale_update();
+
+	ao2_wrlock(cache->objects);
+	cache->populate_id = -1;
+	if (objects) {
+		remove_all_from_cache(cache);
+		ao2_callback(objects, OBJ_NODATA | OBJ_MULTIPLE, full_backend_cache_add, cache);
+		cache->populated = ast_tvnow();
+		ast_debug(1, "Populated memory cache '%s' with %d objects of type '%s'\n",
+			cache->name, ao2_container_count(cache->objects), cache->object_type);
+	} else {
+		ast_log(LOG_WARNING, "Unable to retrieve objects of type '%s' to populate memory cache '%s'\n",
+			cache->object_type, cache->name);
+	}
+	ao2_unlock(cache->objects);
+
+	ast_test_suite_event_notify("SORCERY_MEMORY_CACHE_POPULATED", "Cache: %s\r\nType: %s\r\n",
+		cache->name, cache->object_type);
+
+	ao2_cleanup(objects);
+	ao2_ref(task_data, -1);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Schedule the full backend cache to be populated
+ *
+ * \pre cache->objects is write-locked
+ */
+static void full_backend_cache_schedule(const struct ast_sorcery *sorcery, struct sorcery_memory_cache *cache)
+{
+	struct stale_update_task_data *task_data;
+
+	if (cache->populate_id != -1) {
+		return;
+	}
+
+	task_data = stale_update_task_data_alloc((struct ast_sorcery *) sorcery, cache, cache->object_type, NULL);
+	if (task_data) {
+		cache->populate_id = ast_sched_add(sched, 1, full_backend_cache_populate, task_data);
+	}
+	if (cache->populate_id < 0) {
+		ao2_cleanup(task_data);
+		cache->populate_id = -1;
+		ast_log(LOG_ERROR, "Unable to populate memory cache '%s' with objects of type '%s'\n",
+			cache->name, cache->object_type);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Check the age of a full backend cache before it is used
+ *
+ * A cache that is stale is refreshed in the background while it continues to
+ * be used. A cache that has expired, or has not been populated, is refreshed
+ * the same way but is not used until that completes.
+ *
+ * \param sorcery The sorcery instance
+ * \param cache The sorcery memory cache
+ *
+ * \retval 1 if the cache holds every object in the backend
+ * \retval 0 if it does not
+ */
+static int memory_cache_full_update(const struct ast_sorcery *sorcery, struct sorcery_memory_cache *cache)
+{
+	struct timeval elapsed;
+	int populated;
+	int expired;
+	int refresh;
+
+	if (!cache->object_type) {
+		/* Not loaded yet, so the type of object is not known */
+		return 0;
+	}
+
+	ao2_rdlock(cache->objects);
+	populated = !ast_tvzero(cache->populated);
+	elapsed = ast_tvsub(ast_tvnow(), cache->populated);
+	expired = populated && cache->object_lifetime_maximum
+		&& elapsed.tv_sec >= cache->object_lifetime_maximum;
+	refresh = !populated || expired
+		|| (cache->object_lifetime_stale && elapsed.tv_sec > cache->object_lifetime_stale);
+	if (!refresh || (!expired && cache->populate_id != -1)) {
+		ao2_unlock(cache->objects);
+		return populated;
+	}
+	ao2_unlock(cache->objects);
+
+	ao2_wrlock(cache->objects);
+	if (expired && !ast_tvzero(cache->populated)) {
+		ast_debug(1, "Memory cache '%s' of all objects of type '%s' has expired\n",
+			cache->name, cache->object_type);
+		remove_all_from_cache(cache);
+	}
+	populated = !ast_tvzero(cache->populated);
+	full_backend_cache_schedule(sorcery, cache);
+	ao2_unlock(cache->objects);
+
+	return populated;
+}
+
+/*! \brief Structure used for fields comparison */
+struct sorcery_memory_cache_fields_cmp_params {
+	/*! \brief Pointer to the sorcery structure */
+	const struct ast_sorcery *sorcery;
+	/*! \brief Pointer to the fields to check */
+	const struct ast_variable *fields;
+	/*! \brief Regular expression for checking object id */
+	regex_t *regex;
+	/*! \brief Optional container to put object into */
+	struct ao2_container *container;
+};
+
+/*!
+ * \internal
+ * \brief AO2 callback function for matching cached objects against fields or a regular expression
+ */
+static int sorcery_memory_cache_fields_cmp(void *obj, void *arg, int flags)
+{
+	struct sorcery_memory_cached_object *cached = obj;
+	const struct sorcery_memory_cache_fields_cmp_params *params = arg;
+	RAII_VAR(struct ast_variable *, objset, NULL, ast_variables_destroy);
+	RAII_VAR(struct ast_variable *, diff, NULL, ast_variables_destroy);
+
+	if (params->regex) {
+		if (!regexec(params->regex, ast_sorcery_object_get_id(cached->object), 0, NULL, 0)) {
+			ao2_link(params->container, cached->object);
+		}
+		return 0;
+	} else if (params->fields &&
+	    (!(objset = ast_sorcery_objectset_create(params->sorcery, cached->object)) ||
+	     (ast_sorcery_changeset_create(objset, params->fields, &diff)) ||
+	     diff)) {
+		return 0;
+	}
+
+	if (params->container) {
+		ao2_link(params->container, cached->object);
+		return 0;
+	}
+
+	return CMP_MATCH | CMP_STOP;
+}
+
+/*!
+ * \internal
+ * \brief Callback function to retrieve an object by fields from a full backend cache
+ *
+ * \param sorcery The sorcery instance
+ * \param data The sorcery memory cache
+ * \param type The type of the object to retrieve
+ * \param fields The fields to match
+ *
+ * \retval non-NULL success
+ * \retval NULL failure
+ */
+static void *sorcery_memory_cache_retrieve_fields(const struct ast_sorcery *sorcery, void *data, const char *type,
+	const struct ast_variable *fields)
+{
+	struct sorcery_memory_cache *cache = data;
+	struct sorcery_memory_cache_fields_cmp_params params = {
+		.sorcery = sorcery,
+		.fields = fields,
+	};
+	struct sorcery_memory_cached_object *cached;
+	void *object;
+
+	if (!cache->full_backend_cache || is_stale_update() || !fields
+		|| !memory_cache_full_update(sorcery, cache)) {
+		return NULL;
+	}
+
+	cached = ao2_callback(cache->objects, 0, sorcery_memory_cache_fields_cmp, &params);
+	if (!cached) {
+		return NULL;
+	}
+
+	object = ao2_bump(cached->object);
+	ao2_ref(cached, -1);
+
+	return object;
+}
+
+/*!
+ * \internal
+ * \brief Callback function to retrieve multiple objects from a full backend cache
+ *
+ * \param sorcery The sorcery instance
+ * \param data The sorcery memory cache
+ * \param type The type of the objects to retrieve
+ * \param objects Container to place the objects into
+ * \param fields Optional fields to match
+ */
+static void sorcery_memory_cache_retrieve_multiple(const struct ast_sorcery *sorcery, void *data, const char *type,
+	struct ao2_container *objects, const struct ast_variable *fields)
+{
+	struct sorcery_memory_cache *cache = data;
+	struct sorcery_memory_cache_fields_cmp_params params = {
+		.sorcery = sorcery,
+		.fields = fields,
+		.container = objects,
+	};
+
+	if (!cache->full_backend_cache || is_stale_update()
+		|| !memory_cache_full_update(sorcery, cache)) {
+		return;
+	}
+
+	ao2_callback(cache->objects, OBJ_NODATA | OBJ_MULTIPLE, sorcery_memory_cache_fields_cmp, &params);
+}
+
+/*!
+ * \internal
+ * \brief Callback function to retrieve objects by id regular expression from a full backend cache
+ *
+ * \param sorcery The sorcery instance
+ * \param data The sorcery memory cache
+ * \param type The type of the objects to retrieve
+ * \param objects Container to place the objects into
+ * \param regex The regular expression to match object ids against
+ */
+static void sorcery_memory_cache_retrieve_regex(const struct ast_sorcery *sorcery, void *data, const char *type,
+	struct ao2_container *objects, const char *regex)
+{
+	struct sorcery_memory_cache *cache = data;
+	regex_t expression;
+	struct sorcery_memory_cache_fields_cmp_params params = {
+		.sorcery = sorcery,
+		.container = objects,
+		.regex = &expression,
+	};
+
+	if (!cache->full_backend_cache || is_stale_update()
+		|| !memory_cache_full_update(sorcery, cache)) {
+		return;
+	}
+
+	if (regcomp(&expression, regex, REG_EXTENDED | REG_NOSUB)) {
+		return;
+	}
+
+	ao2_callback(cache->objects, OBJ_NODATA | OBJ_MULTIPLE, sorcery_memory_cache_fields_cmp, &params);
+	regfree(&expression);
+}
+
+/*!
+ * \internal
+ * \brief Get the name the cached objects container of a memory cache is registered under
+ *
+ * \param cache The sorcery memory cache
+ *
+ * \retval non-NULL success (must be freed by the caller)
+ * \retval NULL failure
+ */
+static char *memory_cache_container_name(const struct sorcery_memory_cache *cache)
+{
+	char *name;
+
+	if (ast_asprintf(&name, "sorcery_memory_cache/%s", cache->name) < 0) {
+		return NULL;
+	}
+	return name;
+}
+
 /*!
  * \internal
  * \brief Callback function to finish configuring the memory cache
@@ -885,6 +1247,7 @@ static void *sorcery_memory_cache_retrieve_id(const struct ast_sorcery *sorcery,
 static void sorcery_memory_cache_load(void *data, const struct ast_sorcery *sorcery, const char *type)
 {
 	struct sorcery_memory_cache *cache = data;
+	char *container_name;
 
 	/* If no name was explicitly specified generate one given the sorcery instance and object type */
 	if (ast_strlen_zero(cache->name)) {
@@ -892,13 +1255,32 @@ static void sorcery_memory_cache_load(void *data, const struct ast_sorcery *sorc
 	}
 
 	ao2_link(caches, cache);
+
+	container_name = memory_cache_container_name(cache);
+	if (container_name) {
+		ao2_container_register(container_name, cache->objects, NULL);
+		ast_free(container_name);
+	}
+
 	ast_debug(1, "Memory cache '%s' associated with sorcery instance '%p' of module '%s' with object type '%s'\n",
 		cache->name, sorcery, ast_sorcery_get_module(sorcery), type);
+
+	if (cache->full_backend_cache) {
+		ao2_wrlock(cache->objects);
+		if (!cache->object_type) {
+			cache->object_type = ast_strdup(type);
+		}
+		if (cache->object_type) {
+			full_backend_cache_schedule(sorcery, cache);
+		}
+		ao2_unlock(cache->objects);
+	}
 }
 
 /*!
  * \internal
  * \brief Callback function to expire objects from the memory cache on reload (if configured)
+ * and to refresh a full backend cache
  *
  * \param data The sorcery memory cache
  * \param sorcery The sorcery instance
@@ -908,12 +1290,18 @@ static void sorcery_memory_cache_reload(void *data, const struct ast_sorcery *so
 {
 	struct sorcery_memory_cache *cache = data;
 
-	if (!cache->expire_on_reload) {
+	if (!cache->expire_on_reload && !cache->full_backend_cache) {
 		return;
 	}
 
 	ao2_wrlock(cache->objects);
-	remove_all_from_cache(cache);
+	if (cache->expire_on_reload) {
+		remove_all_from_cache(cache);
+	}
+	if (cache->full_backend_cache && cache->object_type) {
+		/* The backend may have changed, so replace everything */
+		full_backend_cache_schedule(sorcery, cache);
+	}
 	ao2_unlock(cache->objects);
 }
 
@@ -962,6 +1350,7 @@ static void *sorcery_memory_cache_open(const char *data)
 	}
 
 	cache->expire_id = -1;
+	cache->populate_id = -1;
 
 	/* If no configuration options have been provided this memory cache will operate in a default
 	 * configuration.
@@ -996,12 +1385,19 @@ static void *sorcery_memory_cache_open(const char *data)
 			}
 		} else if (!strcasecmp(name, "expire_on_reload")) {
 			cache->expire_on_reload = ast_true(value);
+		} else if (!strcasecmp(name, "full_backend_cache")) {
+			cache->full_backend_cache = ast_true(value);
 		} else {
 			ast_log(LOG_ERROR, "Unsupported option '%s' used for memory cache\n", name);
 			return NULL;
 		}
 	}
 
+	if (cache->full_backend_cache && cache->maximum_objects) {
+		ast_log(LOG_ERROR, "A memory cache of all objects cannot have a maximum number of objects\n");
+		return NULL;
+	}
+
 	cache->objects = ao2_container_alloc_options(AO2_ALLOC_OPT_LOCK_RWLOCK,
 		cache->maximum_objects ? cache->maximum_objects : CACHE_CONTAINER_BUCKET_SIZE,
 		sorcery_memory_cached_object_hash, sorcery_memory_cached_object_cmp);
@@ -1063,10 +1459,17 @@ static int sorcery_memory_cache_delete(const struct ast_sorcery *sorcery, void *
 static void sorcery_memory_cache_close(void *data)
 {
 	struct sorcery_memory_cache *cache = data;
+	char *container_name;
 
 	/* This can occur if a cache is created but never loaded */
 	if (!ast_strlen_zero(cache->name)) {
 		ao2_unlink(caches, cache);
+
+		container_name = memory_cache_container_name(cache);
+		if (container_name) {
+			ao2_container_unregister(container_name);
+			ast_free(container_name);
+		}
 	}
 
 	if (cache->object_lifetime_maximum) {
@@ -1160,6 +1563,7 @@ static char *sorcery_memory_cache_show(struct ast_cli_entry *e, int cmd, struct
 		ast_cli(a->fd, "Object staleness is not enabled - cached objects will not go stale\n");
 	}
 	ast_cli(a->fd, "Expire all objects on reload: %s\n", AST_CLI_ONOFF(cache->expire_on_reload));
+	ast_cli(a->fd, "Cache all objects in the backend: %s\n", AST_CLI_ONOFF(cache->full_backend_cache));
 
 	ao2_ref(cache, -1);
 
@@ -2488,6 +2892,178 @@ cleanup:
 	return res;
 }
 
+/*! \brief Identifiers of the objects the full backend mock wizard holds */
+static const char *full_backend_ids[] = { "alice", "bob", "carol" };
+
+/*! \brief Number of times the full backend mock wizard has retrieved a single object */
+static int full_backend_retrieve_id_count;
+
+/*! \brief Number of times the full backend mock wizard has retrieved all objects */
+static int full_backend_retrieve_multiple_count;
+
+/*!
+ * \brief Callback for retrieving a sorcery object by ID from the full backend mock
+ */
+static void *mock_full_retrieve_id(const struct ast_sorcery *sorcery, void *data,
+		const char *type, const char *id)
+{
+	int i;
+
+	ast_atomic_fetchadd_int(&full_backend_retrieve_id_count, +1);
+
+	for (i = 0; i < ARRAY_LEN(full_backend_ids); ++i) {
+		if (!strcmp(full_backend_ids[i], id)) {
+			return ast_sorcery_alloc(sorcery, type, id);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Callback for retrieving all sorcery objects from the full backend mock
+ */
+static void mock_full_retrieve_multiple(const struct ast_sorcery *sorcery, void *data,
+		const char *type, struct ao2_container *objects, const struct ast_variable *fields)
+{
+	int i;
+
+	ast_atomic_fetchadd_int(&full_backend_retrieve_multiple_count, +1);
+
+	for (i = 0; i < ARRAY_LEN(full_backend_ids); ++i) {
+		void *object = ast_sorcery_alloc(sorcery, type, full_backend_ids[i]);
+
+		if (object) {
+			ao2_link(objects, object);
+			ao2_ref(object, -1);
+		}
+	}
+}
+
+/*!
+ * \brief A mock sorcery wizard used for the full backend cache test
+ */
+static struct ast_sorcery_wizard mock_full_wizard = {
+	.name = "mock_full",
+	.retrieve_id = mock_full_retrieve_id,
+	.retrieve_multiple = mock_full_retrieve_multiple,
+};
+
+AST_TEST_DEFINE(full_backend_cache)
+{
+	int res = AST_TEST_FAIL;
+	struct ast_sorcery *sorcery = NULL;
+	struct sorcery_memory_cache *cache = NULL;
+	struct ao2_container *objects = NULL;
+	void *object = NULL;
+	struct timeval start;
+	int populated = 0;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "full_backend_cache";
+		info->category = "/res/res_sorcery_memory_cache/";
+		info->summary = "Ensure that a full backend cache answers all retrievals";
+		info->description = "This test performs the following:\n"
+			"\t* Create a sorcery instance with two wizards\n"
+			"\t\t* The first is a memory cache of all objects in the backend\n"
+			"\t\t* The second is a mock of a back-end holding three objects\n"
+			"\t* Loads the sorcery instance and waits for the cache to be populated\n"
+			"\t* Ensures the backend was asked for all objects once\n"
+			"\t* Retrieves an object by id and ensures the backend was not asked\n"
+			"\t* Retrieves all objects and ensures each is returned once without asking the backend\n"
+			"\t* Retrieves objects by regular expression and ensures only the matches are returned\n"
+			"\t* Retrieves an object the backend does not have and ensures the backend was asked";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	full_backend_retrieve_id_count = 0;
+	full_backend_retrieve_multiple_count = 0;
+
+	ast_sorcery_wizard_register(&mock_full_wizard);
+
+	sorcery = ast_sorcery_open();
+	if (!sorcery) {
+		ast_test_status_update(test, "Failed to create sorcery instance\n");
+		goto cleanup;
+	}
+
+	ast_sorcery_apply_wizard_mapping(sorcery, "test", "memory_cache",
+			"name=full_backend_test,full_backend_cache=yes", 1);
+	ast_sorcery_apply_wizard_mapping(sorcery, "test", "mock_full", NULL, 0);
+	ast_sorcery_internal_object_register(sorcery, "test", test_sorcery_object_alloc, NULL, NULL);
+	ast_sorcery_load(sorcery);
+
+	cache = ao2_find(caches, "full_backend_test", OBJ_SEARCH_KEY);
+	if (!cache) {
+		ast_test_status_update(test, "Failed to find the full backend cache\n");
+		goto cleanup;
+	}
+
+	start = ast_tvnow();
+	while (!populated && ast_remaining_ms(start, 5000) > 0) {
+		ao2_rdlock(cache->objects);
+		populated = !ast_tvzero(cache->populated);
+		ao2_unlock(cache->objects);
+		if (!populated) {
+			usleep(1000);
+		}
+	}
+	if (!populated) {
+		ast_test_status_update(test, "The full backend cache was not populated\n");
+		goto cleanup;
+	}
+
+	if (full_backend_retrieve_multiple_count != 1 || ao2_container_count(cache->objects) != ARRAY_LEN(full_backend_ids)) {
+		ast_test_status_update(test, "The full backend cache holds %d objects after %d retrievals of all objects\n",
+			ao2_container_count(cache->objects), full_backend_retrieve_multiple_count);
+		goto cleanup;
+	}
+
+	object = ast_sorcery_retrieve_by_id(sorcery, "test", "bob");
+	if (!object || full_backend_retrieve_id_count) {
+		ast_test_status_update(test, "Retrieving an object by id was not answered by the cache\n");
+		goto cleanup;
+	}
+
+	objects = ast_sorcery_retrieve_by_fields(sorcery, "test", AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
+	if (!objects || ao2_container_count(objects) != ARRAY_LEN(full_backend_ids)
+		|| full_backend_retrieve_multiple_count != 1) {
+		ast_test_status_update(test, "Retrieving all objects returned %d objects with %d retrievals from the backend\n",
+			objects ? ao2_container_count(objects) : 0, full_backend_retrieve_multiple_count);
+		goto cleanup;
+	}
+	ao2_cleanup(objects);
+
+	objects = ast_sorcery_retrieve_by_regex(sorcery, "test", "^[ab]");
+	if (!objects || ao2_container_count(objects) != 2) {
+		ast_test_status_update(test, "Retrieving objects by regular expression returned %d objects\n",
+			objects ? ao2_container_count(objects) : 0);
+		goto cleanup;
+	}
+
+	ao2_cleanup(object);
+	object = ast_sorcery_retrieve_by_id(sorcery, "test", "dave");
+	if (object || full_backend_retrieve_id_count != 1) {
+		ast_test_status_update(test, "Retrieving an object the cache does not hold did not ask the backend\n");
+		goto cleanup;
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	ao2_cleanup(object);
+	ao2_cleanup(objects);
+	ao2_cleanup(cache);
+	if (sorcery) {
+		ast_sorcery_unref(sorcery);
+	}
+	ast_sorcery_wizard_unregister(&mock_full_wizard);
+	return res;
+}
+
 #endif
 
 static int unload_module(void)
@@ -2500,6 +3076,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(maximum_objects);
 	AST_TEST_UNREGISTER(expiration);
 	AST_TEST_UNREGISTER(stale);
+	AST_TEST_UNREGISTER(full_backend_cache);
 
 	ast_manager_unregister("SorceryMemoryCacheExpireObject");
 	ast_manager_unregister("SorceryMemoryCacheExpire");
@@ -2577,6 +3154,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(delete);
 	AST_TEST_REGISTER(maximum_objects);
 	AST_TEST_REGISTER(expiration);
+	AST_TEST_REGISTER(full_backend_cache);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
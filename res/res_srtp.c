@@ -75,6 +75,7 @@ static int ast_srtp_add_stream(struct ast_srtp *srtp, struct ast_srtp_policy *po
 static int ast_srtp_change_source(struct ast_srtp *srtp, unsigned int from_ssrc, unsigned int to_ssrc);
 
 static int ast_srtp_unprotect(struct ast_srtp *srtp, void *buf, int *len, int rtcp);
+static int ast_srtp_unprotect_batch(struct ast_srtp *srtp, void **bufs, int *lens, int count, int rtcp);
 static int ast_srtp_protect(struct ast_srtp *srtp, void **buf, int *len, int rtcp);
 static void ast_srtp_set_cb(struct ast_srtp *srtp, const struct ast_srtp_cb *cb, void *data);
 static int ast_srtp_get_random(unsigned char *key, size_t len);
@@ -94,6 +95,7 @@ static struct ast_srtp_res srtp_res = {
 	.change_source = ast_srtp_change_source,
 	.set_cb = ast_srtp_set_cb,
 	.unprotect = ast_srtp_unprotect,
+	.unprotect_batch = ast_srtp_unprotect_batch,
 	.protect = ast_srtp_protect,
 	.get_random = ast_srtp_get_random
 };
@@ -416,6 +418,35 @@ tryagain:
 	return *len;
 }
 
+static int ast_srtp_unprotect_batch(struct ast_srtp *srtp, void **bufs, int *lens, int count, int rtcp)
+{
+	int unprotected = 0;
+	int res;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		/*
+		 * Packets of a running session normally unprotect right away.  Failures
+		 * leave the packet untouched, so the full handling can retry it.
+		 */
+		if (srtp->session) {
+			res = rtcp ? srtp_unprotect_rtcp(srtp->session, bufs[i], &lens[i]) : srtp_unprotect(srtp->session, bufs[i], &lens[i]);
+			if (res == err_status_ok || res == err_status_replay_fail) {
+				++unprotected;
+				continue;
+			}
+		}
+
+		if (ast_srtp_unprotect(srtp, bufs[i], &lens[i], rtcp) < 0) {
+			lens[i] = -1;
+		} else {
+			++unprotected;
+		}
+	}
+
+	return unprotected;
+}
+
 static int ast_srtp_protect(struct ast_srtp *srtp, void **buf, int *len, int rtcp)
 {
 	int res;
@@ -1609,11 +1609,15 @@ static struct ast_json *app_event_sources_to_json(
 
 static struct ast_json *stasis_app_object_to_json(struct stasis_app *app)
 {
+	struct ast_json *json;
+
 	if (!app) {
 		return NULL;
 	}
 
-	return app_event_sources_to_json(app, app_to_json(app));
+	json = app_to_json(app);
+	app_event_filter_to_json(app, json);
+	return app_event_sources_to_json(app, json);
 }
 
 struct ast_json *stasis_app_to_json(const char *app_name)
@@ -1709,6 +1713,43 @@ static enum stasis_app_subscribe_res app_handle_subscriptions(
 	return STASIS_ASR_OK;
 }
 
+enum stasis_app_event_filter_res stasis_app_event_filter_set(const char *app_name,
+	struct ast_json *filter, struct ast_json **json)
+{
+	RAII_VAR(struct stasis_app *, app, find_app_by_name(app_name), ao2_cleanup);
+	enum stasis_app_event_filter_res res;
+
+	if (!app) {
+		return STASIS_AEF_APP_NOT_FOUND;
+	}
+
+	res = app_event_filter_set(app, filter);
+	if (res != STASIS_AEF_OK) {
+		return res;
+	}
+
+	if (json) {
+		*json = stasis_app_object_to_json(app);
+		if (!*json) {
+			return STASIS_AEF_INTERNAL_ERROR;
+		}
+	}
+
+	return STASIS_AEF_OK;
+}
+
+int stasis_app_compact_set(const char *app_name, int compact)
+{
+	RAII_VAR(struct stasis_app *, app, find_app_by_name(app_name), ao2_cleanup);
+
+	if (!app) {
+		return -1;
+	}
+
+	app_set_compact(app, compact);
+	return 0;
+}
+
 enum stasis_app_subscribe_res stasis_app_subscribe_channel(const char *app_name,
 	struct ast_channel *chan)
 {
@@ -49,6 +49,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/uuid.h"
 #include "asterisk/say.h"
 #include "asterisk/indications.h"
+#include "asterisk/taskprocessor.h"
 
 /*! Number of hash buckets for playback container. Keep it prime! */
 #define PLAYBACK_BUCKETS 127
@@ -66,11 +67,14 @@ ASTERISK_REGISTER_FILE()
 /*! Container of all current playbacks */
 static struct ao2_container *playbacks;
 
+/*! Reads the upcoming items of media lists while the current ones play */
+static struct ast_taskprocessor *prefetch_tps;
+
 /*! Playback control object for res_stasis */
 struct stasis_app_playback {
 	AST_DECLARE_STRING_FIELDS(
 		AST_STRING_FIELD(id);	/*!< Playback unique id */
-		AST_STRING_FIELD(media);	/*!< Playback media uri */
+		AST_STRING_FIELD(media);	/*!< Playback media uri, or list of uris */
 		AST_STRING_FIELD(language);	/*!< Preferred language */
 		AST_STRING_FIELD(target);       /*!< Playback device uri */
 		);
@@ -254,11 +258,150 @@ static void playback_final_update(struct stasis_app_playback *playback,
 	playback_publish(playback);
 }
 
-static void play_on_channel(struct stasis_app_playback *playback,
+/*!
+ * \brief Find where the item after the first of a media list starts
+ *
+ * Items are separated by commas. Tones have commas of their own, so only a
+ * comma followed by a known scheme separates items.
+ *
+ * \return The comma before the next item, or NULL for the last item
+ */
+static const char *media_list_next(const char *media)
+{
+	static const char * const schemes[] = {
+		SOUND_URI_SCHEME, RECORDING_URI_SCHEME, NUMBER_URI_SCHEME,
+		DIGITS_URI_SCHEME, CHARACTERS_URI_SCHEME, TONE_URI_SCHEME,
+	};
+	const char *comma = media;
+	int i;
+
+	while ((comma = strchr(comma, ','))) {
+		const char *uri = ast_skip_blanks(comma + 1);
+
+		for (i = 0; i < ARRAY_LEN(schemes); ++i) {
+			if (ast_begins_with(uri, schemes[i])) {
+				return comma;
+			}
+		}
+		++comma;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Take the first item off a media list, like strsep()
+ */
+static char *media_list_sep(char **media)
+{
+	char *uri = *media;
+	char *comma;
+
+	if (!uri) {
+		return NULL;
+	}
+
+	if ((comma = (char *) media_list_next(uri))) {
+		*comma = '\0';
+		*media = comma + 1;
+	} else {
+		*media = NULL;
+	}
+
+	return ast_strip(uri);
+}
+
+/*! \brief The items of a media list to read ahead on a channel */
+struct playback_prefetch {
+	struct ast_channel *chan;
+	char *language;
+	char *media;
+};
+
+static void playback_prefetch_free(struct playback_prefetch *prefetch)
+{
+	ast_channel_cleanup(prefetch->chan);
+	ast_free(prefetch->language);
+	ast_free(prefetch->media);
+	ast_free(prefetch);
+}
+
+/*!
+ * \brief Find and read the files of media list items, in the order they play
+ */
+static int playback_prefetch_exec(void *data)
+{
+	struct playback_prefetch *prefetch = data;
+	char *next = prefetch->media;
+	char *uri;
+
+	while ((uri = media_list_sep(&next))) {
+		if (ast_check_hangup_locked(prefetch->chan)) {
+			break;
+		}
+
+		if (ast_begins_with(uri, SOUND_URI_SCHEME)) {
+			ast_file_prefetch(prefetch->chan, uri + strlen(SOUND_URI_SCHEME),
+				prefetch->language);
+		} else if (ast_begins_with(uri, RECORDING_URI_SCHEME)) {
+			struct stasis_app_stored_recording *recording;
+
+			recording = stasis_app_stored_recording_find_by_name(uri + strlen(RECORDING_URI_SCHEME));
+			if (recording) {
+				ast_file_prefetch(prefetch->chan,
+					stasis_app_stored_recording_get_file(recording), prefetch->language);
+				ao2_ref(recording, -1);
+			}
+		}
+	}
+
+	playback_prefetch_free(prefetch);
+	return 0;
+}
+
+/*!
+ * \brief Queue the items of a media list after the first to be read ahead
+ *
+ * Each item is found and read while the ones before it play, so that
+ * opening it when its turn comes does not wait on the filesystem.
+ */
+static void playback_prefetch_queue(struct stasis_app_playback *playback,
 	struct ast_channel *chan)
+{
+	struct playback_prefetch *prefetch;
+	const char *rest = media_list_next(playback->media);
+
+	if (!rest || !prefetch_tps) {
+		return;
+	}
+
+	if (!(prefetch = ast_calloc(1, sizeof(*prefetch)))) {
+		return;
+	}
+	prefetch->chan = ast_channel_ref(chan);
+	prefetch->language = ast_strdup(playback->language);
+	prefetch->media = ast_strdup(rest + 1);
+	if (!prefetch->language || !prefetch->media
+		|| ast_taskprocessor_push(prefetch_tps, playback_prefetch_exec, prefetch)) {
+		playback_prefetch_free(prefetch);
+	}
+}
+
+/*!
+ * \brief Play one item of the media of a playback
+ *
+ * \param playback The playback
+ * \param chan The channel to play it on
+ * \param uri The item
+ * \param[in,out] offsetms Milliseconds to skip, and then that were played
+ *
+ * \retval 0 The item was played through
+ * \retval non-zero The item was interrupted or could not be played
+ */
+static int play_media(struct stasis_app_playback *playback,
+	struct ast_channel *chan, const char *uri, long *offsetms)
 {
 	int res;
-	long offsetms;
 
 	/* Even though these local variables look fairly pointless, the avoid
 	 * having a bunch of NULL's passed directly into
@@ -269,72 +412,107 @@ static void play_on_channel(struct stasis_app_playback *playback,
 	const char *pause = NULL;
 	const char *restart = NULL;
 
-	ast_assert(playback != NULL);
-
-	offsetms = playback->offsetms;
-
-	res = playback_first_update(playback, ast_channel_uniqueid(chan));
-
-	if (res != 0) {
-		return;
-	}
-
-	if (ast_channel_state(chan) != AST_STATE_UP) {
-		ast_indicate(chan, AST_CONTROL_PROGRESS);
-	}
-
-	if (ast_begins_with(playback->media, SOUND_URI_SCHEME)) {
+	if (ast_begins_with(uri, SOUND_URI_SCHEME)) {
 		playback->controllable = 1;
 
 		/* Play sound */
-		res = ast_control_streamfile_lang(chan, playback->media + strlen(SOUND_URI_SCHEME),
+		res = ast_control_streamfile_lang(chan, uri + strlen(SOUND_URI_SCHEME),
 				fwd, rev, stop, pause, restart, playback->skipms, playback->language,
-				&offsetms);
-	} else if (ast_begins_with(playback->media, RECORDING_URI_SCHEME)) {
+				offsetms);
+	} else if (ast_begins_with(uri, RECORDING_URI_SCHEME)) {
 		/* Play recording */
 		RAII_VAR(struct stasis_app_stored_recording *, recording, NULL,
 			ao2_cleanup);
 		const char *relname =
-			playback->media + strlen(RECORDING_URI_SCHEME);
+			uri + strlen(RECORDING_URI_SCHEME);
 		recording = stasis_app_stored_recording_find_by_name(relname);
 
 		if (!recording) {
 			ast_log(LOG_ERROR, "Attempted to play recording '%s' on channel '%s' but recording does not exist",
 				relname, ast_channel_name(chan));
-			return;
+			return -1;
 		}
 
 		playback->controllable = 1;
 
 		res = ast_control_streamfile_lang(chan,
 			stasis_app_stored_recording_get_file(recording), fwd, rev, stop, pause,
-			restart, playback->skipms, playback->language, &offsetms);
-	} else if (ast_begins_with(playback->media, NUMBER_URI_SCHEME)) {
+			restart, playback->skipms, playback->language, offsetms);
+	} else if (ast_begins_with(uri, NUMBER_URI_SCHEME)) {
 		int number;
 
-		if (sscanf(playback->media + strlen(NUMBER_URI_SCHEME), "%30d", &number) != 1) {
+		if (sscanf(uri + strlen(NUMBER_URI_SCHEME), "%30d", &number) != 1) {
 			ast_log(LOG_ERROR, "Attempted to play number '%s' on channel '%s' but number is invalid",
-				playback->media + strlen(NUMBER_URI_SCHEME), ast_channel_name(chan));
-			return;
+				uri + strlen(NUMBER_URI_SCHEME), ast_channel_name(chan));
+			return -1;
 		}
 
 		res = ast_say_number(chan, number, stop, playback->language, NULL);
-	} else if (ast_begins_with(playback->media, DIGITS_URI_SCHEME)) {
-		res = ast_say_digit_str(chan, playback->media + strlen(DIGITS_URI_SCHEME),
+	} else if (ast_begins_with(uri, DIGITS_URI_SCHEME)) {
+		res = ast_say_digit_str(chan, uri + strlen(DIGITS_URI_SCHEME),
 			stop, playback->language);
-	} else if (ast_begins_with(playback->media, CHARACTERS_URI_SCHEME)) {
-		res = ast_say_character_str(chan, playback->media + strlen(CHARACTERS_URI_SCHEME),
+	} else if (ast_begins_with(uri, CHARACTERS_URI_SCHEME)) {
+		res = ast_say_character_str(chan, uri + strlen(CHARACTERS_URI_SCHEME),
 			stop, playback->language, AST_SAY_CASE_NONE);
-	} else if (ast_begins_with(playback->media, TONE_URI_SCHEME)) {
+	} else if (ast_begins_with(uri, TONE_URI_SCHEME)) {
 		playback->controllable = 1;
-		res = ast_control_tone(chan, playback->media + strlen(TONE_URI_SCHEME));
+		res = ast_control_tone(chan, uri + strlen(TONE_URI_SCHEME));
 	} else {
 		/* Play URL */
 		ast_log(LOG_ERROR, "Attempted to play URI '%s' on channel '%s' but scheme is unsupported\n",
-			playback->media, ast_channel_name(chan));
+			uri, ast_channel_name(chan));
+		return -1;
+	}
+
+	return res;
+}
+
+static void play_on_channel(struct stasis_app_playback *playback,
+	struct ast_channel *chan)
+{
+	int res;
+	long offsetms;
+	char *next;
+	char *uri;
+
+	ast_assert(playback != NULL);
+
+	offsetms = playback->offsetms;
+
+	res = playback_first_update(playback, ast_channel_uniqueid(chan));
+
+	if (res != 0) {
 		return;
 	}
 
+	if (ast_channel_state(chan) != AST_STATE_UP) {
+		ast_indicate(chan, AST_CONTROL_PROGRESS);
+	}
+
+	/* A media list plays its items in turn, reading each ahead */
+	playback_prefetch_queue(playback, chan);
+
+	next = ast_strdupa(playback->media);
+	while ((uri = media_list_sep(&next))) {
+		int stopped;
+
+		res = play_media(playback, chan, uri, &offsetms);
+		if (res || !next) {
+			break;
+		}
+
+		ao2_lock(playback);
+		stopped = playback->state == STASIS_PLAYBACK_STATE_STOPPED;
+		ao2_unlock(playback);
+		if (stopped) {
+			res = -1;
+			break;
+		}
+
+		/* The offset only applies to the first item */
+		offsetms = 0;
+	}
+
 	playback_final_update(playback, offsetms, res,
 		ast_channel_uniqueid(chan));
 
@@ -670,11 +848,15 @@ static int load_module(void)
 	if (!playbacks) {
 		return AST_MODULE_LOAD_FAILURE;
 	}
+
+	/* Media lists play without their items read ahead if this fails */
+	prefetch_tps = ast_taskprocessor_get("stasis-playback-prefetch", TPS_REF_DEFAULT);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
 static int unload_module(void)
 {
+	prefetch_tps = ast_taskprocessor_unreference(prefetch_tps);
 	ao2_cleanup(playbacks);
 	playbacks = NULL;
 	STASIS_MESSAGE_TYPE_CLEANUP(stasis_app_playback_snapshot_type);
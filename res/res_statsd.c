@@ -45,6 +45,30 @@
 				<configOption name="add_newline">
 					<synopsis>Append a newline to every event. This is useful if you want to fake out a server using netcat (nc -lu 8125)</synopsis>
 				</configOption>
+				<configOption name="max_packet_size">
+					<synopsis>Largest packet to combine metrics into, in bytes</synopsis>
+					<description>
+						<para>Metrics are combined into packets of up to this many
+						bytes, one metric per line, instead of being sent one per
+						packet. A packet is sent when the next metric does not fit
+						in it, or <replaceable>flush_interval</replaceable> after
+						the first metric was put in it. The default of 1432 fits
+						in the MTU of most networks. 0 sends every metric on its
+						own as soon as it is logged.</para>
+					</description>
+				</configOption>
+				<configOption name="flush_interval">
+					<synopsis>Longest time in milliseconds metrics are held before they are sent</synopsis>
+				</configOption>
+				<configOption name="aggregate_counters">
+					<synopsis>Add up counters before they are sent</synopsis>
+					<description>
+						<para>When enabled, counters logged without a sample rate
+						are added up per name and sent as one metric every
+						<replaceable>flush_interval</replaceable>, so the number of
+						metrics sent no longer grows with the call rate.</para>
+					</description>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -54,9 +78,12 @@
 
 ASTERISK_REGISTER_FILE()
 
+#include "asterisk/astobj2.h"
 #include "asterisk/config_options.h"
+#include "asterisk/lock.h"
 #include "asterisk/module.h"
 #include "asterisk/netsock2.h"
+#include "asterisk/threadstorage.h"
 
 #define AST_API_MODULE
 #include "asterisk/statsd.h"
@@ -65,9 +92,37 @@ ASTERISK_REGISTER_FILE()
 
 #define MAX_PREFIX 40
 
+/*! Largest packet metrics are combined into */
+#define MAX_PACKET_SIZE 8192
+
+/*! Buckets of the container of aggregated counters */
+#define COUNTER_BUCKETS 127
+
 /*! Socket for sending statd messages */
 static int socket_fd = -1;
 
+/*! Protects the packet being combined and the flush thread state */
+AST_MUTEX_DEFINE_STATIC(batch_lock);
+/*! Signalled to stop the flush thread */
+static ast_cond_t batch_cond;
+/*! Metrics combined into the next packet, one per line */
+static char batch[MAX_PACKET_SIZE];
+/*! Length of the metrics in batch */
+static size_t batch_len;
+/*! Thread sending the combined metrics and aggregated counters on time */
+static pthread_t flush_thread = AST_PTHREADT_NULL;
+/*! Set to stop the flush thread */
+static int flush_stop;
+
+/*! Counters added up since they were last sent, by name */
+static struct ao2_container *counters;
+
+/*! \brief A counter added up since it was last sent */
+struct statsd_counter {
+	intmax_t value;
+	char name[0];
+};
+
 /*! \brief Global configuration options for statsd client. */
 struct conf_global_options {
 	/*! Enabled by default, disabled if false. */
@@ -78,6 +133,12 @@ struct conf_global_options {
 	struct ast_sockaddr statsd_server;
 	/*! Prefix to put on every stat. */
 	char prefix[MAX_PREFIX + 1];
+	/*! Largest packet to combine metrics into, 0 to send them one at a time */
+	unsigned int max_packet_size;
+	/*! Longest time in milliseconds metrics are held before being sent */
+	unsigned int flush_interval;
+	/*! Add up counters without a sample rate before sending them */
+	int aggregate_counters;
 };
 
 /*! \brief All configuration options for statsd client. */
@@ -97,13 +158,226 @@ static void conf_server(const struct conf *cfg, struct ast_sockaddr *addr)
 	}
 }
 
+/*!
+ * \internal
+ * \brief Send the combined metrics
+ * \note Must be called with batch_lock held
+ */
+static void batch_send(const struct conf *cfg)
+{
+	struct ast_sockaddr statsd_server;
+
+	if (!batch_len) {
+		return;
+	}
+
+	conf_server(cfg, &statsd_server);
+	ast_debug(6, "Sending %zu bytes of statistics to StatsD server\n", batch_len);
+	ast_sendto(socket_fd, batch, batch_len, 0, &statsd_server);
+	batch_len = 0;
+}
+
+/*!
+ * \internal
+ * \brief Send a metric, or combine it with others into a packet
+ */
+static void statsd_send(const struct conf *cfg, const char *msg, size_t len)
+{
+	struct ast_sockaddr statsd_server;
+	size_t separator;
+
+	if (len < cfg->global->max_packet_size) {
+		ast_mutex_lock(&batch_lock);
+		/* With add_newline each metric already ends its line */
+		separator = batch_len && batch[batch_len - 1] != '\n';
+		if (batch_len + separator + len > cfg->global->max_packet_size) {
+			batch_send(cfg);
+			separator = 0;
+		}
+		if (separator) {
+			batch[batch_len++] = '\n';
+		}
+		memcpy(batch + batch_len, msg, len);
+		batch_len += len;
+		ast_mutex_unlock(&batch_lock);
+		return;
+	}
+
+	conf_server(cfg, &statsd_server);
+	ast_debug(6, "Sending statistic %s to StatsD server\n", msg);
+	ast_sendto(socket_fd, msg, len, 0, &statsd_server);
+}
+
+/*!
+ * \internal
+ * \brief Format a metric as a statsd message
+ */
+static void statsd_format(struct ast_str **msg, const struct conf *cfg, const char *metric_name,
+	const char *metric_type, const char *value, double sample_rate)
+{
+	ast_str_reset(*msg);
+
+	if (!ast_strlen_zero(cfg->global->prefix)) {
+		ast_str_append(msg, 0, "%s.", cfg->global->prefix);
+	}
+
+	ast_str_append(msg, 0, "%s:%s|%s", metric_name, value, metric_type);
+
+	if (sample_rate < 1.0) {
+		ast_str_append(msg, 0, "|@%.2f", sample_rate);
+	}
+
+	if (cfg->global->add_newline) {
+		ast_str_append(msg, 0, "\n");
+	}
+}
+
+static int statsd_counter_hash(const void *obj, const int flags)
+{
+	const struct statsd_counter *counter;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		counter = obj;
+		key = counter->name;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int statsd_counter_cmp(void *obj, void *arg, int flags)
+{
+	const struct statsd_counter *counter_left = obj;
+	const struct statsd_counter *counter_right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = counter_right->name;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(counter_left->name, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Add to a counter sent on the next flush
+ *
+ * \retval 0 the value was added
+ * \retval -1 the counter has to be sent as it is
+ */
+static int statsd_counter_add(const char *metric_name, const char *value)
+{
+	struct statsd_counter *counter;
+	intmax_t delta;
+	int pos = 0;
+
+	if (!counters || sscanf(value, "%jd%n", &delta, &pos) != 1 || value[pos]) {
+		return -1;
+	}
+
+	ao2_lock(counters);
+	counter = ao2_find(counters, metric_name, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!counter) {
+		counter = ao2_alloc_options(sizeof(*counter) + strlen(metric_name) + 1, NULL,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!counter) {
+			ao2_unlock(counters);
+			return -1;
+		}
+		strcpy(counter->name, metric_name); /* Safe */
+		ao2_link_flags(counters, counter, OBJ_NOLOCK);
+	}
+	counter->value += delta;
+	ao2_unlock(counters);
+
+	ao2_ref(counter, -1);
+	return 0;
+}
+
+AST_THREADSTORAGE(statsd_msg_buf);
+
+/*!
+ * \internal
+ * \brief Send the added up counters and the metrics combined so far
+ */
+static void statsd_flush(void)
+{
+	struct conf *cfg;
+	struct ao2_iterator *iter;
+	struct statsd_counter *counter;
+	struct ast_str *msg;
+	char char_value[30];
+
+	cfg = ao2_global_obj_ref(confs);
+	if (!cfg) {
+		return;
+	}
+
+	/* Counters added to from now on are sent on the next flush */
+	if (counters && (msg = ast_str_thread_get(&statsd_msg_buf, 128))
+		&& (iter = ao2_callback(counters, OBJ_MULTIPLE | OBJ_UNLINK, NULL, NULL))) {
+		while ((counter = ao2_iterator_next(iter))) {
+			snprintf(char_value, sizeof(char_value), "%jd", counter->value);
+			statsd_format(&msg, cfg, counter->name, AST_STATSD_COUNTER, char_value, 1.0);
+			statsd_send(cfg, ast_str_buffer(msg), ast_str_strlen(msg));
+			ao2_ref(counter, -1);
+		}
+		ao2_iterator_destroy(iter);
+	}
+
+	ast_mutex_lock(&batch_lock);
+	batch_send(cfg);
+	ast_mutex_unlock(&batch_lock);
+
+	ao2_ref(cfg, -1);
+}
+
+static void *statsd_flush_thread(void *data)
+{
+	struct conf *cfg;
+	struct timeval wake;
+	struct timespec ts;
+	unsigned int interval;
+
+	ast_mutex_lock(&batch_lock);
+	while (!flush_stop) {
+		cfg = ao2_global_obj_ref(confs);
+		interval = cfg ? MAX(cfg->global->flush_interval, 1) : 1000;
+		ao2_cleanup(cfg);
+
+		wake = ast_tvadd(ast_tvnow(), ast_samp2tv(interval, 1000));
+		ts.tv_sec = wake.tv_sec;
+		ts.tv_nsec = wake.tv_usec * 1000;
+		ast_cond_timedwait(&batch_cond, &batch_lock, &ts);
+		if (flush_stop) {
+			break;
+		}
+
+		ast_mutex_unlock(&batch_lock);
+		statsd_flush();
+		ast_mutex_lock(&batch_lock);
+	}
+	ast_mutex_unlock(&batch_lock);
+
+	return NULL;
+}
+
 void AST_OPTIONAL_API_NAME(ast_statsd_log_string)(const char *metric_name,
 	const char *metric_type, const char *value, double sample_rate)
 {
 	struct conf *cfg;
 	struct ast_str *msg;
-	size_t len;
-	struct ast_sockaddr statsd_server;
 
 	if (socket_fd == -1) {
 		return;
@@ -119,35 +393,24 @@ void AST_OPTIONAL_API_NAME(ast_statsd_log_string)(const char *metric_name,
 	}
 
 	cfg = ao2_global_obj_ref(confs);
-	conf_server(cfg, &statsd_server);
 
-	msg = ast_str_create(40);
-	if (!msg) {
+	if (cfg->global->aggregate_counters && sample_rate >= 1.0
+		&& !strcmp(metric_type, AST_STATSD_COUNTER)
+		&& !statsd_counter_add(metric_name, value)) {
 		ao2_cleanup(cfg);
 		return;
 	}
 
-	if (!ast_strlen_zero(cfg->global->prefix)) {
-		ast_str_append(&msg, 0, "%s.", cfg->global->prefix);
-	}
-
-	ast_str_append(&msg, 0, "%s:%s|%s", metric_name, value, metric_type);
-
-	if (sample_rate < 1.0) {
-		ast_str_append(&msg, 0, "|@%.2f", sample_rate);
-	}
-
-	if (cfg->global->add_newline) {
-		ast_str_append(&msg, 0, "\n");
+	msg = ast_str_thread_get(&statsd_msg_buf, 128);
+	if (!msg) {
+		ao2_cleanup(cfg);
+		return;
 	}
 
-	len = ast_str_strlen(msg);
-
-	ast_debug(6, "Sending statistic %s to StatsD server\n", ast_str_buffer(msg));
-	ast_sendto(socket_fd, ast_str_buffer(msg), len, 0, &statsd_server);
+	statsd_format(&msg, cfg, metric_name, metric_type, value, sample_rate);
+	statsd_send(cfg, ast_str_buffer(msg), ast_str_strlen(msg));
 
 	ao2_cleanup(cfg);
-	ast_free(msg);
 }
 
 void AST_OPTIONAL_API_NAME(ast_statsd_log_full)(const char *metric_name,
@@ -305,6 +568,18 @@ static int statsd_init(void)
 	ast_debug(3, "  statsd server = %s.\n", server);
 	ast_debug(3, "  add newline = %s\n", AST_YESNO(cfg->global->add_newline));
 	ast_debug(3, "  prefix = %s\n", cfg->global->prefix);
+	ast_debug(3, "  max packet size = %u\n", cfg->global->max_packet_size);
+	ast_debug(3, "  flush interval = %u\n", cfg->global->flush_interval);
+	ast_debug(3, "  aggregate counters = %s\n", AST_YESNO(cfg->global->aggregate_counters));
+
+	if (flush_thread == AST_PTHREADT_NULL) {
+		flush_stop = 0;
+		if (ast_pthread_create(&flush_thread, NULL, statsd_flush_thread, NULL)) {
+			ast_log(LOG_ERROR, "Unable to start the statsd flush thread\n");
+			flush_thread = AST_PTHREADT_NULL;
+			return -1;
+		}
+	}
 
 	return 0;
 }
@@ -312,7 +587,17 @@ static int statsd_init(void)
 static void statsd_shutdown(void)
 {
 	ast_debug(3, "Shutting down statsd client.\n");
+	if (flush_thread != AST_PTHREADT_NULL) {
+		ast_mutex_lock(&batch_lock);
+		flush_stop = 1;
+		ast_cond_signal(&batch_cond);
+		ast_mutex_unlock(&batch_lock);
+		pthread_join(flush_thread, NULL);
+		flush_thread = AST_PTHREADT_NULL;
+	}
 	if (socket_fd != -1) {
+		/* Send what was held back before the socket goes away */
+		statsd_flush();
 		close(socket_fd);
 		socket_fd = -1;
 	}
@@ -325,6 +610,14 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	counters = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, COUNTER_BUCKETS,
+		statsd_counter_hash, NULL, statsd_counter_cmp);
+	if (!counters) {
+		aco_info_destroy(&cfg_info);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_cond_init(&batch_cond, NULL);
+
 	aco_option_register(&cfg_info, "enabled", ACO_EXACT, global_options,
 		"no", OPT_BOOL_T, 1,
 		FLDSET(struct conf_global_options, enabled));
@@ -341,8 +634,23 @@ static int load_module(void)
 		"", OPT_CHAR_ARRAY_T, 0,
 		CHARFLDSET(struct conf_global_options, prefix));
 
+	aco_option_register(&cfg_info, "max_packet_size", ACO_EXACT, global_options,
+		"1432", OPT_UINT_T, PARSE_IN_RANGE,
+		FLDSET(struct conf_global_options, max_packet_size), 0, MAX_PACKET_SIZE);
+
+	aco_option_register(&cfg_info, "flush_interval", ACO_EXACT, global_options,
+		"1000", OPT_UINT_T, PARSE_IN_RANGE,
+		FLDSET(struct conf_global_options, flush_interval), 1, 60000);
+
+	aco_option_register(&cfg_info, "aggregate_counters", ACO_EXACT, global_options,
+		"no", OPT_BOOL_T, 1,
+		FLDSET(struct conf_global_options, aggregate_counters));
+
 	if (aco_process_config(&cfg_info, 0)) {
 		aco_info_destroy(&cfg_info);
+		ao2_ref(counters, -1);
+		counters = NULL;
+		ast_cond_destroy(&batch_cond);
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
@@ -362,6 +670,9 @@ static int unload_module(void)
 	statsd_shutdown();
 	aco_info_destroy(&cfg_info);
 	ao2_global_obj_release(confs);
+	ao2_cleanup(counters);
+	counters = NULL;
+	ast_cond_destroy(&batch_cond);
 	return 0;
 }
 
@@ -0,0 +1,549 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ *
+ * \brief Timer wheel timing interface
+ *
+ * Every timer of the timerfd interface is a kernel timer of its own, so a
+ * system playing prompts to thousands of channels arms thousands of kernel
+ * timers, each waking the system up at its own phase of the 20 ms cycle.
+ *
+ * This interface spreads the timers over a few timer wheels.  Each wheel is
+ * driven by one thread reading one periodic timerfd, and signals the timers
+ * that expired at each tick through their eventfd, which is what the users
+ * of the timers poll.  Timers expire on a grid of their interval in the
+ * monotonic clock, so all 20 ms timers expire on the same wheel ticks.  A
+ * timer can therefore expire early the first time after its rate is set.
+ */
+
+/*** MODULEINFO
+	<depend>timerfd</depend>
+	<defaultenabled>no</defaultenabled>
+	<support_level>extended</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include <math.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "asterisk/module.h"
+#include "asterisk/astobj2.h"
+#include "asterisk/timing.h"
+#include "asterisk/logger.h"
+#include "asterisk/utils.h"
+#include "asterisk/lock.h"
+#include "asterisk/dlinkedlists.h"
+
+static void *timing_funcs_handle;
+
+static void *wheel_timer_open(void);
+static void wheel_timer_close(void *data);
+static int wheel_timer_set_rate(void *data, unsigned int rate);
+static int wheel_timer_ack(void *data, unsigned int quantity);
+static int wheel_timer_enable_continuous(void *data);
+static int wheel_timer_disable_continuous(void *data);
+static enum ast_timer_event wheel_timer_get_event(void *data);
+static unsigned int wheel_timer_get_max_rate(void *data);
+static int wheel_timer_fd(void *data);
+
+static struct ast_timing_interface wheel_timing = {
+	.name = "wheel",
+	/* Only built on request, so preferred to timerfd when present. */
+	.priority = 250,
+	.timer_open = wheel_timer_open,
+	.timer_close = wheel_timer_close,
+	.timer_set_rate = wheel_timer_set_rate,
+	.timer_ack = wheel_timer_ack,
+	.timer_enable_continuous = wheel_timer_enable_continuous,
+	.timer_disable_continuous = wheel_timer_disable_continuous,
+	.timer_get_event = wheel_timer_get_event,
+	.timer_get_max_rate = wheel_timer_get_max_rate,
+	.timer_fd = wheel_timer_fd,
+};
+
+/*! \brief Number of timer wheels, each with a thread */
+#define WHEEL_COUNT 4
+
+/*! \brief Milliseconds between the ticks of a wheel */
+#define WHEEL_TICK_MS 10
+
+/*! \brief Number of slots of a wheel; must span more than the longest interval */
+#define WHEEL_SLOTS 256
+
+/* 1 tick / 10 ms */
+#define MAX_RATE (1000 / WHEEL_TICK_MS)
+
+struct wheel_timer;
+
+AST_DLLIST_HEAD_NOLOCK(wheel_slot, wheel_timer);
+
+struct timer_wheel {
+	ast_mutex_t lock;
+	pthread_t thread;
+	/*! The periodic timer driving the wheel */
+	int timerfd;
+	/*! Monotonic time in ms of the next tick to process */
+	uint64_t tick_time;
+	/*! Timers with a rate */
+	unsigned int scheduled;
+	/*! Timers expiring at each tick, by tick modulo WHEEL_SLOTS */
+	struct wheel_slot slots[WHEEL_SLOTS];
+	unsigned int stop:1;
+	/*! The periodic timer is running */
+	unsigned int armed:1;
+};
+
+struct wheel_timer {
+	/*! Wheel of the timer, its lock protects the timer too */
+	struct timer_wheel *wheel;
+	AST_DLLIST_ENTRY(wheel_timer) list;
+	/*! The eventfd polled by the user of the timer */
+	int fd;
+	/*! Interval in ms for current rate, 0 if not ticking */
+	unsigned int interval;
+	/*! Monotonic time in ms of the next expiration */
+	uint64_t due;
+	unsigned int pending_ticks;
+	unsigned int continuous:1;
+	unsigned int fd_signaled:1;
+};
+
+static struct timer_wheel wheels[WHEEL_COUNT];
+
+/*! \brief Wheel of the next timer opened */
+static int wheel_next;
+
+static uint64_t wheel_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*!
+ * \internal
+ * \brief Start or stop the periodic timer of a wheel
+ * \pre wheel is locked
+ */
+static int wheel_arm(struct timer_wheel *wheel, int run)
+{
+	struct itimerspec its = { { 0, }, };
+
+	if (run) {
+		/* Tick on the grid, starting with the next tick to process. */
+		its.it_value.tv_sec = wheel->tick_time / 1000;
+		its.it_value.tv_nsec = (wheel->tick_time % 1000) * 1000000;
+		its.it_interval.tv_nsec = WHEEL_TICK_MS * 1000000L;
+	}
+
+	if (timerfd_settime(wheel->timerfd, TFD_TIMER_ABSTIME, &its, NULL)) {
+		ast_log(LOG_ERROR, "Failed to set wheel timerfd: %s\n", strerror(errno));
+		return -1;
+	}
+	wheel->armed = run;
+	return 0;
+}
+
+/*!
+ * \internal
+ * \pre wheel of timer is locked
+ */
+static void signal_fd(struct wheel_timer *timer)
+{
+	uint64_t one = 1;
+
+	if (timer->fd_signaled) {
+		return;
+	}
+
+	if (write(timer->fd, &one, sizeof(one)) != sizeof(one)) {
+		ast_log(LOG_ERROR, "Error writing to timer eventfd: %s\n", strerror(errno));
+	} else {
+		timer->fd_signaled = 1;
+	}
+}
+
+/*!
+ * \internal
+ * \pre wheel of timer is locked
+ */
+static void unsignal_fd(struct wheel_timer *timer)
+{
+	uint64_t count;
+
+	if (!timer->fd_signaled) {
+		return;
+	}
+
+	if (read(timer->fd, &count, sizeof(count)) != sizeof(count)) {
+		ast_log(LOG_ERROR, "Error reading from timer eventfd: %s\n", strerror(errno));
+	} else {
+		timer->fd_signaled = 0;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Put a timer in the slot of the tick at or after it is due
+ * \pre wheel of timer is locked
+ */
+static void wheel_insert(struct wheel_timer *timer)
+{
+	uint64_t tick = (timer->due + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+
+	AST_DLLIST_INSERT_TAIL(&timer->wheel->slots[tick % WHEEL_SLOTS], timer, list);
+}
+
+/*!
+ * \internal
+ * \brief Stop a timer from ticking
+ * \pre wheel of timer is locked
+ */
+static void wheel_unschedule(struct wheel_timer *timer)
+{
+	struct timer_wheel *wheel = timer->wheel;
+	uint64_t tick;
+
+	if (!timer->interval) {
+		return;
+	}
+
+	tick = (timer->due + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+	AST_DLLIST_REMOVE(&wheel->slots[tick % WHEEL_SLOTS], timer, list);
+	timer->interval = 0;
+
+	/* The wheel thread stops the periodic timer at its next tick if no
+	 * timer got a rate again meanwhile, so a timer whose rate is changed
+	 * does not stop and start it each time. */
+	--wheel->scheduled;
+}
+
+/*!
+ * \internal
+ * \brief Expire the timers of the slot of the next tick
+ * \pre wheel is locked
+ */
+static void wheel_tick(struct timer_wheel *wheel)
+{
+	struct wheel_slot *slot = &wheel->slots[(wheel->tick_time / WHEEL_TICK_MS) % WHEEL_SLOTS];
+	struct wheel_timer *timer;
+
+	AST_DLLIST_TRAVERSE_SAFE_BEGIN(slot, timer, list) {
+		if (timer->due > wheel->tick_time) {
+			/* Due a turn of the wheel later. */
+			continue;
+		}
+
+		AST_DLLIST_REMOVE_CURRENT(list);
+		do {
+			timer->pending_ticks++;
+			timer->due += timer->interval;
+		} while (timer->due <= wheel->tick_time);
+		signal_fd(timer);
+		wheel_insert(timer);
+	}
+	AST_DLLIST_TRAVERSE_SAFE_END;
+
+	wheel->tick_time += WHEEL_TICK_MS;
+}
+
+static void *wheel_thread(void *data)
+{
+	struct timer_wheel *wheel = data;
+
+	for (;;) {
+		uint64_t expirations;
+		uint64_t now;
+
+		if (read(wheel->timerfd, &expirations, sizeof(expirations)) < 0
+			&& errno != EINTR && errno != EAGAIN) {
+			ast_log(LOG_ERROR, "Error reading from wheel timerfd: %s\n", strerror(errno));
+			break;
+		}
+
+		ast_mutex_lock(&wheel->lock);
+		if (wheel->stop) {
+			ast_mutex_unlock(&wheel->lock);
+			break;
+		}
+		now = wheel_now();
+		while (wheel->scheduled && wheel->tick_time <= now) {
+			wheel_tick(wheel);
+		}
+		if (!wheel->scheduled && wheel->armed) {
+			wheel_arm(wheel, 0);
+		}
+		ast_mutex_unlock(&wheel->lock);
+	}
+
+	return NULL;
+}
+
+static void wheel_timer_destructor(void *obj)
+{
+	struct wheel_timer *timer = obj;
+
+	if (timer->fd > -1) {
+		close(timer->fd);
+	}
+}
+
+static void *wheel_timer_open(void)
+{
+	struct wheel_timer *timer;
+
+	if (!(timer = ao2_alloc_options(sizeof(*timer), wheel_timer_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ((timer->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		ast_log(LOG_ERROR, "Failed to create timer eventfd: %s\n", strerror(errno));
+		ao2_ref(timer, -1);
+		return NULL;
+	}
+
+	timer->wheel = &wheels[(unsigned int) ast_atomic_fetchadd_int(&wheel_next, 1) % WHEEL_COUNT];
+
+	return timer;
+}
+
+static void wheel_timer_close(void *data)
+{
+	struct wheel_timer *timer = data;
+
+	ast_mutex_lock(&timer->wheel->lock);
+	wheel_unschedule(timer);
+	ast_mutex_unlock(&timer->wheel->lock);
+
+	ao2_ref(timer, -1);
+}
+
+static int wheel_timer_set_rate(void *data, unsigned int rate)
+{
+	struct wheel_timer *timer = data;
+	struct timer_wheel *wheel = timer->wheel;
+	uint64_t now;
+	int res = 0;
+
+	if (rate > MAX_RATE) {
+		ast_log(LOG_ERROR, "res_timing_wheel only supports timers at a "
+				"max rate of %d / sec\n", MAX_RATE);
+		errno = EINVAL;
+		return -1;
+	}
+
+	ast_mutex_lock(&wheel->lock);
+
+	wheel_unschedule(timer);
+	if (rate) {
+		now = wheel_now();
+		if (!wheel->scheduled++) {
+			/* The wheel was idle; resume it at the next tick. A timer
+			 * still running keeps ticking on the same grid. */
+			wheel->tick_time = (now / WHEEL_TICK_MS + 1) * WHEEL_TICK_MS;
+			if (!wheel->armed) {
+				res = wheel_arm(wheel, 1);
+			}
+		}
+		timer->interval = roundf(1000.0 / ((float) rate));
+		timer->due = (now / timer->interval + 1) * timer->interval;
+		wheel_insert(timer);
+	}
+
+	ast_mutex_unlock(&wheel->lock);
+
+	return res;
+}
+
+static int wheel_timer_ack(void *data, unsigned int quantity)
+{
+	struct wheel_timer *timer = data;
+
+	ast_assert(quantity > 0);
+
+	ast_mutex_lock(&timer->wheel->lock);
+
+	if (quantity > timer->pending_ticks) {
+		quantity = timer->pending_ticks;
+	}
+	timer->pending_ticks -= quantity;
+	if (!timer->pending_ticks && !timer->continuous) {
+		unsignal_fd(timer);
+	}
+
+	ast_mutex_unlock(&timer->wheel->lock);
+
+	return 0;
+}
+
+static int wheel_timer_enable_continuous(void *data)
+{
+	struct wheel_timer *timer = data;
+
+	ast_mutex_lock(&timer->wheel->lock);
+	if (!timer->continuous) {
+		timer->continuous = 1;
+		signal_fd(timer);
+	}
+	ast_mutex_unlock(&timer->wheel->lock);
+
+	return 0;
+}
+
+static int wheel_timer_disable_continuous(void *data)
+{
+	struct wheel_timer *timer = data;
+
+	ast_mutex_lock(&timer->wheel->lock);
+	if (timer->continuous) {
+		timer->continuous = 0;
+		if (!timer->pending_ticks) {
+			unsignal_fd(timer);
+		}
+	}
+	ast_mutex_unlock(&timer->wheel->lock);
+
+	return 0;
+}
+
+static enum ast_timer_event wheel_timer_get_event(void *data)
+{
+	struct wheel_timer *timer = data;
+	enum ast_timer_event res = AST_TIMING_EVENT_EXPIRED;
+
+	ast_mutex_lock(&timer->wheel->lock);
+	if (timer->continuous) {
+		res = AST_TIMING_EVENT_CONTINUOUS;
+	}
+	ast_mutex_unlock(&timer->wheel->lock);
+
+	return res;
+}
+
+static unsigned int wheel_timer_get_max_rate(void *data)
+{
+	return MAX_RATE;
+}
+
+static int wheel_timer_fd(void *data)
+{
+	struct wheel_timer *timer = data;
+
+	return timer->fd;
+}
+
+static void wheels_stop(void)
+{
+	int i;
+
+	for (i = 0; i < WHEEL_COUNT; ++i) {
+		struct timer_wheel *wheel = &wheels[i];
+
+		if (wheel->thread != AST_PTHREADT_NULL) {
+			ast_mutex_lock(&wheel->lock);
+			wheel->stop = 1;
+			/* Wake the thread up right away. */
+			wheel->tick_time = wheel_now();
+			wheel_arm(wheel, 1);
+			ast_mutex_unlock(&wheel->lock);
+			pthread_join(wheel->thread, NULL);
+			wheel->thread = AST_PTHREADT_NULL;
+		}
+		if (wheel->timerfd > -1) {
+			close(wheel->timerfd);
+			wheel->timerfd = -1;
+		}
+		ast_mutex_destroy(&wheel->lock);
+	}
+}
+
+static int wheels_start(void)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < WHEEL_COUNT; ++i) {
+		struct timer_wheel *wheel = &wheels[i];
+
+		ast_mutex_init(&wheel->lock);
+		wheel->thread = AST_PTHREADT_NULL;
+		wheel->stop = 0;
+		wheel->armed = 0;
+		wheel->scheduled = 0;
+		for (j = 0; j < WHEEL_SLOTS; ++j) {
+			AST_DLLIST_HEAD_INIT_NOLOCK(&wheel->slots[j]);
+		}
+		wheel->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	}
+
+	for (i = 0; i < WHEEL_COUNT; ++i) {
+		struct timer_wheel *wheel = &wheels[i];
+
+		if (wheel->timerfd < 0) {
+			ast_log(LOG_ERROR, "Failed to create wheel timerfd: %s\n", strerror(errno));
+			return -1;
+		}
+		if (ast_pthread_create_background(&wheel->thread, NULL, wheel_thread, wheel)) {
+			ast_log(LOG_ERROR, "Unable to start timer wheel thread.\n");
+			wheel->thread = AST_PTHREADT_NULL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int load_module(void)
+{
+	if (wheels_start()) {
+		wheels_stop();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	if (!(timing_funcs_handle = ast_register_timing_interface(&wheel_timing))) {
+		wheels_stop();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+static int unload_module(void)
+{
+	int res;
+
+	if (!(res = ast_unregister_timing_interface(timing_funcs_handle))) {
+		wheels_stop();
+	}
+
+	return res;
+}
+
+AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_LOAD_ORDER, "Timer Wheel Timing Interface",
+	.support_level = AST_MODULE_SUPPORT_EXTENDED,
+	.load = load_module,
+	.unload = unload_module,
+	.load_pri = AST_MODPRI_TIMING,
+);
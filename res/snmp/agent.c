@@ -770,7 +770,7 @@ static u_char *ast_var_indications_table(struct variable *vp, oid *name, size_t
 }
 
 static int countmodule(const char *mod, const char *desc, int use, const char *status,
-		const char *like, enum ast_module_support_level support_level)
+		const char *like, enum ast_module_support_level support_level, int64_t load_usec)
 {
 	return 1;
 }
@@ -61,6 +61,14 @@ struct stasis_app {
 	void *data;
 	/*! Subscription model for the application */
 	enum stasis_app_subscription_model subscription_model;
+	/*! Event types sent to the application, or NULL for every type */
+	struct ast_json *events_allowed;
+	/*! Event types not sent to the application */
+	struct ast_json *events_disallowed;
+	/*! Members left out of the objects in each event */
+	struct ast_json *fields_omitted;
+	/*! Whether snapshots in events are reduced to what the event is about */
+	int compact;
 	/*! Name of the Stasis application */
 	char name[];
 };
@@ -306,6 +314,191 @@ static void app_dtor(void *obj)
 	app->forwards = NULL;
 	ao2_cleanup(app->data);
 	app->data = NULL;
+	ast_json_unref(app->events_allowed);
+	app->events_allowed = NULL;
+	ast_json_unref(app->events_disallowed);
+	app->events_disallowed = NULL;
+	ast_json_unref(app->fields_omitted);
+	app->fields_omitted = NULL;
+}
+
+/*! \brief Whether a list of event filters has one for the given type */
+static int event_filter_matches(struct ast_json *filters, const char *type)
+{
+	size_t i;
+
+	for (i = 0; i < ast_json_array_size(filters); ++i) {
+		struct ast_json *filter_type = ast_json_object_get(ast_json_array_get(filters, i), "type");
+
+		if (!strcmp(type, ast_json_string_get(filter_type))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Whether events of the given type are sent to an application
+ *
+ * \note Call with the application locked.
+ */
+static int app_event_type_allowed(struct stasis_app *app, const char *type)
+{
+	/* Events without a type cannot be filtered */
+	if (!type) {
+		return 1;
+	}
+	if (app->events_allowed && !event_filter_matches(app->events_allowed, type)) {
+		return 0;
+	}
+	return !app->events_disallowed || !event_filter_matches(app->events_disallowed, type);
+}
+
+/*!
+ * \internal
+ * \brief Whether to build an event of the given type for an application
+ *
+ * Lets an event that would be filtered out be skipped before its JSON is built.
+ */
+static int app_event_wanted(struct stasis_app *app, const char *type)
+{
+	SCOPED_AO2LOCK(lock, app);
+	return app_event_type_allowed(app, type);
+}
+
+/*!
+ * \brief Snapshot members that snapshot update events are about
+ *
+ * Compact events keep these as well as the id of the snapshot.
+ */
+static const struct {
+	const char *type;
+	const char *member;
+} compact_members[] = {
+	{ "ChannelStateChange", "state" },
+	{ "ChannelDialplan", "dialplan" },
+	{ "ChannelCallerId", "caller" },
+	{ "ChannelConnectedLine", "connected" },
+	{ "EndpointStateChange", "state" },
+};
+
+/*! \brief Events that introduce a snapshot, which are sent in full even when compact */
+static const char *compact_exempt[] = {
+	"StasisStart",
+	"ChannelCreated",
+	"BridgeCreated",
+};
+
+/*! \brief Whether an object in an event is a channel, bridge or endpoint snapshot */
+static int is_snapshot_object(struct ast_json *obj)
+{
+	if (ast_json_object_get(obj, "id")) {
+		return ast_json_object_get(obj, "dialplan") || ast_json_object_get(obj, "bridge_type");
+	}
+	return ast_json_object_get(obj, "resource") && ast_json_object_get(obj, "channel_ids");
+}
+
+/*!
+ * \internal
+ * \brief Reduce a snapshot to its id and the given member
+ *
+ * Endpoints are identified by their technology and resource.
+ */
+static struct ast_json *compact_snapshot(struct ast_json *snapshot, const char *member)
+{
+	static const char *channel_ids[] = { "id", };
+	static const char *endpoint_ids[] = { "technology", "resource", };
+	const char **ids = channel_ids;
+	size_t num_ids = ARRAY_LEN(channel_ids);
+	struct ast_json *compact;
+	struct ast_json *value;
+	size_t i;
+
+	if (!ast_json_object_get(snapshot, "id")) {
+		ids = endpoint_ids;
+		num_ids = ARRAY_LEN(endpoint_ids);
+	}
+
+	compact = ast_json_object_create();
+	if (!compact) {
+		return NULL;
+	}
+	for (i = 0; i < num_ids; ++i) {
+		value = ast_json_object_get(snapshot, ids[i]);
+		if (value && ast_json_object_set(compact, ids[i], ast_json_ref(value))) {
+			ast_json_unref(compact);
+			return NULL;
+		}
+	}
+	value = member ? ast_json_object_get(snapshot, member) : NULL;
+	if (value && ast_json_object_set(compact, member, ast_json_ref(value))) {
+		ast_json_unref(compact);
+		return NULL;
+	}
+
+	return compact;
+}
+
+/*!
+ * \internal
+ * \brief Copy an event, compacting its snapshots or leaving out omitted members
+ *
+ * The event itself is left alone, since its sender may still use it.
+ *
+ * \note Call with the application locked.
+ */
+static struct ast_json *app_event_project(struct stasis_app *app, struct ast_json *message)
+{
+	const char *type = ast_json_string_get(ast_json_object_get(message, "type"));
+	const char *member = NULL;
+	int compact = app->compact;
+	struct ast_json *projected;
+	struct ast_json_iter *iter;
+	size_t i;
+
+	for (i = 0; compact && type && i < ARRAY_LEN(compact_exempt); ++i) {
+		if (!strcmp(type, compact_exempt[i])) {
+			compact = 0;
+		}
+	}
+	for (i = 0; compact && type && i < ARRAY_LEN(compact_members); ++i) {
+		if (!strcmp(type, compact_members[i].type)) {
+			member = compact_members[i].member;
+			break;
+		}
+	}
+
+	projected = ast_json_copy(message);
+	if (!projected) {
+		return NULL;
+	}
+
+	for (iter = ast_json_object_iter(projected); iter; iter = ast_json_object_iter_next(projected, iter)) {
+		struct ast_json *value = ast_json_object_iter_value(iter);
+		struct ast_json *copy;
+
+		if (ast_json_typeof(value) != AST_JSON_OBJECT) {
+			continue;
+		}
+
+		if (compact && is_snapshot_object(value)) {
+			copy = compact_snapshot(value, member);
+		} else {
+			copy = ast_json_copy(value);
+		}
+		if (!copy) {
+			ast_json_unref(projected);
+			return NULL;
+		}
+		for (i = 0; i < ast_json_array_size(app->fields_omitted); ++i) {
+			ast_json_object_del(copy,
+				ast_json_string_get(ast_json_array_get(app->fields_omitted, i)));
+		}
+		ast_json_object_iter_set(projected, iter, copy);
+	}
+
+	return projected;
 }
 
 static void call_forwarded_handler(struct stasis_app *app, struct stasis_message *message)
@@ -332,6 +525,7 @@ static void sub_default_handler(void *data, struct stasis_subscription *sub,
 {
 	struct stasis_app *app = data;
 	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json *json_copy;
 
 	if (stasis_subscription_final_message(sub, message)) {
 		ao2_cleanup(app);
@@ -347,22 +541,41 @@ static void sub_default_handler(void *data, struct stasis_subscription *sub,
 		return;
 	}
 
-	app_send(app, json);
+	if (!app_event_wanted(app, ast_json_string_get(ast_json_object_get(json, "type")))) {
+		return;
+	}
+
+	/* The representation is shared and app handlers add to the message.
+	 * The copy is dropped once sent. */
+	ast_json_arena_begin();
+	json_copy = ast_json_deep_copy(json);
+	if (json_copy) {
+		app_send(app, json_copy);
+		ast_json_unref(json_copy);
+	}
+	ast_json_arena_end();
 }
 
 /*! \brief Typedef for callbacks that get called on channel snapshot updates */
 typedef struct ast_json *(*channel_snapshot_monitor)(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *old_snapshot,
 	struct ast_channel_snapshot *new_snapshot,
 	const struct timeval *tv);
 
 static struct ast_json *simple_channel_event(
+	struct stasis_app *app,
 	const char *type,
 	struct ast_channel_snapshot *snapshot,
 	const struct timeval *tv)
 {
-	struct ast_json *json_channel = ast_channel_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
+	struct ast_json *json_channel;
+
+	if (!app_event_wanted(app, type)) {
+		return NULL;
+	}
 
+	json_channel = ast_channel_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 	if (!json_channel) {
 		return NULL;
 	}
@@ -374,18 +587,25 @@ static struct ast_json *simple_channel_event(
 }
 
 static struct ast_json *channel_created_event(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *snapshot,
 	const struct timeval *tv)
 {
-	return simple_channel_event("ChannelCreated", snapshot, tv);
+	return simple_channel_event(app, "ChannelCreated", snapshot, tv);
 }
 
 static struct ast_json *channel_destroyed_event(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *snapshot,
 	const struct timeval *tv)
 {
-	struct ast_json *json_channel = ast_channel_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
+	struct ast_json *json_channel;
 
+	if (!app_event_wanted(app, "ChannelDestroyed")) {
+		return NULL;
+	}
+
+	json_channel = ast_channel_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 	if (!json_channel) {
 		return NULL;
 	}
@@ -399,14 +619,16 @@ static struct ast_json *channel_destroyed_event(
 }
 
 static struct ast_json *channel_state_change_event(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *snapshot,
 	const struct timeval *tv)
 {
-	return simple_channel_event("ChannelStateChange", snapshot, tv);
+	return simple_channel_event(app, "ChannelStateChange", snapshot, tv);
 }
 
 /*! \brief Handle channel state changes */
 static struct ast_json *channel_state(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *old_snapshot,
 	struct ast_channel_snapshot *new_snapshot,
 	const struct timeval *tv)
@@ -415,17 +637,18 @@ static struct ast_json *channel_state(
 		new_snapshot : old_snapshot;
 
 	if (!old_snapshot) {
-		return channel_created_event(snapshot, tv);
+		return channel_created_event(app, snapshot, tv);
 	} else if (!new_snapshot) {
-		return channel_destroyed_event(snapshot, tv);
+		return channel_destroyed_event(app, snapshot, tv);
 	} else if (old_snapshot->state != new_snapshot->state) {
-		return channel_state_change_event(snapshot, tv);
+		return channel_state_change_event(app, snapshot, tv);
 	}
 
 	return NULL;
 }
 
 static struct ast_json *channel_dialplan(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *old_snapshot,
 	struct ast_channel_snapshot *new_snapshot,
 	const struct timeval *tv)
@@ -446,6 +669,10 @@ static struct ast_json *channel_dialplan(
 		return NULL;
 	}
 
+	if (!app_event_wanted(app, "ChannelDialplan")) {
+		return NULL;
+	}
+
 	json_channel = ast_channel_snapshot_to_json(new_snapshot, stasis_app_get_sanitizer());
 	if (!json_channel) {
 		return NULL;
@@ -460,6 +687,7 @@ static struct ast_json *channel_dialplan(
 }
 
 static struct ast_json *channel_callerid(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *old_snapshot,
 	struct ast_channel_snapshot *new_snapshot,
 	const struct timeval *tv)
@@ -475,6 +703,10 @@ static struct ast_json *channel_callerid(
 		return NULL;
 	}
 
+	if (!app_event_wanted(app, "ChannelCallerId")) {
+		return NULL;
+	}
+
 	json_channel = ast_channel_snapshot_to_json(new_snapshot, stasis_app_get_sanitizer());
 	if (!json_channel) {
 		return NULL;
@@ -490,6 +722,7 @@ static struct ast_json *channel_callerid(
 }
 
 static struct ast_json *channel_connected_line(
+	struct stasis_app *app,
 	struct ast_channel_snapshot *old_snapshot,
 	struct ast_channel_snapshot *new_snapshot,
 	const struct timeval *tv)
@@ -505,6 +738,10 @@ static struct ast_json *channel_connected_line(
 		return NULL;
 	}
 
+	if (!app_event_wanted(app, "ChannelConnectedLine")) {
+		return NULL;
+	}
+
 	json_channel = ast_channel_snapshot_to_json(new_snapshot, stasis_app_get_sanitizer());
 	if (!json_channel) {
 		return NULL;
@@ -549,14 +786,17 @@ static void sub_channel_update_handler(void *data,
 		stasis_message_timestamp(update->new_snapshot) :
 		stasis_message_timestamp(message);
 
+	/* The events are dropped once sent */
+	ast_json_arena_begin();
 	for (i = 0; i < ARRAY_LEN(channel_monitors); ++i) {
 		RAII_VAR(struct ast_json *, msg, NULL, ast_json_unref);
 
-		msg = channel_monitors[i](old_snapshot, new_snapshot, tv);
+		msg = channel_monitors[i](app, old_snapshot, new_snapshot, tv);
 		if (msg) {
 			app_send(app, msg);
 		}
 	}
+	ast_json_arena_end();
 
 	if (!new_snapshot && old_snapshot) {
 		unsubscribe(app, "channel", old_snapshot->uniqueid, 1);
@@ -564,12 +804,18 @@ static void sub_channel_update_handler(void *data,
 }
 
 static struct ast_json *simple_endpoint_event(
+	struct stasis_app *app,
 	const char *type,
 	struct ast_endpoint_snapshot *snapshot,
 	const struct timeval *tv)
 {
-	struct ast_json *json_endpoint = ast_endpoint_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
+	struct ast_json *json_endpoint;
 
+	if (!app_event_wanted(app, type)) {
+		return NULL;
+	}
+
+	json_endpoint = ast_endpoint_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 	if (!json_endpoint) {
 		return NULL;
 	}
@@ -622,7 +868,7 @@ static void sub_endpoint_update_handler(void *data,
 	struct stasis_subscription *sub,
 	struct stasis_message *message)
 {
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json *json;
 	struct stasis_app *app = data;
 	struct stasis_cache_update *update;
 	struct ast_endpoint_snapshot *new_snapshot;
@@ -641,12 +887,13 @@ static void sub_endpoint_update_handler(void *data,
 	if (new_snapshot) {
 		tv = stasis_message_timestamp(update->new_snapshot);
 
-		json = simple_endpoint_event("EndpointStateChange", new_snapshot, tv);
-		if (!json) {
-			return;
+		ast_json_arena_begin();
+		json = simple_endpoint_event(app, "EndpointStateChange", new_snapshot, tv);
+		if (json) {
+			app_send(app, json);
+			ast_json_unref(json);
 		}
-
-		app_send(app, json);
+		ast_json_arena_end();
 	}
 
 	if (!new_snapshot && old_snapshot) {
@@ -655,11 +902,18 @@ static void sub_endpoint_update_handler(void *data,
 }
 
 static struct ast_json *simple_bridge_event(
+	struct stasis_app *app,
 	const char *type,
 	struct ast_bridge_snapshot *snapshot,
 	const struct timeval *tv)
 {
-	struct ast_json *json_bridge = ast_bridge_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
+	struct ast_json *json_bridge;
+
+	if (!app_event_wanted(app, type)) {
+		return NULL;
+	}
+
+	json_bridge = ast_bridge_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 	if (!json_bridge) {
 		return NULL;
 	}
@@ -674,7 +928,7 @@ static void sub_bridge_update_handler(void *data,
 	struct stasis_subscription *sub,
 	struct stasis_message *message)
 {
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json *json = NULL;
 	struct stasis_app *app = data;
 	struct stasis_cache_update *update;
 	struct ast_bridge_snapshot *new_snapshot;
@@ -693,15 +947,18 @@ static void sub_bridge_update_handler(void *data,
 		stasis_message_timestamp(update->new_snapshot) :
 		stasis_message_timestamp(message);
 
+	ast_json_arena_begin();
 	if (!new_snapshot) {
-		json = simple_bridge_event("BridgeDestroyed", old_snapshot, tv);
+		json = simple_bridge_event(app, "BridgeDestroyed", old_snapshot, tv);
 	} else if (!old_snapshot) {
-		json = simple_bridge_event("BridgeCreated", new_snapshot, tv);
+		json = simple_bridge_event(app, "BridgeCreated", new_snapshot, tv);
 	}
 
 	if (json) {
 		app_send(app, json);
+		ast_json_unref(json);
 	}
+	ast_json_arena_end();
 
 	if (!new_snapshot && old_snapshot) {
 		unsubscribe(app, "bridge", old_snapshot->uniqueid, 1);
@@ -876,8 +1133,9 @@ struct stasis_app *app_create(const char *name, stasis_app_cb handler, void *dat
 	res |= stasis_message_router_add(app->bridge_router,
 		ast_attended_transfer_type(), bridge_attended_transfer_handler, app);
 
-	res |= stasis_message_router_set_default(app->bridge_router,
-		bridge_default_handler, app);
+	/* The default route only needs to see the final message */
+	res |= stasis_message_router_set_formatters_default(app->bridge_router,
+		bridge_default_handler, app, STASIS_SUBSCRIPTION_FORMATTER_NONE);
 
 	if (res != 0) {
 		return NULL;
@@ -899,8 +1157,9 @@ struct stasis_app *app_create(const char *name, stasis_app_cb handler, void *dat
 	res |= stasis_message_router_add_cache_update(app->router,
 		ast_endpoint_snapshot_type(), sub_endpoint_update_handler, app);
 
-	res |= stasis_message_router_set_default(app->router,
-		sub_default_handler, app);
+	/* Dial messages have a JSON representation as well */
+	res |= stasis_message_router_set_formatters_default(app->router,
+		sub_default_handler, app, STASIS_SUBSCRIPTION_FORMATTER_JSON);
 
 	if (res != 0) {
 		return NULL;
@@ -930,10 +1189,21 @@ void app_send(struct stasis_app *app, struct ast_json *message)
 {
 	stasis_app_cb handler;
 	RAII_VAR(void *, data, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_json *, projected, NULL, ast_json_unref);
 
 	/* Copy off mutable state with lock held */
 	{
 		SCOPED_AO2LOCK(lock, app);
+		if (!app_event_type_allowed(app, ast_json_string_get(ast_json_object_get(message, "type")))) {
+			return;
+		}
+		if (app->fields_omitted || app->compact) {
+			projected = app_event_project(app, message);
+			if (!projected) {
+				return;
+			}
+			message = projected;
+		}
 		handler = app->handler;
 		if (app->data) {
 			ao2_ref(app->data, +1);
@@ -1069,6 +1339,121 @@ struct ast_json *app_to_json(const struct stasis_app *app)
 	return ast_json_ref(json);
 }
 
+/*! \brief Whether a list of event filters is a list of objects with a type */
+static int event_filters_valid(struct ast_json *filters)
+{
+	size_t i;
+
+	if (ast_json_typeof(filters) != AST_JSON_ARRAY) {
+		return 0;
+	}
+	for (i = 0; i < ast_json_array_size(filters); ++i) {
+		struct ast_json *filter = ast_json_array_get(filters, i);
+
+		if (ast_json_typeof(filter) != AST_JSON_OBJECT
+			|| !ast_json_string_get(ast_json_object_get(filter, "type"))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*! \brief Whether a list of omitted fields is a list of names */
+static int omitted_fields_valid(struct ast_json *fields)
+{
+	size_t i;
+
+	if (ast_json_typeof(fields) != AST_JSON_ARRAY) {
+		return 0;
+	}
+	for (i = 0; i < ast_json_array_size(fields); ++i) {
+		if (!ast_json_string_get(ast_json_array_get(fields, i))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+enum stasis_app_event_filter_res app_event_filter_set(struct stasis_app *app,
+	struct ast_json *filter)
+{
+	RAII_VAR(struct ast_json *, allowed, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, disallowed, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, omitted, NULL, ast_json_unref);
+	struct ast_json_iter *iter;
+
+	if (filter && ast_json_typeof(filter) != AST_JSON_OBJECT) {
+		return STASIS_AEF_BAD_FILTER;
+	}
+
+	for (iter = ast_json_object_iter(filter); iter; iter = ast_json_object_iter_next(filter, iter)) {
+		const char *key = ast_json_object_iter_key(iter);
+		struct ast_json *value = ast_json_object_iter_value(iter);
+		struct ast_json **dst;
+
+		if (!strcmp(key, "allowed") && event_filters_valid(value)) {
+			dst = &allowed;
+		} else if (!strcmp(key, "disallowed") && event_filters_valid(value)) {
+			dst = &disallowed;
+		} else if (!strcmp(key, "omitted") && omitted_fields_valid(value)) {
+			dst = &omitted;
+		} else {
+			ast_log(LOG_WARNING, "Stasis app '%s': invalid event filter member '%s'\n",
+				app->name, key);
+			return STASIS_AEF_BAD_FILTER;
+		}
+
+		*dst = ast_json_deep_copy(value);
+		if (!*dst) {
+			return STASIS_AEF_INTERNAL_ERROR;
+		}
+	}
+
+	/* Empty lists filter nothing, so are not kept */
+	if (!ast_json_array_size(allowed)) {
+		ast_json_unref(allowed);
+		allowed = NULL;
+	}
+	if (!ast_json_array_size(disallowed)) {
+		ast_json_unref(disallowed);
+		disallowed = NULL;
+	}
+	if (!ast_json_array_size(omitted)) {
+		ast_json_unref(omitted);
+		omitted = NULL;
+	}
+
+	ao2_lock(app);
+	SWAP(app->events_allowed, allowed);
+	SWAP(app->events_disallowed, disallowed);
+	SWAP(app->fields_omitted, omitted);
+	ao2_unlock(app);
+
+	return STASIS_AEF_OK;
+}
+
+void app_set_compact(struct stasis_app *app, int compact)
+{
+	SCOPED_AO2LOCK(lock, app);
+	app->compact = compact;
+}
+
+void app_event_filter_to_json(struct stasis_app *app, struct ast_json *json)
+{
+	SCOPED_AO2LOCK(lock, app);
+
+	if (!json) {
+		return;
+	}
+
+	ast_json_object_set(json, "events_allowed", app->events_allowed ?
+		ast_json_deep_copy(app->events_allowed) : ast_json_array_create());
+	ast_json_object_set(json, "events_disallowed", app->events_disallowed ?
+		ast_json_deep_copy(app->events_disallowed) : ast_json_array_create());
+	ast_json_object_set(json, "fields_omitted", app->fields_omitted ?
+		ast_json_deep_copy(app->fields_omitted) : ast_json_array_create());
+}
+
 int app_subscribe_channel(struct stasis_app *app, struct ast_channel *chan)
 {
 	struct app_forwards *forwards;
@@ -129,6 +129,32 @@ struct app_forwards;
 
 struct ast_json *app_to_json(const struct stasis_app *app);
 
+/*!
+ * \brief Replace the event filter of an application.
+ *
+ * \param app Application.
+ * \param filter The filter, as described for stasis_app_event_filter_set().
+ * \return \ref stasis_app_event_filter_res return code.
+ */
+enum stasis_app_event_filter_res app_event_filter_set(struct stasis_app *app,
+	struct ast_json *filter);
+
+/*!
+ * \brief Set whether an application is sent compact events.
+ *
+ * \param app Application.
+ * \param compact Non-zero to reduce the snapshots in events to their ids.
+ */
+void app_set_compact(struct stasis_app *app, int compact);
+
+/*!
+ * \brief Add the event filter of an application to its JSON representation.
+ *
+ * \param app Application.
+ * \param json The JSON object from app_to_json().
+ */
+void app_event_filter_to_json(struct stasis_app *app, struct ast_json *json);
+
 /*!
  * \brief Subscribes an application to a channel.
  *
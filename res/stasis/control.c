@@ -1002,7 +1002,7 @@ void stasis_app_control_publish(
 	if (!control || !control->channel || !message) {
 		return;
 	}
-	stasis_publish(ast_channel_topic(control->channel), message);
+	ast_channel_publish_message(control->channel, message);
 }
 
 int stasis_app_control_queue_control(struct stasis_app_control *control,
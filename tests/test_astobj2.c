@@ -44,6 +44,7 @@ enum test_container_type {
 	TEST_CONTAINER_LIST,
 	TEST_CONTAINER_HASH,
 	TEST_CONTAINER_RBTREE,
+	TEST_CONTAINER_FLAT,
 };
 
 /*!
@@ -70,6 +71,9 @@ static const char *test_container2str(enum test_container_type type)
 	case TEST_CONTAINER_RBTREE:
 		c_type = "RBTree";
 		break;
+	case TEST_CONTAINER_FLAT:
+		c_type = "Flat";
+		break;
 	}
 	return c_type;
 }
@@ -457,6 +461,12 @@ static int astobj2_test_1_helper(int tst_num, enum test_container_type type, int
 		c1 = ao2_t_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
 			test_sort_cb, test_cmp_cb, "test");
 		break;
+	case TEST_CONTAINER_FLAT:
+		/* Flat containers grow their slot array as needed. */
+		n_buckets = 0;
+		c1 = ao2_t_container_alloc_flat(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 0,
+			test_hash_cb, use_sort ? test_sort_cb : NULL, test_cmp_cb, "test");
+		break;
 	}
 	c2 = ao2_t_container_alloc(1, NULL, NULL, "test");
 
@@ -686,6 +696,14 @@ AST_TEST_DEFINE(astobj2_test_1)
 		return res;
 	}
 
+	if ((res = astobj2_test_1_helper(5, TEST_CONTAINER_FLAT, 0, 1000, test)) == AST_TEST_FAIL) {
+		return res;
+	}
+
+	if ((res = astobj2_test_1_helper(6, TEST_CONTAINER_FLAT, 1, 1000, test)) == AST_TEST_FAIL) {
+		return res;
+	}
+
 	return res;
 }
 
@@ -983,6 +1001,10 @@ static struct ao2_container *test_make_nonsorted(enum test_container_type type,
 	case TEST_CONTAINER_RBTREE:
 		/* Container type must be sorted. */
 		break;
+	case TEST_CONTAINER_FLAT:
+		container = ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_MUTEX, options, 5,
+			test_hash_cb, NULL, test_cmp_cb);
+		break;
 	}
 
 	return container;
@@ -1017,6 +1039,10 @@ static struct ao2_container *test_make_sorted(enum test_container_type type, int
 		container = ao2_t_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_MUTEX, options,
 			test_sort_cb, test_cmp_cb, "test");
 		break;
+	case TEST_CONTAINER_FLAT:
+		container = ao2_t_container_alloc_flat(AO2_ALLOC_OPT_LOCK_MUTEX, options, 5,
+			test_hash_cb, test_sort_cb, test_cmp_cb, "test");
+		break;
 	}
 
 	return container;
@@ -1450,6 +1476,7 @@ static int test_traversal_nonsorted(int res, int tst_num, enum test_container_ty
 			"Iteration (descending, insert begin)", test);
 		break;
 	case TEST_CONTAINER_RBTREE:
+	case TEST_CONTAINER_FLAT:
 		break;
 	}
 
@@ -1486,6 +1513,7 @@ static int test_traversal_nonsorted(int res, int tst_num, enum test_container_ty
 			"Traversal (descending, insert begin)", test);
 		break;
 	case TEST_CONTAINER_RBTREE:
+	case TEST_CONTAINER_FLAT:
 		break;
 	}
 
@@ -1514,6 +1542,7 @@ static int test_traversal_nonsorted(int res, int tst_num, enum test_container_ty
 			"Traversal OBJ_PARTIAL_KEY (descending)", test);
 		break;
 	case TEST_CONTAINER_RBTREE:
+	case TEST_CONTAINER_FLAT:
 		break;
 	}
 
@@ -1669,6 +1698,9 @@ static int test_traversal_sorted(int res, int tst_num, enum test_container_type
 			test_hash_backward, ARRAY_LEN(test_hash_backward),
 			"Iteration (descending)", test);
 		break;
+	case TEST_CONTAINER_FLAT:
+		/* Flat containers do not keep their objects in any order. */
+		break;
 	}
 
 	/* Check container traversal directions */
@@ -1690,6 +1722,9 @@ static int test_traversal_sorted(int res, int tst_num, enum test_container_type
 			test_hash_backward, ARRAY_LEN(test_hash_backward),
 			"Traversal (descending)", test);
 		break;
+	case TEST_CONTAINER_FLAT:
+		/* Flat containers do not keep their objects in any order. */
+		break;
 	}
 
 	/* Check traversal with OBJ_PARTIAL_KEY search range. */
@@ -1717,6 +1752,9 @@ static int test_traversal_sorted(int res, int tst_num, enum test_container_type
 			test_hash_partial_backward, ARRAY_LEN(test_hash_partial_backward),
 			"Traversal OBJ_PARTIAL_KEY (descending)", test);
 		break;
+	case TEST_CONTAINER_FLAT:
+		/* Flat containers do not keep their objects in any order. */
+		break;
 	}
 
 	/* Add duplicates to initial containers that allow duplicates */
@@ -1924,6 +1962,552 @@ AST_TEST_DEFINE(astobj2_test_4)
 	return res;
 }
 
+/*!
+ * \internal
+ * \brief Check that every object with a key in the range can be found.
+ * \since 14.0.0
+ *
+ * \param c Container to search.
+ * \param first First key to find.
+ * \param last Last key to find.
+ *
+ * \return Number of objects found.
+ */
+static int test_resize_find_range(struct ao2_container *c, int first, int last)
+{
+	struct test_obj *obj;
+	int found = 0;
+	int i;
+
+	for (i = first; i <= last; ++i) {
+		obj = ao2_find(c, &i, OBJ_SEARCH_KEY);
+		if (obj) {
+			++found;
+			ao2_ref(obj, -1);
+		}
+	}
+	return found;
+}
+
+AST_TEST_DEFINE(astobj2_test_resize)
+{
+/*! \brief The number of objects linked into the container under test. */
+#define RESIZE_OBJS 2000
+	int res = AST_TEST_PASS;
+	struct ao2_container *c1;
+	struct ao2_iterator iter;
+	struct test_obj *obj;
+	int destructor_count = 0;
+	int count;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_resize";
+		info->category = "/main/astobj2/";
+		info->summary = "Test resizable hash containers";
+		info->description =
+			"Links and unlinks enough objects to make a resizable hash container "
+			"grow and shrink, checking that all objects can still be found while "
+			"the container is rehashed.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	c1 = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE | AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT, 7,
+		test_hash_cb, test_sort_cb, test_cmp_cb);
+	if (!c1) {
+		ast_test_status_update(test, "Container c1 creation failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < RESIZE_OBJS; ++i) {
+		obj = ao2_alloc(sizeof(struct test_obj), test_obj_destructor);
+		if (!obj) {
+			ast_test_status_update(test, "test object creation failed.\n");
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+		obj->destructor_count = &destructor_count;
+		obj->i = i;
+		if (ao2_link(c1, obj)) {
+			++destructor_count;
+		}
+		ao2_ref(obj, -1);
+
+		/* A duplicate key must be rejected even while rehashing. */
+		obj = ao2_alloc(sizeof(struct test_obj), test_obj_destructor);
+		if (!obj) {
+			ast_test_status_update(test, "test object creation failed.\n");
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+		obj->i = i / 2;
+		if (ao2_link(c1, obj)) {
+			ast_test_status_update(test, "Duplicate key %d was linked.\n", obj->i);
+			res = AST_TEST_FAIL;
+		}
+		ao2_ref(obj, -1);
+
+		if (!(i % 97) && test_resize_find_range(c1, 0, i) != i + 1) {
+			ast_test_status_update(test, "Objects lost while growing to %d objects.\n", i + 1);
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+	}
+	if (ao2_container_check(c1, 0)) {
+		ast_test_status_update(test, "container integrity check failed\n");
+		res = AST_TEST_FAIL;
+		goto test_cleanup;
+	}
+
+	/* Objects must not move under a positioned iterator. */
+	count = 0;
+	iter = ao2_iterator_init(c1, 0);
+	while ((obj = ao2_iterator_next(&iter))) {
+		++count;
+		if (count == RESIZE_OBJS / 2) {
+			for (i = 0; i < RESIZE_OBJS / 2; i += 2) {
+				ao2_find(c1, &i, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+			}
+		}
+		ao2_ref(obj, -1);
+	}
+	ao2_iterator_destroy(&iter);
+	if (count < RESIZE_OBJS / 2 || RESIZE_OBJS < count) {
+		ast_test_status_update(test, "Iterated over %d objects.\n", count);
+		res = AST_TEST_FAIL;
+	}
+
+	/* Shrink the container back down. */
+	for (i = 1; i < RESIZE_OBJS - 10; i += 2) {
+		ao2_find(c1, &i, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+	for (i = RESIZE_OBJS / 2; i < RESIZE_OBJS - 10; i += 2) {
+		ao2_find(c1, &i, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+	if (ao2_container_count(c1) != 10
+		|| test_resize_find_range(c1, RESIZE_OBJS - 10, RESIZE_OBJS - 1) != 10) {
+		ast_test_status_update(test, "Expected the last 10 objects to remain, found %d objects.\n",
+			ao2_container_count(c1));
+		res = AST_TEST_FAIL;
+	}
+	if (ao2_container_check(c1, 0)) {
+		ast_test_status_update(test, "container integrity check failed\n");
+		res = AST_TEST_FAIL;
+	}
+
+test_cleanup:
+	ao2_cleanup(c1);
+	if (destructor_count) {
+		ast_test_status_update(test,
+			"all destructors were not called, destructor count is %d\n",
+			destructor_count);
+		res = AST_TEST_FAIL;
+	}
+
+	return res;
+#undef RESIZE_OBJS
+}
+
+/*! \brief Shared state of the lockless search test threads. */
+struct lockless_search_state {
+	/*! Container under test. */
+	struct ao2_container *c1;
+	/*! Key of the object that stays linked during the whole test. */
+	int fixed_key;
+	/*! Set when the reader threads should stop. */
+	volatile int stop;
+	/*! Number of wrong or missing objects found by the readers. */
+	volatile int errors;
+	/*! Number of searches done by the readers. */
+	volatile int searches;
+};
+
+static void *lockless_search_reader(void *data)
+{
+	struct lockless_search_state *state = data;
+	struct test_obj *obj;
+	int key = 0;
+
+	while (!state->stop) {
+		key = (key + 1) % state->fixed_key;
+		obj = ao2_find(state->c1, &key, OBJ_SEARCH_KEY);
+		if (obj) {
+			if (obj->i != key) {
+				ast_atomic_fetchadd_int(&state->errors, 1);
+			}
+			ao2_ref(obj, -1);
+		}
+
+		obj = ao2_find(state->c1, &state->fixed_key, OBJ_SEARCH_KEY);
+		if (!obj || obj->i != state->fixed_key) {
+			ast_atomic_fetchadd_int(&state->errors, 1);
+		}
+		ao2_cleanup(obj);
+		ast_atomic_fetchadd_int(&state->searches, 1);
+	}
+	return NULL;
+}
+
+AST_TEST_DEFINE(astobj2_test_lockless)
+{
+/*! \brief The number of objects linked and unlinked in each round. */
+#define LOCKLESS_OBJS 500
+/*! \brief The number of reader threads. */
+#define LOCKLESS_READERS 4
+	int res = AST_TEST_PASS;
+	struct lockless_search_state state = { .fixed_key = LOCKLESS_OBJS, };
+	pthread_t readers[LOCKLESS_READERS];
+	int started = 0;
+	struct test_obj *obj;
+	int round;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_lockless";
+		info->category = "/main/astobj2/";
+		info->summary = "Test lockless searches of hash containers";
+		info->description =
+			"Searches a hash container from several threads without locking it "
+			"while objects are linked and unlinked and the container is rehashed, "
+			"checking that the right objects are always found.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	state.c1 = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE | AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND, 7,
+		test_hash_cb, test_sort_cb, test_cmp_cb);
+	if (!state.c1) {
+		ast_test_status_update(test, "Container c1 creation failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	obj = ao2_alloc(sizeof(struct test_obj), NULL);
+	if (!obj) {
+		ast_test_status_update(test, "test object creation failed.\n");
+		res = AST_TEST_FAIL;
+		goto test_cleanup;
+	}
+	obj->i = state.fixed_key;
+	ao2_link(state.c1, obj);
+	ao2_ref(obj, -1);
+
+	for (; started < LOCKLESS_READERS; ++started) {
+		if (ast_pthread_create(&readers[started], NULL, lockless_search_reader, &state)) {
+			ast_test_status_update(test, "Reader thread creation failed.\n");
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+	}
+
+	for (round = 0; round < 20; ++round) {
+		for (i = 0; i < LOCKLESS_OBJS; ++i) {
+			obj = ao2_alloc(sizeof(struct test_obj), NULL);
+			if (!obj) {
+				ast_test_status_update(test, "test object creation failed.\n");
+				res = AST_TEST_FAIL;
+				goto test_cleanup;
+			}
+			obj->i = i;
+			ao2_link(state.c1, obj);
+			ao2_ref(obj, -1);
+		}
+		for (i = 0; i < LOCKLESS_OBJS; ++i) {
+			ao2_find(state.c1, &i, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+		}
+	}
+
+test_cleanup:
+	state.stop = 1;
+	while (started--) {
+		pthread_join(readers[started], NULL);
+	}
+	if (state.errors) {
+		ast_test_status_update(test, "Readers found %d wrong objects in %d searches.\n",
+			state.errors, state.searches);
+		res = AST_TEST_FAIL;
+	}
+	if (res == AST_TEST_PASS
+		&& (ao2_container_count(state.c1) != 1 || ao2_container_check(state.c1, 0))) {
+		ast_test_status_update(test, "container integrity check failed\n");
+		res = AST_TEST_FAIL;
+	}
+	ao2_cleanup(state.c1);
+
+	return res;
+#undef LOCKLESS_READERS
+#undef LOCKLESS_OBJS
+}
+
+AST_TEST_DEFINE(astobj2_test_swap)
+{
+/*! \brief The number of objects in each population of the container. */
+#define SWAP_OBJS 500
+/*! \brief The number of reader threads. */
+#define SWAP_READERS 4
+	int res = AST_TEST_PASS;
+	struct lockless_search_state state = { .fixed_key = SWAP_OBJS, };
+	pthread_t readers[SWAP_READERS];
+	struct test_obj *objs[SWAP_OBJS + 1];
+	struct ao2_container *staging = NULL;
+	struct ao2_iterator iter;
+	struct test_obj *obj;
+	int started = 0;
+	int round;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_swap";
+		info->category = "/main/astobj2/";
+		info->summary = "Test bulk linking and swapping container contents";
+		info->description =
+			"Replaces the whole population of a hash container with objects "
+			"bulk linked into a private container while other threads search it, "
+			"checking that the searches never miss an object.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	state.c1 = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_LOCKLESS_FIND, 17,
+		test_hash_cb, test_sort_cb, test_cmp_cb);
+	if (!state.c1) {
+		ast_test_status_update(test, "Container c1 creation failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	obj = ao2_alloc(sizeof(struct test_obj), NULL);
+	if (!obj) {
+		ast_test_status_update(test, "test object creation failed.\n");
+		res = AST_TEST_FAIL;
+		goto test_cleanup;
+	}
+	obj->i = state.fixed_key;
+	ao2_link(state.c1, obj);
+	ao2_ref(obj, -1);
+
+	for (; started < SWAP_READERS; ++started) {
+		if (ast_pthread_create(&readers[started], NULL, lockless_search_reader, &state)) {
+			ast_test_status_update(test, "Reader thread creation failed.\n");
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+	}
+
+	for (round = 1; round <= 20; ++round) {
+		staging = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, 17,
+			test_hash_cb, test_sort_cb, test_cmp_cb);
+		if (!staging) {
+			ast_test_status_update(test, "Container staging creation failed.\n");
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+		for (i = 0; i <= SWAP_OBJS; ++i) {
+			objs[i] = ao2_alloc(sizeof(struct test_obj), NULL);
+			if (!objs[i]) {
+				break;
+			}
+			objs[i]->i = i;
+			objs[i]->dup_number = round;
+		}
+		if (i <= SWAP_OBJS
+			|| ao2_container_link_bulk(staging, (void * const *) objs, SWAP_OBJS + 1, 0) != SWAP_OBJS + 1) {
+			ast_test_status_update(test, "Bulk link of round %d failed.\n", round);
+			res = AST_TEST_FAIL;
+		}
+		while (i--) {
+			ao2_ref(objs[i], -1);
+		}
+		if (res == AST_TEST_FAIL) {
+			goto test_cleanup;
+		}
+
+		if (ao2_container_swap_contents(state.c1, staging, 0)) {
+			ast_test_status_update(test, "Swap of round %d failed.\n", round);
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+		if (ao2_container_count(staging) != (round == 1 ? 1 : SWAP_OBJS + 1)) {
+			ast_test_status_update(test, "Staging container did not get the old objects.\n");
+			res = AST_TEST_FAIL;
+			goto test_cleanup;
+		}
+		ao2_ref(staging, -1);
+		staging = NULL;
+	}
+
+	/* Only the last population must be left. */
+	iter = ao2_iterator_init(state.c1, 0);
+	for (i = 0; (obj = ao2_iterator_next(&iter)); ++i) {
+		if (obj->dup_number != round - 1) {
+			res = AST_TEST_FAIL;
+		}
+		ao2_ref(obj, -1);
+	}
+	ao2_iterator_destroy(&iter);
+	if (i != SWAP_OBJS + 1 || res == AST_TEST_FAIL) {
+		ast_test_status_update(test, "Container does not hold the last population.\n");
+		res = AST_TEST_FAIL;
+	}
+
+test_cleanup:
+	state.stop = 1;
+	while (started--) {
+		pthread_join(readers[started], NULL);
+	}
+	if (state.errors) {
+		ast_test_status_update(test, "Readers found %d wrong objects in %d searches.\n",
+			state.errors, state.searches);
+		res = AST_TEST_FAIL;
+	}
+	if (res == AST_TEST_PASS && ao2_container_check(state.c1, 0)) {
+		ast_test_status_update(test, "container integrity check failed\n");
+		res = AST_TEST_FAIL;
+	}
+	ao2_cleanup(staging);
+	ao2_cleanup(state.c1);
+
+	return res;
+#undef SWAP_READERS
+#undef SWAP_OBJS
+}
+
+/*! \brief Shared state of the striped container test threads. */
+struct striped_state {
+	/*! Container under test. */
+	struct ao2_container *c1;
+	/*! Number of wrong or missing objects found. */
+	volatile int errors;
+};
+
+/*! \brief Arguments of a striped container test writer thread. */
+struct striped_writer {
+	/*! Shared test state. */
+	struct striped_state *state;
+	/*! First key of the objects linked by the thread. */
+	int first;
+	/*! Number of objects linked by the thread. */
+	int count;
+	/*! Thread linking and unlinking the objects. */
+	pthread_t thread;
+};
+
+static void *striped_writer_thread(void *data)
+{
+	struct striped_writer *writer = data;
+	struct ao2_container *c1 = writer->state->c1;
+	struct test_obj *obj;
+	int round;
+	int key;
+
+	for (round = 0; round < 20; ++round) {
+		for (key = writer->first; key < writer->first + writer->count; ++key) {
+			obj = ao2_alloc(sizeof(struct test_obj), NULL);
+			if (!obj) {
+				ast_atomic_fetchadd_int(&writer->state->errors, 1);
+				return NULL;
+			}
+			obj->i = key;
+			ao2_link(c1, obj);
+			ao2_ref(obj, -1);
+		}
+		for (key = writer->first; key < writer->first + writer->count; ++key) {
+			obj = ao2_find(c1, &key, OBJ_SEARCH_KEY | OBJ_UNLINK);
+			if (!obj || obj->i != key) {
+				ast_atomic_fetchadd_int(&writer->state->errors, 1);
+			}
+			ao2_cleanup(obj);
+		}
+	}
+	return NULL;
+}
+
+AST_TEST_DEFINE(astobj2_test_striped)
+{
+/*! \brief The number of objects linked and unlinked by each writer thread. */
+#define STRIPED_OBJS 500
+/*! \brief The number of writer threads. */
+#define STRIPED_WRITERS 4
+	int res = AST_TEST_PASS;
+	struct striped_state state = { 0, };
+	struct striped_writer writers[STRIPED_WRITERS];
+	struct ao2_iterator iter;
+	struct test_obj *obj;
+	int started = 0;
+	int count;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_striped";
+		info->category = "/main/astobj2/";
+		info->summary = "Test striped hash containers";
+		info->description =
+			"Links and unlinks objects from several threads while another "
+			"iterates over the container, checking that every object linked "
+			"can be found and that the container stays intact.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	state.c1 = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE | AO2_CONTAINER_ALLOC_OPT_HASH_LOCK_STRIPED, 7,
+		test_hash_cb, NULL, test_cmp_cb);
+	if (!state.c1) {
+		ast_test_status_update(test, "Container c1 creation failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (; started < STRIPED_WRITERS; ++started) {
+		writers[started].state = &state;
+		writers[started].first = started * STRIPED_OBJS;
+		writers[started].count = STRIPED_OBJS;
+		if (ast_pthread_create(&writers[started].thread, NULL, striped_writer_thread,
+			&writers[started])) {
+			ast_test_status_update(test, "Writer thread creation failed.\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+
+	/* Traversals lock every stripe while the writers run. */
+	for (count = 0; count < 50; ++count) {
+		iter = ao2_iterator_init(state.c1, 0);
+		while ((obj = ao2_iterator_next(&iter))) {
+			if (obj->i < 0 || STRIPED_WRITERS * STRIPED_OBJS <= obj->i) {
+				ast_atomic_fetchadd_int(&state.errors, 1);
+			}
+			ao2_ref(obj, -1);
+		}
+		ao2_iterator_destroy(&iter);
+	}
+
+	while (started--) {
+		pthread_join(writers[started].thread, NULL);
+	}
+	if (state.errors) {
+		ast_test_status_update(test, "Found %d wrong or missing objects.\n", state.errors);
+		res = AST_TEST_FAIL;
+	}
+	if (ao2_container_count(state.c1) || ao2_container_check(state.c1, 0)) {
+		ast_test_status_update(test, "container integrity check failed\n");
+		res = AST_TEST_FAIL;
+	}
+	ao2_cleanup(state.c1);
+
+	return res;
+#undef STRIPED_WRITERS
+#undef STRIPED_OBJS
+}
+
 static enum ast_test_result_state test_performance(struct ast_test *test,
 	enum test_container_type type, unsigned int copt)
 {
@@ -1950,6 +2534,10 @@ static enum ast_test_result_state test_performance(struct ast_test *test,
 		c1 = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_MUTEX, copt,
 			test_sort_cb, test_cmp_cb);
 		break;
+	case TEST_CONTAINER_FLAT:
+		c1 = ao2_container_alloc_flat(AO2_ALLOC_OPT_LOCK_MUTEX, copt, 17,
+			test_hash_cb, test_sort_cb, test_cmp_cb);
+		break;
 	}
 
 	for (i = 0; i < OBJS; i++) {
@@ -2007,6 +2595,73 @@ static enum ast_test_result_state testloop(struct ast_test *test,
 	return res;
 }
 
+AST_TEST_DEFINE(astobj2_test_pool)
+{
+/*! \brief The number of objects allocated of each size. */
+#define POOL_OBJS 100
+	int res = AST_TEST_PASS;
+	static const size_t sizes[] = { 1, 24, 100, 300, 1000, };
+	static const enum ao2_alloc_opts opts[] = {
+		AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_ALLOC_OPT_LOCK_RWLOCK,
+		AO2_ALLOC_OPT_LOCK_NOLOCK,
+	};
+	unsigned char *objs[POOL_OBJS];
+	int opt;
+	int size;
+	int pass;
+	int i;
+	int j;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_pool";
+		info->category = "/main/astobj2/";
+		info->summary = "Test reuse of released object memory";
+		info->description =
+			"Allocates and releases objects of several sizes and lock types "
+			"repeatedly, checking that every object is zeroed and that its "
+			"lock works when the memory of a released object is reused.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (opt = 0; opt < ARRAY_LEN(opts); ++opt) {
+		for (size = 0; size < ARRAY_LEN(sizes); ++size) {
+			for (pass = 0; pass < 3 && res == AST_TEST_PASS; ++pass) {
+				memset(objs, 0, sizeof(objs));
+				for (i = 0; i < POOL_OBJS; ++i) {
+					objs[i] = ao2_alloc_options(sizes[size], NULL, opts[opt]);
+					if (!objs[i]) {
+						ast_test_status_update(test, "Object allocation failed.\n");
+						res = AST_TEST_FAIL;
+						break;
+					}
+					for (j = 0; j < sizes[size]; ++j) {
+						if (objs[i][j]) {
+							ast_test_status_update(test, "Object of size %d is not zeroed.\n",
+								(int) sizes[size]);
+							res = AST_TEST_FAIL;
+							break;
+						}
+					}
+					/* Dirty the object so reusing its memory has to clear it. */
+					memset(objs[i], 0xa5, sizes[size]);
+					ao2_lock(objs[i]);
+					ao2_unlock(objs[i]);
+				}
+				for (i = 0; i < POOL_OBJS; ++i) {
+					ao2_cleanup(objs[i]);
+				}
+			}
+		}
+	}
+
+	return res;
+#undef POOL_OBJS
+}
+
 AST_TEST_DEFINE(astobj2_test_perf)
 {
 /*!
@@ -2044,6 +2699,10 @@ AST_TEST_DEFINE(astobj2_test_perf)
 		return res;
 	}
 	res = testloop(test, TEST_CONTAINER_RBTREE, 0, ITERATIONS);
+	if (!res) {
+		return res;
+	}
+	res = testloop(test, TEST_CONTAINER_FLAT, 0, ITERATIONS);
 
 	return res;
 }
@@ -2054,6 +2713,11 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(astobj2_test_2);
 	AST_TEST_UNREGISTER(astobj2_test_3);
 	AST_TEST_UNREGISTER(astobj2_test_4);
+	AST_TEST_UNREGISTER(astobj2_test_resize);
+	AST_TEST_UNREGISTER(astobj2_test_lockless);
+	AST_TEST_UNREGISTER(astobj2_test_swap);
+	AST_TEST_UNREGISTER(astobj2_test_striped);
+	AST_TEST_UNREGISTER(astobj2_test_pool);
 	AST_TEST_UNREGISTER(astobj2_test_perf);
 	return 0;
 }
@@ -2064,6 +2728,11 @@ static int load_module(void)
 	AST_TEST_REGISTER(astobj2_test_2);
 	AST_TEST_REGISTER(astobj2_test_3);
 	AST_TEST_REGISTER(astobj2_test_4);
+	AST_TEST_REGISTER(astobj2_test_resize);
+	AST_TEST_REGISTER(astobj2_test_lockless);
+	AST_TEST_REGISTER(astobj2_test_swap);
+	AST_TEST_REGISTER(astobj2_test_striped);
+	AST_TEST_REGISTER(astobj2_test_pool);
 	AST_TEST_REGISTER(astobj2_test_perf);
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -0,0 +1,232 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief ao2 container benchmarks.
+ *
+ * Measures finding objects by key in hash and red-black tree containers,
+ * and linking and unlinking them.
+ *
+ * Run with 'bench execute category /bench/astobj2/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/astobj2.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/astobj2/";
+
+/*! Number of objects in each container */
+#define BENCH_OBJECTS 10000
+/*! Number of buckets of the hash containers */
+#define BENCH_BUCKETS 1021
+
+struct bench_obj {
+	int key;
+};
+
+/*! \brief A container, and objects for it */
+struct bench_container {
+	struct ao2_container *container;
+	/*! The objects, those after BENCH_OBJECTS not linked in to start with */
+	struct bench_obj *objs[BENCH_OBJECTS * 2];
+};
+
+static int bench_obj_hash(const void *obj, const int flags)
+{
+	const struct bench_obj *object = obj;
+	const int *key = obj;
+
+	return (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? *key : object->key;
+}
+
+static int bench_obj_sort(const void *obj_left, const void *obj_right, int flags)
+{
+	const struct bench_obj *left = obj_left;
+	const struct bench_obj *right = obj_right;
+	int right_key = (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY
+		? *(const int *) obj_right : right->key;
+
+	return left->key < right_key ? -1 : left->key > right_key;
+}
+
+static int bench_obj_cmp(void *obj, void *arg, int flags)
+{
+	return bench_obj_sort(obj, arg, flags) ? 0 : CMP_MATCH;
+}
+
+static void bench_container_teardown(void *data)
+{
+	struct bench_container *bench = data;
+	int i;
+
+	ao2_cleanup(bench->container);
+	for (i = 0; i < ARRAY_LEN(bench->objs); ++i) {
+		ao2_cleanup(bench->objs[i]);
+	}
+	ast_free(bench);
+}
+
+/*!
+ * \internal
+ * \brief Fill a container with the first BENCH_OBJECTS objects
+ *
+ * \param test The benchmark
+ * \param data Set to the struct bench_container
+ * \param container The container, which this steals
+ */
+static int bench_container_fill(struct ast_test *test, void **data, struct ao2_container *container)
+{
+	struct bench_container *bench;
+	int i;
+
+	if (!container || !(bench = ast_calloc(1, sizeof(*bench)))) {
+		ao2_cleanup(container);
+		return -1;
+	}
+	bench->container = container;
+
+	for (i = 0; i < ARRAY_LEN(bench->objs); ++i) {
+		bench->objs[i] = ao2_alloc_options(sizeof(*bench->objs[i]), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!bench->objs[i]) {
+			bench_container_teardown(bench);
+			return -1;
+		}
+		bench->objs[i]->key = i;
+		if (i < BENCH_OBJECTS && !ao2_link(container, bench->objs[i])) {
+			ast_test_status_update(test, "Failed to link object %d\n", i);
+			bench_container_teardown(bench);
+			return -1;
+		}
+	}
+
+	*data = bench;
+	return 0;
+}
+
+static int hash_setup(struct ast_test *test, void **data)
+{
+	return bench_container_fill(test, data,
+		ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, BENCH_BUCKETS,
+			bench_obj_hash, NULL, bench_obj_cmp));
+}
+
+static int rbtree_setup(struct ast_test *test, void **data)
+{
+	return bench_container_fill(test, data,
+		ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+			bench_obj_sort, bench_obj_cmp));
+}
+
+static int find_op(void *data, unsigned int iteration)
+{
+	struct bench_container *bench = data;
+	/* Spread the keys so neighbouring lookups do not share buckets */
+	int key = (iteration * 7919) % BENCH_OBJECTS;
+	struct bench_obj *obj;
+
+	obj = ao2_find(bench->container, &key, OBJ_SEARCH_KEY);
+	if (!obj) {
+		return -1;
+	}
+	ao2_ref(obj, -1);
+	return 0;
+}
+
+static int link_unlink_op(void *data, unsigned int iteration)
+{
+	struct bench_container *bench = data;
+	struct bench_obj *obj = bench->objs[BENCH_OBJECTS + iteration % BENCH_OBJECTS];
+
+	if (!ao2_link(bench->container, obj)) {
+		return -1;
+	}
+	ao2_unlink(bench->container, obj);
+	return 0;
+}
+
+AST_BENCH_DEFINE(hash_find)
+{
+	bench->name = "hash_find";
+	bench->category = test_category;
+	bench->summary = "Find objects by key in a hash container";
+	bench->description = "Find objects by key in a hash container of\n"
+		"10000 objects in 1021 buckets.";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->setup = hash_setup;
+	bench->op = find_op;
+	bench->teardown = bench_container_teardown;
+}
+
+AST_BENCH_DEFINE(rbtree_find)
+{
+	bench->name = "rbtree_find";
+	bench->category = test_category;
+	bench->summary = "Find objects by key in a red-black tree container";
+	bench->description = "Find objects by key in a red-black tree container\n"
+		"of 10000 objects.";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->setup = rbtree_setup;
+	bench->op = find_op;
+	bench->teardown = bench_container_teardown;
+}
+
+AST_BENCH_DEFINE(hash_link_unlink)
+{
+	bench->name = "hash_link_unlink";
+	bench->category = test_category;
+	bench->summary = "Link and unlink objects in a hash container";
+	bench->description = "Link an object to a hash container of 10000\n"
+		"objects in 1021 buckets, and unlink it again.";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->setup = hash_setup;
+	bench->op = link_unlink_op;
+	bench->teardown = bench_container_teardown;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(hash_find);
+	AST_TEST_UNREGISTER(rbtree_find);
+	AST_TEST_UNREGISTER(hash_link_unlink);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(hash_find);
+	AST_TEST_REGISTER(rbtree_find);
+	AST_TEST_REGISTER(hash_link_unlink);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "ao2 container benchmarks");
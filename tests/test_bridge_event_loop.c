@@ -0,0 +1,257 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Bridge event loop unit tests
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/channel.h"
+#include "asterisk/time.h"
+#include "asterisk/bridge.h"
+#include "asterisk/bridge_basic.h"
+#include "asterisk/format_cache.h"
+
+#define TEST_CATEGORY "/main/bridge/event_loop/"
+
+#define CHANNEL_TECH_NAME "EventLoopTestChannel"
+
+/*! \brief Longest time in milliseconds a test waits for a channel */
+#define TEST_WAIT_MS 5000
+
+AST_MUTEX_DEFINE_STATIC(written_lock);
+static ast_cond_t written_cond;
+
+/*! \brief Number of voice frames written to the test channels */
+static int written;
+
+static int test_chan_write(struct ast_channel *chan, struct ast_frame *frame)
+{
+	if (frame->frametype == AST_FRAME_VOICE) {
+		ast_mutex_lock(&written_lock);
+		++written;
+		ast_cond_signal(&written_cond);
+		ast_mutex_unlock(&written_lock);
+	}
+	return 0;
+}
+
+/*! \brief A channel technology used for the unit tests */
+static struct ast_channel_tech test_event_loop_chan_tech = {
+	.type = CHANNEL_TECH_NAME,
+	.description = "Mock channel technology for bridge event loop tests",
+	.write = test_chan_write,
+};
+
+static struct ast_channel *test_channel_alloc(const char *name)
+{
+	struct ast_channel *chan;
+	struct ast_format_cap *caps;
+
+	if (!(caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
+		return NULL;
+	}
+	ast_format_cap_append(caps, ast_format_ulaw, 0);
+
+	chan = ast_channel_alloc(0, AST_STATE_UP, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+		0, CHANNEL_TECH_NAME "/%s", name);
+	if (chan) {
+		ast_channel_tech_set(chan, &test_event_loop_chan_tech);
+		ast_channel_nativeformats_set(chan, caps);
+		ast_channel_set_writeformat(chan, ast_format_ulaw);
+		ast_channel_set_rawwriteformat(chan, ast_format_ulaw);
+		ast_channel_set_readformat(chan, ast_format_ulaw);
+		ast_channel_set_rawreadformat(chan, ast_format_ulaw);
+		ast_channel_unlock(chan);
+	}
+	ao2_ref(caps, -1);
+
+	return chan;
+}
+
+/*!
+ * \brief Wait until a channel is in a bridge or not
+ *
+ * \retval 0 on success
+ * \retval -1 if the channel did not get there in time
+ */
+static int wait_for_bridged(struct ast_channel *chan, int bridged)
+{
+	struct timeval start = ast_tvnow();
+
+	for (;;) {
+		int res;
+
+		ast_channel_lock(chan);
+		res = !ast_channel_is_bridged(chan) == !bridged;
+		ast_channel_unlock(chan);
+		if (res) {
+			return 0;
+		}
+		if (ast_tvdiff_ms(ast_tvnow(), start) > TEST_WAIT_MS) {
+			return -1;
+		}
+		usleep(1000);
+	}
+}
+
+/*!
+ * \brief Wait until a voice frame was written to a test channel
+ *
+ * \retval 0 on success
+ * \retval -1 if none was written in time
+ */
+static int wait_for_written(void)
+{
+	struct timeval wait = ast_tvadd(ast_tvnow(), ast_samp2tv(TEST_WAIT_MS, 1000));
+	struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000, };
+	int res = 0;
+
+	ast_mutex_lock(&written_lock);
+	while (!written && !res) {
+		if (ast_cond_timedwait(&written_cond, &written_lock, &ts) == ETIMEDOUT) {
+			res = -1;
+		}
+	}
+	ast_mutex_unlock(&written_lock);
+
+	return res;
+}
+
+static void safe_bridge_destroy(struct ast_bridge *bridge)
+{
+	if (bridge) {
+		ast_bridge_destroy(bridge, 0);
+	}
+}
+
+AST_TEST_DEFINE(event_loop_media_and_leave)
+{
+	RAII_VAR(struct ast_bridge *, bridge, NULL, safe_bridge_destroy);
+	RAII_VAR(struct ast_channel *, alice, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel *, bob, NULL, ao2_cleanup);
+	unsigned char data[160] = { 0xff, };
+	struct ast_frame voice = {
+		.frametype = AST_FRAME_VOICE,
+		.datalen = sizeof(data),
+		.samples = sizeof(data),
+		.data.ptr = data,
+		.src = __func__,
+	};
+	enum ast_bridge_impart_flags flags = AST_BRIDGE_IMPART_CHAN_INDEPENDENT | AST_BRIDGE_IMPART_EVENT_LOOP;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test channels serviced by a bridge event loop";
+		info->description =
+			"This test imparts two channels into a bridge with event loops\n"
+			"servicing them, and verifies that media passes between them.\n"
+			"It then sets an absolute timeout on one, which needs a thread of\n"
+			"its own, and verifies that both channels leave the bridge.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	written = 0;
+	voice.subclass.format = ast_format_ulaw;
+
+	bridge = ast_bridge_basic_new();
+	ast_test_validate(test, bridge != NULL);
+
+	alice = test_channel_alloc("Alice");
+	ast_test_validate(test, alice != NULL);
+	bob = test_channel_alloc("Bob");
+	ast_test_validate(test, bob != NULL);
+
+	/* The bridge hangs up independent channels when they leave, keep them for the test */
+	ao2_ref(alice, +1);
+	if (ast_bridge_impart(bridge, alice, NULL, NULL, flags)) {
+		ao2_ref(alice, -1);
+		ast_test_status_update(test, "Could not impart Alice\n");
+		return AST_TEST_FAIL;
+	}
+	ao2_ref(bob, +1);
+	if (ast_bridge_impart(bridge, bob, NULL, NULL, flags)) {
+		ao2_ref(bob, -1);
+		ast_test_status_update(test, "Could not impart Bob\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_test_validate(test, !wait_for_bridged(alice, 1));
+	ast_test_validate(test, !wait_for_bridged(bob, 1));
+
+	/* Media goes through the event loops */
+	ast_queue_frame(alice, &voice);
+	if (wait_for_written()) {
+		ast_test_status_update(test, "Voice frame from Alice never reached Bob\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* An absolute timeout takes Alice out of the event loop */
+	ast_channel_lock(alice);
+	ast_channel_setwhentohangup_tv(alice, ast_tv(0, 100000));
+	ast_channel_unlock(alice);
+	if (wait_for_bridged(alice, 0)) {
+		ast_test_status_update(test, "Alice did not leave the bridge on the timeout\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* Bob leaves with the bridge, or is removed if it stays around */
+	ast_bridge_remove(bridge, bob);
+	if (wait_for_bridged(bob, 0)) {
+		ast_test_status_update(test, "Bob did not leave the bridge\n");
+		return AST_TEST_FAIL;
+	}
+
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(event_loop_media_and_leave);
+
+	ast_channel_unregister(&test_event_loop_chan_tech);
+	ast_cond_destroy(&written_cond);
+
+	return 0;
+}
+
+static int load_module(void)
+{
+	ast_cond_init(&written_cond, NULL);
+	ast_channel_register(&test_event_loop_chan_tech);
+
+	AST_TEST_REGISTER(event_loop_media_and_leave);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Bridge Event Loop Unit Tests");
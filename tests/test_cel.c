@@ -1668,8 +1668,8 @@ AST_TEST_DEFINE(test_cel_local_optimize)
 	local_opt_end = stasis_message_create(ast_local_optimization_end_type(), mc_blob);
 	ast_test_validate(test, local_opt_end != NULL);
 
-	stasis_publish(ast_channel_topic(chan_alice), local_opt_begin);
-	stasis_publish(ast_channel_topic(chan_alice), local_opt_end);
+	ast_channel_publish_message(chan_alice, local_opt_begin);
+	ast_channel_publish_message(chan_alice, local_opt_end);
 
 	extra = ast_json_pack("{s: s, s: s}", "local_two", bob_snapshot->name,
 		"local_two_uniqueid", bob_snapshot->uniqueid);
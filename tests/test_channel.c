@@ -0,0 +1,680 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Channel lookup and storage unit tests
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include <unistd.h>
+
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/channel.h"
+#include "asterisk/datastore.h"
+#include "asterisk/framehook.h"
+#include "asterisk/pbx.h"
+
+#define TEST_CATEGORY "/main/channel/"
+
+#define TEST_CHANNEL_PREFIX "ChannelLookupTest/"
+
+/*! \brief Allocate a test channel that is not locked */
+static struct ast_channel *test_channel_alloc(const char *name, const char *exten,
+	const char *context, const struct ast_channel *requestor)
+{
+	struct ast_channel *chan;
+
+	chan = ast_channel_alloc(0, AST_STATE_DOWN, NULL, NULL, NULL, exten, context,
+		NULL, requestor, 0, TEST_CHANNEL_PREFIX "%s", name);
+	if (chan) {
+		ast_channel_unlock(chan);
+	}
+	return chan;
+}
+
+static void safe_channel_release(struct ast_channel *chan)
+{
+	if (!chan) {
+		return;
+	}
+	ast_channel_release(chan);
+}
+
+/*! \brief Count the channels of an iterator, and destroy it */
+static int iterator_count(struct ast_channel_iterator *iter)
+{
+	struct ast_channel *chan;
+	int count = 0;
+
+	if (!iter) {
+		return -1;
+	}
+	while ((chan = ast_channel_iterator_next(iter))) {
+		if (!strncmp(ast_channel_name(chan), TEST_CHANNEL_PREFIX, strlen(TEST_CHANNEL_PREFIX))) {
+			++count;
+		}
+		ast_channel_unref(chan);
+	}
+	ast_channel_iterator_destroy(iter);
+
+	return count;
+}
+
+AST_TEST_DEFINE(lookup_by_name)
+{
+	RAII_VAR(struct ast_channel *, alice1, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, alice2, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, bob, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, found, NULL, ast_channel_cleanup);
+	const char *prefix = TEST_CHANNEL_PREFIX "alice";
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test channel lookups by name and name prefix";
+		info->description =
+			"Find channels by their name, a prefix of it and their uniqueid,\n"
+			"including after a channel is renamed.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	alice1 = test_channel_alloc("alice-1", "100", "default", NULL);
+	alice2 = test_channel_alloc("alice-2", "100", "default", NULL);
+	bob = test_channel_alloc("bob-1", "200", "default", NULL);
+	ast_test_validate(test, alice1 && alice2 && bob);
+
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_name_new(prefix, strlen(prefix))) == 2);
+
+	found = ast_channel_get_by_name_prefix("channellookuptest/BOB", strlen("channellookuptest/BOB"));
+	ast_test_validate(test, found == bob);
+	found = ast_channel_cleanup(found);
+
+	found = ast_channel_get_by_name(TEST_CHANNEL_PREFIX "alice-2");
+	ast_test_validate(test, found == alice2);
+	found = ast_channel_cleanup(found);
+
+	found = ast_channel_get_by_name(ast_channel_uniqueid(alice1));
+	ast_test_validate(test, found == alice1);
+	found = ast_channel_cleanup(found);
+
+	found = ast_channel_get_by_name_prefix(ast_channel_uniqueid(bob), strlen(ast_channel_uniqueid(bob)) - 1);
+	ast_test_validate(test, found != NULL);
+	found = ast_channel_cleanup(found);
+
+	ast_change_name(alice2, TEST_CHANNEL_PREFIX "carol-1");
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_name_new(prefix, strlen(prefix))) == 1);
+	found = ast_channel_get_by_name_prefix(TEST_CHANNEL_PREFIX "carol", strlen(TEST_CHANNEL_PREFIX "carol"));
+	ast_test_validate(test, found == alice2);
+	found = ast_channel_cleanup(found);
+
+	safe_channel_release(alice1);
+	alice1 = NULL;
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_name_new(prefix, strlen(prefix))) == 0);
+	found = ast_channel_get_by_name_prefix(prefix, strlen(prefix));
+	ast_test_validate(test, found == NULL);
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(lookup_by_exten)
+{
+	RAII_VAR(struct ast_channel *, alice, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, bob, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, carol, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, found, NULL, ast_channel_cleanup);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test channel lookups by context and extension";
+		info->description =
+			"Find channels by their context or macro context and extension or\n"
+			"macro extension, including after they change.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	alice = test_channel_alloc("alice", "100", "lookup-test", NULL);
+	bob = test_channel_alloc("bob", "100", "lookup-test", NULL);
+	carol = test_channel_alloc("carol", "300", "lookup-test", NULL);
+	ast_test_validate(test, alice && bob && carol);
+
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_exten_new("100", "lookup-test")) == 2);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_exten_new("100", "LOOKUP-TEST")) == 2);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_exten_new("300", "other")) == 0);
+
+	found = ast_channel_get_by_exten("300", "lookup-test");
+	ast_test_validate(test, found == carol);
+	found = ast_channel_cleanup(found);
+
+	ast_channel_lock(bob);
+	ast_channel_exten_set(bob, "300");
+	ast_channel_unlock(bob);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_exten_new("100", "lookup-test")) == 1);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_exten_new("300", "lookup-test")) == 2);
+
+	/* A macro context and extension match as well. */
+	ast_channel_lock(carol);
+	ast_channel_macrocontext_set(carol, "macro-test");
+	ast_channel_macroexten_set(carol, "s");
+	ast_channel_unlock(carol);
+	found = ast_channel_get_by_exten("s", "macro-test");
+	ast_test_validate(test, found == carol);
+	found = ast_channel_cleanup(found);
+	found = ast_channel_get_by_exten("300", "macro-test");
+	ast_test_validate(test, found == carol);
+	found = ast_channel_cleanup(found);
+	found = ast_channel_get_by_exten("s", "lookup-test");
+	ast_test_validate(test, found == carol);
+	found = ast_channel_cleanup(found);
+
+	safe_channel_release(carol);
+	carol = NULL;
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_exten_new("300", "lookup-test")) == 1);
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(lookup_by_linkedid)
+{
+	RAII_VAR(struct ast_channel *, alice, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, bob, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, carol, NULL, safe_channel_release);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test channel lookups by linkedid";
+		info->description =
+			"Find the channels sharing a linkedid.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	alice = test_channel_alloc("alice", "100", "default", NULL);
+	ast_test_validate(test, alice != NULL);
+	bob = test_channel_alloc("bob", "100", "default", alice);
+	carol = test_channel_alloc("carol", "100", "default", NULL);
+	ast_test_validate(test, bob && carol);
+
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_linkedid_new(ast_channel_linkedid(alice))) == 2);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_linkedid_new(ast_channel_linkedid(carol))) == 1);
+
+	safe_channel_release(bob);
+	bob = NULL;
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_linkedid_new(ast_channel_linkedid(alice))) == 1);
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(lookup_by_spygroup)
+{
+	RAII_VAR(struct ast_channel *, alice, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, bob, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel *, carol, NULL, safe_channel_release);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test channel lookups by spy group";
+		info->description =
+			"Find the channels in spy groups as SPYGROUP changes.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	alice = test_channel_alloc("alice", "100", "default", NULL);
+	bob = test_channel_alloc("bob", "100", "default", NULL);
+	carol = test_channel_alloc("carol", "100", "default", NULL);
+	ast_test_validate(test, alice && bob && carol);
+
+	pbx_builtin_setvar_helper(alice, "SPYGROUP", "sales");
+	pbx_builtin_setvar_helper(bob, "SPYGROUP", "sales:support");
+	pbx_builtin_setvar_helper(carol, "_SPYGROUP", "support");
+
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("sales")) == 2);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("support")) == 2);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("sales:support")) == 3);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("billing")) == 0);
+
+	pbx_builtin_setvar_helper(bob, "SPYGROUP", "billing");
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("sales")) == 1);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("billing")) == 1);
+
+	pbx_builtin_setvar_helper(alice, "SPYGROUP", "a:b:c:d:e:f:g:h:i");
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("i")) == 1);
+
+	pbx_builtin_setvar_helper(alice, "SPYGROUP", NULL);
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("i")) == 0);
+
+	safe_channel_release(carol);
+	carol = NULL;
+	ast_test_validate(test, iterator_count(ast_channel_iterator_by_spygroup_new("support")) == 0);
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(many_variables)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	char name[32];
+	char value[32];
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test a channel with many variables";
+		info->description =
+			"Set, replace, push and clear enough channel variables for them\n"
+			"to be indexed, and check what reading them finds.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = test_channel_alloc("vars", "100", "default", NULL);
+	ast_test_validate(test, chan != NULL);
+
+	for (i = 0; i < 200; ++i) {
+		snprintf(name, sizeof(name), "%sVAR%d", i % 2 ? "_" : "", i);
+		snprintf(value, sizeof(value), "%d", i);
+		pbx_builtin_setvar_helper(chan, name, value);
+	}
+	for (i = 0; i < 200; i += 3) {
+		snprintf(name, sizeof(name), "VAR%d", i);
+		snprintf(value, sizeof(value), "new%d", i);
+		pbx_builtin_setvar_helper(chan, name, value);
+	}
+	for (i = 0; i < 200; i += 5) {
+		snprintf(name, sizeof(name), "VAR%d", i);
+		pbx_builtin_setvar_helper(chan, name, NULL);
+	}
+
+	for (i = 0; i < 200; ++i) {
+		const char *found;
+
+		snprintf(name, sizeof(name), "VAR%d", i);
+		if (i % 5 == 0) {
+			value[0] = '\0';
+		} else if (i % 3 == 0) {
+			snprintf(value, sizeof(value), "new%d", i);
+		} else {
+			snprintf(value, sizeof(value), "%d", i);
+		}
+		found = pbx_builtin_getvar_helper(chan, name);
+		ast_test_validate(test, !strcmp(S_OR(found, ""), value));
+	}
+
+	/* A pushed variable hides the older one until it is cleared. */
+	pbx_builtin_pushvar_helper(chan, "VAR1", "pushed");
+	ast_test_validate(test, !strcmp(S_OR(pbx_builtin_getvar_helper(chan, "VAR1"), ""), "pushed"));
+	pbx_builtin_setvar_helper(chan, "VAR1", NULL);
+	ast_test_validate(test, !strcmp(S_OR(pbx_builtin_getvar_helper(chan, "VAR1"), ""), "1"));
+	pbx_builtin_setvar_helper(chan, "VAR1", NULL);
+	ast_test_validate(test, pbx_builtin_getvar_helper(chan, "VAR1") == NULL);
+
+	return AST_TEST_PASS;
+}
+
+static const struct ast_datastore_info test_datastore_infos[] = {
+	{ .type = "test-datastore-a", },
+	{ .type = "test-datastore-b", },
+	{ .type = "test-datastore-c", },
+};
+
+AST_TEST_DEFINE(many_datastores)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	struct ast_datastore *datastores[30] = { NULL, };
+	struct ast_datastore *found;
+	char uid[16];
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test a channel with many datastores";
+		info->description =
+			"Add and remove enough datastores for them to be indexed, and check\n"
+			"what finding them by type and uid returns.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = test_channel_alloc("datastores", "100", "default", NULL);
+	ast_test_validate(test, chan != NULL);
+
+	ast_channel_lock(chan);
+	for (i = 0; i < ARRAY_LEN(datastores); ++i) {
+		snprintf(uid, sizeof(uid), "%d", i);
+		datastores[i] = ast_datastore_alloc(&test_datastore_infos[i % 3], uid);
+		if (!datastores[i]) {
+			break;
+		}
+		ast_channel_datastore_add(chan, datastores[i]);
+	}
+	if (i < ARRAY_LEN(datastores)) {
+		ast_channel_unlock(chan);
+		ast_test_status_update(test, "Unable to allocate datastores\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* The latest datastore of a type is found first. */
+	found = ast_channel_datastore_find(chan, &test_datastore_infos[0], NULL);
+	ast_test_validate(test, found == datastores[27]);
+	found = ast_channel_datastore_find(chan, &test_datastore_infos[1], "4");
+	ast_test_validate(test, found == datastores[4]);
+	found = ast_channel_datastore_find(chan, &test_datastore_infos[2], "4");
+	ast_test_validate(test, found == NULL);
+
+	ast_channel_datastore_remove(chan, datastores[27]);
+	ast_datastore_free(datastores[27]);
+	found = ast_channel_datastore_find(chan, &test_datastore_infos[0], NULL);
+	ast_test_validate(test, found == datastores[24]);
+
+	for (i = 2; i < ARRAY_LEN(datastores); i += 3) {
+		ast_channel_datastore_remove(chan, datastores[i]);
+		ast_datastore_free(datastores[i]);
+	}
+	found = ast_channel_datastore_find(chan, &test_datastore_infos[2], NULL);
+	ast_test_validate(test, found == NULL);
+	found = ast_channel_datastore_find(chan, &test_datastore_infos[1], NULL);
+	ast_test_validate(test, found == datastores[28]);
+	ast_channel_unlock(chan);
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(setup_times)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	struct ast_channel_setup_times times = { { { 0, }, }, };
+	struct ast_str *buf = ast_str_alloca(512);
+	struct timeval now;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test recording the call setup stages of a channel";
+		info->description =
+			"Merge stages recorded before a channel existed into it, mark more\n"
+			"and check the stages listed and their times.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = test_channel_alloc("setup", "100", "default", NULL);
+	ast_test_validate(test, chan != NULL);
+
+	now = ast_tvnow();
+	times.stage[AST_CHANNEL_SETUP_RECEIVED] = ast_tvsub(now, ast_tv(0, 10000));
+	times.stage[AST_CHANNEL_SETUP_DISTRIBUTED] = ast_tvsub(now, ast_tv(0, 5000));
+	/* The channel was already created, so this is ignored */
+	times.stage[AST_CHANNEL_SETUP_CREATED] = ast_tvadd(now, ast_tv(60, 0));
+	ast_channel_setup_times_merge(chan, &times);
+
+	ast_channel_setup_stage_mark(chan, AST_CHANNEL_SETUP_DIALPLAN);
+	ast_setup_times_mark(&times, AST_CHANNEL_SETUP_DIALPLAN);
+	ast_test_validate(test, ast_tvcmp(times.stage[AST_CHANNEL_SETUP_DIALPLAN], ast_tv(0, 0)) > 0);
+
+	ast_channel_lock(chan);
+	ast_channel_setup_times_str(chan, &buf);
+	ast_channel_unlock(chan);
+	ast_test_status_update(test, "Setup times: %s\n", ast_str_buffer(buf));
+
+	ast_test_validate(test, ast_begins_with(ast_str_buffer(buf), "received=0.000,distributed=0.005,created="));
+	ast_test_validate(test, strstr(ast_str_buffer(buf), ",created=60") == NULL);
+	ast_test_validate(test, strstr(ast_str_buffer(buf), ",dialplan=") != NULL);
+	ast_test_validate(test, strstr(ast_str_buffer(buf), "ringing") == NULL);
+
+	ast_test_validate(test, !strcmp(ast_channel_setup_stage_name(AST_CHANNEL_SETUP_ANSWERED), "answered"));
+	ast_test_validate(test, !strcmp(ast_channel_setup_stage_name(AST_CHANNEL_SETUP_STAGE_MAX), "unknown"));
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief Count the frames a test framehook is passed */
+static struct ast_frame *count_framehook_cb(struct ast_channel *chan, struct ast_frame *frame,
+	enum ast_framehook_event event, void *data)
+{
+	int *count = data;
+
+	if (frame && (event == AST_FRAMEHOOK_EVENT_READ || event == AST_FRAMEHOOK_EVENT_WRITE)) {
+		++*count;
+	}
+	return frame;
+}
+
+AST_TEST_DEFINE(framehook_masks)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	struct ast_frame voice = { .frametype = AST_FRAME_VOICE, };
+	struct ast_frame control = { .frametype = AST_FRAME_CONTROL, .subclass.integer = AST_CONTROL_HOLD, };
+	int count = 0;
+	struct ast_framehook_interface interface = {
+		.version = AST_FRAMEHOOK_INTERFACE_VERSION,
+		.event_cb = count_framehook_cb,
+		.data = &count,
+		.frame_types = AST_FRAMEHOOK_BIT(AST_FRAME_CONTROL),
+		.events = AST_FRAMEHOOK_BIT(AST_FRAMEHOOK_EVENT_WRITE),
+	};
+	struct ast_framehook_list *framehooks;
+	int wants;
+	int empty;
+	int id;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test framehooks are only passed the frames they want";
+		info->description =
+			"Attach a framehook wanting written control frames, push frames\n"
+			"of other types and directions and check it is not called for them.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = test_channel_alloc("framehook", "100", "default", NULL);
+	ast_test_validate(test, chan != NULL);
+
+	ast_channel_lock(chan);
+	id = ast_framehook_attach(chan, &interface);
+	framehooks = ast_channel_framehooks(chan);
+	if (id < 0) {
+		ast_channel_unlock(chan);
+		ast_test_status_update(test, "Failed to attach the framehook\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_framehook_list_write_event(framehooks, &voice);
+	ast_framehook_list_read_event(framehooks, &control);
+	ast_framehook_list_write_event(framehooks, &control);
+	ast_channel_unlock(chan);
+	ast_test_validate(test, count == 1);
+
+	ast_test_validate(test, ast_framehook_list_wants_frame_type(framehooks,
+		AST_FRAMEHOOK_EVENT_WRITE, AST_FRAME_CONTROL));
+	ast_test_validate(test, !ast_framehook_list_wants_frame_type(framehooks,
+		AST_FRAMEHOOK_EVENT_WRITE, AST_FRAME_VOICE));
+	ast_test_validate(test, !ast_framehook_list_wants_frame_type(framehooks,
+		AST_FRAMEHOOK_EVENT_READ, AST_FRAME_CONTROL));
+	ast_test_validate(test, ast_framehook_list_contains_no_active_of_type(framehooks, AST_FRAME_VOICE));
+
+	/* A dying framehook needs the next frame to be detached */
+	ast_channel_lock(chan);
+	ast_framehook_detach(chan, id);
+	wants = ast_framehook_list_wants_frame_type(framehooks, AST_FRAMEHOOK_EVENT_READ, AST_FRAME_VOICE);
+	ast_framehook_list_read_event(framehooks, &voice);
+	empty = ast_framehook_list_is_empty(framehooks);
+	ast_channel_unlock(chan);
+	ast_test_validate(test, wants);
+	ast_test_validate(test, empty);
+	ast_test_validate(test, count == 1);
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief Number of channels waited on, enough for the thread to use an epoll set */
+#define WAIT_CHANNELS 4
+
+AST_TEST_DEFINE(waitfor_reused_fd)
+{
+	struct ast_channel *chans[WAIT_CHANNELS] = { NULL, };
+	int pipes[WAIT_CHANNELS][2];
+	int newpipe[2] = { -1, -1 };
+	struct ast_channel *winner;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	char name[16];
+	char c = 'x';
+	int ms;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test waiting on a file descriptor reopened under the same number";
+		info->description =
+			"Wait on channels, then close the file descriptor of one and open\n"
+			"another under the same number. Waiting again must see it ready.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < WAIT_CHANNELS; ++i) {
+		pipes[i][0] = pipes[i][1] = -1;
+	}
+	for (i = 0; i < WAIT_CHANNELS; ++i) {
+		snprintf(name, sizeof(name), "wait-%d", i);
+		if (!(chans[i] = test_channel_alloc(name, "100", "default", NULL)) || pipe(pipes[i])) {
+			ast_test_status_update(test, "Unable to set up channel %d\n", i);
+			goto end;
+		}
+		ast_channel_set_fd(chans[i], 0, pipes[i][0]);
+	}
+
+	/* Nothing is ready, the file descriptors are registered. */
+	ms = 0;
+	if ((winner = ast_waitfor_n(chans, WAIT_CHANNELS, &ms))) {
+		ast_test_status_update(test, "Channel %s ready before anything was written\n", ast_channel_name(winner));
+		goto end;
+	}
+
+	/* Replace the pipe of the last channel, its read end keeping the number. */
+	if (pipe(newpipe) || dup2(newpipe[0], pipes[WAIT_CHANNELS - 1][0]) < 0) {
+		ast_test_status_update(test, "Unable to reopen the file descriptor\n");
+		goto end;
+	}
+	close(pipes[WAIT_CHANNELS - 1][1]);
+	pipes[WAIT_CHANNELS - 1][1] = newpipe[1];
+	newpipe[1] = -1;
+	ast_channel_set_fd(chans[WAIT_CHANNELS - 1], 0, pipes[WAIT_CHANNELS - 1][0]);
+
+	if (write(pipes[WAIT_CHANNELS - 1][1], &c, 1) != 1) {
+		ast_test_status_update(test, "Unable to write to the pipe\n");
+		goto end;
+	}
+
+	ms = 1000;
+	winner = ast_waitfor_n(chans, WAIT_CHANNELS, &ms);
+	if (winner != chans[WAIT_CHANNELS - 1]) {
+		ast_test_status_update(test, "Reopened file descriptor was not seen ready\n");
+		goto end;
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	for (i = 0; i < WAIT_CHANNELS; ++i) {
+		if (chans[i]) {
+			ast_channel_set_fd(chans[i], 0, -1);
+			safe_channel_release(chans[i]);
+		}
+		if (pipes[i][0] > -1) {
+			close(pipes[i][0]);
+		}
+		if (pipes[i][1] > -1) {
+			close(pipes[i][1]);
+		}
+	}
+	if (newpipe[0] > -1) {
+		close(newpipe[0]);
+	}
+	if (newpipe[1] > -1) {
+		close(newpipe[1]);
+	}
+	return res;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(lookup_by_name);
+	AST_TEST_UNREGISTER(lookup_by_exten);
+	AST_TEST_UNREGISTER(lookup_by_linkedid);
+	AST_TEST_UNREGISTER(lookup_by_spygroup);
+	AST_TEST_UNREGISTER(many_variables);
+	AST_TEST_UNREGISTER(many_datastores);
+	AST_TEST_UNREGISTER(setup_times);
+	AST_TEST_UNREGISTER(framehook_masks);
+	AST_TEST_UNREGISTER(waitfor_reused_fd);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(lookup_by_name);
+	AST_TEST_REGISTER(lookup_by_exten);
+	AST_TEST_REGISTER(lookup_by_linkedid);
+	AST_TEST_REGISTER(lookup_by_spygroup);
+	AST_TEST_REGISTER(many_variables);
+	AST_TEST_REGISTER(many_datastores);
+	AST_TEST_REGISTER(setup_times);
+	AST_TEST_REGISTER(framehook_masks);
+	AST_TEST_REGISTER(waitfor_reused_fd);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Channel Lookup and Storage Unit Tests");
@@ -0,0 +1,150 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Channel allocation benchmarks.
+ *
+ * Allocates and destroys a pair of channels, the way a Local channel does
+ * for each call, with and without recycling destroyed channels. The time
+ * per operation covers two channels.
+ *
+ * Run with 'bench execute category /bench/channel/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/channel.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/channel/";
+
+/*! Destroyed channels kept by the pooled benchmark */
+#define BENCH_POOL_SIZE 64
+
+/*! \brief Pool size to restore when a benchmark ends */
+struct bench_pool {
+	int old_size;
+};
+
+static int bench_pool_setup(int size, void **data)
+{
+	struct bench_pool *pool;
+
+	if (!(pool = ast_calloc(1, sizeof(*pool)))) {
+		return -1;
+	}
+	pool->old_size = ast_channel_pool_size_set(size);
+
+	*data = pool;
+	return 0;
+}
+
+static int unpooled_setup(struct ast_test *test, void **data)
+{
+	return bench_pool_setup(0, data);
+}
+
+static int pooled_setup(struct ast_test *test, void **data)
+{
+	return bench_pool_setup(BENCH_POOL_SIZE, data);
+}
+
+static void bench_pool_teardown(void *data)
+{
+	struct bench_pool *pool = data;
+
+	ast_channel_pool_size_set(pool->old_size);
+	ast_free(pool);
+}
+
+static int alloc_pair_op(void *data, unsigned int iteration)
+{
+	struct ast_channel *chans[2];
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(chans); ++i) {
+		chans[i] = ast_channel_alloc(1, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+			AST_AMA_NONE, "BenchChannel/%u;%d", iteration, i + 1);
+		if (!chans[i]) {
+			while (i--) {
+				ast_channel_release(chans[i]);
+			}
+			return -1;
+		}
+		ast_channel_unlock(chans[i]);
+	}
+
+	for (i = 0; i < ARRAY_LEN(chans); ++i) {
+		ast_channel_release(chans[i]);
+	}
+	return 0;
+}
+
+AST_BENCH_DEFINE(alloc_pair)
+{
+	bench->name = "alloc_pair";
+	bench->category = test_category;
+	bench->summary = "Allocate and destroy a pair of channels";
+	bench->description = "Allocate two channels and destroy them again,\n"
+		"without recycling destroyed channels.";
+	bench->iterations = 20000;
+	bench->batch = 10;
+	bench->setup = unpooled_setup;
+	bench->op = alloc_pair_op;
+	bench->teardown = bench_pool_teardown;
+}
+
+AST_BENCH_DEFINE(alloc_pair_pooled)
+{
+	bench->name = "alloc_pair_pooled";
+	bench->category = test_category;
+	bench->summary = "Allocate and destroy a pair of recycled channels";
+	bench->description = "Allocate two channels and destroy them again,\n"
+		"keeping up to 64 destroyed channels to build new ones.";
+	bench->iterations = 20000;
+	bench->batch = 10;
+	bench->setup = pooled_setup;
+	bench->op = alloc_pair_op;
+	bench->teardown = bench_pool_teardown;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(alloc_pair);
+	AST_TEST_UNREGISTER(alloc_pair_pooled);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(alloc_pair);
+	AST_TEST_REGISTER(alloc_pair_pooled);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Channel allocation benchmarks");
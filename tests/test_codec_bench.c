@@ -0,0 +1,179 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Codec translator benchmarks.
+ *
+ * Runs every registered translator that has sample frames, at each of the
+ * sample rates the loaded translators support, and reports the CPU time,
+ * allocations and cache misses per frame. Each result is printed as a
+ * single line starting with "BENCH" followed by space separated key=value
+ * pairs, so runs can be collected and compared by scripts. Counts that
+ * cannot be taken are reported as -1. The cost of ast_translate() on a
+ * path, with its own overhead, is measured with the benchmark framework.
+ *
+ * Run with 'test execute category /bench/codecs/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/format_cache.h"
+#include "asterisk/frame.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/translate.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/codecs/";
+
+/*! Seconds of audio each translator produces */
+#define BENCH_SECONDS 10
+
+static void bench_cb(const struct ast_translator *t, const struct ast_translator_bench *bench, void *data)
+{
+	struct ast_test *test = data;
+
+	ast_test_status_update(test,
+		"BENCH name=translator translator=%s src=%s src_rate=%u dst=%s dst_rate=%u"
+		" frames=%u samples=%u ns_per_frame=%.0f us_per_second=%.1f"
+		" allocs_per_frame=%.2f cache_misses_per_frame=%.1f\n",
+		t->name, t->src_codec.name, t->src_codec.sample_rate,
+		t->dst_codec.name, t->dst_codec.sample_rate,
+		bench->frames, bench->samples, bench->ns_per_frame, bench->us_per_second,
+		bench->allocs_per_frame, bench->cache_misses_per_frame);
+}
+
+AST_TEST_DEFINE(translators)
+{
+	int count;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark codec translators";
+		info->description = "Measure the CPU time, allocations and cache\n"
+			"misses per frame of every registered translator.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	count = ast_translator_benchmark(BENCH_SECONDS, bench_cb, test);
+	ast_test_status_update(test, "%d translators benchmarked\n", count);
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief The path the translate benchmark runs frames through */
+struct bench_translate {
+	struct ast_trans_pvt *path;
+	int16_t samples[160];
+	struct ast_frame frame;
+};
+
+static void translate_teardown(void *data)
+{
+	struct bench_translate *bench = data;
+
+	if (bench->path) {
+		ast_translator_free_path(bench->path);
+	}
+	ast_free(bench);
+}
+
+static int translate_setup(struct ast_test *test, void **data)
+{
+	struct bench_translate *bench = ast_calloc(1, sizeof(*bench));
+	int i;
+
+	if (!bench) {
+		return -1;
+	}
+	bench->path = ast_translator_build_path(ast_format_ulaw, ast_format_slin);
+	if (!bench->path) {
+		ast_test_status_update(test, "No translation path from slin to ulaw\n");
+		translate_teardown(bench);
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_LEN(bench->samples); ++i) {
+		/* Not silence, which some translators take short cuts with */
+		bench->samples[i] = (i % 8 < 4 ? 1 : -1) * (i % 4) * 4000;
+	}
+	bench->frame.frametype = AST_FRAME_VOICE;
+	bench->frame.subclass.format = ast_format_slin;
+	bench->frame.data.ptr = bench->samples;
+	bench->frame.datalen = sizeof(bench->samples);
+	bench->frame.samples = ARRAY_LEN(bench->samples);
+	bench->frame.src = "bench";
+
+	*data = bench;
+	return 0;
+}
+
+static int translate_op(void *data, unsigned int iteration)
+{
+	struct bench_translate *bench = data;
+	struct ast_frame *out;
+
+	out = ast_translate(bench->path, &bench->frame, 0);
+	if (!out) {
+		return -1;
+	}
+	ast_frfree(out);
+	return 0;
+}
+
+AST_BENCH_DEFINE(translate)
+{
+	bench->name = "translate";
+	bench->category = test_category;
+	bench->summary = "Translate frames with ast_translate()";
+	bench->description = "Measure ast_translate() on 20 ms frames from slin\n"
+		"to ulaw, including the translation path's own overhead.";
+	bench->iterations = 100000;
+	bench->batch = 10;
+	bench->setup = translate_setup;
+	bench->op = translate_op;
+	bench->teardown = translate_teardown;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(translators);
+	AST_TEST_UNREGISTER(translate);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(translators);
+	AST_TEST_REGISTER(translate);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Codec benchmarks");
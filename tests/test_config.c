@@ -1672,6 +1672,263 @@ out:
 	return res;
 }
 
+/*! \brief How many lookups reached the test realtime engine */
+static int realtime_cache_lookups;
+
+static struct ast_variable *realtime_cache_test_get(const char *database, const char *table, const struct ast_variable *fields)
+{
+	realtime_cache_lookups++;
+	if (strcmp(fields->value, "missing")) {
+		return ast_variable_new("value", fields->value, "");
+	}
+	return NULL;
+}
+
+static int realtime_cache_test_update(const char *database, const char *table, const char *keyfield, const char *entity, const struct ast_variable *fields)
+{
+	return 1;
+}
+
+static struct ast_config_engine realtime_cache_test_engine = {
+	.name = "realtime_cache_test",
+	.realtime_func = realtime_cache_test_get,
+	.update_func = realtime_cache_test_update,
+};
+
+/*! \brief Look up a key in the test family, and check what comes back */
+static int realtime_cache_test_load(struct ast_test *test, const char *key, int lookups)
+{
+	struct ast_variable *var = ast_load_realtime("realtime_cache_test", "key", key, SENTINEL);
+	int res = 0;
+
+	if (!strcmp(key, "missing") ? var != NULL : (!var || strcmp(var->value, key))) {
+		ast_test_status_update(test, "Wrong result looking up '%s'\n", key);
+		res = -1;
+	}
+	if (realtime_cache_lookups != lookups) {
+		ast_test_status_update(test, "Looking up '%s' made %d lookups in all rather than %d\n",
+			key, realtime_cache_lookups, lookups);
+		res = -1;
+	}
+	ast_variables_destroy(var);
+	return res;
+}
+
+AST_TEST_DEFINE(config_realtime_cache)
+{
+	enum ast_test_result_state res = AST_TEST_FAIL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "config_realtime_cache";
+		info->category = "/main/config/";
+		info->summary = "Test the realtime cache";
+		info->description = "Looks up a realtime family through a cache, checking "
+			"which lookups reach the engine.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	realtime_cache_lookups = 0;
+	ast_config_engine_register(&realtime_cache_test_engine);
+	if (ast_realtime_append_mapping("realtime_cache_test", "realtime_cache_test", "test", "test", 1)
+		|| ast_realtime_append_cache("realtime_cache_test", 60, 2, 60)) {
+		ast_test_status_update(test, "Unable to set up the realtime cache\n");
+		goto cleanup;
+	}
+
+	/* Found and not found results are both kept */
+	if (realtime_cache_test_load(test, "one", 1) || realtime_cache_test_load(test, "one", 1)
+		|| realtime_cache_test_load(test, "missing", 2) || realtime_cache_test_load(test, "missing", 2)) {
+		goto cleanup;
+	}
+
+	/* A third result pushes out the oldest */
+	if (realtime_cache_test_load(test, "two", 3) || realtime_cache_test_load(test, "missing", 3)
+		|| realtime_cache_test_load(test, "one", 4)) {
+		goto cleanup;
+	}
+
+	/* Writing to the family flushes its cache */
+	if (ast_update_realtime("realtime_cache_test", "key", "one", "value", "uno", SENTINEL) < 0) {
+		ast_test_status_update(test, "Unable to update the realtime family\n");
+		goto cleanup;
+	}
+	if (realtime_cache_test_load(test, "one", 5) || realtime_cache_test_load(test, "one", 5)) {
+		goto cleanup;
+	}
+
+	/* As does flushing it by hand */
+	if (ast_realtime_cache_flush("realtime_cache_test")) {
+		ast_test_status_update(test, "Unable to flush the realtime cache\n");
+		goto cleanup;
+	}
+	if (realtime_cache_test_load(test, "one", 6)) {
+		goto cleanup;
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	ast_realtime_cache_flush("realtime_cache_test");
+	ast_config_engine_deregister(&realtime_cache_test_engine);
+	return res;
+}
+
+#define IMAGE_FILE "test_config_image.conf"
+#define IMAGE_INCLUDE_FILE "test_config_image_inc.conf"
+
+static int write_image_file(const char *name, const char *contents)
+{
+	FILE *config_file;
+	char filename[PATH_MAX];
+
+	snprintf(filename, sizeof(filename), "%s/%s", ast_config_AST_CONFIG_DIR, name);
+	if (!(config_file = fopen(filename, "w"))) {
+		return -1;
+	}
+	fputs(contents, config_file);
+	fclose(config_file);
+	return 0;
+}
+
+static void delete_image_file(const char *name)
+{
+	char filename[PATH_MAX];
+
+	snprintf(filename, sizeof(filename), "%s/%s", ast_config_AST_CONFIG_DIR, name);
+	unlink(filename);
+}
+
+static int config_loaded(struct ast_config *cfg)
+{
+	return cfg && cfg != CONFIG_STATUS_FILEINVALID && cfg != CONFIG_STATUS_FILEUNCHANGED;
+}
+
+/*! \brief Whether two configs have the same categories and variables, from the same places */
+static int configs_match(struct ast_test *test, struct ast_config *a, struct ast_config *b)
+{
+	struct ast_category *cat_a = NULL;
+	struct ast_category *cat_b = NULL;
+
+	while ((cat_a = ast_category_browse_filtered(a, NULL, cat_a, "TEMPLATES=include"))) {
+		struct ast_variable *var_a;
+		struct ast_variable *var_b;
+
+		cat_b = ast_category_browse_filtered(b, NULL, cat_b, "TEMPLATES=include");
+		if (!cat_b || strcmp(ast_category_get_name(cat_a), ast_category_get_name(cat_b))
+			|| ast_category_is_template(cat_a) != ast_category_is_template(cat_b)) {
+			ast_test_status_update(test, "Category '%s' does not match\n", ast_category_get_name(cat_a));
+			return -1;
+		}
+		for (var_a = ast_category_first(cat_a), var_b = ast_category_first(cat_b); var_a && var_b;
+			var_a = var_a->next, var_b = var_b->next) {
+			if (strcmp(var_a->name, var_b->name) || strcmp(var_a->value, var_b->value)
+				|| strcmp(var_a->file, var_b->file) || var_a->lineno != var_b->lineno
+				|| var_a->inherited != var_b->inherited) {
+				ast_test_status_update(test, "Variable '%s' in '%s' does not match\n",
+					var_a->name, ast_category_get_name(cat_a));
+				return -1;
+			}
+		}
+		if (var_a || var_b) {
+			ast_test_status_update(test, "Category '%s' has a different number of variables\n",
+				ast_category_get_name(cat_a));
+			return -1;
+		}
+	}
+	if (ast_category_browse_filtered(b, NULL, cat_b, "TEMPLATES=include")) {
+		ast_test_status_update(test, "Config has extra categories\n");
+		return -1;
+	}
+	return 0;
+}
+
+AST_TEST_DEFINE(config_image)
+{
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct ast_flags config_flags = { 0 };
+	struct ast_flags parse_flags = { CONFIG_FLAG_WITHCOMMENTS };
+	struct ast_config *parsed = NULL;
+	struct ast_config *cfg = NULL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "config_image";
+		info->category = "/main/config/";
+		info->summary = "Test compiled config images";
+		info->description = "Loads a config file with a template and an include "
+			"again and again, checking it loads as parsing it gives, and that "
+			"changing the included file is seen.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (write_image_file(IMAGE_FILE,
+			"[base](!)\n"
+			"context = default\n"
+			"[one](base)\n"
+			"host = dynamic\n"
+			"#include " IMAGE_INCLUDE_FILE "\n"
+			"[one](+)\n"
+			"port => 5060\n")
+		|| write_image_file(IMAGE_INCLUDE_FILE,
+			"[two](base)\n"
+			"host = example.com\n")) {
+		ast_test_status_update(test, "Unable to write the config files\n");
+		goto cleanup;
+	}
+
+	/* Comments keep a load from having an image, so this is always parsed */
+	parsed = ast_config_load2(IMAGE_FILE, "test_config_image", parse_flags);
+	if (!config_loaded(parsed)) {
+		ast_test_status_update(test, "Unable to parse the config file\n");
+		parsed = NULL;
+		goto cleanup;
+	}
+
+	/* Compiles the image, then builds from it */
+	cfg = ast_config_load2(IMAGE_FILE, "test_config_image", config_flags);
+	if (!config_loaded(cfg) || configs_match(test, parsed, cfg)) {
+		ast_test_status_update(test, "Loading the config file the first time gave the wrong config\n");
+		goto cleanup;
+	}
+	ast_config_destroy(cfg);
+	cfg = ast_config_load2(IMAGE_FILE, "test_config_image", config_flags);
+	if (!config_loaded(cfg) || configs_match(test, parsed, cfg)) {
+		ast_test_status_update(test, "Loading the config file from its image gave the wrong config\n");
+		goto cleanup;
+	}
+	ast_config_destroy(cfg);
+
+	/* A change to the included file is seen */
+	if (write_image_file(IMAGE_INCLUDE_FILE,
+			"[two](base)\n"
+			"host = www.example.com\n")) {
+		ast_test_status_update(test, "Unable to write the included config file\n");
+		cfg = NULL;
+		goto cleanup;
+	}
+	cfg = ast_config_load2(IMAGE_FILE, "test_config_image", config_flags);
+	if (!config_loaded(cfg) || strcmp(S_OR(ast_variable_retrieve(cfg, "two", "host"), ""), "www.example.com")) {
+		ast_test_status_update(test, "A change to the included config file was not seen\n");
+		goto cleanup;
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	if (config_loaded(cfg)) {
+		ast_config_destroy(cfg);
+	}
+	ast_config_destroy(parsed);
+	delete_image_file(IMAGE_FILE);
+	delete_image_file(IMAGE_INCLUDE_FILE);
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(config_basic_ops);
@@ -1682,6 +1939,8 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(ast_parse_arg_test);
 	AST_TEST_UNREGISTER(config_options_test);
 	AST_TEST_UNREGISTER(config_dialplan_function);
+	AST_TEST_UNREGISTER(config_realtime_cache);
+	AST_TEST_UNREGISTER(config_image);
 	return 0;
 }
 
@@ -1695,6 +1954,8 @@ static int load_module(void)
 	AST_TEST_REGISTER(ast_parse_arg_test);
 	AST_TEST_REGISTER(config_options_test);
 	AST_TEST_REGISTER(config_dialplan_function);
+	AST_TEST_REGISTER(config_realtime_cache);
+	AST_TEST_REGISTER(config_image);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
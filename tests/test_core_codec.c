@@ -36,6 +36,9 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/test.h"
 #include "asterisk/module.h"
 #include "asterisk/codec.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/frame.h"
+#include "asterisk/translate.h"
 
 static struct ast_codec known_unknown = {
 	.name = "unit_test",
@@ -340,6 +343,159 @@ AST_TEST_DEFINE(codec_get_id)
 	return AST_TEST_PASS;
 }
 
+/*! \brief Frames of reference signal round-tripped through G.722 */
+#define G722_REFERENCE_FRAMES 50
+
+/*! \brief Add a byte to a 32 bit FNV-1a hash */
+static uint32_t fnv1a(uint32_t hash, unsigned char byte)
+{
+	return (hash ^ byte) * 16777619u;
+}
+
+/*!
+ * \brief Generate the reference signal for a frame
+ *
+ * A sawtooth under noise, doubled and clipped every fourth frame so the
+ * codec also sees saturated input.
+ */
+static void g722_reference_signal(int16_t *buf, int samples, int frame, unsigned int *n, unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < samples; ++i, ++*n) {
+		int value;
+
+		*seed = *seed * 1103515245 + 12345;
+		value = ((int) ((*n * 97) % 4000) - 2000) * 8 + (int) ((*seed >> 16) & 0x1fff) - 0x1000;
+		if (frame % 4 == 3) {
+			value = MAX(MIN(value * 2, 32767), -32768);
+		}
+		buf[i] = value;
+	}
+}
+
+/*!
+ * \brief Round-trip the reference signal through G.722 and check the hashes
+ *
+ * The expected hashes of the encoded and decoded data were taken from the
+ * scalar implementation, so they hold for any vector implementation too.
+ */
+static enum ast_test_result_state g722_round_trip(struct ast_test *test, struct ast_format *slin,
+	int samples, uint32_t expected_encoded, uint32_t expected_decoded)
+{
+	struct ast_trans_pvt *encoder;
+	struct ast_trans_pvt *decoder;
+	int16_t buf[320];
+	unsigned int n = 0;
+	unsigned int seed = 1;
+	uint32_t encoded_hash = 2166136261u;
+	uint32_t decoded_hash = 2166136261u;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int frame;
+	int i;
+
+	if (ast_translate_path_steps(ast_format_g722, slin) != 1
+		|| ast_translate_path_steps(slin, ast_format_g722) != 1) {
+		ast_test_status_update(test, "codec_g722 is not loaded\n");
+		return AST_TEST_NOT_RUN;
+	}
+
+	encoder = ast_translator_build_path(ast_format_g722, slin);
+	decoder = ast_translator_build_path(slin, ast_format_g722);
+	if (!encoder || !decoder) {
+		ast_test_status_update(test, "Failed to build the G.722 translation paths\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	for (frame = 0; frame < G722_REFERENCE_FRAMES; ++frame) {
+		struct ast_frame f = {
+			.frametype = AST_FRAME_VOICE,
+			.subclass.format = slin,
+			.datalen = samples * sizeof(int16_t),
+			.samples = samples,
+			.src = __PRETTY_FUNCTION__,
+			.data.ptr = buf,
+		};
+		struct ast_frame *encoded;
+		struct ast_frame *decoded;
+		const unsigned char *bytes;
+		const int16_t *out;
+
+		g722_reference_signal(buf, samples, frame, &n, &seed);
+		encoded = ast_translate(encoder, &f, 0);
+		if (!encoded) {
+			ast_test_status_update(test, "Failed to encode frame %d\n", frame);
+			res = AST_TEST_FAIL;
+			break;
+		}
+		bytes = encoded->data.ptr;
+		for (i = 0; i < encoded->datalen; ++i) {
+			encoded_hash = fnv1a(encoded_hash, bytes[i]);
+		}
+
+		decoded = ast_translate(decoder, encoded, 1);
+		if (!decoded) {
+			ast_test_status_update(test, "Failed to decode frame %d\n", frame);
+			res = AST_TEST_FAIL;
+			break;
+		}
+		out = decoded->data.ptr;
+		for (i = 0; i < decoded->samples; ++i) {
+			decoded_hash = fnv1a(decoded_hash, out[i] & 0xff);
+			decoded_hash = fnv1a(decoded_hash, (out[i] >> 8) & 0xff);
+		}
+		ast_frfree(decoded);
+	}
+
+	if (res == AST_TEST_PASS && encoded_hash != expected_encoded) {
+		ast_test_status_update(test, "Encoding %s gave hash 0x%08x instead of 0x%08x\n",
+			ast_format_get_name(slin), encoded_hash, expected_encoded);
+		res = AST_TEST_FAIL;
+	}
+	if (res == AST_TEST_PASS && decoded_hash != expected_decoded) {
+		ast_test_status_update(test, "Decoding to %s gave hash 0x%08x instead of 0x%08x\n",
+			ast_format_get_name(slin), decoded_hash, expected_decoded);
+		res = AST_TEST_FAIL;
+	}
+
+cleanup:
+	if (encoder) {
+		ast_translator_free_path(encoder);
+	}
+	if (decoder) {
+		ast_translator_free_path(decoder);
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(codec_g722_round_trip)
+{
+	enum ast_test_result_state res;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "codec_g722_round_trip";
+		info->category = "/main/core_codec/";
+		info->summary = "G.722 reference vector unit test";
+		info->description =
+			"Test that encoding and decoding a reference signal with G.722, both\n"
+			"wideband and from narrowband, gives the same data as the scalar\n"
+			"implementation. Requires codec_g722.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	res = g722_round_trip(test, ast_format_slin16, 320, 0x177b3fa3, 0x027e46cf);
+	if (res != AST_TEST_PASS) {
+		return res;
+	}
+
+	return g722_round_trip(test, ast_format_slin, 160, 0x43103f08, 0xe4786c06);
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(codec_register);
@@ -350,6 +506,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(codec_get_unregistered);
 	AST_TEST_UNREGISTER(codec_get_unknown);
 	AST_TEST_UNREGISTER(codec_get_id);
+	AST_TEST_UNREGISTER(codec_g722_round_trip);
 	return 0;
 }
 
@@ -363,6 +520,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(codec_get_unregistered);
 	AST_TEST_REGISTER(codec_get_unknown);
 	AST_TEST_REGISTER(codec_get_id);
+	AST_TEST_REGISTER(codec_g722_round_trip);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -290,12 +290,159 @@ AST_TEST_DEFINE(put_get_long)
 	return res;
 }
 
+AST_TEST_DEFINE(read_own_writes)
+{
+	int res = AST_TEST_PASS;
+	struct ast_db_entry *dbes;
+	char buf[16];
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "read_own_writes";
+		info->category = "/main/astdb/";
+		info->summary = "astdb read after write unit test";
+		info->description =
+			"Ensures that reads see puts, dels, and deltrees made just before\n"
+			"them, before they are committed";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (x = 0; x < 100; x++) {
+		if (ast_db_put("astdbtest", "key", "one") || ast_db_put("astdbtest/sub", "key", "two")) {
+			ast_test_status_update(test, "Failed to put\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (ast_db_get("astdbtest", "key", buf, sizeof(buf)) || strcmp(buf, "one")) {
+			ast_test_status_update(test, "Failed to get astdbtest/key after put\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (!(dbes = ast_db_gettree("astdbtest", "sub"))) {
+			ast_test_status_update(test, "Failed to gettree astdbtest/sub after put\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+		ast_db_freetree(dbes);
+		if (ast_db_del("astdbtest", "key") || !ast_db_get("astdbtest", "key", buf, sizeof(buf))) {
+			ast_test_status_update(test, "Got astdbtest/key after del\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (ast_db_deltree("astdbtest", NULL) != 1 || !ast_db_get("astdbtest/sub", "key", buf, sizeof(buf))) {
+			ast_test_status_update(test, "Got astdbtest/sub/key after deltree\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if ((dbes = ast_db_gettree("astdbtest", NULL))) {
+			ast_test_status_update(test, "Got a tree for astdbtest after deltree\n");
+			ast_db_freetree(dbes);
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (x % 25 == 0) {
+			/* Let some of them be committed */
+			usleep(1100000);
+		}
+	}
+	ast_db_deltree("astdbtest", NULL);
+
+	return res;
+}
+
+AST_TEST_DEFINE(cursor)
+{
+	int res = AST_TEST_PASS;
+	struct ast_db_cursor *cursor;
+	struct ast_db_entry *dbes, *cur;
+	char key[16];
+	char last[32] = "";
+	int pages = 0;
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "cursor";
+		info->category = "/main/astdb/";
+		info->summary = "ast_db_cursor unit test";
+		info->description =
+			"Ensures that a tree read a piece at a time with a cursor is read\n"
+			"whole, in order, and only the keys in it";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (x = 0; x < 250; x++) {
+		snprintf(key, sizeof(key), "%03d", x);
+		ast_db_put("astdbtest/cursor", key, key);
+	}
+	/* Not in the tree, though they sort within its range of keys */
+	ast_db_put("astdbtest/cursor-", "key", "value");
+	ast_db_put("astdbtest", "cursor.", "value");
+
+	if (!(cursor = ast_db_cursor_open("astdbtest", "cursor"))) {
+		ast_test_status_update(test, "Failed to open a cursor\n");
+		ast_db_deltree("astdbtest", NULL);
+		return AST_TEST_FAIL;
+	}
+	x = 0;
+	while ((dbes = ast_db_cursor_next(cursor, 100))) {
+		++pages;
+		for (cur = dbes; cur; cur = cur->next, x++) {
+			snprintf(key, sizeof(key), "%03d", x);
+			if (strncmp(cur->key, "/astdbtest/cursor/", 18) || strcmp(cur->key + 18, key)
+				|| strcmp(cur->key, last) <= 0) {
+				ast_test_status_update(test, "Got key '%s' where '%s' was expected\n", cur->key, key);
+				res = AST_TEST_FAIL;
+			}
+			ast_copy_string(last, cur->key, sizeof(last));
+		}
+		ast_db_freetree(dbes);
+	}
+	ast_db_cursor_close(cursor);
+	if (x != 250 || pages != 3) {
+		ast_test_status_update(test, "Got %d entries in %d pages, expected 250 in 3\n", x, pages);
+		res = AST_TEST_FAIL;
+	}
+
+	if (!(cursor = ast_db_cursor_open_by_prefix("astdbtest/cursor", "24"))) {
+		ast_test_status_update(test, "Failed to open a cursor by prefix\n");
+		res = AST_TEST_FAIL;
+	} else {
+		x = 0;
+		dbes = ast_db_cursor_next(cursor, -1);
+		for (cur = dbes; cur; cur = cur->next) {
+			x++;
+		}
+		ast_db_freetree(dbes);
+		if (x != 10 || ast_db_cursor_next(cursor, -1)) {
+			ast_test_status_update(test, "Got %d entries with prefix '24', expected 10\n", x);
+			res = AST_TEST_FAIL;
+		}
+		ast_db_cursor_close(cursor);
+	}
+
+	if (ast_db_deltree("astdbtest", "cursor") != 250) {
+		ast_test_status_update(test, "Failed to deltree only astdbtest/cursor\n");
+		res = AST_TEST_FAIL;
+	}
+	ast_db_deltree("astdbtest", NULL);
+
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(put_get_del);
 	AST_TEST_UNREGISTER(gettree_deltree);
 	AST_TEST_UNREGISTER(perftest);
 	AST_TEST_UNREGISTER(put_get_long);
+	AST_TEST_UNREGISTER(read_own_writes);
+	AST_TEST_UNREGISTER(cursor);
 	return 0;
 }
 
@@ -305,6 +452,8 @@ static int load_module(void)
 	AST_TEST_REGISTER(gettree_deltree);
 	AST_TEST_REGISTER(perftest);
 	AST_TEST_REGISTER(put_get_long);
+	AST_TEST_REGISTER(read_own_writes);
+	AST_TEST_REGISTER(cursor);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -0,0 +1,417 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Dialing API benchmarks.
+ *
+ * Dials endpoints of a channel technology registered by this module, which
+ * ring at once and answer when told to, so only the cost of ast_dial itself
+ * and the channel core is measured. One benchmark forks a single dial to
+ * many endpoints, the way Dial() with '&' does; the other runs many dials of
+ * one endpoint each at once, the way Page and originates do. Each result is
+ * printed as a single line starting with "BENCH" followed by space separated
+ * key=value pairs, so runs can be collected and compared by scripts.
+ *
+ * Run with 'test execute category /bench/dial/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include <sys/resource.h>
+
+#include "asterisk/causes.h"
+#include "asterisk/channel.h"
+#include "asterisk/dial.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/lock.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/dial/";
+
+#define BENCH_CHANNEL_TYPE "BenchDial"
+
+/*! Resource of the endpoint that answers; the others only ring */
+#define BENCH_ANSWER "answer"
+
+/*!
+ * \brief Most endpoints one dial can fork to
+ *
+ * ast_dial waits on the channels it calls with ast_waitfor_n(), which is
+ * limited to 256 channels.
+ */
+#define BENCH_MAX_FORKS 255
+
+/*! Longest time to wait for the endpoints to answer */
+#define BENCH_TIMEOUT_SECONDS 60
+
+/*! Numbers of endpoints a single dial forks to */
+static const int bench_fork_counts[] = { 1, 10, 100, BENCH_MAX_FORKS };
+
+/*! Numbers of dials run at once */
+static const int bench_dial_counts[] = { 1, 10, 100, 1000 };
+
+/*! \brief What the endpoints measured of the benchmark being run */
+static struct {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! When the benchmark started dialing */
+	struct timeval start;
+	/*! Number of endpoints called */
+	int calls;
+	/*! Number of dials answered */
+	int answered;
+	int64_t setup_sum_us;
+	int64_t setup_max_us;
+} bench;
+
+static struct ast_channel_tech bench_tech;
+
+static struct ast_channel *bench_request(const char *type, struct ast_format_cap *cap,
+	const struct ast_assigned_ids *assignedids, const struct ast_channel *requestor,
+	const char *addr, int *cause)
+{
+	struct ast_channel *chan;
+
+	chan = ast_channel_alloc(1, AST_STATE_DOWN, "", "", "", "s", "default", assignedids,
+		requestor, 0, BENCH_CHANNEL_TYPE "/%s-%08lx", addr, (unsigned long) ast_random());
+	if (!chan) {
+		*cause = AST_CAUSE_FAILURE;
+		return NULL;
+	}
+
+	ast_channel_tech_set(chan, &bench_tech);
+	ast_channel_nativeformats_set(chan, bench_tech.capabilities);
+	ast_channel_set_writeformat(chan, ast_format_slin);
+	ast_channel_set_rawwriteformat(chan, ast_format_slin);
+	ast_channel_set_readformat(chan, ast_format_slin);
+	ast_channel_set_rawreadformat(chan, ast_format_slin);
+	ast_channel_unlock(chan);
+
+	return chan;
+}
+
+static int bench_call(struct ast_channel *chan, const char *addr, int timeout)
+{
+	int64_t setup_us;
+
+	ast_mutex_lock(&bench.lock);
+	setup_us = ast_tvdiff_us(ast_tvnow(), bench.start);
+	bench.calls++;
+	bench.setup_sum_us += setup_us;
+	if (setup_us > bench.setup_max_us) {
+		bench.setup_max_us = setup_us;
+	}
+	ast_mutex_unlock(&bench.lock);
+
+	ast_queue_control(chan, AST_CONTROL_RINGING);
+	if (!strcmp(addr, BENCH_ANSWER)) {
+		ast_queue_control(chan, AST_CONTROL_ANSWER);
+	}
+	return 0;
+}
+
+static int bench_hangup(struct ast_channel *chan)
+{
+	return 0;
+}
+
+static struct ast_channel_tech bench_tech = {
+	.type = BENCH_CHANNEL_TYPE,
+	.description = "Dialing benchmark endpoints",
+	.requester = bench_request,
+	.call = bench_call,
+	.hangup = bench_hangup,
+};
+
+/*! \brief CPU time of the whole process, as the dials run in threads of their own */
+static int64_t bench_cpu_us(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return ((int64_t) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void bench_reset(void)
+{
+	ast_mutex_lock(&bench.lock);
+	bench.calls = 0;
+	bench.answered = 0;
+	bench.setup_sum_us = 0;
+	bench.setup_max_us = 0;
+	bench.start = ast_tvnow();
+	ast_mutex_unlock(&bench.lock);
+}
+
+static void bench_report(struct ast_test *test, const char *name, int dials, int endpoints,
+	int64_t answer_us, int64_t cpu_us, int64_t teardown_us)
+{
+	ast_mutex_lock(&bench.lock);
+	ast_test_status_update(test,
+		"BENCH name=%s dials=%d endpoints=%d calls=%d answer_us=%" PRId64
+		" setup_avg_us=%" PRId64 " setup_max_us=%" PRId64
+		" cpu_us=%" PRId64 " cpu_per_endpoint_us=%" PRId64 " teardown_us=%" PRId64 "\n",
+		name, dials, endpoints, bench.calls, answer_us,
+		bench.calls ? bench.setup_sum_us / bench.calls : 0, bench.setup_max_us,
+		cpu_us, endpoints ? cpu_us / endpoints : 0, teardown_us);
+	ast_mutex_unlock(&bench.lock);
+}
+
+/*!
+ * \internal
+ * \brief Fork one dial to a number of endpoints until the last one answers.
+ *
+ * \param test Test being run.
+ * \param count Number of endpoints.
+ */
+static enum ast_test_result_state bench_fork(struct ast_test *test, int count)
+{
+	struct ast_dial *dial;
+	enum ast_dial_result state;
+	struct timeval answered;
+	int64_t cpu_start;
+	int64_t cpu_us;
+	int res = AST_TEST_PASS;
+	int i;
+
+	if (!(dial = ast_dial_create())) {
+		return AST_TEST_FAIL;
+	}
+	for (i = 0; i < count; ++i) {
+		char resource[16];
+
+		if (i == count - 1) {
+			ast_copy_string(resource, BENCH_ANSWER, sizeof(resource));
+		} else {
+			snprintf(resource, sizeof(resource), "ring%d", i);
+		}
+		if (ast_dial_append(dial, BENCH_CHANNEL_TYPE, resource, NULL) == -1) {
+			ast_dial_destroy(dial);
+			return AST_TEST_FAIL;
+		}
+	}
+	ast_dial_set_global_timeout(dial, BENCH_TIMEOUT_SECONDS * 1000);
+
+	bench_reset();
+	cpu_start = bench_cpu_us();
+	state = ast_dial_run(dial, NULL, 0);
+	answered = ast_tvnow();
+	cpu_us = bench_cpu_us() - cpu_start;
+
+	if (state != AST_DIAL_RESULT_ANSWERED) {
+		ast_test_status_update(test, "fork: dial of %d endpoints ended in state %u\n", count, state);
+		res = AST_TEST_FAIL;
+	}
+
+	ast_dial_destroy(dial);
+
+	bench_report(test, "fork", 1, count, ast_tvdiff_us(answered, bench.start), cpu_us,
+		ast_tvdiff_us(ast_tvnow(), answered));
+
+	return res;
+}
+
+static void bench_parallel_state(struct ast_dial *dial)
+{
+	if (ast_dial_state(dial) != AST_DIAL_RESULT_ANSWERED) {
+		return;
+	}
+	ast_mutex_lock(&bench.lock);
+	bench.answered++;
+	ast_cond_signal(&bench.cond);
+	ast_mutex_unlock(&bench.lock);
+}
+
+/*!
+ * \internal
+ * \brief Run a number of dials to one endpoint each at once until all answer.
+ *
+ * \param test Test being run.
+ * \param count Number of dials.
+ */
+static enum ast_test_result_state bench_parallel(struct ast_test *test, int count)
+{
+	struct ast_dial **dials;
+	struct timeval answered;
+	struct timeval end_tv;
+	struct timespec end;
+	int64_t cpu_start;
+	int64_t cpu_us;
+	int res = AST_TEST_PASS;
+	int started = 0;
+	int i;
+
+	if (!(dials = ast_calloc(count, sizeof(*dials)))) {
+		return AST_TEST_FAIL;
+	}
+
+	bench_reset();
+	cpu_start = bench_cpu_us();
+	for (i = 0; i < count; ++i) {
+		if (!(dials[i] = ast_dial_create())) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (ast_dial_append(dials[i], BENCH_CHANNEL_TYPE, BENCH_ANSWER, NULL) == -1) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+		ast_dial_set_global_timeout(dials[i], BENCH_TIMEOUT_SECONDS * 1000);
+		ast_dial_set_state_callback(dials[i], bench_parallel_state);
+		if (ast_dial_run(dials[i], NULL, 1) != AST_DIAL_RESULT_TRYING) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+		started++;
+	}
+	if (res != AST_TEST_PASS) {
+		ast_test_status_update(test, "parallel: only %d of %d dials started\n", started, count);
+	}
+
+	end_tv = ast_tvadd(bench.start, ast_samp2tv(BENCH_TIMEOUT_SECONDS, 1));
+	end.tv_sec = end_tv.tv_sec;
+	end.tv_nsec = end_tv.tv_usec * 1000;
+
+	ast_mutex_lock(&bench.lock);
+	while (bench.answered < started) {
+		if (ast_cond_timedwait(&bench.cond, &bench.lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	if (bench.answered < started) {
+		ast_test_status_update(test, "parallel: only %d of %d dials answered\n",
+			bench.answered, started);
+		res = AST_TEST_FAIL;
+	}
+	ast_mutex_unlock(&bench.lock);
+	answered = ast_tvnow();
+	cpu_us = bench_cpu_us() - cpu_start;
+
+	for (i = 0; i < count; ++i) {
+		if (dials[i]) {
+			ast_dial_join(dials[i]);
+			ast_dial_destroy(dials[i]);
+		}
+	}
+	ast_free(dials);
+
+	bench_report(test, "parallel", count, count, ast_tvdiff_us(answered, bench.start), cpu_us,
+		ast_tvdiff_us(ast_tvnow(), answered));
+
+	return res;
+}
+
+AST_TEST_DEFINE(forking)
+{
+	int res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark a dial forking to many endpoints";
+		info->description = "Measure how long one dial takes to call 1, 10, 100\n"
+			"and 255 endpoints and see the last of them answer, and the\n"
+			"CPU time it uses.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < ARRAY_LEN(bench_fork_counts); ++i) {
+		if (bench_fork(test, bench_fork_counts[i]) != AST_TEST_PASS) {
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(parallel)
+{
+	int res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark many dials run at once";
+		info->description = "Measure how long 1, 10, 100 and 1000 asynchronous\n"
+			"dials of one endpoint each take to be answered, and the CPU\n"
+			"time they use.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < ARRAY_LEN(bench_dial_counts); ++i) {
+		if (bench_parallel(test, bench_dial_counts[i]) != AST_TEST_PASS) {
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	return res;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(forking);
+	AST_TEST_UNREGISTER(parallel);
+	ast_channel_unregister(&bench_tech);
+	ao2_cleanup(bench_tech.capabilities);
+	bench_tech.capabilities = NULL;
+	ast_mutex_destroy(&bench.lock);
+	ast_cond_destroy(&bench.cond);
+	return 0;
+}
+
+static int load_module(void)
+{
+	if (!(bench_tech.capabilities = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_format_cap_append(bench_tech.capabilities, ast_format_slin, 0);
+
+	if (ast_channel_register(&bench_tech)) {
+		ao2_ref(bench_tech.capabilities, -1);
+		bench_tech.capabilities = NULL;
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_mutex_init(&bench.lock);
+	ast_cond_init(&bench.cond, NULL);
+
+	AST_TEST_REGISTER(forking);
+	AST_TEST_REGISTER(parallel);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Dialing benchmarks");
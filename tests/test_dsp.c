@@ -0,0 +1,347 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief DSP tone and silence detection tests
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include <math.h>
+
+#include "asterisk/utils.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/dsp.h"
+#include "asterisk/frame.h"
+#include "asterisk/format_cache.h"
+
+/*! \brief Every kernel that may be built */
+static const char *kernels[] = { "c", "sse2", "avx2", "neon" };
+
+#define SAMPLE_RATE 8000
+
+/*! \brief Samples in each frame fed to the DSP */
+#define FRAME_SAMPLES 160
+
+/*! \brief Longest signal a test generates, 5 seconds */
+#define MAX_SAMPLES (SAMPLE_RATE * 5)
+
+/*! \brief Average magnitude below which a frame is silent */
+#define SILENCE_THRESHOLD 256
+
+/*! \brief Peak amplitude of each tone */
+#define TONE_AMPLITUDE 8000
+
+struct tone_pair {
+	char digit;
+	float low;
+	float high;
+	/*! Length of the tone in milliseconds */
+	int ms;
+};
+
+static const struct tone_pair dtmf_digits[] = {
+	{ '1', 697, 1209, 60 }, { '2', 697, 1336, 60 }, { '3', 697, 1477, 60 }, { 'A', 697, 1633, 60 },
+	{ '4', 770, 1209, 60 }, { '5', 770, 1336, 60 }, { '6', 770, 1477, 60 }, { 'B', 770, 1633, 60 },
+	{ '7', 852, 1209, 60 }, { '8', 852, 1336, 60 }, { '9', 852, 1477, 60 }, { 'C', 852, 1633, 60 },
+	{ '*', 941, 1209, 60 }, { '0', 941, 1336, 60 }, { '#', 941, 1477, 60 }, { 'D', 941, 1633, 60 },
+};
+
+/*! \brief KP needs a longer tone than the other MF digits */
+static const struct tone_pair mf_digits[] = {
+	{ '*', 1100, 1700, 100 },
+	{ '1', 700, 900, 70 }, { '2', 700, 1100, 70 }, { '3', 900, 1100, 70 }, { '4', 700, 1300, 70 },
+	{ '5', 900, 1300, 70 }, { '6', 1100, 1300, 70 }, { '7', 700, 1500, 70 }, { '8', 900, 1500, 70 },
+	{ '9', 1100, 1500, 70 }, { '0', 1300, 1500, 70 }, { '#', 1500, 1700, 70 },
+};
+
+/*!
+ * \brief Generate each digit followed by a gap, over a little noise
+ *
+ * \return The number of samples generated
+ */
+static int generate_digits(short *buf, const struct tone_pair *digits, int count, int gap_ms)
+{
+	int samples = 0;
+	int d;
+	int i;
+
+	for (d = 0; d < count; ++d) {
+		int tone = digits[d].ms * SAMPLE_RATE / 1000;
+
+		for (i = 0; i < tone; ++i) {
+			buf[samples + i] = TONE_AMPLITUDE * sin(2.0 * M_PI * digits[d].low * i / SAMPLE_RATE)
+				+ TONE_AMPLITUDE * sin(2.0 * M_PI * digits[d].high * i / SAMPLE_RATE);
+		}
+		samples += tone;
+		memset(buf + samples, 0, gap_ms * SAMPLE_RATE / 1000 * sizeof(*buf));
+		samples += gap_ms * SAMPLE_RATE / 1000;
+	}
+	/* Leave enough silence at the end for the last digit to finish */
+	memset(buf + samples, 0, 200 * SAMPLE_RATE / 1000 * sizeof(*buf));
+	samples += 200 * SAMPLE_RATE / 1000;
+
+	for (i = 0; i < samples; ++i) {
+		buf[i] += (ast_random() % 200) - 100;
+	}
+
+	return samples;
+}
+
+/*!
+ * \brief Feed a signal to a DSP frame by frame and collect the digits it ends
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int detect_digits(const short *buf, int samples, int digitmode, struct ast_str **digits)
+{
+	struct ast_dsp *dsp;
+	int offset;
+
+	dsp = ast_dsp_new_with_rate(SAMPLE_RATE);
+	if (!dsp) {
+		return -1;
+	}
+	ast_dsp_set_features(dsp, DSP_FEATURE_DIGIT_DETECT);
+	ast_dsp_set_digitmode(dsp, digitmode);
+
+	ast_str_reset(*digits);
+	for (offset = 0; offset + FRAME_SAMPLES <= samples; offset += FRAME_SAMPLES) {
+		struct ast_frame frame = {
+			.frametype = AST_FRAME_VOICE,
+			.subclass.format = ast_format_slin,
+			.data.ptr = (void *) (buf + offset),
+			.datalen = FRAME_SAMPLES * sizeof(*buf),
+			.samples = FRAME_SAMPLES,
+			.src = "test_dsp",
+		};
+		struct ast_frame *in;
+		struct ast_frame *out;
+
+		/* The DSP mutes detected digits in the frame, and frees it when it reports one */
+		in = ast_frdup(&frame);
+		if (!in) {
+			ast_dsp_free(dsp);
+			return -1;
+		}
+		out = ast_dsp_process(NULL, dsp, in);
+		if (!out) {
+			continue;
+		}
+		if (out->frametype == AST_FRAME_DTMF_END) {
+			ast_str_append(digits, 0, "%c", out->subclass.integer);
+		}
+		ast_frfree(out);
+	}
+
+	ast_dsp_free(dsp);
+
+	return 0;
+}
+
+/*! \brief Detect the digits with each kernel the CPU can run */
+static enum ast_test_result_state test_kernels(struct ast_test *test,
+	const struct tone_pair *tones, int count, int gap_ms, int digitmode)
+{
+	RAII_VAR(short *, buf, NULL, ast_free);
+	RAII_VAR(struct ast_str *, expected, ast_str_create(32), ast_free);
+	RAII_VAR(struct ast_str *, digits, ast_str_create(32), ast_free);
+	const char *original = ast_dsp_kernel();
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int samples;
+	int k;
+	int d;
+
+	buf = ast_malloc(MAX_SAMPLES * sizeof(*buf));
+	if (!buf || !expected || !digits) {
+		return AST_TEST_FAIL;
+	}
+
+	for (d = 0; d < count; ++d) {
+		ast_str_append(&expected, 0, "%c", tones[d].digit);
+	}
+	samples = generate_digits(buf, tones, count, gap_ms);
+
+	for (k = 0; k < ARRAY_LEN(kernels); ++k) {
+		if (ast_dsp_use_kernel(kernels[k])) {
+			ast_test_status_update(test, "Skipping the %s kernel\n", kernels[k]);
+			continue;
+		}
+
+		if (detect_digits(buf, samples, digitmode, &digits)) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (strcmp(ast_str_buffer(digits), ast_str_buffer(expected))) {
+			ast_test_status_update(test, "The %s kernel detected '%s' instead of '%s'\n",
+				kernels[k], ast_str_buffer(digits), ast_str_buffer(expected));
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	ast_dsp_use_kernel(original);
+
+	return res;
+}
+
+AST_TEST_DEFINE(dtmf_kernels)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "dtmf_kernels";
+		info->category = "/main/dsp/";
+		info->summary = "Verify DTMF detection with each DSP kernel";
+		info->description =
+			"Generates every DTMF digit over a little noise and checks each DSP\n"
+			"kernel the CPU can run detects all of them in order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return test_kernels(test, dtmf_digits, ARRAY_LEN(dtmf_digits), 60, DSP_DIGITMODE_DTMF);
+}
+
+AST_TEST_DEFINE(mf_kernels)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "mf_kernels";
+		info->category = "/main/dsp/";
+		info->summary = "Verify MF detection with each DSP kernel";
+		info->description =
+			"Generates every MF digit over a little noise and checks each DSP\n"
+			"kernel the CPU can run detects all of them in order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return test_kernels(test, mf_digits, ARRAY_LEN(mf_digits), 70, DSP_DIGITMODE_MF);
+}
+
+AST_TEST_DEFINE(silence_kernels)
+{
+	/* Frame sizes of 20ms at 8, 16 and 48kHz, and one that is no multiple of a vector */
+	static const int lengths[] = { 160, 320, 960, 37 };
+	short buf[960];
+	const char *original = ast_dsp_kernel();
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int k;
+	int l;
+	int n;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "silence_kernels";
+		info->category = "/main/dsp/";
+		info->summary = "Verify silence detection with each DSP kernel";
+		info->description =
+			"Feeds frames of varying loudness around the silence threshold to each DSP\n"
+			"kernel the CPU can run and checks the energy and silence decision match\n"
+			"the average magnitude of the samples.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (k = 0; k < ARRAY_LEN(kernels); ++k) {
+		if (ast_dsp_use_kernel(kernels[k])) {
+			ast_test_status_update(test, "Skipping the %s kernel\n", kernels[k]);
+			continue;
+		}
+
+		for (l = 0; l < ARRAY_LEN(lengths); ++l) {
+			for (n = 0; n < 100; ++n) {
+				struct ast_frame frame = {
+					.frametype = AST_FRAME_VOICE,
+					.subclass.format = ast_format_slin,
+					.data.ptr = buf,
+					.datalen = lengths[l] * sizeof(*buf),
+					.samples = lengths[l],
+				};
+				/* Mostly quiet frames, so the sum is near the threshold, with a few full scale ones */
+				int peak = n % 10 ? 2 * SILENCE_THRESHOLD : 32768;
+				struct ast_dsp *dsp;
+				int expected = 0;
+				int energy;
+				int total;
+				int silent;
+
+				for (i = 0; i < lengths[l]; ++i) {
+					buf[i] = (ast_random() % (2 * peak)) - peak;
+					expected += abs(buf[i]);
+				}
+				expected /= lengths[l];
+
+				dsp = ast_dsp_new();
+				if (!dsp) {
+					return AST_TEST_FAIL;
+				}
+				ast_dsp_set_threshold(dsp, SILENCE_THRESHOLD);
+				silent = ast_dsp_silence_with_energy(dsp, &frame, &total, &energy);
+				if (energy != expected || silent != (expected < SILENCE_THRESHOLD)) {
+					ast_test_status_update(test, "The %s kernel found energy %d and silence %d instead of %d and %d\n",
+						kernels[k], energy, silent, expected, expected < SILENCE_THRESHOLD);
+					res = AST_TEST_FAIL;
+				}
+				/* Without the energy the sum may stop early, but the decision must not change */
+				silent = ast_dsp_silence(dsp, &frame, &total);
+				if (silent != (expected < SILENCE_THRESHOLD)) {
+					ast_test_status_update(test, "The %s kernel found silence %d instead of %d\n",
+						kernels[k], silent, expected < SILENCE_THRESHOLD);
+					res = AST_TEST_FAIL;
+				}
+				ast_dsp_free(dsp);
+			}
+		}
+	}
+
+	ast_dsp_use_kernel(original);
+
+	return res;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(dtmf_kernels);
+	AST_TEST_UNREGISTER(mf_kernels);
+	AST_TEST_UNREGISTER(silence_kernels);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(dtmf_kernels);
+	AST_TEST_REGISTER(mf_kernels);
+	AST_TEST_REGISTER(silence_kernels);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "DSP Tone and Silence Detection Tests");
@@ -39,6 +39,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/frame.h"
 #include "asterisk/format.h"
 #include "asterisk/format_cap.h"
+#include "asterisk/format_cache.h"
 
 AST_TEST_DEFINE(format_cap_alloc)
 {
@@ -1424,6 +1425,104 @@ AST_TEST_DEFINE(format_cap_replace_from_cap)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(format_cap_intern)
+{
+	RAII_VAR(struct ast_format_cap *, caps1, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, caps2, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, other_caps, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, interned1, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, interned2, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, other_interned, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, compatible_caps, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format *, format, NULL, ao2_cleanup);
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "format_cap_intern";
+		info->category = "/main/format_cap/";
+		info->summary = "format capabilities interning unit test";
+		info->description =
+			"Test that equal capabilities structures are interned once and that\n"
+			"negotiating between interned ones gives the same result every time";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	caps1 = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	caps2 = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	other_caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!caps1 || !caps2 || !other_caps) {
+		ast_test_status_update(test, "Could not allocate an empty format capabilities structure\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_format_cap_append(caps1, ast_format_ulaw, 0)
+		|| ast_format_cap_append(caps1, ast_format_alaw, 0)
+		|| ast_format_cap_append(other_caps, ast_format_ulaw, 0)
+		|| ast_format_cap_append(other_caps, ast_format_alaw, 0)
+		|| ast_format_cap_append(caps2, ast_format_gsm, 0)
+		|| ast_format_cap_append(caps2, ast_format_alaw, 0)) {
+		ast_test_status_update(test, "Could not add formats to capabilities\n");
+		return AST_TEST_FAIL;
+	}
+
+	interned1 = ast_format_cap_intern(caps1);
+	other_interned = ast_format_cap_intern(other_caps);
+	interned2 = ast_format_cap_intern(caps2);
+	if (!interned1 || !other_interned || !interned2) {
+		ast_test_status_update(test, "Could not intern capabilities\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_format_cap_get_intern_id(caps1) || !ast_format_cap_get_intern_id(interned1)) {
+		ast_test_status_update(test, "Only the interned capabilities should have an identifier\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (interned1 != other_interned) {
+		ast_test_status_update(test, "Equal capabilities were interned separately\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (interned1 == interned2 || !ast_format_cap_identical(interned1, caps1)) {
+		ast_test_status_update(test, "Interned capabilities differ from the original ones\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* The first negotiation computes the joint formats, the second remembers them */
+	for (i = 0; i < 2; i++) {
+		ao2_cleanup(compatible_caps);
+		compatible_caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+		if (!compatible_caps) {
+			ast_test_status_update(test, "Could not allocate an empty format capabilities structure\n");
+			return AST_TEST_FAIL;
+		}
+
+		if (!ast_format_cap_iscompatible(interned1, interned2)) {
+			ast_test_status_update(test, "Interned capabilities should be compatible\n");
+			return AST_TEST_FAIL;
+		}
+
+		ast_format_cap_get_compatible(interned1, interned2, compatible_caps);
+		if (ast_format_cap_count(compatible_caps) != 1) {
+			ast_test_status_update(test, "Expected 1 compatible format but got %zu\n",
+				ast_format_cap_count(compatible_caps));
+			return AST_TEST_FAIL;
+		}
+
+		ao2_cleanup(format);
+		format = ast_format_cap_get_format(compatible_caps, 0);
+		if (ast_format_cmp(format, ast_format_alaw) != AST_FORMAT_CMP_EQUAL) {
+			ast_test_status_update(test, "Compatible format should be alaw\n");
+			return AST_TEST_FAIL;
+		}
+	}
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(format_cap_alloc);
@@ -1446,6 +1545,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(format_cap_iscompatible);
 	AST_TEST_UNREGISTER(format_cap_best_by_type);
 	AST_TEST_UNREGISTER(format_cap_replace_from_cap);
+	AST_TEST_UNREGISTER(format_cap_intern);
 	return 0;
 }
 
@@ -1471,6 +1571,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(format_cap_iscompatible);
 	AST_TEST_REGISTER(format_cap_best_by_type);
 	AST_TEST_REGISTER(format_cap_replace_from_cap);
+	AST_TEST_REGISTER(format_cap_intern);
 	ast_codec_register(&test_law);
 	ast_format_interface_register("test_law", &test_law_interface);
 	return AST_MODULE_LOAD_SUCCESS;
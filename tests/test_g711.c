@@ -0,0 +1,196 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief G.711 conversion tests
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/utils.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/ulaw.h"
+#include "asterisk/alaw.h"
+
+/*! \brief Every kernel that may be built */
+static const char *kernels[] = { "c", "sse4.1", "avx2", "neon" };
+
+/*!
+ * \brief Every 16 bit sample, plus a few so the tail of a block is converted too
+ */
+#define LINEAR_SAMPLES (65536 + 5)
+
+/*! \brief Every code, plus a few so the tail of a block is converted too */
+#define CODE_SAMPLES (256 + 5)
+
+AST_TEST_DEFINE(ulaw_kernels)
+{
+	RAII_VAR(short *, linear, NULL, ast_free);
+	RAII_VAR(unsigned char *, codes, NULL, ast_free);
+	const char *original = ast_ulaw_kernel();
+	int res = AST_TEST_PASS;
+	int i;
+	int k;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "ulaw_kernels";
+		info->category = "/main/g711/";
+		info->summary = "Verify block mu-law conversion";
+		info->description =
+			"Converts every sample and every code with each mu-law kernel the CPU\n"
+			"can run and checks they match the lookup tables.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	linear = ast_malloc(LINEAR_SAMPLES * sizeof(*linear));
+	codes = ast_malloc(LINEAR_SAMPLES);
+	if (!linear || !codes) {
+		return AST_TEST_FAIL;
+	}
+
+	for (k = 0; k < ARRAY_LEN(kernels); ++k) {
+		if (ast_ulaw_use_kernel(kernels[k])) {
+			ast_test_status_update(test, "Skipping the %s kernel\n", kernels[k]);
+			continue;
+		}
+
+		for (i = 0; i < LINEAR_SAMPLES; ++i) {
+			linear[i] = (short) i;
+		}
+		ast_ulaw_encode(codes, linear, LINEAR_SAMPLES);
+		for (i = 0; i < LINEAR_SAMPLES; ++i) {
+			if (codes[i] != AST_LIN2MU(linear[i])) {
+				ast_test_status_update(test, "The %s kernel encoded %d as %u instead of %u\n",
+					kernels[k], linear[i], codes[i], AST_LIN2MU(linear[i]));
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+
+		for (i = 0; i < CODE_SAMPLES; ++i) {
+			codes[i] = (unsigned char) i;
+		}
+		ast_ulaw_decode(linear, codes, CODE_SAMPLES);
+		for (i = 0; i < CODE_SAMPLES; ++i) {
+			if (linear[i] != AST_MULAW(codes[i])) {
+				ast_test_status_update(test, "The %s kernel decoded %u as %d instead of %d\n",
+					kernels[k], codes[i], linear[i], AST_MULAW(codes[i]));
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+	}
+
+	ast_ulaw_use_kernel(original);
+
+	return res;
+}
+
+AST_TEST_DEFINE(alaw_kernels)
+{
+	RAII_VAR(short *, linear, NULL, ast_free);
+	RAII_VAR(unsigned char *, codes, NULL, ast_free);
+	const char *original = ast_alaw_kernel();
+	int res = AST_TEST_PASS;
+	int i;
+	int k;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "alaw_kernels";
+		info->category = "/main/g711/";
+		info->summary = "Verify block A-law conversion";
+		info->description =
+			"Converts every sample and every code with each A-law kernel the CPU\n"
+			"can run and checks they match the lookup tables.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	linear = ast_malloc(LINEAR_SAMPLES * sizeof(*linear));
+	codes = ast_malloc(LINEAR_SAMPLES);
+	if (!linear || !codes) {
+		return AST_TEST_FAIL;
+	}
+
+	for (k = 0; k < ARRAY_LEN(kernels); ++k) {
+		if (ast_alaw_use_kernel(kernels[k])) {
+			ast_test_status_update(test, "Skipping the %s kernel\n", kernels[k]);
+			continue;
+		}
+
+		for (i = 0; i < LINEAR_SAMPLES; ++i) {
+			linear[i] = (short) i;
+		}
+		ast_alaw_encode(codes, linear, LINEAR_SAMPLES);
+		for (i = 0; i < LINEAR_SAMPLES; ++i) {
+			if (codes[i] != AST_LIN2A(linear[i])) {
+				ast_test_status_update(test, "The %s kernel encoded %d as %u instead of %u\n",
+					kernels[k], linear[i], codes[i], AST_LIN2A(linear[i]));
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+
+		for (i = 0; i < CODE_SAMPLES; ++i) {
+			codes[i] = (unsigned char) i;
+		}
+		ast_alaw_decode(linear, codes, CODE_SAMPLES);
+		for (i = 0; i < CODE_SAMPLES; ++i) {
+			if (linear[i] != AST_ALAW(codes[i])) {
+				ast_test_status_update(test, "The %s kernel decoded %u as %d instead of %d\n",
+					kernels[k], codes[i], linear[i], AST_ALAW(codes[i]));
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+	}
+
+	ast_alaw_use_kernel(original);
+
+	return res;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(ulaw_kernels);
+	AST_TEST_UNREGISTER(alaw_kernels);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(ulaw_kernels);
+	AST_TEST_REGISTER(alaw_kernels);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "G.711 Conversion Tests");
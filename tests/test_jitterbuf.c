@@ -454,6 +454,93 @@ cleanup:
 	return result;
 }
 
+AST_TEST_DEFINE(jitterbuffer_reversed_voice)
+{
+	enum ast_test_result_state result = AST_TEST_FAIL;
+	struct jitterbuf *jb = NULL;
+	struct jb_frame frame;
+	struct jb_info jbinfo;
+	struct jb_conf jbconf;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "jitterbuffer_reversed_voice";
+		info->category = "/main/jitterbuf/";
+		info->summary = "Tests sending audio frames to a jitter buffer in reversed blocks";
+		info->description =
+			"Frames are sent to a jitter buffer in blocks of 8, each block in "
+			"reverse order, so that most of them are inserted before frames already "
+			"queued.  The expected result is to have a jitter buffer with the frames "
+			"in order, while 7 frames of each block should be recorded as having been "
+			"received out of order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	JB_TEST_BEGIN("jitterbuffer_reversed_voice");
+
+	if (!(jb = jb_new())) {
+		ast_test_status_update(test, "Failed to allocate memory for jitterbuffer\n");
+		goto cleanup;
+	}
+
+	test_jb_populate_config(&jbconf);
+	if (jb_setconf(jb, &jbconf) != JB_OK) {
+		ast_test_status_update(test, "Failed to set jitterbuffer configuration\n");
+		goto cleanup;
+	}
+
+	for (i = 0; i < 40; i++) {
+		int seq = (i / 8) * 8 + 7 - (i % 8);
+
+		if (jb_put(jb, NULL, JB_TYPE_VOICE, 20, seq * 20, seq * 20 + 5) == JB_DROP) {
+			ast_test_status_update(test, "Jitter buffer dropped packet %d\n", seq);
+			goto cleanup;
+		}
+	}
+
+	for (i = 0; i < 40; i++) {
+		enum jb_return_code ret;
+		/* We should have a frame for each point in time */
+		if ((ret = jb_get(jb, &frame, i * 20 + 5, DEFAULT_CODEC_INTERP_LEN)) != JB_OK) {
+			ast_test_status_update(test,
+				"Unexpected jitter buffer return code [%s] when retrieving frame %d\n",
+				jitter_buffer_return_codes[ret], i);
+			goto cleanup;
+		}
+		JB_NUMERIC_TEST(frame.ms, 20);
+		JB_NUMERIC_TEST(frame.ts, i * 20 - jb->info.resync_offset);
+	}
+
+	if (jb_getinfo(jb, &jbinfo) != JB_OK) {
+		ast_test_status_update(test, "Failed to get jitterbuffer information\n");
+		goto cleanup;
+	}
+	JB_INFO_PRINT_FRAME_DEBUG(jbinfo);
+	JB_NUMERIC_TEST(jbinfo.frames_dropped, 0);
+	JB_NUMERIC_TEST(jbinfo.frames_in, 40);
+	JB_NUMERIC_TEST(jbinfo.frames_out, 40);
+	JB_NUMERIC_TEST(jbinfo.frames_late, 0);
+	JB_NUMERIC_TEST(jbinfo.frames_lost, 0);
+	JB_NUMERIC_TEST(jbinfo.frames_ooo, 35);
+
+	result = AST_TEST_PASS;
+
+cleanup:
+	if (jb) {
+		/* No need to do anything - this will put all frames on the 'free' list,
+		 * so jb_destroy will dispose of them */
+		while (jb_getall(jb, &frame) == JB_OK) { }
+		jb_destroy(jb);
+	}
+
+	JB_TEST_END;
+
+	return result;
+}
+
 AST_TEST_DEFINE(jitterbuffer_out_of_order_control)
 {
 	enum ast_test_result_state result = AST_TEST_FAIL;
@@ -1241,6 +1328,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(jitterbuffer_nominal_control_frames);
 	AST_TEST_UNREGISTER(jitterbuffer_out_of_order_voice);
 	AST_TEST_UNREGISTER(jitterbuffer_out_of_order_control);
+	AST_TEST_UNREGISTER(jitterbuffer_reversed_voice);
 	AST_TEST_UNREGISTER(jitterbuffer_lost_voice);
 	AST_TEST_UNREGISTER(jitterbuffer_lost_control);
 	AST_TEST_UNREGISTER(jitterbuffer_late_voice);
@@ -1261,6 +1349,7 @@ static int load_module(void)
 	/* Out of order frame arrival */
 	AST_TEST_REGISTER(jitterbuffer_out_of_order_voice);
 	AST_TEST_REGISTER(jitterbuffer_out_of_order_control);
+	AST_TEST_REGISTER(jitterbuffer_reversed_voice);
 
 	/* Lost frame arrival */
 	AST_TEST_REGISTER(jitterbuffer_lost_voice);
@@ -1690,6 +1690,130 @@ AST_TEST_DEFINE(json_test_cep)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(json_test_writer)
+{
+	RAII_VAR(struct ast_json *, uut, NULL, ast_json_unref);
+	RAII_VAR(struct ast_str *, written, NULL, ast_free);
+	RAII_VAR(struct ast_str *, dumped, NULL, ast_free);
+	RAII_VAR(struct ast_json *, parsed, NULL, ast_json_unref);
+	struct ast_json_writer writer;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "writer";
+		info->category = CATEGORY;
+		info->summary = "Streamed JSON matches dumped JSON.";
+		info->description = "Test JSON abstraction library.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	uut = ast_json_pack("{s: s, s: i, s: [i, s, o, o, o, {}, []], s: {s: s, s: {s: i}}}",
+		"text", "quote \" slash \\ tab \t bell \a",
+		"number", -42,
+		"list", 1, "two", ast_json_null(), ast_json_true(), ast_json_false(),
+		"nested", "name", "v\xc3\xa4lue", "deeper", "depth", 3);
+	ast_test_validate(test, NULL != uut);
+
+	written = ast_str_create(16);
+	dumped = ast_str_create(16);
+	ast_test_validate(test, NULL != written && NULL != dumped);
+
+	/* Compact output walks the members in the same order Jansson does */
+	ast_json_writer_init(&writer, &written, AST_JSON_COMPACT);
+	ast_test_validate(test, 0 == ast_json_writer_value(&writer, uut));
+	ast_test_validate(test, 0 == ast_json_dump_str_format(uut, &dumped, AST_JSON_COMPACT));
+	ast_test_validate(test, 0 == strcmp(ast_str_buffer(dumped), ast_str_buffer(written)));
+
+	/* Pretty output may order members differently, so compare what it reads back as */
+	ast_str_reset(written);
+	ast_json_writer_init(&writer, &written, AST_JSON_PRETTY);
+	ast_test_validate(test, 0 == ast_json_writer_value(&writer, uut));
+	parsed = ast_json_load_str(written, NULL);
+	ast_test_validate(test, ast_json_equal(uut, parsed));
+
+	/* Members written one at a time */
+	ast_str_reset(written);
+	ast_json_writer_init(&writer, &written, AST_JSON_COMPACT);
+	ast_json_writer_object_start(&writer);
+	ast_json_writer_key(&writer, "a");
+	ast_json_writer_integer(&writer, 1);
+	ast_json_writer_key(&writer, "b");
+	ast_json_writer_array_start(&writer);
+	ast_json_writer_null(&writer);
+	ast_json_writer_string(&writer, "c");
+	ast_json_writer_array_end(&writer);
+	ast_test_validate(test, 0 == ast_json_writer_object_end(&writer));
+	ast_test_validate(test, 0 == strcmp("{\"a\":1,\"b\":[null,\"c\"]}", ast_str_buffer(written)));
+
+	/* Invalid UTF-8 fails, and stays failed */
+	ast_str_reset(written);
+	ast_json_writer_init(&writer, &written, AST_JSON_COMPACT);
+	ast_json_writer_array_start(&writer);
+	ast_test_validate(test, -1 == ast_json_writer_string(&writer, "\xc3"));
+	ast_test_validate(test, -1 == ast_json_writer_array_end(&writer));
+
+	/* Unbalanced ends fail */
+	ast_str_reset(written);
+	ast_json_writer_init(&writer, &written, AST_JSON_COMPACT);
+	ast_test_validate(test, -1 == ast_json_writer_object_end(&writer));
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(json_test_arena)
+{
+	struct ast_json *uut;
+	struct ast_json *copy;
+	struct ast_json *kept;
+	unsigned int depth;
+	char *str;
+	int res;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "arena";
+		info->category = CATEGORY;
+		info->summary = "JSON allocated from an arena.";
+		info->description = "Test JSON abstraction library.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_json_arena_begin();
+	uut = ast_json_pack("{s: s, s: i, s: [i, s]}", "text", "value", "number", 42, "list", 1, "two");
+	copy = ast_json_deep_copy(uut);
+	ast_json_object_set(copy, "added", ast_json_string_create("more"));
+
+	/* Nested scopes use the same arena */
+	ast_json_arena_begin();
+	str = ast_json_dump_string(copy);
+	ast_json_arena_end();
+
+	/* Suspended, allocations outlive the scope */
+	depth = ast_json_arena_suspend();
+	kept = ast_json_deep_copy(uut);
+	ast_json_arena_resume(depth);
+
+	res = uut && copy && str
+		&& !strcmp("value", ast_json_string_get(ast_json_object_get(copy, "text")))
+		&& !strcmp("more", ast_json_string_get(ast_json_object_get(copy, "added")))
+		&& ast_json_equal(uut, kept);
+
+	ast_json_free(str);
+	ast_json_unref(copy);
+	ast_json_unref(uut);
+	ast_json_arena_end();
+
+	ast_test_validate(test, res);
+	ast_test_validate(test, 42 == ast_json_integer_get(ast_json_object_get(kept, "number")));
+	ast_json_unref(kept);
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(json_test_false);
@@ -1743,6 +1867,8 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(json_test_name_number);
 	AST_TEST_UNREGISTER(json_test_timeval);
 	AST_TEST_UNREGISTER(json_test_cep);
+	AST_TEST_UNREGISTER(json_test_writer);
+	AST_TEST_UNREGISTER(json_test_arena);
 	return 0;
 }
 
@@ -1799,6 +1925,8 @@ static int load_module(void)
 	AST_TEST_REGISTER(json_test_name_number);
 	AST_TEST_REGISTER(json_test_timeval);
 	AST_TEST_REGISTER(json_test_cep);
+	AST_TEST_REGISTER(json_test_writer);
+	AST_TEST_REGISTER(json_test_arena);
 
 	ast_test_register_init(CATEGORY, json_test_init);
 	ast_test_register_cleanup(CATEGORY, json_test_cleanup);
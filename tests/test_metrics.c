@@ -0,0 +1,212 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Prometheus metrics tests
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/metrics.h"
+#include "asterisk/module.h"
+#include "asterisk/strings.h"
+#include "asterisk/test.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/main/metrics/";
+
+/*!
+ * \internal
+ * \brief Check that rendered metrics contain a line
+ */
+static int render_has(struct ast_test *test, struct ast_str *buf, const char *line)
+{
+	if (!strstr(ast_str_buffer(buf), line)) {
+		ast_test_status_update(test, "Missing '%s' in:\n%s\n", line, ast_str_buffer(buf));
+		return 0;
+	}
+	return 1;
+}
+
+AST_TEST_DEFINE(metrics_render)
+{
+	static const double bounds[] = { 0.01, 0.1, 1 };
+	struct ast_metric *counter;
+	struct ast_metric *gauge;
+	struct ast_metric *histogram;
+	struct ast_str *buf;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "render";
+		info->category = test_category;
+		info->summary = "Render counters, gauges and histograms";
+		info->description = "Create metrics of each type, update them and\n"
+			"check the Prometheus text format they are rendered in.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	counter = ast_metric_counter_create("test_metrics_events_total", "Events counted by the test");
+	gauge = ast_metric_gauge_create("test_metrics_level", "Level set by the test");
+	histogram = ast_metric_histogram_create("test_metrics_latency_seconds", "Latency observed by the test",
+		bounds, ARRAY_LEN(bounds));
+	buf = ast_str_create(4096);
+	if (!counter || !gauge || !histogram || !buf) {
+		ast_test_status_update(test, "Failed to create the metrics\n");
+		goto end;
+	}
+
+	if (ast_metric_counter_create("test_metrics_events_total", NULL)) {
+		ast_test_status_update(test, "Created a metric with a name in use\n");
+		goto end;
+	}
+	if (ast_metric_gauge_create("test metrics", NULL)) {
+		ast_test_status_update(test, "Created a metric with an invalid name\n");
+		goto end;
+	}
+
+	ast_metric_add(counter, 3);
+	ast_metric_add(counter, 2);
+	ast_metric_set(gauge, 7);
+	ast_metric_add(gauge, -2);
+	ast_metric_observe(histogram, 0.005);
+	ast_metric_observe(histogram, 0.05);
+	ast_metric_observe(histogram, 0.06);
+	ast_metric_observe(histogram, 5);
+
+	ast_metrics_render(&buf);
+
+	if (!render_has(test, buf, "# HELP test_metrics_events_total Events counted by the test\n")
+		|| !render_has(test, buf, "# TYPE test_metrics_events_total counter\n")
+		|| !render_has(test, buf, "\ntest_metrics_events_total 5\n")
+		|| !render_has(test, buf, "# TYPE test_metrics_level gauge\n")
+		|| !render_has(test, buf, "\ntest_metrics_level 5\n")
+		|| !render_has(test, buf, "# TYPE test_metrics_latency_seconds histogram\n")
+		|| !render_has(test, buf, "test_metrics_latency_seconds_bucket{le=\"0.01\"} 1\n")
+		|| !render_has(test, buf, "test_metrics_latency_seconds_bucket{le=\"0.1\"} 3\n")
+		|| !render_has(test, buf, "test_metrics_latency_seconds_bucket{le=\"1\"} 3\n")
+		|| !render_has(test, buf, "test_metrics_latency_seconds_bucket{le=\"+Inf\"} 4\n")
+		|| !render_has(test, buf, "test_metrics_latency_seconds_sum 5.115\n")
+		|| !render_has(test, buf, "test_metrics_latency_seconds_count 4\n")) {
+		goto end;
+	}
+
+	ast_metric_destroy(counter);
+	counter = NULL;
+	ast_str_reset(buf);
+	ast_metrics_render(&buf);
+	if (strstr(ast_str_buffer(buf), "test_metrics_events_total")) {
+		ast_test_status_update(test, "Destroyed metric was rendered\n");
+		goto end;
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	ast_metric_destroy(counter);
+	ast_metric_destroy(gauge);
+	ast_metric_destroy(histogram);
+	ast_free(buf);
+	return res;
+}
+
+static void test_collector(struct ast_metrics_output *out)
+{
+	ast_metrics_output_family(out, "test_metrics_collected", AST_METRIC_GAUGE,
+		"Collected by the test\nacross lines");
+	ast_metrics_output_sample(out, "test_metrics_collected", "name", "plain", 1);
+	ast_metrics_output_sample(out, "test_metrics_collected", "name", "a \"quoted\\\" name", 2);
+	ast_metrics_output_sample(out, "test_metrics_collected", NULL, NULL, 1234567);
+}
+
+AST_TEST_DEFINE(metrics_collector)
+{
+	struct ast_str *buf;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "collector";
+		info->category = test_category;
+		info->summary = "Render the samples of a collector";
+		info->description = "Register a collector and check its samples are\n"
+			"rendered with their labels escaped, and not once it is unregistered.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(buf = ast_str_create(4096))) {
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_metrics_collector_register("test", test_collector)) {
+		ast_test_status_update(test, "Failed to register the collector\n");
+		goto end;
+	}
+	ast_metrics_render(&buf);
+	ast_metrics_collector_unregister(test_collector);
+
+	if (!render_has(test, buf, "# HELP test_metrics_collected Collected by the test\\nacross lines\n")
+		|| !render_has(test, buf, "# TYPE test_metrics_collected gauge\n")
+		|| !render_has(test, buf, "test_metrics_collected{name=\"plain\"} 1\n")
+		|| !render_has(test, buf, "test_metrics_collected{name=\"a \\\"quoted\\\\\\\" name\"} 2\n")
+		|| !render_has(test, buf, "\ntest_metrics_collected 1234567\n")) {
+		goto end;
+	}
+
+	ast_str_reset(buf);
+	ast_metrics_render(&buf);
+	if (strstr(ast_str_buffer(buf), "test_metrics_collected")) {
+		ast_test_status_update(test, "Unregistered collector was called\n");
+		goto end;
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	ast_free(buf);
+	return res;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(metrics_render);
+	AST_TEST_UNREGISTER(metrics_collector);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(metrics_render);
+	AST_TEST_REGISTER(metrics_collector);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Prometheus metrics tests");
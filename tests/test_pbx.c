@@ -38,6 +38,8 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/module.h"
 #include "asterisk/pbx.h"
 #include "asterisk/test.h"
+#include "asterisk/config.h"
+#include "asterisk/hashtab.h"
 
 /*!
  * If we determine that we really need
@@ -323,15 +325,205 @@ cleanup:
 	return res;
 }
 
+/*! \brief Check the value of a global variable, NULL if it should not be set */
+static int check_global(struct ast_test *test, const char *name, const char *expected)
+{
+	const char *value = pbx_builtin_getvar_helper(NULL, name);
+
+	if (expected ? !value || strcmp(value, expected) : !!value) {
+		ast_test_status_update(test, "Global variable %s is '%s', expected '%s'\n",
+			name, S_OR(value, "(unset)"), S_OR(expected, "(unset)"));
+		return -1;
+	}
+	return 0;
+}
+
+AST_TEST_DEFINE(global_variables_test)
+{
+	enum ast_test_result_state res = AST_TEST_PASS;
+	struct ast_variable *vars = NULL;
+	struct ast_variable *var;
+	char buf[64];
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "global_variables_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test global dialplan variables";
+		info->description = "Set, push, remove and load global variables and check\n"
+			"what each of them is afterwards.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	pbx_builtin_setvar_helper(NULL, "TEST_PBX_A", "one");
+	pbx_builtin_setvar_helper(NULL, "_TEST_PBX_B", "two");
+	if (check_global(test, "TEST_PBX_A", "one") || check_global(test, "TEST_PBX_B", "two")) {
+		res = AST_TEST_FAIL;
+	}
+
+	/* A pushed variable hides the one before it until it is removed */
+	pbx_builtin_pushvar_helper(NULL, "TEST_PBX_A", "pushed");
+	if (check_global(test, "TEST_PBX_A", "pushed")) {
+		res = AST_TEST_FAIL;
+	}
+	pbx_builtin_setvar_helper(NULL, "TEST_PBX_A", "replaced");
+	if (check_global(test, "TEST_PBX_A", "replaced")) {
+		res = AST_TEST_FAIL;
+	}
+	pbx_builtin_setvar_helper(NULL, "TEST_PBX_A", NULL);
+	if (check_global(test, "TEST_PBX_A", "one")) {
+		res = AST_TEST_FAIL;
+	}
+	pbx_builtin_setvar_helper(NULL, "TEST_PBX_A", NULL);
+	if (check_global(test, "TEST_PBX_A", NULL)) {
+		res = AST_TEST_FAIL;
+	}
+
+	/* Loaded variables see the ones loaded before them */
+	if (!(vars = ast_variable_new("TEST_PBX_C", "three", ""))
+		|| !(vars->next = ast_variable_new("TEST_PBX_B", "${TEST_PBX_C}-${TEST_PBX_B}", ""))) {
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	pbx_builtin_load_globals(vars, 0);
+	if (check_global(test, "TEST_PBX_C", "three") || check_global(test, "TEST_PBX_B", "three-two")) {
+		res = AST_TEST_FAIL;
+	}
+
+	pbx_substitute_variables_helper(NULL, "${TEST_PBX_B}/${TEST_PBX_C}", buf, sizeof(buf) - 1);
+	if (strcmp(buf, "three-two/three")) {
+		ast_test_status_update(test, "Substituted '%s', expected 'three-two/three'\n", buf);
+		res = AST_TEST_FAIL;
+	}
+
+cleanup:
+	for (var = vars; var; var = var->next) {
+		pbx_builtin_setvar_helper(NULL, var->name, NULL);
+	}
+	ast_variables_destroy(vars);
+
+	return res;
+}
+
+/*! \brief Check that an extension is in the dialplan or not */
+static int check_exten(struct ast_test *test, const char *context, const char *exten, int expected)
+{
+	if (!ast_exists_extension(NULL, context, exten, 1, NULL) == !expected) {
+		return 0;
+	}
+	ast_test_status_update(test, "Extension %s@%s is %s, expected it %s\n", exten, context,
+		expected ? "missing" : "there", expected ? "there" : "gone");
+	return -1;
+}
+
+/*!
+ * \brief Load a context of one extension the way a dialplan module reloads
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ */
+static int reload_context(const char *context, const char *exten, const char *registrar)
+{
+	struct ast_context *local_contexts = NULL;
+	struct ast_hashtab *local_table;
+	struct ast_context *con;
+
+	if (!(local_table = ast_hashtab_create(17, ast_hashtab_compare_contexts,
+		ast_hashtab_resize_java, ast_hashtab_newsize_java, ast_hashtab_hash_contexts, 0))) {
+		return -1;
+	}
+	if (!(con = ast_context_find_or_create(&local_contexts, local_table, context, registrar))
+		|| ast_add_extension2(con, 0, exten, 1, NULL, NULL, "Noop", NULL, NULL, registrar)) {
+		/* Merging nothing of ours still hands the table over to the dialplan */
+		ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
+		return -1;
+	}
+	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
+
+	return 0;
+}
+
+AST_TEST_DEFINE(merge_contexts_test)
+{
+	static const char registrar[] = "test_pbx_merge";
+	static const char other[] = "test_pbx_merge_other";
+	static const char TEST_MERGE[] = "test_merge";
+	static const char TEST_MERGE_OTHER[] = "test_merge_other";
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "merge_contexts_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test merging a reloaded dialplan into the old one";
+		info->description = "Reload a context that another registrar added extensions to,\n"
+			"twice, and check that the reloaded extensions replace the old ones\n"
+			"while those of the other registrar and its own context stay.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_context_find_or_create(NULL, NULL, TEST_MERGE, registrar)
+		|| ast_add_extension(TEST_MERGE, 0, "100", 1, NULL, NULL, "Noop", NULL, NULL, registrar)
+		|| ast_add_extension(TEST_MERGE, 0, "200", 1, NULL, NULL, "Noop", NULL, NULL, other)
+		|| !ast_context_find_or_create(NULL, NULL, TEST_MERGE_OTHER, other)
+		|| ast_add_extension(TEST_MERGE_OTHER, 0, "300", 1, NULL, NULL, "Noop", NULL, NULL, other)
+		|| ast_context_add_include(TEST_MERGE, TEST_MERGE_OTHER, other)) {
+		ast_test_status_update(test, "Failed to build the dialplan\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	if (reload_context(TEST_MERGE, "101", registrar)) {
+		ast_test_status_update(test, "Failed to reload the dialplan\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	if (check_exten(test, TEST_MERGE, "101", 1)
+		|| check_exten(test, TEST_MERGE, "100", 0)
+		|| check_exten(test, TEST_MERGE, "200", 1)
+		|| check_exten(test, TEST_MERGE_OTHER, "300", 1)
+		|| check_exten(test, TEST_MERGE, "300", 1)) {
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	/* What the first merge copied over must not pile up */
+	if (reload_context(TEST_MERGE, "102", registrar)) {
+		ast_test_status_update(test, "Failed to reload the dialplan again\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	if (check_exten(test, TEST_MERGE, "102", 1)
+		|| check_exten(test, TEST_MERGE, "101", 0)
+		|| check_exten(test, TEST_MERGE, "200", 1)
+		|| check_exten(test, TEST_MERGE, "300", 1)) {
+		res = AST_TEST_FAIL;
+	}
+
+cleanup:
+	ast_context_destroy(NULL, registrar);
+	ast_context_destroy(NULL, other);
+
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(pattern_match_test);
+	AST_TEST_UNREGISTER(global_variables_test);
+	AST_TEST_UNREGISTER(merge_contexts_test);
 	return 0;
 }
 
 static int load_module(void)
 {
 	AST_TEST_REGISTER(pattern_match_test);
+	AST_TEST_REGISTER(global_variables_test);
+	AST_TEST_REGISTER(merge_contexts_test);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
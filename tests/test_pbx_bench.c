@@ -0,0 +1,163 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Dialplan benchmarks.
+ *
+ * Measures matching extensions against patterns and substituting channel
+ * variables into strings.
+ *
+ * Run with 'bench execute category /bench/pbx/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/channel.h"
+#include "asterisk/module.h"
+#include "asterisk/pbx.h"
+#include "asterisk/strings.h"
+#include "asterisk/test.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/pbx/";
+
+/*! \brief Patterns and extensions matched, and whether they match */
+static const struct {
+	const char *pattern;
+	const char *exten;
+	int match;
+} bench_patterns[] = {
+	{ "_NXXNXXXXXX", "2565551234", 1 },
+	{ "_1NXXNXXXXXX", "12565551234", 1 },
+	{ "_011.", "01144201234567", 1 },
+	{ "_[2-9]XX", "911", 1 },
+	{ "_X.", "100", 1 },
+	{ "_NXXNXXXXXX", "1565551234", 0 },
+	{ "_9!", "9", 1 },
+	{ "1000", "1000", 1 },
+	{ "_[a-z]XX", "100", 0 },
+	{ "_N[4-7]X", "2800", 0 },
+};
+
+/*! \brief The string variables are substituted into, and what it gives */
+#define BENCH_TEMPLATE "sip:${CALLER}@${DOMAIN}/${DIALED:1:4}-${${INDIRECT}}"
+#define BENCH_EXPECTED "sip:alice@example.com/5655-alice"
+
+struct bench_substitute {
+	struct ast_channel *chan;
+	struct ast_str *buf;
+};
+
+static int extension_match_op(void *data, unsigned int iteration)
+{
+	unsigned int i = iteration % ARRAY_LEN(bench_patterns);
+
+	return !ast_extension_match(bench_patterns[i].pattern, bench_patterns[i].exten)
+		!= !bench_patterns[i].match;
+}
+
+static void substitute_teardown(void *data)
+{
+	struct bench_substitute *bench = data;
+
+	ast_channel_cleanup(bench->chan);
+	ast_free(bench->buf);
+	ast_free(bench);
+}
+
+static int substitute_setup(struct ast_test *test, void **data)
+{
+	struct bench_substitute *bench;
+
+	if (!(bench = ast_calloc(1, sizeof(*bench)))) {
+		return -1;
+	}
+	bench->chan = ast_dummy_channel_alloc();
+	bench->buf = ast_str_create(64);
+	if (!bench->chan || !bench->buf) {
+		ast_test_status_update(test, "Failed to allocate a channel\n");
+		substitute_teardown(bench);
+		return -1;
+	}
+
+	pbx_builtin_setvar_helper(bench->chan, "CALLER", "alice");
+	pbx_builtin_setvar_helper(bench->chan, "DOMAIN", "example.com");
+	pbx_builtin_setvar_helper(bench->chan, "DIALED", "2565551234");
+	pbx_builtin_setvar_helper(bench->chan, "INDIRECT", "CALLER");
+
+	*data = bench;
+	return 0;
+}
+
+static int substitute_op(void *data, unsigned int iteration)
+{
+	struct bench_substitute *bench = data;
+
+	ast_str_substitute_variables(&bench->buf, 0, bench->chan, BENCH_TEMPLATE);
+	return strcmp(ast_str_buffer(bench->buf), BENCH_EXPECTED);
+}
+
+AST_BENCH_DEFINE(extension_match)
+{
+	bench->name = "extension_match";
+	bench->category = test_category;
+	bench->summary = "Match extensions against patterns";
+	bench->description = "Match extensions against a mix of patterns with\n"
+		"ranges, wildcards and literal extensions with ast_extension_match().";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->op = extension_match_op;
+}
+
+AST_BENCH_DEFINE(substitute_variables)
+{
+	bench->name = "substitute_variables";
+	bench->category = test_category;
+	bench->summary = "Substitute channel variables into a string";
+	bench->description = "Substitute channel variables, a substring and an\n"
+		"indirect variable into a string with ast_str_substitute_variables().";
+	bench->iterations = 100000;
+	bench->batch = 10;
+	bench->setup = substitute_setup;
+	bench->op = substitute_op;
+	bench->teardown = substitute_teardown;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(extension_match);
+	AST_TEST_UNREGISTER(substitute_variables);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(extension_match);
+	AST_TEST_REGISTER(substitute_variables);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Dialplan benchmarks");
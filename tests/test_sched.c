@@ -45,26 +45,13 @@ static int sched_cb(const void *data)
 	return 0;
 }
 
-AST_TEST_DEFINE(sched_test_order)
+static enum ast_test_result_state sched_order(struct ast_test *test, enum ast_sched_options options)
 {
 	struct ast_sched_context *con;
 	enum ast_test_result_state res = AST_TEST_FAIL;
 	int id1, id2, id3, wait;
 
-	switch (cmd) {
-	case TEST_INIT:
-		info->name = "sched_test_order";
-		info->category = "/main/sched/";
-		info->summary = "Test ordering of events in the scheduler API";
-		info->description =
-			"This test ensures that events are properly ordered by the "
-			"time they are scheduled to execute in the scheduler API.";
-		return AST_TEST_NOT_RUN;
-	case TEST_EXECUTE:
-		break;
-	}
-
-	if (!(con = ast_sched_context_create())) {
+	if (!(con = ast_sched_context_create_with_options(options))) {
 		ast_test_status_update(test,
 				"Test failed - could not create scheduler context\n");
 		return AST_TEST_FAIL;
@@ -160,9 +147,381 @@ return_cleanup:
 	return res;
 }
 
+AST_TEST_DEFINE(sched_test_order)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_order";
+		info->category = "/main/sched/";
+		info->summary = "Test ordering of events in the scheduler API";
+		info->description =
+			"This test ensures that events are properly ordered by the "
+			"time they are scheduled to execute in the scheduler API.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return sched_order(test, AST_SCHED_HEAP);
+}
+
+AST_TEST_DEFINE(sched_test_order_wheel)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_order_wheel";
+		info->category = "/main/sched/";
+		info->summary = "Test ordering of events in a timing wheel scheduler";
+		info->description =
+			"This test ensures that events are properly ordered by the "
+			"time they are scheduled to execute in a scheduler context "
+			"using a timing wheel.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return sched_order(test, AST_SCHED_TIMING_WHEEL);
+}
+
+#define EXPIRE_EVENTS 16
+
+struct expire_event {
+	/*! When the event was scheduled to run */
+	struct timeval when;
+	/*! When the event ran */
+	struct timeval ran;
+	/*! Position the event ran in */
+	int order;
+};
+
+static int expire_count;
+
+static int expire_cb(const void *data)
+{
+	struct expire_event *event = (struct expire_event *) data;
+
+	event->ran = ast_tvnow();
+	event->order = expire_count++;
+	return 0;
+}
+
+AST_TEST_DEFINE(sched_test_wheel_expire)
+{
+	struct ast_sched_context *con;
+	struct expire_event events[EXPIRE_EVENTS];
+	enum ast_test_result_state res = AST_TEST_PASS;
+	struct timeval start;
+	int order = 0;
+	int wait;
+	int id;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_wheel_expire";
+		info->category = "/main/sched/";
+		info->summary = "Test running events in a timing wheel scheduler";
+		info->description =
+			"This test schedules events spread over several levels of the "
+			"timing wheel, deletes some of them and ensures the rest run "
+			"in order and not before they are due.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(con = ast_sched_context_create_with_options(AST_SCHED_TIMING_WHEEL))) {
+		ast_test_status_update(test,
+				"Test failed - could not create scheduler context\n");
+		return AST_TEST_FAIL;
+	}
+
+	expire_count = 0;
+	start = ast_tvnow();
+
+	/* Schedule in reverse so events are not added in the order they run,
+	 * with gaps that cross from the first level of the wheel to the second. */
+	for (i = EXPIRE_EVENTS - 1; i >= 0; --i) {
+		int when = i * 23;
+
+		events[i].when = ast_tvadd(start, ast_samp2tv(when, 1000));
+		events[i].order = -1;
+		if ((id = ast_sched_add(con, when, expire_cb, &events[i])) == -1) {
+			ast_test_status_update(test, "Failed to add scheduler entry\n");
+			res = AST_TEST_FAIL;
+			goto return_cleanup;
+		}
+		/* Each odd event is deleted again */
+		if ((i % 2) && ast_sched_del(con, id)) {
+			ast_test_status_update(test, "Failed to remove scheduler entry\n");
+			res = AST_TEST_FAIL;
+			goto return_cleanup;
+		}
+	}
+
+	while ((wait = ast_sched_wait(con)) != -1) {
+		if (ast_tvdiff_ms(ast_tvnow(), start) > 10000) {
+			ast_test_status_update(test, "Events did not run within 10 seconds\n");
+			res = AST_TEST_FAIL;
+			goto return_cleanup;
+		}
+		if (wait) {
+			usleep(wait * 1000);
+		}
+		ast_sched_runq(con);
+	}
+
+	for (i = 0; i < EXPIRE_EVENTS; ++i) {
+		if (i % 2) {
+			if (events[i].order != -1) {
+				ast_test_status_update(test, "Deleted event %d ran\n", i);
+				res = AST_TEST_FAIL;
+			}
+			continue;
+		}
+		if (events[i].order != order++) {
+			ast_test_status_update(test, "Event %d ran in position %d\n", i, events[i].order);
+			res = AST_TEST_FAIL;
+		} else if (ast_tvdiff_ms(events[i].when, events[i].ran) > 1) {
+			ast_test_status_update(test, "Event %d ran %" PRIi64 " ms early\n", i,
+					ast_tvdiff_ms(events[i].when, events[i].ran));
+			res = AST_TEST_FAIL;
+		}
+	}
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return res;
+}
+
+/*!
+ * \brief Run the events of a context that are due until one of them has run
+ *
+ * \retval 0 the event ran
+ * \retval -1 it did not run within 10 seconds
+ */
+static int expire_run_until(struct ast_sched_context *con, struct expire_event *event)
+{
+	struct timeval start = ast_tvnow();
+	int wait;
+
+	while (event->order == -1) {
+		if ((wait = ast_sched_wait(con)) == -1 || ast_tvdiff_ms(ast_tvnow(), start) > 10000) {
+			return -1;
+		}
+		if (wait) {
+			usleep(wait * 1000);
+		}
+		ast_sched_runq(con);
+	}
+
+	return 0;
+}
+
+AST_TEST_DEFINE(sched_test_wheel_levels)
+{
+	struct ast_sched_context *con;
+	struct expire_event first = { .order = -1, };
+	struct expire_event upper = { .order = -1, };
+	struct expire_event lower = { .order = -1, };
+	enum ast_test_result_state res = AST_TEST_PASS;
+	struct timeval start;
+	int wait;
+	int due;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_wheel_levels";
+		info->category = "/main/sched/";
+		info->summary = "Test waiting on events in several levels of a timing wheel";
+		info->description =
+			"This test puts an event in the second level of a timing wheel "
+			"and then, once the wheel has moved on, a later one in the first "
+			"level.  It ensures the wait for the next event does not go past "
+			"the event in the second level.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(con = ast_sched_context_create_with_options(AST_SCHED_TIMING_WHEEL))) {
+		ast_test_status_update(test,
+				"Test failed - could not create scheduler context\n");
+		return AST_TEST_FAIL;
+	}
+
+	expire_count = 0;
+	start = ast_tvnow();
+
+	/* Too far out for the first level of the wheel */
+	upper.when = ast_tvadd(start, ast_samp2tv(100, 1000));
+	first.when = ast_tvadd(start, ast_samp2tv(50, 1000));
+	if (ast_sched_add(con, 100, expire_cb, &upper) == -1
+		|| ast_sched_add(con, 50, expire_cb, &first) == -1) {
+		ast_test_status_update(test, "Failed to add scheduler entry\n");
+		res = AST_TEST_FAIL;
+		goto return_cleanup;
+	}
+
+	if (expire_run_until(con, &first)) {
+		ast_test_status_update(test, "First event did not run\n");
+		res = AST_TEST_FAIL;
+		goto return_cleanup;
+	}
+
+	/* The wheel has moved on, so this one is close enough for the first level */
+	lower.when = ast_tvadd(ast_tvnow(), ast_samp2tv(60, 1000));
+	if (ast_sched_add(con, 60, expire_cb, &lower) == -1) {
+		ast_test_status_update(test, "Failed to add scheduler entry\n");
+		res = AST_TEST_FAIL;
+		goto return_cleanup;
+	}
+
+	wait = ast_sched_wait(con);
+	due = ast_tvdiff_ms(upper.when, ast_tvnow());
+	if (wait > due + 1) {
+		ast_test_status_update(test, "Waiting %d ms for an event due in %d ms\n", wait, due);
+		res = AST_TEST_FAIL;
+	}
+
+	if (expire_run_until(con, &lower)) {
+		ast_test_status_update(test, "Last event did not run\n");
+		res = AST_TEST_FAIL;
+		goto return_cleanup;
+	}
+
+	if (upper.order != 1 || lower.order != 2) {
+		ast_test_status_update(test, "Events ran in the wrong order\n");
+		res = AST_TEST_FAIL;
+	}
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return res;
+}
+
+struct pool_test_data {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! Number of callbacks of the fast key that ran */
+	int fast_ran;
+	/*! Number of callbacks running for the slow key */
+	int slow_running;
+	/*! Set if two callbacks of the slow key ran at the same time */
+	int slow_concurrent;
+};
+
+static int pool_slow_cb(const void *data)
+{
+	struct pool_test_data *test_data = (struct pool_test_data *) data;
+	struct timeval wait = ast_tvadd(ast_tvnow(), ast_samp2tv(2000, 1000));
+	struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000, };
+
+	ast_mutex_lock(&test_data->lock);
+	if (test_data->slow_running++) {
+		test_data->slow_concurrent = 1;
+	}
+	/* Block until the fast callback has run on the other worker */
+	while (!test_data->fast_ran) {
+		if (ast_cond_timedwait(&test_data->cond, &test_data->lock, &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+	test_data->slow_running--;
+	ast_mutex_unlock(&test_data->lock);
+	return 0;
+}
+
+static int pool_fast_cb(const void *data)
+{
+	struct pool_test_data *test_data = (struct pool_test_data *) data;
+
+	ast_mutex_lock(&test_data->lock);
+	test_data->fast_ran++;
+	ast_cond_signal(&test_data->cond);
+	ast_mutex_unlock(&test_data->lock);
+	return 0;
+}
+
+AST_TEST_DEFINE(sched_test_thread_pool)
+{
+	struct ast_sched_context *con;
+	struct pool_test_data test_data = { .fast_ran = 0, };
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_thread_pool";
+		info->category = "/main/sched/";
+		info->summary = "Test running scheduler callbacks on worker threads";
+		info->description =
+			"This test ensures that a blocked callback does not delay callbacks "
+			"with a different key and that callbacks with the same key do not "
+			"run concurrently.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(con = ast_sched_context_create())) {
+		ast_test_status_update(test,
+				"Test failed - could not create scheduler context\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_mutex_init(&test_data.lock);
+	ast_cond_init(&test_data.cond, NULL);
+
+	if (ast_sched_start_thread_pool(con, 2)) {
+		ast_test_status_update(test, "Failed to start scheduler threads\n");
+		res = AST_TEST_FAIL;
+		goto return_cleanup;
+	}
+
+	for (i = 0; i < 2; ++i) {
+		if (ast_sched_add_keyed(con, 0, pool_slow_cb, &test_data, 0) == -1) {
+			ast_test_status_update(test, "Failed to add scheduler entry\n");
+			res = AST_TEST_FAIL;
+			goto return_cleanup;
+		}
+	}
+	if (ast_sched_add_keyed(con, 10, pool_fast_cb, &test_data, 1) == -1) {
+		ast_test_status_update(test, "Failed to add scheduler entry\n");
+		res = AST_TEST_FAIL;
+		goto return_cleanup;
+	}
+
+	/* Wait for all of the callbacks to complete */
+	usleep(200000);
+
+	ast_mutex_lock(&test_data.lock);
+	if (!test_data.fast_ran) {
+		ast_test_status_update(test, "Callback was delayed by a callback with a different key\n");
+		res = AST_TEST_FAIL;
+	}
+	if (test_data.slow_concurrent) {
+		ast_test_status_update(test, "Callbacks with the same key ran concurrently\n");
+		res = AST_TEST_FAIL;
+	}
+	ast_mutex_unlock(&test_data.lock);
+
+return_cleanup:
+	/* Joins the threads */
+	ast_sched_context_destroy(con);
+	ast_mutex_destroy(&test_data.lock);
+	ast_cond_destroy(&test_data.cond);
+
+	return res;
+}
+
 static char *handle_cli_sched_bench(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct ast_sched_context *con;
+	enum ast_sched_options options = AST_SCHED_HEAP;
 	struct timeval start;
 	unsigned int num, i;
 	int *sched_ids = NULL;
@@ -171,14 +530,18 @@ static char *handle_cli_sched_bench(struct ast_cli_entry *e, int cmd, struct ast
 	case CLI_INIT:
 		e->command = "sched benchmark";
 		e->usage = ""
-			"Usage: sched benchmark <num>\n"
+			"Usage: sched benchmark <num> [wheel]\n"
+			"       Benchmark a heap based scheduler context, or\n"
+			"       a timing wheel based one if 'wheel' is given.\n"
 			"";
 		return NULL;
 	case CLI_GENERATE:
 		return NULL;
 	}
 
-	if (a->argc != e->args + 1) {
+	if (a->argc == e->args + 2 && !strcasecmp(a->argv[e->args + 1], "wheel")) {
+		options = AST_SCHED_TIMING_WHEEL;
+	} else if (a->argc != e->args + 1) {
 		return CLI_SHOWUSAGE;
 	}
 
@@ -186,7 +549,7 @@ static char *handle_cli_sched_bench(struct ast_cli_entry *e, int cmd, struct ast
 		return CLI_SHOWUSAGE;
 	}
 
-	if (!(con = ast_sched_context_create())) {
+	if (!(con = ast_sched_context_create_with_options(options))) {
 		ast_cli(a->fd, "Test failed - could not create scheduler context\n");
 		return CLI_FAILURE;
 	}
@@ -241,6 +604,10 @@ static struct ast_cli_entry cli_sched[] = {
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(sched_test_order);
+	AST_TEST_UNREGISTER(sched_test_order_wheel);
+	AST_TEST_UNREGISTER(sched_test_wheel_expire);
+	AST_TEST_UNREGISTER(sched_test_wheel_levels);
+	AST_TEST_UNREGISTER(sched_test_thread_pool);
 	ast_cli_unregister_multiple(cli_sched, ARRAY_LEN(cli_sched));
 	return 0;
 }
@@ -248,6 +615,10 @@ static int unload_module(void)
 static int load_module(void)
 {
 	AST_TEST_REGISTER(sched_test_order);
+	AST_TEST_REGISTER(sched_test_order_wheel);
+	AST_TEST_REGISTER(sched_test_wheel_expire);
+	AST_TEST_REGISTER(sched_test_wheel_levels);
+	AST_TEST_REGISTER(sched_test_thread_pool);
 	ast_cli_register_multiple(cli_sched, ARRAY_LEN(cli_sched));
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -0,0 +1,231 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Signed linear block arithmetic tests and benchmark
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/utils.h"
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/time.h"
+#include "asterisk/slinear_mix.h"
+
+/*! \brief Every kernel that may be built */
+static const char *kernels[] = { "c", "sse2", "avx2", "neon" };
+
+/*! \brief Samples in a block, not a multiple of any vector width */
+#define BLOCK_SAMPLES 1003
+
+/*! \brief Participants mixed by the benchmark */
+#define BENCH_PARTICIPANTS 100
+
+/*! \brief Samples in 20ms at 48kHz */
+#define BENCH_SAMPLES 960
+
+/*! \brief Mixing intervals run by the benchmark for each kernel */
+#define BENCH_INTERVALS 500
+
+/*! \brief Fill a block with samples that often saturate */
+static void fill_block(short *buf, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		buf[i] = (short) ast_random();
+	}
+}
+
+AST_TEST_DEFINE(slinear_kernels)
+{
+	short src[BLOCK_SAMPLES];
+	short dst[BLOCK_SAMPLES];
+	short expected[BLOCK_SAMPLES];
+	const short factors[] = { 1, 2, 3, 7, 100, 32767 };
+	const char *original = ast_slinear_mix_kernel();
+	int res = AST_TEST_PASS;
+	int k;
+	int f;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "slinear_kernels";
+		info->category = "/main/slinear_mix/";
+		info->summary = "Verify block saturating arithmetic";
+		info->description =
+			"Runs each kernel the CPU can run and checks it gives the same results\n"
+			"as the scalar saturating functions.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (k = 0; k < ARRAY_LEN(kernels); ++k) {
+		if (ast_slinear_mix_use_kernel(kernels[k])) {
+			ast_test_status_update(test, "Skipping the %s kernel\n", kernels[k]);
+			continue;
+		}
+
+		fill_block(src, BLOCK_SAMPLES);
+		fill_block(dst, BLOCK_SAMPLES);
+		memcpy(expected, dst, sizeof(expected));
+		for (i = 0; i < BLOCK_SAMPLES; ++i) {
+			ast_slinear_saturated_add(&expected[i], &src[i]);
+		}
+		ast_slinear_saturated_add_block(dst, src, BLOCK_SAMPLES);
+		if (memcmp(dst, expected, sizeof(expected))) {
+			ast_test_status_update(test, "The %s kernel added wrongly\n", kernels[k]);
+			res = AST_TEST_FAIL;
+		}
+
+		fill_block(dst, BLOCK_SAMPLES);
+		memcpy(expected, dst, sizeof(expected));
+		for (i = 0; i < BLOCK_SAMPLES; ++i) {
+			ast_slinear_saturated_subtract(&expected[i], &src[i]);
+		}
+		ast_slinear_saturated_subtract_block(dst, src, BLOCK_SAMPLES);
+		if (memcmp(dst, expected, sizeof(expected))) {
+			ast_test_status_update(test, "The %s kernel subtracted wrongly\n", kernels[k]);
+			res = AST_TEST_FAIL;
+		}
+
+		for (f = 0; f < ARRAY_LEN(factors); ++f) {
+			short factor = factors[f];
+
+			fill_block(dst, BLOCK_SAMPLES);
+			memcpy(expected, dst, sizeof(expected));
+			for (i = 0; i < BLOCK_SAMPLES; ++i) {
+				ast_slinear_saturated_multiply(&expected[i], &factor);
+			}
+			ast_slinear_saturated_multiply_block(dst, factor, BLOCK_SAMPLES);
+			if (memcmp(dst, expected, sizeof(expected))) {
+				ast_test_status_update(test, "The %s kernel multiplied by %d wrongly\n",
+					kernels[k], factor);
+				res = AST_TEST_FAIL;
+			}
+
+			fill_block(dst, BLOCK_SAMPLES);
+			memcpy(expected, dst, sizeof(expected));
+			for (i = 0; i < BLOCK_SAMPLES; ++i) {
+				ast_slinear_saturated_divide(&expected[i], &factor);
+			}
+			ast_slinear_saturated_divide_block(dst, factor, BLOCK_SAMPLES);
+			if (memcmp(dst, expected, sizeof(expected))) {
+				ast_test_status_update(test, "The %s kernel divided by %d wrongly\n",
+					kernels[k], factor);
+				res = AST_TEST_FAIL;
+			}
+		}
+	}
+
+	ast_slinear_mix_use_kernel(original);
+
+	return res;
+}
+
+AST_TEST_DEFINE(slinear_mix_bench)
+{
+	RAII_VAR(short *, participants, NULL, ast_free);
+	short mix[BENCH_SAMPLES];
+	short out[BENCH_SAMPLES];
+	const char *original = ast_slinear_mix_kernel();
+	int64_t scalar_us = 0;
+	int k;
+	int n;
+	int p;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "slinear_mix_bench";
+		info->category = "/main/slinear_mix/";
+		info->summary = "Benchmark conference mixing";
+		info->description =
+			"Mixes 100 participants of 20ms at 48kHz and takes each one back out of\n"
+			"the mix, as bridge_softmix does, with each kernel the CPU can run.\n"
+			"Reports the time taken compared to the scalar kernel.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	participants = ast_malloc(BENCH_PARTICIPANTS * BENCH_SAMPLES * sizeof(*participants));
+	if (!participants) {
+		return AST_TEST_FAIL;
+	}
+	fill_block(participants, BENCH_PARTICIPANTS * BENCH_SAMPLES);
+
+	for (k = 0; k < ARRAY_LEN(kernels); ++k) {
+		struct timeval start;
+		int64_t elapsed_us;
+
+		if (ast_slinear_mix_use_kernel(kernels[k])) {
+			continue;
+		}
+
+		start = ast_tvnow();
+		for (n = 0; n < BENCH_INTERVALS; ++n) {
+			memcpy(mix, participants, sizeof(mix));
+			for (p = 1; p < BENCH_PARTICIPANTS; ++p) {
+				ast_slinear_saturated_add_block(mix, participants + p * BENCH_SAMPLES, BENCH_SAMPLES);
+			}
+			for (p = 0; p < BENCH_PARTICIPANTS; ++p) {
+				memcpy(out, mix, sizeof(out));
+				ast_slinear_saturated_subtract_block(out, participants + p * BENCH_SAMPLES, BENCH_SAMPLES);
+			}
+		}
+		elapsed_us = MAX(ast_tvdiff_us(ast_tvnow(), start), 1);
+
+		if (!scalar_us) {
+			scalar_us = elapsed_us;
+		}
+		ast_test_status_update(test, "%s: %d intervals in %" PRId64 "us, %.1fus per interval, %.2fx scalar\n",
+			kernels[k], BENCH_INTERVALS, elapsed_us, (double) elapsed_us / BENCH_INTERVALS,
+			(double) scalar_us / elapsed_us);
+	}
+
+	ast_slinear_mix_use_kernel(original);
+
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(slinear_kernels);
+	AST_TEST_UNREGISTER(slinear_mix_bench);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(slinear_kernels);
+	AST_TEST_REGISTER(slinear_mix_bench);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Signed Linear Mixing Tests");
@@ -52,7 +52,7 @@ static void *test_sorcery_object_alloc(const char *id)
 	return ast_sorcery_generic_alloc(sizeof(struct test_sorcery_object), NULL);
 }
 
-static struct ast_sorcery *alloc_and_initialize_sorcery(void)
+static struct ast_sorcery *alloc_and_initialize_sorcery_wizard(const char *wizard)
 {
 	struct ast_sorcery *sorcery;
 
@@ -60,7 +60,7 @@ static struct ast_sorcery *alloc_and_initialize_sorcery(void)
 		return NULL;
 	}
 
-	if ((ast_sorcery_apply_default(sorcery, "test", "astdb", "test") != AST_SORCERY_APPLY_SUCCESS) ||
+	if ((ast_sorcery_apply_default(sorcery, "test", wizard, "test") != AST_SORCERY_APPLY_SUCCESS) ||
 		ast_sorcery_internal_object_register(sorcery, "test", test_sorcery_object_alloc, NULL, NULL)) {
 		ast_sorcery_unref(sorcery);
 		return NULL;
@@ -72,6 +72,11 @@ static struct ast_sorcery *alloc_and_initialize_sorcery(void)
 	return sorcery;
 }
 
+static struct ast_sorcery *alloc_and_initialize_sorcery(void)
+{
+	return alloc_and_initialize_sorcery_wizard("astdb");
+}
+
 static void deinitialize_sorcery(struct ast_sorcery *sorcery)
 {
 	ast_db_deltree("test/test", NULL);
@@ -603,6 +608,111 @@ AST_TEST_DEFINE(object_delete_uncreated)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(object_memory_write_behind)
+{
+	RAII_VAR(struct ast_sorcery *, sorcery, NULL, deinitialize_sorcery);
+	RAII_VAR(struct test_sorcery_object *, obj, NULL, ao2_cleanup);
+	RAII_VAR(struct test_sorcery_object *, obj2, NULL, ao2_cleanup);
+	RAII_VAR(struct ao2_container *, objects, NULL, ao2_cleanup);
+	const char *ids[] = { "blah-98joe", "blah-93joe", "neener-93joe" };
+	char value[2];
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "object_memory_write_behind";
+		info->category = "/res/sorcery_astdb/";
+		info->summary = "sorcery astdb_memory wizard unit test";
+		info->description =
+			"Test that objects changed using the astdb_memory wizard are retrieved\n"
+			"from memory and written to astdb when the wizard is closed";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(sorcery = alloc_and_initialize_sorcery_wizard("astdb_memory"))) {
+		ast_test_status_update(test, "Failed to open sorcery structure\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < ARRAY_LEN(ids); ++i) {
+		ao2_cleanup(obj);
+		if (!(obj = ast_sorcery_alloc(sorcery, "test", ids[i]))) {
+			ast_test_status_update(test, "Failed to allocate a known object type\n");
+			return AST_TEST_FAIL;
+		} else if (ast_sorcery_create(sorcery, obj)) {
+			ast_test_status_update(test, "Failed to create object using astdb_memory wizard\n");
+			return AST_TEST_FAIL;
+		}
+	}
+
+	if (!(objects = ast_sorcery_retrieve_by_regex(sorcery, "test", "^blah-"))) {
+		ast_test_status_update(test, "Failed to retrieve a container of objects\n");
+		return AST_TEST_FAIL;
+	} else if (ao2_container_count(objects) != 2) {
+		ast_test_status_update(test, "Received a container with incorrect number of objects in it\n");
+		return AST_TEST_FAIL;
+	}
+
+	ao2_cleanup(obj);
+	if (!(obj = ast_sorcery_retrieve_by_id(sorcery, "test", "blah-98joe"))) {
+		ast_test_status_update(test, "Failed to retrieve properly created object using id of 'blah-98joe'\n");
+		return AST_TEST_FAIL;
+	} else if (!(obj2 = ast_sorcery_copy(sorcery, obj))) {
+		ast_test_status_update(test, "Failed to allocate a known object type for updating\n");
+		return AST_TEST_FAIL;
+	}
+
+	obj2->bob = 1000;
+	if (ast_sorcery_update(sorcery, obj2)) {
+		ast_test_status_update(test, "Failed to update sorcery with new object\n");
+		return AST_TEST_FAIL;
+	}
+
+	ao2_cleanup(obj);
+	if (!(obj = ast_sorcery_retrieve_by_id(sorcery, "test", "neener-93joe"))) {
+		ast_test_status_update(test, "Failed to retrieve properly created object using id of 'neener-93joe'\n");
+		return AST_TEST_FAIL;
+	} else if (ast_sorcery_delete(sorcery, obj)) {
+		ast_test_status_update(test, "Failed to delete object using astdb_memory wizard\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* Closing the wizard writes everything still waiting to astdb */
+	ao2_cleanup(objects);
+	objects = NULL;
+	ao2_cleanup(obj);
+	obj = NULL;
+	ao2_cleanup(obj2);
+	obj2 = NULL;
+	ast_sorcery_unref(sorcery);
+	sorcery = NULL;
+
+	if (ast_db_get("test/test", "blah-93joe", value, sizeof(value))) {
+		ast_test_status_update(test, "Created object was not written to astdb\n");
+		return AST_TEST_FAIL;
+	} else if (!ast_db_get("test/test", "neener-93joe", value, sizeof(value))) {
+		ast_test_status_update(test, "Deleted object was not removed from astdb\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (!(sorcery = alloc_and_initialize_sorcery_wizard("astdb_memory"))) {
+		ast_test_status_update(test, "Failed to open sorcery structure\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (!(obj = ast_sorcery_retrieve_by_id(sorcery, "test", "blah-98joe"))) {
+		ast_test_status_update(test, "Failed to retrieve object loaded from astdb\n");
+		return AST_TEST_FAIL;
+	} else if (obj->bob != 1000) {
+		ast_test_status_update(test, "Object loaded from astdb does not have the updated value\n");
+		return AST_TEST_FAIL;
+	}
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(object_create);
@@ -615,6 +725,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(object_update_uncreated);
 	AST_TEST_UNREGISTER(object_delete);
 	AST_TEST_UNREGISTER(object_delete_uncreated);
+	AST_TEST_UNREGISTER(object_memory_write_behind);
 
 	return 0;
 }
@@ -631,6 +742,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(object_update_uncreated);
 	AST_TEST_REGISTER(object_delete);
 	AST_TEST_REGISTER(object_delete_uncreated);
+	AST_TEST_REGISTER(object_memory_write_behind);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
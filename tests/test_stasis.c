@@ -606,6 +606,354 @@ AST_TEST_DEFINE(unsubscribe_stops_messages)
 	return AST_TEST_PASS;
 }
 
+/*! \brief Batches received by the subscribe_batch test */
+struct batch_consumer {
+	struct consumer *consumer;
+	size_t max_messages;
+	int oversized;
+};
+
+static void batch_consumer_exec(void *data, struct stasis_subscription *sub,
+	struct stasis_message **messages, size_t count)
+{
+	struct batch_consumer *batch = data;
+	size_t idx;
+
+	if (count > batch->max_messages) {
+		batch->oversized = 1;
+	}
+	for (idx = 0; idx < count; ++idx) {
+		consumer_exec(batch->consumer, sub, messages[idx]);
+	}
+}
+
+AST_TEST_DEFINE(subscribe_batch)
+{
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, uut, NULL, stasis_unsubscribe_and_join);
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, test_message_type, NULL, ao2_cleanup);
+	struct stasis_message *messages[50] = { NULL, };
+	struct batch_consumer batch = { .max_messages = 8, };
+	int res = AST_TEST_FAIL;
+	int actual_len;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test batched subscriptions";
+		info->description = "Test that a batched subscription receives every\n"
+			"message in order, in batches no larger than requested,\n"
+			"followed by the final message.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+	batch.consumer = consumer;
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+	ast_test_validate(test, stasis_message_type_create("TestMessage", NULL, &test_message_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+
+	uut = stasis_subscribe_batch(topic, batch_consumer_exec, &batch, batch.max_messages, 1000);
+	ast_test_validate(test, NULL != uut);
+	ao2_ref(consumer, +1);
+
+	for (i = 0; i < ARRAY_LEN(messages); ++i) {
+		messages[i] = stasis_message_create(test_message_type, test_data);
+		if (!messages[i]) {
+			goto cleanup;
+		}
+		stasis_publish(topic, messages[i]);
+	}
+
+	actual_len = consumer_wait_for(consumer, ARRAY_LEN(messages));
+	if (actual_len != ARRAY_LEN(messages)) {
+		ast_test_status_update(test, "Expected %d messages, got %d\n", (int) ARRAY_LEN(messages), actual_len);
+		goto cleanup;
+	}
+	for (i = 0; i < ARRAY_LEN(messages); ++i) {
+		if (consumer->messages_rxed[i] != messages[i]) {
+			ast_test_status_update(test, "Message %d was delivered out of order\n", i);
+			goto cleanup;
+		}
+	}
+	if (batch.oversized) {
+		ast_test_status_update(test, "A batch had more than %d messages\n", (int) batch.max_messages);
+		goto cleanup;
+	}
+
+	/* The final message still arrives and ends the subscription */
+	uut = stasis_unsubscribe_and_join(uut);
+	if (!consumer_wait_for_completion(consumer)) {
+		ast_test_status_update(test, "The final message was not delivered\n");
+		goto cleanup;
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	for (i = 0; i < ARRAY_LEN(messages); ++i) {
+		ao2_cleanup(messages[i]);
+	}
+	return res;
+}
+
+AST_TEST_DEFINE(subscription_filter)
+{
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, uut, NULL, stasis_unsubscribe);
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, accepted_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, declined_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, formatted_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, accepted_message, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, declined_message, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, formatted_message, NULL, ao2_cleanup);
+	int actual_len;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test subscription message type filtering";
+		info->description = "Test that a selective subscription only receives\n"
+			"messages of accepted types or formatters.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+
+	uut = stasis_subscribe(topic, consumer_exec, consumer);
+	ast_test_validate(test, NULL != uut);
+	ao2_ref(consumer, +1);
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+	ast_test_validate(test, stasis_message_type_create("AcceptedMessage", NULL, &accepted_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, stasis_message_type_create("DeclinedMessage", NULL, &declined_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, stasis_message_type_create("FormattedMessage", &fake_vtable, &formatted_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	accepted_message = stasis_message_create(accepted_type, test_data);
+	ast_test_validate(test, NULL != accepted_message);
+	declined_message = stasis_message_create(declined_type, test_data);
+	ast_test_validate(test, NULL != declined_message);
+	formatted_message = stasis_message_create(formatted_type, test_data);
+	ast_test_validate(test, NULL != formatted_message);
+
+	ast_test_validate(test, 0 == stasis_subscription_accept_message_type(uut, accepted_type));
+	stasis_subscription_accept_formatters(uut, STASIS_SUBSCRIPTION_FORMATTER_JSON);
+	ast_test_validate(test, 0 == stasis_subscription_set_filter(uut, STASIS_SUBSCRIPTION_FILTER_SELECTIVE));
+
+	stasis_publish(topic, declined_message);
+	stasis_publish(topic, accepted_message);
+	stasis_publish(topic, formatted_message);
+
+	actual_len = consumer_wait_for(consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+	actual_len = consumer_should_stay(consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+	ast_test_validate(test, accepted_message == consumer->messages_rxed[0]);
+	ast_test_validate(test, formatted_message == consumer->messages_rxed[1]);
+
+	/* Declined types are no longer dispatched */
+	ast_test_validate(test, 0 == stasis_subscription_decline_message_type(uut, accepted_type));
+	stasis_publish(topic, accepted_message);
+	actual_len = consumer_should_stay(consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+
+	/* Without a filter every message is dispatched */
+	ast_test_validate(test, 0 == stasis_subscription_set_filter(uut, STASIS_SUBSCRIPTION_FILTER_NONE));
+	stasis_publish(topic, declined_message);
+	actual_len = consumer_wait_for(consumer, 3);
+	ast_test_validate(test, 3 == actual_len);
+	ast_test_validate(test, declined_message == consumer->messages_rxed[2]);
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(statistics)
+{
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, uut, NULL, stasis_unsubscribe);
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, accepted_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, declined_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, accepted_message, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, declined_message, NULL, ao2_cleanup);
+	struct stasis_topic_statistics topic_before;
+	struct stasis_topic_statistics topic_after;
+	struct stasis_subscription_statistics sub_before;
+	struct stasis_subscription_statistics sub_after;
+	int actual_len;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test topic and subscription statistics";
+		info->description = "Test that publishing counts the published, dispatched\n"
+			"and filtered messages of the topic and its subscription.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+
+	uut = stasis_subscribe(topic, consumer_exec, consumer);
+	ast_test_validate(test, NULL != uut);
+	ao2_ref(consumer, +1);
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+	ast_test_validate(test, stasis_message_type_create("AcceptedMessage", NULL, &accepted_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, stasis_message_type_create("DeclinedMessage", NULL, &declined_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	accepted_message = stasis_message_create(accepted_type, test_data);
+	ast_test_validate(test, NULL != accepted_message);
+	declined_message = stasis_message_create(declined_type, test_data);
+	ast_test_validate(test, NULL != declined_message);
+
+	ast_test_validate(test, 0 == stasis_subscription_accept_message_type(uut, accepted_type));
+	ast_test_validate(test, 0 == stasis_subscription_set_filter(uut, STASIS_SUBSCRIPTION_FILTER_SELECTIVE));
+
+	stasis_topic_statistics_get(topic, &topic_before);
+	stasis_subscription_statistics_get(uut, &sub_before);
+	ast_test_validate(test, 1 == topic_before.subscribers);
+
+	stasis_publish(topic, accepted_message);
+	stasis_publish(topic, declined_message);
+	stasis_publish(topic, accepted_message);
+
+	actual_len = consumer_wait_for(consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+
+	stasis_topic_statistics_get(topic, &topic_after);
+	stasis_subscription_statistics_get(uut, &sub_after);
+	ast_test_validate(test, 3 == topic_after.messages_published - topic_before.messages_published);
+	ast_test_validate(test, 2 == topic_after.messages_dispatched - topic_before.messages_dispatched);
+	ast_test_validate(test, 2 == sub_after.messages_dispatched - sub_before.messages_dispatched);
+	ast_test_validate(test, 1 == sub_after.messages_filtered - sub_before.messages_filtered);
+	ast_test_validate(test, sub_after.messages_processed == sub_after.messages_dispatched);
+	ast_test_validate(test, 0 == sub_after.queue_size);
+	ast_test_validate(test, sub_after.queue_max >= 1);
+	ast_test_validate(test, sub_after.latency_max_us >= 0);
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief State of the publisher thread of the unsubscribe_while_publishing test */
+struct publisher_state {
+	struct stasis_topic *topic;
+	struct stasis_message *message;
+	volatile int stop;
+};
+
+static void *publisher_thread(void *data)
+{
+	struct publisher_state *state = data;
+
+	while (!state->stop) {
+		stasis_publish(state->topic, state->message);
+	}
+	return NULL;
+}
+
+AST_TEST_DEFINE(unsubscribe_while_publishing)
+{
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, test_message_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, test_message, NULL, ao2_cleanup);
+	struct publisher_state state = { 0, };
+	pthread_t publisher;
+	int res = AST_TEST_PASS;
+	int round;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test unsubscribing while messages are published";
+		info->description = "Test unsubscribing while another thread publishes.\n"
+			"The final message must always be the last message a\n"
+			"subscription receives.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+	ast_test_validate(test, stasis_message_type_create("TestMessage", NULL, &test_message_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	test_message = stasis_message_create(test_message_type, test_data);
+	ast_test_validate(test, NULL != test_message);
+
+	state.topic = topic;
+	state.message = test_message;
+	ast_test_validate(test, !ast_pthread_create(&publisher, NULL, publisher_thread, &state));
+
+	for (round = 0; round < 20 && res == AST_TEST_PASS; ++round) {
+		struct consumer *consumer;
+		struct stasis_subscription *sub;
+		size_t len;
+
+		consumer = consumer_create(0);
+		if (!consumer) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+		sub = stasis_subscribe(topic, consumer_exec, consumer);
+		if (!sub) {
+			ao2_ref(consumer, -1);
+			res = AST_TEST_FAIL;
+			break;
+		}
+		ao2_ref(consumer, +1);
+
+		consumer_wait_for(consumer, 2);
+		ao2_ref(sub, +1);
+		stasis_unsubscribe_and_join(sub);
+
+		len = consumer_should_stay(consumer, consumer->messages_rxed_len);
+		if (!consumer->complete
+			|| !stasis_subscription_final_message(sub, consumer->messages_rxed[len - 1])) {
+			ast_test_status_update(test, "Round %d: message received after the final message\n", round);
+			res = AST_TEST_FAIL;
+		}
+		ao2_ref(sub, -1);
+		ao2_ref(consumer, -1);
+	}
+
+	state.stop = 1;
+	pthread_join(publisher, NULL);
+
+	return res;
+}
+
 AST_TEST_DEFINE(forward)
 {
 	RAII_VAR(struct stasis_topic *, parent_topic, NULL, ao2_cleanup);
@@ -1238,6 +1586,81 @@ AST_TEST_DEFINE(cache_dump)
 	return AST_TEST_PASS;
 }
 
+#define CACHE_ITERATE_ENTRIES 50
+
+struct cache_iterate_count {
+	int count;
+	int stop_at;
+};
+
+static int cache_iterate_count_cb(struct stasis_message *snapshot, void *data)
+{
+	struct cache_iterate_count *iterate = data;
+
+	return ++iterate->count == iterate->stop_at;
+}
+
+AST_TEST_DEFINE(cache_iterate)
+{
+	RAII_VAR(struct stasis_message_type *, cache_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_caching_topic *, caching_topic, NULL, stasis_caching_unsubscribe);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, sub, NULL, stasis_unsubscribe);
+	struct cache_iterate_count iterate = { 0, };
+	char id[16];
+	int actual_len;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test cache iteration.";
+		info->description = "Test that iterating a cache visits every\n"
+			"snapshot of every shard and can be stopped.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_validate(test, stasis_message_type_create("Cacheable", NULL, &cache_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	topic = stasis_topic_create("SomeTopic");
+	ast_test_validate(test, NULL != topic);
+	cache = stasis_cache_create(cache_test_data_id);
+	ast_test_validate(test, NULL != cache);
+	caching_topic = stasis_caching_topic_create(topic, cache);
+	ast_test_validate(test, NULL != caching_topic);
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+	sub = stasis_subscribe(stasis_caching_get_topic(caching_topic), consumer_exec, consumer);
+	ast_test_validate(test, NULL != sub);
+	ao2_ref(consumer, +1);
+
+	for (i = 0; i < CACHE_ITERATE_ENTRIES; ++i) {
+		RAII_VAR(struct stasis_message *, test_message, NULL, ao2_cleanup);
+
+		snprintf(id, sizeof(id), "%d", i);
+		test_message = cache_test_message_create(cache_type, id, "1");
+		ast_test_validate(test, NULL != test_message);
+		stasis_publish(topic, test_message);
+	}
+	actual_len = consumer_wait_for(consumer, CACHE_ITERATE_ENTRIES);
+	ast_test_validate(test, CACHE_ITERATE_ENTRIES == actual_len);
+
+	ast_test_validate(test, 0 == stasis_cache_iterate(cache, cache_type, cache_iterate_count_cb, &iterate));
+	ast_test_validate(test, CACHE_ITERATE_ENTRIES == iterate.count);
+
+	/* The callback can stop the iteration */
+	iterate.count = 0;
+	iterate.stop_at = 10;
+	ast_test_validate(test, 0 == stasis_cache_iterate(cache, NULL, cache_iterate_count_cb, &iterate));
+	ast_test_validate(test, 10 == iterate.count);
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(cache_eid_aggregate)
 {
 	RAII_VAR(struct stasis_message_type *, cache_type, NULL, ao2_cleanup);
@@ -1594,6 +2017,90 @@ AST_TEST_DEFINE(router)
 	return AST_TEST_PASS;
 }
 
+#define MANY_ROUTES 40
+
+AST_TEST_DEFINE(router_many_routes)
+{
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_router *, uut, NULL, stasis_message_router_unsubscribe_and_join);
+	struct stasis_message_type *types[MANY_ROUTES] = { NULL, };
+	struct stasis_message *messages[MANY_ROUTES] = { NULL, };
+	char name[32];
+	int actual_len;
+	int res = AST_TEST_FAIL;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test message routing with many routes";
+		info->description = "Test that a router with many routes, some of\n"
+			"them removed, routes every message to its own route.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+
+	uut = stasis_message_router_create(topic);
+	ast_test_validate(test, NULL != uut);
+
+	for (i = 0; i < MANY_ROUTES; ++i) {
+		snprintf(name, sizeof(name), "TestMessage%d", i);
+		if (stasis_message_type_create(name, NULL, &types[i]) != STASIS_MESSAGE_TYPE_SUCCESS) {
+			goto cleanup;
+		}
+		messages[i] = stasis_message_create(types[i], test_data);
+		if (!messages[i]) {
+			goto cleanup;
+		}
+		if (stasis_message_router_add(uut, types[i], consumer_exec, consumer)) {
+			goto cleanup;
+		}
+	}
+
+	/* Only the routes of even types are left */
+	for (i = 1; i < MANY_ROUTES; i += 2) {
+		stasis_message_router_remove(uut, types[i]);
+	}
+
+	for (i = 0; i < MANY_ROUTES; ++i) {
+		stasis_publish(topic, messages[i]);
+	}
+
+	actual_len = consumer_wait_for(consumer, MANY_ROUTES / 2);
+	if (actual_len != MANY_ROUTES / 2) {
+		ast_test_status_update(test, "Expected %d messages, got %d\n", MANY_ROUTES / 2, actual_len);
+		goto cleanup;
+	}
+	for (i = 0; i < MANY_ROUTES / 2; ++i) {
+		if (consumer->messages_rxed[i] != messages[i * 2]) {
+			ast_test_status_update(test, "Message %d was not routed\n", i * 2);
+			goto cleanup;
+		}
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	for (i = 0; i < MANY_ROUTES; ++i) {
+		ao2_cleanup(messages[i]);
+		ao2_cleanup(types[i]);
+	}
+	return res;
+}
+
 AST_TEST_DEFINE(router_pool)
 {
 	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
@@ -1857,6 +2364,7 @@ AST_TEST_DEFINE(to_json)
 	RAII_VAR(struct stasis_message *, uut, NULL, ao2_cleanup);
 	RAII_VAR(char *, data, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_json *, actual, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, again, NULL, ast_json_unref);
 	const char *expected_text = "SomeData";
 	RAII_VAR(struct ast_json *, expected, NULL, ast_json_unref);
 
@@ -1882,6 +2390,10 @@ AST_TEST_DEFINE(to_json)
 	actual = stasis_message_to_json(uut, NULL);
 	ast_test_validate(test, ast_json_equal(expected, actual));
 
+	/* The representation is only built once */
+	again = stasis_message_to_json(uut, NULL);
+	ast_test_validate(test, actual == again);
+
 	return AST_TEST_PASS;
 }
 
@@ -1928,6 +2440,7 @@ AST_TEST_DEFINE(to_ami)
 	RAII_VAR(struct stasis_message *, uut, NULL, ao2_cleanup);
 	RAII_VAR(char *, data, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_manager_event_blob *, actual, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_manager_event_blob *, again, NULL, ao2_cleanup);
 	const char *expected_text = "SomeData";
 	const char *expected = "Message: SomeData\r\n";
 
@@ -1952,6 +2465,10 @@ AST_TEST_DEFINE(to_ami)
 	actual = stasis_message_to_ami(uut);
 	ast_test_validate(test, strcmp(expected, actual->extra_fields) == 0);
 
+	/* The representation is only built once */
+	again = stasis_message_to_ami(uut);
+	ast_test_validate(test, actual == again);
+
 	return AST_TEST_PASS;
 }
 
@@ -2056,12 +2573,18 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(publish_sync);
 	AST_TEST_UNREGISTER(publish_pool);
 	AST_TEST_UNREGISTER(unsubscribe_stops_messages);
+	AST_TEST_UNREGISTER(unsubscribe_while_publishing);
+	AST_TEST_UNREGISTER(subscription_filter);
+	AST_TEST_UNREGISTER(statistics);
+	AST_TEST_UNREGISTER(subscribe_batch);
 	AST_TEST_UNREGISTER(forward);
 	AST_TEST_UNREGISTER(cache_filter);
 	AST_TEST_UNREGISTER(cache);
 	AST_TEST_UNREGISTER(cache_dump);
+	AST_TEST_UNREGISTER(cache_iterate);
 	AST_TEST_UNREGISTER(cache_eid_aggregate);
 	AST_TEST_UNREGISTER(router);
+	AST_TEST_UNREGISTER(router_many_routes);
 	AST_TEST_UNREGISTER(router_pool);
 	AST_TEST_UNREGISTER(router_cache_updates);
 	AST_TEST_UNREGISTER(interleaving);
@@ -2085,12 +2608,18 @@ static int load_module(void)
 	AST_TEST_REGISTER(publish_sync);
 	AST_TEST_REGISTER(publish_pool);
 	AST_TEST_REGISTER(unsubscribe_stops_messages);
+	AST_TEST_REGISTER(unsubscribe_while_publishing);
+	AST_TEST_REGISTER(subscription_filter);
+	AST_TEST_REGISTER(statistics);
+	AST_TEST_REGISTER(subscribe_batch);
 	AST_TEST_REGISTER(forward);
 	AST_TEST_REGISTER(cache_filter);
 	AST_TEST_REGISTER(cache);
 	AST_TEST_REGISTER(cache_dump);
+	AST_TEST_REGISTER(cache_iterate);
 	AST_TEST_REGISTER(cache_eid_aggregate);
 	AST_TEST_REGISTER(router);
+	AST_TEST_REGISTER(router_many_routes);
 	AST_TEST_REGISTER(router_pool);
 	AST_TEST_REGISTER(router_cache_updates);
 	AST_TEST_REGISTER(interleaving);
@@ -0,0 +1,487 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Stasis throughput and latency benchmarks.
+ *
+ * Publishes messages to topics with 1, 16 and 256 subscribers using
+ * dedicated and pooled mailboxes, and through a caching topic, and reports
+ * how fast the messages are delivered. Each result is printed as a single
+ * line starting with "BENCH" followed by space separated key=value pairs,
+ * so runs can be collected and compared by scripts. The cost of publishing
+ * alone is measured with the benchmark framework.
+ *
+ * Run with 'test execute category /bench/stasis/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/astobj2.h"
+#include "asterisk/lock.h"
+#include "asterisk/module.h"
+#include "asterisk/stasis.h"
+#include "asterisk/test.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/stasis/";
+
+/*! Number of deliveries each fanout benchmark aims for */
+#define BENCH_DELIVERIES 100000
+/*! Fewest messages a benchmark publishes */
+#define BENCH_MIN_MESSAGES 100
+/*! Number of distinct entities the caching topic benchmark updates */
+#define BENCH_CACHE_ENTITIES 500
+/*! Longest time to wait for the messages to be delivered */
+#define BENCH_TIMEOUT_SECONDS 60
+
+/*! \brief State shared by the subscribers of a benchmark */
+struct bench_run {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! Number of subscribers which received every message */
+	int done;
+	/*! Number of messages each subscriber expects */
+	int expected;
+};
+
+/*! \brief Counters of a single subscriber, only touched by its callback */
+struct bench_subscriber {
+	struct bench_run *run;
+	struct stasis_subscription *sub;
+	int received;
+	int64_t latency_sum_us;
+	int64_t latency_max_us;
+};
+
+/*! \brief Benchmark message payload */
+struct bench_snapshot {
+	char id[16];
+};
+
+/*! Numbers of subscribers the fanout benchmarks are run with */
+static const int bench_subscriber_counts[] = { 1, 16, 256 };
+
+static struct stasis_message_type *bench_type;
+
+static const char *bench_snapshot_id(struct stasis_message *message)
+{
+	struct bench_snapshot *snapshot;
+
+	if (stasis_message_type(message) != bench_type) {
+		return NULL;
+	}
+	snapshot = stasis_message_data(message);
+	return snapshot->id;
+}
+
+static void bench_record(struct bench_subscriber *subscriber, struct stasis_message *message)
+{
+	int64_t latency_us = ast_tvdiff_us(ast_tvnow(), *stasis_message_timestamp(message));
+
+	subscriber->latency_sum_us += latency_us;
+	if (latency_us > subscriber->latency_max_us) {
+		subscriber->latency_max_us = latency_us;
+	}
+
+	if (++subscriber->received == subscriber->run->expected) {
+		ast_mutex_lock(&subscriber->run->lock);
+		subscriber->run->done++;
+		ast_cond_signal(&subscriber->run->cond);
+		ast_mutex_unlock(&subscriber->run->lock);
+	}
+}
+
+static void bench_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+	if (stasis_message_type(message) != bench_type) {
+		return;
+	}
+	bench_record(data, message);
+}
+
+static void bench_cache_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+	struct stasis_cache_update *update;
+
+	if (stasis_message_type(message) != stasis_cache_update_type()) {
+		return;
+	}
+	update = stasis_message_data(message);
+	if (!update->new_snapshot) {
+		return;
+	}
+	/* Measure from the publication of the snapshot, not of the update */
+	bench_record(data, update->new_snapshot);
+}
+
+static struct stasis_message *bench_message_create(int entity)
+{
+	struct bench_snapshot *snapshot;
+	struct stasis_message *message;
+
+	snapshot = ao2_alloc_options(sizeof(*snapshot), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!snapshot) {
+		return NULL;
+	}
+	snprintf(snapshot->id, sizeof(snapshot->id), "%d", entity);
+	message = stasis_message_create(bench_type, snapshot);
+	ao2_ref(snapshot, -1);
+	return message;
+}
+
+/*!
+ * \internal
+ * \brief Publish messages and wait until every subscriber received them.
+ *
+ * \param test Test being run.
+ * \param name Name of the benchmark, printed with the results.
+ * \param mode Subscription mode, printed with the results.
+ * \param topic Topic to publish to.
+ * \param run Shared state of the subscribers.
+ * \param subscribers The subscribers.
+ * \param count Number of subscribers.
+ * \param messages Number of messages to publish.
+ * \param entities Number of distinct entities the messages are about.
+ */
+static enum ast_test_result_state bench_publish(struct ast_test *test,
+	const char *name, const char *mode, struct stasis_topic *topic,
+	struct bench_run *run, struct bench_subscriber *subscribers, int count,
+	int messages, int entities)
+{
+	struct timeval start;
+	struct timeval end_tv;
+	struct timespec end;
+	int64_t elapsed_us;
+	int64_t latency_sum_us = 0;
+	int64_t latency_max_us = 0;
+	int64_t deliveries = 0;
+	int res = AST_TEST_PASS;
+	int i;
+
+	run->expected = messages;
+
+	start = ast_tvnow();
+	for (i = 0; i < messages; ++i) {
+		struct stasis_message *message = bench_message_create(i % entities);
+
+		if (!message) {
+			ast_test_status_update(test, "Failed to create message\n");
+			return AST_TEST_FAIL;
+		}
+		stasis_publish(topic, message);
+		ao2_ref(message, -1);
+	}
+
+	end_tv = ast_tvadd(start, ast_samp2tv(BENCH_TIMEOUT_SECONDS, 1));
+	end.tv_sec = end_tv.tv_sec;
+	end.tv_nsec = end_tv.tv_usec * 1000;
+
+	ast_mutex_lock(&run->lock);
+	while (run->done < count) {
+		if (ast_cond_timedwait(&run->cond, &run->lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	if (run->done < count) {
+		ast_test_status_update(test, "%s: only %d of %d subscribers received every message\n",
+			name, run->done, count);
+		res = AST_TEST_FAIL;
+	}
+	ast_mutex_unlock(&run->lock);
+
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+
+	for (i = 0; i < count; ++i) {
+		deliveries += subscribers[i].received;
+		latency_sum_us += subscribers[i].latency_sum_us;
+		if (subscribers[i].latency_max_us > latency_max_us) {
+			latency_max_us = subscribers[i].latency_max_us;
+		}
+	}
+
+	ast_test_status_update(test,
+		"BENCH name=%s mode=%s subscribers=%d messages=%d deliveries=%" PRId64
+		" elapsed_us=%" PRId64 " deliveries_per_sec=%" PRId64
+		" latency_avg_us=%" PRId64 " latency_max_us=%" PRId64 "\n",
+		name, mode, count, messages, deliveries, elapsed_us,
+		elapsed_us ? deliveries * 1000000 / elapsed_us : 0,
+		deliveries ? latency_sum_us / deliveries : 0,
+		latency_max_us);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Measure delivery to a number of subscribers of one topic.
+ *
+ * \param test Test being run.
+ * \param count Number of subscribers.
+ * \param use_pool Subscribe with stasis_subscribe_pool() instead of
+ *        stasis_subscribe().
+ */
+static enum ast_test_result_state bench_fanout(struct ast_test *test, int count, int use_pool)
+{
+	struct stasis_topic *topic;
+	struct bench_subscriber *subscribers;
+	struct bench_run run = { .done = 0, };
+	int res = AST_TEST_FAIL;
+	int i;
+
+	topic = stasis_topic_create("bench/fanout");
+	subscribers = ast_calloc(count, sizeof(*subscribers));
+	if (!topic || !subscribers) {
+		ao2_cleanup(topic);
+		ast_free(subscribers);
+		return AST_TEST_FAIL;
+	}
+	ast_mutex_init(&run.lock);
+	ast_cond_init(&run.cond, NULL);
+
+	for (i = 0; i < count; ++i) {
+		subscribers[i].run = &run;
+		subscribers[i].sub = use_pool
+			? stasis_subscribe_pool(topic, bench_cb, &subscribers[i])
+			: stasis_subscribe(topic, bench_cb, &subscribers[i]);
+		if (!subscribers[i].sub) {
+			ast_test_status_update(test, "Failed to subscribe\n");
+			goto cleanup;
+		}
+	}
+
+	res = bench_publish(test, "fanout", use_pool ? "pool" : "dedicated", topic,
+		&run, subscribers, count, MAX(BENCH_DELIVERIES / count, BENCH_MIN_MESSAGES), 1);
+
+cleanup:
+	for (i = 0; i < count; ++i) {
+		stasis_unsubscribe_and_join(subscribers[i].sub);
+	}
+	ast_free(subscribers);
+	ao2_cleanup(topic);
+	ast_mutex_destroy(&run.lock);
+	ast_cond_destroy(&run.cond);
+	return res;
+}
+
+AST_TEST_DEFINE(fanout_dedicated)
+{
+	int res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark delivery to dedicated subscriptions";
+		info->description = "Measure messages per second and publish to\n"
+			"delivery latency to 1, 16 and 256 subscriptions with a\n"
+			"taskprocessor of their own.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < ARRAY_LEN(bench_subscriber_counts); ++i) {
+		if (bench_fanout(test, bench_subscriber_counts[i], 0) != AST_TEST_PASS) {
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(fanout_pool)
+{
+	int res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark delivery to pooled subscriptions";
+		info->description = "Measure messages per second and publish to\n"
+			"delivery latency to 1, 16 and 256 subscriptions served by\n"
+			"the stasis thread pool.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < ARRAY_LEN(bench_subscriber_counts); ++i) {
+		if (bench_fanout(test, bench_subscriber_counts[i], 1) != AST_TEST_PASS) {
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(caching_topic)
+{
+	struct stasis_topic *topic = NULL;
+	struct stasis_cache *cache = NULL;
+	struct stasis_caching_topic *caching_topic = NULL;
+	struct bench_subscriber subscriber = { NULL, };
+	struct bench_run run = { .done = 0, };
+	int res = AST_TEST_FAIL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark a caching topic";
+		info->description = "Measure messages per second and publish to\n"
+			"delivery latency of snapshots published through a caching\n"
+			"topic to a subscriber of its cache updates.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_mutex_init(&run.lock);
+	ast_cond_init(&run.cond, NULL);
+	subscriber.run = &run;
+
+	topic = stasis_topic_create("bench/cache");
+	cache = stasis_cache_create(bench_snapshot_id);
+	if (!topic || !cache) {
+		goto cleanup;
+	}
+	caching_topic = stasis_caching_topic_create(topic, cache);
+	if (!caching_topic) {
+		goto cleanup;
+	}
+	subscriber.sub = stasis_subscribe(stasis_caching_get_topic(caching_topic),
+		bench_cache_cb, &subscriber);
+	if (!subscriber.sub) {
+		goto cleanup;
+	}
+
+	res = bench_publish(test, "caching_topic", "dedicated", topic, &run,
+		&subscriber, 1, BENCH_DELIVERIES, BENCH_CACHE_ENTITIES);
+
+cleanup:
+	stasis_unsubscribe_and_join(subscriber.sub);
+	stasis_caching_unsubscribe_and_join(caching_topic);
+	ao2_cleanup(cache);
+	ao2_cleanup(topic);
+	ast_mutex_destroy(&run.lock);
+	ast_cond_destroy(&run.cond);
+	return res;
+}
+
+/*! \brief What the publish benchmark publishes, and to where */
+struct bench_publisher {
+	struct stasis_topic *topic;
+	struct stasis_subscription *sub;
+	struct stasis_message *message;
+};
+
+static void bench_ignore_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+}
+
+static void publish_teardown(void *data)
+{
+	struct bench_publisher *bench = data;
+
+	stasis_unsubscribe_and_join(bench->sub);
+	ao2_cleanup(bench->message);
+	ao2_cleanup(bench->topic);
+	ast_free(bench);
+}
+
+static int publish_setup(struct ast_test *test, void **data)
+{
+	struct bench_publisher *bench = ast_calloc(1, sizeof(*bench));
+
+	if (!bench) {
+		return -1;
+	}
+	bench->topic = stasis_topic_create("bench/publish");
+	bench->message = bench_message_create(0);
+	if (bench->topic) {
+		bench->sub = stasis_subscribe(bench->topic, bench_ignore_cb, NULL);
+	}
+	if (!bench->sub || !bench->message) {
+		ast_test_status_update(test, "Failed to subscribe\n");
+		publish_teardown(bench);
+		return -1;
+	}
+
+	*data = bench;
+	return 0;
+}
+
+static int publish_op(void *data, unsigned int iteration)
+{
+	struct bench_publisher *bench = data;
+
+	stasis_publish(bench->topic, bench->message);
+	return 0;
+}
+
+AST_BENCH_DEFINE(publish)
+{
+	bench->name = "publish";
+	bench->category = test_category;
+	bench->summary = "Publish a message to a topic";
+	bench->description = "Measure the cost to the publisher of publishing\n"
+		"a message to a topic with one subscriber.";
+	bench->iterations = 100000;
+	bench->batch = 10;
+	bench->setup = publish_setup;
+	bench->op = publish_op;
+	bench->teardown = publish_teardown;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(fanout_dedicated);
+	AST_TEST_UNREGISTER(fanout_pool);
+	AST_TEST_UNREGISTER(caching_topic);
+	AST_TEST_UNREGISTER(publish);
+	ao2_cleanup(bench_type);
+	bench_type = NULL;
+	return 0;
+}
+
+static int load_module(void)
+{
+	if (stasis_message_type_create("BenchSnapshot", NULL, &bench_type) != STASIS_MESSAGE_TYPE_SUCCESS) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	AST_TEST_REGISTER(fanout_dedicated);
+	AST_TEST_REGISTER(fanout_pool);
+	AST_TEST_REGISTER(caching_topic);
+	AST_TEST_REGISTER(publish);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Stasis benchmarks");
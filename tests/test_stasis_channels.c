@@ -27,6 +27,7 @@
 
 /*** MODULEINFO
 	<depend>TEST_FRAMEWORK</depend>
+	<depend>res_stasis_test</depend>
 	<support_level>core</support_level>
  ***/
 
@@ -41,6 +42,7 @@ ASTERISK_REGISTER_FILE()
 #include "asterisk/test.h"
 #include "asterisk/stasis_channels.h"
 #include "asterisk/channel.h"
+#include "asterisk/stasis_test.h"
 
 static const char *test_category = "/stasis/channels/";
 
@@ -306,6 +308,102 @@ AST_TEST_DEFINE(channel_snapshot_json)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(channel_snapshot_segments)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel_snapshot *, first, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel_snapshot *, second, NULL, ao2_cleanup);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test sharing of unchanged channel snapshot segments";
+		info->description = "Take two snapshots of a channel with a dialplan step\n"
+			"in between and check that only the dialplan segment was copied.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = ast_channel_alloc(0, AST_STATE_DOWN, "cid_num", "cid_name", "acctcode", "exten", "context", NULL, NULL, 0, "TEST/name");
+	ast_test_validate(test, NULL != chan);
+	first = ast_channel_snapshot_create(chan);
+	ast_channel_exten_set(chan, "next");
+	ast_channel_priority_set(chan, 2);
+	second = ast_channel_snapshot_create(chan);
+	ast_channel_unlock(chan);
+	ast_test_validate(test, NULL != first);
+	ast_test_validate(test, NULL != second);
+
+	ast_test_validate(test, first->base == second->base);
+	ast_test_validate(test, first->name == second->name);
+	ast_test_validate(test, first->peer == second->peer);
+	ast_test_validate(test, first->caller == second->caller);
+	ast_test_validate(test, first->bridge == second->bridge);
+	ast_test_validate(test, first->dialplan != second->dialplan);
+
+	ast_test_validate(test, !strcmp(first->exten, "exten"));
+	ast_test_validate(test, !strcmp(second->exten, "next"));
+	ast_test_validate(test, !strcmp(second->context, "context"));
+	ast_test_validate(test, 1 == first->priority);
+	ast_test_validate(test, 2 == second->priority);
+	ast_test_validate(test, !strcmp(second->name, "TEST/name"));
+	ast_test_validate(test, !strcmp(second->caller_number, "cid_num"));
+	ast_test_validate(test, !strcmp(second->bridgeid, ""));
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(channel_topic_lazy)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	RAII_VAR(struct stasis_message_sink *, sink, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, sub, NULL, stasis_unsubscribe_and_join);
+	RAII_VAR(struct ast_channel_snapshot *, cached, NULL, ao2_cleanup);
+	struct stasis_topic *topic;
+	int actual_count;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test publishing for a channel without its own topic";
+		info->description = "Publish a snapshot of a channel nothing subscribed to\n"
+			"and check that it is cached, then subscribe to the channel's\n"
+			"topic and check that its messages arrive there.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = ast_channel_alloc(0, AST_STATE_DOWN, "cid_num", "cid_name", "acctcode", "exten", "context", NULL, NULL, 0, "TEST/lazy");
+	ast_test_validate(test, NULL != chan);
+	ast_channel_exten_set(chan, "lazy");
+	ast_channel_publish_snapshot(chan);
+	ast_channel_unlock(chan);
+
+	/* The cache is updated by the publisher, not by a subscription */
+	cached = ast_channel_snapshot_get_latest(ast_channel_uniqueid(chan));
+	ast_test_validate(test, NULL != cached);
+	ast_test_validate(test, !strcmp(cached->exten, "lazy"));
+
+	sink = stasis_message_sink_create();
+	ast_test_validate(test, NULL != sink);
+	topic = ast_channel_topic(chan);
+	ast_test_validate(test, NULL != topic);
+	ast_test_validate(test, topic == ast_channel_topic(chan));
+	sub = stasis_subscribe(topic, stasis_message_sink_cb(), sink);
+	ast_test_validate(test, NULL != sub);
+
+	ast_channel_publish_blob(chan, ast_channel_varset_type(), NULL);
+	actual_count = stasis_message_sink_wait_for_count(sink, 1, STASIS_SINK_DEFAULT_WAIT);
+	ast_test_validate(test, 1 == actual_count);
+	ast_test_validate(test, ast_channel_varset_type() == stasis_message_type(sink->messages[0]));
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(channel_blob_create);
@@ -313,6 +411,8 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(multi_channel_blob_create);
 	AST_TEST_UNREGISTER(multi_channel_blob_snapshots);
 	AST_TEST_UNREGISTER(channel_snapshot_json);
+	AST_TEST_UNREGISTER(channel_snapshot_segments);
+	AST_TEST_UNREGISTER(channel_topic_lazy);
 
 	return 0;
 }
@@ -324,11 +424,14 @@ static int load_module(void)
 	AST_TEST_REGISTER(multi_channel_blob_create);
 	AST_TEST_REGISTER(multi_channel_blob_snapshots);
 	AST_TEST_REGISTER(channel_snapshot_json);
+	AST_TEST_REGISTER(channel_snapshot_segments);
+	AST_TEST_REGISTER(channel_topic_lazy);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
 AST_MODULE_INFO(ASTERISK_GPL_KEY, 0, "Stasis Channel Testing",
 	.load = load_module,
-	.unload = unload_module
+	.unload = unload_module,
+	.nonoptreq = "res_stasis_test",
 );
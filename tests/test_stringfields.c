@@ -400,10 +400,80 @@ error:
 	return AST_TEST_FAIL;
 }
 
+AST_TEST_DEFINE(string_field_interned_test)
+{
+	struct test_struct {
+		AST_DECLARE_STRING_FIELDS (
+			AST_STRING_FIELD(string1);
+			AST_STRING_FIELD(string2);
+		);
+	} inst1, inst2;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "string_field_interned_test";
+		info->category = "/main/utils/";
+		info->summary = "Test interned stringfields";
+		info->description =
+			"This tests that interned values are shared between structures\n"
+			"and are replaced, not overwritten, when the field is set again";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_string_field_init(&inst1, 32);
+	ast_string_field_init(&inst2, 32);
+
+	ast_string_field_set_interned(&inst1, string1, "from-internal");
+	ast_string_field_set_interned(&inst2, string1, "from-internal");
+	if (strcmp(inst1.string1, "from-internal") || inst1.string1 != inst2.string1) {
+		ast_test_status_update(test, "Interned values are not the same string\n");
+		goto end;
+	}
+
+	ast_string_field_set(&inst1, string2, "en");
+	if (ast_string_fields_copy(&inst2, &inst1)) {
+		ast_test_status_update(test, "Copying structure 1 to structure 2 failed\n");
+		goto end;
+	}
+	if (inst2.string1 != inst1.string1) {
+		ast_test_status_update(test, "Copying an interned value copied the string\n");
+		goto end;
+	}
+	if (inst2.string2 == inst1.string2 || strcmp(inst2.string2, "en")) {
+		ast_test_status_update(test, "Copying a value that is not interned did not copy the string\n");
+		goto end;
+	}
+
+	/* Setting the field again must not write to the shared string */
+	ast_string_field_set(&inst1, string1, "default");
+	ast_string_field_build(&inst2, string1, "%s", "x");
+	if (strcmp(inst1.string1, "default") || strcmp(inst2.string1, "x")) {
+		ast_test_status_update(test, "Setting interned fields gave '%s' and '%s'\n",
+			inst1.string1, inst2.string1);
+		goto end;
+	}
+	ast_string_field_set_interned(&inst1, string2, "from-internal");
+	if (strcmp(inst1.string2, "from-internal")) {
+		ast_test_status_update(test, "The interned string was overwritten with '%s'\n", inst1.string2);
+		goto end;
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	ast_string_field_free_memory(&inst1);
+	ast_string_field_free_memory(&inst2);
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(string_field_aggregate_test);
 	AST_TEST_UNREGISTER(string_field_test);
+	AST_TEST_UNREGISTER(string_field_interned_test);
 	return 0;
 }
 
@@ -411,6 +481,7 @@ static int load_module(void)
 {
 	AST_TEST_REGISTER(string_field_test);
 	AST_TEST_REGISTER(string_field_aggregate_test);
+	AST_TEST_REGISTER(string_field_interned_test);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
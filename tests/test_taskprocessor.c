@@ -194,13 +194,14 @@ static int load_task(void *data)
 }
 
 /*!
- * \brief Load test for taskprocessor with default listener
+ * \brief Queue a large number of tasks and check they all execute in order
  *
- * This test queues a large number of tasks, each with random data associated.
- * The test ensures that all of the tasks are run and that the tasks are executed
- * in the same order that they were queued
+ * \param test The test being run
+ * \param name Name of the taskprocessor to create
+ * \param options Options used to create the taskprocessor
  */
-AST_TEST_DEFINE(default_taskprocessor_load)
+static enum ast_test_result_state taskprocessor_load(struct ast_test *test,
+	const char *name, enum ast_tps_options options)
 {
 	struct ast_taskprocessor *tps;
 	struct timeval start;
@@ -210,19 +211,7 @@ AST_TEST_DEFINE(default_taskprocessor_load)
 	int i;
 	int rand_data[NUM_TASKS];
 
-	switch (cmd) {
-	case TEST_INIT:
-		info->name = "default_taskprocessor_load";
-		info->category = "/main/taskprocessor/";
-		info->summary = "Load test of default taskproccesor";
-		info->description =
-			"Ensure that a large number of queued tasks are executed in the proper order.";
-		return AST_TEST_NOT_RUN;
-	case TEST_EXECUTE:
-		break;
-	}
-
-	tps = ast_taskprocessor_get("test", TPS_REF_DEFAULT);
+	tps = ast_taskprocessor_get(name, options);
 
 	if (!tps) {
 		ast_test_status_update(test, "Unable to create test taskprocessor\n");
@@ -274,6 +263,54 @@ test_end:
 	return res;
 }
 
+/*!
+ * \brief Load test for taskprocessor with default listener
+ *
+ * This test queues a large number of tasks, each with random data associated.
+ * The test ensures that all of the tasks are run and that the tasks are executed
+ * in the same order that they were queued
+ */
+AST_TEST_DEFINE(default_taskprocessor_load)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "default_taskprocessor_load";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Load test of default taskproccesor";
+		info->description =
+			"Ensure that a large number of queued tasks are executed in the proper order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return taskprocessor_load(test, "test", TPS_REF_DEFAULT);
+}
+
+/*!
+ * \brief Load test for taskprocessor with a lock-free queue
+ *
+ * Same as default_taskprocessor_load except that the taskprocessor is
+ * created with a lock-free task queue.
+ */
+AST_TEST_DEFINE(lockfree_taskprocessor_load)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "lockfree_taskprocessor_load";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Load test of taskproccesor with a lock-free queue";
+		info->description =
+			"Ensure that a large number of tasks queued to a lock-free taskprocessor\n"
+			"are executed in the proper order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return taskprocessor_load(test, "test_lockfree", TPS_REF_DEFAULT | TPS_QUEUE_LOCKFREE);
+}
+
 /*!
  * \brief Private data for the test taskprocessor listener
  */
@@ -390,6 +427,41 @@ static int check_stats(struct ast_test *test, const struct test_listener_pvt *pv
 	return 0;
 }
 
+/*!
+ * \brief Check that the latency histograms account for every executed task
+ *
+ * \param test The unit test
+ * \param tps The taskprocessor to check
+ * \param num_executed The number of tasks that have been executed
+ * \retval 0 Histograms match the number of executed tasks
+ * \retval -1 Histograms do not match
+ */
+static int check_latency(struct ast_test *test, struct ast_taskprocessor *tps, unsigned long num_executed)
+{
+	struct ast_taskprocessor_latency latency;
+	unsigned long waited = 0;
+	unsigned long executed = 0;
+	int i;
+
+	if (ast_taskprocessor_latency_get(tps, &latency)) {
+		ast_test_status_update(test, "Unable to get taskprocessor latency\n");
+		return -1;
+	}
+
+	for (i = 0; i < AST_TASKPROCESSOR_HISTOGRAM_BUCKETS; ++i) {
+		waited += latency.wait[i];
+		executed += latency.execute[i];
+	}
+
+	if (waited != num_executed || executed != num_executed) {
+		ast_test_status_update(test, "Latency histograms hold %lu wait and %lu execute samples. Expected %lu\n",
+				waited, executed, num_executed);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*!
  * \brief Test for a taskprocessor with custom listener.
  *
@@ -466,6 +538,11 @@ AST_TEST_DEFINE(taskprocessor_listener)
 		goto test_exit;
 	}
 
+	if (check_latency(test, tps, 2) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
 	tps = ast_taskprocessor_unreference(tps);
 
 	if (!pvt->shutdown) {
@@ -481,6 +558,185 @@ test_exit:
 	return res;
 }
 
+AST_TEST_DEFINE(taskprocessor_execute_batch)
+{
+	struct ast_taskprocessor *tps = NULL;
+	struct ast_taskprocessor_listener *listener = NULL;
+	struct test_listener_pvt *pvt = NULL;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int executed;
+	int more;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor_execute_batch";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Test of executing taskprocessor tasks in batches";
+		info->description =
+			"Ensures that ast_taskprocessor_execute_batch() executes no more\n"
+			"than the requested number of tasks and reports when the\n"
+			"taskprocessor becomes empty.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	pvt = test_listener_pvt_alloc();
+	if (!pvt) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener user data\n");
+		return AST_TEST_FAIL;
+	}
+
+	listener = ast_taskprocessor_listener_alloc(&test_callbacks, pvt);
+	if (!listener) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	tps = ast_taskprocessor_create_with_listener("test_batch", listener);
+	if (!tps) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	for (i = 0; i < 3; ++i) {
+		ast_taskprocessor_push(tps, listener_test_task, NULL);
+	}
+
+	more = ast_taskprocessor_execute_batch(tps, 2, &executed);
+	if (executed != 2 || !more || ast_taskprocessor_size(tps) != 1) {
+		ast_test_status_update(test, "First batch executed %d tasks and left %ld. Expected 2 and 1\n",
+				executed, ast_taskprocessor_size(tps));
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_stats(test, pvt, 3, 0, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	more = ast_taskprocessor_execute_batch(tps, 2, &executed);
+	if (executed != 1 || more) {
+		ast_test_status_update(test, "Second batch executed %d tasks. Expected 1\n", executed);
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_stats(test, pvt, 3, 1, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	more = ast_taskprocessor_execute_batch(tps, 2, &executed);
+	if (executed != 0 || more) {
+		ast_test_status_update(test, "Batch on empty taskprocessor executed %d tasks\n", executed);
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_latency(test, tps, 3) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+test_exit:
+	ao2_cleanup(listener);
+	/* This is safe even if tps is NULL */
+	ast_taskprocessor_unreference(tps);
+	ast_free(pvt);
+	return res;
+}
+
+AST_TEST_DEFINE(taskprocessor_alert)
+{
+	struct ast_taskprocessor *tps = NULL;
+	struct ast_taskprocessor_listener *listener = NULL;
+	struct test_listener_pvt *pvt = NULL;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor_alert";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Test of taskprocessor overload alerts";
+		info->description =
+			"Ensures that a taskprocessor raises an overload alert when its\n"
+			"queue reaches the high water level and clears it once the queue\n"
+			"drains to the low water level.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	pvt = test_listener_pvt_alloc();
+	if (!pvt) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener user data\n");
+		return AST_TEST_FAIL;
+	}
+
+	listener = ast_taskprocessor_listener_alloc(&test_callbacks, pvt);
+	if (!listener) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	tps = ast_taskprocessor_create_with_listener("test_alert", listener);
+	if (!tps) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (!ast_taskprocessor_alert_set_levels(tps, 6, 5)) {
+		ast_test_status_update(test, "Accepted a low water level above the high water level\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (ast_taskprocessor_alert_set_levels(tps, 2, 5)) {
+		ast_test_status_update(test, "Unable to set taskprocessor water levels\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	for (i = 1; i <= 5; ++i) {
+		ast_taskprocessor_push(tps, listener_test_task, NULL);
+		if (ast_taskprocessor_is_overloaded(tps) != (i == 5)) {
+			ast_test_status_update(test, "Unexpected overload alert state with %d queued tasks\n", i);
+			res = AST_TEST_FAIL;
+			goto test_exit;
+		}
+	}
+
+	if (!ast_taskprocessor_alert_get()) {
+		ast_test_status_update(test, "Overload alert is not counted\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	for (i = 4; i >= 2; --i) {
+		ast_taskprocessor_execute(tps);
+		if (ast_taskprocessor_is_overloaded(tps) != (i > 2)) {
+			ast_test_status_update(test, "Unexpected overload alert state with %d queued tasks\n", i);
+			res = AST_TEST_FAIL;
+			goto test_exit;
+		}
+	}
+
+test_exit:
+	ao2_cleanup(listener);
+	/* This is safe even if tps is NULL */
+	ast_taskprocessor_unreference(tps);
+	ast_free(pvt);
+	return res;
+}
+
 struct shutdown_data {
 	ast_cond_t in;
 	ast_cond_t out;
@@ -731,7 +987,10 @@ static int unload_module(void)
 {
 	ast_test_unregister(default_taskprocessor);
 	ast_test_unregister(default_taskprocessor_load);
+	ast_test_unregister(lockfree_taskprocessor_load);
 	ast_test_unregister(taskprocessor_listener);
+	ast_test_unregister(taskprocessor_execute_batch);
+	ast_test_unregister(taskprocessor_alert);
 	ast_test_unregister(taskprocessor_shutdown);
 	ast_test_unregister(taskprocessor_push_local);
 	return 0;
@@ -741,7 +1000,10 @@ static int load_module(void)
 {
 	ast_test_register(default_taskprocessor);
 	ast_test_register(default_taskprocessor_load);
+	ast_test_register(lockfree_taskprocessor_load);
 	ast_test_register(taskprocessor_listener);
+	ast_test_register(taskprocessor_execute_batch);
+	ast_test_register(taskprocessor_alert);
 	ast_test_register(taskprocessor_shutdown);
 	ast_test_register(taskprocessor_push_local);
 	return AST_MODULE_LOAD_SUCCESS;
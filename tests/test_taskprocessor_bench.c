@@ -0,0 +1,230 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Taskprocessor benchmarks.
+ *
+ * Measures pushing tasks and executing them on the pushing thread, which
+ * is the cost of the queue itself, and pushing a task to a taskprocessor's
+ * own thread and waiting for it to run.
+ *
+ * Run with 'bench execute category /bench/taskprocessor/'.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/lock.h"
+#include "asterisk/module.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/test.h"
+#include "asterisk/utils.h"
+
+static const char *test_category = "/bench/taskprocessor/";
+
+/*! \brief A taskprocessor run by a benchmark, and what its tasks signal */
+struct bench_tps {
+	struct ast_taskprocessor_listener *listener;
+	struct ast_taskprocessor *tps;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! Number of tasks run */
+	unsigned int executed;
+};
+
+static int bench_listener_start(struct ast_taskprocessor_listener *listener)
+{
+	return 0;
+}
+
+static void bench_listener_task_pushed(struct ast_taskprocessor_listener *listener, int was_empty)
+{
+	/* The benchmark executes the tasks itself */
+}
+
+static void bench_listener_emptied(struct ast_taskprocessor_listener *listener)
+{
+}
+
+static void bench_listener_shutdown(struct ast_taskprocessor_listener *listener)
+{
+}
+
+static const struct ast_taskprocessor_listener_callbacks bench_listener_callbacks = {
+	.start = bench_listener_start,
+	.task_pushed = bench_listener_task_pushed,
+	.emptied = bench_listener_emptied,
+	.shutdown = bench_listener_shutdown,
+};
+
+static int bench_task(void *data)
+{
+	struct bench_tps *bench = data;
+
+	++bench->executed;
+	return 0;
+}
+
+static int bench_signal_task(void *data)
+{
+	struct bench_tps *bench = data;
+
+	ast_mutex_lock(&bench->lock);
+	++bench->executed;
+	ast_cond_signal(&bench->cond);
+	ast_mutex_unlock(&bench->lock);
+	return 0;
+}
+
+static void bench_tps_teardown(void *data)
+{
+	struct bench_tps *bench = data;
+
+	ast_taskprocessor_unreference(bench->tps);
+	ao2_cleanup(bench->listener);
+	ast_mutex_destroy(&bench->lock);
+	ast_cond_destroy(&bench->cond);
+	ast_free(bench);
+}
+
+static struct bench_tps *bench_tps_alloc(void)
+{
+	struct bench_tps *bench = ast_calloc(1, sizeof(*bench));
+
+	if (!bench) {
+		return NULL;
+	}
+	ast_mutex_init(&bench->lock);
+	ast_cond_init(&bench->cond, NULL);
+	return bench;
+}
+
+static int push_execute_setup(struct ast_test *test, void **data)
+{
+	struct bench_tps *bench = bench_tps_alloc();
+
+	if (!bench) {
+		return -1;
+	}
+	bench->listener = ast_taskprocessor_listener_alloc(&bench_listener_callbacks, bench);
+	if (bench->listener) {
+		bench->tps = ast_taskprocessor_create_with_listener("bench_push_execute", bench->listener);
+	}
+	if (!bench->tps) {
+		ast_test_status_update(test, "Failed to create the taskprocessor\n");
+		bench_tps_teardown(bench);
+		return -1;
+	}
+
+	*data = bench;
+	return 0;
+}
+
+static int push_execute_op(void *data, unsigned int iteration)
+{
+	struct bench_tps *bench = data;
+
+	if (ast_taskprocessor_push(bench->tps, bench_task, bench)) {
+		return -1;
+	}
+	ast_taskprocessor_execute(bench->tps);
+	return bench->executed != iteration + 1;
+}
+
+static int roundtrip_setup(struct ast_test *test, void **data)
+{
+	struct bench_tps *bench = bench_tps_alloc();
+
+	if (!bench) {
+		return -1;
+	}
+	bench->tps = ast_taskprocessor_get("bench_roundtrip", TPS_REF_DEFAULT);
+	if (!bench->tps) {
+		ast_test_status_update(test, "Failed to create the taskprocessor\n");
+		bench_tps_teardown(bench);
+		return -1;
+	}
+
+	*data = bench;
+	return 0;
+}
+
+static int roundtrip_op(void *data, unsigned int iteration)
+{
+	struct bench_tps *bench = data;
+
+	if (ast_taskprocessor_push(bench->tps, bench_signal_task, bench)) {
+		return -1;
+	}
+	ast_mutex_lock(&bench->lock);
+	while (bench->executed != iteration + 1) {
+		ast_cond_wait(&bench->cond, &bench->lock);
+	}
+	ast_mutex_unlock(&bench->lock);
+	return 0;
+}
+
+AST_BENCH_DEFINE(push_execute)
+{
+	bench->name = "push_execute";
+	bench->category = test_category;
+	bench->summary = "Push a task and execute it on the same thread";
+	bench->description = "Push a task to a taskprocessor with a listener that\n"
+		"does not run it, and execute it with ast_taskprocessor_execute().";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->setup = push_execute_setup;
+	bench->op = push_execute_op;
+	bench->teardown = bench_tps_teardown;
+}
+
+AST_BENCH_DEFINE(push_roundtrip)
+{
+	bench->name = "push_roundtrip";
+	bench->category = test_category;
+	bench->summary = "Push a task to a taskprocessor thread and wait for it";
+	bench->description = "Push a task to a taskprocessor with its own thread\n"
+		"and wait until the task has run.";
+	bench->iterations = 100000;
+	bench->setup = roundtrip_setup;
+	bench->op = roundtrip_op;
+	bench->teardown = bench_tps_teardown;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(push_execute);
+	AST_TEST_UNREGISTER(push_roundtrip);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(push_execute);
+	AST_TEST_REGISTER(push_roundtrip);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Taskprocessor benchmarks");
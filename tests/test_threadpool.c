@@ -1100,6 +1100,88 @@ end:
 	return res;
 }
 
+AST_TEST_DEFINE(threadpool_autoscale)
+{
+	struct ast_threadpool *pool = NULL;
+	struct ast_threadpool_listener *listener = NULL;
+	struct simple_task_data *std1 = NULL;
+	struct simple_task_data *std2 = NULL;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct test_listener_data *tld = NULL;
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = 0,
+		.max_size = 4,
+		.autoscale_target_wait = 1,
+		.autoscale_min_size = 2,
+		.autoscale_cooldown = 0,
+	};
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "autoscale";
+		info->category = "/main/threadpool/";
+		info->summary = "Test that an autoscaling threadpool grows to its minimum size";
+		info->description =
+			"Create an empty threadpool that does not grow on its own and push a\n"
+			"task to it. Once the autoscaler takes its first sample it should grow\n"
+			"the pool to its minimum size of two threads, which run the task.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	tld = test_alloc();
+	if (!tld) {
+		return AST_TEST_FAIL;
+	}
+
+	listener = ast_threadpool_listener_alloc(&test_callbacks, tld);
+	if (!listener) {
+		goto end;
+	}
+
+	pool = ast_threadpool_create(info->name, listener, &options);
+	if (!pool) {
+		goto end;
+	}
+
+	std1 = simple_task_data_alloc();
+	std2 = simple_task_data_alloc();
+	if (!std1 || !std2) {
+		goto end;
+	}
+
+	ast_threadpool_push(pool, simple_task, std1);
+
+	/* Let the first autoscaler sample become due */
+	usleep(1100000);
+
+	ast_threadpool_push(pool, simple_task, std2);
+
+	res = wait_for_completion(test, std1);
+	if (res == AST_TEST_FAIL) {
+		goto end;
+	}
+
+	res = wait_for_completion(test, std2);
+	if (res == AST_TEST_FAIL) {
+		goto end;
+	}
+
+	res = wait_until_thread_state(test, tld, 0, 2);
+
+end:
+	ast_threadpool_shutdown(pool);
+	ao2_cleanup(listener);
+	ast_free(std1);
+	ast_free(std2);
+	ast_free(tld);
+	return res;
+}
+
 AST_TEST_DEFINE(threadpool_reactivation)
 {
 	struct ast_threadpool *pool = NULL;
@@ -1684,6 +1766,157 @@ end:
 	return res;
 }
 
+struct ordered_task_data {
+	/*! Number of tasks that have executed */
+	int executed;
+	/*! Set if a task executed before one pushed ahead of it */
+	int out_of_order;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+};
+
+struct ordered_task {
+	struct ordered_task_data *otd;
+	int seq;
+};
+
+static int ordered_task(void *data)
+{
+	struct ordered_task *task = data;
+	struct ordered_task_data *otd = task->otd;
+	SCOPED_MUTEX(lock, &otd->lock);
+
+	if (task->seq != otd->executed) {
+		otd->out_of_order = 1;
+	}
+	++otd->executed;
+	ast_cond_signal(&otd->cond);
+	return 0;
+}
+
+#define ORDERED_TASKS 100
+
+AST_TEST_DEFINE(threadpool_work_stealing)
+{
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct ast_threadpool *pool = NULL;
+	struct ast_taskprocessor *uut = NULL;
+	struct complex_task_data *data1 = NULL;
+	struct complex_task_data *data2 = NULL;
+	struct ordered_task_data otd = { 0, };
+	struct ordered_task tasks[ORDERED_TASKS];
+	struct timeval start;
+	struct timespec end;
+	int i;
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = 2,
+		.max_size = 0,
+		.work_stealing = 1,
+	};
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "threadpool_work_stealing";
+		info->category = "/main/threadpool/";
+		info->summary = "Test a threadpool in work-stealing mode";
+		info->description =
+			"Ensures that tasks pushed into a work-stealing threadpool are\n"
+			"executed by any free thread and that tasks enqueued to a\n"
+			"serializer on the pool still execute in sequence.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_mutex_init(&otd.lock);
+	ast_cond_init(&otd.cond, NULL);
+
+	pool = ast_threadpool_create("threadpool_work_stealing", NULL, &options);
+	if (!pool) {
+		ast_test_status_update(test, "Could not create threadpool\n");
+		goto end;
+	}
+	uut = ast_threadpool_serializer("ser_stealing", pool);
+	data1 = complex_task_data_alloc();
+	data2 = complex_task_data_alloc();
+	if (!uut || !data1 || !data2) {
+		ast_test_status_update(test, "Allocation failed\n");
+		goto end;
+	}
+
+	/* Occupy one thread, the other thread must still pick up work */
+	if (ast_threadpool_push(pool, complex_task, data1)) {
+		ast_test_status_update(test, "Failed to enqueue data1\n");
+		goto end;
+	}
+	if (!wait_for_complex_start(data1)) {
+		ast_test_status_update(test, "Failed to start data1\n");
+		goto end;
+	}
+	if (ast_threadpool_push(pool, complex_task, data2)) {
+		ast_test_status_update(test, "Failed to enqueue data2\n");
+		goto end;
+	}
+	if (!wait_for_complex_start(data2)) {
+		ast_test_status_update(test, "Failed to start data2 while data1 was running\n");
+		goto end;
+	}
+	poke_worker(data1);
+	poke_worker(data2);
+	if (wait_for_complex_completion(data1) == AST_TEST_FAIL
+		|| wait_for_complex_completion(data2) == AST_TEST_FAIL) {
+		ast_test_status_update(test, "Tasks did not complete\n");
+		goto end;
+	}
+
+	/* Serializer tasks must run in the order they were pushed */
+	for (i = 0; i < ORDERED_TASKS; ++i) {
+		tasks[i].otd = &otd;
+		tasks[i].seq = i;
+		if (ast_taskprocessor_push(uut, ordered_task, &tasks[i])) {
+			ast_test_status_update(test, "Failed to enqueue ordered task %d\n", i);
+			goto end;
+		}
+	}
+
+	start = ast_tvnow();
+	end.tv_sec = start.tv_sec + 5;
+	end.tv_nsec = start.tv_usec * 1000;
+	ast_mutex_lock(&otd.lock);
+	while (otd.executed < ORDERED_TASKS) {
+		if (ast_cond_timedwait(&otd.cond, &otd.lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&otd.lock);
+
+	if (otd.executed != ORDERED_TASKS) {
+		ast_test_status_update(test, "Only %d of %d serialized tasks executed\n",
+			otd.executed, ORDERED_TASKS);
+		goto end;
+	}
+	if (otd.out_of_order) {
+		ast_test_status_update(test, "Serialized tasks executed out of order\n");
+		goto end;
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	poke_worker(data1);
+	poke_worker(data2);
+	ast_taskprocessor_unreference(uut);
+	ast_threadpool_shutdown(pool);
+	ast_free(data1);
+	ast_free(data2);
+	ast_mutex_destroy(&otd.lock);
+	ast_cond_destroy(&otd.cond);
+	return res;
+}
+
 static int unload_module(void)
 {
 	ast_test_unregister(threadpool_push);
@@ -1697,11 +1930,13 @@ static int unload_module(void)
 	ast_test_unregister(threadpool_one_thread_multiple_tasks);
 	ast_test_unregister(threadpool_auto_increment);
 	ast_test_unregister(threadpool_max_size);
+	ast_test_unregister(threadpool_autoscale);
 	ast_test_unregister(threadpool_reactivation);
 	ast_test_unregister(threadpool_task_distribution);
 	ast_test_unregister(threadpool_more_destruction);
 	ast_test_unregister(threadpool_serializer);
 	ast_test_unregister(threadpool_serializer_dupe);
+	ast_test_unregister(threadpool_work_stealing);
 	return 0;
 }
 
@@ -1718,11 +1953,13 @@ static int load_module(void)
 	ast_test_register(threadpool_one_thread_multiple_tasks);
 	ast_test_register(threadpool_auto_increment);
 	ast_test_register(threadpool_max_size);
+	ast_test_register(threadpool_autoscale);
 	ast_test_register(threadpool_reactivation);
 	ast_test_register(threadpool_task_distribution);
 	ast_test_register(threadpool_more_destruction);
 	ast_test_register(threadpool_serializer);
 	ast_test_register(threadpool_serializer_dupe);
+	ast_test_register(threadpool_work_stealing);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
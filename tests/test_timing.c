@@ -0,0 +1,207 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2026, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Timing API unit tests
+ *
+ * The tests use the timing module ast_timer_open() picks, so load the
+ * module to test on its own or give it the highest priority.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+ASTERISK_REGISTER_FILE()
+
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/time.h"
+#include "asterisk/timing.h"
+#include "asterisk/poll-compat.h"
+
+#define TEST_CATEGORY "/main/timing/"
+
+/*! \brief Rate the timers tick at */
+#define TEST_RATE 50
+
+/*! \brief Ticks counted to check the rate */
+#define TEST_TICKS 10
+
+/*!
+ * \brief Wait for a timer to tick
+ *
+ * \retval 1 if it ticked
+ * \retval 0 if it did not in time
+ * \retval -1 on error
+ */
+static int timer_wait(struct ast_timer *timer, int ms)
+{
+	struct pollfd pfd = {
+		.fd = ast_timer_fd(timer),
+		.events = POLLIN | POLLPRI,
+	};
+
+	return ast_poll(&pfd, 1, ms);
+}
+
+/*! \brief Acknowledge the ticks a timer has pending */
+static void timer_drain(struct ast_timer *timer)
+{
+	while (timer_wait(timer, 0) > 0) {
+		if (ast_timer_ack(timer, 1)) {
+			break;
+		}
+	}
+}
+
+static void safe_timer_close(struct ast_timer *timer)
+{
+	if (timer) {
+		ast_timer_close(timer);
+	}
+}
+
+AST_TEST_DEFINE(timer_rate)
+{
+	RAII_VAR(struct ast_timer *, timer, NULL, safe_timer_close);
+	struct timeval start;
+	int64_t elapsed;
+	int ticks;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test that a timer ticks at its rate";
+		info->description =
+			"This test sets the rate of a timer, counts its ticks and\n"
+			"checks they came at about that rate.  It then stops the timer\n"
+			"and starts it again, both right away and after a while, and\n"
+			"checks that it ticks again.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	timer = ast_timer_open();
+	ast_test_validate(test, timer != NULL);
+	ast_test_status_update(test, "Using the '%s' timing module\n", ast_timer_get_name(timer));
+
+	ast_test_validate(test, !ast_timer_set_rate(timer, TEST_RATE));
+	start = ast_tvnow();
+	for (ticks = 0; ticks < TEST_TICKS; ++ticks) {
+		if (timer_wait(timer, 1000) != 1) {
+			ast_test_status_update(test, "Timer stopped after %d ticks\n", ticks);
+			return AST_TEST_FAIL;
+		}
+		ast_test_validate(test, !ast_timer_ack(timer, 1));
+	}
+	elapsed = ast_tvdiff_ms(ast_tvnow(), start);
+
+	/* The first tick may come early, the rest one interval apart */
+	if (elapsed < (TEST_TICKS - 2) * 1000 / TEST_RATE || elapsed > 2 * TEST_TICKS * 1000 / TEST_RATE) {
+		ast_test_status_update(test, "%d ticks took %" PRId64 " ms\n", TEST_TICKS, elapsed);
+		return AST_TEST_FAIL;
+	}
+
+	/* Stopped and started again right away, as when a prompt follows another */
+	ast_test_validate(test, !ast_timer_set_rate(timer, 0));
+	timer_drain(timer);
+	ast_test_validate(test, !ast_timer_set_rate(timer, TEST_RATE));
+	if (timer_wait(timer, 1000) != 1) {
+		ast_test_status_update(test, "Timer did not tick after it was started again\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* A stopped timer must not tick */
+	ast_test_validate(test, !ast_timer_set_rate(timer, 0));
+	timer_drain(timer);
+	if (timer_wait(timer, 100)) {
+		ast_test_status_update(test, "Timer ticked without a rate\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* And it ticks again once the timing module has gone idle */
+	ast_test_validate(test, !ast_timer_set_rate(timer, TEST_RATE));
+	if (timer_wait(timer, 1000) != 1) {
+		ast_test_status_update(test, "Timer did not tick after it was idle\n");
+		return AST_TEST_FAIL;
+	}
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(timer_continuous)
+{
+	RAII_VAR(struct ast_timer *, timer, NULL, safe_timer_close);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test the continuous mode of a timer";
+		info->description =
+			"This test puts a timer without a rate in continuous mode and\n"
+			"checks that it is readable and reports a continuous event,\n"
+			"and that it is neither once continuous mode is turned off.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	timer = ast_timer_open();
+	ast_test_validate(test, timer != NULL);
+	ast_test_status_update(test, "Using the '%s' timing module\n", ast_timer_get_name(timer));
+
+	ast_test_validate(test, !ast_timer_enable_continuous(timer));
+	if (timer_wait(timer, 100) != 1) {
+		ast_test_status_update(test, "Timer is not readable in continuous mode\n");
+		return AST_TEST_FAIL;
+	}
+	ast_test_validate(test, ast_timer_get_event(timer) == AST_TIMING_EVENT_CONTINUOUS);
+
+	ast_test_validate(test, !ast_timer_disable_continuous(timer));
+	ast_test_validate(test, ast_timer_get_event(timer) == AST_TIMING_EVENT_EXPIRED);
+	if (timer_wait(timer, 100)) {
+		ast_test_status_update(test, "Timer is still readable after continuous mode\n");
+		return AST_TEST_FAIL;
+	}
+
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(timer_rate);
+	AST_TEST_UNREGISTER(timer_continuous);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(timer_rate);
+	AST_TEST_REGISTER(timer_continuous);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Timing API Unit Tests");
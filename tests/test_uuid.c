@@ -29,6 +29,10 @@
 #include "asterisk/test.h"
 #include "asterisk/uuid.h"
 #include "asterisk/module.h"
+#include "asterisk/utils.h"
+
+/*! Number of UUIDs generated by the random test */
+#define RANDOM_UUIDS 10000
 
 AST_TEST_DEFINE(uuid)
 {
@@ -137,15 +141,121 @@ end:
 	return res;
 }
 
+static int uuid_str_cmp(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+AST_TEST_DEFINE(uuid_random)
+{
+	char (*uuids)[AST_UUID_STR_LEN];
+	unsigned char bytes[100];
+	unsigned char zero[sizeof(bytes)] = { 0, };
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "random";
+		info->category = "/main/uuid/";
+		info->summary = "Random UUID generation";
+		info->description =
+			"Generate many UUIDs and check they are all version 4 with the\n"
+			"RFC 4122 variant, and that none is repeated.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (ast_random_bytes(bytes, sizeof(bytes))) {
+		ast_test_status_update(test, "Failed to get random bytes\n");
+		return AST_TEST_FAIL;
+	}
+	if (!memcmp(bytes, zero, sizeof(bytes))) {
+		ast_test_status_update(test, "Random bytes are all zero\n");
+		return AST_TEST_FAIL;
+	}
+
+	uuids = ast_malloc(RANDOM_UUIDS * sizeof(*uuids));
+	if (!uuids) {
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < RANDOM_UUIDS; ++i) {
+		ast_uuid_generate_str(uuids[i], sizeof(uuids[i]));
+		if (uuids[i][14] != '4' || !strchr("89ab", uuids[i][19])) {
+			ast_test_status_update(test, "UUID %s is not a random RFC 4122 UUID\n", uuids[i]);
+			goto end;
+		}
+	}
+
+	qsort(uuids, RANDOM_UUIDS, sizeof(*uuids), uuid_str_cmp);
+	for (i = 1; i < RANDOM_UUIDS; ++i) {
+		if (!strcmp(uuids[i - 1], uuids[i])) {
+			ast_test_status_update(test, "UUID %s was generated twice\n", uuids[i]);
+			goto end;
+		}
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	ast_free(uuids);
+	return res;
+}
+
+static int generate_str_op(void *data, unsigned int iteration)
+{
+	char uuid_str[AST_UUID_STR_LEN];
+
+	ast_uuid_generate_str(uuid_str, sizeof(uuid_str));
+	return uuid_str[14] != '4';
+}
+
+AST_BENCH_DEFINE(uuid_generate_str)
+{
+	bench->name = "generate_str";
+	bench->category = "/bench/uuid/";
+	bench->summary = "Generate a UUID as a string";
+	bench->description = "Generate a random UUID with ast_uuid_generate_str(),\n"
+		"as is done for every channel, bridge and Stasis message.";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->op = generate_str_op;
+}
+
+static int random_op(void *data, unsigned int iteration)
+{
+	return ast_random() < 0;
+}
+
+AST_BENCH_DEFINE(uuid_ast_random)
+{
+	bench->name = "ast_random";
+	bench->category = "/bench/uuid/";
+	bench->summary = "Get a random number with ast_random()";
+	bench->description = "Get a random number from the per-thread generator\n"
+		"that UUIDs are also generated from.";
+	bench->iterations = 1000000;
+	bench->batch = 100;
+	bench->op = random_op;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(uuid);
+	AST_TEST_UNREGISTER(uuid_random);
+	AST_TEST_UNREGISTER(uuid_generate_str);
+	AST_TEST_UNREGISTER(uuid_ast_random);
 	return 0;
 }
 
 static int load_module(void)
 {
 	AST_TEST_REGISTER(uuid);
+	AST_TEST_REGISTER(uuid_random);
+	AST_TEST_REGISTER(uuid_generate_str);
+	AST_TEST_REGISTER(uuid_ast_random);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
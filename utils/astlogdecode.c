@@ -0,0 +1,269 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2016, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ *
+ * \brief A utility for turning binary log files into text
+ *
+ * Log channels with the [binary] formatter in logger.conf keep the format
+ * string and arguments of each message rather than its text. This reads such
+ * a file and writes the messages as a log file with the default formatter
+ * would have had them.
+ */
+
+/*** MODULEINFO
+	<support_level>extended</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asterisk/logger_binary.h"
+
+/*! \brief The strings of the session being read, by id */
+static char **strings;
+static uint32_t strings_size;
+
+/*! \brief The date format of the messages */
+static const char *dateformat = "%b %e %T";
+
+/*! \brief Whether to show the line and function of each message */
+static int show_location;
+
+/* The date format is given on the command line, so is not a literal the compiler can check */
+static size_t (*format_date)(char *s, size_t max, const char *format, const struct tm *tm) = strftime;
+
+void __ast_register_file(const char *file);
+void __ast_register_file(const char *file)
+{
+}
+
+void __ast_unregister_file(const char *file);
+void __ast_unregister_file(const char *file)
+{
+}
+
+static void strings_reset(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < strings_size; ++i) {
+		free(strings[i]);
+		strings[i] = NULL;
+	}
+}
+
+static const char *string_get(uint32_t id)
+{
+	return id < strings_size && strings[id] ? strings[id] : "?";
+}
+
+static int string_define(const unsigned char *payload, uint32_t len)
+{
+	uint32_t id;
+	char *text;
+
+	if (len < 4) {
+		return -1;
+	}
+	id = ast_logb_get_u32(payload);
+
+	if (id >= strings_size) {
+		uint32_t size = id + 256;
+		char **grown = realloc(strings, size * sizeof(*strings));
+
+		if (!grown) {
+			return -1;
+		}
+		memset(grown + strings_size, 0, (size - strings_size) * sizeof(*strings));
+		strings = grown;
+		strings_size = size;
+	}
+
+	text = malloc(len - 4 + 1);
+	if (!text) {
+		return -1;
+	}
+	memcpy(text, payload + 4, len - 4);
+	text[len - 4] = '\0';
+
+	free(strings[id]);
+	strings[id] = text;
+	return 0;
+}
+
+static int message_print(const unsigned char *payload, uint32_t len)
+{
+	static char message[BUFSIZ];
+	char date[256];
+	char callid[16] = "";
+	struct tm tm;
+	time_t when;
+	uint32_t fmt_id;
+	uint32_t body_len;
+	const unsigned char *body;
+
+	if (len < AST_LOGB_MESSAGE_HEADER) {
+		return -1;
+	}
+	body = payload + AST_LOGB_MESSAGE_HEADER;
+	body_len = len - AST_LOGB_MESSAGE_HEADER;
+
+	fmt_id = ast_logb_get_u32(payload + 36);
+	if (!fmt_id) {
+		/* Kept as text */
+		if (body_len > sizeof(message) - 1) {
+			body_len = sizeof(message) - 1;
+		}
+		memcpy(message, body, body_len);
+		message[body_len] = '\0';
+	} else if (ast_logb_render(message, sizeof(message), string_get(fmt_id), body, body_len) < 0) {
+		snprintf(message, sizeof(message), "<arguments do not match '%s'>\n", string_get(fmt_id));
+	}
+
+	when = ast_logb_get_u64(payload);
+	localtime_r(&when, &tm);
+	format_date(date, sizeof(date), dateformat, &tm);
+
+	if (ast_logb_get_u32(payload + 20)) {
+		snprintf(callid, sizeof(callid), "[C-%08x]", ast_logb_get_u32(payload + 20));
+	}
+
+	if (show_location) {
+		printf("[%s.%06u] %s[%u]%s %s:%u %s: %s", date, ast_logb_get_u32(payload + 8),
+			string_get(ast_logb_get_u32(payload + 12)), ast_logb_get_u32(payload + 16), callid,
+			string_get(ast_logb_get_u32(payload + 24)), ast_logb_get_u32(payload + 28),
+			string_get(ast_logb_get_u32(payload + 32)), message);
+	} else {
+		printf("[%s] %s[%u]%s %s: %s", date,
+			string_get(ast_logb_get_u32(payload + 12)), ast_logb_get_u32(payload + 16), callid,
+			string_get(ast_logb_get_u32(payload + 24)), message);
+	}
+	return 0;
+}
+
+static int decode(FILE *in, const char *name)
+{
+	unsigned char *payload = NULL;
+	uint32_t payload_size = 0;
+	unsigned char header[AST_LOGB_RECORD_HEADER];
+	int res = 0;
+
+	while (fread(header, sizeof(header), 1, in) == 1) {
+		uint32_t len = ast_logb_get_u32(header + 1);
+
+		if (len > payload_size) {
+			unsigned char *grown = realloc(payload, len);
+
+			if (!grown) {
+				fprintf(stderr, "%s: Out of memory\n", name);
+				res = -1;
+				break;
+			}
+			payload = grown;
+			payload_size = len;
+		}
+		if (len && fread(payload, len, 1, in) != 1) {
+			fprintf(stderr, "%s: Truncated record\n", name);
+			res = -1;
+			break;
+		}
+
+		switch (header[0]) {
+		case AST_LOGB_RECORD_SESSION:
+			if (len < strlen(AST_LOGB_MAGIC) || memcmp(payload, AST_LOGB_MAGIC, strlen(AST_LOGB_MAGIC))) {
+				fprintf(stderr, "%s: Not a binary log file\n", name);
+				res = -1;
+				goto done;
+			}
+			strings_reset();
+			fwrite(payload + strlen(AST_LOGB_MAGIC), len - strlen(AST_LOGB_MAGIC), 1, stdout);
+			break;
+		case AST_LOGB_RECORD_STRING:
+			if (string_define(payload, len)) {
+				fprintf(stderr, "%s: Bad string record\n", name);
+				res = -1;
+				goto done;
+			}
+			break;
+		case AST_LOGB_RECORD_MESSAGE:
+			if (message_print(payload, len)) {
+				fprintf(stderr, "%s: Bad message record\n", name);
+				res = -1;
+				goto done;
+			}
+			break;
+		default:
+			/* Records of types added later are skipped */
+			break;
+		}
+	}
+
+done:
+	free(payload);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	int res = 0;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "d:lh")) != -1) {
+		switch (opt) {
+		case 'd':
+			dateformat = optarg;
+			break;
+		case 'l':
+			show_location = 1;
+			break;
+		default:
+			fprintf(stderr, "astlogdecode -- Turn binary Asterisk log files into text.\n\n");
+			fprintf(stderr, "Usage: astlogdecode [-d <date format>] [-l] [<file>...]\n");
+			fprintf(stderr, "  -d  The strftime format of dates; the default is '%%b %%e %%T'\n");
+			fprintf(stderr, "  -l  Show microseconds, and the line and function of each message\n");
+			fprintf(stderr, "Reads standard input if no file is given.\n");
+			exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (optind == argc) {
+		return decode(stdin, "stdin") ? 1 : 0;
+	}
+
+	for (i = optind; i < argc; ++i) {
+		FILE *in = fopen(argv[i], "r");
+
+		if (!in) {
+			fprintf(stderr, "Unable to open '%s'\n", argv[i]);
+			res = 1;
+			continue;
+		}
+		if (decode(in, argv[i])) {
+			res = 1;
+		}
+		fclose(in);
+	}
+
+	return res;
+}